@@ -0,0 +1,50 @@
+@echo off
+rem Profile-guided optimization: builds the PGInstrument configuration, trains it on the
+rem canonical traces and builds the PGOptimize configuration from the profile it wrote.
+rem   pgo.cmd [Project3^|Benchmark] [frames]
+rem Every traces\<session>.p3pt there is replayed for that many frames (pgo.train in
+rem main.cpp). Project3 is the shipped app and trains with the headset connected, though
+rem nobody needs to wear it, the traces drive the head and hands; Benchmark trains headless.
+rem Run it from a Visual Studio developer prompt, msbuild, pgomgr and pgort140.dll come from
+rem there. The optimized build ends up in x64\PGOptimize.
+setlocal
+set TARGET=%1
+if "%TARGET%"=="" set TARGET=Project3
+set FRAMES=%2
+if "%FRAMES%"=="" set FRAMES=3000
+set SOLUTION=%~dp0..\Project3.sln
+set OUT=%~dp0..\x64
+set TRACES=
+for %%s in (static sweep controller wireframes) do (
+	if exist "%~dp0traces\%%s.p3pt" call :addtrace "%~dp0traces\%%s.p3pt"
+)
+if "%TRACES%"=="" (
+	echo no traces in %~dp0traces to train on
+	exit /b 1
+)
+
+msbuild "%SOLUTION%" /m /t:%TARGET% /p:Configuration=PGInstrument /p:Platform=x64
+if errorlevel 1 exit /b 1
+rem Counts of an earlier training would be merged in with this one's
+del /q "%OUT%\PGInstrument\%TARGET%*.pgc" "%OUT%\%TARGET%*.pgc" 2>nul
+rem The shaders and assets are found relative to the app's project directory
+pushd %~dp0..\Project3
+"%OUT%\PGInstrument\%TARGET%.exe" "--pgo.train=%TRACES%" --pgo.frames=%FRAMES%
+set RESULT=%ERRORLEVEL%
+popd
+if not %RESULT%==0 (
+	echo training run failed
+	exit /b 1
+)
+for %%f in ("%OUT%\PGInstrument\%TARGET%*.pgc" "%OUT%\%TARGET%*.pgc") do (
+	pgomgr /merge "%%f" "%OUT%\%TARGET%.pgd" && del "%%f"
+)
+
+msbuild "%SOLUTION%" /m /t:%TARGET% /p:Configuration=PGOptimize /p:Platform=x64
+if errorlevel 1 exit /b 1
+echo %OUT%\PGOptimize\%TARGET%.exe is optimized for the traces
+exit /b 0
+
+:addtrace
+if "%TRACES%"=="" (set TRACES=%~1) else (set TRACES=%TRACES%,%~1)
+exit /b 0
@@ -0,0 +1,31 @@
+@echo off
+rem Frame time regression check: runs each canonical benchmark session and compares its
+rem CPU, GPU and frame time percentiles with baselines.csv. Fails if any session regressed.
+rem   regression.cmd [Debug^|Release] [update]
+rem "update" measures the baselines again instead. A session replays traces\<session>.p3pt
+rem when that trace exists, so recorded head and hand motion can stand in for the synthetic.
+setlocal
+set CONFIGURATION=%1
+if "%CONFIGURATION%"=="" set CONFIGURATION=Release
+set EXE=%~dp0..\x64\%CONFIGURATION%\Benchmark.exe
+set BASELINE=%~dp0baselines.csv
+set EXTRA=
+if "%2"=="update" set EXTRA=--benchmark.update_baseline
+rem The shaders and assets are found relative to the app's project directory
+pushd %~dp0..\Project3
+set FAILED=0
+for %%s in (static sweep controller wireframes) do (
+	if exist "%~dp0traces\%%s.p3pt" (
+		"%EXE%" --benchmark.session=%%s --benchmark.baseline="%BASELINE%" --trace.replay="%~dp0traces\%%s.p3pt" %EXTRA%
+	) else (
+		"%EXE%" --benchmark.session=%%s --benchmark.baseline="%BASELINE%" %EXTRA%
+	)
+	if errorlevel 1 set FAILED=1
+)
+popd
+if %FAILED%==1 (
+	echo frame time regression check failed
+	exit /b 1
+)
+echo frame time regression check passed
+exit /b 0
@@ -0,0 +1,29 @@
+@echo off
+rem Soak test: runs a benchmark session for hours and fails if memory, handles, GL objects
+rem or the frame time kept growing (soak.* in main.cpp's benchmark RiftApp).
+rem   soak.cmd [Debug^|Release] [minutes] [session]
+rem A session replays traces\<session>.p3pt in a loop when that trace exists. The samples
+rem go to soak_<session>.csv next to this script.
+setlocal
+set CONFIGURATION=%1
+if "%CONFIGURATION%"=="" set CONFIGURATION=Release
+set MINUTES=%2
+if "%MINUTES%"=="" set MINUTES=240
+set SESSION=%3
+if "%SESSION%"=="" set SESSION=sweep
+set EXE=%~dp0..\x64\%CONFIGURATION%\Benchmark.exe
+rem The shaders and assets are found relative to the app's project directory
+pushd %~dp0..\Project3
+if exist "%~dp0traces\%SESSION%.p3pt" (
+	"%EXE%" --benchmark.session=%SESSION% --soak.minutes=%MINUTES% --soak.csv="%~dp0soak_%SESSION%.csv" --trace.replay="%~dp0traces\%SESSION%.p3pt" --trace.loop
+) else (
+	"%EXE%" --benchmark.session=%SESSION% --soak.minutes=%MINUTES% --soak.csv="%~dp0soak_%SESSION%.csv"
+)
+set RESULT=%ERRORLEVEL%
+popd
+if not %RESULT%==0 (
+	echo soak test failed
+	exit /b 1
+)
+echo soak test passed
+exit /b 0
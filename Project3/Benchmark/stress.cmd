@@ -0,0 +1,41 @@
+@echo off
+rem Scaling sweep of the synthetic stress scene (StressScene.h): runs the benchmark along each
+rem axis in turn, the other three at the base below, and prints what each prop, image, wall
+rem and viewer costs in CPU and GPU time.
+rem   stress.cmd [Debug^|Release] [frames]
+rem The runs go to stress.csv next to this script, which keeps the earlier sweeps' points.
+setlocal
+set CONFIGURATION=%1
+if "%CONFIGURATION%"=="" set CONFIGURATION=Release
+set FRAMES=%2
+if "%FRAMES%"=="" set FRAMES=500
+set EXE=%~dp0..\x64\%CONFIGURATION%\Benchmark.exe
+set CSV=%~dp0stress.csv
+set RUN="%EXE%" --benchmark.session=sweep --benchmark.frames=%FRAMES% --benchmark.stress_csv="%CSV%"
+rem The shaders and assets are found relative to the app's project directory
+pushd %~dp0..\Project3
+set FAILED=0
+for %%n in (250 1000 4000 16000) do (
+	%RUN% --stress.props=%%n --stress.textures=16 --stress.walls=3 --stress.viewers=1
+	if errorlevel 1 set FAILED=1
+)
+for %%n in (1 64 256) do (
+	%RUN% --stress.props=1000 --stress.textures=%%n --stress.walls=3 --stress.viewers=1
+	if errorlevel 1 set FAILED=1
+)
+for %%n in (1 2 4 6 8) do (
+	%RUN% --stress.props=1000 --stress.textures=16 --stress.walls=%%n --stress.viewers=1
+	if errorlevel 1 set FAILED=1
+)
+rem Every viewer has a layer per eye and wall, 32 in all: four viewers of three walls fit
+for %%n in (2 3 4) do (
+	%RUN% --stress.props=1000 --stress.textures=16 --stress.walls=3 --stress.viewers=%%n
+	if errorlevel 1 set FAILED=1
+)
+popd
+if %FAILED%==1 (
+	echo stress sweep failed
+	exit /b 1
+)
+echo stress sweep done, the scaling is printed after each run
+exit /b 0
@@ -0,0 +1,493 @@
+#include "ModelImport.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+// Just enough JSON for a glTF document: every value is parsed, numbers as doubles
+struct JsonValue
+{
+	enum Type { NUL, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT };
+	Type type = NUL;
+	double number = 0.0;
+	std::string string;
+	std::vector<JsonValue> items;
+	std::vector<std::pair<std::string, JsonValue>> members;
+
+	const JsonValue* get(const char* key) const
+	{
+		for (const auto& member : members) {
+			if (member.first == key) {
+				return &member.second;
+			}
+		}
+		return nullptr;
+	}
+	const JsonValue* at(size_t index) const { return type == ARRAY && index < items.size() ? &items[index] : nullptr; }
+	int integer(const char* key, int fallback) const
+	{
+		const JsonValue* value = get(key);
+		return value && value->type == NUMBER ? (int)value->number : fallback;
+	}
+};
+
+class JsonParser
+{
+public:
+	JsonParser(const char* begin, const char* end) : pos(begin), end(end) {}
+
+	bool parse(JsonValue& value)
+	{
+		return parseValue(value, 0) && (skipSpace(), pos == end);
+	}
+
+private:
+	void skipSpace()
+	{
+		while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == '\n' || *pos == '\r')) {
+			pos++;
+		}
+	}
+
+	bool literal(const char* word)
+	{
+		size_t n = strlen(word);
+		if ((size_t)(end - pos) < n || memcmp(pos, word, n) != 0) {
+			return false;
+		}
+		pos += n;
+		return true;
+	}
+
+	bool parseString(std::string& out)
+	{
+		pos++;
+		while (pos < end && *pos != '"') {
+			if (*pos == '\\') {
+				if (++pos == end) {
+					return false;
+				}
+				switch (*pos) {
+				case 'n': out += '\n'; break;
+				case 't': out += '\t'; break;
+				case 'r': out += '\r'; break;
+				case 'b': out += '\b'; break;
+				case 'f': out += '\f'; break;
+				case 'u': {
+					if (end - pos < 5) {
+						return false;
+					}
+					unsigned code = (unsigned)strtoul(std::string(pos + 1, pos + 5).c_str(), nullptr, 16);
+					// Names and URIs only, anything past ASCII is kept as UTF-8
+					if (code < 0x80) {
+						out += (char)code;
+					}
+					else if (code < 0x800) {
+						out += (char)(0xc0 | (code >> 6));
+						out += (char)(0x80 | (code & 0x3f));
+					}
+					else {
+						out += (char)(0xe0 | (code >> 12));
+						out += (char)(0x80 | ((code >> 6) & 0x3f));
+						out += (char)(0x80 | (code & 0x3f));
+					}
+					pos += 4;
+					break;
+				}
+				default: out += *pos; break;
+				}
+				pos++;
+			}
+			else {
+				out += *pos++;
+			}
+		}
+		if (pos == end) {
+			return false;
+		}
+		pos++;
+		return true;
+	}
+
+	bool parseValue(JsonValue& value, int depth)
+	{
+		skipSpace();
+		if (pos == end || depth > 64) {
+			return false;
+		}
+		if (*pos == '{') {
+			value.type = JsonValue::OBJECT;
+			pos++;
+			skipSpace();
+			if (pos < end && *pos == '}') {
+				pos++;
+				return true;
+			}
+			while (true) {
+				skipSpace();
+				if (pos == end || *pos != '"') {
+					return false;
+				}
+				value.members.emplace_back();
+				if (!parseString(value.members.back().first)) {
+					return false;
+				}
+				skipSpace();
+				if (pos == end || *pos++ != ':' || !parseValue(value.members.back().second, depth + 1)) {
+					return false;
+				}
+				skipSpace();
+				if (pos < end && *pos == ',') {
+					pos++;
+					continue;
+				}
+				if (pos < end && *pos == '}') {
+					pos++;
+					return true;
+				}
+				return false;
+			}
+		}
+		if (*pos == '[') {
+			value.type = JsonValue::ARRAY;
+			pos++;
+			skipSpace();
+			if (pos < end && *pos == ']') {
+				pos++;
+				return true;
+			}
+			while (true) {
+				value.items.emplace_back();
+				if (!parseValue(value.items.back(), depth + 1)) {
+					return false;
+				}
+				skipSpace();
+				if (pos < end && *pos == ',') {
+					pos++;
+					continue;
+				}
+				if (pos < end && *pos == ']') {
+					pos++;
+					return true;
+				}
+				return false;
+			}
+		}
+		if (*pos == '"') {
+			value.type = JsonValue::STRING;
+			return parseString(value.string);
+		}
+		if (literal("true")) {
+			value.type = JsonValue::BOOLEAN;
+			value.number = 1.0;
+			return true;
+		}
+		if (literal("false")) {
+			value.type = JsonValue::BOOLEAN;
+			return true;
+		}
+		if (literal("null")) {
+			return true;
+		}
+		// strtod stops at the end of the number, the document is not null terminated though
+		std::string number;
+		while (pos < end && *pos && strchr("+-0123456789.eE", *pos)) {
+			number += *pos++;
+		}
+		char* stop;
+		value.type = JsonValue::NUMBER;
+		value.number = strtod(number.c_str(), &stop);
+		return !number.empty() && *stop == 0;
+	}
+
+	const char* pos;
+	const char* end;
+};
+
+static bool readFile(const std::string& filename, std::vector<unsigned char>& data)
+{
+	std::ifstream in(filename.c_str(), std::ios::binary);
+	if (!in) {
+		return false;
+	}
+	data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	return true;
+}
+
+static bool decodeBase64(const std::string& text, size_t start, std::vector<unsigned char>& out)
+{
+	uint32_t bits = 0;
+	int count = 0;
+	for (size_t i = start; i < text.size() && text[i] != '='; i++) {
+		char c = text[i];
+		int v;
+		if (c >= 'A' && c <= 'Z') v = c - 'A';
+		else if (c >= 'a' && c <= 'z') v = c - 'a' + 26;
+		else if (c >= '0' && c <= '9') v = c - '0' + 52;
+		else if (c == '+') v = 62;
+		else if (c == '/') v = 63;
+		else return false;
+		bits = (bits << 6) | (uint32_t)v;
+		count += 6;
+		if (count >= 8) {
+			count -= 8;
+			out.push_back((unsigned char)(bits >> count));
+		}
+	}
+	return true;
+}
+
+static std::string directoryOf(const std::string& path)
+{
+	size_t slash = path.find_last_of("/\\");
+	return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+}
+
+// The document and its buffers, loaded up front
+struct GltfDocument
+{
+	JsonValue json;
+	std::vector<std::vector<unsigned char>> buffers;
+};
+
+// An accessor's elements as floats, with normalized integers scaled the way the glTF
+// spec says. components is how many of each element the caller wants.
+static bool readAccessor(const GltfDocument& doc, int index, int components, std::vector<float>& out, std::string& error)
+{
+	const JsonValue* accessors = doc.json.get("accessors");
+	const JsonValue* accessor = accessors ? accessors->at((size_t)index) : nullptr;
+	if (!accessor) {
+		error = "missing accessor " + std::to_string(index);
+		return false;
+	}
+	const JsonValue* type = accessor->get("type");
+	int width = !type ? 0 : type->string == "SCALAR" ? 1 : type->string == "VEC2" ? 2 : type->string == "VEC3" ? 3 :
+		type->string == "VEC4" ? 4 : 0;
+	int componentType = accessor->integer("componentType", 0);
+	size_t count = (size_t)accessor->integer("count", 0);
+	const JsonValue* normalizedValue = accessor->get("normalized");
+	bool normalized = normalizedValue && normalizedValue->number != 0.0;
+	int size = componentType == 5120 || componentType == 5121 ? 1 : componentType == 5122 || componentType == 5123 ? 2 :
+		componentType == 5125 || componentType == 5126 ? 4 : 0;
+	if (width < components || size == 0) {
+		error = "accessor " + std::to_string(index) + " has an unsupported type";
+		return false;
+	}
+
+	out.assign(count * components, 0.f);
+	// An accessor without a buffer view is all zeros
+	int viewIndex = accessor->integer("bufferView", -1);
+	if (viewIndex < 0) {
+		return true;
+	}
+	const JsonValue* views = doc.json.get("bufferViews");
+	const JsonValue* view = views ? views->at((size_t)viewIndex) : nullptr;
+	int bufferIndex = view ? view->integer("buffer", -1) : -1;
+	if (bufferIndex < 0 || (size_t)bufferIndex >= doc.buffers.size()) {
+		error = "accessor " + std::to_string(index) + " has no buffer";
+		return false;
+	}
+	const std::vector<unsigned char>& buffer = doc.buffers[bufferIndex];
+	size_t offset = (size_t)view->integer("byteOffset", 0) + (size_t)accessor->integer("byteOffset", 0);
+	size_t stride = (size_t)view->integer("byteStride", 0);
+	if (!stride) {
+		stride = (size_t)width * size;
+	}
+	if (count && offset + stride * (count - 1) + (size_t)width * size > buffer.size()) {
+		error = "accessor " + std::to_string(index) + " runs past its buffer";
+		return false;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		const unsigned char* element = buffer.data() + offset + stride * i;
+		for (int c = 0; c < components; c++) {
+			const unsigned char* p = element + c * size;
+			float v = 0.f;
+			switch (componentType) {
+			case 5120: { int8_t x; memcpy(&x, p, 1); v = normalized ? std::max(x / 127.f, -1.f) : x; break; }
+			case 5121: { uint8_t x = *p; v = normalized ? x / 255.f : x; break; }
+			case 5122: { int16_t x; memcpy(&x, p, 2); v = normalized ? std::max(x / 32767.f, -1.f) : x; break; }
+			case 5123: { uint16_t x; memcpy(&x, p, 2); v = normalized ? x / 65535.f : x; break; }
+			case 5125: { uint32_t x; memcpy(&x, p, 4); v = (float)x; break; }
+			case 5126: memcpy(&v, p, 4); break;
+			}
+			out[i * components + c] = v;
+		}
+	}
+	return true;
+}
+
+// Indices are read separately, floats cannot hold every 32 bit index
+static bool readIndices(const GltfDocument& doc, int index, uint32_t base, std::vector<uint32_t>& out, std::string& error)
+{
+	const JsonValue* accessors = doc.json.get("accessors");
+	const JsonValue* accessor = accessors ? accessors->at((size_t)index) : nullptr;
+	const JsonValue* views = doc.json.get("bufferViews");
+	int viewIndex = accessor ? accessor->integer("bufferView", -1) : -1;
+	const JsonValue* view = views && viewIndex >= 0 ? views->at((size_t)viewIndex) : nullptr;
+	int bufferIndex = view ? view->integer("buffer", -1) : -1;
+	if (bufferIndex < 0 || (size_t)bufferIndex >= doc.buffers.size()) {
+		error = "bad index accessor " + std::to_string(index);
+		return false;
+	}
+	int componentType = accessor->integer("componentType", 0);
+	size_t size = componentType == 5121 ? 1 : componentType == 5123 ? 2 : componentType == 5125 ? 4 : 0;
+	size_t count = (size_t)accessor->integer("count", 0);
+	size_t offset = (size_t)view->integer("byteOffset", 0) + (size_t)accessor->integer("byteOffset", 0);
+	const std::vector<unsigned char>& buffer = doc.buffers[bufferIndex];
+	if (!size || offset + size * count > buffer.size()) {
+		error = "bad index accessor " + std::to_string(index);
+		return false;
+	}
+	for (size_t i = 0; i < count; i++) {
+		uint32_t v = 0;
+		memcpy(&v, buffer.data() + offset + size * i, size);
+		out.push_back(base + v);
+	}
+	return true;
+}
+
+static bool loadDocument(const std::string& filename, GltfDocument& doc, std::string& error)
+{
+	std::vector<unsigned char> file;
+	if (!readFile(filename, file)) {
+		error = "cannot open " + filename;
+		return false;
+	}
+
+	// A .glb is a 12 byte header, the JSON chunk and an optional binary chunk for buffer 0
+	const unsigned char* json = file.data();
+	size_t jsonSize = file.size();
+	std::vector<unsigned char> binary;
+	if (file.size() >= 20 && memcmp(file.data(), "glTF", 4) == 0) {
+		uint32_t chunkSize, chunkType;
+		memcpy(&chunkSize, &file[12], 4);
+		memcpy(&chunkType, &file[16], 4);
+		if (chunkType != 0x4e4f534a || 20 + (size_t)chunkSize > file.size()) {
+			error = filename + " has no JSON chunk";
+			return false;
+		}
+		json = &file[20];
+		jsonSize = chunkSize;
+		size_t next = 20 + (size_t)chunkSize;
+		if (next + 8 <= file.size()) {
+			memcpy(&chunkSize, &file[next], 4);
+			memcpy(&chunkType, &file[next + 4], 4);
+			if (chunkType == 0x004e4942 && next + 8 + (size_t)chunkSize <= file.size()) {
+				binary.assign(file.begin() + next + 8, file.begin() + next + 8 + chunkSize);
+			}
+		}
+	}
+
+	JsonParser parser((const char*)json, (const char*)json + jsonSize);
+	if (!parser.parse(doc.json) || doc.json.type != JsonValue::OBJECT) {
+		error = filename + " is not valid JSON";
+		return false;
+	}
+
+	const JsonValue* buffers = doc.json.get("buffers");
+	for (size_t i = 0; buffers && i < buffers->items.size(); i++) {
+		doc.buffers.emplace_back();
+		const JsonValue* uri = buffers->items[i].get("uri");
+		if (!uri) {
+			doc.buffers.back().swap(binary);
+		}
+		else if (uri->string.compare(0, 5, "data:") == 0) {
+			size_t comma = uri->string.find(";base64,");
+			if (comma == std::string::npos || !decodeBase64(uri->string, comma + 8, doc.buffers.back())) {
+				error = "buffer " + std::to_string(i) + " has an unsupported data URI";
+				return false;
+			}
+		}
+		else if (!readFile(directoryOf(filename) + uri->string, doc.buffers.back())) {
+			error = "cannot open buffer " + uri->string;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool importGltf(const std::string& filename, ImportedModel& model, std::string& error)
+{
+	GltfDocument doc;
+	if (!loadDocument(filename, doc, error)) {
+		return false;
+	}
+
+	const JsonValue* meshes = doc.json.get("meshes");
+	bool allNormals = true;
+	std::vector<float> positions, normals, uvs;
+	for (size_t m = 0; meshes && m < meshes->items.size(); m++) {
+		const JsonValue* primitives = meshes->items[m].get("primitives");
+		for (size_t p = 0; primitives && p < primitives->items.size(); p++) {
+			const JsonValue& primitive = primitives->items[p];
+			// Triangle lists only, the default mode
+			if (primitive.integer("mode", 4) != 4) {
+				continue;
+			}
+			const JsonValue* attributes = primitive.get("attributes");
+			int position = attributes ? attributes->integer("POSITION", -1) : -1;
+			if (position < 0) {
+				continue;
+			}
+			if (!readAccessor(doc, position, 3, positions, error)) {
+				return false;
+			}
+			size_t count = positions.size() / 3;
+			uint32_t base = (uint32_t)model.vertexCount();
+
+			int normal = attributes->integer("NORMAL", -1);
+			allNormals = allNormals && normal >= 0;
+			if (normal < 0) {
+				normals.assign(count * 3, 0.f);
+			}
+			else if (!readAccessor(doc, normal, 3, normals, error)) {
+				return false;
+			}
+			int uv = attributes->integer("TEXCOORD_0", -1);
+			if (uv < 0) {
+				uvs.assign(count * 2, 0.f);
+			}
+			else if (!readAccessor(doc, uv, 2, uvs, error)) {
+				return false;
+			}
+			if (normals.size() != count * 3 || uvs.size() != count * 2) {
+				error = "primitive " + std::to_string(p) + " of mesh " + std::to_string(m) + " has streams of different lengths";
+				return false;
+			}
+			for (size_t i = 0; i < count; i++) {
+				uvs[i * 2 + 1] = 1.f - uvs[i * 2 + 1];
+			}
+			model.positions.insert(model.positions.end(), positions.begin(), positions.end());
+			model.normals.insert(model.normals.end(), normals.begin(), normals.end());
+			model.uvs.insert(model.uvs.end(), uvs.begin(), uvs.end());
+
+			int indices = primitive.integer("indices", -1);
+			size_t firstIndex = model.indices.size();
+			if (indices < 0) {
+				for (uint32_t i = 0; i < (uint32_t)count; i++) {
+					model.indices.push_back(base + i);
+				}
+			}
+			else if (!readIndices(doc, indices, base, model.indices, error)) {
+				return false;
+			}
+			for (size_t i = firstIndex; i < model.indices.size(); i++) {
+				if (model.indices[i] >= base + count) {
+					error = "primitive " + std::to_string(p) + " of mesh " + std::to_string(m) + " indexes past its vertices";
+					return false;
+				}
+			}
+			model.indices.resize(firstIndex + (model.indices.size() - firstIndex) / 3 * 3);
+		}
+	}
+
+	if (model.indices.empty()) {
+		error = "no triangles in " + filename;
+		return false;
+	}
+	model.hasNormals = allNormals;
+	return true;
+}
@@ -0,0 +1,35 @@
+#ifndef _MODEL_IMPORT_H_
+#define _MODEL_IMPORT_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A model read from a source file, as one indexed triangle list with full precision
+// vertex streams. Sources without normals get them from the faces (hasNormals false until
+// then), sources without texture coordinates leave them 0.
+struct ImportedModel
+{
+	std::vector<float> positions;	// 3 per vertex
+	std::vector<float> normals;		// 3 per vertex
+	std::vector<float> uvs;			// 2 per vertex
+	std::vector<uint32_t> indices;
+	bool hasNormals = false;
+
+	size_t vertexCount() const { return positions.size() / 3; }
+};
+
+// Wavefront OBJ: v, vt, vn and f (polygons are fanned into triangles, negative indices
+// count back from the end). Everything else, materials and groups included, is ignored.
+bool importObj(const std::string& filename, ImportedModel& model, std::string& error);
+
+// glTF 2.0, .gltf with its buffers in files next to it or in data URIs, or a binary .glb.
+// Every triangle primitive of every mesh is taken in its own space, node transforms are
+// not applied (export with transforms applied). Texture coordinates are flipped to GL's
+// bottom left origin.
+bool importGltf(const std::string& filename, ImportedModel& model, std::string& error);
+
+// Area weighted face normals for every vertex, for models that came without any
+void computeNormals(ImportedModel& model);
+
+#endif
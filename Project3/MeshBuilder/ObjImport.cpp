@@ -0,0 +1,183 @@
+#include "ModelImport.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+
+// Resolves a 1-based (or negative, from the end) OBJ index into a 0-based one, -1 if bad
+static long resolveIndex(long index, size_t count)
+{
+	if (index > 0 && (size_t)index <= count) {
+		return index - 1;
+	}
+	if (index < 0 && (size_t)-index <= count) {
+		return (long)count + index;
+	}
+	return -1;
+}
+
+// One corner of a face: "v", "v/t", "v//n" or "v/t/n"
+static bool parseCorner(const char* text, size_t positions, size_t uvs, size_t normals, long corner[3])
+{
+	char* end;
+	corner[0] = resolveIndex(strtol(text, &end, 10), positions);
+	corner[1] = corner[2] = -1;
+	if (corner[0] < 0) {
+		return false;
+	}
+	if (*end == '/') {
+		text = end + 1;
+		if (*text != '/') {
+			corner[1] = resolveIndex(strtol(text, &end, 10), uvs);
+			if (corner[1] < 0) {
+				return false;
+			}
+		}
+		else {
+			end = (char*)text;
+		}
+		if (*end == '/') {
+			corner[2] = resolveIndex(strtol(end + 1, &end, 10), normals);
+			if (corner[2] < 0) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool importObj(const std::string& filename, ImportedModel& model, std::string& error)
+{
+	std::ifstream in(filename.c_str());
+	if (!in) {
+		error = "cannot open " + filename;
+		return false;
+	}
+
+	std::vector<float> positions, uvs, normals;
+	// Each distinct position/uv/normal triple becomes one vertex
+	std::unordered_map<uint64_t, uint32_t> vertices;
+	std::vector<uint32_t> face;
+	bool allNormals = true;
+	std::string line;
+	int lineNumber = 0;
+
+	while (std::getline(in, line)) {
+		lineNumber++;
+		const char* text = line.c_str();
+		while (*text == ' ' || *text == '\t') {
+			text++;
+		}
+		float a = 0.f, b = 0.f, c = 0.f;
+		if (strncmp(text, "v ", 2) == 0) {
+			if (sscanf(text + 2, "%f %f %f", &a, &b, &c) != 3) {
+				error = "bad vertex on line " + std::to_string(lineNumber);
+				return false;
+			}
+			positions.insert(positions.end(), { a, b, c });
+		}
+		else if (strncmp(text, "vt ", 3) == 0) {
+			if (sscanf(text + 3, "%f %f", &a, &b) < 1) {
+				error = "bad texture coordinate on line " + std::to_string(lineNumber);
+				return false;
+			}
+			uvs.insert(uvs.end(), { a, b });
+		}
+		else if (strncmp(text, "vn ", 3) == 0) {
+			if (sscanf(text + 3, "%f %f %f", &a, &b, &c) != 3) {
+				error = "bad normal on line " + std::to_string(lineNumber);
+				return false;
+			}
+			normals.insert(normals.end(), { a, b, c });
+		}
+		else if (strncmp(text, "f ", 2) == 0) {
+			face.clear();
+			text += 2;
+			while (*text) {
+				while (*text == ' ' || *text == '\t' || *text == '\r') {
+					text++;
+				}
+				if (!*text) {
+					break;
+				}
+				long corner[3];
+				if (!parseCorner(text, positions.size() / 3, uvs.size() / 2, normals.size() / 3, corner)) {
+					error = "bad face on line " + std::to_string(lineNumber);
+					return false;
+				}
+				allNormals = allNormals && corner[2] >= 0;
+				uint64_t key = ((uint64_t)corner[0] << 42) | ((uint64_t)(corner[1] + 1) << 21) | (uint64_t)(corner[2] + 1);
+				auto found = vertices.find(key);
+				if (found == vertices.end()) {
+					uint32_t index = (uint32_t)model.vertexCount();
+					found = vertices.emplace(key, index).first;
+					model.positions.insert(model.positions.end(), &positions[corner[0] * 3], &positions[corner[0] * 3] + 3);
+					if (corner[1] >= 0) {
+						model.uvs.insert(model.uvs.end(), &uvs[corner[1] * 2], &uvs[corner[1] * 2] + 2);
+					}
+					else {
+						model.uvs.insert(model.uvs.end(), { 0.f, 0.f });
+					}
+					if (corner[2] >= 0) {
+						model.normals.insert(model.normals.end(), &normals[corner[2] * 3], &normals[corner[2] * 3] + 3);
+					}
+					else {
+						model.normals.insert(model.normals.end(), { 0.f, 0.f, 0.f });
+					}
+				}
+				face.push_back(found->second);
+				while (*text && *text != ' ' && *text != '\t' && *text != '\r') {
+					text++;
+				}
+			}
+			for (size_t i = 2; i < face.size(); i++) {
+				model.indices.insert(model.indices.end(), { face[0], face[i - 1], face[i] });
+			}
+		}
+	}
+
+	if (model.indices.empty()) {
+		error = "no faces in " + filename;
+		return false;
+	}
+	// A model with normals on only some faces gets them all computed
+	model.hasNormals = allNormals;
+	return true;
+}
+
+void computeNormals(ImportedModel& model)
+{
+	model.normals.assign(model.positions.size(), 0.f);
+	const float* p = model.positions.data();
+	for (size_t i = 0; i + 2 < model.indices.size(); i += 3) {
+		uint32_t a = model.indices[i], b = model.indices[i + 1], c = model.indices[i + 2];
+		float e1[3], e2[3];
+		for (int axis = 0; axis < 3; axis++) {
+			e1[axis] = p[b * 3 + axis] - p[a * 3 + axis];
+			e2[axis] = p[c * 3 + axis] - p[a * 3 + axis];
+		}
+		// The cross product's length is twice the area, so big faces count for more
+		float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+		for (uint32_t v : { a, b, c }) {
+			for (int axis = 0; axis < 3; axis++) {
+				model.normals[v * 3 + axis] += n[axis];
+			}
+		}
+	}
+	for (size_t v = 0; v < model.vertexCount(); v++) {
+		float* n = &model.normals[v * 3];
+		float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (length > 0.f) {
+			n[0] /= length;
+			n[1] /= length;
+			n[2] /= length;
+		}
+		else {
+			n[2] = 1.f;
+		}
+	}
+	model.hasNormals = true;
+}
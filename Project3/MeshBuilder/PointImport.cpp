@@ -0,0 +1,246 @@
+#include "PointImport.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+static void addPoint(ImportedPoints& points, const double position[3], const int color[3])
+{
+	for (int axis = 0; axis < 3; axis++) {
+		points.positions.push_back((float)position[axis]);
+		points.colors.push_back((uint8_t)std::max(0, std::min(color[axis], 255)));
+	}
+}
+
+bool importXyz(const std::string& filename, ImportedPoints& points, std::string& error)
+{
+	std::ifstream in(filename.c_str());
+	if (!in) {
+		error = "cannot open " + filename;
+		return false;
+	}
+
+	std::string line;
+	while (std::getline(in, line)) {
+		std::replace(line.begin(), line.end(), ',', ' ');
+		const char* text = line.c_str();
+		double position[3];
+		int color[3] = { 255, 255, 255 };
+		char* end = (char*)text;
+		int fields = 0;
+		for (; fields < 3; fields++) {
+			const char* start = end;
+			position[fields] = strtod(start, &end);
+			if (end == start) {
+				break;
+			}
+		}
+		if (fields < 3) {
+			continue;
+		}
+		for (int channel = 0; channel < 3; channel++) {
+			const char* start = end;
+			long value = strtol(start, &end, 10);
+			if (end == start) {
+				// No colours, or not all of them: the point is white
+				color[0] = color[1] = color[2] = 255;
+				break;
+			}
+			color[channel] = (int)value;
+		}
+		addPoint(points, position, color);
+	}
+	if (!points.pointCount()) {
+		error = "no points in " + filename;
+		return false;
+	}
+	return true;
+}
+
+// A PLY property of the vertex element, its type's size and what it is
+struct PlyProperty
+{
+	std::string type;
+	size_t size;
+	size_t offset;
+	int position;
+	int color;
+};
+
+static size_t plyTypeSize(const std::string& type)
+{
+	if (type == "char" || type == "uchar" || type == "int8" || type == "uint8") {
+		return 1;
+	}
+	if (type == "short" || type == "ushort" || type == "int16" || type == "uint16") {
+		return 2;
+	}
+	if (type == "int" || type == "uint" || type == "float" || type == "int32" || type == "uint32" || type == "float32") {
+		return 4;
+	}
+	if (type == "double" || type == "float64") {
+		return 8;
+	}
+	return 0;
+}
+
+static double plyValue(const std::string& type, const unsigned char* data)
+{
+	if (type == "char" || type == "int8") {
+		return (double)*(const int8_t*)data;
+	}
+	if (type == "uchar" || type == "uint8") {
+		return (double)*data;
+	}
+	int16_t s16;
+	uint16_t u16;
+	int32_t s32;
+	uint32_t u32;
+	float f32;
+	double f64;
+	if (type == "short" || type == "int16") {
+		memcpy(&s16, data, 2);
+		return s16;
+	}
+	if (type == "ushort" || type == "uint16") {
+		memcpy(&u16, data, 2);
+		return u16;
+	}
+	if (type == "int" || type == "int32") {
+		memcpy(&s32, data, 4);
+		return s32;
+	}
+	if (type == "uint" || type == "uint32") {
+		memcpy(&u32, data, 4);
+		return u32;
+	}
+	if (type == "float" || type == "float32") {
+		memcpy(&f32, data, 4);
+		return f32;
+	}
+	memcpy(&f64, data, 8);
+	return f64;
+}
+
+bool importPly(const std::string& filename, ImportedPoints& points, std::string& error)
+{
+	std::ifstream in(filename.c_str(), std::ios::binary);
+	if (!in) {
+		error = "cannot open " + filename;
+		return false;
+	}
+
+	std::string line;
+	if (!std::getline(in, line) || line.compare(0, 3, "ply") != 0) {
+		error = filename + " is not a PLY file";
+		return false;
+	}
+	bool binary = false;
+	uint64_t vertexCount = 0;
+	bool inVertex = false;
+	bool vertexFirst = false;
+	int elements = 0;
+	std::vector<PlyProperty> properties;
+	size_t stride = 0;
+	while (std::getline(in, line)) {
+		if (!line.empty() && line.back() == '\r') {
+			line.pop_back();
+		}
+		std::istringstream words(line);
+		std::string keyword;
+		words >> keyword;
+		if (keyword == "format") {
+			std::string format;
+			words >> format;
+			if (format == "binary_little_endian") {
+				binary = true;
+			}
+			else if (format != "ascii") {
+				error = filename + " is " + format + ", only ascii and binary_little_endian are read";
+				return false;
+			}
+		}
+		else if (keyword == "element") {
+			std::string name;
+			words >> name;
+			// Only the first element can be read without knowing how to skip the others
+			inVertex = name == "vertex" && elements++ == 0;
+			if (inVertex) {
+				words >> vertexCount;
+				vertexFirst = true;
+			}
+		}
+		else if (keyword == "property" && inVertex) {
+			PlyProperty property;
+			words >> property.type;
+			if (property.type == "list") {
+				error = "list property in the vertex element of " + filename;
+				return false;
+			}
+			std::string name;
+			words >> name;
+			property.size = plyTypeSize(property.type);
+			if (!property.size) {
+				error = "unknown property type " + property.type + " in " + filename;
+				return false;
+			}
+			property.offset = stride;
+			stride += property.size;
+			property.position = name == "x" ? 0 : name == "y" ? 1 : name == "z" ? 2 : -1;
+			property.color = name == "red" || name == "r" ? 0 : name == "green" || name == "g" ? 1
+				: name == "blue" || name == "b" ? 2 : -1;
+			properties.push_back(property);
+		}
+		else if (keyword == "end_header") {
+			break;
+		}
+	}
+	int found = 0;
+	for (const PlyProperty& property : properties) {
+		found += property.position >= 0 ? 1 : 0;
+	}
+	if (!vertexFirst || found != 3) {
+		error = filename + " has no vertex element with x, y and z first";
+		return false;
+	}
+
+	points.positions.reserve((size_t)vertexCount * 3);
+	points.colors.reserve((size_t)vertexCount * 3);
+	std::vector<unsigned char> record(stride);
+	for (uint64_t i = 0; i < vertexCount; i++) {
+		double position[3] = { 0.0, 0.0, 0.0 };
+		int color[3] = { 255, 255, 255 };
+		if (binary) {
+			if (!in.read((char*)record.data(), (std::streamsize)stride)) {
+				error = "truncated vertices in " + filename;
+				return false;
+			}
+		}
+		else if (!std::getline(in, line)) {
+			error = "truncated vertices in " + filename;
+			return false;
+		}
+		std::istringstream values(binary ? std::string() : line);
+		for (const PlyProperty& property : properties) {
+			double value = 0.0;
+			if (binary) {
+				value = plyValue(property.type, &record[property.offset]);
+			}
+			else {
+				values >> value;
+			}
+			if (property.position >= 0) {
+				position[property.position] = value;
+			}
+			else if (property.color >= 0) {
+				// Float colours are 0 to 1, integer ones 0 to 255
+				bool unit = property.type == "float" || property.type == "float32" || property.type == "double" || property.type == "float64";
+				color[property.color] = (int)(unit ? value * 255.0 + 0.5 : value);
+			}
+		}
+		addPoint(points, position, color);
+	}
+	return true;
+}
@@ -0,0 +1,26 @@
+#ifndef _POINT_IMPORT_H_
+#define _POINT_IMPORT_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A scan read from a source file, every point with full precision. Sources without colours
+// leave them white.
+struct ImportedPoints
+{
+	std::vector<float> positions;	// 3 per point
+	std::vector<uint8_t> colors;	// RGB, 3 per point
+
+	size_t pointCount() const { return positions.size() / 3; }
+};
+
+// Text, one point a line: "x y z" or "x y z r g b" with 0-255 colours, separated by spaces,
+// tabs or commas. Lines that do not start with a number are skipped, headers included.
+bool importXyz(const std::string& filename, ImportedPoints& points, std::string& error);
+
+// PLY, ASCII or binary little endian, the x, y, z and red, green, blue properties of its
+// vertex element, which has to be the first. Faces and other elements are ignored.
+bool importPly(const std::string& filename, ImportedPoints& points, std::string& error);
+
+#endif
@@ -0,0 +1,146 @@
+#include "PointOctree.h"
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+
+// A node waiting to be built, with the points inside its cube it was handed
+struct PendingNode
+{
+	float boundsMin[3];
+	float size;
+	uint32_t level;
+	std::vector<uint32_t> members;
+};
+
+uint64_t buildPointOctree(const ImportedPoints& points, uint32_t maxNodePoints, uint32_t cells,
+	std::vector<PointCloudNode>& nodes, std::vector<PointCloudPoint>& sorted)
+{
+	nodes.clear();
+	sorted.clear();
+	size_t count = points.pointCount();
+	if (!count) {
+		return 0;
+	}
+	maxNodePoints = std::max(maxNodePoints, 1u);
+	cells = std::max(std::min(cells, 1024u), 1u);
+
+	// The root's cube around the bounds, a little bigger so no point lies on its far side
+	float lo[3], hi[3];
+	for (int axis = 0; axis < 3; axis++) {
+		lo[axis] = INFINITY;
+		hi[axis] = -INFINITY;
+	}
+	for (size_t i = 0; i < count; i++) {
+		for (int axis = 0; axis < 3; axis++) {
+			lo[axis] = std::min(lo[axis], points.positions[i * 3 + axis]);
+			hi[axis] = std::max(hi[axis], points.positions[i * 3 + axis]);
+		}
+	}
+	float extent = std::max(std::max(hi[0] - lo[0], hi[1] - lo[1]), hi[2] - lo[2]);
+	std::deque<PendingNode> pending(1);
+	PendingNode& root = pending.front();
+	std::copy(lo, lo + 3, root.boundsMin);
+	root.size = std::max(extent * 1.0001f, 1e-6f);
+	root.level = 0;
+	// In a scattered order, so the first point of a cell is any of them rather than the
+	// first the scanner took, which is all on one side
+	root.members.resize(count);
+	for (size_t i = 0; i < count; i++) {
+		root.members[i] = (uint32_t)i;
+	}
+	uint64_t state = 0x9e3779b97f4a7c15ull;
+	for (size_t i = count - 1; i > 0; i--) {
+		state = state * 6364136223846793005ull + 1442695040888963407ull;
+		std::swap(root.members[i], root.members[(size_t)((state >> 33) % (i + 1))]);
+	}
+
+	std::vector<uint8_t> taken((size_t)cells * cells * cells, 0);
+	std::vector<size_t> touched;
+	uint64_t dropped = 0;
+	sorted.reserve(count);
+	// Breadth first: a node's index is its place in the queue, so the children a node pushes
+	// are next to each other and after it
+	while (!pending.empty()) {
+		PendingNode item = std::move(pending.front());
+		pending.pop_front();
+		PointCloudNode node;
+		std::copy(item.boundsMin, item.boundsMin + 3, node.boundsMin);
+		node.size = item.size;
+		node.firstPoint = sorted.size();
+		node.level = item.level;
+		node.spacing = item.size / (float)cells;
+		node.firstChild = 0;
+		node.childCount = 0;
+		node.reserved = 0;
+
+		std::vector<uint32_t> kept;
+		std::vector<uint32_t> children[8];
+		bool leaf = item.members.size() <= maxNodePoints || item.level + 1 >= POINTCLOUD_MAX_LEVELS;
+		if (leaf) {
+			kept.swap(item.members);
+			if (kept.size() > maxNodePoints) {
+				dropped += kept.size() - maxNodePoints;
+				kept.resize(maxNodePoints);
+			}
+		}
+		else {
+			float half = item.size * 0.5f;
+			float scale = (float)cells / item.size;
+			for (uint32_t index : item.members) {
+				const float* p = &points.positions[(size_t)index * 3];
+				size_t cell = 0;
+				int octant = 0;
+				for (int axis = 0; axis < 3; axis++) {
+					float offset = p[axis] - item.boundsMin[axis];
+					int c = std::max(std::min((int)(offset * scale), (int)cells - 1), 0);
+					cell = cell * cells + (size_t)c;
+					octant |= offset >= half ? 1 << axis : 0;
+				}
+				if (!taken[cell] && kept.size() < maxNodePoints) {
+					taken[cell] = 1;
+					touched.push_back(cell);
+					kept.push_back(index);
+				}
+				else {
+					children[octant].push_back(index);
+				}
+			}
+			for (size_t cell : touched) {
+				taken[cell] = 0;
+			}
+			touched.clear();
+			std::vector<uint32_t>().swap(item.members);
+
+			node.firstChild = (uint32_t)(nodes.size() + 1 + pending.size());
+			for (int octant = 0; octant < 8; octant++) {
+				if (children[octant].empty()) {
+					continue;
+				}
+				PendingNode child;
+				for (int axis = 0; axis < 3; axis++) {
+					child.boundsMin[axis] = item.boundsMin[axis] + ((octant >> axis) & 1 ? half : 0.f);
+				}
+				child.size = half;
+				child.level = item.level + 1;
+				child.members.swap(children[octant]);
+				pending.push_back(std::move(child));
+				node.childCount++;
+			}
+			if (!node.childCount) {
+				node.firstChild = 0;
+			}
+		}
+
+		for (uint32_t index : kept) {
+			PointCloudPoint point;
+			std::copy(&points.positions[(size_t)index * 3], &points.positions[(size_t)index * 3] + 3, point.position);
+			std::copy(&points.colors[(size_t)index * 3], &points.colors[(size_t)index * 3] + 3, point.color);
+			point.color[3] = (uint8_t)item.level;
+			sorted.push_back(point);
+		}
+		node.pointCount = (uint32_t)kept.size();
+		nodes.push_back(node);
+	}
+	return dropped;
+}
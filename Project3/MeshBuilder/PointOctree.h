@@ -0,0 +1,19 @@
+#ifndef _POINT_OCTREE_H_
+#define _POINT_OCTREE_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "PointImport.h"
+#include "../Project3/PointCloudFile.h"
+
+//! Sorts the points into the octree of a point cloud file (PointCloudFile.h). Each node
+// keeps the first point of every cell of a grid of cells across its cube, up to
+// maxNodePoints, and hands the rest to its children; a node with no more than that many
+// keeps them all and has no children.
+// @input cells The grid's cells along a side, the node's spacing is its size over this
+// @return The points left out of the deepest level, which has no room for them
+uint64_t buildPointOctree(const ImportedPoints& points, uint32_t maxNodePoints, uint32_t cells,
+	std::vector<PointCloudNode>& nodes, std::vector<PointCloudPoint>& sorted);
+
+#endif
@@ -0,0 +1,101 @@
+#include "Simplify.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <set>
+#include <unordered_map>
+
+SimplifiedLevel simplifyByClustering(const ImportedModel& model, uint32_t cells)
+{
+	SimplifiedLevel level;
+	size_t count = model.vertexCount();
+	const float* p = model.positions.data();
+	if (!count || cells < 1) {
+		return level;
+	}
+
+	float lo[3] = { p[0], p[1], p[2] };
+	float hi[3] = { p[0], p[1], p[2] };
+	for (size_t v = 1; v < count; v++) {
+		for (int axis = 0; axis < 3; axis++) {
+			lo[axis] = std::min(lo[axis], p[v * 3 + axis]);
+			hi[axis] = std::max(hi[axis], p[v * 3 + axis]);
+		}
+	}
+	float side = std::max(hi[0] - lo[0], std::max(hi[1] - lo[1], hi[2] - lo[2]));
+	if (side <= 0.f) {
+		return level;
+	}
+	float cellSize = side / (float)cells;
+
+	// Cell of every vertex, and the sum of the positions in each cell for its middle
+	std::vector<uint32_t> cellOf(count);
+	std::unordered_map<uint64_t, uint32_t> cellIndex;
+	std::vector<float> sums;
+	std::vector<uint32_t> members;
+	for (size_t v = 0; v < count; v++) {
+		uint64_t key = 0;
+		for (int axis = 0; axis < 3; axis++) {
+			uint64_t c = (uint64_t)std::min((float)(cells - 1), std::floor((p[v * 3 + axis] - lo[axis]) / cellSize));
+			key = (key << 21) | c;
+		}
+		auto found = cellIndex.emplace(key, (uint32_t)members.size());
+		if (found.second) {
+			sums.insert(sums.end(), { 0.f, 0.f, 0.f });
+			members.push_back(0);
+		}
+		uint32_t cell = found.first->second;
+		cellOf[v] = cell;
+		for (int axis = 0; axis < 3; axis++) {
+			sums[cell * 3 + axis] += p[v * 3 + axis];
+		}
+		members[cell]++;
+	}
+	if (members.size() == count) {
+		return level;
+	}
+
+	// The vertex nearest its cell's middle stands in for the whole cell
+	std::vector<uint32_t> representative(members.size(), UINT32_MAX);
+	std::vector<float> nearest(members.size(), INFINITY);
+	for (size_t v = 0; v < count; v++) {
+		uint32_t cell = cellOf[v];
+		float d = 0.f;
+		for (int axis = 0; axis < 3; axis++) {
+			float delta = p[v * 3 + axis] - sums[cell * 3 + axis] / (float)members[cell];
+			d += delta * delta;
+		}
+		if (d < nearest[cell]) {
+			nearest[cell] = d;
+			representative[cell] = (uint32_t)v;
+		}
+	}
+	for (size_t v = 0; v < count; v++) {
+		uint32_t r = representative[cellOf[v]];
+		float d = 0.f;
+		for (int axis = 0; axis < 3; axis++) {
+			float delta = p[v * 3 + axis] - p[r * 3 + axis];
+			d += delta * delta;
+		}
+		level.error = std::max(level.error, std::sqrt(d));
+	}
+
+	// Triangles keep their winding, the same one twice is only kept once
+	std::set<std::array<uint32_t, 3>> seen;
+	for (size_t i = 0; i + 2 < model.indices.size(); i += 3) {
+		uint32_t t[3];
+		for (int k = 0; k < 3; k++) {
+			t[k] = representative[cellOf[model.indices[i + k]]];
+		}
+		if (t[0] == t[1] || t[1] == t[2] || t[0] == t[2]) {
+			continue;
+		}
+		int first = t[0] < t[1] ? (t[0] < t[2] ? 0 : 2) : (t[1] < t[2] ? 1 : 2);
+		std::array<uint32_t, 3> triangle = { t[first], t[(first + 1) % 3], t[(first + 2) % 3] };
+		if (seen.insert(triangle).second) {
+			level.indices.insert(level.indices.end(), triangle.begin(), triangle.end());
+		}
+	}
+	return level;
+}
@@ -0,0 +1,24 @@
+#ifndef _SIMPLIFY_H_
+#define _SIMPLIFY_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "ModelImport.h"
+
+// A coarser level of a model, made of the model's own vertices
+struct SimplifiedLevel
+{
+	std::vector<uint32_t> indices;
+	// The furthest any vertex moved onto the one standing in for it, in model units
+	float error = 0.f;
+};
+
+//! Vertex clustering: snaps the vertices onto a grid of cells across the model's bounds,
+// keeps the vertex nearest the middle of each cell for all of them, and drops the
+// triangles that collapse or repeat.
+// @input cells How many cells the longest side of the bounds is split into
+// Returns the level, with no indices if nothing could be merged.
+SimplifiedLevel simplifyByClustering(const ImportedModel& model, uint32_t cells);
+
+#endif
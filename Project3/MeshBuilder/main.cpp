@@ -0,0 +1,260 @@
+// Converts models into mesh files (.p3mesh) the runtime maps and adds to the mesh pool as
+// they are, and scans into point cloud files (.p3points) it pages in node by node. Runs as a
+// post-build step of this project over Project3-Assets, and can be run by hand:
+//
+//   MeshBuilder [--force] [--lods=N] [--node-points=N] <file or directory>...
+//
+// Directories are searched recursively for *.obj, *.gltf and *.glb, and for *.xyz and *.ply
+// scans. A file built from the current version of its source is left alone unless --force
+// is given. Each mesh gets up to N levels of detail (default and most MESHFILE_MAX_LODS),
+// every level made by clustering on a grid half as fine as the last; a level that would not
+// drop at least a quarter of the triangles ends the chain. Each scan becomes an octree of
+// nodes of at most --node-points points (default 20000).
+
+#include <Windows.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "ModelImport.h"
+#include "PointImport.h"
+#include "PointOctree.h"
+#include "Simplify.h"
+#include "../Project3/MeshFile.h"
+#include "../Project3/TextureCache.h"
+
+static bool endsWith(const std::string& s, const char* suffix)
+{
+	size_t n = strlen(suffix);
+	return s.size() >= n && _stricmp(s.c_str() + s.size() - n, suffix) == 0;
+}
+
+static bool isModel(const std::string& name)
+{
+	return endsWith(name, ".obj") || endsWith(name, ".gltf") || endsWith(name, ".glb");
+}
+
+static bool isScan(const std::string& name)
+{
+	return endsWith(name, ".xyz") || endsWith(name, ".ply");
+}
+
+static void collectSources(const std::string& path, std::vector<std::string>& out)
+{
+	WIN32_FIND_DATAA data;
+	HANDLE find = FindFirstFileA((path + "\\*").c_str(), &data);
+	if (find == INVALID_HANDLE_VALUE) {
+		if (isModel(path) || isScan(path)) {
+			out.push_back(path);
+		}
+		return;
+	}
+	do {
+		std::string name = data.cFileName;
+		if (name == "." || name == "..") {
+			continue;
+		}
+		std::string child = path + "\\" + name;
+		if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+			collectSources(child, out);
+		}
+		else if (isModel(name) || isScan(name)) {
+			out.push_back(child);
+		}
+	} while (FindNextFileA(find, &data));
+	FindClose(find);
+}
+
+// True if the mesh file exists and was built from exactly this version of the source
+static bool upToDate(const std::string& source, const std::string& mesh)
+{
+	MappedFile file;
+	if (!file.open(mesh.c_str()) || file.size() < sizeof(MeshFileHeader)) {
+		return false;
+	}
+	const MeshFileHeader* header = (const MeshFileHeader*)file.data();
+	uint64_t size, time;
+	sourceFileStamp(source.c_str(), size, time);
+	return header->magic == MESHFILE_MAGIC && header->version == MESHFILE_VERSION &&
+		header->sourceSize == size && header->sourceTime == time;
+}
+
+// The same for a point cloud file
+static bool cloudUpToDate(const std::string& source, const std::string& cloud)
+{
+	MappedFile file;
+	if (!file.open(cloud.c_str()) || file.size() < sizeof(PointCloudHeader)) {
+		return false;
+	}
+	const PointCloudHeader* header = (const PointCloudHeader*)file.data();
+	uint64_t size, time;
+	sourceFileStamp(source.c_str(), size, time);
+	return header->magic == POINTCLOUD_MAGIC && header->version == POINTCLOUD_VERSION &&
+		header->sourceSize == size && header->sourceTime == time;
+}
+
+// Cells along a side of a node's sampling grid
+static const uint32_t NODE_CELLS = 128;
+
+// Builds the point cloud file of one scan, false (with the reason printed) if it failed
+static bool buildPointCloud(const std::string& source, uint32_t maxNodePoints)
+{
+	std::string cloud = pointCloudFilePath(source);
+	ImportedPoints points;
+	std::string error;
+	bool imported = endsWith(source, ".xyz") ? importXyz(source, points, error) : importPly(source, points, error);
+	if (!imported) {
+		std::cerr << source << ": " << error << std::endl;
+		return false;
+	}
+
+	std::vector<PointCloudNode> nodes;
+	std::vector<PointCloudPoint> sorted;
+	uint64_t dropped = buildPointOctree(points, maxNodePoints, NODE_CELLS, nodes, sorted);
+	if (nodes.empty()) {
+		std::cerr << source << ": no points" << std::endl;
+		return false;
+	}
+
+	uint64_t size, time;
+	sourceFileStamp(source.c_str(), size, time);
+	if (!writePointCloudFile(cloud.c_str(), nodes.data(), (uint32_t)nodes.size(), sorted.data(), sorted.size(), size, time)) {
+		std::cerr << "failed to write " << cloud << std::endl;
+		return false;
+	}
+	uint32_t levels = 0;
+	for (const PointCloudNode& node : nodes) {
+		levels = std::max(levels, node.level + 1);
+	}
+	std::cout << source << " -> " << cloud << " (" << sorted.size() << " points in " << nodes.size()
+		<< " nodes, " << levels << " levels";
+	if (dropped) {
+		std::cout << ", " << dropped << " too close together left out";
+	}
+	std::cout << ")" << std::endl;
+	return true;
+}
+
+// Cells across the longest side for the first coarser level
+static const uint32_t FIRST_LOD_CELLS = 64;
+
+// The full mesh and its coarser levels, all in indices
+static uint32_t buildLods(const ImportedModel& model, uint32_t maxLods, std::vector<uint32_t>& indices, MeshFileLod* lods)
+{
+	indices = model.indices;
+	lods[0].firstIndex = 0;
+	lods[0].indexCount = (uint32_t)indices.size();
+	lods[0].error = 0.f;
+	uint32_t count = 1;
+	uint32_t cells = FIRST_LOD_CELLS;
+	while (count < maxLods && cells >= 2) {
+		SimplifiedLevel level = simplifyByClustering(model, cells);
+		cells /= 2;
+		if (level.indices.empty()) {
+			continue;
+		}
+		if (level.indices.size() * 4 > (size_t)lods[count - 1].indexCount * 3) {
+			// Not enough gone at this grid yet, a coarser one may do
+			if (lods[count - 1].indexCount == lods[0].indexCount) {
+				continue;
+			}
+			break;
+		}
+		lods[count].firstIndex = (uint32_t)indices.size();
+		lods[count].indexCount = (uint32_t)level.indices.size();
+		lods[count].error = level.error;
+		indices.insert(indices.end(), level.indices.begin(), level.indices.end());
+		count++;
+	}
+	return count;
+}
+
+int main(int argc, char** argv)
+{
+	bool force = false;
+	uint32_t maxLods = MESHFILE_MAX_LODS;
+	uint32_t maxNodePoints = 20000;
+	std::vector<std::string> sources;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--force") {
+			force = true;
+		}
+		else if (arg.compare(0, 7, "--lods=") == 0) {
+			maxLods = (uint32_t)std::max(1, std::min(atoi(arg.c_str() + 7), (int)MESHFILE_MAX_LODS));
+		}
+		else if (arg.compare(0, 14, "--node-points=") == 0) {
+			maxNodePoints = (uint32_t)std::max(256, atoi(arg.c_str() + 14));
+		}
+		else {
+			collectSources(arg, sources);
+		}
+	}
+
+	if (sources.empty()) {
+		// No models is not an error for the post-build step, only for a run by hand
+		if (argc < 2) {
+			std::cerr << "usage: MeshBuilder [--force] [--lods=N] [--node-points=N] <file or directory>..." << std::endl;
+			return 1;
+		}
+		return 0;
+	}
+
+	int failures = 0;
+	for (const std::string& source : sources) {
+		if (isScan(source)) {
+			if (!force && cloudUpToDate(source, pointCloudFilePath(source))) {
+				continue;
+			}
+			if (!buildPointCloud(source, maxNodePoints)) {
+				failures++;
+			}
+			continue;
+		}
+
+		std::string mesh = meshFilePath(source);
+		if (!force && upToDate(source, mesh)) {
+			continue;
+		}
+
+		ImportedModel model;
+		std::string error;
+		bool imported = endsWith(source, ".obj") ? importObj(source, model, error) : importGltf(source, model, error);
+		if (!imported) {
+			std::cerr << source << ": " << error << std::endl;
+			failures++;
+			continue;
+		}
+		if (!model.hasNormals) {
+			computeNormals(model);
+		}
+
+		std::vector<MeshVertex> vertices(model.vertexCount());
+		for (size_t i = 0; i < vertices.size(); i++) {
+			vertices[i] = packMeshVertex(&model.positions[i * 3], &model.normals[i * 3], &model.uvs[i * 2]);
+		}
+
+		std::vector<uint32_t> indices;
+		MeshFileLod lods[MESHFILE_MAX_LODS];
+		uint32_t lodCount = buildLods(model, maxLods, indices, lods);
+
+		uint64_t size, time;
+		sourceFileStamp(source.c_str(), size, time);
+		if (!writeMeshFile(mesh.c_str(), vertices.data(), (uint32_t)vertices.size(), indices.data(),
+				(uint32_t)indices.size(), lods, lodCount, size, time)) {
+			std::cerr << "failed to write " << mesh << std::endl;
+			failures++;
+			continue;
+		}
+		std::cout << source << " -> " << mesh << " (" << vertices.size() << " vertices, triangles";
+		for (uint32_t i = 0; i < lodCount; i++) {
+			std::cout << (i ? " / " : " ") << lods[i].indexCount / 3;
+		}
+		std::cout << ")" << std::endl;
+	}
+	return failures ? 1 : 0;
+}
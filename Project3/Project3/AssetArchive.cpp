@@ -0,0 +1,433 @@
+#include "AssetArchive.h"
+#include "LargePages.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+// The tables of an archive, at the start of its file or of a delta
+struct ArchiveLayout
+{
+	const AssetArchiveHeader* header;
+	const AssetArchiveEntry* entries;
+	const char* names;
+	const AssetArchiveChunk* chunks;
+	// The header to the end of the chunk table
+	size_t headBytes;
+};
+
+static size_t alignNames(size_t offset)
+{
+	return (offset + 7) & ~(size_t)7;
+}
+
+static uint64_t hashBytes(const unsigned char* data, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+	for (size_t i = 0; i < size; i++) {
+		hash = (hash ^ data[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+static size_t chunkBytes(const AssetArchiveHeader& header, const AssetArchiveEntry& entry, uint32_t chunk)
+{
+	return (size_t)std::min<uint64_t>(header.chunkSize, entry.size - (uint64_t)chunk * header.chunkSize);
+}
+
+//! Finds the tables in data and checks them against the archive's size.
+// @input available The bytes of data there are, the tables may be all of it
+// @input size The archive's
+static bool parseLayout(const unsigned char* data, size_t available, uint64_t size, const char* filename, ArchiveLayout& layout)
+{
+	const AssetArchiveHeader* header = (const AssetArchiveHeader*)data;
+	if (available < sizeof(AssetArchiveHeader) || header->magic != ASSETARCHIVE_MAGIC) {
+		std::cerr << filename << " is not an asset archive" << std::endl;
+		return false;
+	}
+	if (header->version != ASSETARCHIVE_VERSION) {
+		std::cerr << "asset archive " << filename << " is version " << header->version << ", not " << ASSETARCHIVE_VERSION
+			<< ", build it again with TexCacheBuilder --archive" << std::endl;
+		return false;
+	}
+	size_t namesStart = sizeof(AssetArchiveHeader) + (size_t)header->entryCount * sizeof(AssetArchiveEntry);
+	size_t chunksStart = alignNames(namesStart + header->nameBytes);
+	size_t headBytes = chunksStart + (size_t)header->chunkCount * sizeof(AssetArchiveChunk);
+	if (headBytes > available || !header->chunkSize) {
+		std::cerr << "asset archive " << filename << " is cut short" << std::endl;
+		return false;
+	}
+	layout.header = header;
+	layout.entries = (const AssetArchiveEntry*)(header + 1);
+	layout.names = (const char*)data + namesStart;
+	layout.chunks = (const AssetArchiveChunk*)(data + chunksStart);
+	layout.headBytes = headBytes;
+	for (uint32_t i = 0; i < header->entryCount; i++) {
+		const AssetArchiveEntry& entry = layout.entries[i];
+		uint64_t chunks = (entry.size + header->chunkSize - 1) / header->chunkSize;
+		if ((size_t)entry.nameOffset + entry.nameLength > header->nameBytes || entry.offset > size || entry.size > size - entry.offset
+			|| entry.chunkCount != chunks || (uint64_t)entry.firstChunk + entry.chunkCount > header->chunkCount) {
+			std::cerr << "asset archive " << filename << " has a bad entry " << i << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+AssetArchive::AssetArchive() : copy(nullptr), copyBytes(0)
+{
+	// Made first, so it is still there when a static archive closes at exit
+	largePages();
+}
+
+AssetArchive::~AssetArchive()
+{
+	close();
+}
+
+bool AssetArchive::open(const char* filename, bool intoLargePages)
+{
+	close();
+	if (!file.open(filename)) {
+		return false;
+	}
+
+	const unsigned char* data = file.data();
+	size_t size = file.size();
+	if (intoLargePages && largePages().enabled()) {
+		copy = (unsigned char*)largePages().allocate(size, LargePages::ASSET_ARCHIVE, copyBytes);
+		if (copy) {
+			memcpy(copy, data, size);
+			file.close();
+			data = copy;
+		}
+	}
+	ArchiveLayout layout;
+	if (!parseLayout(data, size, size, filename, layout)) {
+		close();
+		return false;
+	}
+	for (uint32_t i = 0; i < layout.header->entryCount; i++) {
+		const AssetArchiveEntry& entry = layout.entries[i];
+		Span span = { data + entry.offset, (size_t)entry.size };
+		entries[std::string(layout.names + entry.nameOffset, entry.nameLength)] = span;
+	}
+	return true;
+}
+
+void AssetArchive::close()
+{
+	entries.clear();
+	file.close();
+	if (copy) {
+		largePages().free(copy, copyBytes, LargePages::ASSET_ARCHIVE);
+		copy = nullptr;
+		copyBytes = 0;
+	}
+}
+
+bool AssetArchive::find(const char* name, const unsigned char*& data, size_t& size) const
+{
+	if (entries.empty()) {
+		return false;
+	}
+	auto it = entries.find(entryName(name));
+	if (it == entries.end()) {
+		return false;
+	}
+	data = it->second.data;
+	size = it->second.size;
+	return true;
+}
+
+std::string AssetArchive::entryName(const std::string& path)
+{
+	std::string name;
+	name.reserve(path.size());
+	for (char c : path) {
+		name += c == '\\' ? '/' : (char)tolower((unsigned char)c);
+	}
+	while (name.compare(0, 2, "./") == 0) {
+		name.erase(0, 2);
+	}
+	return name;
+}
+
+AssetArchive& assetArchive()
+{
+	static AssetArchive instance;
+	return instance;
+}
+
+bool readAssetText(const char* filename, std::string& text)
+{
+	const unsigned char* data;
+	size_t size;
+	if (assetArchive().find(filename, data, size)) {
+		text.assign((const char*)data, size);
+		return true;
+	}
+	std::ifstream stream(filename, std::ios::in);
+	if (!stream.is_open()) {
+		return false;
+	}
+	std::ostringstream contents;
+	contents << stream.rdbuf();
+	text = contents.str();
+	return true;
+}
+
+static uint64_t alignUp(uint64_t offset)
+{
+	return (offset + ASSETARCHIVE_ALIGN - 1) & ~(uint64_t)(ASSETARCHIVE_ALIGN - 1);
+}
+
+static const unsigned char padding[ASSETARCHIVE_ALIGN] = {};
+
+bool writeAssetArchive(const char* filename, const std::vector<AssetArchiveFile>& files)
+{
+	// The sizes are known up front, so the table goes out first and every file after it
+	std::vector<MappedFile> sources(files.size());
+	std::vector<AssetArchiveEntry> table(files.size());
+	std::vector<AssetArchiveChunk> chunks;
+	std::string names;
+	for (size_t i = 0; i < files.size(); i++) {
+		if (!sources[i].open(files[i].path.c_str())) {
+			std::cerr << "could not read " << files[i].path << std::endl;
+			return false;
+		}
+		std::string name = AssetArchive::entryName(files[i].name);
+		table[i].size = sources[i].size();
+		table[i].nameOffset = (uint32_t)names.size();
+		table[i].nameLength = (uint32_t)name.size();
+		table[i].firstChunk = (uint32_t)chunks.size();
+		table[i].chunkCount = (uint32_t)((table[i].size + ASSETARCHIVE_CHUNK - 1) / ASSETARCHIVE_CHUNK);
+		for (uint32_t c = 0; c < table[i].chunkCount; c++) {
+			size_t start = (size_t)c * ASSETARCHIVE_CHUNK;
+			AssetArchiveChunk chunk = { hashBytes(sources[i].data() + start, std::min<size_t>(ASSETARCHIVE_CHUNK, sources[i].size() - start)) };
+			chunks.push_back(chunk);
+		}
+		names += name;
+	}
+	AssetArchiveHeader header = {};
+	header.magic = ASSETARCHIVE_MAGIC;
+	header.version = ASSETARCHIVE_VERSION;
+	header.entryCount = (uint32_t)files.size();
+	header.nameBytes = (uint32_t)names.size();
+	header.chunkSize = ASSETARCHIVE_CHUNK;
+	header.chunkCount = (uint32_t)chunks.size();
+	size_t namesEnd = sizeof(header) + table.size() * sizeof(AssetArchiveEntry) + names.size();
+	size_t namesPad = alignNames(namesEnd) - namesEnd;
+	uint64_t offset = namesEnd + namesPad + chunks.size() * sizeof(AssetArchiveChunk);
+	for (AssetArchiveEntry& entry : table) {
+		entry.offset = alignUp(offset);
+		offset = entry.offset + entry.size;
+	}
+
+	FILE* out = fopen(filename, "wb");
+	if (!out) {
+		return false;
+	}
+	bool ok = fwrite(&header, sizeof(header), 1, out) == 1
+		&& (table.empty() || fwrite(table.data(), sizeof(AssetArchiveEntry), table.size(), out) == table.size())
+		&& fwrite(names.data(), 1, names.size(), out) == names.size()
+		&& fwrite(padding, 1, namesPad, out) == namesPad
+		&& (chunks.empty() || fwrite(chunks.data(), sizeof(AssetArchiveChunk), chunks.size(), out) == chunks.size());
+	uint64_t written = namesEnd + namesPad + chunks.size() * sizeof(AssetArchiveChunk);
+	for (size_t i = 0; i < files.size() && ok; i++) {
+		size_t pad = (size_t)(table[i].offset - written);
+		ok = fwrite(padding, 1, pad, out) == pad && fwrite(sources[i].data(), 1, sources[i].size(), out) == sources[i].size();
+		written = table[i].offset + table[i].size;
+	}
+	return fclose(out) == 0 && ok;
+}
+
+uint64_t assetArchiveId(const char* filename)
+{
+	MappedFile file;
+	ArchiveLayout layout;
+	if (!file.open(filename) || !parseLayout(file.data(), file.size(), file.size(), filename, layout)) {
+		return 0;
+	}
+	return hashBytes(file.data(), layout.headBytes);
+}
+
+bool writeAssetDelta(const char* base, const char* target, const char* delta)
+{
+	MappedFile baseFile, targetFile;
+	ArchiveLayout from, to;
+	if (!baseFile.open(base) || !parseLayout(baseFile.data(), baseFile.size(), baseFile.size(), base, from)) {
+		std::cerr << "could not read " << base << std::endl;
+		return false;
+	}
+	if (!targetFile.open(target) || !parseLayout(targetFile.data(), targetFile.size(), targetFile.size(), target, to)) {
+		std::cerr << "could not read " << target << std::endl;
+		return false;
+	}
+
+	// Every chunk the base has, by hash; the first of the same ones will do
+	std::unordered_map<uint64_t, std::pair<uint64_t, size_t>> known;
+	for (uint32_t i = 0; i < from.header->entryCount; i++) {
+		const AssetArchiveEntry& entry = from.entries[i];
+		for (uint32_t c = 0; c < entry.chunkCount; c++) {
+			uint64_t offset = entry.offset + (uint64_t)c * from.header->chunkSize;
+			known.emplace(from.chunks[entry.firstChunk + c].hash, std::make_pair(offset, chunkBytes(*from.header, entry, c)));
+		}
+	}
+
+	// A chunk is taken from the base only if its bytes are the same too, so a hash that
+	// happens to match never makes it into a station's archive
+	std::vector<uint64_t> sources(to.header->chunkCount, ASSETDELTA_NEW);
+	std::vector<std::pair<const unsigned char*, size_t>> added;
+	uint64_t addedBytes = 0;
+	for (uint32_t i = 0; i < to.header->entryCount; i++) {
+		const AssetArchiveEntry& entry = to.entries[i];
+		for (uint32_t c = 0; c < entry.chunkCount; c++) {
+			const unsigned char* bytes = targetFile.data() + entry.offset + (uint64_t)c * to.header->chunkSize;
+			size_t size = chunkBytes(*to.header, entry, c);
+			auto it = known.find(to.chunks[entry.firstChunk + c].hash);
+			if (it != known.end() && it->second.second == size && memcmp(baseFile.data() + it->second.first, bytes, size) == 0) {
+				sources[entry.firstChunk + c] = it->second.first;
+				continue;
+			}
+			added.push_back(std::make_pair(bytes, size));
+			addedBytes += size;
+		}
+	}
+
+	AssetDeltaHeader header = {};
+	header.magic = ASSETDELTA_MAGIC;
+	header.version = ASSETDELTA_VERSION;
+	header.baseId = hashBytes(baseFile.data(), from.headBytes);
+	header.targetId = hashBytes(targetFile.data(), to.headBytes);
+	header.targetSize = targetFile.size();
+	header.headBytes = to.headBytes;
+	header.chunkCount = to.header->chunkCount;
+	header.newChunks = (uint32_t)added.size();
+
+	FILE* out = fopen(delta, "wb");
+	if (!out) {
+		std::cerr << "could not write " << delta << std::endl;
+		return false;
+	}
+	bool ok = fwrite(&header, sizeof(header), 1, out) == 1
+		&& fwrite(targetFile.data(), 1, to.headBytes, out) == to.headBytes
+		&& (sources.empty() || fwrite(sources.data(), sizeof(uint64_t), sources.size(), out) == sources.size());
+	for (size_t i = 0; i < added.size() && ok; i++) {
+		ok = fwrite(added[i].first, 1, added[i].second, out) == added[i].second;
+	}
+	if (fclose(out) != 0 || !ok) {
+		std::cerr << "could not write " << delta << std::endl;
+		remove(delta);
+		return false;
+	}
+	std::cout << added.size() << " of " << to.header->chunkCount << " chunks changed, " << (addedBytes >> 10) << " KB of "
+		<< (targetFile.size() >> 10) << " KB -> " << delta << std::endl;
+	return true;
+}
+
+bool applyAssetDelta(const char* archive, const char* delta, std::ostream& status)
+{
+	MappedFile deltaFile;
+	if (!deltaFile.open(delta)) {
+		std::cerr << "could not read " << delta << std::endl;
+		return false;
+	}
+	const AssetDeltaHeader* header = (const AssetDeltaHeader*)deltaFile.data();
+	if (deltaFile.size() < sizeof(AssetDeltaHeader) || header->magic != ASSETDELTA_MAGIC || header->version != ASSETDELTA_VERSION) {
+		std::cerr << delta << " is not an asset archive delta" << std::endl;
+		return false;
+	}
+	const unsigned char* head = deltaFile.data() + sizeof(AssetDeltaHeader);
+	size_t available = deltaFile.size() - sizeof(AssetDeltaHeader);
+	ArchiveLayout to;
+	if (header->headBytes > available || !parseLayout(head, (size_t)header->headBytes, header->targetSize, delta, to)
+		|| to.header->chunkCount != header->chunkCount
+		|| to.headBytes + (size_t)header->chunkCount * sizeof(uint64_t) > available) {
+		std::cerr << "asset archive delta " << delta << " is cut short" << std::endl;
+		return false;
+	}
+	const uint64_t* sources = (const uint64_t*)(head + to.headBytes);
+	const unsigned char* added = (const unsigned char*)(sources + header->chunkCount);
+	const unsigned char* addedEnd = deltaFile.data() + deltaFile.size();
+
+	// A station without an archive can still take a delta that carries every chunk
+	MappedFile baseFile;
+	ArchiveLayout from;
+	if (baseFile.open(archive)) {
+		if (!parseLayout(baseFile.data(), baseFile.size(), baseFile.size(), archive, from)) {
+			return false;
+		}
+		uint64_t id = hashBytes(baseFile.data(), from.headBytes);
+		if (id == header->targetId) {
+			return true;
+		}
+		if (id != header->baseId) {
+			std::cerr << delta << " is not for the asset archive " << archive << std::endl;
+			return false;
+		}
+	}
+
+	std::string next = std::string(archive) + ".new";
+	FILE* out = fopen(next.c_str(), "wb");
+	if (!out) {
+		std::cerr << "could not write " << next << std::endl;
+		return false;
+	}
+	bool ok = fwrite(head, 1, to.headBytes, out) == to.headBytes;
+	uint64_t written = to.headBytes;
+	uint64_t reused = 0;
+	for (uint32_t i = 0; i < to.header->entryCount && ok; i++) {
+		const AssetArchiveEntry& entry = to.entries[i];
+		size_t pad = (size_t)(entry.offset - written);
+		ok = entry.offset >= written && pad <= sizeof(padding) && fwrite(padding, 1, pad, out) == pad;
+		for (uint32_t c = 0; c < entry.chunkCount && ok; c++) {
+			uint32_t chunk = entry.firstChunk + c;
+			size_t size = chunkBytes(*to.header, entry, c);
+			const unsigned char* bytes;
+			if (sources[chunk] == ASSETDELTA_NEW) {
+				bytes = added;
+				added += size;
+				ok = added <= addedEnd;
+			}
+			else {
+				bytes = baseFile.data() + sources[chunk];
+				ok = baseFile.isOpen() && sources[chunk] <= baseFile.size() && size <= baseFile.size() - sources[chunk];
+				reused += size;
+			}
+			if (ok && hashBytes(bytes, size) != to.chunks[chunk].hash) {
+				std::cerr << "chunk " << chunk << " of " << delta << " does not match its hash" << std::endl;
+				ok = false;
+			}
+			ok = ok && fwrite(bytes, 1, size, out) == size;
+		}
+		written = entry.offset + entry.size;
+	}
+	ok = fclose(out) == 0 && ok && written <= header->targetSize;
+	baseFile.close();
+	if (!ok) {
+		std::cerr << "could not apply " << delta << " to " << archive << ", left as it was" << std::endl;
+		remove(next.c_str());
+		return false;
+	}
+#ifdef _WIN32
+	ok = MoveFileExA(next.c_str(), archive, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	ok = rename(next.c_str(), archive) == 0;
+#endif
+	if (!ok) {
+		std::cerr << "could not replace " << archive << " with " << next << std::endl;
+		remove(next.c_str());
+		return false;
+	}
+	status << "asset archive " << archive << " updated, " << (reused >> 10) << " KB kept and "
+		<< ((uint64_t)(added - (const unsigned char*)(sources + header->chunkCount)) >> 10) << " KB from " << delta << std::endl;
+	return true;
+}
@@ -0,0 +1,173 @@
+#ifndef _ASSET_ARCHIVE_H_
+#define _ASSET_ARCHIVE_H_
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Image.h"
+
+// A packed asset archive (.p3ar): the texture caches, shaders, configs and other files of a
+// deployment in one file, so startup maps one file instead of opening dozens by relative
+// path. TexCacheBuilder --archive writes it:
+//
+//   AssetArchiveHeader
+//   AssetArchiveEntry[entryCount]
+//   the names, nameBytes bytes, padded to 8
+//   AssetArchiveChunk[chunkCount]
+//   the files, each starting on an ASSETARCHIVE_ALIGN boundary
+//
+// Every file is cut into chunks of chunkSize bytes from its start, the last one shorter,
+// and the chunk table has a hash of each, by file in order. A station is brought from one
+// archive to the next with a delta (.p3ad, TexCacheBuilder --delta) that only carries the
+// chunks the station's archive does not already have somewhere; applyAssetDelta puts the
+// new archive together from those and the old one's, and checks every chunk against its
+// hash. The new archive is laid out the same way, each file in one piece, so it is still
+// mapped as it is.
+//
+// Files are named by the path they would be opened by, with / for separators and in lower
+// case ("../Project3-Assets/left-ppm/px.p3tc" -> "../project3-assets/left-ppm/px.p3tc").
+//
+// Once assetArchive() is open, MappedFile::open serves any file it has as a view into the
+// one mapping, so everything that maps its files (images, texture caches, meshes, tiles)
+// reads from the archive without copying, and readAssetText the same for text files. Files
+// the archive does not have are opened from disk as before.
+
+const uint32_t ASSETARCHIVE_MAGIC = 0x52413350; // "P3AR"
+const uint32_t ASSETARCHIVE_VERSION = 2;
+// A page, so every file is mapped page aligned as it would be on its own
+const uint32_t ASSETARCHIVE_ALIGN = 4096;
+// What a delta sends of a file that changed at least
+const uint32_t ASSETARCHIVE_CHUNK = 64 * ASSETARCHIVE_ALIGN;
+
+struct AssetArchiveHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entryCount;
+	uint32_t nameBytes;
+	uint32_t chunkSize;
+	uint32_t chunkCount;
+};
+
+struct AssetArchiveEntry
+{
+	uint64_t offset;
+	uint64_t size;
+	// Into the names
+	uint32_t nameOffset;
+	uint32_t nameLength;
+	// Into the chunk table
+	uint32_t firstChunk;
+	uint32_t chunkCount;
+};
+
+struct AssetArchiveChunk
+{
+	// FNV-1a of the chunk's bytes. Not made to stand up to anyone forging chunks, the
+	// archives come from our own build machine.
+	uint64_t hash;
+};
+
+const uint32_t ASSETDELTA_MAGIC = 0x44413350; // "P3AD"
+const uint32_t ASSETDELTA_VERSION = 1;
+// A chunk whose bytes are in the delta, rather than in the archive it applies to
+const uint64_t ASSETDELTA_NEW = ~(uint64_t)0;
+
+// A delta is this header, then the new archive up to its files (headBytes, the header to
+// the chunk table), then where each of its chunks comes from, an offset into the old
+// archive or ASSETDELTA_NEW, then the bytes of the new chunks in order.
+struct AssetDeltaHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	// assetArchiveId of the archive it applies to and of the one it makes
+	uint64_t baseId;
+	uint64_t targetId;
+	uint64_t targetSize;
+	uint64_t headBytes;
+	uint32_t chunkCount;
+	uint32_t newChunks;
+};
+
+class AssetArchive
+{
+public:
+	AssetArchive();
+	~AssetArchive();
+
+	AssetArchive(const AssetArchive&) = delete;
+	AssetArchive& operator=(const AssetArchive&) = delete;
+
+	// Maps the archive and reads its table of contents. Open it before anything else may
+	// look for files in it, the workers included; lookups do not lock.
+	// With intoLargePages the whole archive is read into large pages (LargePages.h) and the
+	// mapping closed again, since a view of a file cannot be in large pages. That reads all
+	// of it up front, where the mapping only faults in what is used.
+	bool open(const char* filename, bool intoLargePages = false);
+	void close();
+	bool isOpen() const { return copy || file.isOpen(); }
+	size_t size() const { return entries.size(); }
+
+	//! A file in the archive.
+	// @input name The path it would be opened by
+	// @input data Receives a view of its bytes, valid until the archive is closed
+	//
+	// @return Returns false if the archive is not open or has no such file
+	bool find(const char* name, const unsigned char*& data, size_t& size) const;
+
+	// The name a path is stored under
+	static std::string entryName(const std::string& path);
+
+private:
+	struct Span
+	{
+		const unsigned char* data;
+		size_t size;
+	};
+
+	MappedFile file;
+	// The archive read into large pages, in place of the mapping
+	unsigned char* copy;
+	size_t copyBytes;
+	std::unordered_map<std::string, Span> entries;
+};
+
+// The archive of this run, opened in main() when there is one
+AssetArchive& assetArchive();
+
+// A whole text file, from the archive if it has it and from disk otherwise. False if
+// neither has it.
+bool readAssetText(const char* filename, std::string& text);
+
+// A file to pack, read from path and stored under name
+struct AssetArchiveFile
+{
+	std::string name;
+	std::string path;
+};
+
+// Writes files into an archive, in the order given. False if any cannot be read or the
+// archive cannot be written.
+bool writeAssetArchive(const char* filename, const std::vector<AssetArchiveFile>& files);
+
+// What an archive holds, a hash of its header, table, names and chunk hashes. 0 if the
+// file is not an archive.
+uint64_t assetArchiveId(const char* filename);
+
+//! Writes the delta that makes target out of base.
+// @return False if either is not an archive or the delta cannot be written
+bool writeAssetDelta(const char* base, const char* target, const char* delta);
+
+//! Brings archive up to the delta's target, through a new file next to it that replaces it
+// once every chunk is in and checked. An archive already at the target is left alone.
+// Nothing may have the archive open.
+// @input status Gets the line saying what was kept and what came from the delta: the log in
+//		the app, std::cout in the tools, which do not link it
+// @return False if the delta is not for this archive or anything in it does not check out;
+// the archive is then as it was
+bool applyAssetDelta(const char* archive, const char* delta, std::ostream& status);
+
+#endif
@@ -0,0 +1,198 @@
+#include "AssetLoader.h"
+#include "SharedAssetCache.h"
+#include "StartupProfiler.h"
+#include "TextureQuality.h"
+
+#include <algorithm>
+
+AssetLoader::AssetLoader(JobSystem& jobSystem) : jobSystem(jobSystem), pending(0), live(0), skippedCount(0),
+	discardedCount(0), compressedFormats(0)
+{
+}
+
+AssetLoader::~AssetLoader()
+{
+	// Workers write into the requests, so they have to be finished before those go away
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [this] { return finished.size() == pending; });
+}
+
+int AssetLoader::request(const std::string& filename, int maxSize, Priority priority)
+{
+	std::string key = maxSize > 0 ? filename + "@" + std::to_string(maxSize) : filename;
+	auto existing = byFilename.find(key);
+	if (existing != byFilename.end()) {
+		requests[existing->second]->refs++;
+		raise(existing->second, priority);
+		return existing->second;
+	}
+
+	int id = (int)requests.size();
+	requests.emplace_back(new Request());
+	Request* req = requests.back().get();
+	req->id = id;
+	req->filename = filename;
+	req->key = key;
+	req->maxSize = std::max(maxSize, 0);
+	req->refs = 1;
+	req->priority = priority;
+	byFilename[key] = id;
+	live++;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pending++;
+		waiting[priority].push_back(req);
+	}
+	// Not this request's job: each one loads whichever waits first when a worker gets to it
+	jobSystem.submit([this] { loadNext(); });
+	return id;
+}
+
+void AssetLoader::raise(int id, Priority priority)
+{
+	Request& req = *requests[id];
+	std::lock_guard<std::mutex> lock(mutex);
+	if (req.started || priority >= req.priority) {
+		return;
+	}
+	std::deque<Request*>& from = waiting[req.priority];
+	from.erase(std::find(from.begin(), from.end(), &req));
+	req.priority = priority;
+	waiting[priority].push_back(&req);
+}
+
+void AssetLoader::loadNext()
+{
+	Request* req = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (std::deque<Request*>& queue : waiting) {
+			if (!queue.empty()) {
+				req = queue.front();
+				queue.pop_front();
+				req->started = true;
+				break;
+			}
+		}
+	}
+	// The request this job was queued for was cancelled, and taken off the queue
+	if (req) {
+		load(*req);
+	}
+}
+
+void AssetLoader::load(Request& req)
+{
+	StartupScope scope("asset load", req.filename);
+	// What an earlier run had to decode is taken as it left it (assets.shared_cache_mb)
+	bool loaded = findSharedImage(req.filename, req.image);
+	if (!loaded && mapImage(req.filename.c_str(), req.image, compressedFormats, &arena)) {
+		loaded = true;
+		// Pixels that are not a view of a file were decoded here, the next run keeps them
+		if (!req.image.file.isOpen()) {
+			storeSharedImage(req.filename, req.image);
+		}
+	}
+	if (loaded) {
+		limitImageLevels(req.image, req.maxSize);
+		// Fault every page of the levels kept in here so the disk reads overlap across
+		// workers instead of happening one file at a time inside glTexImage2D on the GL
+		// thread (converted images are already resident, touching them costs nothing)
+		unsigned int sum = 0;
+		for (const ImageLevel& level : req.image.levels) {
+			const volatile unsigned char* bytes = level.data;
+			for (size_t offset = 0; offset < level.size; offset += 4096) {
+				sum += bytes[offset];
+			}
+			// Levels do not start on pages, the last one may be past the loop's
+			if (level.size) {
+				sum += bytes[level.size - 1];
+			}
+			scope.addBytes(level.size);
+		}
+		(void)sum;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		finished.push_back(req.id);
+	}
+	done.notify_all();
+}
+
+int AssetLoader::takeFinished()
+{
+	int id = finished.front();
+	finished.pop_front();
+	pending--;
+	Request& req = *requests[id];
+	if (req.cancelled) {
+		drop(req);
+		return -1;
+	}
+	req.delivered = true;
+	return id;
+}
+
+int AssetLoader::waitNext()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (pending > 0) {
+		done.wait(lock, [this] { return !finished.empty(); });
+		int id = takeFinished();
+		if (id != -1) {
+			return id;
+		}
+	}
+	return -1;
+}
+
+int AssetLoader::pollNext()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	while (!finished.empty()) {
+		int id = takeFinished();
+		if (id != -1) {
+			return id;
+		}
+	}
+	return -1;
+}
+
+void AssetLoader::release(int id)
+{
+	Request& req = *requests[id];
+	if (req.refs == 0 || --req.refs > 0) {
+		return;
+	}
+	// A later request for the same file has to load it again
+	byFilename.erase(req.key);
+	if (req.delivered) {
+		drop(req);
+		return;
+	}
+
+	// Cancelled: it is never delivered, and its pixels go once a worker is done with them
+	std::lock_guard<std::mutex> lock(mutex);
+	req.cancelled = true;
+	if (req.started) {
+		discardedCount++;
+		return;
+	}
+	// No worker has it yet, none will, and it is finished as far as pending goes
+	std::deque<Request*>& queue = waiting[req.priority];
+	queue.erase(std::find(queue.begin(), queue.end(), &req));
+	req.started = true;
+	finished.push_back(id);
+	skippedCount++;
+}
+
+void AssetLoader::drop(Request& req)
+{
+	req.image.levels.clear();
+	req.image.file.close();
+	if (--live == 0) {
+		arena.release();
+	}
+}
@@ -0,0 +1,117 @@
+#ifndef _ASSET_LOADER_H_
+#define _ASSET_LOADER_H_
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Image.h"
+#include "ImageArena.h"
+#include "JobSystem.h"
+
+// Maps and pages in image files (or their texture caches) as jobs. Completed
+// requests are handed back in completion order so the GL thread can upload each one as
+// soon as it is ready. Requests are identified by the id returned from request().
+//
+// Requests for a file that is already loading or loaded share one id, so every file is
+// mapped and paged in once however often it is asked for. A request with a maxSize only
+// keeps the levels limitImageLevels (TextureQuality.h) leaves and pages in just those, it
+// shares an id only with requests of the same file and maxSize. Each request() has to be
+// matched by a release(); the mapping is dropped when the last one is released.
+//
+// Requests wait for a worker in order of their Priority, first come first served within
+// one, so what is drawn now is not queued behind a set of environments only prefetched.
+// Asking again for a request still waiting, at a higher priority, moves it up (raise()).
+// The id is the cancellation token: releasing a request before it is delivered cancels it,
+// and once nothing else holds it a request no worker has started is dropped without its
+// file being opened. One already loading finishes and is thrown away, never delivered.
+//
+// Pixels that have to be converted before upload live in an arena owned by the loader,
+// which is given back in one go whenever every request has been released.
+class AssetLoader
+{
+public:
+	explicit AssetLoader(JobSystem& jobSystem);
+	~AssetLoader();
+
+	AssetLoader(const AssetLoader&) = delete;
+	AssetLoader& operator=(const AssetLoader&) = delete;
+
+	enum Priority { VISIBLE, SOON, PREFETCH, PRIORITIES };
+
+	int request(const std::string& filename, int maxSize = 0, Priority priority = VISIBLE);
+	//! Moves a request still waiting for a worker up to priority, if that is higher
+	void raise(int id, Priority priority);
+
+	// Returns the id of the next finished request, or -1 once nothing is outstanding.
+	// waitNext blocks for one to finish, pollNext returns -1 if none has yet. An id is
+	// returned once, even if it was requested several times; delivered() tells whether a
+	// coalesced request had already been handed out before it was asked for again.
+	int waitNext();
+	int pollNext();
+	bool delivered(int id) const { return requests[id]->delivered; }
+
+	// Texture caches are used when present; compressed ones only in the CompressedFormats
+	// set here
+	void setCompressedFormats(unsigned formats) { compressedFormats = formats; }
+
+	// The decoded image for a finished request. Only touch it from the GL thread, or the
+	// upload thread it is handed to until it is released.
+	Image& image(int id) { return requests[id]->image; }
+	const std::string& filename(int id) const { return requests[id]->filename; }
+
+	// Drops the mapping once its pixels have been uploaded by every requester, or cancels
+	// the request if it is not delivered yet
+	void release(int id);
+
+	size_t outstanding() const { return pending; }
+	// Requests cancelled before a worker opened their file, and after
+	size_t skipped() const { return skippedCount; }
+	size_t discarded() const { return discardedCount; }
+
+private:
+	struct Request
+	{
+		int id = 0;
+		std::string filename;
+		// What byFilename has it under, the filename and any maxSize
+		std::string key;
+		int maxSize = 0;
+		Image image;
+		int refs = 0;
+		bool delivered = false;
+		// Under the mutex: the queue it waits in, whether a worker took it, and whether it
+		// was released before it was delivered
+		Priority priority = VISIBLE;
+		bool started = false;
+		bool cancelled = false;
+	};
+
+	// A worker's job: loads the first request waiting, by priority
+	void loadNext();
+	void load(Request& req);
+	// Takes the next finished id off the list, with the mutex held. Cancelled ones are
+	// dropped, -1 once none is left.
+	int takeFinished();
+	void drop(Request& req);
+
+	JobSystem& jobSystem;
+	ImageArena arena;
+	std::vector<std::unique_ptr<Request>> requests;
+	std::unordered_map<std::string, int> byFilename;
+	std::deque<int> finished;
+	std::deque<Request*> waiting[PRIORITIES];
+	size_t pending;
+	size_t live;
+	size_t skippedCount;
+	size_t discardedCount;
+	unsigned compressedFormats;
+	std::mutex mutex;
+	std::condition_variable done;
+};
+
+#endif
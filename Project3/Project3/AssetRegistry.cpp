@@ -0,0 +1,435 @@
+#include "AssetRegistry.h"
+#include "TextureUpload.h"
+#include "StartupProfiler.h"
+#include "UploadThread.h"
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+
+// Levels no bigger than this on their longer side are the mip tail, uploaded at once
+static const int PROGRESSIVE_TAIL_SIZE = 64;
+
+// True if the images carry the same precomputed mip chain, which can be streamed in a
+// level at a time
+static bool hasLevels(const std::vector<const Image*>& images)
+{
+	size_t levels = images[0]->levels.size();
+	return levels > 1 && std::all_of(images.begin(), images.end(),
+		[levels](const Image* image) { return image->levels.size() == levels; });
+}
+
+AssetRegistry::AssetRegistry(JobSystem& jobSystem, UploadRing* ring) : loader(jobSystem), ring(ring)
+{
+	loader.setCompressedFormats(compressedCacheFormats());
+}
+
+AssetRegistry::~AssetRegistry()
+{
+	// Their callbacks point back in here
+	if (threadedUploads) {
+		uploadThread().finish();
+	}
+}
+
+void AssetRegistry::declare(const TextureAsset& asset)
+{
+	Entry& entry = entries[asset.name];
+	entry.name = asset.name;
+	entry.target = asset.target;
+	entry.files = asset.files;
+	entry.key = keyOf(entry);
+}
+
+void AssetRegistry::declare(const TextureAsset* assets, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		declare(assets[i]);
+	}
+}
+
+void AssetRegistry::limitSize(const std::string& name, int maxSize)
+{
+	Entry* entry = find(name);
+	if (entry) {
+		entry->maxSize = std::max(maxSize, 0);
+		entry->key = keyOf(*entry);
+	}
+}
+
+std::string AssetRegistry::keyOf(const Entry& entry)
+{
+	std::string key = entry.target == GL_TEXTURE_CUBE_MAP ? TextureRegistry::keyCube(entry.files)
+		: TextureRegistry::key2D(entry.files[0]);
+	return entry.maxSize ? key + "@" + std::to_string(entry.maxSize) : key;
+}
+
+AssetRegistry::Entry* AssetRegistry::find(const std::string& name)
+{
+	auto it = entries.find(name);
+	if (it == entries.end()) {
+		std::cerr << "unknown texture asset " << name << std::endl;
+		return nullptr;
+	}
+	return &it->second;
+}
+
+GLuint AssetRegistry::get(const std::string& name)
+{
+	Entry* entry = find(name);
+	if (!entry) {
+		return 0;
+	}
+	request(*entry, AssetLoader::VISIBLE);
+	// Other files that finish meanwhile are only queued, this waits for just this one
+	while (!entry->texture && !entry->failed) {
+		if (entry->queued) {
+			finishUpload(*entry);
+			break;
+		}
+		int id = loader.waitNext();
+		if (id == -1) {
+			break;
+		}
+		deliver(id);
+	}
+	textures.touch(entry->key, frame);
+	return entry->texture;
+}
+
+void AssetRegistry::prefetch(const std::string& name, AssetLoader::Priority priority)
+{
+	Entry* entry = find(name);
+	if (entry) {
+		request(*entry, priority);
+		textures.touch(entry->key, frame);
+	}
+}
+
+void AssetRegistry::cancel(const std::string& name)
+{
+	Entry* entry = find(name);
+	// Once it is resident or being made the files are in, there is nothing left to save
+	if (!entry || !entry->requested || entry->texture || entry->building || entry->threaded || entry->failed) {
+		return;
+	}
+	if (entry->queued) {
+		uploads.erase(std::find(uploads.begin(), uploads.end(), entry));
+	}
+	releaseFaces(*entry);
+	entry->remaining = 0;
+	entry->requested = false;
+	cancelCount++;
+}
+
+size_t AssetRegistry::update(size_t byteBudget)
+{
+	frame++;
+	uploadThread().poll();
+	for (int id = loader.pollNext(); id != -1; id = loader.pollNext()) {
+		deliver(id);
+	}
+
+	size_t left = byteBudget;
+	uploadedBytes = 0;
+	while (!uploads.empty() && left > 0) {
+		if (!upload(*uploads.front(), left)) {
+			break;
+		}
+		uploads.pop_front();
+	}
+	if (budget) {
+		// Textures still streaming in are written to, they stay whether drawn or not
+		for (Entry* entry : uploads) {
+			if (entry->texture) {
+				textures.touch(entry->key, frame);
+			}
+		}
+		evict();
+	}
+	return uploadedBytes;
+}
+
+void AssetRegistry::evict()
+{
+	std::vector<std::string> evicted;
+	textures.evict(budget, frame > 1 ? frame - 1 : 0, evicted);
+	// Every asset of the same files had the same texture, and asks for it again
+	for (const std::string& key : evicted) {
+		for (auto& it : entries) {
+			Entry& entry = it.second;
+			if (entry.key == key && entry.texture) {
+				entry.texture = 0;
+				entry.requested = false;
+			}
+		}
+		evictionCount++;
+		residencyVersion++;
+	}
+}
+
+void AssetRegistry::report(std::ostream& out) const
+{
+	if (!cancelCount) {
+		return;
+	}
+	out << "textures: " << cancelCount << " cancelled, " << loader.skipped() << " files dropped before loading and "
+		<< loader.discarded() << " after" << std::endl;
+}
+
+bool AssetRegistry::resident(const std::string& name) const
+{
+	auto it = entries.find(name);
+	return it != entries.end() && it->second.texture != 0;
+}
+
+bool AssetRegistry::failed(const std::string& name) const
+{
+	auto it = entries.find(name);
+	return it != entries.end() && it->second.failed;
+}
+
+void AssetRegistry::request(Entry& entry, AssetLoader::Priority priority)
+{
+	if (entry.requested) {
+		// Wanted sooner than it was: what of it no worker has started on moves up
+		if (priority < entry.priority) {
+			entry.priority = priority;
+			for (int id : entry.faces) {
+				loader.raise(id, priority);
+			}
+		}
+		return;
+	}
+	entry.requested = true;
+	entry.priority = priority;
+
+	// Another asset may already have uploaded the same files to the same target
+	if (GLuint existing = textures.find(entry.key)) {
+		entry.texture = existing;
+		return;
+	}
+
+	// Again after an eviction, from the first face
+	entry.remaining = 0;
+	entry.nextFace = 0;
+	for (const std::string& file : entry.files) {
+		int id = loader.request(file, entry.maxSize, priority);
+		entry.faces.push_back(id);
+		if (!loader.delivered(id)) {
+			entry.remaining++;
+		}
+	}
+	if (!entry.remaining) {
+		enqueue(entry);
+	}
+}
+
+void AssetRegistry::deliver(int id)
+{
+	for (auto& it : entries) {
+		Entry& entry = it.second;
+		if (entry.faces.empty() || entry.queued) {
+			continue;
+		}
+		entry.remaining -= std::count(entry.faces.begin(), entry.faces.end(), id);
+		if (entry.remaining == 0) {
+			enqueue(entry);
+		}
+	}
+}
+
+void AssetRegistry::enqueue(Entry& entry)
+{
+	entry.queued = true;
+	if (uploadThread().running() && uploadThreaded(entry)) {
+		return;
+	}
+	// Ahead of what was asked for at a lower priority, unless that has started
+	auto at = std::find_if(uploads.begin(), uploads.end(), [&entry](const Entry* queued) {
+		return queued->priority > entry.priority && !queued->building;
+	});
+	uploads.insert(at, &entry);
+}
+
+bool AssetRegistry::uploadThreaded(Entry& entry)
+{
+	std::vector<const Image*> images;
+	for (int id : entry.faces) {
+		images.push_back(&loader.image(id));
+	}
+	// What needs no upload is settled by upload() as before
+	if (textures.find(entry.key) ||
+		std::any_of(images.begin(), images.end(), [](const Image* image) { return !image->valid(); })) {
+		return false;
+	}
+	// Streamed in level by level on this thread instead
+	if (progressive && hasLevels(images)) {
+		return false;
+	}
+
+	// The images stay where they are, the loader's, until the texture is handed out
+	entry.threaded = true;
+	threadedUploads++;
+	std::shared_ptr<GLuint> made = std::make_shared<GLuint>(0);
+	uint64_t bytes = imageTextureBytes(entry.target, *images[0]);
+	std::string name = entry.name;
+	GLenum target = entry.target;
+	uploadThread().submit([images, target, made, name] {
+		StartupScope scope("texture upload", name);
+		*made = target == GL_TEXTURE_CUBE_MAP ? createCubeTexture(images) : create2DTexture(*images[0]);
+		for (const Image* image : images) {
+			for (const ImageLevel& level : image->levels) {
+				scope.addBytes(level.size);
+			}
+		}
+	}, [this, &entry, made, bytes] {
+		entry.texture = *made;
+		makeResident(entry, bytes);
+		entry.threaded = false;
+		threadedUploads--;
+		releaseFaces(entry);
+	});
+	return true;
+}
+
+bool AssetRegistry::upload(Entry& entry, size_t& budget, bool untilVisible)
+{
+	StartupScope scope("texture upload", entry.name);
+	std::vector<const Image*> images;
+	for (int id : entry.faces) {
+		images.push_back(&loader.image(id));
+	}
+
+	if (!entry.building) {
+		if (GLuint existing = textures.find(entry.key)) {
+			entry.texture = existing;
+		}
+		else if (std::any_of(images.begin(), images.end(), [](const Image* image) { return !image->valid(); })) {
+			std::cerr << "texture asset " << entry.key << " failed to load" << std::endl;
+			entry.failed = true;
+		}
+		else {
+			entry.building = createTextureStorage(entry.target, *images[0]);
+			entry.progressive = progressive && hasLevels(images);
+			entry.nextLevel = images[0]->levels.size();
+		}
+	}
+
+	if (entry.building && entry.progressive) {
+		if (!uploadLevels(entry, images, budget, untilVisible, scope)) {
+			return false;
+		}
+		releaseFaces(entry);
+		return true;
+	}
+
+	while (entry.building && entry.nextFace < images.size()) {
+		if (budget == 0) {
+			return false;
+		}
+		const Image& face = *images[entry.nextFace];
+		uploadTextureFace(entry.building, entry.target, (int)entry.nextFace, face, ring);
+		entry.nextFace++;
+
+		size_t bytes = 0;
+		for (const ImageLevel& level : face.levels) {
+			bytes += level.size;
+		}
+		scope.addBytes(bytes);
+		uploadedBytes += bytes;
+		budget -= bytes < budget ? bytes : budget;
+	}
+
+	// Only handed out once complete, so a texture is never sampled half uploaded
+	if (entry.building) {
+		finishTexture(entry.building, entry.target, *images[0]);
+		entry.texture = entry.building;
+		entry.building = 0;
+		makeResident(entry, imageTextureBytes(entry.target, *images[0]));
+	}
+
+	releaseFaces(entry);
+	return true;
+}
+
+bool AssetRegistry::uploadLevels(Entry& entry, const std::vector<const Image*>& images, size_t& budget,
+	bool untilVisible, StartupScope& scope)
+{
+	GLint top = (GLint)images[0]->levels.size() - 1;
+	auto spend = [&](size_t bytes) {
+		scope.addBytes(bytes);
+		uploadedBytes += bytes;
+		budget -= bytes < budget ? bytes : budget;
+	};
+
+	// The tail goes whatever the budget, so there is something to draw from the first frame
+	if (!entry.texture) {
+		size_t tail = (size_t)top;
+		while (tail > 0 && std::max(images[0]->levels[tail - 1].width, images[0]->levels[tail - 1].height) <= PROGRESSIVE_TAIL_SIZE) {
+			tail--;
+		}
+		for (size_t face = 0; face < images.size(); face++) {
+			for (size_t level = tail; level <= (size_t)top; level++) {
+				uploadTextureLevel(entry.building, entry.target, (int)face, *images[face], level, ring);
+				spend(images[face]->levels[level].size);
+			}
+		}
+		entry.nextLevel = tail;
+		clampTextureLevels(entry.building, entry.target, (GLint)tail, top);
+		entry.texture = entry.building;
+		makeResident(entry, imageTextureBytes(entry.target, *images[0]));
+		if (untilVisible && entry.nextLevel > 0) {
+			return false;
+		}
+	}
+
+	while (entry.nextLevel > 0) {
+		size_t level = entry.nextLevel - 1;
+		while (entry.nextFace < images.size()) {
+			if (budget == 0) {
+				return false;
+			}
+			const Image& face = *images[entry.nextFace];
+			uploadTextureLevel(entry.building, entry.target, (int)entry.nextFace, face, level, ring);
+			spend(face.levels[level].size);
+			entry.nextFace++;
+		}
+		entry.nextFace = 0;
+		entry.nextLevel = level;
+		clampTextureLevels(entry.building, entry.target, (GLint)level, top);
+		residencyVersion++;
+	}
+
+	entry.building = 0;
+	return true;
+}
+
+void AssetRegistry::makeResident(Entry& entry, uint64_t bytes)
+{
+	textures.add(entry.key, entry.texture, bytes);
+	textures.touch(entry.key, frame);
+	residencyVersion++;
+}
+
+void AssetRegistry::releaseFaces(Entry& entry)
+{
+	for (int id : entry.faces) {
+		loader.release(id);
+	}
+	entry.faces.clear();
+	entry.queued = false;
+}
+
+void AssetRegistry::finishUpload(Entry& entry)
+{
+	if (entry.threaded) {
+		uploadThread().finish();
+		return;
+	}
+	// A progressive texture is wanted as soon as it can be drawn, update() streams the rest
+	size_t unlimited = SIZE_MAX;
+	if (upload(entry, unlimited, true)) {
+		uploads.erase(std::find(uploads.begin(), uploads.end(), &entry));
+	}
+}
@@ -0,0 +1,176 @@
+#ifndef _ASSET_REGISTRY_H_
+#define _ASSET_REGISTRY_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+#include <deque>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "AssetLoader.h"
+#include "StartupProfiler.h"
+#include "TextureRegistry.h"
+#include "UploadRing.h"
+
+// Describes one texture the scene may use: GL_TEXTURE_CUBE_MAP with six faces in
+// +X -X +Y -Y +Z -Z order, or GL_TEXTURE_2D with one file
+struct TextureAsset
+{
+	const char* name;
+	GLenum target;
+	std::vector<std::string> files;
+};
+
+// Textures by name, loaded only once something asks for them. Declaring an asset costs
+// nothing; get() loads and uploads it on first use, prefetch() starts loading it in the
+// background so that a later get() finds it ready. Textures with the same target and
+// files share one GL texture through the TextureRegistry. Only use from the GL thread.
+//
+// Prefetched textures are uploaded by update() a few faces per frame, and only become
+// resident (and returned by get() without blocking) once every face and mip is in. With the
+// upload thread running they are made there in one go instead, and become resident from
+// update() once the GPU has them.
+//
+// With a budget (setBudget) the resident textures are kept under it: update() evicts the
+// least recently used ones, get() and prefetch() marking them used. A texture used this
+// frame or the last is never evicted, the budget is exceeded instead. An evicted texture
+// is loaded again when it is next asked for, through the background path for prefetch().
+//
+// Progressive (setProgressive) textures whose files carry their mips, the texture caches,
+// are streamed in from the smallest level up instead, on the GL thread. The mip tail goes
+// in one step and the texture is handed out right away, get() not waiting for more, then
+// update() adds a level of every face at a time within its byte budget, each one lowering
+// GL_TEXTURE_BASE_LEVEL once all faces have it.
+//
+// Files load in the order of the priority they were asked for at, see AssetLoader: get() at
+// VISIBLE, prefetch() at what it is given, and asking again at a higher one moves them up.
+// Textures loaded have their uploads queued by the same priority. cancel() gives up on a
+// texture no longer wanted, a set of environments switched away from before it was in,
+// dropping the files no worker has opened yet instead of loading them only to throw them away.
+//
+// A texture given a size limit (limitSize) is loaded without its mips above it, see
+// TextureQuality.h. It is a texture of its own, not shared with one of the same files
+// limited otherwise or not at all.
+class AssetRegistry
+{
+public:
+	AssetRegistry(JobSystem& jobSystem, UploadRing* ring);
+	~AssetRegistry();
+
+	AssetRegistry(const AssetRegistry&) = delete;
+	AssetRegistry& operator=(const AssetRegistry&) = delete;
+
+	void declare(const TextureAsset& asset);
+	void declare(const TextureAsset* assets, size_t count);
+
+	// The longer side name's largest level needs (textureSizeLimit), 0 for all of them. Only
+	// before the texture is first asked for.
+	void limitSize(const std::string& name, int maxSize);
+
+	// The texture for name, blocking until it is uploaded if it is not yet. Returns 0 for
+	// an unknown name or an asset that failed to load.
+	GLuint get(const std::string& name);
+
+	// Starts loading name if it is not loaded or loading already, at priority. Marks it used
+	// if it is, so a texture prefetched every frame stays resident.
+	void prefetch(const std::string& name, AssetLoader::Priority priority = AssetLoader::PREFETCH);
+	// Gives up on loading name, if it is not resident or uploading yet. Files it shares with
+	// textures still asked for keep loading for them.
+	void cancel(const std::string& name);
+
+	// Uploads prefetched textures whose files have finished loading, without blocking on
+	// the loader. At most byteBudget bytes are uploaded, but always at least one face so
+	// that progress is made, and none with 0. Call once a frame.
+	// @return The bytes uploaded
+	size_t update(size_t byteBudget = SIZE_MAX);
+
+	// True once get() returns the texture without waiting, for a progressive one maybe
+	// before its full resolution levels are in
+	bool resident(const std::string& name) const;
+	// True once a file of name could not be loaded, it is not tried again
+	bool failed(const std::string& name) const;
+
+	void setProgressive(bool enable) { progressive = enable; }
+	// Changes whenever what a texture draws with does: one made resident or evicted, or a
+	// finer level of a progressive one streamed in
+	uint64_t version() const { return residencyVersion; }
+
+	// Bytes of resident textures update() keeps to, 0 for no limit
+	void setBudget(uint64_t bytes) { budget = bytes; }
+	uint64_t budgetBytes() const { return budget; }
+	uint64_t residentBytes() const { return textures.residentBytes(); }
+	// Textures evicted so far
+	size_t evictions() const { return evictionCount; }
+	void report(std::ostream& out) const;
+
+private:
+	struct Entry
+	{
+		std::string name;
+		GLenum target;
+		std::vector<std::string> files;
+		std::string key;
+		int maxSize = 0;
+		std::vector<int> faces;
+		size_t remaining = 0;
+		GLuint texture = 0;
+		GLuint building = 0;
+		size_t nextFace = 0;
+		bool requested = false;
+		// What it was last asked for at, while requested
+		AssetLoader::Priority priority = AssetLoader::PREFETCH;
+		bool queued = false;
+		// Being made on the upload thread
+		bool threaded = false;
+		// Streamed in from the smallest level, levels below nextLevel still to come
+		bool progressive = false;
+		size_t nextLevel = 0;
+		bool failed = false;
+	};
+
+	Entry* find(const std::string& name);
+	static std::string keyOf(const Entry& entry);
+	void request(Entry& entry, AssetLoader::Priority priority);
+	void deliver(int id);
+	void enqueue(Entry& entry);
+	// Uploads faces of entry until budget runs out. True once it is resident or failed.
+	// untilVisible stops a progressive entry once it is handed out.
+	bool upload(Entry& entry, size_t& budget, bool untilVisible = false);
+	// The progressive part of upload(), true once every level is in
+	bool uploadLevels(Entry& entry, const std::vector<const Image*>& images, size_t& budget,
+		bool untilVisible, StartupScope& scope);
+	void finishUpload(Entry& entry);
+	// Hands the entry to the upload thread, false if it has nothing to upload
+	bool uploadThreaded(Entry& entry);
+	void releaseFaces(Entry& entry);
+	// Registers entry's finished texture, used from this frame on
+	void makeResident(Entry& entry, uint64_t bytes);
+	void evict();
+
+	AssetLoader loader;
+	TextureRegistry textures;
+	UploadRing* ring;
+	std::unordered_map<std::string, Entry> entries;
+	std::deque<Entry*> uploads;
+	size_t threadedUploads = 0;
+	// Bytes uploaded since update() began
+	size_t uploadedBytes = 0;
+	// Counts update() calls, the frames textures are used in
+	uint64_t frame = 0;
+	uint64_t residencyVersion = 0;
+	uint64_t budget = 0;
+	size_t evictionCount = 0;
+	size_t cancelCount = 0;
+	bool progressive = false;
+};
+
+#endif
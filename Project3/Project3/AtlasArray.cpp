@@ -0,0 +1,139 @@
+#include "AtlasArray.h"
+#include "BindlessTextures.h"
+#include "GLState.h"
+#include "GLStats.h"
+#include "GpuMemory.h"
+#include "TextureUpload.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+AtlasArray::AtlasArray() : header(), nextLevel(0), texture(0)
+{
+}
+
+AtlasArray::~AtlasArray()
+{
+	release();
+}
+
+void AtlasArray::release()
+{
+	if (texture) {
+		bindlessTextures().forget(texture);
+		gpuMemory().release(GpuMemory::KIND_TEXTURE, texture);
+		glDeleteTextures(1, &texture);
+		texture = 0;
+	}
+	entries.clear();
+	pages.clear();
+	queue.clear();
+	file.close();
+}
+
+bool AtlasArray::load(const char* filename)
+{
+	release();
+	if (!file.open(filename) || file.size() < sizeof(TexAtlasHeader)) {
+		std::cerr << "texture atlas " << filename << " not found" << std::endl;
+		file.close();
+		return false;
+	}
+	memcpy(&header, file.data(), sizeof(header));
+	bool ok = header.magic == TEXATLAS_MAGIC && header.version == TEXATLAS_VERSION && header.pageSize &&
+		header.pageCount && header.levelCount && header.levelCount <= TEXATLAS_MAX_LEVELS &&
+		header.dataOffset >= sizeof(header) + (size_t)header.entryCount * sizeof(TexAtlasEntry) &&
+		file.size() >= atlasLevelOffset(header, header.pageCount, 0);
+	GLint maxLayers = 0, maxSize = 0;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+	if (!ok || header.pageCount > (uint32_t)maxLayers || header.pageSize > (uint32_t)maxSize) {
+		std::cerr << "texture atlas " << filename << " is not one this build can use" << std::endl;
+		file.close();
+		return false;
+	}
+	const TexAtlasEntry* first = (const TexAtlasEntry*)(file.data() + sizeof(header));
+	entries.assign(first, first + header.entryCount);
+	for (TexAtlasEntry& entry : entries) {
+		entry.name[sizeof(entry.name) - 1] = 0;
+	}
+	pages.assign(header.pageCount, ABSENT);
+
+	glGenTextures(1, &texture);
+	glState().bindTexture(0, GL_TEXTURE_2D_ARRAY, texture);
+	allocateTextureArrayStorage((GLsizei)header.levelCount, GL_RGBA8, header.pageSize, header.pageSize, header.pageCount);
+	// Only the levels the gutter still covers are there
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, (GLint)header.levelCount - 1);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glState().bindTexture(0, GL_TEXTURE_2D_ARRAY, 0);
+	gpuMemory().allocate(GpuMemory::KIND_TEXTURE, texture,
+		textureBytes(GL_RGBA8, header.pageSize, header.pageSize, header.pageCount, header.levelCount),
+		GpuMemory::TEXTURE, std::string("atlas ") + filename);
+	return true;
+}
+
+int AtlasArray::find(const std::string& name) const
+{
+	for (size_t i = 0; i < entries.size(); i++) {
+		if (name == entries[i].name) {
+			return (int)i;
+		}
+	}
+	return -1;
+}
+
+AtlasTile AtlasArray::tile(size_t i)
+{
+	const TexAtlasEntry& entry = entries[i];
+	if (pages[entry.page] == RESIDENT) {
+		return atlasTile(entry, header.pageSize);
+	}
+	if (pages[entry.page] == ABSENT) {
+		pages[entry.page] = REQUESTED;
+		queue.push_back(entry.page);
+	}
+	return noAtlasTile();
+}
+
+bool AtlasArray::update(size_t byteBudget, size_t* uploaded)
+{
+	if (uploaded) {
+		*uploaded = 0;
+	}
+	if (queue.empty() || byteBudget == 0) {
+		return false;
+	}
+	bool completed = false;
+	size_t spent = 0;
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glState().bindTexture(0, GL_TEXTURE_2D_ARRAY, texture);
+	// Rows of RGB8 are not padded to 4 bytes in the file
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	while (!queue.empty() && (spent == 0 || spent < byteBudget)) {
+		uint32_t page = queue.front();
+		GLsizei side = (GLsizei)std::max(header.pageSize >> nextLevel, 1u);
+		const unsigned char* pixels = file.data() + atlasLevelOffset(header, page, nextLevel);
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, (GLint)nextLevel, 0, 0, (GLint)page, side, side, 1, GL_RGB, GL_UNSIGNED_BYTE,
+			pixels);
+		size_t bytes = (size_t)side * side * 3;
+		glStats().addUpload(bytes);
+		spent += bytes;
+		// A page is only sampled once every level of it is in
+		if (++nextLevel == header.levelCount) {
+			pages[page] = RESIDENT;
+			queue.pop_front();
+			nextLevel = 0;
+			completed = true;
+		}
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glState().bindTexture(0, GL_TEXTURE_2D_ARRAY, 0);
+	if (uploaded) {
+		*uploaded = spent;
+	}
+	return completed;
+}
@@ -0,0 +1,71 @@
+#ifndef _ATLAS_ARRAY_H_
+#define _ATLAS_ARRAY_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "Image.h"
+#include "TextureAtlas.h"
+
+// A texture atlas (.p3ta) as a GL_TEXTURE_2D_ARRAY, a layer per page. The file stays mapped
+// and the array's storage is made for every page up front, but a page's pixels are only
+// uploaded once a tile on it is asked for, by update() a few levels per frame. Until then
+// its tiles have no image (layer -1) and draws fall back to whatever they had before.
+// Only use from the GL thread.
+class AtlasArray
+{
+public:
+	AtlasArray();
+	~AtlasArray();
+
+	AtlasArray(const AtlasArray&) = delete;
+	AtlasArray& operator=(const AtlasArray&) = delete;
+
+	//! Maps the atlas and makes the array for its pages. False, with nothing made, if the
+	// file is not an atlas this build reads.
+	bool load(const char* filename);
+	// Deletes the array, while the context is still there
+	void release();
+	bool valid() const { return texture != 0; }
+	GLuint id() const { return texture; }
+
+	size_t size() const { return entries.size(); }
+	const TexAtlasEntry& entry(size_t i) const { return entries[i]; }
+	// The entry called name, -1 for none
+	int find(const std::string& name) const;
+
+	//! Where entry i is, requesting its page if it is not resident. No image (layer -1)
+	// until it is.
+	AtlasTile tile(size_t i);
+	bool resident(uint32_t page) const { return page < pages.size() && pages[page] == RESIDENT; }
+
+	//! Uploads requested pages, at most byteBudget bytes but always at least one level so
+	// that progress is made, and none with 0. True if a page became resident, so tiles
+	// asked for before have an image now. Call once a frame.
+	// @input uploaded Set to the bytes uploaded, if not null
+	bool update(size_t byteBudget = SIZE_MAX, size_t* uploaded = nullptr);
+
+private:
+	enum PageState : uint8_t { ABSENT, REQUESTED, RESIDENT };
+
+	MappedFile file;
+	TexAtlasHeader header;
+	std::vector<TexAtlasEntry> entries;
+	std::vector<PageState> pages;
+	// Requested pages in order, and the next level of the first
+	std::deque<uint32_t> queue;
+	uint32_t nextLevel;
+	GLuint texture;
+};
+
+#endif
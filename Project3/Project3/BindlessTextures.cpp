@@ -0,0 +1,70 @@
+#include "BindlessTextures.h"
+
+#include <iostream>
+
+BindlessTextures::~BindlessTextures()
+{
+	// The context is usually gone by now, there is nothing left to make non-resident
+	handles.clear();
+}
+
+bool BindlessTextures::supported()
+{
+	return GLEW_ARB_bindless_texture != 0;
+}
+
+bool BindlessTextures::enable(bool on)
+{
+	if (on && !supported()) {
+		std::cerr << "ARB_bindless_texture not supported, binding textures to units" << std::endl;
+		on = false;
+	}
+	if (!on) {
+		clear();
+	}
+	active = on;
+	return active;
+}
+
+GLuint64 BindlessTextures::handle(GLuint texture)
+{
+	if (!active || !texture) {
+		return 0;
+	}
+	auto it = handles.find(texture);
+	if (it != handles.end()) {
+		return it->second;
+	}
+	GLuint64 made = glGetTextureHandleARB(texture);
+	if (!made) {
+		std::cerr << "no bindless handle for texture " << texture << std::endl;
+		return 0;
+	}
+	glMakeTextureHandleResidentARB(made);
+	handles[texture] = made;
+	return made;
+}
+
+void BindlessTextures::forget(GLuint texture)
+{
+	auto it = handles.find(texture);
+	if (it == handles.end()) {
+		return;
+	}
+	glMakeTextureHandleNonResidentARB(it->second);
+	handles.erase(it);
+}
+
+void BindlessTextures::clear()
+{
+	for (auto& entry : handles) {
+		glMakeTextureHandleNonResidentARB(entry.second);
+	}
+	handles.clear();
+}
+
+BindlessTextures& bindlessTextures()
+{
+	static BindlessTextures textures;
+	return textures;
+}
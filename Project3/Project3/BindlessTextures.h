@@ -0,0 +1,50 @@
+#ifndef _BINDLESS_TEXTURES_H_
+#define _BINDLESS_TEXTURES_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include <unordered_map>
+
+// Resident ARB_bindless_texture handles of the textures drawn with, made on first use and
+// kept until the texture is deleted. Shaders given a handle sample the texture without it
+// being bound to a unit.
+//
+// A handle fixes its texture's parameters, and a texture name can be reused after it is
+// deleted, so whatever deletes a texture calls forget() first.
+class BindlessTextures
+{
+public:
+	BindlessTextures() : active(false) {}
+	~BindlessTextures();
+
+	BindlessTextures(const BindlessTextures&) = delete;
+	BindlessTextures& operator=(const BindlessTextures&) = delete;
+
+	static bool supported();
+	// Handles are only made while enabled, enabling fails without the extension
+	bool enable(bool on);
+	bool enabled() const { return active; }
+
+	// The texture's resident handle, 0 for no texture
+	GLuint64 handle(GLuint texture);
+	// Makes the texture's handle non-resident and drops it, before the texture goes away
+	void forget(GLuint texture);
+	void clear();
+
+	size_t residentCount() const { return handles.size(); }
+
+private:
+	bool active;
+	std::unordered_map<GLuint, GLuint64> handles;
+};
+
+// The handles of the GL context everything draws into
+BindlessTextures& bindlessTextures();
+
+#endif
@@ -1,64 +1,197 @@
 #include "Box.h"
+#include "TextureUpload.h"
+#include "TextureCache.h"
+#include "GLState.h"
+#include "MeshPool.h"
+#include "GLStats.h"
+#include "GpuMemory.h"
+#include "FrameRing.h"
+#include "GLExtensions.h"
 
 Box::Box()
 {
-	// Create array object and buffers. Remember to delete your buffers when the object is destroyed!
-	glGenVertexArrays(1, &(this->VAO));
-	glGenBuffers(1, &(this->VBO));
-	glGenBuffers(1, &(this->EBO));
-
-	// Bind the Vertex Array Object (VAO) first, then bind the associated buffers to it.
-	// Consider the VAO as a container for all your buffers.
-	glBindVertexArray(this->VAO);
-	glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-	
-	// We've sent the vertex data over to OpenGL, but there's still something missing.
-	// In what order should it draw those vertices? That's why we'll need a GL_ELEMENT_ARRAY_BUFFER for this.
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-
-
-	//Set the vertex attribute pointers
-	// Vertex Positions
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0,3,GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0); 
-
-	// Unbind the currently bound buffer so that we don't accidentally make unwanted changes to it.
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	// Unbind the VAO now so we don't accidentally tamper with it.
-	// NOTE: You must NEVER unbind the element array buffer associated with a VAO!
-	glBindVertexArray(0);
+	// Every Box is the same cube in the mesh pool, only its transform and texture are its own
+	this->VAO = meshPool().vertexArray();
+	this->VBO = meshPool().vertexBuffer();
+	this->EBO = meshPool().indexBuffer();
 }
 
 Box::~Box()
 {
-	// Delete previously generated buffers. Note that forgetting to do this can waste GPU memory in a 
-	// large project! This could crash the graphics driver due to memory leaks, or slow down application performance!
-	glDeleteVertexArrays(1, &(this->VAO));
-	glDeleteBuffers(1, &(this->VBO));
-	glDeleteBuffers(1, &(this->EBO));
+	// Only the instanced vertex array and transforms are this Box's
+	if (instanceVBO) {
+		glDeleteVertexArrays(1, &(this->VAO));
+		gpuMemory().release(GpuMemory::KIND_BUFFER, instanceVBO);
+		glDeleteBuffers(1, &instanceVBO);
+	}
 }
 
 void Box::draw(GLuint shaderProgram, GLuint boxtexture)
 {	
-	// Draw the Box. We simply need to bind the VAO associated with it.
-	glBindVertexArray(this->VAO);
-	//Textures
-	glActiveTexture(GL_TEXTURE0);
-	glUniform1i(glGetUniformLocation(shaderProgram, "cubebox"), 0);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, boxtexture);
-	// Tell OpenGL to draw with triangles, using 36 indices, the type of the indices, and the offset to start from
-	glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-	// Unbind the VAO when we're done so we don't accidentally draw extra stuff or tamper with its bound buffers
-	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
-	glBindVertexArray(0);
+	// Draw the Box. We simply need to bind the VAO associated with it (the state tracker
+	// leaves it bound, the next draw of this Box has nothing to bind).
+	glState().polygonMode(GL_FILL);
+	glState().bindVertexArray(this->VAO);
+	//Textures (the program's cubebox sampler is set to unit 0 when it is loaded, 0 means the
+	//caller has set it already, to a unit or a bindless handle)
+	if (boxtexture)
+		glState().bindTexture(0, GL_TEXTURE_CUBE_MAP, boxtexture);
+	// Tell OpenGL to draw with triangles, using the cube's 36 indices from where it is in the pool
+	const MeshRange& cube = meshPool().mesh(MeshPool::BOX);
+	glDrawElementsBaseVertex(GL_TRIANGLES, cube.indexCount, GL_UNSIGNED_INT, cube.indexOffset(), cube.baseVertex);
+}
+
+void Box::drawInstanced(GLuint shaderProgram, GLuint boxtexture, GLsizei instances)
+{
+	glState().polygonMode(GL_FILL);
+	glState().bindVertexArray(this->VAO);
+	if (boxtexture)
+		glState().bindTexture(0, GL_TEXTURE_CUBE_MAP, boxtexture);
+	const MeshRange& cube = meshPool().mesh(MeshPool::BOX);
+	glDrawElementsInstancedBaseVertex(GL_TRIANGLES, cube.indexCount, GL_UNSIGNED_INT, cube.indexOffset(), instances,
+		cube.baseVertex);
+}
+
+void Box::setInstanceTransforms(const std::vector<glm::mat4>& transforms)
+{
+	setInstanceTransforms(transforms.empty() ? nullptr : &transforms[0], transforms.size());
+}
+
+void Box::setInstanceTransforms(const glm::mat4* transforms, size_t count)
+{
+	if (directStateAccess()) {
+		setInstanceTransformsNamed(transforms, count);
+		return;
+	}
+	if (!instanceVBO) {
+		// The transforms are per Box, so it gets its own vertex array over the pool's buffers
+		glGenVertexArrays(1, &(this->VAO));
+		glState().bindVertexArray(this->VAO);
+		meshPool().setAttributes();
+		glGenBuffers(1, &instanceVBO);
+		glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+		// A mat4 attribute takes four locations, one column each
+		for (GLuint column = 0; column < 4; column++) {
+			glEnableVertexAttribArray(5 + column);
+			glVertexAttribPointer(5 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+				(GLvoid*)(sizeof(glm::vec4) * column));
+			glVertexAttribDivisor(5 + column, instanceDivisor);
+		}
+	}
+	else {
+		glState().bindVertexArray(this->VAO);
+		if (instancesInRing) {
+			pointInstances(instanceVBO, 0);
+			instancesInRing = false;
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+	}
+	glBufferData(GL_ARRAY_BUFFER, count * sizeof(glm::mat4), count ? transforms : nullptr, GL_STATIC_DRAW);
+	gpuMemory().allocate(GpuMemory::KIND_BUFFER, instanceVBO, count * sizeof(glm::mat4), GpuMemory::MESH, "Box instance transforms");
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	instanceCount = (GLsizei)count;
+	instanceCapacity = count;
+}
+
+// The same by name. The four columns read one buffer binding, INSTANCE_BINDING, so moving
+// them is one call.
+void Box::setInstanceTransformsNamed(const glm::mat4* transforms, size_t count)
+{
+	if (!instanceVBO) {
+		glCreateVertexArrays(1, &(this->VAO));
+		// The pool's attributes are set up by binding, as for every other vertex array over it
+		glState().bindVertexArray(this->VAO);
+		meshPool().setAttributes();
+		glCreateBuffers(1, &instanceVBO);
+		for (GLuint column = 0; column < 4; column++) {
+			glEnableVertexArrayAttrib(this->VAO, 5 + column);
+			glVertexArrayAttribFormat(this->VAO, 5 + column, 4, GL_FLOAT, GL_FALSE, (GLuint)(sizeof(glm::vec4) * column));
+			glVertexArrayAttribBinding(this->VAO, 5 + column, INSTANCE_BINDING);
+		}
+		glVertexArrayBindingDivisor(this->VAO, INSTANCE_BINDING, instanceDivisor);
+	}
+	pointInstances(instanceVBO, 0);
+	instancesInRing = false;
+	glNamedBufferData(instanceVBO, count * sizeof(glm::mat4), count ? transforms : nullptr, GL_STATIC_DRAW);
+	gpuMemory().allocate(GpuMemory::KIND_BUFFER, instanceVBO, count * sizeof(glm::mat4), GpuMemory::MESH, "Box instance transforms");
+	instanceCount = (GLsizei)count;
+	instanceCapacity = count;
+}
+
+void Box::updateInstanceTransforms(const glm::mat4* transforms, size_t count)
+{
+	// Fresh space every time, the draws of the last set may still be reading theirs
+	GLintptr offset;
+	if (instanceVBO && count && frameRing().write(transforms, count * sizeof(glm::mat4), sizeof(glm::vec4), offset)) {
+		if (!directStateAccess())
+			glState().bindVertexArray(this->VAO);
+		pointInstances(frameRing().buffer(), offset);
+		instancesInRing = true;
+		instanceCount = (GLsizei)count;
+		return;
+	}
+	if (!instanceVBO || count > instanceCapacity) {
+		setInstanceTransforms(transforms, count);
+		return;
+	}
+	if (instancesInRing) {
+		if (!directStateAccess())
+			glState().bindVertexArray(this->VAO);
+		pointInstances(instanceVBO, 0);
+		instancesInRing = false;
+	}
+	if (count && directStateAccess()) {
+		glNamedBufferSubData(instanceVBO, 0, count * sizeof(glm::mat4), transforms);
+	}
+	else if (count) {
+		glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(glm::mat4), transforms);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	instanceCount = (GLsizei)count;
+}
+
+void Box::pointInstances(GLuint buffer, GLintptr offset)
+{
+	if (directStateAccess()) {
+		glVertexArrayVertexBuffer(this->VAO, INSTANCE_BINDING, buffer, offset, sizeof(glm::mat4));
+		return;
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	for (GLuint column = 0; column < 4; column++) {
+		glVertexAttribPointer(5 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+			(GLvoid*)(offset + sizeof(glm::vec4) * column));
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Box::drawTransformed(GLuint boxtexture, GLsizei repeat)
+{
+	if (!instanceCount || repeat < 1)
+		return;
+	glState().polygonMode(GL_FILL);
+	glState().bindVertexArray(this->VAO);
+	if (instanceDivisor != (GLuint)repeat && directStateAccess()) {
+		instanceDivisor = (GLuint)repeat;
+		glVertexArrayBindingDivisor(this->VAO, INSTANCE_BINDING, instanceDivisor);
+	}
+	else if (instanceDivisor != (GLuint)repeat) {
+		instanceDivisor = (GLuint)repeat;
+		for (GLuint column = 0; column < 4; column++)
+			glVertexAttribDivisor(5 + column, instanceDivisor);
+	}
+	if (boxtexture)
+		glState().bindTexture(0, GL_TEXTURE_CUBE_MAP, boxtexture);
+	const MeshRange& range = meshPool().mesh(meshId);
+	glDrawElementsInstancedBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT, range.indexOffset(),
+		instanceCount * repeat, range.baseVertex);
 }
 
 void Box::draw(GLuint shaderProgram) {
-	glBindVertexArray(this->VAO);
-	glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-	glBindVertexArray(0);
+	glState().polygonMode(GL_FILL);
+	glState().bindVertexArray(this->VAO);
+	const MeshRange& cube = meshPool().mesh(MeshPool::BOX);
+	glDrawElementsBaseVertex(GL_TRIANGLES, cube.indexCount, GL_UNSIGNED_INT, cube.indexOffset(), cube.baseVertex);
 }
 
 void Box::update()
@@ -66,17 +199,41 @@ void Box::update()
 }
 
 
-GLuint Box::loadBoxTexture(std::vector<unsigned char *> dataVector, int width, int height)
+GLuint Box::loadBoxTexture(const std::vector<const unsigned char *>& dataVector, int width, int height)
 {	
 	GLuint textureID;
+	GLsizei levels = (GLsizei)mipLevelCount(width, height);
+	if (directStateAccess()) {
+		// By name, the faces are the layers of the cube map
+		glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, &textureID);
+		glTextureStorage2D(textureID, levels, GL_RGBA8, width, height);
+		gpuMemory().allocate(GpuMemory::KIND_TEXTURE, textureID, textureBytes(GL_RGBA8, width, height, 6, levels),
+			GpuMemory::TEXTURE, "Box::loadBoxTexture");
+		for (GLuint i = 0; i < dataVector.size(); i++) {
+			glTextureSubImage3D(textureID, 0, 0, 0, i, width, height, 1, GL_RGB, GL_UNSIGNED_BYTE, dataVector[i]);
+			glStats().addUpload((uint64_t)width * height * 3);
+		}
+		glGenerateTextureMipmap(textureID);
+		glTextureParameteri(textureID, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTextureParameteri(textureID, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTextureParameteri(textureID, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTextureParameteri(textureID, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTextureParameteri(textureID, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		return textureID;
+	}
+
 	glGenTextures(1, &textureID);
 	glActiveTexture(GL_TEXTURE0);
 
 	glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+	allocateTextureStorage(GL_TEXTURE_CUBE_MAP, levels, GL_RGBA8, width, height);
+	gpuMemory().allocate(GpuMemory::KIND_TEXTURE, textureID, textureBytes(GL_RGBA8, width, height, 6, levels),
+		GpuMemory::TEXTURE, "Box::loadBoxTexture");
 	for (GLuint i = 0; i < dataVector.size(); i++)
 	{
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, 
+		glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, 0, 0, width, height, GL_RGB,
 			GL_UNSIGNED_BYTE, dataVector[i]);
+		glStats().addUpload((uint64_t)width * height * 3);
 	}
 
 	glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
@@ -90,3 +247,9 @@ GLuint Box::loadBoxTexture(std::vector<unsigned char *> dataVector, int width, i
 	return textureID;
 }
 
+
+// Uploads six faces that may carry their own mip chains (texture cache) or just level 0
+GLuint Box::loadBoxTexture(const std::vector<const Image *>& faces, UploadRing * ring)
+{
+	return createCubeTexture(faces, ring);
+}
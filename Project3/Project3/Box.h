@@ -17,6 +17,10 @@
 #include <iostream>
 #include <vector>
 
+#include "Image.h"
+#include "MeshPool.h"
+#include "UploadRing.h"
+
 class Box
 {
 public:
@@ -25,12 +29,47 @@ public:
 
 	void draw(GLuint, GLuint);
 	void draw(GLuint);
+	// Draws instances copies in one call, for shaders that place each one themselves
+	void drawInstanced(GLuint, GLuint, GLsizei);
+	// Per instance model matrices, read by the shaders from attribute 5 (5 to 8, one column
+	// each). Replaces any earlier ones.
+	void setInstanceTransforms(const std::vector<glm::mat4>& transforms);
+	void setInstanceTransforms(const glm::mat4* transforms, size_t count);
+	// For a set that changes every frame: written to the frame ring (FrameRing.h) and drawn
+	// from there, so only this frame, or rewritten in place while there are no more than
+	// were last set
+	void updateInstanceTransforms(const glm::mat4* transforms, size_t count);
+	GLsizei instanceTransformCount() const { return instanceCount; }
+	// Draws every instance transform, each one repeat times in a row (instance i uses
+	// transform i / repeat), so a shader can spread each copy over repeat layers
+	void drawTransformed(GLuint boxtexture, GLsizei repeat = 1);
+	// The pool mesh drawTransformed draws, the cube unless another one is set
+	void setMesh(int id) { meshId = id; }
+	int mesh() const { return meshId; }
 	void update();
-	GLuint loadBoxTexture(std::vector<unsigned char *>, int, int);
+	GLuint loadBoxTexture(const std::vector<const unsigned char *>&, int, int);
+	GLuint loadBoxTexture(const std::vector<const Image *>&, UploadRing * ring = nullptr);
 
 	// These variables are needed for the shader program
 	GLuint VBO, VAO, EBO;
 
+private:
+	// With direct state access the instance attributes read this buffer binding
+	enum { INSTANCE_BINDING = 5 };
+
+	void setInstanceTransformsNamed(const glm::mat4* transforms, size_t count);
+	// Points the instance attributes of the bound vertex array (any, by name) at transforms
+	// in buffer
+	void pointInstances(GLuint buffer, GLintptr offset);
+
+	GLuint instanceVBO = 0;
+	// The attributes point into the frame ring rather than instanceVBO
+	bool instancesInRing = false;
+	GLsizei instanceCount = 0;
+	size_t instanceCapacity = 0;
+	GLuint instanceDivisor = 1;
+	int meshId = MeshPool::BOX;
+
 };
 
 // Define the coordinates and indices needed to draw the Box. Note that it is not necessary
@@ -0,0 +1,138 @@
+#include "CameraUniforms.h"
+#include "GpuMemory.h"
+#include "FrameRing.h"
+
+CameraUniforms::CameraUniforms() : ubo(0), stride(sizeof(CameraBlock)), frame(0), records(RECORDS_PER_FRAME),
+	ringOffsets(RECORDS_PER_FRAME, 0), ringFrames(RECORDS_PER_FRAME, 0), frameCount(1)
+{
+}
+
+CameraUniforms::~CameraUniforms()
+{
+	if (ubo) {
+		gpuMemory().release(GpuMemory::KIND_BUFFER, ubo);
+		glDeleteBuffers(1, &ubo);
+	}
+}
+
+void CameraUniforms::init()
+{
+	// Bound ranges have to start at a multiple of the offset alignment
+	GLint alignment = 1;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	if (alignment < 1) {
+		alignment = 1;
+	}
+	stride = ((GLsizeiptr)sizeof(CameraBlock) + alignment - 1) / alignment * alignment;
+
+	if (!ubo) {
+		glGenBuffers(1, &ubo);
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+	glBufferData(GL_UNIFORM_BUFFER, stride * RECORDS_PER_FRAME * FRAMES, nullptr, GL_DYNAMIC_DRAW);
+	gpuMemory().allocate(GpuMemory::KIND_BUFFER, ubo, stride * RECORDS_PER_FRAME * FRAMES, GpuMemory::STREAMING, "camera uniforms");
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	frame = 0;
+}
+
+void CameraUniforms::beginFrame()
+{
+	frame = (frame + 1) % FRAMES;
+	frameCount++;
+}
+
+void CameraUniforms::setEye(int eye, const glm::mat4& projection, const glm::mat4& modelview)
+{
+	CameraBlock& camera = records[record(eye, -1)];
+	camera.projection = projection;
+	camera.modelview = modelview;
+	camera.viewProjection = projection * modelview;
+	upload(record(eye, -1), 1);
+}
+
+void CameraUniforms::setWalls(int eye, const glm::mat4& wallModelview, const glm::mat4* wallProjections, int wallCount,
+	const glm::vec3& eyePosition)
+{
+	CameraBlock& camera = records[record(eye, -1)];
+	for (int i = 0; i < wallCount; i++) {
+		camera.wallProjections[i] = wallProjections[i];
+	}
+	camera.eyePosition = glm::vec4(eyePosition, 1.f);
+
+	// A wall's camera is the eye's, rendered through that wall
+	for (int i = 0; i < wallCount; i++) {
+		CameraBlock& wall = records[record(eye, i)];
+		wall = camera;
+		wall.projection = wallProjections[i];
+		wall.modelview = wallModelview;
+		wall.viewProjection = wallProjections[i] * wallModelview;
+	}
+	upload(record(eye, -1), 1 + wallCount);
+}
+
+void CameraUniforms::bindEye(int eye)
+{
+	bindRecord(record(eye, -1));
+}
+
+void CameraUniforms::bindWall(int eye, int wall)
+{
+	bindRecord(record(eye, wall));
+}
+
+// The eye's own record comes first (wall -1), its walls after it
+int CameraUniforms::record(int eye, int wall) const
+{
+	return eye * RECORDS_PER_EYE + 1 + wall;
+}
+
+void CameraUniforms::upload(int first, int count)
+{
+	if (!ubo) {
+		return;
+	}
+	bool bound = false;
+	GLintptr base = stride * (GLintptr)(frame * RECORDS_PER_FRAME);
+	for (int i = first; i < first + count; i++) {
+		if (ringRecord(i)) {
+			continue;
+		}
+		if (!bound) {
+			glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+			bound = true;
+		}
+		glBufferSubData(GL_UNIFORM_BUFFER, base + stride * i, sizeof(CameraBlock), &records[i]);
+	}
+	if (bound) {
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+}
+
+// Writes the record to fresh space in the frame ring, false if the ring has none
+bool CameraUniforms::ringRecord(int index)
+{
+	GLintptr offset;
+	if (!frameRing().write(&records[index], sizeof(CameraBlock), frameRing().uniformAlignment(), offset)) {
+		ringFrames[index] = 0;
+		return false;
+	}
+	ringOffsets[index] = offset;
+	ringFrames[index] = frameCount;
+	return true;
+}
+
+void CameraUniforms::bindRecord(int index)
+{
+	if (ringFrames[index] == frameCount) {
+		glBindBufferRange(GL_UNIFORM_BUFFER, BINDING, frameRing().buffer(), ringOffsets[index], sizeof(CameraBlock));
+		return;
+	}
+	if (ringFrames[index] != 0) {
+		// Last written to an earlier frame's region, which is reused soon
+		upload(index, 1);
+		bindRecord(index);
+		return;
+	}
+	GLintptr offset = stride * (GLintptr)(frame * RECORDS_PER_FRAME + index);
+	glBindBufferRange(GL_UNIFORM_BUFFER, BINDING, ubo, offset, sizeof(CameraBlock));
+}
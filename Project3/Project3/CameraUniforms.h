@@ -0,0 +1,89 @@
+#ifndef _CAMERA_UNIFORMS_H_
+#define _CAMERA_UNIFORMS_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "CaveLayout.h"
+
+// The std140 Camera uniform block of shader.vert, screenShader.vert, debugLines.vert and
+// wallRaycast.vert.
+// Every member is a multiple of 16 bytes, so this matches the block byte for byte.
+struct CameraBlock
+{
+	glm::mat4 projection;
+	glm::mat4 modelview;
+	// projection * modelview, made here once instead of in every vertex
+	glm::mat4 viewProjection;
+	// The eye's wall projections, indexed by wall
+	glm::mat4 wallProjections[CaveLayout::MAX_WALLS];
+	glm::vec4 eyePosition;
+};
+
+// One uniform buffer with the camera of every draw of a frame, laid out frame -> eye ->
+// wall: per eye the eye's own camera, then one camera per wall for the wall pass. A draw
+// binds its record to BINDING with glBindBufferRange instead of uploading matrices into
+// each program.
+//
+// Records go into the frame ring (FrameRing.h) when there is one, each write to fresh space
+// bound where it was written. Otherwise there are FRAMES frames in the buffer, used in
+// turn, so writing one never waits on the GPU still reading an earlier one.
+class CameraUniforms
+{
+public:
+	enum { EYES = 2, WALLS = CaveLayout::MAX_WALLS, FRAMES = 3, BINDING = 0 };
+
+	CameraUniforms();
+	~CameraUniforms();
+
+	CameraUniforms(const CameraUniforms&) = delete;
+	CameraUniforms& operator=(const CameraUniforms&) = delete;
+
+	void init();
+	// Moves on to the next frame's records
+	void beginFrame();
+
+	// The camera the eye's own draws use
+	void setEye(int eye, const glm::mat4& projection, const glm::mat4& modelview);
+	// The cameras of the eye's wall pass, all seen from wallModelview (the eye's record
+	// gets the projections and position too)
+	void setWalls(int eye, const glm::mat4& wallModelview, const glm::mat4* wallProjections, int wallCount,
+		const glm::vec3& eyePosition);
+
+	// A record not written this frame is copied into the ring again first
+	void bindEye(int eye);
+	void bindWall(int eye, int wall);
+
+private:
+	enum { RECORDS_PER_EYE = 1 + WALLS, RECORDS_PER_FRAME = EYES * RECORDS_PER_EYE };
+
+	int record(int eye, int wall) const;
+	void upload(int first, int count);
+	bool ringRecord(int index);
+	void bindRecord(int index);
+
+	GLuint ubo;
+	GLsizeiptr stride;
+	int frame;
+	std::vector<CameraBlock> records;
+	// Where each record is in the frame ring, and the frame it was written there (frames
+	// counted by beginFrame(), 0 for never)
+	std::vector<GLintptr> ringOffsets;
+	std::vector<uint64_t> ringFrames;
+	uint64_t frameCount;
+};
+
+#endif
@@ -0,0 +1,460 @@
+#include "CaveLayout.h"
+#include "AssetArchive.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+
+// The AVX kernel is compiled for AVX on its own, the rest of the build does not assume it
+#if defined(__GNUC__) && !defined(__AVX__)
+#define AVX_TARGET __attribute__((target("avx")))
+#else
+#define AVX_TARGET
+#endif
+
+// The near and far planes of the wall frusta
+static const float WALL_NEAR = 0.001f;
+static const float WALL_FAR = 1000.f;
+
+// The SIMD kernels' wall values, each an array of CaveLayout::laneCount floats
+enum {
+	LANE_RX, LANE_RY, LANE_RZ, LANE_UX, LANE_UY, LANE_UZ, LANE_NX, LANE_NY, LANE_NZ,
+	// left0 + right0 and bottom0 + top0, the inverse width and height, and the plane
+	LANE_SUM_X, LANE_SUM_Y, LANE_INV_W, LANE_INV_H, LANE_PLANE,
+	LANE_FIELDS
+};
+static const size_t LANE_PAD = 8;
+
+static CaveLayout::Kernel activeKernel = CaveLayout::KERNEL_AUTO;
+
+CaveLayout::CaveLayout()
+{
+	setDefault();
+}
+
+void CaveLayout::setDefault()
+{
+	setWalls(CAVE_ORIGINAL_WALLS);
+}
+
+void CaveLayout::setWalls(const CaveWallSpec* specs, size_t count)
+{
+	walls.clear();
+	for (size_t w = 0; w < count && w < MAX_WALLS; w++) {
+		CaveWall wall;
+		wall.name = specs[w].name;
+		for (int i = 0; i < 4; i++) {
+			wall.corners[i] = glm::vec3(specs[w].corners[i][0], specs[w].corners[i][1], specs[w].corners[i][2]);
+		}
+		wall.resolution = specs[w].resolution;
+		walls.push_back(wall);
+	}
+	prepare();
+}
+
+bool CaveLayout::load(const char* filename)
+{
+	std::string text;
+	if (!readAssetText(filename, text)) {
+		std::cerr << "could not open CAVE layout " << filename << std::endl;
+		return false;
+	}
+	std::istringstream file(text);
+
+	std::vector<CaveWall> loaded;
+	std::string line;
+	int lineNumber = 0;
+	while (getline(file, line)) {
+		lineNumber++;
+		size_t comment = line.find('#');
+		if (comment != std::string::npos) {
+			line.erase(comment);
+		}
+		std::istringstream fields(line);
+		CaveWall wall;
+		if (!(fields >> wall.name)) {
+			continue;
+		}
+		bool valid = true;
+		for (int i = 0; i < 4 && valid; i++) {
+			valid = !!(fields >> wall.corners[i].x >> wall.corners[i].y >> wall.corners[i].z);
+		}
+		if (!valid) {
+			std::cerr << filename << ":" << lineNumber << ": expected a name and four corners" << std::endl;
+			continue;
+		}
+		if (!(fields >> wall.resolution)) {
+			wall.resolution = 0;
+		}
+		if (loaded.size() == MAX_WALLS) {
+			std::cerr << filename << ":" << lineNumber << ": more than " << MAX_WALLS << " walls, ignoring the rest" << std::endl;
+			break;
+		}
+		loaded.push_back(wall);
+	}
+
+	if (loaded.empty()) {
+		std::cerr << "CAVE layout " << filename << " has no walls" << std::endl;
+		return false;
+	}
+	walls.swap(loaded);
+	prepare();
+	return true;
+}
+
+bool CaveLayout::check(std::string& error) const
+{
+	for (const CaveWall& wall : walls) {
+		for (const glm::vec3& corner : wall.corners) {
+			if (!std::isfinite(corner.x) || !std::isfinite(corner.y) || !std::isfinite(corner.z)) {
+				error = wall.name + " has a corner that is not a number";
+				return false;
+			}
+		}
+		glm::vec3 right = wall.corners[1] - wall.corners[0];
+		glm::vec3 up = wall.corners[3] - wall.corners[0];
+		glm::vec3 normal = glm::cross(right, up);
+		float size = std::max(glm::length(right), glm::length(up));
+		if (size < 1e-4f || glm::length(normal) < 1e-6f * size * size) {
+			error = wall.name + " has no area";
+			return false;
+		}
+		// The top right corner within a thousandth of the wall's size of the others' plane
+		if (std::abs(glm::dot(glm::normalize(normal), wall.corners[2] - wall.corners[0])) > 1e-3f * size) {
+			error = wall.name + " is not flat";
+			return false;
+		}
+	}
+	return true;
+}
+
+int CaveLayout::find(const std::string& name) const
+{
+	for (size_t i = 0; i < walls.size(); i++) {
+		if (walls[i].name == name) {
+			return (int)i;
+		}
+	}
+	return -1;
+}
+
+void CaveLayout::prepare()
+{
+	geometry.resize(walls.size());
+	for (size_t w = 0; w < walls.size(); w++) {
+		const glm::vec3* c = walls[w].corners;
+		CaveWallGeometry& g = geometry[w];
+
+		g.right = glm::normalize(c[1] - c[0]);
+		g.up = glm::normalize(c[3] - c[0]);
+		g.normal = glm::normalize(glm::cross(g.right, g.up));
+		g.left0 = glm::dot(g.right, c[0]);
+		g.right0 = glm::dot(g.right, c[1]);
+		g.bottom0 = glm::dot(g.up, c[0]);
+		g.top0 = glm::dot(g.up, c[3]);
+		g.plane = glm::dot(g.normal, c[0]);
+
+		g.basis = glm::mat4(1.0f);
+		g.basis[0] = glm::vec4(g.right.x, g.up.x, g.normal.x, 0.f);
+		g.basis[1] = glm::vec4(g.right.y, g.up.y, g.normal.y, 0.f);
+		g.basis[2] = glm::vec4(g.right.z, g.up.z, g.normal.z, 0.f);
+
+		glm::vec3 x = (c[1] - c[0]) * 0.5f;
+		glm::vec3 y = (c[3] - c[0]) * 0.5f;
+		glm::vec3 center = (c[0] + c[1] + c[2] + c[3]) * 0.25f;
+		g.transform = glm::mat4(glm::vec4(x, 0.f), glm::vec4(y, 0.f), glm::vec4(g.normal, 0.f), glm::vec4(center, 1.f));
+	}
+
+	laneCount = (geometry.size() + LANE_PAD - 1) / LANE_PAD * LANE_PAD;
+	lanes.assign(LANE_FIELDS * laneCount, 0.f);
+	for (size_t w = 0; w < laneCount; w++) {
+		const CaveWallGeometry& g = geometry[std::min(w, geometry.size() - 1)];
+		float values[LANE_FIELDS] = { g.right.x, g.right.y, g.right.z, g.up.x, g.up.y, g.up.z, g.normal.x, g.normal.y, g.normal.z,
+			g.left0 + g.right0, g.bottom0 + g.top0, 1.f / (g.right0 - g.left0), 1.f / (g.top0 - g.bottom0), g.plane };
+		for (int f = 0; f < LANE_FIELDS; f++) {
+			lanes[f * laneCount + w] = values[f];
+		}
+	}
+}
+
+static bool cpuHas(CaveLayout::Kernel kernel)
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	if (kernel == CaveLayout::KERNEL_SSE) {
+		return (info[3] & (1 << 25)) != 0;
+	}
+	// AVX needs the OS to save the upper halves of the registers too
+	bool avx = (info[2] & (1 << 28)) != 0 && (info[2] & (1 << 27)) != 0;
+	return avx && (_xgetbv(0) & 6) == 6;
+#else
+	return kernel == CaveLayout::KERNEL_SSE ? __builtin_cpu_supports("sse") : __builtin_cpu_supports("avx");
+#endif
+}
+
+void CaveLayout::setKernel(Kernel kernel)
+{
+	if (kernel == KERNEL_AUTO) {
+		kernel = KERNEL_AVX;
+	}
+	if (kernel == KERNEL_AVX && !cpuHas(KERNEL_AVX)) {
+		kernel = KERNEL_SSE;
+	}
+	if (kernel == KERNEL_SSE && !cpuHas(KERNEL_SSE)) {
+		kernel = KERNEL_SCALAR;
+	}
+	activeKernel = kernel;
+}
+
+CaveLayout::Kernel CaveLayout::kernel()
+{
+	if (activeKernel == KERNEL_AUTO) {
+		setKernel(KERNEL_AUTO);
+	}
+	return activeKernel;
+}
+
+CaveLayout::Kernel CaveLayout::parseKernel(const std::string& name)
+{
+	if (name == "scalar") {
+		return KERNEL_SCALAR;
+	}
+	if (name == "sse") {
+		return KERNEL_SSE;
+	}
+	if (name == "avx") {
+		return KERNEL_AVX;
+	}
+	if (name != "auto") {
+		std::cerr << "unknown projection kernel " << name << ", picking one for the CPU" << std::endl;
+	}
+	return KERNEL_AUTO;
+}
+
+const char* CaveLayout::kernelName(Kernel kernel)
+{
+	switch (kernel) {
+	case KERNEL_SCALAR: return "scalar";
+	case KERNEL_SSE: return "sse";
+	case KERNEL_AVX: return "avx";
+	default: return "auto";
+	}
+}
+
+static inline void projectWall(const CaveWallGeometry& g, const glm::vec3& eye, glm::mat4& out)
+{
+	// The eye in screen coordinates. The corners relative to it follow from the
+	// precomputed dot products, and it is the translation of the view as well.
+	float er = glm::dot(g.right, eye);
+	float eu = glm::dot(g.up, eye);
+	float en = glm::dot(g.normal, eye);
+
+	float scale = WALL_NEAR / (en - g.plane);
+	float l = (g.left0 - er) * scale;
+	float r = (g.right0 - er) * scale;
+	float b = (g.bottom0 - eu) * scale;
+	float t = (g.top0 - eu) * scale;
+
+	glm::mat4 view = g.basis;
+	view[3] = glm::vec4(-er, -eu, -en, 1.0f);
+	out = glm::frustum(l, r, b, t, WALL_NEAR, WALL_FAR) * view;
+}
+
+template <size_t WALLS>
+static void projectWalls(const CaveWallGeometry* geometry, const glm::vec3* eyes, int eyeCount, glm::mat4* out)
+{
+	for (int e = 0; e < eyeCount; e++) {
+		for (size_t w = 0; w < WALLS; w++) {
+			projectWall(geometry[w], eyes[e], out[e * WALLS + w]);
+		}
+	}
+}
+
+glm::vec2 CaveLayout::depthTerms()
+{
+	return glm::vec2(-(WALL_FAR + WALL_NEAR) / (WALL_FAR - WALL_NEAR), -2.f * WALL_FAR * WALL_NEAR / (WALL_FAR - WALL_NEAR));
+}
+
+void CaveLayout::computeProjections(const glm::vec3* eyes, int eyeCount, glm::mat4* out) const
+{
+	computeProjections(eyes, eyeCount, out, kernel());
+}
+
+void CaveLayout::computeProjections(const glm::vec3* eyes, int eyeCount, glm::mat4* out, Kernel kernel) const
+{
+	if (kernel == KERNEL_AVX) {
+		computeAvx(eyes, eyeCount, out);
+		return;
+	}
+	if (kernel == KERNEL_SSE) {
+		computeSse(eyes, eyeCount, out);
+		return;
+	}
+	// The wall count is a template argument where it can be, so the loops unroll
+	const size_t count = geometry.size();
+	const CaveWallGeometry* g = geometry.data();
+	switch (count) {
+	case 1: projectWalls<1>(g, eyes, eyeCount, out); break;
+	case 2: projectWalls<2>(g, eyes, eyeCount, out); break;
+	case 3: projectWalls<3>(g, eyes, eyeCount, out); break;
+	case 4: projectWalls<4>(g, eyes, eyeCount, out); break;
+	case 5: projectWalls<5>(g, eyes, eyeCount, out); break;
+	case 6: projectWalls<6>(g, eyes, eyeCount, out); break;
+	case 7: projectWalls<7>(g, eyes, eyeCount, out); break;
+	case 8: projectWalls<8>(g, eyes, eyeCount, out); break;
+	default:
+		for (size_t w = 0; w < count; w++) {
+			for (int e = 0; e < eyeCount; e++) {
+				projectWall(g[w], eyes[e], out[e * count + w]);
+			}
+		}
+	}
+}
+
+// frustum(l, r, b, t, n, f) * view, where view has the wall basis as rows and the eye as
+// translation, only ever has these nonzero: each column v of view becomes
+//   (A vx + C vz, B vy + D vz, E vz + F vw, -vz)
+// with A = 2n / (r - l) and C = (r + l) / (r - l), B and D the same for b and t, and E and
+// F from the near and far planes. With l and r the wall edges relative to the eye scaled by
+// n / (en - plane), A and C do not need the scale at all.
+static const float FRUSTUM_E = -(WALL_FAR + WALL_NEAR) / (WALL_FAR - WALL_NEAR);
+static const float FRUSTUM_F = -2.f * WALL_FAR * WALL_NEAR / (WALL_FAR - WALL_NEAR);
+
+// Columns c of walls lane 0 to 3, rows[4 * c + row] holding that element of every lane
+static inline void storeColumns(__m128 rows[16], glm::mat4* out, size_t valid)
+{
+	for (int c = 0; c < 4; c++) {
+		__m128* column = rows + 4 * c;
+		_MM_TRANSPOSE4_PS(column[0], column[1], column[2], column[3]);
+		for (size_t lane = 0; lane < valid; lane++) {
+			_mm_storeu_ps(&out[lane][c][0], column[lane]);
+		}
+	}
+}
+
+void CaveLayout::computeSse(const glm::vec3* eyes, int eyeCount, glm::mat4* out) const
+{
+	const size_t count = geometry.size();
+	const float* lane = lanes.data();
+	const __m128 two = _mm_set1_ps(2.f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.f);
+	const __m128 e = _mm_set1_ps(FRUSTUM_E);
+	const __m128 f = _mm_set1_ps(FRUSTUM_F);
+	for (int eye = 0; eye < eyeCount; eye++) {
+		const __m128 ex = _mm_set1_ps(eyes[eye].x);
+		const __m128 ey = _mm_set1_ps(eyes[eye].y);
+		const __m128 ez = _mm_set1_ps(eyes[eye].z);
+		for (size_t w = 0; w < count; w += 4) {
+#define LANE(field) _mm_loadu_ps(lane + (field) * laneCount + w)
+			__m128 rx = LANE(LANE_RX), ry = LANE(LANE_RY), rz = LANE(LANE_RZ);
+			__m128 ux = LANE(LANE_UX), uy = LANE(LANE_UY), uz = LANE(LANE_UZ);
+			__m128 nx = LANE(LANE_NX), ny = LANE(LANE_NY), nz = LANE(LANE_NZ);
+			__m128 er = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, ex), _mm_mul_ps(ry, ey)), _mm_mul_ps(rz, ez));
+			__m128 eu = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ux, ex), _mm_mul_ps(uy, ey)), _mm_mul_ps(uz, ez));
+			__m128 en = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, ex), _mm_mul_ps(ny, ey)), _mm_mul_ps(nz, ez));
+			__m128 distance = _mm_mul_ps(two, _mm_sub_ps(en, LANE(LANE_PLANE)));
+			__m128 invW = LANE(LANE_INV_W), invH = LANE(LANE_INV_H);
+			__m128 a = _mm_mul_ps(distance, invW);
+			__m128 b = _mm_mul_ps(distance, invH);
+			__m128 c = _mm_mul_ps(_mm_sub_ps(LANE(LANE_SUM_X), _mm_mul_ps(two, er)), invW);
+			__m128 d = _mm_mul_ps(_mm_sub_ps(LANE(LANE_SUM_Y), _mm_mul_ps(two, eu)), invH);
+#undef LANE
+			const __m128 view[4][4] = {
+				{ rx, ux, nx, zero }, { ry, uy, ny, zero }, { rz, uz, nz, zero },
+				{ _mm_sub_ps(zero, er), _mm_sub_ps(zero, eu), _mm_sub_ps(zero, en), one },
+			};
+			__m128 rows[16];
+			for (int col = 0; col < 4; col++) {
+				const __m128* v = view[col];
+				rows[4 * col + 0] = _mm_add_ps(_mm_mul_ps(a, v[0]), _mm_mul_ps(c, v[2]));
+				rows[4 * col + 1] = _mm_add_ps(_mm_mul_ps(b, v[1]), _mm_mul_ps(d, v[2]));
+				rows[4 * col + 2] = _mm_add_ps(_mm_mul_ps(e, v[2]), _mm_mul_ps(f, v[3]));
+				rows[4 * col + 3] = _mm_sub_ps(zero, v[2]);
+			}
+			storeColumns(rows, out + eye * count + w, std::min<size_t>(4, count - w));
+		}
+	}
+}
+
+AVX_TARGET void CaveLayout::computeAvx(const glm::vec3* eyes, int eyeCount, glm::mat4* out) const
+{
+	const size_t count = geometry.size();
+	const float* lane = lanes.data();
+	const __m256 two = _mm256_set1_ps(2.f);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.f);
+	const __m256 e = _mm256_set1_ps(FRUSTUM_E);
+	const __m256 f = _mm256_set1_ps(FRUSTUM_F);
+	for (int eye = 0; eye < eyeCount; eye++) {
+		const __m256 ex = _mm256_set1_ps(eyes[eye].x);
+		const __m256 ey = _mm256_set1_ps(eyes[eye].y);
+		const __m256 ez = _mm256_set1_ps(eyes[eye].z);
+		for (size_t w = 0; w < count; w += 8) {
+#define LANE(field) _mm256_loadu_ps(lane + (field) * laneCount + w)
+			__m256 rx = LANE(LANE_RX), ry = LANE(LANE_RY), rz = LANE(LANE_RZ);
+			__m256 ux = LANE(LANE_UX), uy = LANE(LANE_UY), uz = LANE(LANE_UZ);
+			__m256 nx = LANE(LANE_NX), ny = LANE(LANE_NY), nz = LANE(LANE_NZ);
+			__m256 er = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(rx, ex), _mm256_mul_ps(ry, ey)), _mm256_mul_ps(rz, ez));
+			__m256 eu = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ux, ex), _mm256_mul_ps(uy, ey)), _mm256_mul_ps(uz, ez));
+			__m256 en = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, ex), _mm256_mul_ps(ny, ey)), _mm256_mul_ps(nz, ez));
+			__m256 distance = _mm256_mul_ps(two, _mm256_sub_ps(en, LANE(LANE_PLANE)));
+			__m256 invW = LANE(LANE_INV_W), invH = LANE(LANE_INV_H);
+			__m256 a = _mm256_mul_ps(distance, invW);
+			__m256 b = _mm256_mul_ps(distance, invH);
+			__m256 c = _mm256_mul_ps(_mm256_sub_ps(LANE(LANE_SUM_X), _mm256_mul_ps(two, er)), invW);
+			__m256 d = _mm256_mul_ps(_mm256_sub_ps(LANE(LANE_SUM_Y), _mm256_mul_ps(two, eu)), invH);
+#undef LANE
+			const __m256 view[4][4] = {
+				{ rx, ux, nx, zero }, { ry, uy, ny, zero }, { rz, uz, nz, zero },
+				{ _mm256_sub_ps(zero, er), _mm256_sub_ps(zero, eu), _mm256_sub_ps(zero, en), one },
+			};
+			__m256 rows[16];
+			for (int col = 0; col < 4; col++) {
+				const __m256* v = view[col];
+				rows[4 * col + 0] = _mm256_add_ps(_mm256_mul_ps(a, v[0]), _mm256_mul_ps(c, v[2]));
+				rows[4 * col + 1] = _mm256_add_ps(_mm256_mul_ps(b, v[1]), _mm256_mul_ps(d, v[2]));
+				rows[4 * col + 2] = _mm256_add_ps(_mm256_mul_ps(e, v[2]), _mm256_mul_ps(f, v[3]));
+				rows[4 * col + 3] = _mm256_sub_ps(zero, v[2]);
+			}
+			// Each half is four walls, stored the same way as the SSE kernel's
+			for (int half = 0; half < 2 && w + 4 * half < count; half++) {
+				__m128 halves[16];
+				for (int i = 0; i < 16; i++) {
+					halves[i] = half ? _mm256_extractf128_ps(rows[i], 1) : _mm256_castps256_ps128(rows[i]);
+				}
+				storeColumns(halves, out + eye * count + w + 4 * half, std::min<size_t>(4, count - w - 4 * half));
+			}
+		}
+	}
+	_mm256_zeroupper();
+}
+
+float CaveLayout::kernelError(Kernel kernel) const
+{
+	const glm::vec3 eyes[4] = {
+		glm::vec3(-0.032f, 0.f, 0.f), glm::vec3(0.032f, 0.f, 0.f), glm::vec3(0.3f, 0.2f, -0.4f), glm::vec3(-0.5f, -0.3f, 0.2f),
+	};
+	std::vector<glm::mat4> reference(4 * geometry.size()), tested(4 * geometry.size());
+	computeProjections(eyes, 4, reference.data(), KERNEL_SCALAR);
+	computeProjections(eyes, 4, tested.data(), kernel);
+	float worst = 0.f;
+	for (size_t i = 0; i < reference.size(); i++) {
+		for (int c = 0; c < 4; c++) {
+			for (int r = 0; r < 4; r++) {
+				float expected = reference[i][c][r];
+				worst = std::max(worst, std::fabs(tested[i][c][r] - expected) / std::max(1.f, std::fabs(expected)));
+			}
+		}
+	}
+	return worst;
+}
@@ -0,0 +1,135 @@
+#ifndef _CAVE_LAYOUT_H_
+#define _CAVE_LAYOUT_H_
+
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+// One screen of the CAVE. Corners are world space, in Quad vertex order: bottom left,
+// bottom right, top right, top left (seen from inside the CAVE).
+struct CaveWall
+{
+	std::string name;
+	glm::vec3 corners[4];
+	// Side of the wall's render target, 0 for walls.resolution
+	int resolution;
+};
+
+// A wall written down as constants, for installations whose screens are known when
+// building. An array of these is a whole layout: checked when compiling, and handed to
+// CaveLayout::setWalls like a layout file's walls would be.
+struct CaveWallSpec
+{
+	const char* name;
+	float corners[4][3];
+	int resolution;
+};
+
+// The original three screen setup: two walls at right angles in front of the viewer and
+// the floor, 2.4 m squares 1.2 m below eye height turned 45 degrees to the viewer
+constexpr float CAVE_HALF_DIAGONAL = 1.69705627f;
+constexpr CaveWallSpec CAVE_ORIGINAL_WALLS[] = {
+	{ "left", { { -CAVE_HALF_DIAGONAL, -1.2f, 0.f }, { 0.f, -1.2f, -CAVE_HALF_DIAGONAL },
+		{ 0.f, 1.2f, -CAVE_HALF_DIAGONAL }, { -CAVE_HALF_DIAGONAL, 1.2f, 0.f } }, 0 },
+	{ "right", { { 0.f, -1.2f, -CAVE_HALF_DIAGONAL }, { CAVE_HALF_DIAGONAL, -1.2f, 0.f },
+		{ CAVE_HALF_DIAGONAL, 1.2f, 0.f }, { 0.f, 1.2f, -CAVE_HALF_DIAGONAL } }, 0 },
+	{ "floor", { { 0.f, -1.2f, CAVE_HALF_DIAGONAL }, { CAVE_HALF_DIAGONAL, -1.2f, 0.f },
+		{ 0.f, -1.2f, -CAVE_HALF_DIAGONAL }, { -CAVE_HALF_DIAGONAL, -1.2f, 0.f } }, 0 },
+};
+
+// What the per eye work needs of a wall, derived once from its corners. The screen basis
+// and the corners projected onto it leave three dot products with the eye position per
+// frustum.
+struct CaveWallGeometry
+{
+	// Screen right, up and normal towards the viewer
+	glm::vec3 right, up, normal;
+	// dot(right, bottom left), dot(right, bottom right), dot(up, bottom left),
+	// dot(up, top left) and dot(normal, bottom left)
+	float left0, right0, bottom0, top0, plane;
+	// World to screen rotation, rows right, up and normal
+	glm::mat4 basis;
+	// Puts the unit Quad onto the wall
+	glm::mat4 transform;
+};
+
+// The screens of the simulated CAVE. The default is the original three screen setup, two
+// walls at right angles and the floor, or the walls can be read from a layout file of lines
+//
+//   name  blx bly blz  brx bry brz  trx try trz  tlx tly tlz  [resolution]
+//
+// ('#' starts a comment), so any installation of up to MAX_WALLS screens can be modelled.
+class CaveLayout
+{
+public:
+	// Layers and views are eye * size() + wall, and both eyes have to fit the 16 viewports
+	// every GL 4.1 context has
+	enum { MAX_WALLS = 8 };
+
+	CaveLayout();
+
+	void setDefault();
+	// Replaces the walls with a constant table of them
+	template <size_t WALLS>
+	void setWalls(const CaveWallSpec (&specs)[WALLS])
+	{
+		static_assert(WALLS > 0 && WALLS <= MAX_WALLS, "a CAVE layout has 1 to MAX_WALLS walls");
+		setWalls(specs, WALLS);
+	}
+	void setWalls(const CaveWallSpec* specs, size_t count);
+	// Replaces the walls with the file's. Returns false, and keeps the current walls, if the
+	// file cannot be read or has no valid walls.
+	bool load(const char* filename);
+	//! Whether every wall is a flat quad with sides of some length that are not parallel,
+	// which the projections need. Otherwise error says which wall is not.
+	bool check(std::string& error) const;
+
+	size_t size() const { return walls.size(); }
+	const CaveWall& wall(size_t i) const { return walls[i]; }
+	// Index of the wall with this name, or -1
+	int find(const std::string& name) const;
+
+	// Model matrix that puts the unit Quad (-1 to 1 in x and y) onto wall i
+	const glm::mat4& wallTransform(size_t i) const { return geometry[i].transform; }
+	// What the projections of wall i are made from, for working them out on the GPU
+	const CaveWallGeometry& wallGeometry(size_t i) const { return geometry[i]; }
+	// The z row's scale and offset every wall frustum has, from its near and far planes
+	static glm::vec2 depthTerms();
+
+	// How computeProjections does the math: scalar, or four (SSE) or eight (AVX) walls at a
+	// time. AUTO is the widest the CPU has, a kernel the CPU does not have falls back to the
+	// next narrower one.
+	enum Kernel { KERNEL_AUTO, KERNEL_SCALAR, KERNEL_SSE, KERNEL_AVX };
+	static void setKernel(Kernel kernel);
+	static Kernel kernel();
+	static Kernel parseKernel(const std::string& name);
+	static const char* kernelName(Kernel kernel);
+
+	// Off-axis projection * view of every wall, for each of eyeCount eye positions at once.
+	// out[e * size() + wall] is the matrix for eyes[e].
+	void computeProjections(const glm::vec3* eyes, int eyeCount, glm::mat4* out) const;
+	void computeProjections(const glm::vec3* eyes, int eyeCount, glm::mat4* out, Kernel kernel) const;
+	// The largest difference of a kernel's matrices from the scalar ones, relative to the
+	// element where it is over 1, for eyes around the middle of the CAVE
+	float kernelError(Kernel kernel) const;
+
+private:
+	void prepare();
+	void computeSse(const glm::vec3* eyes, int eyeCount, glm::mat4* out) const;
+	void computeAvx(const glm::vec3* eyes, int eyeCount, glm::mat4* out) const;
+
+	std::vector<CaveWall> walls;
+	// Rebuilt whenever the walls change, in the same order
+	std::vector<CaveWallGeometry> geometry;
+	// The geometry again for the SIMD kernels, one array of lanes per value (LANE_*),
+	// laneCount walls each: padded to a multiple of eight with copies of the last wall
+	std::vector<float> lanes;
+	size_t laneCount;
+};
+
+#endif
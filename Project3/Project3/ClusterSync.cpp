@@ -0,0 +1,368 @@
+#include "ClusterSync.h"
+#include "Log.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef int socklen_t;
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int SOCKET;
+#define INVALID_SOCKET (-1)
+#define closesocket close
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+static_assert(sizeof(sockaddr_in) <= 16, "ClusterSync keeps its addresses in 16 bytes");
+
+const uint32_t CLUSTER_MAGIC = 0x43335043; // "CP3C"
+// How many frames behind the newest a state can be before it is taken for a restart
+const uint64_t RESTART_GAP = 120;
+
+enum PacketType { PACKET_STATE = 1, PACKET_READY = 2, PACKET_SWAP = 3 };
+
+struct ClusterPacket
+{
+	uint32_t magic;
+	uint16_t type;
+	uint16_t node;
+	uint64_t frame;
+	uint32_t size;
+	uint32_t reserved;
+};
+
+static SOCKET socketOf(uintptr_t sock)
+{
+	return (SOCKET)sock;
+}
+
+static double nowMs()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+ClusterSync::Role parseClusterRole(const std::string& role)
+{
+	if (role == "master") {
+		return ClusterSync::MASTER;
+	}
+	if (role == "node") {
+		return ClusterSync::NODE;
+	}
+	if (!role.empty() && role != "off") {
+		std::cerr << "cluster.role: unknown role " << role << ", not clustered" << std::endl;
+	}
+	return ClusterSync::OFF;
+}
+
+ClusterSync::ClusterSync() : current(OFF), sock((uintptr_t)INVALID_SOCKET), port(0), node(0), nodeCount(0), masterKnown(false),
+	published(0), stopping(false), gathering(0), readyNodes(0), pendingSize(0), pendingFrame(0), lastReceived(0), released(0), skipped(0),
+	timeouts(0)
+{
+	memset(groupAddress, 0, sizeof(groupAddress));
+	memset(masterAddress, 0, sizeof(masterAddress));
+}
+
+ClusterSync::~ClusterSync()
+{
+	shutdown();
+}
+
+// The socket bound to the port, closed again and false on failure
+static bool openSocket(SOCKET& out, int port)
+{
+#ifdef _WIN32
+	WSADATA wsa;
+	if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+		std::cerr << "cluster: winsock did not start" << std::endl;
+		return false;
+	}
+#endif
+	out = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (out == INVALID_SOCKET) {
+		std::cerr << "cluster: no UDP socket" << std::endl;
+		return false;
+	}
+	// A master and nodes on one machine share the group's port
+	int reuse = 1;
+	setsockopt(out, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+	sockaddr_in local;
+	memset(&local, 0, sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_addr.s_addr = htonl(INADDR_ANY);
+	local.sin_port = htons((unsigned short)port);
+	if (bind(out, (const sockaddr*)&local, sizeof(local)) != 0) {
+		std::cerr << "cluster: could not bind port " << port << std::endl;
+		closesocket(out);
+		out = INVALID_SOCKET;
+		return false;
+	}
+	return true;
+}
+
+static bool groupAddressOf(const std::string& group, int port, unsigned char out[16])
+{
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons((unsigned short)port);
+	if (inet_pton(AF_INET, group.c_str(), &address.sin_addr) != 1 || !IN_MULTICAST(ntohl(address.sin_addr.s_addr))) {
+		std::cerr << "cluster.group: " << group << " is not a multicast address" << std::endl;
+		return false;
+	}
+	memcpy(out, &address, sizeof(address));
+	return true;
+}
+
+bool ClusterSync::startMaster(const std::string& group, int groupPort, int nodes, int ttl)
+{
+	shutdown();
+	SOCKET s;
+	if (!groupAddressOf(group, groupPort, groupAddress) || !openSocket(s, groupPort + 1)) {
+		return false;
+	}
+	unsigned char hops = (unsigned char)std::max(1, std::min(ttl, 255));
+	setsockopt(s, IPPROTO_IP, IP_MULTICAST_TTL, (const char*)&hops, sizeof(hops));
+	// Nodes on the master's machine hear it too
+	unsigned char loop = 1;
+	setsockopt(s, IPPROTO_IP, IP_MULTICAST_LOOP, (const char*)&loop, sizeof(loop));
+	sock = (uintptr_t)s;
+	port = groupPort;
+	nodeCount = std::max(0, std::min(nodes, (int)MAX_NODES));
+	published = 0;
+	gathering = 0;
+	readyNodes = 0;
+	current = MASTER;
+	stopping = false;
+	if (nodeCount) {
+		barrier = std::thread(&ClusterSync::barrierLoop, this);
+	}
+	logStream(LOG_INFO) << "cluster master on " << group << ":" << groupPort << " for " << nodeCount << " nodes" << std::endl;
+	return true;
+}
+
+bool ClusterSync::startNode(const std::string& group, int groupPort, int nodeId)
+{
+	shutdown();
+	SOCKET s;
+	if (nodeId < 0 || nodeId >= MAX_NODES) {
+		std::cerr << "cluster.node: " << nodeId << " is not a node from 0 to " << MAX_NODES - 1 << std::endl;
+		return false;
+	}
+	if (!groupAddressOf(group, groupPort, groupAddress) || !openSocket(s, groupPort)) {
+		return false;
+	}
+	ip_mreq membership;
+	memset(&membership, 0, sizeof(membership));
+	membership.imr_multiaddr = ((const sockaddr_in*)groupAddress)->sin_addr;
+	membership.imr_interface.s_addr = htonl(INADDR_ANY);
+	if (setsockopt(s, IPPROTO_IP, IP_ADD_MEMBERSHIP, (const char*)&membership, sizeof(membership)) != 0) {
+		std::cerr << "cluster: could not join " << group << std::endl;
+		closesocket(s);
+		return false;
+	}
+	sock = (uintptr_t)s;
+	port = groupPort;
+	node = nodeId;
+	masterKnown = false;
+	pendingSize = 0;
+	pendingFrame = lastReceived = released = 0;
+	skipped = timeouts = 0;
+	current = NODE;
+	logStream(LOG_INFO) << "cluster node " << node << " on " << group << ":" << groupPort << std::endl;
+	return true;
+}
+
+void ClusterSync::shutdown()
+{
+	if (current == OFF) {
+		return;
+	}
+	stopping = true;
+	if (barrier.joinable()) {
+		barrier.join();
+	}
+	if (current == NODE && (skipped || timeouts)) {
+		logStream(LOG_INFO) << "cluster node " << node << ": " << skipped << " frames skipped, " << timeouts
+			<< " swap barriers timed out" << std::endl;
+	}
+	closesocket(socketOf(sock));
+	sock = (uintptr_t)INVALID_SOCKET;
+#ifdef _WIN32
+	WSACleanup();
+#endif
+	current = OFF;
+}
+
+bool ClusterSync::sendPacket(const void* address, uint16_t type, uint64_t frame, const void* data, size_t size)
+{
+	unsigned char buffer[sizeof(ClusterPacket) + MAX_PAYLOAD];
+	ClusterPacket header;
+	header.magic = CLUSTER_MAGIC;
+	header.type = type;
+	header.node = (uint16_t)node;
+	header.frame = frame;
+	header.size = (uint32_t)std::min(size, (size_t)MAX_PAYLOAD);
+	header.reserved = 0;
+	memcpy(buffer, &header, sizeof(header));
+	if (header.size) {
+		memcpy(buffer + sizeof(header), data, header.size);
+	}
+	int length = (int)(sizeof(header) + header.size);
+	return sendto(socketOf(sock), (const char*)buffer, length, 0, (const sockaddr*)address, sizeof(sockaddr_in)) == length;
+}
+
+bool ClusterSync::receivePacket(uint16_t& type, uint64_t& frame, uint16_t& from, void* data, size_t& size, int timeoutMs)
+{
+	SOCKET s = socketOf(sock);
+	fd_set readable;
+	FD_ZERO(&readable);
+	FD_SET(s, &readable);
+	timeval wait;
+	wait.tv_sec = std::max(timeoutMs, 0) / 1000;
+	wait.tv_usec = std::max(timeoutMs, 0) % 1000 * 1000;
+	if (select((int)s + 1, &readable, nullptr, nullptr, timeoutMs < 0 ? nullptr : &wait) <= 0) {
+		return false;
+	}
+	unsigned char buffer[sizeof(ClusterPacket) + MAX_PAYLOAD];
+	sockaddr_in sender;
+	socklen_t senderSize = sizeof(sender);
+	int length = recvfrom(s, (char*)buffer, sizeof(buffer), 0, (sockaddr*)&sender, &senderSize);
+	ClusterPacket header;
+	if (length < (int)sizeof(header)) {
+		return false;
+	}
+	memcpy(&header, buffer, sizeof(header));
+	if (header.magic != CLUSTER_MAGIC || header.size > MAX_PAYLOAD || length < (int)(sizeof(header) + header.size)) {
+		return false;
+	}
+	type = header.type;
+	frame = header.frame;
+	from = header.node;
+	size = header.size;
+	memcpy(data, buffer + sizeof(header), size);
+	// The master's answers go back where its states come from
+	if (current == NODE && type == PACKET_STATE) {
+		memcpy(masterAddress, &sender, sizeof(sender));
+		masterKnown = true;
+	}
+	return true;
+}
+
+void ClusterSync::publish(const void* data, size_t size)
+{
+	if (current != MASTER) {
+		return;
+	}
+	if (size > MAX_PAYLOAD) {
+		std::cerr << "cluster: a " << size << " byte state does not fit a datagram" << std::endl;
+		return;
+	}
+	sendPacket(groupAddress, PACKET_STATE, ++published, data, size);
+}
+
+void ClusterSync::barrierLoop()
+{
+	unsigned char data[MAX_PAYLOAD];
+	const uint64_t everyone = (1ull << nodeCount) - 1;
+	while (!stopping) {
+		uint16_t type, from;
+		uint64_t frame;
+		size_t size;
+		// Wakes up now and then to see whether it is to stop
+		if (!receivePacket(type, frame, from, data, size, 100) || type != PACKET_READY || from >= nodeCount) {
+			continue;
+		}
+		// A node still on an older frame is let go at once, it is behind already
+		if (frame < gathering) {
+			sendPacket(groupAddress, PACKET_SWAP, frame, nullptr, 0);
+			continue;
+		}
+		if (frame > gathering) {
+			gathering = frame;
+			readyNodes = 0;
+		}
+		readyNodes |= 1ull << from;
+		if ((readyNodes & everyone) == everyone) {
+			sendPacket(groupAddress, PACKET_SWAP, frame, nullptr, 0);
+		}
+	}
+}
+
+void ClusterSync::takePacket(uint16_t type, uint64_t frame, const void* data, size_t size)
+{
+	if (type == PACKET_STATE && frame + RESTART_GAP < pendingFrame) {
+		logStream(LOG_INFO) << "cluster node " << node << ": the master started over" << std::endl;
+		pendingFrame = lastReceived = released = 0;
+	}
+	if (type == PACKET_SWAP) {
+		released = std::max(released, frame);
+	}
+	else if (type == PACKET_STATE && frame > pendingFrame) {
+		if (pendingFrame > lastReceived) {
+			skipped++;
+		}
+		memcpy(pending, data, size);
+		pendingSize = size;
+		pendingFrame = frame;
+	}
+}
+
+bool ClusterSync::receive(uint64_t& frame, void* data, size_t& size, int timeoutMs)
+{
+	if (current != NODE) {
+		return false;
+	}
+	unsigned char packet[MAX_PAYLOAD];
+	uint16_t type, from;
+	uint64_t packetFrame;
+	size_t packetSize;
+	// Whatever has arrived, then the wait for a newer state if there is none
+	while (receivePacket(type, packetFrame, from, packet, packetSize, 0)) {
+		takePacket(type, packetFrame, packet, packetSize);
+	}
+	double deadline = nowMs() + timeoutMs;
+	while (pendingFrame <= lastReceived) {
+		int left = (int)(deadline - nowMs());
+		if (left <= 0 || !receivePacket(type, packetFrame, from, packet, packetSize, left)) {
+			return false;
+		}
+		takePacket(type, packetFrame, packet, packetSize);
+	}
+	frame = lastReceived = pendingFrame;
+	size = pendingSize;
+	memcpy(data, pending, pendingSize);
+	return true;
+}
+
+bool ClusterSync::swapBarrier(uint64_t frame, int timeoutMs)
+{
+	if (current != NODE || !masterKnown) {
+		return false;
+	}
+	sendPacket(masterAddress, PACKET_READY, frame, nullptr, 0);
+	unsigned char packet[MAX_PAYLOAD];
+	uint16_t type, from;
+	uint64_t packetFrame;
+	size_t packetSize;
+	double deadline = nowMs() + timeoutMs;
+	while (released < frame) {
+		int left = (int)(deadline - nowMs());
+		if (left <= 0) {
+			timeouts++;
+			return false;
+		}
+		if (receivePacket(type, packetFrame, from, packet, packetSize, left)) {
+			takePacket(type, packetFrame, packet, packetSize);
+		}
+	}
+	return true;
+}
@@ -0,0 +1,103 @@
+#ifndef _CLUSTER_SYNC_H_
+#define _CLUSTER_SYNC_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+// The network side of a CAVE rendered by a cluster: one master that owns the tracking and
+// the simulation, and render nodes that each drive some of the walls from the state the
+// master sends them.
+//
+// Every frame the master multicasts the frame's state (an opaque record of at most
+// MAX_PAYLOAD bytes, one datagram) to the group. A node renders the newest state it has,
+// then waits at the swap barrier: it tells the master it is ready with the frame, and the
+// master multicasts the swap for it once every one of its nodes is, so all the walls
+// change at the same moment. The master never waits on the nodes, its barrier runs on a
+// thread of its own; a node that misses the swap for timeoutMs swaps anyway and counts it.
+//
+// Datagrams are a ClusterPacket header and the payload. Those from a different build
+// (magic) or another cluster (port) are dropped. A state numbered far behind the newest
+// means the master started over, the node follows it from there.
+class ClusterSync
+{
+public:
+	enum Role { OFF, MASTER, NODE };
+	enum { MAX_PAYLOAD = 1200, MAX_NODES = 32 };
+
+	ClusterSync();
+	~ClusterSync();
+
+	ClusterSync(const ClusterSync&) = delete;
+	ClusterSync& operator=(const ClusterSync&) = delete;
+
+	//! Sends to the group on port, and releases a frame once nodeCount nodes are ready
+	// with it. The nodes answer on port + 1.
+	// @input ttl How many routers the state crosses, 1 keeps it on the local network
+	bool startMaster(const std::string& group, int port, int nodeCount, int ttl);
+	//! Joins the group on port as node (0 to MAX_NODES - 1, unique in the cluster)
+	bool startNode(const std::string& group, int port, int node);
+	void shutdown();
+
+	Role role() const { return current; }
+
+	//! Master: multicasts the frame's state, numbered from 1 on
+	void publish(const void* data, size_t size);
+
+	//! Node: the newest state received, if it is newer than the last one returned. Waits
+	// up to timeoutMs for one, 0 only takes what has arrived.
+	// @input data At least MAX_PAYLOAD bytes
+	bool receive(uint64_t& frame, void* data, size_t& size, int timeoutMs);
+
+	//! Node: tells the master the frame is rendered and waits for its swap, false if the
+	// wait timed out
+	bool swapBarrier(uint64_t frame, int timeoutMs);
+
+	// Frames the node skipped because a newer one had arrived, and barriers that timed out
+	uint64_t skippedFrames() const { return skipped; }
+	uint64_t barrierTimeouts() const { return timeouts; }
+
+private:
+	void barrierLoop();
+	// Sends the payload to address (a sockaddr_in)
+	bool sendPacket(const void* address, uint16_t type, uint64_t frame, const void* data, size_t size);
+	// One datagram within timeoutMs (negative waits forever), false if none came. A node
+	// keeps where the states come from, to answer there.
+	bool receivePacket(uint16_t& type, uint64_t& frame, uint16_t& from, void* data, size_t& size, int timeoutMs);
+	// Node: keeps a state newer than the pending one, notes a swap
+	void takePacket(uint16_t type, uint64_t frame, const void* data, size_t size);
+
+	Role current;
+	uintptr_t sock;
+	int port;
+	int node;
+	int nodeCount;
+	// The group's address, and the master's as the node last heard from it (sockaddr_in)
+	unsigned char groupAddress[16];
+	unsigned char masterAddress[16];
+	bool masterKnown;
+
+	// Master: the last frame sent, the frame being gathered and the nodes ready with it
+	uint64_t published;
+	std::thread barrier;
+	std::atomic<bool> stopping;
+	uint64_t gathering;
+	uint64_t readyNodes;
+
+	// Node: the newest state that came in (while waiting for a swap, say) and the frame of
+	// the last one returned, the newest swap the master released
+	unsigned char pending[MAX_PAYLOAD];
+	size_t pendingSize;
+	uint64_t pendingFrame;
+	uint64_t lastReceived;
+	uint64_t released;
+	uint64_t skipped;
+	uint64_t timeouts;
+};
+
+// The config's cluster.role: off, master or node
+ClusterSync::Role parseClusterRole(const std::string& role);
+
+#endif
@@ -0,0 +1,97 @@
+#include "CommandBuffer.h"
+#include "GLState.h"
+
+#include <cstring>
+
+// A header word is the op in the low byte, its slot or unit in the next and, for calls,
+// the payload's bytes in the high half
+static const int ARG_SHIFT = 8;
+static const int EXTRA_SHIFT = 32;
+
+static size_t wordsFor(size_t bytes)
+{
+	return (bytes + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+}
+
+uint64_t* CommandBuffer::append(Op op, unsigned arg, size_t operandWords, uint32_t extra)
+{
+	size_t at = words.size();
+	words.resize(at + 1 + operandWords);
+	words[at] = (uint64_t)op | (uint64_t)(arg & 0xff) << ARG_SHIFT | (uint64_t)extra << EXTRA_SHIFT;
+	return &words[at + 1];
+}
+
+void CommandBuffer::setInt(unsigned slot, int value)
+{
+	int32_t operand = value;
+	memcpy(append(SET_INT, slot, 1), &operand, sizeof(operand));
+}
+
+void CommandBuffer::setFloat(unsigned slot, float value)
+{
+	memcpy(append(SET_FLOAT, slot, 1), &value, sizeof(value));
+}
+
+void CommandBuffer::setMat4(unsigned slot, const glm::mat4& value)
+{
+	memcpy(append(SET_MAT4, slot, wordsFor(sizeof(glm::mat4))), &value[0][0], sizeof(glm::mat4));
+}
+
+void CommandBuffer::bindTexture(unsigned unit, GLenum target, GLuint texture)
+{
+	*append(BIND_TEXTURE, unit, 1) = (uint64_t)target | (uint64_t)texture << 32;
+}
+
+void* CommandBuffer::call(Call call, void* context, uint32_t bytes)
+{
+	uint64_t* operands = append(CALL, 0, 2 + wordsFor(bytes), bytes);
+	operands[0] = 0;
+	operands[1] = 0;
+	memcpy(&operands[0], &call, sizeof(call));
+	memcpy(&operands[1], &context, sizeof(context));
+	return &operands[2];
+}
+
+void CommandBuffer::replay(const GLint* locations) const
+{
+	const uint64_t* word = words.data();
+	const uint64_t* end = word + words.size();
+	while (word < end) {
+		uint64_t header = *word++;
+		unsigned arg = (unsigned)(header >> ARG_SHIFT) & 0xff;
+		switch ((Op)(header & 0xff)) {
+		case SET_INT: {
+			int32_t value;
+			memcpy(&value, word, sizeof(value));
+			glUniform1i(locations[arg], value);
+			word++;
+			break;
+		}
+		case SET_FLOAT: {
+			float value;
+			memcpy(&value, word, sizeof(value));
+			glUniform1f(locations[arg], value);
+			word++;
+			break;
+		}
+		case SET_MAT4:
+			glUniformMatrix4fv(locations[arg], 1, GL_FALSE, reinterpret_cast<const GLfloat*>(word));
+			word += wordsFor(sizeof(glm::mat4));
+			break;
+		case BIND_TEXTURE:
+			glState().bindTexture(arg, (GLenum)(*word & 0xffffffff), (GLuint)(*word >> 32));
+			word++;
+			break;
+		case CALL: {
+			uint32_t bytes = (uint32_t)(header >> EXTRA_SHIFT);
+			Call call;
+			void* context;
+			memcpy(&call, &word[0], sizeof(call));
+			memcpy(&context, &word[1], sizeof(context));
+			call(context, &word[2], bytes);
+			word += 2 + wordsFor(bytes);
+			break;
+		}
+		}
+	}
+}
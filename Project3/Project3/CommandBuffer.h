@@ -0,0 +1,71 @@
+#ifndef _COMMAND_BUFFER_H_
+#define _COMMAND_BUFFER_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A pass's draws written down as a compact stream on any thread and replayed later on the
+// GL thread, so the work of deciding what a pass draws can be spread over the workers
+// while the GL calls stay on the one thread that may make them.
+//
+// Recording makes no GL calls and knows no program: uniforms are named by a slot, an index
+// into the locations replay is given, so one stream replays into any program that has them
+// (the depth pre-pass and the shading pass of a wall). What is not a uniform or a texture
+// is a call of a function with a payload of bytes copied into the stream, for the draws
+// themselves. Commands are whole 8 byte words, a header and their operands, so replaying
+// one is a switch and a few loads.
+//
+// A stream keeps its storage when cleared, so once the first frames have grown it
+// recording allocates nothing.
+class CommandBuffer
+{
+public:
+	// Replays a call: context as recorded, data the payload (8 byte aligned), bytes its size
+	typedef void (*Call)(void* context, const void* data, uint32_t bytes);
+
+	CommandBuffer() {}
+
+	CommandBuffer(const CommandBuffer&) = delete;
+	CommandBuffer& operator=(const CommandBuffer&) = delete;
+
+	void clear() { words.clear(); }
+	bool empty() const { return words.empty(); }
+	size_t bytes() const { return words.size() * sizeof(uint64_t); }
+
+	// slot is below 256, into the locations given to replay
+	void setInt(unsigned slot, int value);
+	void setFloat(unsigned slot, float value);
+	void setMat4(unsigned slot, const glm::mat4& value);
+	void bindTexture(unsigned unit, GLenum target, GLuint texture);
+	//! Records a call of call with bytes of payload.
+	// @return Where the payload goes, for the caller to fill before recording anything else
+	void* call(Call call, void* context, uint32_t bytes = 0);
+
+	//! Makes the recorded GL calls in order. Only on the GL thread.
+	// @input locations The uniform location of each slot recorded, -1 for one to skip
+	void replay(const GLint* locations) const;
+
+private:
+	enum Op { SET_INT, SET_FLOAT, SET_MAT4, BIND_TEXTURE, CALL };
+
+	// Appends a command of operandWords after its header, returns where they go
+	uint64_t* append(Op op, unsigned arg, size_t operandWords, uint32_t extra = 0);
+
+	std::vector<uint64_t> words;
+};
+
+#endif
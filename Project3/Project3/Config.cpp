@@ -0,0 +1,114 @@
+#include "Config.h"
+#include "AssetArchive.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+static std::string trim(const std::string& s)
+{
+	size_t begin = s.find_first_not_of(" \t\r\n");
+	if (begin == std::string::npos) {
+		return std::string();
+	}
+	size_t end = s.find_last_not_of(" \t\r\n");
+	return s.substr(begin, end - begin + 1);
+}
+
+bool Config::load(const char* filename)
+{
+	std::string text;
+	if (!readAssetText(filename, text)) {
+		return false;
+	}
+	std::istringstream file(text);
+
+	std::string line;
+	int lineNumber = 0;
+	while (getline(file, line)) {
+		lineNumber++;
+		size_t comment = line.find('#');
+		if (comment != std::string::npos) {
+			line.erase(comment);
+		}
+		line = trim(line);
+		if (line.empty()) {
+			continue;
+		}
+
+		size_t equals = line.find('=');
+		if (equals == std::string::npos) {
+			std::cerr << filename << ":" << lineNumber << ": expected key = value" << std::endl;
+			continue;
+		}
+		values[trim(line.substr(0, equals))] = trim(line.substr(equals + 1));
+	}
+	return true;
+}
+
+void Config::parseArgs(int argc, char** argv)
+{
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg.compare(0, 2, "--") != 0) {
+			continue;
+		}
+		size_t equals = arg.find('=');
+		if (equals == std::string::npos) {
+			values[arg.substr(2)] = "1";
+		}
+		else {
+			values[arg.substr(2, equals - 2)] = arg.substr(equals + 1);
+		}
+	}
+}
+
+std::string Config::getString(const std::string& key, const std::string& fallback) const
+{
+	auto it = values.find(key);
+	return it == values.end() ? fallback : it->second;
+}
+
+int Config::getInt(const std::string& key, int fallback) const
+{
+	auto it = values.find(key);
+	if (it == values.end()) {
+		return fallback;
+	}
+	char* end;
+	long value = strtol(it->second.c_str(), &end, 10);
+	return end != it->second.c_str() && *end == '\0' ? (int)value : fallback;
+}
+
+float Config::getFloat(const std::string& key, float fallback) const
+{
+	auto it = values.find(key);
+	if (it == values.end()) {
+		return fallback;
+	}
+	char* end;
+	float value = strtof(it->second.c_str(), &end);
+	return end != it->second.c_str() && *end == '\0' ? value : fallback;
+}
+
+bool Config::getBool(const std::string& key, bool fallback) const
+{
+	auto it = values.find(key);
+	if (it == values.end()) {
+		return fallback;
+	}
+	const std::string& v = it->second;
+	if (v == "1" || v == "true" || v == "yes" || v == "on") {
+		return true;
+	}
+	if (v == "0" || v == "false" || v == "no" || v == "off") {
+		return false;
+	}
+	return fallback;
+}
+
+Config& config()
+{
+	static Config instance;
+	return instance;
+}
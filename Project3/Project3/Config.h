@@ -0,0 +1,33 @@
+#ifndef _CONFIG_H_
+#define _CONFIG_H_
+
+#include <string>
+#include <unordered_map>
+
+// Runtime settings as string key/value pairs. Read from a file of "key = value" lines
+// ('#' starts a comment) and then overridden by "--key=value" command line arguments,
+// so any setting can be changed for one run without touching the file. A bare "--key"
+// sets it to "1". Lookups fall back to the given default for missing or malformed values.
+class Config
+{
+public:
+	// Returns false if the file cannot be opened, which is fine for an optional file
+	bool load(const char* filename);
+	void parseArgs(int argc, char** argv);
+
+	void set(const std::string& key, const std::string& value) { values[key] = value; }
+	bool has(const std::string& key) const { return values.count(key) != 0; }
+
+	std::string getString(const std::string& key, const std::string& fallback = std::string()) const;
+	int getInt(const std::string& key, int fallback) const;
+	float getFloat(const std::string& key, float fallback) const;
+	bool getBool(const std::string& key, bool fallback) const;
+
+private:
+	std::unordered_map<std::string, std::string> values;
+};
+
+// The settings for this run. Loaded from project3.cfg and the command line in main().
+Config& config();
+
+#endif
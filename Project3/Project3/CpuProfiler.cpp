@@ -0,0 +1,185 @@
+#include "CpuProfiler.h"
+#include "Log.h"
+
+#include <Windows.h>
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+thread_local CpuProfiler::ThreadRing* CpuProfiler::currentRing = nullptr;
+
+CpuProfiler::CpuProfiler() : enabled_(false), ringSize(65536), ringCount(0)
+{
+	LARGE_INTEGER counter, frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	origin = counter.QuadPart;
+	microsecondsPerTick = 1000000.0 / (double)frequency.QuadPart;
+}
+
+int64_t CpuProfiler::ticks() const
+{
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return counter.QuadPart;
+}
+
+CpuProfiler::ThreadRing* CpuProfiler::addRing(const std::string& name)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	int id = ringCount.load();
+	if (id == MAX_THREADS) {
+		return nullptr;
+	}
+	ThreadRing* ring = new ThreadRing;
+	ring->events.resize(ringSize);
+	ring->written = 0;
+	ring->id = id + 1;
+	ring->name = name.empty() ? "thread " + std::to_string(ring->id) : name;
+	rings[id].reset(ring);
+	ringCount.store(id + 1);
+	return ring;
+}
+
+CpuProfiler::ThreadRing* CpuProfiler::threadRing()
+{
+	if (!currentRing) {
+		currentRing = addRing(std::string());
+	}
+	return currentRing;
+}
+
+void CpuProfiler::write(ThreadRing& ring, const char* name, int64_t start, int64_t end, int index)
+{
+	// Only one thread writes the ring, the count is published after the event so a reader
+	// never sees an event that is not written yet
+	uint64_t n = ring.written.load(std::memory_order_relaxed);
+	Event& event = ring.events[n % ring.events.size()];
+	event.name = name;
+	event.start = start;
+	event.end = end;
+	event.index = index;
+	ring.written.store(n + 1, std::memory_order_release);
+}
+
+void CpuProfiler::record(const char* name, int64_t start, int64_t end, int index)
+{
+	ThreadRing* ring = threadRing();
+	if (ring) {
+		write(*ring, name, start, end, index);
+	}
+}
+
+void CpuProfiler::counter(const char* name, int value)
+{
+	ThreadRing* ring = threadRing();
+	if (ring) {
+		write(*ring, name, ticks(), -1, value);
+	}
+}
+
+void CpuProfiler::nameThread(const char* name)
+{
+	ThreadRing* ring = threadRing();
+	if (ring) {
+		std::lock_guard<std::mutex> lock(mutex);
+		ring->name = name;
+	}
+}
+
+int CpuProfiler::track(const char* name)
+{
+	ThreadRing* ring = addRing(name);
+	return ring ? ring->id - 1 : -1;
+}
+
+void CpuProfiler::recordTo(int track, const char* name, int64_t start, int64_t end, int index)
+{
+	if (track >= 0 && track < ringCount.load(std::memory_order_acquire)) {
+		write(*rings[track], name, start, end, index);
+	}
+}
+
+static std::string jsonEscape(const std::string& s)
+{
+	std::string out;
+	for (char c : s) {
+		if (c == '"' || c == '\\') {
+			out += '\\';
+		}
+		if ((unsigned char)c >= 0x20) {
+			out += c;
+		}
+	}
+	return out;
+}
+
+bool CpuProfiler::writeTrace(const char* filename, int64_t since, const std::string& moreEvents) const
+{
+	FILE* fp = fopen(filename, "w");
+	if (!fp) {
+		std::cerr << "could not write CPU trace to " << filename << std::endl;
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	size_t total = 0;
+	fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+	bool first = true;
+	for (int r = 0; r < ringCount.load(); r++) {
+		const ThreadRing& ring = *rings[r];
+		fprintf(fp, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+			first ? "" : ",\n", ring.id, jsonEscape(ring.name).c_str());
+		first = false;
+
+		// The thread keeps writing while the ring is copied. Whatever it may have overwritten
+		// in the meantime is dropped instead of exported half old, half new.
+		size_t size = ring.events.size();
+		uint64_t end = ring.written.load(std::memory_order_acquire);
+		uint64_t begin = end > size ? end - size : 0;
+		std::vector<Event> events;
+		events.reserve((size_t)(end - begin));
+		for (uint64_t i = begin; i < end; i++) {
+			events.push_back(ring.events[i % size]);
+		}
+		uint64_t after = ring.written.load(std::memory_order_acquire);
+		size_t overwritten = after > size + begin ? (size_t)std::min<uint64_t>(after - size - begin, events.size()) : 0;
+
+		for (size_t i = overwritten; i < events.size(); i++) {
+			const Event& e = events[i];
+			if ((e.end < 0 ? e.start : e.end) < since) {
+				continue;
+			}
+			if (e.end < 0) {
+				fprintf(fp, ",\n{\"name\": \"%s\", \"ph\": \"C\", \"pid\": 1, \"ts\": %.3f, \"args\": {\"value\": %d}}",
+					jsonEscape(e.name).c_str(), (e.start - origin) * microsecondsPerTick, e.index);
+				total++;
+				continue;
+			}
+			fprintf(fp, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f",
+				jsonEscape(e.name).c_str(), ring.id, (e.start - origin) * microsecondsPerTick, (e.end - e.start) * microsecondsPerTick);
+			if (e.index >= 0) {
+				fprintf(fp, ", \"args\": {\"index\": %d}", e.index);
+			}
+			fprintf(fp, "}");
+			total++;
+		}
+	}
+	fputs(moreEvents.c_str(), fp);
+	fprintf(fp, "\n]}\n");
+	bool ok = ferror(fp) == 0;
+	fclose(fp);
+	if (!ok) {
+		std::cerr << "could not write CPU trace to " << filename << std::endl;
+		remove(filename);
+		return false;
+	}
+	logStream(LOG_INFO) << "wrote " << total << " CPU events to " << filename << std::endl;
+	return true;
+}
+
+CpuProfiler& cpuProfiler()
+{
+	static CpuProfiler instance;
+	return instance;
+}
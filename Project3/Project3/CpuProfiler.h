@@ -0,0 +1,111 @@
+#ifndef _CPU_PROFILER_H_
+#define _CPU_PROFILER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Scoped CPU timings of every frame, for a chrome://tracing timeline of what the frame
+// spends its time on. Each thread writes into a ring of its own, so recording takes no lock
+// and never allocates once the thread's first scope made its ring. Only the newest events
+// are kept, writeTrace() exports whatever the rings hold at the time.
+class CpuProfiler
+{
+public:
+	// Counters are events with no end, their value in index
+	struct Event
+	{
+		const char* name;
+		int64_t start;
+		int64_t end;
+		int index;
+	};
+
+	enum { MAX_THREADS = 64 };
+
+	CpuProfiler();
+
+	void setEnabled(bool on) { enabled_ = on; }
+	bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+	// Events kept per thread, for rings made after the call
+	void setRingSize(size_t events) { ringSize = events ? events : 1; }
+
+	int64_t ticks() const;
+	double ticksPerSecond() const { return 1000000.0 / microsecondsPerTick; }
+	// Where ticks falls in a trace, in microseconds
+	double traceTime(int64_t ticks) const { return (ticks - origin) * microsecondsPerTick; }
+	//! Appends an event to the calling thread's ring
+	// @input name A string that outlives the profiler, a literal
+	// @input index Shows up as the event's argument, -1 for none
+	void record(const char* name, int64_t start, int64_t end, int index);
+	// A value at this time, shown as a graph of its own
+	void counter(const char* name, int value);
+	// The calling thread's row label in the trace
+	void nameThread(const char* name);
+
+	// A row of its own for events that are not the calling thread's, such as the GPU's.
+	// Only one thread may record to a track. Returns -1 once there are MAX_THREADS rows.
+	int track(const char* name);
+	void recordTo(int track, const char* name, int64_t start, int64_t end, int index);
+
+	//! Writes the Trace Event Format, the events of all threads in one file.
+	// @input since Leaves out events that ended before these ticks, 0 for all
+	// @input moreEvents Events of the caller's, each after a ",\n", written after the rest
+	bool writeTrace(const char* filename, int64_t since = 0, const std::string& moreEvents = std::string()) const;
+
+private:
+	struct ThreadRing
+	{
+		std::vector<Event> events;
+		std::atomic<uint64_t> written;
+		int id;
+		std::string name;
+	};
+
+	ThreadRing* addRing(const std::string& name);
+	ThreadRing* threadRing();
+	static void write(ThreadRing& ring, const char* name, int64_t start, int64_t end, int index);
+	// The calling thread's ring, there is one profiler
+	static thread_local ThreadRing* currentRing;
+
+	std::atomic<bool> enabled_;
+	size_t ringSize;
+	int64_t origin;
+	double microsecondsPerTick;
+	// Guards adding rings and their names, not their events
+	mutable std::mutex mutex;
+	std::unique_ptr<ThreadRing> rings[MAX_THREADS];
+	std::atomic<int> ringCount;
+};
+
+CpuProfiler& cpuProfiler();
+
+// Records the time from construction to destruction, does nothing while the profiler is off
+class CpuScope
+{
+public:
+	explicit CpuScope(const char* name, int index = -1)
+		: name(cpuProfiler().enabled() ? name : nullptr), index(index), start(this->name ? cpuProfiler().ticks() : 0)
+	{
+	}
+	~CpuScope()
+	{
+		if (name) {
+			CpuProfiler& profiler = cpuProfiler();
+			profiler.record(name, start, profiler.ticks(), index);
+		}
+	}
+
+	CpuScope(const CpuScope&) = delete;
+	CpuScope& operator=(const CpuScope&) = delete;
+
+private:
+	const char* name;
+	int index;
+	int64_t start;
+};
+
+#endif
@@ -0,0 +1,155 @@
+#include "DebugDraw.h"
+#include "FrameRing.h"
+#include "GLState.h"
+#include "GLStats.h"
+#include "GpuMemory.h"
+
+#include <glm/gtc/matrix_inverse.hpp>
+
+#include <algorithm>
+#include <cstddef>
+
+static uint32_t packColor(const glm::vec3& color)
+{
+	glm::vec3 c = glm::clamp(color, glm::vec3(0.f), glm::vec3(1.f)) * 255.f + 0.5f;
+	return (uint32_t)c.r | ((uint32_t)c.g << 8) | ((uint32_t)c.b << 16) | 0xff000000u;
+}
+
+DebugDraw::DebugDraw() : vao(0), vbo(0), vboBytes(0)
+{
+}
+
+DebugDraw::~DebugDraw()
+{
+	shutdown();
+}
+
+void DebugDraw::init()
+{
+	shutdown();
+	glGenVertexArrays(1, &vao);
+	glGenBuffers(1, &vbo);
+	glState().bindVertexArray(vao);
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glState().bindVertexArray(0);
+}
+
+void DebugDraw::shutdown()
+{
+	if (vbo) {
+		if (vboBytes) {
+			gpuMemory().release(GpuMemory::KIND_BUFFER, vbo);
+		}
+		glDeleteBuffers(1, &vbo);
+		vbo = 0;
+		vboBytes = 0;
+	}
+	if (vao) {
+		glDeleteVertexArrays(1, &vao);
+		vao = 0;
+	}
+	vertices.clear();
+}
+
+void DebugDraw::line(const glm::vec3& from, const glm::vec3& to, const glm::vec3& color)
+{
+	uint32_t packed = packColor(color);
+	vertices.push_back({ from, packed });
+	vertices.push_back({ to, packed });
+}
+
+void DebugDraw::axes(const glm::mat4& frame, float size)
+{
+	glm::vec3 origin(frame[3]);
+	line(origin, origin + glm::vec3(frame[0]) * size, glm::vec3(1.f, 0.f, 0.f));
+	line(origin, origin + glm::vec3(frame[1]) * size, glm::vec3(0.f, 1.f, 0.f));
+	line(origin, origin + glm::vec3(frame[2]) * size, glm::vec3(0.f, 0.f, 1.f));
+}
+
+// The twelve edges of a box whose corners are numbered by their bits, x 1, y 2, z 4
+void DebugDraw::corners(const glm::vec3 points[8], const glm::vec3& color)
+{
+	for (int i = 0; i < 8; i++) {
+		for (int bit = 1; bit < 8; bit <<= 1) {
+			if (!(i & bit)) {
+				line(points[i], points[i | bit], color);
+			}
+		}
+	}
+}
+
+void DebugDraw::frustum(const glm::mat4& viewProjection, const glm::vec3& color)
+{
+	glm::mat4 inverse = glm::inverse(viewProjection);
+	glm::vec3 points[8];
+	for (int i = 0; i < 8; i++) {
+		glm::vec4 ndc((i & 1) ? 1.f : -1.f, (i & 2) ? 1.f : -1.f, (i & 4) ? 1.f : -1.f, 1.f);
+		glm::vec4 world = inverse * ndc;
+		points[i] = glm::vec3(world) / world.w;
+	}
+	corners(points, color);
+}
+
+void DebugDraw::pyramid(const glm::vec3& apex, const glm::vec3 base[4], const glm::vec3& color)
+{
+	for (int i = 0; i < 4; i++) {
+		line(apex, base[i], color);
+		line(base[i], base[(i + 1) % 4], color);
+	}
+}
+
+void DebugDraw::box(const glm::vec3& min, const glm::vec3& max, const glm::vec3& color)
+{
+	glm::vec3 points[8];
+	for (int i = 0; i < 8; i++) {
+		points[i] = glm::vec3((i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, (i & 4) ? max.z : min.z);
+	}
+	corners(points, color);
+}
+
+void DebugDraw::box(const glm::mat4& transform, const glm::vec3& color)
+{
+	glm::vec3 points[8];
+	for (int i = 0; i < 8; i++) {
+		points[i] = glm::vec3(transform * glm::vec4((i & 1) ? 1.f : -1.f, (i & 2) ? 1.f : -1.f, (i & 4) ? 1.f : -1.f, 1.f));
+	}
+	corners(points, color);
+}
+
+void DebugDraw::flush()
+{
+	if (vertices.empty() || !vao) {
+		vertices.clear();
+		return;
+	}
+	const size_t bytes = vertices.size() * sizeof(Vertex);
+	GLintptr offset = 0;
+	GLuint buffer = frameRing().buffer();
+	if (!frameRing().write(vertices.data(), bytes, sizeof(glm::vec4), offset)) {
+		// A fresh store every time, the last flush's draw may still read the old one
+		buffer = vbo;
+		offset = 0;
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		if (bytes > vboBytes) {
+			vboBytes = std::max(bytes, vboBytes * 2);
+			gpuMemory().allocate(GpuMemory::KIND_BUFFER, vbo, vboBytes, GpuMemory::STREAMING, "debug lines");
+		}
+		glBufferData(GL_ARRAY_BUFFER, vboBytes, nullptr, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, vertices.data());
+	}
+	glState().bindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offset);
+	glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (GLvoid*)(offset + offsetof(Vertex, color)));
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glDrawArrays(GL_LINES, 0, (GLsizei)vertices.size());
+	glStats().addDraw();
+	vertices.clear();
+}
+
+DebugDraw& debugDraw()
+{
+	static DebugDraw instance;
+	return instance;
+}
@@ -0,0 +1,75 @@
+#ifndef _DEBUG_DRAW_H_
+#define _DEBUG_DRAW_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// Immediate mode debug lines: anything can add lines, axes, frustums and boxes in world
+// space while a pass is set up, and the pass draws all of them at once with flush(), as one
+// GL_LINES draw from the frame ring (FrameRing.h) with debugLines.vert/.frag. Nothing is
+// kept from one flush to the next. Without room in the ring the lines go through a buffer
+// of its own, orphaned on every flush.
+class DebugDraw
+{
+public:
+	struct Vertex
+	{
+		glm::vec3 position;
+		// RGBA8, read normalized
+		uint32_t color;
+	};
+
+	DebugDraw();
+	~DebugDraw();
+
+	DebugDraw(const DebugDraw&) = delete;
+	DebugDraw& operator=(const DebugDraw&) = delete;
+
+	// With the context current
+	void init();
+	void shutdown();
+
+	void line(const glm::vec3& from, const glm::vec3& to, const glm::vec3& color);
+	// The frame's x, y and z axes, size long, in red, green and blue
+	void axes(const glm::mat4& frame, float size);
+	// The edges of what viewProjection sees, its near and far rectangles and the four sides
+	void frustum(const glm::mat4& viewProjection, const glm::vec3& color);
+	// From apex to each corner and around the corners in turn, a wall's view from an eye
+	void pyramid(const glm::vec3& apex, const glm::vec3 corners[4], const glm::vec3& color);
+	void box(const glm::vec3& min, const glm::vec3& max, const glm::vec3& color);
+	// The cube from -1 to 1 moved by transform
+	void box(const glm::mat4& transform, const glm::vec3& color);
+
+	size_t lineCount() const { return vertices.size() / 2; }
+	//! Draws the lines added since the last flush with the program in use, which has to be
+	// debugLines' or take its attributes, then forgets them
+	void flush();
+	void clear() { vertices.clear(); }
+	// The vertex array flush() draws with, for drawing with its vertex format elsewhere
+	GLuint vertexArray() const { return vao; }
+
+private:
+	void corners(const glm::vec3 points[8], const glm::vec3& color);
+
+	std::vector<Vertex> vertices;
+	GLuint vao;
+	GLuint vbo;
+	size_t vboBytes;
+};
+
+DebugDraw& debugDraw();
+
+#endif
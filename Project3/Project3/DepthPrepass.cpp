@@ -0,0 +1,117 @@
+#include "DepthPrepass.h"
+#include "GLExtensions.h"
+
+#include <algorithm>
+#include <iostream>
+
+DepthPrepass::DepthPrepass() : current(OFF), on(false), probing(false), enableAt(2.f), disableAt(1.5f), probeFrames(120),
+	sinceProbe(0), measured(0.f), frame(0), measuring(false), measuredFrame(false)
+{
+	for (int i = 0; i < FRAMES; i++) {
+		queries[i] = 0;
+		pixels[i] = 0;
+		pending[i] = false;
+	}
+}
+
+DepthPrepass::~DepthPrepass()
+{
+	shutdown();
+}
+
+bool DepthPrepass::parseMode(const std::string& name, Mode& mode)
+{
+	if (name == "off") {
+		mode = OFF;
+	}
+	else if (name == "on") {
+		mode = ON;
+	}
+	else if (name == "auto") {
+		mode = AUTO;
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+void DepthPrepass::init(Mode mode, float enableOverdraw, float disableOverdraw, int probe)
+{
+	shutdown();
+	current = mode;
+	enableAt = enableOverdraw;
+	// Below enableAt, or it would turn back off the frame after
+	disableAt = std::min(disableOverdraw, enableOverdraw);
+	probeFrames = std::max(probe, 2);
+	on = mode == ON;
+	if (mode != AUTO) {
+		return;
+	}
+	if (!supportsPipelineStatistics()) {
+		std::cerr << "pipeline statistics not supported, no overdraw to go by, the depth pre-pass stays off" << std::endl;
+		current = OFF;
+		return;
+	}
+	glGenQueries(FRAMES, queries);
+}
+
+void DepthPrepass::shutdown()
+{
+	if (queries[0]) {
+		glDeleteQueries(FRAMES, queries);
+	}
+	for (int i = 0; i < FRAMES; i++) {
+		queries[i] = 0;
+		pending[i] = false;
+	}
+	measuring = false;
+}
+
+void DepthPrepass::beginFrame()
+{
+	if (current != AUTO) {
+		return;
+	}
+	frame = (frame + 1) % FRAMES;
+	measuredFrame = false;
+	if (pending[frame]) {
+		// A frame the GPU is still on is dropped rather than waited for
+		GLint available = 0;
+		glGetQueryObjectiv(queries[frame], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available && pixels[frame]) {
+			GLuint64 invocations = 0;
+			glGetQueryObjectui64v(queries[frame], GL_QUERY_RESULT, &invocations);
+			measured = (float)((double)invocations / (double)pixels[frame]);
+			on = on ? measured >= disableAt : measured > enableAt;
+		}
+		pending[frame] = false;
+	}
+	// While on, one frame in probeFrames shades without it, to be measured
+	sinceProbe = on ? sinceProbe + 1 : 0;
+	probing = on && sinceProbe >= probeFrames;
+	if (probing) {
+		sinceProbe = 0;
+	}
+}
+
+void DepthPrepass::beginMeasure()
+{
+	if (current != AUTO || active() || measuredFrame) {
+		return;
+	}
+	glBeginQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB, queries[frame]);
+	measuring = true;
+}
+
+void DepthPrepass::endMeasure(uint64_t passPixels)
+{
+	if (!measuring) {
+		return;
+	}
+	glEndQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB);
+	pixels[frame] = passPixels;
+	pending[frame] = true;
+	measuring = false;
+	measuredFrame = true;
+}
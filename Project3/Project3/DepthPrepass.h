@@ -0,0 +1,76 @@
+#ifndef _DEPTH_PREPASS_H_
+#define _DEPTH_PREPASS_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+#include <string>
+
+// Whether the wall passes lay down depth before they shade (walls.depth_prepass). With the
+// pre-pass the wall objects are drawn twice: depth only, from the mesh pool's positions
+// stream and an empty fragment shader, then shaded with GL_EQUAL and no depth writes, so
+// every wall pixel runs the objects' fragment shader once however many of them overlap.
+//
+// AUTO decides from the overdraw it measures: the fragment shader invocations of the first
+// wall pass's shading draws each frame (GL_ARB_pipeline_statistics_query) over the pixels
+// of its viewports, read back FRAMES frames later and only if the GPU is done, like
+// GpuTimers. The pre-pass goes on above enableAt and off below disableAt. With it on the
+// shading draws run once a pixel and say nothing about overdraw, so every probeFrames
+// frames one frame goes without it to measure again.
+class DepthPrepass
+{
+public:
+	enum Mode { OFF, ON, AUTO };
+	enum { FRAMES = 3 };
+
+	DepthPrepass();
+	~DepthPrepass();
+
+	DepthPrepass(const DepthPrepass&) = delete;
+	DepthPrepass& operator=(const DepthPrepass&) = delete;
+
+	// "off", "on" or "auto", false for anything else
+	static bool parseMode(const std::string& name, Mode& mode);
+
+	// AUTO without pipeline statistics stays off, and says so
+	void init(Mode mode, float enableAt, float disableAt, int probeFrames);
+	void shutdown();
+	Mode mode() const { return current; }
+
+	// Reads back the oldest frame's measure and decides for the frame that starts
+	void beginFrame();
+	// Whether this frame's wall passes draw the pre-pass
+	bool active() const { return on && !probing; }
+
+	// Around the shading draws of a wall pass, pixels being its viewports' area. Only the
+	// first wall pass of a frame without the pre-pass is measured.
+	void beginMeasure();
+	void endMeasure(uint64_t pixels);
+	// Shaded fragments per wall pixel, as last read back, 0 before the first
+	float overdraw() const { return measured; }
+
+private:
+	Mode current;
+	bool on;
+	bool probing;
+	float enableAt;
+	float disableAt;
+	int probeFrames;
+	int sinceProbe;
+	float measured;
+
+	GLuint queries[FRAMES];
+	uint64_t pixels[FRAMES];
+	bool pending[FRAMES];
+	int frame;
+	bool measuring;
+	bool measuredFrame;
+};
+
+#endif
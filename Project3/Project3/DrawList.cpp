@@ -0,0 +1,279 @@
+#include "DrawList.h"
+#include "GLState.h"
+#include "MeshPool.h"
+#include "GpuMemory.h"
+#include "FrameRing.h"
+
+#include <cstddef>
+#include <iostream>
+
+DrawList::DrawList() : vao(0), depthVao(0), transformBuffer(0), tileBuffer(0), commandBuffer(0), transformCapacity(0),
+	tileCapacity(0), commandCapacity(0), divisor(1), depthDivisor(1), inRing(false), ringFrame(0), hasTiles(false), commandCount(0)
+{
+	for (int i = 0; i <= MAX_REPEAT; i++) {
+		repeatReady[i] = false;
+	}
+}
+
+DrawList::~DrawList()
+{
+	if (vao) {
+		glDeleteVertexArrays(1, &vao);
+		glDeleteVertexArrays(1, &depthVao);
+		gpuMemory().release(GpuMemory::KIND_BUFFER, transformBuffer);
+		gpuMemory().release(GpuMemory::KIND_BUFFER, commandBuffer);
+		glDeleteBuffers(1, &transformBuffer);
+		glDeleteBuffers(1, &commandBuffer);
+		if (tileBuffer) {
+			gpuMemory().release(GpuMemory::KIND_BUFFER, tileBuffer);
+			glDeleteBuffers(1, &tileBuffer);
+		}
+	}
+}
+
+bool DrawList::supported()
+{
+	return GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance;
+}
+
+bool DrawList::init(int groupCount, bool withTiles)
+{
+	if (!supported()) {
+		std::cerr << "multi draw indirect not supported, drawing objects one at a time" << std::endl;
+		return false;
+	}
+	groups.assign(groupCount, std::vector<DrawElementsIndirectCommand>());
+	groupStart.assign(groupCount, 0);
+
+	// The pool's geometry plus a model matrix per instance, one column per location
+	glGenVertexArrays(1, &vao);
+	glGenBuffers(1, &transformBuffer);
+	glGenBuffers(1, &commandBuffer);
+	glState().bindVertexArray(vao);
+	meshPool().setAttributes();
+	glBindBuffer(GL_ARRAY_BUFFER, transformBuffer);
+	for (GLuint column = 0; column < 4; column++) {
+		glEnableVertexAttribArray(5 + column);
+		glVertexAttribPointer(5 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (GLvoid*)(sizeof(glm::vec4) * column));
+		glVertexAttribDivisor(5 + column, divisor);
+	}
+	// The tile's rect and layer, next to the matrix
+	hasTiles = withTiles;
+	if (hasTiles) {
+		glGenBuffers(1, &tileBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, tileBuffer);
+		glEnableVertexAttribArray(9);
+		glVertexAttribPointer(9, 4, GL_FLOAT, GL_FALSE, sizeof(AtlasTile), (GLvoid*)offsetof(AtlasTile, rect));
+		glVertexAttribDivisor(9, divisor);
+		glEnableVertexAttribArray(10);
+		glVertexAttribPointer(10, 1, GL_FLOAT, GL_FALSE, sizeof(AtlasTile), (GLvoid*)offsetof(AtlasTile, layer));
+		glVertexAttribDivisor(10, divisor);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// The depth pre-pass only needs where things are
+	glGenVertexArrays(1, &depthVao);
+	glState().bindVertexArray(depthVao);
+	meshPool().setPositionAttributes();
+	glBindBuffer(GL_ARRAY_BUFFER, transformBuffer);
+	for (GLuint column = 0; column < 4; column++) {
+		glEnableVertexAttribArray(5 + column);
+		glVertexAttribPointer(5 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (GLvoid*)(sizeof(glm::vec4) * column));
+		glVertexAttribDivisor(5 + column, depthDivisor);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glState().bindVertexArray(0);
+	return true;
+}
+
+void DrawList::begin()
+{
+	transforms.clear();
+	tiles.clear();
+	for (auto& group : groups) {
+		group.clear();
+	}
+	commandCount = 0;
+}
+
+void DrawList::add(int group, int meshId, const glm::mat4* objectTransforms, GLsizei count, const AtlasTile* objectTiles)
+{
+	if (count <= 0) {
+		return;
+	}
+	const MeshRange& range = meshPool().mesh(meshId);
+	DrawElementsIndirectCommand command;
+	command.count = (GLuint)range.indexCount;
+	command.instanceCount = (GLuint)count;
+	command.firstIndex = range.firstIndex;
+	command.baseVertex = range.baseVertex;
+	command.baseInstance = (GLuint)transforms.size();
+	groups[group].push_back(command);
+	transforms.insert(transforms.end(), objectTransforms, objectTransforms + count);
+	if (hasTiles) {
+		if (objectTiles) {
+			tiles.insert(tiles.end(), objectTiles, objectTiles + count);
+		}
+		else {
+			tiles.insert(tiles.end(), (size_t)count, noAtlasTile());
+		}
+	}
+	commandCount++;
+}
+
+void DrawList::end()
+{
+	if (!vao) {
+		return;
+	}
+	GLsizei start = 0;
+	for (size_t i = 0; i < groups.size(); i++) {
+		groupStart[i] = start;
+		start += (GLsizei)groups[i].size();
+	}
+
+	writeInstances();
+
+	// One array of commands per repeat count, filled when that count is first drawn
+	GLsizeiptr commandBytes = (GLsizeiptr)(commandCount * sizeof(DrawElementsIndirectCommand)) * (MAX_REPEAT + 1);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+	if (commandBytes > commandCapacity) {
+		commandCapacity = commandBytes;
+		gpuMemory().allocate(GpuMemory::KIND_BUFFER, commandBuffer, commandCapacity, GpuMemory::STREAMING, "draw list commands");
+	}
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, commandCapacity, nullptr, GL_STREAM_DRAW);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	for (int i = 0; i <= MAX_REPEAT; i++) {
+		repeatReady[i] = false;
+	}
+}
+
+// The frame ring's space is fresh every frame. Without it the list's own buffers are
+// orphaned every frame instead, the last frame's draws may still be reading the old storage.
+void DrawList::writeInstances()
+{
+	GLsizeiptr bytes = (GLsizeiptr)(transforms.size() * sizeof(glm::mat4));
+	GLsizeiptr tileBytes = (GLsizeiptr)(tiles.size() * sizeof(AtlasTile));
+	GLintptr transformOffset = 0, tileOffset = 0;
+	bool ring = bytes && frameRing().write(transforms.data(), bytes, sizeof(glm::vec4), transformOffset);
+	if (ring && hasTiles) {
+		ring = tileBytes && frameRing().write(tiles.data(), tileBytes, sizeof(glm::vec4), tileOffset);
+	}
+	if (ring) {
+		pointInstances(frameRing().buffer(), transformOffset, tileOffset);
+	}
+	else {
+		if (inRing) {
+			pointInstances(0, 0, 0);
+		}
+		uploadOwn(bytes, tileBytes);
+	}
+	inRing = ring;
+	ringFrame = frameRing().frameIndex();
+}
+
+// The transforms and tiles into the list's own buffers
+void DrawList::uploadOwn(GLsizeiptr bytes, GLsizeiptr tileBytes)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, transformBuffer);
+	if (bytes > transformCapacity) {
+		transformCapacity = bytes;
+		gpuMemory().allocate(GpuMemory::KIND_BUFFER, transformBuffer, transformCapacity, GpuMemory::STREAMING, "draw list transforms");
+	}
+	glBufferData(GL_ARRAY_BUFFER, transformCapacity, nullptr, GL_STREAM_DRAW);
+	if (bytes) {
+		glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, transforms.data());
+	}
+	if (hasTiles) {
+		glBindBuffer(GL_ARRAY_BUFFER, tileBuffer);
+		if (tileBytes > tileCapacity) {
+			tileCapacity = tileBytes;
+			gpuMemory().allocate(GpuMemory::KIND_BUFFER, tileBuffer, tileCapacity, GpuMemory::STREAMING, "draw list tiles");
+		}
+		glBufferData(GL_ARRAY_BUFFER, tileCapacity, nullptr, GL_STREAM_DRAW);
+		if (tileBytes) {
+			glBufferSubData(GL_ARRAY_BUFFER, 0, tileBytes, tiles.data());
+		}
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Points both vertex arrays' per instance attributes into buffer, the frame ring's, at the
+// given offsets, or with buffer 0 back at the list's own buffers
+void DrawList::pointInstances(GLuint buffer, GLintptr transformOffset, GLintptr tileOffset)
+{
+	for (GLuint array : { vao, depthVao }) {
+		glState().bindVertexArray(array);
+		glBindBuffer(GL_ARRAY_BUFFER, buffer ? buffer : transformBuffer);
+		for (GLuint column = 0; column < 4; column++) {
+			glVertexAttribPointer(5 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+				(GLvoid*)(transformOffset + sizeof(glm::vec4) * column));
+		}
+		if (hasTiles && array == vao) {
+			glBindBuffer(GL_ARRAY_BUFFER, buffer ? buffer : tileBuffer);
+			glVertexAttribPointer(9, 4, GL_FLOAT, GL_FALSE, sizeof(AtlasTile), (GLvoid*)(tileOffset + offsetof(AtlasTile, rect)));
+			glVertexAttribPointer(10, 1, GL_FLOAT, GL_FALSE, sizeof(AtlasTile), (GLvoid*)(tileOffset + offsetof(AtlasTile, layer)));
+		}
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glState().bindVertexArray(0);
+}
+
+bool DrawList::empty(int group) const
+{
+	return groups.empty() || groups[group].empty();
+}
+
+void DrawList::prepareRepeat(GLsizei repeat)
+{
+	if (repeatReady[repeat]) {
+		return;
+	}
+	std::vector<DrawElementsIndirectCommand> commands;
+	commands.reserve(commandCount);
+	for (const auto& group : groups) {
+		for (DrawElementsIndirectCommand command : group) {
+			command.instanceCount *= (GLuint)repeat;
+			commands.push_back(command);
+		}
+	}
+	GLsizeiptr stride = (GLsizeiptr)(commandCount * sizeof(DrawElementsIndirectCommand));
+	glBufferSubData(GL_DRAW_INDIRECT_BUFFER, stride * repeat, stride, commands.data());
+	repeatReady[repeat] = true;
+}
+
+void DrawList::draw(int group, GLsizei repeat, bool positionsOnly)
+{
+	if (!vao || empty(group) || repeat < 1 || repeat > MAX_REPEAT) {
+		return;
+	}
+	// A list kept from an earlier frame points into ring space that frame has given back,
+	// which another frame may be writing by now; its instances go in again first
+	if (inRing && ringFrame != frameRing().frameIndex()) {
+		writeInstances();
+	}
+	glState().bindVertexArray(positionsOnly ? depthVao : vao);
+	// baseInstance is added after the divisor, so every object still starts at its own matrix
+	GLuint& current = positionsOnly ? depthDivisor : divisor;
+	if (current != (GLuint)repeat) {
+		setDivisor(current, (GLuint)repeat, hasTiles && !positionsOnly);
+	}
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+	prepareRepeat(repeat);
+	GLsizeiptr offset = (GLsizeiptr)((commandCount * repeat + groupStart[group]) * sizeof(DrawElementsIndirectCommand));
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const GLvoid*)offset, (GLsizei)groups[group].size(), 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+// For the bound vertex array, current being its divisor
+void DrawList::setDivisor(GLuint& current, GLuint repeat, bool tiles)
+{
+	current = repeat;
+	for (GLuint column = 0; column < 4; column++) {
+		glVertexAttribDivisor(5 + column, repeat);
+	}
+	if (tiles) {
+		glVertexAttribDivisor(9, repeat);
+		glVertexAttribDivisor(10, repeat);
+	}
+}
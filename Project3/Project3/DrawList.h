@@ -0,0 +1,112 @@
+#ifndef _DRAW_LIST_H_
+#define _DRAW_LIST_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "TextureAtlas.h"
+
+// The layout glMultiDrawElementsIndirect reads
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+// A frame's draws of mesh pool geometry as indirect commands, in groups that each go out
+// in one glMultiDrawElementsIndirect. Everything in a group shares the program, textures
+// and render state; what differs per object is its model matrix, read from attribute 5
+// (InstanceTransform) and picked by the command's baseInstance. A list made with tiles also
+// gives every object an atlas tile (attributes 9 and 10, see AtlasTile), so objects with
+// different textures on one atlas still share a group.
+//
+// A list is recorded once per frame and then drawn by every pass. One drawn again in a later
+// frame without being recorded again writes its instances again first. Passes drawing each
+// object once per layer (the layered wall pass) pass that repeat count, the commands for
+// it are made from the recorded ones the first time it is asked for.
+// Needs ARB_multi_draw_indirect and ARB_base_instance.
+class DrawList
+{
+public:
+	enum { MAX_REPEAT = 16 };
+
+	DrawList();
+	~DrawList();
+
+	DrawList(const DrawList&) = delete;
+	DrawList& operator=(const DrawList&) = delete;
+
+	static bool supported();
+	// groups is how many separately drawn groups there are, tiles whether objects have tiles
+	bool init(int groups, bool tiles = false);
+	bool valid() const { return vao != 0; }
+
+	// Starts recording a new frame's list
+	void begin();
+	// count objects of the mesh, with model matrices transforms[0..count) and, in a list
+	// with tiles, atlas tiles[0..count) (none given is no image)
+	void add(int group, int meshId, const glm::mat4* transforms, GLsizei count, const AtlasTile* tiles = nullptr);
+	void add(int group, int meshId, const glm::mat4& transform) { add(group, meshId, &transform, 1); }
+	// Uploads what was recorded, before the first draw
+	void end();
+
+	// Draws a group, each object repeat times in a row (with the transform divisor at
+	// repeat), with the list's vertex array. The program takes the model from attribute 5.
+	// positionsOnly draws from the pool's positions stream and the transforms alone, for
+	// the depth pre-pass.
+	void draw(int group, GLsizei repeat = 1, bool positionsOnly = false);
+	bool empty(int group) const;
+
+private:
+	// The recorded transforms and tiles into the frame ring, or the list's own buffers
+	void writeInstances();
+	void uploadOwn(GLsizeiptr bytes, GLsizeiptr tileBytes);
+	void pointInstances(GLuint buffer, GLintptr transformOffset, GLintptr tileOffset);
+	void prepareRepeat(GLsizei repeat);
+	void setDivisor(GLuint& current, GLuint repeat, bool tiles);
+
+	GLuint vao;
+	// The positions and transforms only
+	GLuint depthVao;
+	GLuint transformBuffer;
+	GLuint tileBuffer;
+	GLuint commandBuffer;
+	GLsizeiptr transformCapacity;
+	GLsizeiptr tileCapacity;
+	GLsizeiptr commandCapacity;
+	// Of each vertex array, divisors are vertex array state
+	GLuint divisor;
+	GLuint depthDivisor;
+	// The vertex arrays read the transforms and tiles from the frame ring, written in the
+	// ring's frame ringFrame
+	bool inRing;
+	uint64_t ringFrame;
+
+	std::vector<glm::mat4> transforms;
+	bool hasTiles;
+	std::vector<AtlasTile> tiles;
+	// Recorded commands by group, at a repeat of 1
+	std::vector<std::vector<DrawElementsIndirectCommand>> groups;
+	// Where each group starts in the command array of one repeat count
+	std::vector<GLsizei> groupStart;
+	GLsizei commandCount;
+	bool repeatReady[MAX_REPEAT + 1];
+};
+
+#endif
@@ -0,0 +1,67 @@
+#include "DrawQueue.h"
+
+#include <algorithm>
+
+uint64_t DrawQueue::key(unsigned pass, unsigned program, unsigned material, float distance)
+{
+	// Distances go to [0, 1) without a far plane, closer ones still get most of the steps
+	float d = std::max(distance, 0.f);
+	uint64_t depth = (uint64_t)(d / (d + 1.f) * (float)0xffffff);
+	return (uint64_t)(pass & 0xff) << 56 | (uint64_t)(program & 0xfff) << 44 | (uint64_t)(material & 0xfffff) << 24
+		| std::min<uint64_t>(depth, 0xffffff);
+}
+
+void DrawQueue::add(uint64_t key, Submit submit, void* context, uint32_t item)
+{
+	Entry entry = { key, submit, context, item };
+	entries.push_back(entry);
+}
+
+void DrawQueue::sort()
+{
+	size_t count = entries.size();
+	if (count < 2) {
+		return;
+	}
+	scratch.resize(count);
+
+	// Every byte's histogram in one pass over the keys
+	size_t counts[8][256] = {};
+	for (const Entry& entry : entries) {
+		for (int byte = 0; byte < 8; byte++) {
+			counts[byte][(entry.key >> (byte * 8)) & 0xff]++;
+		}
+	}
+
+	Entry* from = entries.data();
+	Entry* to = scratch.data();
+	for (int byte = 0; byte < 8; byte++) {
+		size_t* histogram = counts[byte];
+		// A byte all the keys share leaves the order as it is
+		if (histogram[(from[0].key >> (byte * 8)) & 0xff] == count) {
+			continue;
+		}
+		size_t offset = 0;
+		for (int bucket = 0; bucket < 256; bucket++) {
+			size_t n = histogram[bucket];
+			histogram[bucket] = offset;
+			offset += n;
+		}
+		for (size_t i = 0; i < count; i++) {
+			to[histogram[(from[i].key >> (byte * 8)) & 0xff]++] = from[i];
+		}
+		std::swap(from, to);
+	}
+	if (from != entries.data()) {
+		entries.swap(scratch);
+	}
+}
+
+void DrawQueue::execute()
+{
+	sort();
+	for (const Entry& entry : entries) {
+		entry.submit(entry.context, entry.item);
+	}
+	entries.clear();
+}
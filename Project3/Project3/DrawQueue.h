@@ -0,0 +1,57 @@
+#ifndef _DRAW_QUEUE_H_
+#define _DRAW_QUEUE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Draws collected for a pass and submitted in the order of a 64 bit key instead of the
+// order they were made in. From the top the key holds the pass, the program, the material
+// (the texture the draw binds) and the view distance, so draws with one program go out
+// together, within those the ones sharing a texture, and those front to back for the
+// depth test to reject what is behind. The binds themselves stay with the draws, going
+// through glState() they are only issued when something actually changes.
+//
+// Keys are radix sorted, a byte at a time, skipping the bytes all keys share. The queue
+// keeps its storage between frames.
+class DrawQueue
+{
+public:
+	// Draws queued item of context
+	typedef void (*Submit)(void* context, uint32_t item);
+
+	//! The sort key of a draw.
+	// @input pass Up to 255, passes sharing a queue go out in this order
+	// @input program, material Names or indices; only the low 12 and 20 bits count, draws
+	//		that share them are only put together, never drawn differently
+	// @input distance From the eye, 0 and up
+	static uint64_t key(unsigned pass, unsigned program, unsigned material, float distance);
+
+	DrawQueue() {}
+
+	DrawQueue(const DrawQueue&) = delete;
+	DrawQueue& operator=(const DrawQueue&) = delete;
+
+	void clear() { entries.clear(); }
+	void add(uint64_t key, Submit submit, void* context, uint32_t item);
+	size_t size() const { return entries.size(); }
+
+	//! Sorts what was added and submits it, then clears the queue
+	void execute();
+
+private:
+	struct Entry
+	{
+		uint64_t key;
+		Submit submit;
+		void* context;
+		uint32_t item;
+	};
+
+	void sort();
+
+	std::vector<Entry> entries;
+	std::vector<Entry> scratch;
+};
+
+#endif
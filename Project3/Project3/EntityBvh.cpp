@@ -0,0 +1,308 @@
+#include "EntityBvh.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+
+const uint32_t EntityBvh::LEAF_SIZE;
+
+// Refit boxes this much looser than when built make building again worth it
+static const float REBUILD_GROWTH = 1.5f;
+// Subtrees of at most this many entities are one piece of a split cull
+static const uint32_t TASK_SIZE = (uint32_t)EntityStore::PARALLEL_GRAIN;
+
+static float surfaceArea(const glm::vec3& lo, const glm::vec3& hi)
+{
+	glm::vec3 d = glm::max(hi - lo, glm::vec3(0.f));
+	return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+enum Side { OUTSIDE, STRADDLING, INSIDE };
+
+// Where a box is against a view's planes, the same test as EntityStore::boxInside plus
+// whether it is wholly inside
+static Side classify(const glm::vec4 planes[6], const glm::vec3& lo, const glm::vec3& hi)
+{
+	Side side = INSIDE;
+	for (int p = 0; p < 6; p++) {
+		const glm::vec4& plane = planes[p];
+		// The corners furthest along the plane's normal and furthest against it
+		glm::vec3 far(plane.x >= 0.f ? hi.x : lo.x, plane.y >= 0.f ? hi.y : lo.y, plane.z >= 0.f ? hi.z : lo.z);
+		glm::vec3 near(plane.x >= 0.f ? lo.x : hi.x, plane.y >= 0.f ? lo.y : hi.y, plane.z >= 0.f ? lo.z : hi.z);
+		if (plane.x * far.x + plane.y * far.y + plane.z * far.z + plane.w < 0.f) {
+			return OUTSIDE;
+		}
+		if (plane.x * near.x + plane.y * near.y + plane.z * near.z + plane.w < 0.f) {
+			side = STRADDLING;
+		}
+	}
+	return side;
+}
+
+bool EntityBvh::update(const EntityStore& store, size_t first, size_t count)
+{
+	count = first < store.size() ? std::min(count, store.size() - first) : 0;
+	minima = store.boundsMin();
+	maxima = store.boundsMax();
+	bool rebuilt = false;
+	if (stale || first != this->first || count != this->count) {
+		this->first = first;
+		this->count = count;
+		builtCost = build(store);
+		rebuilt = true;
+	}
+	else if (store.version() != storeVersion && refit() > std::max(builtCost, FLT_MIN) * REBUILD_GROWTH) {
+		builtCost = build(store);
+		rebuilt = true;
+	}
+	storeVersion = store.version();
+	return rebuilt;
+}
+
+float EntityBvh::build(const EntityStore& store)
+{
+	nodes.clear();
+	items.resize(count);
+	centers.resize(count);
+	for (size_t i = 0; i < count; i++) {
+		items[i] = (uint32_t)(first + i);
+		centers[i] = (minima[first + i] + maxima[first + i]) * 0.5f;
+	}
+	if (count) {
+		nodes.reserve(2 * (count / LEAF_SIZE + 1));
+		buildNode(0, (uint32_t)count);
+	}
+	stale = false;
+	buildCount++;
+
+	float total = 0.f;
+	for (const Node& node : nodes) {
+		total += surfaceArea(node.lo, node.hi);
+	}
+	return total;
+}
+
+uint32_t EntityBvh::buildNode(uint32_t begin, uint32_t end)
+{
+	uint32_t index = (uint32_t)nodes.size();
+	nodes.push_back(Node());
+	glm::vec3 lo(FLT_MAX), hi(-FLT_MAX), centerLo(FLT_MAX), centerHi(-FLT_MAX);
+	for (uint32_t i = begin; i < end; i++) {
+		uint32_t item = items[i];
+		lo = glm::min(lo, minima[item]);
+		hi = glm::max(hi, maxima[item]);
+		centerLo = glm::min(centerLo, centers[item - first]);
+		centerHi = glm::max(centerHi, centers[item - first]);
+	}
+	nodes[index].lo = lo;
+	nodes[index].hi = hi;
+	nodes[index].start = begin;
+	nodes[index].size = end - begin;
+	nodes[index].right = 0;
+	if (end - begin <= LEAF_SIZE) {
+		return index;
+	}
+
+	// Half the entities either side of the median center along the widest axis
+	glm::vec3 spread = centerHi - centerLo;
+	int axis = spread.x >= spread.y && spread.x >= spread.z ? 0 : (spread.y >= spread.z ? 1 : 2);
+	uint32_t mid = begin + (end - begin) / 2;
+	const size_t offset = first;
+	const std::vector<glm::vec3>& c = centers;
+	std::nth_element(items.begin() + begin, items.begin() + mid, items.begin() + end,
+		[&](uint32_t a, uint32_t b) { return c[a - offset][axis] < c[b - offset][axis]; });
+	buildNode(begin, mid);
+	uint32_t right = buildNode(mid, end);
+	nodes[index].right = right;
+	return index;
+}
+
+float EntityBvh::refit()
+{
+	// Children come after their parents, so going backwards every child is done first
+	float total = 0.f;
+	for (size_t n = nodes.size(); n-- > 0;) {
+		Node& node = nodes[n];
+		if (node.right) {
+			const Node& left = nodes[n + 1];
+			const Node& right = nodes[node.right];
+			node.lo = glm::min(left.lo, right.lo);
+			node.hi = glm::max(left.hi, right.hi);
+		}
+		else {
+			glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+			for (uint32_t i = node.start; i < node.start + node.size; i++) {
+				lo = glm::min(lo, minima[items[i]]);
+				hi = glm::max(hi, maxima[items[i]]);
+			}
+			node.lo = lo;
+			node.hi = hi;
+		}
+		total += surfaceArea(node.lo, node.hi);
+	}
+	return total;
+}
+
+bool EntityBvh::cullViews(const EntityStore& store, const glm::mat4* viewProjections, size_t viewCount,
+	unsigned int firstBit, uint32_t* masks, JobSystem* jobSystem)
+{
+	const unsigned int MAX_VIEWS = EntityStore::MAX_VIEWS;
+	viewCount = std::min<size_t>(viewCount, MAX_VIEWS - std::min(firstBit, MAX_VIEWS));
+	if (!viewCount || nodes.empty()) {
+		return false;
+	}
+	minima = store.boundsMin();
+	maxima = store.boundsMax();
+	for (size_t v = 0; v < viewCount; v++) {
+		EntityStore::clipPlanes(viewProjections[v], planes[v]);
+	}
+	const uint32_t views = viewCount >= MAX_VIEWS ? ~0u : (1u << viewCount) - 1u;
+	this->firstBit = firstBit;
+	this->viewBits = views << firstBit;
+	this->masks = masks;
+
+	if (!jobSystem || count < 2 * EntityStore::PARALLEL_GRAIN) {
+		return walk(0, views, 0, false);
+	}
+	// The top of the tree here, what is below it split over the threads
+	tasks.clear();
+	bool changed = walk(0, views, 0, true);
+	std::atomic<bool> changedBelow(false);
+	jobSystem->parallelFor(tasks.size(), 1, [&](size_t begin, size_t end, unsigned int) {
+		bool any = false;
+		for (size_t t = begin; t < end; t++) {
+			any = walk(tasks[t].node, tasks[t].testing, tasks[t].inside, false) || any;
+		}
+		if (any) {
+			changedBelow.store(true, std::memory_order_relaxed);
+		}
+	});
+	return changed || changedBelow.load();
+}
+
+bool EntityBvh::walk(uint32_t index, uint32_t testing, uint32_t inside, bool split)
+{
+	const Node& node = nodes[index];
+	if (split && node.size <= TASK_SIZE) {
+		Task task = { index, testing, inside };
+		tasks.push_back(task);
+		return false;
+	}
+	uint32_t straddling = 0;
+	for (uint32_t bits = testing; bits; bits &= bits - 1) {
+		unsigned int v = 0;
+		while (!(bits & (1u << v))) {
+			v++;
+		}
+		Side side = classify(planes[v], node.lo, node.hi);
+		if (side == INSIDE) {
+			inside |= 1u << v;
+		}
+		else if (side == STRADDLING) {
+			straddling |= 1u << v;
+		}
+	}
+	if (!straddling) {
+		return cover(node, inside);
+	}
+	if (!node.right) {
+		bool any = false;
+		for (uint32_t i = node.start; i < node.start + node.size; i++) {
+			uint32_t item = items[i];
+			uint32_t visible = inside;
+			for (uint32_t bits = straddling; bits; bits &= bits - 1) {
+				unsigned int v = 0;
+				while (!(bits & (1u << v))) {
+					v++;
+				}
+				if (EntityStore::boxInside(planes[v], minima[item], maxima[item])) {
+					visible |= 1u << v;
+				}
+			}
+			uint32_t& mask = masks[item - first];
+			uint32_t updated = (mask & ~viewBits) | (visible << firstBit);
+			any = any || updated != mask;
+			mask = updated;
+		}
+		return any;
+	}
+	bool left = walk(index + 1, straddling, inside, split);
+	bool right = walk(node.right, straddling, inside, split);
+	return left || right;
+}
+
+// Everything under node is seen by exactly the views in bits
+bool EntityBvh::cover(const Node& node, uint32_t bits)
+{
+	bool any = false;
+	uint32_t visible = bits << firstBit;
+	for (uint32_t i = node.start; i < node.start + node.size; i++) {
+		uint32_t& mask = masks[items[i] - first];
+		uint32_t updated = (mask & ~viewBits) | visible;
+		any = any || updated != mask;
+		mask = updated;
+	}
+	return any;
+}
+
+bool EntityBvh::raycast(const EntityStore& store, const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+	size_t& hit, float& distance) const
+{
+	if (nodes.empty()) {
+		return false;
+	}
+	const glm::vec3* lo = store.boundsMin();
+	const glm::vec3* hi = store.boundsMax();
+	glm::vec3 inverseDirection = 1.f / direction;
+	float entered;
+	if (!EntityStore::rayHitsBox(origin, inverseDirection, nodes[0].lo, nodes[0].hi, maxDistance, entered)) {
+		return false;
+	}
+	// The median splits keep the tree about log2(count / LEAF_SIZE) deep, and every level
+	// leaves at most one node behind
+	struct Pending
+	{
+		uint32_t node;
+		float distance;
+	};
+	Pending stack[64];
+	int depth = 0;
+	stack[depth++] = { 0, entered };
+	bool any = false;
+	while (depth) {
+		Pending pending = stack[--depth];
+		// Pushed before a nearer hit was found
+		if (pending.distance > maxDistance) {
+			continue;
+		}
+		const Node& node = nodes[pending.node];
+		if (!node.right) {
+			for (uint32_t i = node.start; i < node.start + node.size; i++) {
+				uint32_t item = items[i];
+				if (EntityStore::rayHitsBox(origin, inverseDirection, lo[item], hi[item], maxDistance, entered)) {
+					hit = item;
+					distance = maxDistance = entered;
+					any = true;
+				}
+			}
+			continue;
+		}
+		uint32_t children[2] = { pending.node + 1, node.right };
+		float distances[2];
+		bool hits[2];
+		for (int c = 0; c < 2; c++) {
+			hits[c] = EntityStore::rayHitsBox(origin, inverseDirection, nodes[children[c]].lo, nodes[children[c]].hi, maxDistance,
+				distances[c]);
+		}
+		// The further one first, so the nearer one comes off the stack next
+		int nearer = hits[0] && (!hits[1] || distances[0] <= distances[1]) ? 0 : 1;
+		if (hits[1 - nearer] && depth < 64) {
+			stack[depth++] = { children[1 - nearer], distances[1 - nearer] };
+		}
+		if (hits[nearer] && depth < 64) {
+			stack[depth++] = { children[nearer], distances[nearer] };
+		}
+	}
+	return any;
+}
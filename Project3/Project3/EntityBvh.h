@@ -0,0 +1,104 @@
+#ifndef _ENTITY_BVH_H_
+#define _ENTITY_BVH_H_
+
+#include "EntityStore.h"
+
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+// A bounding volume hierarchy over a range of an EntityStore's entities, for culling them
+// against many views without testing every entity against every view. Built by splitting
+// the entities at the median of their centers along the widest axis, down to a few per
+// leaf. When entities move only the boxes are refit, the tree is built again once the
+// refit boxes have grown too loose, once the range changes size, or after invalidate().
+//
+// Culling walks the tree once for all views: a node wholly outside a view drops that view
+// for everything under it, one wholly inside sets its bit for everything under it, only
+// the views a node straddles go on being tested below it.
+class EntityBvh
+{
+public:
+	// At most this many entities to a leaf
+	static const uint32_t LEAF_SIZE = 4;
+
+	//! Brings the tree up to date with the store's bounds as of its last update.
+	// @input first, count The entities the tree is over, by index
+	// Returns whether it was built again rather than refit.
+	bool update(const EntityStore& store, size_t first, size_t count);
+	// Builds the tree again at the next update
+	void invalidate() { stale = true; }
+
+	//! Which of the views can see each of the tree's entities, the same as
+	// EntityStore::cullViews over first and count of the last update.
+	// @input store The store the tree was updated from, not changed since
+	// @input viewProjections viewCount matrices, viewCount + firstBit at most 32
+	// @input firstBit The bit of an entity's mask the first view sets
+	// Sets the views' bits of masks[0..count), one mask per entity, and leaves the other bits
+	// alone. Returns whether any of the bits changed.
+	bool cullViews(const EntityStore& store, const glm::mat4* viewProjections, size_t viewCount, unsigned int firstBit, uint32_t* masks,
+		JobSystem* jobSystem = nullptr);
+
+	//! The nearest of the tree's entities whose bounds a ray hits, the same as
+	// EntityStore::raycast over first and count of the last update. Walks the nearer child
+	// first and skips what lies past the nearest hit so far.
+	// @input store The store the tree was updated from, not changed since
+	bool raycast(const EntityStore& store, const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+		size_t& hit, float& distance) const;
+
+	size_t nodeCount() const { return nodes.size(); }
+	// Times built since the start, to tell how often refitting is not enough
+	uint64_t builds() const { return buildCount; }
+
+private:
+	// Every node's entities are together in items, a leaf's as much as an inner node's
+	struct Node
+	{
+		glm::vec3 lo;
+		uint32_t start;
+		glm::vec3 hi;
+		uint32_t size;
+		// The right child, the left one is the next node. 0 for leaves.
+		uint32_t right;
+	};
+	// A subtree left to walk, with the views still straddling it and the ones it is inside
+	struct Task
+	{
+		uint32_t node;
+		uint32_t testing;
+		uint32_t inside;
+	};
+
+	float build(const EntityStore& store);
+	uint32_t buildNode(uint32_t begin, uint32_t end);
+	// Both return the summed surface area of the nodes, how loose the tree is
+	float refit();
+	// Returns whether any mask changed. split queues subtrees small enough as tasks instead.
+	bool walk(uint32_t node, uint32_t testing, uint32_t inside, bool split);
+	bool cover(const Node& node, uint32_t bits);
+
+	std::vector<Node> nodes;
+	// Entity indices, each leaf's together
+	std::vector<uint32_t> items;
+	std::vector<glm::vec3> centers;
+	std::vector<Task> tasks;
+
+	size_t first = 0;
+	size_t count = 0;
+	uint64_t storeVersion = ~0ull;
+	// The nodes' summed surface area when last built
+	float builtCost = 0.f;
+	bool stale = true;
+	uint64_t buildCount = 0;
+
+	// What the walk of one cullViews works with
+	const glm::vec3* minima = nullptr;
+	const glm::vec3* maxima = nullptr;
+	glm::vec4 planes[EntityStore::MAX_VIEWS][6];
+	unsigned int firstBit = 0;
+	uint32_t viewBits = 0;
+	uint32_t* masks = nullptr;
+};
+
+#endif
@@ -0,0 +1,311 @@
+#include "EntityStore.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+const EntityStore::Entity EntityStore::NONE;
+const size_t EntityStore::PARALLEL_GRAIN;
+
+const unsigned int EntityStore::MAX_VIEWS;
+
+void EntityStore::clipPlanes(const glm::mat4& viewProjection, glm::vec4 planes[6])
+{
+	glm::vec4 row[4];
+	for (int r = 0; r < 4; r++) {
+		row[r] = glm::vec4(viewProjection[0][r], viewProjection[1][r], viewProjection[2][r], viewProjection[3][r]);
+	}
+	planes[0] = row[3] + row[0];
+	planes[1] = row[3] - row[0];
+	planes[2] = row[3] + row[1];
+	planes[3] = row[3] - row[1];
+	planes[4] = row[3] + row[2];
+	planes[5] = row[3] - row[2];
+}
+
+bool EntityStore::boxInside(const glm::vec4 planes[6], const glm::vec3& lo, const glm::vec3& hi)
+{
+	for (int p = 0; p < 6; p++) {
+		// The corner furthest along the plane's normal
+		const glm::vec4& plane = planes[p];
+		glm::vec3 corner(plane.x >= 0.f ? hi.x : lo.x, plane.y >= 0.f ? hi.y : lo.y, plane.z >= 0.f ? hi.z : lo.z);
+		if (plane.x * corner.x + plane.y * corner.y + plane.z * corner.z + plane.w < 0.f) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool EntityStore::rayHitsBox(const glm::vec3& origin, const glm::vec3& inverseDirection, const glm::vec3& lo, const glm::vec3& hi,
+	float maxDistance, float& distance)
+{
+	glm::vec3 toLo = (lo - origin) * inverseDirection;
+	glm::vec3 toHi = (hi - origin) * inverseDirection;
+	glm::vec3 enter = glm::min(toLo, toHi);
+	glm::vec3 leave = glm::max(toLo, toHi);
+	float nearest = std::max(std::max(enter.x, enter.y), std::max(enter.z, 0.f));
+	float furthest = std::min(std::min(leave.x, leave.y), std::min(leave.z, maxDistance));
+	// Not (nearest > furthest), so the NaN of a ray in the plane of a face misses
+	if (!(nearest <= furthest)) {
+		return false;
+	}
+	distance = nearest;
+	return true;
+}
+
+EntityStore::Entity EntityStore::create(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale,
+	const glm::vec3& halfExtent)
+{
+	Entity entity;
+	if (!freeHandles.empty()) {
+		entity = freeHandles.back();
+		freeHandles.pop_back();
+	}
+	else {
+		entity = (Entity)slots.size();
+		slots.push_back(NONE);
+	}
+	slots[entity] = (uint32_t)positions.size();
+	owners.push_back(entity);
+	positions.push_back(position);
+	rotations.push_back(rotation);
+	scales.push_back(scale);
+	extents.push_back(halfExtent);
+	worlds.push_back(glm::mat4(1.f));
+	minima.push_back(position);
+	maxima.push_back(position);
+	dirty.push_back(1);
+	stamps.push_back(changes + 1);
+	anyDirty = true;
+	return entity;
+}
+
+EntityStore::Entity EntityStore::create(size_t count, const glm::vec3* positions, const glm::quat* rotations,
+	const glm::vec3* scales, const glm::vec3* halfExtents)
+{
+	Entity first = (Entity)slots.size();
+	size_t begin = this->positions.size();
+	for (size_t i = 0; i < count; i++) {
+		slots.push_back((uint32_t)(begin + i));
+		owners.push_back(first + (Entity)i);
+	}
+	this->positions.insert(this->positions.end(), positions, positions + count);
+	this->rotations.insert(this->rotations.end(), rotations, rotations + count);
+	this->scales.insert(this->scales.end(), scales, scales + count);
+	extents.insert(extents.end(), halfExtents, halfExtents + count);
+	worlds.resize(begin + count, glm::mat4(1.f));
+	minima.insert(minima.end(), positions, positions + count);
+	maxima.insert(maxima.end(), positions, positions + count);
+	dirty.resize(begin + count, 1);
+	stamps.resize(begin + count, changes + 1);
+	anyDirty = anyDirty || count > 0;
+	return first;
+}
+
+void EntityStore::destroy(Entity entity)
+{
+	if (entity >= slots.size() || slots[entity] == NONE) {
+		return;
+	}
+	size_t index = slots[entity];
+	size_t last = positions.size() - 1;
+	if (index != last) {
+		positions[index] = positions[last];
+		rotations[index] = rotations[last];
+		scales[index] = scales[last];
+		extents[index] = extents[last];
+		worlds[index] = worlds[last];
+		minima[index] = minima[last];
+		maxima[index] = maxima[last];
+		dirty[index] = dirty[last];
+		stamps[index] = changes + 1;
+		owners[index] = owners[last];
+		slots[owners[index]] = (uint32_t)index;
+	}
+	positions.pop_back();
+	rotations.pop_back();
+	scales.pop_back();
+	extents.pop_back();
+	worlds.pop_back();
+	minima.pop_back();
+	maxima.pop_back();
+	dirty.pop_back();
+	stamps.pop_back();
+	owners.pop_back();
+	slots[entity] = NONE;
+	freeHandles.push_back(entity);
+	// What moved is a change for anyone holding a copy of the arrays
+	changes++;
+}
+
+void EntityStore::clear()
+{
+	positions.clear();
+	rotations.clear();
+	scales.clear();
+	extents.clear();
+	worlds.clear();
+	minima.clear();
+	maxima.clear();
+	dirty.clear();
+	stamps.clear();
+	owners.clear();
+	slots.clear();
+	freeHandles.clear();
+	anyDirty = false;
+	changes++;
+}
+
+void EntityStore::touch(size_t index)
+{
+	dirty[index] = 1;
+	anyDirty = true;
+}
+
+void EntityStore::setPosition(Entity entity, const glm::vec3& position)
+{
+	positions[slots[entity]] = position;
+	touch(slots[entity]);
+}
+
+void EntityStore::setRotation(Entity entity, const glm::quat& rotation)
+{
+	rotations[slots[entity]] = rotation;
+	touch(slots[entity]);
+}
+
+void EntityStore::setScale(Entity entity, const glm::vec3& scale)
+{
+	scales[slots[entity]] = scale;
+	touch(slots[entity]);
+}
+
+bool EntityStore::update(JobSystem* jobSystem)
+{
+	if (!anyDirty) {
+		return false;
+	}
+	const size_t count = positions.size();
+	if (jobSystem && count >= 2 * PARALLEL_GRAIN) {
+		jobSystem->parallelFor(count, PARALLEL_GRAIN, [this](size_t begin, size_t end, unsigned int) { rebuild(begin, end); });
+	}
+	else {
+		rebuild(0, count);
+	}
+	anyDirty = false;
+	changes++;
+	return true;
+}
+
+uint64_t EntityStore::version(size_t first, size_t count) const
+{
+	count = first < stamps.size() ? std::min(count, stamps.size() - first) : 0;
+	uint64_t latest = 0;
+	for (size_t i = first; i < first + count; i++) {
+		latest = std::max(latest, stamps[i]);
+	}
+	return latest;
+}
+
+void EntityStore::rebuild(size_t begin, size_t end)
+{
+	for (size_t i = begin; i < end; i++) {
+		if (!dirty[i]) {
+			continue;
+		}
+		// update() counts the change once the rebuild is done
+		stamps[i] = changes + 1;
+		// translate * rotate * scale, built directly
+		glm::mat3 basis = glm::mat3_cast(rotations[i]);
+		basis[0] *= scales[i].x;
+		basis[1] *= scales[i].y;
+		basis[2] *= scales[i].z;
+		glm::mat4& world = worlds[i];
+		world[0] = glm::vec4(basis[0], 0.f);
+		world[1] = glm::vec4(basis[1], 0.f);
+		world[2] = glm::vec4(basis[2], 0.f);
+		world[3] = glm::vec4(positions[i], 1.f);
+
+		// The box around the rotated and scaled bounds
+		const glm::vec3& e = extents[i];
+		glm::vec3 reach = glm::abs(basis[0]) * e.x + glm::abs(basis[1]) * e.y + glm::abs(basis[2]) * e.z;
+		minima[i] = positions[i] - reach;
+		maxima[i] = positions[i] + reach;
+		dirty[i] = 0;
+	}
+}
+
+size_t EntityStore::cull(const glm::mat4& viewProjection, size_t first, size_t count, uint32_t* visible) const
+{
+	glm::vec4 planes[6];
+	clipPlanes(viewProjection, planes);
+
+	size_t end = std::min(first + count, positions.size());
+	size_t found = 0;
+	for (size_t i = first; i < end; i++) {
+		if (boxInside(planes, minima[i], maxima[i])) {
+			visible[found++] = (uint32_t)i;
+		}
+	}
+	return found;
+}
+
+bool EntityStore::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, size_t first, size_t count,
+	size_t& hit, float& distance) const
+{
+	glm::vec3 inverseDirection = 1.f / direction;
+	size_t end = first < positions.size() ? first + std::min(count, positions.size() - first) : first;
+	bool any = false;
+	for (size_t i = first; i < end; i++) {
+		float entered;
+		if (rayHitsBox(origin, inverseDirection, minima[i], maxima[i], maxDistance, entered)) {
+			hit = i;
+			distance = maxDistance = entered;
+			any = true;
+		}
+	}
+	return any;
+}
+
+bool EntityStore::cullViews(const glm::mat4* viewProjections, size_t viewCount, unsigned int firstBit, size_t first,
+	size_t count, uint32_t* masks, JobSystem* jobSystem) const
+{
+	viewCount = std::min<size_t>(viewCount, MAX_VIEWS - std::min<unsigned int>(firstBit, MAX_VIEWS));
+	count = first < positions.size() ? std::min(count, positions.size() - first) : 0;
+	if (!viewCount || !count) {
+		return false;
+	}
+	glm::vec4 planes[MAX_VIEWS][6];
+	for (size_t v = 0; v < viewCount; v++) {
+		clipPlanes(viewProjections[v], planes[v]);
+	}
+	const uint32_t viewBits = (viewCount + firstBit >= MAX_VIEWS ? ~0u : (1u << (viewCount + firstBit)) - 1u) & ~((1u << firstBit) - 1u);
+
+	std::atomic<bool> changed(false);
+	auto test = [&](size_t begin, size_t end, unsigned int) {
+		bool any = false;
+		for (size_t i = begin; i < end; i++) {
+			const glm::vec3& lo = minima[first + i];
+			const glm::vec3& hi = maxima[first + i];
+			uint32_t mask = masks[i] & ~viewBits;
+			for (size_t v = 0; v < viewCount; v++) {
+				if (boxInside(planes[v], lo, hi)) {
+					mask |= 1u << (firstBit + v);
+				}
+			}
+			any = any || mask != masks[i];
+			masks[i] = mask;
+		}
+		if (any) {
+			changed.store(true, std::memory_order_relaxed);
+		}
+	};
+	if (jobSystem && count >= 2 * PARALLEL_GRAIN) {
+		jobSystem->parallelFor(count, PARALLEL_GRAIN, test);
+	}
+	else {
+		test(0, count, 0);
+	}
+	return changed.load();
+}
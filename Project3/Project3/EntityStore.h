@@ -0,0 +1,130 @@
+#ifndef _ENTITY_STORE_H_
+#define _ENTITY_STORE_H_
+
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+// The scene's objects as parallel arrays, one entry per object in each: position,
+// rotation, scale, world matrix and world bounds. Updates and culling walk the arrays
+// they need straight through, and the world matrices are laid out as an instance buffer
+// wants them, so a range of them can be uploaded or handed to a DrawList as they are.
+//
+// Entities are handles that stay valid, their index into the arrays can change when an
+// entity before the end is destroyed (the last one moves into its place).
+class EntityStore
+{
+public:
+	typedef uint32_t Entity;
+	static const Entity NONE = 0xffffffffu;
+
+	// halfExtent is the model's bounds around its origin, before the scale
+	Entity create(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale,
+		const glm::vec3& halfExtent = glm::vec3(1.f));
+	//! count entities at once, each array copied in whole, for a scene that is loaded rather
+	// than placed.
+	// @return The first's handle; the rest have the handles after it, never reused ones
+	Entity create(size_t count, const glm::vec3* positions, const glm::quat* rotations, const glm::vec3* scales,
+		const glm::vec3* halfExtents);
+	void destroy(Entity entity);
+	void clear();
+
+	size_t size() const { return positions.size(); }
+	size_t index(Entity entity) const { return slots[entity]; }
+	Entity entity(size_t index) const { return owners[index]; }
+
+	const glm::vec3& position(Entity entity) const { return positions[slots[entity]]; }
+	const glm::quat& rotation(Entity entity) const { return rotations[slots[entity]]; }
+	const glm::vec3& scale(Entity entity) const { return scales[slots[entity]]; }
+	void setPosition(Entity entity, const glm::vec3& position);
+	void setRotation(Entity entity, const glm::quat& rotation);
+	void setScale(Entity entity, const glm::vec3& scale);
+
+	// Brings the world matrices and bounds of everything changed since the last update up
+	// to date, split over the job system's threads when there are enough of them. Returns whether
+	// anything changed.
+	bool update(JobSystem* jobSystem = nullptr);
+	// As of the last update
+	const glm::mat4& world(Entity entity) const { return worlds[slots[entity]]; }
+	const glm::mat4* worldMatrices() const { return worlds.data(); }
+	const glm::vec3* boundsMin() const { return minima.data(); }
+	const glm::vec3* boundsMax() const { return maxima.data(); }
+	// Per index, as they were set, for writing the store out
+	const glm::vec3* positionArray() const { return positions.data(); }
+	const glm::quat* rotationArray() const { return rotations.data(); }
+	const glm::vec3* scaleArray() const { return scales.data(); }
+	const glm::vec3* extentArray() const { return extents.data(); }
+	// Goes up with every update that changed something, to tell when a copy is stale
+	uint64_t version() const { return changes; }
+	//! The version() that last changed any of count entities from index first, for a copy of
+	// part of the arrays that what moves elsewhere leaves alone. Goes over their stamps.
+	uint64_t version(size_t first, size_t count) const;
+
+	//! Which of the count entities from index first are at least partly inside a view.
+	// @input viewProjection Clip space is -w to w on every axis
+	// Writes their indices to visible and returns how many there are.
+	size_t cull(const glm::mat4& viewProjection, size_t first, size_t count, uint32_t* visible) const;
+	//! Which of several views can see each of count entities from index first, in one pass
+	// over their bounds split over the job system's threads.
+	// @input viewProjections viewCount matrices, viewCount + firstBit at most 32
+	// @input firstBit The bit of an entity's mask the first view sets
+	// Sets the views' bits of masks[0..count), one mask per entity, and leaves the other bits
+	// alone. Returns whether any of the bits changed.
+	bool cullViews(const glm::mat4* viewProjections, size_t viewCount, unsigned int firstBit, size_t first, size_t count,
+		uint32_t* masks, JobSystem* jobSystem = nullptr) const;
+	//! The nearest of count entities from index first whose bounds a ray hits, testing
+	// every one of them.
+	// @input direction Of unit length, so distances are along it
+	// @input hit, distance Receive its index and how far along the ray it was entered, 0 if
+	//		the ray starts inside it
+	// Returns false if none is hit closer than maxDistance.
+	bool raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, size_t first, size_t count,
+		size_t& hit, float& distance) const;
+
+	// Below this many entities a pass is not worth splitting, and the piece each thread takes
+	static const size_t PARALLEL_GRAIN = 256;
+	// The most views one cullViews can test, one mask bit each
+	static const unsigned int MAX_VIEWS = 32;
+
+	// The six clip planes of a view from the rows of its matrix, normals pointing in
+	static void clipPlanes(const glm::mat4& viewProjection, glm::vec4 planes[6]);
+	// Conservative: a box is out only if it is wholly behind one of the planes
+	static bool boxInside(const glm::vec4 planes[6], const glm::vec3& lo, const glm::vec3& hi);
+	//! Where a ray enters a box, by the slabs.
+	// @input inverseDirection 1 / direction per axis, infinite for an axis it does not move on
+	// @input distance Receives how far along the ray, 0 from inside. Returns false if it
+	//		misses it before maxDistance.
+	static bool rayHitsBox(const glm::vec3& origin, const glm::vec3& inverseDirection, const glm::vec3& lo, const glm::vec3& hi,
+		float maxDistance, float& distance);
+
+private:
+	void touch(size_t index);
+	void rebuild(size_t begin, size_t end);
+
+	std::vector<glm::vec3> positions;
+	std::vector<glm::quat> rotations;
+	std::vector<glm::vec3> scales;
+	std::vector<glm::vec3> extents;
+	std::vector<glm::mat4> worlds;
+	std::vector<glm::vec3> minima;
+	std::vector<glm::vec3> maxima;
+	std::vector<uint8_t> dirty;
+	// Per index, the version() its entry last changed in
+	std::vector<uint64_t> stamps;
+	// Index to entity, and entity to index (NONE once destroyed)
+	std::vector<Entity> owners;
+	std::vector<uint32_t> slots;
+	std::vector<Entity> freeHandles;
+	bool anyDirty = false;
+	uint64_t changes = 0;
+};
+
+#endif
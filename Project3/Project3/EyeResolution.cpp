@@ -0,0 +1,56 @@
+#include "EyeResolution.h"
+#include "Config.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Viewport sides move in steps of this much of the full size
+static const float SCALE_STEP = 1.0f / 32.0f;
+// Growing needs the GPU time this far under the target, so a step up does not go straight over
+static const float GROW_MARGIN = 0.8f;
+// Stats arrive a frame or two late, shrinking again before they show the last step would overshoot
+static const int SHRINK_FRAMES = 3;
+static const int GROW_FRAMES = 30;
+
+EyeResolution::EyeResolution() : enabled(false), minScale(0.6f), target(0.85f), current(1.0f), overBudget(0),
+	underBudget(0)
+{
+}
+
+void EyeResolution::configure()
+{
+	enabled = config().getBool("eyes.dynamic", false);
+	minScale = std::min(std::max(config().getFloat("eyes.min_scale", 0.6f), 0.25f), 1.0f);
+	target = std::min(std::max(config().getFloat("eyes.gpu_target", 0.85f), 0.1f), 1.0f);
+	current = 1.0f;
+	overBudget = 0;
+	underBudget = 0;
+}
+
+void EyeResolution::update(float gpuTime, float budget)
+{
+	if (!enabled || gpuTime <= 0.0f || budget <= 0.0f) {
+		return;
+	}
+	float limit = budget * target;
+	overBudget = gpuTime > limit ? overBudget + 1 : 0;
+	underBudget = gpuTime < limit * GROW_MARGIN ? underBudget + 1 : 0;
+
+	if (overBudget >= SHRINK_FRAMES) {
+		// GPU time goes with the pixel count, the square of the side, so the step is sized to
+		// bring it under the target at once
+		float wanted = current * std::sqrt(limit / gpuTime);
+		current = std::min(wanted, current - SCALE_STEP);
+		overBudget = 0;
+	}
+	else if (underBudget >= GROW_FRAMES) {
+		current = std::min(current + SCALE_STEP, 1.0f);
+		underBudget = 0;
+	}
+	current = std::min(std::max(std::floor(current / SCALE_STEP + 0.5f) * SCALE_STEP, minScale), 1.0f);
+}
+
+void EyeResolution::setScale(float scale)
+{
+	current = std::min(std::max(std::floor(scale / SCALE_STEP + 0.5f) * SCALE_STEP, minScale), 1.0f);
+}
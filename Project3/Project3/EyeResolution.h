@@ -0,0 +1,42 @@
+#ifndef _EYE_RESOLUTION_H_
+#define _EYE_RESOLUTION_H_
+
+// The part of the eye swap chain each frame renders into. The chain is allocated once at
+// full pixel density, a frame that would run over its GPU budget shrinks the eye viewports
+// inside it instead (the compositor samples just the viewport), and they grow back once
+// there is headroom again.
+//
+// Shrinking reacts within a few frames, growing waits for a run of quiet frames, so the
+// size does not flip back and forth around the budget.
+class EyeResolution
+{
+public:
+	EyeResolution();
+
+	// Reads eyes.dynamic, eyes.min_scale and eyes.gpu_target (the share of the frame budget
+	// the app's GPU time is held under)
+	void configure();
+
+	bool dynamic() const { return enabled; }
+
+	// Adjusts the scale from the app's last GPU time and the frame budget, in seconds, 0 when
+	// not known yet
+	void update(float gpuTime, float budget);
+
+	// Scale of the viewports' sides, min_scale to 1
+	float scale() const { return current; }
+	float minimumScale() const { return minScale; }
+	//! Sets the scale for a governor in charge of it instead of update(), held to min_scale
+	// and the steps
+	void setScale(float scale);
+
+private:
+	bool enabled;
+	float minScale;
+	float target;
+	float current;
+	int overBudget;
+	int underBudget;
+};
+
+#endif
@@ -0,0 +1,115 @@
+#include "FarField.h"
+#include "GLMarkers.h"
+#include "GLState.h"
+#include "GLStats.h"
+#include "GpuMemory.h"
+#include "TextureUpload.h"
+
+#include <algorithm>
+
+FarField::FarField() : format(GL_RGBA8), textureWidth(0), textureHeight(0), usedWidth(0), usedHeight(0), farViewProjection(1.0f)
+{
+}
+
+FarField::~FarField()
+{
+	release();
+}
+
+void FarField::release()
+{
+	if (color) {
+		gpuMemory().release(GpuMemory::KIND_TEXTURE, color);
+	}
+	color.reset();
+	framebuffer.reset();
+	vao.reset();
+	textureWidth = 0;
+	textureHeight = 0;
+	usedWidth = 0;
+	usedHeight = 0;
+}
+
+bool FarField::init(GLenum format)
+{
+	release();
+	if (!program.load("farField.vert", "farField.frag")) {
+		return false;
+	}
+	farFromEyeUniform = program.uniform("farFromEye");
+	farScaleUniform = program.uniform("farScale");
+	program.use();
+	program.setSampler("farColor", 0);
+	glState().useProgram(0);
+
+	framebuffer.create();
+	glMarkers().label(GL_FRAMEBUFFER, framebuffer, "far field");
+	// The triangle comes from gl_VertexID, there are no attributes
+	vao.create();
+	this->format = format;
+	return true;
+}
+
+void FarField::begin(GLsizei width, GLsizei height, const glm::mat4& projection, const glm::mat4& view)
+{
+	if (!valid()) {
+		return;
+	}
+	width = std::max(width, (GLsizei)1);
+	height = std::max(height, (GLsizei)1);
+	// Storage is immutable, a larger view takes a new texture. It only ever grows, the eye
+	// viewports shrinking under load draws into part of it.
+	if (width > textureWidth || height > textureHeight) {
+		if (color) {
+			gpuMemory().release(GpuMemory::KIND_TEXTURE, color);
+		}
+		textureWidth = std::max(width, textureWidth);
+		textureHeight = std::max(height, textureHeight);
+		color.reset();
+		color.create();
+		glState().bindTexture(0, GL_TEXTURE_2D, color);
+		allocateTextureStorage(GL_TEXTURE_2D, 1, format, textureWidth, textureHeight);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		gpuMemory().allocate(GpuMemory::KIND_TEXTURE, color, textureBytes(format, textureWidth, textureHeight, 1, 1),
+			GpuMemory::RENDER_TARGET, "far field");
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+		glDrawBuffer(GL_COLOR_ATTACHMENT0);
+	}
+	usedWidth = width;
+	usedHeight = height;
+	farViewProjection = projection * glm::mat4(glm::mat3(view));
+
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(0, 0, width, height);
+	glDisable(GL_DEPTH_TEST);
+	glClear(GL_COLOR_BUFFER_BIT);
+}
+
+void FarField::composite(const glm::mat4& projection, const glm::mat4& view)
+{
+	if (!valid() || !usedWidth) {
+		return;
+	}
+	// From the eye's clip space to a direction in the world and on into the far field's clip
+	// space. Both are projective, so the corners' results interpolate linearly on screen.
+	glm::mat4 eyeViewProjection = projection * glm::mat4(glm::mat3(view));
+	glm::mat4 farFromEye = farViewProjection * glm::inverse(eyeViewProjection);
+
+	program.use();
+	farFromEyeUniform.set(farFromEye);
+	farScaleUniform.set(glm::vec2((float)usedWidth / (float)textureWidth, (float)usedHeight / (float)textureHeight));
+	glState().bindTexture(0, GL_TEXTURE_2D, color);
+	glState().depthMask(false);
+	glDepthFunc(GL_LEQUAL);
+	glState().polygonMode(GL_FILL);
+	glState().bindVertexArray(vao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glStats().addDraw();
+	glState().bindVertexArray(0);
+	glDepthFunc(GL_LESS);
+	glState().depthMask(true);
+}
@@ -0,0 +1,74 @@
+#ifndef _FAR_FIELD_H_
+#define _FAR_FIELD_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+
+#include "GLHandle.h"
+#include "ShaderProgram.h"
+
+// What is far enough away that the eyes see it the same, rendered once a frame from between
+// them instead of once per eye. At 20 m a 64 mm baseline is a few arc minutes of disparity,
+// less than a pixel of the eye buffers, yet the outer skybox around the CAVE fills most of
+// both of them.
+//
+// The far field is drawn into a target of its own (begin), with a projection that takes in
+// both eyes' fields of view and a little more, so the head can still turn by the time the
+// eyes composite it. Each eye then lays it over its buffer as one triangle on the far plane
+// (composite), every pixel looked up by its direction only: the far field is taken to be at
+// infinity, only the rotation between the two views counts.
+class FarField
+{
+public:
+	FarField();
+	~FarField();
+
+	FarField(const FarField&) = delete;
+	FarField& operator=(const FarField&) = delete;
+
+	//! Loads the composite program. False, with nothing made, if it does not link.
+	bool init(GLenum format);
+	bool valid() const { return framebuffer.get() != 0; }
+	// Deletes the far field's texture, its framebuffer and vertex array
+	void release();
+
+	//! Binds the far field's target for a width by height view with projection and view,
+	// growing the target first if it is smaller, and clears it. Leaves the depth test off.
+	void begin(GLsizei width, GLsizei height, const glm::mat4& projection, const glm::mat4& view);
+	//! Draws what the far field holds into the bound framebuffer for an eye seen through
+	// projection and view, at the far plane and without writing depth, so whatever depth
+	// test the caller has on keeps it behind what is there. Leaves the far field's program
+	// in use.
+	void composite(const glm::mat4& projection, const glm::mat4& view);
+
+	GLsizei width() const { return usedWidth; }
+	GLsizei height() const { return usedHeight; }
+
+private:
+	ShaderProgram program;
+	Uniform farFromEyeUniform;
+	Uniform farScaleUniform;
+
+	GLTexture color;
+	GLFramebuffer framebuffer;
+	GLVertexArray vao;
+	GLenum format;
+	GLsizei textureWidth;
+	GLsizei textureHeight;
+	GLsizei usedWidth;
+	GLsizei usedHeight;
+	// The view begin() rendered with, rotation only
+	glm::mat4 farViewProjection;
+};
+
+#endif
@@ -0,0 +1,169 @@
+#include "FeatureToggles.h"
+#include "FrameBaselines.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+static const char* METRIC_NAMES[] = { "cpu", "gpu", "frame" };
+
+FeatureToggles::FeatureToggles() : selected(-1), comparedFeature(-1), original(false), windowFrames(0), windowsLeft(0),
+	settleFrames(0), settleLeft(0), framesLeft(0), windowCount(0)
+{
+}
+
+void FeatureToggles::add(const std::string& name, bool* flag, std::function<void()> changed)
+{
+	if (!flag || find(name) >= 0) {
+		return;
+	}
+	Feature feature = { name, flag, std::move(changed) };
+	features.push_back(std::move(feature));
+}
+
+void FeatureToggles::clear()
+{
+	features.clear();
+	selected = -1;
+	comparedFeature = -1;
+}
+
+int FeatureToggles::find(const std::string& name) const
+{
+	for (size_t i = 0; i < features.size(); i++) {
+		if (features[i].name == name) {
+			return (int)i;
+		}
+	}
+	return -1;
+}
+
+void FeatureToggles::set(int feature, bool on)
+{
+	Feature& toggled = features[feature];
+	if (*toggled.flag == on) {
+		return;
+	}
+	*toggled.flag = on;
+	if (toggled.changed) {
+		toggled.changed();
+	}
+}
+
+void FeatureToggles::selectNext()
+{
+	if (features.empty()) {
+		logStream(LOG_INFO) << "no features to switch" << std::endl;
+		return;
+	}
+	selected = (selected + 1) % (int)features.size();
+	logStream(LOG_INFO) << "feature: " << features[selected].name << " (" << (*features[selected].flag ? "on" : "off") << ")" << std::endl;
+}
+
+void FeatureToggles::toggleSelected()
+{
+	if (selected >= 0) {
+		toggle(features[selected].name);
+	}
+}
+
+bool FeatureToggles::toggle(const std::string& name)
+{
+	int feature = find(name);
+	if (feature < 0) {
+		return false;
+	}
+	if (feature == comparedFeature) {
+		logStream(LOG_INFO) << name << " is being compared, left alone" << std::endl;
+		return true;
+	}
+	set(feature, !*features[feature].flag);
+	logStream(LOG_INFO) << name << ": " << (*features[feature].flag ? "on" : "off") << std::endl;
+	return true;
+}
+
+bool FeatureToggles::compare(const std::string& name, int frames, int windows, int settle)
+{
+	int feature = find(name);
+	if (feature < 0 || comparing()) {
+		return false;
+	}
+	comparedFeature = feature;
+	original = *features[feature].flag;
+	windowFrames = std::max(frames, 1);
+	// Whole pairs, so both sides get as many windows
+	windowCount = std::max((windows + 1) / 2 * 2, 2);
+	windowsLeft = windowCount;
+	settleFrames = std::max(settle, 0);
+	settleLeft = settleFrames;
+	framesLeft = windowFrames;
+	for (auto& side : samples) {
+		for (std::vector<double>& metric : side) {
+			metric.clear();
+			metric.reserve((size_t)windowFrames * windowCount / 2);
+		}
+	}
+	logStream(LOG_INFO) << "comparing " << name << " over " << windowCount << " windows of " << windowFrames << " frames" << std::endl;
+	return true;
+}
+
+bool FeatureToggles::compareSelected(int frames, int windows, int settle)
+{
+	return selected >= 0 && compare(features[selected].name, frames, windows, settle);
+}
+
+void FeatureToggles::frame(double cpuMs, double gpuMs, double frameMs)
+{
+	if (!comparing()) {
+		return;
+	}
+	if (settleLeft > 0) {
+		settleLeft--;
+		return;
+	}
+	std::vector<double>* side = samples[*features[comparedFeature].flag ? 1 : 0];
+	side[CPU].push_back(cpuMs);
+	side[GPU].push_back(gpuMs);
+	side[FRAME].push_back(frameMs);
+	if (--framesLeft > 0) {
+		return;
+	}
+	if (--windowsLeft > 0) {
+		set(comparedFeature, !*features[comparedFeature].flag);
+		settleLeft = settleFrames;
+		framesLeft = windowFrames;
+		return;
+	}
+	set(comparedFeature, original);
+	print(logStream(LOG_INFO));
+	comparedFeature = -1;
+}
+
+void FeatureToggles::print(std::ostream& out) const
+{
+	out << "A/B " << features[comparedFeature].name << ", " << windowCount / 2 << " x " << windowFrames
+		<< " frames a side, ms p50 / p95 / p99:" << std::endl;
+	std::ios::fmtflags flags = out.flags();
+	std::streamsize precision = out.precision();
+	out << std::fixed << std::setprecision(2);
+	for (int metric = 0; metric < METRICS; metric++) {
+		FramePercentiles off = framePercentiles(samples[0][metric]);
+		FramePercentiles on = framePercentiles(samples[1][metric]);
+		out << "  " << std::left << std::setw(6) << METRIC_NAMES[metric] << std::right
+			<< "off " << off.p50 << " / " << off.p95 << " / " << off.p99
+			<< "   on " << on.p50 << " / " << on.p95 << " / " << on.p99;
+		if (off.p50 > 0.0) {
+			out << "   p50 " << std::showpos << (on.p50 - off.p50) / off.p50 * 100.0 << std::noshowpos << "%";
+		}
+		out << std::endl;
+	}
+	out.flags(flags);
+	out.precision(precision);
+}
+
+FeatureToggles& featureToggles()
+{
+	static FeatureToggles toggles;
+	return toggles;
+}
@@ -0,0 +1,85 @@
+#ifndef _FEATURE_TOGGLES_H_
+#define _FEATURE_TOGGLES_H_
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Optimizations that can be switched while the app runs, to see what each one is worth on
+// the station it runs on. Whoever owns a switch registers the bool it reads every frame;
+// switches are flipped between frames, on the render thread. Only switches that need
+// nothing made at startup to go either way are registered, or ones that were on at
+// startup and so had it made.
+//
+// A comparison (compare()) runs one switch through alternating windows of frames, as it was
+// and flipped, a few times over so drift in clocks and temperature shows on both sides. The
+// first frames of each window are left out while caches, incremental walls and the GPU
+// timers' latency catch up. Once done it prints CPU, GPU and frame to frame times of both
+// sides and puts the switch back.
+class FeatureToggles
+{
+public:
+	enum Metric { CPU, GPU, FRAME, METRICS };
+
+	FeatureToggles();
+
+	FeatureToggles(const FeatureToggles&) = delete;
+	FeatureToggles& operator=(const FeatureToggles&) = delete;
+
+	//! Registers a switch under name, the setting it comes from.
+	// @input flag Stays the owner's, it has to outlive the registration (clear())
+	// @input changed Called after every flip, for what has to follow it, or nullptr
+	void add(const std::string& name, bool* flag, std::function<void()> changed = nullptr);
+	// Forgets every switch, and any comparison running
+	void clear();
+	size_t size() const { return features.size(); }
+
+	// Selects the next switch and prints it, for the keyboard
+	void selectNext();
+	void toggleSelected();
+	// False if there is no such switch
+	bool toggle(const std::string& name);
+
+	//! Starts a comparison of a switch.
+	// @input frames Counted per window, after the settle frames
+	// @input windows How many, alternating from the switch's state as it is
+	// @return False if there is no such switch, or a comparison is running
+	bool compare(const std::string& name, int frames, int windows, int settle);
+	bool compareSelected(int frames, int windows, int settle);
+	bool comparing() const { return comparedFeature >= 0; }
+
+	// Render thread, once a frame is done while comparing: the frame's times in ms
+	void frame(double cpuMs, double gpuMs, double frameMs);
+
+private:
+	struct Feature
+	{
+		std::string name;
+		bool* flag;
+		std::function<void()> changed;
+	};
+
+	int find(const std::string& name) const;
+	void set(int feature, bool on);
+	// The two sides' times, off then on
+	void print(std::ostream& out) const;
+
+	std::vector<Feature> features;
+	int selected;
+
+	int comparedFeature;
+	bool original;
+	int windowFrames;
+	int windowsLeft;
+	int settleFrames;
+	int settleLeft;
+	int framesLeft;
+	int windowCount;
+	// By the switch's state, then metric
+	std::vector<double> samples[2][METRICS];
+};
+
+FeatureToggles& featureToggles();
+
+#endif
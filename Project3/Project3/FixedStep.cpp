@@ -0,0 +1,52 @@
+#include "FixedStep.h"
+#include "Config.h"
+
+#include <algorithm>
+
+FixedStep::FixedStep() : dt(1.0 / 120.0), maxSteps(4)
+{
+	reset();
+}
+
+void FixedStep::configure()
+{
+	configure(config().getFloat("sim.hz", 120.0f), config().getInt("sim.max_steps", 4));
+}
+
+void FixedStep::configure(double hz, int maxSteps)
+{
+	dt = 1.0 / std::max(hz, 1.0);
+	this->maxSteps = std::max(maxSteps, 1);
+	reset();
+}
+
+void FixedStep::reset()
+{
+	last = 0.0;
+	accumulator = 0.0;
+	started = false;
+	total = 0;
+	droppedTime = 0.0;
+}
+
+int FixedStep::advance(double now)
+{
+	if (!started) {
+		started = true;
+		last = now;
+		return 0;
+	}
+	accumulator += std::max(now - last, 0.0);
+	last = now;
+	int steps = (int)(accumulator / dt);
+	if (steps > maxSteps) {
+		droppedTime += accumulator - maxSteps * dt;
+		steps = maxSteps;
+		accumulator = 0.0;
+	}
+	else {
+		accumulator -= steps * dt;
+	}
+	total += steps;
+	return steps;
+}
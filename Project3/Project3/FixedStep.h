@@ -0,0 +1,46 @@
+#ifndef _FIXED_STEP_H_
+#define _FIXED_STEP_H_
+
+#include <cstdint>
+
+// Turns frame times into a whole number of fixed simulation steps, so the simulation moves
+// the same per second at 90 Hz, at 45 with ASW or unthrottled in the benchmark, and every
+// step does the same amount of work. The time left over carries to the next frame, and
+// alpha() says how far the frame is into the step after the last one taken, for drawing
+// in between the last two states.
+//
+// A frame that would need more than maxSteps (a hitch, or a breakpoint) drops the time it
+// could not catch up on, so a slow frame never makes the next one slower still.
+class FixedStep
+{
+public:
+	FixedStep();
+
+	// Reads sim.hz and sim.max_steps
+	void configure();
+	void configure(double hz, int maxSteps);
+	// Starts over, the next advance() only gives the time
+	void reset();
+
+	// How many steps to run for a frame at now (seconds, on any clock that only goes
+	// forward). The first call after a reset takes none.
+	int advance(double now);
+
+	double step() const { return dt; }
+	// 0 draws the state of the last step, 1 that of the next one
+	float alpha() const { return (float)(accumulator / dt); }
+	// Steps since the reset, and the time the frames had to drop
+	uint64_t steps() const { return total; }
+	double dropped() const { return droppedTime; }
+
+private:
+	double dt;
+	int maxSteps;
+	double last;
+	double accumulator;
+	bool started;
+	uint64_t total;
+	double droppedTime;
+};
+
+#endif
@@ -0,0 +1,152 @@
+#include "FlightRecorder.h"
+#include "Config.h"
+#include "CpuProfiler.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+FlightRecorder::FlightRecorder() : written(0), budgetMs(0.0f), margin(0.0f), afterFrames(0), minInterval(0.0), maxCaptures(0),
+	sdkGpuMs(0.0f), sdkAppDropped(0), sdkCompositorDropped(0), slowFrame(0), slowMs(0.0f), framesToCapture(0), lastCapture(0),
+	captures(0), missed(0)
+{
+}
+
+void FlightRecorder::configure(double refreshHz)
+{
+	if (!config().getBool("flight.recorder", false)) {
+		return;
+	}
+	double hz = refreshHz > 0.0 ? refreshHz : 60.0;
+	float seconds = std::max(config().getFloat("flight.seconds", 5.0f), 0.5f);
+	budgetMs = (float)(1000.0 / hz);
+	margin = std::max(config().getFloat("flight.margin", 0.5f), 0.0f);
+	afterFrames = std::max(config().getInt("flight.after_frames", 5), 0);
+	minInterval = std::max(config().getFloat("flight.min_interval", 30.0f), 0.0f);
+	maxCaptures = std::max(config().getInt("flight.max_captures", 10), 0);
+	prefix = config().getString("flight.prefix", "hitch");
+
+	ring.resize((size_t)(seconds * hz) + 1);
+	snapshot.reserve(ring.size());
+	written = 0;
+	if (!cpuProfiler().enabled()) {
+		std::cerr << "flight.recorder: profile.cpu is off, captures only have the frames' times" << std::endl;
+	}
+	logStream(LOG_INFO) << "flight recorder: " << ring.size() << " frames, captures frames over " << budgetMs * (1.0f + margin) << " ms" << std::endl;
+}
+
+void FlightRecorder::frame(uint32_t frame, float cpuMs, float gpuMs, float frameMs, int quality, uint64_t vramBytes)
+{
+	if (ring.empty()) {
+		return;
+	}
+	Frame& record = ring[written % ring.size()];
+	record.frame = frame;
+	record.end = cpuProfiler().ticks();
+	record.cpuMs = cpuMs;
+	record.gpuMs = gpuMs;
+	record.frameMs = frameMs;
+	record.sdkGpuMs = sdkGpuMs;
+	record.appDropped = sdkAppDropped;
+	record.compositorDropped = sdkCompositorDropped;
+	record.quality = quality;
+	record.vramBytes = vramBytes;
+	written++;
+
+	if (framesToCapture > 0) {
+		if (--framesToCapture == 0) {
+			capture();
+		}
+		return;
+	}
+	// Nothing is caught before the window has filled once, which also leaves out loading
+	if (written <= ring.size()) {
+		return;
+	}
+	const Frame& before = at(1);
+	bool dropped = record.appDropped > before.appDropped || record.compositorDropped > before.compositorDropped;
+	if (frameMs <= budgetMs * (1.0f + margin) && !dropped) {
+		return;
+	}
+	bool tooSoon = captures > 0 && record.end - lastCapture < (int64_t)(minInterval * cpuProfiler().ticksPerSecond());
+	if (captures >= maxCaptures || tooSoon || !writing.done()) {
+		missed++;
+		return;
+	}
+	slowFrame = frame;
+	slowMs = frameMs;
+	lastCapture = record.end;
+	captures++;
+	framesToCapture = afterFrames;
+	if (!framesToCapture) {
+		capture();
+	}
+}
+
+void FlightRecorder::capture()
+{
+	snapshot.clear();
+	size_t count = (size_t)std::min<uint64_t>(written, ring.size());
+	for (size_t age = count; age-- > 0;) {
+		snapshot.push_back(at(age));
+	}
+	filename = prefix + "_" + std::to_string(slowFrame) + ".json";
+	logStream(LOG_INFO) << "flight recorder: frame " << slowFrame << " took " << slowMs << " ms, writing " << filename << std::endl;
+	// The file is written off the render thread, which is already behind
+	jobs().submit([this] { write(); }, &writing);
+}
+
+void FlightRecorder::write()
+{
+	const CpuProfiler& profiler = cpuProfiler();
+	const Frame& first = snapshot.front();
+	int64_t since = first.end - (int64_t)(first.frameMs / 1000.0 * profiler.ticksPerSecond());
+
+	std::string events;
+	events.reserve(snapshot.size() * 512);
+	char line[512];
+	for (const Frame& f : snapshot) {
+		double ts = profiler.traceTime(f.end);
+		snprintf(line, sizeof(line), ",\n{\"name\": \"frame ms\", \"ph\": \"C\", \"pid\": 1, \"ts\": %.3f, \"args\": "
+			"{\"cpu\": %.3f, \"gpu\": %.3f, \"frame\": %.3f, \"sdk gpu\": %.3f}}", ts, f.cpuMs, f.gpuMs, f.frameMs, f.sdkGpuMs);
+		events += line;
+		snprintf(line, sizeof(line), ",\n{\"name\": \"dropped\", \"ph\": \"C\", \"pid\": 1, \"ts\": %.3f, \"args\": "
+			"{\"app\": %d, \"compositor\": %d}}", ts, f.appDropped - first.appDropped, f.compositorDropped - first.compositorDropped);
+		events += line;
+		snprintf(line, sizeof(line), ",\n{\"name\": \"state\", \"ph\": \"C\", \"pid\": 1, \"ts\": %.3f, \"args\": "
+			"{\"quality\": %d, \"vram MB\": %d}}", ts, f.quality, (int)(f.vramBytes >> 20));
+		events += line;
+		if (f.frame == slowFrame) {
+			snprintf(line, sizeof(line), ",\n{\"name\": \"slow frame %u\", \"ph\": \"i\", \"s\": \"g\", \"pid\": 1, \"ts\": %.3f, "
+				"\"args\": {\"frame ms\": %.3f}}", f.frame, ts, f.frameMs);
+			events += line;
+		}
+	}
+	profiler.writeTrace(filename.c_str(), since, events);
+}
+
+void FlightRecorder::finish()
+{
+	if (!writing.done()) {
+		jobs().wait(writing);
+	}
+}
+
+void FlightRecorder::report(std::ostream& out) const
+{
+	if (ring.empty()) {
+		return;
+	}
+	out << "flight recorder: " << captures << " captures";
+	if (missed) {
+		out << ", " << missed << " slow frames not captured (flight.min_interval, flight.max_captures)";
+	}
+	out << std::endl;
+}
+
+FlightRecorder& flightRecorder()
+{
+	static FlightRecorder recorder;
+	return recorder;
+}
@@ -0,0 +1,104 @@
+#ifndef _FLIGHT_RECORDER_H_
+#define _FLIGHT_RECORDER_H_
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "JobSystem.h"
+
+// Keeps the last flight.seconds of frames in memory and writes them to a trace by itself
+// when a frame runs over, so a hitch in the field can be looked at without having had a
+// profiler running. A capture is the CPU profiler's scopes and GPU passes (CpuProfiler.h)
+// from the start of the window, with each frame's times, the SDK's numbers and the
+// quality knobs as counters, and a marker on the slow frame.
+//
+// A frame is slow when it took flight.margin over the display's frame time, or the
+// compositor reported frames dropped since the frame before. The capture waits
+// flight.after_frames more frames for the GPU's and the SDK's numbers of the slow frame to
+// come in, then a job writes it. Captures are at least flight.min_interval seconds apart
+// and there are at most flight.max_captures of them, a run that keeps hitching does not
+// fill the disk; the hitches that were not captured are counted in the report.
+//
+// frame() copies a fixed size record into a ring made up front, so the render thread
+// does not allocate until a capture is due.
+class FlightRecorder
+{
+public:
+	struct Frame
+	{
+		uint32_t frame;
+		// CpuProfiler ticks when the frame was done
+		int64_t end;
+		float cpuMs;
+		float gpuMs;
+		float frameMs;
+		// ovr_GetPerfStats' GPU time of the app and dropped frame counts, which only go up
+		float sdkGpuMs;
+		int appDropped;
+		int compositorDropped;
+		int quality;
+		uint64_t vramBytes;
+	};
+
+	FlightRecorder();
+
+	FlightRecorder(const FlightRecorder&) = delete;
+	FlightRecorder& operator=(const FlightRecorder&) = delete;
+
+	//! Starts keeping frames, from flight.* in the config.
+	// @input refreshHz The display's refresh, the frame time a frame is held to
+	void configure(double refreshHz);
+	bool active() const { return !ring.empty(); }
+
+	// Render thread, after ovr_GetPerfStats: the SDK's numbers for the frames to come
+	void setCompositor(float gpuMs, int appDropped, int compositorDropped)
+	{
+		sdkGpuMs = gpuMs;
+		sdkAppDropped = appDropped;
+		sdkCompositorDropped = compositorDropped;
+	}
+	//! Render thread, once a frame is done.
+	// @input quality The quality governor's steps down over all its knobs
+	void frame(uint32_t frame, float cpuMs, float gpuMs, float frameMs, int quality, uint64_t vramBytes);
+
+	// Waits for a capture that is being written
+	void finish();
+	void report(std::ostream& out) const;
+
+private:
+	const Frame& at(size_t age) const { return ring[(written - 1 - age) % ring.size()]; }
+	void capture();
+	void write();
+
+	std::vector<Frame> ring;
+	uint64_t written;
+	float budgetMs;
+	float margin;
+	int afterFrames;
+	double minInterval;
+	int maxCaptures;
+	std::string prefix;
+
+	float sdkGpuMs;
+	int sdkAppDropped;
+	int sdkCompositorDropped;
+
+	// The slow frame a capture waits on, and frames still to wait for it
+	uint32_t slowFrame;
+	float slowMs;
+	int framesToCapture;
+	int64_t lastCapture;
+	int captures;
+	int missed;
+
+	// The capture's frames and name, the writing job's until it is done
+	std::vector<Frame> snapshot;
+	std::string filename;
+	JobCounter writing;
+};
+
+FlightRecorder& flightRecorder();
+
+#endif
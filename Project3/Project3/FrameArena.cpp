@@ -0,0 +1,214 @@
+#include "FrameArena.h"
+#include "LargePages.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+#if defined(_DEBUG) && !defined(CAVE_ALLOC_CHECK)
+#define CAVE_ALLOC_CHECK
+#endif
+
+static size_t alignUp(size_t value, size_t alignment)
+{
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+FrameArena::FrameArena(size_t capacity) : base(nullptr), size(0), used(0), overflowUsed(0), peak(0), largeBase(false)
+{
+	base = static_cast<unsigned char*>(largePages().allocate(capacity, LargePages::FRAME_ARENA, size));
+	if (!base) {
+		size = 0;
+	}
+}
+
+FrameArena::~FrameArena()
+{
+	for (unsigned char* block : overflow) {
+		free(block);
+	}
+	largePages().free(base, size, LargePages::FRAME_ARENA);
+}
+
+void FrameArena::reset()
+{
+	size_t frameUsed = used + overflowUsed;
+	peak = std::max(peak, frameUsed);
+	// The block is also made again once large pages are enabled, the first was made before
+	bool toLargePages = largePages().enabled() && !largeBase;
+	if (!overflow.empty() || toLargePages) {
+		for (unsigned char* block : overflow) {
+			free(block);
+		}
+		overflow.clear();
+		// Room for the frame that did not fit and a little more
+		size_t grown;
+		unsigned char* bigger = static_cast<unsigned char*>(largePages().allocate(std::max(frameUsed + frameUsed / 2, size),
+			LargePages::FRAME_ARENA, grown));
+		if (bigger) {
+			largePages().free(base, size, LargePages::FRAME_ARENA);
+			base = bigger;
+			size = grown;
+			largeBase = largePages().enabled();
+		}
+	}
+	used = 0;
+	overflowUsed = 0;
+}
+
+void* FrameArena::allocate(size_t bytes, size_t alignment)
+{
+	// The block is page aligned, the overflow blocks malloc aligned: 16 bytes is as far as
+	// offsets alone can go
+	size_t offset = alignUp(used, alignment);
+	if (base && offset + bytes <= size) {
+		used = offset + bytes;
+		return base + offset;
+	}
+	unsigned char* block = static_cast<unsigned char*>(malloc(std::max<size_t>(bytes, 1)));
+	if (!block) {
+		return nullptr;
+	}
+	overflow.push_back(block);
+	overflowUsed += bytes;
+	return block;
+}
+
+FrameArena& frameArena()
+{
+	static FrameArena arena;
+	return arena;
+}
+
+#ifdef CAVE_ALLOC_CHECK
+
+// Only the thread that called beginFrame counts, and only between it and endFrame
+static thread_local bool watching = false;
+static thread_local uint64_t allocations = 0;
+static int checkAfter = 300;
+static bool assertOnAllocation = false;
+static int reported = 0;
+
+static void* countedAlloc(size_t size)
+{
+	if (watching) {
+		allocations++;
+	}
+	return malloc(size ? size : 1);
+}
+
+void* operator new(size_t size)
+{
+	void* p = countedAlloc(size);
+	if (!p) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void* operator new[](size_t size)
+{
+	void* p = countedAlloc(size);
+	if (!p) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return countedAlloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return countedAlloc(size);
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+	free(p);
+}
+
+namespace allocationWatch {
+	bool available()
+	{
+		return true;
+	}
+
+	void configure(int after, bool assertOn)
+	{
+		checkAfter = after;
+		assertOnAllocation = assertOn;
+	}
+
+	void beginFrame()
+	{
+		allocations = 0;
+		watching = true;
+	}
+
+	void endFrame(unsigned int frame)
+	{
+		watching = false;
+		if (checkAfter < 0 || (int)frame < checkAfter || !allocations) {
+			return;
+		}
+		// The first few are enough to go looking, after that the frame time would suffer
+		if (reported < 10) {
+			std::cerr << "frame " << frame << " allocated " << allocations << " times from the heap" << std::endl;
+			reported++;
+		}
+		assert(!assertOnAllocation && "a steady state frame allocated");
+	}
+}
+
+#else
+
+namespace allocationWatch {
+	bool available()
+	{
+		return false;
+	}
+
+	void configure(int, bool)
+	{
+	}
+
+	void beginFrame()
+	{
+	}
+
+	void endFrame(unsigned int)
+	{
+	}
+}
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef _FRAME_ARENA_H_
+#define _FRAME_ARENA_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+// Storage for arrays that only live until the end of a frame. Allocating moves a pointer,
+// nothing is freed until reset() at the start of the next frame. A frame that outgrows
+// the block gets more blocks; the next reset() replaces them with one block the size the
+// frame needed, so after the first frames the arena never asks the heap again. The block
+// comes from LargePages, in large pages once those are enabled. Render thread only.
+class FrameArena
+{
+public:
+	explicit FrameArena(size_t capacity = 256 * 1024);
+	~FrameArena();
+
+	FrameArena(const FrameArena&) = delete;
+	FrameArena& operator=(const FrameArena&) = delete;
+
+	void reset();
+	void* allocate(size_t bytes, size_t alignment = 16);
+
+	// count Ts, left as they are: only for types without constructors or destructors
+	template <typename T>
+	T* allocate(size_t count)
+	{
+		static_assert(std::is_trivially_destructible<T>::value, "frame arena memory is never destroyed");
+		return static_cast<T*>(allocate(count * sizeof(T), alignof(T) > 16 ? alignof(T) : 16));
+	}
+
+	size_t capacity() const { return size; }
+	// The most any frame has used so far
+	size_t highWater() const { return peak; }
+
+private:
+	unsigned char* base;
+	size_t size;
+	size_t used;
+	// Blocks taken when a frame did not fit, freed at the next reset
+	std::vector<unsigned char*> overflow;
+	size_t overflowUsed;
+	size_t peak;
+	// Made while large pages were enabled
+	bool largeBase;
+};
+
+FrameArena& frameArena();
+
+// Counts global operator new calls on the render thread in builds with CAVE_ALLOC_CHECK
+// (on in debug builds), to check that steady state frames do not allocate. From
+// alloc.check_after frames on, a frame that did is reported, and with alloc.assert it
+// also fails an assert. In other builds this does nothing.
+namespace allocationWatch {
+	// Whether the counting operator new is compiled in
+	bool available();
+	void configure(int checkAfter, bool assertOnAllocation);
+	// Counts this thread's allocations until endFrame
+	void beginFrame();
+	void endFrame(unsigned int frame);
+}
+
+#endif
@@ -0,0 +1,109 @@
+#include "FrameBaselines.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+static std::string key(const std::string& session, const std::string& metric)
+{
+	return session + ',' + metric;
+}
+
+FramePercentiles framePercentiles(std::vector<double> ms)
+{
+	FramePercentiles out = { 0.0, 0.0, 0.0, ms.size() };
+	if (ms.empty()) {
+		return out;
+	}
+	std::sort(ms.begin(), ms.end());
+	auto percentile = [&](double p) { return ms[std::min((size_t)(p * ms.size()), ms.size() - 1)]; };
+	out.p50 = percentile(0.5);
+	out.p95 = percentile(0.95);
+	out.p99 = percentile(0.99);
+	return out;
+}
+
+bool FrameBaselines::load(const char* filename)
+{
+	std::ifstream file(filename);
+	if (!file.is_open()) {
+		return false;
+	}
+	std::string line;
+	while (std::getline(file, line)) {
+		if (line.empty() || line[0] == '#') {
+			continue;
+		}
+		std::istringstream fields(line);
+		std::string session, metric, value;
+		FramePercentiles p = {};
+		if (!std::getline(fields, session, ',') || !std::getline(fields, metric, ',')) {
+			continue;
+		}
+		double* values[] = { &p.p50, &p.p95, &p.p99 };
+		bool complete = true;
+		for (double* v : values) {
+			complete = complete && std::getline(fields, value, ',') && sscanf(value.c_str(), "%lf", v) == 1;
+		}
+		if (!complete) {
+			std::cerr << "skipping malformed baseline line '" << line << "' in " << filename << std::endl;
+			continue;
+		}
+		if (std::getline(fields, value, ',')) {
+			p.frames = (size_t)strtoul(value.c_str(), nullptr, 10);
+		}
+		entries[key(session, metric)] = p;
+	}
+	return true;
+}
+
+bool FrameBaselines::save(const char* filename) const
+{
+	std::ofstream file(filename);
+	if (!file.is_open()) {
+		std::cerr << "could not write frame time baselines to " << filename << std::endl;
+		return false;
+	}
+	file << "# session,metric,p50_ms,p95_ms,p99_ms,frames\n";
+	char line[256];
+	for (const auto& entry : entries) {
+		const FramePercentiles& p = entry.second;
+		snprintf(line, sizeof(line), "%s,%.4f,%.4f,%.4f,%llu\n", entry.first.c_str(), p.p50, p.p95, p.p99,
+			(unsigned long long)p.frames);
+		file << line;
+	}
+	return true;
+}
+
+void FrameBaselines::set(const std::string& session, const std::string& metric, const FramePercentiles& measured)
+{
+	entries[key(session, metric)] = measured;
+}
+
+bool FrameBaselines::check(const std::string& session, const std::string& metric, const FramePercentiles& measured,
+	double tolerance, double slackMs, std::ostream& out) const
+{
+	char line[256];
+	auto found = entries.find(key(session, metric));
+	if (found == entries.end()) {
+		snprintf(line, sizeof(line), "  %-6s p50 %8.3f  p95 %8.3f  p99 %8.3f ms  (no baseline)", metric.c_str(),
+			measured.p50, measured.p95, measured.p99);
+		out << line << std::endl;
+		return true;
+	}
+	const FramePercentiles& base = found->second;
+	const char* names[] = { "p50", "p95", "p99" };
+	double now[] = { measured.p50, measured.p95, measured.p99 };
+	double then[] = { base.p50, base.p95, base.p99 };
+	bool passed = true;
+	for (int i = 0; i < 3; i++) {
+		bool regressed = now[i] > then[i] * (1.0 + tolerance) + slackMs;
+		snprintf(line, sizeof(line), "  %-6s %s %8.3f ms, baseline %8.3f ms (%+.1f%%)%s", metric.c_str(), names[i], now[i],
+			then[i], then[i] > 0.0 ? (now[i] / then[i] - 1.0) * 100.0 : 0.0, regressed ? "  REGRESSED" : "");
+		out << line << std::endl;
+		passed = passed && !regressed;
+	}
+	return passed;
+}
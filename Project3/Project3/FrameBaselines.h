@@ -0,0 +1,43 @@
+#ifndef _FRAME_BASELINES_H_
+#define _FRAME_BASELINES_H_
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Frame time percentiles of a benchmark run, in milliseconds
+struct FramePercentiles
+{
+	double p50;
+	double p95;
+	double p99;
+	size_t frames;
+};
+
+FramePercentiles framePercentiles(std::vector<double> ms);
+
+// The percentiles a benchmark session is expected to stay under, by session and metric
+// ("cpu", "gpu" or "frame"). Kept as CSV lines of session,metric,p50,p95,p99,frames so a
+// baseline file can be diffed and checked in next to the traces it was measured with.
+class FrameBaselines
+{
+public:
+	// Returns false if the file cannot be opened, which is fine before the first baseline
+	bool load(const char* filename);
+	bool save(const char* filename) const;
+
+	void set(const std::string& session, const std::string& metric, const FramePercentiles& measured);
+
+	//! Prints each percentile next to its baseline.
+	// @input tolerance The fraction a percentile may be over its baseline
+	// @input slackMs Also allowed on top, so times of a fraction of a millisecond do not fail on noise
+	// Returns false on a regression. A session without a baseline passes, with a note.
+	bool check(const std::string& session, const std::string& metric, const FramePercentiles& measured,
+		double tolerance, double slackMs, std::ostream& out) const;
+
+private:
+	std::map<std::string, FramePercentiles> entries;
+};
+
+#endif
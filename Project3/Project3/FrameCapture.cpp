@@ -0,0 +1,454 @@
+#include "FrameCapture.h"
+#include "GLMarkers.h"
+#include "CpuProfiler.h"
+#include "GpuMemory.h"
+#include "GpuTimers.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+FrameCapture::FrameCapture() : interval(0.), format(RAW), bitrate(0), persistent(false), readFbo(0), gpuPass(-1),
+	recordingOn(false), take(0), nextCapture(0.), frameTime(0.), capturing(false), screenshotFrame(false), screenshotRequested(false),
+	frame(0), screenshots(0), stopping(false), writtenFrames(0), droppedFrames(0)
+{
+}
+
+FrameCapture::~FrameCapture()
+{
+	shutdown();
+}
+
+void FrameCapture::init(const std::string& filePrefix, double fps, Format recordedFormat, uint32_t videoBitrate)
+{
+	shutdown();
+	prefix = filePrefix;
+	interval = fps > 0. ? 1. / fps : 0.;
+	format = recordedFormat;
+	bitrate = videoBitrate;
+	persistent = GLEW_ARB_buffer_storage != 0;
+	if (!persistent) {
+		std::cerr << "ARB_buffer_storage not supported, capture copies its readbacks on the render thread" << std::endl;
+	}
+	glGenFramebuffers(1, &readFbo);
+	glMarkers().label(GL_FRAMEBUFFER, readFbo, "capture read");
+	gpuPass = gpuTimers().pass("capture");
+	stopping = false;
+	encoder = std::thread(&FrameCapture::run, this);
+}
+
+void FrameCapture::shutdown()
+{
+	if (!active()) {
+		return;
+	}
+	// Whatever is still being read is waited for, it is the end of a recording
+	for (auto& stream : streams) {
+		for (Slot& slot : stream->slots) {
+			if (slot.state == READING) {
+				glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+				handOver(*stream, slot);
+			}
+		}
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_one();
+	encoder.join();
+
+	for (auto& stream : streams) {
+		for (Slot& slot : stream->slots) {
+			if (slot.mapped) {
+				glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+				glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			}
+			if (slot.pbo) {
+				gpuMemory().release(GpuMemory::KIND_BUFFER, slot.pbo);
+				glDeleteBuffers(1, &slot.pbo);
+			}
+		}
+		if (stream->staging) {
+			gpuMemory().release(GpuMemory::KIND_TEXTURE, stream->staging);
+		}
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	streams.clear();
+	glDeleteFramebuffers(1, &readFbo);
+	readFbo = 0;
+	if (writtenFrames || droppedFrames || screenshots) {
+		logStream(LOG_INFO) << "capture: " << writtenFrames << " frames written, " << droppedFrames
+			<< " dropped with every buffer busy, " << screenshots << " screenshots" << std::endl;
+	}
+	recordingOn = false;
+}
+
+int FrameCapture::addStream(const std::string& name, GLsizei width, GLsizei height)
+{
+	if (!active() || width <= 0 || height <= 0) {
+		return -1;
+	}
+	bool video = format == H264 || format == HEVC;
+	if (video) {
+		// The encoders take even sizes only
+		width = std::max(width & ~1, 2);
+		height = std::max(height & ~1, 2);
+	}
+	std::unique_ptr<Stream> stream(new Stream());
+	stream->name = name;
+	stream->width = width;
+	stream->height = height;
+	stream->readFormat = video ? GL_BGRA : GL_RGBA;
+	stream->openTake = 0;
+	stream->closedTake = 0;
+	stream->frames = 0;
+	stream->raw = nullptr;
+	stream->times = nullptr;
+
+	stream->staging.create();
+	glBindTexture(GL_TEXTURE_2D, stream->staging);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	gpuMemory().allocate(GpuMemory::KIND_TEXTURE, stream->staging, textureBytes(GL_RGBA8, width, height, 1, 1),
+		GpuMemory::STREAMING, "capture " + name);
+	stream->stagingFbo.create();
+	glMarkers().label(GL_FRAMEBUFFER, stream->stagingFbo, "capture " + name);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, stream->stagingFbo);
+	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, stream->staging, 0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+
+	// Read by the CPU, so kept in client memory where the driver allows it
+	const GLsizeiptr bytes = (GLsizeiptr)width * height * 4;
+	const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	bool made = true;
+	for (Slot& slot : stream->slots) {
+		slot.mapped = nullptr;
+		slot.fence = 0;
+		slot.frame = 0;
+		slot.time = 0.;
+		slot.take = 0;
+		slot.recorded = false;
+		slot.screenshot = false;
+		slot.state = FREE;
+		glGenBuffers(1, &slot.pbo);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+		if (persistent) {
+			glBufferStorage(GL_PIXEL_PACK_BUFFER, bytes, nullptr, flags | GL_CLIENT_STORAGE_BIT);
+			slot.mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, flags);
+			made = made && slot.mapped;
+		}
+		else {
+			glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+			slot.copy.resize((size_t)bytes);
+		}
+		gpuMemory().allocate(GpuMemory::KIND_BUFFER, slot.pbo, (uint64_t)bytes, GpuMemory::STREAMING,
+			"capture " + name + " readback", persistent);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	streams.push_back(std::move(stream));
+	if (!made) {
+		// Kept in the list so shutdown() releases it, never captured into
+		std::cerr << "capture " << name << ": could not map its readback buffers" << std::endl;
+		streams.back()->width = 0;
+		return -1;
+	}
+	return (int)streams.size() - 1;
+}
+
+void FrameCapture::setRecording(bool on)
+{
+	if (!active() || on == recordingOn) {
+		return;
+	}
+	recordingOn = on;
+	nextCapture = 0.;
+	if (on) {
+		take++;
+	}
+	else {
+		std::lock_guard<std::mutex> lock(mutex);
+		for (auto& stream : streams) {
+			queued.push_back({ stream.get(), nullptr, take });
+		}
+	}
+	wake.notify_one();
+	logStream(LOG_INFO) << "capture: recording " << (on ? "started" : "stopped") << std::endl;
+}
+
+bool FrameCapture::beginFrame(double time)
+{
+	capturing = false;
+	frameTime = time;
+	screenshotFrame = screenshotRequested.exchange(false);
+	if (!active()) {
+		return false;
+	}
+	if (recordingOn && time >= nextCapture) {
+		// On the frame after it was due, without catching up on the frames in between
+		nextCapture = std::max(nextCapture + interval, time);
+		capturing = true;
+	}
+	frame++;
+	if (screenshotFrame) {
+		screenshots++;
+	}
+	return capturing || screenshotFrame;
+}
+
+FrameCapture::Slot* FrameCapture::freeSlot(Stream& stream)
+{
+	if (stream.width == 0) {
+		return nullptr;
+	}
+	for (Slot& slot : stream.slots) {
+		if (slot.state == FREE) {
+			return &slot;
+		}
+	}
+	droppedFrames++;
+	return nullptr;
+}
+
+void FrameCapture::captureFramebuffer(int index, GLuint readFramebuffer, GLenum readBuffer, GLint x0, GLint y0, GLint x1, GLint y1)
+{
+	if (index < 0 || index >= (int)streams.size() || !(capturing || screenshotFrame)) {
+		return;
+	}
+	Stream& stream = *streams[index];
+	Slot* slot = freeSlot(stream);
+	if (!slot) {
+		return;
+	}
+	GpuScope gpuScope(gpuPass);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+	glReadBuffer(readBuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, stream.stagingFbo);
+	glBlitFramebuffer(x0, y0, x1, y1, 0, 0, stream.width, stream.height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+	readStaging(stream, *slot);
+}
+
+void FrameCapture::captureTexture(int index, GLuint texture, GLint layer, GLsizei size)
+{
+	if (index < 0 || index >= (int)streams.size() || !(capturing || screenshotFrame)) {
+		return;
+	}
+	Stream& stream = *streams[index];
+	Slot* slot = freeSlot(stream);
+	if (!slot) {
+		return;
+	}
+	GpuScope gpuScope(gpuPass);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, readFbo);
+	if (layer >= 0) {
+		glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture, 0, layer);
+	}
+	else {
+		glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+	}
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, stream.stagingFbo);
+	glBlitFramebuffer(0, 0, size, size, 0, 0, stream.width, stream.height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+	// Not holding on to a texture its owner may delete
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, readFbo);
+	glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+	readStaging(stream, *slot);
+}
+
+// Queues the staging texture's copy into slot and fences it, nothing here waits
+void FrameCapture::readStaging(Stream& stream, Slot& slot)
+{
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, stream.stagingFbo);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0, 0, stream.width, stream.height, stream.readFormat, GL_UNSIGNED_BYTE, nullptr);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.frame = frame;
+	slot.time = frameTime;
+	slot.take = take;
+	slot.recorded = capturing;
+	slot.screenshot = screenshotFrame;
+	slot.state = READING;
+}
+
+void FrameCapture::endFrame()
+{
+	if (!active()) {
+		return;
+	}
+	CpuScope scope("capture poll");
+	for (auto& stream : streams) {
+		for (Slot& slot : stream->slots) {
+			if (slot.state != READING) {
+				continue;
+			}
+			// The frame's submit has flushed the fence, a copy still in flight waits for a
+			// later frame
+			GLenum result = glClientWaitSync(slot.fence, 0, 0);
+			if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED) {
+				handOver(*stream, slot);
+			}
+		}
+	}
+}
+
+void FrameCapture::handOver(Stream& stream, Slot& slot)
+{
+	glDeleteSync(slot.fence);
+	slot.fence = 0;
+	if (!slot.mapped) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+		const void* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)slot.copy.size(), GL_MAP_READ_BIT);
+		if (pixels) {
+			memcpy(slot.copy.data(), pixels, slot.copy.size());
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+	slot.state = ENCODING;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queued.push_back({ &stream, &slot, 0 });
+	}
+	wake.notify_one();
+}
+
+void FrameCapture::run()
+{
+	for (;;) {
+		Job next;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this] { return stopping || !queued.empty(); });
+			if (queued.empty()) {
+				break;
+			}
+			next = queued.front();
+			queued.pop_front();
+		}
+		if (!next.slot) {
+			closeTake(*next.stream, next.closeTake);
+			continue;
+		}
+		encode(*next.stream, *next.slot);
+		next.slot->state = FREE;
+	}
+	for (auto& stream : streams) {
+		closeTake(*stream, stream->openTake);
+	}
+}
+
+void FrameCapture::openTake(Stream& stream, unsigned newTake)
+{
+	closeTake(stream, stream.openTake);
+	stream.openTake = newTake;
+	stream.frames = 0;
+	const std::string base = prefix + "_" + stream.name + "_" + std::to_string(newTake);
+	if (format == H264 || format == HEVC) {
+		stream.video.reset(new VideoEncoder());
+		if (stream.video->open(base + ".mp4", stream.width, stream.height, interval > 0. ? 1. / interval : 90.,
+			format == HEVC ? VideoEncoder::HEVC : VideoEncoder::H264, bitrate)) {
+			return;
+		}
+		stream.video.reset();
+		std::cerr << "capture: " << stream.name << " recorded raw instead" << std::endl;
+	}
+	if (format == PPM) {
+		return;
+	}
+	stream.raw = fopen((base + ".rgba").c_str(), "wb");
+	stream.times = fopen((base + ".csv").c_str(), "w");
+	if (!stream.raw) {
+		std::cerr << "capture: could not open " << base << ".rgba" << std::endl;
+		return;
+	}
+	logStream(LOG_INFO) << "capture: " << base << ".rgba, ffmpeg -f rawvideo -pix_fmt " << (stream.readFormat == GL_BGRA ? "bgra" : "rgba")
+		<< " -s " << stream.width << "x" << stream.height << " -r " << (interval > 0. ? 1. / interval : 90.) << " -i " << base << ".rgba" << std::endl;
+	if (stream.times) {
+		fprintf(stream.times, "frame,time\n");
+	}
+}
+
+void FrameCapture::closeTake(Stream& stream, unsigned last)
+{
+	if (stream.raw) {
+		fclose(stream.raw);
+		stream.raw = nullptr;
+	}
+	if (stream.times) {
+		fclose(stream.times);
+		stream.times = nullptr;
+	}
+	stream.video.reset();
+	stream.closedTake = std::max(stream.closedTake, last);
+}
+
+void FrameCapture::encode(Stream& stream, Slot& slot)
+{
+	const unsigned char* pixels = slot.mapped ? slot.mapped : slot.copy.data();
+	const std::string base = prefix + "_" + stream.name;
+	if (slot.screenshot) {
+		writePpm(stream, pixels, base + "_shot" + std::to_string(slot.frame) + ".ppm");
+	}
+	// The take's last frames, read back after it was stopped, are dropped
+	if (!slot.recorded || slot.take <= stream.closedTake) {
+		return;
+	}
+	if (slot.take != stream.openTake) {
+		openTake(stream, slot.take);
+	}
+	if (stream.video) {
+		if (stream.video->write(pixels, slot.time)) {
+			stream.frames++;
+			writtenFrames++;
+		}
+		return;
+	}
+	if (format == PPM) {
+		writePpm(stream, pixels, base + "_" + std::to_string(slot.take) + "_" + std::to_string(stream.frames++) + ".ppm");
+		writtenFrames++;
+		return;
+	}
+	if (!stream.raw) {
+		return;
+	}
+	// GL's rows are bottom up
+	const size_t row = (size_t)stream.width * 4;
+	for (GLsizei y = stream.height - 1; y >= 0; y--) {
+		fwrite(pixels + row * y, 1, row, stream.raw);
+	}
+	if (stream.times) {
+		fprintf(stream.times, "%llu,%.6f\n", (unsigned long long)stream.frames, slot.time);
+	}
+	stream.frames++;
+	writtenFrames++;
+}
+
+void FrameCapture::writePpm(const Stream& stream, const unsigned char* pixels, const std::string& filename)
+{
+	FILE* file = fopen(filename.c_str(), "wb");
+	if (!file) {
+		std::cerr << "capture: could not open " << filename << std::endl;
+		return;
+	}
+	fprintf(file, "P6\n%d %d\n255\n", stream.width, stream.height);
+	std::vector<unsigned char> rgb((size_t)stream.width * 3);
+	for (GLsizei y = stream.height - 1; y >= 0; y--) {
+		const unsigned char* source = pixels + (size_t)stream.width * 4 * y;
+		const int red = stream.readFormat == GL_BGRA ? 2 : 0;
+		for (GLsizei x = 0; x < stream.width; x++) {
+			rgb[x * 3 + 0] = source[x * 4 + red];
+			rgb[x * 3 + 1] = source[x * 4 + 1];
+			rgb[x * 3 + 2] = source[x * 4 + 2 - red];
+		}
+		fwrite(rgb.data(), 1, rgb.size(), file);
+	}
+	fclose(file);
+}
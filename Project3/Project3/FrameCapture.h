@@ -0,0 +1,175 @@
+#ifndef _FRAME_CAPTURE_H_
+#define _FRAME_CAPTURE_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "GLHandle.h"
+#include "VideoEncoder.h"
+
+// Session recording and screenshots without stalling the frame (capture.*). Each stream
+// (the mirror window, a wall texture) has a staging texture of a fixed size and a ring of
+// SLOTS pixel pack buffers. A captured frame is blitted into the staging texture, scaled
+// if the source has changed size, and read into a free buffer with glReadPixels, which
+// only queues the copy, and fenced. endFrame() looks at the fences without waiting and
+// hands the buffers the GPU is done with to the encoder thread, which writes them out and
+// gives the buffer back. When every buffer of a stream is still busy the frame is dropped
+// for that stream rather than waited for.
+//
+// With ARB_buffer_storage the buffers stay mapped, coherent and in client memory, and the
+// encoder reads them where they are. Without it endFrame() maps each finished one and
+// copies it out on the render thread.
+//
+// Each recording (a take) writes a stream as one of:
+//
+//   RAW         top-down RGBA, prefix_stream_take.rgba, every frame the same size, what
+//               ffmpeg's rawvideo takes, with the frames' times in prefix_stream_take.csv
+//   PPM         prefix_stream_take_frame.ppm
+//   H264, HEVC  prefix_stream_take.mp4 from the GPU's encoder (VideoEncoder), read back as
+//               BGRA, which is what it takes; without an encoder the take is RAW
+//
+// A screenshot is a PPM of every stream from the next frame. Stopping a recording closes
+// its files, the frames of it still being read back are dropped.
+class FrameCapture
+{
+public:
+	enum { SLOTS = 4 };
+	enum Format { RAW, PPM, H264, HEVC };
+
+	FrameCapture();
+	~FrameCapture();
+
+	FrameCapture(const FrameCapture&) = delete;
+	FrameCapture& operator=(const FrameCapture&) = delete;
+
+	//! Starts the encoder thread.
+	// @input prefix What the files written start with
+	// @input fps How often a recording captures, at most once a frame
+	// @input format What a recording is written as
+	// @input bitrate Of H264 and HEVC, in bits per second
+	void init(const std::string& prefix, double fps, Format format, uint32_t bitrate);
+	// Hands over what the GPU still has, waiting for it, lets the encoder finish and
+	// deletes the GL objects. With the context current.
+	void shutdown();
+	bool active() const { return encoder.joinable(); }
+
+	//! A stream captured at width x height. -1 if its buffers could not be made.
+	int addStream(const std::string& name, GLsizei width, GLsizei height);
+
+	void setRecording(bool on);
+	bool recording() const { return recordingOn; }
+	// Any thread, taken by the next beginFrame()
+	void requestScreenshot() { screenshotRequested = true; }
+
+	// Whether this frame captures, the recording being due at time (seconds) or a
+	// screenshot asked for
+	bool beginFrame(double time);
+	// The rectangle of readFramebuffer's readBuffer into stream, leaves nothing bound
+	void captureFramebuffer(int stream, GLuint readFramebuffer, GLenum readBuffer, GLint x0, GLint y0, GLint x1, GLint y1);
+	// size x size texels from the corner of texture's level 0, of layer layer if it is an
+	// array (-1 otherwise), into stream
+	void captureTexture(int stream, GLuint texture, GLint layer, GLsizei size);
+	// Every frame, capturing or not: hands the finished buffers to the encoder
+	void endFrame();
+
+	// Frames written and frames dropped for want of a buffer, over every stream
+	uint64_t written() const { return writtenFrames; }
+	uint64_t dropped() const { return droppedFrames; }
+
+private:
+	enum SlotState { FREE, READING, ENCODING };
+
+	struct Slot
+	{
+		GLuint pbo;
+		unsigned char* mapped;
+		std::vector<unsigned char> copy;
+		GLsync fence;
+		uint64_t frame;
+		double time;
+		unsigned take;
+		bool recorded;
+		bool screenshot;
+		std::atomic<int> state;
+	};
+
+	struct Stream
+	{
+		std::string name;
+		GLsizei width;
+		GLsizei height;
+		GLenum readFormat;
+		GLTexture staging;
+		GLFramebuffer stagingFbo;
+		Slot slots[SLOTS];
+		// The encoder's alone
+		unsigned openTake;
+		unsigned closedTake;
+		uint64_t frames;
+		FILE* raw;
+		FILE* times;
+		std::unique_ptr<VideoEncoder> video;
+	};
+
+	Slot* freeSlot(Stream& stream);
+	void readStaging(Stream& stream, Slot& slot);
+	void handOver(Stream& stream, Slot& slot);
+	void run();
+	void encode(Stream& stream, Slot& slot);
+	void openTake(Stream& stream, unsigned take);
+	// Closes the files, the takes up to last are over
+	void closeTake(Stream& stream, unsigned last);
+	void writePpm(const Stream& stream, const unsigned char* pixels, const std::string& filename);
+
+	std::string prefix;
+	double interval;
+	Format format;
+	uint32_t bitrate;
+	bool persistent;
+	std::vector<std::unique_ptr<Stream>> streams;
+	GLuint readFbo;
+	int gpuPass;
+
+	bool recordingOn;
+	unsigned take;
+	double nextCapture;
+	double frameTime;
+	bool capturing;
+	bool screenshotFrame;
+	std::atomic<bool> screenshotRequested;
+	uint64_t frame;
+	uint64_t screenshots;
+
+	std::thread encoder;
+	std::mutex mutex;
+	std::condition_variable wake;
+	// A slot to write, or with none, the takes up to closeTake of the stream to close
+	struct Job
+	{
+		Stream* stream;
+		Slot* slot;
+		unsigned closeTake;
+	};
+	std::deque<Job> queued;
+	bool stopping;
+	std::atomic<uint64_t> writtenFrames;
+	std::atomic<uint64_t> droppedFrames;
+};
+
+#endif
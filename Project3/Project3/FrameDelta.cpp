@@ -0,0 +1,120 @@
+#include "FrameDelta.h"
+
+#include <algorithm>
+#include <cstring>
+
+enum { WORD = 8 };
+
+// Word i of a record, the bytes past its end read as zero
+static uint64_t loadWord(const unsigned char* record, size_t size, size_t i)
+{
+	uint64_t word = 0;
+	memcpy(&word, record + i * WORD, std::min((size_t)WORD, size - i * WORD));
+	return word;
+}
+
+static void storeWord(unsigned char* record, size_t size, size_t i, uint64_t word)
+{
+	memcpy(record + i * WORD, &word, std::min((size_t)WORD, size - i * WORD));
+}
+
+FrameDeltaWriter::FrameDeltaWriter(size_t recordSize, unsigned int keyInterval, bool againstKey) : size(recordSize),
+	words((recordSize + WORD - 1) / WORD), keyInterval(keyInterval), againstKey(againstKey), sequence(0), keySequence(0),
+	previous(recordSize)
+{
+}
+
+size_t FrameDeltaWriter::maxCoded() const
+{
+	return sizeof(FrameDeltaHeader) + (words + 7) / 8 + words * WORD;
+}
+
+size_t FrameDeltaWriter::write(const void* record, void* out)
+{
+	const unsigned char* current = (const unsigned char*)record;
+	unsigned char* bytes = (unsigned char*)out;
+	FrameDeltaHeader header;
+	header.recordSize = (uint32_t)size;
+	header.sequence = ++sequence;
+	bool full = sequence == 1 || (keyInterval && (sequence - 1) % keyInterval == 0);
+	header.base = full ? 0 : againstKey ? keySequence : sequence - 1;
+	header.changed = 0;
+
+	unsigned char* changed = bytes + sizeof(header);
+	size_t maskBytes = (words + 7) / 8;
+	memset(changed, 0, maskBytes);
+	unsigned char* data = changed + maskBytes;
+	for (size_t i = 0; i < words; i++) {
+		uint64_t word = loadWord(current, size, i);
+		if (header.base && word == loadWord(previous.data(), size, i)) {
+			continue;
+		}
+		changed[i / 8] |= (unsigned char)(1u << (i % 8));
+		memcpy(data + header.changed * WORD, &word, WORD);
+		header.changed++;
+	}
+	memcpy(bytes, &header, sizeof(header));
+	if (full) {
+		keySequence = sequence;
+	}
+	if (full || !againstKey) {
+		memcpy(previous.data(), current, size);
+	}
+	return sizeof(header) + maskBytes + header.changed * WORD;
+}
+
+FrameDeltaReader::FrameDeltaReader(size_t recordSize) : size(recordSize), words((recordSize + WORD - 1) / WORD),
+	sequence(0), keySequence(0), key(recordSize)
+{
+}
+
+size_t FrameDeltaReader::codedSize(const FrameDeltaHeader& header) const
+{
+	if (header.recordSize != size || header.changed > words) {
+		return 0;
+	}
+	return sizeof(header) + (words + 7) / 8 + header.changed * WORD;
+}
+
+bool FrameDeltaReader::read(const void* coded, size_t available, void* record, size_t* used)
+{
+	const unsigned char* bytes = (const unsigned char*)coded;
+	FrameDeltaHeader header;
+	if (available < sizeof(header)) {
+		return false;
+	}
+	memcpy(&header, bytes, sizeof(header));
+	size_t total = codedSize(header);
+	if (!total || total > available || !header.sequence) {
+		return false;
+	}
+	unsigned char* target = (unsigned char*)record;
+	if (header.base && (!sequence || header.base != sequence)) {
+		// Made against the last full record, with the ones since lost or skipped
+		if (!keySequence || header.base != keySequence) {
+			return false;
+		}
+		memcpy(target, key.data(), size);
+	}
+	const unsigned char* changed = bytes + sizeof(header);
+	const unsigned char* data = changed + (words + 7) / 8;
+	uint32_t taken = 0;
+	for (size_t i = 0; i < words && taken < header.changed; i++) {
+		if (!(changed[i / 8] & (1u << (i % 8)))) {
+			continue;
+		}
+		uint64_t word;
+		memcpy(&word, data + taken * WORD, WORD);
+		storeWord(target, size, i, word);
+		taken++;
+	}
+	sequence = header.sequence;
+	if (!header.base) {
+		memcpy(key.data(), target, size);
+		keySequence = sequence;
+	}
+	if (used) {
+		*used = total;
+	}
+	return true;
+}
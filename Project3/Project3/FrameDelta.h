@@ -0,0 +1,92 @@
+#ifndef _FRAME_DELTA_H_
+#define _FRAME_DELTA_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Delta coding of a fixed layout record that changes a little from frame to frame, such as
+// the pose trace's frames and the cluster's state. The record is never taken apart field
+// by field: it is compared with the last one written as 8 byte words, straight from
+// memory, and only the words that changed are kept. Reading patches those words straight
+// into the record. Either way a few hundred bytes take well under a microsecond.
+//
+// Layout of one coded record (little endian, as written):
+//
+//   FrameDeltaHeader
+//   uint8_t changed[(words + 7) / 8]   bit i set if word i of the record follows
+//   uint64_t word[header.changed]      the changed words, in order
+//
+// where words is the record size in 8 byte words, the last one zero padded. A record whose
+// base is 0 is a full one (every bit set), the others only apply on top of the record
+// numbered base. Whoever can lose records (the network) asks for a full one now and then,
+// and has the deltas made against the last full one rather than the record before: losing
+// one then only loses that record, the next applies all the same. Only a lost full record
+// makes the reader skip deltas until the next one comes.
+struct FrameDeltaHeader
+{
+	uint32_t recordSize;
+	// Numbered from 1 by the writer
+	uint32_t sequence;
+	uint32_t base;
+	uint32_t changed;
+};
+
+class FrameDeltaWriter
+{
+public:
+	//! Codes records of recordSize bytes.
+	// @input keyInterval Every keyInterval-th record is a full one, 0 for only the first
+	// @input againstKey Deltas on the last full record instead of the one before, for a
+	//		reader that may not get every record
+	FrameDeltaWriter(size_t recordSize, unsigned int keyInterval, bool againstKey = false);
+
+	// The most a coded record takes
+	size_t maxCoded() const;
+
+	//! Codes record against the last one written into out (maxCoded() bytes), returns the
+	// coded size
+	size_t write(const void* record, void* out);
+
+	// The next record written is a full one
+	void reset() { sequence = 0; }
+
+private:
+	size_t size;
+	size_t words;
+	unsigned int keyInterval;
+	bool againstKey;
+	uint32_t sequence;
+	uint32_t keySequence;
+	// The record deltas are made against
+	std::vector<unsigned char> previous;
+};
+
+class FrameDeltaReader
+{
+public:
+	explicit FrameDeltaReader(size_t recordSize);
+
+	//! Applies a coded record to record, which holds what the last call left in it. False,
+	// with record as it was, if the coded one is malformed, for another record size or a
+	// delta on a record this reader does not have: neither the last one read nor the last
+	// full one, which the reader keeps a copy of.
+	// @input used Set to the bytes the coded record took
+	bool read(const void* coded, size_t codedSize, void* record, size_t* used = nullptr);
+
+	// Whether a record has been read, and the number of the last
+	bool valid() const { return sequence != 0; }
+	uint32_t last() const { return sequence; }
+
+	//! The bytes a coded record starting with header takes, 0 if it is not for this size
+	size_t codedSize(const FrameDeltaHeader& header) const;
+
+private:
+	size_t size;
+	size_t words;
+	uint32_t sequence;
+	uint32_t keySequence;
+	std::vector<unsigned char> key;
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef _FRAME_EXCHANGE_H_
+#define _FRAME_EXCHANGE_H_
+
+#include <mutex>
+
+// Hands a per-frame value from one thread to another. The writer fills back() at its own
+// pace and publishes it, the reader takes the newest published value when it starts a
+// frame. Each side works on its own copy, the lock is only held for the copy in between.
+template <typename T>
+class FrameExchange
+{
+public:
+	FrameExchange() : writing(), shared(), fresh(false) {}
+
+	FrameExchange(const FrameExchange&) = delete;
+	FrameExchange& operator=(const FrameExchange&) = delete;
+
+	// The writer's copy, only the writer touches it
+	T& back() { return writing; }
+
+	void publish()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		shared = writing;
+		fresh = true;
+	}
+
+	// Copies the newest published value into out. Returns false, leaving out as it was,
+	// when nothing was published since the last acquire.
+	bool acquire(T& out)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!fresh) {
+			return false;
+		}
+		out = shared;
+		fresh = false;
+		return true;
+	}
+
+private:
+	T writing;
+	T shared;
+	bool fresh;
+	std::mutex mutex;
+};
+
+#endif
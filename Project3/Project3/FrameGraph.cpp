@@ -0,0 +1,172 @@
+#include "FrameGraph.h"
+
+static uint64_t versionBit(int version)
+{
+	return version < 64 ? 1ull << version : ~0ull;
+}
+
+FrameGraph::FrameGraph() : passTotal(0), resourceTotal(0), culledTotal(0)
+{
+}
+
+void FrameGraph::reset()
+{
+	passTotal = 0;
+	resourceTotal = 0;
+	culledTotal = 0;
+	for (std::vector<Pass>& ends : slotEnds) {
+		ends.clear();
+	}
+}
+
+FrameGraph::Resource FrameGraph::import(const char* name, bool output)
+{
+	if (resourceTotal == resources.size()) {
+		resources.emplace_back();
+	}
+	ResourceInfo& r = resources[resourceTotal];
+	r.name = name;
+	r.imported = true;
+	r.output = output;
+	r.aliasClass = -1;
+	r.invalidate = nullptr;
+	r.version = 0;
+	r.needed = 0;
+	r.first = -1;
+	r.last = -1;
+	r.slot = -1;
+	return (Resource)resourceTotal++;
+}
+
+FrameGraph::Resource FrameGraph::transient(const char* name, int aliasClass, std::function<void()> invalidate)
+{
+	Resource id = import(name, false);
+	ResourceInfo& r = resources[id];
+	r.imported = false;
+	r.aliasClass = aliasClass;
+	r.invalidate = std::move(invalidate);
+	return id;
+}
+
+FrameGraph::Pass FrameGraph::addPass(const char* name, Run run)
+{
+	if (passTotal == passes.size()) {
+		passes.emplace_back();
+	}
+	PassInfo& p = passes[passTotal];
+	p.name = name;
+	p.run = std::move(run);
+	p.reads.clear();
+	p.writes.clear();
+	p.kept = false;
+	p.live = true;
+	return (Pass)passTotal++;
+}
+
+void FrameGraph::read(Pass pass, Resource r)
+{
+	Access access = { r, resources[r].version };
+	passes[pass].reads.push_back(access);
+}
+
+void FrameGraph::write(Pass pass, Resource r)
+{
+	Access access = { r, ++resources[r].version };
+	passes[pass].writes.push_back(access);
+}
+
+void FrameGraph::keep(Pass pass)
+{
+	passes[pass].kept = true;
+}
+
+void FrameGraph::compile()
+{
+	// What the frame ends with in each output is needed, then whatever the passes making
+	// something needed read, back to the first pass
+	for (size_t i = 0; i < resourceTotal; i++) {
+		ResourceInfo& r = resources[i];
+		r.needed = r.output ? versionBit(r.version) : 0;
+	}
+	culledTotal = 0;
+	for (size_t i = passTotal; i-- > 0;) {
+		PassInfo& p = passes[i];
+		p.live = p.kept;
+		for (const Access& w : p.writes) {
+			p.live = p.live || (resources[w.resource].needed & versionBit(w.version)) != 0;
+		}
+		if (!p.live) {
+			culledTotal++;
+			continue;
+		}
+		for (const Access& r : p.reads) {
+			resources[r.resource].needed |= versionBit(r.version);
+		}
+	}
+
+	// Lifetimes over the live passes
+	for (size_t i = 0; i < passTotal; i++) {
+		PassInfo& p = passes[i];
+		if (!p.live) {
+			continue;
+		}
+		for (const std::vector<Access>* accesses : { &p.reads, &p.writes }) {
+			for (const Access& a : *accesses) {
+				ResourceInfo& r = resources[a.resource];
+				if (r.first < 0) {
+					r.first = (Pass)i;
+				}
+				r.last = (Pass)i;
+			}
+		}
+	}
+
+	// Transients in the order they start take the first slot of their class that is free
+	// by then. Declaration order is pass order, so a resource's first use never comes
+	// before an earlier declared one's.
+	for (size_t i = 0; i < resourceTotal; i++) {
+		ResourceInfo& r = resources[i];
+		if (r.imported || r.first < 0) {
+			continue;
+		}
+		if ((size_t)r.aliasClass >= slotEnds.size()) {
+			slotEnds.resize(r.aliasClass + 1);
+		}
+		std::vector<Pass>& ends = slotEnds[r.aliasClass];
+		r.slot = -1;
+		for (size_t s = 0; s < ends.size() && r.slot < 0; s++) {
+			if (ends[s] < r.first) {
+				r.slot = (int)s;
+			}
+		}
+		if (r.slot < 0) {
+			r.slot = (int)ends.size();
+			ends.push_back(r.last);
+		}
+		ends[r.slot] = r.last;
+	}
+}
+
+void FrameGraph::execute()
+{
+	for (size_t i = 0; i < passTotal; i++) {
+		PassInfo& p = passes[i];
+		if (!p.live) {
+			continue;
+		}
+		if (!p.run()) {
+			continue;
+		}
+		for (size_t j = 0; j < resourceTotal; j++) {
+			ResourceInfo& r = resources[j];
+			if (!r.imported && r.last == (Pass)i && r.invalidate) {
+				r.invalidate();
+			}
+		}
+	}
+}
+
+int FrameGraph::slotCount(int aliasClass) const
+{
+	return aliasClass >= 0 && (size_t)aliasClass < slotEnds.size() ? (int)slotEnds[aliasClass].size() : 0;
+}
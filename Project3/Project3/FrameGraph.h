@@ -0,0 +1,122 @@
+#ifndef _FRAME_GRAPH_H_
+#define _FRAME_GRAPH_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// The passes of a frame with what each reads and writes, declared in the order they run.
+// compile() then works out what the frame actually needs: a pass is kept only if something
+// it writes reaches an output (the eye buffer, the compositor's layers) through the passes
+// after it, so a wall nobody composites (switched off, or shown as a quad layer instead)
+// is never rendered, without the pass itself knowing why.
+//
+// Resources are imported, owned elsewhere and possibly kept from frame to frame, or
+// transient, living only between their first and last use in the graph. Transients of the
+// same alias class whose lifetimes do not overlap get the same slot, so one physical buffer
+// serves them all (the wall passes' shared depth), and each is invalidated right after the
+// last pass that uses it.
+//
+// Writes make new versions of a resource, so a pass that clears a target does not keep the
+// passes that drew into it before alive. modify() is a read and a write, for drawing over.
+//
+// The graph is declared again every frame into the same storage, nothing is allocated once
+// it has seen the largest frame.
+class FrameGraph
+{
+public:
+	typedef int Resource;
+	typedef int Pass;
+	// Runs a pass. False if it found nothing to do and drew nothing, its transients are then
+	// not invalidated by it.
+	typedef std::function<bool()> Run;
+
+	FrameGraph();
+
+	// Starts declaring a new frame
+	void reset();
+
+	//! A resource the graph does not own.
+	// @input output Whether it is what the frame is for. Only passes that contribute to an
+	//		output are run.
+	Resource import(const char* name, bool output);
+	//! A resource that only lives within the frame, like a wall pass's depth.
+	// @input aliasClass Transients of one class can share a slot, so they have to be alike
+	// @input invalidate Called right after the last pass that uses it, with that pass's
+	//		framebuffer still bound, to tell the driver the contents are not needed
+	Resource transient(const char* name, int aliasClass, std::function<void()> invalidate = nullptr);
+
+	Pass addPass(const char* name, Run run);
+	// The pass reads what the passes before it left in r
+	void read(Pass pass, Resource r);
+	// The pass replaces what r holds (clears it, or covers all of it)
+	void write(Pass pass, Resource r);
+	// The pass draws over what r holds
+	void modify(Pass pass, Resource r)
+	{
+		read(pass, r);
+		write(pass, r);
+	}
+	// Never culled, for a pass whose effects are not resources of the graph
+	void keep(Pass pass);
+
+	//! Culls the passes that reach no output, and gives the transients their lifetimes and
+	// slots
+	void compile();
+	//! Runs the passes left in order, invalidating each transient after its last use
+	void execute();
+
+	bool culled(Pass pass) const { return !passes[pass].live; }
+	int slot(Resource r) const { return resources[r].slot; }
+	// Slots of the alias class the last compile() used, the buffers the frame needed
+	int slotCount(int aliasClass) const;
+	size_t passCount() const { return passTotal; }
+	size_t culledCount() const { return culledTotal; }
+	const char* passName(Pass pass) const { return passes[pass].name; }
+
+private:
+	struct Access
+	{
+		Resource resource;
+		int version;
+	};
+
+	struct PassInfo
+	{
+		const char* name;
+		Run run;
+		std::vector<Access> reads;
+		std::vector<Access> writes;
+		bool kept;
+		bool live;
+	};
+
+	struct ResourceInfo
+	{
+		const char* name;
+		bool imported;
+		bool output;
+		int aliasClass;
+		std::function<void()> invalidate;
+		// Writes so far, the version a read sees
+		int version;
+		// Versions a live pass reads, a bit each (versions past 63 are always needed)
+		uint64_t needed;
+		// The live passes that use it first and last, -1 for none
+		Pass first;
+		Pass last;
+		int slot;
+	};
+
+	// Entries past passTotal and resourceTotal are last frames', kept for their storage
+	std::vector<PassInfo> passes;
+	std::vector<ResourceInfo> resources;
+	size_t passTotal;
+	size_t resourceTotal;
+	size_t culledTotal;
+	// Per alias class and slot, the last pass of the transient holding it
+	std::vector<std::vector<Pass>> slotEnds;
+};
+
+#endif
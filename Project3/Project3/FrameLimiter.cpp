@@ -0,0 +1,181 @@
+#include "FrameLimiter.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <timeapi.h>
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#else
+#include <chrono>
+#include <thread>
+#endif
+
+FrameLimiter::FrameLimiter() : limitMode(OFF), frequency(1), period(0), idlePeriod(0), idleAfter(0), next(0), lastActivity(0),
+	timer(nullptr), timerPeriodRaised(false), frames(0), limited(0), idled(0), slept(0)
+{
+#ifdef _WIN32
+	LARGE_INTEGER counterFrequency;
+	QueryPerformanceFrequency(&counterFrequency);
+	frequency = counterFrequency.QuadPart;
+#else
+	frequency = 1000000000;
+#endif
+}
+
+FrameLimiter::~FrameLimiter()
+{
+	shutdown();
+}
+
+bool FrameLimiter::parseMode(const std::string& setting, Mode& mode, double& hz)
+{
+	hz = 0.0;
+	if (setting == "off") {
+		mode = OFF;
+		return true;
+	}
+	if (setting == "compositor") {
+		mode = COMPOSITOR;
+		return true;
+	}
+	if (setting == "vsync") {
+		mode = VSYNC;
+		return true;
+	}
+	char* end = nullptr;
+	hz = strtod(setting.c_str(), &end);
+	if (setting.empty() || *end || hz <= 0.0) {
+		return false;
+	}
+	mode = FIXED;
+	return true;
+}
+
+void FrameLimiter::configure(Mode mode, double hz, double refreshHz, double idleHz, double idleAfterSeconds)
+{
+	limitMode = mode;
+	double rate = mode == FIXED ? hz : mode == COMPOSITOR ? refreshHz : 0.0;
+	period = rate > 0.0 ? (int64_t)((double)frequency / rate) : 0;
+	idlePeriod = idleHz > 0.0 ? (int64_t)((double)frequency / idleHz) : 0;
+	idleAfter = (int64_t)(std::max(idleAfterSeconds, 0.0) * (double)frequency);
+	next = now();
+	lastActivity = next;
+	if (timer || (!period && !idlePeriod)) {
+		return;
+	}
+#ifdef _WIN32
+	timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	if (!timer) {
+		// Before 10 1803 a plain timer only wakes on the system timer's ticks, 1 ms apart then
+		timer = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+		timerPeriodRaised = timeBeginPeriod(1) == TIMERR_NOERROR;
+	}
+#endif
+}
+
+void FrameLimiter::shutdown()
+{
+#ifdef _WIN32
+	if (timer) {
+		CloseHandle(timer);
+	}
+	if (timerPeriodRaised) {
+		timeEndPeriod(1);
+	}
+#endif
+	timer = nullptr;
+	timerPeriodRaised = false;
+	limitMode = OFF;
+	period = 0;
+	idlePeriod = 0;
+}
+
+bool FrameLimiter::idle() const
+{
+	return idlePeriod && now() - lastActivity >= idleAfter;
+}
+
+void FrameLimiter::activity()
+{
+	lastActivity = now();
+}
+
+double FrameLimiter::wait(bool paced)
+{
+	frames++;
+	int64_t start = now();
+	bool idling = idlePeriod && start - lastActivity >= idleAfter;
+	int64_t step;
+	if (idling) {
+		step = idlePeriod;
+	}
+	else if (period && (limitMode == FIXED || (limitMode == COMPOSITOR && !paced))) {
+		step = period;
+	}
+	else {
+		next = start;
+		return 0.0;
+	}
+	// A frame that ran over starts the next period now instead of catching up
+	next = std::max(next + step, start);
+	idled += idling ? 1 : 0;
+	if (next <= start) {
+		return 0.0;
+	}
+	sleepUntil(next);
+	int64_t waited = now() - start;
+	limited++;
+	slept += waited;
+	return (double)waited / (double)frequency;
+}
+
+int64_t FrameLimiter::now() const
+{
+#ifdef _WIN32
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return counter.QuadPart;
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+void FrameLimiter::sleepUntil(int64_t deadline)
+{
+	int64_t remaining = deadline - now();
+	if (remaining <= 0) {
+		return;
+	}
+#ifdef _WIN32
+	// Relative, in 100 ns units
+	LARGE_INTEGER due;
+	due.QuadPart = -(LONGLONG)((double)remaining * 1e7 / (double)frequency);
+	if (timer && SetWaitableTimer(timer, &due, 0, nullptr, nullptr, FALSE)) {
+		WaitForSingleObject(timer, INFINITE);
+	}
+	else {
+		Sleep((DWORD)(remaining * 1000 / frequency));
+	}
+#else
+	std::this_thread::sleep_for(std::chrono::nanoseconds(remaining));
+#endif
+}
+
+void FrameLimiter::report(std::ostream& out) const
+{
+	if (!frames || (!period && !idlePeriod)) {
+		return;
+	}
+	out << "frame limiter: waited on " << limited << " of " << frames << " frames, " << idled << " idle, "
+		<< (double)slept / (double)frequency << " s asleep" << std::endl;
+}
+
+FrameLimiter& frameLimiter()
+{
+	static FrameLimiter limiter;
+	return limiter;
+}
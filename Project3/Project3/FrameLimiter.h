@@ -0,0 +1,80 @@
+#ifndef _FRAME_LIMITER_H_
+#define _FRAME_LIMITER_H_
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Keeps the loop from spinning as fast as it can where nothing else paces it: the desktop
+// window, the benchmark's stand-in HMD, a session that is not presenting. frame.limit is
+//
+//   compositor  frames the compositor paced (submitted while presenting) go as they are,
+//               the rest at the display's refresh
+//   vsync       the window's swap waits for the monitor, the limiter adds nothing
+//   <hz>        every frame at that rate
+//   off         as fast as it goes
+//
+// With frame.idle_hz, once nothing has changed for frame.idle_after_ms (no input, no
+// tracked pose moving, no one wearing the headset) every frame drops to that rate until
+// something does.
+//
+// Waits are on a high resolution waitable timer where Windows has one (10 1803 on), else
+// on a plain one with the system timer at 1 ms. Nothing spins, a wait may end a little
+// late but never early.
+class FrameLimiter
+{
+public:
+	enum Mode { OFF, COMPOSITOR, VSYNC, FIXED };
+
+	FrameLimiter();
+	~FrameLimiter();
+
+	FrameLimiter(const FrameLimiter&) = delete;
+	FrameLimiter& operator=(const FrameLimiter&) = delete;
+
+	//! "off", "compositor", "vsync" or a rate in Hz.
+	// @input hz Receives the rate for FIXED
+	static bool parseMode(const std::string& setting, Mode& mode, double& hz);
+
+	//! Starts limiting.
+	// @input refreshHz The display's refresh, what compositor mode paces unpaced frames to
+	// @input idleHz 0 for no idle mode
+	void configure(Mode mode, double hz, double refreshHz, double idleHz, double idleAfterSeconds);
+	void shutdown();
+	Mode mode() const { return limitMode; }
+	bool idle() const;
+
+	// Something changed this frame, so the next ones are not idle
+	void activity();
+	//! Waits out the rest of this frame's period, from the end of the last wait.
+	// @input paced The frame already waited on the display (ovr_SubmitFrame while presenting)
+	// @return The seconds slept
+	double wait(bool paced);
+
+	// The frames limited and idled and the time slept
+	void report(std::ostream& out) const;
+
+private:
+	// In ticks, frequency of them a second
+	int64_t now() const;
+	void sleepUntil(int64_t deadline);
+
+	Mode limitMode;
+	int64_t frequency;
+	int64_t period;
+	int64_t idlePeriod;
+	int64_t idleAfter;
+	int64_t next;
+	int64_t lastActivity;
+	void* timer;
+	bool timerPeriodRaised;
+
+	uint64_t frames;
+	uint64_t limited;
+	uint64_t idled;
+	int64_t slept;
+};
+
+FrameLimiter& frameLimiter();
+
+#endif
@@ -0,0 +1,183 @@
+#include "FramePacing.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// How quickly a phase's usual time follows its recent frames
+static const double USUAL_RATE = 0.05;
+// A frame this many refreshes long missed at least one vsync
+static const double MISSED_AT = 1.5;
+
+static const char* PHASE_NAMES[FramePacing::PHASES] = { "poll", "update", "beginFrame", "draw", "submit", "swap" };
+
+FramePacing::FramePacing() : now(nullptr), period(1.0 / 90.0), lastEnd(0.0), depth(0), frames(0), missed(0), head(0)
+{
+	memset(current, 0, sizeof(current));
+	memset(usual, 0, sizeof(usual));
+	memset(bins, 0, sizeof(bins));
+	memset(missedBy, 0, sizeof(missedBy));
+}
+
+const char* FramePacing::name(int phase)
+{
+	return phase >= 0 && phase < PHASES ? PHASE_NAMES[phase] : "-";
+}
+
+void FramePacing::init(double refreshHz, double (*now)(), size_t history)
+{
+	this->now = now;
+	period = refreshHz > 0.0 ? 1.0 / refreshHz : 1.0 / 90.0;
+	lastEnd = now();
+	this->history.assign(std::max<size_t>(history, 1), Frame());
+	head = 0;
+	misses.reserve(MAX_MISSES);
+}
+
+void FramePacing::begin(Phase phase)
+{
+	if (depth >= MAX_DEPTH) {
+		return;
+	}
+	Open& open = stack[depth++];
+	open.phase = phase;
+	open.start = now();
+	open.children = 0.0;
+}
+
+void FramePacing::end(Phase phase)
+{
+	if (!depth || stack[depth - 1].phase != phase) {
+		return;
+	}
+	const Open& open = stack[--depth];
+	double elapsed = now() - open.start;
+	current[phase] += elapsed - open.children;
+	if (depth) {
+		stack[depth - 1].children += elapsed;
+	}
+}
+
+void FramePacing::endFrame(uint64_t index)
+{
+	if (!now) {
+		return;
+	}
+	double end = now();
+	Frame f;
+	f.index = index;
+	f.interval = end - lastEnd;
+	memcpy(f.phases, current, sizeof(current));
+	f.blamed = -1;
+	lastEnd = end;
+	memset(current, 0, sizeof(current));
+
+	// The first frame's interval is the startup, it says nothing about pacing
+	if (frames++ == 0) {
+		return;
+	}
+	double refreshes = f.interval / period;
+	bins[std::min((int)(refreshes * 2.0), BINS - 1)]++;
+	if (refreshes > MISSED_AT) {
+		double worst = 0.0;
+		for (int p = 0; p < PHASES; p++) {
+			double over = f.phases[p] - usual[p];
+			if (over > worst) {
+				worst = over;
+				f.blamed = p;
+			}
+		}
+		missed++;
+		if (f.blamed >= 0) {
+			missedBy[f.blamed]++;
+		}
+		if (misses.size() < MAX_MISSES) {
+			misses.push_back(f);
+		}
+	}
+	else {
+		for (int p = 0; p < PHASES; p++) {
+			usual[p] += (f.phases[p] - usual[p]) * USUAL_RATE;
+		}
+	}
+	history[head] = f;
+	head = (head + 1) % history.size();
+}
+
+void FramePacing::report(std::ostream& out) const
+{
+	if (frames < 2) {
+		return;
+	}
+	uint64_t counted = frames - 1;
+	char line[256];
+	snprintf(line, sizeof(line), "frame pacing over %llu frames at %.1f Hz, %llu missed a vsync (%.2f%%)",
+		(unsigned long long)counted, 1.0 / period, (unsigned long long)missed, 100.0 * missed / counted);
+	out << line << std::endl;
+	uint64_t most = *std::max_element(bins, bins + BINS);
+	for (int b = 0; b < BINS; b++) {
+		if (!bins[b]) {
+			continue;
+		}
+		int width = std::max((int)(40 * bins[b] / most), 1);
+		char range[32];
+		if (b == BINS - 1) {
+			snprintf(range, sizeof(range), "%.1f and up", b * 0.5);
+		}
+		else {
+			snprintf(range, sizeof(range), "%.1f-%.1f", b * 0.5, (b + 1) * 0.5);
+		}
+		snprintf(line, sizeof(line), "  %-12s refreshes %8llu %s", range, (unsigned long long)bins[b], std::string(width, '#').c_str());
+		out << line << std::endl;
+	}
+	if (!missed) {
+		return;
+	}
+	out << "  missed vsyncs by phase:";
+	for (int p = 0; p < PHASES; p++) {
+		if (missedBy[p]) {
+			out << ' ' << PHASE_NAMES[p] << ' ' << missedBy[p];
+		}
+	}
+	out << std::endl;
+	for (size_t i = 0; i < std::min<size_t>(misses.size(), 10); i++) {
+		const Frame& f = misses[i];
+		snprintf(line, sizeof(line), "  frame %llu took %.2f ms, %s %.2f ms (usually %.2f ms)", (unsigned long long)f.index,
+			f.interval * 1000.0, name(f.blamed), f.blamed >= 0 ? f.phases[f.blamed] * 1000.0 : 0.0,
+			f.blamed >= 0 ? usual[f.blamed] * 1000.0 : 0.0);
+		out << line << std::endl;
+	}
+}
+
+bool FramePacing::writeCsv(const char* filename) const
+{
+	std::ofstream file(filename);
+	if (!file.is_open()) {
+		std::cerr << "could not write frame pacing to " << filename << std::endl;
+		return false;
+	}
+	file << "frame,interval_ms";
+	for (int p = 0; p < PHASES; p++) {
+		file << ',' << PHASE_NAMES[p] << "_ms";
+	}
+	file << ",missed_by\n";
+	size_t count = std::min<size_t>(history.size(), frames > 0 ? (size_t)(frames - 1) : 0);
+	for (size_t age = count; age-- > 0;) {
+		const Frame& f = history[(head + history.size() - 1 - age) % history.size()];
+		file << f.index << ',' << f.interval * 1000.0;
+		for (int p = 0; p < PHASES; p++) {
+			file << ',' << f.phases[p] * 1000.0;
+		}
+		file << ',' << (f.interval / period > MISSED_AT ? name(f.blamed) : "") << '\n';
+	}
+	return true;
+}
+
+FramePacing& framePacing()
+{
+	static FramePacing pacing;
+	return pacing;
+}
@@ -0,0 +1,101 @@
+#ifndef _FRAME_PACING_H_
+#define _FRAME_PACING_H_
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// Where each frame's time goes between two frames, to tell the compositor's pacing apart
+// from our own stalls. The loop marks its phases (poll, update, beginFrame, draw, submit,
+// swap) and each frame's interval to the one before is binned against the HMD refresh.
+// A frame that took more than one and a half refreshes missed a vsync, and is blamed on
+// the phase that ran longest over its usual time.
+//
+// Phases may nest (submit is inside draw), a phase's time leaves out the ones inside it.
+class FramePacing
+{
+public:
+	enum Phase { POLL, UPDATE, BEGIN_FRAME, DRAW, SUBMIT, SWAP, PHASES };
+	enum { MAX_DEPTH = 8, BINS = 10, MAX_MISSES = 256 };
+
+	struct Frame
+	{
+		uint64_t index;
+		double interval;
+		double phases[PHASES];
+		int blamed;
+	};
+
+	FramePacing();
+
+	//! Starts recording.
+	// @input now The clock, in seconds: ovr_GetTimeInSeconds with a session
+	// @input history How many of the last frames to keep for the CSV
+	void init(double refreshHz, double (*now)(), size_t history);
+	bool active() const { return now != nullptr; }
+
+	void begin(Phase phase);
+	void end(Phase phase);
+	// Closes the frame, the interval runs from the last endFrame
+	void endFrame(uint64_t index);
+
+	// The interval histogram in refreshes, and the missed vsyncs by phase
+	void report(std::ostream& out) const;
+	bool writeCsv(const char* filename) const;
+
+	static const char* name(int phase);
+
+private:
+	double (*now)();
+	double period;
+	double lastEnd;
+	double current[PHASES];
+	// Each phase's usual time, a slow moving average over the frames that made it in time
+	double usual[PHASES];
+	struct Open
+	{
+		int phase;
+		double start;
+		double children;
+	};
+	Open stack[MAX_DEPTH];
+	int depth;
+
+	// Interval bins of half a refresh, the last one takes everything longer
+	uint64_t bins[BINS];
+	uint64_t frames;
+	uint64_t missed;
+	uint64_t missedBy[PHASES];
+	std::vector<Frame> misses;
+	std::vector<Frame> history;
+	size_t head;
+};
+
+FramePacing& framePacing();
+
+// Marks a phase from construction to destruction, nothing while pacing is not recording
+class PacingScope
+{
+public:
+	explicit PacingScope(FramePacing::Phase phase) : phase(phase), active(framePacing().active())
+	{
+		if (active) {
+			framePacing().begin(phase);
+		}
+	}
+	~PacingScope()
+	{
+		if (active) {
+			framePacing().end(phase);
+		}
+	}
+
+	PacingScope(const PacingScope&) = delete;
+	PacingScope& operator=(const PacingScope&) = delete;
+
+private:
+	FramePacing::Phase phase;
+	bool active;
+};
+
+#endif
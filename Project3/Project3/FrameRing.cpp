@@ -0,0 +1,146 @@
+#include "FrameRing.h"
+#include "GpuMemory.h"
+
+#include <cstring>
+#include <iostream>
+
+FrameRing::FrameRing() : vbo(0), mapped(nullptr), regionBytes(0), uboAlignment(256), frame(0), frames(0), head(0), peakBytes(0),
+	overflowed(false)
+{
+	for (int i = 0; i < FRAMES; i++) {
+		fences[i] = nullptr;
+	}
+}
+
+FrameRing::~FrameRing()
+{
+	shutdown();
+}
+
+bool FrameRing::init(size_t frameBytes)
+{
+	shutdown();
+	if (!GLEW_ARB_buffer_storage) {
+		std::cerr << "ARB_buffer_storage not supported, per frame data is uploaded buffer by buffer" << std::endl;
+		return false;
+	}
+
+	GLint alignment = 1;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	uboAlignment = alignment > 0 ? (size_t)alignment : 1;
+	// Every region starts aligned for anything bound out of it
+	regionBytes = (frameBytes + 255) & ~(size_t)255;
+
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	GLsizeiptr total = (GLsizeiptr)(regionBytes * FRAMES);
+	glGenBuffers(1, &vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferStorage(GL_ARRAY_BUFFER, total, nullptr, flags);
+	mapped = (unsigned char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, total, flags);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	if (!mapped) {
+		std::cerr << "could not map the frame ring" << std::endl;
+		glDeleteBuffers(1, &vbo);
+		vbo = 0;
+		return false;
+	}
+	gpuMemory().allocate(GpuMemory::KIND_BUFFER, vbo, (uint64_t)total, GpuMemory::STREAMING, "frame ring");
+	frame = 0;
+	head = 0;
+	return true;
+}
+
+void FrameRing::shutdown()
+{
+	for (int i = 0; i < FRAMES; i++) {
+		if (fences[i]) {
+			glDeleteSync(fences[i]);
+			fences[i] = nullptr;
+		}
+	}
+	if (vbo) {
+		if (mapped) {
+			glBindBuffer(GL_ARRAY_BUFFER, vbo);
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+		}
+		gpuMemory().release(GpuMemory::KIND_BUFFER, vbo);
+		glDeleteBuffers(1, &vbo);
+	}
+	vbo = 0;
+	mapped = nullptr;
+	regionBytes = 0;
+	head = 0;
+}
+
+void FrameRing::beginFrame()
+{
+	if (!mapped) {
+		return;
+	}
+	frame = (frame + 1) % FRAMES;
+	frames++;
+	head = 0;
+	GLsync fence = fences[frame];
+	if (!fence) {
+		return;
+	}
+	// Flushed on the first try, in case the frame that fenced it never got submitted
+	GLbitfield waitFlags = GL_SYNC_FLUSH_COMMANDS_BIT;
+	while (glClientWaitSync(fence, waitFlags, 1000000000ull) == GL_TIMEOUT_EXPIRED) {
+		waitFlags = 0;
+	}
+	glDeleteSync(fence);
+	fences[frame] = nullptr;
+}
+
+void FrameRing::endFrame()
+{
+	if (!mapped) {
+		return;
+	}
+	if (fences[frame]) {
+		glDeleteSync(fences[frame]);
+	}
+	fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	if (head > peakBytes) {
+		peakBytes = head;
+	}
+}
+
+void* FrameRing::allocate(size_t bytes, size_t alignment, GLintptr& offset)
+{
+	if (!mapped || bytes == 0) {
+		return nullptr;
+	}
+	size_t begin = (head + alignment - 1) & ~(alignment - 1);
+	if (begin + bytes > regionBytes) {
+		if (!overflowed) {
+			std::cerr << "frame ring full at " << regionBytes / 1024 << " KB a frame, the rest of the frame's data "
+				"goes through its own buffers (raise gl.frame_ring_kb)" << std::endl;
+			overflowed = true;
+		}
+		return nullptr;
+	}
+	head = begin + bytes;
+	size_t at = regionBytes * frame + begin;
+	offset = (GLintptr)at;
+	return mapped + at;
+}
+
+bool FrameRing::write(const void* data, size_t bytes, size_t alignment, GLintptr& offset)
+{
+	void* to = allocate(bytes, alignment, offset);
+	if (!to) {
+		return false;
+	}
+	memcpy(to, data, bytes);
+	return true;
+}
+
+FrameRing& frameRing()
+{
+	static FrameRing instance;
+	return instance;
+}
@@ -0,0 +1,83 @@
+#ifndef _FRAME_RING_H_
+#define _FRAME_RING_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include <cstddef>
+#include <cstdint>
+
+// One buffer for the data the CPU writes anew every frame: the camera blocks, the props'
+// instance matrices, the draw list's per instance data and the debug wireframes. It stays
+// mapped (ARB_buffer_storage) and is split into FRAMES regions, used in turn. A frame takes
+// space from its region with a bump pointer and writes straight into the mapping; the
+// consumers then bind what they wrote by its offset (glBindBufferRange, or attribute
+// pointers into the buffer), so nothing is ever written over while the GPU reads it and the
+// driver has no reason to sync.
+//
+// endFrame() fences the frame's region and beginFrame() waits for the region it is about
+// to reuse, written FRAMES - 1 frames ago, which hardly ever blocks. Without buffer storage,
+// or once a frame has used up its region, allocate() returns nullptr and the consumer
+// uploads into a buffer of its own as before.
+class FrameRing
+{
+public:
+	enum { FRAMES = 3 };
+
+	FrameRing();
+	~FrameRing();
+
+	FrameRing(const FrameRing&) = delete;
+	FrameRing& operator=(const FrameRing&) = delete;
+
+	//! Creates and maps the buffer, FRAMES times frameBytes.
+	// @return False, and the ring stays unusable, without ARB_buffer_storage
+	bool init(size_t frameBytes);
+	void shutdown();
+
+	bool valid() const { return mapped != nullptr; }
+	GLuint buffer() const { return vbo; }
+
+	// Around each frame, before anything is allocated and after its last draw
+	void beginFrame();
+	void endFrame();
+
+	//! Space for bytes in this frame's region, valid until the frame ends.
+	// @input alignment A power of two the offset is a multiple of
+	// @input offset Receives where the space starts in buffer()
+	// @return Where to write, or nullptr if the ring is unusable or the region is full
+	void* allocate(size_t bytes, size_t alignment, GLintptr& offset);
+	// The same with data copied in
+	bool write(const void* data, size_t bytes, size_t alignment, GLintptr& offset);
+
+	// Counts beginFrame() calls. Data written in an earlier frame has to be written again
+	// before it is drawn.
+	uint64_t frameIndex() const { return frames; }
+
+	// What ranges bound as uniform blocks have to be aligned to
+	size_t uniformAlignment() const { return uboAlignment; }
+
+	// The most any frame has taken, to size frame_ring_kb by
+	size_t peak() const { return peakBytes; }
+
+private:
+	GLuint vbo;
+	unsigned char* mapped;
+	size_t regionBytes;
+	size_t uboAlignment;
+	int frame;
+	uint64_t frames;
+	size_t head;
+	size_t peakBytes;
+	bool overflowed;
+	GLsync fences[FRAMES];
+};
+
+FrameRing& frameRing();
+
+#endif
@@ -0,0 +1,260 @@
+#include "GLDebugLog.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "Log.h"
+
+static const char* typeName(GLenum type)
+{
+	switch (type) {
+	case GL_DEBUG_TYPE_ERROR: return "error";
+	case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated";
+	case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "undefined";
+	case GL_DEBUG_TYPE_PORTABILITY: return "portability";
+	case GL_DEBUG_TYPE_PERFORMANCE: return "performance";
+	case GL_DEBUG_TYPE_MARKER: return "marker";
+	default: return "other";
+	}
+}
+
+GLDebugLog::GLDebugLog() : mode(OFF), writeIndex(0), readIndex(0), dropped(0), recompileCount(0)
+{
+	for (uint32_t i = 0; i < RING_SIZE; i++) {
+		ring[i].sequence.store(i, std::memory_order_relaxed);
+	}
+}
+
+GLDebugLog::~GLDebugLog()
+{
+	shutdown();
+}
+
+GLDebugLog::Mode GLDebugLog::parseMode(const std::string& name)
+{
+	if (name == "performance") {
+		return PERFORMANCE;
+	}
+	if (name == "all") {
+		return ALL;
+	}
+	if (name != "off") {
+		std::cerr << "unknown gl.debug mode " << name << ", leaving debug output off" << std::endl;
+	}
+	return OFF;
+}
+
+bool GLDebugLog::parseDebugContext(const std::string& name)
+{
+	if (name == "debug") {
+		return true;
+	}
+	if (name == "release") {
+		return false;
+	}
+	if (!name.empty()) {
+		std::cerr << "unknown gl.context " << name << ", using the build's" << std::endl;
+	}
+#ifdef _DEBUG
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool GLDebugLog::enable(Mode mode, int flushMs)
+{
+	if (mode == OFF || !GLEW_KHR_debug) {
+		return false;
+	}
+	GLint flags = 0;
+	glGetIntegerv(GL_CONTEXT_FLAGS, &flags);
+	if (!(flags & GL_CONTEXT_FLAG_DEBUG_BIT)) {
+		return false;
+	}
+	this->mode = mode;
+
+	// The driver filters, so what is left out costs nothing
+	glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, mode == ALL ? GL_TRUE : GL_FALSE);
+	if (mode == PERFORMANCE) {
+		const GLenum types[] = { GL_DEBUG_TYPE_PERFORMANCE, GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR,
+			GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR, GL_DEBUG_TYPE_PORTABILITY, GL_DEBUG_TYPE_ERROR };
+		for (GLenum type : types) {
+			glDebugMessageControl(GL_DONT_CARE, type, GL_DONT_CARE, 0, nullptr, GL_TRUE);
+		}
+	}
+	// Asynchronous, the driver does not have to call back before the GL call returns
+	glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	glDebugMessageCallback(callback, this);
+	glEnable(GL_DEBUG_OUTPUT);
+
+	interval = std::chrono::milliseconds(std::max(flushMs, 1));
+	nextFlush = std::chrono::steady_clock::now() + interval;
+	return true;
+}
+
+void GLDebugLog::update()
+{
+	if (mode == OFF) {
+		return;
+	}
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (now < nextFlush || !flushing.done()) {
+		return;
+	}
+	nextFlush = now + interval;
+	jobs().submit([this] { flush(); }, &flushing);
+}
+
+void GLDebugLog::shutdown()
+{
+	if (mode == OFF) {
+		return;
+	}
+	if (glfwGetCurrentContext()) {
+		glDisable(GL_DEBUG_OUTPUT);
+		glDebugMessageCallback(nullptr, nullptr);
+	}
+	jobs().wait(flushing);
+	flush();
+	mode = OFF;
+}
+
+void GLAPIENTRY GLDebugLog::callback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length,
+	const GLchar* message, GLvoid* userParam)
+{
+	static_cast<GLDebugLog*>(userParam)->push(source, type, id, severity, length, message);
+}
+
+void GLDebugLog::push(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* text)
+{
+	uint32_t index = writeIndex.load(std::memory_order_relaxed);
+	Message* slot;
+	for (;;) {
+		slot = &ring[index % RING_SIZE];
+		uint32_t sequence = slot->sequence.load(std::memory_order_acquire);
+		int32_t turn = (int32_t)(sequence - index);
+		if (turn == 0) {
+			if (writeIndex.compare_exchange_weak(index, index + 1, std::memory_order_relaxed)) {
+				break;
+			}
+		}
+		else if (turn < 0) {
+			// The reader is a lap behind, a dropped message beats a driver thread waiting
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		else {
+			index = writeIndex.load(std::memory_order_relaxed);
+		}
+	}
+	slot->source = source;
+	slot->type = type;
+	slot->id = id;
+	slot->severity = severity;
+	size_t n = length >= 0 ? (size_t)length : strlen(text);
+	n = std::min(n, (size_t)MAX_MESSAGE - 1);
+	memcpy(slot->text, text, n);
+	slot->text[n] = 0;
+	// "recompiled" or "Recompiling", the drivers word it differently
+	if (type == GL_DEBUG_TYPE_PERFORMANCE && strstr(slot->text, "ecompil")) {
+		recompileCount.fetch_add(1, std::memory_order_relaxed);
+	}
+	slot->sequence.store(index + 1, std::memory_order_release);
+}
+
+void GLDebugLog::flush()
+{
+	std::lock_guard<std::mutex> lock(flushMutex);
+	for (;;) {
+		Message& slot = ring[readIndex % RING_SIZE];
+		if (slot.sequence.load(std::memory_order_acquire) != readIndex + 1) {
+			break;
+		}
+		// The driver's id only means something with its source and type
+		uint64_t key = ((uint64_t)slot.id << 32) ^ ((uint64_t)slot.source << 16) ^ slot.type;
+		Seen& entry = seen[key];
+		if (!entry.count) {
+			entry.text = slot.text;
+			entry.type = slot.type;
+			entry.severity = slot.severity;
+			// The log mirrors it to the debugger's output
+			logStream(slot.type == GL_DEBUG_TYPE_ERROR ? LOG_ERROR : LOG_WARNING) << "GL " << typeName(slot.type) << " ["
+				<< slot.id << "]: " << slot.text << std::endl;
+		}
+		entry.count++;
+		slot.sequence.store(readIndex + RING_SIZE, std::memory_order_release);
+		readIndex++;
+	}
+}
+
+void GLDebugLog::report(std::ostream& out)
+{
+	std::lock_guard<std::mutex> lock(flushMutex);
+	if (seen.empty() && !dropped.load()) {
+		return;
+	}
+	std::vector<std::pair<uint64_t, const Seen*>> byCount;
+	for (const auto& entry : seen) {
+		byCount.push_back(std::make_pair(entry.second.count, &entry.second));
+	}
+	std::sort(byCount.begin(), byCount.end(), [](const std::pair<uint64_t, const Seen*>& a,
+		const std::pair<uint64_t, const Seen*>& b) { return a.first > b.first; });
+	out << "GL debug messages (" << dropped.load() << " dropped while the ring was full)" << std::endl;
+	for (const auto& entry : byCount) {
+		out << "  " << entry.first << "x " << typeName(entry.second->type) << ": " << entry.second->text << std::endl;
+	}
+}
+
+GLDebugLog& glDebugLog()
+{
+	static GLDebugLog log;
+	return log;
+}
+
+static const char* errorName(GLenum error)
+{
+	switch (error) {
+	case GL_INVALID_ENUM: return "invalid enum";
+	case GL_INVALID_VALUE: return "invalid value";
+	case GL_INVALID_OPERATION: return "invalid operation";
+	case GL_INVALID_FRAMEBUFFER_OPERATION: return "invalid framebuffer operation";
+	case GL_OUT_OF_MEMORY: return "out of memory";
+	case GL_STACK_UNDERFLOW: return "stack underflow";
+	case GL_STACK_OVERFLOW: return "stack overflow";
+	default: return "unknown error";
+	}
+}
+
+bool checkGlError(const char* where)
+{
+	bool any = false;
+	// Each kind of error has a flag of its own, glGetError clears one at a time
+	for (GLenum error = glGetError(); error != GL_NO_ERROR; error = glGetError()) {
+		std::cerr << where << ": GL " << errorName(error) << std::endl;
+		any = true;
+	}
+	return any;
+}
+
+bool checkFramebufferStatus(GLenum target, const char* where)
+{
+	GLenum status = glCheckFramebufferStatus(target);
+	const char* problem;
+	switch (status) {
+	case GL_FRAMEBUFFER_COMPLETE: return true;
+	case GL_FRAMEBUFFER_INCOMPLETE_ATTACHMENT: problem = "incomplete attachment"; break;
+	case GL_FRAMEBUFFER_INCOMPLETE_MISSING_ATTACHMENT: problem = "missing attachment"; break;
+	case GL_FRAMEBUFFER_INCOMPLETE_DRAW_BUFFER: problem = "incomplete draw buffer"; break;
+	case GL_FRAMEBUFFER_INCOMPLETE_READ_BUFFER: problem = "incomplete read buffer"; break;
+	case GL_FRAMEBUFFER_INCOMPLETE_MULTISAMPLE: problem = "incomplete multisample"; break;
+	case GL_FRAMEBUFFER_INCOMPLETE_LAYER_TARGETS: problem = "incomplete layer targets"; break;
+	case GL_FRAMEBUFFER_UNSUPPORTED: problem = "unsupported internal format or image"; break;
+	default: problem = "other framebuffer error"; break;
+	}
+	std::cerr << where << ": framebuffer " << problem << std::endl;
+	return false;
+}
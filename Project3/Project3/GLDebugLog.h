@@ -0,0 +1,126 @@
+#ifndef _GL_DEBUG_LOG_H_
+#define _GL_DEBUG_LOG_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+#include "JobSystem.h"
+
+// Debug builds check GL errors synchronously (GL_CHECK_ERROR below), others leave the checks
+// out altogether
+#if defined(_DEBUG) && !defined(CAVE_GL_CHECKS)
+#define CAVE_GL_CHECKS
+#endif
+
+// KHR_debug messages without the cost of printing them in the driver's callback. The
+// callback only copies a message into a fixed ring (lock free, the driver may call it from
+// its own threads) and a job prints them a few times a second. Each distinct
+// message is printed the first time it is seen, repeats are only counted and summed up by
+// report().
+//
+// "performance" takes the driver's performance, undefined and deprecated behavior,
+// portability and error messages (recompiles, slow paths, stalls), "all" takes everything
+// including notifications.
+class GLDebugLog
+{
+public:
+	enum { RING_SIZE = 1024, MAX_MESSAGE = 240 };
+	enum Mode { OFF, PERFORMANCE, ALL };
+
+	GLDebugLog();
+	~GLDebugLog();
+
+	GLDebugLog(const GLDebugLog&) = delete;
+	GLDebugLog& operator=(const GLDebugLog&) = delete;
+
+	// Needs a current debug context, returns false if there is none or no KHR_debug
+	bool enable(Mode mode, int flushMs);
+	static Mode parseMode(const std::string& name);
+	//! gl.context: "debug" asks for a debug context, with this log; "release" asks for a
+	// KHR_no_error one, where the driver checks nothing and there is nothing to log.
+	// @return Whether it is debug. Empty follows the build.
+	static bool parseDebugContext(const std::string& name);
+	// Waits for the last flush job and prints what is still in the ring
+	void shutdown();
+	bool enabled() const { return mode != OFF; }
+	// Once a frame on the GL thread: queues a flush job when one is due
+	void update();
+
+	// Prints the messages that arrived since the last flush
+	void flush();
+	// Every distinct message with how often it came, and how many the full ring dropped
+	void report(std::ostream& out);
+	// Performance messages about the driver recompiling a shader for the state it is drawn
+	// with, counted as they arrive
+	uint64_t recompiles() const { return recompileCount.load(std::memory_order_relaxed); }
+
+private:
+	struct Message
+	{
+		std::atomic<uint32_t> sequence;
+		GLenum source;
+		GLenum type;
+		GLuint id;
+		GLenum severity;
+		char text[MAX_MESSAGE];
+	};
+	struct Seen
+	{
+		std::string text;
+		GLenum type;
+		GLenum severity;
+		uint64_t count;
+	};
+
+	static void GLAPIENTRY callback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length,
+		const GLchar* message, GLvoid* userParam);
+	void push(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* text);
+
+	Mode mode;
+	// A bounded multi producer queue: a slot's sequence says whose turn it is, so writers
+	// claim slots with one compare and swap and the reader never waits on a writer
+	Message ring[RING_SIZE];
+	std::atomic<uint32_t> writeIndex;
+	uint32_t readIndex;
+	std::atomic<uint64_t> dropped;
+	std::atomic<uint64_t> recompileCount;
+
+	// Only one flush job at a time (or shutdown, after the last) touches these
+	std::mutex flushMutex;
+	std::map<uint64_t, Seen> seen;
+
+	std::chrono::steady_clock::duration interval;
+	std::chrono::steady_clock::time_point nextFlush;
+	JobCounter flushing;
+};
+
+GLDebugLog& glDebugLog();
+
+// glGetError until it has nothing left, printing each error with where. True if there was one.
+// Waits for the driver, so only through GL_CHECK_ERROR outside of setup.
+bool checkGlError(const char* where);
+// Whether the framebuffer bound to target is complete, printing why not
+bool checkFramebufferStatus(GLenum target, const char* where);
+
+#ifdef CAVE_GL_CHECKS
+#define GL_CHECK_ERROR(where) checkGlError(where)
+#define GL_CHECK_FRAMEBUFFER(target, where) checkFramebufferStatus(target, where)
+#else
+#define GL_CHECK_ERROR(where) ((void)0)
+#define GL_CHECK_FRAMEBUFFER(target, where) ((void)0)
+#endif
+
+#endif
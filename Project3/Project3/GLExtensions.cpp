@@ -0,0 +1,185 @@
+#include "GLExtensions.h"
+
+#include <cstring>
+
+PFNGLFRAMEBUFFERTEXTUREMULTIVIEWOVRPROC glFramebufferTextureMultiviewOVR = nullptr;
+PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glMaxShaderCompilerThreadsKHR = nullptr;
+PFNGLGETUNSIGNEDBYTEVEXTPROC glGetUnsignedBytevEXT = nullptr;
+PFNGLRENDERGPUMASKNVPROC glRenderGpuMaskNV = nullptr;
+PFNGLMULTICASTCOPYIMAGESUBDATANVPROC glMulticastCopyImageSubDataNV = nullptr;
+PFNGLMULTICASTWAITSYNCNVPROC glMulticastWaitSyncNV = nullptr;
+PFNGLCREATEBUFFERSPROC glCreateBuffers = nullptr;
+PFNGLNAMEDBUFFERSTORAGEPROC glNamedBufferStorage = nullptr;
+PFNGLNAMEDBUFFERDATAPROC glNamedBufferData = nullptr;
+PFNGLNAMEDBUFFERSUBDATAPROC glNamedBufferSubData = nullptr;
+PFNGLCREATETEXTURESPROC glCreateTextures = nullptr;
+PFNGLTEXTURESTORAGE2DPROC glTextureStorage2D = nullptr;
+PFNGLTEXTURESTORAGE3DPROC glTextureStorage3D = nullptr;
+PFNGLTEXTURESUBIMAGE2DPROC glTextureSubImage2D = nullptr;
+PFNGLTEXTURESUBIMAGE3DPROC glTextureSubImage3D = nullptr;
+PFNGLTEXTUREPARAMETERIPROC glTextureParameteri = nullptr;
+PFNGLTEXTUREPARAMETERFPROC glTextureParameterf = nullptr;
+PFNGLGENERATETEXTUREMIPMAPPROC glGenerateTextureMipmap = nullptr;
+PFNGLCREATEFRAMEBUFFERSPROC glCreateFramebuffers = nullptr;
+PFNGLNAMEDFRAMEBUFFERTEXTUREPROC glNamedFramebufferTexture = nullptr;
+PFNGLNAMEDFRAMEBUFFERRENDERBUFFERPROC glNamedFramebufferRenderbuffer = nullptr;
+PFNGLNAMEDFRAMEBUFFERDRAWBUFFERSPROC glNamedFramebufferDrawBuffers = nullptr;
+PFNGLCHECKNAMEDFRAMEBUFFERSTATUSPROC glCheckNamedFramebufferStatus = nullptr;
+PFNGLCREATERENDERBUFFERSPROC glCreateRenderbuffers = nullptr;
+PFNGLNAMEDRENDERBUFFERSTORAGEPROC glNamedRenderbufferStorage = nullptr;
+PFNGLCREATEVERTEXARRAYSPROC glCreateVertexArrays = nullptr;
+PFNGLENABLEVERTEXARRAYATTRIBPROC glEnableVertexArrayAttrib = nullptr;
+PFNGLVERTEXARRAYATTRIBFORMATPROC glVertexArrayAttribFormat = nullptr;
+PFNGLVERTEXARRAYATTRIBBINDINGPROC glVertexArrayAttribBinding = nullptr;
+PFNGLVERTEXARRAYBINDINGDIVISORPROC glVertexArrayBindingDivisor = nullptr;
+PFNGLVERTEXARRAYVERTEXBUFFERPROC glVertexArrayVertexBuffer = nullptr;
+PFNGLVERTEXARRAYELEMENTBUFFERPROC glVertexArrayElementBuffer = nullptr;
+
+static bool dsaSupported = false;
+static bool dsaUsed = false;
+static GLubyte adapterLuid[GL_LUID_SIZE_EXT];
+static bool adapterLuidKnown = false;
+
+// Looks name up, and clears complete if the driver does not have it
+#define LOAD_GL(name, complete) \
+	name = (decltype(name))glfwGetProcAddress(#name); \
+	complete = complete && name != nullptr
+
+static bool loadDirectStateAccess()
+{
+	GLint major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	if (major * 10 + minor < 45 && !glfwExtensionSupported("GL_ARB_direct_state_access")) {
+		return false;
+	}
+	bool complete = true;
+	LOAD_GL(glCreateBuffers, complete);
+	LOAD_GL(glNamedBufferStorage, complete);
+	LOAD_GL(glNamedBufferData, complete);
+	LOAD_GL(glNamedBufferSubData, complete);
+	LOAD_GL(glCreateTextures, complete);
+	LOAD_GL(glTextureStorage2D, complete);
+	LOAD_GL(glTextureStorage3D, complete);
+	LOAD_GL(glTextureSubImage2D, complete);
+	LOAD_GL(glTextureSubImage3D, complete);
+	LOAD_GL(glTextureParameteri, complete);
+	LOAD_GL(glTextureParameterf, complete);
+	LOAD_GL(glGenerateTextureMipmap, complete);
+	LOAD_GL(glCreateFramebuffers, complete);
+	LOAD_GL(glNamedFramebufferTexture, complete);
+	LOAD_GL(glNamedFramebufferRenderbuffer, complete);
+	LOAD_GL(glNamedFramebufferDrawBuffers, complete);
+	LOAD_GL(glCheckNamedFramebufferStatus, complete);
+	LOAD_GL(glCreateRenderbuffers, complete);
+	LOAD_GL(glNamedRenderbufferStorage, complete);
+	LOAD_GL(glCreateVertexArrays, complete);
+	LOAD_GL(glEnableVertexArrayAttrib, complete);
+	LOAD_GL(glVertexArrayAttribFormat, complete);
+	LOAD_GL(glVertexArrayAttribBinding, complete);
+	LOAD_GL(glVertexArrayBindingDivisor, complete);
+	LOAD_GL(glVertexArrayVertexBuffer, complete);
+	LOAD_GL(glVertexArrayElementBuffer, complete);
+	return complete;
+}
+
+void loadGLExtensions()
+{
+	if (glfwExtensionSupported("GL_OVR_multiview")) {
+		glFramebufferTextureMultiviewOVR =
+			(PFNGLFRAMEBUFFERTEXTUREMULTIVIEWOVRPROC)glfwGetProcAddress("glFramebufferTextureMultiviewOVR");
+	}
+	if (glfwExtensionSupported("GL_KHR_parallel_shader_compile")) {
+		glMaxShaderCompilerThreadsKHR =
+			(PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+	}
+	else if (glfwExtensionSupported("GL_ARB_parallel_shader_compile")) {
+		glMaxShaderCompilerThreadsKHR =
+			(PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+	}
+	if (glfwExtensionSupported("GL_EXT_memory_object") && glfwExtensionSupported("GL_EXT_memory_object_win32")) {
+		glGetUnsignedBytevEXT = (PFNGLGETUNSIGNEDBYTEVEXTPROC)glfwGetProcAddress("glGetUnsignedBytevEXT");
+	}
+	if (glfwExtensionSupported("GL_NV_gpu_multicast")) {
+		bool complete = true;
+		LOAD_GL(glRenderGpuMaskNV, complete);
+		LOAD_GL(glMulticastCopyImageSubDataNV, complete);
+		LOAD_GL(glMulticastWaitSyncNV, complete);
+		if (!complete) {
+			glRenderGpuMaskNV = nullptr;
+		}
+	}
+	dsaSupported = loadDirectStateAccess();
+	// The adapter does not change under a context, it is asked for (and its error checked) here
+	// once rather than at every contextAdapterLuid
+	if (glGetUnsignedBytevEXT) {
+		glGetError();
+		glGetUnsignedBytevEXT(GL_DEVICE_LUID_EXT, adapterLuid);
+		adapterLuidKnown = glGetError() == GL_NO_ERROR;
+	}
+	// As many compiler threads as the driver likes
+	if (glMaxShaderCompilerThreadsKHR) {
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);
+	}
+}
+
+bool supportsParallelShaderCompile()
+{
+	return glMaxShaderCompilerThreadsKHR != nullptr;
+}
+
+bool supportsPipelineStatistics()
+{
+	return glfwExtensionSupported("GL_ARB_pipeline_statistics_query") != 0;
+}
+
+bool supportsMultiview(int views)
+{
+	if (!glFramebufferTextureMultiviewOVR) {
+		return false;
+	}
+	GLint maxViews = 0;
+	glGetIntegerv(GL_MAX_VIEWS_OVR, &maxViews);
+	return maxViews >= views;
+}
+
+int multicastGpuCount()
+{
+	if (!glRenderGpuMaskNV) {
+		return 1;
+	}
+	GLint gpus = 1;
+	glGetIntegerv(GL_MULTICAST_GPUS_NV, &gpus);
+	return gpus > 1 ? gpus : 1;
+}
+
+bool contextAdapterLuid(GLubyte luid[GL_LUID_SIZE_EXT])
+{
+	if (!adapterLuidKnown) {
+		return false;
+	}
+	memcpy(luid, adapterLuid, GL_LUID_SIZE_EXT);
+	return true;
+}
+
+bool noErrorContext()
+{
+	GLint flags = 0;
+	glGetIntegerv(GL_CONTEXT_FLAGS, &flags);
+	return (flags & GL_CONTEXT_FLAG_NO_ERROR_BIT_KHR) != 0;
+}
+
+bool supportsDirectStateAccess()
+{
+	return dsaSupported;
+}
+
+void useDirectStateAccess(bool enabled)
+{
+	dsaUsed = enabled && dsaSupported;
+}
+
+bool directStateAccess()
+{
+	return dsaUsed;
+}
@@ -0,0 +1,159 @@
+#ifndef _GL_EXTENSIONS_H_
+#define _GL_EXTENSIONS_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+// Extensions the bundled GLEW predates. Their entry points are looked up through GLFW
+// by loadGLExtensions(), which has to run once the context is current, and stay null
+// if the driver does not have them.
+
+// GL_OVR_multiview
+#ifndef GL_MAX_VIEWS_OVR
+#define GL_MAX_VIEWS_OVR 0x9631
+#endif
+typedef void (GLAPIENTRY * PFNGLFRAMEBUFFERTEXTUREMULTIVIEWOVRPROC)(GLenum target, GLenum attachment,
+	GLuint texture, GLint level, GLint baseViewIndex, GLsizei numViews);
+extern PFNGLFRAMEBUFFERTEXTUREMULTIVIEWOVRPROC glFramebufferTextureMultiviewOVR;
+
+// GL_KHR_parallel_shader_compile, or its ARB twin with the same enums
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+typedef void (GLAPIENTRY * PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+extern PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glMaxShaderCompilerThreadsKHR;
+
+// GL_ARB_pipeline_statistics_query, queries only, no entry points of its own
+#ifndef GL_FRAGMENT_SHADER_INVOCATIONS_ARB
+#define GL_FRAGMENT_SHADER_INVOCATIONS_ARB 0x82F4
+#endif
+
+// GL 4.5 / GL_ARB_direct_state_access, the entry points the resource setup uses. Objects
+// are made and edited by name, without binding them first.
+typedef void (GLAPIENTRY * PFNGLCREATEBUFFERSPROC)(GLsizei n, GLuint* buffers);
+typedef void (GLAPIENTRY * PFNGLNAMEDBUFFERSTORAGEPROC)(GLuint buffer, GLsizeiptr size, const void* data, GLbitfield flags);
+typedef void (GLAPIENTRY * PFNGLNAMEDBUFFERDATAPROC)(GLuint buffer, GLsizeiptr size, const void* data, GLenum usage);
+typedef void (GLAPIENTRY * PFNGLNAMEDBUFFERSUBDATAPROC)(GLuint buffer, GLintptr offset, GLsizeiptr size, const void* data);
+typedef void (GLAPIENTRY * PFNGLCREATETEXTURESPROC)(GLenum target, GLsizei n, GLuint* textures);
+typedef void (GLAPIENTRY * PFNGLTEXTURESTORAGE2DPROC)(GLuint texture, GLsizei levels, GLenum internalFormat,
+	GLsizei width, GLsizei height);
+typedef void (GLAPIENTRY * PFNGLTEXTURESTORAGE3DPROC)(GLuint texture, GLsizei levels, GLenum internalFormat,
+	GLsizei width, GLsizei height, GLsizei depth);
+typedef void (GLAPIENTRY * PFNGLTEXTURESUBIMAGE2DPROC)(GLuint texture, GLint level, GLint xoffset, GLint yoffset,
+	GLsizei width, GLsizei height, GLenum format, GLenum type, const void* pixels);
+typedef void (GLAPIENTRY * PFNGLTEXTURESUBIMAGE3DPROC)(GLuint texture, GLint level, GLint xoffset, GLint yoffset,
+	GLint zoffset, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const void* pixels);
+typedef void (GLAPIENTRY * PFNGLTEXTUREPARAMETERIPROC)(GLuint texture, GLenum pname, GLint param);
+typedef void (GLAPIENTRY * PFNGLTEXTUREPARAMETERFPROC)(GLuint texture, GLenum pname, GLfloat param);
+typedef void (GLAPIENTRY * PFNGLGENERATETEXTUREMIPMAPPROC)(GLuint texture);
+typedef void (GLAPIENTRY * PFNGLCREATEFRAMEBUFFERSPROC)(GLsizei n, GLuint* framebuffers);
+typedef void (GLAPIENTRY * PFNGLNAMEDFRAMEBUFFERTEXTUREPROC)(GLuint framebuffer, GLenum attachment, GLuint texture,
+	GLint level);
+typedef void (GLAPIENTRY * PFNGLNAMEDFRAMEBUFFERRENDERBUFFERPROC)(GLuint framebuffer, GLenum attachment,
+	GLenum renderbufferTarget, GLuint renderbuffer);
+typedef void (GLAPIENTRY * PFNGLNAMEDFRAMEBUFFERDRAWBUFFERSPROC)(GLuint framebuffer, GLsizei n, const GLenum* buffers);
+typedef GLenum (GLAPIENTRY * PFNGLCHECKNAMEDFRAMEBUFFERSTATUSPROC)(GLuint framebuffer, GLenum target);
+typedef void (GLAPIENTRY * PFNGLCREATERENDERBUFFERSPROC)(GLsizei n, GLuint* renderbuffers);
+typedef void (GLAPIENTRY * PFNGLNAMEDRENDERBUFFERSTORAGEPROC)(GLuint renderbuffer, GLenum internalFormat,
+	GLsizei width, GLsizei height);
+typedef void (GLAPIENTRY * PFNGLCREATEVERTEXARRAYSPROC)(GLsizei n, GLuint* arrays);
+typedef void (GLAPIENTRY * PFNGLENABLEVERTEXARRAYATTRIBPROC)(GLuint vao, GLuint index);
+typedef void (GLAPIENTRY * PFNGLVERTEXARRAYATTRIBFORMATPROC)(GLuint vao, GLuint index, GLint size, GLenum type,
+	GLboolean normalized, GLuint relativeOffset);
+typedef void (GLAPIENTRY * PFNGLVERTEXARRAYATTRIBBINDINGPROC)(GLuint vao, GLuint index, GLuint binding);
+typedef void (GLAPIENTRY * PFNGLVERTEXARRAYBINDINGDIVISORPROC)(GLuint vao, GLuint binding, GLuint divisor);
+typedef void (GLAPIENTRY * PFNGLVERTEXARRAYVERTEXBUFFERPROC)(GLuint vao, GLuint binding, GLuint buffer,
+	GLintptr offset, GLsizei stride);
+typedef void (GLAPIENTRY * PFNGLVERTEXARRAYELEMENTBUFFERPROC)(GLuint vao, GLuint buffer);
+extern PFNGLCREATEBUFFERSPROC glCreateBuffers;
+extern PFNGLNAMEDBUFFERSTORAGEPROC glNamedBufferStorage;
+extern PFNGLNAMEDBUFFERDATAPROC glNamedBufferData;
+extern PFNGLNAMEDBUFFERSUBDATAPROC glNamedBufferSubData;
+extern PFNGLCREATETEXTURESPROC glCreateTextures;
+extern PFNGLTEXTURESTORAGE2DPROC glTextureStorage2D;
+extern PFNGLTEXTURESTORAGE3DPROC glTextureStorage3D;
+extern PFNGLTEXTURESUBIMAGE2DPROC glTextureSubImage2D;
+extern PFNGLTEXTURESUBIMAGE3DPROC glTextureSubImage3D;
+extern PFNGLTEXTUREPARAMETERIPROC glTextureParameteri;
+extern PFNGLTEXTUREPARAMETERFPROC glTextureParameterf;
+extern PFNGLGENERATETEXTUREMIPMAPPROC glGenerateTextureMipmap;
+extern PFNGLCREATEFRAMEBUFFERSPROC glCreateFramebuffers;
+extern PFNGLNAMEDFRAMEBUFFERTEXTUREPROC glNamedFramebufferTexture;
+extern PFNGLNAMEDFRAMEBUFFERRENDERBUFFERPROC glNamedFramebufferRenderbuffer;
+extern PFNGLNAMEDFRAMEBUFFERDRAWBUFFERSPROC glNamedFramebufferDrawBuffers;
+extern PFNGLCHECKNAMEDFRAMEBUFFERSTATUSPROC glCheckNamedFramebufferStatus;
+extern PFNGLCREATERENDERBUFFERSPROC glCreateRenderbuffers;
+extern PFNGLNAMEDRENDERBUFFERSTORAGEPROC glNamedRenderbufferStorage;
+extern PFNGLCREATEVERTEXARRAYSPROC glCreateVertexArrays;
+extern PFNGLENABLEVERTEXARRAYATTRIBPROC glEnableVertexArrayAttrib;
+extern PFNGLVERTEXARRAYATTRIBFORMATPROC glVertexArrayAttribFormat;
+extern PFNGLVERTEXARRAYATTRIBBINDINGPROC glVertexArrayAttribBinding;
+extern PFNGLVERTEXARRAYBINDINGDIVISORPROC glVertexArrayBindingDivisor;
+extern PFNGLVERTEXARRAYVERTEXBUFFERPROC glVertexArrayVertexBuffer;
+extern PFNGLVERTEXARRAYELEMENTBUFFERPROC glVertexArrayElementBuffer;
+
+// GL_EXT_memory_object with GL_EXT_memory_object_win32, only for the LUID of the adapter the
+// context is on (GpuAdapter)
+#ifndef GL_DEVICE_LUID_EXT
+#define GL_LUID_SIZE_EXT 8
+#define GL_DEVICE_LUID_EXT 0x9599
+#define GL_DEVICE_NODE_MASK_EXT 0x959A
+#endif
+typedef void (GLAPIENTRY * PFNGLGETUNSIGNEDBYTEVEXTPROC)(GLenum pname, GLubyte* data);
+extern PFNGLGETUNSIGNEDBYTEVEXTPROC glGetUnsignedBytevEXT;
+
+// GL_NV_gpu_multicast, one context driving every GPU of an SLI group (GpuMulticast)
+#ifndef GL_MULTICAST_GPUS_NV
+#define GL_MULTICAST_GPUS_NV 0x92BA
+#define GL_RENDER_GPU_MASK_NV 0x9558
+#endif
+typedef void (GLAPIENTRY * PFNGLRENDERGPUMASKNVPROC)(GLbitfield mask);
+typedef void (GLAPIENTRY * PFNGLMULTICASTCOPYIMAGESUBDATANVPROC)(GLuint srcGpu, GLbitfield dstGpuMask, GLuint srcName,
+	GLenum srcTarget, GLint srcLevel, GLint srcX, GLint srcY, GLint srcZ, GLuint dstName, GLenum dstTarget, GLint dstLevel,
+	GLint dstX, GLint dstY, GLint dstZ, GLsizei srcWidth, GLsizei srcHeight, GLsizei srcDepth);
+typedef void (GLAPIENTRY * PFNGLMULTICASTWAITSYNCNVPROC)(GLuint signalGpu, GLbitfield waitGpuMask);
+extern PFNGLRENDERGPUMASKNVPROC glRenderGpuMaskNV;
+extern PFNGLMULTICASTCOPYIMAGESUBDATANVPROC glMulticastCopyImageSubDataNV;
+extern PFNGLMULTICASTWAITSYNCNVPROC glMulticastWaitSyncNV;
+
+// GL_KHR_no_error
+#ifndef GL_CONTEXT_FLAG_NO_ERROR_BIT_KHR
+#define GL_CONTEXT_FLAG_NO_ERROR_BIT_KHR 0x00000008
+#endif
+
+void loadGLExtensions();
+
+// True if the driver compiles shaders on threads of its own, and says when one is done
+bool supportsParallelShaderCompile();
+
+// True if queries can count the fragment shader's invocations
+bool supportsPipelineStatistics();
+
+// True if the context can render views views in one multiview draw
+bool supportsMultiview(int views);
+
+// The GPUs the context renders on with GL_NV_gpu_multicast, 1 without it
+int multicastGpuCount();
+
+// True if the current context was made with KHR_no_error, the driver checks nothing
+bool noErrorContext();
+
+// The LUID of the adapter the context is on, as loadGLExtensions() found it, false if the
+// driver does not say
+bool contextAdapterLuid(GLubyte luid[GL_LUID_SIZE_EXT]);
+// True if the context is 4.5 or has GL_ARB_direct_state_access, and every entry point above
+// was found
+bool supportsDirectStateAccess();
+// Whether resources are set up through direct state access, only ever on where supported.
+// Off until set, the app sets it from gl.dsa (on unless turned off) once, right after
+// loadGLExtensions(), before anything is created.
+void useDirectStateAccess(bool enabled);
+bool directStateAccess();
+
+#endif
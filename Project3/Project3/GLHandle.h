@@ -0,0 +1,156 @@
+#ifndef _GL_HANDLE_H_
+#define _GL_HANDLE_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include "GLExtensions.h"
+
+// The name of a GL object that deletes the object with it. Move-only, so there is exactly
+// one owner to delete it, and a scene made again starts from nothing the last one had.
+// Deleting needs the context, so owners that outlive it reset() their handles in
+// shutdownGl. Whatever GpuMemory was told about the object is released by the owner first,
+// the handle does not know its size.
+//
+// Traits say how a kind of object is made and deleted (GLFramebuffer and the others below).
+// With direct state access objects are created whole (glCreate*), so they can be edited by
+// name before they were ever bound; textures need their target for that and are still
+// generated.
+template <typename Traits>
+class GLHandle
+{
+public:
+	GLHandle() : name(0) {}
+	~GLHandle() { reset(); }
+
+	GLHandle(GLHandle&& other) : name(other.release()) {}
+	GLHandle& operator=(GLHandle&& other)
+	{
+		if (this != &other) {
+			reset();
+			name = other.release();
+		}
+		return *this;
+	}
+
+	GLHandle(const GLHandle&) = delete;
+	GLHandle& operator=(const GLHandle&) = delete;
+
+	// A new object, in place of the one held
+	void create()
+	{
+		reset();
+		name = Traits::create();
+	}
+	void reset()
+	{
+		if (name) {
+			Traits::destroy(name);
+		}
+		name = 0;
+	}
+	// Owns an object made without the traits, like a texture created for its target
+	static GLHandle adopt(GLuint name)
+	{
+		GLHandle handle;
+		handle.name = name;
+		return handle;
+	}
+	// Stops owning the object, the caller deletes it
+	GLuint release()
+	{
+		GLuint released = name;
+		name = 0;
+		return released;
+	}
+
+	GLuint get() const { return name; }
+	// Passed to GL as the name it is
+	operator GLuint() const { return name; }
+
+private:
+	GLuint name;
+};
+
+struct GLFramebufferTraits
+{
+	static GLuint create()
+	{
+		GLuint name = 0;
+		if (directStateAccess()) {
+			glCreateFramebuffers(1, &name);
+		}
+		else {
+			glGenFramebuffers(1, &name);
+		}
+		return name;
+	}
+	static void destroy(GLuint name) { glDeleteFramebuffers(1, &name); }
+};
+
+struct GLRenderbufferTraits
+{
+	static GLuint create()
+	{
+		GLuint name = 0;
+		if (directStateAccess()) {
+			glCreateRenderbuffers(1, &name);
+		}
+		else {
+			glGenRenderbuffers(1, &name);
+		}
+		return name;
+	}
+	static void destroy(GLuint name) { glDeleteRenderbuffers(1, &name); }
+};
+
+struct GLTextureTraits
+{
+	static GLuint create() { GLuint name = 0; glGenTextures(1, &name); return name; }
+	static void destroy(GLuint name) { glDeleteTextures(1, &name); }
+};
+
+struct GLBufferTraits
+{
+	static GLuint create()
+	{
+		GLuint name = 0;
+		if (directStateAccess()) {
+			glCreateBuffers(1, &name);
+		}
+		else {
+			glGenBuffers(1, &name);
+		}
+		return name;
+	}
+	static void destroy(GLuint name) { glDeleteBuffers(1, &name); }
+};
+
+struct GLVertexArrayTraits
+{
+	static GLuint create()
+	{
+		GLuint name = 0;
+		if (directStateAccess()) {
+			glCreateVertexArrays(1, &name);
+		}
+		else {
+			glGenVertexArrays(1, &name);
+		}
+		return name;
+	}
+	static void destroy(GLuint name) { glDeleteVertexArrays(1, &name); }
+};
+
+typedef GLHandle<GLFramebufferTraits> GLFramebuffer;
+typedef GLHandle<GLRenderbufferTraits> GLRenderbuffer;
+typedef GLHandle<GLTextureTraits> GLTexture;
+typedef GLHandle<GLBufferTraits> GLBuffer;
+typedef GLHandle<GLVertexArrayTraits> GLVertexArray;
+
+#endif
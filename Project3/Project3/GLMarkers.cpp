@@ -0,0 +1,85 @@
+#include "GLMarkers.h"
+
+#include <cstdio>
+
+GLMarkers::GLMarkers() : on(false), maxLength(0), depth(0)
+{
+}
+
+#ifdef CAVE_GL_MARKERS
+
+bool GLMarkers::enable(bool wanted)
+{
+	on = wanted && GLEW_KHR_debug;
+	if (!on) {
+		return false;
+	}
+	glGetIntegerv(GL_MAX_LABEL_LENGTH, &maxLength);
+	// Every push and pop is a notification otherwise, gl.debug "all" would log them all
+	glDebugMessageControl(GL_DEBUG_SOURCE_APPLICATION, GL_DEBUG_TYPE_PUSH_GROUP, GL_DONT_CARE, 0, nullptr, GL_FALSE);
+	glDebugMessageControl(GL_DEBUG_SOURCE_APPLICATION, GL_DEBUG_TYPE_POP_GROUP, GL_DONT_CARE, 0, nullptr, GL_FALSE);
+	return true;
+}
+
+void GLMarkers::setLabel(GLenum identifier, GLuint name, const std::string& text)
+{
+	// A framebuffer that was only generated does not exist until it is first bound
+	if (identifier == GL_FRAMEBUFFER && !glIsFramebuffer(name)) {
+		GLint draw = 0;
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, name);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, (GLuint)draw);
+	}
+	GLsizei length = (GLsizei)text.size();
+	if (maxLength > 0 && length >= maxLength) {
+		length = maxLength - 1;
+	}
+	glObjectLabel(identifier, name, length, text.c_str());
+}
+
+void GLMarkers::push(const char* name, int index)
+{
+	if (!on) {
+		return;
+	}
+	// Past the stack every driver allows the groups are only counted, so the pops still match
+	if (depth++ >= MAX_DEPTH) {
+		return;
+	}
+	if (index < 0) {
+		glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
+		return;
+	}
+	char text[128];
+	snprintf(text, sizeof(text), "%s %d", name, index);
+	glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, (GLuint)index, -1, text);
+}
+
+void GLMarkers::pop()
+{
+	if (!on || depth == 0) {
+		return;
+	}
+	if (--depth < MAX_DEPTH) {
+		glPopDebugGroup();
+	}
+}
+
+#else
+
+bool GLMarkers::enable(bool)
+{
+	return false;
+}
+
+void GLMarkers::setLabel(GLenum, GLuint, const std::string&)
+{
+}
+
+#endif
+
+GLMarkers& glMarkers()
+{
+	static GLMarkers instance;
+	return instance;
+}
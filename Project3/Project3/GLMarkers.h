@@ -0,0 +1,91 @@
+#ifndef _GL_MARKERS_H_
+#define _GL_MARKERS_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include <string>
+
+// KHR_debug names for frame debuggers and GPU profilers (RenderDoc, Nsight): debug groups
+// around the passes and labels on the textures, framebuffers, buffers and programs, so a
+// capture reads "wall left front" and "eye target" instead of draws of the same cube.
+//
+// Built with CAVE_GL_MARKERS and then switched on with gl.markers. Without it every call
+// here is an empty inline function and enabled() is constant false, so the markers compile
+// away, names and all, at the call sites that test it.
+class GLMarkers
+{
+public:
+	// GL_MAX_DEBUG_GROUP_STACK_DEPTH is at least this
+	enum { MAX_DEPTH = 64 };
+
+	GLMarkers();
+
+	GLMarkers(const GLMarkers&) = delete;
+	GLMarkers& operator=(const GLMarkers&) = delete;
+
+	//! After glewInit, on the render thread. Keeps the groups out of GLDebugLog.
+	// @return Whether markers are on, false without CAVE_GL_MARKERS or KHR_debug
+	bool enable(bool on);
+
+#ifdef CAVE_GL_MARKERS
+	bool enabled() const { return on; }
+	// identifier is GL_TEXTURE, GL_FRAMEBUFFER, GL_BUFFER, GL_PROGRAM, ... Textures and
+	// buffers have to have been bound once, framebuffers are bound here if they were not
+	void label(GLenum identifier, GLuint name, const std::string& text)
+	{
+		if (on && name) {
+			setLabel(identifier, name, text);
+		}
+	}
+	// A group named name, or "name index" with an index of 0 or more
+	void push(const char* name, int index = -1);
+	void pop();
+#else
+	bool enabled() const { return false; }
+	void label(GLenum, GLuint, const std::string&) {}
+	void push(const char*, int = -1) {}
+	void pop() {}
+#endif
+
+private:
+	void setLabel(GLenum identifier, GLuint name, const std::string& text);
+
+	bool on;
+	GLint maxLength;
+	int depth;
+};
+
+GLMarkers& glMarkers();
+
+// A debug group from construction to destruction, nothing while markers are off. A null
+// name makes no group either.
+class GpuGroup
+{
+public:
+	explicit GpuGroup(const char* name, int index = -1) : pushed(name != nullptr && glMarkers().enabled())
+	{
+		if (pushed) {
+			glMarkers().push(name, index);
+		}
+	}
+	~GpuGroup()
+	{
+		if (pushed) {
+			glMarkers().pop();
+		}
+	}
+
+	GpuGroup(const GpuGroup&) = delete;
+	GpuGroup& operator=(const GpuGroup&) = delete;
+
+private:
+	bool pushed;
+};
+
+#endif
@@ -0,0 +1,108 @@
+#include "GLState.h"
+
+GLState::GLState() : issuedCalls(0), savedCalls(0)
+{
+	invalidate();
+}
+
+void GLState::useProgram(GLuint id)
+{
+	if (changes(programKnown, program == id)) {
+		glUseProgram(id);
+		program = id;
+		programKnown = true;
+	}
+}
+
+void GLState::bindVertexArray(GLuint id)
+{
+	if (changes(vaoKnown, vao == id)) {
+		glBindVertexArray(id);
+		vao = id;
+		vaoKnown = true;
+	}
+}
+
+void GLState::bindTexture(GLuint unit, GLenum target, GLuint texture)
+{
+	if (changes(activeUnitKnown, activeUnit == unit)) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+		activeUnit = unit;
+		activeUnitKnown = true;
+	}
+
+	int slot = targetSlot(target);
+	if (unit >= TEXTURE_UNITS || slot == TARGET_OTHER) {
+		// Not tracked, always bound
+		changes(false, false);
+		glBindTexture(target, texture);
+		return;
+	}
+	if (changes(textureKnown[unit][slot], textures[unit][slot] == texture)) {
+		glBindTexture(target, texture);
+		textures[unit][slot] = texture;
+		textureKnown[unit][slot] = true;
+	}
+}
+
+void GLState::polygonMode(GLenum polygonMode)
+{
+	if (changes(polygonModeKnown, mode == polygonMode)) {
+		glPolygonMode(GL_FRONT_AND_BACK, polygonMode);
+		mode = polygonMode;
+		polygonModeKnown = true;
+	}
+}
+
+void GLState::depthMask(bool enabled)
+{
+	if (changes(depthMaskKnown, depthWrites == enabled)) {
+		glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+		depthWrites = enabled;
+		depthMaskKnown = true;
+	}
+}
+
+void GLState::invalidate()
+{
+	programKnown = vaoKnown = activeUnitKnown = polygonModeKnown = depthMaskKnown = false;
+	program = vao = activeUnit = 0;
+	mode = GL_FILL;
+	depthWrites = true;
+	for (int unit = 0; unit < TEXTURE_UNITS; unit++) {
+		for (int slot = 0; slot < TARGETS; slot++) {
+			textureKnown[unit][slot] = false;
+			textures[unit][slot] = 0;
+		}
+	}
+}
+
+int GLState::targetSlot(GLenum target)
+{
+	switch (target) {
+	case GL_TEXTURE_2D:
+		return TARGET_2D;
+	case GL_TEXTURE_2D_ARRAY:
+		return TARGET_2D_ARRAY;
+	case GL_TEXTURE_CUBE_MAP:
+		return TARGET_CUBE_MAP;
+	default:
+		return TARGET_OTHER;
+	}
+}
+
+bool GLState::changes(bool known, bool same)
+{
+	if (known && same) {
+		savedCalls++;
+		return false;
+	}
+	issuedCalls++;
+	return true;
+}
+
+GLState& glState()
+{
+	static GLState state;
+	return state;
+}
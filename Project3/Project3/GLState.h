@@ -0,0 +1,63 @@
+#ifndef _GL_STATE_H_
+#define _GL_STATE_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+// What the draws last set of the bound program, vertex array, texture bindings, polygon
+// mode and depth mask, so setting it again is skipped instead of reaching the driver. Draws
+// set what they need and leave it bound instead of unbinding after themselves.
+//
+// Anything that changes this state behind the tracker's back makes it stale, so it is
+// invalidated once per scene pass (after texture uploads) and checks the GL again then.
+class GLState
+{
+public:
+	enum { TEXTURE_UNITS = 8 };
+
+	GLState();
+
+	void useProgram(GLuint program);
+	void bindVertexArray(GLuint vao);
+	// Binds texture to target on unit, leaving unit active
+	void bindTexture(GLuint unit, GLenum target, GLuint texture);
+	void polygonMode(GLenum mode);
+	void depthMask(bool enabled);
+
+	// Forgets everything, the next call of each kind goes to the GL
+	void invalidate();
+
+	// Calls made and calls skipped since the last resetCounters()
+	unsigned long long issued() const { return issuedCalls; }
+	unsigned long long saved() const { return savedCalls; }
+	void resetCounters() { issuedCalls = savedCalls = 0; }
+
+private:
+	enum { TARGET_2D, TARGET_2D_ARRAY, TARGET_CUBE_MAP, TARGET_OTHER, TARGETS };
+
+	static int targetSlot(GLenum target);
+	// Counts the call and returns whether it has to be made
+	bool changes(bool known, bool same);
+
+	bool programKnown, vaoKnown, activeUnitKnown, polygonModeKnown, depthMaskKnown;
+	GLuint program;
+	GLuint vao;
+	GLuint activeUnit;
+	GLenum mode;
+	bool depthWrites;
+	bool textureKnown[TEXTURE_UNITS][TARGETS];
+	GLuint textures[TEXTURE_UNITS][TARGETS];
+
+	unsigned long long issuedCalls;
+	unsigned long long savedCalls;
+};
+
+// The tracker of the GL context everything draws into
+GLState& glState();
+
+#endif
@@ -0,0 +1,214 @@
+#include "GLStats.h"
+
+#include "CpuProfiler.h"
+
+#include <cstring>
+
+// Takes a running count for the frame's counts and starts it over
+template <typename T>
+static T take(std::atomic<T>& counter)
+{
+	return counter.exchange(0, std::memory_order_relaxed);
+}
+
+GLStats::GLStats() : wrapped(false)
+{
+	memset(&last, 0, sizeof(last));
+	current.draws = 0;
+	current.stateChanges = 0;
+	current.uniforms = 0;
+	current.uniformLookups = 0;
+	current.framebufferBinds = 0;
+	current.attachments = 0;
+	current.creations = 0;
+	current.uploadBytes = 0;
+}
+
+#ifdef CAVE_GL_STATS
+
+// Each wrapper counts and calls the function GLEW loaded, kept in real_<name>
+#define GL_STATS_WRAP(name, proc, counter, params, args) \
+	static proc real_##name = nullptr; \
+	static void GLAPIENTRY count_##name params { glStats().current.counter.fetch_add(1, std::memory_order_relaxed); real_##name args; }
+
+GL_STATS_WRAP(DrawElementsBaseVertex, PFNGLDRAWELEMENTSBASEVERTEXPROC, draws,
+	(GLenum mode, GLsizei count, GLenum type, const GLvoid* indices, GLint basevertex), (mode, count, type, indices, basevertex))
+GL_STATS_WRAP(DrawElementsInstancedBaseVertex, PFNGLDRAWELEMENTSINSTANCEDBASEVERTEXPROC, draws,
+	(GLenum mode, GLsizei count, GLenum type, const GLvoid* indices, GLsizei primcount, GLint basevertex),
+	(mode, count, type, indices, primcount, basevertex))
+GL_STATS_WRAP(DrawElementsInstanced, PFNGLDRAWELEMENTSINSTANCEDPROC, draws,
+	(GLenum mode, GLsizei count, GLenum type, const GLvoid* indices, GLsizei primcount), (mode, count, type, indices, primcount))
+GL_STATS_WRAP(DrawArraysInstanced, PFNGLDRAWARRAYSINSTANCEDPROC, draws,
+	(GLenum mode, GLint first, GLsizei count, GLsizei primcount), (mode, first, count, primcount))
+GL_STATS_WRAP(MultiDrawArrays, PFNGLMULTIDRAWARRAYSPROC, draws,
+	(GLenum mode, const GLint* first, const GLsizei* count, GLsizei drawcount), (mode, first, count, drawcount))
+GL_STATS_WRAP(MultiDrawElementsIndirect, PFNGLMULTIDRAWELEMENTSINDIRECTPROC, draws,
+	(GLenum mode, GLenum type, const GLvoid* indirect, GLsizei primcount, GLsizei stride), (mode, type, indirect, primcount, stride))
+
+GL_STATS_WRAP(UseProgram, PFNGLUSEPROGRAMPROC, stateChanges, (GLuint program), (program))
+GL_STATS_WRAP(BindVertexArray, PFNGLBINDVERTEXARRAYPROC, stateChanges, (GLuint array), (array))
+GL_STATS_WRAP(ActiveTexture, PFNGLACTIVETEXTUREPROC, stateChanges, (GLenum texture), (texture))
+GL_STATS_WRAP(BindBuffer, PFNGLBINDBUFFERPROC, stateChanges, (GLenum target, GLuint buffer), (target, buffer))
+GL_STATS_WRAP(BindBufferBase, PFNGLBINDBUFFERBASEPROC, stateChanges, (GLenum target, GLuint index, GLuint buffer), (target, index, buffer))
+
+GL_STATS_WRAP(Uniform1i, PFNGLUNIFORM1IPROC, uniforms, (GLint location, GLint v0), (location, v0))
+GL_STATS_WRAP(Uniform1f, PFNGLUNIFORM1FPROC, uniforms, (GLint location, GLfloat v0), (location, v0))
+GL_STATS_WRAP(Uniform1iv, PFNGLUNIFORM1IVPROC, uniforms, (GLint location, GLsizei count, const GLint* value), (location, count, value))
+GL_STATS_WRAP(Uniform2fv, PFNGLUNIFORM2FVPROC, uniforms, (GLint location, GLsizei count, const GLfloat* value), (location, count, value))
+GL_STATS_WRAP(Uniform3fv, PFNGLUNIFORM3FVPROC, uniforms, (GLint location, GLsizei count, const GLfloat* value), (location, count, value))
+GL_STATS_WRAP(UniformMatrix3fv, PFNGLUNIFORMMATRIX3FVPROC, uniforms,
+	(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value), (location, count, transpose, value))
+GL_STATS_WRAP(UniformMatrix4fv, PFNGLUNIFORMMATRIX4FVPROC, uniforms,
+	(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value), (location, count, transpose, value))
+GL_STATS_WRAP(UniformHandleui64ARB, PFNGLUNIFORMHANDLEUI64ARBPROC, uniforms, (GLint location, GLuint64 value), (location, value))
+
+GL_STATS_WRAP(BindFramebuffer, PFNGLBINDFRAMEBUFFERPROC, framebufferBinds, (GLenum target, GLuint framebuffer), (target, framebuffer))
+GL_STATS_WRAP(FramebufferTexture2D, PFNGLFRAMEBUFFERTEXTURE2DPROC, attachments,
+	(GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level), (target, attachment, textarget, texture, level))
+GL_STATS_WRAP(FramebufferTextureLayer, PFNGLFRAMEBUFFERTEXTURELAYERPROC, attachments,
+	(GLenum target, GLenum attachment, GLuint texture, GLint level, GLint layer), (target, attachment, texture, level, layer))
+GL_STATS_WRAP(FramebufferTexture, PFNGLFRAMEBUFFERTEXTUREPROC, attachments,
+	(GLenum target, GLenum attachment, GLuint texture, GLint level), (target, attachment, texture, level))
+GL_STATS_WRAP(FramebufferRenderbuffer, PFNGLFRAMEBUFFERRENDERBUFFERPROC, attachments,
+	(GLenum target, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer), (target, attachment, renderbuffertarget, renderbuffer))
+
+GL_STATS_WRAP(GenBuffers, PFNGLGENBUFFERSPROC, creations, (GLsizei n, GLuint* buffers), (n, buffers))
+GL_STATS_WRAP(GenVertexArrays, PFNGLGENVERTEXARRAYSPROC, creations, (GLsizei n, GLuint* arrays), (n, arrays))
+GL_STATS_WRAP(GenFramebuffers, PFNGLGENFRAMEBUFFERSPROC, creations, (GLsizei n, GLuint* framebuffers), (n, framebuffers))
+GL_STATS_WRAP(GenRenderbuffers, PFNGLGENRENDERBUFFERSPROC, creations, (GLsizei n, GLuint* renderbuffers), (n, renderbuffers))
+GL_STATS_WRAP(TexStorage2D, PFNGLTEXSTORAGE2DPROC, creations,
+	(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height), (target, levels, internalformat, width, height))
+GL_STATS_WRAP(TexStorage3D, PFNGLTEXSTORAGE3DPROC, creations,
+	(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height, GLsizei depth),
+	(target, levels, internalformat, width, height, depth))
+
+static PFNGLGETUNIFORMLOCATIONPROC real_GetUniformLocation = nullptr;
+static GLint GLAPIENTRY count_GetUniformLocation(GLuint program, const GLchar* name)
+{
+	glStats().current.uniformLookups.fetch_add(1, std::memory_order_relaxed);
+	return real_GetUniformLocation(program, name);
+}
+
+// The uploads count their bytes instead of their calls
+static PFNGLBUFFERDATAPROC real_BufferData = nullptr;
+static void GLAPIENTRY count_BufferData(GLenum target, GLsizeiptr size, const GLvoid* data, GLenum usage)
+{
+	if (data) {
+		glStats().addUpload((uint64_t)size);
+	}
+	real_BufferData(target, size, data, usage);
+}
+
+static PFNGLBUFFERSUBDATAPROC real_BufferSubData = nullptr;
+static void GLAPIENTRY count_BufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid* data)
+{
+	glStats().addUpload((uint64_t)size);
+	real_BufferSubData(target, offset, size, data);
+}
+
+static PFNGLBUFFERSTORAGEPROC real_BufferStorage = nullptr;
+static void GLAPIENTRY count_BufferStorage(GLenum target, GLsizeiptr size, const GLvoid* data, GLbitfield flags)
+{
+	if (data) {
+		glStats().addUpload((uint64_t)size);
+	}
+	real_BufferStorage(target, size, data, flags);
+}
+
+static PFNGLCOMPRESSEDTEXSUBIMAGE2DPROC real_CompressedTexSubImage2D = nullptr;
+static void GLAPIENTRY count_CompressedTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset,
+	GLsizei width, GLsizei height, GLenum format, GLsizei imageSize, const GLvoid* data)
+{
+	glStats().addUpload((uint64_t)imageSize);
+	real_CompressedTexSubImage2D(target, level, xoffset, yoffset, width, height, format, imageSize, data);
+}
+
+// Swaps GLEW's pointer for the wrapper, functions the context does not have stay null
+#define GL_STATS_INSTALL(name) \
+	if (__glew##name && __glew##name != count_##name) { \
+		real_##name = __glew##name; \
+		__glew##name = count_##name; \
+	}
+
+bool GLStats::install()
+{
+	if (wrapped) {
+		return true;
+	}
+	GL_STATS_INSTALL(DrawElementsBaseVertex)
+	GL_STATS_INSTALL(DrawElementsInstancedBaseVertex)
+	GL_STATS_INSTALL(DrawElementsInstanced)
+	GL_STATS_INSTALL(DrawArraysInstanced)
+	GL_STATS_INSTALL(MultiDrawArrays)
+	GL_STATS_INSTALL(MultiDrawElementsIndirect)
+	GL_STATS_INSTALL(UseProgram)
+	GL_STATS_INSTALL(BindVertexArray)
+	GL_STATS_INSTALL(ActiveTexture)
+	GL_STATS_INSTALL(BindBuffer)
+	GL_STATS_INSTALL(BindBufferBase)
+	GL_STATS_INSTALL(Uniform1i)
+	GL_STATS_INSTALL(Uniform1f)
+	GL_STATS_INSTALL(Uniform1iv)
+	GL_STATS_INSTALL(Uniform2fv)
+	GL_STATS_INSTALL(Uniform3fv)
+	GL_STATS_INSTALL(UniformMatrix3fv)
+	GL_STATS_INSTALL(UniformMatrix4fv)
+	GL_STATS_INSTALL(UniformHandleui64ARB)
+	GL_STATS_INSTALL(GetUniformLocation)
+	GL_STATS_INSTALL(BindFramebuffer)
+	GL_STATS_INSTALL(FramebufferTexture2D)
+	GL_STATS_INSTALL(FramebufferTextureLayer)
+	GL_STATS_INSTALL(FramebufferTexture)
+	GL_STATS_INSTALL(FramebufferRenderbuffer)
+	GL_STATS_INSTALL(GenBuffers)
+	GL_STATS_INSTALL(GenVertexArrays)
+	GL_STATS_INSTALL(GenFramebuffers)
+	GL_STATS_INSTALL(GenRenderbuffers)
+	GL_STATS_INSTALL(TexStorage2D)
+	GL_STATS_INSTALL(TexStorage3D)
+	GL_STATS_INSTALL(BufferData)
+	GL_STATS_INSTALL(BufferSubData)
+	GL_STATS_INSTALL(BufferStorage)
+	GL_STATS_INSTALL(CompressedTexSubImage2D)
+	wrapped = true;
+	return true;
+}
+
+#else
+
+bool GLStats::install()
+{
+	return false;
+}
+
+#endif
+
+void GLStats::endFrame()
+{
+	last.draws = take(current.draws);
+	last.stateChanges = take(current.stateChanges);
+	last.uniforms = take(current.uniforms);
+	last.uniformLookups = take(current.uniformLookups);
+	last.framebufferBinds = take(current.framebufferBinds);
+	last.attachments = take(current.attachments);
+	last.creations = take(current.creations);
+	last.uploadBytes = take(current.uploadBytes);
+
+	CpuProfiler& profiler = cpuProfiler();
+	if (profiler.enabled()) {
+		profiler.counter("gl draws", (int)last.draws);
+		profiler.counter("gl state changes", (int)last.stateChanges);
+		profiler.counter("gl uniforms", (int)last.uniforms);
+		profiler.counter("gl uniform lookups", (int)last.uniformLookups);
+		profiler.counter("gl framebuffer binds", (int)last.framebufferBinds);
+		profiler.counter("gl attachments", (int)last.attachments);
+		profiler.counter("gl creations", (int)last.creations);
+		profiler.counter("gl upload KB", (int)(last.uploadBytes / 1024));
+	}
+}
+
+GLStats& glStats()
+{
+	static GLStats instance;
+	return instance;
+}
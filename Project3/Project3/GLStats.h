@@ -0,0 +1,80 @@
+#ifndef _GL_STATS_H_
+#define _GL_STATS_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include <atomic>
+#include <cstdint>
+
+// GL calls per frame, by kind. Built with CAVE_GL_STATS, install() puts counting wrappers
+// in place of GLEW's function pointers, so every call through GLEW is counted without the
+// callers knowing. Without it nothing is wrapped and only the explicit counts below add up.
+//
+// The GL 1.1 entry points (glDrawElements, glBindTexture, glTexSubImage2D, ...) come
+// straight from opengl32 and cannot be wrapped. Their draws and uploads are counted where
+// they are made, GLState already counts its texture binds.
+//
+// The upload thread's context goes through the same wrappers, and its uploads count in the
+// frame they are made during, so the running counts are atomic.
+struct GLCallCounts
+{
+	uint32_t draws;
+	// Programs, vertex arrays, active texture units and buffer bindings
+	uint32_t stateChanges;
+	uint32_t uniforms;
+	uint32_t uniformLookups;
+	uint32_t framebufferBinds;
+	uint32_t attachments;
+	// Buffers, vertex arrays, framebuffers, renderbuffers and texture storage
+	uint32_t creations;
+	uint64_t uploadBytes;
+};
+
+class GLStats
+{
+public:
+	GLStats();
+
+	// Wraps GLEW's functions, after glewInit. Returns false without CAVE_GL_STATS.
+	bool install();
+	bool installed() const { return wrapped; }
+
+	// The frame's counts become lastFrame() and counting starts over. With the CPU profiler
+	// on they also go to the trace, as counters.
+	void endFrame();
+	const GLCallCounts& lastFrame() const { return last; }
+
+	// For the calls that cannot be wrapped. From any thread.
+	void addDraw() { current.draws.fetch_add(1, std::memory_order_relaxed); }
+	void addUpload(uint64_t bytes) { current.uploadBytes.fetch_add(bytes, std::memory_order_relaxed); }
+	void addCreation() { current.creations.fetch_add(1, std::memory_order_relaxed); }
+
+	// GLCallCounts as it is counted, from any thread
+	struct Counters
+	{
+		std::atomic<uint32_t> draws;
+		std::atomic<uint32_t> stateChanges;
+		std::atomic<uint32_t> uniforms;
+		std::atomic<uint32_t> uniformLookups;
+		std::atomic<uint32_t> framebufferBinds;
+		std::atomic<uint32_t> attachments;
+		std::atomic<uint32_t> creations;
+		std::atomic<uint64_t> uploadBytes;
+	};
+	Counters current;
+
+private:
+	GLCallCounts last;
+	bool wrapped;
+};
+
+// The counts of the GL context everything draws into
+GLStats& glStats();
+
+#endif
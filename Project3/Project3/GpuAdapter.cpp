@@ -0,0 +1,192 @@
+#include "GpuAdapter.h"
+#include "GLExtensions.h"
+#include "Log.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <dxgi.h>
+
+// Read by the NVIDIA and AMD drivers from the executable's exports when it starts, both ask
+// for the high performance GPU of a hybrid machine. They have to be in the .exe itself.
+extern "C" {
+	__declspec(dllexport) DWORD NvOptimusEnablement = 1;
+	__declspec(dllexport) int AmdPowerXpressRequestHighPerformance = 1;
+}
+#endif
+
+#include <cctype>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// The DXGI adapters and their LUIDs, empty without DXGI
+static void listAdapters(std::vector<GpuAdapter::Info>& infos, std::vector<uint64_t>& luids)
+{
+	infos.clear();
+	luids.clear();
+#ifdef _WIN32
+	IDXGIFactory1* factory = nullptr;
+	if (FAILED(CreateDXGIFactory1(__uuidof(IDXGIFactory1), (void**)&factory))) {
+		return;
+	}
+	IDXGIAdapter1* adapter = nullptr;
+	for (UINT i = 0; factory->EnumAdapters1(i, &adapter) != DXGI_ERROR_NOT_FOUND; i++) {
+		DXGI_ADAPTER_DESC1 desc;
+		if (SUCCEEDED(adapter->GetDesc1(&desc)) && !(desc.Flags & DXGI_ADAPTER_FLAG_SOFTWARE)) {
+			GpuAdapter::Info info;
+			info.vendorId = desc.VendorId;
+			char name[128];
+			WideCharToMultiByte(CP_UTF8, 0, desc.Description, -1, name, sizeof(name), nullptr, nullptr);
+			info.description = name;
+			info.dedicatedMemory = desc.DedicatedVideoMemory;
+			infos.push_back(info);
+			uint64_t luid;
+			memcpy(&luid, &desc.AdapterLuid, sizeof(luid));
+			luids.push_back(luid);
+		}
+		adapter->Release();
+	}
+	factory->Release();
+#endif
+}
+
+bool GpuAdapter::find(const uint8_t luid[LUID_SIZE], Info& out)
+{
+	std::vector<Info> infos;
+	std::vector<uint64_t> luids;
+	listAdapters(infos, luids);
+	uint64_t wanted;
+	memcpy(&wanted, luid, sizeof(wanted));
+	for (size_t i = 0; i < luids.size(); i++) {
+		if (luids[i] == wanted) {
+			out = infos[i];
+			return true;
+		}
+	}
+	return false;
+}
+
+uint32_t GpuAdapter::vendorOf(const char* glVendor)
+{
+	std::string vendor = glVendor ? glVendor : "";
+	for (char& c : vendor) {
+		c = (char)tolower((unsigned char)c);
+	}
+	if (vendor.find("nvidia") != std::string::npos) {
+		return 0x10DE;
+	}
+	if (vendor.find("ati ") == 0 || vendor.find("amd") != std::string::npos || vendor.find("advanced micro") != std::string::npos) {
+		return 0x1002;
+	}
+	if (vendor.find("intel") != std::string::npos) {
+		return 0x8086;
+	}
+	return 0;
+}
+
+const char* GpuAdapter::vendorName(uint32_t vendorId)
+{
+	switch (vendorId) {
+	case 0x10DE: return "NVIDIA";
+	case 0x1002: return "AMD";
+	case 0x8086: return "Intel";
+	default: return "unknown vendor";
+	}
+}
+
+// GL_RENDERER up to the bus and instruction set NVIDIA appends ("GeForce GTX 1080/PCIe/SSE2"),
+// without the vendor's name, lower case, for looking for in a DXGI description
+static std::string rendererName(const char* renderer)
+{
+	std::string name = renderer ? renderer : "";
+	name = name.substr(0, name.find('/'));
+	for (char& c : name) {
+		c = (char)tolower((unsigned char)c);
+	}
+	for (const char* prefix : { "nvidia ", "amd ", "ati ", "intel(r) ", "intel " }) {
+		if (name.compare(0, strlen(prefix), prefix) == 0) {
+			name = name.substr(strlen(prefix));
+		}
+	}
+	while (!name.empty() && isspace((unsigned char)name.back())) {
+		name.pop_back();
+	}
+	return name;
+}
+
+static bool describes(const GpuAdapter::Info& info, const std::string& renderer)
+{
+	std::string description = info.description;
+	for (char& c : description) {
+		c = (char)tolower((unsigned char)c);
+	}
+	return !renderer.empty() && description.find(renderer) != std::string::npos;
+}
+
+static void warn(const std::string& what, const std::string& hmd, const char* glRenderer)
+{
+	std::cerr << "********************************************************************" << std::endl;
+	std::cerr << "GPU ADAPTER MISMATCH: " << what << std::endl;
+	std::cerr << "  HMD adapter: " << hmd << std::endl;
+	std::cerr << "  GL context:  " << (glRenderer ? glRenderer : "?") << std::endl;
+	std::cerr << "  Every frame crosses to the HMD's GPU, or the swap chain is refused. Run on the HMD's GPU:" << std::endl;
+	std::cerr << "  the driver's OpenGL rendering GPU setting, Windows' graphics settings (high performance)," << std::endl;
+	std::cerr << "  or the desktop's main display on the HMD's GPU." << std::endl;
+	std::cerr << "********************************************************************" << std::endl;
+}
+
+GpuAdapter::Match GpuAdapter::check(const uint8_t luid[LUID_SIZE])
+{
+	const char* glVendor = (const char*)glGetString(GL_VENDOR);
+	const char* glRenderer = (const char*)glGetString(GL_RENDERER);
+	Info hmd;
+	bool known = find(luid, hmd);
+	std::string hmdName = known ? hmd.description : "not found through DXGI";
+
+	// The context's own LUID settles it
+	GLubyte contextLuid[GL_LUID_SIZE_EXT];
+	if (contextAdapterLuid(contextLuid)) {
+		if (memcmp(contextLuid, luid, LUID_SIZE) == 0) {
+			logStream(LOG_INFO) << "GL context on the HMD's adapter, " << (glRenderer ? glRenderer : "?") << std::endl;
+			return MATCH;
+		}
+		warn("the context's LUID is not the HMD's", hmdName, glRenderer);
+		return MISMATCH;
+	}
+	if (!known) {
+		std::cerr << "WARNING: could not tell whether the GL context (" << (glRenderer ? glRenderer : "?")
+			<< ") is on the HMD's adapter, the driver has no GL_EXT_memory_object_win32 and DXGI does not know the HMD's LUID" << std::endl;
+		return UNKNOWN;
+	}
+
+	// Otherwise by vendor, then by name among the adapters of that vendor
+	uint32_t contextVendor = vendorOf(glVendor);
+	if (contextVendor && contextVendor != hmd.vendorId) {
+		warn(std::string("the context is on ") + vendorName(contextVendor) + ", the HMD on " + vendorName(hmd.vendorId), hmdName, glRenderer);
+		return MISMATCH;
+	}
+	std::vector<Info> infos;
+	std::vector<uint64_t> luids;
+	listAdapters(infos, luids);
+	std::string renderer = rendererName(glRenderer);
+	int named = 0;
+	for (const Info& info : infos) {
+		named += describes(info, renderer) ? 1 : 0;
+	}
+	if (describes(hmd, renderer)) {
+		if (named == 1) {
+			logStream(LOG_INFO) << "GL context on the HMD's adapter, " << hmd.description << std::endl;
+			return MATCH;
+		}
+		std::cerr << "WARNING: " << named << " adapters are " << hmd.description
+			<< ", the driver does not say which one the GL context is on" << std::endl;
+		return UNKNOWN;
+	}
+	if (named > 0) {
+		warn("the context is on another adapter", hmdName, glRenderer);
+		return MISMATCH;
+	}
+	std::cerr << "WARNING: could not tell whether the GL context (" << (glRenderer ? glRenderer : "?")
+		<< ") is on the HMD's adapter (" << hmd.description << ")" << std::endl;
+	return UNKNOWN;
+}
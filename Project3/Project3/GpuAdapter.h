@@ -0,0 +1,49 @@
+#ifndef _GPU_ADAPTER_H_
+#define _GPU_ADAPTER_H_
+
+#include <cstdint>
+#include <string>
+
+// Which GPU the GL context ended up on, against the one the HMD is plugged into. ovr_Create
+// names the HMD's adapter by its LUID, GL has no say in where its context goes: on a hybrid
+// laptop or a workstation with two GPUs the driver may put it on the other one, and every
+// frame then crosses the bus to reach the compositor, or the swap chain is refused outright.
+//
+// The executable exports the NVIDIA Optimus and AMD PowerXpress hints (GpuAdapter.cpp),
+// which steer the context onto the discrete GPU, the HMD's on every such machine we have.
+// Where that is not enough, nothing GLFW makes can be pointed at an adapter, so check()
+// verifies the context once it is current and says loudly what it found:
+//
+//   GL_EXT_memory_object_win32  the context's own LUID, compared exactly
+//   DXGI                        the HMD adapter's vendor and name looked up by LUID and
+//                               compared with GL_VENDOR and GL_RENDERER
+//
+// Everything but the comparison is Windows only, elsewhere the check has nothing to go on.
+class GpuAdapter
+{
+public:
+	enum { LUID_SIZE = 8 };
+	enum Match { MATCH, MISMATCH, UNKNOWN };
+
+	struct Info
+	{
+		uint32_t vendorId;
+		std::string description;
+		uint64_t dedicatedMemory;
+	};
+
+	//! The DXGI adapter with this LUID, false if there is none or no DXGI
+	static bool find(const uint8_t luid[LUID_SIZE], Info& out);
+
+	//! Compares the current context's adapter with the one luid names and reports it, in the
+	// log at info level if they match, as a warning on std::cerr otherwise. Needs the context
+	// current and loadGLExtensions() done.
+	// @return MATCH, MISMATCH, or UNKNOWN if neither way could tell
+	static Match check(const uint8_t luid[LUID_SIZE]);
+
+	// PCI vendor ids of the adapters GL_VENDOR names, 0 for anyone else
+	static uint32_t vendorOf(const char* glVendor);
+	static const char* vendorName(uint32_t vendorId);
+};
+
+#endif
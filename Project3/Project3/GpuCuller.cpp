@@ -0,0 +1,320 @@
+#include "GpuCuller.h"
+#include "DrawList.h"
+#include "EntityStore.h"
+#include "GLState.h"
+#include "GpuMemory.h"
+#include "MeshPool.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+
+// Storage buffer bindings of gpuCull.comp
+enum { BOUNDS_BINDING, WORLDS_BINDING, CULLED_BINDING, COMMANDS_BINDING, TILES_BINDING, CULLED_TILES_BINDING,
+	OCCLUSION_LAYERS_BINDING, OCCLUDED_BINDING, OCCLUDED_COUNTS_BINDING, LATE_COMMANDS_BINDING };
+// The texture unit of the pyramids
+static const GLuint PYRAMID_UNIT = 0;
+
+GpuCuller::GpuCuller() : vao(0), depthVao(0), boundsBuffer(0), worldBuffer(0), culledBuffer(0), commandBuffer(0), tileBuffer(0),
+	culledTileBuffer(0), occludedBuffer(0), occludedCountBuffer(0), lateCommandBuffer(0), occlusionPyramid(0), occlusionLayers(0),
+	mesh(0), count(0), layers(0), uploaded(~0ull)
+{
+}
+
+GpuCuller::~GpuCuller()
+{
+	release();
+}
+
+bool GpuCuller::supported()
+{
+	return DrawList::supported() && GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object;
+}
+
+void GpuCuller::release()
+{
+	if (!vao) {
+		return;
+	}
+	glDeleteVertexArrays(1, &vao);
+	glDeleteVertexArrays(1, &depthVao);
+	for (GLuint* buffer : { &boundsBuffer, &worldBuffer, &culledBuffer, &commandBuffer, &tileBuffer, &culledTileBuffer, &occludedBuffer,
+		&occludedCountBuffer, &lateCommandBuffer }) {
+		if (!*buffer) {
+			continue;
+		}
+		gpuMemory().release(GpuMemory::KIND_BUFFER, *buffer);
+		glDeleteBuffers(1, buffer);
+		*buffer = 0;
+	}
+	vao = 0;
+	depthVao = 0;
+	occlusionPyramid = 0;
+	occlusionLayers = 0;
+}
+
+bool GpuCuller::init(int meshId, size_t instanceCount, int layerCount, bool tiles, bool occlusion)
+{
+	if (!supported()) {
+		std::cerr << "compute shaders not supported, culling on the CPU" << std::endl;
+		return false;
+	}
+	std::string defines = std::string(tiles ? "#define TILES\n" : "") + (occlusion ? "#define OCCLUSION\n" : "");
+	if (!instanceCount || layerCount < 1 || layerCount > MAX_LAYERS || !program.loadCompute("gpuCull.comp", defines) ||
+		(occlusion && !recheckProgram.loadCompute("gpuCull.comp", defines + "#define RECHECK\n"))) {
+		return false;
+	}
+	planesUniform = program.uniform("planes");
+	firstLayerUniform = program.uniform("firstLayer");
+	layerCountUniform = program.uniform("layerCount");
+	instanceCountUniform = program.uniform("instanceCount");
+	if (occlusion) {
+		recheckFirstLayer = recheckProgram.uniform("firstLayer");
+		recheckLayerCount = recheckProgram.uniform("layerCount");
+		recheckInstanceCount = recheckProgram.uniform("instanceCount");
+		for (const ShaderProgram* pass : { &program, &recheckProgram }) {
+			pass->use();
+			pass->setSampler("pyramid", PYRAMID_UNIT);
+		}
+		glState().useProgram(0);
+	}
+	mesh = meshId;
+	count = instanceCount;
+	layers = layerCount;
+	uploaded = ~0ull;
+	bounds.resize(count * 2);
+
+	glGenVertexArrays(1, &vao);
+	glGenBuffers(1, &boundsBuffer);
+	glGenBuffers(1, &worldBuffer);
+	glGenBuffers(1, &culledBuffer);
+	glGenBuffers(1, &commandBuffer);
+
+	GLsizeiptr boundsBytes = (GLsizeiptr)(count * 2 * sizeof(glm::vec4));
+	GLsizeiptr worldBytes = (GLsizeiptr)(count * sizeof(glm::mat4));
+	GLsizeiptr culledBytes = worldBytes * layers;
+	GLsizeiptr commandBytes = (GLsizeiptr)(layers * sizeof(DrawElementsIndirectCommand));
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, boundsBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, boundsBytes, nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, worldBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, worldBytes, nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, culledBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, culledBytes, nullptr, GL_DYNAMIC_COPY);
+	// A layer not culled yet draws nothing
+	std::vector<DrawElementsIndirectCommand> empty(layers, DrawElementsIndirectCommand());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, commandBytes, empty.data(), GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	gpuMemory().allocate(GpuMemory::KIND_BUFFER, boundsBuffer, boundsBytes, GpuMemory::STREAMING, "gpu cull bounds");
+	gpuMemory().allocate(GpuMemory::KIND_BUFFER, worldBuffer, worldBytes, GpuMemory::STREAMING, "gpu cull transforms");
+	gpuMemory().allocate(GpuMemory::KIND_BUFFER, culledBuffer, culledBytes, GpuMemory::STREAMING, "gpu cull visible transforms");
+	gpuMemory().allocate(GpuMemory::KIND_BUFFER, commandBuffer, commandBytes, GpuMemory::STREAMING, "gpu cull commands");
+	if (tiles) {
+		GLsizeiptr tileBytes = (GLsizeiptr)(count * sizeof(AtlasTile));
+		std::vector<AtlasTile> none(count, noAtlasTile());
+		glGenBuffers(1, &tileBuffer);
+		glGenBuffers(1, &culledTileBuffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, tileBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, tileBytes, none.data(), GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, culledTileBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, tileBytes * layers, nullptr, GL_DYNAMIC_COPY);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		gpuMemory().allocate(GpuMemory::KIND_BUFFER, tileBuffer, tileBytes, GpuMemory::STREAMING, "gpu cull tiles");
+		gpuMemory().allocate(GpuMemory::KIND_BUFFER, culledTileBuffer, tileBytes * layers, GpuMemory::STREAMING,
+			"gpu cull visible tiles");
+	}
+	if (occlusion) {
+		GLsizeiptr occludedBytes = (GLsizeiptr)(count * layers * sizeof(GLuint));
+		GLsizeiptr countBytes = (GLsizeiptr)(layers * sizeof(GLuint));
+		glGenBuffers(1, &occludedBuffer);
+		glGenBuffers(1, &occludedCountBuffer);
+		glGenBuffers(1, &lateCommandBuffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, occludedBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, occludedBytes, nullptr, GL_DYNAMIC_COPY);
+		std::vector<GLuint> zeros(layers, 0);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, occludedCountBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, countBytes, zeros.data(), GL_DYNAMIC_COPY);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, lateCommandBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, commandBytes, empty.data(), GL_DYNAMIC_COPY);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		gpuMemory().allocate(GpuMemory::KIND_BUFFER, occludedBuffer, occludedBytes, GpuMemory::STREAMING, "gpu cull occluded");
+		gpuMemory().allocate(GpuMemory::KIND_BUFFER, occludedCountBuffer, countBytes, GpuMemory::STREAMING, "gpu cull occluded counts");
+		gpuMemory().allocate(GpuMemory::KIND_BUFFER, lateCommandBuffer, commandBytes, GpuMemory::STREAMING, "gpu cull late commands");
+	}
+
+	// The pool's geometry plus the culled matrices, one column per location
+	glState().bindVertexArray(vao);
+	meshPool().setAttributes();
+	glBindBuffer(GL_ARRAY_BUFFER, culledBuffer);
+	for (GLuint column = 0; column < 4; column++) {
+		glEnableVertexAttribArray(5 + column);
+		glVertexAttribPointer(5 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (GLvoid*)(sizeof(glm::vec4) * column));
+		glVertexAttribDivisor(5 + column, 1);
+	}
+	// and their tiles, in the same slots
+	if (tiles) {
+		glBindBuffer(GL_ARRAY_BUFFER, culledTileBuffer);
+		glEnableVertexAttribArray(9);
+		glVertexAttribPointer(9, 4, GL_FLOAT, GL_FALSE, sizeof(AtlasTile), (GLvoid*)offsetof(AtlasTile, rect));
+		glVertexAttribDivisor(9, 1);
+		glEnableVertexAttribArray(10);
+		glVertexAttribPointer(10, 1, GL_FLOAT, GL_FALSE, sizeof(AtlasTile), (GLvoid*)offsetof(AtlasTile, layer));
+		glVertexAttribDivisor(10, 1);
+	}
+
+	glGenVertexArrays(1, &depthVao);
+	glState().bindVertexArray(depthVao);
+	meshPool().setPositionAttributes();
+	glBindBuffer(GL_ARRAY_BUFFER, culledBuffer);
+	for (GLuint column = 0; column < 4; column++) {
+		glEnableVertexAttribArray(5 + column);
+		glVertexAttribPointer(5 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (GLvoid*)(sizeof(glm::vec4) * column));
+		glVertexAttribDivisor(5 + column, 1);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glState().bindVertexArray(0);
+	return true;
+}
+
+void GpuCuller::update(const glm::mat4* worlds, const glm::vec3* boundsMin, const glm::vec3* boundsMax, uint64_t version)
+{
+	if (!vao || version == uploaded) {
+		return;
+	}
+	for (size_t i = 0; i < count; i++) {
+		bounds[i * 2] = glm::vec4(boundsMin[i], 0.f);
+		bounds[i * 2 + 1] = glm::vec4(boundsMax[i], 0.f);
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, boundsBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, (GLsizeiptr)(bounds.size() * sizeof(glm::vec4)), bounds.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, worldBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, (GLsizeiptr)(count * sizeof(glm::mat4)), worlds);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	uploaded = version;
+}
+
+void GpuCuller::updateTiles(const AtlasTile* tiles)
+{
+	if (!tileBuffer) {
+		return;
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, tileBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, (GLsizeiptr)(count * sizeof(AtlasTile)), tiles);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void GpuCuller::setOcclusion(GLuint pyramid, GLuint layerBuffer)
+{
+	occlusionPyramid = pyramid;
+	occlusionLayers = layerBuffer;
+}
+
+void GpuCuller::cull(const glm::mat4* viewProjections, int layerCount, int firstLayer)
+{
+	layerCount = std::min(layerCount, layers - firstLayer);
+	if (!vao) {
+		return;
+	}
+	for (int done = 0; done < layerCount; done += MAX_PASS_LAYERS) {
+		dispatch(viewProjections + done, std::min(layerCount - done, (int)MAX_PASS_LAYERS), firstLayer + done);
+	}
+}
+
+void GpuCuller::dispatch(const glm::mat4* viewProjections, int layerCount, int firstLayer)
+{
+	// The layers' commands start empty, the pass counts the instances into them
+	const MeshRange& range = meshPool().mesh(mesh);
+	DrawElementsIndirectCommand commands[MAX_PASS_LAYERS];
+	glm::vec4 planes[MAX_PASS_LAYERS * 6];
+	for (int i = 0; i < layerCount; i++) {
+		DrawElementsIndirectCommand& command = commands[i];
+		command.count = (GLuint)range.indexCount;
+		command.instanceCount = 0;
+		command.firstIndex = range.firstIndex;
+		command.baseVertex = range.baseVertex;
+		command.baseInstance = (GLuint)((firstLayer + i) * count);
+		EntityStore::clipPlanes(viewProjections[i], &planes[i * 6]);
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, (GLintptr)(firstLayer * sizeof(DrawElementsIndirectCommand)),
+		(GLsizeiptr)(layerCount * sizeof(DrawElementsIndirectCommand)), commands);
+	// and nothing occluded or found again yet, the recheck sets the late ones' baseInstance
+	if (occludedBuffer) {
+		const GLuint zeros[MAX_PASS_LAYERS] = {};
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, lateCommandBuffer);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, (GLintptr)(firstLayer * sizeof(DrawElementsIndirectCommand)),
+			(GLsizeiptr)(layerCount * sizeof(DrawElementsIndirectCommand)), commands);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, occludedCountBuffer);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, (GLintptr)(firstLayer * sizeof(GLuint)), (GLsizeiptr)(layerCount * sizeof(GLuint)), zeros);
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	program.use();
+	planesUniform.set(planes, layerCount * 6);
+	firstLayerUniform.set(firstLayer);
+	layerCountUniform.set(layerCount);
+	instanceCountUniform.set((int)count);
+	bindBuffers();
+	glDispatchCompute((GLuint)((count + GROUP_SIZE - 1) / GROUP_SIZE), 1, 1);
+	// The draws read the counts as commands and the matrices as vertex attributes, the
+	// recheck the occluded lists
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void GpuCuller::bindBuffers()
+{
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BOUNDS_BINDING, boundsBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, WORLDS_BINDING, worldBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULLED_BINDING, culledBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COMMANDS_BINDING, commandBuffer);
+	if (tileBuffer) {
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, TILES_BINDING, tileBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULLED_TILES_BINDING, culledTileBuffer);
+	}
+	if (occludedBuffer) {
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OCCLUSION_LAYERS_BINDING, occlusionLayers);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OCCLUDED_BINDING, occludedBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OCCLUDED_COUNTS_BINDING, occludedCountBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LATE_COMMANDS_BINDING, lateCommandBuffer);
+		glState().bindTexture(PYRAMID_UNIT, GL_TEXTURE_2D_ARRAY, occlusionPyramid);
+	}
+}
+
+void GpuCuller::recheck(int layerCount, int firstLayer)
+{
+	layerCount = std::min(layerCount, layers - firstLayer);
+	if (!vao || !occludedBuffer || !occlusionLayers || layerCount < 1) {
+		return;
+	}
+	recheckProgram.use();
+	recheckFirstLayer.set(firstLayer);
+	recheckLayerCount.set(layerCount);
+	recheckInstanceCount.set((int)count);
+	bindBuffers();
+	glDispatchCompute((GLuint)((count + GROUP_SIZE - 1) / GROUP_SIZE), 1, 1);
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
+
+void GpuCuller::draw(int layer, bool positionsOnly)
+{
+	if (!vao || layer < 0 || layer >= layers) {
+		return;
+	}
+	glState().bindVertexArray(positionsOnly ? depthVao : vao);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+		(const GLvoid*)(layer * sizeof(DrawElementsIndirectCommand)), 1, 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void GpuCuller::drawLate(int layer, bool positionsOnly)
+{
+	if (!vao || !lateCommandBuffer || layer < 0 || layer >= layers) {
+		return;
+	}
+	glState().bindVertexArray(positionsOnly ? depthVao : vao);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, lateCommandBuffer);
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+		(const GLvoid*)(layer * sizeof(DrawElementsIndirectCommand)), 1, 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
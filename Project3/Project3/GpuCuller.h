@@ -0,0 +1,122 @@
+#ifndef _GPU_CULLER_H_
+#define _GPU_CULLER_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "ShaderProgram.h"
+#include "TextureAtlas.h"
+
+// Culls a set of instances of one mesh pool mesh against the wall layers on the GPU and
+// draws what each layer can see, without the CPU looking at a single instance per frame.
+//
+// The instances' world matrices and world bounds live in storage buffers (uploaded again
+// only when they changed). A compute pass (gpuCull.comp) tests every instance against each
+// layer's frustum, the same conservative test as EntityStore::boxInside, and appends the
+// matrices of the ones inside to that layer's part of a culled matrix buffer, counting them
+// into the instanceCount of the layer's DrawElementsIndirectCommand. A layer's draw is then
+// one glMultiDrawElementsIndirect of its command, its baseInstance pointing the instanced
+// model attribute (5, as with DrawList) at the layer's matrices. A culler made with tiles
+// carries each instance's atlas tile along with its matrix, into attributes 9 and 10.
+//
+// Every layer has room for all instances, so the culled buffer is layers * count matrices.
+// Needs GL 4.3 compute shaders and storage buffers besides what DrawList needs.
+//
+// A culler made with occlusion also tests what is inside a layer's frustum against the
+// layer's depth pyramid (WallOcclusion, setOcclusion) and lists what it hides instead of
+// drawing it. Once the layer is rendered and its pyramid built again, recheck tests those
+// against the new one and drawLate draws the ones it does not hide, so a prop that came
+// out from behind something shows in the same frame.
+class GpuCuller
+{
+public:
+	// The compute pass takes the planes of MAX_PASS_LAYERS layers at a time
+	enum { MAX_LAYERS = 32, MAX_PASS_LAYERS = 16, GROUP_SIZE = 64 };
+
+	GpuCuller();
+	~GpuCuller();
+
+	GpuCuller(const GpuCuller&) = delete;
+	GpuCuller& operator=(const GpuCuller&) = delete;
+
+	static bool supported();
+	//! Buffers for count instances of the mesh over layers layers, with or without tiles.
+	bool init(int meshId, size_t count, int layers, bool tiles = false, bool occlusion = false);
+	bool valid() const { return vao != 0; }
+	// Deletes the vertex arrays and every buffer it culls through. The occlusion pyramid it was
+	// given is forgotten, not deleted, WallOcclusion owns it
+	void release();
+
+	//! Uploads the instances' matrices and bounds if version says they changed since the last
+	void update(const glm::mat4* worlds, const glm::vec3* boundsMin, const glm::vec3* boundsMax, uint64_t version);
+	//! Uploads the instances' tiles, for a culler with tiles
+	void updateTiles(const AtlasTile* tiles);
+
+	// The pyramids and their layers' storage buffer (WallOcclusion), for a culler with occlusion
+	void setOcclusion(GLuint pyramid, GLuint layerBuffer);
+
+	//! Culls every instance against layerCount layers from firstLayer, replacing what those
+	// layers had. Their draws after this see the result, nothing is read back.
+	void cull(const glm::mat4* viewProjections, int layerCount, int firstLayer);
+	//! Tests what the last cull of layerCount layers from firstLayer found occluded against
+	// their pyramids as they are now, for drawLate.
+	void recheck(int layerCount, int firstLayer);
+
+	//! Draws what the last cull kept for the layer, with the culler's vertex array. The
+	// program takes the model from attribute 5. positionsOnly leaves out everything but the
+	// positions and the model, for the depth pre-pass.
+	void draw(int layer, bool positionsOnly = false);
+	// What the layer's recheck found visible after all, as draw does
+	void drawLate(int layer, bool positionsOnly = false);
+
+private:
+	// The storage buffers and pyramids both passes read
+	void bindBuffers();
+
+	void dispatch(const glm::mat4* viewProjections, int layerCount, int firstLayer);
+
+	ShaderProgram program;
+	Uniform planesUniform;
+	Uniform firstLayerUniform;
+	Uniform layerCountUniform;
+	Uniform instanceCountUniform;
+	ShaderProgram recheckProgram;
+	Uniform recheckFirstLayer;
+	Uniform recheckLayerCount;
+	Uniform recheckInstanceCount;
+
+	GLuint vao;
+	GLuint depthVao;
+	GLuint boundsBuffer;
+	GLuint worldBuffer;
+	GLuint culledBuffer;
+	GLuint commandBuffer;
+	GLuint tileBuffer;
+	GLuint culledTileBuffer;
+	GLuint occludedBuffer;
+	GLuint occludedCountBuffer;
+	GLuint lateCommandBuffer;
+	GLuint occlusionPyramid;
+	GLuint occlusionLayers;
+
+	int mesh;
+	size_t count;
+	int layers;
+	uint64_t uploaded;
+	std::vector<glm::vec4> bounds;
+};
+
+#endif
@@ -0,0 +1,103 @@
+#include "GpuHandles.h"
+#include "BindlessTextures.h"
+
+#include <algorithm>
+
+GpuHandles::GpuHandles() : releasedCount(0), mostPending(0)
+{
+}
+
+void GpuHandles::retire(Kind kind, GLuint name)
+{
+	if (!name) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	released.push_back({ kind, name });
+	releasedCount++;
+}
+
+void GpuHandles::endFrame()
+{
+	collect(false);
+	Batch batch;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (released.empty()) {
+			return;
+		}
+		batch.objects.swap(released);
+	}
+	batch.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	pending.push_back(std::move(batch));
+	mostPending = std::max(mostPending, pending.size());
+}
+
+void GpuHandles::shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (const Retired& object : released) {
+			destroy(object);
+		}
+		released.clear();
+	}
+	collect(true);
+}
+
+void GpuHandles::collect(bool wait)
+{
+	while (!pending.empty()) {
+		Batch& batch = pending.front();
+		// Flushed on the first try, in case the frame that fenced it never got submitted
+		GLenum status = glClientWaitSync(batch.fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? 1000000000ull : 0);
+		while (wait && status == GL_TIMEOUT_EXPIRED) {
+			status = glClientWaitSync(batch.fence, 0, 1000000000ull);
+		}
+		if (status == GL_TIMEOUT_EXPIRED) {
+			return;
+		}
+		for (const Retired& object : batch.objects) {
+			destroy(object);
+		}
+		glDeleteSync(batch.fence);
+		pending.pop_front();
+	}
+}
+
+void GpuHandles::destroy(const Retired& object)
+{
+	switch (object.kind) {
+	case TEXTURE:
+		// Resident for bindless draws until now, the frames in flight may still sample it
+		bindlessTextures().forget(object.name);
+		glDeleteTextures(1, &object.name);
+		break;
+	case BUFFER:
+		glDeleteBuffers(1, &object.name);
+		break;
+	case PROGRAM:
+		glDeleteProgram(object.name);
+		break;
+	case RENDER_TARGET:
+		glDeleteFramebuffers(1, &object.name);
+		break;
+	default:
+		break;
+	}
+}
+
+void GpuHandles::report(std::ostream& out) const
+{
+	if (!releasedCount) {
+		return;
+	}
+	out << "gpu handles: " << releasedCount << " objects retired, deleted at most " << mostPending
+		<< " frames later" << std::endl;
+}
+
+GpuHandles& gpuHandles()
+{
+	static GpuHandles instance;
+	return instance;
+}
@@ -0,0 +1,72 @@
+#ifndef _GPU_HANDLES_H_
+#define _GPU_HANDLES_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+// A deferred deletion queue for GL objects. Every GLuint in the scene is looked up again
+// each frame (AssetRegistry::get, the shader programs), none is held past the frame it was
+// handed out in, but the GPU may still be drawing with an object for a frame or two after
+// the CPU has let go of it: evicted (AssetRegistry), remade by a reload (ShaderReloader) or
+// replaced. retire() queues it instead of deleting it, endFrame() fences what was retired
+// during the frame and deletes what earlier frames' fences have passed.
+class GpuHandles
+{
+public:
+	enum Kind { TEXTURE, BUFFER, PROGRAM, RENDER_TARGET, KINDS };
+
+	GpuHandles();
+
+	GpuHandles(const GpuHandles&) = delete;
+	GpuHandles& operator=(const GpuHandles&) = delete;
+
+	//! Deletes name after the frames in flight. From any thread.
+	void retire(Kind kind, GLuint name);
+
+	// On the GL thread once a frame is submitted: fences what it retired, and deletes what
+	// was retired before fences that have passed
+	void endFrame();
+	// Waits for the GPU and deletes everything retired. Needs the context, before it goes.
+	void shutdown();
+
+	void report(std::ostream& out) const;
+
+private:
+	struct Retired
+	{
+		Kind kind;
+		GLuint name;
+	};
+	struct Batch
+	{
+		GLsync fence;
+		std::vector<Retired> objects;
+	};
+
+	static void destroy(const Retired& object);
+	// Deletes the batches whose fences have passed, waiting for them all with wait
+	void collect(bool wait);
+
+	// Under the mutex: what was retired this frame
+	std::mutex mutex;
+	std::vector<Retired> released;
+	uint64_t releasedCount;
+	// GL thread only: the frames' retirements not deleted yet, oldest first
+	std::deque<Batch> pending;
+	size_t mostPending;
+};
+
+GpuHandles& gpuHandles();
+
+#endif
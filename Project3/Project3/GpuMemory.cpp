@@ -0,0 +1,133 @@
+#include "GpuMemory.h"
+#include "GLMarkers.h"
+
+#include <cstdio>
+#include <cstring>
+
+static const char* categoryNames[GpuMemory::CATEGORIES] = { "textures", "render targets", "meshes", "streaming" };
+
+GpuMemory::GpuMemory() : current(0), peak(0)
+{
+	memset(totals, 0, sizeof(totals));
+}
+
+void GpuMemory::allocate(Kind kind, GLuint name, uint64_t bytes, Category category, const std::string& label, bool persistent)
+{
+	if (!name) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		forget(kind, name);
+		Allocation allocation = { bytes, category, label, persistent };
+		allocations[std::make_pair((int)kind, name)] = allocation;
+		totals[category] += bytes;
+		current += bytes;
+		if (current > peak) {
+			peak = current;
+		}
+	}
+	// The same label names it in frame captures (GLMarkers.h)
+	if (glMarkers().enabled()) {
+		static const GLenum identifiers[] = { GL_TEXTURE, GL_RENDERBUFFER, GL_BUFFER };
+		glMarkers().label(identifiers[kind], name, label);
+	}
+}
+
+void GpuMemory::release(Kind kind, GLuint name)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	forget(kind, name);
+}
+
+void GpuMemory::forget(Kind kind, GLuint name)
+{
+	auto it = allocations.find(std::make_pair((int)kind, name));
+	if (it == allocations.end()) {
+		return;
+	}
+	totals[it->second.category] -= it->second.bytes;
+	current -= it->second.bytes;
+	allocations.erase(it);
+}
+
+void GpuMemory::report(std::ostream& out) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	char line[128];
+	out << "GPU memory" << std::endl;
+	for (int c = 0; c < CATEGORIES; c++) {
+		snprintf(line, sizeof(line), "%-16s %10.1f MB", categoryNames[c], totals[c] / (1024.0 * 1024.0));
+		out << line << std::endl;
+	}
+	snprintf(line, sizeof(line), "%-16s %10.1f MB, at most %.1f MB", "total", current / (1024.0 * 1024.0), peak / (1024.0 * 1024.0));
+	out << line << std::endl;
+}
+
+size_t GpuMemory::objectCount() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return allocations.size();
+}
+
+size_t GpuMemory::reportLeaks(std::ostream& out) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	// One line per label, a leak in a loop would otherwise print thousands
+	std::map<std::string, std::pair<size_t, uint64_t>> leaked;
+	for (const auto& entry : allocations) {
+		const Allocation& a = entry.second;
+		if (!a.persistent) {
+			std::pair<size_t, uint64_t>& l = leaked[a.label];
+			l.first++;
+			l.second += a.bytes;
+		}
+	}
+	size_t count = 0;
+	for (const auto& l : leaked) {
+		out << "GPU memory never freed: " << l.second.first << " x " << l.first << ", " << l.second.second / 1024 << " KB" << std::endl;
+		count += l.second.first;
+	}
+	return count;
+}
+
+GpuMemory& gpuMemory()
+{
+	static GpuMemory instance;
+	return instance;
+}
+
+static uint64_t texelBlockBytes(GLenum internalFormat, int w, int h)
+{
+	switch (internalFormat) {
+	case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+		// 8 bytes per 4x4 block
+		return (uint64_t)((w + 3) / 4) * ((h + 3) / 4) * 8;
+	case GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT_ARB:
+		// 16 bytes per 4x4 block
+		return (uint64_t)((w + 3) / 4) * ((h + 3) / 4) * 16;
+	case GL_DEPTH_COMPONENT16:
+		return (uint64_t)w * h * 2;
+	case GL_RGB8:
+	case GL_SRGB8:
+		return (uint64_t)w * h * 3;
+	case GL_RGBA16F:
+		return (uint64_t)w * h * 8;
+	default:
+		// RGBA8, SRGB8_ALPHA8, R11F_G11F_B10F, DEPTH_COMPONENT24 (padded to 32 bits) and
+		// DEPTH_COMPONENT32F
+		return (uint64_t)w * h * 4;
+	}
+}
+
+uint64_t textureBytes(GLenum internalFormat, int width, int height, int layers, int levels)
+{
+	uint64_t bytes = 0;
+	int w = width, h = height;
+	for (int level = 0; level < levels; level++) {
+		bytes += texelBlockBytes(internalFormat, w, h);
+		w = w > 1 ? w / 2 : 1;
+		h = h > 1 ? h / 2 : 1;
+	}
+	return bytes * (uint64_t)(layers > 0 ? layers : 1);
+}
@@ -0,0 +1,75 @@
+#ifndef _GPU_MEMORY_H_
+#define _GPU_MEMORY_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+
+// What the app has allocated on the GPU, by category: every texture, renderbuffer and buffer
+// is recorded where it is created with its size as the GL would lay it out (mips included,
+// no driver padding), and forgotten where it is deleted. Keeps the high-water mark of the
+// total. Used from the GL threads, the render thread and the upload thread (UploadThread).
+//
+// Compositor swap chains belong to the SDK and are not counted.
+class GpuMemory
+{
+public:
+	enum Category { TEXTURE, RENDER_TARGET, MESH, STREAMING, CATEGORIES };
+	// The GL object namespaces, textures and buffers may have the same name
+	enum Kind { KIND_TEXTURE, KIND_RENDERBUFFER, KIND_BUFFER };
+
+	GpuMemory();
+
+	//! Records an allocation, or its new size if the object is already recorded.
+	// @input label Says where it comes from in the leak report
+	// @input persistent For objects meant to live until the process ends, the leak report
+	// leaves them out
+	void allocate(Kind kind, GLuint name, uint64_t bytes, Category category, const std::string& label, bool persistent = false);
+	void release(Kind kind, GLuint name);
+
+	uint64_t total() const { return current; }
+	uint64_t highWater() const { return peak; }
+	uint64_t categoryTotal(Category category) const { return totals[category]; }
+	// How many objects are recorded, persistent ones included
+	size_t objectCount() const;
+
+	// Totals by category, the total and its high-water mark
+	void report(std::ostream& out) const;
+	// Warns about everything still allocated that is not persistent, returns how many
+	size_t reportLeaks(std::ostream& out) const;
+
+private:
+	void forget(Kind kind, GLuint name);
+
+	struct Allocation
+	{
+		uint64_t bytes;
+		Category category;
+		std::string label;
+		bool persistent;
+	};
+
+	std::map<std::pair<int, GLuint>, Allocation> allocations;
+	uint64_t totals[CATEGORIES];
+	uint64_t current;
+	uint64_t peak;
+	mutable std::mutex mutex;
+};
+
+GpuMemory& gpuMemory();
+
+// Bytes of a texture of levels mip levels and layers layers (6 for a cube map)
+uint64_t textureBytes(GLenum internalFormat, int width, int height, int layers, int levels);
+
+#endif
@@ -0,0 +1,78 @@
+#include "GpuMulticast.h"
+#include "Log.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include <algorithm>
+#include <iostream>
+
+GpuMulticast::GpuMulticast() : requested(false), gpus(1), mask(1), gathers(0)
+{
+}
+
+void GpuMulticast::request()
+{
+	requested = true;
+#ifdef _WIN32
+	SetEnvironmentVariableA("GL_NV_GPU_MULTICAST", "1");
+#endif
+}
+
+bool GpuMulticast::init()
+{
+	if (!requested) {
+		return false;
+	}
+	int found = multicastGpuCount();
+	if (found < 2) {
+		logStream(LOG_INFO) << "gpu.split_eyes: " << (glRenderGpuMaskNV ? "one GPU" : "no GL_NV_gpu_multicast (SLI off?)")
+			<< ", both eyes on one GPU" << std::endl;
+		return false;
+	}
+	gpus = std::min(found, (int)MAX_GPUS);
+	mask = allMask();
+	glRenderGpuMaskNV(mask);
+	logStream(LOG_INFO) << "rendering the eyes on " << gpus << " GPUs of " << found << std::endl;
+	return true;
+}
+
+void GpuMulticast::setRenderMask(GLbitfield gpuMask)
+{
+	if (!active() || gpuMask == mask) {
+		return;
+	}
+	mask = gpuMask;
+	glRenderGpuMaskNV(mask);
+}
+
+void GpuMulticast::gatherEye(int eye, GLuint texture, GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	if (!active()) {
+		return;
+	}
+	renderOnAll();
+	int source = eyeGpu(eye);
+	if (!source) {
+		return;
+	}
+	glMulticastCopyImageSubDataNV(source, 1u, texture, GL_TEXTURE_2D, 0, x, y, 0, texture, GL_TEXTURE_2D, 0, x, y, 0,
+		width, height, 1);
+	// The first GPU holds off until the copy is in
+	glMulticastWaitSyncNV(source, 1u);
+	gathers++;
+}
+
+void GpuMulticast::report(std::ostream& out) const
+{
+	if (active()) {
+		out << "split eyes: " << gathers << " eye copies between GPUs" << std::endl;
+	}
+}
+
+GpuMulticast& gpuMulticast()
+{
+	static GpuMulticast multicast;
+	return multicast;
+}
@@ -0,0 +1,90 @@
+#ifndef _GPU_MULTICAST_H_
+#define _GPU_MULTICAST_H_
+
+#include "GLExtensions.h"
+
+#include <cstdint>
+#include <ostream>
+
+// gpu.split_eyes: each eye's wall passes and eye pass on a GPU of its own, the left eye on
+// the first and the right eye on the second, through GL_NV_gpu_multicast. The one context
+// drives both GPUs; every object is on both, and uploads go to both. The render mask says
+// which of them draws, dispatches, clears and blits, so:
+//
+//   - work shared by the eyes (the first eye's setup, the far field, shadows, the shading
+//     cache) runs on all GPUs, each keeps its own copy of the result
+//   - an eye's passes run on its GPU only, the walls of the right eye are only ever in the
+//     second GPU's copy of their targets
+//   - the right eye's part of the eye buffer is copied over to the first GPU, the one the
+//     compositor reads, and the first GPU waits for that before the frame is submitted
+//
+// The driver only offers the extension to a context made with GL_NV_GPU_MULTICAST set in the
+// environment (request(), before the window) and with more than one GPU in an SLI group. If
+// it does not, or there is one GPU, init() says so and everything stays on the one GPU.
+//
+// GpuTimers' numbers for the right eye's passes are not to be trusted while the eyes are
+// split, the queries are made on whichever GPU renders.
+class GpuMulticast
+{
+public:
+	enum { MAX_GPUS = 2 };
+
+	GpuMulticast();
+
+	GpuMulticast(const GpuMulticast&) = delete;
+	GpuMulticast& operator=(const GpuMulticast&) = delete;
+
+	// Before the context is made
+	void request();
+	// Once the context is current, after loadGLExtensions(). False on a single GPU.
+	bool init();
+	bool active() const { return gpus > 1; }
+
+	// Every GPU renders, the default
+	void renderOnAll() { setRenderMask(allMask()); }
+	// Only eye's GPU renders
+	void renderOnEye(int eye) { setRenderMask(1u << eyeGpu(eye)); }
+	GLbitfield renderMask() const { return mask; }
+	// Does nothing on a single GPU
+	void setRenderMask(GLbitfield gpuMask);
+	GLbitfield allMask() const { return (1u << gpus) - 1u; }
+
+	//! Copies the right eye's part of texture from its GPU to the first, which then waits
+	// for it. Renders on all GPUs after.
+	void gatherEye(int eye, GLuint texture, GLint x, GLint y, GLsizei width, GLsizei height);
+
+	void report(std::ostream& out) const;
+
+private:
+	int eyeGpu(int eye) const { return eye % gpus; }
+
+	bool requested;
+	int gpus;
+	GLbitfield mask;
+	uint64_t gathers;
+};
+
+GpuMulticast& gpuMulticast();
+
+// Renders on all GPUs for its lifetime, for work both eyes use, then goes back to the mask
+// it found
+class SharedGpuScope
+{
+public:
+	SharedGpuScope() : previous(gpuMulticast().renderMask())
+	{
+		gpuMulticast().setRenderMask(gpuMulticast().allMask());
+	}
+	~SharedGpuScope()
+	{
+		gpuMulticast().setRenderMask(previous);
+	}
+
+	SharedGpuScope(const SharedGpuScope&) = delete;
+	SharedGpuScope& operator=(const SharedGpuScope&) = delete;
+
+private:
+	GLbitfield previous;
+};
+
+#endif
@@ -0,0 +1,223 @@
+#include "GpuTimers.h"
+
+#include "CpuProfiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+GpuTimers::GpuTimers() : initialized(false), current(0), window(120), dropped(0), collected(0), frameSpanMs(0.0f), ticksPerNanosecond(0.0), tickOffset(0.0), traceTrack(-1)
+{
+	memset(frames, 0, sizeof(frames));
+	memset(queries, 0, sizeof(queries));
+	// No pass has a scope open, every int -1
+	memset(open, 0xff, sizeof(open));
+	// Names are handed to the CPU profiler by pointer, the passes never move
+	passes.reserve(MAX_PASSES);
+}
+
+GpuTimers::~GpuTimers()
+{
+	shutdown();
+}
+
+bool GpuTimers::init(size_t window)
+{
+	shutdown();
+	this->window = std::max<size_t>(window, 1);
+	for (Pass& p : passes) {
+		p.history.assign(this->window, 0.0f);
+		p.head = 0;
+		p.count = 0;
+	}
+	for (int f = 0; f < FRAMES; f++) {
+		glGenQueries(2 * MAX_SCOPES, queries[f]);
+	}
+	initialized = true;
+	current = 0;
+	dropped = 0;
+	if (traceTrack < 0) {
+		traceTrack = cpuProfiler().track("GPU");
+	}
+	return true;
+}
+
+void GpuTimers::shutdown()
+{
+	if (!active()) {
+		return;
+	}
+	for (int f = 0; f < FRAMES; f++) {
+		glDeleteQueries(2 * MAX_SCOPES, queries[f]);
+		frames[f].pending = false;
+		frames[f].scopeCount = 0;
+		frames[f].queryCount = 0;
+	}
+	memset(queries, 0, sizeof(queries));
+	initialized = false;
+}
+
+int GpuTimers::pass(const std::string& name)
+{
+	for (size_t i = 0; i < passes.size(); i++) {
+		if (passes[i].name == name) {
+			return (int)i;
+		}
+	}
+	if (passes.size() == MAX_PASSES) {
+		return -1;
+	}
+	Pass p;
+	p.name = name;
+	p.history.assign(window, 0.0f);
+	p.head = 0;
+	p.count = 0;
+	p.frameMs = 0.0f;
+	p.timed = false;
+	passes.push_back(p);
+	return (int)passes.size() - 1;
+}
+
+void GpuTimers::beginFrame()
+{
+	if (!active()) {
+		return;
+	}
+	current = (current + 1) % FRAMES;
+	Frame& frame = frames[current];
+	if (frame.pending) {
+		collect(frame);
+	}
+	frame.pending = false;
+	frame.scopeCount = 0;
+	frame.queryCount = 0;
+
+	// Where the GPU clock is against the CPU's, to put the passes on the CPU timeline
+	CpuProfiler& profiler = cpuProfiler();
+	if (profiler.enabled()) {
+		GLint64 gpuNow = 0;
+		glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+		ticksPerNanosecond = profiler.ticksPerSecond() / 1.0e9;
+		tickOffset = (double)profiler.ticks() - (double)gpuNow * ticksPerNanosecond;
+	}
+}
+
+void GpuTimers::begin(int pass)
+{
+	if (pass < 0 || !active()) {
+		return;
+	}
+	Frame& frame = frames[current];
+	if (frame.scopeCount == MAX_SCOPES) {
+		open[pass] = -1;
+		return;
+	}
+	Scope& scope = frame.scopes[frame.scopeCount];
+	scope.pass = pass;
+	scope.beginQuery = frame.queryCount++;
+	scope.endQuery = -1;
+	glQueryCounter(queries[current][scope.beginQuery], GL_TIMESTAMP);
+	open[pass] = frame.scopeCount++;
+}
+
+void GpuTimers::end(int pass)
+{
+	Frame& frame = frames[current];
+	if (pass < 0 || open[pass] < 0) {
+		return;
+	}
+	Scope& scope = frame.scopes[open[pass]];
+	scope.endQuery = frame.queryCount++;
+	glQueryCounter(queries[current][scope.endQuery], GL_TIMESTAMP);
+	open[pass] = -1;
+	frame.pending = true;
+}
+
+void GpuTimers::collect(Frame& frame)
+{
+	// The queries finish in order, once the last is there all of them are. A frame the GPU
+	// is still on is dropped rather than waited for.
+	GLuint* frameQueries = queries[&frame - frames];
+	GLint available = 0;
+	glGetQueryObjectiv(frameQueries[frame.queryCount - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available) {
+		dropped++;
+		return;
+	}
+
+	for (Pass& p : passes) {
+		p.frameMs = 0.0f;
+		p.timed = false;
+	}
+	CpuProfiler& profiler = cpuProfiler();
+	GLuint64 first = ~(GLuint64)0, last = 0;
+	for (int i = 0; i < frame.scopeCount; i++) {
+		const Scope& scope = frame.scopes[i];
+		if (scope.endQuery < 0) {
+			continue;
+		}
+		GLuint64 start = 0, end = 0;
+		glGetQueryObjectui64v(frameQueries[scope.beginQuery], GL_QUERY_RESULT, &start);
+		glGetQueryObjectui64v(frameQueries[scope.endQuery], GL_QUERY_RESULT, &end);
+		Pass& p = passes[scope.pass];
+		p.frameMs += (float)(end - start) / 1.0e6f;
+		p.timed = true;
+		first = std::min(first, start);
+		last = std::max(last, end);
+		if (profiler.enabled()) {
+			profiler.recordTo(traceTrack, p.name.c_str(), (int64_t)(start * ticksPerNanosecond + tickOffset),
+				(int64_t)(end * ticksPerNanosecond + tickOffset), -1);
+		}
+	}
+	frameSpanMs = last > first ? (float)(last - first) / 1.0e6f : 0.0f;
+	collected++;
+	for (Pass& p : passes) {
+		if (p.timed) {
+			p.history[p.head] = p.frameMs;
+			p.head = (p.head + 1) % p.history.size();
+			p.count = std::min(p.count + 1, p.history.size());
+		}
+	}
+}
+
+bool GpuTimers::stats(int pass, Stats& out) const
+{
+	if (pass < 0 || pass >= (int)passes.size() || !passes[pass].count) {
+		return false;
+	}
+	const Pass& p = passes[pass];
+	std::vector<float> sorted(p.history.begin(), p.history.begin() + p.count);
+	std::sort(sorted.begin(), sorted.end());
+	float total = 0.0f;
+	for (float ms : sorted) {
+		total += ms;
+	}
+	out.minMs = sorted.front();
+	out.avgMs = total / sorted.size();
+	out.p99Ms = sorted[std::min((size_t)(0.99 * sorted.size()), sorted.size() - 1)];
+	out.lastMs = p.history[(p.head + p.history.size() - 1) % p.history.size()];
+	out.frames = p.count;
+	return true;
+}
+
+void GpuTimers::report(std::ostream& out) const
+{
+	char line[256];
+	out << "GPU passes over the last " << window << " frames (" << dropped << " frames not ready in time)" << std::endl;
+	snprintf(line, sizeof(line), "%-24s %8s %8s %8s", "pass", "min ms", "avg ms", "p99 ms");
+	out << line << std::endl;
+	for (size_t i = 0; i < passes.size(); i++) {
+		Stats s;
+		if (!stats((int)i, s)) {
+			continue;
+		}
+		snprintf(line, sizeof(line), "%-24s %8.3f %8.3f %8.3f", passes[i].name.c_str(), s.minMs, s.avgMs, s.p99Ms);
+		out << line << std::endl;
+	}
+}
+
+GpuTimers& gpuTimers()
+{
+	static GpuTimers instance;
+	return instance;
+}
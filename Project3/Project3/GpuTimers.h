@@ -0,0 +1,145 @@
+#ifndef _GPU_TIMERS_H_
+#define _GPU_TIMERS_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "GLMarkers.h"
+
+// GPU time of each render pass, from GL_TIMESTAMP queries around it. A frame's queries are
+// read back FRAMES frames later, and only if the GPU is done with them by then, so timing
+// never waits on the GPU. Timestamps rather than GL_TIME_ELAPSED, so passes may nest.
+//
+// Each pass keeps its last window frames for min/avg/p99. Finished passes also go to the
+// CPU profiler's "GPU" row, moved onto the CPU clock, so the trace shows both side by side.
+class GpuTimers
+{
+public:
+	enum { FRAMES = 3, MAX_PASSES = 64, MAX_SCOPES = 256 };
+
+	struct Stats
+	{
+		float minMs;
+		float avgMs;
+		float p99Ms;
+		float lastMs;
+		size_t frames;
+	};
+
+	GpuTimers();
+	~GpuTimers();
+
+	GpuTimers(const GpuTimers&) = delete;
+	GpuTimers& operator=(const GpuTimers&) = delete;
+
+	// Makes the queries, window is how many frames the stats go over
+	bool init(size_t window);
+	void shutdown();
+	bool active() const { return initialized; }
+
+	// A pass to time, by name. The same name gives the same pass.
+	int pass(const std::string& name);
+	size_t passCount() const { return passes.size(); }
+	const std::string& name(int pass) const { return passes[pass].name; }
+
+	// Reads back the oldest frame in flight and starts recording the next one
+	void beginFrame();
+	// A pass timed more than once a frame adds up
+	void begin(int pass);
+	void end(int pass);
+
+	bool stats(int pass, Stats& out) const;
+	// The pass's time in the last frame read back, 0 if it did not run then. Unlike stats()
+	// it sorts nothing, so it can be asked every frame.
+	float passMs(int pass) const { return pass >= 0 && pass < (int)passes.size() && passes[pass].timed ? passes[pass].frameMs : 0.0f; }
+	// The GPU time of the last frame read back, from its first timestamp to its last, and how
+	// many frames have been read back so far
+	float lastFrameMs() const { return frameSpanMs; }
+	size_t collectedFrames() const { return collected; }
+	// One line per pass that has been timed
+	void report(std::ostream& out) const;
+
+private:
+	struct Pass
+	{
+		std::string name;
+		std::vector<float> history;
+		size_t head;
+		size_t count;
+		float frameMs;
+		bool timed;
+	};
+	struct Scope
+	{
+		int pass;
+		int beginQuery;
+		int endQuery;
+	};
+	struct Frame
+	{
+		Scope scopes[MAX_SCOPES];
+		int scopeCount;
+		int queryCount;
+		bool pending;
+	};
+
+	void collect(Frame& frame);
+
+	std::vector<Pass> passes;
+	Frame frames[FRAMES];
+	GLuint queries[FRAMES][2 * MAX_SCOPES];
+	// Between init() and shutdown(), the queries are made
+	bool initialized;
+	int current;
+	int open[MAX_PASSES];
+	size_t window;
+	size_t dropped;
+	size_t collected;
+	float frameSpanMs;
+	// GPU nanoseconds to CPU profiler ticks, measured each frame
+	double ticksPerNanosecond;
+	double tickOffset;
+	int traceTrack;
+};
+
+GpuTimers& gpuTimers();
+
+// Times the GPU work issued from construction to destruction, does nothing while the
+// timers are off. With GL markers on (GLMarkers.h) the work is a debug group as well, named
+// after the pass.
+class GpuScope
+{
+public:
+	explicit GpuScope(int pass) : group(pass >= 0 && glMarkers().enabled() ? gpuTimers().name(pass).c_str() : nullptr),
+		pass(gpuTimers().active() ? pass : -1)
+	{
+		if (this->pass >= 0) {
+			gpuTimers().begin(this->pass);
+		}
+	}
+	~GpuScope()
+	{
+		if (pass >= 0) {
+			gpuTimers().end(pass);
+		}
+	}
+
+	GpuScope(const GpuScope&) = delete;
+	GpuScope& operator=(const GpuScope&) = delete;
+
+private:
+	// Before pass, so the group is pushed before the timer starts and popped after it stops
+	GpuGroup group;
+	int pass;
+};
+
+#endif
@@ -0,0 +1,621 @@
+#include "Image.h"
+#include "AssetArchive.h"
+#include "TextureCache.h"
+#include "ImageArena.h"
+
+#include <algorithm>
+#include <iostream>
+#include <cstdlib>
+#include <cctype>
+#include <cstring>
+#include <string>
+
+MappedFile::MappedFile() : file(INVALID_HANDLE_VALUE), mapping(nullptr), view(nullptr), length(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+MappedFile::MappedFile(MappedFile&& other)
+	: file(other.file), mapping(other.mapping), view(other.view), length(other.length)
+{
+	other.file = INVALID_HANDLE_VALUE;
+	other.mapping = nullptr;
+	other.view = nullptr;
+	other.length = 0;
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other)
+{
+	if (this != &other) {
+		close();
+		file = other.file;
+		mapping = other.mapping;
+		view = other.view;
+		length = other.length;
+		other.file = INVALID_HANDLE_VALUE;
+		other.mapping = nullptr;
+		other.view = nullptr;
+		other.length = 0;
+	}
+	return *this;
+}
+
+bool MappedFile::open(const char* filename)
+{
+	close();
+
+	// A file the asset archive has is a view of its mapping, which is not ours to unmap
+	const unsigned char* archived;
+	size_t archivedSize;
+	if (assetArchive().find(filename, archived, archivedSize)) {
+		view = archived;
+		length = archivedSize;
+		return true;
+	}
+
+	// The assets are read front to back exactly once, so let the cache manager read ahead
+	file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+		close();
+		return false;
+	}
+
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping) {
+		close();
+		return false;
+	}
+
+	view = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!view) {
+		close();
+		return false;
+	}
+	length = (size_t)fileSize.QuadPart;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (view && mapping) {
+		UnmapViewOfFile(view);
+	}
+	view = nullptr;
+	if (mapping) {
+		CloseHandle(mapping);
+		mapping = nullptr;
+	}
+	if (file != INVALID_HANDLE_VALUE) {
+		CloseHandle(file);
+		file = INVALID_HANDLE_VALUE;
+	}
+	length = 0;
+}
+
+// Skips whitespace and '#' comments, then parses one unsigned decimal header field.
+// Returns -1 if the header ends before a number is found, or if the number is past
+// MAX_HEADER_INT, which no width, height or maxval this reads may be.
+static const int MAX_HEADER_INT = 65535;
+
+static int readHeaderInt(const unsigned char* data, size_t size, size_t& pos)
+{
+	while (pos < size) {
+		if (data[pos] == '#') {
+			while (pos < size && data[pos] != '\n')
+				pos++;
+		}
+		else if (isspace(data[pos])) {
+			pos++;
+		}
+		else {
+			break;
+		}
+	}
+
+	if (pos >= size || !isdigit(data[pos])) {
+		return -1;
+	}
+
+	int value = 0;
+	while (pos < size && isdigit(data[pos])) {
+		value = value * 10 + (data[pos] - '0');
+		pos++;
+		if (value > MAX_HEADER_INT) {
+			return -1;
+		}
+	}
+	return value;
+}
+
+bool mapPPM(const char* filename, PPMImage& image)
+{
+	image.pixels = nullptr;
+	image.headerOffset = 0;
+	image.width = 0;
+	image.height = 0;
+
+	if (!image.file.open(filename)) {
+		std::cerr << "error reading ppm file, could not locate " << filename << std::endl;
+		return false;
+	}
+
+	const unsigned char* data = image.file.data();
+	size_t size = image.file.size();
+
+	// Read magic number:
+	if (size < 2 || data[0] != 'P' || data[1] != '6') {
+		std::cerr << "error parsing ppm file, " << filename << " is not a binary ppm" << std::endl;
+		image.file.close();
+		return false;
+	}
+
+	// Read width, height and maxval:
+	size_t pos = 2;
+	int width = readHeaderInt(data, size, pos);
+	int height = readHeaderInt(data, size, pos);
+	int maxval = readHeaderInt(data, size, pos);
+	if (width <= 0 || height <= 0 || maxval <= 0 || maxval > 65535) {
+		std::cerr << "error parsing ppm file, bad header in " << filename << std::endl;
+		image.file.close();
+		return false;
+	}
+
+	// Exactly one whitespace character separates maxval from the pixel data
+	pos++;
+
+	// Above 255 every sample is two bytes, most significant first
+	size_t payload = (size_t)width * (size_t)height * 3 * (maxval > 255 ? 2 : 1);
+	if (pos > size || size - pos < payload) {
+		std::cerr << "error parsing ppm file, incomplete data" << std::endl;
+		image.file.close();
+		return false;
+	}
+
+	image.pixels = data + pos;
+	image.headerOffset = pos;
+	image.width = width;
+	image.height = height;
+	image.maxval = maxval;
+	return true;
+}
+
+void expandPPMRange(const PPMImage& image, unsigned char* dst)
+{
+	size_t count = (size_t)image.width * image.height * 3;
+	if (image.maxval > 255) {
+		// Rounded to the nearest of the 8-bit steps
+		uint32_t maxval = (uint32_t)image.maxval;
+		for (size_t i = 0; i < count; i++) {
+			uint32_t v = ((uint32_t)image.pixels[i * 2] << 8) | image.pixels[i * 2 + 1];
+			dst[i] = (unsigned char)((std::min(v, maxval) * 255 + maxval / 2) / maxval);
+		}
+		return;
+	}
+	// One lookup per sample rather than a divide
+	unsigned char table[256];
+	for (int v = 0; v < 256; v++) {
+		table[v] = (unsigned char)((v > image.maxval ? image.maxval : v) * 255 / image.maxval);
+	}
+	for (size_t i = 0; i < count; i++) {
+		dst[i] = table[image.pixels[i]];
+	}
+}
+
+bool mapPFM(const char* filename, PFMImage& image)
+{
+	image.pixels = nullptr;
+	image.width = 0;
+	image.height = 0;
+
+	if (!image.file.open(filename)) {
+		std::cerr << "error reading pfm file, could not locate " << filename << std::endl;
+		return false;
+	}
+
+	const unsigned char* data = image.file.data();
+	size_t size = image.file.size();
+
+	// Read magic number, greyscale (Pf) maps are not supported:
+	if (size < 2 || data[0] != 'P' || data[1] != 'F') {
+		std::cerr << "error parsing pfm file, " << filename << " is not a colour pfm" << std::endl;
+		image.file.close();
+		return false;
+	}
+
+	// Read width, height and the scale, whose sign gives the byte order:
+	size_t pos = 2;
+	int width = readHeaderInt(data, size, pos);
+	int height = readHeaderInt(data, size, pos);
+	while (pos < size && isspace(data[pos])) {
+		pos++;
+	}
+	size_t scaleStart = pos;
+	while (pos < size && !isspace(data[pos])) {
+		pos++;
+	}
+	std::string scaleText((const char*)data + scaleStart, pos - scaleStart);
+	double scale = atof(scaleText.c_str());
+	if (width <= 0 || height <= 0 || scale == 0.0) {
+		std::cerr << "error parsing pfm file, bad header in " << filename << std::endl;
+		image.file.close();
+		return false;
+	}
+
+	// Exactly one whitespace character separates the scale from the pixel data
+	pos++;
+
+	size_t payload = (size_t)width * (size_t)height * 3 * sizeof(float);
+	if (pos > size || size - pos < payload) {
+		std::cerr << "error parsing pfm file, incomplete data" << std::endl;
+		image.file.close();
+		return false;
+	}
+
+	image.pixels = data + pos;
+	image.width = width;
+	image.height = height;
+	image.bigEndian = scale > 0.0;
+	return true;
+}
+
+void decodePFM(const PFMImage& image, float* dst)
+{
+	size_t rowFloats = (size_t)image.width * 3;
+	for (int y = 0; y < image.height; y++) {
+		const unsigned char* src = image.pixels + (size_t)(image.height - 1 - y) * rowFloats * sizeof(float);
+		float* row = dst + (size_t)y * rowFloats;
+		if (!image.bigEndian) {
+			memcpy(row, src, rowFloats * sizeof(float));
+			continue;
+		}
+		for (size_t i = 0; i < rowFloats; i++, src += 4) {
+			uint32_t bits = ((uint32_t)src[0] << 24) | ((uint32_t)src[1] << 16) | ((uint32_t)src[2] << 8) | src[3];
+			memcpy(&row[i], &bits, sizeof(float));
+		}
+	}
+}
+
+bool isPFMPath(const char* filename)
+{
+	size_t length = strlen(filename);
+	return length >= 4 && _stricmp(filename + length - 4, ".pfm") == 0;
+}
+
+// The header is "qoif", the width and height big endian, the channels and the colour space.
+// The chunks end in seven zero bytes and a one.
+static const size_t QOI_HEADER_SIZE = 14;
+static const size_t QOI_END_SIZE = 8;
+
+static uint32_t readBigEndian32(const unsigned char* p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+bool mapQOI(const char* filename, QOIImage& image)
+{
+	image.chunks = nullptr;
+	image.chunkBytes = 0;
+	image.width = 0;
+	image.height = 0;
+
+	if (!image.file.open(filename)) {
+		std::cerr << "error reading qoi file, could not locate " << filename << std::endl;
+		return false;
+	}
+
+	const unsigned char* data = image.file.data();
+	size_t size = image.file.size();
+	if (size < QOI_HEADER_SIZE + QOI_END_SIZE || memcmp(data, "qoif", 4) != 0) {
+		std::cerr << "error parsing qoi file, " << filename << " is not a qoi" << std::endl;
+		image.file.close();
+		return false;
+	}
+
+	uint32_t width = readBigEndian32(data + 4);
+	uint32_t height = readBigEndian32(data + 8);
+	unsigned channels = data[12];
+	// The same limit the PPM reader's ints have
+	if (width == 0 || height == 0 || width > 65536 || height > 65536 || (channels != 3 && channels != 4)) {
+		std::cerr << "error parsing qoi file, bad header in " << filename << std::endl;
+		image.file.close();
+		return false;
+	}
+
+	image.chunks = data + QOI_HEADER_SIZE;
+	image.chunkBytes = size - QOI_HEADER_SIZE - QOI_END_SIZE;
+	image.width = (int)width;
+	image.height = (int)height;
+	return true;
+}
+
+bool decodeQOI(const QOIImage& image, unsigned char* dst)
+{
+	// Every pixel seen so far by its hash, and the last one. Alpha only feeds the hash.
+	unsigned char index[64][4];
+	memset(index, 0, sizeof(index));
+	unsigned char r = 0, g = 0, b = 0, a = 255;
+
+	const unsigned char* p = image.chunks;
+	const unsigned char* end = image.chunks + image.chunkBytes;
+	unsigned char* out = dst;
+	unsigned char* outEnd = dst + (size_t)image.width * image.height * 3;
+	while (out < outEnd) {
+		if (p >= end) {
+			return false;
+		}
+		unsigned op = *p++;
+		size_t run = 1;
+		if (op == 0xfe) {
+			if (end - p < 3) {
+				return false;
+			}
+			r = p[0];
+			g = p[1];
+			b = p[2];
+			p += 3;
+		}
+		else if (op == 0xff) {
+			if (end - p < 4) {
+				return false;
+			}
+			r = p[0];
+			g = p[1];
+			b = p[2];
+			a = p[3];
+			p += 4;
+		}
+		else {
+			switch (op >> 6) {
+			case 0: {
+				const unsigned char* seen = index[op];
+				r = seen[0];
+				g = seen[1];
+				b = seen[2];
+				a = seen[3];
+				break;
+			}
+			case 1:
+				r += (unsigned char)(((op >> 4) & 3) - 2);
+				g += (unsigned char)(((op >> 2) & 3) - 2);
+				b += (unsigned char)((op & 3) - 2);
+				break;
+			case 2: {
+				if (p >= end) {
+					return false;
+				}
+				int dg = (int)(op & 0x3f) - 32;
+				unsigned second = *p++;
+				r += (unsigned char)(dg - 8 + (int)(second >> 4));
+				g += (unsigned char)dg;
+				b += (unsigned char)(dg - 8 + (int)(second & 0x0f));
+				break;
+			}
+			default:
+				run = (op & 0x3f) + 1;
+				break;
+			}
+		}
+		unsigned char* seen = index[(r * 3 + g * 5 + b * 7 + a * 11) & 63];
+		seen[0] = r;
+		seen[1] = g;
+		seen[2] = b;
+		seen[3] = a;
+
+		if (run > (size_t)(outEnd - out) / 3) {
+			return false;
+		}
+		for (size_t i = 0; i < run; i++, out += 3) {
+			out[0] = r;
+			out[1] = g;
+			out[2] = b;
+		}
+	}
+	return true;
+}
+
+bool isQOIPath(const char* filename)
+{
+	size_t length = strlen(filename);
+	return length >= 4 && _stricmp(filename + length - 4, ".qoi") == 0;
+}
+
+std::string qoiSourcePath(const std::string& sourcePath)
+{
+	size_t dot = sourcePath.find_last_of('.');
+	size_t slash = sourcePath.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+		return sourcePath + ".qoi";
+	}
+	return sourcePath.substr(0, dot) + ".qoi";
+}
+
+// Maps the cache file for a source image if it exists, matches the source and is in a
+// format the caller can upload
+static bool mapTextureCache(const char* filename, Image& image, unsigned compressedFormats)
+{
+	std::string cachePath = textureCachePath(filename);
+	MappedFile file;
+	if (!file.open(cachePath.c_str()) || file.size() < sizeof(TexCacheHeader)) {
+		return false;
+	}
+
+	const TexCacheHeader* header = (const TexCacheHeader*)file.data();
+	if (header->magic != TEXCACHE_MAGIC || header->version != TEXCACHE_VERSION || header->levelCount == 0) {
+		return false;
+	}
+	PixelFormat format;
+	switch (header->format) {
+	case TEXCACHE_RGB8: format = PixelFormat::RGB8; break;
+	case TEXCACHE_BC1: format = PixelFormat::BC1; break;
+	case TEXCACHE_RGB16F: format = PixelFormat::RGB16F; break;
+	case TEXCACHE_BC6H: format = PixelFormat::BC6H; break;
+	default: return false;
+	}
+	if ((format == PixelFormat::BC1 && !(compressedFormats & COMPRESSED_BC1)) ||
+		(format == PixelFormat::BC6H && !(compressedFormats & COMPRESSED_BC6H))) {
+		return false;
+	}
+
+	// A cache whose source has since changed is stale. A missing source is fine, the
+	// cache may have been deployed on its own.
+	uint64_t sourceSize, sourceTime;
+	if (sourceFileStamp(filename, sourceSize, sourceTime) &&
+		(sourceSize != header->sourceSize || sourceTime != header->sourceTime)) {
+		std::cerr << "ignoring stale texture cache " << cachePath << std::endl;
+		return false;
+	}
+
+	size_t tableEnd = sizeof(TexCacheHeader) + sizeof(TexCacheLevel) * header->levelCount;
+	if (file.size() < tableEnd) {
+		return false;
+	}
+	const TexCacheLevel* table = (const TexCacheLevel*)(header + 1);
+
+	std::vector<ImageLevel> levels;
+	for (uint32_t i = 0; i < header->levelCount; i++) {
+		if ((size_t)table[i].offset + table[i].size > file.size()) {
+			return false;
+		}
+		ImageLevel level = { file.data() + table[i].offset, table[i].size, (int)table[i].width, (int)table[i].height };
+		levels.push_back(level);
+	}
+
+	image.format = format;
+	image.width = (int)header->width;
+	image.height = (int)header->height;
+	image.levels.swap(levels);
+	image.file = std::move(file);
+	return true;
+}
+
+// A PFM without a usable cache, converted to half floats in the arena. The floats are
+// decoded there first and then narrowed in place, front to back.
+static bool mapPFMImage(const char* filename, Image& image, ImageArena* arena)
+{
+	PFMImage pfm;
+	if (!mapPFM(filename, pfm)) {
+		image.width = 0;
+		image.height = 0;
+		return false;
+	}
+
+	size_t count = (size_t)pfm.width * pfm.height * 3;
+	unsigned char* pixels = arena ? arena->allocate(count * sizeof(float)) : nullptr;
+	if (!pixels) {
+		std::cerr << "error loading " << filename << ", a pfm without a texture cache has to be converted" << std::endl;
+		image.width = 0;
+		image.height = 0;
+		return false;
+	}
+	float* floats = (float*)pixels;
+	uint16_t* halves = (uint16_t*)pixels;
+	decodePFM(pfm, floats);
+	for (size_t i = 0; i < count; i++) {
+		halves[i] = floatToHalf(floats[i]);
+	}
+
+	ImageLevel level = { pixels, count * sizeof(uint16_t), pfm.width, pfm.height };
+	image.format = PixelFormat::RGB16F;
+	image.width = pfm.width;
+	image.height = pfm.height;
+	image.levels.push_back(level);
+	return true;
+}
+
+// A QOI without a usable cache, decoded into the arena
+static bool mapQOIImage(const char* filename, Image& image, ImageArena* arena)
+{
+	QOIImage qoi;
+	if (!mapQOI(filename, qoi)) {
+		image.width = 0;
+		image.height = 0;
+		return false;
+	}
+
+	size_t bytes = (size_t)qoi.width * qoi.height * 3;
+	unsigned char* pixels = arena ? arena->allocate(bytes) : nullptr;
+	if (!pixels) {
+		std::cerr << "error loading " << filename << ", a qoi without a texture cache has to be decoded" << std::endl;
+		image.width = 0;
+		image.height = 0;
+		return false;
+	}
+	if (!decodeQOI(qoi, pixels)) {
+		std::cerr << "error parsing qoi file, incomplete data in " << filename << std::endl;
+		image.width = 0;
+		image.height = 0;
+		return false;
+	}
+
+	ImageLevel level = { pixels, bytes, qoi.width, qoi.height };
+	image.format = PixelFormat::RGB8;
+	image.width = qoi.width;
+	image.height = qoi.height;
+	image.levels.push_back(level);
+	return true;
+}
+
+bool mapImage(const char* filename, Image& image, unsigned compressedFormats, ImageArena* arena)
+{
+	image.levels.clear();
+	image.file.close();
+
+	if (mapTextureCache(filename, image, compressedFormats)) {
+		return true;
+	}
+	if (isPFMPath(filename)) {
+		return mapPFMImage(filename, image, arena);
+	}
+	if (isQOIPath(filename)) {
+		return mapQOIImage(filename, image, arena);
+	}
+	// Deployed compressed, under the PPM's name
+	uint64_t size, time;
+	if (!sourceFileStamp(filename, size, time)) {
+		std::string qoi = qoiSourcePath(filename);
+		if (sourceFileStamp(qoi.c_str(), size, time)) {
+			return mapQOIImage(qoi.c_str(), image, arena);
+		}
+	}
+
+	PPMImage ppm;
+	if (!mapPPM(filename, ppm)) {
+		image.width = 0;
+		image.height = 0;
+		return false;
+	}
+
+	ImageLevel level = { ppm.pixels, (size_t)ppm.width * ppm.height * 3, ppm.width, ppm.height };
+	image.format = PixelFormat::RGB8;
+	image.width = ppm.width;
+	image.height = ppm.height;
+
+	unsigned char* expanded = ppm.maxval != 255 && arena ? arena->allocate(level.size) : nullptr;
+	if (!expanded && ppm.maxval > 255) {
+		std::cerr << "error reading ppm file, " << filename << " has 16-bit samples and nowhere to convert them" << std::endl;
+		image.width = 0;
+		image.height = 0;
+		return false;
+	}
+	if (expanded) {
+		// The mapping is dropped right away, the arena copy is all the upload needs
+		expandPPMRange(ppm, expanded);
+		level.data = expanded;
+		image.levels.push_back(level);
+		return true;
+	}
+
+	image.levels.push_back(level);
+	image.file = std::move(ppm.file);
+	return true;
+}
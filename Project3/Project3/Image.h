@@ -0,0 +1,180 @@
+#ifndef _IMAGE_H_
+#define _IMAGE_H_
+
+#include <Windows.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class ImageArena;
+
+// Read-only mapping of a whole file into the address space. The view stays valid
+// until close() is called or the object is destroyed. Move-only. A file the asset archive
+// (AssetArchive.h) has is a view into the archive's mapping instead.
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(MappedFile&& other);
+	MappedFile& operator=(MappedFile&& other);
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const char* filename);
+	void close();
+
+	const unsigned char* data() const { return view; }
+	size_t size() const { return length; }
+	bool isOpen() const { return view != nullptr; }
+
+private:
+	HANDLE file;
+	HANDLE mapping;
+	const unsigned char* view;
+	size_t length;
+};
+
+// A binary (P6) PPM viewed in place. pixels points headerOffset bytes into the
+// mapping and is only valid for as long as the image (and so its mapping) lives.
+struct PPMImage
+{
+	MappedFile file;
+	const unsigned char* pixels = nullptr;
+	size_t headerOffset = 0;
+	int width = 0;
+	int height = 0;
+	int maxval = 255;
+};
+
+//! Map a ppm file from disk without copying its pixel payload.
+// @input filename The location of the PPM file. If the file is not found or is not a valid
+//		P6 image, an error message will be printed and this function will return false
+// @input image Receives the mapping, the header offset, the width and the height
+//
+// @return Returns true if image.pixels points at width * height interleaved RGB triplets,
+//		of two big endian bytes a sample when maxval is above 255
+bool mapPPM(const char* filename, PPMImage& image);
+
+//! Stretch the samples of a ppm whose maxval is not 255 to the full 8-bit range, which
+// for a 16-bit ppm also halves them to one byte.
+// @input image A mapped ppm
+// @input dst Receives width * height * 3 bytes. May not alias the mapping.
+void expandPPMRange(const PPMImage& image, unsigned char* dst);
+
+// A colour (PF) PFM, the float format HDR environments come in, viewed in place. Its rows
+// run bottom to top and may be big endian, so pixels is read through decodePFM.
+struct PFMImage
+{
+	MappedFile file;
+	const unsigned char* pixels = nullptr;
+	int width = 0;
+	int height = 0;
+	bool bigEndian = false;
+};
+
+//! Map a pfm file from disk without copying its pixel payload.
+// @input filename The location of the PFM file. If the file is not found or is not a valid
+//		colour PFM, an error message will be printed and this function will return false
+// @input image Receives the mapping, the width, the height and the byte order
+//
+// @return Returns true if image.pixels points at width * height RGB float triplets
+bool mapPFM(const char* filename, PFMImage& image);
+
+//! Copy the pixels of a pfm out as native floats, top row first like a ppm.
+// @input image A mapped pfm
+// @input dst Receives width * height * 3 floats. May not alias the mapping.
+void decodePFM(const PFMImage& image, float* dst);
+
+// True for a file name the PFM readers are meant for rather than the PPM ones
+bool isPFMPath(const char* filename);
+
+// A QOI ("Quite OK Image") file, the lossless compressed form the 8-bit assets can be
+// deployed in at a fraction of a PPM's bytes, viewed in place. Its chunks are only read by
+// decodeQOI. An alpha channel is dropped.
+struct QOIImage
+{
+	MappedFile file;
+	const unsigned char* chunks = nullptr;
+	size_t chunkBytes = 0;
+	int width = 0;
+	int height = 0;
+};
+
+//! Map a qoi file from disk without decoding it.
+// @input filename The location of the QOI file. If the file is not found or its header is
+//		not valid, an error message will be printed and this function will return false
+// @input image Receives the mapping, the width and the height
+//
+// @return Returns true if image.chunks points at the encoded pixels
+bool mapQOI(const char* filename, QOIImage& image);
+
+//! Decode the pixels of a qoi to RGB8, top row first like a ppm.
+// @input image A mapped qoi
+// @input dst Receives width * height * 3 bytes. May not alias the mapping.
+//
+// @return Returns false if the chunks end before every pixel is decoded
+bool decodeQOI(const QOIImage& image, unsigned char* dst);
+
+// True for a file name the QOI readers are meant for
+bool isQOIPath(const char* filename);
+
+// The QOI that may be deployed in place of a source image ("a/b.ppm" -> "a/b.qoi")
+std::string qoiSourcePath(const std::string& sourcePath);
+
+enum class PixelFormat {
+	RGB8,
+	BC1,
+	// Half float RGB, and BC6H blocks of it, from HDR sources
+	RGB16F,
+	BC6H,
+};
+
+// Block compressed formats, or'd together to say which ones the context can sample
+enum CompressedFormats : unsigned {
+	COMPRESSED_BC1 = 1 << 0,
+	COMPRESSED_BC6H = 1 << 1,
+	COMPRESSED_ALL = COMPRESSED_BC1 | COMPRESSED_BC6H,
+};
+
+struct ImageLevel
+{
+	const unsigned char* data;
+	size_t size;
+	int width;
+	int height;
+};
+
+// An image with one or more mip levels (level 0 is full resolution), viewed in place
+// in either a PPM or a texture cache file, or held in an ImageArena if it had to be
+// converted first (and then file is closed). A single level means the mips still have
+// to be generated after upload.
+struct Image
+{
+	MappedFile file;
+	PixelFormat format = PixelFormat::RGB8;
+	int width = 0;
+	int height = 0;
+	std::vector<ImageLevel> levels;
+
+	const unsigned char* pixels() const { return levels.empty() ? nullptr : levels[0].data; }
+	bool valid() const { return pixels() != nullptr; }
+};
+
+//! Map an image, preferring an up to date texture cache (.p3tc) next to the source.
+// @input filename The location of the source PPM, PFM or QOI file. A PPM that is not there
+//		is looked for as a QOI of the same name, which is how compressed assets are deployed
+//		without changing what names them
+// @input image Receives the mapping and its levels, or no levels if neither file could be used
+// @input compressedFormats The block compressed caches that may be used, others are skipped
+//		in favour of the source
+// @input arena Where to put pixels that cannot be used in place (a PPM with a maxval other
+//		than 255, any PFM, which becomes RGB16F, and any QOI). Without one a PPM below 255 is
+//		used as is and comes out too dark, and a 16-bit PPM, PFM or QOI cannot be used at all.
+//
+// @return Returns true if the image has at least one level
+bool mapImage(const char* filename, Image& image, unsigned compressedFormats = COMPRESSED_ALL,
+	ImageArena* arena = nullptr);
+
+#endif
@@ -0,0 +1,45 @@
+#include "ImageArena.h"
+#include "LargePages.h"
+
+ImageArena::ImageArena(size_t blockSize) : blockSize(blockSize), allocated(0)
+{
+}
+
+ImageArena::~ImageArena()
+{
+	release();
+}
+
+unsigned char* ImageArena::allocate(size_t bytes)
+{
+	bytes = (bytes + 15) & ~(size_t)15;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (blocks.empty() || blocks.back().size - blocks.back().used < bytes) {
+		// Straight from the OS so release() hands the pages back rather than leaving them in
+		// the heap, in large pages with memory.large_pages
+		size_t size;
+		unsigned char* base = (unsigned char*)largePages().allocate(bytes > blockSize ? bytes : blockSize, LargePages::IMAGE_ARENA, size);
+		if (!base) {
+			return nullptr;
+		}
+		Block block = { base, size, 0 };
+		blocks.push_back(block);
+	}
+
+	Block& block = blocks.back();
+	unsigned char* result = block.base + block.used;
+	block.used += bytes;
+	allocated += bytes;
+	return result;
+}
+
+void ImageArena::release()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for (Block& block : blocks) {
+		largePages().free(block.base, block.size, LargePages::IMAGE_ARENA);
+	}
+	blocks.clear();
+	allocated = 0;
+}
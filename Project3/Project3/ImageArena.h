@@ -0,0 +1,43 @@
+#ifndef _IMAGE_ARENA_H_
+#define _IMAGE_ARENA_H_
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+// Scoped storage for pixels that had to be decoded or converted on the CPU during a
+// load. Allocations are never freed one by one; everything goes back to the system at
+// once in release() or when the arena is destroyed, which is meant to happen as soon as
+// the GL uploads that read from it are done. Safe to allocate from several threads.
+// Blocks come from LargePages, in large pages once those are enabled.
+class ImageArena
+{
+public:
+	// Blocks are at least blockSize bytes, larger allocations get a block of their own
+	explicit ImageArena(size_t blockSize = 16 * 1024 * 1024);
+	~ImageArena();
+
+	ImageArena(const ImageArena&) = delete;
+	ImageArena& operator=(const ImageArena&) = delete;
+
+	// Returns 16 byte aligned storage, or nullptr if the system is out of memory
+	unsigned char* allocate(size_t bytes);
+	void release();
+
+	size_t bytesAllocated() const { return allocated; }
+
+private:
+	struct Block
+	{
+		unsigned char* base;
+		size_t size;
+		size_t used;
+	};
+
+	size_t blockSize;
+	size_t allocated;
+	std::vector<Block> blocks;
+	std::mutex mutex;
+};
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef _INPUT_EVENTS_H_
+#define _INPUT_EVENTS_H_
+
+#include <OVR_CAPI.h>
+
+#include <cmath>
+
+// One thing the user did, stamped with when the input thread saw it (glfwGetTime)
+struct InputEvent
+{
+	enum Type { KEY, MOUSE_BUTTON, TOUCH_BUTTON, THUMBSTICK };
+
+	Type type;
+	double time;
+	// The GLFW key or mouse button, the ovrButton bit or the ovrHand of the thumbstick
+	int code;
+	// GLFW_PRESS, GLFW_RELEASE or GLFW_REPEAT for keys and mouse buttons, 1 for a Touch
+	// button going down and 0 for it coming up
+	int action;
+	int scancode;
+	int mods;
+	// Where the thumbstick is now and how far it moved since its last event
+	float x, y;
+	float dx, dy;
+};
+
+// Turns the Touch input states read one after another into the button edges and
+// thumbstick moves between them. An invalid state counts as everything let go.
+class TouchEdges
+{
+public:
+	TouchEdges() : buttons(0) { reset(); }
+
+	void reset()
+	{
+		buttons = 0;
+		for (int hand = 0; hand < ovrHand_Count; hand++) {
+			sticks[hand].x = 0.0f;
+			sticks[hand].y = 0.0f;
+		}
+	}
+
+	//! Calls emit(const InputEvent&) for every button pressed or released and every
+	// thumbstick moved since the last state.
+	template <typename Emit>
+	void update(const ovrInputState& state, bool valid, double time, Emit emit)
+	{
+		unsigned int now = valid ? state.Buttons : 0u;
+		for (unsigned int changed = now ^ buttons; changed; changed &= changed - 1) {
+			unsigned int bit = changed & (~changed + 1u);
+			InputEvent e = event(InputEvent::TOUCH_BUTTON, time, (int)bit);
+			e.action = (now & bit) ? 1 : 0;
+			emit(e);
+		}
+		buttons = now;
+
+		for (int hand = 0; hand < ovrHand_Count; hand++) {
+			ovrVector2f stick = state.Thumbstick[hand];
+			if (!valid) {
+				stick.x = 0.0f;
+				stick.y = 0.0f;
+			}
+			if (stick.x == sticks[hand].x && stick.y == sticks[hand].y) {
+				continue;
+			}
+			InputEvent e = event(InputEvent::THUMBSTICK, time, hand);
+			e.x = stick.x;
+			e.y = stick.y;
+			e.dx = stick.x - sticks[hand].x;
+			e.dy = stick.y - sticks[hand].y;
+			emit(e);
+			sticks[hand] = stick;
+		}
+	}
+
+private:
+	static InputEvent event(InputEvent::Type type, double time, int code)
+	{
+		InputEvent e = {};
+		e.type = type;
+		e.time = time;
+		e.code = code;
+		return e;
+	}
+
+	unsigned int buttons;
+	ovrVector2f sticks[ovrHand_Count];
+};
+
+#endif
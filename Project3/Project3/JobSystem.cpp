@@ -0,0 +1,366 @@
+#include "JobSystem.h"
+#include "ThreadScheduling.h"
+
+#include <algorithm>
+#include <chrono>
+
+// Blocks of this many jobs are added to the free list when it runs out
+static const size_t JOB_BLOCK = 64;
+// A loop is cut into at most this many pieces per thread, for stealing to even out
+static const size_t PIECES_PER_THREAD = 4;
+
+// Which index the current thread has, in which set of workers
+struct ThreadSlot
+{
+	const JobSystem* owner = nullptr;
+	uint64_t epoch = 0;
+	unsigned int index = 0;
+};
+static thread_local ThreadSlot slot;
+
+void JobSystem::Queue::pushBack(Job* job)
+{
+	if (count == ring.size()) {
+		// Unrolled into the grown ring so head is at 0 again
+		std::vector<Job*> grown(std::max<size_t>(ring.size() * 2, 16));
+		for (size_t i = 0; i < count; i++) {
+			grown[i] = ring[(head + i) % ring.size()];
+		}
+		ring.swap(grown);
+		head = 0;
+	}
+	ring[(head + count) % ring.size()] = job;
+	count++;
+}
+
+JobSystem::Job* JobSystem::Queue::popBack()
+{
+	if (!count) {
+		return nullptr;
+	}
+	count--;
+	return ring[(head + count) % ring.size()];
+}
+
+JobSystem::Job* JobSystem::Queue::popFront()
+{
+	if (!count) {
+		return nullptr;
+	}
+	Job* job = ring[head];
+	head = (head + 1) % ring.size();
+	count--;
+	return job;
+}
+
+JobSystem::JobSystem() : queues(new Queue[1]), queueCount(1), queued(0), stolen(0), otherThreads(0), freeJobs(nullptr),
+	epoch(0), stopping(false)
+{
+}
+
+JobSystem::~JobSystem()
+{
+	stop();
+}
+
+void JobSystem::start(unsigned int threads)
+{
+	stop();
+	if (threads == 0) {
+		threads = std::thread::hardware_concurrency();
+	}
+	unsigned int workerCount = std::max(threads, 2u) - 1;
+	queues.reset(new Queue[workerCount + 1]);
+	queueCount = workerCount + 1;
+	stolen = 0;
+	otherThreads = 0;
+	epoch++;
+	for (unsigned int i = 0; i < workerCount; i++) {
+		workers.emplace_back(&JobSystem::workerLoop, this, i);
+	}
+}
+
+void JobSystem::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepLock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (auto& worker : workers) {
+		worker.join();
+	}
+	workers.clear();
+	stopping = false;
+}
+
+unsigned int JobSystem::threadIndex()
+{
+	if (slot.owner != this || slot.epoch != epoch) {
+		unsigned int other = std::min(otherThreads.fetch_add(1), (unsigned int)MAX_OTHER_THREADS);
+		slot.owner = this;
+		slot.epoch = epoch;
+		slot.index = (unsigned int)workers.size() + other;
+	}
+	return slot.index;
+}
+
+JobSystem::Job* JobSystem::allocate()
+{
+	std::lock_guard<std::mutex> lock(freeLock);
+	if (!freeJobs) {
+		blocks.emplace_back(new Job[JOB_BLOCK]);
+		Job* block = blocks.back().get();
+		for (size_t i = 0; i < JOB_BLOCK; i++) {
+			block[i].next = i + 1 < JOB_BLOCK ? &block[i + 1] : nullptr;
+		}
+		freeJobs = block;
+	}
+	Job* job = freeJobs;
+	freeJobs = job->next;
+	job->next = nullptr;
+	return job;
+}
+
+void JobSystem::recycle(Job* job)
+{
+	// Whatever the task captured goes now, not when the job is next used
+	job->task = nullptr;
+	job->piece = nullptr;
+	job->body = nullptr;
+	job->counter = nullptr;
+	std::lock_guard<std::mutex> lock(freeLock);
+	job->next = freeJobs;
+	freeJobs = job;
+}
+
+void JobSystem::enqueue(Job* job, int queue)
+{
+	// Counted first, so a thread that takes the job never takes the count below zero
+	queued.fetch_add(1);
+	{
+		std::lock_guard<std::mutex> lock(queues[queue].lock);
+		queues[queue].pushBack(job);
+	}
+	{
+		std::lock_guard<std::mutex> lock(sleepLock);
+	}
+	wake.notify_one();
+}
+
+void JobSystem::hold(Job* job, JobCounter* after)
+{
+	{
+		std::lock_guard<std::mutex> lock(after->lock);
+		if (after->count.load() != 0) {
+			job->next = after->waiting;
+			after->waiting = job;
+			return;
+		}
+	}
+	unsigned int self = threadIndex();
+	enqueue(job, self < workers.size() ? self : (int)queueCount - 1);
+}
+
+void JobSystem::submit(std::function<void()> task, JobCounter* counter, JobCounter* after)
+{
+	Job* job = allocate();
+	job->task = std::move(task);
+	job->counter = counter;
+	if (counter) {
+		counter->count.fetch_add(1);
+	}
+	if (after) {
+		hold(job, after);
+		return;
+	}
+	// A worker's own jobs go to its queue, where it finds them first
+	unsigned int self = threadIndex();
+	enqueue(job, self < workers.size() ? self : (int)queueCount - 1);
+}
+
+void JobSystem::submitGl(std::function<void()> task, JobCounter* counter)
+{
+	Job* job = allocate();
+	job->task = std::move(task);
+	job->counter = counter;
+	if (counter) {
+		counter->count.fetch_add(1);
+	}
+	std::lock_guard<std::mutex> lock(glQueue.lock);
+	glQueue.pushBack(job);
+}
+
+size_t JobSystem::runGlJobs(double budgetMs)
+{
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point start = Clock::now();
+	size_t ran = 0;
+	for (;;) {
+		Job* job;
+		{
+			std::lock_guard<std::mutex> lock(glQueue.lock);
+			job = glQueue.popFront();
+		}
+		if (!job) {
+			break;
+		}
+		execute(job);
+		ran++;
+		if (std::chrono::duration<double, std::milli>(Clock::now() - start).count() >= budgetMs) {
+			break;
+		}
+	}
+	return ran;
+}
+
+void JobSystem::execute(Job* job)
+{
+	if (job->piece) {
+		job->piece(job->body, job->begin, job->end, threadIndex());
+	}
+	else {
+		job->task();
+	}
+	JobCounter* counter = job->counter;
+	recycle(job);
+	finish(counter);
+}
+
+void JobSystem::finish(JobCounter* counter)
+{
+	if (!counter) {
+		return;
+	}
+	// Under the counter's lock, so a waiter that sees zero can only let the counter go once
+	// this is done with it
+	Job* released = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(counter->lock);
+		if (counter->count.fetch_sub(1) != 1) {
+			return;
+		}
+		released = counter->waiting;
+		counter->waiting = nullptr;
+	}
+	unsigned int self = threadIndex();
+	while (released) {
+		Job* job = released;
+		released = job->next;
+		job->next = nullptr;
+		enqueue(job, self < workers.size() ? self : (int)queueCount - 1);
+	}
+	{
+		std::lock_guard<std::mutex> lock(sleepLock);
+	}
+	wake.notify_all();
+}
+
+JobSystem::Job* JobSystem::find(unsigned int self)
+{
+	if (!queued.load()) {
+		return nullptr;
+	}
+	Job* job = nullptr;
+	// The newest of our own, then the oldest anyone submitted from outside
+	if (self < workers.size()) {
+		std::lock_guard<std::mutex> lock(queues[self].lock);
+		job = queues[self].popBack();
+	}
+	if (!job) {
+		std::lock_guard<std::mutex> lock(queues[queueCount - 1].lock);
+		job = queues[queueCount - 1].popFront();
+	}
+	// Then the oldest of another worker's, which is likely the largest piece of its work
+	for (unsigned int i = 1; !job && i <= workers.size(); i++) {
+		unsigned int victim = (self + i) % (unsigned int)workers.size();
+		if (victim == self) {
+			continue;
+		}
+		std::lock_guard<std::mutex> lock(queues[victim].lock);
+		job = queues[victim].popFront();
+		if (job) {
+			stolen.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+	if (job) {
+		queued.fetch_sub(1);
+	}
+	return job;
+}
+
+void JobSystem::wait(JobCounter& counter)
+{
+	unsigned int self = threadIndex();
+	while (!counter.done()) {
+		Job* job = find(self);
+		if (job) {
+			execute(job);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(sleepLock);
+		wake.wait(lock, [this, &counter] { return counter.done() || queued.load() != 0; });
+	}
+	// The last finish() may still be releasing what waited on the counter
+	std::lock_guard<std::mutex> lock(counter.lock);
+}
+
+void JobSystem::split(size_t count, size_t grain, Piece piece, const void* body)
+{
+	if (!count) {
+		return;
+	}
+	grain = std::max<size_t>(grain, 1);
+	if (count <= grain || workers.empty()) {
+		piece(body, 0, count, threadIndex());
+		return;
+	}
+	size_t pieces = std::min((count + grain - 1) / grain, (size_t)threadCount() * PIECES_PER_THREAD);
+	JobCounter counter;
+	counter.count = (int)pieces;
+	queued.fetch_add(pieces);
+	// Dealt out over every queue, so each thread starts on a share of its own
+	for (size_t i = 0; i < pieces; i++) {
+		Job* job = allocate();
+		job->piece = piece;
+		job->body = body;
+		job->begin = count * i / pieces;
+		job->end = count * (i + 1) / pieces;
+		job->counter = &counter;
+		int queue = (int)(i % queueCount);
+		std::lock_guard<std::mutex> lock(queues[queue].lock);
+		queues[queue].pushBack(job);
+	}
+	{
+		std::lock_guard<std::mutex> lock(sleepLock);
+	}
+	wake.notify_all();
+	wait(counter);
+}
+
+void JobSystem::workerLoop(unsigned int self)
+{
+	slot.owner = this;
+	slot.epoch = epoch;
+	slot.index = self;
+	threadScheduling().enter(ThreadScheduling::WORKER);
+	for (;;) {
+		Job* job = find(self);
+		if (job) {
+			execute(job);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(sleepLock);
+		if (stopping && queued.load() == 0) {
+			threadScheduling().leave();
+			return;
+		}
+		wake.wait(lock, [this] { return stopping || queued.load() != 0; });
+	}
+}
+
+JobSystem& jobs()
+{
+	static JobSystem system;
+	return system;
+}
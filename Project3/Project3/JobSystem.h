@@ -0,0 +1,167 @@
+#ifndef _JOB_SYSTEM_H_
+#define _JOB_SYSTEM_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobCounter;
+
+// The app's one set of worker threads, for everything that runs off the render thread:
+// asset loads, loops split across the cores, log flushing. Each worker has its own queue
+// and takes the newest job in it first; one with nothing left steals the oldest job of
+// another, and jobs submitted from outside the workers go into a shared queue everyone
+// takes from. A thread waiting on jobs runs queued ones meanwhile.
+//
+// Jobs count down a JobCounter when they finish, and can be held back until another
+// counter is down to zero. GL work goes into a queue of its own that only the GL thread
+// runs, with runGlJobs() once a frame.
+//
+// Jobs come from a free list, and parallelFor's pieces carry no std::function, so once
+// the first frames have grown the list a frame's loops allocate nothing.
+class JobSystem
+{
+public:
+	JobSystem();
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// threads counts the caller, 0 is one per hardware thread, there is always at least one
+	// worker. Stops any old workers first.
+	void start(unsigned int threads = 0);
+	// Runs what is still queued, then joins the workers
+	void stop();
+	// Workers plus the thread that splits a loop with them
+	unsigned int threadCount() const { return (unsigned int)workers.size() + 1; }
+	// Every thread's index is below this: workers first, then the other threads as they
+	// first ask, the ones past MAX_OTHER_THREADS sharing the last index
+	enum { MAX_OTHER_THREADS = 4 };
+	unsigned int threadSlots() const { return threadCount() + MAX_OTHER_THREADS; }
+	unsigned int threadIndex();
+
+	//! Queues task to run on a worker.
+	// @input counter Raised now and lowered once task is done, for wait(), or nullptr
+	// @input after task only starts once this counter is down to zero, or nullptr
+	void submit(std::function<void()> task, JobCounter* counter = nullptr, JobCounter* after = nullptr);
+	// Returns once every job on counter is done, running queued jobs meanwhile
+	void wait(JobCounter& counter);
+
+	//! Calls body(begin, end, thread) for pieces of [0, count) until all of it is done.
+	// @input grain The smallest piece worth handing to a thread
+	// thread is threadIndex() of whoever runs the piece, below threadSlots(), for output
+	// kept per thread. Returns once every piece has run.
+	template <typename Body>
+	void parallelFor(size_t count, size_t grain, const Body& body)
+	{
+		split(count, grain, &invoke<Body>, &body);
+	}
+
+	// Only for the GL thread: queues task for the next runGlJobs, counted as submit() does
+	void submitGl(std::function<void()> task, JobCounter* counter = nullptr);
+	// Runs queued GL jobs in order until budgetMs is spent, at least one if there are any.
+	// Returns how many ran.
+	size_t runGlJobs(double budgetMs);
+
+	// Jobs taken out of another worker's queue since start
+	uint64_t steals() const { return stolen.load(std::memory_order_relaxed); }
+
+	// What the queues hold, public only so a JobCounter can hold jobs back
+	typedef void(*Piece)(const void* body, size_t begin, size_t end, unsigned int thread);
+	struct Job
+	{
+		std::function<void()> task;
+		// A loop piece instead of a task
+		Piece piece = nullptr;
+		const void* body = nullptr;
+		size_t begin = 0;
+		size_t end = 0;
+		JobCounter* counter = nullptr;
+		// The free list, or a counter's held back jobs
+		Job* next = nullptr;
+	};
+
+private:
+	template <typename Body>
+	static void invoke(const void* body, size_t begin, size_t end, unsigned int thread)
+	{
+		(*static_cast<const Body*>(body))(begin, end, thread);
+	}
+
+	// A ring that only grows, so a steady state never reallocates it
+	class Queue
+	{
+	public:
+		void pushBack(Job* job);
+		Job* popBack();
+		Job* popFront();
+
+		std::mutex lock;
+
+	private:
+		std::vector<Job*> ring;
+		size_t head = 0;
+		size_t count = 0;
+	};
+
+	Job* allocate();
+	void recycle(Job* job);
+	void enqueue(Job* job, int queue);
+	void hold(Job* job, JobCounter* after);
+	void execute(Job* job);
+	void finish(JobCounter* counter);
+	Job* find(unsigned int self);
+	void split(size_t count, size_t grain, Piece piece, const void* body);
+	void workerLoop(unsigned int self);
+
+	std::vector<std::thread> workers;
+	// One per worker, then the shared one
+	std::unique_ptr<Queue[]> queues;
+	unsigned int queueCount;
+	std::atomic<size_t> queued;
+	std::atomic<uint64_t> stolen;
+	std::atomic<unsigned int> otherThreads;
+
+	std::mutex freeLock;
+	Job* freeJobs;
+	std::vector<std::unique_ptr<Job[]>> blocks;
+
+	Queue glQueue;
+	// Goes up with every start, so threads know their index is from an older set of workers
+	uint64_t epoch;
+
+	std::mutex sleepLock;
+	std::condition_variable wake;
+	bool stopping;
+};
+
+// How many jobs submitted against it are not done yet. Reusable once it is back at zero.
+class JobCounter
+{
+public:
+	JobCounter() : count(0), waiting(nullptr) {}
+
+	JobCounter(const JobCounter&) = delete;
+	JobCounter& operator=(const JobCounter&) = delete;
+
+	bool done() const { return count.load(std::memory_order_acquire) == 0; }
+	int pending() const { return count.load(std::memory_order_acquire); }
+
+private:
+	friend class JobSystem;
+	std::atomic<int> count;
+	// Jobs held back until count is at zero
+	std::mutex lock;
+	JobSystem::Job* waiting;
+};
+
+JobSystem& jobs();
+
+#endif
@@ -0,0 +1,156 @@
+#include "LargePages.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cstdlib>
+#endif
+
+#include <algorithm>
+#include <iostream>
+
+static const char* USE_NAMES[] = { "image arena", "frame arena", "asset archive" };
+static const size_t SMALL_PAGE = 4096;
+
+static size_t roundUp(size_t bytes, size_t page)
+{
+	return (std::max<size_t>(bytes, 1) + page - 1) / page * page;
+}
+
+LargePages::LargePages() : tried(false), pageSize(0)
+{
+	for (Counts& count : counts) {
+		count.largeBlocks = 0;
+		count.smallBlocks = 0;
+		count.largeBytes = 0;
+		count.smallBytes = 0;
+		count.fallbacks = 0;
+		count.inUse = 0;
+		count.peak = 0;
+	}
+}
+
+bool LargePages::enable()
+{
+	if (tried) {
+		return enabled();
+	}
+	tried = true;
+#ifdef _WIN32
+	size_t minimum = GetLargePageMinimum();
+	if (!minimum) {
+		std::cerr << "memory.large_pages: this system has no large pages" << std::endl;
+		return false;
+	}
+	HANDLE token;
+	if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+		std::cerr << "memory.large_pages: could not open the process token (" << GetLastError() << ")" << std::endl;
+		return false;
+	}
+	TOKEN_PRIVILEGES privileges = {};
+	privileges.PrivilegeCount = 1;
+	privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+	bool granted = LookupPrivilegeValueA(nullptr, "SeLockMemoryPrivilege", &privileges.Privileges[0].Luid) &&
+		AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr) && GetLastError() != ERROR_NOT_ALL_ASSIGNED;
+	CloseHandle(token);
+	if (!granted) {
+		std::cerr << "memory.large_pages: the account does not have \"Lock pages in memory\", normal pages" << std::endl;
+		return false;
+	}
+	pageSize = minimum;
+	return true;
+#else
+	std::cerr << "memory.large_pages: Windows only, normal pages" << std::endl;
+	return false;
+#endif
+}
+
+void* LargePages::allocate(size_t bytes, Use use, size_t& taken)
+{
+	Counts& count = counts[use];
+	void* block = nullptr;
+#ifdef _WIN32
+	if (pageSize) {
+		taken = roundUp(bytes, pageSize);
+		block = VirtualAlloc(nullptr, taken, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+		if (block) {
+			count.largeBlocks++;
+			count.largeBytes += taken;
+		}
+		else {
+			// Physical memory too fragmented for another large page, or the lot in use
+			count.fallbacks++;
+		}
+	}
+	if (!block) {
+		taken = roundUp(bytes, SMALL_PAGE);
+		block = VirtualAlloc(nullptr, taken, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+		if (!block) {
+			return nullptr;
+		}
+		count.smallBlocks++;
+		count.smallBytes += taken;
+	}
+#else
+	taken = roundUp(bytes, SMALL_PAGE);
+	block = calloc(taken, 1);
+	if (!block) {
+		return nullptr;
+	}
+	count.smallBlocks++;
+	count.smallBytes += taken;
+#endif
+	uint64_t now = count.inUse += taken;
+	uint64_t peak = count.peak.load(std::memory_order_relaxed);
+	while (now > peak && !count.peak.compare_exchange_weak(peak, now, std::memory_order_relaxed)) {
+	}
+	return block;
+}
+
+void LargePages::free(void* block, size_t taken, Use use)
+{
+	if (!block) {
+		return;
+	}
+#ifdef _WIN32
+	VirtualFree(block, 0, MEM_RELEASE);
+#else
+	std::free(block);
+#endif
+	counts[use].inUse -= taken;
+}
+
+void LargePages::report(std::ostream& out) const
+{
+	bool any = false;
+	for (const Counts& count : counts) {
+		any = any || count.largeBlocks || count.smallBlocks;
+	}
+	if (!any) {
+		return;
+	}
+	out << "CPU memory blocks";
+	if (pageSize) {
+		out << " (large pages of " << (pageSize >> 10) << " KB)";
+	}
+	out << ":" << std::endl;
+	for (int use = 0; use < USES; use++) {
+		const Counts& count = counts[use];
+		if (!count.largeBlocks && !count.smallBlocks) {
+			continue;
+		}
+		out << "  " << USE_NAMES[use] << ": " << count.largeBlocks.load() << " in large pages ("
+			<< (count.largeBytes.load() >> 20) << " MB), " << count.smallBlocks.load() << " in 4 KB pages ("
+			<< (count.smallBytes.load() >> 20) << " MB), peak " << (count.peak.load() >> 20) << " MB";
+		if (count.fallbacks) {
+			out << ", " << count.fallbacks.load() << " fell back to small pages";
+		}
+		out << std::endl;
+	}
+}
+
+LargePages& largePages()
+{
+	static LargePages pages;
+	return pages;
+}
@@ -0,0 +1,70 @@
+#ifndef _LARGE_PAGES_H_
+#define _LARGE_PAGES_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+// Blocks of memory in large pages (2 MB on x64) where the OS gives them, for the big, long
+// lived buffers that are walked through from one end to the other: the image arena's blocks,
+// the frame arena and the asset archive. Each large page is one TLB entry where 4 KB pages
+// take 512, so streaming through hundreds of MB misses the TLB that much less often.
+//
+// Large pages are locked in memory, which on Windows takes the SeLockMemoryPrivilege (the
+// "Lock pages in memory" right of the account running the app) and physical memory that is
+// still in contiguous 2 MB pieces. enable() asks for the privilege; without it, or when an
+// allocation finds no large pages left, memory comes in normal pages as before. Sizes are
+// rounded up to whole large pages, so only blocks of a few MB or more are worth it.
+class LargePages
+{
+public:
+	enum Use { IMAGE_ARENA, FRAME_ARENA, ASSET_ARCHIVE, USES };
+
+	LargePages();
+
+	LargePages(const LargePages&) = delete;
+	LargePages& operator=(const LargePages&) = delete;
+
+	// Takes the privilege and finds the page size. False, with a message, if large pages are
+	// not to be had; allocate() then takes normal pages. Once is enough, later calls return
+	// what the first found.
+	bool enable();
+	bool enabled() const { return pageSize != 0; }
+	// 0 until enable() has succeeded
+	size_t largePageSize() const { return pageSize; }
+
+	//! Committed, zeroed read write memory, in large pages if they are enabled and there are
+	// enough of them, in normal ones otherwise.
+	// @input bytes Rounded up to the page size it comes in
+	// @input taken Receives the rounded size, what the block can hold and what free() wants
+	// @return nullptr if there is no memory at all
+	void* allocate(size_t bytes, Use use, size_t& taken);
+	// A block allocate() returned, with the taken size it gave
+	void free(void* block, size_t taken, Use use);
+
+	// Blocks and bytes per use and page size, with the allocations that wanted large pages
+	// and did not get them
+	void report(std::ostream& out) const;
+
+private:
+	struct Counts
+	{
+		std::atomic<uint64_t> largeBlocks;
+		std::atomic<uint64_t> smallBlocks;
+		std::atomic<uint64_t> largeBytes;
+		std::atomic<uint64_t> smallBytes;
+		std::atomic<uint64_t> fallbacks;
+		// The most in use at once, both page sizes
+		std::atomic<uint64_t> inUse;
+		std::atomic<uint64_t> peak;
+	};
+
+	bool tried;
+	size_t pageSize;
+	Counts counts[USES];
+};
+
+LargePages& largePages();
+
+#endif
@@ -0,0 +1,201 @@
+#include "LatencyProbe.h"
+#include "CpuProfiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+static const char* STAGE_NAMES[LatencyProbe::STAGES] = { "render", "submit", "display" };
+
+LatencyProbe::LatencyProbe() : now(nullptr), head(0), count(0)
+{
+	memset(&current, 0, sizeof(current));
+	traceTracks[0] = traceTracks[1] = -1;
+}
+
+const char* LatencyProbe::name(int stage)
+{
+	return stage >= 0 && stage < STAGES ? STAGE_NAMES[stage] : "-";
+}
+
+void LatencyProbe::init(double (*now)(), size_t history)
+{
+	this->now = now;
+	this->history.assign(std::max<size_t>(history, MATCH_FRAMES), Frame());
+	head = 0;
+	count = 0;
+	if (traceTracks[0] < 0) {
+		traceTracks[0] = cpuProfiler().track("motion to photon");
+		traceTracks[1] = cpuProfiler().track("motion to photon display");
+	}
+}
+
+void LatencyProbe::beginFrame(int64_t index, double displayTime, double poseTime)
+{
+	if (!now) {
+		return;
+	}
+	memset(&current, 0, sizeof(current));
+	current.index = index;
+	current.displayTime = displayTime;
+	current.poseTime = poseTime;
+}
+
+void LatencyProbe::beginSubmit(double sampleTime)
+{
+	if (!now) {
+		return;
+	}
+	current.sampleTime = sampleTime;
+	current.submitStart = now();
+}
+
+int64_t LatencyProbe::traceTicks(double time, double nowTime, int64_t nowTicks) const
+{
+	return nowTicks + (int64_t)((time - nowTime) * cpuProfiler().ticksPerSecond());
+}
+
+void LatencyProbe::endSubmit()
+{
+	if (!now) {
+		return;
+	}
+	Frame& f = current;
+	f.submitEnd = now();
+	f.stages[RENDER] = (float)(f.submitStart - f.sampleTime);
+	f.stages[SUBMIT] = (float)(f.submitEnd - f.submitStart);
+	f.stages[DISPLAY] = (float)(f.displayTime - f.submitEnd);
+	f.estimate = (float)(f.displayTime - f.sampleTime);
+	f.reported = -1.0f;
+	history[head] = f;
+	head = (head + 1) % history.size();
+	count = std::min(count + 1, history.size());
+
+	CpuProfiler& profiler = cpuProfiler();
+	if (!profiler.enabled()) {
+		return;
+	}
+	// Both clocks read back to back, the SDK's times moved onto the profiler's from there
+	int64_t nowTicks = profiler.ticks();
+	double nowTime = now();
+	profiler.recordTo(traceTracks[0], STAGE_NAMES[RENDER], traceTicks(f.sampleTime, nowTime, nowTicks),
+		traceTicks(f.submitStart, nowTime, nowTicks), (int)f.index);
+	profiler.recordTo(traceTracks[0], STAGE_NAMES[SUBMIT], traceTicks(f.submitStart, nowTime, nowTicks),
+		traceTicks(f.submitEnd, nowTime, nowTicks), (int)f.index);
+	profiler.recordTo(traceTracks[1], STAGE_NAMES[DISPLAY], traceTicks(f.submitEnd, nowTime, nowTicks),
+		traceTicks(f.displayTime, nowTime, nowTicks), (int)f.index);
+	profiler.counter("motion to photon estimate us", (int)(f.estimate * 1.0e6f));
+}
+
+void LatencyProbe::compositorFrame(const CompositorFrame& reported)
+{
+	if (!now) {
+		return;
+	}
+	for (size_t age = 0; age < std::min<size_t>(count, MATCH_FRAMES); age++) {
+		Frame& f = history[(head + history.size() - 1 - age) % history.size()];
+		if (f.index != reported.appFrameIndex) {
+			continue;
+		}
+		f.reported = reported.motionToPhoton;
+		f.queueAhead = reported.queueAhead;
+		f.appGpu = reported.appGpu;
+		f.compositorCpuToGpuEnd = reported.compositorCpuToGpuEnd;
+		f.compositorGpuEndToVsync = reported.compositorGpuEndToVsync;
+		if (cpuProfiler().enabled()) {
+			cpuProfiler().counter("motion to photon reported us", (int)(f.reported * 1.0e6f));
+		}
+		return;
+	}
+}
+
+bool LatencyProbe::latest(Frame& out) const
+{
+	if (!count) {
+		return false;
+	}
+	out = recent(0);
+	return true;
+}
+
+bool LatencyProbe::latestReported(Frame& out) const
+{
+	for (size_t age = 0; age < std::min<size_t>(count, MATCH_FRAMES); age++) {
+		if (recent(age).reported >= 0.0f) {
+			out = recent(age);
+			return true;
+		}
+	}
+	return false;
+}
+
+void LatencyProbe::report(std::ostream& out) const
+{
+	if (!count) {
+		return;
+	}
+	double stages[STAGES] = {};
+	double estimate = 0.0, reported = 0.0, horizon = 0.0, queueAhead = 0.0, appGpu = 0.0, compositor = 0.0, vsync = 0.0;
+	size_t matched = 0;
+	for (size_t age = 0; age < count; age++) {
+		const Frame& f = recent(age);
+		for (int s = 0; s < STAGES; s++) {
+			stages[s] += f.stages[s];
+		}
+		estimate += f.estimate;
+		if (f.reported < 0.0f) {
+			continue;
+		}
+		matched++;
+		reported += f.reported;
+		horizon += f.poseTime - f.sampleTime;
+		queueAhead += f.queueAhead;
+		appGpu += f.appGpu;
+		compositor += f.compositorCpuToGpuEnd;
+		vsync += f.compositorGpuEndToVsync;
+	}
+	char line[256];
+	snprintf(line, sizeof(line), "motion to photon over %llu frames: %.2f ms estimated (render %.2f, submit %.2f, display %.2f)",
+		(unsigned long long)count, estimate * 1000.0 / count, stages[RENDER] * 1000.0 / count, stages[SUBMIT] * 1000.0 / count,
+		stages[DISPLAY] * 1000.0 / count);
+	out << line << std::endl;
+	if (!matched) {
+		return;
+	}
+	snprintf(line, sizeof(line), "  %llu reported: %.2f ms (queue ahead %.2f, app GPU %.2f, compositor %.2f, to vsync %.2f),"
+		" poses predicted %.2f ms ahead", (unsigned long long)matched, reported * 1000.0 / matched, queueAhead * 1000.0 / matched,
+		appGpu * 1000.0 / matched, compositor * 1000.0 / matched, vsync * 1000.0 / matched, horizon * 1000.0 / matched);
+	out << line << std::endl;
+}
+
+bool LatencyProbe::writeCsv(const char* filename) const
+{
+	std::ofstream file(filename);
+	if (!file.is_open()) {
+		std::cerr << "could not write latency to " << filename << std::endl;
+		return false;
+	}
+	file << "frame,estimate_ms";
+	for (int s = 0; s < STAGES; s++) {
+		file << ',' << STAGE_NAMES[s] << "_ms";
+	}
+	file << ",prediction_ms,reported_ms,queue_ahead_ms,app_gpu_ms,compositor_ms,to_vsync_ms\n";
+	for (size_t age = count; age-- > 0;) {
+		const Frame& f = recent(age);
+		file << f.index << ',' << f.estimate * 1000.0f;
+		for (int s = 0; s < STAGES; s++) {
+			file << ',' << f.stages[s] * 1000.0f;
+		}
+		file << ',' << (f.poseTime - f.sampleTime) * 1000.0;
+		// Frames the compositor never reported are left empty
+		if (f.reported < 0.0f) {
+			file << ",,,,,\n";
+			continue;
+		}
+		file << ',' << f.reported * 1000.0f << ',' << f.queueAhead * 1000.0f << ',' << f.appGpu * 1000.0f << ','
+			<< f.compositorCpuToGpuEnd * 1000.0f << ',' << f.compositorGpuEndToVsync * 1000.0f << '\n';
+	}
+	return true;
+}
@@ -0,0 +1,105 @@
+#ifndef _LATENCY_PROBE_H_
+#define _LATENCY_PROBE_H_
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// Motion-to-photon estimates for every submitted frame (latency.probe). The frame's times on
+// the compositor's clock are marked as the loop passes them: the head sample the eye layer
+// goes out with (SensorSampleTime, after any late latch), the time its pose was predicted
+// for, ovr_SubmitFrame's start and end and the display time the frame was predicted for. The
+// estimate is display time less sample time, split into three stages:
+//
+//   render    sample to the start of the submit, what the app spends on the frame's CPU side
+//   submit    ovr_SubmitFrame itself, the wait for the compositor's queue
+//   display   the end of the submit to the predicted display time: GPU, compositor, scanout
+//
+// When ovr_GetPerfStats reports the frame, it is matched by frame index and gets the
+// compositor's own motion-to-photon and its breakdown: queue ahead, the app's GPU time, the
+// compositor's CPU start to GPU end and its GPU end to vsync. The gap between the pose's
+// prediction horizon and the reported latency is what the head prediction was off by.
+//
+// The stages go to the CPU trace on the profiler's clock, render and submit on one track and
+// display on another, since it runs on while the next frame renders, with the estimate and
+// the reported latency as counters. The newest frame goes to the performance HUD, the last
+// frames are kept for the CSV.
+class LatencyProbe
+{
+public:
+	enum Stage { RENDER, SUBMIT, DISPLAY, STAGES };
+	// Frames a report may come back after its submit and still be matched
+	enum { MATCH_FRAMES = 16 };
+
+	struct Frame
+	{
+		int64_t index;
+		double sampleTime;
+		double poseTime;
+		double submitStart;
+		double submitEnd;
+		double displayTime;
+		// Seconds, the estimate is their sum
+		float stages[STAGES];
+		float estimate;
+		// The compositor's, -1 until it reports the frame
+		float reported;
+		float queueAhead;
+		float appGpu;
+		float compositorCpuToGpuEnd;
+		float compositorGpuEndToVsync;
+	};
+
+	// What ovr_GetPerfStats says about one of our frames
+	struct CompositorFrame
+	{
+		int64_t appFrameIndex;
+		float motionToPhoton;
+		float queueAhead;
+		float appGpu;
+		float compositorCpuToGpuEnd;
+		float compositorGpuEndToVsync;
+	};
+
+	LatencyProbe();
+
+	//! Starts probing.
+	// @input now The clock the SDK's times are on, ovr_GetTimeInSeconds with a session
+	// @input history How many of the last frames to keep for the CSV
+	void init(double (*now)(), size_t history);
+	bool active() const { return now != nullptr; }
+
+	// Once the frame's tracking is read
+	// @input poseTime The time the head pose was predicted for
+	void beginFrame(int64_t index, double displayTime, double poseTime);
+	// Around ovr_SubmitFrame, sampleTime being the SensorSampleTime the eye layer carries.
+	// endSubmit closes the frame.
+	void beginSubmit(double sampleTime);
+	void endSubmit();
+	// Matches a frame the compositor reported to its submit, ignored if it is too old
+	void compositorFrame(const CompositorFrame& reported);
+
+	// The newest submitted frame, false before the first
+	bool latest(Frame& out) const;
+	// The newest frame the compositor has reported, false if none of the recent ones is
+	bool latestReported(Frame& out) const;
+	// Averages over the frames kept, estimated and reported
+	void report(std::ostream& out) const;
+	bool writeCsv(const char* filename) const;
+
+	static const char* name(int stage);
+
+private:
+	const Frame& recent(size_t age) const { return history[(head + history.size() - 1 - age) % history.size()]; }
+	// A time on now's clock on the profiler's, for the trace
+	int64_t traceTicks(double time, double nowTime, int64_t nowTicks) const;
+
+	double (*now)();
+	Frame current;
+	std::vector<Frame> history;
+	size_t head;
+	size_t count;
+	int traceTracks[2];
+};
+
+#endif
@@ -0,0 +1,94 @@
+#include "LayoutReloader.h"
+#include "Log.h"
+#include "TextureCache.h"
+
+#include <chrono>
+#include <iostream>
+
+static double secondsNow()
+{
+	using namespace std::chrono;
+	return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+LayoutReloader::LayoutReloader() : wallCount(0), interval(0.5), lastCheck(0.0), lastStamp(0), reloaded(0), parsePending(false)
+{
+}
+
+LayoutReloader::~LayoutReloader()
+{
+	if (parsePending) {
+		jobs().wait(parsing);
+	}
+}
+
+void LayoutReloader::configure(const std::string& filename, size_t walls, int intervalMs)
+{
+	file = filename;
+	wallCount = walls;
+	interval = (intervalMs > 0 ? intervalMs : 500) / 1000.0;
+	lastCheck = secondsNow();
+	lastStamp = stamp();
+	reloaded = 0;
+}
+
+uint64_t LayoutReloader::stamp() const
+{
+	uint64_t size = 0, time = 0;
+	sourceFileStamp(file.c_str(), size, time);
+	return (14695981039346656037ull ^ size) * 1099511628211ull ^ time;
+}
+
+void LayoutReloader::parse()
+{
+	std::unique_ptr<CaveLayout> layout(new CaveLayout());
+	std::string error;
+	if (!layout->load(file.c_str())) {
+		layout.reset();
+	}
+	else if (layout->size() != wallCount) {
+		std::cerr << "CAVE layout " << file << " has " << layout->size() << " walls, the running one " << wallCount
+			<< ": restart for a different number, keeping the current walls" << std::endl;
+		layout.reset();
+	}
+	else if (!layout->check(error)) {
+		std::cerr << "CAVE layout " << file << ": " << error << ", keeping the current walls" << std::endl;
+		layout.reset();
+	}
+	parsed = std::move(layout);
+}
+
+bool LayoutReloader::update(CaveLayout& layout)
+{
+	if (file.empty()) {
+		return false;
+	}
+	if (parsePending) {
+		if (!parsing.done()) {
+			return false;
+		}
+		parsePending = false;
+		if (parsed) {
+			layout = *parsed;
+			parsed.reset();
+			reloaded++;
+			logStream(LOG_INFO) << "reloaded CAVE layout " << file << std::endl;
+			return true;
+		}
+	}
+
+	double now = secondsNow();
+	if (now - lastCheck < interval) {
+		return false;
+	}
+	lastCheck = now;
+	uint64_t current = stamp();
+	if (current == lastStamp) {
+		return false;
+	}
+	// An editor may still be writing, the next change parses it again anyway
+	lastStamp = current;
+	parsePending = true;
+	jobs().submit([this]() { parse(); }, &parsing);
+	return false;
+}
@@ -0,0 +1,56 @@
+#ifndef _LAYOUT_RELOADER_H_
+#define _LAYOUT_RELOADER_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "CaveLayout.h"
+#include "JobSystem.h"
+
+// Reads a CAVE layout file again when it changes, for moving the walls on site without a
+// restart. update() looks at the file's time every so often; a changed file is parsed and
+// checked on a worker (jobs()), and a later update() hands the layout it gave over, so the
+// render thread never waits on the file and the caller swaps the walls between frames.
+//
+// The number of walls is fixed when the app starts (programs and targets are made per
+// layer), a layout with another number keeps the current one, as does one that does not
+// load or check out (CaveLayout::check). Why is on the console.
+class LayoutReloader
+{
+public:
+	LayoutReloader();
+	// Waits for a parse still running
+	~LayoutReloader();
+
+	LayoutReloader(const LayoutReloader&) = delete;
+	LayoutReloader& operator=(const LayoutReloader&) = delete;
+
+	//! Watches filename, whose layout has walls walls.
+	// @input intervalMs How often the file's time is looked at
+	void configure(const std::string& filename, size_t walls, int intervalMs);
+	bool enabled() const { return !file.empty(); }
+
+	//! Looks at the file when it is time, and takes what a parse made.
+	// @return Whether layout holds a new, checked layout
+	bool update(CaveLayout& layout);
+	// Layouts handed over since configure
+	uint64_t reloads() const { return reloaded; }
+
+private:
+	uint64_t stamp() const;
+	void parse();
+
+	std::string file;
+	size_t wallCount;
+	double interval;
+	double lastCheck;
+	uint64_t lastStamp;
+	uint64_t reloaded;
+	// The worker's parse, only looked at once parsing is done
+	JobCounter parsing;
+	bool parsePending;
+	std::unique_ptr<CaveLayout> parsed;
+};
+
+#endif
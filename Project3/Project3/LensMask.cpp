@@ -0,0 +1,96 @@
+#include "LensMask.h"
+#include "GLState.h"
+#include "GLStats.h"
+#include "GpuMemory.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// How far past the ellipse the outer edge of the ring goes, in NDC. Beyond the viewport
+// from anywhere inside it, the rest is clipped away.
+static const float RING_REACH = 4.f;
+
+LensMask::LensMask() : vao(0), vbo(0)
+{
+}
+
+LensMask::~LensMask()
+{
+	release();
+}
+
+void LensMask::release()
+{
+	if (vao) {
+		glDeleteVertexArrays(1, &vao);
+		gpuMemory().release(GpuMemory::KIND_BUFFER, vbo);
+		glDeleteBuffers(1, &vbo);
+		vao = vbo = 0;
+	}
+}
+
+bool LensMask::init(const float tangents[2][4], float scale)
+{
+	if (!program.load("lensMask.vert", "lensMask.frag")) {
+		return false;
+	}
+	scale = std::max(scale, 0.01f);
+
+	// Per eye a strip from the ellipse out past the viewport, in NDC
+	std::vector<float> ring;
+	ring.reserve(2 * VERTICES * 2);
+	for (int eye = 0; eye < 2; eye++) {
+		float up = tangents[eye][0], down = tangents[eye][1], left = tangents[eye][2], right = tangents[eye][3];
+		// Where the lens axis (tangent 0) lands
+		float axisX = (left - right) / (left + right);
+		float axisY = (down - up) / (up + down);
+		for (int i = 0; i <= SEGMENTS; i++) {
+			float angle = 6.2831853f * (float)i / (float)SEGMENTS;
+			float c = std::cos(angle), s = std::sin(angle);
+			float tanX = c * (c >= 0.f ? right : left) * scale;
+			float tanY = s * (s >= 0.f ? up : down) * scale;
+			float x = (2.f * tanX - (right - left)) / (left + right);
+			float y = (2.f * tanY - (up - down)) / (up + down);
+			float dx = x - axisX, dy = y - axisY;
+			float length = std::max(std::sqrt(dx * dx + dy * dy), 1e-6f);
+			ring.insert(ring.end(), { x, y, x + dx / length * RING_REACH, y + dy / length * RING_REACH });
+		}
+	}
+
+	glGenVertexArrays(1, &vao);
+	glGenBuffers(1, &vbo);
+	glState().bindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferStorage(GL_ARRAY_BUFFER, ring.size() * sizeof(float), ring.data(), 0);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (GLvoid*)0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glState().bindVertexArray(0);
+	gpuMemory().allocate(GpuMemory::KIND_BUFFER, vbo, ring.size() * sizeof(float), GpuMemory::MESH, "lens mask");
+	return true;
+}
+
+void LensMask::draw(int eye, bool stencil)
+{
+	// Written at the near plane, nothing drawn later passes GL_LESS or GL_LEQUAL there
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_ALWAYS);
+	glState().depthMask(true);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	// Marked like a wall marks it, so a draw that tests the stencil and not depth skips it too
+	if (stencil) {
+		glEnable(GL_STENCIL_TEST);
+		glStencilFunc(GL_ALWAYS, 1, 0xff);
+		glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+	}
+	glState().useProgram(program.id());
+	glState().bindVertexArray(vao);
+	glDrawArrays(GL_TRIANGLE_STRIP, eye * VERTICES, VERTICES);
+	glStats().addDraw();
+
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glDepthFunc(GL_LESS);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_STENCIL_TEST);
+}
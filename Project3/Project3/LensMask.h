@@ -0,0 +1,52 @@
+#ifndef _LENS_MASK_H_
+#define _LENS_MASK_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include "ShaderProgram.h"
+
+// The part of an eye buffer viewport the lens does not show, primed into depth (and the
+// stencil, if the buffer has one) right after the clear so every later draw of the eye is
+// rejected there before it is shaded.
+//
+// The SDK this is built with has no hidden area mesh of its own, so the visible region is
+// taken as an ellipse in tangent space around the lens axis, through the middles of the
+// edges of the eye's FOV port (each half of an axis its own radius, for the asymmetric
+// ports), times scale. Everything outside it, the corners of the port, is masked.
+class LensMask
+{
+public:
+	enum { SEGMENTS = 64, VERTICES = 2 * (SEGMENTS + 1) };
+
+	LensMask();
+	~LensMask();
+
+	LensMask(const LensMask&) = delete;
+	LensMask& operator=(const LensMask&) = delete;
+
+	//! Builds both eyes' masks.
+	// @input tangents Per eye the FOV port's up, down, left and right tangents
+	// @input scale Of the ellipse, above 1 masks less
+	bool init(const float tangents[2][4], float scale);
+	bool valid() const { return vao != 0; }
+	// Deletes the mask's vertex array and buffer
+	void release();
+
+	//! Masks the eye's part of the bound framebuffer, with its viewport set, writing 1 to
+	// the stencil too if stencil. Leaves depth writes on, the depth test off with GL_LESS,
+	// the stencil test off and the color mask on.
+	void draw(int eye, bool stencil);
+
+private:
+	ShaderProgram program;
+	GLuint vao;
+	GLuint vbo;
+};
+
+#endif
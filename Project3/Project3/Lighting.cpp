@@ -0,0 +1,284 @@
+#include "Lighting.h"
+#include "GLMarkers.h"
+#include "GLState.h"
+#include "GpuMemory.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+Lighting::Lighting() : lightCount(0), boundsMin(0.f), boundsMax(0.f), dirty(true), shadowSize(0), binned(0)
+{
+	block = LightingBlock();
+	block.sunDirection = glm::vec4(glm::normalize(glm::vec3(0.4f, 1.f, 0.3f)), 0.f);
+	block.sunColor = glm::vec4(0.8f, 0.78f, 0.7f, 0.f);
+	block.ambientColor = glm::vec4(0.25f, 0.25f, 0.3f, 0.f);
+}
+
+Lighting::~Lighting()
+{
+	release();
+}
+
+void Lighting::release()
+{
+	for (GLuint buffer : { ubo.get(), cellBuffer.get(), indexBuffer.get() }) {
+		if (buffer) {
+			gpuMemory().release(GpuMemory::KIND_BUFFER, buffer);
+		}
+	}
+	if (shadowMap.get()) {
+		gpuMemory().release(GpuMemory::KIND_TEXTURE, shadowMap);
+	}
+	shadowFramebuffer.reset();
+	shadowMap.reset();
+	cellView.reset();
+	indexView.reset();
+	cellBuffer.reset();
+	indexBuffer.reset();
+	ubo.reset();
+}
+
+bool Lighting::init(const glm::vec3& boundsMin, const glm::vec3& boundsMax, int shadowSize)
+{
+	release();
+	this->boundsMin = boundsMin;
+	this->boundsMax = boundsMax;
+	this->shadowSize = std::max(shadowSize, 16);
+	block.gridMin = glm::vec4(boundsMin, 0.f);
+	block.gridCellSize = glm::vec4((boundsMax - boundsMin) / glm::vec3(GRID_X, GRID_Y, GRID_Z), 0.f);
+	block.gridCells = glm::ivec4(GRID_X, GRID_Y, GRID_Z, (int)lightCount);
+	cells.assign(CELLS * 2, 0);
+	indices.reserve(CELLS);
+
+	ubo.create();
+	glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(LightingBlock), nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	gpuMemory().allocate(GpuMemory::KIND_BUFFER, ubo, sizeof(LightingBlock), GpuMemory::STREAMING, "lighting block");
+
+	// Every light in every cell is the most the index list can ever hold
+	GLsizeiptr indexBytes = (GLsizeiptr)CELLS * LightingBlock::MAX_LIGHTS * sizeof(uint16_t);
+	cellBuffer.create();
+	indexBuffer.create();
+	glBindBuffer(GL_TEXTURE_BUFFER, cellBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, cells.size() * sizeof(uint32_t), nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, indexBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, indexBytes, nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	gpuMemory().allocate(GpuMemory::KIND_BUFFER, cellBuffer, cells.size() * sizeof(uint32_t), GpuMemory::STREAMING, "light grid");
+	gpuMemory().allocate(GpuMemory::KIND_BUFFER, indexBuffer, indexBytes, GpuMemory::STREAMING, "light indices");
+
+	cellView.create();
+	glState().bindTexture(CELL_UNIT, GL_TEXTURE_BUFFER, cellView);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, cellBuffer);
+	indexView.create();
+	glState().bindTexture(INDEX_UNIT, GL_TEXTURE_BUFFER, indexView);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_R16UI, indexBuffer);
+
+	// Compared in the lookup, and lit outside the map
+	shadowMap.create();
+	glState().bindTexture(SHADOW_UNIT, GL_TEXTURE_2D, shadowMap);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, this->shadowSize, this->shadowSize, 0, GL_DEPTH_COMPONENT,
+		GL_FLOAT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	const GLfloat border[4] = { 1.f, 1.f, 1.f, 1.f };
+	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	gpuMemory().allocate(GpuMemory::KIND_TEXTURE, shadowMap, (uint64_t)this->shadowSize * this->shadowSize * 4,
+		GpuMemory::RENDER_TARGET, "shadow map");
+
+	shadowFramebuffer.create();
+	glMarkers().label(GL_FRAMEBUFFER, shadowFramebuffer, "shadow map");
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, shadowFramebuffer);
+	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, shadowMap, 0);
+	glDrawBuffer(GL_NONE);
+	bool complete = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	if (!complete) {
+		release();
+		return false;
+	}
+	dirty = true;
+	return true;
+}
+
+void Lighting::setSun(const glm::vec3& direction, const glm::vec3& color)
+{
+	block.sunDirection = glm::vec4(glm::normalize(direction), 0.f);
+	block.sunColor = glm::vec4(color, 0.f);
+	dirty = true;
+}
+
+void Lighting::setAmbient(const glm::vec3& color)
+{
+	block.ambientColor = glm::vec4(color, 0.f);
+	dirty = true;
+}
+
+bool Lighting::setPointLight(size_t i, const glm::vec3& position, float radius, const glm::vec3& color)
+{
+	if (i > lightCount || i >= LightingBlock::MAX_LIGHTS) {
+		return false;
+	}
+	block.lightPositions[i] = glm::vec4(position, std::max(radius, 1e-3f));
+	block.lightColors[i] = glm::vec4(color, 0.f);
+	lightCount = std::max(lightCount, i + 1);
+	block.gridCells.w = (int)lightCount;
+	dirty = true;
+	return true;
+}
+
+void Lighting::bin()
+{
+	// Counted first, so that each cell's range can be laid out before it is filled
+	std::fill(cells.begin(), cells.end(), 0u);
+	glm::vec3 cellSize(block.gridCellSize);
+	glm::ivec3 last(GRID_X - 1, GRID_Y - 1, GRID_Z - 1);
+	glm::ivec3 from[LightingBlock::MAX_LIGHTS], to[LightingBlock::MAX_LIGHTS];
+	for (size_t l = 0; l < lightCount; l++) {
+		glm::vec3 center(block.lightPositions[l]);
+		float radius = block.lightPositions[l].w;
+		from[l] = glm::clamp(glm::ivec3(glm::floor((center - radius - boundsMin) / cellSize)), glm::ivec3(0), last);
+		to[l] = glm::clamp(glm::ivec3(glm::floor((center + radius - boundsMin) / cellSize)), glm::ivec3(0), last);
+		// Entirely outside the box on some axis
+		glm::vec3 reachMin = center - radius, reachMax = center + radius;
+		if (glm::any(glm::lessThan(reachMax, boundsMin)) || glm::any(glm::greaterThan(reachMin, boundsMax))) {
+			to[l] = from[l] - 1;
+		}
+		for (int z = from[l].z; z <= to[l].z; z++) {
+			for (int y = from[l].y; y <= to[l].y; y++) {
+				for (int x = from[l].x; x <= to[l].x; x++) {
+					cells[((z * GRID_Y + y) * GRID_X + x) * 2 + 1]++;
+				}
+			}
+		}
+	}
+	uint32_t next = 0;
+	for (size_t c = 0; c < CELLS; c++) {
+		cells[c * 2] = next;
+		next += cells[c * 2 + 1];
+		cells[c * 2 + 1] = 0;
+	}
+	binned = next;
+	indices.resize(next);
+	for (size_t l = 0; l < lightCount; l++) {
+		for (int z = from[l].z; z <= to[l].z; z++) {
+			for (int y = from[l].y; y <= to[l].y; y++) {
+				for (int x = from[l].x; x <= to[l].x; x++) {
+					uint32_t* cell = &cells[((z * GRID_Y + y) * GRID_X + x) * 2];
+					indices[cell[0] + cell[1]++] = (uint16_t)l;
+				}
+			}
+		}
+	}
+}
+
+void Lighting::updateSunMatrix()
+{
+	// An orthographic view of the whole box, from far enough along the sun's direction
+	glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+	float radius = std::max(glm::length(boundsMax - boundsMin) * 0.5f, 1e-3f);
+	glm::vec3 toSun(block.sunDirection);
+	glm::vec3 up = std::abs(toSun.y) > 0.99f ? glm::vec3(0.f, 0.f, 1.f) : glm::vec3(0.f, 1.f, 0.f);
+	glm::mat4 view = glm::lookAt(center + toSun * (2.f * radius), center, up);
+	glm::mat4 projection = glm::ortho(-radius, radius, -radius, radius, radius, 3.f * radius);
+	block.sunViewProjection = projection * view;
+}
+
+void Lighting::beginFrame()
+{
+	if (!valid() || !dirty) {
+		return;
+	}
+	bin();
+	updateSunMatrix();
+	glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(LightingBlock), &block);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, cellBuffer);
+	glBufferSubData(GL_TEXTURE_BUFFER, 0, cells.size() * sizeof(uint32_t), cells.data());
+	if (!indices.empty()) {
+		glBindBuffer(GL_TEXTURE_BUFFER, indexBuffer);
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, indices.size() * sizeof(uint16_t), indices.data());
+	}
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	dirty = false;
+}
+
+void Lighting::beginShadows(GLint& boundFramebuffer, GLint* viewport)
+{
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &boundFramebuffer);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, shadowFramebuffer);
+	glViewport(0, 0, shadowSize, shadowSize);
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LESS);
+	glState().depthMask(true);
+	glClear(GL_DEPTH_BUFFER_BIT);
+	// Pushed back a little, so a surface does not shadow itself
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(2.f, 4.f);
+	bindBlock();
+}
+
+void Lighting::endShadows(GLint boundFramebuffer, const GLint* viewport)
+{
+	glDisable(GL_POLYGON_OFFSET_FILL);
+	glDisable(GL_DEPTH_TEST);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, (GLuint)boundFramebuffer);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+void Lighting::bindBlock() const
+{
+	glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, ubo);
+}
+
+std::string Lighting::shaderDefines()
+{
+	return "#define LIGHTING\n"
+		"#define MAX_LIGHTS " + std::to_string((int)LightingBlock::MAX_LIGHTS) + "\n"
+		// One macro, so only the stages that expand it have it. LightingBlock, member for member.
+		"#define LIGHTING_DECLARATIONS \\\n"
+		"layout (std140) uniform Lighting { \\\n"
+		"	mat4 sunViewProjection; \\\n"
+		"	vec4 sunDirection; \\\n"
+		"	vec4 sunColor; \\\n"
+		"	vec4 ambientColor; \\\n"
+		"	vec4 gridMin; \\\n"
+		"	vec4 gridCellSize; \\\n"
+		"	ivec4 gridCells; \\\n"
+		"	vec4 lightPositions[MAX_LIGHTS]; \\\n"
+		"	vec4 lightColors[MAX_LIGHTS]; \\\n"
+		"}; \\\n"
+		"uniform sampler2DShadow shadowMap; \\\n"
+		"uniform usamplerBuffer lightCells; \\\n"
+		"uniform usamplerBuffer lightIndices; \\\n"
+		// Diffuse light arriving at position on a surface facing normal: ambient, the sun where
+		// the shadow map has nothing in front of it, and the point lights of the position's cell
+		"vec3 lightAt(vec3 position, vec3 normal) \\\n"
+		"{ \\\n"
+		"	vec3 light = ambientColor.rgb; \\\n"
+		"	vec4 shadow = sunViewProjection * vec4(position, 1.0); \\\n"
+		"	float sunlit = texture(shadowMap, shadow.xyz / shadow.w * 0.5 + 0.5); \\\n"
+		"	light += sunColor.rgb * max(dot(normal, sunDirection.xyz), 0.0) * sunlit; \\\n"
+		"	ivec3 cell = ivec3(floor((position - gridMin.xyz) / gridCellSize.xyz)); \\\n"
+		"	if (all(greaterThanEqual(cell, ivec3(0))) && all(lessThan(cell, gridCells.xyz))) { \\\n"
+		"		uvec2 range = texelFetch(lightCells, (cell.z * gridCells.y + cell.y) * gridCells.x + cell.x).xy; \\\n"
+		"		for (uint i = 0u; i < range.y; i++) { \\\n"
+		"			int l = int(texelFetch(lightIndices, int(range.x + i)).r); \\\n"
+		"			vec3 toLight = lightPositions[l].xyz - position; \\\n"
+		"			float distance = length(toLight); \\\n"
+		"			float falloff = clamp(1.0 - distance / lightPositions[l].w, 0.0, 1.0); \\\n"
+		"			light += lightColors[l].rgb * max(dot(normal, toLight / max(distance, 1e-4)), 0.0) * falloff * falloff; \\\n"
+		"		} \\\n"
+		"	} \\\n"
+		"	return light; \\\n"
+		"}\n";
+}
@@ -0,0 +1,144 @@
+#ifndef _LIGHTING_H_
+#define _LIGHTING_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "GLHandle.h"
+
+// The std140 Lighting uniform block of the lit scene shaders (LIGHTING) and shadow.vert.
+// Every member is a multiple of 16 bytes, so this matches the block byte for byte.
+struct LightingBlock
+{
+	enum { MAX_LIGHTS = 64 };
+
+	glm::mat4 sunViewProjection;
+	// Towards the sun
+	glm::vec4 sunDirection;
+	glm::vec4 sunColor;
+	glm::vec4 ambientColor;
+	// The light grid's corner and the size of a cell, w unused
+	glm::vec4 gridMin;
+	glm::vec4 gridCellSize;
+	// Cells along x, y and z, and the light count in w
+	glm::ivec4 gridCells;
+	// xyz and the radius the light reaches in w
+	glm::vec4 lightPositions[MAX_LIGHTS];
+	glm::vec4 lightColors[MAX_LIGHTS];
+};
+
+// What the scene's lighting needs that does not depend on where it is seen from, made once a
+// frame for every view of it: all the walls of all the viewers, and the shading cache. The
+// naive way, each wall pass culling the lights against its frustum and rendering the shadows
+// it needs, would do the same work once per wall.
+//
+// A sun lights everything, with a shadow map of the grid's box from its direction. Point
+// lights light what is within their radius, found through a grid of cells over the box in
+// world space: per cell the lights that reach into it, as a range of a light index list. The
+// grid is a pair of texture buffers (a cell's first index and count, the indices), made on
+// the CPU again only when a light changed. The shaders look up the cell of the point shaded
+// and go through its lights, so a point pays only for the lights near it.
+//
+// The lighting is diffuse only, so that it is the same from every eye and can be shaded once
+// into the shading cache.
+class Lighting
+{
+public:
+	// The block's binding and the units of the shadow map and the grid's texture buffers
+	enum { BINDING = 1, SHADOW_UNIT = 4, CELL_UNIT = 5, INDEX_UNIT = 6 };
+	enum { GRID_X = 16, GRID_Y = 8, GRID_Z = 16, CELLS = GRID_X * GRID_Y * GRID_Z };
+
+	Lighting();
+	~Lighting();
+
+	Lighting(const Lighting&) = delete;
+	Lighting& operator=(const Lighting&) = delete;
+
+	//! #define LIGHTING, and LIGHTING_DECLARATIONS: the block, the shadow map and grid
+	// samplers and lightAt(position, normal), which a lit shader expands where it needs them.
+	// For ShaderProgram::begin, so the shaders do not each have a copy.
+	static std::string shaderDefines();
+
+	//! Makes the block, the grid and a shadow map of shadowSize texels square, for the box
+	// boundsMin to boundsMax. Point lights outside it light nothing.
+	bool init(const glm::vec3& boundsMin, const glm::vec3& boundsMax, int shadowSize);
+	bool valid() const { return ubo.get() != 0; }
+	// Deletes the light block, the cluster grid's buffers and the shadow map
+	void release();
+
+	void setSun(const glm::vec3& direction, const glm::vec3& color);
+	void setAmbient(const glm::vec3& color);
+	// Point light i, added if i is the count. False past MAX_LIGHTS.
+	bool setPointLight(size_t i, const glm::vec3& position, float radius, const glm::vec3& color);
+	size_t pointLightCount() const { return lightCount; }
+
+	//! Bins the point lights into the grid and uploads the block, if anything changed since
+	// the last frame. Once a frame, before the shadows.
+	void beginFrame();
+
+	//! Renders the sun's shadow map: draw() is called with the map's framebuffer bound and
+	// cleared, and should draw every object that casts a shadow with shadow.vert, which
+	// takes the light's matrix from the block. Leaves the framebuffer and viewport as they
+	// were.
+	template <typename Draw>
+	void renderShadows(Draw draw)
+	{
+		if (!valid()) {
+			return;
+		}
+		GLint boundFramebuffer = 0, viewport[4];
+		beginShadows(boundFramebuffer, viewport);
+		draw();
+		endShadows(boundFramebuffer, viewport);
+	}
+
+	// The block bound to BINDING, for the draws after
+	void bindBlock() const;
+	GLuint shadowTexture() const { return shadowMap; }
+	GLuint cellTexture() const { return cellView; }
+	GLuint indexTexture() const { return indexView; }
+	// Grid cells a light reached into at the last binning, over all lights
+	size_t binnedCount() const { return binned; }
+
+private:
+	void beginShadows(GLint& boundFramebuffer, GLint* viewport);
+	void endShadows(GLint boundFramebuffer, const GLint* viewport);
+	void bin();
+	void updateSunMatrix();
+
+	LightingBlock block;
+	size_t lightCount;
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	bool dirty;
+
+	GLBuffer ubo;
+	GLBuffer cellBuffer;
+	GLBuffer indexBuffer;
+	GLTexture cellView;
+	GLTexture indexView;
+	GLTexture shadowMap;
+	GLFramebuffer shadowFramebuffer;
+	int shadowSize;
+
+	// Per cell its first index and count, then the indices, made again on the CPU each time
+	std::vector<uint32_t> cells;
+	std::vector<uint16_t> indices;
+	size_t binned;
+};
+
+#endif
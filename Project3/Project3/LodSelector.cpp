@@ -0,0 +1,100 @@
+#include "LodSelector.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+// Nearest clip w an object is measured at, so one the eye is inside or right up against
+// comes out huge rather than infinite or behind
+static const float MIN_DISTANCE = 0.01f;
+
+void LodSelector::configure(const float* errors, int levelCount, float pixelError, float hysteresis)
+{
+	levels = std::max(1, std::min(levelCount, (int)MAX_LEVELS));
+	for (int i = 0; i < levels; i++) {
+		error[i] = errors[i];
+	}
+	this->pixelError = std::max(pixelError, 0.f);
+	this->hysteresis = std::max(0.f, std::min(hysteresis, 1.f));
+	setErrorScale(1.f);
+	for (uint8_t& level : selected) {
+		level = (uint8_t)std::min((int)level, levels - 1);
+	}
+}
+
+void LodSelector::setErrorScale(float scale)
+{
+	keepBelow = pixelError * std::max(scale, 0.f);
+	coarsenBelow = keepBelow * (1.f - hysteresis);
+}
+
+float LodSelector::pixelScale(const glm::mat4& projection, int size)
+{
+	return std::max(std::fabs(projection[0][0]), std::fabs(projection[1][1])) * 0.5f * (float)size;
+}
+
+bool LodSelector::select(const glm::mat4* viewProjections, const float* pixelScales, size_t viewCount,
+	unsigned int firstBit, const uint32_t* masks, const glm::mat4* worlds, const glm::vec3* boundsMin,
+	const glm::vec3* boundsMax, JobSystem* jobSystem)
+{
+	viewCount = std::min<size_t>(viewCount, MAX_VIEWS - std::min<unsigned int>(firstBit, MAX_VIEWS));
+	size_t count = selected.size();
+	if (levels < 2 || !viewCount || !count) {
+		return false;
+	}
+	// Clip w is the last row of a view's matrix
+	glm::vec4 depthRows[MAX_VIEWS];
+	for (size_t v = 0; v < viewCount; v++) {
+		const glm::mat4& m = viewProjections[v];
+		depthRows[v] = glm::vec4(m[0][3], m[1][3], m[2][3], m[3][3]);
+	}
+	const uint32_t viewBits = (viewCount + firstBit >= MAX_VIEWS ? ~0u : (1u << (viewCount + firstBit)) - 1u) & ~((1u << firstBit) - 1u);
+
+	std::atomic<bool> changed(false);
+	auto pick = [&](size_t begin, size_t end, unsigned int) {
+		bool any = false;
+		for (size_t i = begin; i < end; i++) {
+			uint32_t mask = (masks ? masks[i] : ~0u) & viewBits;
+			if (!mask) {
+				continue;
+			}
+			glm::vec3 center = (boundsMin[i] + boundsMax[i]) * 0.5f;
+			float radius = glm::length(boundsMax[i] - boundsMin[i]) * 0.5f;
+			// Pixels per model unit in the view it is biggest in
+			float pixels = 0.f;
+			for (size_t v = 0; v < viewCount; v++) {
+				if (mask & (1u << (firstBit + v))) {
+					float w = glm::dot(depthRows[v], glm::vec4(center, 1.f));
+					pixels = std::max(pixels, pixelScales[v] / std::max(w - radius, MIN_DISTANCE));
+				}
+			}
+			pixels *= glm::length(glm::vec3(worlds[i][0]));
+
+			int level = selected[i];
+			int next = level;
+			while (next > 0 && error[next] * pixels > keepBelow) {
+				next--;
+			}
+			if (next == level) {
+				while (next + 1 < levels && error[next + 1] * pixels <= coarsenBelow) {
+					next++;
+				}
+			}
+			if (next != level) {
+				selected[i] = (uint8_t)next;
+				any = true;
+			}
+		}
+		if (any) {
+			changed.store(true, std::memory_order_relaxed);
+		}
+	};
+	if (jobSystem && count >= 2 * PARALLEL_GRAIN) {
+		jobSystem->parallelFor(count, PARALLEL_GRAIN, pick);
+	}
+	else {
+		pick(0, count, 0);
+	}
+	return changed.load();
+}
@@ -0,0 +1,70 @@
+#ifndef _LOD_SELECTOR_H_
+#define _LOD_SELECTOR_H_
+
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+// Picks a level of detail for each of a set of objects that share one mesh, from how big
+// the mesh's error comes out on screen. An object's error in pixels is its level's error
+// (model units) times its scale times the pixels a unit covers at its distance in a view;
+// of the views that see it, the one it is biggest in decides.
+//
+// The finest level is taken whose error is within pixelError. A coarser one than the
+// current level is only taken once its error is within pixelError * (1 - hysteresis), so
+// an object near a switching distance does not flip between two levels every frame.
+class LodSelector
+{
+public:
+	enum { MAX_LEVELS = 8 };
+	// The most views one select() takes, one mask bit each
+	static const unsigned int MAX_VIEWS = 32;
+
+	//! @input errors levelCount errors in model units, rising, level 0 the full mesh (0)
+	void configure(const float* errors, int levelCount, float pixelError, float hysteresis);
+	int levelCount() const { return levels; }
+	//! Scales the configured pixelError, levels coarsen sooner above 1. The hysteresis keeps
+	// its share of it.
+	void setErrorScale(float scale);
+
+	// Objects start at the full level
+	void resize(size_t count) { selected.assign(count, 0); }
+	size_t size() const { return selected.size(); }
+	uint8_t level(size_t index) const { return selected[index]; }
+
+	//! How many pixels one unit covers at clip w = 1 through a projection into a square
+	// target size pixels across: the larger of its x and y scales, times half the size.
+	static float pixelScale(const glm::mat4& projection, int size);
+
+	//! Picks the level of every object from the views that can see it.
+	// @input viewProjections, pixelScales viewCount views, at most MAX_VIEWS - firstBit
+	// @input masks Which views can see each object (bit firstBit + view), nullptr if all can
+	// @input worlds, boundsMin, boundsMax Each object's world matrix (scale from its first
+	//		column) and world bounds
+	// An object no view sees keeps its level. Returns whether any level changed.
+	bool select(const glm::mat4* viewProjections, const float* pixelScales, size_t viewCount, unsigned int firstBit,
+		const uint32_t* masks, const glm::mat4* worlds, const glm::vec3* boundsMin, const glm::vec3* boundsMax,
+		JobSystem* jobSystem = nullptr);
+
+	// Below this many objects a pass is not worth splitting, and the piece each thread takes
+	static const size_t PARALLEL_GRAIN = 256;
+
+private:
+	int levels = 1;
+	float error[MAX_LEVELS] = { 0.f };
+	float keepBelow = 1.f;
+	float coarsenBelow = 1.f;
+	float pixelError = 1.f;
+	float hysteresis = 0.f;
+	std::vector<uint8_t> selected;
+};
+
+#endif
@@ -0,0 +1,313 @@
+#include "Log.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include "SpscRing.h"
+
+struct Log::ThreadRing
+{
+	SpscRing<Record, RING_SIZE> ring;
+};
+
+// Takes the lines of one level apart where they end. The line being built is the writing
+// thread's own, so the one buffer serves std::cout for every thread without a lock.
+class LogBuffer : public std::streambuf
+{
+public:
+	explicit LogBuffer(LogLevel level) : level(level) {}
+
+protected:
+	int_type overflow(int_type c) override
+	{
+		if (c != traits_type::eof()) {
+			put((char)c);
+		}
+		return traits_type::not_eof(c);
+	}
+	std::streamsize xsputn(const char* s, std::streamsize n) override
+	{
+		for (std::streamsize i = 0; i < n; i++) {
+			put(s[i]);
+		}
+		return n;
+	}
+
+private:
+	struct Line
+	{
+		char text[Log::MAX_LINE];
+		size_t length;
+	};
+
+	void put(char c)
+	{
+		Line& line = lines[level];
+		if (c == '\n') {
+			logger().write(level, line.text, line.length);
+			line.length = 0;
+			return;
+		}
+		// A line longer than a record is written in pieces
+		if (line.length == Log::MAX_LINE) {
+			logger().write(level, line.text, line.length);
+			line.length = 0;
+		}
+		line.text[line.length++] = c;
+	}
+
+	LogLevel level;
+	static thread_local Line lines[LOG_LEVELS];
+};
+
+thread_local LogBuffer::Line LogBuffer::lines[LOG_LEVELS];
+
+static LogBuffer buffers[LOG_LEVELS] = { LogBuffer(LOG_DEBUG), LogBuffer(LOG_INFO), LogBuffer(LOG_WARNING), LogBuffer(LOG_ERROR) };
+
+Log::Log() : threshold(LOG_INFO), sequence(0), dropped(0), running(false), stopping(false), drainsAsked(0),
+	drainsDone(0), droppedReported(0), linesPerSecond(0), windowLines(0), suppressed(0), suppressedTotal(0),
+	file(nullptr), coutBuffer(nullptr), cerrBuffer(nullptr)
+{
+}
+
+Log::~Log()
+{
+	shutdown();
+	for (ThreadRing* ring : rings) {
+		delete ring;
+	}
+}
+
+void Log::install()
+{
+	if (running) {
+		return;
+	}
+	stopping = false;
+	windowStart = std::chrono::steady_clock::now();
+	coutBuffer = std::cout.rdbuf(&buffers[LOG_INFO]);
+	cerrBuffer = std::cerr.rdbuf(&buffers[LOG_WARNING]);
+	running = true;
+	writer = std::thread([this] { run(); });
+}
+
+void Log::configure(LogLevel level, int linesPerSecond, const std::string& path)
+{
+	threshold = level;
+	std::lock_guard<std::mutex> lock(printMutex);
+	this->linesPerSecond = linesPerSecond > 0 ? linesPerSecond : 0;
+	if (file) {
+		fclose(file);
+		file = nullptr;
+	}
+	if (!path.empty()) {
+		file = fopen(path.c_str(), "w");
+		if (!file) {
+			fprintf(stderr, "Could not open the log file %s\n", path.c_str());
+		}
+	}
+}
+
+LogLevel Log::parseLevel(const std::string& name)
+{
+	if (name == "debug") {
+		return LOG_DEBUG;
+	}
+	if (name == "warning") {
+		return LOG_WARNING;
+	}
+	if (name == "error") {
+		return LOG_ERROR;
+	}
+	if (name != "info") {
+		std::cerr << "unknown log.level " << name << ", logging info and up" << std::endl;
+	}
+	return LOG_INFO;
+}
+
+Log::ThreadRing* Log::ringOfThisThread()
+{
+	// The logger outlives every thread writing to it, so a thread's ring is only given back
+	// with the logger
+	thread_local ThreadRing* ring = nullptr;
+	if (!ring) {
+		ring = new ThreadRing();
+		std::lock_guard<std::mutex> lock(ringsMutex);
+		rings.push_back(ring);
+	}
+	return ring;
+}
+
+void Log::write(LogLevel level, const char* text, size_t length)
+{
+	if (!enabled(level)) {
+		return;
+	}
+	if (length > MAX_LINE) {
+		length = MAX_LINE;
+	}
+	if (!running) {
+		std::lock_guard<std::mutex> lock(printMutex);
+		print(level, text, length);
+		return;
+	}
+	// Records are big, so each thread keeps one to fill rather than one on its stack
+	thread_local Record record;
+	record.sequence = sequence.fetch_add(1, std::memory_order_relaxed);
+	record.level = (uint8_t)level;
+	record.length = (uint16_t)length;
+	memcpy(record.text, text, length);
+	if (!ringOfThisThread()->ring.push(record)) {
+		dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+void Log::run()
+{
+	std::unique_lock<std::mutex> lock(wakeMutex);
+	while (!stopping) {
+		wake.wait_for(lock, std::chrono::milliseconds(5), [this] { return stopping || drainsAsked > drainsDone; });
+		uint64_t asked = drainsAsked;
+		lock.unlock();
+		drain();
+		lock.lock();
+		drainsDone = asked;
+		drained.notify_all();
+	}
+}
+
+void Log::flush()
+{
+	if (!running) {
+		drain();
+		return;
+	}
+	std::unique_lock<std::mutex> lock(wakeMutex);
+	uint64_t ticket = ++drainsAsked;
+	wake.notify_one();
+	drained.wait(lock, [this, ticket] { return drainsDone >= ticket || stopping; });
+}
+
+void Log::drain()
+{
+	std::lock_guard<std::mutex> printLock(printMutex);
+	pending.clear();
+	{
+		std::lock_guard<std::mutex> lock(ringsMutex);
+		Record record;
+		for (ThreadRing* ring : rings) {
+			while (ring->ring.pop(record)) {
+				pending.push_back(record);
+			}
+		}
+	}
+	std::sort(pending.begin(), pending.end(), [](const Record& a, const Record& b) { return a.sequence < b.sequence; });
+
+	char note[96];
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (now - windowStart >= std::chrono::seconds(1)) {
+		if (suppressed) {
+			int n = snprintf(note, sizeof(note), "(%llu lines over log.lines_per_second left out)", (unsigned long long)suppressed);
+			print(LOG_WARNING, note, n);
+		}
+		windowStart = now;
+		windowLines = 0;
+		suppressed = 0;
+	}
+	for (const Record& record : pending) {
+		// Errors are always printed
+		if (linesPerSecond && windowLines >= linesPerSecond && record.level < LOG_ERROR) {
+			suppressed++;
+			suppressedTotal++;
+			continue;
+		}
+		windowLines++;
+		print((LogLevel)record.level, record.text, record.length);
+	}
+	uint64_t lost = dropped.load(std::memory_order_relaxed);
+	if (lost != droppedReported) {
+		int n = snprintf(note, sizeof(note), "(%llu lines lost to a full log ring)", (unsigned long long)(lost - droppedReported));
+		print(LOG_WARNING, note, n);
+		droppedReported = lost;
+	}
+	if (!pending.empty()) {
+		fflush(stdout);
+		fflush(stderr);
+		if (file) {
+			fflush(file);
+		}
+	}
+}
+
+void Log::print(LogLevel level, const char* text, size_t length)
+{
+	char line[MAX_LINE + 2];
+	memcpy(line, text, length);
+	line[length] = '\n';
+	line[length + 1] = 0;
+	fwrite(line, 1, length + 1, level >= LOG_WARNING ? stderr : stdout);
+	if (file) {
+		fwrite(line, 1, length + 1, file);
+	}
+#ifdef _WIN32
+	OutputDebugStringA(line);
+#endif
+}
+
+void Log::shutdown()
+{
+	if (!running) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(wakeMutex);
+		stopping = true;
+	}
+	wake.notify_one();
+	drained.notify_all();
+	writer.join();
+	running = false;
+	// Whatever came after the writer's last look
+	drain();
+	std::cout.rdbuf(coutBuffer);
+	std::cerr.rdbuf(cerrBuffer);
+	std::lock_guard<std::mutex> lock(printMutex);
+	if (suppressed) {
+		char note[96];
+		int n = snprintf(note, sizeof(note), "(%llu lines over log.lines_per_second left out)", (unsigned long long)suppressed);
+		print(LOG_WARNING, note, n);
+		suppressed = 0;
+	}
+	if (file) {
+		fclose(file);
+		file = nullptr;
+	}
+}
+
+Log& logger()
+{
+	static Log log;
+	return log;
+}
+
+std::ostream& logStream(LogLevel level)
+{
+	struct Streams
+	{
+		Streams() : debug(&buffers[LOG_DEBUG]), info(&buffers[LOG_INFO]), warning(&buffers[LOG_WARNING]),
+			error(&buffers[LOG_ERROR]) {}
+		std::ostream debug, info, warning, error;
+	};
+	thread_local Streams streams;
+	switch (level) {
+	case LOG_DEBUG: return streams.debug;
+	case LOG_WARNING: return streams.warning;
+	case LOG_ERROR: return streams.error;
+	default: return streams.info;
+	}
+}
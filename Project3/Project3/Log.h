@@ -0,0 +1,116 @@
+#ifndef _LOG_H_
+#define _LOG_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+// How much a line matters. Lines below log.level are dropped by the thread writing them.
+enum LogLevel { LOG_DEBUG, LOG_INFO, LOG_WARNING, LOG_ERROR, LOG_LEVELS };
+
+// Console output kept off the threads that make it. Writing to a Windows console can block
+// for milliseconds, long enough to miss a frame, so a line is only copied into a ring owned
+// by the thread writing it (SpscRing.h, no lock and no allocation after the thread's first
+// line), and a writer thread takes the lines from every ring a few times a frame, puts them
+// back in the order they were written and prints them: debug and info to stdout, warnings
+// and errors to stderr, everything to the debugger's output and log.file if there is one.
+//
+// Past log.lines_per_second the writer only counts lines and says how many it left out once
+// the second is over, so a message repeated every frame cannot flood the console (errors
+// are always printed). A thread that fills its ring before the writer comes by loses lines
+// rather than waiting, they are counted too.
+//
+// install() points std::cout (info) and std::cerr (warnings) here, so everything printed
+// through them takes this way; logStream() writes at any level.
+class Log
+{
+public:
+	enum { MAX_LINE = 240, RING_SIZE = 256 };
+
+	Log();
+	~Log();
+
+	// Takes over std::cout and std::cerr and starts the writer. Lines written before are kept.
+	void install();
+	//! Applies the log.* settings
+	// @input linesPerSecond Printed at most, 0 for no limit
+	// @input file Also written to when not empty, replacing what it held
+	void configure(LogLevel level, int linesPerSecond, const std::string& file);
+	static LogLevel parseLevel(const std::string& name);
+
+	// One line without its newline, cut at MAX_LINE. Any thread.
+	void write(LogLevel level, const char* text, size_t length);
+	bool enabled(LogLevel level) const { return level >= threshold.load(std::memory_order_relaxed); }
+	// Prints what is queued now and waits for it, for a crash about to end the process
+	void flush();
+	// Prints the rest, stops the writer and gives std::cout and std::cerr back. Lines after
+	// this are printed by the thread writing them.
+	void shutdown();
+
+	// Lines lost to full rings and to the rate limit so far
+	uint64_t droppedCount() const { return dropped.load(); }
+	uint64_t suppressedCount() const { return suppressedTotal; }
+
+private:
+	struct Record
+	{
+		uint64_t sequence;
+		uint8_t level;
+		uint16_t length;
+		char text[MAX_LINE];
+	};
+	struct ThreadRing;
+
+	ThreadRing* ringOfThisThread();
+	void run();
+	// Takes everything out of the rings and prints it in order. Writer (or shutdown) only.
+	void drain();
+	void print(LogLevel level, const char* text, size_t length);
+
+	std::atomic<int> threshold;
+	std::atomic<uint64_t> sequence;
+	std::atomic<uint64_t> dropped;
+	std::atomic<bool> running;
+
+	// Every thread's ring, added to at a thread's first line
+	std::mutex ringsMutex;
+	std::vector<ThreadRing*> rings;
+
+	std::thread writer;
+	std::mutex wakeMutex;
+	std::condition_variable wake;
+	bool stopping;
+	// flush() waits for a drain that started after it asked
+	uint64_t drainsAsked;
+	uint64_t drainsDone;
+	std::condition_variable drained;
+
+	// The writer's (and shutdown's, after it) alone
+	std::mutex printMutex;
+	std::vector<Record> pending;
+	uint64_t droppedReported;
+	int linesPerSecond;
+	std::chrono::steady_clock::time_point windowStart;
+	int windowLines;
+	uint64_t suppressed;
+	uint64_t suppressedTotal;
+	FILE* file;
+
+	std::streambuf* coutBuffer;
+	std::streambuf* cerrBuffer;
+};
+
+Log& logger();
+
+// A stream writing lines at level, one per thread, so any thread can use it like std::cout
+std::ostream& logStream(LogLevel level);
+
+#endif
@@ -0,0 +1,228 @@
+#include "MeshFile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+std::string meshFilePath(const std::string& sourcePath)
+{
+	size_t dot = sourcePath.find_last_of('.');
+	size_t slash = sourcePath.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+		return sourcePath + ".p3mesh";
+	}
+	return sourcePath.substr(0, dot) + ".p3mesh";
+}
+
+uint16_t packHalf(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, 4);
+	uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+	uint32_t exponent = (bits >> 23) & 0xff;
+	uint32_t mantissa = bits & 0x7fffff;
+
+	if (exponent == 0xff) {
+		// Inf stays inf, NaN stays a NaN
+		return (uint16_t)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+	}
+	int e = (int)exponent - 127 + 15;
+	if (e >= 31) {
+		return (uint16_t)(sign | 0x7bff);
+	}
+	if (e <= 0) {
+		// Subnormal, or zero below half the smallest one
+		if (e < -10) {
+			return sign;
+		}
+		mantissa |= 0x800000;
+		uint32_t shift = (uint32_t)(14 - e);
+		uint32_t half = mantissa >> shift;
+		uint32_t rest = mantissa & ((1u << shift) - 1);
+		uint32_t midpoint = 1u << (shift - 1);
+		if (rest > midpoint || (rest == midpoint && (half & 1))) {
+			half++;
+		}
+		return (uint16_t)(sign | half);
+	}
+	uint32_t half = ((uint32_t)e << 10) | (mantissa >> 13);
+	uint32_t rest = mantissa & 0x1fff;
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+		// A carry into the exponent is still the right rounding, up to the largest half
+		half++;
+		if (half >= 0x7c00) {
+			half = 0x7bff;
+		}
+	}
+	return (uint16_t)(sign | half);
+}
+
+float unpackHalf(uint16_t value)
+{
+	uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+	uint32_t exponent = (value >> 10) & 0x1f;
+	uint32_t mantissa = value & 0x3ff;
+	uint32_t bits;
+	if (exponent == 0) {
+		float magnitude = std::ldexp((float)mantissa, -24);
+		return sign ? -magnitude : magnitude;
+	}
+	if (exponent == 31) {
+		bits = sign | 0x7f800000 | (mantissa << 13);
+	}
+	else {
+		bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+	}
+	float result;
+	memcpy(&result, &bits, 4);
+	return result;
+}
+
+static uint32_t packSnorm10(float value)
+{
+	value = std::max(-1.f, std::min(1.f, value));
+	int v = (int)std::floor(value * 511.f + 0.5f);
+	return (uint32_t)v & 0x3ff;
+}
+
+uint32_t packNormal(float x, float y, float z)
+{
+	float length = std::sqrt(x * x + y * y + z * z);
+	if (length > 0.f) {
+		x /= length;
+		y /= length;
+		z /= length;
+	}
+	return packSnorm10(x) | (packSnorm10(y) << 10) | (packSnorm10(z) << 20);
+}
+
+MeshVertex packMeshVertex(const float position[3], const float normal[3], const float uv[2])
+{
+	MeshVertex vertex;
+	for (int axis = 0; axis < 3; axis++) {
+		vertex.position[axis] = packHalf(position[axis]);
+	}
+	vertex.position[3] = packHalf(1.f);
+	vertex.normal = packNormal(normal[0], normal[1], normal[2]);
+	vertex.uv[0] = packHalf(uv[0]);
+	vertex.uv[1] = packHalf(uv[1]);
+	return vertex;
+}
+
+bool mapMesh(const char* filename, MappedMesh& mesh)
+{
+	mesh.header = nullptr;
+	mesh.vertices = nullptr;
+	mesh.indices = nullptr;
+
+	if (!mesh.file.open(filename)) {
+		std::cerr << "error reading mesh file, could not locate " << filename << std::endl;
+		return false;
+	}
+
+	const unsigned char* data = mesh.file.data();
+	size_t size = mesh.file.size();
+	const MeshFileHeader* header = (const MeshFileHeader*)data;
+	if (size < sizeof(MeshFileHeader) || header->magic != MESHFILE_MAGIC) {
+		std::cerr << "error parsing mesh file, " << filename << " is not a mesh file" << std::endl;
+		mesh.file.close();
+		return false;
+	}
+	if (header->version != MESHFILE_VERSION) {
+		std::cerr << "error parsing mesh file, " << filename << " is version " << header->version
+			<< ", rebuild it with MeshBuilder" << std::endl;
+		mesh.file.close();
+		return false;
+	}
+
+	size_t vertexBytes = (size_t)header->vertexCount * sizeof(MeshVertex);
+	size_t indexBytes = (size_t)header->indexCount * sizeof(uint32_t);
+	if (header->vertexOffset % 16 || header->indexOffset % 16 ||
+		header->vertexOffset > size || size - header->vertexOffset < vertexBytes ||
+		header->indexOffset > size || size - header->indexOffset < indexBytes || header->indexCount % 3) {
+		std::cerr << "error parsing mesh file, incomplete data in " << filename << std::endl;
+		mesh.file.close();
+		return false;
+	}
+
+	bool lodsValid = header->lodCount >= 1 && header->lodCount <= MESHFILE_MAX_LODS;
+	for (uint32_t i = 0; lodsValid && i < header->lodCount; i++) {
+		const MeshFileLod& lod = header->lods[i];
+		lodsValid = lod.indexCount % 3 == 0 && lod.firstIndex <= header->indexCount &&
+			header->indexCount - lod.firstIndex >= lod.indexCount;
+	}
+	if (!lodsValid) {
+		std::cerr << "error parsing mesh file, bad levels of detail in " << filename << std::endl;
+		mesh.file.close();
+		return false;
+	}
+
+	// One pass over the indices up front rather than a GPU reading past the vertices later
+	const uint32_t* indices = (const uint32_t*)(data + header->indexOffset);
+	for (uint32_t i = 0; i < header->indexCount; i++) {
+		if (indices[i] >= header->vertexCount) {
+			std::cerr << "error parsing mesh file, index out of range in " << filename << std::endl;
+			mesh.file.close();
+			return false;
+		}
+	}
+
+	mesh.header = header;
+	mesh.vertices = (const MeshVertex*)(data + header->vertexOffset);
+	mesh.indices = indices;
+	return true;
+}
+
+bool writeMeshFile(const char* filename, const MeshVertex* vertices, uint32_t vertexCount,
+	const uint32_t* indices, uint32_t indexCount, const MeshFileLod* lods, uint32_t lodCount,
+	uint64_t sourceSize, uint64_t sourceTime)
+{
+	if (lodCount < 1 || lodCount > MESHFILE_MAX_LODS) {
+		return false;
+	}
+	MeshFileHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = MESHFILE_MAGIC;
+	header.version = MESHFILE_VERSION;
+	header.vertexCount = vertexCount;
+	header.indexCount = indexCount;
+	header.vertexOffset = (uint32_t)((sizeof(MeshFileHeader) + 15) & ~(size_t)15);
+	header.indexOffset = (uint32_t)((header.vertexOffset + vertexCount * sizeof(MeshVertex) + 15) & ~(size_t)15);
+	header.sourceSize = sourceSize;
+	header.sourceTime = sourceTime;
+	header.lodCount = lodCount;
+	memcpy(header.lods, lods, lodCount * sizeof(MeshFileLod));
+
+	// Bounds of what the runtime will see, after rounding to halves
+	for (int axis = 0; axis < 3; axis++) {
+		header.boundsMin[axis] = vertexCount ? INFINITY : 0.f;
+		header.boundsMax[axis] = vertexCount ? -INFINITY : 0.f;
+	}
+	for (uint32_t i = 0; i < vertexCount; i++) {
+		for (int axis = 0; axis < 3; axis++) {
+			float p = unpackHalf(vertices[i].position[axis]);
+			header.boundsMin[axis] = std::min(header.boundsMin[axis], p);
+			header.boundsMax[axis] = std::max(header.boundsMax[axis], p);
+		}
+	}
+
+	FILE* fp = fopen(filename, "wb");
+	if (!fp) {
+		return false;
+	}
+	static const unsigned char zeros[16] = { 0 };
+	size_t vertexPad = header.vertexOffset - sizeof(MeshFileHeader);
+	size_t indexPad = header.indexOffset - header.vertexOffset - vertexCount * sizeof(MeshVertex);
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+	ok = ok && fwrite(zeros, 1, vertexPad, fp) == vertexPad;
+	ok = ok && fwrite(vertices, sizeof(MeshVertex), vertexCount, fp) == vertexCount;
+	ok = ok && fwrite(zeros, 1, indexPad, fp) == indexPad;
+	ok = ok && fwrite(indices, sizeof(uint32_t), indexCount, fp) == indexCount;
+	ok = (fclose(fp) == 0) && ok;
+	if (!ok) {
+		remove(filename);
+	}
+	return ok;
+}
@@ -0,0 +1,98 @@
+#ifndef _MESH_FILE_H_
+#define _MESH_FILE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "Image.h"
+
+// On-disk mesh (.p3mesh). One file holds one indexed triangle mesh at one or more levels
+// of detail, its vertices already in the layout the mesh pool draws from, so they go into
+// the pool as they are:
+//
+//   MeshFileHeader
+//   MeshVertex[vertexCount], from vertexOffset
+//   uint32_t[indexCount], from indexOffset
+//
+// both arrays starting on a 16 byte boundary. The levels share the vertices, each is its
+// own range of the indices, level 0 the full mesh. MeshBuilder writes these next to the
+// source models (OBJ, glTF) at build time; the runtime maps them with mapMesh().
+
+const uint32_t MESHFILE_MAGIC = 0x534d3350; // "P3MS"
+const uint32_t MESHFILE_VERSION = 2;
+const uint32_t MESHFILE_MAX_LODS = 4;
+
+// One vertex, 16 bytes: position as half floats (attribute 0, w is 1), normal as signed
+// normalized 10:10:10:2 (attribute 2) and texture coordinate as half floats (attribute 1).
+// Half floats keep 11 bits of mantissa, well under a millimetre for props a metre across.
+struct MeshVertex
+{
+	uint16_t position[4];
+	uint32_t normal;
+	uint16_t uv[2];
+};
+
+struct MeshFileLod
+{
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	// How far, in model units, any vertex of the full mesh moved to make this level
+	float error;
+};
+
+struct MeshFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t vertexOffset;
+	uint32_t indexOffset;
+	// Bounds of the positions as stored, in model units
+	float boundsMin[3];
+	float boundsMax[3];
+	// Size and last-write time of the source file, so stale meshes can be told apart
+	uint64_t sourceSize;
+	uint64_t sourceTime;
+	uint32_t lodCount;
+	MeshFileLod lods[MESHFILE_MAX_LODS];
+};
+
+// A mesh file viewed in place. vertices and indices point into the mapping and are only
+// valid for as long as the mesh (and so its mapping) lives.
+struct MappedMesh
+{
+	MappedFile file;
+	const MeshFileHeader* header = nullptr;
+	const MeshVertex* vertices = nullptr;
+	const uint32_t* indices = nullptr;
+};
+
+// Path of the mesh file that belongs to a source model ("a/b.obj" -> "a/b.p3mesh")
+std::string meshFilePath(const std::string& sourcePath);
+
+// IEEE half float, rounded to nearest, out of range values clamped to the largest half
+uint16_t packHalf(float value);
+float unpackHalf(uint16_t value);
+// A normal in signed normalized 10:10:10:2, x in the low bits (GL_INT_2_10_10_10_REV)
+uint32_t packNormal(float x, float y, float z);
+
+MeshVertex packMeshVertex(const float position[3], const float normal[3], const float uv[2]);
+
+//! Map a mesh file without copying its vertices or indices.
+// @input filename The location of the .p3mesh file. If it is missing, truncated or of
+//		another version an error message is printed and this function returns false
+// @input mesh Receives the mapping and the views into it
+//
+// @return Returns true if every index is below the vertex count and every level lies
+//		within the indices
+bool mapMesh(const char* filename, MappedMesh& mesh);
+
+// Writes a mesh file, with the bounds of the vertices' positions. lods are ranges of
+// indices, at least one and MESHFILE_MAX_LODS at most.
+bool writeMeshFile(const char* filename, const MeshVertex* vertices, uint32_t vertexCount,
+	const uint32_t* indices, uint32_t indexCount, const MeshFileLod* lods, uint32_t lodCount,
+	uint64_t sourceSize, uint64_t sourceTime);
+
+#endif
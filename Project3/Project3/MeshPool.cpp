@@ -0,0 +1,208 @@
+#include "MeshPool.h"
+#include "GLState.h"
+#include "GpuMemory.h"
+#include "Box.h"
+#include "Quad.h"
+
+#include <algorithm>
+#include <iostream>
+
+MeshPool::MeshPool()
+{
+	addBuiltins();
+}
+
+void MeshPool::addBuiltins()
+{
+	// The cube: the skybox shaders take texture coordinates from the positions, the corners
+	// share their vertices so the normals point out through the corners
+	static const float noUV[2] = { 0.f, 0.f };
+	MeshVertex cube[8];
+	for (int i = 0; i < 8; i++) {
+		cube[i] = packMeshVertex(::vertices[i], ::vertices[i], noUV);
+	}
+	add(cube, 8, &::indices[0][0], 36);
+
+	// The quad is two triangles of its own six vertices, facing +z
+	static const float front[3] = { 0.f, 0.f, 1.f };
+	MeshVertex quad[6];
+	GLuint quadIndices[6];
+	for (int i = 0; i < 6; i++) {
+		quad[i] = packMeshVertex(&quad_vertices[i * 5], front, &quad_vertices[i * 5 + 3]);
+		quadIndices[i] = (GLuint)i;
+	}
+	add(quad, 6, quadIndices, 6);
+}
+
+int MeshPool::add(const MeshVertex* meshVertices, size_t vertexCount, const GLuint* meshIndices, size_t indexCount)
+{
+	if (vao) {
+		std::cerr << "mesh pool already built, mesh not added" << std::endl;
+		return -1;
+	}
+	MeshRange range;
+	range.indexCount = (GLsizei)indexCount;
+	range.firstIndex = (GLuint)indices.size();
+	range.baseVertex = (GLint)vertices.size();
+	range.vertexCount = (GLint)vertexCount;
+	vertices.insert(vertices.end(), meshVertices, meshVertices + vertexCount);
+	indices.insert(indices.end(), meshIndices, meshIndices + indexCount);
+	ranges.push_back(range);
+	return (int)ranges.size() - 1;
+}
+
+int MeshPool::load(const char* filename, MeshInfo* info)
+{
+	if (vao) {
+		std::cerr << "mesh pool already built, " << filename << " not added" << std::endl;
+		return -1;
+	}
+	MappedMesh mesh;
+	if (!mapMesh(filename, mesh)) {
+		return -1;
+	}
+	// Straight from the mapping into the pool, the layouts are the same
+	const MeshFileHeader& header = *mesh.header;
+	GLint baseVertex = (GLint)vertices.size();
+	GLuint firstIndex = (GLuint)indices.size();
+	vertices.insert(vertices.end(), mesh.vertices, mesh.vertices + header.vertexCount);
+	indices.insert(indices.end(), mesh.indices, mesh.indices + header.indexCount);
+	int first = (int)ranges.size();
+	for (uint32_t i = 0; i < header.lodCount; i++) {
+		MeshRange range;
+		range.indexCount = (GLsizei)header.lods[i].indexCount;
+		range.firstIndex = firstIndex + header.lods[i].firstIndex;
+		range.baseVertex = baseVertex;
+		range.vertexCount = (GLint)header.vertexCount;
+		ranges.push_back(range);
+	}
+	if (info) {
+		for (int axis = 0; axis < 3; axis++) {
+			info->boundsMin[axis] = header.boundsMin[axis];
+			info->boundsMax[axis] = header.boundsMax[axis];
+		}
+		info->lodCount = (int)header.lodCount;
+		for (uint32_t i = 0; i < header.lodCount; i++) {
+			info->lodIds[i] = first + (int)i;
+			info->lodError[i] = header.lods[i].error;
+		}
+	}
+	return first;
+}
+
+GLuint MeshPool::vertexArray()
+{
+	build();
+	return vao;
+}
+
+void MeshPool::setAttributes()
+{
+	build();
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	// The element array binding is part of the vertex array, it must stay bound
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_HALF_FLOAT, GL_FALSE, sizeof(MeshVertex), (GLvoid*)offsetof(MeshVertex, position));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(MeshVertex), (GLvoid*)offsetof(MeshVertex, uv));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(MeshVertex), (GLvoid*)offsetof(MeshVertex, normal));
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void MeshPool::setPositionAttributes()
+{
+	build();
+	glBindBuffer(GL_ARRAY_BUFFER, positions);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_HALF_FLOAT, GL_FALSE, 4 * sizeof(uint16_t), (GLvoid*)0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void MeshPool::draw(int id)
+{
+	const MeshRange& range = ranges[id];
+	glState().bindVertexArray(vertexArray());
+	glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT, range.indexOffset(), range.baseVertex);
+}
+
+void MeshPool::drawInstanced(int id, GLsizei instances)
+{
+	const MeshRange& range = ranges[id];
+	glState().bindVertexArray(vertexArray());
+	glDrawElementsInstancedBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT, range.indexOffset(), instances,
+		range.baseVertex);
+}
+
+void MeshPool::build()
+{
+	if (vao) {
+		return;
+	}
+	GLsizeiptr vertexBytes = (GLsizeiptr)(vertices.size() * sizeof(MeshVertex));
+	GLsizeiptr indexBytes = (GLsizeiptr)(indices.size() * sizeof(GLuint));
+	// The halves of each position as they are, w included so every vertex stays 8 bytes
+	std::vector<uint16_t> positionData(vertices.size() * 4);
+	for (size_t i = 0; i < vertices.size(); i++) {
+		std::copy(vertices[i].position, vertices[i].position + 4, positionData.begin() + i * 4);
+	}
+	GLsizeiptr positionBytes = (GLsizeiptr)(positionData.size() * sizeof(uint16_t));
+
+	vao.create();
+	vbo.create();
+	ebo.create();
+	positions.create();
+	glBindBuffer(GL_ARRAY_BUFFER, positions);
+	if (GLEW_ARB_buffer_storage) {
+		glBufferStorage(GL_ARRAY_BUFFER, positionBytes, positionData.data(), 0);
+	}
+	else {
+		glBufferData(GL_ARRAY_BUFFER, positionBytes, positionData.data(), GL_STATIC_DRAW);
+	}
+	glState().bindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+	if (GLEW_ARB_buffer_storage) {
+		glBufferStorage(GL_ARRAY_BUFFER, vertexBytes, vertices.data(), 0);
+		glBufferStorage(GL_ELEMENT_ARRAY_BUFFER, indexBytes, indices.data(), 0);
+	}
+	else {
+		glBufferData(GL_ARRAY_BUFFER, vertexBytes, vertices.data(), GL_STATIC_DRAW);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, indices.data(), GL_STATIC_DRAW);
+	}
+	setAttributes();
+	glState().bindVertexArray(0);
+	// Not leaks if nothing resets the pool, it may outlive every scene
+	gpuMemory().allocate(GpuMemory::KIND_BUFFER, vbo, vertexBytes, GpuMemory::MESH, "mesh pool vertices", true);
+	gpuMemory().allocate(GpuMemory::KIND_BUFFER, ebo, indexBytes, GpuMemory::MESH, "mesh pool indices", true);
+	gpuMemory().allocate(GpuMemory::KIND_BUFFER, positions, positionBytes, GpuMemory::MESH, "mesh pool positions", true);
+
+	// Everything is on the GPU now
+	std::vector<MeshVertex>().swap(vertices);
+	std::vector<GLuint>().swap(indices);
+}
+
+void MeshPool::reset()
+{
+	if (vao) {
+		gpuMemory().release(GpuMemory::KIND_BUFFER, vbo);
+		gpuMemory().release(GpuMemory::KIND_BUFFER, ebo);
+		gpuMemory().release(GpuMemory::KIND_BUFFER, positions);
+	}
+	vao.reset();
+	vbo.reset();
+	ebo.reset();
+	positions.reset();
+	std::vector<MeshVertex>().swap(vertices);
+	std::vector<GLuint>().swap(indices);
+	ranges.clear();
+	addBuiltins();
+}
+
+MeshPool& meshPool()
+{
+	static MeshPool pool;
+	return pool;
+}
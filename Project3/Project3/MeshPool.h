@@ -0,0 +1,101 @@
+#ifndef _MESH_POOL_H_
+#define _MESH_POOL_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include <cstddef>
+#include <vector>
+
+#include "GLHandle.h"
+#include "MeshFile.h"
+
+// Where a mesh is in the pool's buffers, for glDrawElementsBaseVertex
+struct MeshRange
+{
+	GLsizei indexCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	// The vertices from baseVertex its indices use
+	GLint vertexCount;
+
+	const GLvoid* indexOffset() const { return (const GLvoid*)(firstIndex * sizeof(GLuint)); }
+};
+
+// What loading a mesh file gives besides its ids: the bounds in model units, and each
+// level's id and error (how far it is from the full mesh, in model units)
+struct MeshInfo
+{
+	float boundsMin[3];
+	float boundsMax[3];
+	int lodCount;
+	int lodIds[MESHFILE_MAX_LODS];
+	float lodError[MESHFILE_MAX_LODS];
+};
+
+// All static geometry in one vertex buffer and one index buffer behind a single vertex
+// array, so drawing a Box after a Quad switches nothing. The vertices are MeshVertex, the
+// layout mesh files store, so a loaded mesh goes in without conversion. The cube and the
+// quad are always in it, meshes loaded later are added before the first draw builds it.
+// Once built the buffers never change (immutable storage where ARB_buffer_storage is there).
+// Next to the vertices the positions are kept again on their own, 8 bytes a vertex, for
+// the draws that need nothing else (the depth pre-pass).
+//
+// The pool lasts as long as the context, like the objects drawing from it, unless reset()
+// gives it back first.
+class MeshPool
+{
+public:
+	enum MeshId { BOX, QUAD, BUILTIN_COUNT };
+
+	MeshPool();
+	MeshPool(const MeshPool&) = delete;
+	MeshPool& operator=(const MeshPool&) = delete;
+
+	// Adds a mesh, indices relative to its own first vertex. Returns its id, or -1 once the
+	// pool is built.
+	int add(const MeshVertex* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount);
+	// Adds the mesh of a mesh file (mapMesh), every level of detail a mesh of its own over
+	// the same vertices. Returns the full level's id, or -1 if the file cannot be used or
+	// the pool is built.
+	int load(const char* filename, MeshInfo* info = nullptr);
+
+	const MeshRange& mesh(int id) const { return ranges[id]; }
+	// The shared vertex array, built on first use
+	GLuint vertexArray();
+	GLuint vertexBuffer() { build(); return vbo; }
+	GLuint indexBuffer() { build(); return ebo; }
+	// Points the bound vertex array at the pool's buffers, for vertex arrays that add
+	// attributes of their own (instancing)
+	void setAttributes();
+	// The same with only attribute 0, from the positions stream
+	void setPositionAttributes();
+
+	// Draws one mesh with the shared vertex array bound
+	void draw(int id);
+	void drawInstanced(int id, GLsizei instances);
+
+	// Deletes the buffers and forgets every loaded mesh, back to the cube and the quad
+	// unbuilt, so a scene made again loads its meshes again. Nothing may still draw from it.
+	void reset();
+
+private:
+	void addBuiltins();
+	void build();
+
+	GLVertexArray vao;
+	GLBuffer vbo, ebo, positions;
+	std::vector<MeshVertex> vertices;
+	std::vector<GLuint> indices;
+	std::vector<MeshRange> ranges;
+};
+
+// The pool of the GL context everything draws into
+MeshPool& meshPool();
+
+#endif
@@ -0,0 +1,67 @@
+#include "MicroBench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+volatile uint64_t MicroBench::sink = 0;
+
+MicroBench::MicroBench(int repeats, double minSeconds)
+	: repeats(std::max(repeats, 1)), minSeconds(std::max(minSeconds, 0.001))
+{
+}
+
+void MicroBench::run(const std::string& name, uint64_t batch, const std::function<uint64_t()>& op)
+{
+	typedef std::chrono::steady_clock Clock;
+	batch = std::max<uint64_t>(batch, 1);
+	op();
+
+	std::vector<Result> runs;
+	for (int r = 0; r < repeats; r++) {
+		uint64_t ops = 0;
+		uint64_t bytes = 0;
+		Clock::time_point start = Clock::now();
+		double seconds = 0.0;
+		do {
+			bytes += op();
+			ops += batch;
+			seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		} while (seconds < minSeconds);
+		Result result = { name, seconds * 1.0e9 / ops, bytes / seconds, ops };
+		runs.push_back(result);
+	}
+	std::sort(runs.begin(), runs.end(), [](const Result& a, const Result& b) { return a.nsPerOp < b.nsPerOp; });
+	results.push_back(runs[runs.size() / 2]);
+}
+
+void MicroBench::report(std::ostream& out) const
+{
+	char line[256];
+	snprintf(line, sizeof(line), "%-32s %14s %12s %12s", "case", "ns/op", "MB/s", "ops");
+	out << line << std::endl;
+	for (const Result& r : results) {
+		char rate[32] = "-";
+		if (r.bytesPerSecond > 0.0) {
+			snprintf(rate, sizeof(rate), "%.1f", r.bytesPerSecond / 1.0e6);
+		}
+		snprintf(line, sizeof(line), "%-32s %14.1f %12s %12llu", r.name.c_str(), r.nsPerOp, rate, (unsigned long long)r.ops);
+		out << line << std::endl;
+	}
+}
+
+bool MicroBench::writeCsv(const char* filename) const
+{
+	std::ofstream file(filename);
+	if (!file.is_open()) {
+		std::cerr << "could not write micro benchmark results to " << filename << std::endl;
+		return false;
+	}
+	file << "case,ns_per_op,bytes_per_second,ops\n";
+	for (const Result& r : results) {
+		file << r.name << ',' << r.nsPerOp << ',' << r.bytesPerSecond << ',' << r.ops << '\n';
+	}
+	return true;
+}
@@ -0,0 +1,46 @@
+#ifndef _MICRO_BENCH_H_
+#define _MICRO_BENCH_H_
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Times small pieces of CPU work in isolation, for comparing a hot path before and after a
+// change. Each case runs untimed once, then repeats times for at least minSeconds each, and
+// reports the median run: runs differ mostly by what else the machine was doing, the median
+// leaves that out.
+class MicroBench
+{
+public:
+	struct Result
+	{
+		std::string name;
+		double nsPerOp;
+		double bytesPerSecond;
+		uint64_t ops;
+	};
+
+	MicroBench(int repeats, double minSeconds);
+
+	//! Times one case.
+	// @input op Does batch operations and returns how many bytes they went through, 0 for
+	// cases where bytes do not mean anything
+	void run(const std::string& name, uint64_t batch, const std::function<uint64_t()>& op);
+
+	void report(std::ostream& out) const;
+	bool writeCsv(const char* filename) const;
+
+	// Results fed here are not optimized away
+	static void keep(uint64_t value) { sink += value; }
+	static void keep(float value) { sink += (uint64_t)(int64_t)value; }
+
+private:
+	int repeats;
+	double minSeconds;
+	std::vector<Result> results;
+	static volatile uint64_t sink;
+};
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef _OVR_HANDLE_H_
+#define _OVR_HANDLE_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include <OVR_CAPI.h>
+#include <OVR_CAPI_GL.h>
+
+// A swap chain or mirror texture of a session that is destroyed with it, move-only like
+// GLHandle. The session has to outlive it, RiftApp resets its own in shutdownGl.
+template <typename Traits>
+class OvrHandle
+{
+public:
+	typedef typename Traits::Object Object;
+	typedef typename Traits::Desc Desc;
+
+	OvrHandle() : session(nullptr), object(nullptr) {}
+	~OvrHandle() { reset(); }
+
+	OvrHandle(OvrHandle&& other) : session(other.session), object(other.object)
+	{
+		other.session = nullptr;
+		other.object = nullptr;
+	}
+	OvrHandle& operator=(OvrHandle&& other)
+	{
+		if (this != &other) {
+			reset();
+			session = other.session;
+			object = other.object;
+			other.session = nullptr;
+			other.object = nullptr;
+		}
+		return *this;
+	}
+
+	OvrHandle(const OvrHandle&) = delete;
+	OvrHandle& operator=(const OvrHandle&) = delete;
+
+	// A new object, in place of the one held. Holds nothing if it fails.
+	ovrResult create(ovrSession owner, const Desc& desc)
+	{
+		reset();
+		ovrResult result = Traits::create(owner, desc, &object);
+		if (OVR_SUCCESS(result)) {
+			session = owner;
+		}
+		else {
+			object = nullptr;
+		}
+		return result;
+	}
+	void reset()
+	{
+		if (object) {
+			Traits::destroy(session, object);
+		}
+		session = nullptr;
+		object = nullptr;
+	}
+
+	Object get() const { return object; }
+	operator Object() const { return object; }
+
+private:
+	ovrSession session;
+	Object object;
+};
+
+struct OvrSwapChainTraits
+{
+	typedef ovrTextureSwapChain Object;
+	typedef ovrTextureSwapChainDesc Desc;
+	static ovrResult create(ovrSession session, const Desc& desc, Object* out) { return ovr_CreateTextureSwapChainGL(session, &desc, out); }
+	static void destroy(ovrSession session, Object object) { ovr_DestroyTextureSwapChain(session, object); }
+};
+
+struct OvrMirrorTextureTraits
+{
+	typedef ovrMirrorTexture Object;
+	typedef ovrMirrorTextureDesc Desc;
+	static ovrResult create(ovrSession session, const Desc& desc, Object* out) { return ovr_CreateMirrorTextureGL(session, &desc, out); }
+	static void destroy(ovrSession session, Object object) { ovr_DestroyMirrorTexture(session, object); }
+};
+
+typedef OvrHandle<OvrSwapChainTraits> OvrSwapChain;
+typedef OvrHandle<OvrMirrorTextureTraits> OvrMirrorTexture;
+
+#endif
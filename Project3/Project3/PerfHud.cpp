@@ -0,0 +1,309 @@
+#include "PerfHud.h"
+#include "GLMarkers.h"
+
+#include "GpuTimers.h"
+#include "GLStats.h"
+
+#include <OVR_CAPI_GL.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+static const int ROWS = 10;
+// The GL call rows are full at this many calls in a frame
+static const float GL_CALL_RANGE = 1000.0f;
+// Bars for times are full at twice the frame budget, so the budget mark sits halfway
+static const float TIME_RANGE = 2.0f;
+// The latency row is full at this many frame budgets
+static const float LATENCY_RANGE = 4.0f;
+
+static const float BACKGROUND[3] = { 0.02f, 0.02f, 0.02f };
+static const float TRACK[3] = { 0.1f, 0.1f, 0.1f };
+static const float GOOD[3] = { 0.1f, 0.7f, 0.1f };
+static const float BAD[3] = { 0.8f, 0.1f, 0.1f };
+static const float LATENCY[3] = { 0.2f, 0.4f, 0.9f };
+static const float ASW_ACTIVE[3] = { 0.9f, 0.5f, 0.0f };
+static const float ASW_AVAILABLE[3] = { 0.4f, 0.4f, 0.4f };
+static const float MARK[3] = { 0.9f, 0.9f, 0.9f };
+// The GPU passes take turns with these, in the order they were named
+static const float PASS_COLORS[][3] = {
+	{ 0.9f, 0.3f, 0.3f }, { 0.3f, 0.8f, 0.3f }, { 0.3f, 0.5f, 0.9f }, { 0.9f, 0.8f, 0.2f },
+	{ 0.8f, 0.3f, 0.8f }, { 0.2f, 0.8f, 0.8f }, { 0.9f, 0.6f, 0.3f }, { 0.6f, 0.6f, 0.6f },
+};
+static const int PASS_COLOR_COUNT = sizeof(PASS_COLORS) / sizeof(PASS_COLORS[0]);
+// LatencyProbe's stages, left to right
+static const float LATENCY_STAGES[][3] = { { 0.3f, 0.8f, 0.3f }, { 0.9f, 0.8f, 0.2f }, { 0.2f, 0.4f, 0.9f }, { 0.6f, 0.6f, 0.6f } };
+
+PerfHud::PerfHud() : session(nullptr), layers(nullptr), layer(-1), width(0), height(0), frameBudget(1.0f / 90.0f),
+	head(0), count(0), residentBytes(0), budgetBytes(0), evictions(0), evictionsShown(0), latencyStageCount(0),
+	latencyReported(-1.0f)
+{
+	memset(latencyStages, 0, sizeof(latencyStages));
+}
+
+PerfHud::~PerfHud()
+{
+	shutdown();
+}
+
+bool PerfHud::init(ovrSession session, QuadLayers& layers, float frameBudget, size_t logLength, int width, int height)
+{
+	shutdown();
+	this->session = session;
+	this->frameBudget = frameBudget > 0.0f ? frameBudget : 1.0f / 90.0f;
+	this->width = width;
+	this->height = height;
+	samples.assign(std::max<size_t>(logLength, 1), Sample());
+	head = 0;
+	count = 0;
+
+	// Head locked, a little below the line of sight so it stays out of the way
+	ovrPosef pose = {};
+	pose.Orientation.w = 1.0f;
+	pose.Position.y = -0.25f;
+	pose.Position.z = -1.0f;
+	layer = layers.add(width, height, false, true, pose, 0.4f);
+	if (layer < 0) {
+		std::cerr << "could not create the performance HUD layer" << std::endl;
+		return false;
+	}
+	this->layers = &layers;
+	return true;
+}
+
+void PerfHud::shutdown()
+{
+	// The layer goes with the QuadLayers it is in
+	layers = nullptr;
+	layer = -1;
+}
+
+void PerfHud::setVisible(bool on)
+{
+	if (layers) {
+		layers->setShown(layer, on);
+	}
+}
+
+size_t PerfHud::poll()
+{
+	if (!session || samples.empty()) {
+		return 0;
+	}
+	ovrPerfStats stats;
+	if (!OVR_SUCCESS(ovr_GetPerfStats(session, &stats))) {
+		return 0;
+	}
+	// FrameStats[0] is the newest, the ring is filled oldest first
+	for (int i = stats.FrameStatsCount - 1; i >= 0; i--) {
+		const ovrPerfStatsPerCompositorFrame& frame = stats.FrameStats[i];
+		Sample& sample = samples[head];
+		sample.appFrameIndex = frame.AppFrameIndex;
+		sample.appGpuTime = frame.AppGpuElapsedTime;
+		sample.appCpuTime = frame.AppCpuElapsedTime;
+		sample.compositorLatency = frame.CompositorLatency;
+		sample.motionToPhoton = frame.AppMotionToPhotonLatency;
+		sample.queueAhead = frame.AppQueueAheadTime;
+		sample.compositorCpuToGpuEnd = frame.CompositorCpuStartToGpuEndElapsedTime;
+		sample.compositorGpuEndToVsync = frame.CompositorGpuEndToVsyncElapsedTime;
+		sample.appDroppedFrames = frame.AppDroppedFrameCount;
+		sample.compositorDroppedFrames = frame.CompositorDroppedFrameCount;
+		sample.aswActive = frame.AswIsActive != ovrFalse;
+		sample.aswAvailable = stats.AswIsAvailable != ovrFalse;
+		sample.gpuScale = stats.AdaptiveGpuPerformanceScale;
+		head = (head + 1) % samples.size();
+		count = std::min(count + 1, samples.size());
+	}
+	if (stats.FrameStatsCount > 0 && layers) {
+		layers->invalidate(layer);
+	}
+	return std::min((size_t)std::max(stats.FrameStatsCount, 0), samples.size());
+}
+
+bool PerfHud::latest(Sample& out) const
+{
+	if (!count) {
+		return false;
+	}
+	out = recent(0);
+	return true;
+}
+
+const PerfHud::Sample& PerfHud::recent(size_t age) const
+{
+	return samples[(head + samples.size() - 1 - age) % samples.size()];
+}
+
+// Fills the left fraction of a row, rows count from the top of the HUD
+void PerfHud::bar(int row, float fraction, const float color[3])
+{
+	int rowHeight = height / ROWS;
+	int y = height - (row + 1) * rowHeight;
+	int barWidth = (int)(width * std::min(std::max(fraction, 0.0f), 1.0f));
+	if (barWidth <= 0) {
+		return;
+	}
+	glScissor(0, y + 2, barWidth, rowHeight - 4);
+	glClearColor(color[0], color[1], color[2], 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+}
+
+void PerfHud::setResidency(uint64_t resident, uint64_t budget, size_t evicted)
+{
+	if ((resident != residentBytes || budget != budgetBytes || evicted != evictions) && layers) {
+		layers->invalidate(layer);
+	}
+	residentBytes = resident;
+	budgetBytes = budget;
+	evictions = evicted;
+}
+
+void PerfHud::setLatency(const float* stages, int stageCount, float reported)
+{
+	latencyStageCount = std::min(std::max(stageCount, 0), (int)MAX_LATENCY_STAGES);
+	for (int i = 0; i < latencyStageCount; i++) {
+		latencyStages[i] = stages[i];
+	}
+	latencyReported = reported;
+	if (layers) {
+		layers->invalidate(layer);
+	}
+}
+
+void PerfHud::render()
+{
+	if (!layers || !layers->begin(layer)) {
+		return;
+	}
+	GLfloat clearColor[4];
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(0, 0, width, height);
+	glClearColor(BACKGROUND[0], BACKGROUND[1], BACKGROUND[2], 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	for (int row = 0; row < ROWS; row++) {
+		bar(row, 1.0f, TRACK);
+	}
+
+	if (count) {
+		const Sample& latest = recent(0);
+		float range = frameBudget * TIME_RANGE;
+		bar(0, latest.appGpuTime / range, latest.appGpuTime > frameBudget ? BAD : GOOD);
+		bar(1, latest.compositorLatency / range, LATENCY);
+
+		// Two pixels per frame, the newest on the right, red where the app dropped frames
+		int rowHeight = height / ROWS;
+		int columns = std::min((int)count - 1, width / 2);
+		glClearColor(BAD[0], BAD[1], BAD[2], 1.0f);
+		for (int age = 0; age < columns; age++) {
+			if (recent(age).appDroppedFrames != recent(age + 1).appDroppedFrames) {
+				glScissor(width - 2 * (age + 1), height - 3 * rowHeight + 2, 2, rowHeight - 4);
+				glClear(GL_COLOR_BUFFER_BIT);
+			}
+		}
+
+		if (latest.aswActive) {
+			bar(3, 1.0f, ASW_ACTIVE);
+		}
+		else if (latest.aswAvailable) {
+			bar(3, 0.25f, ASW_AVAILABLE);
+		}
+
+		// The runtime's scale is above 1 while there is GPU time to spare, before it reports
+		// one the headroom is what is left of the budget
+		float headroom = latest.gpuScale > 0.0f ? 1.0f - 1.0f / latest.gpuScale : 1.0f - latest.appGpuTime / frameBudget;
+		bar(4, headroom, headroom > 0.1f ? GOOD : BAD);
+	}
+
+	// The timed GPU passes' averages end to end, on the same scale as the app's GPU time
+	int rowHeight = height / ROWS;
+	int x = 0;
+	const GpuTimers& timers = gpuTimers();
+	for (size_t i = 0; i < timers.passCount() && x < width; i++) {
+		GpuTimers::Stats stats;
+		if (!timers.stats((int)i, stats)) {
+			continue;
+		}
+		int w = (int)(width * stats.avgMs / 1000.0f / (frameBudget * TIME_RANGE) + 0.5f);
+		w = std::min(w, width - x);
+		if (w <= 0) {
+			continue;
+		}
+		const float* color = PASS_COLORS[i % PASS_COLOR_COUNT];
+		glScissor(x, height - 6 * rowHeight + 2, w, rowHeight - 4);
+		glClearColor(color[0], color[1], color[2], 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT);
+		x += w;
+	}
+
+	// GL calls of the last frame, only counted in CAVE_GL_STATS builds: draws, then the
+	// state, uniform and framebuffer calls, red once anything is created mid-frame
+	const GLStats& gl = glStats();
+	if (gl.installed()) {
+		const GLCallCounts& calls = gl.lastFrame();
+		bar(6, calls.draws / GL_CALL_RANGE, GOOD);
+		float other = (float)(calls.stateChanges + calls.uniforms + calls.uniformLookups + calls.framebufferBinds + calls.attachments);
+		bar(7, other / GL_CALL_RANGE, calls.creations ? BAD : LATENCY);
+	}
+
+	// Texture residency, orange when the budget made the registry evict since the last redraw
+	if (budgetBytes) {
+		float pressure = (float)((double)residentBytes / (double)budgetBytes);
+		bar(8, pressure, evictions != evictionsShown ? ASW_ACTIVE : pressure > 1.0f ? BAD : GOOD);
+		evictionsShown = evictions;
+	}
+
+	// The stages end to end, the compositor's figure over them
+	if (latencyStageCount) {
+		float range = frameBudget * LATENCY_RANGE;
+		float total = 0.0f;
+		for (int i = 0; i < latencyStageCount; i++) {
+			total += std::max(latencyStages[i], 0.0f);
+		}
+		// Each bar fills from the left, so the stages go in from the last
+		for (int i = latencyStageCount; i-- > 0;) {
+			bar(9, total / range, LATENCY_STAGES[i]);
+			total -= std::max(latencyStages[i], 0.0f);
+		}
+		if (latencyReported >= 0.0f) {
+			glScissor(std::min((int)(width * latencyReported / range), width - 2), height - 10 * rowHeight, 2, rowHeight);
+			glClearColor(MARK[0], MARK[1], MARK[2], 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT);
+		}
+	}
+
+	// The frame budget on the time rows
+	glScissor((int)(width / TIME_RANGE), height - 2 * rowHeight, 1, 2 * rowHeight);
+	glClearColor(MARK[0], MARK[1], MARK[2], 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glScissor((int)(width / TIME_RANGE), height - 6 * rowHeight, 1, rowHeight);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	glDisable(GL_SCISSOR_TEST);
+	glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+	layers->end(layer);
+}
+
+bool PerfHud::dump(const char* filename) const
+{
+	if (!count) {
+		return true;
+	}
+	std::ofstream file(filename);
+	if (!file.is_open()) {
+		std::cerr << "could not write performance stats to " << filename << std::endl;
+		return false;
+	}
+
+	file << "app_frame,app_gpu_ms,app_cpu_ms,compositor_latency_ms,motion_to_photon_ms,app_dropped,"
+		"compositor_dropped,asw_active,asw_available,gpu_scale\n";
+	for (size_t age = count; age-- > 0;) {
+		const Sample& s = recent(age);
+		file << s.appFrameIndex << ',' << s.appGpuTime * 1000.0f << ',' << s.appCpuTime * 1000.0f << ','
+			<< s.compositorLatency * 1000.0f << ',' << s.motionToPhoton * 1000.0f << ',' << s.appDroppedFrames << ','
+			<< s.compositorDroppedFrames << ',' << s.aswActive << ',' << s.aswAvailable << ',' << s.gpuScale << '\n';
+	}
+	return true;
+}
@@ -0,0 +1,110 @@
+#ifndef _PERF_HUD_H_
+#define _PERF_HUD_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include <OVR_CAPI.h>
+
+#include "QuadLayers.h"
+
+#include <cstdint>
+#include <vector>
+
+// Compositor statistics from ovr_GetPerfStats, kept in a ring of the most recent frames and
+// shown as bars on a head-locked quad layer (QuadLayers). The compositor places the quad
+// over the eye buffers, so showing it adds nothing to the scene's passes, and the bars are
+// only drawn again when something they show has changed.
+//
+// Rows, top to bottom: app GPU time against the frame budget, compositor latency, frames
+// dropped over the ring, ASW (orange while active, grey while only available), GPU
+// headroom, the GpuTimers passes' average times end to end, with GLStats the frame's
+// draws and other GL calls, the resident textures against their budget (setResidency),
+// orange in a frame that evicted some, and with latency.probe the newest frame's
+// motion-to-photon estimate by stage (setLatency) against four frame budgets, the latency
+// the compositor reported for it marked in white.
+class PerfHud
+{
+public:
+	struct Sample {
+		int appFrameIndex;
+		float appGpuTime;
+		float appCpuTime;
+		float compositorLatency;
+		float motionToPhoton;
+		float queueAhead;
+		float compositorCpuToGpuEnd;
+		float compositorGpuEndToVsync;
+		int appDroppedFrames;
+		int compositorDroppedFrames;
+		bool aswActive;
+		bool aswAvailable;
+		float gpuScale;
+	};
+
+	PerfHud();
+	~PerfHud();
+
+	PerfHud(const PerfHud&) = delete;
+	PerfHud& operator=(const PerfHud&) = delete;
+
+	// Adds the HUD's layer to layers, frameBudget is the display's frame time in seconds
+	bool init(ovrSession session, QuadLayers& layers, float frameBudget, size_t logLength, int width = 256, int height = 128);
+	void shutdown();
+
+	void setVisible(bool on);
+	bool isVisible() const { return layers && layers->shown(layer); }
+
+	// Reads the stats of every compositor frame since the last poll into the ring, returns
+	// how many there were
+	size_t poll();
+	// Redraws the bars from the ring and commits them for the next ovr_SubmitFrame, if
+	// anything has changed since the last time
+	void render();
+
+	// The scene's resident texture bytes, their budget (0 for none, no bar) and how many
+	// textures have been evicted so far
+	void setResidency(uint64_t resident, uint64_t budget, size_t evictions);
+	// A frame's motion-to-photon stages in seconds (LatencyProbe), and what the compositor
+	// reported for it, negative for nothing yet
+	void setLatency(const float* stages, int stageCount, float reported);
+
+	// Writes the ring, oldest first, as CSV
+	bool dump(const char* filename) const;
+	size_t sampleCount() const { return count; }
+	// The newest sample, false before the first
+	bool latest(Sample& out) const;
+	// The sample age compositor frames before the newest, age under sampleCount()
+	const Sample& recent(size_t age) const;
+
+private:
+	void bar(int row, float fraction, const float color[3]);
+
+	ovrSession session;
+	QuadLayers* layers;
+	int layer;
+	int width;
+	int height;
+	float frameBudget;
+
+	std::vector<Sample> samples;
+	size_t head;
+	size_t count;
+
+	uint64_t residentBytes;
+	uint64_t budgetBytes;
+	size_t evictions;
+	size_t evictionsShown;
+
+	enum { MAX_LATENCY_STAGES = 4 };
+	float latencyStages[MAX_LATENCY_STAGES];
+	int latencyStageCount;
+	float latencyReported;
+};
+
+#endif
@@ -0,0 +1,227 @@
+#include "PipelineWarmup.h"
+#include "GLDebugLog.h"
+#include "GLState.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+// How many of the slowest combinations report() names
+static const size_t SLOWEST_SHOWN = 5;
+
+static double elapsedMs(std::chrono::steady_clock::time_point since)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+}
+
+static bool hasStencil(GLenum format)
+{
+	return format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH32F_STENCIL8;
+}
+
+PipelineWarmup::PipelineWarmup() : emptyVao(0), ran(false), totalMs(0.0), recompilesBefore(0), recompilesAfter(0)
+{
+}
+
+GLuint PipelineWarmup::createTexture(GLenum format, GLsizei samples, GLsizei layers)
+{
+	GLuint texture;
+	glGenTextures(1, &texture);
+	if (layers > 1) {
+		GLenum target = samples > 1 ? GL_TEXTURE_2D_MULTISAMPLE_ARRAY : GL_TEXTURE_2D_ARRAY;
+		glBindTexture(target, texture);
+		if (samples > 1) {
+			glTexStorage3DMultisample(target, samples, format, TARGET_SIZE, TARGET_SIZE, layers, GL_TRUE);
+		}
+		else {
+			glTexStorage3D(target, 1, format, TARGET_SIZE, TARGET_SIZE, layers);
+		}
+		glBindTexture(target, 0);
+	}
+	else {
+		GLenum target = samples > 1 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
+		glBindTexture(target, texture);
+		if (samples > 1) {
+			glTexStorage2DMultisample(target, samples, format, TARGET_SIZE, TARGET_SIZE, GL_TRUE);
+		}
+		else {
+			glTexStorage2D(target, 1, format, TARGET_SIZE, TARGET_SIZE);
+		}
+		glBindTexture(target, 0);
+	}
+	return texture;
+}
+
+int PipelineWarmup::addTarget(const std::string& name, GLenum color, GLenum depth, GLsizei samples, GLsizei layers)
+{
+	GLint maxSamples = 1;
+	glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+	samples = std::max(std::min(samples, (GLsizei)maxSamples), 1);
+	Target target;
+	target.name = name;
+	target.color = color ? createTexture(color, samples, layers) : 0;
+	target.depth = depth ? createTexture(depth, samples, layers) : 0;
+	glGenFramebuffers(1, &target.fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+	// Attached whole, so a layered texture makes a layered framebuffer like the wall passes'
+	if (target.color) {
+		glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, target.color, 0);
+	}
+	else {
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+	}
+	if (target.depth) {
+		glFramebufferTexture(GL_FRAMEBUFFER, hasStencil(depth) ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT, target.depth, 0);
+	}
+	bool complete = checkFramebufferStatus(GL_FRAMEBUFFER, name.c_str());
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	if (!complete) {
+		glDeleteFramebuffers(1, &target.fbo);
+		glDeleteTextures(1, &target.color);
+		glDeleteTextures(1, &target.depth);
+		std::cerr << "pipeline warm-up: " << name << " target not complete, nothing is warmed for it" << std::endl;
+		return -1;
+	}
+	targets.push_back(target);
+	return (int)targets.size() - 1;
+}
+
+void PipelineWarmup::add(const std::string& name, GLuint program, GLuint vao, int target, const State& state)
+{
+	if (!program || target < 0) {
+		return;
+	}
+	for (const Combination& combination : combinations) {
+		if (combination.name == name) {
+			return;
+		}
+	}
+	Combination combination;
+	combination.name = name;
+	combination.program = program;
+	combination.vao = vao;
+	combination.target = target;
+	combination.state = state;
+	combination.firstMs = 0.0;
+	combination.secondMs = 0.0;
+	combinations.push_back(combination);
+}
+
+void PipelineWarmup::run()
+{
+	recompilesBefore = glDebugLog().recompiles();
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+	if (!emptyVao) {
+		glGenVertexArrays(1, &emptyVao);
+	}
+	glViewport(0, 0, TARGET_SIZE, TARGET_SIZE);
+	glState().polygonMode(GL_FILL);
+	glState().depthMask(true);
+	// Whatever compiles on the driver's threads is waited for here, and counted as the warm-up's
+	glFinish();
+	auto start = std::chrono::steady_clock::now();
+	for (Combination& combination : combinations) {
+		const Target& target = targets[combination.target];
+		glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+		if (combination.state.depthTest) {
+			glEnable(GL_DEPTH_TEST);
+		}
+		else {
+			glDisable(GL_DEPTH_TEST);
+		}
+		GLboolean writes = combination.state.colorWrites ? GL_TRUE : GL_FALSE;
+		glColorMask(writes, writes, writes, writes);
+		glState().useProgram(combination.program);
+		glState().bindVertexArray(combination.vao ? combination.vao : emptyVao);
+		// A triangle or a line of whatever the attributes hold, the uniforms as they were
+		// left, nothing of it need show: only that the driver has it ready to draw
+		GLsizei vertices = combination.state.primitive == GL_LINES ? 2 : 3;
+		for (int pass = 0; pass < 2; pass++) {
+			auto drawStart = std::chrono::steady_clock::now();
+			glDrawArrays(combination.state.primitive, 0, vertices);
+			glFinish();
+			(pass ? combination.secondMs : combination.firstMs) = elapsedMs(drawStart);
+		}
+	}
+	totalMs = elapsedMs(start);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	if (depthTest) {
+		glEnable(GL_DEPTH_TEST);
+	}
+	else {
+		glDisable(GL_DEPTH_TEST);
+	}
+	glState().useProgram(0);
+	glState().bindVertexArray(0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	GL_CHECK_ERROR("pipeline warm-up");
+	recompilesAfter = glDebugLog().recompiles();
+	ran = true;
+}
+
+void PipelineWarmup::release()
+{
+	for (Target& target : targets) {
+		glDeleteFramebuffers(1, &target.fbo);
+		glDeleteTextures(1, &target.color);
+		glDeleteTextures(1, &target.depth);
+	}
+	targets.clear();
+	combinations.clear();
+	lazy.clear();
+	if (emptyVao) {
+		glDeleteVertexArrays(1, &emptyVao);
+		emptyVao = 0;
+	}
+	ran = false;
+}
+
+void PipelineWarmup::noteLazy(const std::string& name)
+{
+	if (!ran) {
+		return;
+	}
+	if (std::find(lazy.begin(), lazy.end(), name) == lazy.end()) {
+		lazy.push_back(name);
+	}
+	std::cerr << "pipeline warm-up: " << name << " was not warmed, it compiled in a frame" << std::endl;
+}
+
+void PipelineWarmup::report(std::ostream& out) const
+{
+	if (!ran) {
+		return;
+	}
+	out << "pipeline warm-up: " << combinations.size() << " combinations in " << targets.size() << " targets, " << totalMs
+		<< " ms" << std::endl;
+	// What the first draw cost over the second is what the driver did for it
+	std::vector<const Combination*> slowest;
+	for (const Combination& combination : combinations) {
+		slowest.push_back(&combination);
+	}
+	std::sort(slowest.begin(), slowest.end(), [](const Combination* a, const Combination* b) {
+		return a->firstMs - a->secondMs > b->firstMs - b->secondMs;
+	});
+	slowest.resize(std::min(slowest.size(), SLOWEST_SHOWN));
+	for (const Combination* combination : slowest) {
+		out << "  " << combination->name << " (" << targets[combination->target].name << "): first draw "
+			<< combination->firstMs << " ms, then " << combination->secondMs << " ms" << std::endl;
+	}
+	if (glDebugLog().enabled()) {
+		out << "  driver recompiles: " << recompilesAfter - recompilesBefore << " during the warm-up, "
+			<< glDebugLog().recompiles() - recompilesAfter << " after it" << std::endl;
+	}
+	for (const std::string& name : lazy) {
+		out << "  not warmed: " << name << std::endl;
+	}
+}
+
+PipelineWarmup& pipelineWarmup()
+{
+	static PipelineWarmup instance;
+	return instance;
+}
@@ -0,0 +1,106 @@
+#ifndef _PIPELINE_WARMUP_H_
+#define _PIPELINE_WARMUP_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Draws every program with every state and target format it is drawn with, once, into
+// tiny targets of their own at load time. Linking a program is not the end of it: drivers
+// compile the final shader when it is first drawn, with what it is drawn into, its vertex
+// format and the state that goes into the shader (depth only, lines). Left to the frame, that
+// is a hitch the first time the wireframes are turned on or a wall breaks.
+//
+// The scene adds its combinations and run() draws each twice, a few vertices of nothing,
+// timing both with glFinish: the first pays for the compile, the second shows what is left.
+// What is asked of the driver after run() that was not warmed is noted (noteLazy) and the
+// driver's own recompile messages (GLDebugLog::recompiles) are counted from there, both
+// for report(), to catch what the list misses.
+class PipelineWarmup
+{
+public:
+	enum { TARGET_SIZE = 4 };
+
+	// What of the state goes into the shader the driver compiles
+	struct State
+	{
+		GLenum primitive;
+		bool depthTest;
+		bool colorWrites;
+
+		State(GLenum primitive = GL_TRIANGLES, bool depthTest = true, bool colorWrites = true)
+			: primitive(primitive), depthTest(depthTest), colorWrites(colorWrites)
+		{
+		}
+	};
+
+	PipelineWarmup();
+
+	PipelineWarmup(const PipelineWarmup&) = delete;
+	PipelineWarmup& operator=(const PipelineWarmup&) = delete;
+
+	//! A target for the combinations to draw into, TARGET_SIZE square
+	// @input color, depth Their formats, 0 for none
+	// @input layers Above 1 a layered target, for the programs that pick a layer
+	// @return Its index for add(), -1 if it is not complete
+	int addTarget(const std::string& name, GLenum color, GLenum depth, GLsizei samples, GLsizei layers);
+	//! A program drawn with vao (0 for none) into target with state. A name added already
+	// is not added again.
+	void add(const std::string& name, GLuint program, GLuint vao, int target, const State& state);
+	//! Draws every combination added, leaving the program, vertex array and framebuffer
+	// unbound and depth testing as it was. Needs a current context.
+	void run();
+	bool done() const { return ran; }
+	// Frees the targets, while the context is still there, and forgets the combinations
+	// for the next scene's
+	void release();
+
+	//! A program or state first drawn after run(), which the warm-up did not cover
+	void noteLazy(const std::string& name);
+	void report(std::ostream& out) const;
+
+private:
+	struct Target
+	{
+		std::string name;
+		GLuint fbo;
+		GLuint color;
+		GLuint depth;
+	};
+	struct Combination
+	{
+		std::string name;
+		GLuint program;
+		GLuint vao;
+		int target;
+		State state;
+		// The first and second draws
+		double firstMs;
+		double secondMs;
+	};
+
+	GLuint createTexture(GLenum format, GLsizei samples, GLsizei layers);
+
+	std::vector<Target> targets;
+	std::vector<Combination> combinations;
+	std::vector<std::string> lazy;
+	GLuint emptyVao;
+	bool ran;
+	double totalMs;
+	// GLDebugLog::recompiles() before and after run()
+	uint64_t recompilesBefore;
+	uint64_t recompilesAfter;
+};
+
+PipelineWarmup& pipelineWarmup();
+
+#endif
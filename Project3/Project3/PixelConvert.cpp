@@ -0,0 +1,386 @@
+#include "PixelConvert.h"
+
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// Each kernel is compiled for its instructions on its own, the rest of the build does not
+// assume them
+#if defined(__GNUC__) && !defined(__SSSE3__)
+#define SSSE3_TARGET __attribute__((target("ssse3")))
+#else
+#define SSSE3_TARGET
+#endif
+#if defined(__GNUC__) && !defined(__AVX2__)
+#define AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define AVX2_TARGET
+#endif
+
+static PixelKernel activeKernel = PIXEL_KERNEL_AUTO;
+
+// The sRGB filter averages 14 bit linear values: four of them still add up in 16 bits, and
+// one sRGB step near black is a few of them
+static const int LINEAR_BITS = 14;
+static const int LINEAR_MAX = (1 << LINEAR_BITS) - 1;
+
+struct SRGBTables
+{
+	uint16_t toLinear[256];
+	unsigned char fromLinear[LINEAR_MAX + 1];
+
+	SRGBTables()
+	{
+		for (int i = 0; i < 256; i++) {
+			double s = i / 255.0;
+			double l = s <= 0.04045 ? s / 12.92 : std::pow((s + 0.055) / 1.055, 2.4);
+			toLinear[i] = (uint16_t)(l * LINEAR_MAX + 0.5);
+		}
+		for (int i = 0; i <= LINEAR_MAX; i++) {
+			double l = (double)i / LINEAR_MAX;
+			double s = l <= 0.0031308 ? l * 12.92 : 1.055 * std::pow(l, 1 / 2.4) - 0.055;
+			fromLinear[i] = (unsigned char)(s * 255 + 0.5);
+		}
+	}
+};
+
+static const SRGBTables& srgbTables()
+{
+	static SRGBTables tables;
+	return tables;
+}
+
+static bool cpuHas(PixelKernel kernel)
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	if (kernel == PIXEL_KERNEL_SSSE3) {
+		return (info[2] & (1 << 9)) != 0;
+	}
+	// AVX2 needs the OS to save the upper halves of the registers too
+	bool avx = (info[2] & (1 << 28)) != 0 && (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+	__cpuidex(info, 7, 0);
+	return avx && (info[1] & (1 << 5)) != 0;
+#else
+	return kernel == PIXEL_KERNEL_SSSE3 ? __builtin_cpu_supports("ssse3") : __builtin_cpu_supports("avx2");
+#endif
+}
+
+void setPixelKernel(PixelKernel kernel)
+{
+	if (kernel == PIXEL_KERNEL_AUTO) {
+		kernel = PIXEL_KERNEL_AVX2;
+	}
+	if (kernel == PIXEL_KERNEL_AVX2 && !cpuHas(PIXEL_KERNEL_AVX2)) {
+		kernel = PIXEL_KERNEL_SSSE3;
+	}
+	if (kernel == PIXEL_KERNEL_SSSE3 && !cpuHas(PIXEL_KERNEL_SSSE3)) {
+		kernel = PIXEL_KERNEL_SCALAR;
+	}
+	activeKernel = kernel;
+}
+
+PixelKernel pixelKernel()
+{
+	if (activeKernel == PIXEL_KERNEL_AUTO) {
+		setPixelKernel(PIXEL_KERNEL_AUTO);
+	}
+	return activeKernel;
+}
+
+PixelKernel parsePixelKernel(const std::string& name)
+{
+	if (name == "scalar") {
+		return PIXEL_KERNEL_SCALAR;
+	}
+	if (name == "ssse3") {
+		return PIXEL_KERNEL_SSSE3;
+	}
+	if (name == "avx2") {
+		return PIXEL_KERNEL_AVX2;
+	}
+	if (name != "auto") {
+		std::cerr << "unknown pixel kernel " << name << ", picking one for the CPU" << std::endl;
+	}
+	return PIXEL_KERNEL_AUTO;
+}
+
+const char* pixelKernelName(PixelKernel kernel)
+{
+	switch (kernel) {
+	case PIXEL_KERNEL_SCALAR: return "scalar";
+	case PIXEL_KERNEL_SSSE3: return "ssse3";
+	case PIXEL_KERNEL_AVX2: return "avx2";
+	default: return "auto";
+	}
+}
+
+// The vector kernels below do what they can of a job and return how far they got, the
+// scalar loops do the rest
+
+static const char RGBA_SHUFFLE[16] = { 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1 };
+static const char BGRA_SHUFFLE[16] = { 2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1 };
+
+// Four texels a step from a 16 byte load, of which the last 4 bytes are the next step's
+SSSE3_TARGET static size_t expandSsse3(const unsigned char* rgb, size_t count, unsigned char* out, bool bgra)
+{
+	__m128i shuffle = _mm_loadu_si128((const __m128i*)(bgra ? BGRA_SHUFFLE : RGBA_SHUFFLE));
+	__m128i alpha = _mm_set1_epi32((int)0xff000000);
+	size_t i = 0;
+	for (; i + 6 <= count; i += 4) {
+		__m128i texels = _mm_loadu_si128((const __m128i*)(rgb + i * 3));
+		_mm_storeu_si128((__m128i*)(out + i * 4), _mm_or_si128(_mm_shuffle_epi8(texels, shuffle), alpha));
+	}
+	return i;
+}
+
+// Eight texels a step, one load into each 128 bit lane as pshufb stays within a lane
+AVX2_TARGET static size_t expandAvx2(const unsigned char* rgb, size_t count, unsigned char* out, bool bgra)
+{
+	__m256i shuffle = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)(bgra ? BGRA_SHUFFLE : RGBA_SHUFFLE)));
+	__m256i alpha = _mm256_set1_epi32((int)0xff000000);
+	size_t i = 0;
+	for (; i + 10 <= count; i += 8) {
+		const unsigned char* at = rgb + i * 3;
+		__m256i texels = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)at)),
+			_mm_loadu_si128((const __m128i*)(at + 12)), 1);
+		_mm256_storeu_si256((__m256i*)(out + i * 4), _mm256_or_si256(_mm256_shuffle_epi8(texels, shuffle), alpha));
+	}
+	return i;
+}
+
+void expandRGB8(const unsigned char* rgb, size_t count, unsigned char* out, bool bgra, PixelKernel kernel)
+{
+	size_t i = 0;
+	if (kernel == PIXEL_KERNEL_AVX2) {
+		i = expandAvx2(rgb, count, out, bgra);
+	}
+	else if (kernel == PIXEL_KERNEL_SSSE3) {
+		i = expandSsse3(rgb, count, out, bgra);
+	}
+	int red = bgra ? 2 : 0;
+	for (; i < count; i++) {
+		out[i * 4 + red] = rgb[i * 3];
+		out[i * 4 + 1] = rgb[i * 3 + 1];
+		out[i * 4 + 2 - red] = rgb[i * 3 + 2];
+		out[i * 4 + 3] = 255;
+	}
+}
+
+SSSE3_TARGET static size_t swapSsse3(unsigned char* a, unsigned char* b, size_t bytes)
+{
+	size_t i = 0;
+	for (; i + 16 <= bytes; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+		__m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+		_mm_storeu_si128((__m128i*)(a + i), y);
+		_mm_storeu_si128((__m128i*)(b + i), x);
+	}
+	return i;
+}
+
+AVX2_TARGET static size_t swapAvx2(unsigned char* a, unsigned char* b, size_t bytes)
+{
+	size_t i = 0;
+	for (; i + 32 <= bytes; i += 32) {
+		__m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+		__m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+		_mm256_storeu_si256((__m256i*)(a + i), y);
+		_mm256_storeu_si256((__m256i*)(b + i), x);
+	}
+	return i;
+}
+
+void flipRows(unsigned char* pixels, size_t rowBytes, uint32_t rows, PixelKernel kernel)
+{
+	for (uint32_t y = 0; y < rows / 2; y++) {
+		unsigned char* a = pixels + y * rowBytes;
+		unsigned char* b = pixels + (rows - 1 - y) * rowBytes;
+		size_t i = 0;
+		if (kernel == PIXEL_KERNEL_AVX2) {
+			i = swapAvx2(a, b, rowBytes);
+		}
+		else if (kernel == PIXEL_KERNEL_SSSE3) {
+			i = swapSsse3(a, b, rowBytes);
+		}
+		for (; i < rowBytes; i++) {
+			std::swap(a[i], b[i]);
+		}
+	}
+}
+
+// The filter goes a row of the next level at a time: the two source rows summed channel by
+// channel into 16 bits, then each pair of texels of the sums averaged. A pair is the bytes
+// 0-2 and 3-5 of 6, which pshufb pulls apart into the first and second texels' lanes.
+
+SSSE3_TARGET static size_t addRowsSsse3(const unsigned char* a, const unsigned char* b, size_t count, uint16_t* sums)
+{
+	__m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+		__m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+		_mm_storeu_si128((__m128i*)(sums + i), _mm_add_epi16(_mm_unpacklo_epi8(x, zero), _mm_unpacklo_epi8(y, zero)));
+		_mm_storeu_si128((__m128i*)(sums + i + 8), _mm_add_epi16(_mm_unpackhi_epi8(x, zero), _mm_unpackhi_epi8(y, zero)));
+	}
+	return i;
+}
+
+AVX2_TARGET static size_t addRowsAvx2(const unsigned char* a, const unsigned char* b, size_t count, uint16_t* sums)
+{
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m256i x = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(a + i)));
+		__m256i y = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(b + i)));
+		_mm256_storeu_si256((__m256i*)(sums + i), _mm256_add_epi16(x, y));
+	}
+	return i;
+}
+
+// Two texels of the next level from 12 sums, read as the 8 at 0 and the 8 at 4: the first
+// texels' channels out of the one and the other, the second texels' likewise
+static const char FIRST_LOW[16] = { 0, 1, 2, 3, 4, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 };
+static const char FIRST_HIGH[16] = { -1, -1, -1, -1, -1, -1, 4, 5, 6, 7, 8, 9, -1, -1, -1, -1 };
+static const char SECOND_LOW[16] = { 6, 7, 8, 9, 10, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 };
+static const char SECOND_HIGH[16] = { -1, -1, -1, -1, -1, -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1 };
+
+SSSE3_TARGET static uint32_t averagePairsSsse3(const uint16_t* sums, uint32_t width, uint32_t dstWidth, uint16_t* out)
+{
+	__m128i firstLow = _mm_loadu_si128((const __m128i*)FIRST_LOW);
+	__m128i firstHigh = _mm_loadu_si128((const __m128i*)FIRST_HIGH);
+	__m128i secondLow = _mm_loadu_si128((const __m128i*)SECOND_LOW);
+	__m128i secondHigh = _mm_loadu_si128((const __m128i*)SECOND_HIGH);
+	__m128i two = _mm_set1_epi16(2);
+	uint32_t x = 0;
+	for (; x + 2 <= dstWidth && (x + 2) * 2 <= width; x += 2) {
+		__m128i low = _mm_loadu_si128((const __m128i*)(sums + x * 6));
+		__m128i high = _mm_loadu_si128((const __m128i*)(sums + x * 6 + 4));
+		__m128i first = _mm_or_si128(_mm_shuffle_epi8(low, firstLow), _mm_shuffle_epi8(high, firstHigh));
+		__m128i second = _mm_or_si128(_mm_shuffle_epi8(low, secondLow), _mm_shuffle_epi8(high, secondHigh));
+		__m128i average = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(first, second), two), 2);
+		_mm_storel_epi64((__m128i*)(out + x * 3), average);
+		int32_t last = _mm_cvtsi128_si32(_mm_srli_si128(average, 8));
+		memcpy(out + x * 3 + 4, &last, sizeof(last));
+	}
+	return x;
+}
+
+// Four texels a step, two in each lane, which a dword permute then packs together
+AVX2_TARGET static uint32_t averagePairsAvx2(const uint16_t* sums, uint32_t width, uint32_t dstWidth, uint16_t* out)
+{
+	__m256i firstLow = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)FIRST_LOW));
+	__m256i firstHigh = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)FIRST_HIGH));
+	__m256i secondLow = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)SECOND_LOW));
+	__m256i secondHigh = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)SECOND_HIGH));
+	__m256i pack = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+	__m256i two = _mm256_set1_epi16(2);
+	uint32_t x = 0;
+	for (; x + 4 <= dstWidth && (x + 4) * 2 <= width; x += 4) {
+		const uint16_t* at = sums + x * 6;
+		__m256i low = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)at)),
+			_mm_loadu_si128((const __m128i*)(at + 12)), 1);
+		__m256i high = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(at + 4))),
+			_mm_loadu_si128((const __m128i*)(at + 16)), 1);
+		__m256i first = _mm256_or_si256(_mm256_shuffle_epi8(low, firstLow), _mm256_shuffle_epi8(high, firstHigh));
+		__m256i second = _mm256_or_si256(_mm256_shuffle_epi8(low, secondLow), _mm256_shuffle_epi8(high, secondHigh));
+		__m256i average = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(first, second), two), 2);
+		average = _mm256_permutevar8x32_epi32(average, pack);
+		_mm_storeu_si128((__m128i*)(out + x * 3), _mm256_castsi256_si128(average));
+		_mm_storel_epi64((__m128i*)(out + x * 3 + 8), _mm256_extracti128_si256(average, 1));
+	}
+	return x;
+}
+
+SSSE3_TARGET static size_t narrowSsse3(const uint16_t* values, size_t count, unsigned char* out)
+{
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m128i low = _mm_loadu_si128((const __m128i*)(values + i));
+		__m128i high = _mm_loadu_si128((const __m128i*)(values + i + 8));
+		_mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(low, high));
+	}
+	return i;
+}
+
+AVX2_TARGET static size_t narrowAvx2(const uint16_t* values, size_t count, unsigned char* out)
+{
+	size_t i = 0;
+	for (; i + 32 <= count; i += 32) {
+		__m256i low = _mm256_loadu_si256((const __m256i*)(values + i));
+		__m256i high = _mm256_loadu_si256((const __m256i*)(values + i + 16));
+		// packus works within lanes, the permute puts the quarters back in order
+		__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(low, high), 0xd8);
+		_mm256_storeu_si256((__m256i*)(out + i), packed);
+	}
+	return i;
+}
+
+void downsamplePixels(const unsigned char* src, uint32_t width, uint32_t height,
+	unsigned char* dst, uint32_t dstWidth, uint32_t dstHeight, bool srgb, PixelKernel kernel)
+{
+	const SRGBTables* tables = srgb ? &srgbTables() : nullptr;
+	size_t rowCount = (size_t)width * 3;
+	size_t dstRowCount = (size_t)dstWidth * 3;
+	std::vector<uint16_t> sums(rowCount);
+	std::vector<uint16_t> averages(dstRowCount);
+
+	for (uint32_t y = 0; y < dstHeight; y++) {
+		const unsigned char* a = src + std::min(y * 2, height - 1) * rowCount;
+		const unsigned char* b = src + std::min(y * 2 + 1, height - 1) * rowCount;
+		size_t i = 0;
+		if (tables) {
+			for (; i < rowCount; i++) {
+				sums[i] = (uint16_t)(tables->toLinear[a[i]] + tables->toLinear[b[i]]);
+			}
+		}
+		else if (kernel == PIXEL_KERNEL_AVX2) {
+			i = addRowsAvx2(a, b, rowCount, sums.data());
+		}
+		else if (kernel == PIXEL_KERNEL_SSSE3) {
+			i = addRowsSsse3(a, b, rowCount, sums.data());
+		}
+		for (; i < rowCount; i++) {
+			sums[i] = (uint16_t)(a[i] + b[i]);
+		}
+
+		uint32_t x = 0;
+		if (kernel == PIXEL_KERNEL_AVX2) {
+			x = averagePairsAvx2(sums.data(), width, dstWidth, averages.data());
+		}
+		else if (kernel == PIXEL_KERNEL_SSSE3) {
+			x = averagePairsSsse3(sums.data(), width, dstWidth, averages.data());
+		}
+		for (; x < dstWidth; x++) {
+			const uint16_t* first = &sums[std::min(x * 2, width - 1) * 3];
+			const uint16_t* second = &sums[std::min(x * 2 + 1, width - 1) * 3];
+			for (int c = 0; c < 3; c++) {
+				averages[x * 3 + c] = (uint16_t)((first[c] + second[c] + 2) / 4);
+			}
+		}
+
+		unsigned char* out = dst + y * dstRowCount;
+		i = 0;
+		if (tables) {
+			for (; i < dstRowCount; i++) {
+				out[i] = tables->fromLinear[averages[i]];
+			}
+		}
+		else if (kernel == PIXEL_KERNEL_AVX2) {
+			i = narrowAvx2(averages.data(), dstRowCount, out);
+		}
+		else if (kernel == PIXEL_KERNEL_SSSE3) {
+			i = narrowSsse3(averages.data(), dstRowCount, out);
+		}
+		for (; i < dstRowCount; i++) {
+			out[i] = (unsigned char)averages[i];
+		}
+	}
+}
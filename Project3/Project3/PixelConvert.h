@@ -0,0 +1,35 @@
+#ifndef _PIXEL_CONVERT_H_
+#define _PIXEL_CONVERT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// The byte shuffling between an 8-bit RGB image as it is read and what is uploaded or
+// cached: RGB to four channel texels, upside down rows, and the 2x2 box filter of the mip
+// chains, in linear or in sRGB light.
+//
+// Each has a scalar kernel and SSSE3 (pshufb) and AVX2 ones, picked at run time by
+// setPixelKernel(); AUTO is the widest the CPU has and a kernel it does not have falls back
+// to the next narrower one. The kernels give the same bytes, only how fast differs. The
+// sRGB filter's table lookups stay scalar in every kernel, only the sums are vectorized.
+enum PixelKernel { PIXEL_KERNEL_AUTO, PIXEL_KERNEL_SCALAR, PIXEL_KERNEL_SSSE3, PIXEL_KERNEL_AVX2 };
+void setPixelKernel(PixelKernel kernel);
+PixelKernel pixelKernel();
+PixelKernel parsePixelKernel(const std::string& name);
+const char* pixelKernelName(PixelKernel kernel);
+
+//! Expands count RGB texels into four channel ones with an opaque alpha.
+// @input bgra Whether the texels are written in BGRA order rather than RGBA
+void expandRGB8(const unsigned char* rgb, size_t count, unsigned char* out, bool bgra,
+	PixelKernel kernel = pixelKernel());
+
+//! Turns rows of rowBytes upside down in place.
+void flipRows(unsigned char* pixels, size_t rowBytes, uint32_t rows, PixelKernel kernel = pixelKernel());
+
+//! 2x2 box filter of an RGB8 image into the next mip level, odd edges clamped.
+// @input srgb Whether the bytes are sRGB, averaged as the light they stand for
+void downsamplePixels(const unsigned char* src, uint32_t width, uint32_t height,
+	unsigned char* dst, uint32_t dstWidth, uint32_t dstHeight, bool srgb, PixelKernel kernel = pixelKernel());
+
+#endif
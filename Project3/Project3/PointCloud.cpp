@@ -0,0 +1,343 @@
+#include "PointCloud.h"
+#include "EntityStore.h"
+#include "GpuMemory.h"
+#include "GLState.h"
+#include "Log.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <queue>
+#include <utility>
+
+PointCloud::PointCloud()
+{
+	for (unsigned int i = 0; i < MAX_VIEWS; i++) {
+		viewProjections[i] = glm::mat4(1.f);
+		pixelScales[i] = 0.f;
+	}
+}
+
+PointCloud::~PointCloud()
+{
+	// The workers may still be reading the mapping
+	if (!paging.done()) {
+		jobs().wait(paging);
+	}
+}
+
+bool PointCloud::open(const char* filename, uint64_t gpuBytes, uint64_t pointBudget)
+{
+	release();
+	if (!mapPointCloud(filename, cloud)) {
+		return false;
+	}
+	const PointCloudHeader& header = *cloud.header;
+	slotBytes = (GLsizeiptr)std::max<uint64_t>(header.maxNodePoints, 1) * sizeof(PointCloudPoint);
+	// A handful of slots at least, the root and the levels right under it
+	uint64_t slots = std::max<uint64_t>(gpuBytes / (uint64_t)slotBytes, 16);
+	slots = std::min<uint64_t>(slots, header.nodeCount);
+	// The draws' firsts are GLint
+	slots = std::min<uint64_t>(slots, 0x7fffffffull / std::max<uint32_t>(header.maxNodePoints, 1));
+	budgetPoints = std::max<uint64_t>(pointBudget, header.maxNodePoints);
+
+	nodeSlots.assign(header.nodeCount, -1);
+	pageStates.reset(new std::atomic<uint8_t>[header.nodeCount]);
+	for (uint32_t i = 0; i < header.nodeCount; i++) {
+		pageStates[i].store(ABSENT, std::memory_order_relaxed);
+	}
+	slotNodes.assign((size_t)slots, -1);
+	slotFrames.assign((size_t)slots, 0);
+	freeSlots.clear();
+	for (int slot = (int)slots - 1; slot >= 0; slot--) {
+		freeSlots.push_back(slot);
+	}
+
+	GLsizeiptr bytes = (GLsizeiptr)slots * slotBytes;
+	buffer.create();
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferData(GL_ARRAY_BUFFER, bytes, nullptr, GL_DYNAMIC_DRAW);
+	gpuMemory().allocate(GpuMemory::KIND_BUFFER, buffer, (uint64_t)bytes, GpuMemory::STREAMING, "point cloud nodes");
+	vao.create();
+	glState().bindVertexArray(vao);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(PointCloudPoint), (const GLvoid*)0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(PointCloudPoint), (const GLvoid*)(3 * sizeof(float)));
+	glState().bindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	logStream(LOG_INFO) << "point cloud: " << filename << ", " << header.pointCount << " points in " << header.nodeCount
+		<< " nodes, " << slots << " slots (" << (bytes >> 20) << " MB) for " << budgetPoints << " points a frame" << std::endl;
+	return true;
+}
+
+void PointCloud::release()
+{
+	if (!paging.done()) {
+		jobs().wait(paging);
+	}
+	if (buffer) {
+		gpuMemory().release(GpuMemory::KIND_BUFFER, buffer);
+	}
+	buffer.reset();
+	vao.reset();
+	cloud.file.close();
+	cloud.header = nullptr;
+	cloud.nodes = nullptr;
+	cloud.points = nullptr;
+	nodeSlots.clear();
+	pageStates.reset();
+	slotNodes.clear();
+	slotFrames.clear();
+	freeSlots.clear();
+	selected.clear();
+	wanted.clear();
+}
+
+void PointCloud::setModel(const glm::mat4& model)
+{
+	modelMatrix = model;
+	modelScale = glm::length(glm::vec3(model[0]));
+}
+
+void PointCloud::setView(unsigned int view, const glm::mat4& viewProjection, float pixelScale)
+{
+	if (view >= MAX_VIEWS) {
+		return;
+	}
+	viewProjections[view] = viewProjection;
+	pixelScales[view] = pixelScale;
+	viewMask |= 1u << view;
+}
+
+size_t PointCloud::update(size_t budget)
+{
+	if (!valid()) {
+		return 0;
+	}
+	frame++;
+	select();
+	page();
+	return budget ? upload(budget) : 0;
+}
+
+void PointCloud::select()
+{
+	selected.clear();
+	wanted.clear();
+	glm::mat4 clips[MAX_VIEWS];
+	glm::vec4 planes[MAX_VIEWS][6];
+	for (unsigned int view = 0; view < MAX_VIEWS; view++) {
+		if ((viewMask >> view) & 1) {
+			clips[view] = viewProjections[view] * modelMatrix;
+			EntityStore::clipPlanes(clips[view], planes[view]);
+		}
+	}
+
+	// Which views see the node, and how far apart its points are in the one they are
+	// furthest apart in: its spacing over the clip w of its nearest corner, at least
+	const PointCloudNode* nodes = cloud.nodes;
+	auto measure = [&](uint32_t index, float& pixels) {
+		const PointCloudNode& node = nodes[index];
+		glm::vec3 lo(node.boundsMin[0], node.boundsMin[1], node.boundsMin[2]);
+		glm::vec3 hi = lo + glm::vec3(node.size);
+		glm::vec3 center = lo + glm::vec3(0.5f * node.size);
+		float radius = 0.8660254f * node.size;
+		uint32_t mask = 0;
+		pixels = 0.f;
+		for (unsigned int view = 0; view < MAX_VIEWS; view++) {
+			if (!((viewMask >> view) & 1) || !EntityStore::boxInside(planes[view], lo, hi)) {
+				continue;
+			}
+			mask |= 1u << view;
+			const glm::mat4& clip = clips[view];
+			glm::vec3 row(clip[0][3], clip[1][3], clip[2][3]);
+			float w = glm::dot(row, center) + clip[3][3] - radius * glm::length(row);
+			// The eye inside the node (or as good as): as fine as it gets
+			float scaled = node.spacing * modelScale * pixelScales[view];
+			pixels = std::max(pixels, w > 1e-4f ? scaled / w : 1e30f);
+		}
+		return mask;
+	};
+
+	typedef std::pair<float, uint32_t> Open;
+	std::priority_queue<Open> open;
+	float pixels;
+	uint32_t rootMask = viewMask ? measure(0, pixels) : 0;
+	if (rootMask) {
+		open.push(Open(pixels, 0));
+	}
+	uint64_t points = 0;
+	bool full = false;
+	while (!open.empty()) {
+		Open next = open.top();
+		open.pop();
+		const PointCloudNode& node = nodes[next.second];
+		if (nodeSlots[next.second] < 0) {
+			wanted.push_back(next.second);
+			continue;
+		}
+		if (points + node.pointCount > budgetPoints) {
+			full = true;
+			break;
+		}
+		Selected entry;
+		entry.node = next.second;
+		entry.mask = measure(next.second, pixels);
+		selected.push_back(entry);
+		points += node.pointCount;
+		slotFrames[nodeSlots[next.second]] = frame;
+		if (next.first <= pixelSpacing) {
+			continue;
+		}
+		for (uint32_t child = node.firstChild; child < node.firstChild + node.childCount; child++) {
+			float childPixels;
+			if (measure(child, childPixels)) {
+				open.push(Open(childPixels, child));
+			}
+		}
+	}
+	selectedPoints = points;
+	mostPoints = std::max(mostPoints, points);
+	budgetFrames += full ? 1 : 0;
+
+	// What is drawn only changes with the nodes and their views
+	uint64_t hash = 1469598103934665603ull;
+	for (const Selected& entry : selected) {
+		hash = (hash ^ entry.node) * 1099511628211ull;
+		hash = (hash ^ entry.mask) * 1099511628211ull;
+	}
+	for (int i = 0; i < 16; i++) {
+		float value = glm::value_ptr(modelMatrix)[i];
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		hash = (hash ^ bits) * 1099511628211ull;
+	}
+	if (hash != selectionHash) {
+		selectionHash = hash;
+		selectionVersion++;
+	}
+}
+
+void PointCloud::page()
+{
+	for (uint32_t index : wanted) {
+		if (paging.pending() >= MAX_PAGING) {
+			return;
+		}
+		uint8_t expected = ABSENT;
+		if (!pageStates[index].compare_exchange_strong(expected, PAGING)) {
+			continue;
+		}
+		const unsigned char* begin = (const unsigned char*)(cloud.points + cloud.nodes[index].firstPoint);
+		size_t bytes = (size_t)cloud.nodes[index].pointCount * sizeof(PointCloudPoint);
+		std::atomic<uint8_t>* state = &pageStates[index];
+		// A read of every page of the node's points, so the upload never waits on the disk
+		jobs().submit([begin, bytes, state] {
+			unsigned int sum = 0;
+			for (size_t offset = 0; offset < bytes; offset += 4096) {
+				sum += ((const volatile unsigned char*)begin)[offset];
+			}
+			if (bytes) {
+				sum += ((const volatile unsigned char*)begin)[bytes - 1];
+			}
+			(void)sum;
+			state->store(PAGED, std::memory_order_release);
+		}, &paging);
+	}
+}
+
+int PointCloud::takeSlot()
+{
+	if (!freeSlots.empty()) {
+		int slot = freeSlots.back();
+		freeSlots.pop_back();
+		return slot;
+	}
+	int oldest = -1;
+	for (int slot = 0; slot < (int)slotNodes.size(); slot++) {
+		if (slotFrames[slot] < frame && (oldest < 0 || slotFrames[slot] < slotFrames[oldest])) {
+			oldest = slot;
+		}
+	}
+	if (oldest < 0) {
+		return -1;
+	}
+	// Its points may leave memory again too, the next time it is wanted it is read again
+	int node = slotNodes[oldest];
+	nodeSlots[node] = -1;
+	pageStates[node].store(ABSENT, std::memory_order_relaxed);
+	slotNodes[oldest] = -1;
+	evictions++;
+	return oldest;
+}
+
+size_t PointCloud::upload(size_t budget)
+{
+	size_t uploaded = 0;
+	bool bound = false;
+	for (uint32_t index : wanted) {
+		if (uploaded >= budget) {
+			break;
+		}
+		if (pageStates[index].load(std::memory_order_acquire) != PAGED) {
+			continue;
+		}
+		int slot = takeSlot();
+		if (slot < 0) {
+			break;
+		}
+		const PointCloudNode& node = cloud.nodes[index];
+		size_t bytes = (size_t)node.pointCount * sizeof(PointCloudPoint);
+		if (!bound) {
+			glBindBuffer(GL_ARRAY_BUFFER, buffer);
+			bound = true;
+		}
+		glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)slot * slotBytes, (GLsizeiptr)bytes, cloud.points + node.firstPoint);
+		slotNodes[slot] = (int)index;
+		// Not drawn yet, but not to be taken again by the next node this frame either
+		slotFrames[slot] = frame;
+		nodeSlots[index] = slot;
+		uploaded += bytes;
+		uploadedNodes++;
+		uploadedBytes += bytes;
+	}
+	if (bound) {
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	return uploaded;
+}
+
+void PointCloud::draw(uint32_t mask) const
+{
+	if (!valid()) {
+		return;
+	}
+	firsts.clear();
+	counts.clear();
+	GLint slotPoints = (GLint)(slotBytes / (GLsizeiptr)sizeof(PointCloudPoint));
+	for (const Selected& entry : selected) {
+		if (entry.mask & mask) {
+			firsts.push_back(nodeSlots[entry.node] * slotPoints);
+			counts.push_back((GLsizei)cloud.nodes[entry.node].pointCount);
+		}
+	}
+	if (firsts.empty()) {
+		return;
+	}
+	glState().bindVertexArray(vao);
+	glMultiDrawArrays(GL_POINTS, firsts.data(), counts.data(), (GLsizei)firsts.size());
+}
+
+void PointCloud::report(std::ostream& out) const
+{
+	if (!valid()) {
+		return;
+	}
+	out << "point cloud: " << selected.size() << " nodes and " << selectedPoints << " points drawn last frame, at most "
+		<< mostPoints << " of " << budgetPoints << " (the budget cut " << budgetFrames << " frames short), "
+		<< uploadedNodes << " nodes uploaded (" << (uploadedBytes >> 20) << " MB), " << evictions << " slots reused" << std::endl;
+}
@@ -0,0 +1,156 @@
+#ifndef _POINT_CLOUD_H_
+#define _POINT_CLOUD_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include "GLHandle.h"
+#include "JobSystem.h"
+#include "PointCloudFile.h"
+
+// A scan far bigger than the GPU (or memory) holds, drawn from a point cloud file
+// (PointCloudFile.h) at whatever detail the walls need. The file stays mapped; the nodes the
+// views want are faulted in on the workers, then uploaded into one buffer of equal slots,
+// a node to a slot, and the slots not drawn for longest are reused once it is full. How
+// much is drawn goes by the point budget and the views, never by the size of the scan, so
+// a frame takes as long with a billion points as with a million.
+//
+// Every frame update() picks the nodes from the views given with setView(): from the root
+// down, the node whose points are furthest apart on screen first, its children only if its
+// spacing is more than pixelSpacing pixels in a view that sees it, until the point budget
+// is used up. A node is only drawn once it is in a slot, and its children only once it is
+// drawn, so what is missing shows as the coarser level above it and never as a hole. Each
+// node drawn knows which of the views can see it, so every wall pass draws its own part of
+// the one selection out of the one buffer.
+//
+// The points are drawn with GL_POINTS sized by their node's spacing (pointCloud.vert), the
+// level in the colour's alpha.
+class PointCloud
+{
+public:
+	// The views setView() takes, one mask bit each
+	static const unsigned int MAX_VIEWS = 32;
+	// Nodes being faulted in at once
+	static const int MAX_PAGING = 8;
+
+	PointCloud();
+	~PointCloud();
+
+	PointCloud(const PointCloud&) = delete;
+	PointCloud& operator=(const PointCloud&) = delete;
+
+	//! Maps the file and makes the buffer the nodes go into, with the context current.
+	// @input gpuBytes What the buffer may take, at least a few nodes' worth is made
+	// @input pointBudget The most points drawn in a frame
+	// @return Returns false with the reason printed if the file could not be mapped
+	bool open(const char* filename, uint64_t gpuBytes, uint64_t pointBudget);
+	// The buffer and the mapping, with the context current
+	void release();
+	bool valid() const { return cloud.header != nullptr; }
+
+	// Where the cloud is in the world, uniform scale only
+	void setModel(const glm::mat4& model);
+	const glm::mat4& model() const { return modelMatrix; }
+	// Refines a node while its points are more than this many pixels apart
+	void setPixelSpacing(float pixels) { pixelSpacing = pixels; }
+
+	//! A view the next update() selects for, kept until set again or cleared.
+	// @input view Its mask bit, below MAX_VIEWS
+	// @input viewProjection World to clip space
+	// @input pixelScale Pixels a unit covers at clip w = 1 (LodSelector::pixelScale)
+	void setView(unsigned int view, const glm::mat4& viewProjection, float pixelScale);
+	void clearView(unsigned int view) { viewMask &= view < MAX_VIEWS ? ~(1u << view) : ~0u; }
+
+	//! Selects the nodes for the views, then pages and uploads the ones they want first.
+	// @input budget About the bytes to upload, 0 only selects and pages (UploadScheduler)
+	// @return Returns the bytes uploaded
+	size_t update(size_t budget);
+
+	//! Draws the selected nodes any of the views in viewMask can see, with the program in use,
+	// one glMultiDrawArrays
+	void draw(uint32_t viewMask) const;
+
+	// The root's point spacing in the cloud's units, a node's is this over 2 to its level
+	float spacing() const { return valid() ? cloud.header->spacing : 0.f; }
+	// Changes whenever what draw() would draw does
+	uint64_t version() const { return selectionVersion; }
+	// The vertex array draw() draws with
+	GLuint vertexArray() const { return vao; }
+	uint64_t pointCount() const { return valid() ? cloud.header->pointCount : 0; }
+	// The points' bounds in the cloud's units
+	glm::vec3 boundsMin() const { return valid() ? glm::vec3(cloud.header->boundsMin[0], cloud.header->boundsMin[1], cloud.header->boundsMin[2]) : glm::vec3(0.f); }
+	glm::vec3 boundsMax() const { return valid() ? glm::vec3(cloud.header->boundsMax[0], cloud.header->boundsMax[1], cloud.header->boundsMax[2]) : glm::vec3(0.f); }
+	void report(std::ostream& out) const;
+
+private:
+	enum PageState { ABSENT, PAGING, PAGED };
+
+	struct Selected
+	{
+		uint32_t node;
+		uint32_t mask;
+	};
+
+	void select();
+	void page();
+	size_t upload(size_t budget);
+	// A slot for a node: a free one, or the one drawn longest ago that is not drawn now
+	int takeSlot();
+
+	MappedPointCloud cloud;
+	GLBuffer buffer;
+	GLVertexArray vao;
+	GLsizeiptr slotBytes = 0;
+	uint64_t budgetPoints = 0;
+	float pixelSpacing = 1.5f;
+	glm::mat4 modelMatrix = glm::mat4(1.f);
+	float modelScale = 1.f;
+
+	glm::mat4 viewProjections[MAX_VIEWS];
+	float pixelScales[MAX_VIEWS];
+	uint32_t viewMask = 0;
+
+	// By node: its slot or -1, and whether its points are in memory
+	std::vector<int> nodeSlots;
+	std::unique_ptr<std::atomic<uint8_t>[]> pageStates;
+	JobCounter paging;
+	// By slot: its node or -1, and the frame it was last drawn in
+	std::vector<int> slotNodes;
+	std::vector<uint64_t> slotFrames;
+	std::vector<int> freeSlots;
+
+	std::vector<Selected> selected;
+	// The nodes the views want that are not in a slot, most wanted first
+	std::vector<uint32_t> wanted;
+	uint64_t frame = 0;
+	uint64_t selectionVersion = 0;
+	uint64_t selectionHash = 0;
+	mutable std::vector<GLint> firsts;
+	mutable std::vector<GLsizei> counts;
+
+	// For the report
+	uint64_t uploadedNodes = 0;
+	uint64_t uploadedBytes = 0;
+	uint64_t evictions = 0;
+	uint64_t selectedPoints = 0;
+	uint64_t mostPoints = 0;
+	uint64_t budgetFrames = 0;
+};
+
+#endif
@@ -0,0 +1,134 @@
+#include "PointCloudFile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+std::string pointCloudFilePath(const std::string& sourcePath)
+{
+	size_t dot = sourcePath.find_last_of('.');
+	size_t slash = sourcePath.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+		return sourcePath + ".p3points";
+	}
+	return sourcePath.substr(0, dot) + ".p3points";
+}
+
+bool mapPointCloud(const char* filename, MappedPointCloud& cloud)
+{
+	cloud.header = nullptr;
+	cloud.nodes = nullptr;
+	cloud.points = nullptr;
+
+	if (!cloud.file.open(filename)) {
+		std::cerr << "error reading point cloud file, could not locate " << filename << std::endl;
+		return false;
+	}
+
+	const unsigned char* data = cloud.file.data();
+	size_t size = cloud.file.size();
+	const PointCloudHeader* header = (const PointCloudHeader*)data;
+	if (size < sizeof(PointCloudHeader) || header->magic != POINTCLOUD_MAGIC) {
+		std::cerr << "error parsing point cloud file, " << filename << " is not a point cloud file" << std::endl;
+		cloud.file.close();
+		return false;
+	}
+	if (header->version != POINTCLOUD_VERSION) {
+		std::cerr << "error parsing point cloud file, " << filename << " is version " << header->version
+			<< ", rebuild it with MeshBuilder" << std::endl;
+		cloud.file.close();
+		return false;
+	}
+
+	uint64_t nodeBytes = (uint64_t)header->nodeCount * sizeof(PointCloudNode);
+	uint64_t pointBytes = header->pointCount * sizeof(PointCloudPoint);
+	if (header->nodeOffset % 16 || header->pointOffset % 16 || !header->nodeCount ||
+		header->pointCount > size / sizeof(PointCloudPoint) ||
+		header->nodeOffset > size || size - header->nodeOffset < nodeBytes ||
+		header->pointOffset > size || size - header->pointOffset < pointBytes) {
+		std::cerr << "error parsing point cloud file, incomplete data in " << filename << std::endl;
+		cloud.file.close();
+		return false;
+	}
+
+	// One pass over the nodes up front rather than a GPU reading past the points, or a
+	// traversal that never ends, later
+	const PointCloudNode* nodes = (const PointCloudNode*)(data + header->nodeOffset);
+	for (uint32_t i = 0; i < header->nodeCount; i++) {
+		const PointCloudNode& node = nodes[i];
+		bool valid = node.pointCount <= header->maxNodePoints && node.firstPoint <= header->pointCount &&
+			header->pointCount - node.firstPoint >= node.pointCount && node.level < POINTCLOUD_MAX_LEVELS;
+		if (valid && node.childCount) {
+			valid = node.childCount <= 8 && node.firstChild > i && node.firstChild <= header->nodeCount &&
+				header->nodeCount - node.firstChild >= node.childCount;
+		}
+		if (!valid) {
+			std::cerr << "error parsing point cloud file, bad node " << i << " in " << filename << std::endl;
+			cloud.file.close();
+			return false;
+		}
+	}
+
+	cloud.header = header;
+	cloud.nodes = nodes;
+	cloud.points = (const PointCloudPoint*)(data + header->pointOffset);
+	return true;
+}
+
+bool writePointCloudFile(const char* filename, const PointCloudNode* nodes, uint32_t nodeCount,
+	const PointCloudPoint* points, uint64_t pointCount, uint64_t sourceSize, uint64_t sourceTime)
+{
+	if (!nodeCount) {
+		return false;
+	}
+	PointCloudHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = POINTCLOUD_MAGIC;
+	header.version = POINTCLOUD_VERSION;
+	header.nodeCount = nodeCount;
+	header.pointCount = pointCount;
+	header.nodeOffset = (sizeof(PointCloudHeader) + 15) & ~(uint64_t)15;
+	header.pointOffset = (header.nodeOffset + (uint64_t)nodeCount * sizeof(PointCloudNode) + 15) & ~(uint64_t)15;
+	header.spacing = nodes[0].spacing;
+	header.sourceSize = sourceSize;
+	header.sourceTime = sourceTime;
+	for (uint32_t i = 0; i < nodeCount; i++) {
+		header.maxNodePoints = std::max(header.maxNodePoints, nodes[i].pointCount);
+		header.levels = std::max(header.levels, nodes[i].level + 1);
+	}
+	for (int axis = 0; axis < 3; axis++) {
+		header.boundsMin[axis] = pointCount ? INFINITY : 0.f;
+		header.boundsMax[axis] = pointCount ? -INFINITY : 0.f;
+	}
+	for (uint64_t i = 0; i < pointCount; i++) {
+		for (int axis = 0; axis < 3; axis++) {
+			header.boundsMin[axis] = std::min(header.boundsMin[axis], points[i].position[axis]);
+			header.boundsMax[axis] = std::max(header.boundsMax[axis], points[i].position[axis]);
+		}
+	}
+
+	FILE* fp = fopen(filename, "wb");
+	if (!fp) {
+		return false;
+	}
+	static const unsigned char zeros[16] = { 0 };
+	size_t nodePad = (size_t)(header.nodeOffset - sizeof(PointCloudHeader));
+	size_t pointPad = (size_t)(header.pointOffset - header.nodeOffset - (uint64_t)nodeCount * sizeof(PointCloudNode));
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+	ok = ok && fwrite(zeros, 1, nodePad, fp) == nodePad;
+	ok = ok && fwrite(nodes, sizeof(PointCloudNode), nodeCount, fp) == nodeCount;
+	ok = ok && fwrite(zeros, 1, pointPad, fp) == pointPad;
+	// In pieces, a write of several GB at once is more than some C runtimes take
+	const uint64_t chunk = 1 << 20;
+	for (uint64_t written = 0; ok && written < pointCount; written += chunk) {
+		size_t count = (size_t)std::min(chunk, pointCount - written);
+		ok = fwrite(points + written, sizeof(PointCloudPoint), count, fp) == count;
+	}
+	ok = (fclose(fp) == 0) && ok;
+	if (!ok) {
+		remove(filename);
+	}
+	return ok;
+}
@@ -0,0 +1,103 @@
+#ifndef _POINT_CLOUD_FILE_H_
+#define _POINT_CLOUD_FILE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "Image.h"
+
+// On-disk point cloud (.p3points). An octree of the points, each node a sample of what is
+// inside its cube that is about spacing apart, its children the rest at half the spacing
+// (drawn together with the nodes above them, not instead). A coarse view of the whole
+// scan is the first few levels; any part of it gets finer by adding nodes, never by
+// throwing points away. The points are in the layout the GPU draws from, so a node goes
+// into a buffer as it is:
+//
+//   PointCloudHeader
+//   PointCloudNode[nodeCount], from nodeOffset, breadth first
+//   PointCloudPoint[pointCount], from pointOffset, node by node in the same order
+//
+// both arrays starting on a 16 byte boundary. A node's children are next to each other in
+// the node array, and after it, so the root is node 0 and what is coarser comes first in
+// the file. MeshBuilder writes these next to the source scans (XYZ, PLY) at build time;
+// the runtime maps them with mapPointCloud() and reads the nodes it needs straight out of
+// the mapping, never the whole file.
+
+const uint32_t POINTCLOUD_MAGIC = 0x43503350; // "P3PC"
+const uint32_t POINTCLOUD_VERSION = 1;
+// Deeper than this, points closer than the scan can tell apart are kept in one node
+const uint32_t POINTCLOUD_MAX_LEVELS = 24;
+
+// One point, 16 bytes: position (attribute 0) and colour as normalized unsigned bytes
+// (attribute 1), with the level of its node in place of an alpha, for the size it is drawn at
+struct PointCloudPoint
+{
+	float position[3];
+	uint8_t color[4];
+};
+
+struct PointCloudNode
+{
+	// The node's cube, in the cloud's units
+	float boundsMin[3];
+	float size;
+	uint64_t firstPoint;
+	uint32_t pointCount;
+	// Children first..first + count - 1, none with count 0
+	uint32_t firstChild;
+	uint32_t childCount;
+	uint32_t level;
+	// How far apart the node's points are at least
+	float spacing;
+	uint32_t reserved;
+};
+
+struct PointCloudHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t nodeCount;
+	// No node has more, what one node's buffer space is sized for
+	uint32_t maxNodePoints;
+	uint64_t pointCount;
+	uint64_t nodeOffset;
+	uint64_t pointOffset;
+	// Bounds of the points, and the root's spacing
+	float boundsMin[3];
+	float boundsMax[3];
+	float spacing;
+	uint32_t levels;
+	// Size and last-write time of the source file, so stale clouds can be told apart
+	uint64_t sourceSize;
+	uint64_t sourceTime;
+};
+
+// A point cloud file viewed in place. nodes and points point into the mapping and are only
+// valid for as long as the cloud (and so its mapping) lives.
+struct MappedPointCloud
+{
+	MappedFile file;
+	const PointCloudHeader* header = nullptr;
+	const PointCloudNode* nodes = nullptr;
+	const PointCloudPoint* points = nullptr;
+};
+
+// Path of the point cloud file that belongs to a source scan ("a/b.ply" -> "a/b.p3points")
+std::string pointCloudFilePath(const std::string& sourcePath);
+
+//! Map a point cloud file without reading its points.
+// @input filename The location of the .p3points file. If it is missing, truncated or of
+//		another version an error message is printed and this function returns false
+// @input cloud Receives the mapping and the views into it
+//
+// @return Returns true if every node's points lie within the points, none has more than
+//		maxNodePoints, and every child comes after its parent
+bool mapPointCloud(const char* filename, MappedPointCloud& cloud);
+
+// Writes a point cloud file. nodes are in the order described above, with their
+// firstPoint into points; the header's counts, offsets and bounds are filled in here.
+bool writePointCloudFile(const char* filename, const PointCloudNode* nodes, uint32_t nodeCount,
+	const PointCloudPoint* points, uint64_t pointCount, uint64_t sourceSize, uint64_t sourceTime);
+
+#endif
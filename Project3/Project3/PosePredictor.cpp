@@ -0,0 +1,90 @@
+#include "PosePredictor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// When two states come with the same time, as a replayed trace may have them
+static const float FALLBACK_DT = 1.0f / 90.0f;
+static const float PI = 3.14159265f;
+
+PosePredictor::PosePredictor() : filtered(0.f), hasState(false), maxPrediction(0.05), filter(false), minCutoff(1.5f),
+	beta(0.5f), derivativeCutoff(1.0f)
+{
+	memset(&last, 0, sizeof(last));
+	last.ThePose.Orientation.w = 1.f;
+	position.primed = false;
+	speed.primed = false;
+}
+
+void PosePredictor::setFilter(bool enabled, float minCutoff, float beta, float derivativeCutoff)
+{
+	filter = enabled;
+	this->minCutoff = std::max(minCutoff, 0.001f);
+	this->beta = std::max(beta, 0.f);
+	this->derivativeCutoff = std::max(derivativeCutoff, 0.001f);
+	position.primed = false;
+	speed.primed = false;
+}
+
+float PosePredictor::alpha(float cutoff, float dt)
+{
+	float tau = 1.f / (2.f * PI * cutoff);
+	return 1.f / (1.f + tau / dt);
+}
+
+void PosePredictor::update(const ovrPoseStatef& state)
+{
+	glm::vec3 raw(state.ThePose.Position.x, state.ThePose.Position.y, state.ThePose.Position.z);
+	float dt = hasState ? (float)(state.TimeInSeconds - last.TimeInSeconds) : 0.f;
+	if (dt <= 0.f) {
+		dt = FALLBACK_DT;
+	}
+	last = state;
+	hasState = true;
+	if (!filter) {
+		filtered = raw;
+		return;
+	}
+
+	if (!position.primed) {
+		position.value = raw;
+		position.primed = true;
+		speed.value = glm::vec3(0.f);
+		speed.primed = true;
+		filtered = raw;
+		return;
+	}
+	// The speed is filtered on its own, the position's cutoff follows it
+	glm::vec3 velocity = (raw - position.value) / dt;
+	speed.value += (velocity - speed.value) * alpha(derivativeCutoff, dt);
+	float cutoff = minCutoff + beta * glm::length(speed.value);
+	position.value += (raw - position.value) * alpha(cutoff, dt);
+	filtered = position.value;
+}
+
+RigidPose PosePredictor::predict(double time) const
+{
+	const ovrPosef& pose = last.ThePose;
+	glm::quat orientation(pose.Orientation.w, pose.Orientation.x, pose.Orientation.y, pose.Orientation.z);
+	if (!hasState) {
+		return RigidPose(orientation, filtered);
+	}
+	float dt = (float)std::min(std::max(time - last.TimeInSeconds, 0.0), maxPrediction);
+	glm::vec3 velocity(last.LinearVelocity.x, last.LinearVelocity.y, last.LinearVelocity.z);
+	glm::vec3 acceleration(last.LinearAcceleration.x, last.LinearAcceleration.y, last.LinearAcceleration.z);
+	glm::vec3 position = filtered + velocity * dt + acceleration * (0.5f * dt * dt);
+
+	// The angular velocity is in world space, so its rotation goes in front
+	glm::vec3 angular(last.AngularVelocity.x, last.AngularVelocity.y, last.AngularVelocity.z);
+	float rate = glm::length(angular);
+	if (rate * dt > 1e-6f) {
+		orientation = glm::normalize(glm::angleAxis(rate * dt, angular / rate) * orientation);
+	}
+	return RigidPose(orientation, position);
+}
+
+glm::vec3 PosePredictor::predictPoint(const glm::vec3& local, double time) const
+{
+	return predict(time).transform(local);
+}
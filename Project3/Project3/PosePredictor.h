@@ -0,0 +1,59 @@
+#ifndef _POSE_PREDICTOR_H_
+#define _POSE_PREDICTOR_H_
+
+#include <OVR_CAPI.h>
+
+#include "RigidPose.h"
+
+// Where a tracked pose (the head, a hand) will be at a given time, extrapolated from the
+// tracker's last state with its linear and angular velocity and linear acceleration. For
+// work that is shown later or for longer than the frame it was rendered in, such as walls
+// that are only re-rendered every few frames.
+//
+// The position can also go through a One Euro filter first: a low pass whose cutoff rises
+// with speed, so a still head stops jittering and a moving one does not lag.
+class PosePredictor
+{
+public:
+	PosePredictor();
+
+	//! Turns the filter on or off.
+	// @input minCutoff Hz at rest, lower is smoother
+	// @input beta How much the cutoff rises per m/s
+	// @input derivativeCutoff Hz of the low pass on the speed the cutoff follows
+	void setFilter(bool enabled, float minCutoff, float beta, float derivativeCutoff);
+	// Predictions further ahead than this are held there, so a stale state cannot fly off
+	void setMaxPrediction(double seconds) { maxPrediction = seconds; }
+
+	// The tracker's latest state, its TimeInSeconds is the time it is for
+	void update(const ovrPoseStatef& state);
+	bool valid() const { return hasState; }
+	// The time of the latest state, on the tracker's clock
+	double sampleTime() const { return last.TimeInSeconds; }
+
+	RigidPose predict(double time) const;
+	// A point fixed to the pose, such as an eye relative to the head, at time
+	glm::vec3 predictPoint(const glm::vec3& local, double time) const;
+
+private:
+	struct LowPass
+	{
+		glm::vec3 value;
+		bool primed;
+	};
+	static float alpha(float cutoff, float dt);
+
+	ovrPoseStatef last;
+	glm::vec3 filtered;
+	bool hasState;
+	double maxPrediction;
+
+	bool filter;
+	float minCutoff;
+	float beta;
+	float derivativeCutoff;
+	LowPass position;
+	LowPass speed;
+};
+
+#endif
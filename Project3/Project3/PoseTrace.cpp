@@ -0,0 +1,123 @@
+#include "PoseTrace.h"
+
+#include <cstring>
+#include <iostream>
+
+PoseTrace::PoseTrace() : out(nullptr), coder(sizeof(PoseTraceFrame), 0), coded(coder.maxCoded()), position(0), loop(false)
+{
+}
+
+PoseTrace::~PoseTrace()
+{
+	close();
+}
+
+bool PoseTrace::record(const char* filename)
+{
+	close();
+	out = fopen(filename, "wb");
+	if (!out) {
+		std::cerr << "could not write pose trace " << filename << std::endl;
+		return false;
+	}
+	PoseTraceHeader header = { POSETRACE_MAGIC, POSETRACE_VERSION, (uint32_t)sizeof(PoseTraceFrame), 0 };
+	if (fwrite(&header, sizeof(header), 1, out) != 1) {
+		std::cerr << "could not write pose trace " << filename << std::endl;
+		close();
+		return false;
+	}
+	coder.reset();
+	return true;
+}
+
+bool PoseTrace::replay(const char* filename, bool loop)
+{
+	close();
+	FILE* fp = fopen(filename, "rb");
+	if (!fp) {
+		std::cerr << "could not open pose trace " << filename << std::endl;
+		return false;
+	}
+	PoseTraceHeader header;
+	if (fread(&header, sizeof(header), 1, fp) != 1 || header.magic != POSETRACE_MAGIC
+		|| (header.version != 1 && header.version != POSETRACE_VERSION) || header.frameSize != sizeof(PoseTraceFrame)) {
+		std::cerr << filename << " is not a pose trace of this build" << std::endl;
+		fclose(fp);
+		return false;
+	}
+	if (header.version == 1) {
+		PoseTraceFrame frame;
+		while (fread(&frame, sizeof(frame), 1, fp) == 1) {
+			frames.push_back(frame);
+		}
+	}
+	else if (!readCoded(fp)) {
+		std::cerr << "pose trace " << filename << " is cut short after " << frames.size() << " frames" << std::endl;
+	}
+	fclose(fp);
+	if (frames.empty()) {
+		std::cerr << "pose trace " << filename << " has no frames" << std::endl;
+		return false;
+	}
+	this->loop = loop;
+	position = 0;
+	return true;
+}
+
+bool PoseTrace::readCoded(FILE* fp)
+{
+	std::vector<unsigned char> data;
+	unsigned char chunk[4096];
+	size_t read;
+	while ((read = fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+		data.insert(data.end(), chunk, chunk + read);
+	}
+	// Each frame starts as a copy of the one before and takes what changed
+	FrameDeltaReader reader(sizeof(PoseTraceFrame));
+	PoseTraceFrame frame;
+	memset(&frame, 0, sizeof(frame));
+	size_t offset = 0;
+	while (offset < data.size()) {
+		size_t used;
+		if (!reader.read(data.data() + offset, data.size() - offset, &frame, &used)) {
+			return false;
+		}
+		frames.push_back(frame);
+		offset += used;
+	}
+	return true;
+}
+
+void PoseTrace::close()
+{
+	if (out) {
+		fclose(out);
+		out = nullptr;
+	}
+	frames.clear();
+	position = 0;
+}
+
+void PoseTrace::write(const PoseTraceFrame& frame)
+{
+	if (!out) {
+		return;
+	}
+	size_t size = coder.write(&frame, coded.data());
+	if (fwrite(coded.data(), 1, size, out) != size) {
+		std::cerr << "pose trace write failed, recording stopped" << std::endl;
+		fclose(out);
+		out = nullptr;
+	}
+}
+
+const PoseTraceFrame* PoseTrace::next()
+{
+	if (position == frames.size()) {
+		if (!loop || frames.empty()) {
+			return nullptr;
+		}
+		position = 0;
+	}
+	return &frames[position++];
+}
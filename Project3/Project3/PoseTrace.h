@@ -0,0 +1,83 @@
+#ifndef _POSE_TRACE_H_
+#define _POSE_TRACE_H_
+
+#include <OVR_CAPI.h>
+
+#include "FrameDelta.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// A session's tracking and controller input, frame by frame, so it can be played back in
+// place of the SDK: the same head, hands, eye poses and button presses on every run.
+//
+// File layout (little endian, as written):
+//
+//   PoseTraceHeader
+//   PoseTraceFrame[...] up to the end of the file, each delta coded (FrameDelta) against
+//   the one before it, the first in full
+//
+// The frames are the SDK structs as they are, the header's frameSize has their size so a
+// trace from a build with a different SDK is refused instead of misread. Version 1 traces,
+// every frame in full, still play back.
+
+const uint32_t POSETRACE_MAGIC = 0x54503350; // "P3PT"
+const uint32_t POSETRACE_VERSION = 2;
+
+struct PoseTraceHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t frameSize;
+	uint32_t reserved;
+};
+
+struct PoseTraceFrame
+{
+	int64_t frameIndex;
+	double displayTime;
+	double sensorSampleTime;
+	ovrTrackingState tracking;
+	ovrPosef eyePoses[2];
+	ovrInputState input;
+	int32_t inputValid;
+	int32_t reserved;
+};
+
+class PoseTrace
+{
+public:
+	PoseTrace();
+	~PoseTrace();
+
+	PoseTrace(const PoseTrace&) = delete;
+	PoseTrace& operator=(const PoseTrace&) = delete;
+
+	// Frames recorded are appended to filename, which is started over
+	bool record(const char* filename);
+	// Reads a whole trace to play back. With loop set it starts over at the end.
+	bool replay(const char* filename, bool loop);
+	void close();
+
+	bool recording() const { return out != nullptr; }
+	bool replaying() const { return !frames.empty(); }
+
+	void write(const PoseTraceFrame& frame);
+	// The next frame to play back, nullptr once the trace is over
+	const PoseTraceFrame* next();
+	size_t frameCount() const { return frames.size(); }
+
+private:
+	// The version 2 frames after the header, up to the end of the file
+	bool readCoded(FILE* fp);
+
+	FILE* out;
+	FrameDeltaWriter coder;
+	std::vector<unsigned char> coded;
+	std::vector<PoseTraceFrame> frames;
+	size_t position;
+	bool loop;
+};
+
+#endif
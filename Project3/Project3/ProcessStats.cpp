@@ -0,0 +1,41 @@
+#include "ProcessStats.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <unistd.h>
+#include <cstdio>
+#endif
+
+bool readProcessStats(ProcessStats& out)
+{
+	out.residentBytes = 0;
+	out.handles = 0;
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return false;
+	}
+	out.residentBytes = counters.WorkingSetSize;
+	DWORD handles = 0;
+	if (GetProcessHandleCount(GetCurrentProcess(), &handles)) {
+		out.handles = handles;
+	}
+	return true;
+#else
+	FILE* statm = fopen("/proc/self/statm", "r");
+	if (!statm) {
+		return false;
+	}
+	unsigned long size = 0;
+	unsigned long resident = 0;
+	int read = fscanf(statm, "%lu %lu", &size, &resident);
+	fclose(statm);
+	if (read != 2) {
+		return false;
+	}
+	out.residentBytes = (uint64_t)resident * (uint64_t)sysconf(_SC_PAGESIZE);
+	return true;
+#endif
+}
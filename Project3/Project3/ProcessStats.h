@@ -0,0 +1,19 @@
+#ifndef _PROCESS_STATS_H_
+#define _PROCESS_STATS_H_
+
+#include <cstdint>
+
+// What the OS says about this process, for telemetry and the soak test. Each read asks the
+// OS again, a few times a minute is what it is meant for, not every frame.
+struct ProcessStats
+{
+	// The working set on Windows, the resident set elsewhere
+	uint64_t residentBytes;
+	// Open kernel handles, 0 where there is no such count (anywhere but Windows)
+	uint64_t handles;
+};
+
+// False if nothing could be read, the fields are 0 then
+bool readProcessStats(ProcessStats& out);
+
+#endif
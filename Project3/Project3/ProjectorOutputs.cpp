@@ -0,0 +1,113 @@
+#include "ProjectorOutputs.h"
+#include "CpuProfiler.h"
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+ProjectorOutputs::ProjectorOutputs()
+{
+}
+
+ProjectorOutputs::~ProjectorOutputs()
+{
+	close();
+}
+
+size_t ProjectorOutputs::open(GLFWwindow* shared, const std::vector<Output>& outputs, int firstMonitor, int windowSize, bool vsync)
+{
+	close();
+	int monitorCount = 0;
+	GLFWmonitor** monitors = glfwGetMonitors(&monitorCount);
+	firstMonitor = std::max(firstMonitor, 0);
+	windowSize = std::max(windowSize, 16);
+	for (size_t i = 0; i < outputs.size(); i++) {
+		const Output& output = outputs[i];
+		int monitor = firstMonitor + (int)i;
+		std::string title = "projector wall " + std::to_string(output.wall) + (output.eye ? " right" : " left");
+		int x = 0, y = 0, width = windowSize, height = windowSize;
+		// The hints of the shared window still hold, its context is made the same way
+		if (monitor < monitorCount) {
+			const GLFWvidmode* mode = glfwGetVideoMode(monitors[monitor]);
+			glfwGetMonitorPos(monitors[monitor], &x, &y);
+			width = mode->width;
+			height = mode->height;
+			// Borderless over the monitor rather than fullscreen, which would be iconified
+			// whenever the main window has the focus
+			glfwWindowHint(GLFW_DECORATED, GL_FALSE);
+		}
+		else {
+			x = 32 + (int)i * (windowSize + 16);
+			y = 64;
+			std::cerr << title << ": no monitor " << monitor << ", opening a window" << std::endl;
+		}
+		GLFWwindow* window = glfwCreateWindow(width, height, title.c_str(), nullptr, shared);
+		glfwWindowHint(GLFW_DECORATED, GL_TRUE);
+		if (!window) {
+			std::cerr << title << ": no window with a shared context" << std::endl;
+			continue;
+		}
+		glfwSetWindowPos(window, x, y);
+		glfwMakeContextCurrent(window);
+		glfwSwapInterval(vsync ? 1 : 0);
+		Window entry;
+		entry.window = window;
+		entry.output = output;
+		// Read here, the render thread may not ask GLFW for it
+		glfwGetFramebufferSize(window, &entry.width, &entry.height);
+		glGenFramebuffers(1, &entry.readFbo);
+		windows.push_back(entry);
+	}
+	glfwMakeContextCurrent(shared);
+	return windows.size();
+}
+
+void ProjectorOutputs::close()
+{
+	// Their framebuffers go with their contexts
+	for (Window& entry : windows) {
+		glfwDestroyWindow(entry.window);
+	}
+	windows.clear();
+}
+
+void ProjectorOutputs::present(const WallSource& source)
+{
+	if (windows.empty()) {
+		return;
+	}
+	CpuScope scope("projector present");
+	GLFWwindow* frameContext = glfwGetCurrentContext();
+	// Flushed, or the other contexts could wait for a fence the GPU never gets
+	GLsync rendered = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	glFlush();
+	for (Window& entry : windows) {
+		glfwMakeContextCurrent(entry.window);
+		glWaitSync(rendered, 0, GL_TIMEOUT_IGNORED);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+		GLuint texture;
+		GLint layer;
+		GLsizei size;
+		if (!source(entry.output.eye, entry.output.wall, texture, layer, size)) {
+			// A wall switched off is dark in the room as well
+			glClearColor(0.f, 0.f, 0.f, 1.f);
+			glClear(GL_COLOR_BUFFER_BIT);
+			glfwSwapBuffers(entry.window);
+			continue;
+		}
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, entry.readFbo);
+		if (layer >= 0) {
+			glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture, 0, layer);
+		}
+		else {
+			glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+		}
+		glBlitFramebuffer(0, 0, size, size, 0, 0, entry.width, entry.height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+		// Not holding on to a texture the main context may delete
+		glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+		glfwSwapBuffers(entry.window);
+	}
+	glfwMakeContextCurrent(frameContext);
+	glDeleteSync(rendered);
+}
@@ -0,0 +1,74 @@
+#ifndef _PROJECTOR_OUTPUTS_H_
+#define _PROJECTOR_OUTPUTS_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include <functional>
+#include <vector>
+
+// The wall textures the wall passes render anyway, shown on the projectors of a physical
+// CAVE (projector.walls): a borderless window per wall and eye, each covering a monitor of
+// its own, whose context shares the main one's objects. Nothing is rendered for them, every
+// frame each window only blits its wall's texture to its back buffer and swaps, so the
+// simulator and the room run off the same wall passes. Passive stereo is a window per eye.
+//
+// Container objects are not shared, so each context has its own read framebuffer. The
+// frame's commands are fenced on the main context and each window's context waits for the
+// fence on the GPU before it reads, the CPU never waits for it.
+//
+// The windows are presented from the thread rendering the frame, switching contexts for
+// each, and without vsync unless asked for: a swap that waited for a projector's refresh
+// would hold up the headset's frame.
+class ProjectorOutputs
+{
+public:
+	struct Output
+	{
+		int wall;
+		int eye;
+	};
+
+	// Where a wall's image is: the texture, its layer (-1 for a GL_TEXTURE_2D) and the size
+	// drawn of it from the corner, false if the wall has nothing to show
+	typedef std::function<bool(int eye, int wall, GLuint& texture, GLint& layer, GLsizei& size)> WallSource;
+
+	ProjectorOutputs();
+	~ProjectorOutputs();
+
+	ProjectorOutputs(const ProjectorOutputs&) = delete;
+	ProjectorOutputs& operator=(const ProjectorOutputs&) = delete;
+
+	//! A window for each output, the first on monitor firstMonitor and each next one on the
+	// monitor after. Outputs past the last monitor get a windowSize square window instead,
+	// decorated, for trying a layout out on one screen. Main thread, with shared's context
+	// current, which it is again after.
+	// @return How many windows opened
+	size_t open(GLFWwindow* shared, const std::vector<Output>& outputs, int firstMonitor, int windowSize, bool vsync);
+	// Destroys the windows and their contexts. Main thread, with none of them current.
+	void close();
+	size_t size() const { return windows.size(); }
+
+	//! Blits each output's wall into its window and swaps them all. The frame's context has
+	// to be current, it is current again after.
+	void present(const WallSource& source);
+
+private:
+	struct Window
+	{
+		GLFWwindow* window;
+		GLuint readFbo;
+		int width;
+		int height;
+		Output output;
+	};
+
+	std::vector<Window> windows;
+};
+
+#endif
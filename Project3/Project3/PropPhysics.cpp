@@ -0,0 +1,548 @@
+#include "PropPhysics.h"
+#include "CaveLayout.h"
+#include "Config.h"
+#include "CpuProfiler.h"
+#include "EntityStore.h"
+#include "JobSystem.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+#include <string>
+
+const uint32_t PropPhysics::WALL;
+const size_t PropPhysics::NONE;
+
+// Steps a body has to stay under physics.sleep_speed before it sleeps
+static const uint16_t SLEEP_STEPS = 30;
+// The gap contacts look across, of the largest half box
+static const float MARGIN = 0.5f;
+// Contacts are left this deep, so a body at rest keeps its contact from step to step,
+// and this much of the rest is pushed out a pass, over a few passes
+static const float PENETRATION_SLOP = 0.002f;
+static const float PENETRATION_PUSH = 0.8f;
+static const int PUSH_PASSES = 4;
+
+// Half a box turned by rotation, on the world axes
+static glm::vec3 reach(const glm::quat& rotation, const glm::vec3& extent)
+{
+	glm::mat3 basis = glm::mat3_cast(rotation);
+	return glm::abs(basis[0]) * extent.x + glm::abs(basis[1]) * extent.y + glm::abs(basis[2]) * extent.z;
+}
+
+PropPhysics::PropPhysics() : first(0), holding(NONE), holdingInverseMass(0.f), bucketMask(0), largestHalf(0.f), margin(0.f),
+	minimumCell(0.f), cellSize(1.f), gravity(0.f, -9.81f, 0.f), restitution(0.3f), friction(0.5f), damping(0.05f), iterations(8),
+	sleepSpeed(0.05f), awake(0), steps(0), stepMs(0.0), peakContacts(0)
+{
+}
+
+void PropPhysics::setWalls(const CaveLayout& cave)
+{
+	walls.clear();
+	for (size_t i = 0; i < cave.size(); i++) {
+		const CaveWallGeometry& geometry = cave.wallGeometry(i);
+		walls.push_back({ geometry.normal, geometry.plane });
+	}
+}
+
+void PropPhysics::configure(const EntityStore& store, size_t first, size_t count)
+{
+	count = first < store.size() ? std::min(count, store.size() - first) : 0;
+	if (!config().getBool("physics.props", false) || !count) {
+		return;
+	}
+	this->first = first;
+	std::string shape = config().getString("physics.shape", "box");
+	gravity = glm::vec3(0.f, -config().getFloat("physics.gravity", 9.81f), 0.f);
+	restitution = glm::clamp(config().getFloat("physics.restitution", 0.3f), 0.f, 1.f);
+	friction = std::max(config().getFloat("physics.friction", 0.5f), 0.f);
+	damping = glm::clamp(config().getFloat("physics.damping", 0.05f), 0.f, 1.f);
+	iterations = std::max(config().getInt("physics.iterations", 8), 1);
+	sleepSpeed = std::max(config().getFloat("physics.sleep_speed", 0.05f), 0.f);
+	minimumCell = std::max(config().getFloat("physics.cell", 0.f), 0.f);
+	if (shape != "box" && shape != "sphere" && shape != "mixed") {
+		std::cerr << "physics.shape: " << shape << " is not box, sphere or mixed, using box" << std::endl;
+		shape = "box";
+	}
+
+	previous.resize(count);
+	positions.resize(count);
+	velocities.assign(count, glm::vec3(0.f));
+	extents.resize(count);
+	halves.resize(count);
+	inverseMasses.resize(count);
+	shapes.resize(count);
+	asleep.assign(count, 0);
+	slowSteps.assign(count, 0);
+	moves.resize(count);
+	holding = NONE;
+
+	largestHalf = 0.f;
+	for (size_t i = 0; i < count; i++) {
+		size_t index = first + i;
+		glm::vec3 extent = glm::abs(store.extentArray()[index] * store.scaleArray()[index]);
+		positions[i] = previous[i] = store.positionArray()[index];
+		// Every other one a sphere with mixed, the masses by volume
+		bool sphere = shape == "sphere" || (shape == "mixed" && (i & 1));
+		if (sphere) {
+			float radius = std::max(extent.x, std::max(extent.y, extent.z));
+			shapes[i] = SPHERE;
+			extents[i] = halves[i] = glm::vec3(radius);
+			inverseMasses[i] = 1.f / std::max(4.18879f * radius * radius * radius, 1e-9f);
+		}
+		else {
+			shapes[i] = BOX;
+			extents[i] = extent;
+			halves[i] = reach(store.rotationArray()[index], extent);
+			inverseMasses[i] = 1.f / std::max(8.f * extent.x * extent.y * extent.z, 1e-9f);
+		}
+		largestHalf = std::max(largestHalf, std::max(halves[i].x, std::max(halves[i].y, halves[i].z)));
+	}
+	fitCells();
+
+	// Twice as many buckets as bodies keeps the ones that share a bucket by chance few
+	size_t buckets = 1;
+	while (buckets < 2 * count) {
+		buckets <<= 1;
+	}
+	bucketMask = (uint32_t)(buckets - 1);
+	starts.assign(buckets + 1, 0u);
+	cells.resize(count);
+	keys.resize(count);
+	sorted.resize(count);
+	contacts.reserve(count * 4);
+	awake = count;
+	logStream(LOG_INFO) << "prop physics: " << count << " bodies, " << cellSize << " m cells, " << walls.size() << " walls" << std::endl;
+}
+
+void PropPhysics::fitCells()
+{
+	margin = MARGIN * largestHalf;
+	cellSize = std::max(std::max(2.f * largestHalf + margin, minimumCell), 1e-3f);
+}
+
+void PropPhysics::hold(size_t body, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& velocity)
+{
+	if (body >= positions.size()) {
+		return;
+	}
+	if (body != holding) {
+		release(glm::vec3(0.f));
+		holding = body;
+		holdingInverseMass = inverseMasses[body];
+		inverseMasses[body] = 0.f;
+		std::fill(asleep.begin(), asleep.end(), (uint8_t)0);
+		std::fill(slowSteps.begin(), slowSteps.end(), (uint16_t)0);
+	}
+	previous[body] = positions[body] = position;
+	velocities[body] = velocity;
+	if (shapes[body] == BOX) {
+		// Turned in the hand it can be wider than anything was, the cells grow to fit it
+		halves[body] = reach(rotation, extents[body]);
+		float half = std::max(halves[body].x, std::max(halves[body].y, halves[body].z));
+		if (half > largestHalf) {
+			largestHalf = half;
+			fitCells();
+		}
+	}
+}
+
+void PropPhysics::release(const glm::vec3& velocity)
+{
+	if (holding == NONE) {
+		return;
+	}
+	inverseMasses[holding] = holdingInverseMass;
+	velocities[holding] = velocity;
+	std::fill(asleep.begin(), asleep.end(), (uint8_t)0);
+	std::fill(slowSteps.begin(), slowSteps.end(), (uint16_t)0);
+	holding = NONE;
+}
+
+void PropPhysics::step(float dt, JobSystem* jobSystem)
+{
+	if (positions.empty() || dt <= 0.f) {
+		return;
+	}
+	CpuScope scope("physics");
+	int64_t start = cpuProfiler().ticks();
+	const size_t count = positions.size();
+	const size_t grain = EntityStore::PARALLEL_GRAIN;
+	if (count < 2 * grain) {
+		jobSystem = nullptr;
+	}
+
+	if (jobSystem) {
+		jobSystem->parallelFor(count, grain, [this, dt](size_t begin, size_t end, unsigned int) { accelerate(begin, end, dt); });
+	}
+	else {
+		accelerate(0, count, dt);
+	}
+	file(jobSystem);
+
+	size_t slots = jobSystem ? jobSystem->threadSlots() : 1;
+	if (threadContacts.size() < slots) {
+		threadContacts.resize(slots);
+	}
+	for (std::vector<Contact>& list : threadContacts) {
+		list.clear();
+	}
+	if (jobSystem) {
+		jobSystem->parallelFor(count, grain, [this](size_t begin, size_t end, unsigned int thread) { collide(begin, end, thread); });
+	}
+	else {
+		collide(0, count, 0);
+	}
+	// Which thread found a contact changes from run to run, the order they are solved in
+	// does not: the walls first, then from the ground up, so a stack gets what holds it up
+	// passed all the way up in one pass
+	contacts.clear();
+	for (std::vector<Contact>& list : threadContacts) {
+		for (Contact& c : list) {
+			c.height = c.b == WALL ? -FLT_MAX : std::min(positions[c.a].y, positions[c.b].y);
+		}
+		contacts.insert(contacts.end(), list.begin(), list.end());
+	}
+	std::sort(contacts.begin(), contacts.end(), [](const Contact& x, const Contact& y) {
+		return x.height != y.height ? x.height < y.height : x.a != y.a ? x.a < y.a : x.b < y.b;
+	});
+	solve(dt);
+
+	if (jobSystem) {
+		jobSystem->parallelFor(count, grain, [this, dt](size_t begin, size_t end, unsigned int) { move(begin, end, dt); });
+	}
+	else {
+		move(0, count, dt);
+	}
+	separate();
+	if (jobSystem) {
+		jobSystem->parallelFor(count, grain, [this, dt](size_t begin, size_t end, unsigned int) { settle(begin, end, dt); });
+	}
+	else {
+		settle(0, count, dt);
+	}
+
+	awake = (size_t)std::count(asleep.begin(), asleep.end(), (uint8_t)0);
+	steps++;
+	stepMs += (cpuProfiler().ticks() - start) * 1000.0 / cpuProfiler().ticksPerSecond();
+	peakContacts = std::max(peakContacts, contacts.size());
+	if (cpuProfiler().enabled()) {
+		cpuProfiler().counter("physics contacts", (int)contacts.size());
+		cpuProfiler().counter("physics awake", (int)awake);
+	}
+}
+
+void PropPhysics::accelerate(size_t begin, size_t end, float dt)
+{
+	// damping is the share of its velocity a body loses in a second
+	const float keep = std::pow(1.f - damping, dt);
+	for (size_t i = begin; i < end; i++) {
+		previous[i] = positions[i];
+		if (asleep[i] || i == holding) {
+			continue;
+		}
+		velocities[i] = (velocities[i] + gravity * dt) * keep;
+	}
+}
+
+uint32_t PropPhysics::bucket(int x, int y, int z) const
+{
+	return ((uint32_t)x * 73856093u ^ (uint32_t)y * 19349663u ^ (uint32_t)z * 83492791u) & bucketMask;
+}
+
+void PropPhysics::file(JobSystem* jobSystem)
+{
+	const size_t count = positions.size();
+	auto hash = [this](size_t begin, size_t end, unsigned int) {
+		for (size_t i = begin; i < end; i++) {
+			cells[i] = cell(positions[i]);
+			keys[i] = bucket(cells[i].x, cells[i].y, cells[i].z);
+		}
+	};
+	if (jobSystem) {
+		jobSystem->parallelFor(count, EntityStore::PARALLEL_GRAIN, hash);
+	}
+	else {
+		hash(0, count, 0);
+	}
+
+	// A counting sort by bucket: counts, where each bucket begins, then the bodies in order
+	// with starts[b] moving to where bucket b ends, which is where b + 1 begins
+	const size_t buckets = starts.size() - 1;
+	std::fill(starts.begin(), starts.end(), 0u);
+	for (size_t i = 0; i < count; i++) {
+		starts[keys[i] + 1]++;
+	}
+	for (size_t b = 1; b <= buckets; b++) {
+		starts[b] += starts[b - 1];
+	}
+	for (size_t i = 0; i < count; i++) {
+		sorted[starts[keys[i]]++] = (uint32_t)i;
+	}
+	for (size_t b = buckets - 1; b > 0; b--) {
+		starts[b] = starts[b - 1];
+	}
+	starts[0] = 0;
+}
+
+void PropPhysics::collide(size_t begin, size_t end, unsigned int thread)
+{
+	std::vector<Contact>& out = threadContacts[thread];
+	for (size_t i = begin; i < end; i++) {
+		// A sleeping body's contacts with bodies awake are found from their side
+		if (!moving(i)) {
+			continue;
+		}
+		// The held body goes where the hand puts it, walls or not
+		if (i != holding) {
+			for (const WallPlane& wall : walls) {
+				float extent = shapes[i] == SPHERE ? halves[i].x : glm::dot(glm::abs(wall.normal), halves[i]);
+				float depth = extent - (glm::dot(wall.normal, positions[i]) - wall.offset);
+				if (depth > -margin) {
+					out.push_back({ (uint32_t)i, WALL, -wall.normal, depth, 0.f, 0.f, 0.f });
+				}
+			}
+		}
+
+		// The 27 cells around. Cells can share a bucket, only the bodies in the cell itself
+		// are taken from it, which also takes each body once.
+		const glm::ivec3& c = cells[i];
+		for (int z = c.z - 1; z <= c.z + 1; z++) {
+			for (int y = c.y - 1; y <= c.y + 1; y++) {
+				for (int x = c.x - 1; x <= c.x + 1; x++) {
+					uint32_t b = bucket(x, y, z);
+					for (uint32_t s = starts[b]; s < starts[b + 1]; s++) {
+						uint32_t j = sorted[s];
+						// Each pair of bodies awake once
+						if (j == i || (j < i && moving(j)) || cells[j] != glm::ivec3(x, y, z)) {
+							continue;
+						}
+						Contact contact;
+						if (touch((uint32_t)i, j, contact)) {
+							out.push_back(contact);
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+bool PropPhysics::touch(uint32_t a, uint32_t b, Contact& contact) const
+{
+	glm::vec3 d = positions[b] - positions[a];
+	const glm::vec3& ha = halves[a];
+	const glm::vec3& hb = halves[b];
+	// The boxes on the world axes first, around spheres too
+	glm::vec3 overlap = ha + hb + margin - glm::abs(d);
+	if (overlap.x <= 0.f || overlap.y <= 0.f || overlap.z <= 0.f) {
+		return false;
+	}
+	contact.a = a;
+	contact.b = b;
+	contact.bounce = 0.f;
+	contact.impulse = 0.f;
+	if (shapes[a] == BOX && shapes[b] == BOX) {
+		// Apart along the axis they overlap least on
+		int axis = overlap.x < overlap.y ? (overlap.x < overlap.z ? 0 : 2) : (overlap.y < overlap.z ? 1 : 2);
+		contact.normal = glm::vec3(0.f);
+		contact.normal[axis] = d[axis] < 0.f ? -1.f : 1.f;
+		contact.depth = overlap[axis] - margin;
+		return true;
+	}
+	if (shapes[a] == SPHERE && shapes[b] == SPHERE) {
+		float radii = ha.x + hb.x;
+		float distance = glm::length(d);
+		if (distance >= radii + margin) {
+			return false;
+		}
+		contact.normal = distance > 1e-6f ? d / distance : glm::vec3(0.f, 1.f, 0.f);
+		contact.depth = radii - distance;
+		return true;
+	}
+
+	// A sphere and a box, worked out from the sphere towards the box
+	bool sphereFirst = shapes[a] == SPHERE;
+	const glm::vec3& half = sphereFirst ? hb : ha;
+	float radius = sphereFirst ? ha.x : hb.x;
+	glm::vec3 offset = sphereFirst ? -d : d;
+	glm::vec3 outside = offset - glm::clamp(offset, -half, half);
+	float distance2 = glm::dot(outside, outside);
+	glm::vec3 normal(0.f);
+	if (distance2 > 0.f) {
+		float distance = std::sqrt(distance2);
+		if (distance >= radius + margin) {
+			return false;
+		}
+		normal = -outside / distance;
+		contact.depth = radius - distance;
+	}
+	else {
+		// The centre is inside the box, out through the nearest face
+		glm::vec3 faces = half - glm::abs(offset);
+		int axis = faces.x < faces.y ? (faces.x < faces.z ? 0 : 2) : (faces.y < faces.z ? 1 : 2);
+		normal[axis] = offset[axis] < 0.f ? 1.f : -1.f;
+		contact.depth = faces[axis] + radius;
+	}
+	contact.normal = sphereFirst ? normal : -normal;
+	return true;
+}
+
+void PropPhysics::solve(float dt)
+{
+	const glm::vec3 still(0.f);
+	auto byBodies = [](const Contact& x, const Contact& y) { return x.a != y.a ? x.a < y.a : x.b < y.b; };
+	// Only what comes in faster than a few steps of falling and meets within the step
+	// bounces, or wakes a sleeping body up, so bodies at rest stay there
+	const float bounceSpeed = 2.f * glm::length(gravity) * dt;
+	for (Contact& c : contacts) {
+		const glm::vec3& vb = c.b == WALL ? still : velocities[c.b];
+		float approach = glm::dot(velocities[c.a] - vb, c.normal);
+		if (approach > bounceSpeed && c.depth + approach * dt > 0.f) {
+			c.bounce = restitution * approach;
+			wake(c.a);
+			if (c.b != WALL) {
+				wake(c.b);
+			}
+		}
+	}
+
+	// A contact there was at the step before starts from the push it ended that step with,
+	// which is what lets a stack hold up in a few passes rather than one per body in it
+	for (Contact& c : contacts) {
+		auto found = std::lower_bound(warm.begin(), warm.end(), c, byBodies);
+		for (; found != warm.end() && found->a == c.a && found->b == c.b; ++found) {
+			if (glm::dot(found->normal, c.normal) < 0.9f) {
+				continue;
+			}
+			c.impulse = found->impulse;
+			velocities[c.a] -= c.normal * (c.impulse * inverseMass(c.a));
+			if (c.b != WALL) {
+				velocities[c.b] += c.normal * (c.impulse * inverseMass(c.b));
+			}
+			break;
+		}
+	}
+
+	for (int pass = 0; pass < iterations; pass++) {
+		for (Contact& c : contacts) {
+			float ia = inverseMass(c.a);
+			float ib = inverseMass(c.b);
+			float k = ia + ib;
+			if (k <= 0.f) {
+				continue;
+			}
+			const glm::vec3& vb = c.b == WALL ? still : velocities[c.b];
+			glm::vec3 relative = velocities[c.a] - vb;
+			float approach = glm::dot(relative, c.normal);
+			// Bodies apart may close the gap in the step, no more. The push so far never pulls.
+			float allowed = std::max(-c.depth, 0.f) / dt;
+			float total = std::max(c.impulse + (approach - allowed + c.bounce) / k, 0.f);
+			float applied = total - c.impulse;
+			c.impulse = total;
+			glm::vec3 change = c.normal * applied;
+			// Friction takes out the sliding, up to friction times the push
+			glm::vec3 slide = relative - c.normal * approach;
+			float slideSpeed = glm::length(slide);
+			if (slideSpeed > 1e-6f) {
+				change += slide * (std::min(slideSpeed / k, friction * c.impulse) / slideSpeed);
+			}
+			velocities[c.a] -= change * ia;
+			if (c.b != WALL) {
+				velocities[c.b] += change * ib;
+			}
+		}
+	}
+
+	warm = contacts;
+	std::sort(warm.begin(), warm.end(), byBodies);
+}
+
+void PropPhysics::move(size_t begin, size_t end, float dt)
+{
+	for (size_t i = begin; i < end; i++) {
+		if (asleep[i] || i == holding) {
+			moves[i] = glm::vec3(0.f);
+			continue;
+		}
+		moves[i] = velocities[i] * dt;
+	}
+}
+
+void PropPhysics::separate()
+{
+	// What the move left overlapping, pushed apart by the inverse masses. A push moves
+	// bodies other contacts hold too, so this takes a few passes, each contact's depth
+	// less how far its bodies have moved apart along it.
+	const glm::vec3 still(0.f);
+	for (int pass = 0; pass < PUSH_PASSES; pass++) {
+		for (const Contact& c : contacts) {
+			float ia = inverseMass(c.a);
+			float ib = inverseMass(c.b);
+			float k = ia + ib;
+			const glm::vec3& moveB = c.b == WALL ? still : moves[c.b];
+			float depth = c.depth - glm::dot(moveB - moves[c.a], c.normal);
+			float push = std::max(depth - PENETRATION_SLOP, 0.f) * PENETRATION_PUSH;
+			if (k <= 0.f || push <= 0.f) {
+				continue;
+			}
+			moves[c.a] -= c.normal * (push * ia / k);
+			if (c.b != WALL) {
+				moves[c.b] += c.normal * (push * ib / k);
+			}
+		}
+	}
+	for (size_t i = 0; i < positions.size(); i++) {
+		positions[i] += moves[i];
+	}
+}
+
+void PropPhysics::settle(size_t begin, size_t end, float dt)
+{
+	// By how far it went in the step, pushing apart included, so a body still being pushed
+	// out of another does not sleep inside it
+	const float slow = sleepSpeed * sleepSpeed * dt * dt;
+	for (size_t i = begin; i < end; i++) {
+		if (i == holding) {
+			continue;
+		}
+		if (asleep[i]) {
+			velocities[i] = glm::vec3(0.f);
+		}
+		else if (glm::dot(moves[i], moves[i]) >= slow) {
+			slowSteps[i] = 0;
+		}
+		else if (++slowSteps[i] >= SLEEP_STEPS) {
+			asleep[i] = 1;
+			velocities[i] = glm::vec3(0.f);
+		}
+	}
+}
+
+void PropPhysics::apply(EntityStore& store, float alpha) const
+{
+	const glm::vec3* stored = store.positionArray();
+	for (size_t i = 0; i < positions.size(); i++) {
+		if (i == holding) {
+			continue;
+		}
+		glm::vec3 position = glm::mix(previous[i], positions[i], alpha);
+		if (position != stored[first + i]) {
+			store.setPosition(store.entity(first + i), position);
+		}
+	}
+}
+
+void PropPhysics::report(std::ostream& out) const
+{
+	if (positions.empty()) {
+		return;
+	}
+	out << "prop physics: " << positions.size() << " bodies, " << steps << " steps";
+	if (steps) {
+		out << " at " << stepMs / steps << " ms each";
+	}
+	out << ", at most " << peakContacts << " contacts, " << awake << " awake at the end" << std::endl;
+}
@@ -0,0 +1,174 @@
+#ifndef _PROP_PHYSICS_H_
+#define _PROP_PHYSICS_H_
+
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+class CaveLayout;
+class EntityStore;
+class JobSystem;
+
+// physics.props: the props fall, stack, knock each other over and can be thrown, stepped
+// at the simulation's fixed rate (FixedStep). Physics-lite: bodies do not turn, a box
+// collides as the box around it on the world axes, a sphere (physics.shape) as the sphere
+// around its model's widest side, and the CAVE's screens are walls no body goes through.
+//
+// A step runs over the bodies as parallel arrays, split over the job system's threads:
+//
+//   - gravity on the velocities of the bodies awake
+//   - broadphase: a uniform spatial hash, a cell as wide as the widest body and the gap
+//     contacts look across, each body filed by its centre, so whatever it can touch is in
+//     the 27 cells around it. The cells are counted and sorted into one array, nothing is
+//     allocated per cell.
+//   - narrow phase: each body tests the bodies after it in those cells, and the walls,
+//     writing contacts to a list per thread. Bodies a little apart get a contact too, that
+//     only stops them closing more than the gap in a step, so a fast body lands on what
+//     it falls on rather than in it.
+//   - solve: the contacts, merged and sorted so a run does the same every time, get
+//     impulses over physics.iterations passes on the one thread, starting from the
+//     impulses the same contacts ended the step before with
+//   - the bodies move, and what still overlaps is pushed apart
+//
+// Bodies that stay still for a while sleep, and are neither moved nor tested against each
+// other until something awake runs into them, so a settled pile costs next to nothing.
+// A held body (the grabbed prop) goes where the hand puts it and pushes the others, and
+// flies off with the hand's velocity when let go.
+class PropPhysics
+{
+public:
+	enum Shape { BOX, SPHERE };
+
+	PropPhysics();
+
+	PropPhysics(const PropPhysics&) = delete;
+	PropPhysics& operator=(const PropPhysics&) = delete;
+
+	// The screens' planes, the walls every body stays in front of. Again when the layout changes.
+	void setWalls(const CaveLayout& cave);
+	//! Makes bodies of count entities from index first, from physics.* in the config, as
+	// they are in the store.
+	void configure(const EntityStore& store, size_t first, size_t count);
+	bool active() const { return !positions.empty(); }
+	size_t size() const { return positions.size(); }
+
+	//! Holds body where it is put, moving with velocity, until released. Wakes every body,
+	// what rested on it has to fall once it is gone.
+	void hold(size_t body, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& velocity);
+	void release(const glm::vec3& velocity);
+	size_t held() const { return holding; }
+
+	//! One fixed step of dt seconds.
+	// @input jobSystem Splits the passes over its threads, or nullptr for this thread only
+	void step(float dt, JobSystem* jobSystem = nullptr);
+	//! Puts the bodies that moved into the store, where they are between the last two
+	// steps. Not the held body, the hand moves that one.
+	// @input alpha FixedStep::alpha()
+	void apply(EntityStore& store, float alpha) const;
+
+	// Of the last step
+	size_t awakeCount() const { return awake; }
+	size_t contactCount() const { return contacts.size(); }
+	void report(std::ostream& out) const;
+
+	static const size_t NONE = ~(size_t)0;
+
+private:
+	// b is WALL for a screen, normal is from a to b. depth is below 0 for bodies apart.
+	struct Contact
+	{
+		uint32_t a;
+		uint32_t b;
+		glm::vec3 normal;
+		float depth;
+		// The speed along normal to bounce back with, and the impulse so far
+		float bounce;
+		float impulse;
+		// The lower body's height, to solve in
+		float height;
+	};
+	static const uint32_t WALL = ~0u;
+
+	struct WallPlane
+	{
+		glm::vec3 normal;
+		float offset;
+	};
+
+	void accelerate(size_t begin, size_t end, float dt);
+	void file(JobSystem* jobSystem);
+	void collide(size_t begin, size_t end, unsigned int thread);
+	bool touch(uint32_t a, uint32_t b, Contact& contact) const;
+	void solve(float dt);
+	void move(size_t begin, size_t end, float dt);
+	void separate();
+	void settle(size_t begin, size_t end, float dt);
+	void fitCells();
+	uint32_t bucket(int x, int y, int z) const;
+	glm::ivec3 cell(const glm::vec3& p) const { return glm::ivec3(glm::floor(p / cellSize)); }
+	bool moving(size_t body) const { return !asleep[body] || body == holding; }
+	// A sleeping body stays put, like the walls and the held body, until woken
+	float inverseMass(uint32_t body) const { return body == WALL || asleep[body] ? 0.f : inverseMasses[body]; }
+	void wake(uint32_t body)
+	{
+		asleep[body] = 0;
+		slowSteps[body] = 0;
+	}
+
+	// Per body: where it was at the step before and is now, its velocity, half its model's
+	// box, half its box on the world axes (all three the radius for a sphere), 1 / its
+	// mass, 0 while held
+	std::vector<glm::vec3> previous;
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> velocities;
+	std::vector<glm::vec3> extents;
+	std::vector<glm::vec3> halves;
+	std::vector<float> inverseMasses;
+	std::vector<uint8_t> shapes;
+	std::vector<uint8_t> asleep;
+	std::vector<uint16_t> slowSteps;
+	// How far the step moved each body, then pushed it out of the others
+	std::vector<glm::vec3> moves;
+	size_t first;
+	size_t holding;
+	float holdingInverseMass;
+
+	// The hash: each body's cell and bucket, the bodies sorted by bucket and where each
+	// bucket starts. A cell is two of the largest half box plus the gap contacts look across.
+	std::vector<glm::ivec3> cells;
+	std::vector<uint32_t> keys;
+	std::vector<uint32_t> sorted;
+	std::vector<uint32_t> starts;
+	uint32_t bucketMask;
+	float largestHalf;
+	float margin;
+	float minimumCell;
+	float cellSize;
+
+	std::vector<std::vector<Contact>> threadContacts;
+	std::vector<Contact> contacts;
+	// The last step's, by their bodies
+	std::vector<Contact> warm;
+	std::vector<WallPlane> walls;
+
+	glm::vec3 gravity;
+	float restitution;
+	float friction;
+	float damping;
+	int iterations;
+	float sleepSpeed;
+
+	size_t awake;
+	uint64_t steps;
+	double stepMs;
+	size_t peakContacts;
+};
+
+#endif
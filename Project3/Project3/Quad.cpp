@@ -1,52 +1,74 @@
 #include "Quad.h"
+#include "TextureUpload.h"
+#include "TextureCache.h"
+#include "GLState.h"
+#include "MeshPool.h"
+#include "GLStats.h"
+#include "GpuMemory.h"
+#include "GLExtensions.h"
 
 Quad::Quad()
 {
-	//Vertex Array Object
-	glGenVertexArrays(1, &(this->VAO));
-	glBindVertexArray(this->VAO);
-
-	//Vertex Buffer Object
-	glGenBuffers(1, &(this->VBO));
-	glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(quad_vertices), quad_vertices, GL_STATIC_DRAW);
-
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (GLvoid*)0);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
-
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
+	//All quads are the same unit square, in the mesh pool
+	this->VAO = meshPool().vertexArray();
+	this->VBO = meshPool().vertexBuffer();
+	this->EBO = meshPool().indexBuffer();
 }
 
 Quad::~Quad()
 {
-	glDeleteVertexArrays(1, &(this->VAO));
-	glDeleteBuffers(1, &(this->VBO));
 }
 
 void Quad::draw(GLuint shaderProgram, GLuint texture) 
 {
-	glBindVertexArray(this->VAO);
-	//Textures
-	glActiveTexture(GL_TEXTURE0);
-	glUniform1i(glGetUniformLocation(shaderProgram, "renderedTexture"), 0);
+	glState().polygonMode(GL_FILL);
+	//Textures (the program's sampler is set to unit 0 when it is loaded, 0 means the caller
+	//has set it already)
+	if (texture)
+		glState().bindTexture(0, GL_TEXTURE_2D, texture);
+	//Draw
+	meshPool().draw(MeshPool::QUAD);
+}
 
-	glBindTexture(GL_TEXTURE_2D, texture);
+void Quad::drawLayer(GLint layerLocation, GLuint textureArray, int layer)
+{
+	glState().polygonMode(GL_FILL);
+	//Textures
+	glUniform1i(layerLocation, layer);
+	if (textureArray)
+		glState().bindTexture(0, GL_TEXTURE_2D_ARRAY, textureArray);
 	//Draw
-	glDrawArrays(GL_TRIANGLES,0,6);
-	glBindVertexArray(0);
+	meshPool().draw(MeshPool::QUAD);
 }
 
-GLuint Quad::loadQuadTexture(unsigned char* data, int width, int height) {
+GLuint Quad::loadQuadTexture(const unsigned char* data, int width, int height) {
 	GLuint textureID;
+	GLsizei levels = (GLsizei)mipLevelCount(width, height);
+	if (directStateAccess()) {
+		glCreateTextures(GL_TEXTURE_2D, 1, &textureID);
+		glTextureStorage2D(textureID, levels, GL_RGBA8, width, height);
+		gpuMemory().allocate(GpuMemory::KIND_TEXTURE, textureID, textureBytes(GL_RGBA8, width, height, 1, levels),
+			GpuMemory::TEXTURE, "Quad::loadQuadTexture");
+		glTextureSubImage2D(textureID, 0, 0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, data);
+		glStats().addUpload((uint64_t)width * height * 3);
+		glGenerateTextureMipmap(textureID);
+		glTextureParameteri(textureID, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTextureParameteri(textureID, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTextureParameteri(textureID, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTextureParameteri(textureID, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		return textureID;
+	}
+
 	glGenTextures(1, &textureID);
 	glActiveTexture(GL_TEXTURE0);
 
 	glBindTexture(GL_TEXTURE_2D, textureID);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB,
+	allocateTextureStorage(GL_TEXTURE_2D, levels, GL_RGBA8, width, height);
+	gpuMemory().allocate(GpuMemory::KIND_TEXTURE, textureID, textureBytes(GL_RGBA8, width, height, 1, levels),
+		GpuMemory::TEXTURE, "Quad::loadQuadTexture");
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGB,
 		GL_UNSIGNED_BYTE, data);
+	glStats().addUpload((uint64_t)width * height * 3);
 
 	glGenerateMipmap(GL_TEXTURE_2D);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -57,3 +79,7 @@ GLuint Quad::loadQuadTexture(unsigned char* data, int width, int height) {
 
 	return textureID;
 }
+
+GLuint Quad::loadQuadTexture(const Image& image, UploadRing * ring) {
+	return create2DTexture(image, ring);
+}
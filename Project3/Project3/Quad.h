@@ -18,6 +18,9 @@
 #include <iostream>
 #include <vector>
 
+#include "Image.h"
+#include "UploadRing.h"
+
 class Quad
 {
 public:
@@ -25,7 +28,11 @@ public:
 	~Quad();
 
 	void draw(GLuint shaderprogram, GLuint texture);
-	GLuint loadQuadTexture(unsigned char* data, int width, int height);
+	// Draws with one layer of a GL_TEXTURE_2D_ARRAY (screenShaderArray.frag), layerLocation
+	// being the bound program's "layer" uniform
+	void drawLayer(GLint layerLocation, GLuint textureArray, int layer);
+	GLuint loadQuadTexture(const unsigned char* data, int width, int height);
+	GLuint loadQuadTexture(const Image& image, UploadRing * ring = nullptr);
 
 	GLuint VBO, VAO, EBO;
 
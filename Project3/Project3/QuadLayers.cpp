@@ -0,0 +1,180 @@
+#include "QuadLayers.h"
+#include "GLMarkers.h"
+#include "GLState.h"
+#include "PixelConvert.h"
+
+#include <OVR_CAPI_GL.h>
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+QuadLayers::QuadLayers() : session(nullptr), fbo(0), count(0), committed(0)
+{
+	memset(layers, 0, sizeof(layers));
+	memset(savedViewport, 0, sizeof(savedViewport));
+}
+
+QuadLayers::~QuadLayers()
+{
+	shutdown();
+}
+
+void QuadLayers::init(ovrSession session)
+{
+	shutdown();
+	this->session = session;
+}
+
+void QuadLayers::shutdown()
+{
+	if (fbo) {
+		glDeleteFramebuffers(1, &fbo);
+		fbo = 0;
+	}
+	for (int i = 0; i < count; i++) {
+		if (layers[i].chain) {
+			ovr_DestroyTextureSwapChain(session, layers[i].chain);
+		}
+	}
+	memset(layers, 0, sizeof(layers));
+	count = 0;
+}
+
+int QuadLayers::add(int width, int height, bool staticImage, bool headLocked, const ovrPosef& pose, float metersWide)
+{
+	if (!session || count == MAX_LAYERS || width < 1 || height < 1) {
+		return -1;
+	}
+	ovrTextureSwapChainDesc desc = {};
+	desc.Type = ovrTexture_2D;
+	desc.ArraySize = 1;
+	desc.Width = width;
+	desc.Height = height;
+	desc.MipLevels = 1;
+	desc.Format = OVR_FORMAT_R8G8B8A8_UNORM_SRGB;
+	desc.SampleCount = 1;
+	desc.StaticImage = staticImage ? ovrTrue : ovrFalse;
+	Layer& layer = layers[count];
+	if (!OVR_SUCCESS(ovr_CreateTextureSwapChainGL(session, &desc, &layer.chain))) {
+		std::cerr << "could not create the swap chain of quad layer " << count << std::endl;
+		layer.chain = nullptr;
+		return -1;
+	}
+	if (!fbo) {
+		glGenFramebuffers(1, &fbo);
+		glMarkers().label(GL_FRAMEBUFFER, fbo, "quad layers");
+	}
+	layer.quad.Header.Type = ovrLayerType_Quad;
+	layer.quad.Header.Flags = ovrLayerFlag_TextureOriginAtBottomLeft | (headLocked ? ovrLayerFlag_HeadLocked : 0);
+	layer.quad.ColorTexture = layer.chain;
+	layer.quad.Viewport.Pos.x = 0;
+	layer.quad.Viewport.Pos.y = 0;
+	layer.quad.Viewport.Size.w = width;
+	layer.quad.Viewport.Size.h = height;
+	layer.quad.QuadPoseCenter = pose;
+	layer.quad.QuadSize.x = metersWide;
+	layer.quad.QuadSize.y = metersWide * height / width;
+	layer.width = width;
+	layer.height = height;
+	layer.staticImage = staticImage;
+	layer.shown = false;
+	layer.dirty = true;
+	layer.ready = false;
+	return count++;
+}
+
+void QuadLayers::setShown(int layer, bool shown)
+{
+	if (layer >= 0 && layer < count) {
+		layers[layer].shown = shown;
+	}
+}
+
+void QuadLayers::setPose(int layer, const ovrPosef& pose)
+{
+	if (layer >= 0 && layer < count) {
+		layers[layer].quad.QuadPoseCenter = pose;
+	}
+}
+
+void QuadLayers::invalidate(int layer)
+{
+	// A static chain's one commit is spent, there is nothing to draw into again
+	if (layer >= 0 && layer < count && !layers[layer].staticImage) {
+		layers[layer].dirty = true;
+	}
+}
+
+bool QuadLayers::begin(int index)
+{
+	if (!dirty(index) || !layers[index].shown) {
+		return false;
+	}
+	Layer& layer = layers[index];
+	int current;
+	GLuint texture;
+	ovr_GetTextureSwapChainCurrentIndex(session, layer.chain, &current);
+	ovr_GetTextureSwapChainBufferGL(session, layer.chain, current, &texture);
+	glGetIntegerv(GL_VIEWPORT, savedViewport);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+	glViewport(0, 0, layer.width, layer.height);
+	return true;
+}
+
+void QuadLayers::end(int index)
+{
+	if (index < 0 || index >= count) {
+		return;
+	}
+	Layer& layer = layers[index];
+	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+	ovr_CommitTextureSwapChain(session, layer.chain);
+	layer.dirty = false;
+	layer.ready = true;
+	committed++;
+}
+
+bool QuadLayers::setImage(int index, const unsigned char* rgb, int width, int height)
+{
+	if (index < 0 || index >= count) {
+		return false;
+	}
+	Layer& layer = layers[index];
+	if (!layer.staticImage || !layer.dirty || width != layer.width || height != layer.height) {
+		return false;
+	}
+	// Four channels, bottom row first for the layer's texture origin
+	std::vector<unsigned char> rgba((size_t)width * height * 4);
+	expandRGB8(rgb, (size_t)width * height, rgba.data(), false);
+	flipRows(rgba.data(), (size_t)width * 4, (uint32_t)height);
+
+	GLuint texture;
+	ovr_GetTextureSwapChainBufferGL(session, layer.chain, 0, &texture);
+	glState().bindTexture(0, GL_TEXTURE_2D, texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	ovr_CommitTextureSwapChain(session, layer.chain);
+	layer.dirty = false;
+	layer.ready = true;
+	committed++;
+	return true;
+}
+
+int QuadLayers::headers(const ovrLayerHeader** out, int max) const
+{
+	int n = 0;
+	for (int i = 0; i < count && (!out || n < max); i++) {
+		if (layers[i].shown && layers[i].ready) {
+			if (out) {
+				out[n] = &layers[i].quad.Header;
+			}
+			n++;
+		}
+	}
+	return n;
+}
@@ -0,0 +1,92 @@
+#ifndef _QUAD_LAYERS_H_
+#define _QUAD_LAYERS_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include <OVR_CAPI.h>
+
+#include <cstdint>
+
+// Compositor quad layers for flat content that seldom changes: HUD panels, menus, test
+// patterns. Each is a swap chain of its own that the compositor places in the view, so none
+// of it costs the eye passes anything. A layer is only drawn into and committed when it is
+// dirty; otherwise the compositor keeps showing what was committed last.
+//
+// A static layer's chain is a StaticImage one, a single texture that takes one commit in its
+// lifetime: for an image that never changes (setImage).
+class QuadLayers
+{
+public:
+	enum { MAX_LAYERS = 8 };
+
+	QuadLayers();
+	~QuadLayers();
+
+	QuadLayers(const QuadLayers&) = delete;
+	QuadLayers& operator=(const QuadLayers&) = delete;
+
+	void init(ovrSession session);
+	void shutdown();
+
+	//! A layer of width x height texels, hidden until setShown. -1, with a message, if the
+	// compositor gives no chain for it.
+	// @input staticImage Whether it only ever gets one image (setImage)
+	// @input headLocked Whether pose is relative to the head rather than tracking space
+	// @input pose Where the quad's center is and which way it faces (+z toward the viewer)
+	// @input metersWide Its width in the world, the height follows the texels' aspect
+	int add(int width, int height, bool staticImage, bool headLocked, const ovrPosef& pose, float metersWide);
+
+	void setShown(int layer, bool shown);
+	bool shown(int layer) const { return layer >= 0 && layer < count && layers[layer].shown; }
+	void setPose(int layer, const ovrPosef& pose);
+
+	// The layer is drawn again at its next begin()
+	void invalidate(int layer);
+	bool dirty(int layer) const { return layer >= 0 && layer < count && layers[layer].dirty; }
+
+	//! Binds a framebuffer onto the layer's next texture with the viewport over all of it, if
+	// the layer is shown and dirty. The caller draws and calls end(). False leaves the
+	// framebuffer and viewport alone, nothing to do.
+	bool begin(int layer);
+	// Commits what was drawn since begin() and puts the framebuffer binding and viewport back
+	void end(int layer);
+
+	//! Fills a static layer with an RGB8 image, rows top down, and commits it, once.
+	// @return False if the layer is not static, already has its image or the size differs
+	bool setImage(int layer, const unsigned char* rgb, int width, int height);
+
+	// The shown layers, for ovr_SubmitFrame after the eye layer. With no out, how many
+	// there are, whatever max.
+	int headers(const ovrLayerHeader** out, int max) const;
+	// How many times a layer has been drawn and committed
+	uint64_t commits() const { return committed; }
+
+private:
+	struct Layer
+	{
+		ovrTextureSwapChain chain;
+		ovrLayerQuad quad;
+		int width;
+		int height;
+		bool staticImage;
+		bool shown;
+		bool dirty;
+		// Committed at least once, the compositor has something to show
+		bool ready;
+	};
+
+	ovrSession session;
+	GLuint fbo;
+	Layer layers[MAX_LAYERS];
+	int count;
+	GLint savedViewport[4];
+	uint64_t committed;
+};
+
+#endif
@@ -0,0 +1,163 @@
+#include "QualityGovernor.h"
+#include "Config.h"
+#include "CpuProfiler.h"
+
+#include <algorithm>
+#include <iostream>
+
+// Going down needs this many frames over in a row, coming back up this many with headroom
+static const int LOWER_FRAMES = 3;
+static const int RAISE_FRAMES = 90;
+// Under this much of the budget is headroom, so a step back up does not go straight over
+static const float RAISE_MARGIN = 0.75f;
+// The GPU stats are a frame or two late, a step waits for them to show the one before
+static const int SETTLE_FRAMES = 8;
+
+static const char* const KNOB_NAMES[QualityGovernor::KNOBS] = {
+	"mirror", "wall_rate", "lod", "wall_resolution", "eye_resolution"
+};
+// The trace's event names, literals as the profiler keeps the pointers
+static const char* const TRACE_NAMES[QualityGovernor::KNOBS] = {
+	"quality mirror", "quality wall_rate", "quality lod", "quality wall_resolution", "quality eye_resolution"
+};
+
+QualityGovernor::QualityGovernor() : enabled(false), budgetMs(0.0f), target(0.85f), orderCount(0), overBudget(0),
+	underBudget(0), settle(0), lastDropped(-1), lowered(0), raised(0)
+{
+	for (int i = 0; i < KNOBS; i++) {
+		order[i] = (Knob)i;
+		steps[i] = 0;
+		levels[i] = 0;
+	}
+	orderCount = KNOBS;
+}
+
+void QualityGovernor::configure()
+{
+	enabled = config().getBool("quality.governor", false);
+	budgetMs = std::max(config().getFloat("quality.budget_ms", 0.0f), 0.0f);
+	target = std::min(std::max(config().getFloat("quality.gpu_target", 0.85f), 0.1f), 1.0f);
+	if (!parseOrder(config().getString("quality.order", "mirror,wall_rate,lod,wall_resolution,eye_resolution"))) {
+		std::cerr << "quality.order names mirror, wall_rate, lod, wall_resolution and eye_resolution, "
+			<< "the unknown ones are left out" << std::endl;
+	}
+	for (int i = 0; i < KNOBS; i++) {
+		levels[i] = 0;
+	}
+	overBudget = 0;
+	underBudget = 0;
+	settle = 0;
+	lastDropped = -1;
+}
+
+bool QualityGovernor::parseOrder(const std::string& list)
+{
+	bool known = true;
+	orderCount = 0;
+	size_t start = 0;
+	while (start <= list.size()) {
+		size_t end = std::min(list.find(',', start), list.size());
+		std::string name = list.substr(start, end - start);
+		start = end + 1;
+		name.erase(0, name.find_first_not_of(" \t"));
+		name.erase(name.find_last_not_of(" \t") + 1);
+		if (name.empty()) {
+			continue;
+		}
+		int knob = 0;
+		while (knob < KNOBS && name != KNOB_NAMES[knob]) {
+			knob++;
+		}
+		if (knob == KNOBS) {
+			known = false;
+			continue;
+		}
+		// A knob named twice keeps its first place
+		if (std::find(order, order + orderCount, (Knob)knob) == order + orderCount) {
+			order[orderCount++] = (Knob)knob;
+		}
+	}
+	return known;
+}
+
+void QualityGovernor::setSteps(Knob knob, int count)
+{
+	steps[knob] = std::max(count, 0);
+	levels[knob] = std::min(levels[knob], steps[knob]);
+}
+
+void QualityGovernor::update(const Sample& sample)
+{
+	if (!enabled || sample.gpuMs <= 0.0f) {
+		return;
+	}
+	float budget = budgetMs > 0.0f ? budgetMs : sample.frameMs * target;
+	if (budget <= 0.0f) {
+		return;
+	}
+	int dropped = lastDropped >= 0 ? sample.droppedFrames - lastDropped : 0;
+	lastDropped = sample.droppedFrames;
+	bool compositorWantsLess = sample.performanceScale > 0.0f && sample.performanceScale < 1.0f;
+	bool over = sample.gpuMs > budget || compositorWantsLess || dropped > 0;
+	bool headroom = sample.gpuMs < budget * RAISE_MARGIN && !compositorWantsLess && dropped <= 0;
+	overBudget = over ? overBudget + 1 : 0;
+	underBudget = headroom ? underBudget + 1 : 0;
+
+	if (settle > 0) {
+		settle--;
+		return;
+	}
+	if (overBudget >= LOWER_FRAMES) {
+		for (int i = 0; i < orderCount; i++) {
+			if (levels[order[i]] < steps[order[i]]) {
+				step(order[i], 1);
+				break;
+			}
+		}
+		overBudget = 0;
+	}
+	else if (underBudget >= RAISE_FRAMES) {
+		// Back up in the reverse order, the last knob turned down is the first turned up
+		for (int i = orderCount; i-- > 0;) {
+			if (levels[order[i]] > 0) {
+				step(order[i], -1);
+				break;
+			}
+		}
+		underBudget = 0;
+	}
+}
+
+void QualityGovernor::step(Knob knob, int delta)
+{
+	levels[knob] += delta;
+	(delta > 0 ? lowered : raised)++;
+	settle = SETTLE_FRAMES;
+	if (cpuProfiler().enabled()) {
+		int64_t now = cpuProfiler().ticks();
+		cpuProfiler().record(TRACE_NAMES[knob], now, now, levels[knob]);
+		int total = 0;
+		for (int i = 0; i < KNOBS; i++) {
+			total += levels[i];
+		}
+		cpuProfiler().counter("quality steps down", total);
+	}
+}
+
+void QualityGovernor::report(std::ostream& out) const
+{
+	if (!enabled) {
+		return;
+	}
+	out << "quality governor: " << lowered << " steps down, " << raised << " back up, ending at";
+	for (int i = 0; i < orderCount; i++) {
+		out << " " << KNOB_NAMES[order[i]] << " " << levels[order[i]] << "/" << steps[order[i]];
+	}
+	out << std::endl;
+}
+
+QualityGovernor& qualityGovernor()
+{
+	static QualityGovernor governor;
+	return governor;
+}
@@ -0,0 +1,95 @@
+#ifndef _QUALITY_GOVERNOR_H_
+#define _QUALITY_GOVERNOR_H_
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// One loop over every knob that trades quality for GPU time, so they do not each chase the
+// budget on their own and fight (quality.governor). Each frame it looks at the app's GPU
+// time and what the compositor's stats say about headroom, and once the frame has been over
+// its budget for a few frames it takes one step down on the first knob in quality.order
+// that has a step left; once there has been headroom for a good while it gives back one
+// step, on the last knob it took one from. After a step it waits for the stats to show it
+// before deciding again.
+//
+// The knobs, each a level from 0 (full quality) to the steps its owner says it has:
+//
+//   mirror           the desktop mirror every 2, 4, 8 frames
+//   wall_rate        the walls re-rendered less often (WallSchedule)
+//   lod              the props' level of detail pixel error doubled per step
+//   wall_resolution  the walls drawn with fewer texels (WallResolution)
+//   eye_resolution   the eye viewports shrunk (EyeResolution's minimum is the floor)
+//
+// The budget is quality.budget_ms, per station, or quality.gpu_target of the display's
+// frame. While it governs, the knobs' own adaptive loops stand still. Every step goes into
+// the CPU trace as an event named for the knob, its new level the argument.
+class QualityGovernor
+{
+public:
+	enum Knob { MIRROR, WALL_RATE, LOD, WALL_RESOLUTION, EYE_RESOLUTION, KNOBS };
+
+	// What one frame measured, in milliseconds
+	struct Sample
+	{
+		float gpuMs;
+		// The display's frame
+		float frameMs;
+		// The compositor's AdaptiveGpuPerformanceScale, under 1 when it wants less GPU work,
+		// 0 when not known
+		float performanceScale;
+		// Frames the compositor dropped so far, counted up
+		int droppedFrames;
+	};
+
+	QualityGovernor();
+
+	QualityGovernor(const QualityGovernor&) = delete;
+	QualityGovernor& operator=(const QualityGovernor&) = delete;
+
+	// Reads quality.governor, quality.budget_ms, quality.gpu_target and quality.order
+	void configure();
+	bool active() const { return enabled; }
+
+	//! How many steps down knob has, from whoever owns it; 0, the default, leaves it alone
+	void setSteps(Knob knob, int steps);
+	int level(Knob knob) const { return levels[knob]; }
+	// The levels of all knobs added up, how far below full quality the frame is
+	int stepsDown() const
+	{
+		int total = 0;
+		for (int knob = 0; knob < KNOBS; knob++) {
+			total += levels[knob];
+		}
+		return total;
+	}
+
+	// Once a frame, with the last frame's numbers
+	void update(const Sample& sample);
+
+	// The steps taken and where each knob ended up
+	void report(std::ostream& out) const;
+
+private:
+	bool parseOrder(const std::string& list);
+	// One step on a knob, in the trace as well
+	void step(Knob knob, int delta);
+
+	bool enabled;
+	float budgetMs;
+	float target;
+	Knob order[KNOBS];
+	int orderCount;
+	int steps[KNOBS];
+	int levels[KNOBS];
+	int overBudget;
+	int underBudget;
+	int settle;
+	int lastDropped;
+	uint64_t lowered;
+	uint64_t raised;
+};
+
+QualityGovernor& qualityGovernor();
+
+#endif
@@ -0,0 +1,567 @@
+#include "RenderTargets.h"
+#include "GLExtensions.h"
+#include "TextureUpload.h"
+#include "BindlessTextures.h"
+#include "GpuMemory.h"
+#include "GLMarkers.h"
+#include "TextureCache.h"
+
+#include <algorithm>
+#include <iostream>
+
+// The most samples a target can have, layered ones being multisampled textures
+static GLsizei maxSamples(bool layered)
+{
+	GLint most = 1;
+	if (layered) {
+		GLint depth = 1;
+		glGetIntegerv(GL_MAX_COLOR_TEXTURE_SAMPLES, &most);
+		glGetIntegerv(GL_MAX_DEPTH_TEXTURE_SAMPLES, &depth);
+		most = std::min(most, depth);
+	}
+	else {
+		glGetIntegerv(GL_MAX_SAMPLES, &most);
+	}
+	return std::max(most, 1);
+}
+
+RenderTargetCache::RenderTargetCache() : anisotropy(1.f), resolveRead(0), resolveDraw(0)
+{
+}
+
+RenderTargetCache::~RenderTargetCache()
+{
+	clear();
+}
+
+const RenderTarget* RenderTargetCache::acquire(const std::string& name, GLsizei width, GLsizei height, GLsizei layers, bool multiview,
+	const RenderTargetFormat& format)
+{
+	GLsizei levels = std::max(std::min(format.levels, (GLsizei)mipLevelCount(width, height)), 1);
+	// Multiview has its own multisampled attachments, which the loader does not have
+	GLsizei samples = format.samples > 1 && !multiview ? std::min(format.samples, maxSamples(layers != 0)) : 1;
+	auto it = targets.find(name);
+	if (it != targets.end()) {
+		RenderTarget& existing = it->second;
+		if (existing.width == width && existing.height == height && existing.layers == layers && existing.multiview == multiview &&
+			existing.levels == levels && existing.format == format.color && existing.sharedDepth == format.sharedDepth &&
+			existing.samples == samples) {
+			return &existing;
+		}
+		destroy(existing);
+	}
+
+	RenderTarget& target = targets[name];
+	target.fbo = 0;
+	target.color = 0;
+	target.depth = 0;
+	target.width = width;
+	target.height = height;
+	target.layers = layers;
+	target.levels = levels;
+	target.format = format.color;
+	target.sharedDepth = format.sharedDepth;
+	target.multiview = multiview;
+	target.drawFbo = 0;
+	target.samples = samples;
+	target.msaaColor = 0;
+	target.msaaDepth = 0;
+	if (!create(target)) {
+		std::cerr << "render target " << name << " (" << width << "x" << height << ") is not complete" << std::endl;
+		destroy(target);
+		targets.erase(name);
+		return nullptr;
+	}
+	// By the target's name in frame captures
+	if (glMarkers().enabled()) {
+		glMarkers().label(GL_FRAMEBUFFER, target.fbo, name);
+		glMarkers().label(GL_TEXTURE, target.color, name + " color");
+		if (target.drawFbo != target.fbo) {
+			glMarkers().label(GL_FRAMEBUFFER, target.drawFbo, name + " multisampled");
+		}
+	}
+	return &target;
+}
+
+const RenderTarget* RenderTargetCache::find(const std::string& name) const
+{
+	auto it = targets.find(name);
+	return it == targets.end() ? nullptr : &it->second;
+}
+
+void RenderTargetCache::release(const std::string& name)
+{
+	auto it = targets.find(name);
+	if (it != targets.end()) {
+		destroy(it->second);
+		targets.erase(it);
+	}
+}
+
+void RenderTargetCache::clear()
+{
+	for (auto& entry : targets) {
+		destroy(entry.second);
+	}
+	targets.clear();
+	sharedDepths.clear();
+	if (resolveRead) {
+		glDeleteFramebuffers(1, &resolveRead);
+		glDeleteFramebuffers(1, &resolveDraw);
+		resolveRead = resolveDraw = 0;
+	}
+}
+
+void RenderTargetCache::setAnisotropy(float maxAnisotropy)
+{
+	anisotropy = 1.f;
+	if (maxAnisotropy > 1.f && GLEW_EXT_texture_filter_anisotropic) {
+		GLfloat most = 1.f;
+		glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &most);
+		anisotropy = std::min(maxAnisotropy, most);
+	}
+}
+
+void RenderTargetCache::bind(const RenderTarget& target)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, target.drawFbo);
+	glViewport(0, 0, target.width, target.height);
+}
+
+void RenderTargetCache::resolve(const RenderTarget& target, int layer, GLsizei width, GLsizei height, bool keepDepth)
+{
+	if (target.samples <= 1) {
+		return;
+	}
+	if (target.layers) {
+		// A blit only sees layer 0 of a layered attachment, so the layer is attached alone
+		if (!resolveRead) {
+			glGenFramebuffers(1, &resolveRead);
+			glGenFramebuffers(1, &resolveDraw);
+			glMarkers().label(GL_FRAMEBUFFER, resolveRead, "layer resolve read");
+			glMarkers().label(GL_FRAMEBUFFER, resolveDraw, "layer resolve draw");
+		}
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, resolveRead);
+		glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, target.msaaColor, 0, layer);
+		glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, target.msaaDepth, 0, layer);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolveDraw);
+		glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, target.color, 0, layer);
+		glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, keepDepth ? target.depth : 0, 0, layer);
+	}
+	else {
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, target.drawFbo);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target.fbo);
+	}
+	// Depth resolves to one of the samples, whichever the driver picks
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT | (keepDepth ? GL_DEPTH_BUFFER_BIT : 0), GL_NEAREST);
+	if (GLEW_ARB_invalidate_subdata) {
+		const GLenum attachments[2] = { GL_COLOR_ATTACHMENT0, GL_DEPTH_ATTACHMENT };
+		glInvalidateFramebuffer(GL_READ_FRAMEBUFFER, 2, attachments);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+}
+
+void RenderTargetCache::discardDepth()
+{
+	if (GLEW_ARB_invalidate_subdata) {
+		GLenum attachment = GL_DEPTH_ATTACHMENT;
+		glInvalidateFramebuffer(GL_FRAMEBUFFER, 1, &attachment);
+	}
+}
+
+GLenum RenderTargetCache::parseColorFormat(const std::string& name)
+{
+	if (name == "rgba8") {
+		return GL_RGBA8;
+	}
+	if (name == "r11g11b10f") {
+		return GL_R11F_G11F_B10F;
+	}
+	if (name == "rgba16f") {
+		return GL_RGBA16F;
+	}
+	return 0;
+}
+
+// A parameter of texture, which is bound to textureTarget unless it is set by name
+static void setParameter(GLenum textureTarget, GLuint texture, GLenum name, GLint value)
+{
+	if (directStateAccess()) {
+		glTextureParameteri(texture, name, value);
+	}
+	else {
+		glTexParameteri(textureTarget, name, value);
+	}
+}
+
+bool RenderTargetCache::create(RenderTarget& target)
+{
+	GLenum textureTarget = target.layers ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+	bool dsa = directStateAccess();
+
+	if (dsa) {
+		glCreateTextures(textureTarget, 1, &target.color);
+		if (target.layers) {
+			glTextureStorage3D(target.color, target.levels, target.format, target.width, target.height, target.layers);
+		}
+		else {
+			glTextureStorage2D(target.color, target.levels, target.format, target.width, target.height);
+		}
+	}
+	else {
+		glGenTextures(1, &target.color);
+		glBindTexture(textureTarget, target.color);
+		if (target.layers) {
+			allocateTextureArrayStorage(target.levels, target.format, target.width, target.height, target.layers);
+		}
+		else {
+			allocateTextureStorage(GL_TEXTURE_2D, target.levels, target.format, target.width, target.height);
+		}
+	}
+	if (target.levels > 1) {
+		// Seen at an angle, a texel per pixel only holds where the wall faces the eye
+		setParameter(textureTarget, target.color, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		setParameter(textureTarget, target.color, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		setParameter(textureTarget, target.color, GL_TEXTURE_MAX_LEVEL, target.levels - 1);
+		if (anisotropy > 1.f && dsa) {
+			glTextureParameterf(target.color, GL_TEXTURE_MAX_ANISOTROPY_EXT, anisotropy);
+		}
+		else if (anisotropy > 1.f) {
+			glTexParameterf(textureTarget, GL_TEXTURE_MAX_ANISOTROPY_EXT, anisotropy);
+		}
+	}
+	else {
+		// Sampled one texel per pixel, no filtering wanted
+		setParameter(textureTarget, target.color, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		setParameter(textureTarget, target.color, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	}
+	setParameter(textureTarget, target.color, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	setParameter(textureTarget, target.color, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	if (!dsa) {
+		glBindTexture(textureTarget, 0);
+	}
+	gpuMemory().allocate(GpuMemory::KIND_TEXTURE, target.color, textureBytes(target.format, target.width, target.height, target.layers, target.levels),
+		GpuMemory::RENDER_TARGET, "render target color");
+
+	// Multiview attachments have no by-name form, those are bound either way
+	if (dsa) {
+		glCreateFramebuffers(1, &target.fbo);
+	}
+	else {
+		glGenFramebuffers(1, &target.fbo);
+	}
+	if (target.multiview) {
+		glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+		glFramebufferTextureMultiviewOVR(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, target.color, 0, 0, target.layers);
+	}
+	else if (dsa) {
+		glNamedFramebufferTexture(target.fbo, GL_COLOR_ATTACHMENT0, target.color, 0);
+	}
+	else if (target.layers) {
+		glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+		glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, target.color, 0);
+	}
+	else {
+		glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target.color, 0);
+	}
+	if (!target.sharedDepth.empty()) {
+		target.depth = sharedDepthFor(target);
+	}
+	if (!target.depth) {
+		target.depth = createDepth(target.width, target.height, target.layers);
+	}
+	attachDepth(target, target.depth);
+	GLenum drawBuffers[1] = { GL_COLOR_ATTACHMENT0 };
+	GLenum status;
+	if (dsa) {
+		glNamedFramebufferDrawBuffers(target.fbo, 1, drawBuffers);
+		status = glCheckNamedFramebufferStatus(target.fbo, GL_FRAMEBUFFER);
+	}
+	else {
+		glDrawBuffers(1, drawBuffers);
+		status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	}
+	if (!dsa || target.multiview) {
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		return false;
+	}
+	target.drawFbo = target.fbo;
+	return target.samples <= 1 || createMultisample(target);
+}
+
+bool RenderTargetCache::createMultisample(RenderTarget& target)
+{
+	// Bound to be made, the multisampled textures have no by-name form here
+	glGenFramebuffers(1, &target.drawFbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, target.drawFbo);
+	uint64_t colorBytes = textureBytes(target.format, target.width, target.height, std::max(target.layers, 1), 1) * target.samples;
+	uint64_t depthBytes = textureBytes(GL_DEPTH_COMPONENT24, target.width, target.height, std::max(target.layers, 1), 1) * target.samples;
+	if (target.layers) {
+		glGenTextures(1, &target.msaaColor);
+		glBindTexture(GL_TEXTURE_2D_MULTISAMPLE_ARRAY, target.msaaColor);
+		glTexImage3DMultisample(GL_TEXTURE_2D_MULTISAMPLE_ARRAY, target.samples, target.format, target.width, target.height,
+			target.layers, GL_TRUE);
+		glGenTextures(1, &target.msaaDepth);
+		glBindTexture(GL_TEXTURE_2D_MULTISAMPLE_ARRAY, target.msaaDepth);
+		glTexImage3DMultisample(GL_TEXTURE_2D_MULTISAMPLE_ARRAY, target.samples, GL_DEPTH_COMPONENT24, target.width, target.height,
+			target.layers, GL_TRUE);
+		glBindTexture(GL_TEXTURE_2D_MULTISAMPLE_ARRAY, 0);
+		glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, target.msaaColor, 0);
+		glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, target.msaaDepth, 0);
+		gpuMemory().allocate(GpuMemory::KIND_TEXTURE, target.msaaColor, colorBytes, GpuMemory::RENDER_TARGET, "render target multisampled color");
+		gpuMemory().allocate(GpuMemory::KIND_TEXTURE, target.msaaDepth, depthBytes, GpuMemory::RENDER_TARGET, "render target multisampled depth");
+	}
+	else {
+		glGenRenderbuffers(1, &target.msaaColor);
+		glBindRenderbuffer(GL_RENDERBUFFER, target.msaaColor);
+		glRenderbufferStorageMultisample(GL_RENDERBUFFER, target.samples, target.format, target.width, target.height);
+		glGenRenderbuffers(1, &target.msaaDepth);
+		glBindRenderbuffer(GL_RENDERBUFFER, target.msaaDepth);
+		glRenderbufferStorageMultisample(GL_RENDERBUFFER, target.samples, GL_DEPTH_COMPONENT24, target.width, target.height);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, target.msaaColor);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, target.msaaDepth);
+		gpuMemory().allocate(GpuMemory::KIND_RENDERBUFFER, target.msaaColor, colorBytes, GpuMemory::RENDER_TARGET, "render target multisampled color");
+		gpuMemory().allocate(GpuMemory::KIND_RENDERBUFFER, target.msaaDepth, depthBytes, GpuMemory::RENDER_TARGET, "render target multisampled depth");
+	}
+	GLenum drawBuffers[1] = { GL_COLOR_ATTACHMENT0 };
+	glDrawBuffers(1, drawBuffers);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	return status == GL_FRAMEBUFFER_COMPLETE;
+}
+
+void RenderTargetCache::destroy(RenderTarget& target)
+{
+	if (target.drawFbo && target.drawFbo != target.fbo) {
+		glDeleteFramebuffers(1, &target.drawFbo);
+	}
+	GpuMemory::Kind msaaKind = target.layers ? GpuMemory::KIND_TEXTURE : GpuMemory::KIND_RENDERBUFFER;
+	for (GLuint* msaa : { &target.msaaColor, &target.msaaDepth }) {
+		if (!*msaa) {
+			continue;
+		}
+		gpuMemory().release(msaaKind, *msaa);
+		if (target.layers) {
+			glDeleteTextures(1, msaa);
+		}
+		else {
+			glDeleteRenderbuffers(1, msaa);
+		}
+		*msaa = 0;
+	}
+	target.drawFbo = 0;
+	if (target.fbo) {
+		glDeleteFramebuffers(1, &target.fbo);
+	}
+	if (target.color) {
+		bindlessTextures().forget(target.color);
+		gpuMemory().release(GpuMemory::KIND_TEXTURE, target.color);
+		glDeleteTextures(1, &target.color);
+	}
+	auto shared = sharedDepths.find(target.sharedDepth);
+	if (target.depth && shared != sharedDepths.end() && shared->second.depth == target.depth) {
+		if (--shared->second.users == 0) {
+			deleteDepth(shared->second.depth, shared->second.layers);
+			sharedDepths.erase(shared);
+		}
+	}
+	else if (target.depth) {
+		// Its own, the shared one did not fit it
+		deleteDepth(target.depth, target.layers);
+	}
+	target.fbo = 0;
+	target.color = 0;
+	target.depth = 0;
+}
+
+GLuint RenderTargetCache::sharedDepthFor(const RenderTarget& target)
+{
+	auto it = sharedDepths.find(target.sharedDepth);
+	if (it == sharedDepths.end()) {
+		SharedDepth shared;
+		shared.width = target.width;
+		shared.height = target.height;
+		shared.layers = target.layers;
+		shared.depth = createDepth(shared.width, shared.height, shared.layers);
+		shared.users = 1;
+		sharedDepths[target.sharedDepth] = shared;
+		return shared.depth;
+	}
+	SharedDepth& shared = it->second;
+	// A renderbuffer and an array cannot stand in for each other
+	if ((shared.layers == 0) != (target.layers == 0)) {
+		std::cerr << "shared depth " << target.sharedDepth << " is layered for some targets and not others" << std::endl;
+		return 0;
+	}
+	if (target.width > shared.width || target.height > shared.height || target.layers > shared.layers) {
+		// Grown to fit, and put in place of the old one in every target that has it
+		GLuint grown = createDepth(std::max(target.width, shared.width), std::max(target.height, shared.height),
+			std::max(target.layers, shared.layers));
+		for (auto& entry : targets) {
+			RenderTarget& user = entry.second;
+			if (user.depth == shared.depth && user.sharedDepth == target.sharedDepth) {
+				attachDepth(user, grown);
+				user.depth = grown;
+			}
+		}
+		deleteDepth(shared.depth, shared.layers);
+		shared.depth = grown;
+		shared.width = std::max(target.width, shared.width);
+		shared.height = std::max(target.height, shared.height);
+		shared.layers = std::max(target.layers, shared.layers);
+	}
+	shared.users++;
+	return shared.depth;
+}
+
+GLuint RenderTargetCache::createDepth(GLsizei width, GLsizei height, GLsizei layers)
+{
+	GLuint depth = 0;
+	if (layers) {
+		// Layered color needs layered depth, so depth is an array texture as well
+		if (directStateAccess()) {
+			glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &depth);
+			glTextureStorage3D(depth, 1, GL_DEPTH_COMPONENT24, width, height, layers);
+		}
+		else {
+			glGenTextures(1, &depth);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, depth);
+			allocateTextureArrayStorage(1, GL_DEPTH_COMPONENT24, width, height, layers);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+		}
+		gpuMemory().allocate(GpuMemory::KIND_TEXTURE, depth, textureBytes(GL_DEPTH_COMPONENT24, width, height, layers, 1),
+			GpuMemory::RENDER_TARGET, "render target depth");
+	}
+	else {
+		if (directStateAccess()) {
+			glCreateRenderbuffers(1, &depth);
+			glNamedRenderbufferStorage(depth, GL_DEPTH_COMPONENT24, width, height);
+		}
+		else {
+			glGenRenderbuffers(1, &depth);
+			glBindRenderbuffer(GL_RENDERBUFFER, depth);
+			glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+			glBindRenderbuffer(GL_RENDERBUFFER, 0);
+		}
+		gpuMemory().allocate(GpuMemory::KIND_RENDERBUFFER, depth, textureBytes(GL_DEPTH_COMPONENT24, width, height, 1, 1),
+			GpuMemory::RENDER_TARGET, "render target depth");
+	}
+	return depth;
+}
+
+void RenderTargetCache::deleteDepth(GLuint depth, GLsizei layers)
+{
+	if (layers) {
+		gpuMemory().release(GpuMemory::KIND_TEXTURE, depth);
+		glDeleteTextures(1, &depth);
+	}
+	else {
+		gpuMemory().release(GpuMemory::KIND_RENDERBUFFER, depth);
+		glDeleteRenderbuffers(1, &depth);
+	}
+}
+
+// Leaves target's framebuffer bound, unless depth was attached by name
+void RenderTargetCache::attachDepth(const RenderTarget& target, GLuint depth)
+{
+	if (directStateAccess() && !target.multiview) {
+		if (target.layers) {
+			glNamedFramebufferTexture(target.fbo, GL_DEPTH_ATTACHMENT, depth, 0);
+		}
+		else {
+			glNamedFramebufferRenderbuffer(target.fbo, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+		}
+		return;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+	if (!target.layers) {
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+	}
+	else if (target.multiview) {
+		glFramebufferTextureMultiviewOVR(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth, 0, 0, target.layers);
+	}
+	else {
+		glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth, 0);
+	}
+}
+
+MultisampleFramebuffer::MultisampleFramebuffer() : fbo(0), color(0), depth(0), width(0), height(0), samples(0)
+{
+}
+
+MultisampleFramebuffer::~MultisampleFramebuffer()
+{
+	release();
+}
+
+bool MultisampleFramebuffer::init(GLenum colorFormat, GLenum depthFormat, GLenum depthAttachment, GLsizei w, GLsizei h, GLsizei s)
+{
+	release();
+	GLint most = 1;
+	glGetIntegerv(GL_MAX_SAMPLES, &most);
+	s = std::min(s, (GLsizei)most);
+	if (s < 2) {
+		return false;
+	}
+	glGenRenderbuffers(1, &color);
+	glBindRenderbuffer(GL_RENDERBUFFER, color);
+	glRenderbufferStorageMultisample(GL_RENDERBUFFER, s, colorFormat, w, h);
+	glGenRenderbuffers(1, &depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, depth);
+	glRenderbufferStorageMultisample(GL_RENDERBUFFER, s, depthFormat, w, h);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, depthAttachment, GL_RENDERBUFFER, depth);
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glMarkers().label(GL_FRAMEBUFFER, fbo, "eye buffer multisampled");
+	gpuMemory().allocate(GpuMemory::KIND_RENDERBUFFER, color, textureBytes(colorFormat, w, h, 1, 1) * s, GpuMemory::RENDER_TARGET,
+		"eye buffer multisampled color");
+	gpuMemory().allocate(GpuMemory::KIND_RENDERBUFFER, depth, textureBytes(depthFormat, w, h, 1, 1) * s, GpuMemory::RENDER_TARGET,
+		"eye buffer multisampled depth");
+	if (!complete) {
+		std::cerr << "multisampled eye buffer (" << s << " samples) is not complete" << std::endl;
+		release();
+		return false;
+	}
+	width = w;
+	height = h;
+	samples = s;
+	return true;
+}
+
+void MultisampleFramebuffer::release()
+{
+	for (GLuint* renderbuffer : { &color, &depth }) {
+		if (*renderbuffer) {
+			gpuMemory().release(GpuMemory::KIND_RENDERBUFFER, *renderbuffer);
+			glDeleteRenderbuffers(1, renderbuffer);
+			*renderbuffer = 0;
+		}
+	}
+	if (fbo) {
+		glDeleteFramebuffers(1, &fbo);
+		fbo = 0;
+	}
+	samples = 0;
+}
+
+void MultisampleFramebuffer::resolve(GLuint target)
+{
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	// Nothing of the samples is needed once resolved, not even depth and stencil
+	if (GLEW_ARB_invalidate_subdata) {
+		const GLenum attachments[3] = { GL_COLOR_ATTACHMENT0, GL_DEPTH_ATTACHMENT, GL_STENCIL_ATTACHMENT };
+		glInvalidateFramebuffer(GL_READ_FRAMEBUFFER, 3, attachments);
+	}
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+}
@@ -0,0 +1,164 @@
+#ifndef _RENDER_TARGETS_H_
+#define _RENDER_TARGETS_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include <string>
+#include <unordered_map>
+
+// How a target is made besides its size and layers
+struct RenderTargetFormat
+{
+	// GL_RGBA8, or GL_R11F_G11F_B10F (no alpha) and GL_RGBA16F for more range
+	GLenum color = GL_RGBA8;
+	GLsizei levels = 1;
+	// Targets naming the same depth here share one depth buffer, as large as the largest of
+	// them, instead of having one each. Only for passes that clear depth before drawing and
+	// do not need it after (RenderTargetCache::discardDepth).
+	std::string sharedDepth;
+	// Above 1, passes draw into multisampled color and depth of their own (drawFbo) that
+	// RenderTargetCache::resolve() blits into the color, for multisampling in place of a
+	// larger target. Clamped to what the driver has, multiview targets get 1.
+	GLsizei samples = 1;
+};
+
+// A framebuffer with its own color texture and 24 bit depth, complete and ready to bind.
+// With layers set the color is a GL_TEXTURE_2D_ARRAY attached layered (or as views with
+// OVR_multiview), otherwise a GL_TEXTURE_2D. Color with more than one level is drawn into
+// level 0 and sampled trilinear and anisotropic, whoever draws fills the rest in
+// (WallMips); with one it is sampled nearest.
+//
+// A multisampled target is drawn through drawFbo, a renderbuffer or GL_TEXTURE_2D_MULTISAMPLE_ARRAY
+// each for color and depth, and read through fbo once resolved. Otherwise both are the same.
+struct RenderTarget
+{
+	GLuint fbo;
+	GLuint drawFbo;
+	GLuint color;
+	// The target's own, or the shared one of its format
+	GLuint depth;
+	GLsizei width;
+	GLsizei height;
+	GLsizei layers;
+	GLsizei levels;
+	GLenum format;
+	std::string sharedDepth;
+	bool multiview;
+	GLsizei samples;
+	GLuint msaaColor;
+	GLuint msaaDepth;
+};
+
+// Offscreen targets by name. Each framebuffer is built and validated once, when it is first
+// acquired, so passes only bind them instead of swapping attachments every frame (which
+// makes some drivers validate the framebuffer again each time).
+// The cache owns the GL objects and deletes them in clear() or on destruction.
+class RenderTargetCache
+{
+public:
+	RenderTargetCache();
+	~RenderTargetCache();
+
+	RenderTargetCache(const RenderTargetCache&) = delete;
+	RenderTargetCache& operator=(const RenderTargetCache&) = delete;
+
+	// The target named name, created at this size first if it does not exist yet or had a
+	// different size or layout. Returns nullptr (and logs why) if the framebuffer is not
+	// complete. Returned targets stay at the same address until released.
+	const RenderTarget* acquire(const std::string& name, GLsizei width, GLsizei height, GLsizei layers = 0, bool multiview = false,
+		const RenderTargetFormat& format = RenderTargetFormat());
+	const RenderTarget* find(const std::string& name) const;
+	void release(const std::string& name);
+	void clear();
+
+	// Binds the framebuffer passes draw into and sets the viewport to all of it
+	static void bind(const RenderTarget& target);
+	//! Blits what a pass drew into a multisampled target into its color, and its depth if
+	// keepDepth, and discards the multisampled color and depth. Nothing for other targets.
+	// Leaves the target's fbo bound.
+	// @input layer The layer of a layered target, 0 otherwise
+	// @input width, height From the corner, what the pass drew into
+	void resolve(const RenderTarget& target, int layer, GLsizei width, GLsizei height, bool keepDepth);
+	// Tells the driver the depth of the bound target's pass is not needed any more, so it
+	// is not written back (ARB_invalidate_subdata, nothing without it)
+	static void discardDepth();
+
+	// GL_RGBA8 for "rgba8", GL_R11F_G11F_B10F for "r11g11b10f", GL_RGBA16F for "rgba16f",
+	// 0 for anything else
+	static GLenum parseColorFormat(const std::string& name);
+	static bool hasAlpha(GLenum format) { return format != GL_R11F_G11F_B10F; }
+
+	size_t size() const { return targets.size(); }
+
+	// The most anisotropy the color of targets with levels is sampled with, for targets
+	// created from now on. Clamped to what the driver has, 1 turns it off.
+	void setAnisotropy(float maxAnisotropy);
+
+private:
+	struct SharedDepth
+	{
+		GLuint depth;
+		GLsizei width;
+		GLsizei height;
+		GLsizei layers;
+		int users;
+	};
+
+	bool create(RenderTarget& target);
+	// The multisampled attachments and drawFbo of a target with samples
+	bool createMultisample(RenderTarget& target);
+	void destroy(RenderTarget& target);
+	GLuint sharedDepthFor(const RenderTarget& target);
+	static GLuint createDepth(GLsizei width, GLsizei height, GLsizei layers);
+	static void deleteDepth(GLuint depth, GLsizei layers);
+	static void attachDepth(const RenderTarget& target, GLuint depth);
+
+	std::unordered_map<std::string, RenderTarget> targets;
+	std::unordered_map<std::string, SharedDepth> sharedDepths;
+	float anisotropy;
+	// A layer of a multisampled array and the same layer of the color, for resolve()
+	GLuint resolveRead;
+	GLuint resolveDraw;
+};
+
+// The multisampled color and depth the eye pass draws into in place of the swap chain's
+// texture (eye.msaa), and the blit that resolves them into it. The eye buffer is one
+// framebuffer for both eyes, so it is resolved once for both.
+class MultisampleFramebuffer
+{
+public:
+	MultisampleFramebuffer();
+	~MultisampleFramebuffer();
+
+	MultisampleFramebuffer(const MultisampleFramebuffer&) = delete;
+	MultisampleFramebuffer& operator=(const MultisampleFramebuffer&) = delete;
+
+	// Clamped to what the driver has for renderbuffers. False, with nothing made, for fewer
+	// than 2 samples or if the framebuffer is not complete.
+	bool init(GLenum colorFormat, GLenum depthFormat, GLenum depthAttachment, GLsizei width, GLsizei height, GLsizei samples);
+	bool valid() const { return fbo != 0; }
+	// Deletes the multisampled renderbuffers and their framebuffer, init() can make them again
+	void release();
+	GLuint framebuffer() const { return fbo; }
+	GLsizei sampleCount() const { return samples; }
+
+	// Blits all of it into target's color attachment 0 and discards the multisampled color
+	// and depth. Leaves nothing bound.
+	void resolve(GLuint target);
+
+private:
+	GLuint fbo;
+	GLuint color;
+	GLuint depth;
+	GLsizei width;
+	GLsizei height;
+	GLsizei samples;
+};
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef _RIGID_POSE_H_
+#define _RIGID_POSE_H_
+
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+// A rotation and a translation, as the tracker reports head, eye and hand poses. Kept as a
+// quaternion and a position until a matrix is needed, and inverted by conjugating the
+// rotation and rotating the translation back, which is cheaper than a general 4x4 inverse
+// and stays exactly rigid.
+struct RigidPose
+{
+	glm::quat orientation;
+	glm::vec3 position;
+
+	RigidPose() : orientation(1.f, 0.f, 0.f, 0.f), position(0.f) {}
+	RigidPose(const glm::quat& orientation, const glm::vec3& position) : orientation(orientation), position(position) {}
+
+	RigidPose inverse() const
+	{
+		glm::quat conjugate = glm::conjugate(orientation);
+		return RigidPose(conjugate, conjugate * -position);
+	}
+
+	// This pose applied after other
+	RigidPose operator*(const RigidPose& other) const
+	{
+		return RigidPose(orientation * other.orientation, position + orientation * other.position);
+	}
+
+	glm::vec3 transform(const glm::vec3& point) const { return position + orientation * point; }
+
+	glm::mat4 matrix() const
+	{
+		glm::mat4 result = glm::mat4_cast(orientation);
+		result[3] = glm::vec4(position, 1.f);
+		return result;
+	}
+
+	// The same as inverse().matrix(), the rotation goes in transposed
+	glm::mat4 inverseMatrix() const
+	{
+		glm::mat3 rotation = glm::mat3_cast(orientation);
+		glm::mat4 result(glm::transpose(rotation));
+		result[3] = glm::vec4(-(position * rotation), 1.f);
+		return result;
+	}
+};
+
+// The inverse of a matrix that is only a rotation and a translation, such as a view or a
+// pose matrix. Anything scaled or projected needs glm::inverse.
+inline glm::mat4 rigidInverse(const glm::mat4& m)
+{
+	glm::mat3 rotation(m);
+	glm::mat4 result(glm::transpose(rotation));
+	result[3] = glm::vec4(-(glm::vec3(m[3]) * rotation), 1.f);
+	return result;
+}
+
+#endif
@@ -0,0 +1,175 @@
+#include "SceneSnapshot.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+static_assert(sizeof(glm::vec3) == 12 && sizeof(glm::quat) == 16, "the snapshot's arrays are packed glm types");
+
+static uint32_t alignUp(size_t offset)
+{
+	return (uint32_t)((offset + 15) & ~(size_t)15);
+}
+
+// Whether count elements of size from offset lie inside the file, on their boundary
+static bool partInside(uint32_t offset, size_t count, size_t size, size_t fileSize)
+{
+	return offset % 16 == 0 && offset <= fileSize && (fileSize - offset) / size >= count;
+}
+
+// A name in the file, "" for none, nullptr if it runs off the end
+static const char* nameAt(const unsigned char* data, size_t size, uint32_t offset)
+{
+	if (!offset) {
+		return "";
+	}
+	if (offset >= size || !memchr(data + offset, 0, size - offset)) {
+		return nullptr;
+	}
+	return (const char*)data + offset;
+}
+
+bool mapSceneSnapshot(const char* filename, SceneSnapshot& snapshot)
+{
+	snapshot.header = nullptr;
+	if (!snapshot.file.open(filename)) {
+		std::cerr << "error reading scene snapshot, could not locate " << filename << std::endl;
+		return false;
+	}
+	const unsigned char* data = snapshot.file.data();
+	size_t size = snapshot.file.size();
+	const SceneSnapshotHeader* header = (const SceneSnapshotHeader*)data;
+	if (size < sizeof(SceneSnapshotHeader) || header->magic != SCENESNAPSHOT_MAGIC) {
+		std::cerr << "error parsing scene snapshot, " << filename << " is not a scene snapshot" << std::endl;
+		snapshot.file.close();
+		return false;
+	}
+	if (header->version != SCENESNAPSHOT_VERSION) {
+		std::cerr << "error parsing scene snapshot, " << filename << " is version " << header->version
+			<< ", write it again with scene.write_snapshot" << std::endl;
+		snapshot.file.close();
+		return false;
+	}
+
+	size_t count = header->entityCount;
+	const char* names[3] = { nameAt(data, size, header->meshOffset), nameAt(data, size, header->atlasOffset),
+		nameAt(data, size, header->skyboxOffset) };
+	if (!count || header->wallCount < 1 || header->wallCount > CaveLayout::MAX_WALLS ||
+		!partInside(header->positionOffset, count, sizeof(glm::vec3), size) ||
+		!partInside(header->rotationOffset, count, sizeof(glm::quat), size) ||
+		!partInside(header->scaleOffset, count, sizeof(glm::vec3), size) ||
+		!partInside(header->extentOffset, count, sizeof(glm::vec3), size) ||
+		!partInside(header->atlasEntryOffset, count, sizeof(int32_t), size) ||
+		!partInside(header->wallOffset, header->wallCount, sizeof(SceneSnapshotWall), size) ||
+		!names[0] || !names[1] || !names[2]) {
+		std::cerr << "error parsing scene snapshot, incomplete data in " << filename << std::endl;
+		snapshot.file.close();
+		return false;
+	}
+	const SceneSnapshotWall* walls = (const SceneSnapshotWall*)(data + header->wallOffset);
+	for (uint32_t i = 0; i < header->wallCount; i++) {
+		if (!memchr(walls[i].name, 0, SCENESNAPSHOT_NAME)) {
+			std::cerr << "error parsing scene snapshot, bad wall " << i << " in " << filename << std::endl;
+			snapshot.file.close();
+			return false;
+		}
+	}
+
+	snapshot.header = header;
+	snapshot.positions = (const glm::vec3*)(data + header->positionOffset);
+	snapshot.rotations = (const glm::quat*)(data + header->rotationOffset);
+	snapshot.scales = (const glm::vec3*)(data + header->scaleOffset);
+	snapshot.extents = (const glm::vec3*)(data + header->extentOffset);
+	snapshot.atlasEntries = (const int32_t*)(data + header->atlasEntryOffset);
+	snapshot.walls = walls;
+	snapshot.mesh = names[0];
+	snapshot.atlas = names[1];
+	snapshot.skybox = names[2];
+	return true;
+}
+
+void sceneSnapshotWalls(const SceneSnapshot& snapshot, std::vector<CaveWallSpec>& specs)
+{
+	specs.resize(snapshot.header ? snapshot.header->wallCount : 0);
+	for (size_t i = 0; i < specs.size(); i++) {
+		const SceneSnapshotWall& wall = snapshot.walls[i];
+		specs[i].name = wall.name;
+		memcpy(specs[i].corners, wall.corners, sizeof(wall.corners));
+		specs[i].resolution = wall.resolution;
+	}
+}
+
+bool writeSceneSnapshot(const char* filename, const SceneSnapshotContent& content)
+{
+	size_t count = content.entityCount;
+	std::vector<SceneSnapshotWall> walls(content.walls.size());
+	for (size_t i = 0; i < walls.size(); i++) {
+		const CaveWall& wall = content.walls[i];
+		if (wall.name.size() >= SCENESNAPSHOT_NAME) {
+			std::cerr << "wall name " << wall.name << " is too long for a scene snapshot" << std::endl;
+			return false;
+		}
+		memset(&walls[i], 0, sizeof(SceneSnapshotWall));
+		memcpy(walls[i].name, wall.name.c_str(), wall.name.size());
+		for (int c = 0; c < 4; c++) {
+			for (int axis = 0; axis < 3; axis++) {
+				walls[i].corners[c][axis] = wall.corners[c][axis];
+			}
+		}
+		walls[i].resolution = wall.resolution;
+	}
+	std::vector<int32_t> entries(content.atlasEntries ? content.atlasEntries : nullptr,
+		content.atlasEntries ? content.atlasEntries + count : nullptr);
+	entries.resize(count, -1);
+
+	SceneSnapshotHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = SCENESNAPSHOT_MAGIC;
+	header.version = SCENESNAPSHOT_VERSION;
+	header.entityCount = (uint32_t)count;
+	header.wallCount = (uint32_t)walls.size();
+	header.positionOffset = alignUp(sizeof(header));
+	header.rotationOffset = alignUp(header.positionOffset + count * sizeof(glm::vec3));
+	header.scaleOffset = alignUp(header.rotationOffset + count * sizeof(glm::quat));
+	header.extentOffset = alignUp(header.scaleOffset + count * sizeof(glm::vec3));
+	header.atlasEntryOffset = alignUp(header.extentOffset + count * sizeof(glm::vec3));
+	header.wallOffset = alignUp(header.atlasEntryOffset + count * sizeof(int32_t));
+	size_t offset = header.wallOffset + walls.size() * sizeof(SceneSnapshotWall);
+	std::string names;
+	uint32_t* nameOffsets[3] = { &header.meshOffset, &header.atlasOffset, &header.skyboxOffset };
+	const std::string* values[3] = { &content.mesh, &content.atlas, &content.skybox };
+	for (int i = 0; i < 3; i++) {
+		if (!values[i]->empty()) {
+			*nameOffsets[i] = (uint32_t)(offset + names.size());
+			names += *values[i];
+			names += '\0';
+		}
+	}
+
+	FILE* fp = fopen(filename, "wb");
+	if (!fp) {
+		return false;
+	}
+	static const unsigned char zeros[16] = { 0 };
+	size_t written = 0;
+	// Pads up to a part's offset, then writes it
+	auto part = [&](uint32_t at, const void* bytes, size_t length) {
+		size_t pad = at - written;
+		written = at + length;
+		return fwrite(zeros, 1, pad, fp) == pad && (!length || fwrite(bytes, 1, length, fp) == length);
+	};
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+	written = sizeof(header);
+	ok = ok && part(header.positionOffset, content.positions, count * sizeof(glm::vec3));
+	ok = ok && part(header.rotationOffset, content.rotations, count * sizeof(glm::quat));
+	ok = ok && part(header.scaleOffset, content.scales, count * sizeof(glm::vec3));
+	ok = ok && part(header.extentOffset, content.extents, count * sizeof(glm::vec3));
+	ok = ok && part(header.atlasEntryOffset, entries.data(), count * sizeof(int32_t));
+	ok = ok && part(header.wallOffset, walls.data(), walls.size() * sizeof(SceneSnapshotWall));
+	ok = ok && (names.empty() || fwrite(names.data(), 1, names.size(), fp) == names.size());
+	ok = (fclose(fp) == 0) && ok;
+	if (!ok) {
+		remove(filename);
+	}
+	return ok;
+}
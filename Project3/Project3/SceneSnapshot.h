@@ -0,0 +1,107 @@
+#ifndef _SCENE_SNAPSHOT_H_
+#define _SCENE_SNAPSHOT_H_
+
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "CaveLayout.h"
+#include "Image.h"
+
+// Compiled scene snapshot (.p3scene): what ColorCubeScene otherwise sets up from its
+// settings, written once (scene.write_snapshot) and then mapped and taken as it is
+// (scene.snapshot) instead of placed again:
+//
+//   SceneSnapshotHeader
+//   glm::vec3[entityCount] positions, glm::quat[entityCount] rotations,
+//   glm::vec3[entityCount] scales, glm::vec3[entityCount] half extents
+//   int32_t[entityCount] atlas entries, -1 for the box's texture
+//   SceneSnapshotWall[wallCount]
+//   the mesh, atlas and skybox set names, zero terminated
+//
+// each part from its offset, on a 16 byte boundary. Offsets are from the start of the file,
+// so a mapping anywhere reads the same. The entity arrays are EntityStore's own layout and
+// go into it in one copy each; the first entity is the box, the props follow. The atlas
+// entries are used from the mapping.
+
+const uint32_t SCENESNAPSHOT_MAGIC = 0x53533350; // "P3SS"
+const uint32_t SCENESNAPSHOT_VERSION = 1;
+const uint32_t SCENESNAPSHOT_NAME = 32;
+
+struct SceneSnapshotHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entityCount;
+	uint32_t wallCount;
+	uint32_t positionOffset;
+	uint32_t rotationOffset;
+	uint32_t scaleOffset;
+	uint32_t extentOffset;
+	uint32_t atlasEntryOffset;
+	uint32_t wallOffset;
+	// The props.mesh source, the props.atlas file and the skybox set, 0 for none
+	uint32_t meshOffset;
+	uint32_t atlasOffset;
+	uint32_t skyboxOffset;
+	uint32_t reserved[3];
+};
+
+// A CaveWall without the string
+struct SceneSnapshotWall
+{
+	char name[SCENESNAPSHOT_NAME];
+	float corners[4][3];
+	int32_t resolution;
+};
+
+// A snapshot viewed in place. The pointers are into the mapping and only valid for as long
+// as the snapshot (and so its mapping) lives. The names are "" for none.
+struct SceneSnapshot
+{
+	MappedFile file;
+	const SceneSnapshotHeader* header = nullptr;
+	const glm::vec3* positions = nullptr;
+	const glm::quat* rotations = nullptr;
+	const glm::vec3* scales = nullptr;
+	const glm::vec3* extents = nullptr;
+	const int32_t* atlasEntries = nullptr;
+	const SceneSnapshotWall* walls = nullptr;
+	const char* mesh = "";
+	const char* atlas = "";
+	const char* skybox = "";
+};
+
+// Maps and checks a snapshot. False, with nothing mapped, if it is not one this build reads.
+bool mapSceneSnapshot(const char* filename, SceneSnapshot& snapshot);
+
+// The snapshot's walls as CaveLayout::setWalls takes them, named from the mapping
+void sceneSnapshotWalls(const SceneSnapshot& snapshot, std::vector<CaveWallSpec>& specs);
+
+// What goes into a snapshot, count entities' worth of each array
+struct SceneSnapshotContent
+{
+	size_t entityCount;
+	const glm::vec3* positions;
+	const glm::quat* rotations;
+	const glm::vec3* scales;
+	const glm::vec3* extents;
+	// nullptr for every entity on the box's texture
+	const int32_t* atlasEntries;
+	std::vector<CaveWall> walls;
+	std::string mesh;
+	std::string atlas;
+	std::string skybox;
+};
+
+// False if the file could not be written or a wall's name does not fit
+bool writeSceneSnapshot(const char* filename, const SceneSnapshotContent& content);
+
+#endif
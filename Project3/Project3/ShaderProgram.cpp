@@ -0,0 +1,220 @@
+#include "ShaderProgram.h"
+#include "shader.h"
+#include "GLState.h"
+#include "GLMarkers.h"
+#include "GpuHandles.h"
+
+#include <vector>
+
+ShaderProgram::ShaderProgram() : program(0), pending(new PendingProgram())
+{
+}
+
+ShaderProgram::~ShaderProgram()
+{
+	if (program) {
+		glDeleteProgram(program);
+	}
+}
+
+bool ShaderProgram::load(const char* vertex_file_path, const char* fragment_file_path)
+{
+	return load(vertex_file_path, nullptr, fragment_file_path);
+}
+
+bool ShaderProgram::load(const char* vertex_file_path, const char* geometry_file_path, const char* fragment_file_path,
+	const std::string& defines)
+{
+	begin(vertex_file_path, geometry_file_path, fragment_file_path, defines);
+	return finish();
+}
+
+bool ShaderProgram::loadCompute(const char* compute_file_path, const std::string& defines)
+{
+	beginCompute(compute_file_path, defines);
+	return finish();
+}
+
+bool ShaderProgram::begin(const char* vertex_file_path, const char* geometry_file_path, const char* fragment_file_path,
+	const std::string& defines)
+{
+	if (program) {
+		glDeleteProgram(program);
+		program = 0;
+	}
+	locations.clear();
+
+	made = ShaderSource();
+	made.vertex = vertex_file_path;
+	made.geometry = geometry_file_path ? geometry_file_path : "";
+	made.fragment = fragment_file_path;
+	made.defines = defines;
+	*pending = made.begin();
+	return pending->program != 0;
+}
+
+bool ShaderProgram::beginCompute(const char* compute_file_path, const std::string& defines)
+{
+	if (program) {
+		glDeleteProgram(program);
+		program = 0;
+	}
+	locations.clear();
+
+	made = ShaderSource();
+	made.compute = compute_file_path;
+	made.defines = defines;
+	*pending = made.begin();
+	return pending->program != 0;
+}
+
+bool ShaderProgram::finish()
+{
+	program = FinishProgram(*pending);
+	return checkLinked();
+}
+
+bool ShaderProgram::ready() const
+{
+	return ProgramReady(*pending);
+}
+
+bool ShaderProgram::replace(GLuint linked)
+{
+	GLint status = GL_FALSE;
+	if (linked) {
+		glGetProgramiv(linked, GL_LINK_STATUS, &status);
+	}
+	if (!status) {
+		if (linked) {
+			glDeleteProgram(linked);
+		}
+		return false;
+	}
+	// Frames in flight may still draw with the old one, it goes once they are done
+	gpuHandles().retire(GpuHandles::PROGRAM, program);
+	glState().useProgram(0);
+	program = linked;
+	locations.clear();
+	resolveUniforms();
+	labelProgram();
+	return true;
+}
+
+std::vector<std::string> ShaderSource::files() const
+{
+	std::vector<std::string> out;
+	for (const std::string* file : { &vertex, &geometry, &fragment, &compute }) {
+		if (!file->empty()) {
+			out.push_back(*file);
+		}
+	}
+	return out;
+}
+
+PendingProgram ShaderSource::begin() const
+{
+	if (!compute.empty()) {
+		return BeginComputeShader(compute.c_str(), defines);
+	}
+	return BeginShaders(vertex.c_str(), geometry.empty() ? nullptr : geometry.c_str(), fragment.c_str(), defines);
+}
+
+bool ShaderProgram::checkLinked()
+{
+	GLint linked = GL_FALSE;
+	if (program) {
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	}
+	if (!linked) {
+		if (program) {
+			glDeleteProgram(program);
+		}
+		program = 0;
+		return false;
+	}
+	resolveUniforms();
+	labelProgram();
+	return true;
+}
+
+void ShaderProgram::use() const
+{
+	glState().useProgram(program);
+}
+
+Uniform ShaderProgram::uniform(const std::string& name) const
+{
+	auto it = locations.find(name);
+	return Uniform(it == locations.end() ? -1 : it->second);
+}
+
+void ShaderProgram::setSampler(const std::string& name, GLint unit) const
+{
+	Uniform sampler = uniform(name);
+	if (sampler.valid()) {
+		glUseProgram(program);
+		sampler.set((int)unit);
+	}
+}
+
+void ShaderProgram::bindUniformBlock(const std::string& name, GLuint binding) const
+{
+	GLuint index = glGetUniformBlockIndex(program, name.c_str());
+	if (index != GL_INVALID_INDEX) {
+		glUniformBlockBinding(program, index, binding);
+	}
+}
+
+void ShaderProgram::resolveUniforms()
+{
+	GLint count = 0;
+	GLint maxLength = 0;
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+	std::vector<char> name(maxLength + 1);
+
+	for (GLint i = 0; i < count; i++) {
+		GLsizei length = 0;
+		GLint size = 0;
+		GLenum type = 0;
+		glGetActiveUniform(program, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, name.data());
+		std::string uniformName(name.data(), length);
+		GLint location = glGetUniformLocation(program, uniformName.c_str());
+		if (location < 0) {
+			// Block members have no location of their own
+			continue;
+		}
+		// Arrays are reported as "name[0]", they are set from their first element
+		size_t bracket = uniformName.find('[');
+		if (bracket != std::string::npos) {
+			uniformName.erase(bracket);
+		}
+		locations[uniformName] = location;
+	}
+}
+
+// The program's files and the names it was defined with, for frame captures (GLMarkers.h)
+void ShaderProgram::labelProgram()
+{
+	if (!glMarkers().enabled()) {
+		return;
+	}
+	std::string text;
+	for (const std::string& file : made.files()) {
+		text += (text.empty() ? "" : " ") + file;
+	}
+	size_t start = 0;
+	while (start < made.defines.size()) {
+		size_t end = made.defines.find('\n', start);
+		if (end == std::string::npos) {
+			end = made.defines.size();
+		}
+		std::string line = made.defines.substr(start, end - start);
+		if (line.compare(0, 8, "#define ") == 0) {
+			text += " " + line.substr(8);
+		}
+		start = end + 1;
+	}
+	glMarkers().label(GL_PROGRAM, program, text);
+}
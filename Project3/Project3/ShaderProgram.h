@@ -0,0 +1,128 @@
+#ifndef _SHADER_PROGRAM_H_
+#define _SHADER_PROGRAM_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct PendingProgram;
+
+// What a program is made from, kept so that it can be made again (ShaderReloader)
+struct ShaderSource
+{
+	std::string vertex;
+	std::string geometry;
+	std::string fragment;
+	std::string compute;
+	std::string defines;
+
+	std::vector<std::string> files() const;
+	// Begins the program (BeginShaders or BeginComputeShader), from any GL thread
+	PendingProgram begin() const;
+};
+
+// The location of one uniform of a program, typed by what is set through it. Setting a
+// uniform the program does not have (location -1) does nothing, like glUniform* itself.
+// The program has to be in use.
+class Uniform
+{
+public:
+	Uniform() : location(-1) {}
+	explicit Uniform(GLint location) : location(location) {}
+
+	bool valid() const { return location >= 0; }
+	GLint id() const { return location; }
+
+	void set(int value) const { glUniform1i(location, value); }
+	void set(float value) const { glUniform1f(location, value); }
+	void set(const glm::vec2& value) const { glUniform2fv(location, 1, &value[0]); }
+	void set(const glm::vec3& value) const { glUniform3fv(location, 1, &value[0]); }
+	void set(const glm::vec4& value) const { glUniform4fv(location, 1, &value[0]); }
+	void set(const glm::mat3& value) const { glUniformMatrix3fv(location, 1, GL_FALSE, &value[0][0]); }
+	void set(const glm::mat4& value) const { glUniformMatrix4fv(location, 1, GL_FALSE, &value[0][0]); }
+	void set(const GLint* values, GLsizei count) const { glUniform1iv(location, count, values); }
+	void set(const float* values, GLsizei count) const { glUniform1fv(location, count, values); }
+	void set(const glm::vec4* values, GLsizei count) const { glUniform4fv(location, count, &values[0][0]); }
+	void set(const glm::mat4* values, GLsizei count) const { glUniformMatrix4fv(location, count, GL_FALSE, &values[0][0][0]); }
+	// A bindless texture handle, for samplers declared bindless_sampler
+	void setHandle(GLuint64 handle) const { glUniformHandleui64ARB(location, handle); }
+
+private:
+	GLint location;
+};
+
+// A linked program and the locations of all its active uniforms, read once after linking
+// so nothing has to be looked up by name while drawing. Owns the program.
+class ShaderProgram
+{
+public:
+	ShaderProgram();
+	~ShaderProgram();
+
+	ShaderProgram(const ShaderProgram&) = delete;
+	ShaderProgram& operator=(const ShaderProgram&) = delete;
+
+	// Compiles and links through LoadShaders (geometry_file_path may be nullptr). Returns
+	// false if the program did not link, the errors are printed by then.
+	bool load(const char* vertex_file_path, const char* fragment_file_path);
+	bool load(const char* vertex_file_path, const char* geometry_file_path, const char* fragment_file_path,
+		const std::string& defines = std::string());
+	// A compute program, through LoadComputeShader
+	bool loadCompute(const char* compute_file_path, const std::string& defines = std::string());
+
+	// load() in two steps (see BeginShaders): begin() hands the program to the driver,
+	// finish() waits for it and reads its uniforms. Programs begun together compile
+	// together. begin() returns false if the files could not be read.
+	bool begin(const char* vertex_file_path, const char* geometry_file_path, const char* fragment_file_path,
+		const std::string& defines = std::string());
+	bool beginCompute(const char* compute_file_path, const std::string& defines = std::string());
+	bool finish();
+	// Whether finish() would not wait
+	bool ready() const;
+
+	const ShaderSource& source() const { return made; }
+	//! Takes over linked, a program made again from source(), in place of this one and
+	// reads its uniforms. If it did not link it is deleted and this one kept, and false
+	// is returned. Uniform handles, samplers and block bindings have to be set again.
+	bool replace(GLuint linked);
+
+	GLuint id() const { return program; }
+	bool valid() const { return program != 0; }
+	void use() const;
+
+	// The uniform by name (arrays by their name without [0]), invalid if the program has no
+	// such active uniform. For setup: keep the handle instead of asking every draw.
+	Uniform uniform(const std::string& name) const;
+
+	// Points a sampler at a texture unit. Sampler units are program state, so once is enough.
+	void setSampler(const std::string& name, GLint unit) const;
+	// Sources a uniform block from a buffer binding point, if the program has the block
+	void bindUniformBlock(const std::string& name, GLuint binding) const;
+
+private:
+	// Keeps the program and reads its uniforms if it linked, deletes it otherwise
+	bool checkLinked();
+	void resolveUniforms();
+	void labelProgram();
+
+	GLuint program;
+	std::unique_ptr<PendingProgram> pending;
+	ShaderSource made;
+	std::unordered_map<std::string, GLint> locations;
+};
+
+#endif
@@ -0,0 +1,141 @@
+#include "ShaderReloader.h"
+#include "Log.h"
+#include "TextureCache.h"
+#include "UploadThread.h"
+#include "shader.h"
+
+#include <chrono>
+#include <iostream>
+
+struct ShaderReloader::Watched
+{
+	ShaderProgram* program;
+	std::function<void()> reloaded;
+	std::vector<std::string> files;
+	// The files' times and sizes folded together, as last compiled
+	uint64_t stamp;
+	// Compiling on the render context, or on the upload thread
+	PendingProgram pending;
+	bool threaded;
+};
+
+static double secondsNow()
+{
+	using namespace std::chrono;
+	return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+ShaderReloader::ShaderReloader() : active(false), interval(0.5), lastCheck(0.0), swapped(0)
+{
+}
+
+ShaderReloader::~ShaderReloader()
+{
+	// A compile still on the upload thread calls back into here
+	for (auto& watched : programs) {
+		if (watched->threaded) {
+			uploadThread().finish();
+			break;
+		}
+	}
+	for (auto& watched : programs) {
+		if (watched->pending.program) {
+			glDeleteProgram(FinishProgram(watched->pending));
+		}
+	}
+}
+
+void ShaderReloader::configure(bool enabled, int intervalMs)
+{
+	active = enabled;
+	interval = (intervalMs > 0 ? intervalMs : 500) / 1000.0;
+}
+
+void ShaderReloader::watch(ShaderProgram& program, std::function<void()> reloaded)
+{
+	std::unique_ptr<Watched> watched(new Watched());
+	watched->program = &program;
+	watched->reloaded = std::move(reloaded);
+	watched->files = program.source().files();
+	watched->stamp = stamp(*watched);
+	watched->threaded = false;
+	programs.push_back(std::move(watched));
+}
+
+uint64_t ShaderReloader::stamp(const Watched& watched) const
+{
+	uint64_t folded = 14695981039346656037ull;
+	for (const std::string& file : watched.files) {
+		uint64_t size = 0, time = 0;
+		sourceFileStamp(file.c_str(), size, time);
+		folded = (folded ^ size) * 1099511628211ull;
+		folded = (folded ^ time) * 1099511628211ull;
+	}
+	return folded;
+}
+
+void ShaderReloader::update()
+{
+	if (!active) {
+		return;
+	}
+	// What finished compiling, the upload thread's callbacks swap theirs in
+	uploadThread().poll();
+	for (auto& watched : programs) {
+		if (watched->pending.program && ProgramReady(watched->pending)) {
+			swap(*watched, FinishProgram(watched->pending));
+		}
+	}
+
+	double now = secondsNow();
+	if (now - lastCheck < interval) {
+		return;
+	}
+	lastCheck = now;
+	for (auto& watched : programs) {
+		if (watched->pending.program || watched->threaded) {
+			continue;
+		}
+		uint64_t current = stamp(*watched);
+		if (current == watched->stamp) {
+			continue;
+		}
+		// An editor may still be writing, the next change starts another compile anyway
+		watched->stamp = current;
+		start(*watched);
+	}
+}
+
+void ShaderReloader::start(Watched& watched)
+{
+	logStream(LOG_INFO) << "reloading " << watched.files[0] << std::endl;
+	if (!uploadThread().running()) {
+		watched.pending = watched.program->source().begin();
+		return;
+	}
+	// Programs are shared between the contexts, the upload thread makes it and this one
+	// takes it over once the GPU has it
+	watched.threaded = true;
+	std::shared_ptr<GLuint> made = std::make_shared<GLuint>(0);
+	ShaderSource source = watched.program->source();
+	Watched* target = &watched;
+	uploadThread().submit([source, made] {
+		PendingProgram pending = source.begin();
+		*made = FinishProgram(pending);
+	}, [this, target, made] {
+		target->threaded = false;
+		swap(*target, *made);
+	});
+}
+
+void ShaderReloader::swap(Watched& watched, GLuint linked)
+{
+	if (!watched.program->replace(linked)) {
+		std::cerr << "reloading " << watched.files[0] << " failed, keeping the old program" << std::endl;
+		return;
+	}
+	swapped++;
+	if (watched.reloaded) {
+		watched.reloaded();
+	}
+}
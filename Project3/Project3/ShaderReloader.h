@@ -0,0 +1,57 @@
+#ifndef _SHADER_RELOADER_H_
+#define _SHADER_RELOADER_H_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ShaderProgram.h"
+
+// Makes programs again when their source files change, while the app keeps running with
+// the old ones. update() looks at the files' times every so often; a program whose files
+// changed is compiled in the background, on the upload thread's shared context when it
+// runs, otherwise by the driver's own compiler threads (KHR_parallel_shader_compile), and
+// swapped in by a later update() at the start of a frame. reloaded is then called to set
+// uniform handles, samplers and block bindings again. A program that does not compile
+// leaves the old one in place and its log on the console.
+//
+// Without either, the compile is waited for in update(): a stall, but only after an edit.
+// Only use from the render thread.
+class ShaderReloader
+{
+public:
+	ShaderReloader();
+	~ShaderReloader();
+
+	ShaderReloader(const ShaderReloader&) = delete;
+	ShaderReloader& operator=(const ShaderReloader&) = delete;
+
+	// @input intervalMs How often the files' times are looked at
+	void configure(bool enabled, int intervalMs);
+	bool enabled() const { return active; }
+
+	//! Makes program again when one of its files changes. It has to outlive the reloader.
+	void watch(ShaderProgram& program, std::function<void()> reloaded);
+
+	//! Looks for changed files when it is time, and swaps in what finished compiling
+	void update();
+	// Programs swapped in so far, for what was drawn with the old ones
+	uint64_t version() const { return swapped; }
+
+private:
+	struct Watched;
+
+	void start(Watched& watched);
+	void swap(Watched& watched, GLuint linked);
+	uint64_t stamp(const Watched& watched) const;
+
+	bool active;
+	double interval;
+	double lastCheck;
+	uint64_t swapped;
+	std::vector<std::unique_ptr<Watched>> programs;
+};
+
+#endif
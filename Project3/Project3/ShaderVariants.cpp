@@ -0,0 +1,74 @@
+#include "ShaderVariants.h"
+
+#include <cstdio>
+#include <iostream>
+
+ShaderVariants::ShaderVariants(std::initializer_list<const char*> names)
+{
+	for (const char* name : names) {
+		if (switches.size() == MAX_SWITCHES) {
+			std::cerr << "more than " << MAX_SWITCHES << " shader switches, " << name << " left out" << std::endl;
+			break;
+		}
+		switches.push_back(name);
+	}
+}
+
+ShaderVariants::Key ShaderVariants::bit(const char* name) const
+{
+	for (size_t i = 0; i < switches.size(); i++) {
+		if (switches[i] == name) {
+			return Key(1) << i;
+		}
+	}
+	return 0;
+}
+
+ShaderVariants::Key ShaderVariants::with(Key key, const char* name, bool on) const
+{
+	return on ? key | bit(name) : key & ~bit(name);
+}
+
+void ShaderVariants::constant(const char* name, int value)
+{
+	constants += "#define " + std::string(name) + " " + std::to_string(value) + "\n";
+}
+
+void ShaderVariants::constant(const char* name, float value)
+{
+	// GLSL reads it back exactly, and as a float even when it is whole
+	char text[32];
+	snprintf(text, sizeof(text), "%.9g", value);
+	std::string literal = text;
+	if (literal.find_first_of(".eEni") == std::string::npos) {
+		literal += ".0";
+	}
+	constants += "#define " + std::string(name) + " " + literal + "\n";
+}
+
+void ShaderVariants::declare(const std::string& lines)
+{
+	constants += lines;
+}
+
+std::string ShaderVariants::defines(Key key) const
+{
+	std::string out = constants;
+	for (size_t i = 0; i < switches.size(); i++) {
+		if (key & (Key(1) << i)) {
+			out += "#define " + switches[i] + "\n";
+		}
+	}
+	return out;
+}
+
+std::string ShaderVariants::describe(Key key) const
+{
+	std::string out;
+	for (size_t i = 0; i < switches.size(); i++) {
+		if (key & (Key(1) << i)) {
+			out += (out.empty() ? "" : "|") + switches[i];
+		}
+	}
+	return out.empty() ? "base" : out;
+}
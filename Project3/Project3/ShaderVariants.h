@@ -0,0 +1,47 @@
+#ifndef _SHADER_VARIANTS_H_
+#define _SHADER_VARIANTS_H_
+
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+// The #define switches and constants one set of shader files is compiled with. A key holds
+// a bit per switch, and every key compiles to a program of its own (defines(key) goes to
+// ShaderProgram::begin). What the draw decides once, the shader is not asked per fragment:
+// a branch on a uniform becomes an #ifdef, and the code a variant does not take is not in
+// it. Constants are the same in every variant, values a shader would otherwise read from
+// a uniform but that are fixed once the program is made, like specialization constants.
+class ShaderVariants
+{
+public:
+	typedef uint32_t Key;
+
+	static const size_t MAX_SWITCHES = 32;
+
+	ShaderVariants() {}
+	ShaderVariants(std::initializer_list<const char*> switches);
+
+	//! The bit of a switch in a key, 0 for one this does not have
+	Key bit(const char* name) const;
+	//! key with name's bit set, or cleared
+	Key with(Key key, const char* name, bool on = true) const;
+
+	//! #define name value, in every variant
+	void constant(const char* name, int value);
+	void constant(const char* name, float value);
+	//! Lines the shaders share, a #define a macro of their declarations (like
+	// WallResolution::shaderDefines), in every variant
+	void declare(const std::string& lines);
+
+	//! The constants and key's switches, one #define a line
+	std::string defines(Key key) const;
+	//! key's switches joined with |, for logs
+	std::string describe(Key key) const;
+
+private:
+	std::vector<std::string> switches;
+	std::string constants;
+};
+
+#endif
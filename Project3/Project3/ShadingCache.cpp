@@ -0,0 +1,225 @@
+#include "ShadingCache.h"
+#include "GLMarkers.h"
+#include "GLState.h"
+#include "GpuMemory.h"
+#include "TextureUpload.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+// The scene shaders' per instance atlas tile attributes, which shadingCache.vert reads the
+// material from
+static const GLuint RECT_ATTRIBUTE = 9;
+static const GLuint LAYER_ATTRIBUTE = 10;
+static const GLuint TRANSFORM_ATTRIBUTE = 5;
+
+ShadingCache::ShadingCache() : transformsUploaded(0), count(0), tileWidth(0), tileHeight(0), columns(0), rows(0), width(0), height(0), layers(0)
+{
+}
+
+ShadingCache::~ShadingCache()
+{
+	release();
+}
+
+void ShadingCache::release()
+{
+	if (texture.get()) {
+		gpuMemory().release(GpuMemory::KIND_TEXTURE, texture);
+	}
+	for (GLuint buffer : { materialBuffer.get(), transformBuffer.get() }) {
+		if (buffer) {
+			gpuMemory().release(GpuMemory::KIND_BUFFER, buffer);
+		}
+	}
+	texture.reset();
+	framebuffer.reset();
+	vao.reset();
+	materialBuffer.reset();
+	transformBuffer.reset();
+	transformsUploaded = 0;
+	count = 0;
+}
+
+bool ShadingCache::init(size_t count, int faceSize, bool lit)
+{
+	release();
+	if (!count || faceSize < 1) {
+		return false;
+	}
+	GLint maxSide = 0, maxLayers = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSide);
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+	int side = std::min((int)maxSide, (int)MAX_SIDE);
+	tileWidth = COLUMNS * faceSize;
+	tileHeight = ROWS * faceSize;
+	if (tileWidth > side || tileHeight > side) {
+		std::cerr << "shading cache faces of " << faceSize << " texels do not fit a " << side << " texture" << std::endl;
+		return false;
+	}
+	// A layer only as tall as the tiles need
+	columns = side / tileWidth;
+	rows = (int)std::min((size_t)(side / tileHeight), (count + columns - 1) / columns);
+	size_t perLayer = (size_t)columns * rows;
+	layers = (int)((count + perLayer - 1) / perLayer);
+	if (layers > maxLayers) {
+		std::cerr << "shading cache for " << count << " props needs " << layers << " layers, more than the "
+			<< maxLayers << " an array has" << std::endl;
+		return false;
+	}
+	width = columns * tileWidth;
+	height = rows * tileHeight;
+
+	if (!program.load("shadingCache.vert", nullptr, "shadingCache.frag", lit ? Lighting::shaderDefines() : "")) {
+		return false;
+	}
+	columnsUniform = program.uniform("columns");
+	tileScaleUniform = program.uniform("tileScale");
+	program.use();
+	program.setSampler("cubebox", 0);
+	program.setSampler("atlas", 2);
+	program.setSampler("shadowMap", Lighting::SHADOW_UNIT);
+	program.setSampler("lightCells", Lighting::CELL_UNIT);
+	program.setSampler("lightIndices", Lighting::INDEX_UNIT);
+	program.bindUniformBlock("Lighting", Lighting::BINDING);
+	glState().useProgram(0);
+
+	texture.create();
+	glState().bindTexture(0, GL_TEXTURE_2D_ARRAY, texture);
+	allocateTextureArrayStorage(1, GL_RGBA8, width, height, layers);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	gpuMemory().allocate(GpuMemory::KIND_TEXTURE, texture, (uint64_t)width * height * layers * 4, GpuMemory::RENDER_TARGET,
+		"shading cache");
+	framebuffer.create();
+	glMarkers().label(GL_FRAMEBUFFER, framebuffer, "shading cache");
+
+	materialBuffer.create();
+	vao.create();
+	glState().bindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, materialBuffer);
+	glBufferData(GL_ARRAY_BUFFER, count * sizeof(AtlasTile), nullptr, GL_DYNAMIC_DRAW);
+	glEnableVertexAttribArray(RECT_ATTRIBUTE);
+	glEnableVertexAttribArray(LAYER_ATTRIBUTE);
+	glVertexAttribDivisor(RECT_ATTRIBUTE, 1);
+	glVertexAttribDivisor(LAYER_ATTRIBUTE, 1);
+	if (lit) {
+		transformBuffer.create();
+		glBindBuffer(GL_ARRAY_BUFFER, transformBuffer);
+		glBufferData(GL_ARRAY_BUFFER, count * sizeof(glm::mat4), nullptr, GL_DYNAMIC_DRAW);
+		for (GLuint column = 0; column < 4; column++) {
+			glEnableVertexAttribArray(TRANSFORM_ATTRIBUTE + column);
+			glVertexAttribDivisor(TRANSFORM_ATTRIBUTE + column, 1);
+		}
+		gpuMemory().allocate(GpuMemory::KIND_BUFFER, transformBuffer, count * sizeof(glm::mat4), GpuMemory::MESH,
+			"shading cache transforms");
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glState().bindVertexArray(0);
+	gpuMemory().allocate(GpuMemory::KIND_BUFFER, materialBuffer, count * sizeof(AtlasTile), GpuMemory::MESH, "shading cache materials");
+
+	this->count = count;
+	updateMaterials(nullptr);
+	return true;
+}
+
+AtlasTile ShadingCache::tile(size_t i) const
+{
+	size_t perLayer = (size_t)columns * rows;
+	size_t slot = i % perLayer;
+	AtlasTile t = noAtlasTile();
+	t.rect[0] = (float)((slot % columns) * tileWidth) / (float)width;
+	t.rect[1] = (float)((slot / columns) * tileHeight) / (float)height;
+	t.rect[2] = (float)tileWidth / (float)width;
+	t.rect[3] = (float)tileHeight / (float)height;
+	t.layer = (float)(i / perLayer);
+	return t;
+}
+
+void ShadingCache::updateMaterials(const AtlasTile* materials)
+{
+	if (!valid()) {
+		return;
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, materialBuffer);
+	if (materials) {
+		glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(AtlasTile), materials);
+	}
+	else {
+		std::vector<AtlasTile> none(count, noAtlasTile());
+		glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(AtlasTile), none.data());
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void ShadingCache::updateTransforms(const glm::mat4* worlds, uint64_t version)
+{
+	if (!transformBuffer.get() || version == transformsUploaded) {
+		return;
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, transformBuffer);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(glm::mat4), worlds);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	transformsUploaded = version;
+}
+
+void ShadingCache::shade(GLuint cube, GLuint atlas, const Lighting* lighting)
+{
+	if (!valid()) {
+		return;
+	}
+	// Called in the middle of an eye's setup, so what it had bound is put back after. Both
+	// are the driver's own copies, asking does not wait for the GPU.
+	GLint boundFramebuffer = 0, viewport[4];
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &boundFramebuffer);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+	glViewport(0, 0, width, height);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+	glState().polygonMode(GL_FILL);
+
+	program.use();
+	columnsUniform.set(columns);
+	tileScaleUniform.set(glm::vec2((float)tileWidth / (float)width, (float)tileHeight / (float)height));
+	glState().bindTexture(0, GL_TEXTURE_CUBE_MAP, cube);
+	if (atlas) {
+		glState().bindTexture(2, GL_TEXTURE_2D_ARRAY, atlas);
+	}
+	if (lighting && transformBuffer.get()) {
+		glState().bindTexture(Lighting::SHADOW_UNIT, GL_TEXTURE_2D, lighting->shadowTexture());
+		glState().bindTexture(Lighting::CELL_UNIT, GL_TEXTURE_BUFFER, lighting->cellTexture());
+		glState().bindTexture(Lighting::INDEX_UNIT, GL_TEXTURE_BUFFER, lighting->indexTexture());
+	}
+	glState().bindVertexArray(vao);
+
+	// A quad per tile, every texel of it written, so nothing needs clearing. Instances
+	// count from 0 again in each layer's draw, the material attributes are moved to its
+	// first instance instead.
+	size_t perLayer = (size_t)columns * rows;
+	for (int layer = 0; layer < layers; layer++) {
+		size_t first = layer * perLayer;
+		GLsizei instances = (GLsizei)std::min(perLayer, count - first);
+		glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture, 0, layer);
+		if (transformBuffer.get()) {
+			glBindBuffer(GL_ARRAY_BUFFER, transformBuffer);
+			for (GLuint column = 0; column < 4; column++) {
+				glVertexAttribPointer(TRANSFORM_ATTRIBUTE + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+					(GLvoid*)(first * sizeof(glm::mat4) + column * sizeof(glm::vec4)));
+			}
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, materialBuffer);
+		glVertexAttribPointer(RECT_ATTRIBUTE, 4, GL_FLOAT, GL_FALSE, sizeof(AtlasTile),
+			(GLvoid*)(first * sizeof(AtlasTile) + offsetof(AtlasTile, rect)));
+		glVertexAttribPointer(LAYER_ATTRIBUTE, 1, GL_FLOAT, GL_FALSE, sizeof(AtlasTile),
+			(GLvoid*)(first * sizeof(AtlasTile) + offsetof(AtlasTile, layer)));
+		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, instances);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glState().bindVertexArray(0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, (GLuint)boundFramebuffer);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
@@ -0,0 +1,97 @@
+#ifndef _SHADING_CACHE_H_
+#define _SHADING_CACHE_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "GLHandle.h"
+#include "Lighting.h"
+#include "ShaderProgram.h"
+#include "TextureAtlas.h"
+
+// The props' shading done once a frame in texture space, instead of in every view that
+// draws them: up to three walls for each of two eyes per viewer, and more for each viewer
+// after the first. What a cube prop looks like does not depend on where it is seen from, so
+// every texel of its surface is shaded into a tile of a GL_TEXTURE_2D_ARRAY by
+// shadingCache.frag, and the views only sample that tile (atlased 3 in the scene shaders),
+// the same lookup whatever the material costs.
+//
+// A tile holds the cube's six faces in a grid of three by two: +x, +y and +z on the first
+// row, -x, -y and -z on the second, each face mapped like atlased 2 maps a face to a whole
+// atlas tile. The views keep half a texel inside a face so filtering never reaches the next.
+// Tiles are not mipmapped, a face is meant to be about as big as a prop gets on a wall.
+// A lit cache applies the frame's Lighting as well, which is diffuse and so the same from
+// every view, and the views leave the props it shaded unlit.
+class ShadingCache
+{
+public:
+	enum { COLUMNS = 3, ROWS = 2, MAX_SIDE = 2048 };
+
+	ShadingCache();
+	~ShadingCache();
+
+	ShadingCache(const ShadingCache&) = delete;
+	ShadingCache& operator=(const ShadingCache&) = delete;
+
+	//! Tiles for count instances, faces faceSize texels square. False, with nothing made, if
+	// the program does not link or they do not fit an array.
+	// @input lit Shades with the frame's Lighting too, which needs where each instance is
+	//		(updateTransforms)
+	bool init(size_t count, int faceSize, bool lit = false);
+	bool valid() const { return texture.get() != 0; }
+	// Deletes the shading atlas with its framebuffer and vertex array, and the material and
+	// transform buffers
+	void release();
+
+	GLuint id() const { return texture; }
+	// Where instance i's faces are, what the draws sampling the cache are given as its tile
+	AtlasTile tile(size_t i) const;
+
+	//! Each instance's material: an atlas tile mapped on its faces, or the cube texture for
+	// one without an image (layer -1). nullptr is none for all of them.
+	void updateMaterials(const AtlasTile* materials);
+	//! Each instance's world matrix, uploaded if version says they changed since the last.
+	// Only a lit cache needs them.
+	void updateTransforms(const glm::mat4* worlds, uint64_t version);
+
+	//! Shades every instance's tile, leaving the framebuffer and viewport as they were. The
+	// depth test and blending are left off.
+	// @input cube The cube texture, for instances without an atlas image
+	// @input atlas The array materials point into, 0 for none
+	// @input lighting The frame's, for a lit cache, with its block bound
+	void shade(GLuint cube, GLuint atlas, const Lighting* lighting = nullptr);
+
+private:
+	ShaderProgram program;
+	Uniform columnsUniform;
+	Uniform tileScaleUniform;
+
+	GLTexture texture;
+	GLFramebuffer framebuffer;
+	GLVertexArray vao;
+	// Each instance's material tile, read by instance (attributes 9 and 10)
+	GLBuffer materialBuffer;
+	// And its world matrix (attributes 5 to 8), in a lit cache
+	GLBuffer transformBuffer;
+	uint64_t transformsUploaded;
+
+	size_t count;
+	int tileWidth;
+	int tileHeight;
+	// Tiles across and down a layer, and how big one layer is
+	int columns;
+	int rows;
+	int width;
+	int height;
+	int layers;
+};
+
+#endif
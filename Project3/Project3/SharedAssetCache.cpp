@@ -0,0 +1,328 @@
+#include "SharedAssetCache.h"
+#include "Log.h"
+#include "TextureCache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+static const uint32_t SHARED_CACHE_MAGIC = 0x43533350; // "P3SC"
+static const uint32_t SHARED_CACHE_VERSION = 1;
+static const uint32_t MAX_ENTRIES = 4096;
+static const size_t KEY_LENGTH = 232;
+// Blobs start on a cache line, image levels within them on 16 bytes like a texture cache's
+static const uint64_t BLOB_ALIGN = 64;
+
+struct SharedCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entryCount;
+	uint32_t reserved;
+	// Of the whole segment, and the bytes of it used so far
+	uint64_t capacity;
+	uint64_t used;
+	// FILETIME of the last attach, detach or insert, which the keeper goes by
+	uint64_t lastUse;
+};
+
+struct SharedCacheEntry
+{
+	uint64_t stamp;
+	uint64_t offset;
+	uint64_t size;
+	char key[KEY_LENGTH];
+};
+
+static const uint64_t TABLE_END = (sizeof(SharedCacheHeader) + MAX_ENTRIES * sizeof(SharedCacheEntry) + 4095) & ~(uint64_t)4095;
+
+static uint64_t alignBlob(uint64_t offset)
+{
+	return (offset + BLOB_ALIGN - 1) & ~(BLOB_ALIGN - 1);
+}
+
+static uint64_t fileTimeNow()
+{
+	FILETIME now;
+	GetSystemTimeAsFileTime(&now);
+	return ((uint64_t)now.dwHighDateTime << 32) | now.dwLowDateTime;
+}
+
+SharedAssetCache::SharedAssetCache() : mapping(nullptr), mutex(nullptr), view(nullptr)
+{
+}
+
+SharedAssetCache::~SharedAssetCache()
+{
+	detach();
+}
+
+bool SharedAssetCache::attach(const std::string& name, size_t bytes, bool startKeeper)
+{
+	detach();
+	uint64_t total = TABLE_END + bytes;
+	mutex = CreateMutexA(nullptr, FALSE, (name + ".lock").c_str());
+	mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, (DWORD)(total >> 32), (DWORD)total, name.c_str());
+	bool created = mapping && GetLastError() != ERROR_ALREADY_EXISTS;
+	view = mapping ? (unsigned char*)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0) : nullptr;
+	if (!mutex || !view) {
+		std::cerr << "assets.shared_cache: could not open " << name << ", decoding everything" << std::endl;
+		detach();
+		return false;
+	}
+
+	if (!lock()) {
+		detach();
+		return false;
+	}
+	SharedCacheHeader* header = (SharedCacheHeader*)view;
+	if (created || header->magic != SHARED_CACHE_MAGIC || header->version != SHARED_CACHE_VERSION) {
+		// A segment made by another version is only as big as that one asked for
+		MEMORY_BASIC_INFORMATION region;
+		VirtualQuery(view, &region, sizeof(region));
+		memset(header, 0, sizeof(SharedCacheHeader));
+		header->magic = SHARED_CACHE_MAGIC;
+		header->version = SHARED_CACHE_VERSION;
+		header->capacity = created ? total : region.RegionSize;
+		header->used = TABLE_END;
+	}
+	touch();
+	logStream(LOG_INFO) << "assets.shared_cache: " << header->entryCount << " blobs, " << (header->used - TABLE_END) / (1024 * 1024)
+		<< " of " << (header->capacity - TABLE_END) / (1024 * 1024) << " MB" << (created ? ", new" : "") << std::endl;
+	unlock();
+
+	if (created && startKeeper) {
+		char executable[MAX_PATH];
+		DWORD length = GetModuleFileNameA(nullptr, executable, MAX_PATH);
+		std::string command = "\"" + std::string(executable, length < MAX_PATH ? length : 0) +
+			"\" --assets.shared_cache_keeper --assets.shared_cache_name=" + name;
+		STARTUPINFOA startup = {};
+		startup.cb = sizeof(startup);
+		PROCESS_INFORMATION process = {};
+		if (CreateProcessA(nullptr, &command[0], nullptr, nullptr, FALSE, DETACHED_PROCESS | CREATE_NEW_PROCESS_GROUP,
+			nullptr, nullptr, &startup, &process)) {
+			CloseHandle(process.hThread);
+			CloseHandle(process.hProcess);
+		}
+		else {
+			std::cerr << "assets.shared_cache: no keeper started, the cache goes with this run" << std::endl;
+		}
+	}
+	return true;
+}
+
+void SharedAssetCache::detach()
+{
+	if (view) {
+		if (lock()) {
+			touch();
+			unlock();
+		}
+		UnmapViewOfFile(view);
+		view = nullptr;
+	}
+	if (mapping) {
+		CloseHandle(mapping);
+		mapping = nullptr;
+	}
+	if (mutex) {
+		CloseHandle(mutex);
+		mutex = nullptr;
+	}
+}
+
+bool SharedAssetCache::lock()
+{
+	// An instance that died holding it left the table as it was between two blobs
+	DWORD result = WaitForSingleObject(mutex, 5000);
+	return result == WAIT_OBJECT_0 || result == WAIT_ABANDONED;
+}
+
+void SharedAssetCache::unlock()
+{
+	ReleaseMutex(mutex);
+}
+
+void SharedAssetCache::touch()
+{
+	((SharedCacheHeader*)view)->lastUse = fileTimeNow();
+}
+
+bool SharedAssetCache::find(const std::string& key, uint64_t stamp, const unsigned char*& data, size_t& size)
+{
+	if (!view || key.size() >= KEY_LENGTH || !lock()) {
+		return false;
+	}
+	const SharedCacheHeader* header = (const SharedCacheHeader*)view;
+	const SharedCacheEntry* entries = (const SharedCacheEntry*)(header + 1);
+	bool found = false;
+	// The newest blob of a key is the one that can be current
+	for (uint32_t i = header->entryCount; i-- > 0;) {
+		if (key.compare(entries[i].key) == 0) {
+			found = entries[i].stamp == stamp;
+			data = view + entries[i].offset;
+			size = (size_t)entries[i].size;
+			break;
+		}
+	}
+	unlock();
+	return found;
+}
+
+bool SharedAssetCache::insert(const std::string& key, uint64_t stamp, const void* data, size_t size)
+{
+	if (!view || key.size() >= KEY_LENGTH || !lock()) {
+		return false;
+	}
+	SharedCacheHeader* header = (SharedCacheHeader*)view;
+	SharedCacheEntry* entries = (SharedCacheEntry*)(header + 1);
+	for (uint32_t i = header->entryCount; i-- > 0;) {
+		if (key.compare(entries[i].key) == 0) {
+			if (entries[i].stamp == stamp) {
+				unlock();
+				return false;
+			}
+			break;
+		}
+	}
+	uint64_t offset = alignBlob(header->used);
+	if (header->entryCount == MAX_ENTRIES || offset + size > header->capacity) {
+		unlock();
+		return false;
+	}
+	memcpy(view + offset, data, size);
+	SharedCacheEntry& entry = entries[header->entryCount];
+	memset(&entry, 0, sizeof(entry));
+	entry.stamp = stamp;
+	entry.offset = offset;
+	entry.size = size;
+	memcpy(entry.key, key.data(), key.size());
+	// Only counted once it is all there
+	header->used = offset + size;
+	header->entryCount++;
+	touch();
+	unlock();
+	return true;
+}
+
+int SharedAssetCache::keep(const std::string& name, double hours)
+{
+	HANDLE mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+	const volatile SharedCacheHeader* header = mapping ?
+		(const volatile SharedCacheHeader*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (!header) {
+		if (mapping) {
+			CloseHandle(mapping);
+		}
+		return 1;
+	}
+	// FILETIME counts 100ns
+	uint64_t idle = (uint64_t)(std::max(hours, 0.0) * 3600.0 * 1e7);
+	while (fileTimeNow() - header->lastUse < idle) {
+		Sleep(60 * 1000);
+	}
+	UnmapViewOfFile((const void*)header);
+	CloseHandle(mapping);
+	return 0;
+}
+
+SharedAssetCache& sharedAssetCache()
+{
+	static SharedAssetCache instance;
+	return instance;
+}
+
+// What an image of filename was decoded from: the file or the QOI deployed for it, and a
+// texture cache that would now be taken instead
+static uint64_t imageStamp(const std::string& filename)
+{
+	uint64_t values[6];
+	sourceFileStamp(filename.c_str(), values[0], values[1]);
+	sourceFileStamp(qoiSourcePath(filename).c_str(), values[2], values[3]);
+	sourceFileStamp(textureCachePath(filename).c_str(), values[4], values[5]);
+	uint64_t hash = 14695981039346656037ull;
+	const unsigned char* bytes = (const unsigned char*)values;
+	for (size_t i = 0; i < sizeof(values); i++) {
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+// Images are stored in the texture cache layout, their levels after the table
+bool findSharedImage(const std::string& filename, Image& image)
+{
+	const unsigned char* data;
+	size_t size;
+	if (!sharedAssetCache().attached()) {
+		return false;
+	}
+	if (!sharedAssetCache().find("image:" + filename, imageStamp(filename), data, size) || size < sizeof(TexCacheHeader)) {
+		return false;
+	}
+	const TexCacheHeader* header = (const TexCacheHeader*)data;
+	const TexCacheLevel* table = (const TexCacheLevel*)(header + 1);
+	if (header->magic != TEXCACHE_MAGIC || header->levelCount == 0 ||
+		sizeof(TexCacheHeader) + header->levelCount * sizeof(TexCacheLevel) > size) {
+		return false;
+	}
+	PixelFormat format;
+	switch (header->format) {
+	case TEXCACHE_RGB8: format = PixelFormat::RGB8; break;
+	case TEXCACHE_BC1: format = PixelFormat::BC1; break;
+	case TEXCACHE_RGB16F: format = PixelFormat::RGB16F; break;
+	case TEXCACHE_BC6H: format = PixelFormat::BC6H; break;
+	default: return false;
+	}
+	std::vector<ImageLevel> levels;
+	for (uint32_t i = 0; i < header->levelCount; i++) {
+		if ((size_t)table[i].offset + table[i].size > size) {
+			return false;
+		}
+		ImageLevel level = { data + table[i].offset, table[i].size, (int)table[i].width, (int)table[i].height };
+		levels.push_back(level);
+	}
+	image.file.close();
+	image.format = format;
+	image.width = (int)header->width;
+	image.height = (int)header->height;
+	image.levels.swap(levels);
+	return true;
+}
+
+void storeSharedImage(const std::string& filename, const Image& image)
+{
+	if (!sharedAssetCache().attached() || !image.valid()) {
+		return;
+	}
+	TexCacheHeader header = {};
+	header.magic = TEXCACHE_MAGIC;
+	header.version = TEXCACHE_VERSION;
+	switch (image.format) {
+	case PixelFormat::RGB8: header.format = TEXCACHE_RGB8; break;
+	case PixelFormat::BC1: header.format = TEXCACHE_BC1; break;
+	case PixelFormat::RGB16F: header.format = TEXCACHE_RGB16F; break;
+	case PixelFormat::BC6H: header.format = TEXCACHE_BC6H; break;
+	}
+	header.width = (uint32_t)image.width;
+	header.height = (uint32_t)image.height;
+	header.levelCount = (uint32_t)image.levels.size();
+
+	std::vector<TexCacheLevel> table(image.levels.size());
+	size_t offset = sizeof(TexCacheHeader) + table.size() * sizeof(TexCacheLevel);
+	for (size_t i = 0; i < image.levels.size(); i++) {
+		offset = (offset + 15) & ~(size_t)15;
+		table[i].offset = (uint32_t)offset;
+		table[i].size = (uint32_t)image.levels[i].size;
+		table[i].width = (uint32_t)image.levels[i].width;
+		table[i].height = (uint32_t)image.levels[i].height;
+		offset += image.levels[i].size;
+	}
+	std::vector<unsigned char> blob(offset, 0);
+	memcpy(blob.data(), &header, sizeof(header));
+	memcpy(blob.data() + sizeof(header), table.data(), table.size() * sizeof(TexCacheLevel));
+	for (size_t i = 0; i < image.levels.size(); i++) {
+		memcpy(blob.data() + table[i].offset, image.levels[i].data, image.levels[i].size);
+	}
+	sharedAssetCache().insert("image:" + filename, imageStamp(filename), blob.data(), blob.size());
+}
@@ -0,0 +1,71 @@
+#ifndef _SHARED_ASSET_CACHE_H_
+#define _SHARED_ASSET_CACHE_H_
+
+#include <Windows.h>
+#include <cstdint>
+#include <string>
+
+#include "Image.h"
+
+// Blobs kept in named shared memory across restarts of the app (assets.shared_cache_mb),
+// so a new instance takes what the last one decoded instead of decoding it again: images
+// that had to be decoded on the CPU (QOIs, PFMs and PPMs without a texture cache) and
+// program binaries. An image is uploaded straight from its view into the segment.
+//
+// Shared memory lasts only as long as some process has it open. The instance that creates
+// the segment starts a keeper, this executable again with --assets.shared_cache_keeper,
+// which holds it until no instance has used it for assets.shared_cache_hours. A running
+// instance marks it used every frame (heartbeat).
+//
+// The segment is filled front to back and never compacted: a blob stays at its address for
+// as long as the segment lives, and once it is full nothing more is added. A blob replaced
+// by a newer version of its file only wastes its space. Every instance and the keeper take
+// a named mutex around the table, so several instances on one machine can share it.
+class SharedAssetCache
+{
+public:
+	SharedAssetCache();
+	~SharedAssetCache();
+
+	SharedAssetCache(const SharedAssetCache&) = delete;
+	SharedAssetCache& operator=(const SharedAssetCache&) = delete;
+
+	//! Opens the segment, creating it with bytes of room if it is not there yet.
+	// @input startKeeper Start a keeper when this instance created the segment
+	bool attach(const std::string& name, size_t bytes, bool startKeeper);
+	void detach();
+	bool attached() const { return view != nullptr; }
+
+	//! The blob stored under key, if it was stored with the same stamp.
+	// @input data Receives a view into the segment, valid while attached
+	bool find(const std::string& key, uint64_t stamp, const unsigned char*& data, size_t& size);
+	// Copies a blob in. False if the cache is not attached, full or already has key at stamp.
+	bool insert(const std::string& key, uint64_t stamp, const void* data, size_t size);
+	// Marks the cache used now, so the keeper waits. A plain store, cheap enough every frame.
+	void heartbeat() { if (view) touch(); }
+
+	//! Runs as the keeper: holds the segment until it goes unused for hours.
+	// @return The exit code, 0 once it lets go
+	static int keep(const std::string& name, double hours);
+
+private:
+	// Returns false if the segment's mutex cannot be had
+	bool lock();
+	void unlock();
+	void touch();
+
+	HANDLE mapping;
+	// Named, so it is the same across instances. It serializes this process's threads too.
+	HANDLE mutex;
+	unsigned char* view;
+};
+
+SharedAssetCache& sharedAssetCache();
+
+// The decoded image of filename from the shared cache, its levels views into the segment.
+// Misses when the file, its QOI or its texture cache changed since it was stored.
+bool findSharedImage(const std::string& filename, Image& image);
+// Stores a decoded image of filename for the next instance
+void storeSharedImage(const std::string& filename, const Image& image);
+
+#endif
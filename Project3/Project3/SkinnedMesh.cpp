@@ -0,0 +1,162 @@
+#include "SkinnedMesh.h"
+#include "GLState.h"
+#include "GpuMemory.h"
+#include "MeshPool.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+
+// Storage buffer bindings of skin.comp
+enum { SOURCE_BINDING, SKINNED_BINDING };
+// Each joint a little behind the one below it, so the chain sways rather than bends as one
+static const float JOINT_PHASE = 0.6f;
+
+SkinnedMesh::SkinnedMesh() : vao(0), buffer(0), mesh(0), boneCount(0), fit(1.f), amplitude(0.f), speed(0.f), skins(0), draws(0)
+{
+}
+
+SkinnedMesh::~SkinnedMesh()
+{
+	release();
+}
+
+bool SkinnedMesh::supported()
+{
+	return GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object;
+}
+
+bool SkinnedMesh::init(int meshId, const glm::vec3& boundsMin, const glm::vec3& boundsMax, int bones)
+{
+	if (!supported()) {
+		std::cerr << "compute shaders not supported, the mesh is not skinned" << std::endl;
+		return false;
+	}
+	if (!program.loadCompute("skin.comp")) {
+		return false;
+	}
+	baseVertexUniform = program.uniform("baseVertex");
+	vertexCountUniform = program.uniform("vertexCount");
+	boneCountUniform = program.uniform("boneCount");
+	bonesUniform = program.uniform("bones");
+	boneLengthUniform = program.uniform("boneLength");
+	fitUniform = program.uniform("fit");
+
+	mesh = meshId;
+	boneCount = std::max(1, std::min(bones, (int)MAX_BONES));
+	// Centred, the largest side 2 across
+	glm::vec3 size = boundsMax - boundsMin;
+	float largest = std::max(std::max(size.x, size.y), std::max(size.z, 1e-6f));
+	fit = glm::scale(glm::mat4(1.f), glm::vec3(2.f / largest)) * glm::translate(glm::mat4(1.f), -0.5f * (boundsMin + boundsMax));
+	return true;
+}
+
+void SkinnedMesh::create()
+{
+	const MeshRange& range = meshPool().mesh(mesh);
+	GLsizeiptr bytes = (GLsizeiptr)range.vertexCount * (GLsizeiptr)sizeof(MeshVertex);
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, nullptr, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	gpuMemory().allocate(GpuMemory::KIND_BUFFER, buffer, bytes, GpuMemory::MESH, "skinned vertices");
+
+	// The pool's attributes over the skinned buffer, which starts at the mesh's first vertex
+	glGenVertexArrays(1, &vao);
+	glState().bindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshPool().indexBuffer());
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_HALF_FLOAT, GL_FALSE, sizeof(MeshVertex), (GLvoid*)offsetof(MeshVertex, position));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(MeshVertex), (GLvoid*)offsetof(MeshVertex, uv));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(MeshVertex), (GLvoid*)offsetof(MeshVertex, normal));
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glState().bindVertexArray(0);
+}
+
+void SkinnedMesh::release()
+{
+	if (!vao) {
+		return;
+	}
+	gpuMemory().release(GpuMemory::KIND_BUFFER, buffer);
+	glDeleteBuffers(1, &buffer);
+	glDeleteVertexArrays(1, &vao);
+	buffer = 0;
+	vao = 0;
+}
+
+void SkinnedMesh::setMotion(float swing, float frequency)
+{
+	amplitude = swing;
+	speed = frequency;
+}
+
+void SkinnedMesh::update(double time)
+{
+	if (!valid()) {
+		return;
+	}
+	// Each bone turns about z on the joint at its bottom, carrying the ones above with it
+	glm::mat4 bones[MAX_BONES];
+	glm::mat4 parent(1.f);
+	float length = 2.f / (float)boneCount;
+	for (int i = 0; i < boneCount; i++) {
+		float angle = i == 0 ? 0.f : amplitude * (float)std::sin(speed * time - JOINT_PHASE * i);
+		glm::vec3 joint(0.f, -1.f + length * (float)i, 0.f);
+		parent = parent * glm::translate(glm::mat4(1.f), joint) * glm::rotate(glm::mat4(1.f), angle, glm::vec3(0.f, 0.f, 1.f)) *
+			glm::translate(glm::mat4(1.f), -joint);
+		bones[i] = parent;
+	}
+	skin(bones, boneCount);
+}
+
+void SkinnedMesh::skin(const glm::mat4* boneMatrices, int count)
+{
+	if (!valid() || count < 1) {
+		return;
+	}
+	if (!vao) {
+		create();
+	}
+	const MeshRange& range = meshPool().mesh(mesh);
+	program.use();
+	baseVertexUniform.set((int)range.baseVertex);
+	vertexCountUniform.set((int)range.vertexCount);
+	boneCountUniform.set(std::min(count, (int)MAX_BONES));
+	bonesUniform.set(boneMatrices, std::min(count, (int)MAX_BONES));
+	boneLengthUniform.set(2.f / (float)boneCount);
+	fitUniform.set(fit);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SOURCE_BINDING, meshPool().vertexBuffer());
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SKINNED_BINDING, buffer);
+	glDispatchCompute((GLuint)((range.vertexCount + GROUP_SIZE - 1) / GROUP_SIZE), 1, 1);
+	// Every draw of the frame reads the vertices as attributes
+	glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+	skins++;
+}
+
+void SkinnedMesh::drawInstanced(GLsizei instances)
+{
+	if (!vao) {
+		return;
+	}
+	const MeshRange& range = meshPool().mesh(mesh);
+	glState().polygonMode(GL_FILL);
+	glState().bindVertexArray(vao);
+	// The indices are the mesh's own, from its first vertex, which the skinned buffer starts with
+	glDrawElementsInstancedBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT, range.indexOffset(), instances, 0);
+	draws++;
+}
+
+void SkinnedMesh::report(std::ostream& out) const
+{
+	if (skins) {
+		out << "skinned mesh: " << boneCount << " bones, skinned " << skins << " times for " << draws << " draws ("
+			<< (double)draws / (double)skins << " views a skinning)" << std::endl;
+	}
+}
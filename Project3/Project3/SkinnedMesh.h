@@ -0,0 +1,94 @@
+#ifndef _SKINNED_MESH_H_
+#define _SKINNED_MESH_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <ostream>
+
+#include "ShaderProgram.h"
+
+// A mesh pool mesh deformed once a frame into a vertex buffer of its own, which every view
+// of the frame then draws as it is: the walls of both eyes, their layers, the shadow pass.
+// Skinning in the vertex shader would do it again in each of them.
+//
+// The rig is a chain of bones up the mesh's height, each turning on the one below like
+// the joints of an arm, every vertex weighted between the two bones nearest to it. A
+// compute pass (skin.comp) reads the pool's vertices, blends their bones' matrices and
+// writes the result in the pool's own layout (MeshVertex), so the draws take the skinned
+// buffer where they would take the pool's, with the pool's indices. The mesh is fitted into
+// [-1, 1] on the way, the size of the cube, whatever its model's units.
+//
+// Needs GL 4.3 compute shaders and storage buffers, like GpuCuller. The buffers are made on
+// the first skin(), after the pool is built.
+class SkinnedMesh
+{
+public:
+	enum { MAX_BONES = 16, GROUP_SIZE = 64 };
+
+	SkinnedMesh();
+	~SkinnedMesh();
+
+	SkinnedMesh(const SkinnedMesh&) = delete;
+	SkinnedMesh& operator=(const SkinnedMesh&) = delete;
+
+	static bool supported();
+	//! Rigs a pool mesh with a chain of bones from the bottom of its bounds to the top.
+	// False without compute shaders or if skin.comp does not load.
+	bool init(int meshId, const glm::vec3& boundsMin, const glm::vec3& boundsMax, int bones);
+	bool valid() const { return program.valid(); }
+	// Deletes the skinned vertex buffer and its vertex array
+	void release();
+
+	// How far each joint swings either way (radians), and how fast (radians per second), for update()
+	void setMotion(float swing, float frequency);
+	//! Poses the chain at time seconds and skins the mesh with it. Once a frame, before
+	// anything draws it.
+	void update(double time);
+	//! Skins the mesh with count bone matrices, each in the fitted mesh's space
+	void skin(const glm::mat4* boneMatrices, int count);
+	// Changes every skin(), for whatever keeps what it drew from the mesh
+	uint64_t version() const { return skins; }
+
+	//! Draws the skinned mesh instances times, with its own vertex array (the pool's
+	// attributes 0 to 2)
+	void drawInstanced(GLsizei instances);
+
+	void report(std::ostream& out) const;
+
+private:
+	void create();
+
+	ShaderProgram program;
+	Uniform baseVertexUniform;
+	Uniform vertexCountUniform;
+	Uniform boneCountUniform;
+	Uniform bonesUniform;
+	Uniform boneLengthUniform;
+	Uniform fitUniform;
+
+	GLuint vao;
+	GLuint buffer;
+
+	int mesh;
+	int boneCount;
+	glm::mat4 fit;
+	float amplitude;
+	float speed;
+
+	uint64_t skins;
+	uint64_t draws;
+};
+
+#endif
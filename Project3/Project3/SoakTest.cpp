@@ -0,0 +1,137 @@
+#include "SoakTest.h"
+#include "GpuMemory.h"
+#include "ProcessStats.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+static const char* metricNames[SoakTest::METRICS] = { "resident MB", "handles", "GL objects", "GPU MB", "frame ms" };
+
+SoakTest::SoakTest() : duration(0.0), interval(0.0), settle(0.0), start(-1.0), nextSample(0.0)
+{
+	std::fill(limits, limits + METRICS, -1.0);
+}
+
+void SoakTest::init(double minutes, double intervalSeconds, double settleMinutes, const double limitsPerHour[METRICS])
+{
+	duration = std::max(minutes, 0.0) * 60.0;
+	interval = std::max(intervalSeconds, 1.0);
+	settle = std::max(settleMinutes, 0.0) * 60.0;
+	std::copy(limitsPerHour, limitsPerHour + METRICS, limits);
+	start = -1.0;
+	samples.clear();
+	samples.reserve((size_t)(duration / interval) + 2);
+	// An interval of frames at a high refresh, more only grows it
+	intervalFrames.clear();
+	intervalFrames.reserve((size_t)(interval * 240.0));
+}
+
+const char* SoakTest::name(int metric)
+{
+	return metric >= 0 && metric < METRICS ? metricNames[metric] : "";
+}
+
+bool SoakTest::frame(double now, double frameMs)
+{
+	if (!active()) {
+		return false;
+	}
+	if (start < 0.0) {
+		start = now;
+		nextSample = now;
+	}
+	intervalFrames.push_back(frameMs);
+	if (now >= nextSample) {
+		sample(now);
+		nextSample += interval;
+	}
+	return now - start < duration;
+}
+
+void SoakTest::sample(double now)
+{
+	Sample s;
+	s.minutes = (now - start) / 60.0;
+	ProcessStats process;
+	readProcessStats(process);
+	s.values[RESIDENT_MB] = process.residentBytes / (1024.0 * 1024.0);
+	s.values[HANDLES] = (double)process.handles;
+	s.values[GL_OBJECTS] = (double)gpuMemory().objectCount();
+	s.values[GPU_MB] = gpuMemory().total() / (1024.0 * 1024.0);
+	double median = 0.0;
+	if (!intervalFrames.empty()) {
+		std::nth_element(intervalFrames.begin(), intervalFrames.begin() + intervalFrames.size() / 2, intervalFrames.end());
+		median = intervalFrames[intervalFrames.size() / 2];
+	}
+	s.values[FRAME_MS] = median;
+	intervalFrames.clear();
+	samples.push_back(s);
+}
+
+bool SoakTest::evaluate(std::ostream& out) const
+{
+	std::vector<const Sample*> settled;
+	for (const Sample& s : samples) {
+		if (s.minutes * 60.0 >= settle) {
+			settled.push_back(&s);
+		}
+	}
+	out << "soak: " << samples.size() << " samples over " << (samples.empty() ? 0.0 : samples.back().minutes) << " minutes";
+	if (settled.size() < 3) {
+		out << ", too few after the first " << settle / 60.0 << " minutes to tell any growth" << std::endl;
+		return true;
+	}
+	out << ", " << settled.size() << " after settling" << std::endl;
+	double meanHours = 0.0;
+	for (const Sample* s : settled) {
+		meanHours += s->minutes / 60.0;
+	}
+	meanHours /= settled.size();
+	bool passed = true;
+	for (int metric = 0; metric < METRICS; metric++) {
+		double meanValue = 0.0;
+		for (const Sample* s : settled) {
+			meanValue += s->values[metric];
+		}
+		meanValue /= settled.size();
+		double covariance = 0.0;
+		double variance = 0.0;
+		for (const Sample* s : settled) {
+			double dx = s->minutes / 60.0 - meanHours;
+			covariance += dx * (s->values[metric] - meanValue);
+			variance += dx * dx;
+		}
+		double slope = variance > 0.0 ? covariance / variance : 0.0;
+		bool over = limits[metric] >= 0.0 && slope > limits[metric];
+		passed = passed && !over;
+		out << "  " << std::left << std::setw(12) << metricNames[metric] << std::right << std::fixed << std::setprecision(2)
+			<< settled.front()->values[metric] << " -> " << settled.back()->values[metric] << ", " << slope << " an hour";
+		if (limits[metric] >= 0.0) {
+			out << " (limit " << limits[metric] << ")" << (over ? " GROWING" : "");
+		}
+		out << std::defaultfloat << std::endl;
+	}
+	return passed;
+}
+
+bool SoakTest::writeCsv(const char* filename) const
+{
+	std::ofstream out(filename);
+	if (!out) {
+		return false;
+	}
+	out << "minutes";
+	for (int metric = 0; metric < METRICS; metric++) {
+		out << "," << metricNames[metric];
+	}
+	out << "\n";
+	for (const Sample& s : samples) {
+		out << s.minutes;
+		for (int metric = 0; metric < METRICS; metric++) {
+			out << "," << s.values[metric];
+		}
+		out << "\n";
+	}
+	return (bool)out;
+}
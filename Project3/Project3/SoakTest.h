@@ -0,0 +1,56 @@
+#ifndef _SOAK_TEST_H_
+#define _SOAK_TEST_H_
+
+#include <ostream>
+#include <vector>
+
+// A long run that watches for slow growth, the leaks that take hours to show (benchmark
+// with soak.minutes). Every interval it samples the process's resident memory and kernel
+// handles (ProcessStats), the GL objects GpuMemory has recorded and their bytes, and the
+// median frame time of the interval. At the end a least squares line is fitted through
+// each metric's samples after the first settle minutes, when the caches have filled, and
+// the run fails if any rises faster per hour than its limit.
+class SoakTest
+{
+public:
+	enum Metric { RESIDENT_MB, HANDLES, GL_OBJECTS, GPU_MB, FRAME_MS, METRICS };
+
+	struct Sample
+	{
+		double minutes;
+		double values[METRICS];
+	};
+
+	SoakTest();
+
+	//! Starts the soak.
+	// @input limits The growth per hour each metric may have, negative for no limit
+	void init(double minutes, double intervalSeconds, double settleMinutes, const double limits[METRICS]);
+	bool active() const { return duration > 0.0; }
+
+	//! Once a frame, now in seconds on any clock that does not jump. Samples when the
+	// interval is up.
+	// @return False once the soak has run its minutes
+	bool frame(double now, double frameMs);
+
+	//! Prints each metric's first and last sample and its slope against the limit.
+	// @return False if any grew too fast
+	bool evaluate(std::ostream& out) const;
+	bool writeCsv(const char* filename) const;
+
+	static const char* name(int metric);
+
+private:
+	void sample(double now);
+
+	double duration;
+	double interval;
+	double settle;
+	double limits[METRICS];
+	double start;
+	double nextSample;
+	std::vector<double> intervalFrames;
+	std::vector<Sample> samples;
+};
+
+#endif
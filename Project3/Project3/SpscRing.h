@@ -0,0 +1,58 @@
+#ifndef _SPSC_RING_H_
+#define _SPSC_RING_H_
+
+#include <atomic>
+#include <cstddef>
+
+// A fixed size ring handing values from one thread to one other without a lock. Only the
+// producer moves tail and only the consumer moves head; each reads the other's index with
+// acquire, so the value written before an index moved is there when it is seen.
+// CAPACITY is a power of two. A push into a full ring fails instead of waiting.
+template <typename T, size_t CAPACITY>
+class SpscRing
+{
+	static_assert(CAPACITY && (CAPACITY & (CAPACITY - 1)) == 0, "the ring's capacity has to be a power of two");
+
+public:
+	SpscRing() : head(0), tail(0) {}
+
+	SpscRing(const SpscRing&) = delete;
+	SpscRing& operator=(const SpscRing&) = delete;
+
+	// Producer only
+	bool push(const T& value)
+	{
+		size_t at = tail.load(std::memory_order_relaxed);
+		if (at - head.load(std::memory_order_acquire) == CAPACITY) {
+			return false;
+		}
+		items[at & (CAPACITY - 1)] = value;
+		tail.store(at + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer only, returns false when the ring is empty
+	bool pop(T& out)
+	{
+		size_t at = head.load(std::memory_order_relaxed);
+		if (at == tail.load(std::memory_order_acquire)) {
+			return false;
+		}
+		out = items[at & (CAPACITY - 1)];
+		head.store(at + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool empty() const { return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire); }
+	static size_t capacity() { return CAPACITY; }
+
+private:
+	// The indices on lines of their own, so the two threads do not share one
+	std::atomic<size_t> head;
+	char headPad[64];
+	std::atomic<size_t> tail;
+	char tailPad[64];
+	T items[CAPACITY];
+};
+
+#endif
@@ -0,0 +1,115 @@
+#include "StartupPrefetch.h"
+#include "AssetArchive.h"
+#include "StartupProfiler.h"
+#include "TextureCache.h"
+
+#include <fstream>
+#include <sstream>
+
+StartupPrefetch::StartupPrefetch() : started(false)
+{
+}
+
+// The jobs are done by the time statics go, jobs().stop() runs what is queued
+StartupPrefetch::~StartupPrefetch()
+{
+}
+
+void StartupPrefetch::start(const std::vector<std::string>& images, const std::vector<std::string>& sourceFiles)
+{
+	finish();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		started = true;
+		// The archive's are views already
+		for (const std::string& file : sourceFiles) {
+			const unsigned char* data;
+			size_t size;
+			if (!assetArchive().find(file.c_str(), data, size)) {
+				sources[file];
+			}
+		}
+	}
+	// The entries stay where they are until finish(), the jobs fill them in place
+	for (auto& entry : sources) {
+		const std::string* path = &entry.first;
+		Source* source = &entry.second;
+		jobs().submit([path, source] {
+			StartupScope scope("prefetch", *path);
+			std::ifstream stream(path->c_str(), std::ios::in);
+			if (!stream.is_open()) {
+				return;
+			}
+			std::ostringstream contents;
+			contents << stream.rdbuf();
+			source->text = contents.str();
+			source->read = true;
+			scope.addBytes(source->text.size());
+		}, &sourceJobs);
+	}
+	for (const std::string& file : images) {
+		jobs().submit([this, file] { map(file); }, &imageJobs);
+	}
+}
+
+// The file mapImage would map first, paged in the way AssetLoader does. With an archive
+// that pages in its part of the archive.
+void StartupPrefetch::map(const std::string& filename)
+{
+	StartupScope scope("prefetch", filename);
+	MappedFile file;
+	if (!file.open(textureCachePath(filename).c_str()) && !file.open(filename.c_str()) &&
+		!file.open(qoiSourcePath(filename).c_str())) {
+		return;
+	}
+	const volatile unsigned char* bytes = file.data();
+	unsigned int sum = 0;
+	for (size_t offset = 0; offset < file.size(); offset += 4096) {
+		sum += bytes[offset];
+	}
+	(void)sum;
+	scope.addBytes(file.size());
+	std::lock_guard<std::mutex> lock(mutex);
+	mapped.push_back(std::move(file));
+}
+
+bool StartupPrefetch::source(const std::string& path, std::string& out)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!started || sources.find(path) == sources.end()) {
+			return false;
+		}
+	}
+	// Not under the lock, the waiting thread may run the image jobs meanwhile
+	jobs().wait(sourceJobs);
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = sources.find(path);
+	if (it == sources.end() || !it->second.read) {
+		return false;
+	}
+	out = it->second.text;
+	return true;
+}
+
+void StartupPrefetch::finish()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!started) {
+			return;
+		}
+	}
+	jobs().wait(sourceJobs);
+	jobs().wait(imageJobs);
+	std::lock_guard<std::mutex> lock(mutex);
+	started = false;
+	sources.clear();
+	mapped.clear();
+}
+
+StartupPrefetch& startupPrefetch()
+{
+	static StartupPrefetch instance;
+	return instance;
+}
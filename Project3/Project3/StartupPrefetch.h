@@ -0,0 +1,58 @@
+#ifndef _STARTUP_PREFETCH_H_
+#define _STARTUP_PREFETCH_H_
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Image.h"
+#include "JobSystem.h"
+
+// The file reads of startup, started at the top of main so they run on the workers while
+// the SDK, the window and the context are still being set up instead of after them. Image
+// files (their texture caches where there are any, as mapImage would pick) are mapped and
+// paged in and held mapped, so that when the scene's AssetLoader maps them again the pages
+// are already in memory. Shader sources are read whole and handed to readShaderFile.
+//
+// Nothing here needs the GL context. finish() drops it all once the first frame is out,
+// later reads (shader reloads, streamed textures) go to the files as before.
+class StartupPrefetch
+{
+public:
+	StartupPrefetch();
+	~StartupPrefetch();
+
+	StartupPrefetch(const StartupPrefetch&) = delete;
+	StartupPrefetch& operator=(const StartupPrefetch&) = delete;
+
+	// A job per file on jobs()
+	void start(const std::vector<std::string>& images, const std::vector<std::string>& sources);
+	//! A source read ahead, waiting for the source reads if they are still running.
+	// @return False for a file that was not read ahead or could not be, which the caller
+	// then reads itself
+	bool source(const std::string& path, std::string& out);
+	// Waits for the reads and lets go of everything
+	void finish();
+
+private:
+	struct Source
+	{
+		std::string text;
+		bool read = false;
+	};
+
+	void map(const std::string& filename);
+
+	JobCounter imageJobs;
+	JobCounter sourceJobs;
+	std::mutex mutex;
+	std::vector<MappedFile> mapped;
+	// Filled in place by the jobs, keys are only added by start()
+	std::unordered_map<std::string, Source> sources;
+	bool started;
+};
+
+StartupPrefetch& startupPrefetch();
+
+#endif
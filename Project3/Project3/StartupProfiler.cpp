@@ -0,0 +1,147 @@
+#include "StartupProfiler.h"
+#include "Log.h"
+
+#include <Windows.h>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+
+StartupTimeline::StartupTimeline() : mainThread(std::this_thread::get_id()), finished(false)
+{
+	LARGE_INTEGER counter, frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	origin = counter.QuadPart;
+	secondsPerTick = 1.0 / (double)frequency.QuadPart;
+}
+
+double StartupTimeline::now() const
+{
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return (double)(counter.QuadPart - origin) * secondsPerTick;
+}
+
+void StartupTimeline::record(const std::string& phase, const std::string& detail, double start, double duration, uint64_t bytes)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (finished) {
+		return;
+	}
+	Entry entry = { phase, detail, start, duration, bytes, std::this_thread::get_id() == mainThread };
+	entries.push_back(entry);
+}
+
+void StartupTimeline::report(std::ostream& out) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	std::vector<Entry> sorted = entries;
+	std::stable_sort(sorted.begin(), sorted.end(), [](const Entry& a, const Entry& b) { return a.start < b.start; });
+
+	char line[512];
+	out << "startup timeline" << std::endl;
+	snprintf(line, sizeof(line), "%9s %9s %9s  %-6s %-16s %s", "start ms", "time ms", "KB", "thread", "phase", "detail");
+	out << line << std::endl;
+	for (const Entry& e : sorted) {
+		snprintf(line, sizeof(line), "%9.1f %9.1f %9llu  %-6s %-16s %s", e.start * 1000.0, e.duration * 1000.0,
+			(unsigned long long)(e.bytes / 1024), e.mainThread ? "main" : "worker", e.phase.c_str(), e.detail.c_str());
+		out << line << std::endl;
+	}
+
+	// Worker entries overlap each other, so their totals can exceed the wall clock time
+	struct Total { double time; uint64_t bytes; int count; };
+	std::map<std::string, Total> totals;
+	for (const Entry& e : entries) {
+		Total& t = totals[e.phase];
+		t.time += e.duration;
+		t.bytes += e.bytes;
+		t.count++;
+	}
+	std::vector<std::pair<std::string, Total>> worst(totals.begin(), totals.end());
+	std::sort(worst.begin(), worst.end(), [](const std::pair<std::string, Total>& a, const std::pair<std::string, Total>& b) {
+		return a.second.time > b.second.time;
+	});
+
+	out << "startup totals by phase" << std::endl;
+	for (const auto& p : worst) {
+		snprintf(line, sizeof(line), "%-16s %9.1f ms %9llu KB %5d x", p.first.c_str(), p.second.time * 1000.0,
+			(unsigned long long)(p.second.bytes / 1024), p.second.count);
+		out << line << std::endl;
+	}
+}
+
+static std::string jsonEscape(const std::string& s)
+{
+	std::string out;
+	for (char c : s) {
+		if (c == '"' || c == '\\') {
+			out += '\\';
+			out += c;
+		}
+		else if ((unsigned char)c < 0x20) {
+			char escape[8];
+			snprintf(escape, sizeof(escape), "\\u%04x", c);
+			out += escape;
+		}
+		else {
+			out += c;
+		}
+	}
+	return out;
+}
+
+bool StartupTimeline::writeJson(const char* filename) const
+{
+	std::ofstream file(filename);
+	if (!file.is_open()) {
+		std::cerr << "could not write startup timeline to " << filename << std::endl;
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	file << "[\n";
+	for (size_t i = 0; i < entries.size(); i++) {
+		const Entry& e = entries[i];
+		file << "  { \"phase\": \"" << jsonEscape(e.phase) << "\", \"detail\": \"" << jsonEscape(e.detail)
+			<< "\", \"start_ms\": " << e.start * 1000.0 << ", \"duration_ms\": " << e.duration * 1000.0
+			<< ", \"bytes\": " << e.bytes << ", \"thread\": \"" << (e.mainThread ? "main" : "worker") << "\" }"
+			<< (i + 1 < entries.size() ? ",\n" : "\n");
+	}
+	file << "]\n";
+	return true;
+}
+
+void StartupTimeline::finish(const char* jsonFile)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (finished) {
+			return;
+		}
+		finished = true;
+	}
+	report(logStream(LOG_INFO));
+	if (jsonFile && *jsonFile) {
+		writeJson(jsonFile);
+	}
+}
+
+StartupTimeline& startupTimeline()
+{
+	static StartupTimeline instance;
+	return instance;
+}
+
+StartupScope::StartupScope(const char* phase, const std::string& detail)
+	: phase(phase), detail(detail), start(startupTimeline().now()), bytes(0)
+{
+}
+
+StartupScope::~StartupScope()
+{
+	StartupTimeline& timeline = startupTimeline();
+	timeline.record(phase, detail, start, timeline.now() - start, bytes);
+}
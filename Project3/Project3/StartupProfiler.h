@@ -0,0 +1,74 @@
+#ifndef _STARTUP_PROFILER_H_
+#define _STARTUP_PROFILER_H_
+
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Wall clock timeline of everything that happens before the first frame is shown: SDK
+// and window setup, shader builds, and the load and upload of each asset. Entries can
+// be recorded from any thread. finish() prints the table once and stops recording, so
+// assets streamed in later do not show up.
+class StartupTimeline
+{
+public:
+	struct Entry
+	{
+		std::string phase;
+		std::string detail;
+		double start;
+		double duration;
+		uint64_t bytes;
+		bool mainThread;
+	};
+
+	StartupTimeline();
+
+	// Seconds since the timeline was created
+	double now() const;
+
+	void record(const std::string& phase, const std::string& detail, double start, double duration, uint64_t bytes);
+
+	// Prints every entry in start order, then the total per phase, worst first
+	void report(std::ostream& out) const;
+	bool writeJson(const char* filename) const;
+
+	// Reports to the console and, if jsonFile is set, to that file. Only the first call
+	// does anything.
+	void finish(const char* jsonFile = nullptr);
+
+private:
+	std::vector<Entry> entries;
+	mutable std::mutex mutex;
+	std::thread::id mainThread;
+	int64_t origin;
+	double secondsPerTick;
+	bool finished;
+};
+
+StartupTimeline& startupTimeline();
+
+// Records the time from construction to destruction as one timeline entry
+class StartupScope
+{
+public:
+	explicit StartupScope(const char* phase, const std::string& detail = std::string());
+	~StartupScope();
+
+	StartupScope(const StartupScope&) = delete;
+	StartupScope& operator=(const StartupScope&) = delete;
+
+	void setDetail(const std::string& d) { detail = d; }
+	void addBytes(uint64_t n) { bytes += n; }
+
+private:
+	const char* phase;
+	std::string detail;
+	double start;
+	uint64_t bytes;
+};
+
+#endif
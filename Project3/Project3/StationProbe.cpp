@@ -0,0 +1,335 @@
+#include "StationProbe.h"
+#include "GLHandle.h"
+#include "GLState.h"
+#include "ShaderProgram.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+// The fill test's target, the size of a wall at walls.resolution 2048
+static const GLsizei FILL_SIZE = 2048;
+static const int FILL_DRAWS = 32;
+// Each test is run this many times and the best taken, the others had something in the way
+static const int PROBE_RUNS = 3;
+static const GLsizei UPLOAD_SIZE = 2048;
+static const int UPLOAD_COUNT = 16;
+
+// The fill rate the defaults (walls.resolution 1024, no MSAA) are set for
+static const double REFERENCE_FILL_GPIXELS = 10.0;
+// What the GPU may take of a 90 Hz frame before the settings are too much for it
+static const double TARGET_GPU_MS = 0.75 * 1000.0 / 90.0;
+// The slice of a frame the uploads may take
+static const double UPLOAD_SLICE_S = 0.0015;
+
+static double seconds()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+StationProbe::StationProbe()
+{
+	measurements.fillGpixels = 0.0;
+	measurements.uploadMBs = 0.0;
+	measurements.diskReadMBs = 0.0;
+	measurements.diskWriteMBs = 0.0;
+	measurements.sceneGpuMs = 0.0;
+	measurements.sceneFrameMs = 0.0;
+	measurements.sceneWallResolution = 0;
+	measurements.cores = std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+bool StationProbe::measureFill()
+{
+	const GLubyte* renderer = glGetString(GL_RENDERER);
+	measurements.renderer = renderer ? (const char*)renderer : "";
+	ShaderProgram program;
+	if (!program.load("stationFill.vert", "stationFill.frag")) {
+		return false;
+	}
+	GLTexture target;
+	target.create();
+	glState().bindTexture(0, GL_TEXTURE_2D, target);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, FILL_SIZE, FILL_SIZE, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	GLFramebuffer fbo;
+	fbo.create();
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target, 0);
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	GLVertexArray vao;
+	vao.create();
+	GLuint query = 0;
+	glGenQueries(1, &query);
+
+	double bestNs = 0.0;
+	if (complete) {
+		glViewport(0, 0, FILL_SIZE, FILL_SIZE);
+		glDisable(GL_DEPTH_TEST);
+		glDisable(GL_BLEND);
+		program.use();
+		Uniform tint = program.uniform("tint");
+		glState().bindVertexArray(vao);
+		// Once untimed, for whatever the driver puts off to the first draw
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		glFinish();
+		for (int run = 0; run < PROBE_RUNS; run++) {
+			glBeginQuery(GL_TIME_ELAPSED, query);
+			for (int i = 0; i < FILL_DRAWS; i++) {
+				tint.set(glm::vec4((float)(i + 1) / (float)FILL_DRAWS));
+				glDrawArrays(GL_TRIANGLES, 0, 3);
+			}
+			glEndQuery(GL_TIME_ELAPSED);
+			GLuint64 ns = 0;
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+			if (ns && (bestNs == 0.0 || (double)ns < bestNs)) {
+				bestNs = (double)ns;
+			}
+		}
+	}
+	glDeleteQueries(1, &query);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glState().bindVertexArray(0);
+	glState().useProgram(0);
+	if (bestNs <= 0.0) {
+		std::cerr << "station: the fill test did not run" << std::endl;
+		return false;
+	}
+	measurements.fillGpixels = (double)FILL_SIZE * (double)FILL_SIZE * FILL_DRAWS / bestNs;
+	return true;
+}
+
+bool StationProbe::measureUpload()
+{
+	std::vector<unsigned char> pixels((size_t)UPLOAD_SIZE * UPLOAD_SIZE * 4);
+	for (size_t i = 0; i < pixels.size(); i++) {
+		pixels[i] = (unsigned char)(i * 31);
+	}
+	GLTexture texture;
+	texture.create();
+	glState().bindTexture(0, GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, UPLOAD_SIZE, UPLOAD_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, UPLOAD_SIZE, UPLOAD_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+	glFinish();
+
+	double best = 0.0;
+	for (int run = 0; run < PROBE_RUNS; run++) {
+		double start = seconds();
+		for (int i = 0; i < UPLOAD_COUNT; i++) {
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, UPLOAD_SIZE, UPLOAD_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+		}
+		glFinish();
+		double elapsed = seconds() - start;
+		if (elapsed > 0.0 && (best == 0.0 || elapsed < best)) {
+			best = elapsed;
+		}
+	}
+	glState().bindTexture(0, GL_TEXTURE_2D, 0);
+	if (best <= 0.0) {
+		return false;
+	}
+	measurements.uploadMBs = (double)pixels.size() * UPLOAD_COUNT / best / (1024.0 * 1024.0);
+	return true;
+}
+
+bool StationProbe::measureDisk(const std::string& directory, int megabytes)
+{
+	const size_t CHUNK = 4 * 1024 * 1024;
+	size_t chunks = (size_t)std::max(megabytes / 4, 1);
+	std::string path = directory + "/station_probe.tmp";
+#ifdef _WIN32
+	// Sector aligned, for the unbuffered reads
+	unsigned char* buffer = (unsigned char*)VirtualAlloc(nullptr, CHUNK, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	if (!buffer) {
+		return false;
+	}
+	for (size_t i = 0; i < CHUNK; i++) {
+		buffer[i] = (unsigned char)(i * 131);
+	}
+	// Written through to the disk, then read without the cache, or both would measure memory
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+		FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_WRITE_THROUGH | FILE_FLAG_NO_BUFFERING, nullptr);
+	bool ok = file != INVALID_HANDLE_VALUE;
+	double start = seconds();
+	for (size_t i = 0; ok && i < chunks; i++) {
+		DWORD written = 0;
+		ok = WriteFile(file, buffer, (DWORD)CHUNK, &written, nullptr) && written == CHUNK;
+	}
+	if (file != INVALID_HANDLE_VALUE) {
+		FlushFileBuffers(file);
+		CloseHandle(file);
+	}
+	double writeSeconds = seconds() - start;
+	if (ok) {
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+			FILE_FLAG_NO_BUFFERING | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		ok = file != INVALID_HANDLE_VALUE;
+	}
+	start = seconds();
+	for (size_t i = 0; ok && i < chunks; i++) {
+		DWORD read = 0;
+		ok = ReadFile(file, buffer, (DWORD)CHUNK, &read, nullptr) && read == CHUNK;
+	}
+	double readSeconds = seconds() - start;
+	if (file != INVALID_HANDLE_VALUE) {
+		CloseHandle(file);
+	}
+	DeleteFileA(path.c_str());
+	VirtualFree(buffer, 0, MEM_RELEASE);
+#else
+	std::vector<unsigned char> buffer(CHUNK);
+	for (size_t i = 0; i < CHUNK; i++) {
+		buffer[i] = (unsigned char)(i * 131);
+	}
+	// Synced to the disk and dropped from the cache before it is read back
+	int file = open(path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+	bool ok = file >= 0;
+	double start = seconds();
+	for (size_t i = 0; ok && i < chunks; i++) {
+		ok = ::write(file, buffer.data(), CHUNK) == (ssize_t)CHUNK;
+	}
+	if (file >= 0) {
+		fsync(file);
+		posix_fadvise(file, 0, 0, POSIX_FADV_DONTNEED);
+		close(file);
+	}
+	double writeSeconds = seconds() - start;
+	file = ok ? open(path.c_str(), O_RDONLY) : -1;
+	ok = file >= 0;
+	start = seconds();
+	for (size_t i = 0; ok && i < chunks; i++) {
+		ok = ::read(file, buffer.data(), CHUNK) == (ssize_t)CHUNK;
+	}
+	double readSeconds = seconds() - start;
+	if (file >= 0) {
+		close(file);
+	}
+	std::remove(path.c_str());
+#endif
+	if (!ok || writeSeconds <= 0.0 || readSeconds <= 0.0) {
+		std::cerr << "station: could not time the disk with " << path << std::endl;
+		return false;
+	}
+	double bytes = (double)chunks * (double)CHUNK / (1024.0 * 1024.0);
+	measurements.diskWriteMBs = bytes / writeSeconds;
+	measurements.diskReadMBs = bytes / readSeconds;
+	return true;
+}
+
+void StationProbe::setSceneTimes(double gpuMs, double frameMs, int wallResolution)
+{
+	measurements.sceneGpuMs = gpuMs;
+	measurements.sceneFrameMs = frameMs;
+	measurements.sceneWallResolution = wallResolution;
+}
+
+double StationProbe::gpuHeadroom() const
+{
+	// The scene's cost goes with the wall pixels, so its headroom at its resolution is that
+	// much more at the default 1024
+	if (measurements.sceneGpuMs > 0.0 && measurements.sceneWallResolution > 0) {
+		double pixels = (double)measurements.sceneWallResolution / 1024.0;
+		return TARGET_GPU_MS / measurements.sceneGpuMs * pixels * pixels;
+	}
+	if (measurements.fillGpixels > 0.0) {
+		return measurements.fillGpixels / REFERENCE_FILL_GPIXELS;
+	}
+	return 1.0;
+}
+
+std::vector<std::pair<std::string, std::string>> StationProbe::settings() const
+{
+	std::vector<std::pair<std::string, std::string>> out;
+	double headroom = gpuHeadroom();
+
+	// Multisampling first, it is worth more than the pixels it costs, then the resolution
+	// with what is left
+	int samples = headroom >= 3.0 ? 4 : headroom >= 1.6 ? 2 : 1;
+	double pixelHeadroom = headroom / (samples == 4 ? 2.0 : samples == 2 ? 1.4 : 1.0);
+	int resolution = (int)std::lround(1024.0 * std::sqrt(pixelHeadroom) / 128.0) * 128;
+	resolution = std::min(std::max(resolution, 512), 2048);
+	out.emplace_back("walls.resolution", std::to_string(resolution));
+	out.emplace_back("walls.msaa", std::to_string(samples));
+	out.emplace_back("eye.msaa", std::to_string(samples));
+
+	bool slow = headroom < 1.3;
+	out.emplace_back("eyes.dynamic", slow ? "1" : "0");
+	out.emplace_back("eyes.min_scale", headroom < 0.8 ? "0.5" : "0.6");
+
+	// A spinning disk streams the levels too slowly for full, NVMe does not notice them
+	const char* tiers[] = { "full", "high", "medium", "low" };
+	double disk = measurements.diskReadMBs;
+	int tier = disk <= 0.0 || disk >= 400.0 ? 0 : disk >= 150.0 ? 1 : disk >= 60.0 ? 2 : 3;
+	if (headroom < 0.75) {
+		tier = std::min(tier + 1, 3);
+	}
+	out.emplace_back("textures.quality", tiers[tier]);
+
+	if (measurements.uploadMBs > 0.0) {
+		int budgetKb = (int)(measurements.uploadMBs * 1024.0 * UPLOAD_SLICE_S);
+		out.emplace_back("upload.budget_kb", std::to_string(std::min(std::max(budgetKb, 1024), 65536)));
+	}
+
+	// The render and upload threads have a core each where there are enough of them
+	unsigned int cores = measurements.cores;
+	out.emplace_back("jobs.threads", std::to_string(cores > 4 ? cores - 2 : std::max(cores, 2u)));
+	out.emplace_back("upload.thread", cores >= 4 ? "1" : "0");
+	return out;
+}
+
+bool StationProbe::write(const char* filename) const
+{
+	std::ofstream out(filename);
+	if (!out) {
+		return false;
+	}
+	std::time_t now = std::time(nullptr);
+	char date[32];
+	std::strftime(date, sizeof(date), "%Y-%m-%d %H:%M", std::localtime(&now));
+	out << "# Station profile, written by the calibration on " << date << ". Loaded over project3.cfg;" << std::endl;
+	out << "# delete it or run with --station.calibrate=now to measure again." << std::endl;
+	out << "#" << std::endl;
+	out << "# gpu: " << measurements.renderer << std::endl;
+	out << "# fill: " << measurements.fillGpixels << " Gpixel/s" << std::endl;
+	out << "# upload: " << measurements.uploadMBs << " MB/s" << std::endl;
+	out << "# disk: " << measurements.diskReadMBs << " MB/s read, " << measurements.diskWriteMBs << " MB/s write" << std::endl;
+	if (measurements.sceneGpuMs > 0.0) {
+		out << "# scene: " << measurements.sceneGpuMs << " ms GPU, " << measurements.sceneFrameMs << " ms frame at walls.resolution "
+			<< measurements.sceneWallResolution << std::endl;
+	}
+	out << "# cores: " << measurements.cores << std::endl;
+	out << "# headroom: " << gpuHeadroom() << " of the defaults" << std::endl;
+	for (const auto& setting : settings()) {
+		out << setting.first << " = " << setting.second << std::endl;
+	}
+	return (bool)out;
+}
+
+void StationProbe::report(std::ostream& out) const
+{
+	out << "station: " << measurements.renderer << ", fill " << measurements.fillGpixels << " Gpixel/s, upload "
+		<< measurements.uploadMBs << " MB/s, disk " << measurements.diskReadMBs << " MB/s, " << measurements.cores << " cores";
+	if (measurements.sceneGpuMs > 0.0) {
+		out << ", scene " << measurements.sceneGpuMs << " ms GPU";
+	}
+	out << std::endl;
+	out << "  ";
+	for (const auto& setting : settings()) {
+		out << setting.first << "=" << setting.second << " ";
+	}
+	out << std::endl;
+}
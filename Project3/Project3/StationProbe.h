@@ -0,0 +1,72 @@
+#ifndef _STATION_PROBE_H_
+#define _STATION_PROBE_H_
+
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Measures what a station can do and picks the settings for it. The stations are not alike,
+// an old GPU with a spinning disk next to a new one with NVMe, and one project3.cfg cannot
+// suit both. A calibration run (station.calibrate) measures:
+//
+//   - fill rate: full screen triangles into a wall-sized RGBA16F target, timed on the GPU
+//   - upload bandwidth: wall-sized RGBA8 texture uploads from client memory
+//   - disk throughput: a scratch file written and read back around the OS's cache
+//   - in the benchmark build, the GPU and frame time of the scene as configured, rendered
+//     headless (setSceneTimes)
+//
+// and writes the settings they call for to the station profile, a config file that later
+// startups load over project3.cfg (the command line still wins):
+//
+//   walls.resolution, walls.msaa, eye.msaa   from the GPU's headroom against the defaults
+//   eyes.dynamic, eyes.min_scale             the eye buffer gives way sooner on a slow GPU
+//   textures.quality                         from the disk, a tier lower on a slow GPU
+//   upload.budget_kb                         what the uploads do in a slice of a frame
+//   jobs.threads, upload.thread              from the cores
+//
+// The GPU's headroom is the scene's GPU time against the budget where it was measured, the
+// fill rate against the one the defaults are set for otherwise.
+class StationProbe
+{
+public:
+	struct Measurements
+	{
+		// Gigapixels a second, 0 where not measured
+		double fillGpixels;
+		// Megabytes a second
+		double uploadMBs;
+		double diskReadMBs;
+		double diskWriteMBs;
+		// The scene's median GPU and frame times, and the walls.resolution they were at
+		double sceneGpuMs;
+		double sceneFrameMs;
+		int sceneWallResolution;
+		unsigned int cores;
+		std::string renderer;
+	};
+
+	StationProbe();
+
+	//! Times the fill test (stationFill.vert and .frag). Needs a current context.
+	bool measureFill();
+	//! Times texture uploads. Needs a current context.
+	bool measureUpload();
+	//! Writes megabytes of a scratch file in directory, reads it back and deletes it
+	bool measureDisk(const std::string& directory, int megabytes);
+	void setSceneTimes(double gpuMs, double frameMs, int wallResolution);
+
+	const Measurements& measured() const { return measurements; }
+	// The GPU against the defaults, 1 where they are about right
+	double gpuHeadroom() const;
+	//! The settings for this station, as config keys and values
+	std::vector<std::pair<std::string, std::string>> settings() const;
+	//! Writes settings() as a config file, with the measurements in its comments
+	bool write(const char* filename) const;
+	void report(std::ostream& out) const;
+
+private:
+	Measurements measurements;
+};
+
+#endif
@@ -0,0 +1,262 @@
+#include "StressScene.h"
+#include "Config.h"
+#include "Log.h"
+#include "TextureAtlas.h"
+
+#include <Windows.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+static const char* axisNames[STRESS_AXES] = { "props", "textures", "walls", "viewers" };
+static const char* axisUnitNames[STRESS_AXES] = { "props", "textures", "wall", "viewer" };
+// What the slopes are given per, so they are not all fractions of a microsecond
+static const int axisUnits[STRESS_AXES] = { 1000, 100, 1, 1 };
+
+static const int STRESS_IMAGE_SIZE = 64;
+static const uint32_t STRESS_PAGE_SIZE = 1024;
+static const float STRESS_WALL_SIZE = 2.4f;
+
+const char* stressAxisName(int axis)
+{
+	return axisNames[axis];
+}
+
+int stressAxis(const StressSpec& spec, int axis)
+{
+	const int values[STRESS_AXES] = { spec.props, spec.textures, spec.walls, spec.viewers };
+	return values[axis];
+}
+
+bool stressSpecFromConfig(StressSpec& spec)
+{
+	spec.props = std::max(config().getInt("stress.props", 0), 0);
+	spec.textures = std::max(config().getInt("stress.textures", 0), 0);
+	spec.walls = std::min(std::max(config().getInt("stress.walls", 0), 0), (int)CaveLayout::MAX_WALLS);
+	spec.viewers = std::max(config().getInt("stress.viewers", 0), 0);
+	return spec.props || spec.textures || spec.walls || spec.viewers;
+}
+
+void stressWalls(int count, std::vector<CaveWall>& walls)
+{
+	walls.clear();
+	int sides = std::max(count, 4);
+	float step = 6.28318531f / (float)sides;
+	// From the middle to a wall, for walls of that width
+	float apothem = STRESS_WALL_SIZE * 0.5f / tanf(step * 0.5f);
+	float half = STRESS_WALL_SIZE * 0.5f;
+	for (int i = 0; i < count; i++) {
+		// 0, then one step to the right, one to the left, two to the right...
+		float angle = step * (float)((i + 1) / 2) * (i % 2 ? 1.f : -1.f);
+		glm::vec3 forward(sinf(angle), 0.f, -cosf(angle));
+		glm::vec3 right(cosf(angle), 0.f, sinf(angle));
+		glm::vec3 middle = forward * apothem;
+		CaveWall wall;
+		wall.name = "stress" + std::to_string(i);
+		wall.corners[0] = middle - right * half - glm::vec3(0.f, half, 0.f);
+		wall.corners[1] = middle + right * half - glm::vec3(0.f, half, 0.f);
+		wall.corners[2] = middle + right * half + glm::vec3(0.f, half, 0.f);
+		wall.corners[3] = middle - right * half + glm::vec3(0.f, half, 0.f);
+		wall.resolution = 0;
+		walls.push_back(wall);
+	}
+}
+
+void stressImages(int count, std::vector<unsigned char>& rgb)
+{
+	const size_t imageBytes = (size_t)STRESS_IMAGE_SIZE * STRESS_IMAGE_SIZE * 3;
+	rgb.resize(imageBytes * (size_t)count);
+	for (int i = 0; i < count; i++) {
+		// Spread round the hue circle by the golden ratio, so neighbours differ
+		float hue = fmodf((float)i * 0.618034f, 1.f) * 6.f;
+		float rising = 1.f - fabsf(fmodf(hue, 2.f) - 1.f);
+		const float sectors[6][3] = { { 1.f, rising, 0.f }, { rising, 1.f, 0.f }, { 0.f, 1.f, rising },
+			{ 0.f, rising, 1.f }, { rising, 0.f, 1.f }, { 1.f, 0.f, rising } };
+		const float* colour = sectors[std::min((int)hue, 5)];
+		unsigned char* out = rgb.data() + imageBytes * i;
+		// A checker whose squares shrink with the image's number, so each mips differently
+		int square = 4 << (i % 4);
+		for (int y = 0; y < STRESS_IMAGE_SIZE; y++) {
+			for (int x = 0; x < STRESS_IMAGE_SIZE; x++) {
+				float shade = ((x / square) + (y / square)) % 2 ? 1.f : 0.45f;
+				for (int c = 0; c < 3; c++) {
+					*out++ = (unsigned char)(255.f * shade * (0.2f + 0.8f * colour[c]));
+				}
+			}
+		}
+	}
+}
+
+// The temporary directory, with its separator
+static std::string temporaryDirectory()
+{
+	char path[MAX_PATH];
+	DWORD length = GetTempPathA(MAX_PATH, path);
+	return length && length < MAX_PATH ? std::string(path, length) : std::string();
+}
+
+static bool writeStressLayout(const char* filename, int count)
+{
+	std::vector<CaveWall> walls;
+	stressWalls(count, walls);
+	std::ofstream file(filename);
+	if (!file.is_open()) {
+		return false;
+	}
+	file << "# " << count << " walls of the stress scene\n";
+	char line[256];
+	for (const CaveWall& wall : walls) {
+		const glm::vec3* c = wall.corners;
+		snprintf(line, sizeof(line), "%s  %.6f %.6f %.6f  %.6f %.6f %.6f  %.6f %.6f %.6f  %.6f %.6f %.6f\n", wall.name.c_str(),
+			c[0].x, c[0].y, c[0].z, c[1].x, c[1].y, c[1].z, c[2].x, c[2].y, c[2].z, c[3].x, c[3].y, c[3].z);
+		file << line;
+	}
+	return file.good();
+}
+
+static bool writeStressAtlas(const char* filename, int count)
+{
+	std::vector<unsigned char> rgb;
+	stressImages(count, rgb);
+	std::vector<AtlasImage> images(count);
+	for (int i = 0; i < count; i++) {
+		images[i].name = "stress" + std::to_string(i);
+		images[i].rgb = rgb.data() + (size_t)STRESS_IMAGE_SIZE * STRESS_IMAGE_SIZE * 3 * i;
+		images[i].width = STRESS_IMAGE_SIZE;
+		images[i].height = STRESS_IMAGE_SIZE;
+	}
+	return writeTextureAtlas(filename, images, STRESS_PAGE_SIZE);
+}
+
+bool applyStressScene(const StressSpec& spec)
+{
+	std::string directory = temporaryDirectory();
+	if (spec.props) {
+		config().set("props.count", std::to_string(spec.props));
+	}
+	if (spec.textures) {
+		std::string atlas = directory + "project3_stress_" + std::to_string(spec.textures) + ".p3ta";
+		if (!writeStressAtlas(atlas.c_str(), spec.textures)) {
+			std::cerr << "could not write the stress scene's atlas " << atlas << std::endl;
+			return false;
+		}
+		config().set("props.atlas", atlas);
+	}
+	if (spec.walls) {
+		std::string layout = directory + "project3_stress_" + std::to_string(spec.walls) + ".cave";
+		if (!writeStressLayout(layout.c_str(), spec.walls)) {
+			std::cerr << "could not write the stress scene's layout " << layout << std::endl;
+			return false;
+		}
+		config().set("cave.layout", layout);
+	}
+	if (spec.viewers) {
+		std::string viewers;
+		for (int i = 1; i < spec.viewers; i++) {
+			viewers += i % 2 ? "right_hand," : "left_hand,";
+		}
+		config().set("cave.viewers", viewers);
+	}
+	std::ostream& out = logStream(LOG_INFO);
+	out << "stress scene:";
+	for (int axis = 0; axis < STRESS_AXES; axis++) {
+		out << " " << stressAxis(spec, axis) << " " << axisNames[axis];
+	}
+	out << std::endl;
+	return true;
+}
+
+bool appendStressResult(const char* filename, const StressResult& result)
+{
+	bool exists = std::ifstream(filename).is_open();
+	std::ofstream file(filename, std::ios::app);
+	if (!file.is_open()) {
+		std::cerr << "could not write the stress results to " << filename << std::endl;
+		return false;
+	}
+	if (!exists) {
+		file << "# props,textures,walls,viewers,cpu_p50,cpu_p95,gpu_p50,gpu_p95,frame_p50,frame_p95\n";
+	}
+	const StressSpec& s = result.spec;
+	char line[256];
+	snprintf(line, sizeof(line), "%d,%d,%d,%d,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n", s.props, s.textures, s.walls, s.viewers,
+		result.cpu.p50, result.cpu.p95, result.gpu.p50, result.gpu.p95, result.frame.p50, result.frame.p95);
+	file << line;
+	return file.good();
+}
+
+// The p50 CPU and GPU times of a point
+struct StressPoint
+{
+	double cpu;
+	double gpu;
+};
+
+// Least squares slope of y over x
+static double slope(const std::map<int, StressPoint>& points, double StressPoint::* y)
+{
+	double meanX = 0.0, meanY = 0.0;
+	for (const auto& point : points) {
+		meanX += point.first;
+		meanY += point.second.*y;
+	}
+	meanX /= points.size();
+	meanY /= points.size();
+	double xy = 0.0, xx = 0.0;
+	for (const auto& point : points) {
+		xy += (point.first - meanX) * (point.second.*y - meanY);
+		xx += (point.first - meanX) * (point.first - meanX);
+	}
+	return xx > 0.0 ? xy / xx : 0.0;
+}
+
+void reportStressScaling(const char* filename, const StressSpec& spec, std::ostream& out)
+{
+	std::ifstream file(filename);
+	if (!file.is_open()) {
+		return;
+	}
+	std::map<int, StressPoint> axes[STRESS_AXES];
+	std::string line;
+	while (std::getline(file, line)) {
+		if (line.empty() || line[0] == '#') {
+			continue;
+		}
+		StressSpec run;
+		double cpu, cpu95, gpu;
+		if (sscanf(line.c_str(), "%d,%d,%d,%d,%lf,%lf,%lf", &run.props, &run.textures, &run.walls, &run.viewers, &cpu, &cpu95, &gpu) != 7) {
+			continue;
+		}
+		// A run belongs to an axis when only that axis may differ from spec
+		for (int axis = 0; axis < STRESS_AXES; axis++) {
+			bool others = true;
+			for (int other = 0; other < STRESS_AXES; other++) {
+				others = others && (other == axis || stressAxis(run, other) == stressAxis(spec, other));
+			}
+			if (others) {
+				axes[axis][stressAxis(run, axis)] = { cpu, gpu };
+			}
+		}
+	}
+	char text[256];
+	for (int axis = 0; axis < STRESS_AXES; axis++) {
+		const std::map<int, StressPoint>& points = axes[axis];
+		if (points.size() < 2) {
+			continue;
+		}
+		out << "scaling along " << axisNames[axis] << std::endl;
+		for (const auto& point : points) {
+			snprintf(text, sizeof(text), "  %8d  cpu %8.3f ms  gpu %8.3f ms", point.first, point.second.cpu, point.second.gpu);
+			out << text << std::endl;
+		}
+		int unit = axisUnits[axis];
+		snprintf(text, sizeof(text), "  per %s%s: cpu %+.3f ms, gpu %+.3f ms", unit > 1 ? (std::to_string(unit) + " ").c_str() : "",
+			axisUnitNames[axis], slope(points, &StressPoint::cpu) * unit, slope(points, &StressPoint::gpu) * unit);
+		out << text << std::endl;
+	}
+}
@@ -0,0 +1,68 @@
+#ifndef _STRESS_SCENE_H_
+#define _STRESS_SCENE_H_
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "CaveLayout.h"
+#include "FrameBaselines.h"
+
+// A synthetic heavy scene for scaling benchmarks, the same for every run with the same
+// four numbers: stress.props props on the grid, taking stress.textures generated images
+// in turn from an atlas, seen on stress.walls walls of a ring around the viewer by
+// stress.viewers viewers (the head, then the right and left hands by turns).
+//
+// It is made of what the scene already reads, so the scene draws it as it would any other
+// settings: applyStressScene writes the atlas and the layout into the temporary directory
+// and points props.count, props.atlas, cave.layout and cave.viewers at them. An axis left
+// at 0 keeps the scene's own setting.
+struct StressSpec
+{
+	int props;
+	int textures;
+	int walls;
+	int viewers;
+};
+
+enum { STRESS_AXES = 4 };
+
+// "props", "textures", "walls" and "viewers"
+const char* stressAxisName(int axis);
+int stressAxis(const StressSpec& spec, int axis);
+
+// The stress.* settings. False if none is set, so there is no stress scene.
+bool stressSpecFromConfig(StressSpec& spec);
+
+// Writes the scene's atlas and layout and overrides the settings the scene reads. Call
+// before the scene is made. False if a file could not be written.
+bool applyStressScene(const StressSpec& spec);
+
+//! count upright walls 2.4 m wide and tall, of a regular polygon of at least four sides
+// around the origin, the first in front (-z) and the rest to its left and right by turns
+// @input count 1 to CaveLayout::MAX_WALLS
+void stressWalls(int count, std::vector<CaveWall>& walls);
+
+//! count images of 64 by 64, each its own colour, checkered so its mips differ
+// @input rgb Receives every image's pixels one after the other
+void stressImages(int count, std::vector<unsigned char>& rgb);
+
+// One run of a stress scene, in milliseconds
+struct StressResult
+{
+	StressSpec spec;
+	FramePercentiles cpu;
+	FramePercentiles gpu;
+	FramePercentiles frame;
+};
+
+//! Adds the run to a CSV of runs (props,textures,walls,viewers then p50 and p95 of each
+// metric), starting it with a header if it is new.
+bool appendStressResult(const char* filename, const StressResult& result);
+
+//! For every axis the file has runs along, with the other three as in spec: the p50 CPU
+// and GPU times at each point and the least squares slope through them, so a sweep shows
+// what each prop, image, wall or viewer costs. The last run of a point counts.
+void reportStressScaling(const char* filename, const StressSpec& spec, std::ostream& out);
+
+#endif
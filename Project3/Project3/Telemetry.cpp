@@ -0,0 +1,201 @@
+#include "Telemetry.h"
+#include "ProcessStats.h"
+#include "ThreadScheduling.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int SOCKET;
+#define INVALID_SOCKET (-1)
+#define closesocket close
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+// How often the sender drains the ring, well before RING frames at any refresh rate
+static const int DRAIN_MS = 250;
+// StatsD datagrams stay under a common MTU
+static const size_t MAX_DATAGRAM = 1400;
+
+static SOCKET socketOf(uintptr_t sock)
+{
+	return (SOCKET)sock;
+}
+
+Telemetry::Telemetry() : intervalMs(0), sock((uintptr_t)INVALID_SOCKET), running(false), lost(0), appDropped(0), compositorDropped(0),
+	startupMs(-1), lastAppDropped(0), lastCompositorDropped(0), lastLost(0), stopping(false)
+{
+	memset(address, 0, sizeof(address));
+}
+
+Telemetry::~Telemetry()
+{
+	shutdown();
+}
+
+bool Telemetry::init(const std::string& host, int port, const std::string& metricPrefix, int interval)
+{
+	shutdown();
+	sockaddr_in target;
+	memset(&target, 0, sizeof(target));
+	target.sin_family = AF_INET;
+	target.sin_port = htons((unsigned short)port);
+	if (inet_pton(AF_INET, host.c_str(), &target.sin_addr) != 1) {
+		std::cerr << "telemetry.host: " << host << " is not an IPv4 address, no telemetry" << std::endl;
+		return false;
+	}
+#ifdef _WIN32
+	WSADATA wsa;
+	if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+		std::cerr << "telemetry: winsock did not start" << std::endl;
+		return false;
+	}
+#endif
+	SOCKET s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (s == INVALID_SOCKET) {
+		std::cerr << "telemetry: no UDP socket" << std::endl;
+#ifdef _WIN32
+		WSACleanup();
+#endif
+		return false;
+	}
+	static_assert(sizeof(sockaddr_in) <= sizeof(address), "Telemetry keeps its address in 16 bytes");
+	memcpy(address, &target, sizeof(target));
+	sock = (uintptr_t)s;
+	prefix = metricPrefix;
+	intervalMs = std::max(interval, DRAIN_MS);
+	// A few seconds of frames at a high refresh, the sender grows it if it has to
+	window.reserve((size_t)intervalMs * 240 / 1000 + RING);
+	sorted.reserve(window.capacity());
+	lastAppDropped = appDropped.load(std::memory_order_relaxed);
+	lastCompositorDropped = compositorDropped.load(std::memory_order_relaxed);
+	lastLost = lost.load(std::memory_order_relaxed);
+	stopping = false;
+	running = true;
+	sender = std::thread(&Telemetry::run, this);
+	return true;
+}
+
+void Telemetry::shutdown()
+{
+	if (!running) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	sender.join();
+	running = false;
+	closesocket(socketOf(sock));
+	sock = (uintptr_t)INVALID_SOCKET;
+#ifdef _WIN32
+	WSACleanup();
+#endif
+	Frame discard;
+	while (ring.pop(discard)) {
+	}
+	window.clear();
+}
+
+void Telemetry::run()
+{
+	auto due = std::chrono::steady_clock::now() + std::chrono::milliseconds(intervalMs);
+	std::unique_lock<std::mutex> lock(mutex);
+	while (!stopping) {
+		wake.wait_for(lock, std::chrono::milliseconds(DRAIN_MS), [this] { return stopping; });
+		Frame sample;
+		while (ring.pop(sample)) {
+			window.push_back(sample);
+		}
+		if (std::chrono::steady_clock::now() >= due) {
+			due += std::chrono::milliseconds(intervalMs);
+			lock.unlock();
+			send();
+			lock.lock();
+		}
+	}
+}
+
+void Telemetry::gauge(std::string& packet, const char* name, double value)
+{
+	char line[160];
+	int length = snprintf(line, sizeof(line), "%s.%s:%.3f|g\n", prefix.c_str(), name, value);
+	if (length <= 0 || (size_t)length >= sizeof(line)) {
+		return;
+	}
+	if (packet.size() + length > MAX_DATAGRAM) {
+		sendto(socketOf(sock), packet.data(), (int)packet.size(), 0, (const sockaddr*)address, sizeof(sockaddr_in));
+		packet.clear();
+	}
+	packet.append(line, length);
+}
+
+void Telemetry::send()
+{
+	std::string packet;
+	if (!window.empty()) {
+		sorted.clear();
+		double gpuMs = 0.0;
+		double wallGpuMs = 0.0;
+		for (const Frame& frame : window) {
+			sorted.push_back(frame.frameMs);
+			gpuMs += frame.gpuMs;
+			wallGpuMs += frame.wallGpuMs;
+		}
+		std::sort(sorted.begin(), sorted.end());
+		auto percentile = [this](double p) { return sorted[std::min((size_t)(p * sorted.size()), sorted.size() - 1)]; };
+		gauge(packet, "frame_ms.p50", percentile(0.50));
+		gauge(packet, "frame_ms.p90", percentile(0.90));
+		gauge(packet, "frame_ms.p99", percentile(0.99));
+		gauge(packet, "frame_ms.max", sorted.back());
+		gauge(packet, "frames", (double)window.size());
+		gauge(packet, "gpu_ms", gpuMs / window.size());
+		gauge(packet, "wall_gpu_ms", wallGpuMs / window.size());
+		gauge(packet, "vram_mb", (double)(window.back().vramBytes >> 20));
+		window.clear();
+	}
+	int app = appDropped.load(std::memory_order_relaxed);
+	int compositor = compositorDropped.load(std::memory_order_relaxed);
+	// The SDK's counts start over with a new session, that interval counts from zero
+	gauge(packet, "dropped.app", app >= lastAppDropped ? app - lastAppDropped : app);
+	gauge(packet, "dropped.compositor", compositor >= lastCompositorDropped ? compositor - lastCompositorDropped : compositor);
+	lastAppDropped = app;
+	lastCompositorDropped = compositor;
+	uint64_t lostNow = lost.load(std::memory_order_relaxed);
+	if (lostNow != lastLost) {
+		gauge(packet, "telemetry_lost", (double)(lostNow - lastLost));
+		lastLost = lostNow;
+	}
+	ProcessStats process;
+	if (readProcessStats(process)) {
+		gauge(packet, "resident_mb", (double)(process.residentBytes >> 20));
+	}
+	int64_t startup = startupMs.load(std::memory_order_relaxed);
+	if (startup >= 0) {
+		gauge(packet, "startup_s", startup / 1000.0);
+	}
+	if (threadScheduling().active()) {
+		gauge(packet, "threads.mmcss", threadScheduling().mmcssThreads());
+		gauge(packet, "threads.render_priority", threadScheduling().renderPriority());
+	}
+	if (!packet.empty()) {
+		sendto(socketOf(sock), packet.data(), (int)packet.size(), 0, (const sockaddr*)address, sizeof(sockaddr_in));
+	}
+}
+
+Telemetry& telemetry()
+{
+	static Telemetry instance;
+	return instance;
+}
@@ -0,0 +1,103 @@
+#ifndef _TELEMETRY_H_
+#define _TELEMETRY_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SpscRing.h"
+
+// Rolling metrics of a station sent as StatsD gauges over UDP (telemetry.*), so a fleet of
+// them can be watched from one collector and a machine that slowly gets worse shows up
+// before anyone complains about it. Every interval:
+//
+//   <prefix>.frame_ms.p50/.p90/.p99/.max   frame to frame time on the render thread
+//   <prefix>.gpu_ms, .wall_gpu_ms          GpuTimers' frame and wall pass time, averaged
+//   <prefix>.dropped.app/.compositor       ovr_GetPerfStats' dropped frames in the interval
+//   <prefix>.vram_mb                       what GpuMemory has recorded
+//   <prefix>.resident_mb                   the process's working set
+//   <prefix>.startup_s                     launch to first frame, once it is known
+//   <prefix>.threads.mmcss                 threads registered with MMCSS, with threads.*
+//   <prefix>.threads.render_priority       the render thread's priority as the OS has it
+//
+// The render thread only pushes a fixed size sample into a lock free ring (frame()) and
+// stores a few atomics, it never allocates, locks or touches the socket. A thread of its
+// own drains the ring a few times a second, works the numbers out and sends them; it does
+// not wait on anyone either, a collector that is not there loses the datagrams.
+class Telemetry
+{
+public:
+	enum { RING = 1024 };
+
+	struct Frame
+	{
+		float frameMs;
+		float gpuMs;
+		float wallGpuMs;
+		uint64_t vramBytes;
+	};
+
+	Telemetry();
+	~Telemetry();
+
+	Telemetry(const Telemetry&) = delete;
+	Telemetry& operator=(const Telemetry&) = delete;
+
+	//! Starts sending to host:port, an IPv4 address, every intervalMs.
+	// @input prefix Goes before every metric, the station's name for one
+	bool init(const std::string& host, int port, const std::string& prefix, int intervalMs);
+	void shutdown();
+	bool active() const { return running; }
+
+	// Render thread, once a frame. A full ring drops the sample and counts it as lost.
+	void frame(const Frame& sample)
+	{
+		if (running && !ring.push(sample)) {
+			lost.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+	// The SDK's dropped frame counts, which only ever go up
+	void setDropped(int app, int compositor)
+	{
+		appDropped.store(app, std::memory_order_relaxed);
+		compositorDropped.store(compositor, std::memory_order_relaxed);
+	}
+	void setStartup(double seconds) { startupMs.store((int64_t)(seconds * 1000.0), std::memory_order_relaxed); }
+
+private:
+	void run();
+	void send();
+	void gauge(std::string& packet, const char* name, double value);
+
+	std::string prefix;
+	int intervalMs;
+	uintptr_t sock;
+	unsigned char address[16];
+	bool running;
+
+	SpscRing<Frame, RING> ring;
+	std::atomic<uint64_t> lost;
+	std::atomic<int> appDropped;
+	std::atomic<int> compositorDropped;
+	std::atomic<int64_t> startupMs;
+
+	// The sender's: the interval's samples and the counts at the last send
+	std::vector<Frame> window;
+	std::vector<float> sorted;
+	int lastAppDropped;
+	int lastCompositorDropped;
+	uint64_t lastLost;
+
+	std::thread sender;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping;
+};
+
+Telemetry& telemetry();
+
+#endif
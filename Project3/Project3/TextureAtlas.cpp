@@ -0,0 +1,159 @@
+#include "TextureAtlas.h"
+#include "TextureCache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+AtlasTile noAtlasTile()
+{
+	AtlasTile tile = {};
+	tile.layer = -1.f;
+	return tile;
+}
+
+AtlasTile atlasTile(const TexAtlasEntry& entry, uint32_t pageSize)
+{
+	AtlasTile tile = {};
+	float scale = 1.f / (float)pageSize;
+	tile.rect[0] = entry.x * scale;
+	tile.rect[1] = entry.y * scale;
+	tile.rect[2] = entry.width * scale;
+	tile.rect[3] = entry.height * scale;
+	tile.layer = (float)entry.page;
+	return tile;
+}
+
+bool packTextureAtlas(const std::vector<AtlasImage>& images, uint32_t pageSize, std::vector<TexAtlasEntry>& entries,
+	uint32_t& pageCount)
+{
+	entries.assign(images.size(), TexAtlasEntry());
+	std::vector<size_t> order(images.size());
+	for (size_t i = 0; i < order.size(); i++) {
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return images[a].height > images[b].height; });
+
+	// The shelf being filled on the page being filled
+	uint32_t page = 0, shelfY = 0, shelfHeight = 0, x = 0;
+	bool used = false;
+	for (size_t i : order) {
+		const AtlasImage& image = images[i];
+		uint32_t width = image.width + 2 * TEXATLAS_GUTTER;
+		uint32_t height = image.height + 2 * TEXATLAS_GUTTER;
+		if (width > pageSize || height > pageSize) {
+			std::cerr << image.name << " (" << image.width << "x" << image.height << ") does not fit a "
+				<< pageSize << " atlas page" << std::endl;
+			return false;
+		}
+		if (x + width > pageSize) {
+			shelfY += shelfHeight;
+			shelfHeight = 0;
+			x = 0;
+		}
+		if (shelfY + height > pageSize) {
+			page++;
+			shelfY = shelfHeight = x = 0;
+		}
+		TexAtlasEntry& entry = entries[i];
+		memset(&entry, 0, sizeof(entry));
+		strncpy(entry.name, image.name.c_str(), sizeof(entry.name) - 1);
+		entry.page = page;
+		entry.x = x + TEXATLAS_GUTTER;
+		entry.y = shelfY + TEXATLAS_GUTTER;
+		entry.width = image.width;
+		entry.height = image.height;
+		x += width;
+		shelfHeight = std::max(shelfHeight, height);
+		used = true;
+	}
+	pageCount = used ? page + 1 : 0;
+	return true;
+}
+
+size_t atlasLevelSize(uint32_t pageSize, uint32_t level)
+{
+	size_t side = std::max(pageSize >> level, 1u);
+	return (side * side * 3 + 15) & ~(size_t)15;
+}
+
+size_t atlasLevelOffset(const TexAtlasHeader& header, uint32_t page, uint32_t level)
+{
+	size_t pageBytes = 0;
+	for (uint32_t l = 0; l < header.levelCount; l++) {
+		pageBytes += atlasLevelSize(header.pageSize, l);
+	}
+	size_t offset = header.dataOffset + page * pageBytes;
+	for (uint32_t l = 0; l < level; l++) {
+		offset += atlasLevelSize(header.pageSize, l);
+	}
+	return offset;
+}
+
+// Copies the image onto the page at its entry, with its edge pixels repeated out over the
+// gutter around it
+static void placeImage(const AtlasImage& image, const TexAtlasEntry& entry, uint32_t pageSize, unsigned char* page)
+{
+	int gutter = (int)TEXATLAS_GUTTER;
+	for (int y = -gutter; y < (int)image.height + gutter; y++) {
+		int sourceY = std::min(std::max(y, 0), (int)image.height - 1);
+		for (int x = -gutter; x < (int)image.width + gutter; x++) {
+			int sourceX = std::min(std::max(x, 0), (int)image.width - 1);
+			const unsigned char* from = image.rgb + ((size_t)sourceY * image.width + sourceX) * 3;
+			unsigned char* to = page + (((size_t)(entry.y + y)) * pageSize + entry.x + x) * 3;
+			memcpy(to, from, 3);
+		}
+	}
+}
+
+bool writeTextureAtlas(const char* filename, const std::vector<AtlasImage>& images, uint32_t pageSize)
+{
+	std::vector<TexAtlasEntry> entries;
+	uint32_t pageCount;
+	if (!packTextureAtlas(images, pageSize, entries, pageCount)) {
+		return false;
+	}
+	TexAtlasHeader header = {};
+	header.magic = TEXATLAS_MAGIC;
+	header.version = TEXATLAS_VERSION;
+	header.pageSize = pageSize;
+	header.pageCount = pageCount;
+	header.levelCount = std::min(mipLevelCount(pageSize, pageSize), TEXATLAS_MAX_LEVELS);
+	header.entryCount = (uint32_t)entries.size();
+	header.dataOffset = (uint32_t)((sizeof(header) + entries.size() * sizeof(TexAtlasEntry) + 15) & ~(size_t)15);
+
+	FILE* out = fopen(filename, "wb");
+	if (!out) {
+		return false;
+	}
+	bool ok = fwrite(&header, sizeof(header), 1, out) == 1
+		&& (entries.empty() || fwrite(entries.data(), sizeof(TexAtlasEntry), entries.size(), out) == entries.size());
+	static const unsigned char padding[16] = {};
+	size_t written = sizeof(header) + entries.size() * sizeof(TexAtlasEntry);
+	ok = ok && fwrite(padding, 1, header.dataOffset - written, out) == header.dataOffset - written;
+
+	std::vector<unsigned char> level, next;
+	for (uint32_t page = 0; page < pageCount && ok; page++) {
+		level.assign((size_t)pageSize * pageSize * 3, 0);
+		for (size_t i = 0; i < images.size(); i++) {
+			if (entries[i].page == page) {
+				placeImage(images[i], entries[i], pageSize, level.data());
+			}
+		}
+		uint32_t side = pageSize;
+		for (uint32_t l = 0; l < header.levelCount && ok; l++) {
+			size_t bytes = (size_t)side * side * 3;
+			size_t padded = atlasLevelSize(pageSize, l);
+			ok = fwrite(level.data(), 1, bytes, out) == bytes && fwrite(padding, 1, padded - bytes, out) == padded - bytes;
+			if (l + 1 < header.levelCount) {
+				uint32_t half = std::max(side / 2, 1u);
+				next.resize((size_t)half * half * 3);
+				downsampleRGB8(level.data(), side, side, next.data(), half, half);
+				level.swap(next);
+				side = half;
+			}
+		}
+	}
+	return fclose(out) == 0 && ok;
+}
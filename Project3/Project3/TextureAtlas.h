@@ -0,0 +1,85 @@
+#ifndef _TEXTURE_ATLAS_H_
+#define _TEXTURE_ATLAS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// On-disk texture atlas (.p3ta): many small images packed onto the square pages of a 2D
+// texture array, so objects that each have a texture of their own can still be drawn
+// together, each picking its image by layer and rectangle instead of by binding.
+//
+//   TexAtlasHeader
+//   TexAtlasEntry[entryCount]
+//   per page, levelCount levels of RGB8, each level starting on a 16 byte boundary
+//
+// TexCacheBuilder --atlas packs PPMs into one; the runtime (AtlasArray) maps it and
+// uploads the pages as they are needed.
+
+const uint32_t TEXATLAS_MAGIC = 0x41543350; // "P3TA"
+const uint32_t TEXATLAS_VERSION = 1;
+// Pixels of its edge repeated around each image, so filtering and the mips stay inside it.
+// Each level halves it, so only the levels it still covers are kept.
+const uint32_t TEXATLAS_GUTTER = 8;
+const uint32_t TEXATLAS_MAX_LEVELS = 4;
+
+struct TexAtlasHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t pageSize;
+	uint32_t pageCount;
+	uint32_t levelCount;
+	uint32_t entryCount;
+	// Where the first page's pixels start
+	uint32_t dataOffset;
+	uint32_t reserved;
+};
+
+struct TexAtlasEntry
+{
+	// The source's file name without its directory and extension
+	char name[44];
+	uint32_t page;
+	uint32_t x;
+	uint32_t y;
+	uint32_t width;
+	uint32_t height;
+};
+
+// Where an instance's image is, as the draw lists hand it to the vertex shader (attributes
+// 9 and 10): rect is x, y, width and height in the page's texture coordinates, layer the
+// page, below 0 for no image at all
+struct AtlasTile
+{
+	float rect[4];
+	float layer;
+	float reserved[3];
+};
+
+struct AtlasImage
+{
+	std::string name;
+	const unsigned char* rgb;
+	uint32_t width;
+	uint32_t height;
+};
+
+// The tile of no image
+AtlasTile noAtlasTile();
+AtlasTile atlasTile(const TexAtlasEntry& entry, uint32_t pageSize);
+
+//! Places the images on pages of pageSize square, on shelves tallest first. False if one is
+// too big for a page with its gutter.
+bool packTextureAtlas(const std::vector<AtlasImage>& images, uint32_t pageSize, std::vector<TexAtlasEntry>& entries,
+	uint32_t& pageCount);
+
+//! Packs the images and writes the atlas with its pages' mips
+bool writeTextureAtlas(const char* filename, const std::vector<AtlasImage>& images, uint32_t pageSize);
+
+// Bytes of one level of a page, padded to 16, and where a page's level starts in the file
+size_t atlasLevelSize(uint32_t pageSize, uint32_t level);
+size_t atlasLevelOffset(const TexAtlasHeader& header, uint32_t page, uint32_t level);
+
+#endif
@@ -0,0 +1,432 @@
+#include "TextureCache.h"
+#include "PixelConvert.h"
+
+#include <Windows.h>
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+std::string textureCachePath(const std::string& sourcePath)
+{
+	size_t dot = sourcePath.find_last_of('.');
+	size_t slash = sourcePath.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+		return sourcePath + ".p3tc";
+	}
+	return sourcePath.substr(0, dot) + ".p3tc";
+}
+
+bool sourceFileStamp(const char* filename, uint64_t& size, uint64_t& time)
+{
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if (!GetFileAttributesExA(filename, GetFileExInfoStandard, &attributes)) {
+		size = 0;
+		time = 0;
+		return false;
+	}
+	size = ((uint64_t)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+	time = ((uint64_t)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+	return true;
+}
+
+uint32_t mipLevelCount(uint32_t width, uint32_t height)
+{
+	uint32_t levels = 1;
+	uint32_t size = std::max(width, height);
+	while (size > 1) {
+		size >>= 1;
+		levels++;
+	}
+	return levels;
+}
+
+void downsampleRGB8(const unsigned char* src, uint32_t width, uint32_t height,
+	unsigned char* dst, uint32_t dstWidth, uint32_t dstHeight)
+{
+	downsamplePixels(src, width, height, dst, dstWidth, dstHeight, false);
+}
+
+size_t bc1Size(uint32_t width, uint32_t height)
+{
+	return (size_t)std::max(1u, (width + 3) / 4) * std::max(1u, (height + 3) / 4) * 8;
+}
+
+static uint16_t packRGB565(const unsigned char* c)
+{
+	return (uint16_t)(((c[0] >> 3) << 11) | ((c[1] >> 2) << 5) | (c[2] >> 3));
+}
+
+static void unpackRGB565(uint16_t v, int* c)
+{
+	int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+	c[0] = (r << 3) | (r >> 2);
+	c[1] = (g << 2) | (g >> 4);
+	c[2] = (b << 3) | (b >> 2);
+}
+
+// Bounding box endpoints, inset by 1/16 of the range, with nearest-palette indices
+static void compressBlockBC1(const unsigned char block[16][3], unsigned char* out)
+{
+	unsigned char lo[3] = { 255, 255, 255 };
+	unsigned char hi[3] = { 0, 0, 0 };
+	for (int i = 0; i < 16; i++) {
+		for (int c = 0; c < 3; c++) {
+			lo[c] = std::min(lo[c], block[i][c]);
+			hi[c] = std::max(hi[c], block[i][c]);
+		}
+	}
+	for (int c = 0; c < 3; c++) {
+		int inset = (hi[c] - lo[c]) >> 4;
+		lo[c] = (unsigned char)(lo[c] + inset);
+		hi[c] = (unsigned char)(hi[c] - inset);
+	}
+
+	uint16_t c0 = packRGB565(hi);
+	uint16_t c1 = packRGB565(lo);
+	uint32_t indices = 0;
+
+	if (c0 != c1) {
+		int palette[4][3];
+		unpackRGB565(c0, palette[0]);
+		unpackRGB565(c1, palette[1]);
+		for (int c = 0; c < 3; c++) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		for (int i = 0; i < 16; i++) {
+			int best = 0;
+			int bestDist = INT_MAX;
+			for (int p = 0; p < 4; p++) {
+				int dr = block[i][0] - palette[p][0];
+				int dg = block[i][1] - palette[p][1];
+				int db = block[i][2] - palette[p][2];
+				int dist = dr * dr + dg * dg + db * db;
+				if (dist < bestDist) {
+					bestDist = dist;
+					best = p;
+				}
+			}
+			indices |= (uint32_t)best << (i * 2);
+		}
+	}
+
+	// c0 >= c1 always holds here, which selects the opaque 4 colour mode
+	out[0] = (unsigned char)(c0 & 0xff);
+	out[1] = (unsigned char)(c0 >> 8);
+	out[2] = (unsigned char)(c1 & 0xff);
+	out[3] = (unsigned char)(c1 >> 8);
+	memcpy(out + 4, &indices, 4);
+}
+
+void compressBC1(const unsigned char* src, uint32_t width, uint32_t height, unsigned char* dst)
+{
+	uint32_t blocksX = std::max(1u, (width + 3) / 4);
+	uint32_t blocksY = std::max(1u, (height + 3) / 4);
+	unsigned char block[16][3];
+
+	for (uint32_t by = 0; by < blocksY; by++) {
+		for (uint32_t bx = 0; bx < blocksX; bx++) {
+			for (uint32_t i = 0; i < 16; i++) {
+				uint32_t x = std::min(bx * 4 + (i & 3), width - 1);
+				uint32_t y = std::min(by * 4 + (i >> 2), height - 1);
+				memcpy(block[i], src + (y * width + x) * 3, 3);
+			}
+			compressBlockBC1(block, dst);
+			dst += 8;
+		}
+	}
+}
+
+uint16_t floatToHalf(float value)
+{
+	// Also true for NaN
+	if (!(value > 0.0f)) {
+		return 0;
+	}
+	if (value >= 65504.0f) {
+		return 0x7bff;
+	}
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+	uint32_t mantissa = bits & 0x7fffff;
+	if (exponent <= 0) {
+		// Below the smallest normal half: a subnormal, or nothing at all
+		if (exponent < -10) {
+			return 0;
+		}
+		mantissa |= 0x800000;
+		int shift = 14 - exponent;
+		uint32_t half = mantissa >> shift;
+		if ((mantissa >> (shift - 1)) & 1) {
+			half++;
+		}
+		return (uint16_t)half;
+	}
+	// Rounding up may carry into the exponent, which is still the right half
+	uint32_t half = ((uint32_t)exponent << 10) | (mantissa >> 13);
+	if (mantissa & 0x1000) {
+		half++;
+	}
+	return (uint16_t)std::min(half, 0x7bffu);
+}
+
+void downsampleRGB32F(const float* src, uint32_t width, uint32_t height,
+	float* dst, uint32_t dstWidth, uint32_t dstHeight)
+{
+	for (uint32_t y = 0; y < dstHeight; y++) {
+		uint32_t y0 = std::min(y * 2, height - 1);
+		uint32_t y1 = std::min(y * 2 + 1, height - 1);
+		for (uint32_t x = 0; x < dstWidth; x++) {
+			uint32_t x0 = std::min(x * 2, width - 1);
+			uint32_t x1 = std::min(x * 2 + 1, width - 1);
+			const float* a = src + (y0 * width + x0) * 3;
+			const float* b = src + (y0 * width + x1) * 3;
+			const float* c = src + (y1 * width + x0) * 3;
+			const float* d = src + (y1 * width + x1) * 3;
+			float* out = dst + (y * dstWidth + x) * 3;
+			for (int i = 0; i < 3; i++) {
+				out[i] = (a[i] + b[i] + c[i] + d[i]) * 0.25f;
+			}
+		}
+	}
+}
+
+size_t bc6hSize(uint32_t width, uint32_t height)
+{
+	return (size_t)std::max(1u, (width + 3) / 4) * std::max(1u, (height + 3) / 4) * 16;
+}
+
+static const int bc6hWeights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// What the hardware makes of a 10-bit unsigned endpoint before interpolating
+static int unquantizeBC6H(int q)
+{
+	if (q == 0) {
+		return 0;
+	}
+	if (q == 1023) {
+		return 0xffff;
+	}
+	return ((q << 16) + 0x8000) >> 10;
+}
+
+// Writes the low count bits of value at bit pos of a block, least significant first
+static void putBits(unsigned char* block, int& pos, uint32_t value, int count)
+{
+	for (int i = 0; i < count; i++, pos++) {
+		if ((value >> i) & 1) {
+			block[pos >> 3] |= (unsigned char)(1 << (pos & 7));
+		}
+	}
+}
+
+// Mode 11: one region, 10-bit endpoints stored as they are and 4-bit indices. The endpoints
+// are the bounding box of the block in half float bits, which is what the hardware
+// interpolates in (roughly the log of the light), and each texel takes the nearest of the
+// 16 palette entries.
+static void compressBlockBC6H(const uint16_t block[16][3], unsigned char* out)
+{
+	int lo[3] = { 0x7bff, 0x7bff, 0x7bff };
+	int hi[3] = { 0, 0, 0 };
+	for (int i = 0; i < 16; i++) {
+		for (int c = 0; c < 3; c++) {
+			lo[c] = std::min(lo[c], (int)block[i][c]);
+			hi[c] = std::max(hi[c], (int)block[i][c]);
+		}
+	}
+
+	// An endpoint q decodes to about q * 31 + 15, and 1023 to the largest half exactly
+	int endpoints[2][3];
+	int palette[16][3];
+	for (int c = 0; c < 3; c++) {
+		endpoints[0][c] = std::min(1023, lo[c] / 31);
+		endpoints[1][c] = std::min(1023, hi[c] / 31);
+		int u0 = unquantizeBC6H(endpoints[0][c]);
+		int u1 = unquantizeBC6H(endpoints[1][c]);
+		for (int p = 0; p < 16; p++) {
+			int u = (u0 * (64 - bc6hWeights[p]) + u1 * bc6hWeights[p] + 32) >> 6;
+			palette[p][c] = (u * 31) >> 6;
+		}
+	}
+
+	int indices[16];
+	for (int i = 0; i < 16; i++) {
+		int best = 0;
+		int64_t bestDist = INT64_MAX;
+		for (int p = 0; p < 16; p++) {
+			int64_t dist = 0;
+			for (int c = 0; c < 3; c++) {
+				int64_t d = block[i][c] - palette[p][c];
+				dist += d * d;
+			}
+			if (dist < bestDist) {
+				bestDist = dist;
+				best = p;
+			}
+		}
+		indices[i] = best;
+	}
+
+	// The first index is stored without its top bit, which has to be 0. The weights are
+	// symmetric, so swapping the endpoints and flipping every index decodes the same.
+	if (indices[0] >= 8) {
+		for (int c = 0; c < 3; c++) {
+			std::swap(endpoints[0][c], endpoints[1][c]);
+		}
+		for (int i = 0; i < 16; i++) {
+			indices[i] = 15 - indices[i];
+		}
+	}
+
+	memset(out, 0, 16);
+	int pos = 0;
+	putBits(out, pos, 0x03, 5);
+	for (int e = 0; e < 2; e++) {
+		for (int c = 0; c < 3; c++) {
+			putBits(out, pos, (uint32_t)endpoints[e][c], 10);
+		}
+	}
+	putBits(out, pos, (uint32_t)indices[0], 3);
+	for (int i = 1; i < 16; i++) {
+		putBits(out, pos, (uint32_t)indices[i], 4);
+	}
+}
+
+void compressBC6H(const float* src, uint32_t width, uint32_t height, unsigned char* dst)
+{
+	uint32_t blocksX = std::max(1u, (width + 3) / 4);
+	uint32_t blocksY = std::max(1u, (height + 3) / 4);
+	uint16_t block[16][3];
+
+	for (uint32_t by = 0; by < blocksY; by++) {
+		for (uint32_t bx = 0; bx < blocksX; bx++) {
+			for (uint32_t i = 0; i < 16; i++) {
+				uint32_t x = std::min(bx * 4 + (i & 3), width - 1);
+				uint32_t y = std::min(by * 4 + (i >> 2), height - 1);
+				const float* texel = src + (y * width + x) * 3;
+				for (int c = 0; c < 3; c++) {
+					block[i][c] = floatToHalf(texel[c]);
+				}
+			}
+			compressBlockBC6H(block, dst);
+			dst += 16;
+		}
+	}
+}
+
+// Lays out levels after the header and table, each on a 16 byte boundary, and writes them
+static bool writeCacheFile(const char* filename, TexCacheFormat format, uint32_t width, uint32_t height,
+	const std::vector<std::vector<unsigned char>>& payloads, uint64_t sourceSize, uint64_t sourceTime)
+{
+	TexCacheHeader header;
+	header.magic = TEXCACHE_MAGIC;
+	header.version = TEXCACHE_VERSION;
+	header.format = format;
+	header.width = width;
+	header.height = height;
+	header.levelCount = (uint32_t)payloads.size();
+	header.sourceSize = sourceSize;
+	header.sourceTime = sourceTime;
+
+	std::vector<TexCacheLevel> levels(header.levelCount);
+	uint32_t offset = (uint32_t)(sizeof(TexCacheHeader) + sizeof(TexCacheLevel) * header.levelCount);
+	uint32_t w = width, h = height;
+	for (uint32_t level = 0; level < header.levelCount; level++) {
+		offset = (offset + 15) & ~15u;
+		levels[level].offset = offset;
+		levels[level].size = (uint32_t)payloads[level].size();
+		levels[level].width = w;
+		levels[level].height = h;
+		offset += levels[level].size;
+		w = std::max(1u, w / 2);
+		h = std::max(1u, h / 2);
+	}
+
+	FILE* fp = fopen(filename, "wb");
+	if (!fp) {
+		return false;
+	}
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+	ok = ok && fwrite(levels.data(), sizeof(TexCacheLevel), levels.size(), fp) == levels.size();
+	uint32_t written = (uint32_t)(sizeof(TexCacheHeader) + sizeof(TexCacheLevel) * header.levelCount);
+	static const unsigned char zeros[16] = { 0 };
+	for (uint32_t level = 0; ok && level < header.levelCount; level++) {
+		ok = fwrite(zeros, 1, levels[level].offset - written, fp) == levels[level].offset - written;
+		ok = ok && fwrite(payloads[level].data(), 1, payloads[level].size(), fp) == payloads[level].size();
+		written = levels[level].offset + levels[level].size;
+	}
+	ok = (fclose(fp) == 0) && ok;
+	if (!ok) {
+		remove(filename);
+	}
+	return ok;
+}
+
+bool writeTextureCache(const char* filename, const unsigned char* rgb, uint32_t width, uint32_t height,
+	TexCacheFormat format, uint64_t sourceSize, uint64_t sourceTime, bool srgbMips)
+{
+	uint32_t levelCount = mipLevelCount(width, height);
+	std::vector<std::vector<unsigned char>> payloads(levelCount);
+
+	std::vector<unsigned char> current(rgb, rgb + (size_t)width * height * 3);
+	uint32_t w = width, h = height;
+
+	for (uint32_t level = 0; level < levelCount; level++) {
+		if (format == TEXCACHE_BC1) {
+			payloads[level].resize(bc1Size(w, h));
+			compressBC1(current.data(), w, h, payloads[level].data());
+		}
+		else {
+			payloads[level] = current;
+		}
+
+		if (level + 1 < levelCount) {
+			uint32_t nw = std::max(1u, w / 2), nh = std::max(1u, h / 2);
+			std::vector<unsigned char> next((size_t)nw * nh * 3);
+			downsamplePixels(current.data(), w, h, next.data(), nw, nh, srgbMips);
+			current.swap(next);
+			w = nw;
+			h = nh;
+		}
+	}
+
+	return writeCacheFile(filename, format, width, height, payloads, sourceSize, sourceTime);
+}
+
+bool writeHdrTextureCache(const char* filename, const float* rgb, uint32_t width, uint32_t height,
+	TexCacheFormat format, uint64_t sourceSize, uint64_t sourceTime)
+{
+	uint32_t levelCount = mipLevelCount(width, height);
+	std::vector<std::vector<unsigned char>> payloads(levelCount);
+
+	std::vector<float> current(rgb, rgb + (size_t)width * height * 3);
+	uint32_t w = width, h = height;
+
+	for (uint32_t level = 0; level < levelCount; level++) {
+		if (format == TEXCACHE_BC6H) {
+			payloads[level].resize(bc6hSize(w, h));
+			compressBC6H(current.data(), w, h, payloads[level].data());
+		}
+		else {
+			payloads[level].resize(current.size() * sizeof(uint16_t));
+			uint16_t* halves = (uint16_t*)payloads[level].data();
+			for (size_t i = 0; i < current.size(); i++) {
+				halves[i] = floatToHalf(current[i]);
+			}
+		}
+
+		if (level + 1 < levelCount) {
+			uint32_t nw = std::max(1u, w / 2), nh = std::max(1u, h / 2);
+			std::vector<float> next((size_t)nw * nh * 3);
+			downsampleRGB32F(current.data(), w, h, next.data(), nw, nh);
+			current.swap(next);
+			w = nw;
+			h = nh;
+		}
+	}
+
+	return writeCacheFile(filename, format, width, height, payloads, sourceSize, sourceTime);
+}
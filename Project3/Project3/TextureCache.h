@@ -0,0 +1,99 @@
+#ifndef _TEXTURE_CACHE_H_
+#define _TEXTURE_CACHE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// On-disk texture cache (.p3tc). One file holds one 2D image (or one cubemap face)
+// with its whole mip chain already generated, either as raw RGB8 or as BC1 blocks, or for
+// an HDR source (a PFM) as raw half float RGB or as BC6H blocks:
+//
+//   TexCacheHeader
+//   TexCacheLevel[levelCount]
+//   level data, each level starting on a 16 byte boundary
+//
+// TexCacheBuilder writes these next to the source PPMs at build time; the runtime maps
+// them with mapImage() in Image.h and uploads the levels as they are.
+
+const uint32_t TEXCACHE_MAGIC = 0x43543350; // "P3TC"
+const uint32_t TEXCACHE_VERSION = 1;
+
+enum TexCacheFormat : uint32_t {
+	TEXCACHE_RGB8 = 0,
+	TEXCACHE_BC1 = 1,
+	TEXCACHE_RGB16F = 2,
+	TEXCACHE_BC6H = 3,
+};
+
+// True for the formats built from a float source
+inline bool isHdrCacheFormat(uint32_t format)
+{
+	return format == TEXCACHE_RGB16F || format == TEXCACHE_BC6H;
+}
+
+struct TexCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t format;
+	uint32_t width;
+	uint32_t height;
+	uint32_t levelCount;
+	// Size and last-write time of the source file, so stale caches are ignored
+	uint64_t sourceSize;
+	uint64_t sourceTime;
+};
+
+struct TexCacheLevel
+{
+	uint32_t offset;
+	uint32_t size;
+	uint32_t width;
+	uint32_t height;
+};
+
+// Path of the cache file that belongs to a source image ("a/b.ppm" -> "a/b.p3tc")
+std::string textureCachePath(const std::string& sourcePath);
+
+// Size and last-write time of a file, 0 if it does not exist
+bool sourceFileStamp(const char* filename, uint64_t& size, uint64_t& time);
+
+// Number of levels in a full mip chain down to 1x1
+uint32_t mipLevelCount(uint32_t width, uint32_t height);
+
+// 2x2 box filter of an RGB8 image into the next mip level (odd edges are clamped), with the
+// kernel downsamplePixels in PixelConvert.h picks
+void downsampleRGB8(const unsigned char* src, uint32_t width, uint32_t height,
+	unsigned char* dst, uint32_t dstWidth, uint32_t dstHeight);
+
+// Encodes an RGB8 image into BC1 blocks, padding partial blocks by edge clamping.
+// dst must hold bc1Size(width, height) bytes.
+size_t bc1Size(uint32_t width, uint32_t height);
+void compressBC1(const unsigned char* src, uint32_t width, uint32_t height, unsigned char* dst);
+
+// Half floats of unsigned HDR data. Negatives and NaN become 0, anything past the largest
+// half becomes the largest half.
+uint16_t floatToHalf(float value);
+
+// 2x2 box filter of a float RGB image, like downsampleRGB8
+void downsampleRGB32F(const float* src, uint32_t width, uint32_t height,
+	float* dst, uint32_t dstWidth, uint32_t dstHeight);
+
+// Encodes a float RGB image into unsigned BC6H blocks (the single region mode with 10-bit
+// endpoints), padding partial blocks by edge clamping. dst must hold bc6hSize(width, height)
+// bytes.
+size_t bc6hSize(uint32_t width, uint32_t height);
+void compressBC6H(const float* src, uint32_t width, uint32_t height, unsigned char* dst);
+
+// Builds the full mip chain of an RGB8 image and writes it as a cache file. srgbMips filters
+// the mips in linear light, for images whose bytes are sRGB.
+bool writeTextureCache(const char* filename, const unsigned char* rgb, uint32_t width, uint32_t height,
+	TexCacheFormat format, uint64_t sourceSize, uint64_t sourceTime, bool srgbMips = false);
+
+// The same for a float RGB image, format being TEXCACHE_RGB16F or TEXCACHE_BC6H. The mips
+// are filtered in float, so bright texels are averaged as the light they are.
+bool writeHdrTextureCache(const char* filename, const float* rgb, uint32_t width, uint32_t height,
+	TexCacheFormat format, uint64_t sourceSize, uint64_t sourceTime);
+
+#endif
@@ -0,0 +1,52 @@
+#include "TextureQuality.h"
+
+#include <algorithm>
+#include <cmath>
+
+bool parseTextureQuality(const std::string& name, TextureQuality& quality)
+{
+	if (name == "full") {
+		quality = TextureQuality::FULL;
+	}
+	else if (name == "high") {
+		quality = TextureQuality::HIGH;
+	}
+	else if (name == "medium") {
+		quality = TextureQuality::MEDIUM;
+	}
+	else if (name == "low") {
+		quality = TextureQuality::LOW;
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+int textureSizeLimit(TextureQuality quality, float sampledTexels)
+{
+	if (quality == TextureQuality::FULL || sampledTexels <= 0.0f) {
+		return 0;
+	}
+	// Each tier below high halves what is kept
+	int below = (int)quality - (int)TextureQuality::HIGH;
+	return std::max((int)std::ceil(sampledTexels / (float)(1 << below)), 1);
+}
+
+void limitImageLevels(Image& image, int maxSize)
+{
+	if (maxSize <= 0) {
+		return;
+	}
+	size_t drop = 0;
+	while (drop + 1 < image.levels.size() &&
+		std::max(image.levels[drop + 1].width, image.levels[drop + 1].height) >= maxSize) {
+		drop++;
+	}
+	if (drop == 0) {
+		return;
+	}
+	image.levels.erase(image.levels.begin(), image.levels.begin() + drop);
+	image.width = image.levels[0].width;
+	image.height = image.levels[0].height;
+}
@@ -0,0 +1,32 @@
+#ifndef _TEXTURE_QUALITY_H_
+#define _TEXTURE_QUALITY_H_
+
+#include <string>
+
+#include "Image.h"
+
+// How much of a texture's mip chain is loaded (textures.quality). At full everything is.
+// Otherwise a texture is only loaded down from the level that what it is drawn into can
+// resolve: high keeps the largest level at least as many texels across as the target has
+// pixels over it, medium and low start one and two levels below that. The levels above are
+// never read from the texture cache, uploaded or allocated.
+//
+// Only images that carry their mips, the texture caches, lose levels. A source image
+// without a cache is loaded whole and mipped after upload as before.
+enum class TextureQuality { FULL, HIGH, MEDIUM, LOW };
+
+// full, high, medium or low
+bool parseTextureQuality(const std::string& name, TextureQuality& quality);
+
+//! The size the largest level of a texture should have.
+// @input sampledTexels The pixels the texture covers across at most, for a cube map those a
+//		face spans
+// @return The longer side the largest level loaded needs, the smallest level that big is
+//		kept on top. 0 for no limit.
+int textureSizeLimit(TextureQuality quality, float sampledTexels);
+
+// Drops the leading levels of image while the next one is still at least maxSize on its
+// longer side, keeping one at least. The image's size becomes its new first level's.
+void limitImageLevels(Image& image, int maxSize);
+
+#endif
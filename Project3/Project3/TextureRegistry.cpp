@@ -0,0 +1,95 @@
+#include "TextureRegistry.h"
+#include "GpuMemory.h"
+
+#include <algorithm>
+
+TextureRegistry::TextureRegistry() : bytes(0), hitCount(0), missCount(0)
+{
+}
+
+TextureRegistry::~TextureRegistry()
+{
+	clear();
+}
+
+std::string TextureRegistry::key2D(const std::string& path)
+{
+	return "2d:" + path;
+}
+
+std::string TextureRegistry::keyCube(const std::vector<std::string>& faces)
+{
+	std::string key = "cube";
+	for (const std::string& face : faces) {
+		key += ":" + face;
+	}
+	return key;
+}
+
+GLuint TextureRegistry::find(const std::string& key)
+{
+	auto it = textures.find(key);
+	if (it == textures.end()) {
+		missCount++;
+		return 0;
+	}
+	hitCount++;
+	return it->second.texture;
+}
+
+void TextureRegistry::add(const std::string& key, GLuint texture, uint64_t textureBytes)
+{
+	Slot& slot = textures[key];
+	if (slot.texture && slot.texture != texture) {
+		destroy(slot);
+	}
+	bytes = bytes - slot.bytes + textureBytes;
+	slot.texture = texture;
+	slot.bytes = textureBytes;
+}
+
+void TextureRegistry::touch(const std::string& key, uint64_t frame)
+{
+	auto it = textures.find(key);
+	if (it != textures.end()) {
+		it->second.lastUse = frame;
+	}
+}
+
+void TextureRegistry::clear()
+{
+	for (auto& entry : textures) {
+		destroy(entry.second);
+	}
+	textures.clear();
+	bytes = 0;
+}
+
+void TextureRegistry::evict(uint64_t budget, uint64_t before, std::vector<std::string>& evicted)
+{
+	if (bytes <= budget) {
+		return;
+	}
+	std::vector<std::pair<uint64_t, std::string>> candidates;
+	for (const auto& entry : textures) {
+		if (entry.second.lastUse < before) {
+			candidates.push_back(std::make_pair(entry.second.lastUse, entry.first));
+		}
+	}
+	std::sort(candidates.begin(), candidates.end());
+	for (size_t i = 0; i < candidates.size() && bytes > budget; i++) {
+		auto it = textures.find(candidates[i].second);
+		bytes -= it->second.bytes;
+		destroy(it->second);
+		textures.erase(it);
+		evicted.push_back(candidates[i].second);
+	}
+}
+
+void TextureRegistry::destroy(Slot& slot)
+{
+	gpuMemory().release(GpuMemory::KIND_TEXTURE, slot.texture);
+	// Deleted, and its bindless handle made non-resident, once the frames in flight are done
+	gpuHandles().retire(GpuHandles::TEXTURE, slot.texture);
+	slot.texture = 0;
+}
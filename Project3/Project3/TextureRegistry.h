@@ -0,0 +1,75 @@
+#ifndef _TEXTURE_REGISTRY_H_
+#define _TEXTURE_REGISTRY_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "GpuHandles.h"
+
+// GL textures keyed by their source files and target, so asking for the same texture
+// twice returns the texture that already exists instead of loading and uploading again.
+// The registry owns the textures it holds and deletes them in clear() or on destruction.
+//
+// Each texture keeps its size and the frame it was last used in, so the least recently used
+// ones can be evicted to stay under a budget.
+//
+// Evicted, replaced or cleared, a texture is retired to GpuHandles, deleted once the frames
+// that may still sample it are done.
+class TextureRegistry
+{
+public:
+	TextureRegistry();
+	~TextureRegistry();
+
+	TextureRegistry(const TextureRegistry&) = delete;
+	TextureRegistry& operator=(const TextureRegistry&) = delete;
+
+	static std::string key2D(const std::string& path);
+	static std::string keyCube(const std::vector<std::string>& faces);
+
+	// The texture registered under key, or 0. Counts a hit or a miss.
+	GLuint find(const std::string& key);
+	// bytes is the texture's size on the GPU, mips included
+	void add(const std::string& key, GLuint texture, uint64_t bytes = 0);
+	// Marks key's texture used in frame
+	void touch(const std::string& key, uint64_t frame);
+	void clear();
+
+	//! Deletes the least recently used textures until at most budget bytes are left.
+	// @input before Only textures last used before this frame go, the ones in use stay even
+	//		over the budget
+	// @input evicted Gets the keys of the textures deleted
+	void evict(uint64_t budget, uint64_t before, std::vector<std::string>& evicted);
+	uint64_t residentBytes() const { return bytes; }
+
+	size_t size() const { return textures.size(); }
+	size_t hits() const { return hitCount; }
+	size_t misses() const { return missCount; }
+
+private:
+	struct Slot
+	{
+		GLuint texture = 0;
+		uint64_t bytes = 0;
+		uint64_t lastUse = 0;
+	};
+
+	void destroy(Slot& slot);
+
+	std::unordered_map<std::string, Slot> textures;
+	uint64_t bytes;
+	size_t hitCount;
+	size_t missCount;
+};
+
+#endif
@@ -0,0 +1,260 @@
+#include "TextureUpload.h"
+#include "TextureCache.h"
+#include "StartupProfiler.h"
+#include "GLStats.h"
+#include "GpuMemory.h"
+#include "PixelConvert.h"
+
+#include <cstring>
+
+static bool isCompressedFormat(GLenum internalFormat)
+{
+	return internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || internalFormat == GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT_ARB;
+}
+
+// RGB formats are stored with a fourth channel, which the hardware handles natively
+static GLenum imageInternalFormat(PixelFormat format)
+{
+	switch (format) {
+	case PixelFormat::BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case PixelFormat::RGB16F: return GL_RGBA16F;
+	case PixelFormat::BC6H: return GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT_ARB;
+	default: return GL_RGBA8;
+	}
+}
+
+void allocateTextureStorage(GLenum target, GLsizei levels, GLenum internalFormat, int width, int height)
+{
+	if (GLEW_ARB_texture_storage) {
+		glTexStorage2D(target, levels, internalFormat, width, height);
+		return;
+	}
+
+	glStats().addCreation();
+	int faces = target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+	for (int face = 0; face < faces; face++) {
+		GLenum faceTarget = faces == 6 ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : target;
+		int w = width, h = height;
+		for (GLsizei level = 0; level < levels; level++) {
+			if (isCompressedFormat(internalFormat)) {
+				size_t size = internalFormat == GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT_ARB ? bc6hSize(w, h) : bc1Size(w, h);
+				glCompressedTexImage2D(faceTarget, level, internalFormat, w, h, 0, (GLsizei)size, nullptr);
+			}
+			else {
+				glTexImage2D(faceTarget, level, internalFormat, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+			}
+			w = w > 1 ? w / 2 : 1;
+			h = h > 1 ? h / 2 : 1;
+		}
+	}
+	glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, levels - 1);
+}
+
+void allocateTextureArrayStorage(GLsizei levels, GLenum internalFormat, int width, int height, int layers)
+{
+	if (GLEW_ARB_texture_storage) {
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, internalFormat, width, height, layers);
+		return;
+	}
+
+	glStats().addCreation();
+	bool depth = internalFormat == GL_DEPTH_COMPONENT16 || internalFormat == GL_DEPTH_COMPONENT24 ||
+		internalFormat == GL_DEPTH_COMPONENT32F;
+	int w = width, h = height;
+	for (GLsizei level = 0; level < levels; level++) {
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, level, internalFormat, w, h, layers, 0,
+			depth ? GL_DEPTH_COMPONENT : GL_RGBA, depth ? GL_FLOAT : GL_UNSIGNED_BYTE, nullptr);
+		w = w > 1 ? w / 2 : 1;
+		h = h > 1 ? h / 2 : 1;
+	}
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+}
+
+void allocateImageStorage(GLenum target, const Image& image)
+{
+	allocateTextureStorage(target, (GLsizei)mipLevelCount(image.width, image.height), imageInternalFormat(image.format),
+		image.width, image.height);
+}
+
+static RGBUploadLayout rgbLayout = RGB_UPLOAD_AS_IS;
+
+void setRGBUploadLayout(RGBUploadLayout layout)
+{
+	rgbLayout = layout;
+}
+
+// Uploads level i of image, true if it was staged through ring and still needs a commit
+static bool uploadLevel(GLenum faceTarget, const Image& image, size_t i, UploadRing* ring)
+{
+	const ImageLevel& level = image.levels[i];
+	// Expanded RGB8 levels are written straight into the ring, or into scratch without one
+	bool expand = image.format == PixelFormat::RGB8 && rgbLayout != RGB_UPLOAD_AS_IS;
+	size_t texels = (size_t)level.width * level.height;
+	size_t size = expand ? texels * 4 : level.size;
+
+	// With a ring the pixels pointer becomes an offset into the bound unpack buffer
+	const void* pixels = level.data;
+	GLintptr offset;
+	unsigned char* slot = ring && ring->valid() ? ring->reserve(size, offset) : nullptr;
+	if (slot) {
+		if (expand) {
+			expandRGB8(level.data, texels, slot, rgbLayout == RGB_UPLOAD_BGRA);
+		}
+		else {
+			memcpy(slot, level.data, level.size);
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring->buffer());
+		pixels = (const void*)offset;
+	}
+	else if (expand) {
+		// One per thread, the upload thread and the main thread both come through here
+		static thread_local std::vector<unsigned char> scratch;
+		scratch.resize(size);
+		expandRGB8(level.data, texels, scratch.data(), rgbLayout == RGB_UPLOAD_BGRA);
+		pixels = scratch.data();
+	}
+
+	if (image.format == PixelFormat::BC1 || image.format == PixelFormat::BC6H) {
+		glCompressedTexSubImage2D(faceTarget, (GLint)i, 0, 0, level.width, level.height,
+			imageInternalFormat(image.format), (GLsizei)level.size, pixels);
+	}
+	else if (image.format == PixelFormat::RGB16F) {
+		// Rows of 6 byte texels only line up on 2 bytes
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+		glTexSubImage2D(faceTarget, (GLint)i, 0, 0, level.width, level.height, GL_RGB,
+			GL_HALF_FLOAT, pixels);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glStats().addUpload(level.size);
+	}
+	else if (expand) {
+		glTexSubImage2D(faceTarget, (GLint)i, 0, 0, level.width, level.height,
+			rgbLayout == RGB_UPLOAD_BGRA ? GL_BGRA : GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+		glStats().addUpload(size);
+	}
+	else {
+		// Tight rows of 3 byte texels, which only line up on 4 bytes when the width does
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexSubImage2D(faceTarget, (GLint)i, 0, 0, level.width, level.height, GL_RGB,
+			GL_UNSIGNED_BYTE, pixels);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glStats().addUpload(level.size);
+	}
+
+	if (slot) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+	return slot != nullptr;
+}
+
+void uploadImageLevels(GLenum faceTarget, const Image& image, UploadRing* ring)
+{
+	bool staged = false;
+	for (size_t i = 0; i < image.levels.size(); i++) {
+		staged = uploadLevel(faceTarget, image, i, ring) || staged;
+	}
+	if (staged) {
+		ring->commit();
+	}
+}
+
+void finishImageMips(GLenum target, const Image& image)
+{
+	// The storage always has the full chain; a cache may stop short of it
+	if (image.levels.size() > 1) {
+		glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+		glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, (GLint)image.levels.size() - 1);
+	}
+	else {
+		StartupScope scope("mipmaps", target == GL_TEXTURE_CUBE_MAP ? "cubemap" : "2d");
+		glGenerateMipmap(target);
+	}
+}
+
+uint64_t imageTextureBytes(GLenum target, const Image& image)
+{
+	return textureBytes(imageInternalFormat(image.format), image.width, image.height, target == GL_TEXTURE_CUBE_MAP ? 6 : 1,
+		(int)mipLevelCount(image.width, image.height));
+}
+
+GLuint createTextureStorage(GLenum target, const Image& image)
+{
+	GLuint textureID;
+	glGenTextures(1, &textureID);
+	glActiveTexture(GL_TEXTURE0);
+
+	glBindTexture(target, textureID);
+	allocateImageStorage(target, image);
+	gpuMemory().allocate(GpuMemory::KIND_TEXTURE, textureID, imageTextureBytes(target, image), GpuMemory::TEXTURE,
+		target == GL_TEXTURE_CUBE_MAP ? "cube map" : "2D texture");
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	if (target == GL_TEXTURE_CUBE_MAP) {
+		glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	}
+	glBindTexture(target, 0);
+
+	return textureID;
+}
+
+void uploadTextureFace(GLuint texture, GLenum target, int face, const Image& image, UploadRing* ring)
+{
+	glBindTexture(target, texture);
+	uploadImageLevels(target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : target, image, ring);
+	glBindTexture(target, 0);
+}
+
+void uploadTextureLevel(GLuint texture, GLenum target, int face, const Image& image, size_t level, UploadRing* ring)
+{
+	glBindTexture(target, texture);
+	if (uploadLevel(target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : target, image, level, ring)) {
+		ring->commit();
+	}
+	glBindTexture(target, 0);
+}
+
+void clampTextureLevels(GLuint texture, GLenum target, GLint base, GLint max)
+{
+	glBindTexture(target, texture);
+	glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, base);
+	glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, max);
+	glBindTexture(target, 0);
+}
+
+void finishTexture(GLuint texture, GLenum target, const Image& image)
+{
+	glBindTexture(target, texture);
+	finishImageMips(target, image);
+	glBindTexture(target, 0);
+}
+
+GLuint createCubeTexture(const std::vector<const Image*>& faces, UploadRing* ring)
+{
+	GLuint textureID = createTextureStorage(GL_TEXTURE_CUBE_MAP, *faces[0]);
+	for (size_t i = 0; i < faces.size(); i++) {
+		uploadTextureFace(textureID, GL_TEXTURE_CUBE_MAP, (int)i, *faces[i], ring);
+	}
+	finishTexture(textureID, GL_TEXTURE_CUBE_MAP, *faces[0]);
+	return textureID;
+}
+
+GLuint create2DTexture(const Image& image, UploadRing* ring)
+{
+	GLuint textureID = createTextureStorage(GL_TEXTURE_2D, image);
+	uploadTextureFace(textureID, GL_TEXTURE_2D, 0, image, ring);
+	finishTexture(textureID, GL_TEXTURE_2D, image);
+	return textureID;
+}
+
+unsigned compressedCacheFormats()
+{
+	unsigned formats = 0;
+	if (GLEW_EXT_texture_compression_s3tc) {
+		formats |= COMPRESSED_BC1;
+	}
+	if (GLEW_ARB_texture_compression_bptc) {
+		formats |= COMPRESSED_BC6H;
+	}
+	return formats;
+}
@@ -0,0 +1,75 @@
+#ifndef _TEXTURE_UPLOAD_H_
+#define _TEXTURE_UPLOAD_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "Image.h"
+#include "UploadRing.h"
+
+// Allocates levels of internalFormat for the texture bound to target (GL_TEXTURE_2D or
+// GL_TEXTURE_CUBE_MAP, all six faces). Immutable (glTexStorage2D) where the context has
+// ARB_texture_storage, otherwise the same levels are specified one by one.
+void allocateTextureStorage(GLenum target, GLsizei levels, GLenum internalFormat, int width, int height);
+
+// Allocates levels of a GL_TEXTURE_2D_ARRAY with the given number of layers for the
+// texture bound to it. Color or depth formats, like allocateTextureStorage.
+void allocateTextureArrayStorage(GLsizei levels, GLenum internalFormat, int width, int height, int layers);
+
+// Allocates a full mip chain for image in the texture bound to target. RGB8 and RGB16F
+// images are stored as RGBA8 and RGBA16F, which the hardware handles natively, instead of
+// an unsized GL_RGB.
+void allocateImageStorage(GLenum target, const Image& image);
+
+// How RGB8 levels go to GL: as the 3 byte texels they are, which many drivers turn into
+// the RGBA8 storage on a slow path, or expanded on the CPU (expandRGB8) into RGBA or BGRA
+// texels the driver copies as they are. As they are by default.
+enum RGBUploadLayout { RGB_UPLOAD_AS_IS, RGB_UPLOAD_RGBA, RGB_UPLOAD_BGRA };
+void setRGBUploadLayout(RGBUploadLayout layout);
+
+// Uploads every level an image carries into one face of the currently bound texture,
+// which has to have been allocated with allocateImageStorage.
+// faceTarget is GL_TEXTURE_2D or one of the GL_TEXTURE_CUBE_MAP_POSITIVE_X + i faces.
+// Block compressed levels go through glCompressedTexImage2D untouched. Levels are staged
+// through ring when it is given and usable, and read from client memory otherwise.
+void uploadImageLevels(GLenum faceTarget, const Image& image, UploadRing* ring = nullptr);
+
+// Either generates the mips of a single level upload, or clamps the level range to
+// the precomputed chain, for the texture bound to target
+void finishImageMips(GLenum target, const Image& image);
+
+// What a texture made for image takes on the GPU, its full mip chain and for a cube map all
+// six faces, as GpuMemory counts it
+uint64_t imageTextureBytes(GLenum target, const Image& image);
+
+// Creates a texture in steps so that its upload can be spread over several frames:
+// storage and sampling state sized for image, then each face's levels, then the mips.
+// target is GL_TEXTURE_2D (face 0 only) or GL_TEXTURE_CUBE_MAP. Each step leaves
+// nothing bound.
+GLuint createTextureStorage(GLenum target, const Image& image);
+void uploadTextureFace(GLuint texture, GLenum target, int face, const Image& image, UploadRing* ring = nullptr);
+void finishTexture(GLuint texture, GLenum target, const Image& image);
+
+// The same a level at a time, for textures that are streamed in from their smallest mips
+// up: one level of one face, and the range of levels that may be sampled, which has to
+// be only levels every face already has
+void uploadTextureLevel(GLuint texture, GLenum target, int face, const Image& image, size_t level, UploadRing* ring = nullptr);
+void clampTextureLevels(GLuint texture, GLenum target, GLint base, GLint max);
+
+// Create a mipmapped, edge clamped texture from six cubemap faces or a 2D image in one go
+GLuint createCubeTexture(const std::vector<const Image*>& faces, UploadRing* ring = nullptr);
+GLuint create2DTexture(const Image& image, UploadRing* ring = nullptr);
+
+// The block compressed caches the context can sample, BC1 with EXT_texture_compression_s3tc
+// and BC6H with ARB_texture_compression_bptc, as CompressedFormats bits
+unsigned compressedCacheFormats();
+
+#endif
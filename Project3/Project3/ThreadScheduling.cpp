@@ -0,0 +1,235 @@
+#include "ThreadScheduling.h"
+#include "Config.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <avrt.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+
+namespace {
+
+struct Level
+{
+	const char* name;
+	int value;
+};
+
+// Windows' THREAD_PRIORITY_* values, spelled out so the settings parse the same everywhere
+const Level THREAD_LEVELS[] = { { "idle", -15 }, { "lowest", -2 }, { "below_normal", -1 }, { "normal", 0 },
+	{ "above_normal", 1 }, { "highest", 2 }, { "time_critical", 15 } };
+// AVRT_PRIORITY_*
+const Level MMCSS_LEVELS[] = { { "low", -1 }, { "normal", 0 }, { "high", 1 }, { "critical", 2 } };
+const char* PROCESS_CLASSES[] = { "normal", "above_normal", "high" };
+const char* ROLE_NAMES[] = { "render", "upload", "worker" };
+
+template <size_t N>
+bool parseLevel(const std::string& name, const Level(&levels)[N], int& value)
+{
+	for (const Level& level : levels) {
+		if (name == level.name) {
+			value = level.value;
+			return true;
+		}
+	}
+	return false;
+}
+
+template <size_t N>
+const char* levelName(int value, const Level(&levels)[N])
+{
+	for (const Level& level : levels) {
+		if (value == level.value) {
+			return level.name;
+		}
+	}
+	return "?";
+}
+
+// The MMCSS registration of the thread it belongs to
+thread_local void* mmcssTask = nullptr;
+
+}
+
+ThreadScheduling::ThreadScheduling() : processPriority(-1), renderCore(-1), isolateRender(true), configured(false),
+	registered(0), renderLevel(0)
+{
+	for (int role = 0; role < ROLES; role++) {
+		settings[role].setPriority = false;
+		settings[role].priority = 0;
+		settings[role].mmcssPriority = 0;
+		entered[role] = 0;
+		refused[role] = 0;
+	}
+}
+
+void ThreadScheduling::configure()
+{
+	for (int role = 0; role < ROLES; role++) {
+		Setting& setting = settings[role];
+		std::string prefix = std::string("threads.") + ROLE_NAMES[role];
+		std::string priority = config().getString(prefix + "_priority", "");
+		setting.setPriority = !priority.empty();
+		if (setting.setPriority && !parseLevel(priority, THREAD_LEVELS, setting.priority)) {
+			std::cerr << prefix << "_priority: " << priority << " is not a thread priority, left alone" << std::endl;
+			setting.setPriority = false;
+		}
+		setting.mmcss = config().getString(prefix + "_mmcss", "");
+		std::string mmcssPriority = config().getString(prefix + "_mmcss_priority", role == RENDER ? "high" : "normal");
+		if (!parseLevel(mmcssPriority, MMCSS_LEVELS, setting.mmcssPriority)) {
+			std::cerr << prefix << "_mmcss_priority: " << mmcssPriority << " is not an MMCSS priority, normal" << std::endl;
+			setting.mmcssPriority = 0;
+		}
+	}
+	std::string process = config().getString("threads.process_priority", "");
+	processPriority = -1;
+	for (int i = 0; i < (int)(sizeof(PROCESS_CLASSES) / sizeof(PROCESS_CLASSES[0])); i++) {
+		if (process == PROCESS_CLASSES[i]) {
+			processPriority = i;
+		}
+	}
+	if (!process.empty() && processPriority < 0) {
+		std::cerr << "threads.process_priority: " << process << " is not a priority class, left alone" << std::endl;
+	}
+	renderCore = config().getInt("threads.render_core", -1);
+	if (renderCore >= (int)std::min(std::thread::hardware_concurrency(), 64u)) {
+		std::cerr << "threads.render_core: there is no core " << renderCore << ", no affinity" << std::endl;
+		renderCore = -1;
+	}
+	isolateRender = config().getBool("threads.isolate_render", true);
+	configured = true;
+
+#ifdef _WIN32
+	static const DWORD CLASSES[] = { NORMAL_PRIORITY_CLASS, ABOVE_NORMAL_PRIORITY_CLASS, HIGH_PRIORITY_CLASS };
+	if (processPriority >= 0 && !SetPriorityClass(GetCurrentProcess(), CLASSES[processPriority])) {
+		std::cerr << "threads.process_priority: refused (" << GetLastError() << ")" << std::endl;
+	}
+#else
+	for (int role = 0; role < ROLES; role++) {
+		if (settings[role].setPriority || !settings[role].mmcss.empty()) {
+			std::cerr << "threads: thread priorities and MMCSS are Windows only, only affinity applies" << std::endl;
+			break;
+		}
+	}
+#endif
+}
+
+void ThreadScheduling::enter(Role role)
+{
+	if (!configured) {
+		return;
+	}
+	entered[role]++;
+	bool refusedAny = false;
+
+	// Affinity, to one core for the render thread, to all the others for the rest
+	bool pin = renderCore >= 0 && (role == RENDER || isolateRender);
+#ifdef _WIN32
+	const Setting& setting = settings[role];
+	if (pin) {
+		DWORD_PTR process, system;
+		GetProcessAffinityMask(GetCurrentProcess(), &process, &system);
+		DWORD_PTR core = (DWORD_PTR)1 << renderCore;
+		DWORD_PTR mask = role == RENDER ? core : process & ~core;
+		if (!mask || !SetThreadAffinityMask(GetCurrentThread(), mask)) {
+			refusedAny = true;
+		}
+	}
+	if (!setting.mmcss.empty()) {
+		DWORD taskIndex = 0;
+		HANDLE task = AvSetMmThreadCharacteristicsA(setting.mmcss.c_str(), &taskIndex);
+		if (task) {
+			AvSetMmThreadPriority(task, (AVRT_PRIORITY)setting.mmcssPriority);
+			mmcssTask = task;
+			registered++;
+		}
+		else {
+			std::cerr << "threads." << ROLE_NAMES[role] << "_mmcss: " << setting.mmcss << " refused (" << GetLastError() << ")" << std::endl;
+			refusedAny = true;
+		}
+	}
+	if (setting.setPriority && !mmcssTask && !SetThreadPriority(GetCurrentThread(), setting.priority)) {
+		refusedAny = true;
+	}
+	if (role == RENDER) {
+		renderLevel = GetThreadPriority(GetCurrentThread());
+	}
+#else
+	if (pin) {
+		cpu_set_t cores;
+		CPU_ZERO(&cores);
+		if (role == RENDER) {
+			CPU_SET(renderCore, &cores);
+		}
+		else {
+			sched_getaffinity(0, sizeof(cores), &cores);
+			CPU_CLR(renderCore, &cores);
+		}
+		if (CPU_COUNT(&cores) == 0 || pthread_setaffinity_np(pthread_self(), sizeof(cores), &cores) != 0) {
+			refusedAny = true;
+		}
+	}
+#endif
+	if (refusedAny) {
+		refused[role]++;
+	}
+}
+
+void ThreadScheduling::leave()
+{
+#ifdef _WIN32
+	if (mmcssTask) {
+		AvRevertMmThreadCharacteristics(mmcssTask);
+		mmcssTask = nullptr;
+		registered--;
+	}
+#endif
+}
+
+void ThreadScheduling::report(std::ostream& out) const
+{
+	if (!configured) {
+		return;
+	}
+	bool any = processPriority >= 0 || renderCore >= 0;
+	for (int role = 0; role < ROLES; role++) {
+		any = any || settings[role].setPriority || !settings[role].mmcss.empty();
+	}
+	if (!any) {
+		return;
+	}
+	out << "thread scheduling:";
+	if (processPriority >= 0) {
+		out << " process " << PROCESS_CLASSES[processPriority] << ",";
+	}
+	for (int role = 0; role < ROLES; role++) {
+		const Setting& setting = settings[role];
+		out << " " << ROLE_NAMES[role] << " (" << entered[role].load() << " threads";
+		if (!setting.mmcss.empty()) {
+			out << ", mmcss " << setting.mmcss << " " << levelName(setting.mmcssPriority, MMCSS_LEVELS);
+		}
+		else if (setting.setPriority) {
+			out << ", " << levelName(setting.priority, THREAD_LEVELS);
+		}
+		if (renderCore >= 0 && (role == RENDER || isolateRender)) {
+			out << (role == RENDER ? ", on core " : ", off core ") << renderCore;
+		}
+		if (refused[role]) {
+			out << ", " << refused[role].load() << " refused";
+		}
+		out << ")";
+	}
+	out << std::endl;
+}
+
+ThreadScheduling& threadScheduling()
+{
+	static ThreadScheduling scheduling;
+	return scheduling;
+}
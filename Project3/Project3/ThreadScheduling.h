@@ -0,0 +1,78 @@
+#ifndef _THREAD_SCHEDULING_H_
+#define _THREAD_SCHEDULING_H_
+
+#include <atomic>
+#include <ostream>
+#include <string>
+
+// How the OS schedules the app's threads, for stations that share the machine with
+// services that would otherwise preempt the render loop. Per role (render, upload, the
+// job system's workers), all of it off unless set:
+//
+//   threads.<role>_priority        idle, lowest, below_normal, normal, above_normal,
+//                                  highest or time_critical
+//   threads.<role>_mmcss           an MMCSS task ("Games", "Playback", "Pro Audio", ...)
+//                                  the thread registers with, which then raises it for
+//                                  as long as it runs in place of the priority above
+//   threads.<role>_mmcss_priority  low, normal, high or critical within that task
+//   threads.process_priority       the process's class: normal, above_normal or high
+//   threads.render_core            a logical core the render thread is pinned to, -1 for
+//                                  none; the upload thread and the workers then keep off
+//                                  it (threads.isolate_render)
+//
+// Each thread calls enter() once it starts and leave() before it ends, on itself, since
+// MMCSS and the thread calls work on the calling thread. Priorities and MMCSS are Windows
+// only, affinity works on Linux as well. Affinity covers the first 64 logical cores, the
+// process's processor group.
+class ThreadScheduling
+{
+public:
+	enum Role { RENDER, UPLOAD, WORKER, ROLES };
+
+	ThreadScheduling();
+
+	ThreadScheduling(const ThreadScheduling&) = delete;
+	ThreadScheduling& operator=(const ThreadScheduling&) = delete;
+
+	// Reads threads.* and sets the process's priority class, before any thread enters
+	void configure();
+	// Applies role's settings to the calling thread
+	void enter(Role role);
+	// Leaves the MMCSS task the calling thread registered with, if any
+	void leave();
+
+	// Threads registered with MMCSS right now, for telemetry
+	int mmcssThreads() const { return registered.load(std::memory_order_relaxed); }
+	// The render thread's priority as the OS has it after enter(), 0 (normal) before
+	int renderPriority() const { return renderLevel.load(std::memory_order_relaxed); }
+	bool active() const { return configured; }
+
+	// What was asked for and what each role got
+	void report(std::ostream& out) const;
+
+private:
+	struct Setting
+	{
+		// Whether priority is to be set at all, the OS's value for it if so
+		bool setPriority;
+		int priority;
+		std::string mmcss;
+		int mmcssPriority;
+	};
+
+	Setting settings[ROLES];
+	int processPriority;
+	int renderCore;
+	bool isolateRender;
+	bool configured;
+
+	std::atomic<int> registered;
+	std::atomic<int> renderLevel;
+	// Threads that entered each role and those of them the OS refused something
+	std::atomic<int> entered[ROLES];
+	std::atomic<int> refused[ROLES];
+};
+
+ThreadScheduling& threadScheduling();
+
+#endif
@@ -0,0 +1,145 @@
+#include "TiledTexture.h"
+#include "TextureCache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+const unsigned char* TiledImage::tile(uint32_t level, uint32_t x, uint32_t y) const
+{
+	const TexTiledLevel& l = levels[level];
+	return file.data() + l.offset + ((size_t)y * l.tilesX + x) * tileBytes();
+}
+
+std::string tiledTexturePath(const std::string& sourcePath)
+{
+	size_t dot = sourcePath.find_last_of('.');
+	size_t slash = sourcePath.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+		return sourcePath + ".p3vt";
+	}
+	return sourcePath.substr(0, dot) + ".p3vt";
+}
+
+bool mapTiledTexture(const char* filename, TiledImage& image)
+{
+	image.header = nullptr;
+	image.levels = nullptr;
+	if (!image.file.open(filename) || image.file.size() < sizeof(TexTiledHeader)) {
+		std::cerr << "error reading tiled texture, could not locate " << filename << std::endl;
+		image.file.close();
+		return false;
+	}
+
+	const TexTiledHeader* header = (const TexTiledHeader*)image.file.data();
+	size_t tableEnd = sizeof(TexTiledHeader) + sizeof(TexTiledLevel) * header->levelCount;
+	if (header->magic != TEXTILED_MAGIC || header->version != TEXTILED_VERSION || header->levelCount == 0 ||
+		header->tiledLevels > header->levelCount || header->tileSize == 0 || image.file.size() < tableEnd) {
+		std::cerr << "error parsing tiled texture, " << filename << " is not one" << std::endl;
+		image.file.close();
+		return false;
+	}
+
+	const TexTiledLevel* levels = (const TexTiledLevel*)(header + 1);
+	size_t tileBytes = (size_t)header->tileSize * header->tileSize * 3;
+	for (uint32_t i = 0; i < header->levelCount; i++) {
+		uint64_t size = i < header->tiledLevels ? (uint64_t)levels[i].tilesX * levels[i].tilesY * tileBytes
+			: (uint64_t)levels[i].width * levels[i].height * 3;
+		if (levels[i].offset + size > image.file.size()) {
+			std::cerr << "error parsing tiled texture, incomplete data in " << filename << std::endl;
+			image.file.close();
+			return false;
+		}
+	}
+
+	image.header = header;
+	image.levels = levels;
+	return true;
+}
+
+bool writeTiledTexture(const char* filename, const unsigned char* rgb, uint32_t width, uint32_t height,
+	uint32_t tileSize, uint64_t sourceSize, uint64_t sourceTime)
+{
+	bool powersOfTwo = (width & (width - 1)) == 0 && (height & (height - 1)) == 0 && (tileSize & (tileSize - 1)) == 0;
+	if (!powersOfTwo || tileSize == 0 || width < tileSize || height < tileSize) {
+		std::cerr << filename << ": tiled textures need power of two sides of at least a tile" << std::endl;
+		return false;
+	}
+
+	TexTiledHeader header = {};
+	header.magic = TEXTILED_MAGIC;
+	header.version = TEXTILED_VERSION;
+	header.width = width;
+	header.height = height;
+	header.tileSize = tileSize;
+	header.levelCount = mipLevelCount(width, height);
+	header.sourceSize = sourceSize;
+	header.sourceTime = sourceTime;
+
+	// Every level's place is known up front, so each is written as soon as it is made
+	std::vector<TexTiledLevel> levels(header.levelCount);
+	uint64_t offset = sizeof(TexTiledHeader) + sizeof(TexTiledLevel) * header.levelCount;
+	uint32_t w = width, h = height;
+	for (uint32_t level = 0; level < header.levelCount; level++) {
+		bool tiled = w >= tileSize && h >= tileSize;
+		if (tiled) {
+			header.tiledLevels = level + 1;
+		}
+		offset = (offset + 15) & ~(uint64_t)15;
+		levels[level].offset = offset;
+		levels[level].width = w;
+		levels[level].height = h;
+		levels[level].tilesX = tiled ? w / tileSize : 0;
+		levels[level].tilesY = tiled ? h / tileSize : 0;
+		offset += (uint64_t)w * h * 3;
+		w = std::max(1u, w / 2);
+		h = std::max(1u, h / 2);
+	}
+
+	FILE* fp = fopen(filename, "wb");
+	if (!fp) {
+		return false;
+	}
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+	ok = ok && fwrite(levels.data(), sizeof(TexTiledLevel), levels.size(), fp) == levels.size();
+	uint64_t written = sizeof(TexTiledHeader) + sizeof(TexTiledLevel) * header.levelCount;
+	static const unsigned char zeros[16] = { 0 };
+
+	std::vector<unsigned char> current(rgb, rgb + (size_t)width * height * 3);
+	w = width;
+	h = height;
+	for (uint32_t level = 0; ok && level < header.levelCount; level++) {
+		size_t pad = (size_t)(levels[level].offset - written);
+		ok = fwrite(zeros, 1, pad, fp) == pad;
+		if (level < header.tiledLevels) {
+			size_t row = (size_t)tileSize * 3;
+			for (uint32_t ty = 0; ok && ty < levels[level].tilesY; ty++) {
+				for (uint32_t tx = 0; ok && tx < levels[level].tilesX; tx++) {
+					for (uint32_t y = 0; ok && y < tileSize; y++) {
+						const unsigned char* src = current.data() + (((size_t)ty * tileSize + y) * w + (size_t)tx * tileSize) * 3;
+						ok = fwrite(src, 1, row, fp) == row;
+					}
+				}
+			}
+		}
+		else {
+			ok = ok && fwrite(current.data(), 1, current.size(), fp) == current.size();
+		}
+		written = levels[level].offset + (uint64_t)w * h * 3;
+
+		if (level + 1 < header.levelCount) {
+			uint32_t nw = std::max(1u, w / 2), nh = std::max(1u, h / 2);
+			std::vector<unsigned char> next((size_t)nw * nh * 3);
+			downsampleRGB8(current.data(), w, h, next.data(), nw, nh);
+			current.swap(next);
+			w = nw;
+			h = nh;
+		}
+	}
+	ok = (fclose(fp) == 0) && ok;
+	if (!ok) {
+		remove(filename);
+	}
+	return ok;
+}
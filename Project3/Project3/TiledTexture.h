@@ -0,0 +1,80 @@
+#ifndef _TILED_TEXTURE_H_
+#define _TILED_TEXTURE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "Image.h"
+
+// On-disk tiled texture (.p3vt): one image (or one cube map face) with its whole mip chain
+// cut into square tiles, so that a sparse texture can page in only the tiles it draws:
+//
+//   TexTiledHeader
+//   TexTiledLevel[levelCount]
+//   level data, each level starting on a 16 byte boundary
+//
+// Levels at least a tile on each side are stored tile by tile, row by row, each tile's
+// tileSize * tileSize RGB8 texels together. The smaller levels, the tail, are stored whole.
+// TexCacheBuilder --tiles writes them next to the source PPMs; VirtualTexture maps them.
+
+const uint32_t TEXTILED_MAGIC = 0x54563350; // "P3VT"
+const uint32_t TEXTILED_VERSION = 1;
+
+struct TexTiledHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	uint32_t tileSize;
+	uint32_t levelCount;
+	// Levels 0 to tiledLevels - 1 are tiles, the rest the tail
+	uint32_t tiledLevels;
+	uint32_t reserved;
+	// Size and last-write time of the source file, as in TexCacheHeader
+	uint64_t sourceSize;
+	uint64_t sourceTime;
+};
+
+struct TexTiledLevel
+{
+	// A level of 16K texels a side is most of a gigabyte
+	uint64_t offset;
+	uint32_t width;
+	uint32_t height;
+	// 0 for a tail level
+	uint32_t tilesX;
+	uint32_t tilesY;
+};
+
+// A tiled texture file viewed in place
+struct TiledImage
+{
+	MappedFile file;
+	const TexTiledHeader* header = nullptr;
+	const TexTiledLevel* levels = nullptr;
+
+	bool valid() const { return header != nullptr; }
+	size_t tileBytes() const { return (size_t)header->tileSize * header->tileSize * 3; }
+	// A tile of a tiled level, or a whole tail level
+	const unsigned char* tile(uint32_t level, uint32_t x, uint32_t y) const;
+	const unsigned char* tail(uint32_t level) const { return file.data() + levels[level].offset; }
+};
+
+// Path of the tiled file that belongs to a source image ("a/b.ppm" -> "a/b.p3vt")
+std::string tiledTexturePath(const std::string& sourcePath);
+
+//! Map a tiled texture file.
+// @input filename The .p3vt file
+// @input image Receives the mapping and its tables. If the file is missing or not a tiled
+//		texture an error message is printed and this function returns false.
+bool mapTiledTexture(const char* filename, TiledImage& image);
+
+//! Builds the full mip chain of an RGB8 image and writes it cut into tiles.
+// @input tileSize A power of two. Width and height have to be powers of two as well, at
+//		least tileSize, so that every tiled level divides into whole tiles.
+bool writeTiledTexture(const char* filename, const unsigned char* rgb, uint32_t width, uint32_t height,
+	uint32_t tileSize, uint64_t sourceSize, uint64_t sourceTime);
+
+#endif
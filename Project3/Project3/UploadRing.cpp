@@ -0,0 +1,135 @@
+#include "UploadRing.h"
+#include "GpuMemory.h"
+
+#include <iostream>
+
+// Keeps every reservation suitably aligned for any GL_UNPACK_ALIGNMENT
+static const size_t RESERVE_ALIGNMENT = 64;
+
+UploadRing::UploadRing() : pbo(0), mapped(nullptr), size(0), head(0)
+{
+}
+
+UploadRing::~UploadRing()
+{
+	shutdown();
+}
+
+bool UploadRing::init(size_t capacity)
+{
+	shutdown();
+	if (!GLEW_ARB_buffer_storage) {
+		std::cerr << "ARB_buffer_storage not supported, uploading textures from client memory" << std::endl;
+		return false;
+	}
+
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glGenBuffers(1, &pbo);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+	glBufferStorage(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)capacity, nullptr, flags);
+	mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)capacity, flags);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	if (!mapped) {
+		std::cerr << "could not map texture upload ring" << std::endl;
+		glDeleteBuffers(1, &pbo);
+		pbo = 0;
+		return false;
+	}
+	size = capacity;
+	head = 0;
+	gpuMemory().allocate(GpuMemory::KIND_BUFFER, pbo, capacity, GpuMemory::STREAMING, "texture upload ring");
+	return true;
+}
+
+void UploadRing::shutdown()
+{
+	for (Region& region : regions) {
+		if (region.fence) {
+			glDeleteSync(region.fence);
+		}
+	}
+	regions.clear();
+
+	if (pbo) {
+		if (mapped) {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
+		gpuMemory().release(GpuMemory::KIND_BUFFER, pbo);
+		glDeleteBuffers(1, &pbo);
+	}
+	pbo = 0;
+	mapped = nullptr;
+	size = 0;
+	head = 0;
+}
+
+unsigned char* UploadRing::reserve(size_t bytes, GLintptr& offset)
+{
+	if (!mapped || bytes == 0 || bytes > size) {
+		return nullptr;
+	}
+
+	retire(false);
+
+	size_t begin = (head + RESERVE_ALIGNMENT - 1) & ~(RESERVE_ALIGNMENT - 1);
+	if (begin + bytes > size) {
+		begin = 0;
+	}
+
+	while (overlapsPending(begin, begin + bytes)) {
+		// Reservations from this batch are in the way, so it has to be fenced first
+		if (!regions.front().fence) {
+			commit();
+		}
+		retire(true);
+	}
+
+	Region region = { begin, begin + bytes, nullptr };
+	regions.push_back(region);
+	head = begin + bytes;
+	offset = (GLintptr)begin;
+	return mapped + begin;
+}
+
+void UploadRing::commit()
+{
+	for (Region& region : regions) {
+		if (!region.fence) {
+			region.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		}
+	}
+}
+
+// Drops the regions the GPU is done with, oldest first. With wait set, blocks until at
+// least the oldest one is done.
+void UploadRing::retire(bool wait)
+{
+	bool waited = false;
+	while (!regions.empty() && regions.front().fence) {
+		bool block = wait && !waited;
+		GLenum result = glClientWaitSync(regions.front().fence, block ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+			block ? 1000000000ull : 0);
+		if (result == GL_TIMEOUT_EXPIRED) {
+			if (!block) {
+				return;
+			}
+			continue;
+		}
+		glDeleteSync(regions.front().fence);
+		regions.pop_front();
+		waited = true;
+	}
+}
+
+bool UploadRing::overlapsPending(size_t begin, size_t end) const
+{
+	for (const Region& region : regions) {
+		if (region.begin < end && begin < region.end) {
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,65 @@
+#ifndef _UPLOAD_RING_H_
+#define _UPLOAD_RING_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include <cstddef>
+#include <deque>
+
+// A pixel unpack buffer that stays mapped for the life of the ring (ARB_buffer_storage).
+// Pixels are written straight into the mapping and glTexImage2D sources them from the
+// buffer, so the driver copies them asynchronously instead of stalling on client memory.
+//
+// Space is handed out front to back and wraps around. Every commit() fences what was
+// reserved since the last one, and reserve() only blocks if it has caught up with a
+// range the GPU has not finished reading yet.
+class UploadRing
+{
+public:
+	UploadRing();
+	~UploadRing();
+
+	UploadRing(const UploadRing&) = delete;
+	UploadRing& operator=(const UploadRing&) = delete;
+
+	// Creates and maps the buffer. Returns false (and the ring stays unusable) if the
+	// context lacks ARB_buffer_storage, in which case callers upload from client memory.
+	bool init(size_t capacity);
+	void shutdown();
+
+	bool valid() const { return mapped != nullptr; }
+	GLuint buffer() const { return pbo; }
+	size_t capacity() const { return size; }
+
+	// Reserves bytes in the mapping and returns where to write them, with offset set to
+	// the matching offset in the buffer. Returns nullptr if bytes can never fit.
+	unsigned char* reserve(size_t bytes, GLintptr& offset);
+
+	// Fences every reservation since the last commit, after the uploads reading them
+	void commit();
+
+private:
+	struct Region
+	{
+		size_t begin;
+		size_t end;
+		GLsync fence;
+	};
+
+	void retire(bool wait);
+	bool overlapsPending(size_t begin, size_t end) const;
+
+	GLuint pbo;
+	unsigned char* mapped;
+	size_t size;
+	size_t head;
+	std::deque<Region> regions;
+};
+
+#endif
@@ -0,0 +1,131 @@
+#include "UploadScheduler.h"
+#include "Config.h"
+
+#include <algorithm>
+#include <chrono>
+
+// How much of the rate a frame's measurement moves
+static const double RATE_SMOOTHING = 0.1;
+// Jobs shorter than this are not timed into the rate, the clock says too little about them
+static const double MIN_TIMED_MS = 0.05;
+
+UploadScheduler::UploadScheduler() : minBytes(512 * 1024), maxBytes(8192 * 1024), maxMs(2.0), headroomShare(0.5f),
+	adaptive(false), frameBytes(8192 * 1024), frameDisplayTime(0.0), bytesPerMs(0.0), frames(0), budgetSum(0), spentSum(0),
+	overFrames(0)
+{
+}
+
+void UploadScheduler::configure()
+{
+	maxBytes = (size_t)std::max(config().getInt("upload.budget_kb", 8192), 1) * 1024;
+	minBytes = std::min((size_t)std::max(config().getInt("upload.min_kb", 512), 1) * 1024, maxBytes);
+	maxMs = std::max(config().getFloat("upload.budget_ms", 2.f), 0.1f);
+	headroomShare = std::min(std::max(config().getFloat("upload.headroom_share", 0.5f), 0.f), 1.f);
+	adaptive = config().getBool("upload.adaptive", false);
+	frameBytes = maxBytes;
+}
+
+void UploadScheduler::beginFrame(float gpuTime, float frameBudget, double displayTime)
+{
+	frameDisplayTime = displayTime;
+	frameBytes = maxBytes;
+	if (!adaptive || gpuTime <= 0.f || frameBudget <= 0.f || bytesPerMs <= 0.0) {
+		return;
+	}
+	// What the GPU had left of the last frame, in time, at the rate the uploads have gone at
+	double headroomMs = std::max((double)(frameBudget - gpuTime), 0.0) * 1000.0 * headroomShare;
+	double bytes = bytesPerMs * std::min(headroomMs, maxMs);
+	frameBytes = (size_t)std::min(std::max(bytes, (double)minBytes), (double)maxBytes);
+}
+
+void UploadScheduler::queue(const char* source, Priority priority, double deadline, const Job& job)
+{
+	Queued entry;
+	entry.source = source;
+	// Needed before the frame is shown, it cannot wait for a later one
+	entry.priority = deadline > 0.0 && deadline <= frameDisplayTime ? DUE : priority;
+	entry.deadline = deadline;
+	entry.job = job;
+	queued.push_back(entry);
+}
+
+UploadScheduler::Source& UploadScheduler::source(const char* name)
+{
+	for (Source& known : sources) {
+		if (known.name == name) {
+			return known;
+		}
+	}
+	Source added;
+	added.name = name;
+	added.bytes = 0;
+	added.runs = 0;
+	added.skipped = 0;
+	added.starved = 0;
+	sources.push_back(added);
+	return sources.back();
+}
+
+void UploadScheduler::service()
+{
+	std::stable_sort(queued.begin(), queued.end(), [](const Queued& a, const Queued& b) {
+		if (a.priority != b.priority) {
+			return a.priority < b.priority;
+		}
+		// No deadline comes after every deadline
+		return a.deadline > 0.0 && (b.deadline <= 0.0 || a.deadline < b.deadline);
+	});
+	size_t spent = 0;
+	double spentMs = 0.0;
+	for (const Queued& entry : queued) {
+		Source& from = source(entry.source);
+		size_t left = spent < frameBytes && spentMs < maxMs ? frameBytes - spent : 0;
+		// DUE runs whatever is left, and so does a job left out for too long, a step of it
+		if (!left && (entry.priority == DUE || from.starved >= STARVED_FRAMES)) {
+			left = 1;
+		}
+		auto start = std::chrono::steady_clock::now();
+		size_t bytes = entry.job(left);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		spent += bytes;
+		spentMs += ms;
+		if (bytes) {
+			from.bytes += bytes;
+			from.runs++;
+			from.starved = 0;
+			if (ms >= MIN_TIMED_MS) {
+				double rate = (double)bytes / ms;
+				bytesPerMs = bytesPerMs > 0.0 ? bytesPerMs + (rate - bytesPerMs) * RATE_SMOOTHING : rate;
+			}
+		}
+		else if (!left) {
+			from.skipped++;
+			from.starved++;
+		}
+	}
+	queued.clear();
+	frames++;
+	budgetSum += frameBytes;
+	spentSum += spent;
+	if (spent > frameBytes) {
+		overFrames++;
+	}
+}
+
+void UploadScheduler::report(std::ostream& out) const
+{
+	if (!spentSum) {
+		return;
+	}
+	out << "uploads: " << spentSum / 1024 << " KB in " << frames << " frames, " << (double)spentSum / (double)frames / 1024.0
+		<< " KB a frame of a " << (double)budgetSum / (double)frames / 1024.0 << " KB budget" << (adaptive ? " (adaptive)" : "")
+		<< ", over it in " << overFrames << " frames";
+	if (bytesPerMs > 0.0) {
+		out << ", " << bytesPerMs * 1000.0 / (1024.0 * 1024.0) << " MB/s";
+	}
+	out << std::endl;
+	for (const Source& from : sources) {
+		out << "  " << from.name << ": " << from.bytes / 1024 << " KB in " << from.runs << " frames, left out of " << from.skipped
+			<< std::endl;
+	}
+}
@@ -0,0 +1,100 @@
+#ifndef _UPLOAD_SCHEDULER_H_
+#define _UPLOAD_SCHEDULER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// One upload budget a frame for everything that streams to the GPU: the environments and
+// their mips (AssetRegistry), the virtual sky's tiles, the prop atlas's pages and the video's
+// frames. Each of them used to take upload.budget_kb of its own, and a skybox swap, a video
+// frame and new props landing in the same frame made it late.
+//
+// Every frame the streams queue a job each, and service() runs them in priority order within
+// the frame's budget:
+//
+//   DUE       has to be in for this frame (a video frame at its display time). Runs whatever
+//             is left of the budget, and counts against it.
+//   VISIBLE   drawn without it now, or coarser (the sky's missing tiles, the atlas pages the
+//             props asked for, a skybox being swapped to)
+//   PREFETCH  not drawn yet
+//
+// Within a priority the earlier deadline goes first, and a job with a deadline before the
+// frame is shown is DUE. A job the budget does not reach is still called, with 0, for its
+// bookkeeping; one left out for STARVED_FRAMES frames in a row gets a step's worth anyway.
+//
+// The budget is upload.budget_kb. With upload.adaptive it follows the GPU's headroom instead:
+// upload.headroom_share of what the last frame left of its budget, at the rate the uploads
+// went at, from upload.min_kb up to upload.budget_kb. upload.budget_ms caps the time the
+// jobs take on the CPU in a frame, DUE ones aside.
+class UploadScheduler
+{
+public:
+	enum Priority { DUE, VISIBLE, PREFETCH, PRIORITIES };
+	enum { STARVED_FRAMES = 30 };
+	// Uploads at most about budget bytes, and at least a step's worth unless budget is 0,
+	// which only does the bookkeeping. Returns the bytes uploaded.
+	typedef std::function<size_t(size_t budget)> Job;
+
+	UploadScheduler();
+
+	// Reads upload.*
+	void configure();
+	//! Starts a frame: its budget from the GPU's last frame.
+	// @input gpuTime, frameBudget Seconds, 0 when not known
+	// @input displayTime When the frame is shown, the deadline DUE goes by
+	void beginFrame(float gpuTime, float frameBudget, double displayTime);
+	//! Queues a job for this frame
+	// @input deadline When it is needed by (seconds, display time), 0 for no deadline
+	void queue(const char* source, Priority priority, double deadline, const Job& job);
+	//! Runs the jobs queued in their order, and forgets them
+	void service();
+
+	// This frame's budget in bytes
+	size_t budget() const { return frameBytes; }
+	void report(std::ostream& out) const;
+
+private:
+	struct Queued
+	{
+		const char* source;
+		Priority priority;
+		double deadline;
+		Job job;
+	};
+	struct Source
+	{
+		std::string name;
+		uint64_t bytes;
+		uint64_t runs;
+		// Frames it was left out of, and how many of them in a row now
+		uint64_t skipped;
+		int starved;
+	};
+
+	Source& source(const char* name);
+
+	size_t minBytes;
+	size_t maxBytes;
+	double maxMs;
+	float headroomShare;
+	bool adaptive;
+
+	size_t frameBytes;
+	double frameDisplayTime;
+	std::vector<Queued> queued;
+	std::vector<Source> sources;
+	// Bytes a millisecond the jobs uploaded at, smoothed over the frames, 0 until measured
+	double bytesPerMs;
+
+	uint64_t frames;
+	uint64_t budgetSum;
+	uint64_t spentSum;
+	// Frames whose jobs together went over the budget, the DUE ones or a step's worth more
+	uint64_t overFrames;
+};
+
+#endif
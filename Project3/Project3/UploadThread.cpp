@@ -0,0 +1,149 @@
+#include "UploadThread.h"
+#include "CpuProfiler.h"
+#include "ThreadScheduling.h"
+
+#include <iostream>
+
+UploadThread::UploadThread() : window(nullptr), working(false), stopping(false)
+{
+}
+
+UploadThread::~UploadThread()
+{
+	if (thread.joinable()) {
+		stop();
+	}
+}
+
+bool UploadThread::start(GLFWwindow* shared)
+{
+	if (window) {
+		return true;
+	}
+	// The hints of the shared window still hold, its context is made the same way
+	glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+	window = glfwCreateWindow(1, 1, "upload", nullptr, shared);
+	glfwWindowHint(GLFW_VISIBLE, GL_TRUE);
+	if (!window) {
+		std::cerr << "no shared upload context, uploading on the render thread" << std::endl;
+		return false;
+	}
+	stopping = false;
+	thread = std::thread([this] { run(); });
+	return true;
+}
+
+void UploadThread::stop()
+{
+	if (!window) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	thread.join();
+	// Whoever submitted these is gone by now, their callbacks have nothing left to give to
+	submitted.clear();
+	glfwDestroyWindow(window);
+	window = nullptr;
+}
+
+void UploadThread::run()
+{
+	glfwMakeContextCurrent(window);
+	cpuProfiler().nameThread("upload");
+	threadScheduling().enter(ThreadScheduling::UPLOAD);
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		wake.wait(lock, [this] { return stopping || !queued.empty(); });
+		if (queued.empty()) {
+			break;
+		}
+		Task task = std::move(queued.front());
+		queued.pop_front();
+		working = true;
+		lock.unlock();
+		{
+			CpuScope scope("upload task");
+			task.work();
+		}
+		task.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		// A fence another context waits on has to reach the GPU first
+		glFlush();
+		lock.lock();
+		submitted.push_back(std::move(task));
+		working = false;
+		idle.notify_all();
+	}
+	// The fences of tasks never collected go with the context
+	for (Task& task : submitted) {
+		glDeleteSync(task.fence);
+	}
+	lock.unlock();
+	threadScheduling().leave();
+	glfwMakeContextCurrent(nullptr);
+}
+
+void UploadThread::submit(std::function<void()> work, std::function<void()> done)
+{
+	Task task;
+	task.work = std::move(work);
+	task.done = std::move(done);
+	task.fence = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queued.push_back(std::move(task));
+	}
+	wake.notify_one();
+}
+
+void UploadThread::poll()
+{
+	while (true) {
+		Task task;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (submitted.empty()) {
+				return;
+			}
+			// In order, a later task may use what an earlier one made
+			GLenum status = glClientWaitSync(submitted.front().fence, 0, 0);
+			if (status == GL_TIMEOUT_EXPIRED) {
+				return;
+			}
+			task = std::move(submitted.front());
+			submitted.pop_front();
+		}
+		glDeleteSync(task.fence);
+		task.done();
+	}
+}
+
+void UploadThread::finish()
+{
+	std::deque<Task> tasks;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		idle.wait(lock, [this] { return queued.empty() && !working; });
+		tasks.swap(submitted);
+	}
+	for (Task& task : tasks) {
+		glWaitSync(task.fence, 0, GL_TIMEOUT_IGNORED);
+		glDeleteSync(task.fence);
+		task.done();
+	}
+}
+
+size_t UploadThread::outstanding() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return queued.size() + submitted.size() + (working ? 1 : 0);
+}
+
+UploadThread& uploadThread()
+{
+	static UploadThread instance;
+	return instance;
+}
@@ -0,0 +1,86 @@
+#ifndef _UPLOAD_THREAD_H_
+#define _UPLOAD_THREAD_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// A second GL context, shared with the one everything draws into, current on a thread of
+// its own that only uploads. Textures and buffers are created, filled and mipped there while
+// the render thread goes on drawing.
+//
+// Each task's work ends with a fence. Its done callback runs on the render thread, from
+// poll(), only once the GPU is past that fence, so nothing is handed out half written and
+// the render thread never waits for the upload. finish() is for whoever cannot go on
+// without a result: the render context's commands wait on the fences instead (glWaitSync),
+// its thread only for the work to be submitted.
+//
+// The work runs without the render thread's GLState cache (it binds directly) and without
+// an UploadRing, whose buffer is the render thread's. GpuMemory records from both threads.
+class UploadThread
+{
+public:
+	UploadThread();
+	~UploadThread();
+
+	UploadThread(const UploadThread&) = delete;
+	UploadThread& operator=(const UploadThread&) = delete;
+
+	//! Makes a hidden window whose context shares with shared's, and the thread it is
+	// current on. Call from the main thread, which GLFW needs for windows. False if the
+	// context could not be made, uploads then stay on the render thread.
+	bool start(GLFWwindow* shared);
+	//! Runs what is queued, then ends the thread and deletes the window. Main thread.
+	void stop();
+	bool running() const { return window != nullptr; }
+
+	//! Queues work to run with the upload context current. done then runs on the render
+	// thread once the GPU has finished the work.
+	void submit(std::function<void()> work, std::function<void()> done);
+
+	// Runs the done callbacks of the tasks the GPU has finished, in the order submitted,
+	// without waiting. Render thread, once a frame.
+	void poll();
+	// Waits for every task submitted so far to be submitted to the GPU, makes the render
+	// context wait for them, and runs their done callbacks. Render thread.
+	void finish();
+
+	// Tasks submitted whose done has not run yet
+	size_t outstanding() const;
+
+private:
+	struct Task
+	{
+		std::function<void()> work;
+		std::function<void()> done;
+		GLsync fence;
+	};
+
+	void run();
+
+	GLFWwindow* window;
+	std::thread thread;
+	mutable std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable idle;
+	std::deque<Task> queued;
+	// Worked on, waiting for the GPU and for poll() or finish()
+	std::deque<Task> submitted;
+	bool working;
+	bool stopping;
+};
+
+// The upload context of the GL context everything draws into
+UploadThread& uploadThread();
+
+#endif
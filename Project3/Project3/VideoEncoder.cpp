@@ -0,0 +1,233 @@
+#include "VideoEncoder.h"
+#include "Log.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <d3d11.h>
+#include <mfapi.h>
+#include <mfidl.h>
+#include <mfreadwrite.h>
+#include <mferror.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+VideoEncoder::VideoEncoder() : writer(nullptr), deviceManager(nullptr), device(nullptr), stream(0), width(0), height(0),
+	frameDuration(0), firstTime(-1.), lastSampleTime(-1), hardwareEncoder(false), started(false), comInitialized(false)
+{
+}
+
+VideoEncoder::~VideoEncoder()
+{
+	close();
+}
+
+#ifdef _WIN32
+template <typename T>
+static void release(T*& object)
+{
+	if (object) {
+		object->Release();
+		object = nullptr;
+	}
+}
+
+// Whether the sink writer's encoder for stream is a hardware MFT
+static bool encoderIsHardware(IMFSinkWriter* writer, DWORD stream)
+{
+	IMFSinkWriterEx* writerEx = nullptr;
+	if (FAILED(writer->QueryInterface(__uuidof(IMFSinkWriterEx), (void**)&writerEx))) {
+		return false;
+	}
+	bool hardware = false;
+	GUID category;
+	IMFTransform* transform = nullptr;
+	for (DWORD i = 0; SUCCEEDED(writerEx->GetTransformForStream(stream, i, &category, &transform)); i++) {
+		if (category == MFT_CATEGORY_VIDEO_ENCODER) {
+			IMFAttributes* attributes = nullptr;
+			UINT32 length = 0;
+			if (SUCCEEDED(transform->GetAttributes(&attributes)) && attributes) {
+				hardware = SUCCEEDED(attributes->GetStringLength(MFT_ENUM_HARDWARE_URL_Attribute, &length));
+				attributes->Release();
+			}
+		}
+		transform->Release();
+	}
+	writerEx->Release();
+	return hardware;
+}
+
+static IMFMediaType* videoType(const GUID& subtype, int width, int height, double fps)
+{
+	IMFMediaType* type = nullptr;
+	if (FAILED(MFCreateMediaType(&type))) {
+		return nullptr;
+	}
+	type->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video);
+	type->SetGUID(MF_MT_SUBTYPE, subtype);
+	type->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive);
+	MFSetAttributeSize(type, MF_MT_FRAME_SIZE, (UINT32)width, (UINT32)height);
+	MFSetAttributeRatio(type, MF_MT_FRAME_RATE, (UINT32)(fps * 1000. + 0.5), 1000);
+	MFSetAttributeRatio(type, MF_MT_PIXEL_ASPECT_RATIO, 1, 1);
+	return type;
+}
+#endif
+
+bool VideoEncoder::open(const std::string& filename, int frameWidth, int frameHeight, double fps, Codec codec, uint32_t bitrate)
+{
+	close();
+#ifdef _WIN32
+	const char* codecName = codec == HEVC ? "HEVC" : "H.264";
+	comInitialized = SUCCEEDED(CoInitializeEx(nullptr, COINIT_MULTITHREADED));
+	if (FAILED(MFStartup(MF_VERSION))) {
+		std::cerr << "capture: no Media Foundation, cannot encode " << filename << std::endl;
+		close();
+		return false;
+	}
+	started = true;
+	width = frameWidth;
+	height = frameHeight;
+	fps = fps > 0. ? fps : 90.;
+
+	// A device for the writer's colour conversion and a hardware encoder to run on, on the
+	// default adapter the way the driver hints (GpuAdapter.cpp) leave it
+	UINT token = 0;
+	if (SUCCEEDED(D3D11CreateDevice(nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr, D3D11_CREATE_DEVICE_VIDEO_SUPPORT,
+		nullptr, 0, D3D11_SDK_VERSION, &device, nullptr, nullptr))) {
+		ID3D10Multithread* multithread = nullptr;
+		if (SUCCEEDED(device->QueryInterface(__uuidof(ID3D10Multithread), (void**)&multithread))) {
+			multithread->SetMultithreadProtected(TRUE);
+			multithread->Release();
+		}
+		if (FAILED(MFCreateDXGIDeviceManager(&token, &deviceManager)) || FAILED(deviceManager->ResetDevice(device, token))) {
+			release(deviceManager);
+		}
+	}
+
+	IMFAttributes* attributes = nullptr;
+	MFCreateAttributes(&attributes, 3);
+	attributes->SetUINT32(MF_READWRITE_ENABLE_HARDWARE_TRANSFORMS, TRUE);
+	attributes->SetUINT32(MF_SINK_WRITER_DISABLE_THROTTLING, FALSE);
+	if (deviceManager) {
+		attributes->SetUnknown(MF_SINK_WRITER_D3D_MANAGER, deviceManager);
+	}
+	std::wstring url(filename.begin(), filename.end());
+	HRESULT hr = MFCreateSinkWriterFromURL(url.c_str(), nullptr, attributes, &writer);
+	release(attributes);
+
+	IMFMediaType* output = nullptr;
+	IMFMediaType* input = nullptr;
+	if (SUCCEEDED(hr)) {
+		output = videoType(codec == HEVC ? MFVideoFormat_HEVC : MFVideoFormat_H264, width, height, fps);
+		input = videoType(MFVideoFormat_RGB32, width, height, fps);
+		hr = output && input ? S_OK : E_OUTOFMEMORY;
+	}
+	if (SUCCEEDED(hr)) {
+		output->SetUINT32(MF_MT_AVG_BITRATE, bitrate);
+		// The rows as GL reads them, bottom up
+		input->SetUINT32(MF_MT_DEFAULT_STRIDE, (UINT32)(-width * 4));
+		hr = writer->AddStream(output, &stream);
+	}
+	if (SUCCEEDED(hr)) {
+		hr = writer->SetInputMediaType(stream, input, nullptr);
+	}
+	if (SUCCEEDED(hr)) {
+		hr = writer->BeginWriting();
+	}
+	release(output);
+	release(input);
+	if (FAILED(hr)) {
+		std::cerr << "capture: no " << codecName << " encoder for " << width << "x" << height << " (0x" << std::hex << hr << std::dec
+			<< "), cannot write " << filename << std::endl;
+		close();
+		return false;
+	}
+
+	frameDuration = (int64_t)(1e7 / fps);
+	firstTime = -1.;
+	lastSampleTime = -1;
+	hardwareEncoder = encoderIsHardware(writer, stream);
+	if (hardwareEncoder) {
+		logStream(LOG_INFO) << "capture: " << filename << ", " << codecName << " on the GPU's encoder, " << bitrate / 1000000.f << " Mbit/s" << std::endl;
+	}
+	else {
+		std::cerr << "WARNING: capture: " << filename << " is encoded in software, the GPU has no " << codecName
+			<< " encoder Media Foundation can use, expect it to cost the frame" << std::endl;
+	}
+	return true;
+#else
+	(void)frameWidth;
+	(void)frameHeight;
+	(void)fps;
+	(void)codec;
+	(void)bitrate;
+	std::cerr << "capture: video encoding needs Media Foundation, cannot write " << filename << std::endl;
+	return false;
+#endif
+}
+
+void VideoEncoder::close()
+{
+#ifdef _WIN32
+	if (writer) {
+		writer->Finalize();
+	}
+	release(writer);
+	release(deviceManager);
+	release(device);
+	if (started) {
+		MFShutdown();
+	}
+	if (comInitialized) {
+		CoUninitialize();
+	}
+#endif
+	started = false;
+	comInitialized = false;
+	hardwareEncoder = false;
+}
+
+bool VideoEncoder::write(const unsigned char* bgra, double time)
+{
+#ifdef _WIN32
+	if (!writer) {
+		return false;
+	}
+	const DWORD bytes = (DWORD)width * height * 4;
+	IMFMediaBuffer* buffer = nullptr;
+	IMFSample* sample = nullptr;
+	HRESULT hr = MFCreateMemoryBuffer(bytes, &buffer);
+	BYTE* data = nullptr;
+	if (SUCCEEDED(hr)) {
+		hr = buffer->Lock(&data, nullptr, nullptr);
+	}
+	if (SUCCEEDED(hr)) {
+		memcpy(data, bgra, bytes);
+		buffer->Unlock();
+		buffer->SetCurrentLength(bytes);
+		hr = MFCreateSample(&sample);
+	}
+	if (SUCCEEDED(hr)) {
+		sample->AddBuffer(buffer);
+		// Stamped with when the frame was captured, a dropped frame leaves a gap rather than
+		// speeding the video up
+		if (firstTime < 0.) {
+			firstTime = time;
+		}
+		int64_t sampleTime = std::max((int64_t)((time - firstTime) * 1e7), lastSampleTime + 1);
+		lastSampleTime = sampleTime;
+		sample->SetSampleTime(sampleTime);
+		sample->SetSampleDuration(frameDuration);
+		hr = writer->WriteSample(stream, sample);
+	}
+	release(sample);
+	release(buffer);
+	return SUCCEEDED(hr);
+#else
+	(void)bgra;
+	(void)time;
+	return false;
+#endif
+}
@@ -0,0 +1,61 @@
+#ifndef _VIDEO_ENCODER_H_
+#define _VIDEO_ENCODER_H_
+
+#include <cstdint>
+#include <string>
+
+struct IMFSinkWriter;
+struct IMFDXGIDeviceManager;
+struct ID3D11Device;
+
+// An H.264 or HEVC file written through Media Foundation's sink writer, which picks the GPU's
+// encoder (NVENC, AMF, Quick Sync, each shipped as a hardware MFT by its driver) when there
+// is one. The writer is given a D3D11 device of its own, so the conversion from BGRA to the
+// encoder's NV12 runs on the GPU as well, the CPU only copies each frame into a media buffer.
+// open() says which encoder it got, a software one is warned about: next to the headset's
+// renderer it is not fast enough for anything past the smallest streams.
+//
+// Frames are bottom-up BGRA, as glReadPixels gives them with GL_BGRA. Everything is called
+// from one thread, which gets COM and Media Foundation for as long as a file is open.
+// Elsewhere than Windows open() fails.
+class VideoEncoder
+{
+public:
+	enum Codec { H264, HEVC };
+
+	VideoEncoder();
+	~VideoEncoder();
+
+	VideoEncoder(const VideoEncoder&) = delete;
+	VideoEncoder& operator=(const VideoEncoder&) = delete;
+
+	//! Starts a file, the container follows filename's extension (.mp4).
+	// @input width, height Even, what the encoders ask for
+	// @input fps The nominal frame rate, the frames' own times are what is written
+	// @input bitrate In bits per second
+	// @return false if there is no encoder for the codec or the file could not be made
+	bool open(const std::string& filename, int width, int height, double fps, Codec codec, uint32_t bitrate);
+	// Finishes the file, after which it plays
+	void close();
+	bool valid() const { return writer != nullptr; }
+	bool hardware() const { return hardwareEncoder; }
+
+	//! Encodes a frame shown at time (seconds, any origin, increasing)
+	bool write(const unsigned char* bgra, double time);
+
+private:
+	IMFSinkWriter* writer;
+	IMFDXGIDeviceManager* deviceManager;
+	ID3D11Device* device;
+	unsigned long stream;
+	int width;
+	int height;
+	int64_t frameDuration;
+	double firstTime;
+	int64_t lastSampleTime;
+	bool hardwareEncoder;
+	bool started;
+	bool comInitialized;
+};
+
+#endif
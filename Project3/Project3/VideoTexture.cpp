@@ -0,0 +1,382 @@
+#include "VideoTexture.h"
+#include "GLMarkers.h"
+#include "CpuProfiler.h"
+#include "Log.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <GL/wglew.h>
+#include <d3d11.h>
+#include <mfapi.h>
+#include <mfidl.h>
+#include <mfreadwrite.h>
+#include <mferror.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+// Decoded frames kept ahead of the one shown
+static const size_t FRAMES_AHEAD = 3;
+
+VideoTexture::VideoTexture() : reader(nullptr), deviceManager(nullptr), device(nullptr), context(nullptr),
+	interopDevice(nullptr), targets{ nullptr, nullptr }, interopObjects{ nullptr, nullptr }, glTextures{ 0, 0 }, front(-1),
+	frameWidth(0), frameHeight(0), loop(false), startTime(-1.), shownFrames(0), droppedFrames(0), mediaFoundation(false), failed(false),
+	stopping(false), ended(false)
+{
+}
+
+VideoTexture::~VideoTexture()
+{
+	close();
+}
+
+#ifdef _WIN32
+template <typename T>
+static void release(T*& object)
+{
+	if (object) {
+		object->Release();
+		object = nullptr;
+	}
+}
+#endif
+
+bool VideoTexture::open(const std::string& filename, bool loopAtEnd)
+{
+	close();
+#ifdef _WIN32
+	if (!WGLEW_NV_DX_interop) {
+		std::cerr << "video: WGL_NV_DX_interop not supported, cannot play " << filename << std::endl;
+		return false;
+	}
+	if (FAILED(MFStartup(MF_VERSION))) {
+		std::cerr << "video: no Media Foundation, cannot play " << filename << std::endl;
+		return false;
+	}
+	mediaFoundation = true;
+	UINT token = 0;
+	HRESULT hr = D3D11CreateDevice(nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr,
+		D3D11_CREATE_DEVICE_VIDEO_SUPPORT | D3D11_CREATE_DEVICE_BGRA_SUPPORT, nullptr, 0, D3D11_SDK_VERSION, &device, nullptr, &context);
+	if (SUCCEEDED(hr)) {
+		// The decoder uses the device from its own thread, the copies from this one
+		ID3D10Multithread* multithread = nullptr;
+		if (SUCCEEDED(device->QueryInterface(__uuidof(ID3D10Multithread), (void**)&multithread))) {
+			multithread->SetMultithreadProtected(TRUE);
+			multithread->Release();
+		}
+		hr = MFCreateDXGIDeviceManager(&token, &deviceManager);
+	}
+	if (SUCCEEDED(hr)) {
+		hr = deviceManager->ResetDevice(device, token);
+	}
+	IMFAttributes* attributes = nullptr;
+	if (SUCCEEDED(hr)) {
+		hr = MFCreateAttributes(&attributes, 3);
+	}
+	if (SUCCEEDED(hr)) {
+		attributes->SetUnknown(MF_SOURCE_READER_D3D_MANAGER, deviceManager);
+		attributes->SetUINT32(MF_READWRITE_ENABLE_HARDWARE_TRANSFORMS, TRUE);
+		// Colour conversion to the BGRA asked for below, on the device
+		attributes->SetUINT32(MF_SOURCE_READER_ENABLE_ADVANCED_VIDEO_PROCESSING, TRUE);
+		std::wstring url(filename.begin(), filename.end());
+		hr = MFCreateSourceReaderFromURL(url.c_str(), attributes, &reader);
+	}
+	release(attributes);
+	if (SUCCEEDED(hr)) {
+		reader->SetStreamSelection((DWORD)MF_SOURCE_READER_ALL_STREAMS, FALSE);
+		hr = reader->SetStreamSelection((DWORD)MF_SOURCE_READER_FIRST_VIDEO_STREAM, TRUE);
+	}
+	IMFMediaType* type = nullptr;
+	if (SUCCEEDED(hr)) {
+		hr = MFCreateMediaType(&type);
+	}
+	if (SUCCEEDED(hr)) {
+		type->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video);
+		type->SetGUID(MF_MT_SUBTYPE, MFVideoFormat_ARGB32);
+		hr = reader->SetCurrentMediaType((DWORD)MF_SOURCE_READER_FIRST_VIDEO_STREAM, nullptr, type);
+	}
+	release(type);
+	if (SUCCEEDED(hr)) {
+		hr = reader->GetCurrentMediaType((DWORD)MF_SOURCE_READER_FIRST_VIDEO_STREAM, &type);
+	}
+	if (SUCCEEDED(hr)) {
+		UINT32 width = 0, height = 0;
+		hr = MFGetAttributeSize(type, MF_MT_FRAME_SIZE, &width, &height);
+		frameWidth = (int)width;
+		frameHeight = (int)height;
+	}
+	release(type);
+	if (SUCCEEDED(hr)) {
+		interopDevice = wglDXOpenDeviceNV(device);
+		hr = interopDevice ? S_OK : E_FAIL;
+	}
+	if (FAILED(hr)) {
+		std::cerr << "video: cannot play " << filename << " (0x" << std::hex << hr << std::dec << ")" << std::endl;
+		close();
+		return false;
+	}
+
+	readFbo.create();
+	drawFbo.create();
+	glMarkers().label(GL_FRAMEBUFFER, readFbo, "video read");
+	glMarkers().label(GL_FRAMEBUFFER, drawFbo, "video draw");
+	loop = loopAtEnd;
+	startTime = -1.;
+	stopping = false;
+	ended = false;
+	decoder = std::thread(&VideoTexture::run, this);
+	logStream(LOG_INFO) << "video: " << filename << ", " << frameWidth << "x" << frameHeight << std::endl;
+	return true;
+#else
+	(void)loopAtEnd;
+	std::cerr << "video: playing needs Media Foundation and WGL_NV_DX_interop, cannot play " << filename << std::endl;
+	return false;
+#endif
+}
+
+void VideoTexture::close()
+{
+#ifdef _WIN32
+	if (decoder.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		decoder.join();
+	}
+	for (Frame& frame : decoded) {
+		frame.sample->Release();
+	}
+	decoded.clear();
+	if (front >= 0) {
+		wglDXUnlockObjectsNV(interopDevice, 1, &interopObjects[front]);
+	}
+	for (int i = 0; i < 2; i++) {
+		if (interopObjects[i]) {
+			wglDXUnregisterObjectNV(interopDevice, interopObjects[i]);
+			interopObjects[i] = nullptr;
+		}
+		if (glTextures[i]) {
+			glDeleteTextures(1, &glTextures[i]);
+			glTextures[i] = 0;
+		}
+		release(targets[i]);
+	}
+	if (interopDevice) {
+		wglDXCloseDeviceNV(interopDevice);
+		interopDevice = nullptr;
+	}
+	release(reader);
+	release(deviceManager);
+	release(context);
+	release(device);
+	if (mediaFoundation) {
+		MFShutdown();
+		mediaFoundation = false;
+	}
+#endif
+	readFbo.reset();
+	drawFbo.reset();
+	front = -1;
+	failed = false;
+	frameWidth = frameHeight = 0;
+	if (shownFrames) {
+		logStream(LOG_INFO) << "video: " << shownFrames << " frames shown, " << droppedFrames << " dropped" << std::endl;
+	}
+	shownFrames = droppedFrames = 0;
+}
+
+// The two interop textures, once the first frame says what the decoder makes
+bool VideoTexture::createTargets(ID3D11Texture2D* like)
+{
+#ifdef _WIN32
+	D3D11_TEXTURE2D_DESC desc;
+	memset(&desc, 0, sizeof(desc));
+	if (like) {
+		like->GetDesc(&desc);
+	}
+	else {
+		desc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+	}
+	desc.Width = (UINT)frameWidth;
+	desc.Height = (UINT)frameHeight;
+	desc.MipLevels = 1;
+	desc.ArraySize = 1;
+	desc.SampleDesc.Count = 1;
+	desc.SampleDesc.Quality = 0;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	desc.CPUAccessFlags = 0;
+	desc.MiscFlags = 0;
+	for (int i = 0; i < 2; i++) {
+		if (FAILED(device->CreateTexture2D(&desc, nullptr, &targets[i]))) {
+			return false;
+		}
+		glGenTextures(1, &glTextures[i]);
+		interopObjects[i] = wglDXRegisterObjectNV(interopDevice, targets[i], glTextures[i], GL_TEXTURE_2D, WGL_ACCESS_READ_ONLY_NV);
+		if (!interopObjects[i]) {
+			std::cerr << "video: GL cannot share the decoder's format " << desc.Format << std::endl;
+			return false;
+		}
+	}
+	return true;
+#else
+	(void)like;
+	return false;
+#endif
+}
+
+bool VideoTexture::update(double displayTime)
+{
+	if (!valid()) {
+		return false;
+	}
+#ifdef _WIN32
+	CpuScope scope("video update");
+	if (startTime < 0.) {
+		startTime = displayTime;
+	}
+	double time = displayTime - startTime;
+	IMFSample* due = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		while (!decoded.empty() && decoded.front().time <= time) {
+			if (due) {
+				due->Release();
+				droppedFrames++;
+			}
+			due = decoded.front().sample;
+			decoded.pop_front();
+		}
+	}
+	if (!due) {
+		return false;
+	}
+	wake.notify_all();
+
+	IMFMediaBuffer* buffer = nullptr;
+	IMFDXGIBuffer* dxgiBuffer = nullptr;
+	ID3D11Texture2D* decodedTexture = nullptr;
+	UINT subresource = 0;
+	if (SUCCEEDED(due->GetBufferByIndex(0, &buffer))
+		&& SUCCEEDED(buffer->QueryInterface(__uuidof(IMFDXGIBuffer), (void**)&dxgiBuffer))) {
+		dxgiBuffer->GetResource(__uuidof(ID3D11Texture2D), (void**)&decodedTexture);
+		dxgiBuffer->GetSubresourceIndex(&subresource);
+	}
+	bool shown = false;
+	if (!targets[0] && !createTargets(decodedTexture)) {
+		// Nothing GL could share, playing stops here
+		std::cerr << "video: no texture to show the frames in, stopped" << std::endl;
+		failed = true;
+	}
+	else if (buffer) {
+		int back = front < 0 ? 0 : 1 - front;
+		if (decodedTexture) {
+			context->CopySubresourceRegion(targets[back], 0, 0, 0, 0, decodedTexture, subresource, nullptr);
+		}
+		else {
+			// A software decoder's frame, in system memory
+			BYTE* data = nullptr;
+			DWORD length = 0;
+			if (SUCCEEDED(buffer->Lock(&data, nullptr, &length))) {
+				context->UpdateSubresource(targets[back], 0, nullptr, data, (UINT)frameWidth * 4, 0);
+				buffer->Unlock();
+			}
+		}
+		wglDXLockObjectsNV(interopDevice, 1, &interopObjects[back]);
+		if (front >= 0) {
+			wglDXUnlockObjectsNV(interopDevice, 1, &interopObjects[front]);
+		}
+		front = back;
+		shownFrames++;
+		shown = true;
+	}
+	release(decodedTexture);
+	release(dxgiBuffer);
+	release(buffer);
+	due->Release();
+	return shown;
+#else
+	(void)displayTime;
+	return false;
+#endif
+}
+
+void VideoTexture::run()
+{
+#ifdef _WIN32
+	CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+	// Where the current pass through the file starts on the video's clock, for looping
+	double passStart = 0.;
+	double lastTime = 0.;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this] { return stopping || (!ended && decoded.size() < FRAMES_AHEAD); });
+			if (stopping) {
+				break;
+			}
+		}
+		DWORD flags = 0;
+		LONGLONG timestamp = 0;
+		IMFSample* sample = nullptr;
+		HRESULT hr = reader->ReadSample((DWORD)MF_SOURCE_READER_FIRST_VIDEO_STREAM, 0, nullptr, &flags, &timestamp, &sample);
+		if (FAILED(hr) || (flags & MF_SOURCE_READERF_ERROR)) {
+			std::cerr << "video: decoding failed (0x" << std::hex << hr << std::dec << "), stopped" << std::endl;
+			std::lock_guard<std::mutex> lock(mutex);
+			ended = true;
+			continue;
+		}
+		if (sample) {
+			lastTime = passStart + timestamp * 1e-7;
+			std::lock_guard<std::mutex> lock(mutex);
+			decoded.push_back({ sample, lastTime });
+		}
+		if (flags & MF_SOURCE_READERF_ENDOFSTREAM) {
+			if (!loop) {
+				std::lock_guard<std::mutex> lock(mutex);
+				ended = true;
+				continue;
+			}
+			PROPVARIANT position;
+			PropVariantInit(&position);
+			position.vt = VT_I8;
+			position.hVal.QuadPart = 0;
+			reader->SetCurrentPosition(GUID_NULL, position);
+			PropVariantClear(&position);
+			// The next pass goes on a frame after the last one
+			passStart = lastTime + 1. / 60.;
+		}
+	}
+	CoUninitialize();
+#endif
+}
+
+void VideoTexture::blitToCube(GLuint cube, GLsizei faceSize, int x, int y, int w, int h, bool cubeLayout)
+{
+	if (!texture()) {
+		return;
+	}
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, readFbo);
+	glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture(), 0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFbo);
+	for (int face = 0; face < 6; face++) {
+		glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, cube, 0);
+		int x0 = x, y0 = y, x1 = x + w, y1 = y + h;
+		if (cubeLayout) {
+			// The frame's first row is the top one, at y
+			x0 = x + (face % 3) * w / 3;
+			x1 = x + (face % 3 + 1) * w / 3;
+			y0 = y + (face / 3) * h / 2;
+			y1 = y + (face / 3 + 1) * h / 2;
+		}
+		glBlitFramebuffer(x0, y0, x1, y1, 0, 0, faceSize, faceSize, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+	}
+	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+	glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+}
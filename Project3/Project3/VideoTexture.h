@@ -0,0 +1,111 @@
+#ifndef _VIDEO_TEXTURE_H_
+#define _VIDEO_TEXTURE_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "GLHandle.h"
+
+struct IMFSourceReader;
+struct IMFSample;
+struct IMFDXGIDeviceManager;
+struct ID3D11Device;
+struct ID3D11DeviceContext;
+struct ID3D11Texture2D;
+
+// A video file played into a GL texture (video.*). Media Foundation's source reader decodes
+// it on the GPU into D3D11 textures, converted to BGRA there as well, on a thread of its own
+// that keeps a few frames ahead. Two D3D11 textures of our own are shared with GL through
+// WGL_NV_DX_interop: the front one is locked for GL and sampled, the decoded frame due next
+// is copied into the back one on the GPU and the two swap. No frame passes through the CPU
+// unless the decoder itself is a software one, whose frames are uploaded instead.
+//
+// Frames are shown by the frame's predicted display time: update() takes the newest one
+// whose timestamp has come by then, counted from the first update(), and drops the older
+// ones. There is no audio.
+//
+// Rows are as D3D has them, the first one at the top. Windows only, open() fails elsewhere
+// or without the interop extension.
+class VideoTexture
+{
+public:
+	VideoTexture();
+	~VideoTexture();
+
+	VideoTexture(const VideoTexture&) = delete;
+	VideoTexture& operator=(const VideoTexture&) = delete;
+
+	//! Starts decoding filename, from the start again at its end with loop. With the GL
+	// context current, on the thread that calls update().
+	bool open(const std::string& filename, bool loop);
+	void close();
+	bool valid() const { return interopDevice != nullptr && !failed; }
+
+	//! The newest frame due by displayTime (seconds) into the texture.
+	// @return Whether the texture changed
+	bool update(double displayTime);
+	// The current frame, 0 until the first one arrives
+	GLuint texture() const { return front >= 0 ? glTextures[front] : 0; }
+	int width() const { return frameWidth; }
+	int height() const { return frameHeight; }
+	// Frames shown, and dropped for coming due in the same frame as a newer one
+	uint64_t shown() const { return shownFrames; }
+	uint64_t dropped() const { return droppedFrames; }
+
+	//! Blits the rectangle x, y, w, h of the frame onto the faces of the GL_TEXTURE_CUBE_MAP
+	// cube, faceSize on a side: all of it onto every face, or with cubeLayout the rectangle
+	// taken as three faces across and two down, +X -X +Y in the top row, -Y +Z -Z below.
+	void blitToCube(GLuint cube, GLsizei faceSize, int x, int y, int w, int h, bool cubeLayout);
+
+private:
+	struct Frame
+	{
+		IMFSample* sample;
+		double time;
+	};
+
+	bool createTargets(ID3D11Texture2D* like);
+	void run();
+
+	IMFSourceReader* reader;
+	IMFDXGIDeviceManager* deviceManager;
+	ID3D11Device* device;
+	ID3D11DeviceContext* context;
+	void* interopDevice;
+	ID3D11Texture2D* targets[2];
+	void* interopObjects[2];
+	GLuint glTextures[2];
+	int front;
+	int frameWidth;
+	int frameHeight;
+	bool loop;
+	double startTime;
+	uint64_t shownFrames;
+	uint64_t droppedFrames;
+	GLFramebuffer readFbo;
+	GLFramebuffer drawFbo;
+	bool mediaFoundation;
+	bool failed;
+
+	std::thread decoder;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<Frame> decoded;
+	bool stopping;
+	bool ended;
+};
+
+#endif
@@ -0,0 +1,472 @@
+#include "VirtualTexture.h"
+#include "GLState.h"
+#include "GLStats.h"
+#include "GpuMemory.h"
+#include "Log.h"
+#include "UploadThread.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+VirtualTexture::VirtualTexture()
+	: ring(nullptr), texture(0), residency(0), size(0), tileSize(0), tiles(0), levels(0), paged(0), perFace(0),
+	feedbackWords(0), frame(0), tailBytes(0), residentTiles(0), budgetTiles(0), uploading(0), residencyDirty(false),
+	residencyVersion(0)
+{
+	for (int i = 0; i < FEEDBACK_FRAMES; i++) {
+		feedback[i] = 0;
+		fences[i] = nullptr;
+	}
+	for (int i = 0; i < MAX_LEVELS; i++) {
+		offsets[i] = 0;
+	}
+}
+
+VirtualTexture::~VirtualTexture()
+{
+	release();
+}
+
+bool VirtualTexture::supported()
+{
+	return GLEW_ARB_sparse_texture && GLEW_ARB_shader_storage_buffer_object;
+}
+
+bool VirtualTexture::init(const std::vector<std::string>& files, uint64_t budgetBytes, UploadRing* uploadRing)
+{
+	release();
+	if (!supported()) {
+		std::cerr << "sparse textures not supported, no virtual environment" << std::endl;
+		return false;
+	}
+	if (files.size() != 6) {
+		std::cerr << "a virtual environment needs six faces, not " << files.size() << std::endl;
+		return false;
+	}
+	for (int face = 0; face < 6; face++) {
+		if (!mapTiledTexture(files[face].c_str(), faces[face])) {
+			return false;
+		}
+		const TexTiledHeader& h = *faces[face].header;
+		const TexTiledHeader& first = *faces[0].header;
+		if (h.width != h.height || h.width != first.width || h.tileSize != first.tileSize) {
+			std::cerr << files[face] << " is not square or not the size of the other faces" << std::endl;
+			return false;
+		}
+	}
+
+	const TexTiledHeader& header = *faces[0].header;
+	GLint pageX = 0, pageY = 0;
+	glGetInternalformativ(GL_TEXTURE_CUBE_MAP, GL_RGBA8, GL_VIRTUAL_PAGE_SIZE_X_ARB, 1, &pageX);
+	glGetInternalformativ(GL_TEXTURE_CUBE_MAP, GL_RGBA8, GL_VIRTUAL_PAGE_SIZE_Y_ARB, 1, &pageY);
+	if (pageX <= 0 || pageY <= 0 || header.tileSize % pageX || header.tileSize % pageY) {
+		std::cerr << "tiles of " << header.tileSize << " do not cover whole " << pageX << "x" << pageY
+			<< " sparse pages, no virtual environment" << std::endl;
+		return false;
+	}
+
+	ring = uploadRing;
+	size = header.width;
+	tileSize = header.tileSize;
+	tiles = size / tileSize;
+	levels = header.levelCount;
+
+	glGenTextures(1, &texture);
+	glState().bindTexture(0, GL_TEXTURE_CUBE_MAP, texture);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_SPARSE_ARB, GL_TRUE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_VIRTUAL_PAGE_SIZE_INDEX_ARB, 0);
+	glTexStorage2D(GL_TEXTURE_CUBE_MAP, (GLsizei)levels, GL_RGBA8, size, size);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+	// The driver's own tail can only be committed whole, so it is not paged either
+	GLint sparseLevels = 0;
+	glGetTexParameteriv(GL_TEXTURE_CUBE_MAP, GL_NUM_SPARSE_LEVELS_ARB, &sparseLevels);
+	paged = std::min(std::min(header.tiledLevels, (uint32_t)std::max(sparseLevels, 0)), (uint32_t)MAX_LEVELS);
+
+	perFace = 0;
+	for (uint32_t level = 0; level < paged; level++) {
+		offsets[level] = (GLint)perFace;
+		perFace += (size_t)(tiles >> level) * (tiles >> level);
+	}
+	state.assign(perFace * 6, ABSENT);
+	lastUse.assign(perFace * 6, 0);
+	size_t tileGpuBytes = (size_t)tileSize * tileSize * 4;
+	budgetTiles = budgetBytes ? std::max((size_t)(budgetBytes / tileGpuBytes), (size_t)6) : SIZE_MAX;
+
+	// Everything below the paged levels goes in now and stays
+	tailBytes = 0;
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (uint32_t face = 0; face < 6; face++) {
+		GLenum faceTarget = GL_TEXTURE_CUBE_MAP_POSITIVE_X + face;
+		const TiledImage& image = faces[face];
+		for (uint32_t level = paged; level < levels; level++) {
+			const TexTiledLevel& l = image.levels[level];
+			glTexPageCommitmentARB(GL_TEXTURE_CUBE_MAP, level, 0, 0, face, l.width, l.height, 1, GL_TRUE);
+			if (level < header.tiledLevels) {
+				for (uint32_t y = 0; y < l.tilesY; y++) {
+					for (uint32_t x = 0; x < l.tilesX; x++) {
+						glTexSubImage2D(faceTarget, level, x * tileSize, y * tileSize, tileSize, tileSize, GL_RGB,
+							GL_UNSIGNED_BYTE, image.tile(level, x, y));
+					}
+				}
+			}
+			else {
+				glTexSubImage2D(faceTarget, level, 0, 0, l.width, l.height, GL_RGB, GL_UNSIGNED_BYTE, image.tail(level));
+			}
+			glStats().addUpload((size_t)l.width * l.height * 3);
+			tailBytes += (uint64_t)l.width * l.height * 4;
+		}
+	}
+
+	glGenTextures(1, &residency);
+	glState().bindTexture(0, GL_TEXTURE_CUBE_MAP, residency);
+	glTexStorage2D(GL_TEXTURE_CUBE_MAP, 1, GL_R8, tiles, tiles);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glState().bindTexture(0, GL_TEXTURE_CUBE_MAP, 0);
+	gpuMemory().allocate(GpuMemory::KIND_TEXTURE, residency, (uint64_t)tiles * tiles * 6, GpuMemory::TEXTURE,
+		"virtual residency");
+	residencyDirty = true;
+	updateResidency();
+
+	feedbackWords = std::max((perFace * 6 + 31) / 32, (size_t)1);
+	std::vector<uint32_t> zeros(feedbackWords, 0);
+	glGenBuffers(FEEDBACK_FRAMES, feedback);
+	for (int i = 0; i < FEEDBACK_FRAMES; i++) {
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, feedback[i]);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, feedbackWords * sizeof(uint32_t), zeros.data(), GL_DYNAMIC_READ);
+		gpuMemory().allocate(GpuMemory::KIND_BUFFER, feedback[i], feedbackWords * sizeof(uint32_t), GpuMemory::STREAMING,
+			"virtual feedback");
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	readback.resize(feedbackWords);
+
+	account();
+	logStream(LOG_INFO) << "virtual environment: " << size << " a face, " << paged << " of " << levels << " levels paged in "
+		<< tileSize << " tiles" << std::endl;
+	return true;
+}
+
+void VirtualTexture::release()
+{
+	// Their callbacks point back in here
+	if (uploading) {
+		uploadThread().finish();
+	}
+	if (texture) {
+		gpuMemory().release(GpuMemory::KIND_TEXTURE, texture);
+		glDeleteTextures(1, &texture);
+		texture = 0;
+	}
+	if (residency) {
+		gpuMemory().release(GpuMemory::KIND_TEXTURE, residency);
+		glDeleteTextures(1, &residency);
+		residency = 0;
+	}
+	for (int i = 0; i < FEEDBACK_FRAMES; i++) {
+		if (feedback[i]) {
+			gpuMemory().release(GpuMemory::KIND_BUFFER, feedback[i]);
+			glDeleteBuffers(1, &feedback[i]);
+			feedback[i] = 0;
+		}
+		if (fences[i]) {
+			glDeleteSync(fences[i]);
+			fences[i] = nullptr;
+		}
+	}
+	for (TiledImage& face : faces) {
+		face.file.close();
+		face.header = nullptr;
+		face.levels = nullptr;
+	}
+	state.clear();
+	lastUse.clear();
+	residentTiles = 0;
+	paged = 0;
+}
+
+void VirtualTexture::bindFeedback() const
+{
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, FEEDBACK_BINDING, feedback[frame % FEEDBACK_FRAMES]);
+}
+
+size_t VirtualTexture::tileIndex(uint32_t face, uint32_t level, uint32_t x, uint32_t y) const
+{
+	return face * perFace + offsets[level] + (size_t)y * (tiles >> level) + x;
+}
+
+void VirtualTexture::tileAt(size_t index, uint32_t& face, uint32_t& level, uint32_t& x, uint32_t& y) const
+{
+	face = (uint32_t)(index / perFace);
+	size_t rest = index % perFace;
+	level = 0;
+	while (level + 1 < paged && rest >= (size_t)offsets[level + 1]) {
+		level++;
+	}
+	rest -= offsets[level];
+	uint32_t n = tiles >> level;
+	x = (uint32_t)(rest % n);
+	y = (uint32_t)(rest / n);
+}
+
+size_t VirtualTexture::update(size_t byteBudget)
+{
+	if (!texture) {
+		return 0;
+	}
+
+	// Last frame's feedback is fenced now, behind the barrier that lets the shader's
+	// writes be read back
+	if (frame > 0) {
+		uint32_t last = (uint32_t)((frame - 1) % FEEDBACK_FRAMES);
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+		if (fences[last]) {
+			glDeleteSync(fences[last]);
+		}
+		fences[last] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+	frame++;
+
+	// This frame writes into the oldest buffer. If the GPU is not done with it yet its bits
+	// stay and this frame's are added, they are read together later.
+	std::vector<size_t> wanted;
+	uint32_t slot = (uint32_t)(frame % FEEDBACK_FRAMES);
+	if (fences[slot]) {
+		GLenum status = glClientWaitSync(fences[slot], 0, 0);
+		if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+			glDeleteSync(fences[slot]);
+			fences[slot] = nullptr;
+			readFeedback(slot, wanted);
+		}
+	}
+
+	// Coarsest first, so a tile's parent is always in before it
+	std::sort(wanted.begin(), wanted.end(), [this](size_t a, size_t b) {
+		uint32_t fa, la, xa, ya, fb, lb, xb, yb;
+		tileAt(a, fa, la, xa, ya);
+		tileAt(b, fb, lb, xb, yb);
+		return la > lb;
+	});
+	size_t tileBytes = faces[0].tileBytes();
+	size_t loaded = 0;
+	for (size_t index : wanted) {
+		if (byteBudget == 0 || residentTiles + uploading >= budgetTiles) {
+			break;
+		}
+		uint32_t face, level, x, y;
+		tileAt(index, face, level, x, y);
+		if (level + 1 < paged && state[tileIndex(face, level + 1, x / 2, y / 2)] != RESIDENT) {
+			continue;
+		}
+		load(index);
+		loaded += tileBytes;
+		byteBudget -= tileBytes < byteBudget ? tileBytes : byteBudget;
+	}
+
+	if (residentTiles > budgetTiles) {
+		evict();
+	}
+	updateResidency();
+	return loaded;
+}
+
+void VirtualTexture::readFeedback(uint32_t slot, std::vector<size_t>& wanted)
+{
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, feedback[slot]);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, feedbackWords * sizeof(uint32_t), readback.data());
+	std::vector<uint32_t> zeros(feedbackWords, 0);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, feedbackWords * sizeof(uint32_t), zeros.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	for (size_t word = 0; word < feedbackWords; word++) {
+		uint32_t bits = readback[word];
+		for (uint32_t bit = 0; bits && bit < 32; bit++) {
+			size_t index = word * 32 + bit;
+			if ((bits & (1u << bit)) && index < state.size()) {
+				want(index, wanted);
+			}
+		}
+	}
+}
+
+// Marks the tile and every coarser tile over it used this frame, and the missing ones wanted
+void VirtualTexture::want(size_t index, std::vector<size_t>& wanted)
+{
+	uint32_t face, level, x, y;
+	tileAt(index, face, level, x, y);
+	for (; level < paged; level++, x /= 2, y /= 2) {
+		size_t tile = tileIndex(face, level, x, y);
+		if (lastUse[tile] == frame) {
+			// Its parents were marked with it
+			return;
+		}
+		lastUse[tile] = frame;
+		if (state[tile] == ABSENT) {
+			wanted.push_back(tile);
+		}
+	}
+}
+
+void VirtualTexture::load(size_t index)
+{
+	uint32_t face, level, x, y;
+	tileAt(index, face, level, x, y);
+	const unsigned char* pixels = faces[face].tile(level, x, y);
+	size_t bytes = faces[face].tileBytes();
+	GLuint tex = texture;
+	GLint side = (GLint)tileSize;
+	state[index] = LOADING;
+
+	if (uploadThread().running()) {
+		// Reading the tile off the disk happens there too
+		uploading++;
+		uploadThread().submit([tex, face, level, x, y, side, pixels] {
+			glBindTexture(GL_TEXTURE_CUBE_MAP, tex);
+			glTexPageCommitmentARB(GL_TEXTURE_CUBE_MAP, level, x * side, y * side, face, side, side, 1, GL_TRUE);
+			glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, x * side, y * side, side, side, GL_RGB,
+				GL_UNSIGNED_BYTE, pixels);
+			glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+		}, [this, index] {
+			uploading--;
+			state[index] = RESIDENT;
+			residentTiles++;
+			residencyDirty = true;
+			account();
+		});
+		glStats().addUpload(bytes);
+		return;
+	}
+
+	glState().bindTexture(0, GL_TEXTURE_CUBE_MAP, texture);
+	glTexPageCommitmentARB(GL_TEXTURE_CUBE_MAP, level, x * side, y * side, face, side, side, 1, GL_TRUE);
+	GLintptr offset;
+	unsigned char* staged = ring && ring->valid() ? ring->reserve(bytes, offset) : nullptr;
+	if (staged) {
+		memcpy(staged, pixels, bytes);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring->buffer());
+		pixels = (const unsigned char*)offset;
+	}
+	glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, x * side, y * side, side, side, GL_RGB,
+		GL_UNSIGNED_BYTE, pixels);
+	if (staged) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		ring->commit();
+	}
+	glState().bindTexture(0, GL_TEXTURE_CUBE_MAP, 0);
+	glStats().addUpload(bytes);
+
+	state[index] = RESIDENT;
+	residentTiles++;
+	residencyDirty = true;
+	account();
+}
+
+bool VirtualTexture::childrenAbsent(size_t index) const
+{
+	uint32_t face, level, x, y;
+	tileAt(index, face, level, x, y);
+	if (level == 0) {
+		return true;
+	}
+	for (uint32_t i = 0; i < 4; i++) {
+		if (state[tileIndex(face, level - 1, x * 2 + (i & 1), y * 2 + (i >> 1))] != ABSENT) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void VirtualTexture::evict()
+{
+	// Finest first among the equally old, so children go before their parents
+	std::vector<std::pair<uint64_t, size_t>> candidates;
+	for (size_t index = 0; index < state.size(); index++) {
+		if (state[index] == RESIDENT && lastUse[index] + 1 < frame) {
+			candidates.push_back(std::make_pair(lastUse[index], index));
+		}
+	}
+	std::sort(candidates.begin(), candidates.end(), [this](const std::pair<uint64_t, size_t>& a, const std::pair<uint64_t, size_t>& b) {
+		if (a.first != b.first) {
+			return a.first < b.first;
+		}
+		uint32_t fa, la, xa, ya, fb, lb, xb, yb;
+		tileAt(a.second, fa, la, xa, ya);
+		tileAt(b.second, fb, lb, xb, yb);
+		return la < lb;
+	});
+
+	glState().bindTexture(0, GL_TEXTURE_CUBE_MAP, texture);
+	for (size_t i = 0; i < candidates.size() && residentTiles > budgetTiles; i++) {
+		size_t index = candidates[i].second;
+		if (!childrenAbsent(index)) {
+			continue;
+		}
+		uint32_t face, level, x, y;
+		tileAt(index, face, level, x, y);
+		glTexPageCommitmentARB(GL_TEXTURE_CUBE_MAP, level, x * tileSize, y * tileSize, face, tileSize, tileSize, 1, GL_FALSE);
+		state[index] = ABSENT;
+		residentTiles--;
+		residencyDirty = true;
+	}
+	glState().bindTexture(0, GL_TEXTURE_CUBE_MAP, 0);
+	account();
+}
+
+void VirtualTexture::updateResidency()
+{
+	if (!residencyDirty) {
+		return;
+	}
+	residencyDirty = false;
+	residencyVersion++;
+
+	std::vector<uint8_t> finest(tiles * tiles);
+	std::vector<uint8_t> map(tiles * tiles);
+	glState().bindTexture(0, GL_TEXTURE_CUBE_MAP, residency);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (uint32_t face = 0; face < 6; face++) {
+		for (uint32_t y = 0; y < tiles; y++) {
+			for (uint32_t x = 0; x < tiles; x++) {
+				uint32_t level = paged;
+				while (level > 0 && state[tileIndex(face, level - 1, x >> (level - 1), y >> (level - 1))] == RESIDENT) {
+					level--;
+				}
+				finest[y * tiles + x] = (uint8_t)level;
+			}
+		}
+		// A texel near a tile's edge is filtered with its neighbour's texels too
+		for (uint32_t y = 0; y < tiles; y++) {
+			for (uint32_t x = 0; x < tiles; x++) {
+				uint8_t level = 0;
+				for (uint32_t ny = y > 0 ? y - 1 : 0; ny <= std::min(y + 1, tiles - 1); ny++) {
+					for (uint32_t nx = x > 0 ? x - 1 : 0; nx <= std::min(x + 1, tiles - 1); nx++) {
+						level = std::max(level, finest[ny * tiles + nx]);
+					}
+				}
+				map[y * tiles + x] = level;
+			}
+		}
+		glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, 0, 0, tiles, tiles, GL_RED, GL_UNSIGNED_BYTE, map.data());
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glState().bindTexture(0, GL_TEXTURE_CUBE_MAP, 0);
+}
+
+uint64_t VirtualTexture::residentBytes() const
+{
+	return tailBytes + (uint64_t)residentTiles * tileSize * tileSize * 4;
+}
+
+void VirtualTexture::account() const
+{
+	gpuMemory().allocate(GpuMemory::KIND_TEXTURE, texture, residentBytes(), GpuMemory::TEXTURE, "virtual environment");
+}
@@ -0,0 +1,126 @@
+#ifndef _VIRTUAL_TEXTURE_H_
+#define _VIRTUAL_TEXTURE_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "TiledTexture.h"
+#include "UploadRing.h"
+
+// An environment cube map too big to keep on the GPU whole (8K to 16K a face), as a sparse
+// texture (ARB_sparse_texture) with pages committed only for the tiles that are drawn.
+//
+// The faces come from tiled files (.p3vt, TiledTexture.h). The levels smaller than a tile,
+// and any the driver keeps in its own mip tail, are committed and uploaded by init() and
+// stay. The others are paged a tile at a time: virtualSky.frag records the tiles it samples,
+// at the level it samples them, as bits in a feedback buffer. update() reads a frame's
+// bits back FEEDBACK_FRAMES frames later, once its fence says the GPU is done, so it never
+// waits, and uploads the tiles missing coarsest first within a byte budget, on the upload
+// thread when it runs. Tiles not wanted for a frame are decommitted again once more than
+// the budget is resident, least recently wanted first.
+//
+// A tile is only made resident once its parent is, and evicted only once none of its
+// children are, so every texel has some level resident. The residency map, a small cube map
+// with a texel per level 0 tile, holds the finest level resident around that tile (its
+// neighbours included, for the filter's sake); the shader never samples finer than that.
+class VirtualTexture
+{
+public:
+	enum { FEEDBACK_BINDING = 3, FEEDBACK_FRAMES = 3, MAX_LEVELS = 16 };
+
+	VirtualTexture();
+	~VirtualTexture();
+
+	VirtualTexture(const VirtualTexture&) = delete;
+	VirtualTexture& operator=(const VirtualTexture&) = delete;
+
+	static bool supported();
+
+	//! Maps the six faces' tiled files and makes the texture with its tail resident.
+	// @input faces The tiled files in +X -X +Y -Y +Z -Z order, square and all the same size
+	// @input budgetBytes What the paged tiles may take on the GPU, 0 for no limit
+	// @input ring Where tiles uploaded on this thread are staged, may be nullptr
+	//
+	// @return False, with nothing made, if the context or the files do not allow it
+	bool init(const std::vector<std::string>& faces, uint64_t budgetBytes, UploadRing* ring);
+	// Waits for pages still on the upload thread, deletes the page texture, the residency map
+	// and the feedback buffers and unmaps the tiled files
+	void release();
+	bool valid() const { return texture != 0; }
+
+	GLuint cubeMap() const { return texture; }
+	GLuint residencyMap() const { return residency; }
+
+	//! Binds this frame's feedback buffer to FEEDBACK_BINDING, for the draws sampling the
+	// texture with virtualSky.frag
+	void bindFeedback() const;
+
+	// What virtualSky.frag is told: tiles a side of level 0, how many levels are paged, where
+	// each paged level's tiles start within a face, and the tiles of a face over those levels
+	int tilesPerSide() const { return (int)tiles; }
+	int pagedLevels() const { return (int)paged; }
+	const GLint* levelOffsets() const { return offsets; }
+	int faceTiles() const { return (int)perFace; }
+	// Changes every frame, so the few pixels that record tiles are different ones each frame
+	int feedbackPhase() const { return (int)(frame & 0xffff); }
+
+	//! Reads back what a past frame sampled, pages in what is missing and evicts over the
+	// budget. At most byteBudget bytes of tiles are uploaded, but at least one tile, and
+	// none with 0. Once a frame, before the draws.
+	// @return The bytes of the tiles it started loading
+	size_t update(size_t byteBudget);
+
+	uint64_t residentBytes() const;
+	size_t tilesResident() const { return residentTiles; }
+	// Changes whenever the residency map does, and with it what the texture samples
+	uint64_t version() const { return residencyVersion; }
+
+private:
+	enum TileState : uint8_t { ABSENT, LOADING, RESIDENT };
+
+	size_t tileIndex(uint32_t face, uint32_t level, uint32_t x, uint32_t y) const;
+	void tileAt(size_t index, uint32_t& face, uint32_t& level, uint32_t& x, uint32_t& y) const;
+	void readFeedback(uint32_t slot, std::vector<size_t>& wanted);
+	void want(size_t index, std::vector<size_t>& wanted);
+	void load(size_t index);
+	bool childrenAbsent(size_t index) const;
+	void evict();
+	void updateResidency();
+	void account() const;
+
+	TiledImage faces[6];
+	UploadRing* ring;
+	GLuint texture;
+	GLuint residency;
+	GLuint feedback[FEEDBACK_FRAMES];
+	GLsync fences[FEEDBACK_FRAMES];
+	uint32_t size;
+	uint32_t tileSize;
+	uint32_t tiles;
+	uint32_t levels;
+	uint32_t paged;
+	GLint offsets[MAX_LEVELS];
+	size_t perFace;
+	size_t feedbackWords;
+	std::vector<uint8_t> state;
+	std::vector<uint64_t> lastUse;
+	std::vector<uint32_t> readback;
+	uint64_t frame;
+	uint64_t tailBytes;
+	size_t residentTiles;
+	size_t budgetTiles;
+	size_t uploading;
+	bool residencyDirty;
+	uint64_t residencyVersion;
+};
+
+#endif
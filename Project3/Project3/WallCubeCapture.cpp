@@ -0,0 +1,272 @@
+#include "WallCubeCapture.h"
+#include "GLMarkers.h"
+#include "GLState.h"
+#include "GLStats.h"
+#include "GpuMemory.h"
+#include "TextureUpload.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+
+// The faces' near and far planes, those of the wall frusta (CaveLayout)
+static const float FACE_NEAR = 0.001f;
+static const float FACE_FAR = 1000.f;
+
+// How much cheaper the way not taken has to have been to switch to it
+static const float SWITCH_MARGIN = 0.9f;
+
+// Where each face looks and which way is up on it, in GL_TEXTURE_CUBE_MAP_POSITIVE_X order
+static const glm::vec3 FACE_DIRECTIONS[WallCubeCapture::FACES] = {
+	glm::vec3(1.f, 0.f, 0.f), glm::vec3(-1.f, 0.f, 0.f), glm::vec3(0.f, 1.f, 0.f),
+	glm::vec3(0.f, -1.f, 0.f), glm::vec3(0.f, 0.f, 1.f), glm::vec3(0.f, 0.f, -1.f)
+};
+static const glm::vec3 FACE_UPS[WallCubeCapture::FACES] = {
+	glm::vec3(0.f, -1.f, 0.f), glm::vec3(0.f, -1.f, 0.f), glm::vec3(0.f, 0.f, 1.f),
+	glm::vec3(0.f, 0.f, -1.f), glm::vec3(0.f, -1.f, 0.f), glm::vec3(0.f, -1.f, 0.f)
+};
+
+// A cube map array of cubes cubes with side texels square faces, the texture bound to unit 0
+static void allocateCubes(GLTexture& texture, GLenum format, GLsizei side, int cubes, GLint filter, const char* label)
+{
+	texture.create();
+	glState().bindTexture(0, GL_TEXTURE_CUBE_MAP_ARRAY, texture);
+	int layers = cubes * WallCubeCapture::FACES;
+	if (GLEW_ARB_texture_storage) {
+		glTexStorage3D(GL_TEXTURE_CUBE_MAP_ARRAY, 1, format, side, side, layers);
+	}
+	else {
+		bool isDepth = format == GL_DEPTH_COMPONENT24;
+		glTexImage3D(GL_TEXTURE_CUBE_MAP_ARRAY, 0, format, side, side, layers, 0, isDepth ? GL_DEPTH_COMPONENT : GL_RGBA,
+			isDepth ? GL_UNSIGNED_INT : GL_UNSIGNED_BYTE, nullptr);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+	}
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MIN_FILTER, filter);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MAG_FILTER, filter);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	gpuMemory().allocate(GpuMemory::KIND_TEXTURE, texture, textureBytes(format, side, side, layers, 1), GpuMemory::RENDER_TARGET, label);
+}
+
+WallCubeCapture::WallCubeCapture() : side(0), current(OFF), on(false), probing(false), probeFrames(120), sinceProbe(0),
+	frame(0), measuring(false), measuredFrame(false)
+{
+	for (int i = 0; i < 2; i++) {
+		costs[i] = 0.f;
+		known[i] = false;
+	}
+	for (int i = 0; i < FRAMES; i++) {
+		queries[i][0] = queries[i][1] = 0;
+		captured[i] = false;
+		pending[i] = false;
+	}
+}
+
+WallCubeCapture::~WallCubeCapture()
+{
+	release();
+}
+
+bool WallCubeCapture::parseMode(const std::string& name, Mode& mode)
+{
+	if (name == "off") {
+		mode = OFF;
+	}
+	else if (name == "on") {
+		mode = ON;
+	}
+	else if (name == "auto") {
+		mode = AUTO;
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+void WallCubeCapture::release()
+{
+	for (GLuint texture : { color.get(), depth.get() }) {
+		if (texture) {
+			gpuMemory().release(GpuMemory::KIND_TEXTURE, texture);
+		}
+	}
+	color.reset();
+	depth.reset();
+	captureFramebuffer.reset();
+	layerFramebuffer.reset();
+	vao.reset();
+	if (queries[0][0]) {
+		glDeleteQueries(2 * FRAMES, &queries[0][0]);
+	}
+	for (int i = 0; i < FRAMES; i++) {
+		queries[i][0] = queries[i][1] = 0;
+		pending[i] = false;
+	}
+	measuring = false;
+	current = OFF;
+	side = 0;
+}
+
+bool WallCubeCapture::init(Mode mode, GLsizei faceSize, GLenum format, int probe)
+{
+	release();
+	if (mode == OFF || faceSize < 1) {
+		return false;
+	}
+	if (!program.load("wallCubeResample.vert", nullptr, "wallCubeResample.frag")) {
+		return false;
+	}
+	cubeUniform = program.uniform("cube");
+	sizeUniform = program.uniform("size");
+	wallToCaptureUniform = program.uniform("wallToCapture");
+	program.use();
+	program.setSampler("capture", 0);
+	glState().useProgram(0);
+
+	// Sampled across the faces' seams, so linear
+	allocateCubes(color, format, faceSize, MAX_EYES, GL_LINEAR, "wall cube capture");
+	allocateCubes(depth, GL_DEPTH_COMPONENT24, faceSize, MAX_EYES, GL_NEAREST, "wall cube capture depth");
+
+	// Every face at once for the layered pass, single layers of the wall targets to resample into
+	captureFramebuffer.create();
+	glMarkers().label(GL_FRAMEBUFFER, captureFramebuffer, "cube capture");
+	glBindFramebuffer(GL_FRAMEBUFFER, captureFramebuffer);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, color, 0);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth, 0);
+	glDrawBuffer(GL_COLOR_ATTACHMENT0);
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	layerFramebuffer.create();
+	glMarkers().label(GL_FRAMEBUFFER, layerFramebuffer, "cube capture layer");
+	glBindFramebuffer(GL_FRAMEBUFFER, layerFramebuffer);
+	glDrawBuffer(GL_COLOR_ATTACHMENT0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	if (!complete) {
+		release();
+		return false;
+	}
+	// The resample's triangle comes from gl_VertexID, there are no attributes
+	vao.create();
+
+	side = faceSize;
+	current = mode;
+	probeFrames = std::max(probe, 2);
+	on = true;
+	probing = false;
+	sinceProbe = 0;
+	if (mode == AUTO) {
+		glGenQueries(2 * FRAMES, &queries[0][0]);
+	}
+	return true;
+}
+
+void WallCubeCapture::beginFrame()
+{
+	if (current != AUTO) {
+		return;
+	}
+	frame = (frame + 1) % FRAMES;
+	measuredFrame = false;
+	if (pending[frame]) {
+		// A frame the GPU is still on is dropped rather than waited for
+		GLint available = 0;
+		glGetQueryObjectiv(queries[frame][1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available) {
+			GLuint64 begin = 0, end = 0;
+			glGetQueryObjectui64v(queries[frame][0], GL_QUERY_RESULT, &begin);
+			glGetQueryObjectui64v(queries[frame][1], GL_QUERY_RESULT, &end);
+			int way = captured[frame] ? 1 : 0;
+			float ms = (float)((double)(end - begin) / 1.0e6);
+			costs[way] = known[way] ? costs[way] + (ms - costs[way]) * 0.25f : ms;
+			known[way] = true;
+		}
+		pending[frame] = false;
+	}
+	if (known[0] && known[1]) {
+		on = on ? !(costs[0] < costs[1] * SWITCH_MARGIN) : costs[1] < costs[0] * SWITCH_MARGIN;
+	}
+	// The way not taken is measured soon if it never has been, then every probeFrames frames
+	sinceProbe++;
+	probing = sinceProbe >= (known[on ? 0 : 1] ? probeFrames : FRAMES + 1);
+	if (probing) {
+		sinceProbe = 0;
+	}
+}
+
+void WallCubeCapture::beginMeasure()
+{
+	if (current != AUTO || measuredFrame) {
+		return;
+	}
+	glQueryCounter(queries[frame][0], GL_TIMESTAMP);
+	measuring = true;
+}
+
+void WallCubeCapture::endMeasure(bool drawn)
+{
+	if (!measuring) {
+		return;
+	}
+	measuring = false;
+	// A pass with nothing to draw says nothing about either way, the next one may
+	if (!drawn) {
+		return;
+	}
+	glQueryCounter(queries[frame][1], GL_TIMESTAMP);
+	captured[frame] = active();
+	pending[frame] = true;
+	measuredFrame = true;
+}
+
+void WallCubeCapture::faceMatrices(const glm::vec3& position, const glm::mat4& view, glm::mat4 out[FACES])
+{
+	glm::mat4 projection = glm::perspective(glm::half_pi<float>(), 1.f, FACE_NEAR, FACE_FAR);
+	for (int face = 0; face < FACES; face++) {
+		out[face] = projection * glm::lookAt(position, position + FACE_DIRECTIONS[face], FACE_UPS[face]) * view;
+	}
+}
+
+void WallCubeCapture::beginCapture(int eyes)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, captureFramebuffer);
+	// The layered program picks each instance's viewport by its layer
+	for (int layer = 0; layer < eyes * FACES; layer++) {
+		glViewportIndexedf(layer, 0.f, 0.f, (float)side, (float)side);
+	}
+	// Without touching the clear color the other targets are cleared with
+	const GLfloat clear[4] = { 0.f, 0.f, 0.f, 0.f };
+	glClearBufferfv(GL_COLOR, 0, clear);
+	glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void WallCubeCapture::resample(const RenderTarget& target, int targetLayer, int cube, GLsizei size, const glm::mat4& wallProjection)
+{
+	if (!valid() || cube < 0 || cube >= MAX_EYES) {
+		return;
+	}
+	// A layered target's depth is an array as well (RenderTargetCache)
+	if (target.layers) {
+		glBindFramebuffer(GL_FRAMEBUFFER, layerFramebuffer);
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, target.color, 0, targetLayer);
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, target.depth, 0, targetLayer);
+	}
+	else {
+		glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+	}
+	glViewport(0, 0, size, size);
+	glDisable(GL_DEPTH_TEST);
+	glState().polygonMode(GL_FILL);
+	program.use();
+	cubeUniform.set(cube);
+	sizeUniform.set(size);
+	// The off-axis matrices are badly conditioned near the wall's plane, so the inverse is
+	// taken in double
+	wallToCaptureUniform.set(glm::mat4(glm::inverse(glm::dmat4(wallProjection))));
+	glState().bindTexture(0, GL_TEXTURE_CUBE_MAP_ARRAY, color);
+	glState().bindVertexArray(vao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glStats().addDraw();
+	glState().bindVertexArray(0);
+	glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+	glEnable(GL_DEPTH_TEST);
+}
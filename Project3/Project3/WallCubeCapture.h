@@ -0,0 +1,112 @@
+#ifndef _WALL_CUBE_CAPTURE_H_
+#define _WALL_CUBE_CAPTURE_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+
+#include <string>
+
+#include "GLHandle.h"
+#include "RenderTargets.h"
+#include "ShaderProgram.h"
+
+// The walls of an eye resampled from one cube rendered around it (walls.cube_capture),
+// instead of the scene rendered through every wall. All of an eye's walls are seen from
+// the same point, so past six walls the six faces of a cube at the eye cost less to draw
+// than the walls do, and each wall is then one fullscreen pass that looks up the cube in
+// the direction of each of its texels (wallCubeResample.frag). Those directions come from
+// the wall's off-axis matrix, which is all it is used for.
+//
+// The faces are rendered by the layered wall program into a cube map array, a cube per eye
+// of the pass. AUTO times the wall passes with timestamps, read back FRAMES frames later
+// and only if the GPU is done like GpuTimers, and keeps whichever way has been cheaper.
+// Every probeFrames frames one frame goes the other way, to be measured again.
+class WallCubeCapture
+{
+public:
+	enum Mode { OFF, ON, AUTO };
+	enum { FACES = 6, MAX_EYES = 2, FRAMES = 3 };
+
+	WallCubeCapture();
+	~WallCubeCapture();
+
+	WallCubeCapture(const WallCubeCapture&) = delete;
+	WallCubeCapture& operator=(const WallCubeCapture&) = delete;
+
+	// "off", "on" or "auto", false for anything else
+	static bool parseMode(const std::string& name, Mode& mode);
+
+	//! Cubes for MAX_EYES eyes with faceSize texels square faces, in the wall targets' color
+	// format. False, with nothing made, for OFF or if the program does not link.
+	// @input probeFrames Frames between AUTO's measures of the way it is not taking
+	bool init(Mode mode, GLsizei faceSize, GLenum format, int probeFrames);
+	bool valid() const { return color.get() != 0; }
+	// Deletes the capture cube, its framebuffers and the timer queries, and goes back to OFF
+	void release();
+	Mode mode() const { return current; }
+	GLsizei faceSize() const { return side; }
+
+	// Reads back the oldest frame's measure and decides for the frame that starts
+	void beginFrame();
+	// Whether this frame's wall passes capture
+	bool active() const { return valid() && on != probing; }
+	// Around a wall pass, only the first one of a frame that drew is measured
+	void beginMeasure();
+	void endMeasure(bool drawn);
+	// Milliseconds of a wall pass each way as last measured, 0 before the first
+	float cost(bool captured) const { return costs[captured ? 1 : 0]; }
+
+	//! Projection * view of each face of a cube at position, in GL's cube map face order
+	// @input view What the walls' projections are applied after, so the faces see the
+	//		same space
+	static void faceMatrices(const glm::vec3& position, const glm::mat4& view, glm::mat4 out[FACES]);
+	//! Binds the cubes of eyes eyes for the layered pass, each face its viewport, and
+	// clears them. Alpha is cleared to 0 for the analytic sky like a wall target.
+	void beginCapture(int eyes);
+	//! Fills layer targetLayer of target, size texels square, with cube cube as seen through
+	// a wall. Leaves target bound.
+	// @input wallProjection The wall's off-axis projection, applied after the view the
+	//		faces were given
+	void resample(const RenderTarget& target, int targetLayer, int cube, GLsizei size, const glm::mat4& wallProjection);
+
+private:
+	ShaderProgram program;
+	Uniform cubeUniform;
+	Uniform sizeUniform;
+	Uniform wallToCaptureUniform;
+
+	// Face f of eye e's cube is layer e * FACES + f of both
+	GLTexture color;
+	GLTexture depth;
+	GLFramebuffer captureFramebuffer;
+	GLFramebuffer layerFramebuffer;
+	GLVertexArray vao;
+	GLsizei side;
+
+	Mode current;
+	bool on;
+	bool probing;
+	int probeFrames;
+	int sinceProbe;
+	float costs[2];
+	bool known[2];
+
+	GLuint queries[FRAMES][2];
+	bool captured[FRAMES];
+	bool pending[FRAMES];
+	int frame;
+	bool measuring;
+	bool measuredFrame;
+};
+
+#endif
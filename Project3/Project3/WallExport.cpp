@@ -0,0 +1,314 @@
+#include "WallExport.h"
+#include "GLMarkers.h"
+#include "Log.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <GL/wglew.h>
+#include <d3d11_4.h>
+#include <dxgi1_2.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+WallExport::WallExport() : device(nullptr), context(nullptr), context4(nullptr), fence(nullptr), fenceHandle(nullptr),
+	interopDevice(nullptr), mapping(nullptr), header(nullptr), layerCount(0), textureSize(0), fenceValue(0), published(0), blocked(0)
+{
+	memset(textures, 0, sizeof(textures));
+	memset(sharedHandles, 0, sizeof(sharedHandles));
+	memset(interopObjects, 0, sizeof(interopObjects));
+	memset(glTextures, 0, sizeof(glTextures));
+}
+
+WallExport::~WallExport()
+{
+	close();
+}
+
+#ifdef _WIN32
+template <typename T>
+static void release(T*& object)
+{
+	if (object) {
+		object->Release();
+		object = nullptr;
+	}
+}
+#endif
+
+uint32_t WallExport::dxgiFormat(GLenum format)
+{
+#ifdef _WIN32
+	switch (format) {
+	case GL_RGBA8:
+		return DXGI_FORMAT_R8G8B8A8_UNORM;
+	case GL_SRGB8_ALPHA8:
+		return DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+	case GL_RGBA16F:
+		return DXGI_FORMAT_R16G16B16A16_FLOAT;
+	case GL_R11F_G11F_B10F:
+		return DXGI_FORMAT_R11G11B10_FLOAT;
+	case GL_RGB10_A2:
+		return DXGI_FORMAT_R10G10B10A2_UNORM;
+	default:
+		return 0;
+	}
+#else
+	(void)format;
+	return 0;
+#endif
+}
+
+bool WallExport::open(const std::string& name, int layers, int walls, GLsizei size, GLenum format)
+{
+	close();
+#ifdef _WIN32
+	if (!WGLEW_NV_DX_interop) {
+		std::cerr << "wall export: WGL_NV_DX_interop not supported, the walls are not exported" << std::endl;
+		return false;
+	}
+	DXGI_FORMAT dxgi = (DXGI_FORMAT)dxgiFormat(format);
+	if (!dxgi || layers < 1 || layers > (int)WALLEXPORT_MAX_LAYERS || size < 1) {
+		std::cerr << "wall export: cannot share " << layers << " layers of format 0x" << std::hex << format << std::dec
+			<< ", the walls are not exported" << std::endl;
+		return false;
+	}
+	layerCount = layers;
+	textureSize = size;
+
+	// The default adapter, which is the context's when there is one GPU. The interop device
+	// is refused on another one.
+	HRESULT hr = D3D11CreateDevice(nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr, 0, nullptr, 0, D3D11_SDK_VERSION, &device, nullptr, &context);
+	ID3D11Device5* device5 = nullptr;
+	if (SUCCEEDED(hr)) {
+		hr = device->QueryInterface(__uuidof(ID3D11Device5), (void**)&device5);
+	}
+	if (SUCCEEDED(hr)) {
+		hr = context->QueryInterface(__uuidof(ID3D11DeviceContext4), (void**)&context4);
+	}
+	if (SUCCEEDED(hr)) {
+		hr = device5->CreateFence(0, D3D11_FENCE_FLAG_SHARED, __uuidof(ID3D11Fence), (void**)&fence);
+	}
+	release(device5);
+	if (SUCCEEDED(hr)) {
+		HANDLE handle = nullptr;
+		hr = fence->CreateSharedHandle(nullptr, GENERIC_ALL, nullptr, &handle);
+		fenceHandle = handle;
+	}
+	if (SUCCEEDED(hr)) {
+		interopDevice = wglDXOpenDeviceNV(device);
+		hr = interopDevice ? S_OK : E_FAIL;
+	}
+
+	D3D11_TEXTURE2D_DESC desc;
+	memset(&desc, 0, sizeof(desc));
+	desc.Width = (UINT)size;
+	desc.Height = (UINT)size;
+	desc.MipLevels = 1;
+	desc.ArraySize = 1;
+	desc.Format = dxgi;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+	desc.MiscFlags = D3D11_RESOURCE_MISC_SHARED | D3D11_RESOURCE_MISC_SHARED_NTHANDLE;
+	for (int layer = 0; layer < layers && SUCCEEDED(hr); layer++) {
+		for (uint32_t slot = 0; slot < WALLEXPORT_SLOTS && SUCCEEDED(hr); slot++) {
+			hr = device->CreateTexture2D(&desc, nullptr, &textures[layer][slot]);
+			IDXGIResource1* resource = nullptr;
+			if (SUCCEEDED(hr)) {
+				hr = textures[layer][slot]->QueryInterface(__uuidof(IDXGIResource1), (void**)&resource);
+			}
+			if (SUCCEEDED(hr)) {
+				HANDLE handle = nullptr;
+				hr = resource->CreateSharedHandle(nullptr, DXGI_SHARED_RESOURCE_READ | DXGI_SHARED_RESOURCE_WRITE, nullptr, &handle);
+				sharedHandles[layer][slot] = handle;
+			}
+			release(resource);
+			if (SUCCEEDED(hr)) {
+				glGenTextures(1, &glTextures[layer][slot]);
+				interopObjects[layer][slot] = wglDXRegisterObjectNV(interopDevice, textures[layer][slot], glTextures[layer][slot],
+					GL_TEXTURE_2D, WGL_ACCESS_WRITE_DISCARD_NV);
+				hr = interopObjects[layer][slot] ? S_OK : E_FAIL;
+			}
+		}
+	}
+
+	std::string mappingName = "Local\\" + name;
+	if (SUCCEEDED(hr)) {
+		mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, (DWORD)sizeof(WallExportHeader), mappingName.c_str());
+		if (mapping && GetLastError() == ERROR_ALREADY_EXISTS) {
+			std::cerr << "wall export: " << mappingName << " is already published by another process" << std::endl;
+			CloseHandle(mapping);
+			mapping = nullptr;
+		}
+		header = mapping ? (WallExportHeader*)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(WallExportHeader)) : nullptr;
+		hr = header ? S_OK : E_FAIL;
+	}
+	if (FAILED(hr)) {
+		std::cerr << "wall export: cannot share the walls (0x" << std::hex << hr << std::dec
+			<< "), it needs D3D11.4 fences and GL and D3D on one GPU" << std::endl;
+		close();
+		return false;
+	}
+
+	memset(header, 0, sizeof(WallExportHeader));
+	header->producerProcess = GetCurrentProcessId();
+	header->layerCount = (uint32_t)layers;
+	header->wallCount = (uint32_t)walls;
+	header->slots = WALLEXPORT_SLOTS;
+	header->textureSize = (uint32_t)size;
+	header->dxgiFormat = (uint32_t)dxgi;
+	header->fenceHandle = (uint64_t)(uintptr_t)fenceHandle;
+	for (int layer = 0; layer < layers; layer++) {
+		for (uint32_t slot = 0; slot < WALLEXPORT_SLOTS; slot++) {
+			header->textureHandles[layer][slot] = (uint64_t)(uintptr_t)sharedHandles[layer][slot];
+		}
+		header->layers[layer].slot = WALLEXPORT_NO_SLOT;
+		header->layers[layer].reading = WALLEXPORT_NO_SLOT;
+	}
+	// Consumers go by the magic, it is written last
+	MemoryBarrier();
+	header->version = WALLEXPORT_VERSION;
+	header->magic = WALLEXPORT_MAGIC;
+	logStream(LOG_INFO) << "wall export: " << layers << " layers of " << size << "x" << size << " published as " << mappingName << std::endl;
+	return true;
+#else
+	(void)name;
+	(void)layers;
+	(void)walls;
+	(void)size;
+	(void)format;
+	std::cerr << "wall export: sharing the walls needs D3D11 and WGL_NV_DX_interop, the walls are not exported" << std::endl;
+	return false;
+#endif
+}
+
+void WallExport::close()
+{
+#ifdef _WIN32
+	if (header) {
+		// Consumers still mapping it see it go away
+		header->magic = 0;
+		UnmapViewOfFile(header);
+		header = nullptr;
+	}
+	if (mapping) {
+		CloseHandle(mapping);
+		mapping = nullptr;
+	}
+	for (int layer = 0; layer < (int)WALLEXPORT_MAX_LAYERS; layer++) {
+		for (uint32_t slot = 0; slot < WALLEXPORT_SLOTS; slot++) {
+			if (interopObjects[layer][slot]) {
+				wglDXUnregisterObjectNV(interopDevice, interopObjects[layer][slot]);
+				interopObjects[layer][slot] = nullptr;
+			}
+			if (glTextures[layer][slot]) {
+				glDeleteTextures(1, &glTextures[layer][slot]);
+				glTextures[layer][slot] = 0;
+			}
+			if (sharedHandles[layer][slot]) {
+				CloseHandle(sharedHandles[layer][slot]);
+				sharedHandles[layer][slot] = nullptr;
+			}
+			release(textures[layer][slot]);
+		}
+	}
+	if (interopDevice) {
+		wglDXCloseDeviceNV(interopDevice);
+		interopDevice = nullptr;
+	}
+	if (fenceHandle) {
+		CloseHandle(fenceHandle);
+		fenceHandle = nullptr;
+	}
+	release(fence);
+	release(context4);
+	release(context);
+	release(device);
+#endif
+	layerCount = 0;
+	fenceValue = published = blocked = 0;
+}
+
+int WallExport::freeSlot(int layer) const
+{
+	const WallExportLayer& entry = header->layers[layer];
+	uint32_t reading = entry.reading;
+	for (uint32_t slot = 0; slot < WALLEXPORT_SLOTS; slot++) {
+		if (slot != entry.slot && slot != reading) {
+			return (int)slot;
+		}
+	}
+	return -1;
+}
+
+void WallExport::publish(const Source* sources, int count, uint64_t frame)
+{
+	if (!valid() || !count) {
+		return;
+	}
+#ifdef _WIN32
+	GpuGroup group("wall export");
+	count = std::min(count, (int)WALLEXPORT_MAX_LAYERS);
+	void* locked[WALLEXPORT_MAX_LAYERS];
+	int slots[WALLEXPORT_MAX_LAYERS];
+	int lockedCount = 0;
+	for (int i = 0; i < count; i++) {
+		int layer = sources[i].layer;
+		slots[i] = layer >= 0 && layer < layerCount ? freeSlot(layer) : -1;
+		if (slots[i] < 0) {
+			blocked += layer >= 0 && layer < layerCount ? 1 : 0;
+			continue;
+		}
+		locked[lockedCount++] = interopObjects[layer][slots[i]];
+	}
+	if (!lockedCount) {
+		return;
+	}
+	// The copies are on the GPU, unlocking orders the D3D side's signal after them
+	wglDXLockObjectsNV(interopDevice, lockedCount, locked);
+	for (int i = 0; i < count; i++) {
+		if (slots[i] < 0) {
+			continue;
+		}
+		const Source& source = sources[i];
+		GLsizei size = std::min(source.size, textureSize);
+		glCopyImageSubData(source.texture, source.textureLayer < 0 ? GL_TEXTURE_2D : GL_TEXTURE_2D_ARRAY, 0, 0, 0,
+			std::max(source.textureLayer, 0), glTextures[source.layer][slots[i]], GL_TEXTURE_2D, 0, 0, 0, 0, size, size, 1);
+	}
+	wglDXUnlockObjectsNV(interopDevice, lockedCount, locked);
+	fenceValue++;
+	context4->Signal(fence, fenceValue);
+	context->Flush();
+
+	InterlockedIncrement64((volatile LONG64*)&header->sequence);
+	for (int i = 0; i < count; i++) {
+		if (slots[i] < 0) {
+			continue;
+		}
+		WallExportLayer& entry = header->layers[sources[i].layer];
+		GLsizei size = std::min(sources[i].size, textureSize);
+		entry.slot = (uint32_t)slots[i];
+		entry.width = (uint32_t)size;
+		entry.height = (uint32_t)size;
+		entry.frame = frame;
+		entry.fenceValue = fenceValue;
+	}
+	InterlockedIncrement64((volatile LONG64*)&header->sequence);
+	published++;
+#else
+	(void)sources;
+	(void)frame;
+#endif
+}
+
+void WallExport::report(std::ostream& out) const
+{
+	if (!valid()) {
+		return;
+	}
+	out << "wall export: " << layerCount << " layers, " << published << " frames published, " << blocked
+		<< " layer images left out with every slot taken" << std::endl;
+}
@@ -0,0 +1,147 @@
+#ifndef _WALL_EXPORT_H_
+#define _WALL_EXPORT_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+struct ID3D11Device;
+struct ID3D11DeviceContext;
+struct ID3D11DeviceContext4;
+struct ID3D11Fence;
+struct ID3D11Texture2D;
+
+// Hands the wall images to other processes on the same GPU without a copy through the CPU
+// (export.walls), for the projector warping and edge blending tools that drive the real
+// screens. Each exported layer (eye * walls + wall) has SLOTS D3D11 textures created shared
+// (NT handles) on a device of our own and registered with GL through WGL_NV_DX_interop;
+// after its wall pass a layer's image is copied on the GPU into a slot no consumer is
+// reading, a shared D3D11 fence is signaled once the copies are done, and the slot is
+// published with the fence value to wait for.
+//
+// What consumers need is in a named file mapping ("Local\" + export.name) laid out as
+// WallExportHeader. A consumer:
+//
+//   1. opens the mapping, checks magic and version, and DuplicateHandle()s textureHandles
+//      and fenceHandle out of producerProcess into its own process
+//   2. opens them on its device (ID3D11Device1::OpenSharedResource1, ID3D11Device5::
+//      OpenSharedFence), all of them once; they stay the same until the producer exits
+//   3. each frame, per layer: reads sequence (again if it is odd, the producer is writing),
+//      the layer's entry, and sequence again (all again if it moved); sets reading to the
+//      entry's slot and checks slot is still the newest, else takes the newest again; then
+//      has its context Wait() for fenceValue and reads the texture; sets reading back to
+//      NO_SLOT once its GPU is done with it
+//
+// The producer never writes a slot that is published or being read, so with three slots
+// there is always one to write. Images are as GL has them, the bottom row first, width x
+// height from the texture's first texel; the textures are as large as the largest wall.
+// Windows only, open() fails elsewhere or without the interop extension or D3D11.4 fences.
+const uint32_t WALLEXPORT_MAGIC = 0x58573350; // "P3WX"
+const uint32_t WALLEXPORT_VERSION = 1;
+const uint32_t WALLEXPORT_MAX_LAYERS = 16;
+const uint32_t WALLEXPORT_SLOTS = 3;
+const uint32_t WALLEXPORT_NO_SLOT = 0xffffffffu;
+
+struct WallExportLayer
+{
+	// Written by the producer: the newest slot, NO_SLOT before the first, and its image
+	uint32_t slot;
+	uint32_t width;
+	uint32_t height;
+	uint32_t reserved;
+	uint64_t frame;
+	uint64_t fenceValue;
+	// Written by a consumer: the slot it is reading, NO_SLOT when none. One consumer per
+	// layer can hold a slot this way, others read what is published without holding it.
+	volatile uint32_t reading;
+	uint32_t pad;
+};
+
+struct WallExportHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t producerProcess;
+	uint32_t layerCount;
+	uint32_t wallCount;
+	uint32_t slots;
+	// Side of every texture, and their DXGI_FORMAT
+	uint32_t textureSize;
+	uint32_t dxgiFormat;
+	// Handles in producerProcess, by layer and slot
+	uint64_t textureHandles[WALLEXPORT_MAX_LAYERS][WALLEXPORT_SLOTS];
+	uint64_t fenceHandle;
+	// Odd while the producer writes the layers, raised once before and once after
+	volatile int64_t sequence;
+	WallExportLayer layers[WALLEXPORT_MAX_LAYERS];
+};
+
+class WallExport
+{
+public:
+	// One layer's image this frame, where wallTexture() has it
+	struct Source
+	{
+		int layer;
+		GLuint texture;
+		// Its layer of a GL_TEXTURE_2D_ARRAY, -1 for a GL_TEXTURE_2D
+		GLint textureLayer;
+		GLsizei size;
+	};
+
+	WallExport();
+	~WallExport();
+
+	WallExport(const WallExport&) = delete;
+	WallExport& operator=(const WallExport&) = delete;
+
+	//! Creates the shared textures and the mapping, with the GL context current.
+	// @input layers The layers exported, eye * walls + wall, at most WALLEXPORT_MAX_LAYERS
+	// @input size The largest wall's side
+	// @input format The walls' GL format, the textures get the DXGI format like it
+	// @return Returns false with the reason printed if anything could not be made
+	bool open(const std::string& name, int layers, int walls, GLsizei size, GLenum format);
+	void close();
+	bool valid() const { return header != nullptr; }
+
+	//! Copies count layers' images into free slots and publishes them with one fence.
+	void publish(const Source* sources, int count, uint64_t frame);
+
+	void report(std::ostream& out) const;
+
+	//! The DXGI_FORMAT of the same layout as a GL format, 0 for one D3D has none of
+	static uint32_t dxgiFormat(GLenum format);
+
+private:
+	int freeSlot(int layer) const;
+
+	ID3D11Device* device;
+	ID3D11DeviceContext* context;
+	ID3D11DeviceContext4* context4;
+	ID3D11Fence* fence;
+	void* fenceHandle;
+	void* interopDevice;
+	void* mapping;
+	WallExportHeader* header;
+	int layerCount;
+	GLsizei textureSize;
+	ID3D11Texture2D* textures[WALLEXPORT_MAX_LAYERS][WALLEXPORT_SLOTS];
+	void* sharedHandles[WALLEXPORT_MAX_LAYERS][WALLEXPORT_SLOTS];
+	void* interopObjects[WALLEXPORT_MAX_LAYERS][WALLEXPORT_SLOTS];
+	GLuint glTextures[WALLEXPORT_MAX_LAYERS][WALLEXPORT_SLOTS];
+	uint64_t fenceValue;
+	uint64_t published;
+	// Frames a layer had no slot to write, every one taken
+	uint64_t blocked;
+};
+
+#endif
@@ -0,0 +1,140 @@
+#include "WallLayers.h"
+#include "GLMarkers.h"
+
+#include <OVR_CAPI_GL.h>
+
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstring>
+#include <iostream>
+
+WallLayers::WallLayers() : session(nullptr), count(0), size(0), readFbo(0), drawFbo(0)
+{
+	memset(chains, 0, sizeof(chains));
+	memset(quads, 0, sizeof(quads));
+	memset(shown, 0, sizeof(shown));
+}
+
+WallLayers::~WallLayers()
+{
+	shutdown();
+}
+
+bool WallLayers::init(ovrSession session, int count, GLsizei size, bool highQuality)
+{
+	shutdown();
+	this->session = session;
+	this->size = size;
+	if (count > MAX_WALLS) {
+		count = MAX_WALLS;
+	}
+
+	ovrTextureSwapChainDesc desc = {};
+	desc.Type = ovrTexture_2D;
+	desc.ArraySize = 1;
+	desc.Width = size;
+	desc.Height = size;
+	desc.MipLevels = 1;
+	desc.Format = OVR_FORMAT_R8G8B8A8_UNORM_SRGB;
+	desc.SampleCount = 1;
+	desc.StaticImage = ovrFalse;
+	for (int i = 0; i < count; i++) {
+		if (!OVR_SUCCESS(ovr_CreateTextureSwapChainGL(session, &desc, &chains[i]))) {
+			std::cerr << "could not create a swap chain for wall layer " << i << std::endl;
+			chains[i] = nullptr;
+			shutdown();
+			return false;
+		}
+		ovrLayerQuad& quad = quads[i];
+		quad.Header.Type = ovrLayerType_Quad;
+		quad.Header.Flags = ovrLayerFlag_TextureOriginAtBottomLeft | (highQuality ? ovrLayerFlag_HighQuality : 0);
+		quad.ColorTexture = chains[i];
+		shown[i] = false;
+	}
+	this->count = count;
+	glGenFramebuffers(1, &readFbo);
+	glGenFramebuffers(1, &drawFbo);
+	glMarkers().label(GL_FRAMEBUFFER, readFbo, "wall layers read");
+	glMarkers().label(GL_FRAMEBUFFER, drawFbo, "wall layers draw");
+	return true;
+}
+
+void WallLayers::shutdown()
+{
+	for (int i = 0; i < MAX_WALLS; i++) {
+		if (chains[i]) {
+			ovr_DestroyTextureSwapChain(session, chains[i]);
+			chains[i] = nullptr;
+		}
+		shown[i] = false;
+	}
+	if (readFbo) {
+		glDeleteFramebuffers(1, &readFbo);
+		glDeleteFramebuffers(1, &drawFbo);
+		readFbo = 0;
+		drawFbo = 0;
+	}
+	count = 0;
+}
+
+void WallLayers::update(int wall, GLuint texture, GLint layer, GLsizei size, const glm::mat4& transform)
+{
+	if (wall >= count) {
+		return;
+	}
+	size = size < this->size ? size : this->size;
+
+	int index;
+	GLuint chainTexture;
+	ovr_GetTextureSwapChainCurrentIndex(session, chains[wall], &index);
+	ovr_GetTextureSwapChainBufferGL(session, chains[wall], index, &chainTexture);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, readFbo);
+	if (layer >= 0) {
+		glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture, 0, layer);
+	}
+	else {
+		glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+	}
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFbo);
+	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, chainTexture, 0);
+	glBlitFramebuffer(0, 0, size, size, 0, 0, size, size, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+	glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	ovr_CommitTextureSwapChain(session, chains[wall]);
+
+	// The Quad spans -1..1, so the transform's first two columns are half the wall's extent.
+	// Only the part of the texture rendered into is sampled, like uvScale in the composite.
+	ovrLayerQuad& quad = quads[wall];
+	glm::vec3 right(transform[0]);
+	glm::vec3 up(transform[1]);
+	glm::vec3 normal(transform[2]);
+	glm::quat orientation = glm::quat_cast(glm::mat3(glm::normalize(right), glm::normalize(up), glm::normalize(normal)));
+	quad.QuadPoseCenter.Orientation.x = orientation.x;
+	quad.QuadPoseCenter.Orientation.y = orientation.y;
+	quad.QuadPoseCenter.Orientation.z = orientation.z;
+	quad.QuadPoseCenter.Orientation.w = orientation.w;
+	quad.QuadPoseCenter.Position.x = transform[3].x;
+	quad.QuadPoseCenter.Position.y = transform[3].y;
+	quad.QuadPoseCenter.Position.z = transform[3].z;
+	quad.QuadSize.x = 2.0f * glm::length(right);
+	quad.QuadSize.y = 2.0f * glm::length(up);
+	quad.Viewport.Pos.x = 0;
+	quad.Viewport.Pos.y = 0;
+	quad.Viewport.Size.w = size;
+	quad.Viewport.Size.h = size;
+	shown[wall] = true;
+}
+
+int WallLayers::headers(const ovrLayerHeader** out, int max) const
+{
+	int n = 0;
+	for (int i = 0; i < count && n < max; i++) {
+		if (shown[i]) {
+			out[n++] = &quads[i].Header;
+		}
+	}
+	return n;
+}
@@ -0,0 +1,64 @@
+#ifndef _WALL_LAYERS_H_
+#define _WALL_LAYERS_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include <OVR_CAPI.h>
+
+#include "CaveLayout.h"
+
+// The CAVE walls as compositor quad layers: each wall's offscreen texture is copied into a
+// swap chain of its own, and the compositor samples it straight onto the wall instead of the
+// app drawing the wall into the eye buffer first.
+//
+// A quad layer shows the same texture to both eyes, so the walls look like a CAVE without
+// shutter glasses: one eye's walls, seen in stereo as flat screens.
+class WallLayers
+{
+public:
+	enum { MAX_WALLS = CaveLayout::MAX_WALLS };
+
+	WallLayers();
+	~WallLayers();
+
+	WallLayers(const WallLayers&) = delete;
+	WallLayers& operator=(const WallLayers&) = delete;
+
+	// Swap chains for count walls of up to size x size texels. highQuality asks the compositor
+	// for its better filtered quad sampling.
+	bool init(ovrSession session, int count, GLsizei size, bool highQuality);
+	void shutdown();
+	bool active() const { return count > 0; }
+
+	//! Copies a wall's texture into its layer and commits it
+	// @input layer The array layer, -1 for a GL_TEXTURE_2D
+	// @input size The part of the texture rendered into, from the origin
+	// @input transform Puts the unit Quad onto the wall, in tracking space
+	void update(int wall, GLuint texture, GLint layer, GLsizei size, const glm::mat4& transform);
+	// Leaves the wall out of the submitted layers until its next update
+	void hide(int wall) { shown[wall] = false; }
+
+	// The layers of the walls shown, for ovr_SubmitFrame after the eye layer
+	int headers(const ovrLayerHeader** out, int max) const;
+
+private:
+	ovrSession session;
+	int count;
+	GLsizei size;
+	GLuint readFbo;
+	GLuint drawFbo;
+	ovrTextureSwapChain chains[MAX_WALLS];
+	ovrLayerQuad quads[MAX_WALLS];
+	bool shown[MAX_WALLS];
+};
+
+#endif
@@ -0,0 +1,69 @@
+#include "WallMips.h"
+#include "GLState.h"
+
+#include <algorithm>
+#include <iostream>
+
+// Level 0 texels one workgroup covers on a side
+static const GLint BLOCK = 32;
+
+WallMips::WallMips() : format(GL_RGBA8)
+{
+}
+
+bool WallMips::init(GLenum targetFormat)
+{
+	if (!GLEW_ARB_compute_shader || !GLEW_ARB_shader_image_load_store) {
+		std::cerr << "compute shaders not supported, wall mips from glGenerateMipmap" << std::endl;
+		return false;
+	}
+	// The images are declared in the targets' format
+	format = targetFormat;
+	const char* image = format == GL_R11F_G11F_B10F ? "r11f_g11f_b10f" : format == GL_RGBA16F ? "rgba16f" : "rgba8";
+	if (!program.loadCompute("wallMips.comp", std::string("#define IMAGE_FORMAT ") + image + "\n")) {
+		return false;
+	}
+	levels = program.uniform("levels");
+	extentsUniform = program.uniform("extents");
+	program.use();
+	program.setSampler("source", 0);
+	return true;
+}
+
+void WallMips::generate(const RenderTarget& target, int count, const GLint* extents)
+{
+	if (target.levels < 2 || count < 1) {
+		return;
+	}
+	if (!program.valid() || count > MAX_LAYERS || target.format != format) {
+		glState().bindTexture(0, GL_TEXTURE_2D_ARRAY, target.color);
+		glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+		return;
+	}
+	GLint written = std::min((GLint)target.levels - 1, (GLint)MAX_FUSED_LEVELS);
+	GLint largest = 1;
+	for (int i = 0; i < count; i++) {
+		largest = std::max(largest, extents[i]);
+	}
+
+	program.use();
+	levels.set(written);
+	extentsUniform.set(extents, count);
+	glState().bindTexture(0, GL_TEXTURE_2D_ARRAY, target.color);
+	for (GLint level = 1; level <= written; level++) {
+		glBindImageTexture(level - 1, target.color, level, GL_TRUE, 0, GL_WRITE_ONLY, target.format);
+	}
+	GLuint groups = (GLuint)((largest + BLOCK - 1) / BLOCK);
+	glDispatchCompute(groups, groups, (GLuint)count);
+	// The composite samples the levels next
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+void WallMips::generate(const RenderTarget& target)
+{
+	if (target.levels < 2) {
+		return;
+	}
+	glState().bindTexture(0, GL_TEXTURE_2D, target.color);
+	glGenerateMipmap(GL_TEXTURE_2D);
+}
@@ -0,0 +1,52 @@
+#ifndef _WALL_MIPS_H_
+#define _WALL_MIPS_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include "RenderTargets.h"
+#include "ShaderProgram.h"
+
+// Fills in the mip levels of wall targets after a wall pass, so the composite can sample
+// the walls trilinear and anisotropic where the HMD sees them at an angle.
+//
+// For array targets one compute dispatch (wallMips.comp) makes up to four levels at once:
+// every workgroup reads a 32x32 block of level 0 once and averages it down through shared
+// memory, instead of glGenerateMipmap going over the texture once per level. Each layer
+// only has its rendered corner (WallResolution) read, clamped at its edge, so whatever the
+// rest holds does not bleed into the coarser levels. Without compute shaders, and for the
+// per-wall GL_TEXTURE_2D targets, glGenerateMipmap does it.
+class WallMips
+{
+public:
+	// Levels past level 0 one dispatch writes, and the layers it takes at a time
+	enum { MAX_FUSED_LEVELS = 4, MAX_LAYERS = 32 };
+
+	WallMips();
+
+	WallMips(const WallMips&) = delete;
+	WallMips& operator=(const WallMips&) = delete;
+
+	//! Loads the compute pass for targets of a color format (RenderTargetFormat), if the
+	// context has compute shaders. False if not, generate() then uses glGenerateMipmap.
+	bool init(GLenum format);
+
+	//! Levels 1 and up of layers [0, count) of target from their level 0
+	// @input extents Per layer, the side of the square in its corner that was rendered
+	void generate(const RenderTarget& target, int count, const GLint* extents);
+	//! Levels 1 and up of a GL_TEXTURE_2D target
+	void generate(const RenderTarget& target);
+
+private:
+	ShaderProgram program;
+	GLenum format;
+	Uniform levels;
+	Uniform extentsUniform;
+};
+
+#endif
@@ -0,0 +1,177 @@
+#include "WallOcclusion.h"
+#include "GLMarkers.h"
+#include "GLState.h"
+#include "GpuMemory.h"
+#include "TextureUpload.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+// Texels a side of one workgroup of wallOcclusion.comp
+static const GLsizei GROUP = 8;
+// The smallest level 0 worth culling against
+static const GLsizei MIN_SIDE = 16;
+
+WallOcclusion::WallOcclusion() : side(0), depthSide(0), levels(0), layers(0)
+{
+}
+
+WallOcclusion::~WallOcclusion()
+{
+	release();
+}
+
+bool WallOcclusion::supported()
+{
+	return GLEW_ARB_compute_shader && GLEW_ARB_shader_image_load_store && GLEW_ARB_shader_storage_buffer_object;
+}
+
+void WallOcclusion::release()
+{
+	for (GLuint texture : { pyramid.get(), depth.get() }) {
+		if (texture) {
+			gpuMemory().release(GpuMemory::KIND_TEXTURE, texture);
+		}
+	}
+	if (layerInfo.get()) {
+		gpuMemory().release(GpuMemory::KIND_BUFFER, layerInfo);
+	}
+	pyramid.reset();
+	depth.reset();
+	layerInfo.reset();
+	sourceFramebuffer.reset();
+	depthFramebuffer.reset();
+	layers = 0;
+}
+
+bool WallOcclusion::init(int layerCount, GLsizei wallSide)
+{
+	release();
+	if (!supported()) {
+		std::cerr << "compute shaders not supported, props are not occlusion culled" << std::endl;
+		return false;
+	}
+	if (layerCount < 1 || layerCount > MAX_LAYERS || wallSide < MIN_SIDE) {
+		return false;
+	}
+	if (!fromDepth.loadCompute("wallOcclusion.comp", "#define FROM_DEPTH\n") || !reduce.loadCompute("wallOcclusion.comp")) {
+		return false;
+	}
+	fromDepthSize = fromDepth.uniform("size");
+	fromDepthSide = fromDepth.uniform("side");
+	fromDepthLayer = fromDepth.uniform("layer");
+	reduceSide = reduce.uniform("side");
+	reduceLayer = reduce.uniform("layer");
+	fromDepth.use();
+	fromDepth.setSampler("depth", 0);
+	glState().useProgram(0);
+
+	// A pyramid texel over at most 4x4 depth texels, or 5x5 where they do not line up
+	side = MIN_SIDE;
+	while (side * 4 < wallSide) {
+		side *= 2;
+	}
+	levels = 1;
+	while ((side >> (levels - 1)) > 1) {
+		levels++;
+	}
+	depthSide = wallSide;
+	layers = layerCount;
+
+	pyramid.create();
+	glState().bindTexture(0, GL_TEXTURE_2D_ARRAY, pyramid);
+	allocateTextureArrayStorage(levels, GL_R32F, side, side, layers);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	// The depth is copied out of the wall target, a renderbuffer for the separate walls
+	depth.create();
+	glState().bindTexture(0, GL_TEXTURE_2D, depth);
+	allocateTextureStorage(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT24, depthSide, depthSide);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+	gpuMemory().allocate(GpuMemory::KIND_TEXTURE, pyramid, textureBytes(GL_R32F, side, side, layers, levels),
+		GpuMemory::RENDER_TARGET, "wall occlusion pyramid");
+	gpuMemory().allocate(GpuMemory::KIND_TEXTURE, depth, textureBytes(GL_DEPTH_COMPONENT24, depthSide, depthSide, 1, 1),
+		GpuMemory::RENDER_TARGET, "wall occlusion depth");
+
+	layerInfo.create();
+	GLsizeiptr infoBytes = (GLsizeiptr)(layers * sizeof(Layer));
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, layerInfo);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, infoBytes, nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	gpuMemory().allocate(GpuMemory::KIND_BUFFER, layerInfo, infoBytes, GpuMemory::STREAMING, "wall occlusion layers");
+
+	sourceFramebuffer.create();
+	depthFramebuffer.create();
+	glMarkers().label(GL_FRAMEBUFFER, sourceFramebuffer, "occlusion source");
+	glMarkers().label(GL_FRAMEBUFFER, depthFramebuffer, "occlusion depth");
+	glBindFramebuffer(GL_FRAMEBUFFER, depthFramebuffer);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	glBindFramebuffer(GL_FRAMEBUFFER, sourceFramebuffer);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	invalidate();
+	return true;
+}
+
+void WallOcclusion::invalidate()
+{
+	if (!valid()) {
+		return;
+	}
+	std::vector<Layer> none((size_t)layers, Layer{ glm::mat4(1.f), glm::vec4(0.f) });
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, layerInfo);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, (GLsizeiptr)(none.size() * sizeof(Layer)), none.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void WallOcclusion::build(const RenderTarget& target, int targetLayer, int layer, GLsizei size, const glm::mat4& matrix)
+{
+	if (!valid() || layer < 0 || layer >= layers || size < 1 || size > depthSide) {
+		return;
+	}
+	// A layered target's depth is an array as well (RenderTargetCache), the others' is
+	// read from their own framebuffer
+	if (target.layers) {
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, sourceFramebuffer);
+		glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, target.depth, 0, targetLayer);
+	}
+	else {
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, target.fbo);
+	}
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depthFramebuffer);
+	glBlitFramebuffer(0, 0, size, size, 0, 0, size, size, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+
+	fromDepth.use();
+	fromDepthSize.set((int)size);
+	fromDepthSide.set((int)side);
+	fromDepthLayer.set(layer);
+	glState().bindTexture(0, GL_TEXTURE_2D, depth);
+	glBindImageTexture(0, pyramid, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_R32F);
+	GLuint groups = (GLuint)((side + GROUP - 1) / GROUP);
+	glDispatchCompute(groups, groups, 1);
+	reduce.use();
+	reduceLayer.set(layer);
+	for (int level = 1; level < levels; level++) {
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		GLsizei levelSide = side >> level;
+		reduceSide.set((int)levelSide);
+		glBindImageTexture(0, pyramid, level, GL_TRUE, 0, GL_WRITE_ONLY, GL_R32F);
+		glBindImageTexture(1, pyramid, level - 1, GL_TRUE, 0, GL_READ_ONLY, GL_R32F);
+		groups = (GLuint)((levelSide + GROUP - 1) / GROUP);
+		glDispatchCompute(groups, groups, 1);
+	}
+	// The culling fetches the levels next
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+	Layer info = { matrix, glm::vec4(1.f, (float)side, (float)levels, 0.f) };
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, layerInfo);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, (GLintptr)(layer * sizeof(Layer)), sizeof(Layer), &info);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
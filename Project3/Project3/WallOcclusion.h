@@ -0,0 +1,89 @@
+#ifndef _WALL_OCCLUSION_H_
+#define _WALL_OCCLUSION_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+
+#include "GLHandle.h"
+#include "RenderTargets.h"
+#include "ShaderProgram.h"
+
+// A depth pyramid per wall layer, from the last time the layer was rendered, for GpuCuller
+// to leave out the props something nearer hides from that wall's view (props.occlusion).
+//
+// After a layer is rendered its depth is copied out and reduced (build, wallOcclusion.comp)
+// into a level 0 of a quarter to a half of the wall targets' side, a power of two, and the
+// levels down to 1x1, each texel the farthest depth under it. The matrix the layer was rendered with
+// goes along into a storage buffer, so the culling projects a prop's bounds with the view
+// the pyramid holds rather than this frame's: a prop whose nearest point is behind the
+// farthest depth over all of it was hidden then. The eye moves between the two, which the
+// culler's second look (GpuCuller::recheck) against the pyramid of this frame catches.
+class WallOcclusion
+{
+public:
+	enum { MAX_LAYERS = 32 };
+
+	// What the culling reads of a layer, as gpuCull.comp declares it
+	struct Layer
+	{
+		glm::mat4 matrix;
+		// x 1 once built, y the pyramid's side, z its levels
+		glm::vec4 state;
+	};
+
+	WallOcclusion();
+	~WallOcclusion();
+
+	WallOcclusion(const WallOcclusion&) = delete;
+	WallOcclusion& operator=(const WallOcclusion&) = delete;
+
+	static bool supported();
+	//! Pyramids for layers wall layers of targets up to wallSide square. False, with
+	// nothing made, if compute shaders are missing or the programs do not link.
+	bool init(int layers, GLsizei wallSide);
+	bool valid() const { return pyramid.get() != 0; }
+	// Deletes the depth pyramid, the depth copy, the layer buffer and their framebuffers
+	void release();
+
+	//! Builds layer's pyramid from the depth just rendered into targetLayer of target
+	// (ignored for a target without layers). Leaves target bound.
+	// @input size The side of the rendered square at the target's origin
+	// @input matrix What the layer was rendered with
+	void build(const RenderTarget& target, int targetLayer, int layer, GLsizei size, const glm::mat4& matrix);
+	// No layer is culled against until it is built again
+	void invalidate();
+
+	GLuint texture() const { return pyramid; }
+	GLuint layerBuffer() const { return layerInfo; }
+
+private:
+	ShaderProgram fromDepth;
+	ShaderProgram reduce;
+	Uniform fromDepthSize;
+	Uniform fromDepthSide;
+	Uniform fromDepthLayer;
+	Uniform reduceSide;
+	Uniform reduceLayer;
+
+	GLTexture pyramid;
+	GLTexture depth;
+	GLFramebuffer sourceFramebuffer;
+	GLFramebuffer depthFramebuffer;
+	GLBuffer layerInfo;
+	GLsizei side;
+	GLsizei depthSide;
+	int levels;
+	int layers;
+};
+
+#endif
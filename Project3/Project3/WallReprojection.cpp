@@ -0,0 +1,187 @@
+#include "WallReprojection.h"
+#include "GLMarkers.h"
+#include "GLState.h"
+#include "GLStats.h"
+#include "GpuMemory.h"
+#include "TextureUpload.h"
+
+#include <algorithm>
+#include <iostream>
+
+WallReprojection::WallReprojection() : format(GL_RGBA8), side(0), layers(0), distance(0.f), maxWarps(0), step(1)
+{
+}
+
+WallReprojection::~WallReprojection()
+{
+	release();
+}
+
+void WallReprojection::release()
+{
+	for (GLuint texture : { color.get(), depth.get() }) {
+		if (texture) {
+			gpuMemory().release(GpuMemory::KIND_TEXTURE, texture);
+		}
+	}
+	color.reset();
+	depth.reset();
+	sourceFramebuffer.reset();
+	layerFramebuffer.reset();
+	vao.reset();
+	kept.clear();
+	layers = 0;
+}
+
+bool WallReprojection::init(int layers, GLsizei side, GLenum format, float distance, int maxWarps, int step)
+{
+	release();
+	if (layers < 1 || side < 1) {
+		return false;
+	}
+	if (!program.load("wallReproject.vert", nullptr, "wallReproject.frag")) {
+		return false;
+	}
+	reprojectionUniform = program.uniform("reprojection");
+	cellsUniform = program.uniform("cells");
+	stepUniform = program.uniform("step");
+	sizeUniform = program.uniform("size");
+	sourceScaleUniform = program.uniform("sourceScale");
+	layerUniform = program.uniform("layer");
+	program.use();
+	program.setSampler("sourceColor", 0);
+	program.setSampler("sourceDepth", 1);
+	glState().useProgram(0);
+
+	// Color is read between the grid's vertices, depth only at them
+	color.create();
+	glState().bindTexture(0, GL_TEXTURE_2D_ARRAY, color);
+	allocateTextureArrayStorage(1, format, side, side, layers);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	depth.create();
+	glState().bindTexture(0, GL_TEXTURE_2D_ARRAY, depth);
+	allocateTextureArrayStorage(1, GL_DEPTH_COMPONENT24, side, side, layers);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+	gpuMemory().allocate(GpuMemory::KIND_TEXTURE, color, textureBytes(format, side, side, layers, 1), GpuMemory::RENDER_TARGET,
+		"wall reprojection color");
+	gpuMemory().allocate(GpuMemory::KIND_TEXTURE, depth, textureBytes(GL_DEPTH_COMPONENT24, side, side, layers, 1),
+		GpuMemory::RENDER_TARGET, "wall reprojection depth");
+
+	// The layers are attached as they are used, the buffers read and drawn stay the same
+	sourceFramebuffer.create();
+	layerFramebuffer.create();
+	glMarkers().label(GL_FRAMEBUFFER, sourceFramebuffer, "reprojection source");
+	glMarkers().label(GL_FRAMEBUFFER, layerFramebuffer, "reprojection layer");
+	glBindFramebuffer(GL_FRAMEBUFFER, layerFramebuffer);
+	glDrawBuffer(GL_COLOR_ATTACHMENT0);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glBindFramebuffer(GL_FRAMEBUFFER, sourceFramebuffer);
+	glDrawBuffer(GL_COLOR_ATTACHMENT0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	// The grid comes from gl_VertexID, there are no attributes
+	vao.create();
+
+	this->format = format;
+	this->side = side;
+	this->layers = layers;
+	this->distance = distance;
+	this->maxWarps = maxWarps;
+	this->step = std::max(step, 1);
+	kept.assign((size_t)layers, Kept());
+	invalidate();
+	return true;
+}
+
+void WallReprojection::invalidate()
+{
+	for (Kept& k : kept) {
+		k.valid = false;
+	}
+}
+
+bool WallReprojection::canWarp(int layer, const glm::vec3& eye, GLsizei size, uint64_t scene) const
+{
+	if (!valid() || layer < 0 || layer >= layers) {
+		return false;
+	}
+	const Kept& k = kept[layer];
+	return k.valid && k.size == size && k.scene == scene && k.warps < maxWarps && glm::length(eye - k.eye) <= distance;
+}
+
+void WallReprojection::bindLayer(GLenum binding, const RenderTarget& target, int targetLayer)
+{
+	if (!target.layers) {
+		glBindFramebuffer(binding, target.fbo);
+		return;
+	}
+	// A layered target's depth is an array as well (RenderTargetCache)
+	glBindFramebuffer(binding, layerFramebuffer);
+	glFramebufferTextureLayer(binding, GL_COLOR_ATTACHMENT0, target.color, 0, targetLayer);
+	glFramebufferTextureLayer(binding, GL_DEPTH_ATTACHMENT, target.depth, 0, targetLayer);
+}
+
+void WallReprojection::keep(const RenderTarget& target, int targetLayer, int layer, GLsizei size, const glm::mat4& matrix,
+	const glm::vec3& eye, uint64_t scene)
+{
+	if (!valid() || layer < 0 || layer >= layers || size > side) {
+		return;
+	}
+	bindLayer(GL_READ_FRAMEBUFFER, target, targetLayer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, sourceFramebuffer);
+	glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, color, 0, layer);
+	glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth, 0, layer);
+	glBlitFramebuffer(0, 0, size, size, 0, 0, size, size, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+
+	Kept& k = kept[layer];
+	k.valid = true;
+	k.matrix = matrix;
+	k.eye = eye;
+	k.size = size;
+	k.scene = scene;
+	k.warps = 0;
+}
+
+void WallReprojection::warp(const RenderTarget& target, int targetLayer, int layer, const glm::mat4& matrix)
+{
+	if (!valid() || layer < 0 || layer >= layers || !kept[layer].valid) {
+		return;
+	}
+	Kept& k = kept[layer];
+	// From the kept clip space back to the world and into the new one. The off-axis matrices
+	// are badly conditioned near the wall's plane, so the inverse is taken in double.
+	glm::mat4 reprojection = glm::mat4(glm::dmat4(matrix) * glm::inverse(glm::dmat4(k.matrix)));
+	GLint cells = (k.size + step - 1) / step;
+
+	bindLayer(GL_FRAMEBUFFER, target, targetLayer);
+	glViewport(0, 0, k.size, k.size);
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LESS);
+	glState().depthMask(true);
+	glState().polygonMode(GL_FILL);
+	// Color is left as it is, the little the grid does not reach keeps the frame before's
+	glClear(GL_DEPTH_BUFFER_BIT);
+
+	program.use();
+	reprojectionUniform.set(reprojection);
+	cellsUniform.set(cells);
+	stepUniform.set(step);
+	sizeUniform.set(k.size);
+	sourceScaleUniform.set((float)k.size / (float)side);
+	layerUniform.set(layer);
+	glState().bindTexture(0, GL_TEXTURE_2D_ARRAY, color);
+	glState().bindTexture(1, GL_TEXTURE_2D_ARRAY, depth);
+	glState().bindVertexArray(vao);
+	glDrawArrays(GL_TRIANGLES, 0, cells * cells * 6);
+	glStats().addDraw();
+	glState().bindVertexArray(0);
+	if (target.layers) {
+		glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+	}
+	k.warps++;
+}
@@ -0,0 +1,108 @@
+#ifndef _WALL_REPROJECTION_H_
+#define _WALL_REPROJECTION_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "GLHandle.h"
+#include "RenderTargets.h"
+#include "ShaderProgram.h"
+
+// Walls for an eye that has hardly moved, warped from the last time they were rendered
+// instead of rendered again. What a wall shows only depends on where the eye is, which moves
+// by millimeters from one frame to the next, so for a viewer standing still most wall passes
+// draw nearly the same image again.
+//
+// After each full render of a wall layer its color and depth are copied out (keep). While the
+// eye stays within walls.reproject_mm of where it was then, the scene has not changed and
+// fewer than walls.reproject_frames warps have been made from it, the layer is drawn from
+// that copy instead (warp): a grid with a vertex every walls.reproject_step texels, each put
+// back into the world by its depth with the kept wall matrix and projected again with the new
+// one (wallReproject.vert). The grid stretches over what the move uncovers, and the depth
+// test sorts out what it covers. Warps always start from the full render, so their errors do
+// not add up.
+class WallReprojection
+{
+public:
+	WallReprojection();
+	~WallReprojection();
+
+	WallReprojection(const WallReprojection&) = delete;
+	WallReprojection& operator=(const WallReprojection&) = delete;
+
+	//! Room for layers wall layers up to side texels square, in the wall targets' color
+	// format. False, with nothing made, if the program does not link.
+	// @input distance How far the eye may be from where a layer was rendered, in meters
+	// @input maxWarps Warps of one render before the layer is rendered again
+	// @input step Texels between the grid's vertices
+	bool init(int layers, GLsizei side, GLenum format, float distance, int maxWarps, int step);
+	bool valid() const { return color.get() != 0; }
+	// Deletes the kept color and depth layers and their framebuffers, nothing is left to
+	// reproject from
+	void release();
+
+	//! Whether layer can be warped to an eye at eye instead of rendered. scene is whatever
+	// the caller's scene version is; a layer rendered with another is never warped.
+	bool canWarp(int layer, const glm::vec3& eye, GLsizei size, uint64_t scene) const;
+	//! Copies what was just rendered into layer targetLayer of target (ignored for a target
+	// without layers) as layer's, rendered with matrix from eye. Leaves target bound.
+	void keep(const RenderTarget& target, int targetLayer, int layer, GLsizei size, const glm::mat4& matrix,
+		const glm::vec3& eye, uint64_t scene);
+	//! Draws layer's kept image into targetLayer of target as seen with matrix, over its
+	// depth, which is cleared. Leaves target bound and the depth test on.
+	void warp(const RenderTarget& target, int targetLayer, int layer, const glm::mat4& matrix);
+	// Every layer rendered again before it is warped
+	void invalidate();
+
+private:
+	struct Kept
+	{
+		bool valid;
+		glm::mat4 matrix;
+		glm::vec3 eye;
+		GLsizei size;
+		uint64_t scene;
+		int warps;
+	};
+
+	// The layer of target (or target itself) attached to the scratch framebuffer and bound
+	// to binding
+	void bindLayer(GLenum binding, const RenderTarget& target, int targetLayer);
+
+	ShaderProgram program;
+	Uniform reprojectionUniform;
+	Uniform cellsUniform;
+	Uniform stepUniform;
+	Uniform sizeUniform;
+	Uniform sourceScaleUniform;
+	Uniform layerUniform;
+
+	GLTexture color;
+	GLTexture depth;
+	GLFramebuffer sourceFramebuffer;
+	GLFramebuffer layerFramebuffer;
+	GLVertexArray vao;
+	GLenum format;
+	GLsizei side;
+	int layers;
+	float distance;
+	int maxWarps;
+	int step;
+
+	std::vector<Kept> kept;
+};
+
+#endif
@@ -0,0 +1,219 @@
+#include "WallResolution.h"
+#include "Config.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// Viewports move in steps of this much of the base size, so they do not change every frame
+static const float SCALE_STEP = 1.0f / 32.0f;
+
+WallResolution::WallResolution() : wallCount(0), variableBands(false), outerScale(0.5f), foveaTan(0.5f), adaptiveScale(false),
+	budgetMs(4.0f), minScale(0.25f), passes(1), gpuScale(1.0f), qualityScale(1.0f),
+	governed(false), gpuMs(0.0f), nextQuery(0), activeQuery(-1)
+{
+	for (int wall = 0; wall < MAX_WALLS; wall++) {
+		baseSize[wall] = 1024;
+		for (int eye = 0; eye < EYES; eye++) {
+			coverageScale[eye][wall] = 1.0f;
+			fovea[eye][wall] = glm::vec4(0.5f);
+		}
+	}
+	for (int i = 0; i < QUERIES; i++) {
+		queries[i] = 0;
+		queryPending[i] = false;
+	}
+}
+
+WallResolution::~WallResolution()
+{
+	if (queries[0]) {
+		glDeleteQueries(QUERIES, queries);
+	}
+}
+
+// walls.<name>.resolution, the layout's or walls.resolution
+static GLsizei configuredBase(const CaveWall& wall)
+{
+	int size = config().getInt("walls." + wall.name + ".resolution", wall.resolution ? wall.resolution : config().getInt("walls.resolution", 1024));
+	return (GLsizei)std::min(std::max(size, 16), 8192);
+}
+
+void WallResolution::configure(const CaveLayout& layout)
+{
+	wallCount = (int)layout.size();
+	for (int wall = 0; wall < wallCount; wall++) {
+		baseSize[wall] = configuredBase(layout.wall(wall));
+	}
+	adaptiveScale = config().getBool("walls.adaptive", false);
+	budgetMs = std::max(config().getFloat("walls.gpu_budget_ms", 4.0f), 0.1f);
+	minScale = std::min(std::max(config().getFloat("walls.min_scale", 0.25f), 0.05f), 1.0f);
+	variableBands = config().getBool("walls.variable", false);
+	outerScale = std::min(std::max(config().getFloat("walls.variable_outer", 0.5f), 0.1f), 1.0f);
+	float degrees = std::min(std::max(config().getFloat("walls.variable_fovea_degrees", 25.0f), 1.0f), 80.0f);
+	foveaTan = std::tan(degrees * 3.14159265f / 180.0f);
+
+	if (adaptiveScale && !queries[0]) {
+		glGenQueries(QUERIES, queries);
+	}
+}
+
+bool WallResolution::reloadBases(const CaveLayout& layout, GLsizei limit)
+{
+	bool changed = false;
+	for (int wall = 0; wall < wallCount && wall < (int)layout.size(); wall++) {
+		GLsizei size = configuredBase(layout.wall(wall));
+		if (size > limit) {
+			std::cerr << "wall " << layout.wall(wall).name << ": resolution " << size << " is above the " << limit
+				<< " the wall targets were made for, using that" << std::endl;
+			size = limit;
+		}
+		changed = changed || size != baseSize[wall];
+		baseSize[wall] = size;
+	}
+	return changed;
+}
+
+GLsizei WallResolution::maxBase() const
+{
+	GLsizei size = 1;
+	for (int wall = 0; wall < wallCount; wall++) {
+		size = std::max(size, baseSize[wall]);
+	}
+	return size;
+}
+
+void WallResolution::setCoverage(int eye, int wall, float pixels)
+{
+	// Roughly one texel per covered pixel is all the composite can show
+	float side = std::sqrt(std::max(pixels, 0.0f));
+	coverageScale[eye][wall] = std::min(std::max(side / (float)baseSize[wall], minScale), 1.0f);
+}
+
+GLsizei WallResolution::size(int eye, int wall) const
+{
+	if (!adaptiveScale && qualityScale >= 1.0f) {
+		return baseSize[wall];
+	}
+	float scale = adaptiveScale ? std::min(std::min(coverageScale[eye][wall], gpuScale), qualityScale) : qualityScale;
+	scale = std::ceil(scale / SCALE_STEP) * SCALE_STEP;
+	return std::max((GLsizei)(baseSize[wall] * std::min(scale, 1.0f)), (GLsizei)1);
+}
+
+void WallResolution::setFovea(int eye, int wall, const glm::vec4& bounds, bool inView)
+{
+	// In wall uv, grown out to the steps so the bands do not change every frame
+	glm::vec4 uv = glm::clamp(bounds * 0.5f + 0.5f, glm::vec4(0.0f), glm::vec4(1.0f));
+	uv.x = std::floor(uv.x / SCALE_STEP) * SCALE_STEP;
+	uv.z = std::floor(uv.z / SCALE_STEP) * SCALE_STEP;
+	uv.y = std::ceil(uv.y / SCALE_STEP) * SCALE_STEP;
+	uv.w = std::ceil(uv.w / SCALE_STEP) * SCALE_STEP;
+	if (!inView || uv.y <= uv.x || uv.w <= uv.z) {
+		uv = glm::vec4(0.5f);
+	}
+	fovea[eye][wall] = uv;
+}
+
+WallBands WallResolution::uniformBands(GLsizei side)
+{
+	WallBands bands;
+	bands.edges = glm::vec4(0.5f);
+	bands.packed = glm::vec4(0.5f);
+	bands.extent = glm::ivec2(side);
+	return bands;
+}
+
+std::string WallResolution::shaderDefines()
+{
+	// Wall uv to where it was drawn: per axis, three bands whose middle one starts and ends
+	// at edges in the wall and at placed in what was drawn
+	return "#define BAND_FUNCTIONS \\\n"
+		"float band(float u, vec2 edges, vec2 placed) \\\n"
+		"{ \\\n"
+		"	if (u < edges.x) \\\n"
+		"		return edges.x > 0.0 ? u / edges.x * placed.x : 0.0; \\\n"
+		"	if (u < edges.y) \\\n"
+		"		return placed.x + (u - edges.x) / (edges.y - edges.x) * (placed.y - placed.x); \\\n"
+		"	return edges.y < 1.0 ? placed.y + (u - edges.y) / (1.0 - edges.y) * (1.0 - placed.y) : 1.0; \\\n"
+		"} \\\n"
+		"vec2 bandUV(vec2 uv, vec4 edges, vec4 placed) \\\n"
+		"{ \\\n"
+		"	return vec2(band(uv.x, edges.xy, placed.xy), band(uv.y, edges.zw, placed.zw)); \\\n"
+		"}\n";
+}
+
+WallBands WallResolution::bands(int eye, int wall) const
+{
+	GLsizei side = size(eye, wall);
+	WallBands bands = uniformBands(side);
+	if (!variableBands) {
+		return bands;
+	}
+	bands.edges = fovea[eye][wall];
+	for (int axis = 0; axis < 2; axis++) {
+		float first = bands.edges[axis * 2];
+		float last = bands.edges[axis * 2 + 1];
+		// Texels of the bands before, in and after the middle one
+		float before = first * outerScale * side;
+		float middle = (last - first) * side;
+		float after = (1.0f - last) * outerScale * side;
+		float extent = std::max(std::ceil(before + middle + after), 1.0f);
+		bands.packed[axis * 2] = before / extent;
+		bands.packed[axis * 2 + 1] = (before + middle) / extent;
+		bands.extent[axis] = (int)extent;
+	}
+	return bands;
+}
+
+void WallResolution::beginPass()
+{
+	if (!adaptiveScale) {
+		return;
+	}
+	readQueries();
+	// A query whose result has not come back yet cannot be reused, that pass goes untimed
+	if (queryPending[nextQuery]) {
+		activeQuery = -1;
+		return;
+	}
+	activeQuery = nextQuery;
+	nextQuery = (nextQuery + 1) % QUERIES;
+	glBeginQuery(GL_TIME_ELAPSED, queries[activeQuery]);
+}
+
+void WallResolution::endPass()
+{
+	if (activeQuery < 0) {
+		return;
+	}
+	glEndQuery(GL_TIME_ELAPSED);
+	queryPending[activeQuery] = true;
+	activeQuery = -1;
+}
+
+void WallResolution::readQueries()
+{
+	for (int i = 0; i < QUERIES; i++) {
+		if (!queryPending[i]) {
+			continue;
+		}
+		GLint available = 0;
+		glGetQueryObjectiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) {
+			continue;
+		}
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &elapsed);
+		queryPending[i] = false;
+
+		float ms = (float)elapsed / 1.0e6f * passes;
+		gpuMs += (ms - gpuMs) * 0.1f;
+		if (governed) {
+			continue;
+		}
+		// Cost follows the pixel count, the square of the scale. Ease toward the scale that
+		// would just meet the budget.
+		float target = gpuScale * std::sqrt(budgetMs / std::max(ms, 0.01f));
+		gpuScale += (std::min(std::max(target, minScale), 1.0f) - gpuScale) * 0.1f;
+	}
+}
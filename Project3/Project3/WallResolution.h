@@ -0,0 +1,131 @@
+#ifndef _WALL_RESOLUTION_H_
+#define _WALL_RESOLUTION_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+
+#include "CaveLayout.h"
+
+#include <string>
+
+// How a wall's texels are spread over it with variable resolution: three bands per axis,
+// the middle one at full density. edges has where the middle bands start and end in wall
+// uv (x1, x2, y1, y2), packed the same in the part of the target drawn, which is extent
+// texels. Without variable resolution the bands are the identity and extent is square.
+struct WallBands
+{
+	glm::vec4 edges;
+	glm::vec4 packed;
+	glm::ivec2 extent;
+};
+
+// How many pixels of its render target each CAVE wall is drawn with, per eye.
+//
+// Every wall has a base resolution its target is allocated at. In adaptive mode the
+// viewport inside that target shrinks with the wall's coverage of the eye buffer (a wall
+// seen at a grazing angle covers few pixels and gains nothing from a full target) and with
+// the measured GPU time of the wall pass against a budget.
+//
+// With walls.variable the density also falls off across a wall, by where the lens center
+// is: the part of the wall within walls.variable_fovea_degrees of the eye's forward
+// direction (setFovea) is drawn at size(), the bands either side of it at
+// walls.variable_outer of that. A wall the eye faces away from is all outer. The wall
+// pass draws the bands side by side, packed into less of the target (bands()), and the
+// composite maps wall uv through them again.
+class WallResolution
+{
+public:
+	enum { MAX_WALLS = CaveLayout::MAX_WALLS, EYES = 2 };
+
+	WallResolution();
+	~WallResolution();
+
+	WallResolution(const WallResolution&) = delete;
+	WallResolution& operator=(const WallResolution&) = delete;
+
+	// A wall's base resolution is walls.<name>.resolution, else the layout's resolution for
+	// it, else walls.resolution. Also reads walls.adaptive, walls.gpu_budget_ms and
+	// walls.min_scale.
+	void configure(const CaveLayout& layout);
+	//! The base resolutions of a layout with as many walls, reloaded while running, each at
+	// most limit (what the targets the walls share were made for).
+	// @return Whether any of them changed
+	bool reloadBases(const CaveLayout& layout, GLsizei limit);
+	// How many timed wall passes make up a frame, the budget is for all of them
+	void setPassesPerFrame(int count) { passes = count > 0 ? count : 1; }
+
+	bool adaptive() const { return adaptiveScale; }
+	void disableAdaptive() { adaptiveScale = false; }
+	//! A governor's scale on every wall's side, on top of the adaptive one or without it. While
+	// governed the measured GPU time no longer moves the adaptive scale.
+	void setQualityScale(float scale) { qualityScale = scale; }
+	void setGoverned(bool governed) { this->governed = governed; }
+	GLsizei base(int wall) const { return baseSize[wall]; }
+	GLsizei maxBase() const;
+
+	// The wall covers this many pixels of the eye buffer this frame
+	void setCoverage(int eye, int wall, float pixels);
+
+	// Side of the square viewport to draw the wall with, at most base(wall)
+	GLsizei size(int eye, int wall) const;
+
+	bool variable() const { return variableBands; }
+	void disableVariable() { variableBands = false; }
+	// Tangent of the half angle drawn at full density
+	float foveaTangent() const { return foveaTan; }
+	//! Where the full density part of the wall is this frame, in wall clip space (x min and
+	// max, y min and max), or none if inView is false
+	void setFovea(int eye, int wall, const glm::vec4& bounds, bool inView);
+	// The bands to draw the wall with at size(eye, wall)
+	WallBands bands(int eye, int wall) const;
+	// The same density all over, side texels square
+	static WallBands uniformBands(GLsizei side);
+	//! #define BAND_FUNCTIONS, band() and bandUV() for the shaders that sample a wall drawn
+	// with bands, which expand it rather than each having a copy
+	static std::string shaderDefines();
+
+	// Times the GPU work between the two. Results are read back frames later, once they are
+	// available, so this never waits on the GPU.
+	void beginPass();
+	void endPass();
+	float gpuMilliseconds() const { return gpuMs; }
+
+private:
+	enum { QUERIES = 4 };
+
+	void readQueries();
+
+	int wallCount;
+	GLsizei baseSize[MAX_WALLS];
+	float coverageScale[EYES][MAX_WALLS];
+	// The middle bands in wall uv, empty (both at 0.5) for none
+	glm::vec4 fovea[EYES][MAX_WALLS];
+	bool variableBands;
+	float outerScale;
+	float foveaTan;
+	bool adaptiveScale;
+	float budgetMs;
+	float minScale;
+	int passes;
+
+	float gpuScale;
+	float qualityScale;
+	bool governed;
+	float gpuMs;
+	GLuint queries[QUERIES];
+	bool queryPending[QUERIES];
+	int nextQuery;
+	int activeQuery;
+};
+
+#endif
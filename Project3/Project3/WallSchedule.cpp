@@ -0,0 +1,71 @@
+#include "WallSchedule.h"
+#include "Config.h"
+
+#include <algorithm>
+
+// Above this much of the budget the interval grows, below the lower one it shrinks
+static const float BUSY = 0.9f;
+static const float IDLE = 0.7f;
+// How many frames in a row it takes, growing reacts quickly, shrinking waits to be sure
+static const int BUSY_FRAMES = 3;
+static const int IDLE_FRAMES = 45;
+
+WallSchedule::WallSchedule() : current(EVERY_FRAME), wallCount(1), baseInterval(1), maxInterval(4), stride(1),
+	adaptive(false), frame(0), overBudget(0), underBudget(0)
+{
+}
+
+void WallSchedule::configure(int wallCount)
+{
+	std::string mode = config().getString("walls.update", "every");
+	current = mode == "interval" ? INTERVAL : mode == "round_robin" ? ROUND_ROBIN : EVERY_FRAME;
+	this->wallCount = std::max(wallCount, 1);
+	baseInterval = current == EVERY_FRAME ? 1 : std::max(config().getInt("walls.update_interval", 2), 1);
+	maxInterval = std::max(config().getInt("walls.update_max_interval", 4), baseInterval);
+	adaptive = config().getBool("walls.update_adaptive", false);
+	stride = baseInterval;
+	frame = 0;
+	overBudget = 0;
+	underBudget = 0;
+}
+
+void WallSchedule::beginFrame(float gpuTime, float budget)
+{
+	frame++;
+	if (!adaptive || gpuTime <= 0.0f || budget <= 0.0f) {
+		return;
+	}
+	overBudget = gpuTime > budget * BUSY ? overBudget + 1 : 0;
+	underBudget = gpuTime < budget * IDLE ? underBudget + 1 : 0;
+	if (overBudget >= BUSY_FRAMES && stride < maxInterval) {
+		stride++;
+		overBudget = 0;
+	}
+	if (underBudget >= IDLE_FRAMES && stride > baseInterval) {
+		stride--;
+		underBudget = 0;
+	}
+}
+
+void WallSchedule::govern(int extra)
+{
+	adaptive = false;
+	stride = std::min(baseInterval + std::max(extra, 0), maxInterval);
+}
+
+bool WallSchedule::wallDue(int wall) const
+{
+	if (current == ROUND_ROBIN) {
+		return frame % (unsigned int)(wallCount * stride) == (unsigned int)(wall * stride);
+	}
+	return frame % (unsigned int)stride == 0;
+}
+
+bool WallSchedule::passDue() const
+{
+	// A layered pass clears every layer of its array, so its walls take their turns together
+	if (current == ROUND_ROBIN) {
+		return frame % (unsigned int)(wallCount * stride) == 0;
+	}
+	return frame % (unsigned int)stride == 0;
+}
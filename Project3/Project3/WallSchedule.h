@@ -0,0 +1,56 @@
+#ifndef _WALL_SCHEDULE_H_
+#define _WALL_SCHEDULE_H_
+
+// Which frames re-render the CAVE walls. The wall textures only depend on where the eyes
+// are, not where the head looks, so they can be refreshed less often than the composite
+// that shows them, which still runs every frame.
+//
+//   every        every frame
+//   interval     all walls every walls.update_interval-th frame
+//   round_robin  one wall per frame, walls.update_interval frames each
+//
+// With walls.update_adaptive the interval also grows while the app's GPU time is close to
+// the frame budget and shrinks back once there is headroom again, so wall passes are
+// skipped before HMD frames are dropped.
+class WallSchedule
+{
+public:
+	enum Mode { EVERY_FRAME, INTERVAL, ROUND_ROBIN };
+
+	WallSchedule();
+
+	// Reads walls.update, walls.update_interval, walls.update_adaptive and
+	// walls.update_max_interval
+	void configure(int wallCount);
+
+	// Moves to the next frame. gpuTime is the app's last measured GPU time and budget the
+	// frame's, both in seconds, 0 when not known.
+	void beginFrame(float gpuTime, float budget);
+
+	//! Hands the interval to a governor: base plus extra frames, at most the max interval,
+	// and the adaptive loop stops adjusting it.
+	void govern(int extra);
+	// How many frames the governor can add to the base interval
+	int governSteps() const { return maxInterval - baseInterval; }
+
+	// Whether a wall rendered to a target of its own is re-rendered this frame
+	bool wallDue(int wall) const;
+	// Whether a pass that renders every wall at once (the layered ones) runs this frame
+	bool passDue() const;
+
+	Mode mode() const { return current; }
+	int interval() const { return stride; }
+
+private:
+	Mode current;
+	int wallCount;
+	int baseInterval;
+	int maxInterval;
+	int stride;
+	bool adaptive;
+	unsigned int frame;
+	int overBudget;
+	int underBudget;
+};
+
+#endif
@@ -0,0 +1,224 @@
+#include "WallTemporal.h"
+#include "GLState.h"
+#include "GLStats.h"
+#include "GpuMemory.h"
+#include "TextureUpload.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+// Element index of the Halton sequence in base
+static float halton(unsigned int index, unsigned int base)
+{
+	float result = 0.f;
+	float fraction = 1.f / (float)base;
+	while (index) {
+		result += fraction * (float)(index % base);
+		index /= base;
+		fraction /= (float)base;
+	}
+	return result;
+}
+
+// A side x side array of layers textures in format, sampled with filter
+static void allocateLayers(GLTexture& texture, GLenum format, GLsizei side, int layers, GLint filter, const char* label)
+{
+	texture.create();
+	glState().bindTexture(0, GL_TEXTURE_2D_ARRAY, texture);
+	allocateTextureArrayStorage(1, format, side, side, layers);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, filter);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, filter);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	gpuMemory().allocate(GpuMemory::KIND_TEXTURE, texture, textureBytes(format, side, side, layers, 1), GpuMemory::RENDER_TARGET, label);
+}
+
+WallTemporal::WallTemporal() : side(0), layers(0), scale(1.f), feedback(0.f), frame(0)
+{
+}
+
+WallTemporal::~WallTemporal()
+{
+	release();
+}
+
+void WallTemporal::release()
+{
+	for (GLuint texture : { color.get(), depth.get(), history.get() }) {
+		if (texture) {
+			gpuMemory().release(GpuMemory::KIND_TEXTURE, texture);
+		}
+	}
+	color.reset();
+	depth.reset();
+	history.reset();
+	inputFramebuffer.reset();
+	historyFramebuffer.reset();
+	layerFramebuffer.reset();
+	vao.reset();
+	histories.clear();
+	layers = 0;
+}
+
+bool WallTemporal::init(int layers, GLsizei side, GLenum format, float scale, float feedback)
+{
+	release();
+	if (layers < 1 || side < 1) {
+		return false;
+	}
+	if (!program.load("wallTemporal.vert", nullptr, "wallTemporal.frag")) {
+		return false;
+	}
+	layerUniform = program.uniform("layer");
+	jitterUniform = program.uniform("jitter");
+	renderSizeUniform = program.uniform("renderSize");
+	sizeUniform = program.uniform("size");
+	inputScaleUniform = program.uniform("inputScale");
+	historyScaleUniform = program.uniform("historyScale");
+	reprojectionUniform = program.uniform("reprojection");
+	historyValidUniform = program.uniform("historyValid");
+	feedbackUniform = program.uniform("feedback");
+	program.use();
+	program.setSampler("renderColor", 0);
+	program.setSampler("renderDepth", 1);
+	program.setSampler("history", 2);
+	glState().useProgram(0);
+
+	allocateLayers(color, format, side, layers, GL_LINEAR, "wall temporal render");
+	allocateLayers(depth, GL_DEPTH_COMPONENT24, side, layers, GL_NEAREST, "wall temporal depth");
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+	allocateLayers(history, format, side, layers, GL_LINEAR, "wall temporal history");
+
+	// The layers are attached as they are used, the buffers read and drawn stay the same
+	inputFramebuffer.create();
+	historyFramebuffer.create();
+	layerFramebuffer.create();
+	for (GLuint framebuffer : { inputFramebuffer.get(), historyFramebuffer.get(), layerFramebuffer.get() }) {
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glDrawBuffer(GL_COLOR_ATTACHMENT0);
+		glReadBuffer(GL_COLOR_ATTACHMENT0);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	// The resolve's triangle comes from gl_VertexID, there are no attributes
+	vao.create();
+
+	this->side = side;
+	this->layers = layers;
+	this->scale = glm::clamp(scale, 0.25f, 1.f);
+	this->feedback = glm::clamp(feedback, 0.f, 0.98f);
+	histories.assign((size_t)layers, History());
+	invalidate();
+	return true;
+}
+
+void WallTemporal::invalidate()
+{
+	for (History& h : histories) {
+		h.valid = false;
+		h.frames = 0;
+	}
+}
+
+void WallTemporal::beginFrame()
+{
+	frame++;
+}
+
+glm::vec2 WallTemporal::jitter() const
+{
+	unsigned int index = frame % JITTERS + 1;
+	return glm::vec2(halton(index, 2), halton(index, 3)) - 0.5f;
+}
+
+GLsizei WallTemporal::renderSize(int layer, GLsizei size) const
+{
+	if (!valid() || layer < 0 || layer >= layers) {
+		return size;
+	}
+	return std::max((GLsizei)std::lround(size * scale), (GLsizei)1);
+}
+
+glm::mat4 WallTemporal::jitterMatrix(int layer, GLsizei renderSize) const
+{
+	if (!valid() || layer < 0 || layer >= layers || renderSize < 1) {
+		return glm::mat4(1.f);
+	}
+	// Clip space is two across the render
+	return glm::translate(glm::mat4(1.f), glm::vec3(jitter() * 2.f / (float)renderSize, 0.f));
+}
+
+bool WallTemporal::converged(int layer, const glm::mat4& matrix) const
+{
+	if (!valid() || layer < 0 || layer >= layers) {
+		return true;
+	}
+	const History& h = histories[layer];
+	return h.valid && h.frames >= JITTERS && h.matrix == matrix;
+}
+
+void WallTemporal::bindLayer(GLenum binding, const RenderTarget& target, int targetLayer)
+{
+	if (!target.layers) {
+		glBindFramebuffer(binding, target.fbo);
+		return;
+	}
+	// A layered target's depth is an array as well (RenderTargetCache)
+	glBindFramebuffer(binding, layerFramebuffer);
+	glFramebufferTextureLayer(binding, GL_COLOR_ATTACHMENT0, target.color, 0, targetLayer);
+	glFramebufferTextureLayer(binding, GL_DEPTH_ATTACHMENT, target.depth, 0, targetLayer);
+}
+
+void WallTemporal::resolve(const RenderTarget& target, int targetLayer, int layer, GLsizei renderSize, GLsizei size,
+	const glm::mat4& matrix)
+{
+	if (!valid() || layer < 0 || layer >= layers || size > side) {
+		return;
+	}
+	History& h = histories[layer];
+	bool historyValid = h.valid && h.size == size;
+	// The previous resolve's clip space from this one's, in double for the off-axis matrices
+	glm::mat4 reprojection = historyValid ? glm::mat4(glm::dmat4(h.matrix) * glm::inverse(glm::dmat4(matrix))) : glm::mat4(1.f);
+
+	// The render's corner of the target into the arrays, since the resolve writes over it
+	bindLayer(GL_READ_FRAMEBUFFER, target, targetLayer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, inputFramebuffer);
+	glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, color, 0, layer);
+	glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth, 0, layer);
+	glBlitFramebuffer(0, 0, renderSize, renderSize, 0, 0, renderSize, renderSize, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+	bindLayer(GL_FRAMEBUFFER, target, targetLayer);
+	glViewport(0, 0, size, size);
+	glDisable(GL_DEPTH_TEST);
+	glState().polygonMode(GL_FILL);
+	program.use();
+	layerUniform.set(layer);
+	jitterUniform.set(jitter());
+	renderSizeUniform.set(renderSize);
+	sizeUniform.set(size);
+	inputScaleUniform.set((float)renderSize / (float)side);
+	historyScaleUniform.set((float)size / (float)side);
+	reprojectionUniform.set(reprojection);
+	historyValidUniform.set(historyValid ? 1 : 0);
+	feedbackUniform.set(feedback);
+	glState().bindTexture(0, GL_TEXTURE_2D_ARRAY, color);
+	glState().bindTexture(1, GL_TEXTURE_2D_ARRAY, depth);
+	glState().bindTexture(2, GL_TEXTURE_2D_ARRAY, history);
+	glState().bindVertexArray(vao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glStats().addDraw();
+	glState().bindVertexArray(0);
+
+	// What was resolved is the next frame's history
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, historyFramebuffer);
+	glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, history, 0, layer);
+	glBlitFramebuffer(0, 0, size, size, 0, 0, size, size, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+	glEnable(GL_DEPTH_TEST);
+
+	h.frames = historyValid && h.matrix == matrix ? h.frames + 1 : 1;
+	h.valid = true;
+	h.matrix = matrix;
+	h.size = size;
+}
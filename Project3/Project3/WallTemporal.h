@@ -0,0 +1,115 @@
+#ifndef _WALL_TEMPORAL_H_
+#define _WALL_TEMPORAL_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "GLHandle.h"
+#include "RenderTargets.h"
+#include "ShaderProgram.h"
+
+// Walls rendered with fewer pixels than they are shown with, and made up to full size over
+// the frames. Each wall pass draws walls.temporal_scale of the side WallResolution gives a
+// wall, about half the pixels at 0.7, with the projection moved by a different fraction of
+// a pixel each frame. The resolve (wallTemporal.frag) then writes the full size wall from
+// that render and from the wall it resolved the frame before, found again by the depth of
+// the render and how the wall's matrix changed since: the eye moves, the wall matrix with
+// it. Over the eight jitters of a cycle the history gathers as many samples per pixel as a
+// full render has. Whatever moved by itself is held to the colors around it in the render,
+// so it lags a little instead of leaving trails.
+//
+// The history is a copy of each resolved layer, so the target's own texture is only
+// written. A layer whose matrix stays the same is resolved until the cycle is through and
+// then kept (converged), like the walls that do not need rendering again.
+class WallTemporal
+{
+public:
+	enum { JITTERS = 8 };
+
+	WallTemporal();
+	~WallTemporal();
+
+	WallTemporal(const WallTemporal&) = delete;
+	WallTemporal& operator=(const WallTemporal&) = delete;
+
+	//! Room for layers wall layers up to side texels square, in the wall targets' color
+	// format. False, with nothing made, if the program does not link.
+	// @input scale The part of a wall's side rendered
+	// @input feedback How much of the history each resolve keeps, 0 to 1
+	bool init(int layers, GLsizei side, GLenum format, float scale, float feedback);
+	bool valid() const { return color.get() != 0; }
+	// Deletes the input and history layers and their framebuffers, every layer's history
+	// starts over
+	void release();
+
+	// The next jitter, once a frame before the wall cameras are set
+	void beginFrame();
+	// Side to render layer with when it is shown at size
+	GLsizei renderSize(int layer, GLsizei size) const;
+	//! What moves layer's projection by this frame's jitter, for a render renderSize texels
+	// across. The identity for layers this does not resolve.
+	glm::mat4 jitterMatrix(int layer, GLsizei renderSize) const;
+	// Whether layer has been resolved with matrix for a whole cycle
+	bool converged(int layer, const glm::mat4& matrix) const;
+
+	//! Resolves what was just rendered into layer targetLayer of target (ignored for a target
+	// without layers) to size texels. Leaves target bound and the depth test on.
+	// @input matrix The layer's wall matrix without the jitter
+	void resolve(const RenderTarget& target, int targetLayer, int layer, GLsizei renderSize, GLsizei size, const glm::mat4& matrix);
+	// Every layer starts again from its next render alone
+	void invalidate();
+
+private:
+	struct History
+	{
+		bool valid;
+		glm::mat4 matrix;
+		GLsizei size;
+		int frames;
+	};
+
+	void bindLayer(GLenum binding, const RenderTarget& target, int targetLayer);
+	// This frame's jitter in render texels, -0.5 to 0.5
+	glm::vec2 jitter() const;
+
+	ShaderProgram program;
+	Uniform layerUniform;
+	Uniform jitterUniform;
+	Uniform renderSizeUniform;
+	Uniform sizeUniform;
+	Uniform inputScaleUniform;
+	Uniform historyScaleUniform;
+	Uniform reprojectionUniform;
+	Uniform historyValidUniform;
+	Uniform feedbackUniform;
+
+	// The render's color and depth, and the resolved layers of the frame before
+	GLTexture color;
+	GLTexture depth;
+	GLTexture history;
+	GLFramebuffer inputFramebuffer;
+	GLFramebuffer historyFramebuffer;
+	GLFramebuffer layerFramebuffer;
+	GLVertexArray vao;
+	GLsizei side;
+	int layers;
+	float scale;
+	float feedback;
+	unsigned int frame;
+
+	std::vector<History> histories;
+};
+
+#endif
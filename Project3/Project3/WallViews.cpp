@@ -0,0 +1,92 @@
+#include "WallViews.h"
+#include "FrameRing.h"
+#include "GpuMemory.h"
+
+WallViews::WallViews() : ubo(0), stride(sizeof(WallViewsBlock)), frame(0), dirty(true), inRing(false), ringOffset(0)
+{
+	block = WallViewsBlock();
+	for (glm::mat4& modelview : block.modelviews) {
+		modelview = glm::mat4(1.f);
+	}
+}
+
+WallViews::~WallViews()
+{
+	if (ubo) {
+		gpuMemory().release(GpuMemory::KIND_BUFFER, ubo);
+		glDeleteBuffers(1, &ubo);
+	}
+}
+
+void WallViews::init()
+{
+	GLint alignment = 1;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	if (alignment < 1) {
+		alignment = 1;
+	}
+	stride = ((GLsizeiptr)sizeof(WallViewsBlock) + alignment - 1) / alignment * alignment;
+
+	if (!ubo) {
+		glGenBuffers(1, &ubo);
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+	glBufferData(GL_UNIFORM_BUFFER, stride * FRAMES, nullptr, GL_DYNAMIC_DRAW);
+	gpuMemory().allocate(GpuMemory::KIND_BUFFER, ubo, stride * FRAMES, GpuMemory::STREAMING, "wall views");
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	frame = 0;
+	dirty = true;
+}
+
+void WallViews::setLayout(const CaveLayout& cave)
+{
+	for (size_t i = 0; i < cave.size() && i < CaveLayout::MAX_WALLS; i++) {
+		const CaveWallGeometry& wall = cave.wallGeometry(i);
+		glm::vec4* out = &block.walls[4 * i];
+		out[0] = glm::vec4(wall.right, wall.left0);
+		out[1] = glm::vec4(wall.up, wall.right0);
+		out[2] = glm::vec4(wall.normal, wall.bottom0);
+		out[3] = glm::vec4(wall.top0, wall.plane, 0.f, 0.f);
+	}
+	glm::vec2 depth = CaveLayout::depthTerms();
+	block.depth = glm::vec4(depth, 0.f, 0.f);
+	dirty = true;
+}
+
+void WallViews::beginFrame()
+{
+	frame = (frame + 1) % FRAMES;
+	// Whatever was written last frame is in space that is about to be reused
+	dirty = true;
+}
+
+void WallViews::setViews(int first, int count, const glm::vec3* eyes, const glm::mat4* modelviews)
+{
+	for (int i = 0; i < count && first + i < VIEWS; i++) {
+		block.eyes[first + i] = glm::vec4(eyes[i], 1.f);
+		block.modelviews[first + i] = modelviews[i];
+	}
+	dirty = true;
+}
+
+void WallViews::bind()
+{
+	if (!ubo) {
+		return;
+	}
+	if (dirty) {
+		inRing = frameRing().write(&block, sizeof(block), frameRing().uniformAlignment(), ringOffset);
+		if (!inRing) {
+			glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+			glBufferSubData(GL_UNIFORM_BUFFER, stride * frame, sizeof(block), &block);
+			glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		}
+		dirty = false;
+	}
+	if (inRing) {
+		glBindBufferRange(GL_UNIFORM_BUFFER, BINDING, frameRing().buffer(), ringOffset, sizeof(block));
+	}
+	else {
+		glBindBufferRange(GL_UNIFORM_BUFFER, BINDING, ubo, stride * frame, sizeof(block));
+	}
+}
@@ -0,0 +1,77 @@
+#ifndef _WALL_VIEWS_H_
+#define _WALL_VIEWS_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+#include "CaveLayout.h"
+
+// The std140 WallViews uniform block of wallLayered.vert and wallMultiview.vert with
+// WALL_VIEWS. Every member is a multiple of 16 bytes, so this matches the block byte for byte.
+struct WallViewsBlock
+{
+	// Per wall CaveWallGeometry's right, up and normal with left0, right0 and bottom0 in w,
+	// then top0 and plane
+	glm::vec4 walls[CaveLayout::MAX_WALLS * 4];
+	// By view (viewer * 2 + eye): the eye in CAVE space and the modelview the walls are
+	// rendered with
+	glm::vec4 eyes[8];
+	glm::mat4 modelviews[8];
+	// The frustums' depth terms, CaveLayout::depthTerms
+	glm::vec4 depth;
+};
+
+// What the layered wall passes need to work out every wall's off-axis projection in the
+// vertex shader, in place of a matrix per layer uploaded for every pass: the walls, which
+// only change with the layout, and each view's eye position and modelview, once a frame.
+// The vertex shader does CaveLayout's projectWall for its layer's wall and view, with the
+// projection folded into the vertex so no matrix is built.
+//
+// The block goes into the frame ring (FrameRing.h) when there is one and anything in it
+// changed, otherwise into one of FRAMES copies of it used in turn.
+class WallViews
+{
+public:
+	enum { VIEWS = 8, FRAMES = 3, BINDING = 2 };
+
+	WallViews();
+	~WallViews();
+
+	WallViews(const WallViews&) = delete;
+	WallViews& operator=(const WallViews&) = delete;
+
+	void init();
+	bool valid() const { return ubo != 0; }
+
+	// The walls, again whenever the layout changes
+	void setLayout(const CaveLayout& cave);
+	// Moves on to the next frame's copy
+	void beginFrame();
+	// count views from first, after CaveLayout::computeProjections has had the same eyes
+	void setViews(int first, int count, const glm::vec3* eyes, const glm::mat4* modelviews);
+	// Writes the block if it changed since and binds it for the next draws
+	void bind();
+
+private:
+	WallViewsBlock block;
+	GLuint ubo;
+	GLsizeiptr stride;
+	int frame;
+	bool dirty;
+	bool inRing;
+	GLintptr ringOffset;
+};
+
+#endif
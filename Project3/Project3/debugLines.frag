@@ -0,0 +1,9 @@
+#version 330 core
+
+in vec3 lineColor;
+out vec3 color;
+
+void main()
+{
+	color = lineColor;
+}
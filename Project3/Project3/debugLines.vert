@@ -0,0 +1,23 @@
+#version 330 core
+
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec4 vertexColor;
+
+// The camera of the draw, bound by CameraUniforms (frame -> eye -> wall)
+layout (std140) uniform Camera {
+	mat4 projection;
+	mat4 modelview;
+	// projection * modelview, so vertices need no matrix products of their own
+	mat4 viewProjection;
+	mat4 wallProjections[8];
+	vec4 eyePosition;
+};
+
+// DebugDraw's lines, in world space with a colour each
+out vec3 lineColor;
+
+void main()
+{
+	lineColor = vertexColor.rgb;
+	gl_Position = viewProjection * vec4(position, 1.0);
+}
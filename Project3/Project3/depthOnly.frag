@@ -0,0 +1,8 @@
+#version 330 core
+// The wall passes' depth pre-pass (DepthPrepass): depth is all it writes, with color masked
+// off. The scene programs' vertex stages are shared with it and declare gl_Position
+// invariant, so the shading draws after it find exactly its depth with GL_EQUAL.
+
+void main()
+{
+}
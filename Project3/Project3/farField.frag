@@ -0,0 +1,16 @@
+#version 330 core
+// The far field's color where the eye's pixel looks (FarField)
+
+uniform sampler2D farColor;
+// The part of the texture the far field was drawn into this frame
+uniform vec2 farScale;
+
+in vec4 farClip;
+
+out vec4 color;
+
+void main()
+{
+	vec2 uv = farClip.xy / farClip.w * 0.5 + 0.5;
+	color = texture(farColor, uv * farScale);
+}
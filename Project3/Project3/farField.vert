@@ -0,0 +1,16 @@
+#version 330 core
+// NOTE: Do NOT use any version older than 330! Bad things will happen!
+// The far field over a whole eye (FarField): one triangle on the far plane, its corners
+// taken into the far field's clip space by direction
+
+// From the eye's clip space to the far field's, rotation only
+uniform mat4 farFromEye;
+
+out vec4 farClip;
+
+void main()
+{
+	vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;
+	farClip = farFromEye * vec4(corner, 1.0, 1.0);
+	gl_Position = vec4(corner, 1.0, 1.0);
+}
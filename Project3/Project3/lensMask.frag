@@ -0,0 +1,6 @@
+#version 330 core
+
+// Only depth and stencil are written, the color mask is off
+void main()
+{
+}
@@ -0,0 +1,10 @@
+#version 330 core
+// NOTE: Do NOT use any version older than 330! Bad things will happen!
+
+// Already in NDC, put on the near plane
+layout (location = 0) in vec2 position;
+
+void main()
+{
+	gl_Position = vec4(position, -1.0, 1.0);
+}
@@ -22,12 +22,120 @@ limitations under the License.
 #include <memory>
 #include <exception>
 #include <algorithm>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <map>
+#include <fstream>
+#include <cstddef>
 #include <Windows.h>
 
 #include "shader.h"
 #include "Box.h"
 #include "Quad.h"
-#include "Pyramid.h"
+#include "DebugDraw.h"
+#include "Image.h"
+#include "TextureCache.h"
+#include "AssetArchive.h"
+#include "AssetLoader.h"
+#include "SharedAssetCache.h"
+#include "TextureUpload.h"
+#include "PixelConvert.h"
+#include "AssetRegistry.h"
+#include "TextureQuality.h"
+#include "UploadRing.h"
+#include "UploadScheduler.h"
+#include "FrameRing.h"
+#include "VirtualTexture.h"
+#include "Config.h"
+#include "StartupProfiler.h"
+#include "GLExtensions.h"
+#include "RenderTargets.h"
+#include "WallMips.h"
+#include "WallReprojection.h"
+#include "FarField.h"
+#include "WallOcclusion.h"
+#include "WallTemporal.h"
+#include "WallCubeCapture.h"
+#include "DepthPrepass.h"
+#include "WallResolution.h"
+#include "CaveLayout.h"
+#include "ShaderProgram.h"
+#include "ShaderReloader.h"
+#include "LayoutReloader.h"
+#include "ShaderVariants.h"
+#include "CameraUniforms.h"
+#include "WallViews.h"
+#include "GLState.h"
+#include "MeshPool.h"
+#include "LodSelector.h"
+#include "LensMask.h"
+#include "DrawList.h"
+#include "GpuCuller.h"
+#include "GpuAdapter.h"
+#include "AtlasArray.h"
+#include "BindlessTextures.h"
+#include "PerfHud.h"
+#include "QuadLayers.h"
+#include "ProjectorOutputs.h"
+#include "FrameCapture.h"
+#include "VideoTexture.h"
+#include "LatencyProbe.h"
+#include "FrameExchange.h"
+#include "WallLayers.h"
+#include "WallSchedule.h"
+#include "EyeResolution.h"
+#include "QualityGovernor.h"
+#include "ThreadScheduling.h"
+#include "LargePages.h"
+#include "FeatureToggles.h"
+#include "FlightRecorder.h"
+#include "PoseTrace.h"
+#include "CpuProfiler.h"
+#include "GpuTimers.h"
+#include "FramePacing.h"
+#include "FrameLimiter.h"
+#include "MicroBench.h"
+#include "RigidPose.h"
+#include "PosePredictor.h"
+#include "FrameArena.h"
+#include "EntityStore.h"
+#include "EntityBvh.h"
+#include "PropPhysics.h"
+#include "SkinnedMesh.h"
+#include "StationProbe.h"
+#include "PipelineWarmup.h"
+#include "JobSystem.h"
+#include "SpscRing.h"
+#include "InputEvents.h"
+#include "FixedStep.h"
+#include "GLStats.h"
+#include "GLDebugLog.h"
+#include "GLMarkers.h"
+#include "Telemetry.h"
+#include "SoakTest.h"
+#include "StartupPrefetch.h"
+#include "StressScene.h"
+#include "SceneSnapshot.h"
+#include "GpuMemory.h"
+#include "GpuHandles.h"
+#include "GpuMulticast.h"
+#include "FrameBaselines.h"
+#include "ClusterSync.h"
+#include "FrameDelta.h"
+#include "FrameGraph.h"
+#include "DrawQueue.h"
+#include "CommandBuffer.h"
+#include "ShadingCache.h"
+#include "Lighting.h"
+#include "UploadThread.h"
+#include "PointCloud.h"
+#include "WallExport.h"
+#include "GLHandle.h"
+#include "OvrHandle.h"
+#include "Log.h"
 
 #define __STDC_FORMAT_MACROS 1
 
@@ -67,87 +175,6 @@ using namespace std;
 
 #include <GL/glew.h>
 
-bool checkFramebufferStatus(GLenum target = GL_FRAMEBUFFER) {
-	GLuint status = glCheckFramebufferStatus(target);
-	switch (status) {
-	case GL_FRAMEBUFFER_COMPLETE:
-		return true;
-		break;
-
-	case GL_FRAMEBUFFER_INCOMPLETE_ATTACHMENT:
-		std::cerr << "framebuffer incomplete attachment" << std::endl;
-		break;
-
-	case GL_FRAMEBUFFER_INCOMPLETE_MISSING_ATTACHMENT:
-		std::cerr << "framebuffer missing attachment" << std::endl;
-		break;
-
-	case GL_FRAMEBUFFER_INCOMPLETE_DRAW_BUFFER:
-		std::cerr << "framebuffer incomplete draw buffer" << std::endl;
-		break;
-
-	case GL_FRAMEBUFFER_INCOMPLETE_READ_BUFFER:
-		std::cerr << "framebuffer incomplete read buffer" << std::endl;
-		break;
-
-	case GL_FRAMEBUFFER_INCOMPLETE_MULTISAMPLE:
-		std::cerr << "framebuffer incomplete multisample" << std::endl;
-		break;
-
-	case GL_FRAMEBUFFER_INCOMPLETE_LAYER_TARGETS:
-		std::cerr << "framebuffer incomplete layer targets" << std::endl;
-		break;
-
-	case GL_FRAMEBUFFER_UNSUPPORTED:
-		std::cerr << "framebuffer unsupported internal format or image" << std::endl;
-		break;
-
-	default:
-		std::cerr << "other framebuffer error" << std::endl;
-		break;
-	}
-
-	return false;
-}
-
-bool checkGlError() {
-	GLenum error = glGetError();
-	if (!error) {
-		return false;
-	}
-	else {
-		switch (error) {
-		case GL_INVALID_ENUM:
-			std::cerr << ": An unacceptable value is specified for an enumerated argument.The offending command is ignored and has no other side effect than to set the error flag.";
-			break;
-		case GL_INVALID_VALUE:
-			std::cerr << ": A numeric argument is out of range.The offending command is ignored and has no other side effect than to set the error flag";
-			break;
-		case GL_INVALID_OPERATION:
-			std::cerr << ": The specified operation is not allowed in the current state.The offending command is ignored and has no other side effect than to set the error flag..";
-			break;
-		case GL_INVALID_FRAMEBUFFER_OPERATION:
-			std::cerr << ": The framebuffer object is not complete.The offending command is ignored and has no other side effect than to set the error flag.";
-			break;
-		case GL_OUT_OF_MEMORY:
-			std::cerr << ": There is not enough memory left to execute the command.The state of the GL is undefined, except for the state of the error flags, after this error is recorded.";
-			break;
-		case GL_STACK_UNDERFLOW:
-			std::cerr << ": An attempt has been made to perform an operation that would cause an internal stack to underflow.";
-			break;
-		case GL_STACK_OVERFLOW:
-			std::cerr << ": An attempt has been made to perform an operation that would cause an internal stack to overflow.";
-			break;
-		}
-		return true;
-	}
-}
-
-void glDebugCallbackHandler(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar *msg, GLvoid* data) {
-	OutputDebugStringA(msg);
-	std::cout << "debug call: " << msg << std::endl;
-}
-
 //////////////////////////////////////////////////////////////////////
 //
 // GLFW provides cross platform window creation
@@ -177,16 +204,49 @@ protected:
 	GLFWwindow * window{ nullptr };
 	unsigned int frame{ 0 };
 
+private:
+	// Everything the user does goes from the thread polling for it (the main thread) to the
+	// one rendering through this ring, and is handled at the start of the next frame
+	enum { INPUT_RING = 256 };
+	SpscRing<InputEvent, INPUT_RING> inputRing;
+	std::atomic<uint64_t> droppedInput{ 0 };
+	// This frame's Touch events, for frameInput()
+	std::vector<InputEvent> frameEvents;
+	// How long a frame may spend on GL jobs (jobs.gl_budget_ms)
+	double glJobBudgetMs{ 1.0 };
+	// When the last frame started, for telemetry's frame times
+	double lastFrameStart{ -1.0 };
+	// The windows of a feature comparison (features.compare_frames, _windows, _settle)
+	int compareFrames{ 300 };
+	int compareWindows{ 4 };
+	int compareSettle{ 30 };
+	// The context was asked for as a debug one (gl.context), otherwise without error checking
+	bool debugContext{ true };
+	// app.max_frames, 0 for no end
+	unsigned int maxFrames{ 0 };
+	// app.pipelined: the next frame's update() and prepareFrame() run on a worker from when a
+	// frame is submitted, the job on preparing
+	bool pipelined{ false };
+	bool prepareStarted{ false };
+	JobCounter preparing;
+
 public:
 	GlfwApp() {
 		// Initialize the GLFW system for creating and positioning windows
-		if (!glfwInit()) {
+		int initialized;
+		{
+			StartupScope scope("glfw", "glfwInit");
+			initialized = glfwInit();
+		}
+		if (!initialized) {
 			FAIL("Failed to initialize GLFW");
 		}
 		glfwSetErrorCallback(ErrorCallback);
+		frameEvents.reserve(INPUT_RING);
 	}
 
 	virtual ~GlfwApp() {
+		uploadThread().stop();
 		if (nullptr != window) {
 			glfwDestroyWindow(window);
 		}
@@ -194,9 +254,20 @@ public:
 	}
 
 	virtual int run() {
+		cpuProfiler().setEnabled(config().getBool("profile.cpu", true));
+		cpuProfiler().setRingSize((size_t)std::max(config().getInt("profile.ring", 65536), 1));
+		cpuProfiler().nameThread("main");
+		allocationWatch::configure(config().getInt("alloc.check_after", 300), config().getBool("alloc.assert", false));
+		maxFrames = (unsigned int)std::max(config().getInt("app.max_frames", 0), 0);
+		compareFrames = config().getInt("features.compare_frames", 300);
+		compareWindows = config().getInt("features.compare_windows", 4);
+		compareSettle = config().getInt("features.compare_settle", 30);
 		preCreate();
 
-		window = createRenderingTarget(windowSize, windowPosition);
+		{
+			StartupScope scope("window", "createRenderingTarget");
+			window = createRenderingTarget(windowSize, windowPosition);
+		}
 
 		if (!window) {
 			std::cout << "Unable to create OpenGL window" << std::endl;
@@ -206,18 +277,237 @@ public:
 		postCreate();
 
 		initGl();
+		GL_CHECK_ERROR("initGl");
+		setupFrameLimiter();
+		//features.compare runs an A/B comparison of a feature from the first frame, for
+		//unattended runs
+		std::string compared = config().getString("features.compare");
+		if (!compared.empty() && !featureToggles().compare(compared, compareFrames, compareWindows, compareSettle))
+			std::cerr << "features.compare: there is no feature " << compared << " to switch" << std::endl;
+
+		if (config().getBool("app.render_thread", false)) {
+			runThreaded();
+		}
+		else {
+			// app.pipelined overlaps a frame's simulation with the GPU's work on the one
+			// before, the render thread already runs update on a thread of its own
+			pipelined = config().getBool("app.pipelined", false);
+			threadScheduling().enter(ThreadScheduling::RENDER);
+			while (!glfwWindowShouldClose(window)) {
+				// Events are only polled once the job is done, it pushes input as well
+				bool prepared = finishPreparedFrame();
+				{
+					CpuScope scope("glfwPollEvents");
+					PacingScope pacing(FramePacing::POLL);
+					glfwPollEvents();
+				}
+				if (!prepared) {
+					PacingScope pacing(FramePacing::UPDATE);
+					updateScoped();
+				}
+				renderFrame();
+			}
+
+			finishPreparedFrame();
+			shutdownGl();
+			threadScheduling().leave();
+		}
+
+		if (config().getBool("profile.trace_at_exit", false)) {
+			writeCpuTrace();
+		}
+		// Everything the app made should be gone with shutdownGl
+		gpuMemory().report(logStream(LOG_INFO));
+		gpuMemory().reportLeaks(std::cerr);
+		largePages().report(logStream(LOG_INFO));
+		return 0;
+	}
+
+	// The CPU timeline so far, to profile.trace. P writes one while running.
+	void writeCpuTrace() {
+		cpuProfiler().writeTrace(config().getString("profile.trace", "cpu_trace.json").c_str());
+	}
+
+	// The GL context moves to a render thread that only renders frames, events and update()
+	// stay on this thread at app.update_hz. update() hands its results over with a
+	// FrameExchange, beginFrame() picks them up.
+	void runThreaded() {
+		std::atomic<bool> running(true);
+		std::exception_ptr failure;
+
+		glfwMakeContextCurrent(nullptr);
+		std::thread renderer([&] {
+			glfwMakeContextCurrent(window);
+			cpuProfiler().nameThread("render");
+			threadScheduling().enter(ThreadScheduling::RENDER);
+			try {
+				while (running) {
+					renderFrame();
+				}
+				shutdownGl();
+			}
+			catch (...) {
+				failure = std::current_exception();
+				glfwSetWindowShouldClose(window, 1);
+			}
+			threadScheduling().leave();
+			glfwMakeContextCurrent(nullptr);
+		});
 
+		const std::chrono::microseconds period(1000000 / std::max(config().getInt("app.update_hz", 1000), 1));
+		auto next = std::chrono::steady_clock::now();
 		while (!glfwWindowShouldClose(window)) {
-			++frame;
-			glfwPollEvents();
-			update();
-			draw();
+			{
+				CpuScope scope("glfwPollEvents");
+				glfwPollEvents();
+			}
+			updateScoped();
+			// A slow update starts the next one right away instead of catching up
+			next = std::max(next + period, std::chrono::steady_clock::now());
+			std::this_thread::sleep_until(next);
+		}
+
+		running = false;
+		renderer.join();
+		glfwMakeContextCurrent(window);
+		if (failure) {
+			std::rethrow_exception(failure);
+		}
+	}
+
+	void updateScoped() {
+		CpuScope scope("update");
+		update();
+	}
+
+	//! Waits for the job startNextFrame() started.
+	// @return Whether there was one, and update() already ran for the coming frame
+	bool finishPreparedFrame() {
+		if (!prepareStarted)
+			return false;
+		{
+			CpuScope scope("wait prepared frame");
+			jobs().wait(preparing);
+		}
+		prepareStarted = false;
+		return true;
+	}
+
+	void renderFrame() {
+		++frame;
+		allocationWatch::beginFrame();
+		dispatchInput();
+		double frameStart = startupTimeline().now();
+		{
+			CpuScope scope("frame", (int)frame);
+			{
+				CpuScope scope("beginFrame");
+				PacingScope pacing(FramePacing::BEGIN_FRAME);
+				gpuTimers().beginFrame();
+				frameRing().beginFrame();
+				// What background jobs left for the GL thread
+				jobs().runGlJobs(glJobBudgetMs);
+				glDebugLog().update();
+				beginFrame();
+			}
+			{
+				PacingScope pacing(FramePacing::DRAW);
+				draw();
+			}
+			startNextFrame();
+			PacingScope pacing(FramePacing::SWAP);
 			finishFrame();
+			frameRing().endFrame();
+			//What the frame released is deleted once the GPU is past it
+			gpuHandles().endFrame();
+		}
+		double frameEnd = startupTimeline().now();
+		GL_CHECK_ERROR("frame");
+		framePacing().endFrame(frame);
+		allocationWatch::endFrame(frame);
+		glStats().endFrame();
+		if (cpuProfiler().enabled())
+			cpuProfiler().counter("gpu memory MB", (int)(gpuMemory().total() >> 20));
+		if (telemetry().active() && lastFrameStart >= 0.0)
+			telemetry().frame(telemetrySample((float)((frameStart - lastFrameStart) * 1000.0)));
+		if (featureToggles().comparing() && lastFrameStart >= 0.0)
+			featureToggles().frame((frameEnd - frameStart) * 1000.0, gpuTimers().lastFrameMs(), (frameStart - lastFrameStart) * 1000.0);
+		if (flightRecorder().active() && lastFrameStart >= 0.0)
+			flightRecorder().frame(frame, (float)((frameEnd - frameStart) * 1000.0), gpuTimers().lastFrameMs(),
+				(float)((frameStart - lastFrameStart) * 1000.0), qualityGovernor().stepsDown(), gpuMemory().total());
+		lastFrameStart = frameStart;
+		sharedAssetCache().heartbeat();
+		{
+			CpuScope scope("frame limiter");
+			frameLimiter().wait(framePaced());
+		}
+
+		// Textures that are loaded on first use finish here, so startup ends with the first frame
+		if (frame == 1) {
+			startupTimeline().record("first frame", "", frameStart, startupTimeline().now() - frameStart, 0);
+			startupTimeline().finish(config().getString("startup.json").c_str());
+			telemetry().setStartup(startupTimeline().now());
+			startupPrefetch().finish();
 		}
+		// Ends the run the way closing the window does, so everything shuts down in order
+		if (maxFrames && frame >= maxFrames)
+			glfwSetWindowShouldClose(window, 1);
+	}
 
-		shutdownGl();
+	//The frame's numbers for telemetry, where every pass whose name starts with "wall" adds
+	//to the walls' GPU time. Nothing here allocates.
+	Telemetry::Frame telemetrySample(float frameMs) const {
+		Telemetry::Frame sample;
+		sample.frameMs = frameMs;
+		sample.gpuMs = gpuTimers().lastFrameMs();
+		sample.wallGpuMs = 0.0f;
+		for (size_t i = 0; i < gpuTimers().passCount(); i++) {
+			if (gpuTimers().name((int)i).compare(0, 4, "wall") == 0)
+				sample.wallGpuMs += gpuTimers().passMs((int)i);
+		}
+		sample.vramBytes = gpuMemory().total();
+		return sample;
+	}
 
-		return 0;
+	// Keys and mouse buttons go to their handlers, the rest is kept for frameInput()
+	void dispatchInput() {
+		frameEvents.clear();
+		InputEvent e;
+		bool any = false;
+		while (inputRing.pop(e)) {
+			any = true;
+			if (e.type == InputEvent::KEY)
+				onKey(e.code, e.scancode, e.action, e.mods);
+			else if (e.type == InputEvent::MOUSE_BUTTON)
+				onMouseButton(e.code, e.action, e.mods);
+			else
+				frameEvents.push_back(e);
+		}
+		if (any)
+			frameLimiter().activity();
+	}
+
+	// frame.limit and frame.idle_hz, see FrameLimiter.h. The benchmarks run as fast as they go
+	// unless asked to, everything else goes no faster than the display.
+	void setupFrameLimiter() {
+#ifdef CAVE_BENCHMARK
+		const char * limitDefault = "off";
+		float idleDefault = 0.f;
+#else
+		const char * limitDefault = "compositor";
+		float idleDefault = 4.f;
+#endif
+		std::string limit = config().getString("frame.limit", limitDefault);
+		FrameLimiter::Mode mode;
+		double hz;
+		if (!FrameLimiter::parseMode(limit, mode, hz)) {
+			std::cerr << "frame.limit is off, compositor, vsync or a rate in Hz, using " << limitDefault << std::endl;
+			FrameLimiter::parseMode(limitDefault, mode, hz);
+		}
+		frameLimiter().configure(mode, hz, refreshRate(), std::max(config().getFloat("frame.idle_hz", idleDefault), 0.f),
+			std::max(config().getInt("frame.idle_after_ms", 2000), 0) / 1000.0);
+		if (mode == FrameLimiter::VSYNC)
+			glfwSwapInterval(1);
 	}
 
 
@@ -231,7 +521,20 @@ protected:
 		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
 		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
 		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-		glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, true);
+		// gl.context is debug (the default in debug builds) or release (in release builds).
+		// In a debug context gl.debug (off, performance or all) picks the driver messages
+		// logged, off also leaves out the debug context. A release context is made with
+		// KHR_no_error where the driver has it. The upload context is made with the same
+		// hints, contexts sharing objects have to agree on that.
+		debugContext = GLDebugLog::parseDebugContext(config().getString("gl.context"));
+		glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, debugContext && config().getString("gl.debug", "performance") != "off");
+#ifdef GLFW_CONTEXT_NO_ERROR
+		glfwWindowHint(GLFW_CONTEXT_NO_ERROR, !debugContext);
+#endif
+		//gpu.split_eyes renders each eye on a GPU of its own where there are two, see
+		//GpuMulticast.h. The driver has to know before the context is made.
+		if (config().getBool("gpu.split_eyes", false))
+			gpuMulticast().request();
 	}
 
 
@@ -245,30 +548,103 @@ protected:
 		// For some reason we have to set this experminetal flag to properly
 		// init GLEW if we use a core context.
 		glewExperimental = GL_TRUE;
-		if (0 != glewInit()) {
+		GLenum glewResult;
+		{
+			StartupScope scope("gl", "glewInit");
+			glewResult = glewInit();
+		}
+		if (0 != glewResult) {
 			FAIL("Failed to initialize GLEW");
 		}
 		glGetError();
-
-		if (GLEW_KHR_debug) {
-			GLint v;
-			glGetIntegerv(GL_CONTEXT_FLAGS, &v);
-			if (v & GL_CONTEXT_FLAG_DEBUG_BIT) {
-				//glDebugMessageCallback(glDebugCallbackHandler, this);
-			}
+		loadGLExtensions();
+		gpuMulticast().init();
+		// gl.dsa creates and edits resources by name where the context is 4.5 (or has the
+		// extension), binding to edit stays for the 4.1 contexts asked for above
+		useDirectStateAccess(config().getBool("gl.dsa", true));
+		if (directStateAccess())
+			logStream(LOG_INFO) << "setting up GL resources with direct state access" << std::endl;
+		if (glStats().install())
+			logStream(LOG_INFO) << "counting GL calls" << std::endl;
+
+		if (!debugContext)
+			logStream(LOG_INFO) << (noErrorContext() ? "GL context without error checking" : "GL context with error checking, the driver has no KHR_no_error") << std::endl;
+		else if (glDebugLog().enable(GLDebugLog::parseMode(config().getString("gl.debug", "performance")),
+				config().getInt("gl.debug_flush_ms", 250)))
+			logStream(LOG_INFO) << "logging GL debug messages" << std::endl;
+		//gl.markers names the passes and resources for RenderDoc or Nsight, in builds with
+		//CAVE_GL_MARKERS only
+		if (glMarkers().enable(config().getBool("gl.markers", true)))
+			logStream(LOG_INFO) << "GL debug groups and object labels on" << std::endl;
+		//upload.thread uploads textures from a second context on a thread of its own, so
+		//they do not hold up the frames (or the scene's construction) on this one
+		if (config().getBool("upload.thread", true)) {
+			StartupScope scope("gl", "upload context");
+			uploadThread().start(window);
 		}
 	}
 
 	virtual void initGl() {
+		glJobBudgetMs = std::max(config().getFloat("jobs.gl_budget_ms", 1.0f), 0.0f);
+		// Camera blocks, instance matrices and the like are written here every frame
+		frameRing().init((size_t)std::max(config().getInt("gl.frame_ring_kb", 4096), 64) * 1024);
+		debugDraw().init();
+		if (config().getBool("gpu.timers", true)) {
+			gpuTimers().init((size_t)std::max(config().getInt("gpu.stats_frames", 120), 1));
+		}
+		//quality.governor turns the quality knobs down and up toward one GPU budget, see
+		//QualityGovernor.h
+		qualityGovernor().configure();
+		//flight.recorder keeps the last seconds of frames and writes a trace of any that ran
+		//over, see FlightRecorder.h
+		flightRecorder().configure(refreshRate());
+		//telemetry.host sends the station's rolling metrics to a StatsD collector there
+		std::string telemetryHost = config().getString("telemetry.host");
+		if (!telemetryHost.empty() && telemetry().init(telemetryHost, config().getInt("telemetry.port", 8125),
+				config().getString("telemetry.prefix", "cave"), config().getInt("telemetry.interval_ms", 10000)))
+			logStream(LOG_INFO) << "telemetry to " << telemetryHost << std::endl;
 	}
 
 	virtual void shutdownGl() {
+		framePacing().report(logStream(LOG_INFO));
+		frameLimiter().report(logStream(LOG_INFO));
+		qualityGovernor().report(logStream(LOG_INFO));
+		threadScheduling().report(logStream(LOG_INFO));
+		gpuMulticast().report(logStream(LOG_INFO));
+		frameLimiter().shutdown();
+		std::string pacingFile = config().getString("pacing.csv");
+		if (!pacingFile.empty() && framePacing().active())
+			framePacing().writeCsv(pacingFile.c_str());
+		if (frameRing().valid())
+			logStream(LOG_INFO) << "frame ring: at most " << frameRing().peak() / 1024 << " KB a frame" << std::endl;
+		telemetry().shutdown();
+		flightRecorder().finish();
+		flightRecorder().report(logStream(LOG_INFO));
+		debugDraw().shutdown();
+		frameRing().shutdown();
+		gpuHandles().shutdown();
+		gpuHandles().report(logStream(LOG_INFO));
+		glDebugLog().shutdown();
+		glDebugLog().report(logStream(LOG_INFO));
+		if (gpuTimers().active()) {
+			gpuTimers().report(logStream(LOG_INFO));
+			gpuTimers().shutdown();
+		}
 	}
 
 	virtual void finishFrame() {
 		glfwSwapBuffers(window);
 	}
 
+	// The display's refresh, what frame.limit compositor paces to
+	virtual double refreshRate() const {
+		const GLFWvidmode * mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+		return mode && mode->refreshRate > 0 ? mode->refreshRate : 60.0;
+	}
+
+	// Whether the frame just finished already waited on the display
+	virtual bool framePaced() const { return false; }
+
 	virtual void destroyWindow() {
 		glfwSetKeyCallback(window, nullptr);
 		glfwSetMouseButtonCallback(window, nullptr);
@@ -284,13 +660,75 @@ protected:
 		case GLFW_KEY_ESCAPE:
 			glfwSetWindowShouldClose(window, 1);
 			return;
+
+		case GLFW_KEY_P:
+			writeCpuTrace();
+			return;
+
+		//The runtime switches (FeatureToggles.h): F5 picks one, F6 flips it, F7 compares
+		//frame times with it on and off
+		case GLFW_KEY_F5:
+			featureToggles().selectNext();
+			return;
+
+		case GLFW_KEY_F6:
+			featureToggles().toggleSelected();
+			return;
+
+		case GLFW_KEY_F7:
+			featureToggles().compareSelected(compareFrames, compareWindows, compareSettle);
+			return;
 		}
 	}
 
+	// Simulation, on the main thread even when rendering has its own
 	virtual void update() {}
 
+	// On the rendering thread, right before draw()
+	virtual void beginFrame() {}
+
+	// With app.pipelined, on a worker after update() while the frame before is still being
+	// finished: the coming frame's CPU work that needs no GL. It may only touch what the rest
+	// of that frame (submit, mirror, swap) does not.
+	virtual void prepareFrame() {}
+
+	//! With app.pipelined, starts the coming frame's update() and prepareFrame() on a worker,
+	// once per frame. Called where a frame is submitted and the CPU is about to wait on the
+	// GPU, or after draw() for an app that does not.
+	void startNextFrame() {
+		if (!pipelined || prepareStarted)
+			return;
+		prepareStarted = true;
+		jobs().submit([this]() {
+			CpuScope scope("prepare next frame");
+			updateScoped();
+			prepareFrame();
+		}, &preparing);
+	}
+
 	virtual void onMouseButton(int button, int action, int mods) {}
 
+	//! Hands an event to the rendering thread, only from the thread that polls events
+	// (the one running update). An event that does not fit is dropped and counted.
+	void pushInput(const InputEvent & e) {
+		if (!inputRing.push(e) && droppedInput++ == 0)
+			std::cerr << "input events are coming faster than frames, dropping some" << std::endl;
+	}
+
+	// The Touch events pushed before this frame started, oldest first
+	const std::vector<InputEvent> & frameInput() const { return frameEvents; }
+
+	static InputEvent windowEvent(InputEvent::Type type, int code, int scancode, int action, int mods) {
+		InputEvent e = {};
+		e.type = type;
+		e.time = glfwGetTime();
+		e.code = code;
+		e.scancode = scancode;
+		e.action = action;
+		e.mods = mods;
+		return e;
+	}
+
 protected:
 	virtual void viewport(const ivec2 & pos, const uvec2 & size) {
 		glViewport(pos.x, pos.y, size.x, size.y);
@@ -300,12 +738,12 @@ private:
 
 	static void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
 		GlfwApp * instance = (GlfwApp *)glfwGetWindowUserPointer(window);
-		instance->onKey(key, scancode, action, mods);
+		instance->pushInput(windowEvent(InputEvent::KEY, key, scancode, action, mods));
 	}
 
 	static void MouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
 		GlfwApp * instance = (GlfwApp *)glfwGetWindowUserPointer(window);
-		instance->onMouseButton(button, action, mods);
+		instance->pushInput(windowEvent(InputEvent::MOUSE_BUTTON, button, 0, action, mods));
 	}
 
 	static void ErrorCallback(int error, const char* description) {
@@ -363,6 +801,15 @@ namespace ovr {
 		return translation * orientation;
 	}
 
+	inline RigidPose toPose(const ovrPosef & op) {
+		return RigidPose(toGlm(op.Orientation), toGlm(op.Position));
+	}
+
+	// The view matrix of a pose, glm::inverse(toGlm(op)) without the general inverse
+	inline mat4 toGlmInverse(const ovrPosef & op) {
+		return toPose(op).inverseMatrix();
+	}
+
 	inline ovrMatrix4f fromGlm(const mat4 & m) {
 		ovrMatrix4f result;
 		mat4 transposed(glm::transpose(m));
@@ -402,6 +849,164 @@ namespace ovr {
 	}
 }
 
+// What the SDK reports for a frame, read once per frame by RiftApp so both eyes render the
+// same head, hands and buttons. The input comes from update, the tracking from beginFrame.
+struct FrameState {
+	long long frameIndex;
+	double displayTime;
+	// When the tracking state was read, the eye layer's SensorSampleTime
+	double sensorSampleTime;
+	ovrTrackingState tracking;
+	ovrInputState input;
+	bool inputValid;
+	// The button edges and thumbstick moves since the last frame, valid for the frame
+	const InputEvent * events;
+	size_t eventCount;
+	// The app's GPU time the compositor last reported and the frame's budget, in seconds
+	// (0 before the first report)
+	float gpuTime;
+	float frameBudget;
+};
+
+// What one eye of a frame is rendered with, made by RiftApp and handed down by reference,
+// so the scene and its passes all read the same snapshot without copying the layer or
+// asking the SDK again
+struct RenderContext {
+	const FrameState * frame;
+	// The frame's eye layer: both eyes' viewports, fields of view and render poses
+	const ovrLayerEyeFov * layer;
+	ovrEyeType eye;
+	mat4 projection;
+	// The eye's view, from its render pose
+	mat4 view;
+	// The eye buffer's framebuffer, the eye's part of it is layer->Viewport[eye]
+	GLuint fbo;
+	int displayMode;
+	uvec2 windowSize;
+
+	const ovrRecti & viewport() const { return layer->Viewport[eye]; }
+};
+
+// What the master of a clustered CAVE sends its render nodes every frame: where the shown
+// viewer's eyes see the walls from, and what is on them. It is everything a node's walls
+// depend on, so a node runs no simulation of its own and a lost datagram costs it one frame,
+// not the box's place. Copied as it is, every machine runs the same build.
+struct ClusterFrame {
+	mat4 wallModelviews[2];
+	vec3 eyePositions[2];
+	vec3 boxPosition;
+	float boxScale;
+	int32_t skybox;
+	uint32_t wallsOff;
+};
+
+// Starts recording to trace.record or loads trace.replay (looping with trace.loop), the
+// replay wins when both are set
+static void openPoseTrace(PoseTrace & trace) {
+	std::string replayFile = config().getString("trace.replay");
+	std::string recordFile = config().getString("trace.record");
+	if (!replayFile.empty()) {
+		if (trace.replay(replayFile.c_str(), config().getBool("trace.loop", false))) {
+			logStream(LOG_INFO) << "replaying " << trace.frameCount() << " frames from " << replayFile << std::endl;
+		}
+	}
+	else if (!recordFile.empty()) {
+		trace.record(recordFile.c_str());
+	}
+}
+
+static PoseTraceFrame traceFrame(const FrameState & state, const ovrPosef eyePoses[2]) {
+	PoseTraceFrame out;
+	memset(&out, 0, sizeof(out));
+	out.frameIndex = state.frameIndex;
+	out.displayTime = state.displayTime;
+	out.sensorSampleTime = state.sensorSampleTime;
+	out.tracking = state.tracking;
+	out.eyePoses[ovrEye_Left] = eyePoses[ovrEye_Left];
+	out.eyePoses[ovrEye_Right] = eyePoses[ovrEye_Right];
+	out.input = state.input;
+	out.inputValid = state.inputValid ? 1 : 0;
+	return out;
+}
+
+// With skybox.mask=stencil (and skybox.last) the eye buffer's depth has a stencil buffer
+// too, which the walls mark so the outer skybox is only shaded where they leave gaps
+static bool eyeBufferStencil() {
+	return config().getBool("skybox.last", true) && config().getString("skybox.mask", "depth") == "stencil";
+}
+
+// With eye.lens_mask what the lenses hide of each eye's viewport is masked in depth before
+// the eye is drawn, so the composite and the skybox skip it
+static bool eyeLensMask() {
+	return config().getBool("eye.lens_mask", false);
+}
+
+// The mask of the layer's FOV ports, eye.lens_mask_scale the size of the visible ellipse
+static void initLensMask(LensMask & mask, const ovrLayerEyeFov & layer) {
+	if (!eyeLensMask())
+		return;
+	float tangents[2][4];
+	for (int eye = 0; eye < 2; eye++) {
+		const ovrFovPort & fov = layer.Fov[eye];
+		tangents[eye][0] = fov.UpTan;
+		tangents[eye][1] = fov.DownTan;
+		tangents[eye][2] = fov.LeftTan;
+		tangents[eye][3] = fov.RightTan;
+	}
+	if (!mask.init(tangents, config().getFloat("eye.lens_mask_scale", 1.f)))
+		std::cerr << "lens mask shaders did not load, drawing the whole eye viewport" << std::endl;
+}
+
+// Clears the bound eye buffer for a frame. When the scene covers it the color is only
+// invalidated, its old contents are not loaded or written, and depth (and stencil) cleared.
+static void clearEyeBuffer(GLbitfield mask, bool covered) {
+	if (covered) {
+		if (GLEW_ARB_invalidate_subdata) {
+			GLenum color = GL_COLOR_ATTACHMENT0;
+			glInvalidateFramebuffer(GL_DRAW_FRAMEBUFFER, 1, &color);
+		}
+		mask &= ~GL_COLOR_BUFFER_BIT;
+	}
+	glClear(mask);
+}
+
+// The same for one eye's viewport, the rest of the buffer is left as it is
+static void clearEyeViewport(GLbitfield mask, bool covered, const ovrRecti & vp) {
+	if (covered) {
+		if (GLEW_ARB_invalidate_subdata) {
+			GLenum color = GL_COLOR_ATTACHMENT0;
+			glInvalidateSubFramebuffer(GL_DRAW_FRAMEBUFFER, 1, &color, vp.Pos.x, vp.Pos.y, vp.Size.w, vp.Size.h);
+		}
+		mask &= ~GL_COLOR_BUFFER_BIT;
+	}
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(vp.Pos.x, vp.Pos.y, vp.Size.w, vp.Size.h);
+	glClear(mask);
+	glDisable(GL_SCISSOR_TEST);
+}
+
+// What the scene shows (RiftApp's displaymodes). Calibration and both show the CAVE, its
+// walls carrying the calibration cube and the stereo environment. Panorama is the stereo
+// environment alone around the eyes, with no wall rendered or composited.
+enum DisplayMode { DISPLAY_CALIBRATION, DISPLAY_PANORAMA, DISPLAY_BOTH };
+
+// Whether the head or a hand moved more than a millimetre or a tenth of a degree since
+// last, which then becomes now. Anything less is tracking noise to frame.idle_hz.
+static bool trackingMoved(const ovrTrackingState & now, ovrTrackingState & last) {
+	const ovrPoseStatef * poses[3] = { &now.HeadPose, &now.HandPoses[ovrHand_Left], &now.HandPoses[ovrHand_Right] };
+	const ovrPoseStatef * lastPoses[3] = { &last.HeadPose, &last.HandPoses[ovrHand_Left], &last.HandPoses[ovrHand_Right] };
+	bool moved = false;
+	for (int i = 0; i < 3; i++) {
+		moved = moved || glm::distance(ovr::toGlm(poses[i]->ThePose.Position), ovr::toGlm(lastPoses[i]->ThePose.Position)) > 0.001f
+			|| std::fabs(glm::dot(ovr::toGlm(poses[i]->ThePose.Orientation), ovr::toGlm(lastPoses[i]->ThePose.Orientation))) < 0.9999996f;
+	}
+	if (moved)
+		last = now;
+	return moved;
+}
+
+#ifndef CAVE_BENCHMARK
+
 class RiftManagerApp {
 protected:
 	ovrSession _session;
@@ -410,7 +1015,12 @@ protected:
 
 public:
 	RiftManagerApp() {
-		if (!OVR_SUCCESS(ovr_Create(&_session, &_luid))) {
+		ovrResult result;
+		{
+			StartupScope scope("sdk", "ovr_Create");
+			result = ovr_Create(&_session, &_luid);
+		}
+		if (!OVR_SUCCESS(result)) {
 			FAIL("Unable to create HMD session");
 		}
 
@@ -427,12 +1037,37 @@ class RiftApp : public GlfwApp, public RiftManagerApp {
 public:
 
 private:
-	GLuint _fbo{ 0 };
-	GLuint _depthBuffer{ 0 };
-	ovrTextureSwapChain _eyeTexture;
-
-	GLuint _mirrorFbo{ 0 };
-	ovrMirrorTexture _mirrorTexture;
+	GLFramebuffer _fbo;
+	GLRenderbuffer _depthBuffer;
+	// With eye.msaa the eyes are drawn here and resolved into _fbo, which then has no depth
+	MultisampleFramebuffer _eyeMsaa;
+	int _eyeResolveGpuPass{ gpuTimers().pass("eye resolve") };
+	GLbitfield _clearMask{ GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT };
+	LensMask _lensMask;
+	OvrSwapChain _eyeTexture;
+
+	GLFramebuffer _mirrorFbo;
+	OvrMirrorTexture _mirrorTexture;
+
+	// How often the desktop window shows the HMD, and what of it
+	enum MirrorMode { MIRROR_OFF, MIRROR_INTERVAL, MIRROR_ON_DEMAND };
+	enum MirrorSource { MIRROR_COMPOSITOR, MIRROR_EYE, MIRROR_WALL };
+	// The steps the quality governor has on the mirror (its interval doubled each) and the eyes
+	enum { MIRROR_STEPS = 3, EYE_STEPS = 4 };
+	MirrorMode _mirrorMode{ MIRROR_INTERVAL };
+	MirrorSource _mirrorSource{ MIRROR_COMPOSITOR };
+	int _mirrorInterval{ 1 };
+	int _mirrorEye{ 0 };
+	int _mirrorWall{ 0 };
+	bool _mirrorRequested{ false };
+	bool _mirrorPresented{ false };
+
+	// Nothing is rendered while the HMD shows no frames of ours, draw sleeps instead
+	bool _presenting{ true };
+	bool _renderUnmounted{ false };
+	int _idleSleepMs{ 100 };
+	// The poses frame.idle_hz last saw move
+	ovrTrackingState _limiterTracking{};
 
 	ovrEyeRenderDesc _eyeRenderDescs[2];
 
@@ -440,24 +1075,66 @@ private:
 
 	ovrLayerEyeFov _sceneLayer;
 	ovrViewScaleDesc _viewScaleDesc;
+	// Compositor quad layers: the HUD, and with layers.test_pattern the calibration image on a
+	// panel of its own, committed once and shown in calibration mode
+	QuadLayers _quadLayers;
+	PerfHud _perfHud;
+	int _testPattern = -1;
+	// latency.probe follows each frame from its head sample to its predicted display
+	LatencyProbe _latencyProbe;
+	// trace.record writes every frame's tracking and input, trace.replay plays a trace back
+	// in their place
+	PoseTrace _poseTrace;
+	const PoseTraceFrame* _replayed{ nullptr };
+	int _mirrorGpuPass{ gpuTimers().pass("mirror blit") };
+	// capture.* records the mirror and chosen walls, F9 starts and stops it, F12 takes a
+	// screenshot
+	FrameCapture _capture;
+	struct CapturedWall { int eye; int wall; int stream; };
+	std::vector<CapturedWall> _capturedWalls;
+	int _captureMirror{ -1 };
+	bool _captureToggled{ false };
 
 	uvec2 _renderTargetSize;
 	uvec2 _mirrorSize;
-
-	int viewSelector = 0;
-	int trackingSelector = 0;
-	int displaySelector = 0;
+	// The eye viewports at full pixel density, the swap chain is allocated for these
+	ovrSizei _eyeFullSize[2];
+	EyeResolution _eyeResolution;
+
+	// Which of viewmodes, view.mode and V pick it
+	enum ViewMode { VIEW_STEREO, VIEW_MONO, VIEW_LEFT, VIEW_RIGHT };
+	int viewSelector = VIEW_STEREO;
+	// Which of trackmodes, tracking.mode and T pick it
+	enum TrackMode { TRACK_FULL, TRACK_NONE, TRACK_POSITION, TRACK_ORIENTATION };
+	int trackingSelector = TRACK_FULL;
+	// The head as the tracking mode last gave it, what the parts it holds still keep
+	ovrPosef _heldHead;
+	bool _headHeld{ false };
+	// Which of displaymodes, display.mode and D pick it
+	int displaySelector = DISPLAY_CALIBRATION;
+	// Mono's field of view, both eyes' in one, and its projection
+	ovrFovPort _monoFov;
+	mat4 _monoProjection;
+	// Where each eye's viewport is in the swap chain
+	ovrVector2i _eyeViewportPos[2];
+	int _eyeChainLength{ 1 };
+	// Left or right only, once the hidden eye is black in the last _blankImages textures
+	int _blankedMode{ -1 };
+	int _blankImages{ 0 };
 
 	ovrPosef lastPoses[2];
+	FrameExchange<FrameState> _simulation;
+	FrameState _frameState{};
 	float originalIODL;
 	float originalIODR;
 
 	vector<char*> viewmodes = { "Stereo", "Mono", "Left only", "Right only" };
 	vector<char*> trackmodes = { "Full Tracking", "No Tracking", "Position", "Orientation"};
 	vector<char*> displaymodes = { "Calibration", "Panorama", "Both" };
-	bool A_down = false;
-	bool B_down = false;
-	bool X_down = false;
+	// Live input turns into events on the update thread, a replayed trace's where it is read
+	TouchEdges _touchEdges;
+	TouchEdges _replayEdges;
+	std::vector<InputEvent> _replayEvents;
 
 public:
 
@@ -479,11 +1156,22 @@ public:
 			ovrFovPort & fov = _sceneLayer.Fov[eye] = _eyeRenderDescs[eye].Fov;
 			auto eyeSize = ovr_GetFovTextureSize(_session, eye, fov, 1.0f);
 			_sceneLayer.Viewport[eye].Size = eyeSize;
+			_eyeFullSize[eye] = eyeSize;
 			_sceneLayer.Viewport[eye].Pos = { (int)_renderTargetSize.x, 0 };
 
+			_eyeViewportPos[eye] = _sceneLayer.Viewport[eye].Pos;
+
 			_renderTargetSize.y = std::max(_renderTargetSize.y, (uint32_t)eyeSize.h);
 			_renderTargetSize.x += eyeSize.w;
 		});
+		const ovrFovPort & left = _eyeRenderDescs[ovrEye_Left].Fov;
+		const ovrFovPort & right = _eyeRenderDescs[ovrEye_Right].Fov;
+		_monoFov.UpTan = std::max(left.UpTan, right.UpTan);
+		_monoFov.DownTan = std::max(left.DownTan, right.DownTan);
+		_monoFov.LeftTan = std::max(left.LeftTan, right.LeftTan);
+		_monoFov.RightTan = std::max(left.RightTan, right.RightTan);
+		_monoProjection = ovr::toGlm(ovrMatrix4f_Projection(_monoFov, 0.01f, 1000.0f, ovrProjection_ClipRangeOpenGL));
+		_replayEvents.reserve(64);
 		originalIODL = _viewScaleDesc.HmdToEyeOffset[ovrEye_Left].x;
 		originalIODR = _viewScaleDesc.HmdToEyeOffset[ovrEye_Right].x;
 
@@ -493,12 +1181,163 @@ public:
 	}
 
 protected:
+	const mat4 & eyeProjection(ovrEyeType eye) const { return _eyeProjections[eye]; }
+	const FrameState & frameState() const { return _frameState; }
+	void recenter() { ovr_RecenterTrackingOrigin(_session); }
+	// The pixels the eye buffer has at full density across a cube map face seen head on, the
+	// wider of the two eyes: the face's tangents run -1 to 1 where the eye's span
+	// 2 / projection[0][0]
+	float eyeFaceTexels() const {
+		return std::max(_eyeFullSize[0].w * _eyeProjections[0][0][0], _eyeFullSize[1].w * _eyeProjections[1][0][0]);
+	}
+
+	// Every view mode but stereo renders the scene for one eye only (shownEye). Mono shows
+	// it to both eyes, left and right only leave the other eye black.
+	bool singleView() const { return viewSelector != VIEW_STEREO; }
+	// Whether the head moves with the tracker, in the no tracking and orientation modes it
+	// stays where it was and the CAVE sees it from there
+	bool headPositionTracked() const { return trackingSelector == TRACK_FULL || trackingSelector == TRACK_POSITION; }
+	ovrEyeType shownEye() const { return viewSelector == VIEW_RIGHT ? ovrEye_Right : ovrEye_Left; }
+
+	//! Holds still what the tracking mode does not track: the orientation without it (no
+	// tracking, position only), the position without it (no tracking, orientation only),
+	// their velocities and accelerations 0 so nothing predicts them on.
+	void applyTrackingMode(ovrPoseStatef & head) {
+		static const ovrVector3f still = { 0.f, 0.f, 0.f };
+		if (!_headHeld) {
+			_heldHead = head.ThePose;
+			_headHeld = true;
+		}
+		if (trackingSelector == TRACK_NONE || trackingSelector == TRACK_POSITION) {
+			head.ThePose.Orientation = _heldHead.Orientation;
+			head.AngularVelocity = still;
+			head.AngularAcceleration = still;
+		}
+		if (!headPositionTracked()) {
+			head.ThePose.Position = _heldHead.Position;
+			head.LinearVelocity = still;
+			head.LinearAcceleration = still;
+		}
+		_heldHead = head.ThePose;
+	}
+
+	// Mono's pose, the center eye halfway between the eyes
+	static ovrPosef centerPose(const ovrPosef eyePoses[2]) {
+		ovrPosef center = eyePoses[ovrEye_Left];
+		center.Position.x = 0.5f * (eyePoses[ovrEye_Left].Position.x + eyePoses[ovrEye_Right].Position.x);
+		center.Position.y = 0.5f * (eyePoses[ovrEye_Left].Position.y + eyePoses[ovrEye_Right].Position.y);
+		center.Position.z = 0.5f * (eyePoses[ovrEye_Left].Position.z + eyePoses[ovrEye_Right].Position.z);
+		return center;
+	}
+
+	//! Sets the scene layer up for the view mode. Each eye has its own viewport and field of
+	// view, except in mono: that is rendered into the left eye's viewport over both eyes'
+	// fields of view (at the left eye's pixel count, a little less dense), and both eyes of
+	// the layer show it.
+	// @input scale How much of each eye's full viewport is drawn (EyeResolution)
+	void layoutViews(float scale) {
+		ovr::for_each_eye([&](ovrEyeType eye) {
+			_sceneLayer.Viewport[eye].Pos = _eyeViewportPos[eye];
+			_sceneLayer.Viewport[eye].Size.w = std::max((int)(_eyeFullSize[eye].w * scale), 1);
+			_sceneLayer.Viewport[eye].Size.h = std::max((int)(_eyeFullSize[eye].h * scale), 1);
+			_sceneLayer.Fov[eye] = _eyeRenderDescs[eye].Fov;
+		});
+		if (viewSelector != VIEW_MONO)
+			return;
+		_sceneLayer.Viewport[ovrEye_Right] = _sceneLayer.Viewport[ovrEye_Left];
+		_sceneLayer.Fov[ovrEye_Left] = _monoFov;
+		_sceneLayer.Fov[ovrEye_Right] = _monoFov;
+	}
+
+	//! Clears the eye buffer for the frame. Left and right only clear the shown eye's viewport
+	// alone. The other eye's is cleared to black once in each of the swap chain's textures
+	// after the mode is picked, at its full size so no resolution change uncovers any more
+	// of it, and then left alone.
+	void clearEyes() {
+		bool covered = sceneCoversEyes();
+		if (viewSelector != VIEW_LEFT && viewSelector != VIEW_RIGHT) {
+			clearEyeBuffer(_clearMask, covered);
+			_blankedMode = -1;
+			return;
+		}
+		clearEyeViewport(_clearMask, covered, _sceneLayer.Viewport[shownEye()]);
+		if (_blankedMode != viewSelector) {
+			_blankedMode = viewSelector;
+			_blankImages = _eyeChainLength;
+		}
+		//The multisampled buffer is discarded once resolved, the hidden eye is blanked in it
+		//every frame
+		if (_eyeMsaa.valid())
+			_blankImages = std::max(_blankImages, 1);
+		if (_blankImages == 0)
+			return;
+		_blankImages--;
+		ovrEyeType hidden = shownEye() == ovrEye_Left ? ovrEye_Right : ovrEye_Left;
+		ovrRecti blank;
+		blank.Pos = _eyeViewportPos[hidden];
+		blank.Size = _eyeFullSize[hidden];
+		GLfloat clearColor[4];
+		glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+		glClearColor(0.f, 0.f, 0.f, 1.f);
+		clearEyeViewport(GL_COLOR_BUFFER_BIT, false, blank);
+		glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+	}
+
+	//! The offscreen texture a wall was last rendered into, for the wall mirror.
+	// @input layer Set to the array layer, -1 for a GL_TEXTURE_2D
+	// @input size Set to the part of the texture rendered into, from the origin
+	virtual bool mirrorWallTexture(int eye, int wall, GLuint & texture, GLint & layer, GLsizei & size) const { return false; }
+
+	// Layers the scene submits on top of the eye layer, returns how many it wrote
+	virtual int sceneLayers(const ovrLayerHeader ** out, int max) const { return 0; }
+
+	// Whether the scene draws every pixel of the eye buffer, so its old color need not be
+	// cleared (only invalidated)
+	virtual bool sceneCoversEyes() const { return false; }
+
+	// The scene's resident texture bytes against their budget, for the HUD. False without one.
+	virtual bool sceneResidency(uint64_t & resident, uint64_t & budget, size_t & evictions) const { return false; }
+
+	// Reads the head again, still predicted for this frame's display time, and moves the
+	// eye's layer pose to it. Returns the eye's new pose.
+	mat4 latchEyePose(ovrEyeType eye) {
+		if (_replayed) {
+			return ovr::toGlm(_sceneLayer.RenderPose[eye]);
+		}
+		double sampleTime = ovr_GetTimeInSeconds();
+		ovrTrackingState tracking = ovr_GetTrackingState(_session, _frameState.displayTime, ovrTrue);
+		applyTrackingMode(tracking.HeadPose);
+		ovrPosef eyePoses[2];
+		ovr_CalcEyePoses(tracking.HeadPose.ThePose, _viewScaleDesc.HmdToEyeOffset, eyePoses);
+		_sceneLayer.SensorSampleTime = sampleTime;
+		if (viewSelector == VIEW_MONO) {
+			ovrPosef pose = centerPose(eyePoses);
+			_sceneLayer.RenderPose[ovrEye_Left] = pose;
+			_sceneLayer.RenderPose[ovrEye_Right] = pose;
+			return ovr::toGlm(pose);
+		}
+		_sceneLayer.RenderPose[eye] = eyePoses[eye];
+		return ovr::toGlm(eyePoses[eye]);
+	}
+
 	GLFWwindow * createRenderingTarget(uvec2 & outSize, ivec2 & outPosition) override {
 		return glfw::createWindow(_mirrorSize);
 	}
 
 	void initGl() override {
 		GlfwApp::initGl();
+		//The context has to be on the GPU the HMD is plugged into, gpu.require_hmd_adapter
+		//stops here when it is known not to be rather than only warning
+		{
+			StartupScope scope("gl", "adapter check");
+			GpuAdapter::Match match = GpuAdapter::check((const uint8_t*)_luid.Reserved);
+			if (match == GpuAdapter::MISMATCH && config().getBool("gpu.require_hmd_adapter", false))
+				FAIL("GL context is not on the HMD's adapter");
+		}
+		// The loop's phases on the compositor's clock, pacing.csv gets the last pacing.frames
+		if (config().getBool("pacing.enabled", true))
+			framePacing().init(_hmdDesc.DisplayRefreshRate, ovr_GetTimeInSeconds, (size_t)std::max(config().getInt("pacing.frames", 2000), 1));
+		StartupScope scope("swap chain", "eye and mirror textures");
 
 		// Disable the v-sync for buffer swap
 		glfwSwapInterval(0);
@@ -512,7 +1351,7 @@ protected:
 		desc.Format = OVR_FORMAT_R8G8B8A8_UNORM_SRGB;
 		desc.SampleCount = 1;
 		desc.StaticImage = ovrFalse;
-		ovrResult result = ovr_CreateTextureSwapChainGL(_session, &desc, &_eyeTexture);
+		ovrResult result = _eyeTexture.create(_session, desc);
 		_sceneLayer.ColorTexture[0] = _eyeTexture;
 		if (!OVR_SUCCESS(result)) {
 			FAIL("Failed to create swap textures");
@@ -523,9 +1362,17 @@ protected:
 		if (!OVR_SUCCESS(result) || !length) {
 			FAIL("Unable to count swap chain textures");
 		}
+		_eyeChainLength = length;
 		for (int i = 0; i < length; ++i) {
 			GLuint chainTexId;
 			ovr_GetTextureSwapChainBufferGL(_session, _eyeTexture, i, &chainTexId);
+			if (directStateAccess()) {
+				glTextureParameteri(chainTexId, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+				glTextureParameteri(chainTexId, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+				glTextureParameteri(chainTexId, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+				glTextureParameteri(chainTexId, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+				continue;
+			}
 			glBindTexture(GL_TEXTURE_2D, chainTexId);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -535,24 +1382,202 @@ protected:
 		glBindTexture(GL_TEXTURE_2D, 0);
 
 		// Set up the framebuffer object
-		glGenFramebuffers(1, &_fbo);
-		glGenRenderbuffers(1, &_depthBuffer);
-		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _fbo);
-		glBindRenderbuffer(GL_RENDERBUFFER, _depthBuffer);
-		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT16, _renderTargetSize.x, _renderTargetSize.y);
-		glBindRenderbuffer(GL_RENDERBUFFER, 0);
-		glFramebufferRenderbuffer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, _depthBuffer);
-		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+		bool stencil = eyeBufferStencil();
+		GLenum depthFormat = stencil ? GL_DEPTH24_STENCIL8 : GL_DEPTH_COMPONENT16;
+		GLenum depthAttachment = stencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+		_fbo.create();
+		glMarkers().label(GL_FRAMEBUFFER, _fbo, "eye buffer");
+		//eye.msaa (2 or 4) draws the eyes with that many samples a pixel and resolves them
+		//into the swap chain's texture, for less aliasing than a larger eye buffer costs.
+		//The swap chain stays single sampled, _fbo only takes the resolve.
+		int eyeSamples = config().getInt("eye.msaa", 1);
+		if (eyeSamples > 1) {
+			if (_eyeMsaa.init(GL_SRGB8_ALPHA8, depthFormat, depthAttachment, _renderTargetSize.x, _renderTargetSize.y, eyeSamples))
+				logStream(LOG_INFO) << "eye buffer with " << _eyeMsaa.sampleCount() << "x MSAA" << std::endl;
+			else
+				std::cerr << "eye.msaa: no multisampled eye buffer, drawing single sampled" << std::endl;
+		}
+		if (!_eyeMsaa.valid()) {
+			_depthBuffer.create();
+			if (directStateAccess()) {
+				glNamedRenderbufferStorage(_depthBuffer, depthFormat, _renderTargetSize.x, _renderTargetSize.y);
+				glNamedFramebufferRenderbuffer(_fbo, depthAttachment, GL_RENDERBUFFER, _depthBuffer);
+			}
+			else {
+				glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _fbo);
+				glBindRenderbuffer(GL_RENDERBUFFER, _depthBuffer);
+				glRenderbufferStorage(GL_RENDERBUFFER, depthFormat, _renderTargetSize.x, _renderTargetSize.y);
+				glBindRenderbuffer(GL_RENDERBUFFER, 0);
+				glFramebufferRenderbuffer(GL_DRAW_FRAMEBUFFER, depthAttachment, GL_RENDERBUFFER, _depthBuffer);
+				glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+			}
+			gpuMemory().allocate(GpuMemory::KIND_RENDERBUFFER, _depthBuffer,
+				textureBytes(depthFormat, _renderTargetSize.x, _renderTargetSize.y, 1, 1), GpuMemory::RENDER_TARGET, "eye buffer depth");
+		}
+		if (stencil)
+			_clearMask |= GL_STENCIL_BUFFER_BIT;
+		initLensMask(_lensMask, _sceneLayer);
+
+		// mirror.mode is every (each mirror.interval-th frame), demand (M shows one frame) or off.
+		// mirror.source is compositor (the distorted view), eye (mirror.eye's buffer, undistorted)
+		// or wall (mirror.wall's offscreen texture for mirror.eye).
+		std::string mirrorMode = config().getString("mirror.mode", "every");
+		_mirrorMode = mirrorMode == "off" ? MIRROR_OFF : mirrorMode == "demand" ? MIRROR_ON_DEMAND : MIRROR_INTERVAL;
+		_mirrorInterval = std::max(config().getInt("mirror.interval", 1), 1);
+		std::string mirrorSource = config().getString("mirror.source", "compositor");
+		_mirrorSource = mirrorSource == "eye" ? MIRROR_EYE : mirrorSource == "wall" ? MIRROR_WALL : MIRROR_COMPOSITOR;
+		_mirrorEye = config().getInt("mirror.eye", 0) ? 1 : 0;
+		_mirrorWall = std::max(config().getInt("mirror.wall", 0), 0);
+		_eyeResolution.configure();
+		//Under the governor the mirror halves its rate per step, the eyes shrink to
+		//eyes.min_scale in EYE_STEPS
+		if (_mirrorMode == MIRROR_INTERVAL)
+			qualityGovernor().setSteps(QualityGovernor::MIRROR, MIRROR_STEPS);
+		qualityGovernor().setSteps(QualityGovernor::EYE_RESOLUTION, EYE_STEPS);
+		_renderUnmounted = config().getBool("session.render_unmounted", false);
+		//view.mode is stereo, mono, left or right
+		std::string viewMode = config().getString("view.mode", "stereo");
+		viewSelector = viewMode == "mono" ? VIEW_MONO : viewMode == "left" ? VIEW_LEFT : viewMode == "right" ? VIEW_RIGHT : VIEW_STEREO;
+		//tracking.mode is full, none, position or orientation, held from where the head is
+		//on the first frame
+		std::string trackMode = config().getString("tracking.mode", "full");
+		trackingSelector = trackMode == "none" ? TRACK_NONE : trackMode == "position" ? TRACK_POSITION
+			: trackMode == "orientation" ? TRACK_ORIENTATION : TRACK_FULL;
+		//display.mode is calibration, panorama or both
+		std::string displayMode = config().getString("display.mode", "calibration");
+		displaySelector = displayMode == "panorama" ? DISPLAY_PANORAMA : displayMode == "both" ? DISPLAY_BOTH : DISPLAY_CALIBRATION;
+		_idleSleepMs = std::max(config().getInt("session.idle_sleep_ms", 100), 1);
+
+		// The compositor fills its mirror texture on every frame it exists, so it is only made
+		// when it is shown
+		if (_mirrorMode != MIRROR_OFF && _mirrorSource == MIRROR_COMPOSITOR) {
+			ovrMirrorTextureDesc mirrorDesc;
+			memset(&mirrorDesc, 0, sizeof(mirrorDesc));
+			mirrorDesc.Format = OVR_FORMAT_R8G8B8A8_UNORM_SRGB;
+			mirrorDesc.Width = _mirrorSize.x;
+			mirrorDesc.Height = _mirrorSize.y;
+			if (!OVR_SUCCESS(_mirrorTexture.create(_session, mirrorDesc))) {
+				FAIL("Could not create mirror texture");
+			}
+		}
+		_mirrorFbo.create();
+		glMarkers().label(GL_FRAMEBUFFER, _mirrorFbo, "mirror");
+
+		_quadLayers.init(_session);
+		if (_perfHud.init(_session, _quadLayers, 1.0f / _hmdDesc.DisplayRefreshRate, (size_t)config().getInt("perf.hud_log", 4096))) {
+			_perfHud.setVisible(config().getBool("perf.hud", false));
+		}
+		if (config().getBool("layers.test_pattern", false))
+			initTestPattern();
+		if (config().getBool("latency.probe", false))
+			_latencyProbe.init(ovr_GetTimeInSeconds, (size_t)std::max(config().getInt("latency.frames", 2000), 1));
+		openPoseTrace(_poseTrace);
+		initCapture();
+	}
+
+	void initCapture() {
+		//Off unless asked for, capture.enabled sets up its streams and key
+		if (!config().getBool("capture.enabled", false))
+			return;
+		//capture.format is raw, ppm, h264 or hevc, the last two at capture.bitrate Mbit/s
+		std::string format = config().getString("capture.format", "raw");
+		_capture.init(config().getString("capture.prefix", "capture"), config().getFloat("capture.fps", 30.0f),
+			format == "ppm" ? FrameCapture::PPM : format == "h264" ? FrameCapture::H264 : format == "hevc" ? FrameCapture::HEVC : FrameCapture::RAW,
+			(uint32_t)(std::max(config().getFloat("capture.bitrate", 20.0f), 0.5f) * 1000000.0f));
+		//The mirror as the window shows it, on the frames it is drawn
+		if (_mirrorMode != MIRROR_OFF && config().getBool("capture.mirror", true))
+			_captureMirror = _capture.addStream("mirror", _mirrorSize.x, _mirrorSize.y);
+		//capture.walls is a comma separated list of wall indices, of the eye capture.eye
+		int eye = config().getInt("capture.eye", 0) ? 1 : 0;
+		GLsizei wallSize = std::max(config().getInt("capture.wall_size", 1024), 16);
+		std::string walls = config().getString("capture.walls", "");
+		for (size_t start = 0; start < walls.size();) {
+			size_t end = std::min(walls.find(',', start), walls.size());
+			int wall = atoi(walls.substr(start, end - start).c_str());
+			int stream = _capture.addStream("wall" + std::to_string(wall), wallSize, wallSize);
+			if (stream >= 0)
+				_capturedWalls.push_back({ eye, wall, stream });
+			start = end + 1;
+		}
+		_capture.setRecording(config().getBool("capture.record", false));
+	}
+
+	//! Queues this frame's readbacks if the recording is due or a screenshot was asked for,
+	// and hands the ones from earlier frames the GPU has finished to the encoder. Nothing
+	// here waits on the GPU.
+	void captureFrame() {
+		if (!_capture.active())
+			return;
+		if (_captureToggled) {
+			_captureToggled = false;
+			_capture.setRecording(!_capture.recording());
+		}
+		if (_capture.beginFrame(ovr_GetTimeInSeconds())) {
+			CpuScope scope("capture");
+			if (_mirrorPresented)
+				_capture.captureFramebuffer(_captureMirror, 0, GL_BACK, 0, 0, _mirrorSize.x, _mirrorSize.y);
+			for (const CapturedWall & captured : _capturedWalls) {
+				GLuint texture;
+				GLint layer;
+				GLsizei size;
+				if (mirrorWallTexture(captured.eye, captured.wall, texture, layer, size))
+					_capture.captureTexture(captured.stream, texture, layer, size);
+			}
+		}
+		_capture.endFrame();
+	}
+
+	void shutdownGl() override {
+		std::string dumpFile = config().getString("perf.dump", "perf_stats.csv");
+		if (!dumpFile.empty()) {
+			_perfHud.dump(dumpFile.c_str());
+		}
+		_perfHud.shutdown();
+		_quadLayers.shutdown();
+		_testPattern = -1;
+		if (_latencyProbe.active()) {
+			_latencyProbe.report(logStream(LOG_INFO));
+			std::string latencyFile = config().getString("latency.csv", "latency.csv");
+			if (!latencyFile.empty())
+				_latencyProbe.writeCsv(latencyFile.c_str());
+		}
+		_poseTrace.close();
+		_capture.shutdown();
+		_lensMask.release();
+		if (_depthBuffer)
+			gpuMemory().release(GpuMemory::KIND_RENDERBUFFER, _depthBuffer);
+		//While the context and the session are still there
+		_depthBuffer.reset();
+		_eyeMsaa.release();
+		_mirrorFbo.reset();
+		_fbo.reset();
+		_mirrorTexture.reset();
+		_eyeTexture.reset();
+		GlfwApp::shutdownGl();
+	}
 
-		ovrMirrorTextureDesc mirrorDesc;
-		memset(&mirrorDesc, 0, sizeof(mirrorDesc));
-		mirrorDesc.Format = OVR_FORMAT_R8G8B8A8_UNORM_SRGB;
-		mirrorDesc.Width = _mirrorSize.x;
-		mirrorDesc.Height = _mirrorSize.y;
-		if (!OVR_SUCCESS(ovr_CreateMirrorTextureGL(_session, &mirrorDesc, &_mirrorTexture))) {
-			FAIL("Could not create mirror texture");
+	//The test pattern never changes, so it goes on a static chain that is filled once and
+	//left to the compositor, a panel in front of the user rather than anything in the eye passes
+	void initTestPattern() {
+		PPMImage image;
+		if (!mapPPM("../Project3-Assets/vr_test_pattern.ppm", image))
+			return;
+		ovrPosef pose = {};
+		pose.Orientation.w = 1.0f;
+		pose.Position.y = config().getFloat("layers.test_pattern_height", 0.0f);
+		pose.Position.z = -config().getFloat("layers.test_pattern_distance", 1.5f);
+		_testPattern = _quadLayers.add(image.width, image.height, true, false, pose,
+			config().getFloat("layers.test_pattern_width", 1.0f));
+		if (_testPattern < 0)
+			return;
+		const unsigned char* rgb = image.pixels;
+		std::vector<unsigned char> expanded;
+		if (image.maxval != 255) {
+			expanded.resize((size_t)image.width * image.height * 3);
+			expandPPMRange(image, expanded.data());
+			rgb = expanded.data();
 		}
-		glGenFramebuffers(1, &_mirrorFbo);
+		_quadLayers.setImage(_testPattern, rgb, image.width, image.height);
 	}
 
 	void onKey(int key, int scancode, int action, int mods) override {
@@ -560,14 +1585,95 @@ protected:
 		case GLFW_KEY_R:
 			ovr_RecenterTrackingOrigin(_session);
 			return;
+
+		case GLFW_KEY_H:
+			_perfHud.setVisible(!_perfHud.isVisible());
+			return;
+
+		case GLFW_KEY_M:
+			_mirrorRequested = true;
+			return;
+
+		case GLFW_KEY_V:
+			viewSelector = (viewSelector + 1) % (int)viewmodes.size();
+			logStream(LOG_INFO) << "view: " << viewmodes[viewSelector] << std::endl;
+			return;
+
+		case GLFW_KEY_T:
+			trackingSelector = (trackingSelector + 1) % (int)trackmodes.size();
+			logStream(LOG_INFO) << "tracking: " << trackmodes[trackingSelector] << std::endl;
+			return;
+
+		case GLFW_KEY_D:
+			displaySelector = (displaySelector + 1) % (int)displaymodes.size();
+			logStream(LOG_INFO) << "display: " << displaymodes[displaySelector] << std::endl;
+			return;
+
+		case GLFW_KEY_F9:
+			_captureToggled = true;
+			return;
+
+		case GLFW_KEY_F12:
+			_capture.requestScreenshot();
+			return;
 		}
 
 		GlfwApp::onKey(key, scancode, action, mods);
 	}
 
+	// Follows what the runtime asks for, returns whether this frame is shown in the HMD
+	bool checkSessionStatus() {
+		ovrSessionStatus status;
+		if (!OVR_SUCCESS(ovr_GetSessionStatus(_session, &status))) {
+			return _presenting;
+		}
+		if (status.ShouldQuit || status.DisplayLost) {
+			if (status.DisplayLost)
+				std::cerr << "HMD display lost, exiting" << std::endl;
+			glfwSetWindowShouldClose(window, 1);
+			return false;
+		}
+		if (status.ShouldRecenter) {
+			ovr_RecenterTrackingOrigin(_session);
+		}
+		bool presenting = status.IsVisible && (status.HmdMounted || _renderUnmounted);
+		if (presenting != _presenting) {
+			logStream(LOG_INFO) << (presenting ? "HMD visible, rendering" : "HMD not visible, idling") << std::endl;
+			_presenting = presenting;
+		}
+		//Someone wearing the headset sees every frame, however still they stand
+		if (presenting && status.HmdMounted)
+			frameLimiter().activity();
+		return presenting;
+	}
+
 	void draw() final override {
+		// Whatever the last frame took from the arena is done with
+		frameArena().reset();
+		_mirrorPresented = false;
+		if (!checkSessionStatus()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(_idleSleepMs));
+			return;
+		}
+
+		// The head is predicted from the same tracking state as the hands, for the frame submitted below
 		ovrPosef eyePoses[2];
-		ovr_GetEyePoses(_session, frame, true, _viewScaleDesc.HmdToEyeOffset, eyePoses, &_sceneLayer.SensorSampleTime);
+		//A replay's eyes as recorded, unless the tracking mode holds part of the head still
+		if (_replayed && trackingSelector == TRACK_FULL) {
+			eyePoses[ovrEye_Left] = _replayed->eyePoses[ovrEye_Left];
+			eyePoses[ovrEye_Right] = _replayed->eyePoses[ovrEye_Right];
+		}
+		else {
+			ovr_CalcEyePoses(_frameState.tracking.HeadPose.ThePose, _viewScaleDesc.HmdToEyeOffset, eyePoses);
+		}
+		bool single = singleView();
+		bool mono = viewSelector == VIEW_MONO;
+		if (mono)
+			eyePoses[ovrEye_Left] = eyePoses[ovrEye_Right] = centerPose(eyePoses);
+		_sceneLayer.SensorSampleTime = _frameState.sensorSampleTime;
+		if (_poseTrace.recording()) {
+			_poseTrace.write(traceFrame(_frameState, eyePoses));
+		}
 		
 		int curIndex;
 		ovr_GetTextureSwapChainCurrentIndex(_session, _eyeTexture, &curIndex);
@@ -575,116 +1681,776 @@ protected:
 		ovr_GetTextureSwapChainBufferGL(_session, _eyeTexture, curIndex, &curTexId);
 		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _fbo);
 		glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, curTexId, 0);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		GLuint eyeFbo = _eyeMsaa.valid() ? _eyeMsaa.framebuffer() : (GLuint)_fbo;
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, eyeFbo);
+		clearEyes();
+
 
+		// Both poses are set up front, the scene may render for both eyes in the first pass
+		_sceneLayer.RenderPose[ovrEye_Left] = eyePoses[ovrEye_Left];
+		_sceneLayer.RenderPose[ovrEye_Right] = eyePoses[ovrEye_Right];
 
+		RenderContext context = renderContext(eyeFbo);
+		//With gpu.split_eyes each eye renders on its own GPU, a single view stays on all
+		bool split = gpuMulticast().active() && !single;
 		ovr::for_each_eye([&](ovrEyeType eye) {
-			
+			//The other eye does nothing: mono's layer shows this eye's viewport to both, left
+			//and right only leave it black
+			if (single && eye != shownEye())
+				return;
+			if (split)
+				gpuMulticast().renderOnEye(eye);
+			GpuGroup group(eye == ovrEye_Left ? "eye left" : "eye right");
 			const auto& vp = _sceneLayer.Viewport[eye];
 			glViewport(vp.Pos.x, vp.Pos.y, vp.Size.w, vp.Size.h);
-			_sceneLayer.RenderPose[eye] = eyePoses[eye];
-
-			renderScene(_eyeProjections[eye], ovr::toGlm(eyePoses[eye]), eye, displaySelector, _fbo, _sceneLayer, windowSize);
-			
+			//The mask is the left eye's shape, the right eye sees other parts of the mono view
+			if (_lensMask.valid() && !mono)
+				_lensMask.draw(eye, (_clearMask & GL_STENCIL_BUFFER_BIT) != 0);
+
+			context.eye = eye;
+			context.projection = mono ? _monoProjection : _eyeProjections[eye];
+			context.view = rigidInverse(ovr::toGlm(eyePoses[eye]));
+			renderScene(context);
 		});
+		gpuMulticast().renderOnAll();
+		if (_eyeMsaa.valid()) {
+			CpuScope scope("eye resolve");
+			GpuScope gpuScope(_eyeResolveGpuPass);
+			_eyeMsaa.resolve(_fbo);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _fbo);
+		}
+		//The compositor reads the first GPU's eye buffer, the right eye is still on the second
+		if (split) {
+			CpuScope scope("eye gather");
+			const auto& vp = _sceneLayer.Viewport[ovrEye_Right];
+			gpuMulticast().gatherEye(ovrEye_Right, curTexId, vp.Pos.x, vp.Pos.y, vp.Size.w, vp.Size.h);
+		}
+		_mirrorPresented = mirrorThisFrame();
+		// The eye buffer belongs to the compositor once it is committed, so it is copied out first
+		if (_mirrorPresented && _mirrorSource == MIRROR_EYE) {
+			CpuScope scope("mirror blit");
+			GpuScope gpuScope(_mirrorGpuPass);
+			const auto& vp = _sceneLayer.Viewport[_mirrorEye];
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, _fbo);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+			glBlitFramebuffer(vp.Pos.x, vp.Pos.y, vp.Pos.x + vp.Size.w, vp.Pos.y + vp.Size.h, 0, 0, _mirrorSize.x, _mirrorSize.y,
+				GL_COLOR_BUFFER_BIT, GL_LINEAR);
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _fbo);
+		}
 		glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
 		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
 		ovr_CommitTextureSwapChain(_session, _eyeTexture);
-		ovrLayerHeader* headerList = &_sceneLayer.Header;
-		ovr_SubmitFrame(_session, frame, &_viewScaleDesc, &headerList, 1);
-
-		GLuint mirrorTextureId;
-		ovr_GetMirrorTextureBufferGL(_session, _mirrorTexture, &mirrorTextureId);
-		glBindFramebuffer(GL_READ_FRAMEBUFFER, _mirrorFbo);
-		glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mirrorTextureId, 0);
-		glBlitFramebuffer(0, 0, _mirrorSize.x, _mirrorSize.y, 0, _mirrorSize.y, _mirrorSize.x, 0, GL_COLOR_BUFFER_BIT, GL_NEAREST);
-		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+		// The HUD and the test pattern are quad layers, the compositor draws them over the eye
+		// buffers and they are only drawn into when they change
+		uint64_t resident, budget;
+		size_t evictions;
+		if (sceneResidency(resident, budget, evictions))
+			_perfHud.setResidency(resident, budget, evictions);
+		_perfHud.render();
+		const ovrLayerHeader* headerList[ovrMaxLayerCount];
+		int layerCount = 0;
+		headerList[layerCount++] = &_sceneLayer.Header;
+		_quadLayers.setShown(_testPattern, displaySelector == DISPLAY_CALIBRATION);
+		//Only the quad layers going up this frame are kept back from the walls
+		layerCount += sceneLayers(headerList + layerCount, ovrMaxLayerCount - 1 - _quadLayers.headers(nullptr, 0));
+		layerCount += _quadLayers.headers(headerList + layerCount, ovrMaxLayerCount - layerCount);
+		ovrResult submitted;
+		//The submit waits for the compositor, the next frame gets going meanwhile
+		startNextFrame();
+		{
+			CpuScope scope("ovr_SubmitFrame");
+			PacingScope pacing(FramePacing::SUBMIT);
+			_latencyProbe.beginSubmit(_sceneLayer.SensorSampleTime);
+			submitted = ovr_SubmitFrame(_session, _frameState.frameIndex, &_viewScaleDesc, headerList, layerCount);
+			_latencyProbe.endSubmit();
+		}
+		if (submitted == ovrSuccess_NotVisible) {
+			// Picked up by the next frame's status check, which idles until it is shown again
+			_presenting = false;
+		}
+		else if (submitted == ovrError_DisplayLost) {
+			std::cerr << "HMD display lost, exiting" << std::endl;
+			glfwSetWindowShouldClose(window, 1);
+		}
+		size_t reported = _perfHud.poll();
+		if (_latencyProbe.active())
+			updateLatency(reported);
+		PerfHud::Sample newest;
+		if (telemetry().active() && _perfHud.latest(newest))
+			telemetry().setDropped(newest.appDroppedFrames, newest.compositorDroppedFrames);
+		if (flightRecorder().active() && _perfHud.latest(newest))
+			flightRecorder().setCompositor(newest.appGpuTime * 1000.0f, newest.appDroppedFrames, newest.compositorDroppedFrames);
+
+		if (!_mirrorPresented)
+			return;
+		CpuScope scope("mirror blit");
+		GpuScope gpuScope(_mirrorGpuPass);
+		if (_mirrorSource == MIRROR_COMPOSITOR && _mirrorTexture) {
+			GLuint mirrorTextureId;
+			ovr_GetMirrorTextureBufferGL(_session, _mirrorTexture, &mirrorTextureId);
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, _mirrorFbo);
+			glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mirrorTextureId, 0);
+			glBlitFramebuffer(0, 0, _mirrorSize.x, _mirrorSize.y, 0, _mirrorSize.y, _mirrorSize.x, 0, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+		}
+		else if (_mirrorSource == MIRROR_WALL) {
+			GLuint texture;
+			GLint layer;
+			GLsizei size;
+			if (!mirrorWallTexture(_mirrorEye, _mirrorWall, texture, layer, size))
+				return;
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, _mirrorFbo);
+			if (layer >= 0)
+				glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture, 0, layer);
+			else
+				glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+			glBlitFramebuffer(0, 0, size, size, 0, 0, _mirrorSize.x, _mirrorSize.y, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+			glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+		}
 	}
 
-	void update() final override
-	{
-		//ovrInputState inputState;
-		/*if (OVR_SUCCESS(ovr_GetInputState(_session, ovrControllerType_Touch, &inputState)))
-		{			
-			// On B press, change head tracking mode
-			if (inputState.Buttons & ovrButton_B && !B_down) {
-				B_down = true;
-				trackingSelector = (trackingSelector + 1)%2;	
-				printf("Tracking mode: ", trackingSelector);
-			}
-			if (!(inputState.Buttons & ovrButton_B)) {
-				B_down = false;
-			}
-		}*/
+	//! Hands the compositor frames the HUD just polled to the latency probe, oldest first, and
+	// the newest frame it has a report for (or else the newest) back to the HUD
+	// @input reported How many frames the poll read
+	void updateLatency(size_t reported) {
+		for (size_t age = reported; age-- > 0;) {
+			const PerfHud::Sample & sample = _perfHud.recent(age);
+			LatencyProbe::CompositorFrame frame;
+			frame.appFrameIndex = sample.appFrameIndex;
+			frame.motionToPhoton = sample.motionToPhoton;
+			frame.queueAhead = sample.queueAhead;
+			frame.appGpu = sample.appGpuTime;
+			frame.compositorCpuToGpuEnd = sample.compositorCpuToGpuEnd;
+			frame.compositorGpuEndToVsync = sample.compositorGpuEndToVsync;
+			_latencyProbe.compositorFrame(frame);
+		}
+		LatencyProbe::Frame latency;
+		if (_latencyProbe.latestReported(latency) || _latencyProbe.latest(latency))
+			_perfHud.setLatency(latency.stages, LatencyProbe::STAGES, latency.reported);
 	}
 
-	virtual void renderScene(const glm::mat4 & projection, const glm::mat4 & headPose, ovrEyeType eye, int displayMode, GLuint hmd_fbo, ovrLayerEyeFov _sceneLayer, uvec2 windowSize) = 0;
-};
+	bool mirrorThisFrame() {
+		switch (_mirrorMode) {
+		case MIRROR_OFF:
+			return false;
+		case MIRROR_ON_DEMAND: {
+			bool requested = _mirrorRequested;
+			_mirrorRequested = false;
+			return requested;
+		}
+		default:
+			return frame % (_mirrorInterval << qualityGovernor().level(QualityGovernor::MIRROR)) == 0;
+		}
+	}
+
+	// The window only swaps on the frames the mirror was drawn into. The capture reads the
+	// back buffer before it is swapped.
+	void finishFrame() override {
+		captureFrame();
+		if (_mirrorPresented)
+			GlfwApp::finishFrame();
+	}
 
-///////////////////////////////////////////////////////////////////////////////////////////
-//										LOAD PPM
-///////////////////////////////////////////////////////////////////////////////////////////
+	double refreshRate() const override { return _hmdDesc.DisplayRefreshRate; }
 
-//! Load a ppm file from disk.
-// @input filename The location of the PPM file.  If the file is not found, an error message
-//		will be printed and this function will return 0
-// @input width This will be modified to contain the width of the loaded image, or 0 if file not found
-// @input height This will be modified to contain the height of the loaded image, or 0 if file not found
-//
-// @return Returns the RGB pixel data as interleaved unsigned chars (R0 G0 B0 R1 G1 B1 R2 G2 B2 .... etc) or 0 if an error ocured
+	// ovr_SubmitFrame waited for the compositor on every frame that was presented
+	bool framePaced() const override { return _presenting; }
 
-unsigned char* loadPPM(const char* filename, int& width, int& height)
-{
-	const int BUFSIZE = 128;
-	FILE* fp;
-	unsigned int read;
-	unsigned char* rawData;
-	char buf[3][BUFSIZE];
-	char* retval_fgets;
-	size_t retval_sscanf;
-
-	if ((fp = fopen(filename, "rb")) == NULL)
+	void update() final override
 	{
-		std::cerr << "error reading ppm file, could not locate " << filename << std::endl;
-		width = 0;
-		height = 0;
-		return 0;
+		FrameState & simulated = _simulation.back();
+		simulated.inputValid = OVR_SUCCESS(ovr_GetInputState(_session, ovrControllerType_Touch, &simulated.input));
+		_touchEdges.update(simulated.input, simulated.inputValid, glfwGetTime(), [this](const InputEvent & e) { pushInput(e); });
+		_simulation.publish();
 	}
 
-	// Read magic number:
-	retval_fgets = fgets(buf[0], BUFSIZE, fp);
-
-	// Read width and height:
-	do
+	// With app.pipelined the next frame's props are picked ahead, from where the hands are
+	// predicted to be at that frame's display. The frame itself still renders the head and
+	// hands beginFrame reads.
+	void prepareFrame() final override
 	{
-		retval_fgets = fgets(buf[0], BUFSIZE, fp);
-	} while (buf[0][0] == '#');
-	retval_sscanf = sscanf(buf[0], "%s %s", buf[1], buf[2]);
-	width = atoi(buf[1]);
-	height = atoi(buf[2]);
-
-	// Read maxval:
-	do
-	{
-		retval_fgets = fgets(buf[0], BUFSIZE, fp);
-	} while (buf[0][0] == '#');
-
-	// Read image data:
-	rawData = new unsigned char[width * height * 3];
-	read = (unsigned int) fread(rawData, width * height * 3, 1, fp);
-	fclose(fp);
-	if (read != 1)
+		if (_poseTrace.replaying())
+			return;
+		//The update that just ran on this thread wrote the input
+		FrameState predicted = _simulation.back();
+		predicted.frameIndex = frame + 1;
+		predicted.displayTime = ovr_GetPredictedDisplayTime(_session, frame + 1);
+		predicted.sensorSampleTime = ovr_GetTimeInSeconds();
+		predicted.tracking = ovr_GetTrackingState(_session, predicted.displayTime, ovrFalse);
+		predicted.events = nullptr;
+		predicted.eventCount = 0;
+		predicted.gpuTime = _frameState.gpuTime;
+		predicted.frameBudget = _frameState.frameBudget;
+		prepareScene(predicted);
+	}
+
+	// Tracking is read here rather than in update, as late as possible for the frame
+	void beginFrame() final override
 	{
-		std::cerr << "error parsing ppm file, incomplete data" << std::endl;
-		delete[] rawData;
-		width = 0;
-		height = 0;
+		// Keeps the last input when update has not run since the previous frame
+		_simulation.acquire(_frameState);
+		_frameState.events = frameInput().data();
+		_frameState.eventCount = frameInput().size();
+		// The midpoint of the frame about to be rendered, draw submits it with the same index
+		_frameState.frameIndex = frame;
+		_frameState.displayTime = ovr_GetPredictedDisplayTime(_session, frame);
+		_frameState.sensorSampleTime = ovr_GetTimeInSeconds();
+		_frameState.tracking = ovr_GetTrackingState(_session, _frameState.displayTime, ovrTrue);
+		PerfHud::Sample stats;
+		bool statsValid = _perfHud.latest(stats);
+		_frameState.gpuTime = statsValid ? stats.appGpuTime : 0.0f;
+		_frameState.frameBudget = 1.0f / _hmdDesc.DisplayRefreshRate;
+		//The governor goes by whichever of the app's timers and the compositor's is longer,
+		//and by the compositor's own verdict on headroom
+		if (qualityGovernor().active()) {
+			QualityGovernor::Sample sample;
+			sample.gpuMs = std::max(gpuTimers().lastFrameMs(), _frameState.gpuTime * 1000.0f);
+			sample.frameMs = _frameState.frameBudget * 1000.0f;
+			sample.performanceScale = statsValid ? stats.gpuScale : 0.0f;
+			sample.droppedFrames = statsValid ? stats.appDroppedFrames : 0;
+			qualityGovernor().update(sample);
+		}
 
-		return 0;
+		// The recorded head, hands and buttons stand in for the live ones. The frame is still
+		// timed and submitted live, so the compositor paces it as usual.
+		if (_poseTrace.replaying()) {
+			_replayed = _poseTrace.next();
+			if (!_replayed) {
+				logStream(LOG_INFO) << "pose trace finished" << std::endl;
+				_poseTrace.close();
+				glfwSetWindowShouldClose(window, 1);
+			}
+			else {
+				_frameState.tracking = _replayed->tracking;
+				_frameState.input = _replayed->input;
+				_frameState.inputValid = _replayed->inputValid != 0;
+				_replayEvents.clear();
+				_replayEdges.update(_frameState.input, _frameState.inputValid, glfwGetTime(),
+					[this](const InputEvent & e) { _replayEvents.push_back(e); });
+				_frameState.events = _replayEvents.data();
+				_frameState.eventCount = _replayEvents.size();
+			}
+		}
+		applyTrackingMode(_frameState.tracking.HeadPose);
+		if (trackingMoved(_frameState.tracking, _limiterTracking))
+			frameLimiter().activity();
+		_latencyProbe.beginFrame(_frameState.frameIndex, _frameState.displayTime, _frameState.tracking.HeadPose.TimeInSeconds);
+
+		// Each eye keeps its place in the swap chain, only how much of it is drawn changes
+		if (qualityGovernor().active()) {
+			float steps = (float)qualityGovernor().level(QualityGovernor::EYE_RESOLUTION) / EYE_STEPS;
+			_eyeResolution.setScale(1.f - steps * (1.f - _eyeResolution.minimumScale()));
+			layoutViews(_eyeResolution.scale());
+		}
+		else {
+			if (_eyeResolution.dynamic())
+				_eyeResolution.update(_frameState.gpuTime, _frameState.frameBudget);
+			layoutViews(_eyeResolution.dynamic() ? _eyeResolution.scale() : 1.f);
+		}
 	}
 
-	return rawData;
-}
+	// The scene's part of prepareFrame()
+	virtual void prepareScene(const FrameState & predicted) {}
+	// The frame's part of every eye's context, the eye's own is filled in per eye
+	RenderContext renderContext(GLuint eyeFbo) const {
+		RenderContext context = {};
+		context.frame = &_frameState;
+		context.layer = &_sceneLayer;
+		context.fbo = eyeFbo;
+		context.displayMode = displaySelector;
+		context.windowSize = windowSize;
+		return context;
+	}
+
+	virtual void renderScene(const RenderContext & context) = 0;
+};
+
+#else
+
+// Stands in for the Rift in the benchmark build (CAVE_BENCHMARK): a fixed field of view, an
+// offscreen eye buffer instead of the swap chain and a head swaying along a fixed path, so
+// the scene renders as it would in the headset, only as fast as it can and with no
+// compositor. Runs benchmark.warmup frames, times benchmark.frames more and prints the
+// frame time percentiles. With benchmark.finish each frame ends in glFinish, so the GPU
+// time is in the frame time.
+//
+// benchmark.session picks what the viewer does: "sweep" looks around (the default),
+// "static" stands still, "controller" looks around viewing the walls from the right hand
+// (trigger held) and "wireframes" looks around with the debug wireframes on (A pressed).
+// A trace.replay trace takes the place of the synthetic head and hands. With
+// benchmark.baseline the CPU, GPU and frame time p50/p95/p99 are checked against that
+// file, and the run exits with 2 if any is over by more than benchmark.tolerance (a
+// fraction) plus benchmark.tolerance_ms. benchmark.update_baseline writes them instead.
+//
+// With a stress scene (stress.*, StressScene.h) the run also goes into
+// benchmark.stress_csv, and the CPU and GPU times of the runs in it along each axis are
+// printed with what each step along it costs.
+//
+// soak.minutes makes it a soak test instead (SoakTest.h): the session runs that long, with
+// trace.loop a trace plays over and over, and the run exits with 3 if memory, handles, GL
+// objects or the frame time kept growing. soak.csv writes the samples.
+class RiftApp : public GlfwApp {
+protected:
+	// There is no session, everything that would need one checks for nullptr
+	ovrSession _session{ nullptr };
+
+private:
+	GLFramebuffer _fbo;
+	GLTexture _colorBuffer;
+	GLRenderbuffer _depthBuffer;
+	MultisampleFramebuffer _eyeMsaa;
+	int _eyeResolveGpuPass{ gpuTimers().pass("eye resolve") };
+	GLbitfield _clearMask{ GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT };
+	LensMask _lensMask;
+
+	mat4 _eyeProjections[2];
+	ovrLayerEyeFov _sceneLayer;
+	uvec2 _renderTargetSize;
+	float _eyeOffset{ 0.032f };
+
+	int displaySelector = 0;
+	FrameState _frameState{};
+	// With trace.replay the head and hands come from a trace recorded in the headset
+	PoseTrace _poseTrace;
+	// There is no input thread, the synthetic or replayed input turns into events here
+	TouchEdges _touchEdges;
+	std::vector<InputEvent> _events;
+
+	enum BenchSession { SWEEP, STATIC, CONTROLLER, WIREFRAMES };
+	BenchSession _bench{ SWEEP };
+	// The poses frame.idle_hz last saw move
+	ovrTrackingState _limiterTracking{};
+	std::string _sessionName;
+
+	int _warmupFrames{ 100 };
+	int _timedFrames{ 2000 };
+	bool _finish{ true };
+	// Seconds for the frame times, milliseconds for the CPU and GPU times like the baselines
+	std::vector<double> _frameTimes;
+	std::vector<double> _cpuTimes;
+	std::vector<double> _gpuTimes;
+	size_t _gpuFramesSeen{ 0 };
+	double _frameStart{ 0.0 };
+	bool _reported{ false };
+	bool _regressed{ false };
+	SoakTest _soak;
+	bool _soakFailed{ false };
+	// The run's CPU, GPU and frame time percentiles, once reported
+	FramePercentiles _measured[3]{};
+
+public:
+	RiftApp() {
+		memset(&_sceneLayer, 0, sizeof(ovrLayerEyeFov));
+		_sceneLayer.Header.Type = ovrLayerType_EyeFov;
+		uvec2 eyeSize(std::max(config().getInt("benchmark.eye_width", 1344), 16),
+			std::max(config().getInt("benchmark.eye_height", 1600), 16));
+		_eyeOffset = config().getFloat("benchmark.ipd", 0.064f) * 0.5f;
+
+		// About the default field of view of a CV1
+		ovrFovPort fov;
+		fov.UpTan = 1.33f;
+		fov.DownTan = 1.33f;
+		fov.LeftTan = 1.06f;
+		fov.RightTan = 1.06f;
+		ovr::for_each_eye([&](ovrEyeType eye) {
+			_eyeProjections[eye] = ovr::toGlm(ovrMatrix4f_Projection(fov, 0.01f, 1000.0f, ovrProjection_ClipRangeOpenGL));
+			_sceneLayer.Fov[eye] = fov;
+			_sceneLayer.Viewport[eye].Size = ovr::fromGlm(eyeSize);
+			_sceneLayer.Viewport[eye].Pos = { (int)_renderTargetSize.x, 0 };
+			_renderTargetSize.x += eyeSize.x;
+		});
+		_renderTargetSize.y = eyeSize.y;
+
+		_sessionName = config().getString("benchmark.session", "sweep");
+		if (_sessionName == "static")
+			_bench = STATIC;
+		else if (_sessionName == "controller")
+			_bench = CONTROLLER;
+		else if (_sessionName == "wireframes")
+			_bench = WIREFRAMES;
+		else if (_sessionName != "sweep") {
+			std::cerr << "unknown benchmark.session " << _sessionName << ", using sweep" << std::endl;
+			_sessionName = "sweep";
+		}
+	}
+
+	// 2 when a baseline check failed, for scripts running the sessions
+	int run() override {
+		int result = GlfwApp::run();
+		return result ? result : _regressed ? 2 : _soakFailed ? 3 : 0;
+	}
+
+	// Of the timed frames, for the station calibration. No frames until the run is over.
+	const FramePercentiles & measuredGpu() const { return _measured[1]; }
+	const FramePercentiles & measuredFrame() const { return _measured[2]; }
+
+protected:
+	const mat4 & eyeProjection(ovrEyeType eye) const { return _eyeProjections[eye]; }
+	const FrameState & frameState() const { return _frameState; }
+	mat4 latchEyePose(ovrEyeType eye) { return ovr::toGlm(_sceneLayer.RenderPose[eye]); }
+	void recenter() {}
+	// As the headset's RiftApp has it, for the configured eye size
+	float eyeFaceTexels() const {
+		return std::max(_sceneLayer.Viewport[0].Size.w * _eyeProjections[0][0][0], _sceneLayer.Viewport[1].Size.w * _eyeProjections[1][0][0]);
+	}
+	// The swaying head is always tracked in full, in stereo
+	bool singleView() const { return false; }
+	bool headPositionTracked() const { return true; }
+
+	virtual bool mirrorWallTexture(int eye, int wall, GLuint & texture, GLint & layer, GLsizei & size) const { return false; }
+	virtual int sceneLayers(const ovrLayerHeader ** out, int max) const { return 0; }
+	virtual bool sceneCoversEyes() const { return false; }
+	virtual bool sceneResidency(uint64_t & resident, uint64_t & budget, size_t & evictions) const { return false; }
+
+	GLFWwindow * createRenderingTarget(uvec2 & outSize, ivec2 & outPosition) override {
+		// Only the context is needed, the frames go to the offscreen eye buffer
+		glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+		return glfw::createWindow(uvec2(256, 256));
+	}
+
+	void initGl() override {
+		GlfwApp::initGl();
+		glfwSwapInterval(0);
+		// No compositor, the intervals are only measured against its refresh
+		if (config().getBool("pacing.enabled", true))
+			framePacing().init(90.0, glfwGetTime, (size_t)std::max(config().getInt("pacing.frames", 2000), 1));
+		_warmupFrames = std::max(config().getInt("benchmark.warmup", 100), 0);
+		_timedFrames = std::max(config().getInt("benchmark.frames", 2000), 1);
+		_finish = config().getBool("benchmark.finish", true);
+		_frameTimes.reserve(_timedFrames);
+		_events.reserve(64);
+		_cpuTimes.reserve(_timedFrames);
+		_gpuTimes.reserve(_timedFrames);
+		openPoseTrace(_poseTrace);
+		float soakMinutes = config().getFloat("soak.minutes", 0.0f);
+		if (soakMinutes > 0.0f) {
+			//Growth an hour each metric may have once settled, negative for none
+			double limits[SoakTest::METRICS];
+			limits[SoakTest::RESIDENT_MB] = config().getFloat("soak.resident_mb_per_hour", 32.0f);
+			limits[SoakTest::HANDLES] = config().getFloat("soak.handles_per_hour", 100.0f);
+			limits[SoakTest::GL_OBJECTS] = config().getFloat("soak.objects_per_hour", 20.0f);
+			limits[SoakTest::GPU_MB] = config().getFloat("soak.gpu_mb_per_hour", 16.0f);
+			limits[SoakTest::FRAME_MS] = config().getFloat("soak.frame_ms_per_hour", 0.5f);
+			_soak.init(soakMinutes, config().getFloat("soak.interval_s", 30.0f), config().getFloat("soak.settle_minutes", 5.0f), limits);
+			logStream(LOG_INFO) << "soak test for " << soakMinutes << " minutes" << std::endl;
+		}
+
+		// The eye buffer in the swap chain's format, both eyes side by side
+		bool stencil = eyeBufferStencil();
+		GLenum depthFormat = stencil ? GL_DEPTH24_STENCIL8 : GL_DEPTH_COMPONENT16;
+		GLenum depthAttachment = stencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+		if (directStateAccess()) {
+			GLuint color = 0;
+			glCreateTextures(GL_TEXTURE_2D, 1, &color);
+			_colorBuffer = GLTexture::adopt(color);
+			glTextureStorage2D(_colorBuffer, 1, GL_SRGB8_ALPHA8, _renderTargetSize.x, _renderTargetSize.y);
+			_depthBuffer.create();
+			glNamedRenderbufferStorage(_depthBuffer, depthFormat, _renderTargetSize.x, _renderTargetSize.y);
+		}
+		else {
+			_colorBuffer.create();
+			glBindTexture(GL_TEXTURE_2D, _colorBuffer);
+			glTexStorage2D(GL_TEXTURE_2D, 1, GL_SRGB8_ALPHA8, _renderTargetSize.x, _renderTargetSize.y);
+			glBindTexture(GL_TEXTURE_2D, 0);
+			_depthBuffer.create();
+			glBindRenderbuffer(GL_RENDERBUFFER, _depthBuffer);
+			glRenderbufferStorage(GL_RENDERBUFFER, depthFormat, _renderTargetSize.x, _renderTargetSize.y);
+			glBindRenderbuffer(GL_RENDERBUFFER, 0);
+		}
+		gpuMemory().allocate(GpuMemory::KIND_TEXTURE, _colorBuffer,
+			textureBytes(GL_SRGB8_ALPHA8, _renderTargetSize.x, _renderTargetSize.y, 1, 1), GpuMemory::RENDER_TARGET, "eye buffer color");
+		gpuMemory().allocate(GpuMemory::KIND_RENDERBUFFER, _depthBuffer,
+			textureBytes(depthFormat, _renderTargetSize.x, _renderTargetSize.y, 1, 1), GpuMemory::RENDER_TARGET, "eye buffer depth");
+		if (stencil)
+			_clearMask |= GL_STENCIL_BUFFER_BIT;
+		initLensMask(_lensMask, _sceneLayer);
+		_fbo.create();
+		glMarkers().label(GL_FRAMEBUFFER, _fbo, "eye buffer");
+		GLenum status;
+		if (directStateAccess()) {
+			glNamedFramebufferTexture(_fbo, GL_COLOR_ATTACHMENT0, _colorBuffer, 0);
+			glNamedFramebufferRenderbuffer(_fbo, depthAttachment, GL_RENDERBUFFER, _depthBuffer);
+			status = glCheckNamedFramebufferStatus(_fbo, GL_DRAW_FRAMEBUFFER);
+		}
+		else {
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _fbo);
+			glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _colorBuffer, 0);
+			glFramebufferRenderbuffer(GL_DRAW_FRAMEBUFFER, depthAttachment, GL_RENDERBUFFER, _depthBuffer);
+			status = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+		}
+		if (status != GL_FRAMEBUFFER_COMPLETE) {
+			FAIL("Benchmark eye buffer is not complete");
+		}
+		//eye.msaa as in the headset, drawn multisampled and resolved into _colorBuffer
+		int eyeSamples = config().getInt("eye.msaa", 1);
+		if (eyeSamples > 1) {
+			if (_eyeMsaa.init(GL_SRGB8_ALPHA8, depthFormat, depthAttachment, _renderTargetSize.x, _renderTargetSize.y, eyeSamples))
+				logStream(LOG_INFO) << "eye buffer with " << _eyeMsaa.sampleCount() << "x MSAA" << std::endl;
+			else
+				std::cerr << "eye.msaa: no multisampled eye buffer, drawing single sampled" << std::endl;
+		}
+		_frameStart = glfwGetTime();
+	}
+
+	void shutdownGl() override {
+		if (_soak.active())
+			reportSoak();
+		else
+			report();
+		_lensMask.release();
+		_eyeMsaa.release();
+		_fbo.reset();
+		gpuMemory().release(GpuMemory::KIND_RENDERBUFFER, _depthBuffer);
+		gpuMemory().release(GpuMemory::KIND_TEXTURE, _colorBuffer);
+		_depthBuffer.reset();
+		_colorBuffer.reset();
+		_poseTrace.close();
+		GlfwApp::shutdownGl();
+	}
+
+	void update() final override {
+		_frameState.inputValid = false;
+	}
+
+	// The head follows the same path in every run, a slow look around while swaying a little,
+	// as if someone stood in the CAVE. The path goes by frame, not by time.
+	void sessionFrame(unsigned int index, FrameState & state, quat & orientation, vec3 & position) const {
+		float t = _bench == STATIC ? 0.0f : index / 90.0f;
+		orientation = glm::angleAxis(0.6f * sinf(0.4f * t), vec3(0, 1, 0)) * glm::angleAxis(0.15f * sinf(0.3f * t), vec3(1, 0, 0));
+		position = vec3(0.1f * sinf(0.5f * t), 0.03f * sinf(0.9f * t), 0.1f * cosf(0.35f * t));
+
+		state.frameIndex = index;
+		memset(&state.tracking, 0, sizeof(state.tracking));
+		state.tracking.HeadPose.ThePose.Orientation = ovr::fromGlm(orientation);
+		state.tracking.HeadPose.ThePose.Position = ovr::fromGlm(position);
+		state.tracking.HandPoses[ovrHand_Right].ThePose.Orientation = ovr::fromGlm(orientation);
+		state.tracking.HandPoses[ovrHand_Right].ThePose.Position = ovr::fromGlm(position + orientation * vec3(0.2f, -0.3f, -0.3f));
+		state.frameBudget = 1.0f / 90.0f;
+		memset(&state.input, 0, sizeof(state.input));
+		state.inputValid = false;
+		if (_bench == CONTROLLER || _bench == WIREFRAMES) {
+			// Held the whole run, the scene reacts to the first press only
+			state.inputValid = true;
+			if (_bench == CONTROLLER)
+				state.input.HandTrigger[ovrHand_Right] = 1.0f;
+			else
+				state.input.Buttons = ovrButton_A;
+		}
+	}
+
+	// With app.pipelined the next frame's props are picked ahead, with the hand where the
+	// path has it then
+	void prepareFrame() final override {
+		if (_poseTrace.replaying())
+			return;
+		FrameState predicted{};
+		quat orientation;
+		vec3 position;
+		sessionFrame(frame + 1, predicted, orientation, position);
+		predicted.displayTime = glfwGetTime() + predicted.frameBudget;
+		predicted.sensorSampleTime = predicted.displayTime;
+		prepareScene(predicted);
+	}
+
+	void beginFrame() final override {
+		quat orientation;
+		vec3 position;
+		sessionFrame(frame, _frameState, orientation, position);
+		_frameState.displayTime = glfwGetTime();
+		_frameState.sensorSampleTime = _frameState.displayTime;
+		_frameState.gpuTime = _frameTimes.empty() ? 0.0f : (float)_frameTimes.back();
+		//The frame's wall time stands in for the compositor's numbers, there are none
+		if (qualityGovernor().active()) {
+			QualityGovernor::Sample sample;
+			sample.gpuMs = std::max(gpuTimers().lastFrameMs(), _frameState.gpuTime * 1000.0f);
+			sample.frameMs = _frameState.frameBudget * 1000.0f;
+			sample.performanceScale = 0.0f;
+			sample.droppedFrames = 0;
+			qualityGovernor().update(sample);
+		}
+
+		if (_poseTrace.replaying()) {
+			const PoseTraceFrame* replayed = _poseTrace.next();
+			if (!replayed) {
+				_poseTrace.close();
+				glfwSetWindowShouldClose(window, 1);
+			}
+			else {
+				_frameState.tracking = replayed->tracking;
+				_frameState.input = replayed->input;
+				_frameState.inputValid = replayed->inputValid != 0;
+				_sceneLayer.RenderPose[ovrEye_Left] = replayed->eyePoses[ovrEye_Left];
+				_sceneLayer.RenderPose[ovrEye_Right] = replayed->eyePoses[ovrEye_Right];
+				collectInput();
+				return;
+			}
+		}
+
+		ovr::for_each_eye([&](ovrEyeType eye) {
+			_sceneLayer.RenderPose[eye].Orientation = ovr::fromGlm(orientation);
+			vec3 offset(eye == ovrEye_Left ? -_eyeOffset : _eyeOffset, 0.f, 0.f);
+			_sceneLayer.RenderPose[eye].Position = ovr::fromGlm(position + orientation * offset);
+		});
+		collectInput();
+	}
+
+	void collectInput() {
+		_events.clear();
+		_touchEdges.update(_frameState.input, _frameState.inputValid, _frameState.displayTime,
+			[this](const InputEvent & e) { _events.push_back(e); });
+		if (!_events.empty() || trackingMoved(_frameState.tracking, _limiterTracking))
+			frameLimiter().activity();
+		_frameState.events = _events.data();
+		_frameState.eventCount = _events.size();
+	}
+
+	void draw() final override {
+		frameArena().reset();
+		GLuint eyeFbo = _eyeMsaa.valid() ? _eyeMsaa.framebuffer() : (GLuint)_fbo;
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, eyeFbo);
+		clearEyeBuffer(_clearMask, sceneCoversEyes());
+		RenderContext context = renderContext(eyeFbo);
+		ovr::for_each_eye([&](ovrEyeType eye) {
+			GpuGroup group(eye == ovrEye_Left ? "eye left" : "eye right");
+			const auto& vp = _sceneLayer.Viewport[eye];
+			glViewport(vp.Pos.x, vp.Pos.y, vp.Size.w, vp.Size.h);
+			if (_lensMask.valid())
+				_lensMask.draw(eye, (_clearMask & GL_STENCIL_BUFFER_BIT) != 0);
+			context.eye = eye;
+			context.projection = _eyeProjections[eye];
+			context.view = rigidInverse(ovr::toGlm(_sceneLayer.RenderPose[eye]));
+			renderScene(context);
+		});
+		if (_eyeMsaa.valid()) {
+			CpuScope scope("eye resolve");
+			GpuScope gpuScope(_eyeResolveGpuPass);
+			_eyeMsaa.resolve(_fbo);
+		}
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+		double submitted = glfwGetTime();
+		//glFinish waits for the GPU, the next frame gets going meanwhile
+		startNextFrame();
+		if (_finish)
+			glFinish();
+
+		double now = glfwGetTime();
+		//A soak keeps no frame times of its own, they would grow with the run
+		if (_soak.active()) {
+			if (!_soak.frame(now, (now - _frameStart) * 1000.0))
+				glfwSetWindowShouldClose(window, 1);
+			_frameStart = now;
+			return;
+		}
+		if ((int)frame > _warmupFrames) {
+			_frameTimes.push_back(now - _frameStart);
+			_cpuTimes.push_back((submitted - _frameStart) * 1000.0);
+			// The timers read a frame back a few frames later, each one is taken once
+			if (gpuTimers().collectedFrames() != _gpuFramesSeen)
+				_gpuTimes.push_back(gpuTimers().lastFrameMs());
+		}
+		_gpuFramesSeen = gpuTimers().collectedFrames();
+		_frameStart = now;
+		if ((int)_frameTimes.size() >= _timedFrames)
+			glfwSetWindowShouldClose(window, 1);
+	}
+
+	void finishFrame() override {
+	}
+
+	// What the stand-in paces to, the same 90 Hz its frame budget is
+	double refreshRate() const override { return 90.0; }
+
+	void reportSoak() {
+		_soakFailed = !_soak.evaluate(std::cout);
+		std::string csvFile = config().getString("soak.csv");
+		if (!csvFile.empty() && !_soak.writeCsv(csvFile.c_str()))
+			std::cerr << "could not write " << csvFile << std::endl;
+		if (_soakFailed)
+			std::cerr << "soak test failed, something kept growing" << std::endl;
+	}
+
+	void report() {
+		if (_reported || _frameTimes.empty())
+			return;
+		_reported = true;
+		std::vector<double> sorted(_frameTimes);
+		std::sort(sorted.begin(), sorted.end());
+		double total = 0.0;
+		for (double time : sorted)
+			total += time;
+		auto percentile = [&](double p) { return sorted[std::min((size_t)(p * sorted.size()), sorted.size() - 1)] * 1000.0; };
+		std::cout << "benchmark: " << sorted.size() << " frames at " << _renderTargetSize.x << "x" << _renderTargetSize.y
+			<< (_finish ? ", finished each frame" : "") << std::endl;
+		std::cout << "  mean " << total / sorted.size() * 1000.0 << " ms, p50 " << percentile(0.5) << " ms, p90 "
+			<< percentile(0.9) << " ms, p99 " << percentile(0.99) << " ms, max " << sorted.back() * 1000.0 << " ms" << std::endl;
+
+		std::vector<double> frameMs(_frameTimes);
+		for (double& time : frameMs)
+			time *= 1000.0;
+		const char* metrics[] = { "cpu", "gpu", "frame" };
+		FramePercentiles measured[] = { framePercentiles(_cpuTimes), framePercentiles(_gpuTimes), framePercentiles(frameMs) };
+		std::copy(measured, measured + 3, _measured);
+		reportStress(measured[0], measured[1], measured[2]);
+
+		std::string baselineFile = config().getString("benchmark.baseline");
+		FrameBaselines baselines;
+		if (!baselineFile.empty())
+			baselines.load(baselineFile.c_str());
+		if (config().getBool("benchmark.update_baseline", false) && !baselineFile.empty()) {
+			// Keeps the other sessions' lines, so the sessions can be run one by one
+			for (int i = 0; i < 3; i++) {
+				if (measured[i].frames)
+					baselines.set(_sessionName, metrics[i], measured[i]);
+			}
+			if (baselines.save(baselineFile.c_str()))
+				std::cout << "session " << _sessionName << " written to " << baselineFile << std::endl;
+			return;
+		}
+
+		double tolerance = config().getFloat("benchmark.tolerance", 0.1f);
+		double slackMs = config().getFloat("benchmark.tolerance_ms", 0.25f);
+		std::cout << "session " << _sessionName << std::endl;
+		for (int i = 0; i < 3; i++) {
+			// No GPU times without timer queries
+			if (measured[i].frames && !baselines.check(_sessionName, metrics[i], measured[i], tolerance, slackMs, std::cout))
+				_regressed = true;
+		}
+		if (_regressed)
+			std::cerr << "session " << _sessionName << " regressed against " << baselineFile << std::endl;
+	}
+
+	void reportStress(const FramePercentiles & cpu, const FramePercentiles & gpu, const FramePercentiles & frame) {
+		StressResult result;
+		if (!stressSpecFromConfig(result.spec))
+			return;
+		result.cpu = cpu;
+		result.gpu = gpu;
+		result.frame = frame;
+		std::string csvFile = config().getString("benchmark.stress_csv", "stress.csv");
+		if (appendStressResult(csvFile.c_str(), result))
+			reportStressScaling(csvFile.c_str(), result.spec, std::cout);
+	}
+
+	// The scene's part of prepareFrame()
+	virtual void prepareScene(const FrameState & predicted) {}
+	// The frame's part of every eye's context, the eye's own is filled in per eye
+	RenderContext renderContext(GLuint eyeFbo) const {
+		RenderContext context = {};
+		context.frame = &_frameState;
+		context.layer = &_sceneLayer;
+		context.fbo = eyeFbo;
+		context.displayMode = displaySelector;
+		context.windowSize = windowSize;
+		return context;
+	}
+
+	virtual void renderScene(const RenderContext & context) = 0;
+};
+
+#endif
 
 //////////////////////////////////////////////////////////////////////
 //
@@ -733,6 +2499,290 @@ namespace Attribute {
 }
 
 // a class for encapsulating building and rendering an RGB cube
+// Every texture the scene can use. Nothing here is loaded until it is prefetched or drawn.
+static const TextureAsset sceneTextures[] = {
+	//Calibration cube
+	{ "calibration_cube", GL_TEXTURE_CUBE_MAP, {
+		"../Project3-Assets/vr_test_pattern.ppm", "../Project3-Assets/vr_test_pattern.ppm",
+		"../Project3-Assets/vr_test_pattern.ppm", "../Project3-Assets/vr_test_pattern.ppm",
+		"../Project3-Assets/vr_test_pattern.ppm", "../Project3-Assets/vr_test_pattern.ppm" } },
+
+	//Skybox, one per eye
+	{ "skybox_left", GL_TEXTURE_CUBE_MAP, {
+		"../Project3-Assets/left-ppm/px.ppm", "../Project3-Assets/left-ppm/nx.ppm",
+		"../Project3-Assets/left-ppm/py.ppm", "../Project3-Assets/left-ppm/ny.ppm",
+		"../Project3-Assets/left-ppm/pz.ppm", "../Project3-Assets/left-ppm/nz.ppm" } },
+	{ "skybox_right", GL_TEXTURE_CUBE_MAP, {
+		"../Project3-Assets/right-ppm/px.ppm", "../Project3-Assets/right-ppm/nx.ppm",
+		"../Project3-Assets/right-ppm/py.ppm", "../Project3-Assets/right-ppm/ny.ppm",
+		"../Project3-Assets/right-ppm/pz.ppm", "../Project3-Assets/right-ppm/nz.ppm" } },
+
+	//Bigger skybox around the CAVE
+	{ "bigger_skybox", GL_TEXTURE_CUBE_MAP, {
+		"../Project3-Assets/bsk/SunSetLeft2048.ppm", "../Project3-Assets/bsk/SunSetRight2048.ppm",
+		"../Project3-Assets/bsk/SunSetUp2048.ppm", "../Project3-Assets/bsk/SunSetDown2048.ppm",
+		"../Project3-Assets/bsk/SunSetFront2048.ppm", "../Project3-Assets/bsk/SunSetBack2048.ppm" } },
+
+	//Purple nebula, same face order as the sunset
+	{ "purplenebula", GL_TEXTURE_CUBE_MAP, {
+		"../Project3-Assets/bsk/purplenebula_lf.ppm", "../Project3-Assets/bsk/purplenebula_rt.ppm",
+		"../Project3-Assets/bsk/purplenebula_up.ppm", "../Project3-Assets/bsk/purplenebula_dn.ppm",
+		"../Project3-Assets/bsk/purplenebula_ft.ppm", "../Project3-Assets/bsk/purplenebula_bk.ppm" } },
+
+	//Static wall textures, one per eye
+	{ "left_wall_left", GL_TEXTURE_2D, { "../Project3-Assets/left-ppm/nx.ppm" } },
+	{ "left_wall_right", GL_TEXTURE_2D, { "../Project3-Assets/right-ppm/nx.ppm" } },
+	{ "right_wall_left", GL_TEXTURE_2D, { "../Project3-Assets/left-ppm/pz.ppm" } },
+	{ "right_wall_right", GL_TEXTURE_2D, { "../Project3-Assets/right-ppm/pz.ppm" } },
+	{ "floor_left", GL_TEXTURE_2D, { "../Project3-Assets/left-ppm/ny.ppm" } },
+	{ "floor_right", GL_TEXTURE_2D, { "../Project3-Assets/right-ppm/ny.ppm" } },
+};
+
+// An environment: the skybox around the CAVE and the one rendered into the walls per eye
+struct SkyboxSet {
+	const char * name;
+	const char * outer;
+	const char * eyes[2];
+};
+
+static const SkyboxSet skyboxSets[] = {
+	{ "sunset", "bigger_skybox", { "skybox_left", "skybox_right" } },
+	{ "nebula", "purplenebula", { "purplenebula", "purplenebula" } },
+};
+static const int skyboxSetCount = sizeof(skyboxSets) / sizeof(skyboxSets[0]);
+
+// The scene's shaders, read ahead at startup (StartupPrefetch.h). One missing here is only
+// read when its program is made, as it always was.
+static const char * sceneShaderFiles[] = {
+	"shader.vert", "shader.frag", "screenShader.vert", "screenShader.frag", "screenShaderArray.frag",
+	"wallLayered.vert", "wallLayered.geom", "wallLayered.frag", "wallMultiview.vert", "wallRaycast.vert",
+	"wallRaycast.frag", "depthOnly.frag", "shadow.vert", "virtualSky.frag", "debugLines.vert", "debugLines.frag",
+};
+
+//! Starts reading what the first frame draws, the calibration cube and the skybox set
+// config names with the scene's shaders, on the workers. Needs only the config, so main
+// calls it before the SDK and the window are set up.
+static void prefetchStartupFiles() {
+	const SkyboxSet * skybox = &skyboxSets[0];
+	std::string wanted = config().getString("skybox", "sunset");
+	for (const SkyboxSet & set : skyboxSets) {
+		if (wanted == set.name)
+			skybox = &set;
+	}
+	std::vector<std::string> names = { "calibration_cube", skybox->outer, skybox->eyes[0], skybox->eyes[1] };
+	std::vector<std::string> images;
+	for (const TextureAsset & asset : sceneTextures) {
+		if (std::find(names.begin(), names.end(), asset.name) == names.end())
+			continue;
+		for (const std::string & file : asset.files) {
+			if (std::find(images.begin(), images.end(), file) == images.end())
+				images.push_back(file);
+		}
+	}
+	startupPrefetch().start(images, std::vector<std::string>(std::begin(sceneShaderFiles), std::end(sceneShaderFiles)));
+}
+
+// Half the side of the inner skybox, centered on the origin
+static const float SKYBOX_SIZE = 20.0f;
+// And of the outer one around the CAVE
+static const float OUTER_SKYBOX_SIZE = 20.0f;
+// The box the controllers move and scale starts, and is reset to, this size
+static const float BOX_SCALE = 0.2f;
+// How fast a thumbstick held all the way moves the box (meters a second) and grows it
+// (scale a second), what 0.02 a frame at 90 Hz used to come to
+static const float BOX_MOVE_SPEED = 1.8f;
+static const float BOX_SCALE_SPEED = 1.8f;
+// What the quality governor takes off the walls' sides per step, and the steps it has on
+// them and on the props' level of detail (the pixel error doubled each)
+static const float WALL_QUALITY_STEP = 0.15f;
+static const int WALL_QUALITY_STEPS = 3;
+static const int LOD_QUALITY_STEPS = 3;
+
+// Debug wireframe colors, by wall
+static const glm::vec3 wireframeColors[] = {
+	glm::vec3(0, 0, 1), glm::vec3(1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(1, 1, 0),
+	glm::vec3(0, 1, 1), glm::vec3(1, 0, 1), glm::vec3(1, 1, 1), glm::vec3(1, 0.5f, 0),
+};
+static const int wireframeColorCount = sizeof(wireframeColors) / sizeof(wireframeColors[0]);
+
+// A scene program with the uniforms the scene sets resolved once at load. Any a program
+// lacks stay invalid and setting them does nothing. Projection and view come from the
+// Camera block (CameraUniforms) where a program has one.
+struct SceneProgram {
+	ShaderProgram program;
+	Uniform transform, instanced, color, skyboxDepth;
+	Uniform layer, uvScale;
+	Uniform skyEye, skyOrigin, skyRotation, skySize;
+	Uniform layerMatrices, layerIds, layerCount, layerBase, wallCount, projectWalls;
+	Uniform cubebox, cubeboxRight, renderedTexture, renderedTextures, skybox;
+	Uniform atlas, atlased;
+	Uniform wallInverses, wallSampling;
+	Uniform residency, vtTiles, vtPagedLevels, vtLevelOffsets, vtFaceTiles, vtFeedbackPhase;
+	Uniform lit, shadowMap, lightCells, lightIndices;
+	Uniform bandEdges, bandPacked, uvCrop;
+	Uniform pointSizes;
+	bool bindless = false;
+
+	void load(const char * vert, const char * frag) {
+		load(vert, nullptr, frag, std::string());
+	}
+
+	void load(const char * vert, const char * geom, const char * frag, const std::string & defines = std::string()) {
+		begin(vert, geom, frag, defines);
+		finish();
+	}
+
+	// load() in two steps, so that the scene's programs compile side by side (see
+	// ShaderProgram::begin). With bindless textures on (textures.bindless) the samplers take
+	// handles instead.
+	void begin(const char * vert, const char * geom, const char * frag, const std::string & defines = std::string()) {
+		bindless = bindlessTextures().enabled();
+		program.begin(vert, geom, frag, bindless ? "#define BINDLESS\n" + defines : defines);
+	}
+
+	void finish() {
+		program.finish();
+		bindUniforms();
+	}
+
+	// Again after the program is reloaded (ShaderReloader), the old handles are of the old one
+	void bindUniforms() {
+		transform = program.uniform("transform");
+		instanced = program.uniform("instanced");
+		color = program.uniform("incolor");
+		skyboxDepth = program.uniform("skyboxDepth");
+		layer = program.uniform("layer");
+		uvScale = program.uniform("uvScale");
+		skyEye = program.uniform("skyEye");
+		skyOrigin = program.uniform("skyOrigin");
+		skyRotation = program.uniform("skyRotation");
+		skySize = program.uniform("skySize");
+		layerMatrices = program.uniform("layerMatrices");
+		layerIds = program.uniform("layerIds");
+		layerCount = program.uniform("layerCount");
+		layerBase = program.uniform("layerBase");
+		wallCount = program.uniform("wallCount");
+		cubebox = program.uniform("cubebox");
+		cubeboxRight = program.uniform("cubeboxRight");
+		renderedTexture = program.uniform("renderedTexture");
+		renderedTextures = program.uniform("renderedTextures");
+		skybox = program.uniform("skybox");
+		atlas = program.uniform("atlas");
+		atlased = program.uniform("atlased");
+		wallInverses = program.uniform("wallInverses");
+		wallSampling = program.uniform("wallSampling");
+		residency = program.uniform("residency");
+		vtTiles = program.uniform("vtTiles");
+		vtPagedLevels = program.uniform("vtPagedLevels");
+		vtLevelOffsets = program.uniform("vtLevelOffsets");
+		vtFaceTiles = program.uniform("vtFaceTiles");
+		vtFeedbackPhase = program.uniform("vtFeedbackPhase");
+		lit = program.uniform("lit");
+		shadowMap = program.uniform("shadowMap");
+		lightCells = program.uniform("lightCells");
+		lightIndices = program.uniform("lightIndices");
+		bandEdges = program.uniform("bandEdges");
+		bandPacked = program.uniform("bandPacked");
+		uvCrop = program.uniform("uvCrop");
+		projectWalls = program.uniform("projectWalls");
+		pointSizes = program.uniform("pointSizes");
+
+		program.bindUniformBlock("Camera", CameraUniforms::BINDING);
+		program.bindUniformBlock("Lighting", Lighting::BINDING);
+		program.bindUniformBlock("WallViews", WallViews::BINDING);
+
+		if (bindless)
+			return;
+		//Textures are drawn from unit 0, the right eye's sky and the analytic sky from unit 1,
+		//the props' atlas from unit 2, a virtual environment's residency from unit 3, and the
+		//lighting's from the units Lighting names
+		program.use();
+		program.setSampler("cubebox", 0);
+		program.setSampler("renderedTexture", 0);
+		program.setSampler("renderedTextures", 0);
+		program.setSampler("cubeboxRight", 1);
+		program.setSampler("skybox", 1);
+		program.setSampler("atlas", 2);
+		program.setSampler("residency", 3);
+		program.setSampler("shadowMap", Lighting::SHADOW_UNIT);
+		program.setSampler("lightCells", Lighting::CELL_UNIT);
+		program.setSampler("lightIndices", Lighting::INDEX_UNIT);
+		glState().useProgram(0);
+	}
+
+	// Gives the sampler the texture: its resident handle when bindless, else bound to the
+	// sampler's unit. The program has to be in use.
+	void bindTexture(const Uniform & sampler, GLuint unit, GLenum target, GLuint texture) const {
+		if (bindless)
+			sampler.setHandle(bindlessTextures().handle(texture));
+		else
+			glState().bindTexture(unit, target, texture);
+	}
+
+	GLuint id() const { return program.id(); }
+	void use() const { program.use(); }
+};
+
+// The ScenePrograms one pair of shader files is compiled to, one for each combination of
+// their ShaderVariants switches asked for. Combinations known up front are begun with the
+// other programs; one first asked for by get() is compiled there and then, once.
+struct SceneVariants {
+	ShaderVariants variants;
+	std::string vert;
+	std::string frag;
+	std::map<ShaderVariants::Key, std::unique_ptr<SceneProgram>> programs;
+	// Set once hot reload is on, variants made after that are watched too
+	ShaderReloader * reloader = nullptr;
+
+	void init(const char * vertFile, const char * fragFile, const ShaderVariants & made) {
+		vert = vertFile;
+		frag = fragFile;
+		variants = made;
+	}
+
+	void begin(ShaderVariants::Key key) {
+		if (programs.count(key))
+			return;
+		std::unique_ptr<SceneProgram> prog(new SceneProgram());
+		prog->begin(vert.c_str(), nullptr, frag.c_str(), variants.defines(key));
+		if (reloader)
+			watch(*prog);
+		programs[key] = std::move(prog);
+	}
+
+	//! Finishes every program begun
+	void finish() {
+		for (auto & entry : programs) {
+			if (!entry.second->program.valid())
+				entry.second->finish();
+		}
+	}
+
+	const SceneProgram & get(ShaderVariants::Key key) {
+		auto found = programs.find(key);
+		if (found != programs.end())
+			return *found->second;
+		logStream(LOG_INFO) << frag << " " << variants.describe(key) << " compiled on first use" << std::endl;
+		pipelineWarmup().noteLazy(frag + " " + variants.describe(key));
+		begin(key);
+		SceneProgram & prog = *programs[key];
+		prog.finish();
+		return prog;
+	}
+
+	void watch(ShaderReloader & with) {
+		reloader = &with;
+		for (auto & entry : programs)
+			watch(*entry.second);
+	}
+
+private:
+	void watch(SceneProgram & prog) {
+		SceneProgram * target = &prog;
+		reloader->watch(prog.program, [target] { target->bindUniforms(); });
+	}
+};
+
 struct ColorCubeScene {
 
 	// Program
@@ -742,551 +2792,3733 @@ struct ColorCubeScene {
 	GLuint instanceCount;
 	oglplus::Buffer instances;
 
-	GLuint shaderProg;
-	GLuint screenShaderProg;
-	GLuint pyrShaderProg;
-	GLuint texture_box;
-	GLuint texture_skybox[2];
-	GLuint texture_biggerskybox;
+	SceneProgram shaderProg;
+	// The wall composite, with analytic sky or without and black for a wall switched off
+	SceneVariants screenVariants;
+	SceneProgram debugLinesProg;
+	SceneProgram wallLayeredProg;
+	SceneVariants screenArrayVariants;
+	// With walls.raycast the array composite is one fullscreen triangle per eye, which finds
+	// the walls itself (wallRaycast.frag), drawn without attributes from an empty VAO
+	bool raycastWalls = false;
+	SceneVariants raycastVariants;
+	GLVertexArray raycastVao;
+	// With walls.merged_composite it is one draw per eye of every wall's quad instead, from
+	// one static buffer of them in world space with each vertex's wall (wallMerged.vert)
+	bool mergedWalls = false;
+	SceneVariants mergedVariants;
+	GLVertexArray mergedWallVao;
+	GLBuffer mergedWallBuffer;
+	// What fills in the wall targets' levels after a pass
+	WallMips wallMips;
+	// With walls.reproject, walls of an eye that has hardly moved are warped from their
+	// last render instead of rendered again
+	WallReprojection wallReprojection;
+	// With walls.temporal, walls are rendered smaller with a jitter and resolved to their
+	// size over the frames. The side each layer is rendered with this frame.
+	WallTemporal wallTemporal;
+	GLsizei wallRenderSizes[MAX_LAYERS];
+	// With walls.cube_capture, the first viewer's layered passes render a cube around each
+	// eye and resample the walls from it
+	WallCubeCapture wallCubeCapture;
+	// video.file plays on the box, or with video.target=sky as the walls' environment: a cube
+	// per eye, filled from the video's frame on the GPU whenever it changes, stands in for
+	// the box's or the sky's texture. videoFrame counts the changes, the walls that show
+	// the video are rendered again on each.
+	enum VideoStereo { VIDEO_MONO, VIDEO_SIDE_BY_SIDE, VIDEO_TOP_BOTTOM };
+	VideoTexture video;
+	GLTexture videoCubes[2];
+	GLsizei videoFaceSize = 0;
+	VideoStereo videoStereo = VIDEO_MONO;
+	bool videoOnSky = false;
+	bool videoCubeLayout = false;
+	uint64_t videoFrame = 0;
+	int videoGpuPass{ gpuTimers().pass("video") };
+	// The wall passes' depth pre-pass, and its depth only programs for the three kinds of pass
+	DepthPrepass depthPrepass;
+	SceneProgram depthProg, depthLayeredProg, depthMultiviewProg;
+	// The ring has to outlive the assets that upload through it
+	UploadRing uploads;
+	AssetRegistry assets;
+	// With skybox.virtual the outer skybox, and with skybox.virtual_walls the walls' sky, is
+	// one environment too big for the GPU whole, paged in by the tiles the draws sample
+	VirtualTexture virtualSky;
+	SceneProgram virtualSkyProg;
+	bool virtualWalls = false;
+	// pointcloud.file, a scan streamed in by what the walls see and drawn in their passes
+	// after the props. pointCloudScale is the model's, for the points' size on screen.
+	PointCloud pointCloud;
+	SceneProgram pointCloudProg;
+	SceneProgram pointCloudMultiviewProg;
+	float pointCloudScale = 1.f;
+	// export.walls, the walls' images handed to the warping and blending tools for the real
+	// screens. exportEyes is 1 for the left eye's walls only, 2 for both.
+	WallExport wallExport;
+	int exportEyes = 0;
+	float pointCloudPointScale = 1.f;
 	
-	unsigned char * imgData; 
 	int imgWidth;
 	int imgHeight;
 
-	Box * box;
-	glm::mat4 boxtransform;
-	float boxScale = 0.2f;
-	Box * skybox;
-	Box * biggerSkyBox;
-
-	Box * x;
-	Box * y;
-	Box * z;
-
-	Quad * leftwall;
-	GLuint leftTextures[2];
-	Quad * rightwall;
-	GLuint rightTextures[2];
-	Quad * floor;
-	GLuint floorTextures[2];
-
-	glm::vec3 leftWallVerts[4];
-	glm::vec3 rightWallVerts[4];
-	glm::vec3 floorVerts[4];
-	glm::vec3 eyePos[2];
-
-	Pyramid * lefteye_wireFrames [3];
-	Pyramid * righteye_wireFrames[3];
-
-	mat4 quadProjections[3];
-	GLuint renderedTextures[6];
-	GLuint fbo;
-	GLuint renderedTexture;
-
-	mat4 posOnly = mat4(1.0f);
-
-	bool B_down = false;
-	bool A_down = false;
-	bool X_down = false;
+	std::unique_ptr<Box> box;
+	// Where the box and the props are: the box first, then propCount props in a row, whose
+	// world matrices are the props' instance buffer and draw list entries as they are
+	EntityStore entities;
+	EntityStore::Entity boxEntity;
+	size_t propCount = 0;
+	// The entities' version() the props' part of them last changed in, and the one uploaded
+	uint64_t propsVersion = 0;
+	uint64_t entitiesSeen = 0;
+	uint64_t propsUploaded = 0;
+	// With props.cull, which wall layers (bit eye * wallCount + wall) can see each prop; only
+	// those get it. With props.bvh too the props are culled through a hierarchy over them
+	// rather than one by one.
+	bool cullProps = false;
+	bool propBvh = false;
+	std::vector<uint32_t> propMasks;
+	EntityBvh propTree;
+	// With props.pick the right controller points at the props: the nearest one its ray hits
+	// within props.pick_distance is found once a frame, through the props' hierarchy unless
+	// props.bvh is off, and both eyes use it. Holding the index trigger on one grabs it, and
+	// it follows the hand until let go. The wireframes show the ray and what it picked.
+	bool pickProps = false;
+	float pickDistance = 10.f;
+	RigidPose pickRay;
+	EntityStore::Entity pickedProp = EntityStore::NONE;
+	float pickedAt = 0.f;
+	EntityStore::Entity grabbedProp = EntityStore::NONE;
+	// The grabbed prop in the hand's frame when it was grabbed
+	RigidPose grabOffset;
+	bool grabHeld = false;
+	// With physics.props the props fall, stack and knock each other over (PropPhysics.h),
+	// stepped with the box. The grabbed prop is held where the hand puts it, and flies off
+	// with the hand's velocity when let go.
+	PropPhysics physics;
+
+	// With skin.active the box is skinned (SkinnedMesh.h): a chain of skin.bones bones up
+	// its height sways, skinned once a frame before the walls, and every pass that draws
+	// the box draws that. skin.mesh skins a model in place of the cube.
+	SkinnedMesh skinnedBox;
+	// With app.pipelined prepareFrame picked and updated the entities for the coming frame
+	// already, and whether the update changed any
+	bool framePrepared = false;
+	bool entitiesPrepared = false;
+	// The props standing around the CAVE, drawn instanced in one call per wall pass
+	std::unique_ptr<Box> props;
+	// What the props are: the cube, or the mesh file props.mesh names, with its bounds
+	// around its origin
+	int propMesh = MeshPool::BOX;
+	vec3 propExtent = vec3(1.f);
+	// With props.lod and a mesh with levels of detail, the level each prop is drawn at by
+	// the draw list, picked from how big it is on the walls that can see it
+	MeshInfo propMeshInfo;
+	LodSelector propLods;
+	bool propLodActive = false;
+	// With props.gpu_cull (and the indirect draw list) a compute pass culls the props per
+	// wall layer instead, and each layer draws what it kept straight from the GPU. The CPU
+	// culling and the levels of detail are off then.
+	GpuCuller propCuller;
+	bool gpuCullProps = false;
+	// With props.occlusion as well, each wall layer's depth pyramid from the last time it was
+	// rendered leaves out the props something nearer hid then, and the ones this frame's
+	// depth no longer hides are drawn after the rest of the scene
+	WallOcclusion wallOcclusion;
+	// With props.atlas (a .p3ta from TexCacheBuilder --atlas) and the draw list, the props
+	// take the atlas's images in turn, so props with different textures still go out in one
+	// draw. propTiles is where each one's is, no image (the box's texture) until its page is in.
+	AtlasArray propAtlas;
+	std::vector<AtlasTile> propTiles;
+	// With scene.snapshot the layout, the box, the props and their atlas entries come from a
+	// compiled snapshot instead of the settings. It stays mapped, the entries are read from it.
+	SceneSnapshot snapshot;
+	// The programs' atlased: 1 for the prop mesh's UVs, 2 for the cube's faces
+	int propAtlasMode = 0;
+	// With props.shading_cache the cube props are shaded once a frame into tiles of their
+	// own, and every view samples those instead of shading the props itself. The draw list
+	// and the culler carry the cache's tiles then, propTiles stays each prop's material.
+	ShadingCache propShading;
+	std::vector<AtlasTile> propShadingTiles;
+	bool propShadingActive = false;
+	// With lighting.enabled the wall passes' objects are lit by a sun and point lights, from
+	// a shadow map and a light grid made once a frame for all of the walls (Lighting). The
+	// scene programs are compiled with LIGHTING then.
+	Lighting lighting;
+	bool lightingOn = false;
+	SceneProgram shadowProg;
+	// With walls.indirect the wall passes' objects are recorded once per frame and drawn
+	// with one multi draw per group
+	enum { DRAW_SCENE, DRAW_SKY, DRAW_GROUPS };
+	DrawList drawList;
+	bool indirectDraws;
+	bool drawListStale = true;
+	mat4 drawListBox;
+	std::unique_ptr<Box> skybox;
+	std::unique_ptr<Box> biggerSkyBox;
+
+	// World axes drawn with the wireframes, this long, 0 for none (debug.axes)
+	float debugAxes;
+
+	// The screens of the CAVE, each drawn as the unit quad moved onto its corners. A pass
+	// draws at most MAX_WALL_LAYERS layers (both eyes of one viewer), every viewer has that
+	// many and the props' cull masks have a bit for each layer of all of them.
+	enum { MAX_WALL_LAYERS = 2 * CaveLayout::MAX_WALLS, MAX_VIEWERS = 4, MAX_LAYERS = MAX_VIEWERS * MAX_WALL_LAYERS,
+		MASK_LAYERS = 32 };
+	CaveLayout cave;
+	int wallCount;
+	std::unique_ptr<Quad> wallQuad;
+	mat4 wallTransforms[CaveLayout::MAX_WALLS];
+	mat4 wallInverseTransforms[CaveLayout::MAX_WALLS];
+	glm::vec3 wallVerts[CaveLayout::MAX_WALLS][4];
+	// Where each view renders the walls from, a view being an eye of a viewer (viewer * 2 + eye)
+	glm::vec3 eyePos[2 * MAX_VIEWERS];
+	// The walls switched off, a bit per eye and wall of a viewer (eye * wallCount + wall), as
+	// a projector that failed would be: no wall pass renders them for any viewer and the
+	// composite shows them black. walls.off sets them, the X button toggles brokenWall's (the
+	// floor, or -1) for the right eye.
+	uint32_t wallsOff = 0;
+	int brokenWall;
+
+	// The off-axis projection through each wall per view (view * wallCount + wall), and the
+	// view the walls are rendered with
+	mat4 wallProjections[MAX_LAYERS];
+	mat4 wallModelviews[2 * MAX_VIEWERS];
+	// Offscreen targets of the wall pass, built once up front
+	RenderTargetCache renderTargets;
+	const RenderTarget * wallTargets[MAX_WALL_LAYERS];
+	// With walls.parallel_record, and the props drawn without the draw list, what each wall
+	// rendered one by one draws of the props is recorded by the workers before the eye's
+	// passes (recordWallCommands) and the passes only replay it. Layers with a bit in
+	// wallCommandsRecorded have a stream for this pass, uniforms by the slots below.
+	enum { SLOT_TRANSFORM, SLOT_INSTANCED, WALL_SLOTS };
+	bool parallelRecord = false;
+	CommandBuffer wallCommands[MAX_WALL_LAYERS];
+	uint32_t wallCommandsRecorded = 0;
+	// The payload the props' instances were last uploaded from, the depth pre-pass and the
+	// pass after it replay the same one
+	const void * recordedPropsUpload = nullptr;
+
+	// The part of its target each wall was drawn into, which the composite scales its
+	// texture coordinates by
+	WallResolution wallResolution;
+	// Projection and view of every draw of the frame, in one uniform buffer
+	CameraUniforms cameras;
+	// The walls and this frame's views, for the wall passes to project with in the vertex
+	// shader (walls.gpu_projection)
+	WallViews wallViews;
+	bool gpuWallProjection = false;
+	// Frames between reports of the GL state tracker's counters, 0 for none
+	int glStateReport;
+	int glStateFrames = 0;
+	vec2 wallUvScale[MAX_LAYERS];
+	mat4 eyeProjections[2];
+
+	// Walls entirely outside an eye's view are neither rendered nor composited for it,
+	// unless a projector shows them (a bit per wall)
+	bool cullWalls;
+	bool wallVisible[MAX_LAYERS];
+	uint32_t projectedWalls = 0;
+	// With walls.partial the first viewer's walls are rendered only where its HMD eyes see
+	// them, with walls.partial_margin_degrees more of the view each way for the head to turn
+	// in. A layer's region is in its wall's clip space (x0, x1, y0, y1): wallRegions what is
+	// rendered now, wallRegionsSeen half the margin, what the last render has to cover.
+	bool partialWalls = false;
+	float partialMargin = 0.f;
+	vec4 wallRegions[MAX_LAYERS];
+	vec4 wallRegionsSeen[MAX_LAYERS];
+
+	// What each wall layer was last rendered with. A pass whose layers would come out the
+	// same keeps last frame's textures.
+	struct WallLayerState {
+		bool valid;
+		mat4 matrix;
+		mat4 boxTransform;
+		uint64_t boxSkin;
+		int skybox;
+		uint64_t videoFrame;
+		uint64_t pointCloud;
+		// wallTextureVersion(), the textures streamed in since
+		uint64_t textures;
+		GLsizei size;
+		// walls.variable's, which the composite maps the wall through
+		WallBands bands;
+		// The part of the wall rendered (walls.partial)
+		vec4 region;
+	};
+	bool incrementalWalls;
+	WallLayerState wallLayerStates[MAX_LAYERS];
+	// Frames that skip re-rendering the walls composite what they last rendered
+	WallSchedule wallSchedule;
+
+	// Single pass wall rendering: per eye, all walls in the layers of one array
+	bool layeredWalls;
+	// The layered programs spread each layer over its bands (walls.variable)
+	bool variableWalls = false;
+	const RenderTarget * eyeWallTargets[2];
+
+	// Stereo wall rendering: both eyes' walls in one array, once per frame, with OVR_multiview
+	// where the driver has it and instancing otherwise
+	bool stereoWalls;
+	bool multiviewWalls;
+	SceneProgram wallMultiviewProg;
+	const RenderTarget * stereoWallTarget;
+	// Only one eye is rendered (mono, left or right only), the stereo pass has its walls alone
+	bool singleView = false;
+
+	// With shaders.hot_reload the scene programs are made again when their files are saved.
+	// After the programs, so it goes first. shaderVersion is its version the walls were
+	// last drawn again for (updateShaders).
+	ShaderReloader shaderReloader;
+	uint64_t shaderVersion = 0;
+	// With cave.layout_reload the layout file is read again when it is saved, and the walls
+	// it gives swapped in at the start of a frame (updateLayout). layoutVersion counts them.
+	LayoutReloader layoutReloader;
+	uint64_t layoutVersion = 0;
+	// What the walls' own targets are made with, for making them again at another size, and
+	// the largest size anything made per wall layer has room for
+	RenderTargetFormat separateWallFormat;
+	GLsizei wallSizeLimit = 0;
+
+	mat4 posOnly[2] = { mat4(1.0f), mat4(1.0f) };
+
+	// With cave.viewers, more viewers than the head (or the controller with viewFromController)
+	// in the CAVE: each one a controller, with its own walls rendered from there into its
+	// own array every frame. The scene update, the props' culling (one pass for all of
+	// them), the draw list and the textures are shared. shownViewer's walls are the ones
+	// composited, mirrored and handed to the compositor; the right thumbstick cycles it.
+	int viewerCount = 1;
+	int viewerHands[MAX_VIEWERS];
+	const RenderTarget * viewerTargets[MAX_VIEWERS];
+	int viewerGpuPasses[MAX_VIEWERS];
+	int shownViewer = 0;
+
+	// Skyboxes are drawn last, at the far plane, so they only shade uncovered pixels
+	bool skyboxLast;
+	// With skybox.mask=stencil the walls mark the eye buffer's stencil and the outer skybox
+	// is tested against that instead of depth
+	bool stencilSky;
+	// The eye buffer comes with what the lenses hide already at the near plane, so the eye's
+	// draws are depth tested to skip it even where they would not need the test otherwise
+	bool lensMasked;
+	// The wall passes render only the box and the composite looks the sky up per pixel
+	bool analyticSky;
+	// With skybox.mono the outer skybox is drawn once a frame for both eyes (FarField.h),
+	// with this view and size, set at the first eye
+	FarField farField;
+	// Off draws the sky per eye again while the far field stays made, for the feature switches
+	bool monoSkyOn = true;
+	float farMargin = 0.1f;
+	float farScale = 1.f;
+	mat4 farProjection;
+	mat4 farView;
+	GLsizei farWidth = 0;
+	GLsizei farHeight = 0;
+	// The left eye's walls handed to the compositor as quad layers instead of composited
+	WallLayers wallLayers;
+
+	// GpuTimers passes: each wall on its own by layer, the layered passes by eye, the stereo
+	// pass, and the eye buffer passes by eye
+	int wallGpuPasses[MAX_WALL_LAYERS];
+	int layeredGpuPasses[2];
+	int stereoGpuPass;
+	int skyboxGpuPass;
+	int propShadingGpuPass;
+	int shadowGpuPass;
+	int compositeGpuPasses[2];
+	int wireframeGpuPasses[2];
+
+	// An eye's passes from the outer skybox to the wireframes, declared again every eye with
+	// what each reads and writes. Passes whose walls show nowhere (the right eye's under the
+	// quad layers, walls switched off) are culled instead of checked for one by one.
+	FrameGraph frameGraph;
+	// The graph's alias classes: the wall passes' depth, and what the walls rendered one by
+	// one share
+	enum { WALL_DEPTH, WALL_SETUP };
+	// What the eye's passes draw into, for the passes to find
+	struct EyeTarget {
+		ovrEyeType eye;
+		GLuint fbo;
+		ovrRecti viewport;
+		mat4 projection;
+		// The view the eye is drawn with, the late one once the composite has asked for it
+		mat4 modelview;
+		const std::function<mat4(ovrEyeType)> * lateModelview;
+	};
+	EyeTarget eyeTarget;
+	// Between the begin and end passes of the walls rendered one by one
+	bool wallPassOpen = false;
+	// The composite's walls, sorted for the fewest program and texture changes
+	DrawQueue compositeQueue;
+
+	// The environment being drawn, and the one being loaded to replace it (or -1)
+	int skyboxActive = 0;
+	int skyboxPending = -1;
+	// Every upload of a frame within one budget, what is drawn already missing it first
+	UploadScheduler uploadScheduler;
+
+	// Where the thumbsticks are, as of the last thumbstick event
+	vec2 thumbsticks[ovrHand_Count] = { vec2(0.f), vec2(0.f) };
+	// The box as the fixed step simulation has it after the last two steps, frames draw it
+	// in between
+	struct BoxState {
+		vec3 position;
+		float scale;
+	};
+	FixedStep simulation;
+	BoxState boxPrevious;
+	BoxState boxCurrent;
 	bool track = true;
+	bool headTracked = true;
+	// The frame shows the panorama only (DISPLAY_PANORAMA)
+	bool panorama = false;
 	bool debug = false;
-	bool broken = false;
 	bool viewFromController = false;
+	// With pose.predict_walls the walls are rendered from where the eyes (or the hand) will
+	// be halfway through the frames they are shown for, not where they are for this one
+	bool predictWalls;
+	PosePredictor headPredictor;
+	PosePredictor handPredictor;
+	RigidPose headNow;
+	// How far past this frame's display time that is, in seconds
+	double wallAhead = 0.0;
 	// For controller input
-	ovrTrackingState trackstate;
 	ovrPosef handPoses[2];
-	ovrInputState inputstate;
 	bool triggerPressed[2] = { false, false };
 
 	// VBOs for the cube's vertices and normals
 	//const unsigned int GRID_SIZE{ 5 };
 
 public:
-	ColorCubeScene() : cube({ "Position", "Normal" }, oglplus::shapes::Cube()) {
-		shaderProg = LoadShaders("shader.vert", "shader.frag");
-		screenShaderProg = LoadShaders("screenShader.vert", "screenShader.frag");
-		pyrShaderProg = LoadShaders("pyrShader.vert", "pyrShader.frag");
-		leftwall = new Quad();
-		rightwall = new Quad();
-		floor = new Quad();
-
-		x = new Box();
-		y = new Box();
-		z = new Box();
-
-		box = new Box();
-		boxtransform = glm::translate(boxtransform, glm::vec3(0.0f, 0.f, -1.f));
-		skybox = new Box();		
-		biggerSkyBox = new Box();
-
-		//Acquire the width, height, and data
-
-		//Load calibration cube textures
-		imgData = loadPPM("../Project3-Assets/vr_test_pattern.ppm", imgWidth, imgHeight);
-		vector<unsigned char*> cubeDataVec(6, imgData);
-		texture_box = box->loadBoxTexture(cubeDataVec, imgWidth, imgHeight);
-
-		//Load skybox textures
-		vector<unsigned char*> skyboxDataVec;
-		skyboxDataVec.push_back(loadPPM("../Project3-Assets/left-ppm/px.ppm", imgWidth, imgHeight));
-		skyboxDataVec.push_back(loadPPM("../Project3-Assets/left-ppm/nx.ppm", imgWidth, imgHeight));
-		skyboxDataVec.push_back(loadPPM("../Project3-Assets/left-ppm/py.ppm", imgWidth, imgHeight));
-		skyboxDataVec.push_back(loadPPM("../Project3-Assets/left-ppm/ny.ppm", imgWidth, imgHeight));
-		skyboxDataVec.push_back(loadPPM("../Project3-Assets/left-ppm/pz.ppm", imgWidth, imgHeight));
-		skyboxDataVec.push_back(loadPPM("../Project3-Assets/left-ppm/nz.ppm", imgWidth, imgHeight));
-		texture_skybox[0] = skybox->loadBoxTexture(skyboxDataVec, imgWidth, imgWidth);
-
-		vector<unsigned char*> skyboxDataVec2;
-		skyboxDataVec2.push_back(loadPPM("../Project3-Assets/right-ppm/px.ppm", imgWidth, imgHeight));
-		skyboxDataVec2.push_back(loadPPM("../Project3-Assets/right-ppm/nx.ppm", imgWidth, imgHeight));
-		skyboxDataVec2.push_back(loadPPM("../Project3-Assets/right-ppm/py.ppm", imgWidth, imgHeight));
-		skyboxDataVec2.push_back(loadPPM("../Project3-Assets/right-ppm/ny.ppm", imgWidth, imgHeight));
-		skyboxDataVec2.push_back(loadPPM("../Project3-Assets/right-ppm/pz.ppm", imgWidth, imgHeight));
-		skyboxDataVec2.push_back(loadPPM("../Project3-Assets/right-ppm/nz.ppm", imgWidth, imgHeight));
-		texture_skybox[1] = skybox->loadBoxTexture(skyboxDataVec2, imgWidth, imgWidth);
-		
-		//Load biggerskybox textures
-		vector<unsigned char*> biggerSkyboxDataVec;
-		biggerSkyboxDataVec.push_back(loadPPM("../Project3-Assets/bsk/SunSetLeft2048.ppm", imgWidth, imgHeight));
-		biggerSkyboxDataVec.push_back(loadPPM("../Project3-Assets/bsk/SunSetRight2048.ppm", imgWidth, imgHeight));
-		biggerSkyboxDataVec.push_back(loadPPM("../Project3-Assets/bsk/SunSetUp2048.ppm", imgWidth, imgHeight));
-		biggerSkyboxDataVec.push_back(loadPPM("../Project3-Assets/bsk/SunSetDown2048.ppm", imgWidth, imgHeight));
-		biggerSkyboxDataVec.push_back(loadPPM("../Project3-Assets/bsk/SunSetFront2048.ppm", imgWidth, imgHeight));
-		biggerSkyboxDataVec.push_back(loadPPM("../Project3-Assets/bsk/SunSetBack2048.ppm", imgWidth, imgHeight));
-		texture_biggerskybox = biggerSkyBox->loadBoxTexture(biggerSkyboxDataVec, imgWidth, imgWidth);
-
-		unsigned char* data = loadPPM("../Project3-Assets/left-ppm/nx.ppm", imgWidth, imgHeight);
-		leftTextures[0] = leftwall->loadQuadTexture(data, imgWidth, imgHeight);
-		data = loadPPM("../Project3-Assets/right-ppm/nx.ppm", imgWidth, imgHeight);
-		leftTextures[1] = leftwall->loadQuadTexture(data, imgWidth, imgHeight);
-
-		data = loadPPM("../Project3-Assets/left-ppm/pz.ppm", imgWidth, imgHeight);
-		rightTextures[0] = rightwall->loadQuadTexture(data, imgWidth, imgHeight);
-		data = loadPPM("../Project3-Assets/right-ppm/pz.ppm", imgWidth, imgHeight);
-		rightTextures[1] = rightwall->loadQuadTexture(data, imgWidth, imgHeight);
-
-		data = loadPPM("../Project3-Assets/left-ppm/ny.ppm", imgWidth, imgHeight);
-		floorTextures[0] = floor->loadQuadTexture(data, imgWidth, imgHeight);
-		data = loadPPM("../Project3-Assets/right-ppm/ny.ppm", imgWidth, imgHeight);
-		floorTextures[1] = floor->loadQuadTexture(data, imgWidth, imgHeight);
-
-
-		//Set up frame buffer
-		glGenFramebuffers(1, &fbo);
-		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-
-		// The texture we're going to render to
-		glGenTextures(1, &renderedTexture);
-
-		// "Bind" the newly created texture : all future texture functions will modify this texture
-		glBindTexture(GL_TEXTURE_2D, renderedTexture);
-
-		// Give an empty image to OpenGL ( the last "0" )
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1024, 1024, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
-
-		// Poor filtering. Needed !
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-		// The depth buffer
-		GLuint depthrenderbuffer;
-		glGenRenderbuffers(1, &depthrenderbuffer);
-		glBindRenderbuffer(GL_RENDERBUFFER, depthrenderbuffer);
-		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, 1024, 1024);
-		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, 
-			GL_RENDERBUFFER, depthrenderbuffer);
-
-		// Set "renderedTexture" as our colour attachement #0
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, renderedTexture, 0);
-
-		// Set the list of draw buffers.
-		GLenum DrawBuffers[1] = { GL_COLOR_ATTACHMENT0 };
-		glDrawBuffers(1, DrawBuffers); // "1" is the size of DrawBuffers
+	//! eyeFaceTexels is what eyeFaceTexels() of the app says, 0 without an eye buffer
+	ColorCubeScene(float eyeFaceTexels = 0.f) : cube({ "Position", "Normal" }, oglplus::shapes::Cube()), assets(jobs(), &uploads) {
+		//Samplers are compiled for handles or units, so this comes before the programs
+		bindlessTextures().enable(config().getBool("textures.bindless", false));
+		//Lighting is compiled into the programs that draw the wall passes' objects
+		lightingOn = config().getBool("lighting.enabled", false);
+		std::string lightingDefines = lightingOn ? Lighting::shaderDefines() : "";
+		//Every program is handed to the driver first and only asked about once all of them
+		//are, so they compile together, and alongside the setup in between
+		shaderProg.begin("shader.vert", nullptr, "shader.frag", lightingDefines);
+		if (lightingOn)
+			shadowProg.begin("shadow.vert", nullptr, "depthOnly.frag");
+		ShaderVariants compositeSwitches({ "ANALYTIC_SKY", "BROKEN" });
+		screenVariants.init("screenShader.vert", "screenShader.frag", compositeSwitches);
+		beginComposite(screenVariants);
+		debugLinesProg.begin("debugLines.vert", nullptr, "debugLines.frag");
+		cameras.init();
+		glStateReport = config().getInt("gl.state_report", 0);
+		//scene.snapshot (from scene.write_snapshot) is the whole scene as it was set up, taken
+		//as it is instead of placed again
+		std::string snapshotFile = config().getString("scene.snapshot");
+		if (!snapshotFile.empty() && !mapSceneSnapshot(snapshotFile.c_str(), snapshot))
+			std::cerr << "scene.snapshot: " << snapshotFile << " not loaded, setting the scene up from its settings" << std::endl;
+		//The CAVE's screens, the original three unless cave.layout names a layout file
+		std::string layoutFile = config().getString("cave.layout");
+		if (snapshot.header) {
+			std::vector<CaveWallSpec> snapshotWalls;
+			sceneSnapshotWalls(snapshot, snapshotWalls);
+			cave.setWalls(snapshotWalls.data(), snapshotWalls.size());
+		}
+		else if (!layoutFile.empty())
+			cave.load(layoutFile.c_str());
+		wallCount = (int)cave.size();
+		//cave.layout_reload watches the file every cave.layout_reload_ms while running
+		if (!snapshot.header && !layoutFile.empty() && config().getBool("cave.layout_reload", false))
+			layoutReloader.configure(layoutFile, cave.size(), config().getInt("cave.layout_reload_ms", 500));
+		brokenWall = cave.find("floor");
+		setupWallsOff(config().getString("walls.off"));
+		//cave.kernel picks the wall projection math, a kernel that disagrees with the scalar
+		//one is not used
+		CaveLayout::setKernel(CaveLayout::parseKernel(config().getString("cave.kernel", "auto")));
+		if (cave.kernelError(CaveLayout::kernel()) > 1e-4f) {
+			std::cerr << "the " << CaveLayout::kernelName(CaveLayout::kernel())
+				<< " wall projections do not match the scalar ones, using those" << std::endl;
+			CaveLayout::setKernel(CaveLayout::KERNEL_SCALAR);
+		}
+		//Meshes go into the pool before the first Quad or Box builds it
+		loadPropMesh(snapshot.header ? snapshot.mesh : config().getString("props.mesh"));
+		setupSkin(config().getString("skin.mesh"));
+		wallQuad.reset(new Quad());
+		setupWallGeometry();
+		for (int i = 0; i < MAX_LAYERS; i++)
+			wallUvScale[i] = vec2(1.f);
+
+		layeredWalls = config().getBool("walls.layered", true);
+		//A stereo pass has both eyes' walls in one, split eyes render them on different GPUs
+		stereoWalls = layeredWalls && config().getBool("walls.stereo", true) && !gpuMulticast().active();
+		multiviewWalls = stereoWalls && config().getBool("walls.multiview", true) && supportsMultiview(2 * wallCount);
+		//walls.variable spreads the layered pass's triangles over the bands of its layers in
+		//the geometry stage, which a multiview pass does not have, and the point cloud's
+		//points do not go through
+		variableWalls = layeredWalls && !multiviewWalls && config().getBool("walls.variable", false);
+		if (variableWalls && !config().getString("pointcloud.file").empty()) {
+			std::cerr << "walls.variable does not draw pointcloud.file, rendering the walls at one resolution" << std::endl;
+			variableWalls = false;
+		}
+		std::string variableDefines = variableWalls ? "#define VARIABLE_RESOLUTION\n" : "";
+		//walls.gpu_projection has the wall passes work out each layer's projection from the
+		//eye instead of reading a matrix, which has no room for walls.temporal's jitter
+		gpuWallProjection = layeredWalls && config().getBool("walls.gpu_projection", false) && !config().getBool("walls.temporal", false);
+		std::string wallViewsDefines = gpuWallProjection ? "#define WALL_VIEWS\n" : "";
+		if (gpuWallProjection)
+			wallViews.init();
+		//walls.depth_prepass is off, on, or auto to go by the overdraw measured
+		DepthPrepass::Mode prepassMode = DepthPrepass::OFF;
+		if (!DepthPrepass::parseMode(config().getString("walls.depth_prepass", "off"), prepassMode))
+			std::cerr << "walls.depth_prepass is off, on or auto, leaving it off" << std::endl;
+		if (prepassMode != DepthPrepass::OFF) {
+			depthProg.begin("shader.vert", nullptr, "depthOnly.frag");
+			if (layeredWalls)
+				depthLayeredProg.begin("wallLayered.vert", "wallLayered.geom", "depthOnly.frag", wallViewsDefines + variableDefines);
+		}
+		if (layeredWalls) {
+			wallLayeredProg.begin("wallLayered.vert", "wallLayered.geom", "wallLayered.frag", lightingDefines + wallViewsDefines + variableDefines);
+			ShaderVariants arraySwitches = compositeSwitches;
+			arraySwitches.declare(WallResolution::shaderDefines());
+			screenArrayVariants.init("screenShader.vert", "screenShaderArray.frag", arraySwitches);
+			raycastWalls = config().getBool("walls.raycast", false);
+			if (!raycastWalls)
+				beginComposite(screenArrayVariants);
+		}
+		//The wall shaders that sample through the bands, with analytic sky or without
+		ShaderVariants skySwitch({ "ANALYTIC_SKY" });
+		skySwitch.declare(WallResolution::shaderDefines());
+		if (raycastWalls) {
+			raycastVariants.init("wallRaycast.vert", "wallRaycast.frag", skySwitch);
+			raycastVariants.begin(raycastVariants.variants.with(0, "ANALYTIC_SKY", config().getBool("walls.analytic_sky", false)));
+			raycastVao.create();
+		}
+		else if (layeredWalls && config().getBool("walls.merged_composite", false)) {
+			mergedWalls = true;
+			mergedVariants.init("wallMerged.vert", "wallMerged.frag", skySwitch);
+			mergedVariants.begin(mergedVariants.variants.with(0, "ANALYTIC_SKY", config().getBool("walls.analytic_sky", false)));
+			setupMergedWalls();
+		}
+		if (multiviewWalls) {
+			//The view count is part of the shader, so it is compiled for this layout
+			ShaderVariants multiview;
+			multiview.constant("VIEWS", 2 * wallCount);
+			multiview.constant("WALLS", wallCount);
+			wallMultiviewProg.begin("wallMultiview.vert", nullptr, "wallLayered.frag", multiview.defines(0) + lightingDefines + wallViewsDefines);
+			if (prepassMode != DepthPrepass::OFF)
+				depthMultiviewProg.begin("wallMultiview.vert", nullptr, "depthOnly.frag", multiview.defines(0) + wallViewsDefines);
+		}
+		shaderProg.finish();
+		if (lightingOn)
+			shadowProg.finish();
+		screenVariants.finish();
+		debugLinesProg.finish();
+		if (layeredWalls) {
+			wallLayeredProg.finish();
+			screenArrayVariants.finish();
+		}
+		raycastVariants.finish();
+		mergedVariants.finish();
+		if (multiviewWalls)
+			wallMultiviewProg.finish();
+		if (prepassMode != DepthPrepass::OFF) {
+			depthProg.finish();
+			if (layeredWalls)
+				depthLayeredProg.finish();
+			if (multiviewWalls)
+				depthMultiviewProg.finish();
+		}
+		//Overdraw (shaded fragments per wall pixel) above walls.prepass_overdraw turns it on
+		//in auto, under three quarters of it off again
+		float prepassOverdraw = config().getFloat("walls.prepass_overdraw", 2.f);
+		depthPrepass.init(prepassMode, prepassOverdraw, 0.75f * prepassOverdraw, config().getInt("walls.prepass_probe", 120));
+		setupShaderReload();
+
+		debugAxes = config().getFloat("debug.axes", 0.f);
+
+		box.reset(new Box());
+		if (snapshot.header)
+			boxEntity = entities.create(snapshot.header->entityCount, snapshot.positions, snapshot.rotations, snapshot.scales,
+				snapshot.extents);
+		else
+			boxEntity = entities.create(vec3(0.f, 0.f, -1.f), glm::quat(), vec3(BOX_SCALE));
+		boxCurrent.position = entities.position(boxEntity);
+		boxCurrent.scale = entities.scale(boxEntity).x;
+		boxPrevious = boxCurrent;
+		simulation.configure();
+		skybox.reset(new Box());
+		if (snapshot.header)
+			initProps(snapshot.header->entityCount - 1);
+		else
+			setupProps(config().getInt("props.count", 0));
+		pickProps = propCount && config().getBool("props.pick", true);
+		pickDistance = config().getFloat("props.pick_distance", 10.f);
+		std::string propAtlasFile = !propCount ? std::string() : snapshot.header ? snapshot.atlas : config().getString("props.atlas");
+		bool propShadingWanted = propCount && config().getBool("props.shading_cache", false);
+		indirectDraws = config().getBool("walls.indirect", true) && drawList.init(DRAW_GROUPS, !propAtlasFile.empty() || propShadingWanted);
+		setupPropAtlas(propAtlasFile);
+		if (lightingOn)
+			setupLighting();
+		if (propShadingWanted)
+			setupPropShading(config().getInt("props.shading_cache_face", 32));
+		biggerSkyBox.reset(new Box());
+
+		//Uploads are staged through a persistently mapped unpack buffer when the driver has one,
+		//sized to hold two full resolution faces in flight.
+		uploads.init(32 * 1024 * 1024);
+
+		//textures.pixel_kernel picks the SIMD of the pixel conversions, textures.rgb_upload
+		//(rgba or bgra) expands RGB levels on the CPU before they go to the driver
+		setPixelKernel(parsePixelKernel(config().getString("textures.pixel_kernel", "auto")));
+		std::string rgbUpload = config().getString("textures.rgb_upload", "as_is");
+		if (rgbUpload == "rgba")
+			setRGBUploadLayout(RGB_UPLOAD_RGBA);
+		else if (rgbUpload == "bgra")
+			setRGBUploadLayout(RGB_UPLOAD_BGRA);
+		else if (rgbUpload != "as_is")
+			std::cerr << "textures.rgb_upload is as_is, rgba or bgra, uploading RGB as it is" << std::endl;
+		//Start loading what the first frame draws. Everything else in the manifest is only
+		//loaded if something draws it.
+		assets.declare(sceneTextures, sizeof(sceneTextures) / sizeof(sceneTextures[0]));
+		//The wall targets' sizes, which the environments drawn into them are loaded for
+		wallResolution.configure(cave);
+		limitTextureSizes(eyeFaceTexels);
+		//textures.progressive streams cached textures in from their smallest mips, so the
+		//environments show blurry on the first frame instead of holding it up
+		assets.setProgressive(config().getBool("textures.progressive", false));
+		skyboxActive = std::max(findSkyboxSet(snapshot.header && *snapshot.skybox ? snapshot.skybox
+			: config().getString("skybox", "sunset").c_str()), 0);
+		//The first frame draws these
+		assets.prefetch("calibration_cube", AssetLoader::VISIBLE);
+		assets.prefetch(skyboxSets[skyboxActive].eyes[0], AssetLoader::VISIBLE);
+		assets.prefetch(skyboxSets[skyboxActive].eyes[1], AssetLoader::VISIBLE);
+		assets.prefetch(skyboxSets[skyboxActive].outer, AssetLoader::VISIBLE);
+		std::string writeSnapshotFile = config().getString("scene.write_snapshot");
+		if (!writeSnapshotFile.empty())
+			writeSnapshot(writeSnapshotFile, propAtlasFile);
+
+		//Textures requested at runtime, the sky's tiles, the atlas's pages and the video's
+		//frames are uploaded at most upload.budget_kb between them per frame
+		uploadScheduler.configure();
+		//textures.budget_mb keeps the environments and other textures under it, the least
+		//recently used are evicted and streamed in again when asked for (0 for no limit)
+		assets.setBudget((uint64_t)std::max(config().getInt("textures.budget_mb", 0), 0) * 1024 * 1024);
+		//skybox.virtual pages a huge environment in by what is drawn of it, in place of the
+		//skybox sets' outer cube
+		setupVirtualSky(config().getString("skybox.virtual"));
+
+		//Wall targets, one framebuffer per wall and eye. With walls.mip_levels over 1 they
+		//get that many levels, made after every wall pass, and are sampled with up to
+		//walls.anisotropy
+		RenderTargetFormat wallFormat = wallTargetFormat();
+		if (wallFormat.levels > 1) {
+			renderTargets.setAnisotropy(config().getFloat("walls.anisotropy", 8.f));
+			wallMips.init(wallFormat.color);
+		}
+		//Every pass clears depth first and nothing reads it after, so with walls.shared_depth
+		//the targets of a kind draw on one depth buffer between them
+		bool sharedDepth = config().getBool("walls.shared_depth", true);
+		RenderTargetFormat wallsFormat = wallFormat;
+		RenderTargetFormat stereoFormat = wallFormat;
+		if (sharedDepth) {
+			wallFormat.sharedDepth = "wall";
+			wallsFormat.sharedDepth = "walls";
+			stereoFormat.sharedDepth = "walls_stereo";
+		}
+		separateWallFormat = wallFormat;
+		wallSizeLimit = wallResolution.maxBase();
+		for (int i = 0; i < 2 * wallCount; i++) {
+			GLsizei size = wallResolution.base(i % wallCount);
+			wallTargets[i] = renderTargets.acquire("wall" + std::to_string(i), size, size, 0, false, wallFormat);
+			if (!wallTargets[i]) {
+				FAIL("Could not create the CAVE wall render targets");
+			}
+		}
 
-		glBindTexture(GL_TEXTURE_2D, 0);
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		//Layered targets: one array per eye, a layer per wall
+		if (layeredWalls) {
+			for (int eye = 0; eye < 2; eye++) {
+				eyeWallTargets[eye] = renderTargets.acquire(eye ? "walls_right" : "walls_left",
+					wallResolution.maxBase(), wallResolution.maxBase(), wallCount, false, wallsFormat);
+				if (!eyeWallTargets[eye]) {
+					std::cerr << "layered wall targets unavailable, rendering walls one at a time" << std::endl;
+					layeredWalls = false;
+					stereoWalls = false;
+					multiviewWalls = false;
+				}
+			}
+		}
 
-		for (int i = 0; i < 6; i++) {
-			glGenTextures(1, &renderedTextures[i]);
-			glBindTexture(GL_TEXTURE_2D, renderedTextures[i]);
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1024, 1024, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
+		if (multiviewWalls && wallFormat.samples > 1)
+			std::cerr << "walls.msaa: the multiview wall target is drawn single sampled" << std::endl;
+		//Stereo target: a layer per wall and eye, left eye walls first
+		if (stereoWalls) {
+			stereoWallTarget = renderTargets.acquire("walls_stereo",
+				wallResolution.maxBase(), wallResolution.maxBase(), 2 * wallCount, multiviewWalls, stereoFormat);
+			if (!stereoWallTarget) {
+				std::cerr << "stereo wall target unavailable, rendering walls per eye" << std::endl;
+				stereoWalls = false;
+				multiviewWalls = false;
+			}
+		}
+		setupViewers(stereoFormat);
+		wallResolution.setPassesPerFrame((stereoWalls ? 1 : 2) + viewerCount - 1);
+		if (wallResolution.variable() && (!layeredWalls || multiviewWalls)) {
+			std::cerr << "walls.variable needs the layered wall pass without multiview, every wall at one density" << std::endl;
+			wallResolution.disableVariable();
+		}
 
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-			glBindTexture(GL_TEXTURE_2D, 0);
+		//A multiview pass cannot draw a different list per view, it keeps the CPU culled one
+		if (propCount && indirectDraws && !multiviewWalls && config().getBool("props.gpu_cull", false))
+			setupGpuCulling(wallFormat.samples);
+
+		for (int eye = 0; eye < 2; eye++) {
+			std::string side = eye ? "right" : "left";
+			for (int i = 0; i < wallCount; i++)
+				wallGpuPasses[layerIndex(eye, i)] = gpuTimers().pass("wall " + side + " " + cave.wall(i).name);
+			layeredGpuPasses[eye] = gpuTimers().pass("walls " + side);
+			compositeGpuPasses[eye] = gpuTimers().pass("composite " + side);
+			wireframeGpuPasses[eye] = gpuTimers().pass("wireframes " + side);
+		}
+		stereoGpuPass = gpuTimers().pass("walls stereo");
+		skyboxGpuPass = gpuTimers().pass("skybox");
+		propShadingGpuPass = gpuTimers().pass("prop shading");
+		shadowGpuPass = gpuTimers().pass("shadows");
+
+		cullWalls = config().getBool("walls.cull", true);
+		incrementalWalls = config().getBool("walls.incremental", true);
+		wallSchedule.configure(wallCount);
+		//walls.temporal renders walls.temporal_scale of each wall's side and resolves the rest
+		//from the frames before, keeping walls.temporal_feedback of them. Its resolve and
+		//walls.reproject's warp take the walls to be drawn at one density.
+		if (config().getBool("walls.temporal", false) && wallResolution.variable())
+			std::cerr << "walls.temporal does not work with walls.variable, rendering every wall whole" << std::endl;
+		else if (config().getBool("walls.temporal", false))
+			wallTemporal.init(2 * wallCount, wallResolution.maxBase(), wallFormat.color, config().getFloat("walls.temporal_scale", 0.7f),
+				config().getFloat("walls.temporal_feedback", 0.9f));
+		//walls.reproject keeps every wall's depth and warps it for eye moves under
+		//walls.reproject_mm, rendering again at least every walls.reproject_frames. A
+		//multiview pass renders every layer at one size, which the warps do not follow.
+		if (config().getBool("walls.reproject", false)) {
+			if (multiviewWalls)
+				std::cerr << "walls.reproject does not work with multiview walls, rendering every wall" << std::endl;
+			else if (wallTemporal.valid() || wallResolution.variable())
+				std::cerr << "walls.reproject does not work with walls.temporal or walls.variable, rendering every wall" << std::endl;
+			else
+				wallReprojection.init(2 * wallCount, wallResolution.maxBase(), wallFormat.color,
+					config().getFloat("walls.reproject_mm", 5.f) / 1000.f, std::max(config().getInt("walls.reproject_frames", 30), 1),
+					config().getInt("walls.reproject_step", 2));
+		}
+		setupCubeCapture(wallFormat.color);
+		setupWallExport(wallFormat.color);
+		//walls.partial: what keeps a wall from one frame to the next, or shows more of it than
+		//the HMD does, needs it whole
+		if (config().getBool("walls.partial", false)) {
+			if (multiviewWalls || variableWalls || raycastWalls || mergedWalls || wallTemporal.valid() || wallReprojection.valid()
+					|| wallCubeCapture.valid() || wallExport.valid())
+				std::cerr << "walls.partial does not work with multiview walls, walls.variable, walls.raycast, walls.merged_composite, "
+					"walls.temporal, walls.reproject, walls.cube_capture or export.walls, rendering every wall whole" << std::endl;
+			else {
+				partialWalls = true;
+				partialMargin = glm::radians(std::max(config().getFloat("walls.partial_margin_degrees", 10.f), 0.f));
+			}
+		}
+		setupVideo();
+		setupPointCloud();
+		predictWalls = config().getBool("pose.predict_walls", true);
+		bool filterPoses = config().getBool("pose.filter", false);
+		for (PosePredictor * predictor : { &headPredictor, &handPredictor }) {
+			predictor->setMaxPrediction(config().getFloat("pose.max_prediction_ms", 50.f) / 1000.0);
+			predictor->setFilter(filterPoses, config().getFloat("pose.filter_min_cutoff", 1.5f),
+				config().getFloat("pose.filter_beta", 0.5f), config().getFloat("pose.filter_dcutoff", 1.0f));
+		}
+		skyboxLast = config().getBool("skybox.last", true);
+		stencilSky = eyeBufferStencil();
+		lensMasked = eyeLensMask();
+		analyticSky = config().getBool("walls.analytic_sky", false);
+		//skybox.mono draws the outer skybox once for both eyes if it is at least
+		//skybox.mono_distance meters away, over skybox.mono_margin more of the view than the
+		//eyes' so the head can turn before they composite it, at skybox.mono_scale of their
+		//pixel density
+		if (config().getBool("skybox.mono", false)) {
+			if (OUTER_SKYBOX_SIZE < config().getFloat("skybox.mono_distance", 10.f))
+				std::cerr << "skybox.mono: the outer skybox is nearer than skybox.mono_distance, drawing it per eye" << std::endl;
+			else if (!farField.init(GL_RGBA8))
+				std::cerr << "skybox.mono: drawing the outer skybox per eye" << std::endl;
+			farMargin = std::max(config().getFloat("skybox.mono_margin", 0.1f), 0.f);
+			farScale = std::min(std::max(config().getFloat("skybox.mono_scale", 1.f), 0.25f), 1.f);
+		}
+		for (int layer = 0; layer < MAX_LAYERS; layer++) {
+			wallVisible[layer] = true;
+			wallLayerStates[layer].valid = false;
+			wallLayerStates[layer].bands = WallResolution::uniformBands(1);
+			wallLayerStates[layer].region = wallRegions[layer] = wallRegionsSeen[layer] = wholeWall();
+			wallRenderSizes[layer] = 0;
 		}
 
 		glLineWidth(2.f);
+		registerFeatures();
+	}
+
+	// What can be switched while running (FeatureToggles.h): what is read every frame and
+	// needs nothing made for it, and what was made at startup
+	void registerFeatures() {
+		featureToggles().add("walls.cull", &cullWalls);
+		featureToggles().add("walls.incremental", &incrementalWalls);
+		featureToggles().add("pose.predict_walls", &predictWalls);
+		if (farField.valid())
+			featureToggles().add("skybox.mono", &monoSkyOn);
+		//Without culling the props draw from the whole set, which the next updateEntities
+		//has to upload again
+		if (cullProps) {
+			featureToggles().add("props.cull", &cullProps, [this]() {
+				propsUploaded = ~(uint64_t)0;
+				drawListStale = true;
+			});
+			featureToggles().add("walls.parallel_record", &parallelRecord);
+		}
+	}
+
+	// Needs the session's swap chains, so RiftApp turns it on once the scene is made
+	void enableWallLayers(ovrSession session, bool highQuality) {
+		if (analyticSky) {
+			std::cerr << "wall quad layers cannot look the sky up per pixel, compositing the walls" << std::endl;
+			return;
+		}
+		if (wallResolution.variable()) {
+			std::cerr << "wall quad layers cannot map walls.variable's bands, compositing the walls" << std::endl;
+			return;
+		}
+		if (wallLayers.init(session, wallCount, wallResolution.maxBase(), highQuality) && !stereoWalls)
+			wallResolution.setPassesPerFrame(1);
+		//The compositor shows the whole layer, wherever the head turns by then
+		if (wallLayers.active())
+			partialWalls = false;
 	}
 
-	void render(const mat4 & projection, const mat4 & modelview, ovrSession session, ovrEyeType eye, int displayMode, GLuint hmd_fbo, ovrLayerEyeFov _sceneLayer, uvec2 windowSize) {
-		checkInput(session, track, B_down, A_down, debug);
+	// The outer skybox is drawn around both eyes every frame, before the CAVE or (skyboxLast)
+	// into whatever it left, so nothing of the eye buffer's last frame shows. Where the lens
+	// mask keeps it out nothing is seen.
+	bool coversEyeBuffer() const {
+		return true;
+	}
+
+	// The app renders one eye only (RiftApp's view modes other than stereo), which then
+	// starts and ends the frame on its own
+	void setSingleView(bool single) {
+		singleView = single;
+	}
+
+	// Whether the head's position is tracked (RiftApp's tracking modes), the CAVE's viewer
+	// stays where it is while it is not
+	void setHeadTracked(bool tracked) {
+		headTracked = tracked;
+	}
+
+	bool textureResidency(uint64_t & resident, uint64_t & budget, size_t & evictions) const {
+		if (!assets.budgetBytes())
+			return false;
+		resident = assets.residentBytes();
+		budget = assets.budgetBytes();
+		evictions = assets.evictions();
+		return true;
+	}
+
+	int wallLayerHeaders(const ovrLayerHeader ** out, int max) const {
+		//The panorama has no walls to show
+		return panorama ? 0 : wallLayers.headers(out, max);
+	}
+
+	// The stereo wall pass needs the right eye's projection before that eye is rendered
+	void setEyeProjections(const mat4 & left, const mat4 & right) {
+		eyeProjections[0] = left;
+		eyeProjections[1] = right;
+	}
+
+	// The meshes and GL objects go with their handles, the textures with the asset registry.
+	// The pool gives back the meshes this scene loaded into it, the next scene loads its own.
+	~ColorCubeScene() {
+		physics.report(logStream(LOG_INFO));
+		skinnedBox.report(logStream(LOG_INFO));
+		uploadScheduler.report(logStream(LOG_INFO));
+		assets.report(logStream(LOG_INFO));
+		pointCloud.report(logStream(LOG_INFO));
+		pointCloud.release();
+		wallExport.report(logStream(LOG_INFO));
+		wallExport.close();
+		pipelineWarmup().report(logStream(LOG_INFO));
+		pipelineWarmup().release();
+		featureToggles().clear();
+		for (GLTexture & cube : videoCubes)
+			if (cube)
+				gpuMemory().release(GpuMemory::KIND_TEXTURE, cube);
+		meshPool().reset();
+		//Deleted names come back for the next scene's objects
+		glState().invalidate();
+	}
+
+	//! The coming frame's pick and entity update with app.pipelined, on a worker while the GPU
+	// is still on the frame before. render() only brings up to date what its input changes.
+	// @input predicted The hands where they are predicted at that frame's display
+	void prepareFrame(const FrameState & predicted) {
+		pickProp(predicted);
+		entitiesPrepared = entities.update(&jobs()) || entitiesPrepared;
+		if ((cullProps || pickProps) && propBvh)
+			propTree.update(entities, 1, propCount);
+		framePrepared = true;
+	}
+
+	//! Renders one eye: the wall passes, then the CAVE composited into the eye buffer.
+	// @input lateModelview Empty, or gives the eye's view again right before the composite.
+	// The walls keep the view they were rendered with either way.
+	void render(const RenderContext & context, const std::function<mat4(ovrEyeType)> & lateModelview) {
+		const mat4 & projection = context.projection;
+		const mat4 & modelview = context.view;
+		const FrameState & state = *context.frame;
+		const ovrLayerEyeFov & _sceneLayer = *context.layer;
+		ovrEyeType eye = context.eye;
+		//A single view's one eye is both the first and the last of the frame
+		bool firstEye = eye == ovrEye_Left || singleView;
+		bool lastEye = eye == ovrEye_Right || singleView;
+		//Both eyes of a frame draw the same environment and react to the same input. What
+		//this renders the eyes share, with split eyes every GPU renders it.
+		if (firstEye) {
+			SharedGpuScope shared;
+			{
+				CpuScope scope("checkInput");
+				checkInput(state);
+			}
+			if (!framePrepared)
+				pickProp(state);
+			framePrepared = false;
+			updateEntities();
+			if (qualityGovernor().active())
+				applyQuality();
+			wallSchedule.beginFrame(state.gpuTime, state.frameBudget);
+			uploadScheduler.beginFrame(state.gpuTime, state.frameBudget, state.displayTime);
+			wallTemporal.beginFrame();
+			wallCubeCapture.beginFrame();
+			depthPrepass.beginFrame();
+			serviceUploads(state.displayTime);
+			updateShaders();
+			updateLayout();
+			updateLighting();
+			shadeProps();
+			updateSkyboxSwap();
+			//Once for every pass of the frame that draws the box
+			skinnedBox.update(state.displayTime);
+			headPredictor.update(state.tracking.HeadPose);
+			handPredictor.update(state.tracking.HandPoses[ovrHand_Right]);
+			headNow = ovr::toPose(state.tracking.HeadPose.ThePose);
+			//The tracking state is for this frame's display time already. A replayed one keeps
+			//its recorded times, so the prediction goes from those rather than the clock.
+			wallAhead = (wallSchedule.interval() - 1) * 0.5 * state.frameBudget;
+		}
+		//Uploads and RiftApp bind behind the tracker's back
+		glState().invalidate();
+		if (firstEye)
+			drawListStale = true;
 
 		//Check controller input
 		// Position + Orientation
-		double displayMidpointSeconds = ovr_GetPredictedDisplayTime(session, 0);
-		trackstate = ovr_GetTrackingState(session, displayMidpointSeconds, ovrTrue);
-
-		//handPoses[LEFT] = trackstate.HandPoses[ovrHand_Left].ThePose;
-		handPoses[RIGHT] = trackstate.HandPoses[ovrHand_Right].ThePose;
+		handPoses[LEFT] = state.tracking.HandPoses[ovrHand_Left].ThePose;
+		handPoses[RIGHT] = state.tracking.HandPoses[ovrHand_Right].ThePose;
 
 
 		// T R I G G E R E D
 		// finger triggers
-		if (OVR_SUCCESS(ovr_GetInputState(session, ovrControllerType_Touch, &inputstate))) {
-			//triggerPressed[LEFT] = inputstate.HandTrigger[ovrHand_Left] > 0.5f;
-			triggerPressed[RIGHT] = inputstate.HandTrigger[ovrHand_Right] > 0.5f;
+		if (state.inputValid) {
+			//triggerPressed[LEFT] = state.input.HandTrigger[ovrHand_Left] > 0.5f;
+			triggerPressed[RIGHT] = state.input.HandTrigger[ovrHand_Right] > 0.5f;
 		}
 
 		viewFromController = triggerPressed[RIGHT];
 
-		glUseProgram(shaderProg);
-
-		//Draw CAVE
-		GLuint uProjection = glGetUniformLocation(shaderProg, "projection");
-		GLuint uModelview = glGetUniformLocation(shaderProg, "modelview");
-		GLuint uTransform = glGetUniformLocation(shaderProg, "transform");
-		GLuint uColor = glGetUniformLocation(shaderProg, "incolor");
+		//The eye's camera, until the wall pass binds the walls'
+		if (firstEye) {
+			cameras.beginFrame();
+			wallViews.beginFrame();
+		}
+		cameras.setEye(eye, projection, modelview);
+		cameras.bindEye(eye);
+
+		//Panorama only skips the CAVE altogether
+		panorama = context.displayMode == DISPLAY_PANORAMA;
+		if (panorama) {
+			renderPanorama(modelview, eye, context.fbo, _sceneLayer);
+			glState().bindVertexArray(0);
+			if (lastEye)
+				reportGLState();
+			return;
+		}
 
-		glUniformMatrix4fv(uProjection, 1, GL_FALSE, (&projection[0][0]));
-		glUniformMatrix4fv(uModelview, 1, GL_FALSE, &modelview[0][0]);
+		shaderProg.use();
 
-		glm::mat4 bskTransform = glm::scale(glm::mat4(1.0f), glm::vec3(20.0f));
-		glUniformMatrix4fv(uTransform, 1, GL_FALSE, &(bskTransform[0][0]));
-		biggerSkyBox->draw(shaderProg, texture_biggerskybox);
+		//Draw CAVE
+		eyeTarget.eye = eye;
+		eyeTarget.fbo = context.fbo;
+		eyeTarget.viewport = context.viewport();
+		eyeTarget.projection = projection;
+		eyeTarget.modelview = modelview;
+		eyeTarget.lateModelview = &lateModelview;
 
 		
 		
-		if (viewFromController) {
-			glm::mat4 mv = ovr::toGlm(handPoses[RIGHT]);
-			mv = glm::inverse(mv);
-			glUniformMatrix4fv(uModelview, 1, GL_FALSE, &(mv[0][0]));
-		}
-		else {
-			if (track)
-				posOnly[3] = modelview[3];
-			glUniformMatrix4fv(uModelview, 1, GL_FALSE, &(posOnly[0][0]));
-		}		
-		
 
-		//---------------Coordinate axes---------------//
-		/*glm::mat4 transform;
-		glm::vec3 color;
-
-		color = vec3(1, 0, 0);
-		transform = glm::scale(mat4(1.f), vec3(10, 0.0005f, 0.0005f));
-		glUniformMatrix4fv(uTransform, 1, GL_FALSE, &(transform[0][0]));
-		glUniform3fv(uColor, 1, &(color[0]));
-		x->draw(shaderProg);
-		color = vec3(0, 1, 0);
-		transform = glm::scale(mat4(1.f), vec3(0.0005f, 10, 0.0005f));
-		glUniformMatrix4fv(uTransform, 1, GL_FALSE, &(transform[0][0]));
-		glUniform3fv(uColor, 1, &(color[0]));
-		y->draw(shaderProg);
-		color = vec3(0, 0, 1);
-		transform = glm::scale(mat4(1.f), vec3(0.0005f, 0.0005f, 10));
-		glUniformMatrix4fv(uTransform, 1, GL_FALSE, &(transform[0][0]));
-		glUniform3fv(uColor, 1, &(color[0]));
-		z->draw(shaderProg);*/
-		//-----------------END AXES--------------------//
-
-
-		//-----------------MATHEMATICS-----------------//
-		glm::mat4 leftTransform;
-		leftTransform = glm::rotate((float)glm::radians(45.f), glm::vec3(0, 1, 0));
-		leftTransform = glm::scale(leftTransform, vec3(1.2f));
-		leftTransform = glm::translate(leftTransform, vec3(-0.f, 0, -1));
-
-		glm::mat4 rightTransform;
-		rightTransform = glm::rotate((float)glm::radians(-45.f), glm::vec3(0, 1, 0));
-		rightTransform = glm::scale(rightTransform, vec3(1.2f));
-		rightTransform = glm::translate(rightTransform, vec3(0.f, 0, -1));
-
-		glm::mat4 floorTransform;
-		floorTransform = glm::rotate(glm::radians(-90.f), glm::vec3(1, 0, 0));
-		floorTransform = glm::rotate(floorTransform, glm::radians(45.f), glm::vec3(0, 0, 1));
-		floorTransform = glm::scale(floorTransform, glm::vec3(1.2f));
-		floorTransform = glm::translate(floorTransform, glm::vec3(0, 0, -1.f));
-
-		//LEFT WALL MATH
-		if (viewFromController) {
+
+
+		//-----------------WALL VIEWS-----------------//
+		//The views are worked out even for walls no pass renders, the composite, the quad
+		//layers and the wireframes place the walls by them
+		eyeProjections[eye] = projection;
+		//Both eyes' walls go into one array in the left eye's pass, so the eye poses have to
+		//be known for both by now. A single view only has its own eye's.
+		int wallEye = stereoWalls && !singleView ? 0 : eye;
+		int wallEyes = stereoWalls && !singleView ? 2 : 1;
+		bool wallPass = !stereoWalls || firstEye;
+		if (stereoWalls && firstEye) {
+			CpuScope scope("off-axis");
+			mat4 eyeModelviews[2];
+			for (int e = 0; e < wallEyes; e++) {
+				eyeModelviews[e] = ovr::toGlmInverse(_sceneLayer.RenderPose[wallEye + e]);
+				updateWallView(wallEye + e, eyeModelviews[e], _sceneLayer);
+			}
+			updateWallProjections(wallEye, wallEyes, eyeModelviews, _sceneLayer);
+			for (int e = 0; e < wallEyes; e++)
+				setWallCameras(wallEye + e);
+			//A single view's pass still goes over the whole stereo target, whose layer 0 is
+			//the left eye's first wall, with the other eye's walls left out of it
+			for (int i = 0; i < wallCount && singleView; i++)
+				wallVisible[layerIndex(1 - wallEye, i)] = false;
+		}
+		else if (!stereoWalls) {
+			CpuScope scope("off-axis", eye);
+			updateWallView(eye, modelview, _sceneLayer);
+			updateWallProjections(eye, 1, &modelview, _sceneLayer);
+			setWallCameras(eye);
+		}
+
+		//-----------------FRAME GRAPH-----------------//
+		//The eye buffer and the quad layers are what the frame is for, the walls' targets
+		//are kept from frame to frame and only drawn into when something shows them
+		frameGraph.reset();
+		FrameGraph::Resource eyeColor = frameGraph.import("eye color", true);
+		FrameGraph::Resource eyeDepth = frameGraph.import("eye depth", false);
+		FrameGraph::Resource quadLayers = frameGraph.import("quad layers", true);
+		FrameGraph::Resource wallColors[MAX_WALL_LAYERS];
+		for (int layer = 0; layer < 2 * wallCount; layer++)
+			wallColors[layer] = frameGraph.import("wall color", false);
+
+		//Both eyes composite the far field drawn at the first
+		if (firstEye && monoSky()) {
+			setFarView(_sceneLayer);
+			frameGraph.keep(frameGraph.addPass("far field", [this]() {
+				SharedGpuScope shared;
+				renderFarField();
+				return true;
+			}));
+		}
+		//Drawn after the CAVE instead when skyboxLast is set
+		if (!skyboxLast) {
+			FrameGraph::Pass pass = frameGraph.addPass("outer skybox", [this]() {
+				renderOuterSkybox();
+				return true;
+			});
+			frameGraph.read(pass, eyeDepth);
+			frameGraph.modify(pass, eyeColor);
+		}
+		if (wallPass)
+			declareWallPasses(wallEye, wallEyes, wallColors);
+		if (viewerCount > 1 && firstEye) {
+			frameGraph.keep(frameGraph.addPass("viewers", [this]() {
+				SharedGpuScope shared;
+				glEnable(GL_DEPTH_TEST);
+				renderViewers();
+				return true;
+			}));
+		}
+		//The quad layers only show the left eye's walls, the right eye's are culled
+		if (wallLayers.active() && firstEye) {
+			FrameGraph::Pass pass = frameGraph.addPass("wall layers", [this]() {
+				updateWallLayers();
+				return true;
+			});
+			for (int i = 0; i < wallCount; i++)
+				frameGraph.read(pass, wallColors[layerIndex(ovrEye_Left, i)]);
+			frameGraph.write(pass, quadLayers);
+		}
+		//Each eye's walls go out once they are drawn, the consumers wait on the fence
+		if (wallExport.valid() && (int)eye < exportEyes) {
+			uint64_t frame = (uint64_t)state.frameIndex;
+			FrameGraph::Pass pass = frameGraph.addPass("wall export", [this, eye, frame]() {
+				exportWalls(eye, frame);
+				return true;
+			});
+			for (int i = 0; i < wallCount; i++)
+				frameGraph.read(pass, wallColors[layerIndex(eye, i)]);
+		}
+		{
+			FrameGraph::Pass pass = frameGraph.addPass("composite", [this]() {
+				compositeWalls();
+				return true;
+			});
+			//A wall switched off is drawn black, its target is not looked at
+			for (int i = 0; i < wallCount && !wallLayers.active(); i++) {
+				if (!wallOff(eye, i))
+					frameGraph.read(pass, wallColors[layerIndex(eye, i)]);
+			}
+			frameGraph.modify(pass, eyeDepth);
+			frameGraph.modify(pass, eyeColor);
+		}
+		if (skyboxLast) {
+			FrameGraph::Pass pass = frameGraph.addPass("outer skybox last", [this]() {
+				renderOuterSkyboxLast();
+				return true;
+			});
+			frameGraph.read(pass, eyeDepth);
+			frameGraph.modify(pass, eyeColor);
+		}
+		//If A is pressed
+		if (debug) {
+			FrameGraph::Pass pass = frameGraph.addPass("wireframes", [this]() {
+				renderWireframes(eyeTarget.eye);
+				return true;
+			});
+			frameGraph.modify(pass, eyeColor);
+		}
+
+		{
+			CpuScope scope("frame graph", eye);
+			frameGraph.compile();
+		}
+		frameGraph.execute();
+		glDisable(GL_DEPTH_TEST);
+
+		//Leave nothing bound for RiftApp to draw into
+		glState().bindVertexArray(0);
+		glState().polygonMode(GL_FILL);
+		if (lastEye)
+			reportGLState();
+	}
+
+	//! The wall passes of eyes eyes from firstEye, declared into the frame graph: one
+	// layered pass for all of them or for the eye, or one pass per wall. Each has a depth
+	// buffer of its own as far as the graph is concerned, which it invalidates after the
+	// pass; they never overlap, so the graph gives them all one slot, the depth buffer
+	// RenderTargetCache shares between the wall targets.
+	void declareWallPasses(int firstEye, int eyes, const FrameGraph::Resource * wallColors) {
+		auto discard = []() { RenderTargetCache::discardDepth(); };
+		int firstLayer = layerIndex(firstEye, 0);
+		if (stereoWalls || layeredWalls) {
+			FrameGraph::Pass pass = frameGraph.addPass("layered walls", [this, firstEye, eyes]() {
+				const RenderTarget & target = stereoWalls ? *stereoWallTarget : *eyeWallTargets[firstEye];
+				glEnable(GL_DEPTH_TEST);
+				recordDrawList();
+				wallResolution.beginPass();
+				wallCubeCapture.beginMeasure();
+				//The geometry stage sends each layer to the target's layer of the same index
+				//from the pass's first, so the stereo target is always drawn from layer 0
+				bool drawn = stereoWalls ? renderLayeredWalls(target, 0, 2 * wallCount)
+					: renderLayeredWalls(target, layerIndex(firstEye, 0), eyes * wallCount);
+				wallCubeCapture.endMeasure(drawn);
+				wallResolution.endPass();
+				return drawn;
+			});
+			frameGraph.write(pass, frameGraph.transient("wall depth", WALL_DEPTH, discard));
+			for (int i = 0; i < eyes * wallCount; i++)
+				frameGraph.write(pass, wallColors[firstLayer + i]);
+			return;
+		}
+
+		//The walls' passes share what is set up for them, which is only set up if one of them
+		//is left
+		FrameGraph::Resource setup = frameGraph.transient("wall pass setup", WALL_SETUP);
+		FrameGraph::Pass begin = frameGraph.addPass("wall pass begin", [this, firstEye]() {
+			glEnable(GL_DEPTH_TEST);
+			recordDrawList();
+			recordWallCommands(firstEye);
+			wallResolution.beginPass();
+			wallPassOpen = true;
+			shaderProg.use();
+			return true;
+		});
+		frameGraph.write(begin, setup);
+		for (int i = 0; i < wallCount; i++) {
+			FrameGraph::Pass pass = frameGraph.addPass("wall", [this, firstEye, i]() {
+				return renderWall(firstEye, i);
+			});
+			frameGraph.read(pass, setup);
+			frameGraph.write(pass, frameGraph.transient("wall depth", WALL_DEPTH, discard));
+			frameGraph.write(pass, wallColors[firstLayer + i]);
+		}
+		frameGraph.keep(frameGraph.addPass("wall pass end", [this]() {
+			if (!wallPassOpen)
+				return false;
+			wallResolution.endPass();
+			wallPassOpen = false;
+			wallCommandsRecorded = 0;
+			return true;
+		}));
+	}
+
+	// The outer skybox around the eye before the CAVE, everything behind it drawn over
+	void renderOuterSkybox() {
+		GpuScope gpuScope(skyboxGpuPass);
+		if (lensMasked)
+			glEnable(GL_DEPTH_TEST);
+		if (monoSky()) {
+			farField.composite(eyeTarget.projection, eyeTarget.modelview);
+			shaderProg.use();
+		}
+		else if (virtualSky.valid()) {
+			useVirtualSky();
+			virtualSkyProg.transform.set(outerSkyboxTransform());
+			virtualSkyProg.bindTexture(virtualSkyProg.cubebox, 0, GL_TEXTURE_CUBE_MAP, virtualSky.cubeMap());
+			biggerSkyBox->draw(virtualSkyProg.id(), 0);
+			shaderProg.use();
+		}
+		else {
+			shaderProg.use();
+			shaderProg.transform.set(outerSkyboxTransform());
+			shaderProg.bindTexture(shaderProg.cubebox, 0, GL_TEXTURE_CUBE_MAP, assets.get(skyboxSets[skyboxActive].outer));
+			biggerSkyBox->draw(shaderProg.id(), 0);
+		}
+	}
+
+	// Whether the outer skybox comes from the far field. A single view has nothing to share.
+	bool monoSky() const {
+		return monoSkyOn && farField.valid() && !singleView;
+	}
+
+	//! The far field's view for this frame: from between the eyes, looking where the head
+	// does, over both eyes' fields of view and farMargin more, at the left eye's density
+	void setFarView(const ovrLayerEyeFov & layer) {
+		const ovrFovPort & left = layer.Fov[ovrEye_Left];
+		const ovrFovPort & right = layer.Fov[ovrEye_Right];
+		ovrFovPort fov;
+		fov.UpTan = std::max(left.UpTan, right.UpTan) * (1.f + farMargin);
+		fov.DownTan = std::max(left.DownTan, right.DownTan) * (1.f + farMargin);
+		fov.LeftTan = std::max(left.LeftTan, right.LeftTan) * (1.f + farMargin);
+		fov.RightTan = std::max(left.RightTan, right.RightTan) * (1.f + farMargin);
+		farProjection = ovr::toGlm(ovrMatrix4f_Projection(fov, 0.01f, 1000.0f, ovrProjection_ClipRangeOpenGL));
+		ovrPosef center = layer.RenderPose[ovrEye_Left];
+		center.Position = ovr::fromGlm((ovr::toGlm(layer.RenderPose[ovrEye_Left].Position)
+			+ ovr::toGlm(layer.RenderPose[ovrEye_Right].Position)) * 0.5f);
+		farView = ovr::toGlmInverse(center);
+		const ovrSizei & size = layer.Viewport[ovrEye_Left].Size;
+		farWidth = (GLsizei)std::ceil(size.w / (left.LeftTan + left.RightTan) * (fov.LeftTan + fov.RightTan) * farScale);
+		farHeight = (GLsizei)std::ceil(size.h / (left.UpTan + left.DownTan) * (fov.UpTan + fov.DownTan) * farScale);
+	}
+
+	// The outer skybox into the far field, with the eye's camera and framebuffer put back after
+	void renderFarField() {
+		CpuScope scope("far field");
+		GpuScope gpuScope(skyboxGpuPass);
+		ovrEyeType eye = eyeTarget.eye;
+		farField.begin(farWidth, farHeight, farProjection, farView);
+		cameras.setEye(eye, farProjection, farView);
+		cameras.bindEye(eye);
+		if (virtualSky.valid()) {
+			useVirtualSky();
+			virtualSkyProg.transform.set(outerSkyboxTransform());
+			drawSkybox(virtualSkyProg, biggerSkyBox.get(), virtualSky.cubeMap(), 1);
+		}
+		else {
+			shaderProg.use();
+			shaderProg.transform.set(outerSkyboxTransform());
+			drawSkybox(shaderProg, biggerSkyBox.get(), assets.get(skyboxSets[skyboxActive].outer), 1);
+		}
+		shaderProg.use();
+		cameras.setEye(eye, eyeTarget.projection, eyeTarget.modelview);
+		cameras.bindEye(eye);
+		glBindFramebuffer(GL_FRAMEBUFFER, eyeTarget.fbo);
+		const ovrRecti & vp = eyeTarget.viewport;
+		glViewport(vp.Pos.x, vp.Pos.y, vp.Size.w, vp.Size.h);
+	}
+
+	glm::mat4 outerSkyboxTransform() const {
+		return glm::scale(glm::mat4(1.0f), glm::vec3(OUTER_SKYBOX_SIZE));
+	}
+
+	//! The walls into the eye buffer (eyeTarget), as textured quads or ray cast
+	void compositeWalls() {
+		ovrEyeType eye = eyeTarget.eye;
+		glDisable(GL_DEPTH_TEST);
+		glBindFramebuffer(GL_FRAMEBUFFER, eyeTarget.fbo);
+		const ovrRecti & vp = eyeTarget.viewport;
+		glViewport(vp.Pos.x, vp.Pos.y, vp.Size.w, vp.Size.h);
+
+		//Layered targets may have been given up on since, the ray cast needs the arrays
+		bool raycast = raycastWalls && (layeredWalls || stereoWalls);
+		bool merged = mergedWalls && (layeredWalls || stereoWalls);
+		SceneVariants & composite = raycast ? raycastVariants : merged ? mergedVariants
+			: (layeredWalls || stereoWalls) ? screenArrayVariants : screenVariants;
+		const SceneProgram & compositeProg = composite.get(composite.variants.with(0, "ANALYTIC_SKY", analyticSky));
+		//The wall passes took a few milliseconds, the composite shows the walls from where the head is now
+		if (*eyeTarget.lateModelview) {
+			eyeTarget.modelview = (*eyeTarget.lateModelview)(eye);
+			cameras.setEye(eye, eyeTarget.projection, eyeTarget.modelview);
+		}
+		cameras.bindEye(eye);
+		compositeProg.use();
+
+		setAnalyticSky(compositeProg, eye);
+
+		//The walls write depth so the outer skybox only fills what they leave uncovered, or
+		//mark the stencil with stencilSky
+		if (skyboxLast || lensMasked)
+			glEnable(GL_DEPTH_TEST);
+		if (stencilSky) {
+			glEnable(GL_STENCIL_TEST);
+			glStencilFunc(GL_ALWAYS, 1, 0xff);
+			glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+		}
+		CpuScope scope("composite", eye);
+		GpuScope gpuScope(compositeGpuPasses[eye]);
+		if (raycast) {
+			if (!wallLayers.active())
+				drawWallsRaycast(compositeProg, eye);
+			return;
+		}
+		if (wallLayers.active())
+			return;
+		if (merged) {
+			drawWallsMerged(compositeProg, eye);
+			return;
+		}
+		//The walls go out by program, then by the texture they show, then front to back
+		CompositeDraws draws = { this, { &compositeProg, nullptr }, eye };
+		for (int i = 0; i < wallCount; i++) {
+			int layer = layerIndex(viewIndex(shownViewer, eye), i);
+			if (!wallVisible[layer])
+				continue;
+			//A wall switched off is drawn black, with a program of its own
+			uint32_t broken = wallOff(eye, i) ? 1 : 0;
+			if (broken && !draws.programs[1])
+				draws.programs[1] = &composite.get(composite.variants.bit("BROKEN"));
+			int arrayLayer;
+			GLuint texture = shownViewer || stereoWalls || layeredWalls ? wallArray(eye, i, arrayLayer) : wallTargets[layer]->color;
+			float distance = glm::length(vec3(wallTransforms[i][3]) - eyePos[eye]);
+			compositeQueue.add(DrawQueue::key(0, draws.programs[broken]->id(), texture, distance), &drawQueuedWall, &draws,
+				broken << 16 | (uint32_t)i);
+		}
+		compositeQueue.execute();
+	}
+
+	// The programs and eye a composite's queued walls are drawn with
+	struct CompositeDraws {
+		ColorCubeScene * scene;
+		const SceneProgram * programs[2];
+		ovrEyeType eye;
+	};
+
+	// A queued wall: the program in the high half of item, the wall in the low
+	static void drawQueuedWall(void * context, uint32_t item) {
+		CompositeDraws & draws = *static_cast<CompositeDraws *>(context);
+		const SceneProgram & prog = *draws.programs[item >> 16];
+		int i = (int)(item & 0xffff);
+		prog.use();
+		prog.transform.set(draws.scene->wallTransforms[i]);
+		draws.scene->drawWall(prog, draws.eye, i);
+	}
+
+	// The outer skybox after the CAVE, only where the walls left the eye buffer uncovered
+	void renderOuterSkyboxLast() {
+		GpuScope gpuScope(skyboxGpuPass);
+		//Pixels a wall marked are rejected before shading, no depth test needed
+		if (stencilSky) {
+			glStencilFunc(GL_EQUAL, 0, 0xff);
+			glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+			glDisable(GL_DEPTH_TEST);
+		}
+		if (monoSky()) {
+			farField.composite(eyeTarget.projection, eyeTarget.modelview);
+			shaderProg.use();
+		}
+		else if (virtualSky.valid()) {
+			useVirtualSky();
+			virtualSkyProg.transform.set(outerSkyboxTransform());
+			drawSkybox(virtualSkyProg, biggerSkyBox.get(), virtualSky.cubeMap(), 1);
+			shaderProg.use();
+		}
+		else {
+			shaderProg.use();
+			shaderProg.transform.set(outerSkyboxTransform());
+			drawSkybox(shaderProg, biggerSkyBox.get(), assets.get(skyboxSets[skyboxActive].outer), 1);
+		}
+		glDisable(GL_STENCIL_TEST);
+		glDisable(GL_DEPTH_TEST);
+	}
+
+	// One pyramid per wall, from the eye to the wall's corners, and the world axes with
+	// debug.axes, all as one batch of lines
+	void renderWireframes(ovrEyeType eye) {
+		CpuScope scope("wireframes", eye);
+		GpuScope gpuScope(wireframeGpuPasses[eye]);
+		glDisable(GL_DEPTH_TEST);
+		debugLinesProg.use();
+
+		for (int i = 0; i < wallCount; i++) {
+			//The wall's corners in turn around it
+			const glm::vec3 corners[4] = { wallVerts[i][0], wallVerts[i][1], wallVerts[i][2], wallVerts[i][3] };
+			debugDraw().pyramid(eyePos[eye], corners, wireframeColors[i % wireframeColorCount]);
+		}
+		if (debugAxes > 0.f)
+			debugDraw().axes(mat4(1.f), debugAxes);
+		if (pickProps) {
+			bool picked = pickedProp != EntityStore::NONE;
+			vec3 pickColor = grabbedProp != EntityStore::NONE ? vec3(1.f, 0.5f, 0.f) : picked ? vec3(1.f, 1.f, 0.f) : vec3(0.5f);
+			debugDraw().line(pickRay.position, pickRay.transform(vec3(0.f, 0.f, -(picked ? pickedAt : pickDistance))), pickColor);
+			if (picked) {
+				size_t index = entities.index(pickedProp);
+				debugDraw().box(entities.boundsMin()[index], entities.boundsMax()[index], pickColor);
+			}
+		}
+		debugDraw().flush();
+	}
+
+	//! Panorama only: the eye's cube map of the stereo environment straight into the eye
+	// buffer, centred on the eye so it sits at infinity like the walls' sky does.
+	void renderPanorama(const mat4 & modelview, ovrEyeType eye, GLuint hmd_fbo, const ovrLayerEyeFov & _sceneLayer) {
+		CpuScope scope("panorama", eye);
+		GpuScope gpuScope(skyboxGpuPass);
+		glBindFramebuffer(GL_FRAMEBUFFER, hmd_fbo);
+		const auto& vp = _sceneLayer.Viewport[eye];
+		glViewport(vp.Pos.x, vp.Pos.y, vp.Size.w, vp.Size.h);
+		//The lens mask's depth keeps the sky off the pixels it covers
+		if (lensMasked)
+			glEnable(GL_DEPTH_TEST);
+		shaderProg.use();
+		vec3 eyeWorld = vec3(glm::inverse(modelview)[3]);
+		shaderProg.transform.set(glm::translate(mat4(1.f), eyeWorld) * glm::scale(mat4(1.f), vec3(SKYBOX_SIZE)));
+		drawSkybox(shaderProg, skybox.get(), wallSkyTexture(eye), 1);
+		glDisable(GL_DEPTH_TEST);
+	}
+
+	// Every gl.state_report frames, how many state changes the tracker let through and skipped
+	void reportGLState() {
+		if (glStateReport <= 0 || ++glStateFrames < glStateReport)
+			return;
+		std::cout << "gl state: " << glState().issued() << " calls, " << glState().saved()
+			<< " redundant skipped over " << glStateFrames << " frames" << std::endl;
+		glState().resetCounters();
+		glStateFrames = 0;
+	}
+
+	// Layers, targets and per wall state are indexed eye * wallCount + wall
+	int layerIndex(int eye, int wall) const { return eye * wallCount + wall; }
+	int viewIndex(int viewer, int eye) const { return viewer * 2 + eye; }
+	// The HMD eye a layer of any viewer is composited into
+	int layerEye(int layer) const { return layer / wallCount % 2; }
+	// Whether eye's wall is switched off (wallsOff), for every viewer
+	bool wallOff(int eye, int wall) const { return ((wallsOff >> layerIndex(eye, wall)) & 1) != 0; }
+	// Whether the wall passes draw a layer: its wall is in view and not switched off
+	bool layerDrawn(int layer) const { return wallVisible[layer] && !wallOff(layerEye(layer), layer % wallCount); }
+
+	//! Switches off the walls in list, each a wall's name, for both eyes or with ":left" or
+	// ":right" for one (walls.off, "floor:right" is what the X button does)
+	void setupWallsOff(const std::string & list) {
+		size_t start = 0;
+		while (start < list.size()) {
+			size_t end = std::min(list.find(',', start), list.size());
+			std::string name = list.substr(start, end - start);
+			start = end + 1;
+			name.erase(0, name.find_first_not_of(" \t"));
+			name.erase(name.find_last_not_of(" \t") + 1);
+			if (name.empty())
+				continue;
+			uint32_t eyes = 3;
+			size_t colon = name.find(':');
+			if (colon != std::string::npos) {
+				std::string eye = name.substr(colon + 1);
+				name.erase(colon);
+				if (eye == "left")
+					eyes = 1;
+				else if (eye == "right")
+					eyes = 2;
+				else
+					std::cerr << "walls.off: " << eye << " is not left or right, switching off both eyes'" << std::endl;
+			}
+			int wall = cave.find(name);
+			if (wall < 0) {
+				std::cerr << "walls.off: no wall " << name << std::endl;
+				continue;
+			}
+			for (int eye = 0; eye < 2; eye++) {
+				if ((eyes >> eye) & 1)
+					wallsOff |= 1u << layerIndex(eye, wall);
+			}
+		}
+	}
+
+	void setWallCameras(int eye) {
+		//The separate passes render with the sizes these are jittered for
+		mat4 projections[CaveLayout::MAX_WALLS];
+		for (int i = 0; i < wallCount; i++) {
+			int layer = layerIndex(eye, i);
+			wallRenderSizes[layer] = wallTemporal.renderSize(layer, wallResolution.size(eye, i));
+			projections[i] = wallJitter(layer) * wallProjections[layer];
+		}
+		cameras.setWalls(eye, wallModelviews[eye], projections, wallCount, eyePos[eye]);
+	}
+
+	// The walls never move, their transforms and corners are copied out of the layout once
+	void setupWallGeometry() {
+		for (int i = 0; i < wallCount; i++) {
+			wallTransforms[i] = cave.wallTransform(i);
+			wallInverseTransforms[i] = glm::inverse(wallTransforms[i]);
+			for (int corner = 0; corner < 4; corner++)
+				wallVerts[i][corner] = cave.wall(i).corners[corner];
+		}
+		wallViews.setLayout(cave);
+		physics.setWalls(cave);
+		if (mergedWallBuffer.get())
+			uploadMergedWalls();
+	}
+
+	// A vertex of the merged wall quads, attributes 0 to 2 of wallMerged.vert
+	struct MergedWallVertex {
+		vec3 position;
+		vec2 uv;
+		GLint wall;
+	};
+
+	// The buffer for every wall's quad, and the vertex array reading it
+	void setupMergedWalls() {
+		mergedWallVao.create();
+		mergedWallBuffer.create();
+		glState().bindVertexArray(mergedWallVao);
+		glBindBuffer(GL_ARRAY_BUFFER, mergedWallBuffer);
+		glBufferData(GL_ARRAY_BUFFER, CaveLayout::MAX_WALLS * 6 * sizeof(MergedWallVertex), nullptr, GL_STATIC_DRAW);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(MergedWallVertex), (const GLvoid *)offsetof(MergedWallVertex, position));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(MergedWallVertex), (const GLvoid *)offsetof(MergedWallVertex, uv));
+		glEnableVertexAttribArray(2);
+		glVertexAttribIPointer(2, 1, GL_INT, sizeof(MergedWallVertex), (const GLvoid *)offsetof(MergedWallVertex, wall));
+		glState().bindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		uploadMergedWalls();
+	}
+
+	// Each wall's Quad, its six vertices put on the wall, again whenever the walls move
+	void uploadMergedWalls() {
+		MergedWallVertex vertices[CaveLayout::MAX_WALLS * 6];
+		for (int i = 0; i < wallCount; i++) {
+			for (int v = 0; v < 6; v++) {
+				const GLfloat * quad = &quad_vertices[v * 5];
+				MergedWallVertex & vertex = vertices[i * 6 + v];
+				vertex.position = vec3(wallTransforms[i] * vec4(quad[0], quad[1], quad[2], 1.f));
+				vertex.uv = vec2(quad[3], quad[4]);
+				vertex.wall = i;
+			}
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, mergedWallBuffer);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, wallCount * 6 * sizeof(MergedWallVertex), vertices);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	//! Swaps in the walls of a layout file saved since (cave.layout_reload), between frames.
+	// Walls whose resolution changed get their own targets again at the new size, the
+	// arrays and histories shared by the walls stay as big as the largest wall at startup.
+	// Every wall is rendered again.
+	void updateLayout() {
+		CaveLayout layout;
+		if (!layoutReloader.update(layout))
+			return;
+		cave = layout;
+		brokenWall = cave.find("floor");
+		setupWallGeometry();
+		if (wallResolution.reloadBases(cave, wallSizeLimit)) {
+			for (int i = 0; i < 2 * wallCount; i++) {
+				GLsizei size = wallResolution.base(i % wallCount);
+				if (wallTargets[i]->width == size)
+					continue;
+				wallTargets[i] = renderTargets.acquire("wall" + std::to_string(i), size, size, 0, false, separateWallFormat);
+				if (!wallTargets[i])
+					FAIL("Could not create the CAVE wall render targets");
+			}
+		}
+		invalidateWalls();
+		wallOcclusion.invalidate();
+		layoutVersion++;
+	}
+
+	//! Swaps in the programs shaders.hot_reload made again, and has every wall drawn again
+	// with them
+	void updateShaders() {
+		shaderReloader.update();
+		if (shaderReloader.version() == shaderVersion)
+			return;
+		shaderVersion = shaderReloader.version();
+		invalidateWalls();
+	}
+
+	//! Every wall is rendered again from nothing: no layer is kept, the temporal histories
+	// start over and, through wallSceneVersion, no reprojected image is used. The quad
+	// layers copy the walls' targets every frame, so they follow.
+	void invalidateWalls() {
+		for (int layer = 0; layer < MAX_LAYERS; layer++)
+			wallLayerStates[layer].valid = false;
+		wallTemporal.invalidate();
+	}
+
+	// Where an eye sees the walls from this frame: the view they are rendered with and the
+	// eye position
+	void updateWallView(int eye, const mat4 & modelview, const ovrLayerEyeFov & _sceneLayer) {
+		//The walls are rendered from the tracked position only, or from the controller
+		if (viewFromController) {
+			wallModelviews[eye] = ovr::toGlmInverse(handPoses[RIGHT]);
+		}
+		else {
+			//A head held in place (headTracked) is seen from where it is held, so the walls stay
+			//as they are and wallLayerCurrent keeps what was rendered of them
+			if (track && headTracked)
+				posOnly[eye][3] = modelview[3];
+			wallModelviews[eye] = posOnly[eye];
+		}
+
+		if (viewFromController) {
 			if (track) {
+				vec3 hand = predictWalls ? handPredictor.predict(handPredictor.sampleTime() + wallAhead).position : vec3(ovr::toGlm(handPoses[RIGHT].Position));
 				if (!eye) {	//Left eye
-					eyePos[eye] = vec3(ovr::toGlm(handPoses[RIGHT].Position));
+					eyePos[eye] = hand;
 					eyePos[eye].x -= 0.0325f;
 				}
 				else { //Right
-					eyePos[eye] = vec3(ovr::toGlm(handPoses[RIGHT].Position));
+					eyePos[eye] = hand;
 					eyePos[eye].x += 0.0325f;
 				}
 				
 			}
 		}
-		else {
-			if (track)
-				eyePos[eye] = vec3(ovr::toGlm(_sceneLayer.RenderPose[eye].Position));
-		} 
-		leftWallVerts[0] = leftTransform * vec4(leftwall->vertices[0], 1.0f);
-		leftWallVerts[1] = leftTransform * vec4(leftwall->vertices[1], 1.0f);
-		leftWallVerts[2] = leftTransform * vec4(leftwall->vertices[2], 1.0f);
-		leftWallVerts[3] = leftTransform * vec4(leftwall->vertices[3], 1.0f);
-		vec3 va = leftWallVerts[0] - eyePos[eye];
-		vec3 vb = leftWallVerts[1] - eyePos[eye];
-		vec3 vc = leftWallVerts[3] - eyePos[eye];
-
-		vec3 vr = glm::normalize(leftWallVerts[1] - leftWallVerts[0]);
-		vec3 vu = glm::normalize(leftWallVerts[3] - leftWallVerts[0]);
-		vec3 vn = glm::normalize(glm::cross(vr, vu));
-		float dist = -glm::dot(vn, va);
-		float l = glm::dot(vr, va) * 0.001f / dist;
-		float r = glm::dot(vr, vb) * 0.001f / dist;
-		float b = glm::dot(vu, va) * 0.001f / dist;
-		float t = glm::dot(vu, vc) * 0.001f / dist;
-		mat4 M = mat4(1.0f);
-		M[0] = vec4(vr, 0.f);
-		M[1] = vec4(vu, 0.f);
-		M[2] = vec4(vn, 0.f);
-		M = glm::transpose(M);
-		mat4 T = mat4(1.0f);
-		T[3] = vec4(-eyePos[eye].x, -eyePos[eye].y, -eyePos[eye].z, 1.0f);
-		quadProjections[0] = glm::frustum(l, r, b, t, 0.001f, 1000.f) * M * T;
-
-		//RIGHT WALL MATH
-		rightWallVerts[0] = rightTransform * vec4(rightwall->vertices[0], 1.0f);
-		rightWallVerts[1] = rightTransform * vec4(rightwall->vertices[1], 1.0f);
-		rightWallVerts[2] = rightTransform * vec4(rightwall->vertices[2], 1.0f);
-		rightWallVerts[3] = rightTransform * vec4(rightwall->vertices[3], 1.0f);
-		va = rightWallVerts[0] - eyePos[eye];
-		vb = rightWallVerts[1] - eyePos[eye];
-		vc = rightWallVerts[3] - eyePos[eye];
-
-		vr = glm::normalize(rightWallVerts[1] - rightWallVerts[0]);
-		vu = glm::normalize(rightWallVerts[3] - rightWallVerts[0]);
-		vn = glm::normalize(glm::cross(vr, vu));
-		dist = -glm::dot(vn, va);
-		l = glm::dot(vr, va) * 0.001f / dist;
-		r = glm::dot(vr, vb) * 0.001f / dist;
-		b = glm::dot(vu, va) * 0.001f / dist;
-		t = glm::dot(vu, vc) * 0.001f / dist;
-		M = mat4(1.0f);
-		M[0] = vec4(vr, 0.f);
-		M[1] = vec4(vu, 0.f);
-		M[2] = vec4(vn, 0.f);
-		M = glm::transpose(M);
-		T = mat4(1.0f);
-		T[3] = vec4(-eyePos[eye].x, -eyePos[eye].y, -eyePos[eye].z, 1.0f);
-		quadProjections[1] = glm::frustum(l, r, b, t, 0.001f, 1000.f) * M * T;
-
-		//FLOOR WALL MATH
-		floorVerts[0] = floorTransform * vec4(floor->vertices[0], 1.0f);
-		floorVerts[1] = floorTransform * vec4(floor->vertices[1], 1.0f);
-		floorVerts[2] = floorTransform * vec4(floor->vertices[2], 1.0f);
-		floorVerts[3] = floorTransform * vec4(floor->vertices[3], 1.0f);
-		va = floorVerts[0] - eyePos[eye];
-		vb = floorVerts[1] - eyePos[eye];
-		vc = floorVerts[3] - eyePos[eye];
-
-		vr = glm::normalize(floorVerts[1] - floorVerts[0]);
-		vu = glm::normalize(floorVerts[3] - floorVerts[0]);
-		vn = glm::normalize(glm::cross(vr, vu));
-		dist = -glm::dot(vn, va);
-		l = glm::dot(vr, va) * 0.001f / dist;
-		r = glm::dot(vr, vb) * 0.001f / dist;
-		b = glm::dot(vu, va) * 0.001f / dist;
-		t = glm::dot(vu, vc) * 0.001f / dist;
-		M = mat4(1.0f);
-		M[0] = vec4(vr, 0.f);
-		M[1] = vec4(vu, 0.f);
-		M[2] = vec4(vn, 0.f);
-		M = glm::transpose(M);
-		T = mat4(1.0f);
-		T[3] = vec4(-eyePos[eye].x, -eyePos[eye].y, -eyePos[eye].z, 1.0f);
-		quadProjections[2] = glm::frustum(l, r, b, t, 0.001f, 1000.f) * M * T;
-		//---------------MATHEMATICS END---------------//
-
-		//if (track) {
-			glEnable(GL_DEPTH_TEST);
+		else {
+			if (track && headTracked) {
+				eyePos[eye] = vec3(ovr::toGlm(_sceneLayer.RenderPose[eye].Position));
+				//The eye stays where it is on the head, the head moves on
+				if (predictWalls)
+					eyePos[eye] = headPredictor.predictPoint(headNow.inverse().transform(eyePos[eye]), headPredictor.sampleTime() + wallAhead);
+			}
+		} 
+	}
+
+	// walls.format picks the wall targets' color: rgba8, or r11g11b10f and rgba16f for
+	// skyboxes with more range than 8 bits. The analytic sky needs the alpha r11g11b10f does
+	// not have. walls.mip_levels gives them levels.
+	RenderTargetFormat wallTargetFormat() const {
+		RenderTargetFormat format;
+		std::string name = config().getString("walls.format", "rgba8");
+		format.color = RenderTargetCache::parseColorFormat(name);
+		if (!format.color) {
+			std::cerr << "walls.format: unknown format " << name << ", using rgba8" << std::endl;
+			format.color = GL_RGBA8;
+		}
+		if (!RenderTargetCache::hasAlpha(format.color) && config().getBool("walls.analytic_sky", false)) {
+			std::cerr << "the analytic sky needs alpha in the wall targets, using rgba16f" << std::endl;
+			format.color = GL_RGBA16F;
+		}
+		format.levels = std::max(std::min(config().getInt("walls.mip_levels", 4), WallMips::MAX_FUSED_LEVELS + 1), 1);
+		//walls.msaa (2 or 4) draws the wall passes multisampled and resolves them into the
+		//wall textures, for less aliasing than a larger walls.resolution costs
+		format.samples = std::max(config().getInt("walls.msaa", 1), 1);
+		return format;
+	}
+
+	//! The viewers past the first from cave.viewers, a comma separated list of the hand
+	// tracking each ("left_hand" or "right_hand"). They need the layered wall pass, and
+	// there are only as many as the cull masks have bits for.
+	// @input format Their targets', those of the stereo pass
+	void setupViewers(const RenderTargetFormat & format) {
+		std::string list = config().getString("cave.viewers");
+		size_t start = 0;
+		while (start < list.size()) {
+			size_t end = std::min(list.find(',', start), list.size());
+			std::string source = list.substr(start, end - start);
+			start = end + 1;
+			source.erase(0, source.find_first_not_of(" \t"));
+			source.erase(source.find_last_not_of(" \t") + 1);
+			if (source.empty())
+				continue;
+			if (source != "left_hand" && source != "right_hand") {
+				std::cerr << "cave.viewers: unknown viewer " << source << std::endl;
+				continue;
+			}
+			if (!layeredWalls) {
+				std::cerr << "cave.viewers needs walls.layered, rendering the first viewer only" << std::endl;
+				break;
+			}
+			if (viewerCount == MAX_VIEWERS || (viewerCount + 1) * 2 * wallCount > MASK_LAYERS) {
+				std::cerr << "cave.viewers: at most " << viewerCount << " viewers with " << wallCount << " walls" << std::endl;
+				break;
+			}
+			const RenderTarget * target = renderTargets.acquire("walls_viewer" + std::to_string(viewerCount),
+				wallResolution.maxBase(), wallResolution.maxBase(), 2 * wallCount, multiviewWalls, format);
+			if (!target) {
+				std::cerr << "wall target for viewer " << viewerCount << " unavailable" << std::endl;
+				break;
+			}
+			viewerHands[viewerCount] = source == "left_hand" ? LEFT : RIGHT;
+			viewerTargets[viewerCount] = target;
+			viewerGpuPasses[viewerCount] = gpuTimers().pass("walls viewer " + std::to_string(viewerCount));
+			viewerCount++;
+		}
+		shownViewer = std::max(std::min(config().getInt("cave.show_viewer", 0), viewerCount - 1), 0);
+	}
+
+	// A viewer past the first sees the walls from its controller, its eyes either side of
+	// it in x like viewFromController
+	void updateViewerView(int viewer) {
+		int hand = viewerHands[viewer];
+		for (int eye = 0; eye < 2; eye++)
+			wallModelviews[viewIndex(viewer, eye)] = ovr::toGlmInverse(handPoses[hand]);
+		if (!track)
+			return;
+		vec3 position = predictWalls && hand == RIGHT ? handPredictor.predict(handPredictor.sampleTime() + wallAhead).position
+			: vec3(ovr::toGlm(handPoses[hand].Position));
+		eyePos[viewIndex(viewer, 0)] = position - vec3(0.0325f, 0.f, 0.f);
+		eyePos[viewIndex(viewer, 1)] = position + vec3(0.0325f, 0.f, 0.f);
+	}
+
+	//! The walls of every viewer past the first, once a frame after the first viewer's left
+	// eye walls. All their projections are computed and their props culled together, then
+	// each viewer's walls go into its array in one layered pass.
+	void renderViewers() {
+		int firstView = viewIndex(1, 0);
+		int views = 2 * (viewerCount - 1);
+		{
+			CpuScope scope("off-axis viewers");
+			for (int viewer = 1; viewer < viewerCount; viewer++)
+				updateViewerView(viewer);
+			cave.computeProjections(&eyePos[firstView], views, &wallProjections[layerIndex(firstView, 0)]);
+			if (gpuWallProjection)
+				wallViews.setViews(firstView, views, &eyePos[firstView], &wallModelviews[firstView]);
+			cullPropLayers(firstView, views);
+			setPointCloudViews(firstView, views);
+		}
+		recordDrawList();
+		for (int viewer = 1; viewer < viewerCount; viewer++) {
+			wallResolution.beginPass();
+			if (renderLayeredWalls(*viewerTargets[viewer], layerIndex(viewIndex(viewer, 0), 0), 2 * wallCount))
+				RenderTargetCache::discardDepth();
+			wallResolution.endPass();
+		}
+	}
+
+	// The projections through every wall for eyeCount eyes from firstEye, then which walls
+	// those eyes can see and how much of their view each takes up
+	void updateWallProjections(int firstEye, int eyeCount, const mat4 * modelviews, const ovrLayerEyeFov & _sceneLayer) {
+		cave.computeProjections(&eyePos[firstEye], eyeCount, &wallProjections[layerIndex(firstEye, 0)]);
+		if (gpuWallProjection)
+			wallViews.setViews(firstEye, eyeCount, &eyePos[firstEye], &wallModelviews[firstEye]);
+		//A wall that is not rendered every frame has to hold what the head may turn to by its
+		//next render, the whole of it
+		bool partial = partialWalls && wallSchedule.mode() == WallSchedule::EVERY_FRAME && wallSchedule.interval() == 1;
+		for (int eye = firstEye; eye < firstEye + eyeCount; eye++) {
+			for (int i = 0; i < wallCount; i++) {
+				int layer = layerIndex(eye, i);
+				wallRegions[layer] = partial ? wallRegion(layer, modelviews[eye - firstEye], _sceneLayer.Fov[eye], partialMargin) : wholeWall();
+				wallRegionsSeen[layer] = partial ? wallRegion(layer, modelviews[eye - firstEye], _sceneLayer.Fov[eye], 0.5f * partialMargin)
+					: wholeWall();
+			}
+		}
+		cullPropLayers(firstEye, eyeCount);
+		setPointCloudViews(firstEye, eyeCount);
+
+		for (int eye = firstEye; eye < firstEye + eyeCount; eye++) {
+			mat4 viewProjection = eyeProjections[eye] * modelviews[eye - firstEye];
+			const ovrSizei & eyeSize = _sceneLayer.Viewport[eye].Size;
+			float pixels = (float)eyeSize.w * (float)eyeSize.h;
+			for (int i = 0; i < wallCount; i++) {
+				wallVisible[layerIndex(eye, i)] = !cullWalls || ((projectedWalls >> i) & 1) || wallInView(wallVerts[i], viewProjection);
+				//How much of this eye's view each wall takes up decides how many pixels it is worth
+				if (wallResolution.adaptive())
+					wallResolution.setCoverage(eye, i, wallCoverage(wallVerts[i], viewProjection) * pixels);
+				//and where the lens center looks at it where they go
+				if (wallResolution.variable()) {
+					vec4 fovea;
+					bool inView = wallFovea(layerIndex(eye, i), modelviews[eye - firstEye], fovea);
+					wallResolution.setFovea(eye, i, fovea, inView);
+				}
+			}
+		}
+	}
+
+	static vec4 wholeWall() { return vec4(-1.f, 1.f, -1.f, 1.f); }
+
+	//! What an HMD eye sees of a layer's wall, for walls.partial: the wall clip space bounds
+	// (x0, x1, y0, y1) of where the eye's view, margin radians wider each way, meets the
+	// wall's plane, as far as the wall goes. The whole wall where it does not meet it.
+	// @input eyeModelview The HMD eye's view, for which way it faces
+	vec4 wallRegion(int layer, const mat4 & eyeModelview, const ovrFovPort & fov, float margin) const {
+		mat3 eyeToWorld = glm::transpose(mat3(eyeModelview));
+		vec3 origin = eyePos[layer / wallCount];
+		mat4 wallMatrix = wallLayerMatrix(layer);
+		//No wider than 80 degrees off the axis, where the view meets the plane far away
+		auto widen = [margin](float tangent) { return std::tan(std::min(std::atan(tangent) + margin, glm::radians(80.f))); };
+		float left = widen(fov.LeftTan), right = widen(fov.RightTan), down = widen(fov.DownTan), up = widen(fov.UpTan);
+		const vec2 corners[4] = { vec2(-left, -down), vec2(right, -down), vec2(right, up), vec2(-left, up) };
+		vec3 edges[4];
+		for (int i = 0; i < 4; i++) {
+			vec4 clip = wallMatrix * vec4(origin + eyeToWorld * vec3(corners[i], -1.f), 1.f);
+			edges[i] = vec3(clip.x, clip.y, clip.w);
+		}
+		//The view's edges clipped to the half in front of the wall's eye, where it runs out
+		//to the plane's horizon between an edge in front and one behind
+		const float nearW = 0.0001f;
+		vec4 bounds(1.f, -1.f, 1.f, -1.f);
+		bool meets = false;
+		auto extend = [&](const vec3 & p) {
+			vec2 ndc = vec2(p) / p.z;
+			bounds = vec4(std::min(bounds.x, ndc.x), std::max(bounds.y, ndc.x), std::min(bounds.z, ndc.y), std::max(bounds.w, ndc.y));
+			meets = true;
+		};
+		for (int i = 0; i < 4; i++) {
+			const vec3 & a = edges[i];
+			const vec3 & b = edges[(i + 1) % 4];
+			if (a.z > nearW)
+				extend(a);
+			if ((a.z > nearW) != (b.z > nearW))
+				extend(a + (b - a) * ((nearW - a.z) / (b.z - a.z)));
+		}
+		bounds = glm::clamp(bounds, vec4(-1.f), vec4(1.f));
+		if (!meets || bounds.x >= bounds.y || bounds.z >= bounds.w)
+			return wholeWall();
+		return bounds;
+	}
+
+	// Takes a region of a wall's clip space (x0, x1, y0, y1) to all of it, for culling to
+	// what walls.partial renders
+	static mat4 regionCrop(const vec4 & region) {
+		vec2 scale = 2.f / vec2(region.y - region.x, region.w - region.z);
+		mat4 crop(1.f);
+		crop[0][0] = scale.x;
+		crop[1][1] = scale.y;
+		crop[3][0] = -0.5f * scale.x * (region.x + region.y);
+		crop[3][1] = -0.5f * scale.y * (region.z + region.w);
+		return crop;
+	}
+
+	// Whether the layer's last render holds what is seen of it now
+	bool wallRegionCovered(int layer) const {
+		const vec4 & rendered = wallLayerStates[layer].region;
+		const vec4 & seen = wallRegionsSeen[layer];
+		return rendered.x <= seen.x && rendered.y >= seen.y && rendered.z <= seen.z && rendered.w >= seen.w;
+	}
+
+	// Scissors the wall pass's viewport index to the layer's region, size pixels on a side
+	void scissorWall(GLuint viewport, int layer, GLsizei size) const {
+		const vec4 & region = wallRegions[layer];
+		GLint x0 = (GLint)std::floor((region.x * 0.5f + 0.5f) * size);
+		GLint x1 = (GLint)std::ceil((region.y * 0.5f + 0.5f) * size);
+		GLint y0 = (GLint)std::floor((region.z * 0.5f + 0.5f) * size);
+		GLint y1 = (GLint)std::ceil((region.w * 0.5f + 0.5f) * size);
+		glScissorIndexed(viewport, x0, y0, x1 - x0, y1 - y0);
+	}
+
+	//! Where an eye's lens center region falls on a wall, for walls.variable: the layer's
+	// wall clip space bounds of the points walls.variable_fovea_degrees either side of the
+	// eye's forward direction, across and up. A side behind the wall's view widens that axis
+	// to the whole wall.
+	// @input eyeModelview The HMD eye's view, for which way it faces
+	// @return Returns false if the eye faces away from the wall
+	bool wallFovea(int layer, const mat4 & eyeModelview, vec4 & bounds) const {
+		mat3 eyeToWorld = glm::transpose(mat3(eyeModelview));
+		vec3 origin = eyePos[layer / wallCount];
+		mat4 wallMatrix = wallLayerMatrix(layer);
+		vec4 center = wallMatrix * vec4(origin + eyeToWorld * vec3(0.f, 0.f, -1.f), 1.f);
+		if (center.w <= 0.0001f)
+			return false;
+		bounds = vec4(center.x, center.x, center.y, center.y) / center.w;
+		float t = wallResolution.foveaTangent();
+		const vec2 sides[4] = { vec2(-t, 0.f), vec2(t, 0.f), vec2(0.f, -t), vec2(0.f, t) };
+		for (int side = 0; side < 4; side++) {
+			int axis = side / 2;
+			vec4 clip = wallMatrix * vec4(origin + eyeToWorld * vec3(sides[side], -1.f), 1.f);
+			if (clip.w <= 0.0001f) {
+				bounds[axis * 2] = -1.f;
+				bounds[axis * 2 + 1] = 1.f;
+				continue;
+			}
+			float v = clip[axis] / clip.w;
+			bounds[axis * 2] = glm::min(bounds[axis * 2], v);
+			bounds[axis * 2 + 1] = glm::max(bounds[axis * 2 + 1], v);
+		}
+		return true;
+	}
+
+	// The bands a layer is drawn with: walls.variable's for the first viewer's, one density
+	// for the others
+	WallBands layerBands(int layer) const {
+		GLsizei size = wallResolution.size(layerEye(layer), layer % wallCount);
+		if (layer >= 2 * wallCount)
+			return WallResolution::uniformBands(size);
+		return wallResolution.bands(layerEye(layer), layer % wallCount);
+	}
+
+	//! Whether any of a wall can be in view. Conservative: only walls with all four corners
+	// beyond the same clip plane are out.
+	// @input verts The wall's world space corners
+	// @input viewProjection The eye's projection * view
+	//
+	// @return Returns false if the wall is certainly outside the view frustum
+	static bool wallInView(const vec3 verts[4], const mat4 & viewProjection) {
+		int outside[6] = { 0, 0, 0, 0, 0, 0 };
+		for (int i = 0; i < 4; i++) {
+			vec4 clip = viewProjection * vec4(verts[i], 1.f);
+			outside[0] += clip.x < -clip.w;
+			outside[1] += clip.x > clip.w;
+			outside[2] += clip.y < -clip.w;
+			outside[3] += clip.y > clip.w;
+			outside[4] += clip.z < -clip.w;
+			outside[5] += clip.z > clip.w;
+		}
+		for (int plane = 0; plane < 6; plane++) {
+			if (outside[plane] == 4)
+				return false;
+		}
+		return true;
+	}
+
+	//! Fraction of the viewport a wall's screen space bounds cover.
+	// @input verts The wall's world space corners
+	// @input viewProjection The eye's projection * view
+	//
+	// @return Returns 0 to 1, and 1 if a corner is behind the eye (where the bounds are not known)
+	static float wallCoverage(const vec3 verts[4], const mat4 & viewProjection) {
+		vec2 lo(1.f), hi(-1.f);
+		for (int i = 0; i < 4; i++) {
+			vec4 clip = viewProjection * vec4(verts[i], 1.f);
+			if (clip.w <= 0.0001f)
+				return 1.f;
+			vec2 ndc = vec2(clip) / clip.w;
+			lo = glm::min(lo, ndc);
+			hi = glm::max(hi, ndc);
+		}
+		lo = glm::clamp(lo, vec2(-1.f), vec2(1.f));
+		hi = glm::clamp(hi, vec2(-1.f), vec2(1.f));
+		vec2 extent = glm::max(hi - lo, vec2(0.f));
+		return extent.x * extent.y / 4.f;
+	}
+
+	// Matrices are per instance (per view with multiview), layerIds says which layer each
+	// instance draws to. With walls.gpu_projection the vertex shader has the views instead.
+	void setLayerUniforms(const SceneProgram & prog, int firstLayer, const GLint * layerIds, GLsizei count) {
+		prog.projectWalls.set(gpuWallProjection ? 1 : 0);
+		if (gpuWallProjection)
+			wallViews.bind();
+		else {
+			mat4 layerMatrices[MAX_WALL_LAYERS];
+			for (int i = 0; i < count; i++)
+				layerMatrices[i] = wallRenderMatrix(firstLayer + layerIds[i]);
+			prog.layerMatrices.set(layerMatrices, count);
+		}
+		prog.layerIds.set(layerIds, count);
+		prog.layerCount.set(count);
+		//The bands go by the layer of the target, not the instance
+		if (!variableWalls)
+			return;
+		vec4 edges[MAX_WALL_LAYERS], packed[MAX_WALL_LAYERS];
+		GLsizei used = 0;
+		for (int i = 0; i < count; i++) {
+			WallBands bands = layerBands(firstLayer + layerIds[i]);
+			for (; used <= layerIds[i]; used++)
+				edges[used] = packed[used] = vec4(0.5f);
+			edges[layerIds[i]] = bands.edges;
+			packed[layerIds[i]] = bands.packed;
+		}
+		prog.bandEdges.set(edges, used);
+		prog.bandPacked.set(packed, used);
+	}
+
+	// A wall pass draws the sky over all of its viewport, so only depth needs clearing. The
+	// analytic sky leaves the sky out and marks coverage in alpha, that needs the color
+	// cleared to 0. Color is not invalidated: past the viewport the target keeps the wall of
+	// the pass before, which the composite's filtering and the mips may still touch.
+	void clearWallTarget() const {
+		glClear(analyticSky ? GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT : GL_DEPTH_BUFFER_BIT);
+	}
+
+	//! Render the box and skybox into layerCount layers of a wall array in one submission.
+	// @input target A layered (or multiview) target with layerCount layers
+	// @input firstLayer Which eye and wall combination (eye * wallCount + wall) layer 0 is
+	// @input layerCount Both eyes' walls at once, or the walls of one eye
+	// @return Whether it rendered, the target's depth is the caller's to discard then
+	bool renderLayeredWalls(const RenderTarget & target, int firstLayer, int layerCount) {
+		CpuScope scope("wall pass", firstLayer);
+		//Instances only go to the visible layers, multiview always renders every view
+		bool multiview = multiviewWalls && layerCount == 2 * wallCount;
+		GLint layerIds[MAX_WALL_LAYERS];
+		GLsizei visibleCount = 0;
+		bool dirty = false;
+		for (int i = 0; i < layerCount; i++) {
+			int layer = firstLayer + i;
+			bool visible = layerDrawn(layer);
+			dirty = dirty || (visible && !wallLayerCurrent(layer));
+			if (multiview || visible)
+				layerIds[visibleCount++] = i;
+		}
+		//Nothing visible, or nothing visible would change, or not this frame's turn (once
+		//every visible layer has been rendered)
+		if (!dirty)
+			return false;
+		if (!wallSchedule.passDue()) {
+			bool rendered = true;
+			for (int i = 0; i < layerCount; i++)
+				rendered = rendered && (!layerDrawn(firstLayer + i) || (wallLayerStates[firstLayer + i].valid && wallRegionCovered(firstLayer + i)));
+			if (rendered)
+				return false;
+		}
+		if (warpLayers(target, firstLayer, layerCount))
+			return true;
+		//The layers that are not drawn are not shown either, they are rendered again first
+		for (int i = 0; i < layerCount; i++)
+			wallLayerStates[firstLayer + i].valid = false;
+		for (int i = 0; i < visibleCount; i++)
+			setWallLayerRendered(firstLayer + layerIds[i]);
+
+		int viewer = firstLayer / (2 * wallCount);
+		GpuScope gpuScope(viewer ? viewerGpuPasses[viewer] : layerCount == 2 * wallCount ? stereoGpuPass : layeredGpuPasses[firstLayer / wallCount]);
+		if (!viewer && wallCubeCapture.active()) {
+			renderCubeCapture(target, firstLayer, layerCount, layerIds, visibleCount);
+			return true;
+		}
+		RenderTargetCache::bind(target);
+		clearWallTarget();
+
+		//Each layer gets its own viewport (the geometry shader picks it), multiview views
+		//can only share one
+		GLsizei shared = 0;
+		GLint extents[MAX_WALL_LAYERS];
+		for (int i = 0; i < layerCount; i++) {
+			int layer = firstLayer + i;
+			GLsizei size = wallResolution.size(layerEye(layer), layer % wallCount);
+			shared = std::max(shared, size);
+			extents[i] = size;
+			wallRenderSizes[layer] = wallTemporal.renderSize(layer, size);
+			if (!multiview && variableWalls) {
+				//The bands packed together take up less than size, and not the same both ways
+				glm::ivec2 extent = layerBands(layer).extent;
+				glViewportIndexedf(i, 0.f, 0.f, (float)extent.x, (float)extent.y);
+				wallUvScale[layer] = vec2(extent) / (float)target.width;
+				extents[i] = std::max(extent.x, extent.y);
+			}
+			else if (!multiview) {
+				glViewportIndexedf(i, 0.f, 0.f, (float)wallRenderSizes[layer], (float)wallRenderSizes[layer]);
+				wallUvScale[layer] = vec2((float)size / (float)target.width);
+				if (partialWalls)
+					scissorWall(i, layer, wallRenderSizes[layer]);
+			}
+		}
+		if (partialWalls)
+			glEnable(GL_SCISSOR_TEST);
+		if (multiview) {
+			GLsizei sharedRender = wallTemporal.renderSize(firstLayer, shared);
+			glViewport(0, 0, sharedRender, sharedRender);
+			for (int i = 0; i < layerCount; i++) {
+				wallUvScale[firstLayer + i] = vec2((float)shared / (float)target.width);
+				extents[i] = shared;
+				wallRenderSizes[firstLayer + i] = sharedRender;
+			}
+		}
+		const SceneProgram & prog = multiview ? wallMultiviewProg : wallLayeredProg;
+		GLsizei instances = multiview ? 1 : visibleCount;
+
+		GLuint cube = boxTexture(0);
+		uint32_t layerMask = 0;
+		uint64_t pixels = 0;
+		for (int i = 0; i < visibleCount; i++) {
+			layerMask |= 1u << (firstLayer + layerIds[i]);
+			pixels += (uint64_t)extents[layerIds[i]] * (uint64_t)extents[layerIds[i]];
+		}
+		//The geometry stage clips each band's copy of a triangle to the band
+		bool bandClip = variableWalls && !multiview;
+		for (int plane = 0; plane < 4 && bandClip; plane++)
+			glEnable(GL_CLIP_DISTANCE0 + plane);
+		drawWallScene(prog, multiview ? depthMultiviewProg : depthLayeredProg, pixels, [&](const SceneProgram & pass, bool positionsOnly) {
+			setLayerUniforms(pass, firstLayer, layerIds, visibleCount);
+			pass.layerBase.set(firstLayer);
+			pass.wallCount.set(wallCount);
+			//The right eye's layers sample unit 1, the draws bind the left eye's texture to unit 0
+			if (!positionsOnly)
+				pass.bindTexture(pass.cubeboxRight, 1, GL_TEXTURE_CUBE_MAP, boxTexture(1));
+			drawWallObjects(pass, cube, instances, layerMask, positionsOnly);
+			if (gpuCullProps)
+				drawCulledProps(pass, firstLayer, layerIds, visibleCount, true, positionsOnly);
+		});
+		drawUnoccludedProps(prog, target, firstLayer, layerCount, layerIds, visibleCount, true, cube);
+		if (drawPointCloud(firstLayer, layerIds, visibleCount, multiview))
+			prog.use();
+
+		if (!analyticSky) {
+			prog.bindTexture(prog.cubeboxRight, 1, GL_TEXTURE_CUBE_MAP, wallSkyTexture(1));
+			drawWallSky(prog, wallSkyTexture(0), instances);
+		}
+		for (int plane = 0; plane < 4 && bandClip; plane++)
+			glDisable(GL_CLIP_DISTANCE0 + plane);
+		if (partialWalls)
+			glDisable(GL_SCISSOR_TEST);
+		//The temporal history and the reprojection read the depth as well
+		bool keepDepth = wallTemporal.valid() || wallReprojection.valid();
+		for (int i = 0; i < visibleCount && target.samples > 1; i++)
+			renderTargets.resolve(target, layerIds[i], extents[layerIds[i]], extents[layerIds[i]], keepDepth);
+		for (int i = 0; i < visibleCount && wallTemporal.valid(); i++) {
+			int layer = firstLayer + layerIds[i];
+			wallTemporal.resolve(target, layerIds[i], layer, wallRenderSizes[layer], extents[layerIds[i]], wallLayerMatrix(layer));
+		}
+		uint64_t scene = wallSceneVersion();
+		for (int i = 0; i < visibleCount; i++) {
+			int layer = firstLayer + layerIds[i];
+			wallReprojection.keep(target, layerIds[i], layer, extents[layerIds[i]], wallLayerMatrix(layer), eyePos[layer / wallCount], scene);
+		}
+		wallMips.generate(target, layerCount, extents);
+		return true;
+	}
+
+	//! The layers of a layered pass of the first viewer resampled from a cube per eye
+	// (WallCubeCapture): the scene into the faces any of the eye's visible walls are in, in
+	// one layered submission, then each visible layer looked up from its eye's cube.
+	void renderCubeCapture(const RenderTarget & target, int firstLayer, int layerCount, const GLint * layerIds, GLsizei visibleCount) {
+		int firstEye = firstLayer / wallCount;
+		int eyes = layerCount / wallCount;
+		mat4 faceMatrices[WallCubeCapture::MAX_EYES * WallCubeCapture::FACES];
+		GLint faceIds[WallCubeCapture::MAX_EYES * WallCubeCapture::FACES];
+		GLsizei faceCount = 0;
+		uint32_t layerMask = 0;
+		for (int i = 0; i < visibleCount; i++)
+			layerMask |= 1u << (firstLayer + layerIds[i]);
+		for (int e = 0; e < eyes; e++) {
+			int eye = firstEye + e;
+			mat4 * faces = &faceMatrices[e * WallCubeCapture::FACES];
+			WallCubeCapture::faceMatrices(eyePos[eye], wallModelviews[eye], faces);
+			for (int face = 0; face < WallCubeCapture::FACES; face++) {
+				bool seen = false;
+				for (int i = 0; i < wallCount && !seen; i++)
+					seen = layerDrawn(layerIndex(eye, i)) && wallInView(wallVerts[i], faces[face]);
+				if (seen) {
+					faceMatrices[faceCount] = faces[face];
+					faceIds[faceCount++] = e * WallCubeCapture::FACES + face;
+				}
+			}
+		}
+
+		wallCubeCapture.beginCapture(eyes);
+		GLuint cube = boxTexture(0);
+		GLsizei side = wallCubeCapture.faceSize();
+		//The faces stand in for the layers: wallLayered.geom takes a face's eye from its
+		//layer over six
+		drawWallScene(wallLayeredProg, depthLayeredProg, (uint64_t)faceCount * (uint64_t)side * (uint64_t)side,
+			[&](const SceneProgram & pass, bool positionsOnly) {
+			pass.projectWalls.set(0);
+			pass.layerMatrices.set(faceMatrices, faceCount);
+			pass.layerIds.set(faceIds, faceCount);
+			pass.layerCount.set(faceCount);
+			pass.layerBase.set(firstEye * WallCubeCapture::FACES);
+			pass.wallCount.set(WallCubeCapture::FACES);
+			if (!positionsOnly)
+				pass.bindTexture(pass.cubeboxRight, 1, GL_TEXTURE_CUBE_MAP, boxTexture(1));
+			drawWallObjects(pass, cube, faceCount, layerMask, positionsOnly);
+		});
+		if (!analyticSky) {
+			wallLayeredProg.bindTexture(wallLayeredProg.cubeboxRight, 1, GL_TEXTURE_CUBE_MAP, wallSkyTexture(1));
+			drawWallSky(wallLayeredProg, wallSkyTexture(0), faceCount);
+		}
+		RenderTargetCache::discardDepth();
+
+		GLint extents[MAX_WALL_LAYERS];
+		for (int i = 0; i < layerCount; i++) {
+			int layer = firstLayer + i;
+			extents[i] = wallResolution.size(layerEye(layer), layer % wallCount);
+			wallRenderSizes[layer] = extents[i];
+			wallUvScale[layer] = vec2((float)extents[i] / (float)target.width);
+		}
+		for (int i = 0; i < visibleCount; i++) {
+			int layer = firstLayer + layerIds[i];
+			wallCubeCapture.resample(target, layerIds[i], layer / wallCount - firstEye, extents[layerIds[i]], wallProjections[layer]);
+		}
+		wallMips.generate(target, layerCount, extents);
+	}
+
+	// What the wall passes draw, as an indirect draw list. Recorded once a frame, again only
+	// if the box was moved between the eyes' passes. A list kept past its frame puts its
+	// instances back in the frame ring itself before it is drawn.
+	void recordDrawList() {
+		const mat4 & boxModel = entities.world(boxEntity);
+		if (!indirectDraws || (!drawListStale && drawListBox == boxModel))
+			return;
+		drawList.begin();
+		//A skinned box draws from its own buffer, next to the list
+		if (!skinnedBox.valid())
+			drawList.add(DRAW_SCENE, MeshPool::BOX, boxModel);
+		//The props any layer can see, in runs of neighbours at one level of detail so their
+		//matrices go in as they are
+		const mat4 * propWorlds = entities.worldMatrices() + 1;
+		for (size_t i = 0; i < propCount && !gpuCullProps;) {
+			size_t end = i;
+			int level = propLodActive ? propLods.level(i) : 0;
+			while (end < propCount && (!cullProps || propMasks[end]) && (!propLodActive || propLods.level(end) == level))
+				end++;
+			if (end > i)
+				drawList.add(DRAW_SCENE, propLodActive ? propMeshInfo.lodIds[level] : propMesh, propWorlds + i, (GLsizei)(end - i),
+					drawnPropTiles() ? drawnPropTiles() + i : nullptr);
+			i = std::max(end, i + 1);
+		}
+		drawList.add(DRAW_SKY, MeshPool::BOX, glm::scale(mat4(1.f), vec3(SKYBOX_SIZE)));
+		drawList.end();
+		drawListStale = false;
+		drawListBox = boxModel;
+	}
+
+	//! The wall objects of a pass, with the depth pre-pass first while it is on: draw(pass,
+	// positionsOnly) once with depthProg and the color masked, then with prog against that
+	// depth, GL_EQUAL and no depth writes. Leaves prog bound.
+	// @input pixels The area of the pass's viewports, for the overdraw DepthPrepass measures
+	template <typename Draw>
+	void drawWallScene(const SceneProgram & prog, const SceneProgram & depthProg, uint64_t pixels, Draw draw) {
+		bool prepass = depthPrepass.active() && depthProg.program.valid();
+		if (prepass) {
+			depthProg.use();
+			glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+			draw(depthProg, true);
+			glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+			glDepthFunc(GL_EQUAL);
+			glState().depthMask(false);
+		}
+		prog.use();
+		depthPrepass.beginMeasure();
+		draw(prog, false);
+		depthPrepass.endMeasure(pixels);
+		if (prepass) {
+			glDepthFunc(GL_LESS);
+			glState().depthMask(true);
+		}
+	}
+
+	// The box and the props, each repeat times for the layered passes. layerMask has the
+	// bits of the wall layers drawn, only the props they can see are. positionsOnly draws
+	// the indirect ones from the pool's positions stream, for the depth pre-pass.
+	void drawWallObjects(const SceneProgram & prog, GLuint cube, GLsizei repeat, uint32_t layerMask, bool positionsOnly = false) {
+		prog.bindTexture(prog.cubebox, 0, GL_TEXTURE_CUBE_MAP, cube);
+		if (!positionsOnly)
+			bindLighting(prog);
+		prog.lit.set(1);
+		if (indirectDraws) {
+			if (skinnedBox.valid()) {
+				prog.transform.set(entities.world(boxEntity));
+				skinnedBox.drawInstanced(repeat);
+			}
+			setPropAtlas(prog, true);
+			drawListGroup(prog, DRAW_SCENE, repeat, positionsOnly);
+			setPropAtlas(prog, false);
+			prog.lit.set(0);
+			return;
+		}
+		prog.transform.set(entities.world(boxEntity));
+		if (skinnedBox.valid())
+			skinnedBox.drawInstanced(repeat);
+		else
+			box->drawInstanced(prog.id(), 0, repeat);
+		//Every prop once per instance of the draw above
+		drawProps(prog, repeat, layerMask);
+		prog.lit.set(0);
+	}
+
+	void drawWallSky(const SceneProgram & prog, GLuint texture, GLsizei repeat) {
+		if (indirectDraws) {
+			prog.bindTexture(prog.cubebox, 0, GL_TEXTURE_CUBE_MAP, texture);
+			beginSkybox(prog);
+			drawListGroup(prog, DRAW_SKY, repeat);
+			endSkybox(prog);
+			return;
+		}
+		prog.transform.set(glm::scale(glm::mat4(1.0f), glm::vec3(SKYBOX_SIZE)));
+		drawSkybox(prog, skybox.get(), texture, repeat);
+	}
+
+	// The list's models are per instance, transform only has to leave them alone
+	void drawListGroup(const SceneProgram & prog, int group, GLsizei repeat, bool positionsOnly = false) {
+		prog.transform.set(mat4(1.f));
+		prog.instanced.set(1);
+		glState().polygonMode(GL_FILL);
+		drawList.draw(group, repeat, positionsOnly);
+		prog.instanced.set(0);
+	}
+
+	//! Adds the mesh the props are drawn with to the mesh pool.
+	// @input source A model (its .p3mesh from MeshBuilder is loaded) or a .p3mesh. Empty
+	//		keeps the cube, as does a mesh that cannot be loaded.
+	void loadPropMesh(const std::string & source) {
+		if (source.empty())
+			return;
+		std::string path = meshFilePath(source);
+		int id = meshPool().load(path.c_str(), &propMeshInfo);
+		if (id < 0) {
+			std::cerr << "props.mesh: " << path << " not loaded, the props stay cubes" << std::endl;
+			return;
+		}
+		propMesh = id;
+		for (int axis = 0; axis < 3; axis++)
+			propExtent[axis] = std::max(std::max(std::fabs(propMeshInfo.boundsMin[axis]),
+				std::fabs(propMeshInfo.boundsMax[axis])), 1e-4f);
+		//props.lod_pixels is how far off a level may be on a wall target before a finer one
+		//is drawn
+		propLodActive = propMeshInfo.lodCount > 1 && config().getBool("props.lod", true);
+		if (propLodActive)
+			propLods.configure(propMeshInfo.lodError, propMeshInfo.lodCount, config().getFloat("props.lod_pixels", 1.f),
+				config().getFloat("props.lod_hysteresis", 0.25f));
+	}
+
+	//! Rigs the box for skin.active, the cube or the model of source (as loadPropMesh takes
+	// it). Without compute shaders the box stays as it is.
+	void setupSkin(const std::string & source) {
+		if (!config().getBool("skin.active", false))
+			return;
+		int mesh = MeshPool::BOX;
+		vec3 boundsMin(-1.f), boundsMax(1.f);
+		if (!source.empty()) {
+			std::string path = meshFilePath(source);
+			MeshInfo info;
+			int id = meshPool().load(path.c_str(), &info);
+			if (id < 0) {
+				std::cerr << "skin.mesh: " << path << " not loaded, the cube is skinned" << std::endl;
+			}
+			else {
+				mesh = id;
+				boundsMin = vec3(info.boundsMin[0], info.boundsMin[1], info.boundsMin[2]);
+				boundsMax = vec3(info.boundsMax[0], info.boundsMax[1], info.boundsMax[2]);
+			}
+		}
+		if (skinnedBox.init(mesh, boundsMin, boundsMax, config().getInt("skin.bones", 4)))
+			skinnedBox.setMotion(config().getFloat("skin.amplitude", 0.3f), config().getFloat("skin.speed", 2.f));
+	}
+
+	//! Places count props on a grid filling props.spread around the origin, each one a
+	// calibration cube (or the props.mesh model) props.size across
+	void setupProps(int count) {
+		if (count <= 0)
+			return;
+		float spread = config().getFloat("props.spread", 1.f);
+		float size = config().getFloat("props.size", 0.05f);
+		//The widest side of the model is size across, whatever its units
+		float scale = size * 0.5f / std::max(propExtent.x, std::max(propExtent.y, propExtent.z));
+		int side = 1;
+		while (side * side * side < count)
+			side++;
+
+		float step = side > 1 ? 2.f * spread / (float)(side - 1) : 0.f;
+		for (int i = 0; i < count; i++) {
+			vec3 cell = vec3((float)(i % side), (float)(i / side % side), (float)(i / (side * side)));
+			vec3 position = side > 1 ? cell * step - vec3(spread) : vec3(0.f);
+			entities.create(position, glm::quat(), vec3(scale), propExtent);
+		}
+		initProps(count);
+	}
+
+	// The count entities after the box are the props, set up to draw them
+	void initProps(size_t count) {
+		if (!count)
+			return;
+		propCount = count;
+		cullProps = config().getBool("props.cull", true);
+		parallelRecord = config().getBool("walls.parallel_record", false);
+		propBvh = config().getBool("props.bvh", true);
+		propMasks.assign(propCount, ~0u);
+		propLods.resize(propCount);
+		props.reset(new Box());
+		props->setMesh(propMesh);
+		updateEntities();
+		//The whole set once, so the culled sets written over it every pass always fit
+		if (cullProps)
+			props->setInstanceTransforms(entities.worldMatrices() + 1, propCount);
+		physics.configure(entities, 1, propCount);
+	}
+
+	// Hands the props to the compute culling, if the GL can run it, in place of culling and
+	// picking levels on the CPU. samples is the wall targets'.
+	void setupGpuCulling(GLsizei samples) {
+		//The pyramids are built from single sampled depth of a whole square per layer
+		bool occlusion = config().getBool("props.occlusion", false);
+		if (occlusion && (samples > 1 || wallResolution.variable())) {
+			std::cerr << "props.occlusion does not work with walls.msaa or walls.variable, culling against the views only" << std::endl;
+			occlusion = false;
+		}
+		int layers = viewerCount * 2 * wallCount;
+		occlusion = occlusion && wallOcclusion.init(layers, wallResolution.maxBase());
+		if (!propCuller.init(propMesh, propCount, layers, drawnPropTiles() != nullptr, occlusion)) {
+			wallOcclusion.release();
+			return;
+		}
+		if (occlusion)
+			propCuller.setOcclusion(wallOcclusion.texture(), wallOcclusion.layerBuffer());
+		gpuCullProps = true;
+		cullProps = false;
+		propLodActive = false;
+		drawListStale = true;
+		propCuller.update(entities.worldMatrices() + 1, entities.boundsMin() + 1, entities.boundsMax() + 1, propsVersion);
+		if (drawnPropTiles())
+			propCuller.updateTiles(drawnPropTiles());
+	}
+
+	// shaders.hot_reload watches the scene programs' files, every shaders.reload_ms
+	void setupShaderReload() {
+		shaderReloader.configure(config().getBool("shaders.hot_reload", false), config().getInt("shaders.reload_ms", 500));
+		if (!shaderReloader.enabled())
+			return;
+		for (SceneProgram * prog : { &shaderProg, &debugLinesProg, &wallLayeredProg, &wallMultiviewProg, &depthProg, &depthLayeredProg,
+			&depthMultiviewProg, &shadowProg }) {
+			if (prog->program.valid())
+				shaderReloader.watch(prog->program, [prog] { prog->bindUniforms(); });
+		}
+		screenVariants.watch(shaderReloader);
+		screenArrayVariants.watch(shaderReloader);
+		raycastVariants.watch(shaderReloader);
+		mergedVariants.watch(shaderReloader);
+	}
+
+	//! Loads the props' atlas and gives each prop its entry, the entries taken in turn.
+	// Without the draw list there is nowhere to put the tiles and the props keep the box's
+	// texture.
+	void setupPropAtlas(const std::string & file) {
+		if (file.empty())
+			return;
+		if (!indirectDraws) {
+			std::cerr << "props.atlas needs the indirect draw list, the props keep the box's texture" << std::endl;
+			return;
+		}
+		if (!propAtlas.load(file.c_str()) || !propAtlas.size()) {
+			propAtlas.release();
+			return;
+		}
+		//The cube has no UVs of its own, its faces are mapped instead
+		propAtlasMode = propMesh == MeshPool::BOX ? 2 : 1;
+		propTiles.assign(propCount, noAtlasTile());
+		refreshPropTiles();
+	}
+
+	//! Writes the scene as it was set up to a snapshot scene.snapshot can load instead.
+	// @input atlasFile The props' atlas, empty for none
+	void writeSnapshot(const std::string & filename, const std::string & atlasFile) {
+		SceneSnapshotContent content;
+		content.entityCount = entities.size();
+		content.positions = entities.positionArray();
+		content.rotations = entities.rotationArray();
+		content.scales = entities.scaleArray();
+		content.extents = entities.extentArray();
+		//The box, then the props' entries as they were given out
+		std::vector<int32_t> entries(content.entityCount, -1);
+		for (size_t i = 0; i < propCount && propAtlas.valid(); i++)
+			entries[i + 1] = snapshot.header ? snapshot.atlasEntries[i + 1] : (int32_t)(i % propAtlas.size());
+		content.atlasEntries = entries.data();
+		for (size_t i = 0; i < cave.size(); i++)
+			content.walls.push_back(cave.wall(i));
+		content.mesh = snapshot.header ? snapshot.mesh : config().getString("props.mesh");
+		content.atlas = propAtlas.valid() ? atlasFile : std::string();
+		content.skybox = skyboxSets[skyboxActive].name;
+		if (writeSceneSnapshot(filename.c_str(), content))
+			logStream(LOG_INFO) << "scene snapshot written to " << filename << std::endl;
+		else
+			std::cerr << "scene.write_snapshot: could not write " << filename << std::endl;
+	}
+
+	// Each prop's tile as its page is now, asking for the pages not in yet
+	void refreshPropTiles() {
+		for (size_t i = 0; i < propCount; i++) {
+			//A snapshot's entries are the ones it was written with, an atlas changed since may
+			//not have them
+			int64_t entry = snapshot.header ? snapshot.atlasEntries[i + 1] : (int64_t)(i % propAtlas.size());
+			propTiles[i] = entry >= 0 && (size_t)entry < propAtlas.size() ? propAtlas.tile((size_t)entry) : noAtlasTile();
+		}
+		if (propShadingActive) {
+			//The views keep sampling the same cache tiles, only what is shaded into them changed
+			propShading.updateMaterials(propTiles.data());
+			return;
+		}
+		drawListStale = true;
+		if (gpuCullProps)
+			propCuller.updateTiles(propTiles.data());
+	}
+
+	// Uploads some of the atlas pages the props asked for, at most about budget bytes of them.
+	// Returns the bytes uploaded.
+	size_t updatePropAtlas(size_t budget) {
+		size_t uploaded = 0;
+		if (propAtlas.valid() && propAtlas.update(budget, &uploaded))
+			refreshPropTiles();
+		return uploaded;
+	}
+
+	//! Queues the frame's uploads with the scheduler and runs them, within its budget and
+	// what is drawn already missing them first (UploadScheduler)
+	// @input displayTime When the frame is shown, which the video's frame is due by. 0 leaves
+	// the video as it is.
+	void serviceUploads(double displayTime) {
+		if (displayTime > 0.0 && video.valid())
+			uploadScheduler.queue("video", UploadScheduler::VISIBLE, displayTime, [this, displayTime](size_t) {
+				return updateVideo(displayTime);
+			});
+		uploadScheduler.queue("virtual sky", UploadScheduler::VISIBLE, 0.0, [this](size_t budget) {
+			return virtualSky.update(budget);
+		});
+		uploadScheduler.queue("prop atlas", UploadScheduler::VISIBLE, 0.0, [this](size_t budget) {
+			return updatePropAtlas(budget);
+		});
+		if (pointCloud.valid())
+			uploadScheduler.queue("point cloud", UploadScheduler::VISIBLE, 0.0, [this](size_t budget) {
+				return pointCloud.update(budget);
+			});
+		//The skybox being swapped to is waited for, everything else is ahead of time
+		uploadScheduler.queue("textures", skyboxPending >= 0 ? UploadScheduler::VISIBLE : UploadScheduler::PREFETCH, 0.0,
+			[this](size_t budget) { return assets.update(budget); });
+		uploadScheduler.service();
+	}
+
+	//! Shades the cube props into the shading cache, each face of each one with the material
+	// the views would have given it. Needs the draw list to hand the views the cache's tiles.
+	// @input faceSize Texels on a side of a face, about as big as a prop gets on a wall
+	void setupPropShading(int faceSize) {
+		if (!indirectDraws) {
+			std::cerr << "props.shading_cache needs the indirect draw list, the props are shaded in every view" << std::endl;
+			return;
+		}
+		//Where on a mesh file's surface a texel of its UVs is, the cache has no way to know
+		if (propMesh != MeshPool::BOX) {
+			std::cerr << "props.shading_cache lays out the cube's faces, mesh props are shaded in every view" << std::endl;
+			return;
+		}
+		if (!propShading.init(propCount, faceSize, lightingOn))
+			return;
+		propShadingActive = true;
+		propShadingTiles.resize(propCount);
+		for (size_t i = 0; i < propCount; i++)
+			propShadingTiles[i] = propShading.tile(i);
+		if (!propTiles.empty())
+			propShading.updateMaterials(propTiles.data());
+		drawListStale = true;
+	}
+
+	// The tiles the draws of the props are given, nullptr for none
+	const AtlasTile * drawnPropTiles() const {
+		if (propShadingActive)
+			return propShadingTiles.data();
+		return propTiles.empty() ? nullptr : propTiles.data();
+	}
+
+	// The props' shading for every view of the frame, once
+	void shadeProps() {
+		if (!propShadingActive)
+			return;
+		GpuScope gpuScope(propShadingGpuPass);
+		propShading.updateTransforms(entities.worldMatrices() + 1, propsVersion);
+		propShading.shade(assets.get("calibration_cube"), propAtlas.valid() ? propAtlas.id() : 0, lightingOn ? &lighting : nullptr);
+	}
+
+	//! The lights of lighting.enabled: a sun, and lighting.lights point lights (up to
+	// LightingBlock::MAX_LIGHTS) in a ring around the box, over a light grid lighting.extent
+	// meters each way from the origin
+	void setupLighting() {
+		float extent = std::max(config().getFloat("lighting.extent", 2.f), 0.1f);
+		if (!shadowProg.program.valid() || !lighting.init(vec3(-extent), vec3(extent), config().getInt("lighting.shadow_size", 1024))) {
+			std::cerr << "lighting could not be set up, the scene stays unlit" << std::endl;
+			lightingOn = false;
+			return;
+		}
+		static const vec3 lightColors[] = { vec3(1.f, 0.6f, 0.3f), vec3(0.3f, 0.5f, 1.f), vec3(0.4f, 1.f, 0.5f), vec3(1.f, 0.4f, 0.8f) };
+		int count = std::min(std::max(config().getInt("lighting.lights", 8), 0), (int)LightingBlock::MAX_LIGHTS);
+		for (int i = 0; i < count; i++) {
+			float angle = 6.2831853f * (float)i / (float)count;
+			vec3 position = vec3(std::cos(angle), 0.5f, std::sin(angle)) * (0.6f * extent);
+			lighting.setPointLight((size_t)i, position, 0.75f * extent, lightColors[i % 4]);
+		}
+	}
+
+	//! What the frame's lighting needs for every view: the light grid if a light changed, and
+	// the sun's shadows of the wall passes' objects where they are now. Props no wall drew
+	// last time (the draw list's) and props culled on the GPU cast none.
+	void updateLighting() {
+		if (!lightingOn)
+			return;
+		lighting.beginFrame();
+		lighting.bindBlock();
+		recordDrawList();
+		GpuScope gpuScope(shadowGpuPass);
+		lighting.renderShadows([this]() {
+			shadowProg.use();
+			drawWallObjects(shadowProg, assets.get("calibration_cube"), 1, ~0u, true);
+		});
+	}
+
+	//! walls.cube_capture: off, on, or auto to capture only with more walls than a cube has
+	// faces and while that measures cheaper. The faces are walls.cube_capture_size texels
+	// square. The cube is drawn with the layered program and the props culled on the CPU.
+	void setupVideo() {
+		std::string file = config().getString("video.file", "");
+		if (file.empty() || !video.open(file, config().getBool("video.loop", true)))
+			return;
+		videoOnSky = config().getString("video.target", "box") == "sky";
+		//video.stereo is mono, sbs (the left eye's half on the left) or tb (the left eye's on
+		//top). video.layout is flat, the frame on every face, or cube3x2, the faces in a grid.
+		std::string stereo = config().getString("video.stereo", "mono");
+		videoStereo = stereo == "sbs" ? VIDEO_SIDE_BY_SIDE : stereo == "tb" ? VIDEO_TOP_BOTTOM : VIDEO_MONO;
+		videoCubeLayout = config().getString("video.layout", videoOnSky ? "cube3x2" : "flat") == "cube3x2";
+		videoFaceSize = std::max(config().getInt("video.face_size", 1024), 16);
+		for (int eye = 0; eye < 2; eye++) {
+			videoCubes[eye].create();
+			glBindTexture(GL_TEXTURE_CUBE_MAP, videoCubes[eye]);
+			for (int face = 0; face < 6; face++)
+				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGBA8, videoFaceSize, videoFaceSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, 0);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+			gpuMemory().allocate(GpuMemory::KIND_TEXTURE, videoCubes[eye], textureBytes(GL_RGBA8, videoFaceSize, videoFaceSize, 6, 1),
+				GpuMemory::TEXTURE, "video cube");
+		}
+		glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+	}
+
+	//! pointcloud.file, a .p3points file from MeshBuilder, drawn in the wall passes. It takes
+	// at most pointcloud.gpu_mb of buffer and draws at most pointcloud.max_points points a
+	// frame, refining while its points are more than pointcloud.pixel_spacing pixels apart;
+	// the points are drawn pointcloud.point_scale times their spacing. The longest side of its
+	// bounds is pointcloud.size meters, around pointcloud.x, y and z. Cube capture does not
+	// draw it.
+	void setupPointCloud() {
+		std::string file = config().getString("pointcloud.file");
+		if (file.empty())
+			return;
+		if (!pointCloud.open(file.c_str(), (uint64_t)std::max(config().getInt("pointcloud.gpu_mb", 512), 16) << 20,
+				(uint64_t)std::max(config().getInt("pointcloud.max_points", 8000000), 1)))
+			return;
+		pointCloud.setPixelSpacing(std::max(config().getFloat("pointcloud.pixel_spacing", 1.5f), 0.25f));
+		pointCloudPointScale = std::max(config().getFloat("pointcloud.point_scale", 1.f), 0.f);
+		vec3 lo = pointCloud.boundsMin(), hi = pointCloud.boundsMax();
+		vec3 extent = hi - lo;
+		float longest = std::max(std::max(extent.x, extent.y), extent.z);
+		pointCloudScale = longest > 0.f ? config().getFloat("pointcloud.size", 2.f) / longest : 1.f;
+		vec3 center(config().getFloat("pointcloud.x", 0.f), config().getFloat("pointcloud.y", 0.f), config().getFloat("pointcloud.z", 0.f));
+		pointCloud.setModel(glm::translate(mat4(1.f), center) * glm::scale(mat4(1.f), vec3(pointCloudScale))
+			* glm::translate(mat4(1.f), -0.5f * (lo + hi)));
+
+		pointCloudProg.load("pointCloud.vert", "pointCloud.geom", "pointCloud.frag");
+		if (multiviewWalls) {
+			ShaderVariants multiview;
+			multiview.constant("VIEWS", 2 * wallCount);
+			pointCloudMultiviewProg.load("pointCloud.vert", nullptr, "pointCloud.frag", "#define MULTIVIEW\n" + multiview.defines(0));
+		}
+		for (SceneProgram * prog : { &pointCloudProg, &pointCloudMultiviewProg }) {
+			if (shaderReloader.enabled() && prog->program.valid())
+				shaderReloader.watch(prog->program, [prog] { prog->bindUniforms(); });
+		}
+	}
+
+	//! Shows the video's frame due by displayTime in both eyes' cubes, if there is a new one
+	// @return The bytes of the frame copied, 0 without a new one
+	size_t updateVideo(double displayTime) {
+		if (!video.valid() || !video.update(displayTime))
+			return 0;
+		GpuScope gpuScope(videoGpuPass);
+		int width = video.width(), height = video.height();
+		for (int eye = 0; eye < 2; eye++) {
+			int x = 0, y = 0, w = width, h = height;
+			if (videoStereo == VIDEO_SIDE_BY_SIDE) {
+				w = width / 2;
+				x = eye * w;
+			}
+			else if (videoStereo == VIDEO_TOP_BOTTOM) {
+				//The frame's rows are top first
+				h = height / 2;
+				y = eye * h;
+			}
+			video.blitToCube(videoCubes[eye], videoFaceSize, x, y, w, h, videoCubeLayout);
+		}
+		videoFrame++;
+		//BGRA
+		return (size_t)width * (size_t)height * 4;
+	}
+
+	// The box's texture and the walls' sky for eye, the video's cube in place of one of them
+	GLuint boxTexture(int eye) {
+		return video.texture() && !videoOnSky ? (GLuint)videoCubes[eye & 1] : assets.get("calibration_cube");
+	}
+
+	GLuint wallSkyTexture(int eye) {
+		return video.texture() && videoOnSky ? (GLuint)videoCubes[eye & 1] : assets.get(skyboxSets[skyboxActive].eyes[eye & 1]);
+	}
+
+	// export.walls: export.name is the mapping's name, export.eyes left or both. The walls of
+	// walls.variable are packed in bands, not one to an image, so they are not exported.
+	void setupWallExport(GLenum format) {
+		if (!config().getBool("export.walls", false))
+			return;
+		if (variableWalls) {
+			std::cerr << "export.walls does not work with walls.variable, the walls are not exported" << std::endl;
+			return;
+		}
+		std::string eyes = config().getString("export.eyes", "both");
+		if (eyes != "both" && eyes != "left")
+			std::cerr << "export.eyes is left or both, exporting both" << std::endl;
+		exportEyes = eyes == "left" ? 1 : 2;
+		if (exportEyes * wallCount > (int)WALLEXPORT_MAX_LAYERS) {
+			exportEyes = 1;
+			std::cerr << "export.walls shares at most " << WALLEXPORT_MAX_LAYERS << " walls, exporting the left eye's" << std::endl;
+		}
+		if (wallCount > (int)WALLEXPORT_MAX_LAYERS || !wallExport.open(config().getString("export.name", "Project3Walls"),
+				exportEyes * wallCount, wallCount, wallResolution.maxBase(), format)) {
+			std::cerr << "wall export unavailable, the walls are not exported" << std::endl;
+			exportEyes = 0;
+		}
+	}
+
+	//Publishes the eye's walls that are shown, the others keep their last image
+	void exportWalls(int eye, uint64_t frame) {
+		WallExport::Source sources[WALLEXPORT_MAX_LAYERS];
+		int count = 0;
+		for (int i = 0; i < wallCount; i++) {
+			WallExport::Source & source = sources[count];
+			if (!wallTexture(eye, i, source.texture, source.textureLayer, source.size))
+				continue;
+			source.layer = layerIndex(eye, i);
+			count++;
+		}
+		wallExport.publish(sources, count, frame);
+	}
+
+	void setupCubeCapture(GLenum format) {
+		WallCubeCapture::Mode mode = WallCubeCapture::OFF;
+		if (!WallCubeCapture::parseMode(config().getString("walls.cube_capture", "off"), mode))
+			std::cerr << "walls.cube_capture is off, on or auto, leaving it off" << std::endl;
+		if (mode == WallCubeCapture::OFF || (mode == WallCubeCapture::AUTO && wallCount <= WallCubeCapture::FACES))
+			return;
+		if (!layeredWalls) {
+			std::cerr << "walls.cube_capture needs walls.layered, rendering every wall" << std::endl;
+			return;
+		}
+		if (gpuCullProps || wallResolution.variable() || wallTemporal.valid() || wallReprojection.valid()) {
+			std::cerr << "walls.cube_capture does not work with props.gpu_cull, walls.variable, walls.temporal or walls.reproject,"
+				" rendering every wall" << std::endl;
+			return;
+		}
+		if (!wallCubeCapture.init(mode, config().getInt("walls.cube_capture_size", 1024), format, config().getInt("walls.cube_capture_probe", 120)))
+			std::cerr << "wall cube capture unavailable, rendering every wall" << std::endl;
+	}
+
+	// The lighting's textures for the program's draws after. The same every pass of the
+	// frame, so only the first that binds them costs anything.
+	void bindLighting(const SceneProgram & prog) {
+		if (!lightingOn)
+			return;
+		prog.bindTexture(prog.shadowMap, Lighting::SHADOW_UNIT, GL_TEXTURE_2D, lighting.shadowTexture());
+		prog.bindTexture(prog.lightCells, Lighting::CELL_UNIT, GL_TEXTURE_BUFFER, lighting.cellTexture());
+		prog.bindTexture(prog.lightIndices, Lighting::INDEX_UNIT, GL_TEXTURE_BUFFER, lighting.indexTexture());
+	}
+
+	// Turns the props' tiles on in the program for the draws that have them, and off after
+	void setPropAtlas(const SceneProgram & prog, bool on) {
+		if (propShadingActive) {
+			if (on)
+				prog.bindTexture(prog.atlas, 2, GL_TEXTURE_2D_ARRAY, propShading.id());
+			prog.atlased.set(on ? 3 : 0);
+			return;
+		}
+		if (!propAtlas.valid())
+			return;
+		if (on)
+			prog.bindTexture(prog.atlas, 2, GL_TEXTURE_2D_ARRAY, propAtlas.id());
+		prog.atlased.set(on ? propAtlasMode : 0);
+	}
+
+	//! Draws the props the compute pass kept for each of count layers, one indirect draw
+	// per layer, in the bound program with the box's texture.
+	// @input layerIds Which layer of the pass (from firstLayer) each is
+	// @input layered For the layered programs, which send instance i to layerIds[i %
+	//		layerCount]: each layer's draw is sent to that layer alone, and the pass's
+	//		uniforms are set again after
+	// @input positionsOnly From the pool's positions stream, for the depth pre-pass
+	// @input late What the occlusion recheck found instead (drawUnoccludedProps)
+	void drawCulledProps(const SceneProgram & prog, int firstLayer, const GLint * layerIds, GLsizei count, bool layered,
+		bool positionsOnly = false, bool late = false) {
+		prog.transform.set(mat4(1.f));
+		prog.instanced.set(1);
+		if (!positionsOnly)
+			bindLighting(prog);
+		prog.lit.set(1);
+		setPropAtlas(prog, true);
+		glState().polygonMode(GL_FILL);
+		for (GLsizei i = 0; i < count; i++) {
+			int layer = firstLayer + layerIds[i];
+			if (layered) {
+				if (!gpuWallProjection) {
+					mat4 layerMatrix = wallRenderMatrix(layer);
+					prog.layerMatrices.set(&layerMatrix, 1);
+				}
+				prog.layerIds.set(&layerIds[i], 1);
+				prog.layerCount.set(1);
+			}
+			if (late)
+				propCuller.drawLate(layer, positionsOnly);
+			else
+				propCuller.draw(layer, positionsOnly);
+		}
+		setPropAtlas(prog, false);
+		prog.instanced.set(0);
+		prog.lit.set(0);
+		if (layered && count)
+			setLayerUniforms(prog, firstLayer, layerIds, count);
+	}
+
+	//! Builds the occlusion pyramids of the layers just drawn (WallOcclusion) and draws the
+	// props the culling held back that they no longer hide, before anything else is drawn
+	// over the depth. prog is in use again after.
+	// @input passLayers The layers of the pass from firstLayer, all of them are rechecked
+	// @input layerIds Which of them were drawn, and which layer of target each is
+	void drawUnoccludedProps(const SceneProgram & prog, const RenderTarget & target, int firstLayer, int passLayers,
+		const GLint * layerIds, GLsizei count, bool layered, GLuint cube) {
+		if (!wallOcclusion.valid() || !count)
+			return;
+		for (GLsizei i = 0; i < count; i++) {
+			int layer = firstLayer + layerIds[i];
+			wallOcclusion.build(target, layerIds[i], layer, wallRenderSizes[layer], wallRenderMatrix(layer));
+		}
+		propCuller.recheck(passLayers, firstLayer);
+		prog.use();
+		prog.bindTexture(prog.cubebox, 0, GL_TEXTURE_CUBE_MAP, cube);
+		drawCulledProps(prog, firstLayer, layerIds, count, layered, false, true);
+	}
+
+	// The point cloud selects its nodes for every drawn layer of eyeCount views from
+	// firstEye, through the part of the wall the layer renders. A layer past the cloud's
+	// views draws whatever the others selected.
+	void setPointCloudViews(int firstEye, int eyeCount) {
+		if (!pointCloud.valid())
+			return;
+		int firstLayer = layerIndex(firstEye, 0);
+		for (int layer = firstLayer; layer < firstLayer + eyeCount * wallCount; layer++) {
+			if (layerDrawn(layer))
+				pointCloud.setView(layer, regionCrop(wallRegions[layer]) * wallLayerMatrix(layer),
+					LodSelector::pixelScale(wallProjections[layer], wallResolution.base(layer % wallCount)));
+			else
+				pointCloud.clearView(layer);
+		}
+	}
+
+	//! Draws the point cloud into count layers of a wall pass, over what is drawn and before
+	// the sky: each layer the nodes selected for it, or with multiview every view at once
+	// (the nodes any of them selected). The program drawn with is left in use.
+	// @input layerIds Which layer of the pass (from firstLayer) each is
+	// @return Whether it drew, the pass's program is to be used again then
+	bool drawPointCloud(int firstLayer, const GLint * layerIds, GLsizei count, bool multiview) {
+		if (!pointCloud.valid() || !count)
+			return false;
+		const SceneProgram & prog = multiview ? pointCloudMultiviewProg : pointCloudProg;
+		prog.use();
+		prog.transform.set(pointCloud.model());
+		glEnable(GL_PROGRAM_POINT_SIZE);
+		mat4 matrices[MAX_WALL_LAYERS];
+		float sizes[MAX_WALL_LAYERS];
+		uint32_t mask = 0;
+		for (GLsizei i = 0; i < count; i++) {
+			int layer = firstLayer + layerIds[i];
+			uint32_t layerMask = layer < (int)PointCloud::MAX_VIEWS ? 1u << layer : ~0u;
+			matrices[i] = wallRenderMatrix(layer);
+			//The root's spacing in pixels at w = 1 in the size the layer is rendered at
+			sizes[i] = pointCloud.spacing() * pointCloudScale * pointCloudPointScale
+				* LodSelector::pixelScale(wallProjections[layer], wallRenderSizes[layer]);
+			if (multiview) {
+				mask |= layerMask;
+				continue;
+			}
+			prog.layerMatrices.set(&matrices[i], 1);
+			prog.pointSizes.set(&sizes[i], 1);
+			prog.layer.set(layerIds[i]);
+			pointCloud.draw(layerMask);
+		}
+		if (multiview) {
+			prog.layerMatrices.set(matrices, count);
+			prog.pointSizes.set(sizes, count);
+			pointCloud.draw(mask);
+		}
+		glDisable(GL_PROGRAM_POINT_SIZE);
+		return true;
+	}
+
+	// The scene's knobs at the quality governor's levels. The props' levels of detail can go
+	// away while running (props.gpu_cull), so the steps are given again every frame.
+	void applyQuality() {
+		QualityGovernor & governor = qualityGovernor();
+		governor.setSteps(QualityGovernor::WALL_RATE, wallSchedule.governSteps());
+		governor.setSteps(QualityGovernor::WALL_RESOLUTION, WALL_QUALITY_STEPS);
+		governor.setSteps(QualityGovernor::LOD, propLodActive ? LOD_QUALITY_STEPS : 0);
+		wallSchedule.govern(governor.level(QualityGovernor::WALL_RATE));
+		wallResolution.setGoverned(true);
+		wallResolution.setQualityScale(1.f - WALL_QUALITY_STEP * governor.level(QualityGovernor::WALL_RESOLUTION));
+		if (propLodActive)
+			propLods.setErrorScale((float)(1 << governor.level(QualityGovernor::LOD)));
+	}
+
+	// World matrices and bounds for whatever moved, the props' hierarchy refit to them, and
+	// the props' instance buffer again if one of them did (culled props are written per pass)
+	void updateEntities() {
+		if (entities.update(&jobs()) || entitiesPrepared)
+			drawListStale = true;
+		entitiesPrepared = false;
+		if ((cullProps || pickProps) && propBvh)
+			propTree.update(entities, 1, propCount);
+		//Only the props' stamps are gone over, and only once something moved: the box moving
+		//alone leaves their copies be
+		if (entitiesSeen != entities.version()) {
+			propsVersion = entities.version(1, propCount);
+			entitiesSeen = entities.version();
+		}
+		if (gpuCullProps)
+			propCuller.update(entities.worldMatrices() + 1, entities.boundsMin() + 1, entities.boundsMax() + 1, propsVersion);
+		if (!props || cullProps || propsUploaded == propsVersion)
+			return;
+		props->setInstanceTransforms(entities.worldMatrices() + 1, propCount);
+		propsUploaded = propsVersion;
+	}
+
+	// Which props every wall layer of eyeCount views from firstEye can see, in one pass over
+	// the props for all of them. Levels of detail are picked for the first viewer's views
+	// only, the others draw the same.
+	void cullPropLayers(int firstEye, int eyeCount) {
+		if (!propCount || (!cullProps && !propLodActive && !gpuCullProps))
+			return;
+		int firstLayer = layerIndex(firstEye, 0);
+		int layers = eyeCount * wallCount;
+		mat4 viewProjections[MASK_LAYERS];
+		for (int i = 0; i < layers; i++)
+			viewProjections[i] = regionCrop(wallRegions[firstLayer + i]) * wallLayerMatrix(firstLayer + i);
+		if (gpuCullProps) {
+			propCuller.cull(viewProjections, layers, firstLayer);
+			return;
+		}
+		bool changed = false;
+		if (cullProps)
+			changed = propBvh ? propTree.cullViews(entities, viewProjections, layers, firstLayer, propMasks.data(), &jobs())
+				: entities.cullViews(viewProjections, layers, firstLayer, 1, propCount, propMasks.data(), &jobs());
+		//Levels of detail for the same layers, each through its wall's off-axis projection
+		//onto its target
+		if (propLodActive && firstEye < 2) {
+			float pixelScales[MAX_WALL_LAYERS];
+			for (int i = 0; i < layers; i++)
+				pixelScales[i] = LodSelector::pixelScale(wallProjections[firstLayer + i], wallResolution.base((firstLayer + i) % wallCount));
+			changed = propLods.select(viewProjections, pixelScales, layers, firstLayer, cullProps ? propMasks.data() : nullptr,
+				entities.worldMatrices() + 1, entities.boundsMin() + 1, entities.boundsMax() + 1, &jobs()) || changed;
+		}
+		if (changed)
+			drawListStale = true;
+	}
+
+	// The props in one instanced draw, each repeated repeat times for the layered passes,
+	// with whatever texture the box was drawn with
+	void drawProps(const SceneProgram & prog, GLsizei repeat, uint32_t layerMask) {
+		if (!props)
+			return;
+		//A wall pass recorded ahead replays what was recorded
+		if (repeat == 1 && (layerMask & wallCommandsRecorded) && !(layerMask & (layerMask - 1))) {
+			int layer = 0;
+			while (!((layerMask >> layer) & 1))
+				layer++;
+			GLint locations[WALL_SLOTS] = { prog.transform.id(), prog.instanced.id() };
+			wallCommands[layer].replay(locations);
+			return;
+		}
+		if (cullProps) {
+			recordedPropsUpload = nullptr;
+			mat4 * visible = frameArena().allocate<mat4>(propCount);
+			const mat4 * worlds = entities.worldMatrices() + 1;
+			size_t visibleCount = 0;
+			for (size_t i = 0; i < propCount; i++) {
+				if (propMasks[i] & layerMask)
+					visible[visibleCount++] = worlds[i];
+			}
+			props->updateInstanceTransforms(visible, visibleCount);
+		}
+		prog.transform.set(mat4(1.f));
+		prog.instanced.set(1);
+		props->drawTransformed(0, repeat);
+		prog.instanced.set(0);
+	}
+
+	// The original wall pass: one framebuffer, clear and scene submission per wall. What
+	// recordWallCommands recorded for the eye is replayed.
+	void renderWallsSeparately(int eye) {
+		shaderProg.use();
+
+		for (int i = 0; i < wallCount; i++) {
+			if (renderWall(eye, i))
+				RenderTargetCache::discardDepth();
+		}
+	}
+
+	//! Records what each wall pass of the eyes draws of the props, split over the workers:
+	// the props the wall's layer can see and the uniforms around their draw, for drawProps
+	// to replay. Nothing without walls.parallel_record or with nothing to pick per pass.
+	void recordWallCommands(int firstEye, int eyeCount = 1) {
+		wallCommandsRecorded = 0;
+		recordedPropsUpload = nullptr;
+		if (!parallelRecord || !props || !cullProps)
+			return;
+		CpuScope scope("record walls", firstEye);
+		int firstLayer = layerIndex(firstEye, 0);
+		int layers = eyeCount * wallCount;
+		jobs().parallelFor((size_t)layers, 1, [&](size_t begin, size_t end, unsigned int) {
+			for (size_t i = begin; i < end; i++)
+				recordWallProps(wallCommands[firstLayer + i], firstLayer + (int)i);
+		});
+		for (int i = 0; i < layers; i++)
+			wallCommandsRecorded |= 1u << (firstLayer + i);
+	}
+
+	// One layer's props as drawProps would draw them, their matrices in the payload
+	void recordWallProps(CommandBuffer & commands, int layer) {
+		commands.clear();
+		uint32_t bit = 1u << layer;
+		size_t visibleCount = 0;
+		for (size_t i = 0; i < propCount; i++)
+			visibleCount += (propMasks[i] & bit) ? 1 : 0;
+		commands.setMat4(SLOT_TRANSFORM, mat4(1.f));
+		commands.setInt(SLOT_INSTANCED, 1);
+		mat4 * visible = static_cast<mat4 *>(commands.call(&drawRecordedProps, this, (uint32_t)(visibleCount * sizeof(mat4))));
+		const mat4 * worlds = entities.worldMatrices() + 1;
+		for (size_t i = 0, n = 0; n < visibleCount; i++) {
+			if (propMasks[i] & bit)
+				visible[n++] = worlds[i];
+		}
+		commands.setInt(SLOT_INSTANCED, 0);
+	}
+
+	// A recorded pass's props, their matrices the payload
+	static void drawRecordedProps(void * context, const void * data, uint32_t bytes) {
+		ColorCubeScene & scene = *static_cast<ColorCubeScene *>(context);
+		//The depth pre-pass replayed the same stream just before, its upload is still there
+		if (scene.recordedPropsUpload != data) {
+			scene.props->updateInstanceTransforms(static_cast<const mat4 *>(data), bytes / sizeof(mat4));
+			scene.recordedPropsUpload = data;
+		}
+		scene.props->drawTransformed(0, 1);
+	}
+
+	//! One wall of the eye into its own target, with shaderProg in use.
+	// @return Whether it rendered, or was current or not due. The target's depth is the
+	//		caller's to discard.
+	bool renderWall(int eye, int i) {
+		int layer = layerIndex(eye, i);
+		if (!layerDrawn(layer) || wallLayerCurrent(layer))
+			return false;
+		//A wall that has been rendered waits for its turn
+		if (wallLayerStates[layer].valid && wallRegionCovered(layer) && !wallSchedule.wallDue(i))
+			return false;
+		CpuScope scope("wall pass", layer);
+		GpuScope gpuScope(wallGpuPasses[layer]);
+		setWallLayerRendered(layer);
+		const RenderTarget & target = *wallTargets[layer];
+		GLsizei size = wallResolution.size(eye, i);
+		wallUvScale[layer] = vec2((float)size / (float)target.width);
+		//Close enough to where the wall was last rendered, that is moved instead
+		if (wallReprojection.canWarp(layer, eyePos[eye], size, wallSceneVersion())) {
+			wallReprojection.warp(target, 0, layer, wallLayerMatrix(layer));
+			wallMips.generate(target);
+			return true;
+		}
+		RenderTargetCache::bind(target);
+		clearWallTarget();
+		wallRenderSizes[layer] = wallTemporal.renderSize(layer, size);
+		glViewport(0, 0, wallRenderSizes[layer], wallRenderSizes[layer]);
+		if (partialWalls) {
+			scissorWall(0, layer, wallRenderSizes[layer]);
+			glEnable(GL_SCISSOR_TEST);
+		}
+
+		cameras.bindWall(eye, i);
+		//Render cubes to walls
+		drawWallScene(shaderProg, depthProg, (uint64_t)size * (uint64_t)size, [&](const SceneProgram & pass, bool positionsOnly) {
+			drawWallObjects(pass, boxTexture(eye), 1, 1u << layer, positionsOnly);
+			if (gpuCullProps) {
+				GLint layerId = 0;
+				drawCulledProps(pass, layer, &layerId, 1, false, positionsOnly);
+			}
+		});
+		GLint layerId = 0;
+		drawUnoccludedProps(shaderProg, target, layer, 1, &layerId, 1, false, boxTexture(eye));
+		if (drawPointCloud(layer, &layerId, 1, false))
+			shaderProg.use();
+
+		if (!analyticSky && virtualWalls) {
+			useVirtualSky();
+			drawWallSky(virtualSkyProg, virtualSky.cubeMap(), 1);
+			shaderProg.use();
+		}
+		else if (!analyticSky)
+			drawWallSky(shaderProg, wallSkyTexture(eye), 1);
+		//The resolve blits are scissored too
+		if (partialWalls)
+			glDisable(GL_SCISSOR_TEST);
+		renderTargets.resolve(target, 0, wallRenderSizes[layer], wallRenderSizes[layer], wallTemporal.valid() || wallReprojection.valid());
+		wallTemporal.resolve(target, 0, layer, wallRenderSizes[layer], size, wallLayerMatrix(layer));
+		wallReprojection.keep(target, 0, layer, size, wallLayerMatrix(layer), eyePos[eye], wallSceneVersion());
+		wallMips.generate(target);
+		return true;
+	}
+
+	// What a wall's image depends on besides the eye, for WallReprojection: the entities, the
+	// video's frame, the point cloud's nodes, the layout, the programs and the environment. Textures streaming in are
+	// not, warps catch up with them at the next render walls.reproject_frames makes.
+	uint64_t wallSceneVersion() const {
+		return ((entities.version() + videoFrame + layoutVersion + shaderVersion + skinnedBox.version() + pointCloud.version()
+			+ wallTextureVersion()) << 8) | (uint64_t)(skyboxActive & 0xff);
+	}
+
+	// The textures the walls sample as far as they are in: a texture made resident or a finer
+	// level streamed in, or the virtual sky's pages, which are only asked for by the walls'
+	// draws themselves, so a wall kept from before would otherwise never get past its tail
+	uint64_t wallTextureVersion() const {
+		return assets.version() + (virtualWalls ? virtualSky.version() : 0);
+	}
+
+	//! Warps the layers of a layered pass that would be drawn from what their last render
+	// kept, if every one of them can be (WallReprojection). One that cannot renders them all.
+	// @return Whether it warped, the caller's pass is done then
+	bool warpLayers(const RenderTarget & target, int firstLayer, int layerCount) {
+		if (!wallReprojection.valid())
+			return false;
+		uint64_t scene = wallSceneVersion();
+		GLint extents[MAX_WALL_LAYERS];
+		for (int i = 0; i < layerCount; i++) {
+			int layer = firstLayer + i;
+			extents[i] = wallResolution.size(layerEye(layer), layer % wallCount);
+			if (layerDrawn(layer) && !wallLayerCurrent(layer)
+				&& !wallReprojection.canWarp(layer, eyePos[layer / wallCount], extents[i], scene))
+				return false;
+		}
+		int viewer = firstLayer / (2 * wallCount);
+		GpuScope gpuScope(viewer ? viewerGpuPasses[viewer] : layerCount == 2 * wallCount ? stereoGpuPass : layeredGpuPasses[firstLayer / wallCount]);
+		for (int i = 0; i < layerCount; i++) {
+			int layer = firstLayer + i;
+			if (!layerDrawn(layer) || wallLayerCurrent(layer))
+				continue;
+			wallReprojection.warp(target, i, layer, wallLayerMatrix(layer));
+			setWallLayerRendered(layer);
+			wallUvScale[layer] = vec2((float)extents[i] / (float)target.width);
+		}
+		wallMips.generate(target, layerCount, extents);
+		return true;
+	}
+
+	// The composite variants every frame draws with: the walls with or without the analytic
+	// sky, and the black of a wall switched off
+	void beginComposite(SceneVariants & composite) {
+		composite.begin(composite.variants.with(0, "ANALYTIC_SKY", config().getBool("walls.analytic_sky", false)));
+		composite.begin(composite.variants.bit("BROKEN"));
+	}
+
+	//! Draws every program the scene has with the targets and state it is drawn with, once
+	// and before the first frame (gl.warmup), so that what the driver compiles on a
+	// program's first draw is compiled now and not in a frame (PipelineWarmup). The multiview
+	// programs are left to their first frame, their targets are the multiview pass's own.
+	// @input eyeColor, eyeDepth, eyeSamples What the composite draws into
+	void warmPipelines(GLenum eyeColor, GLenum eyeDepth, GLsizei eyeSamples) {
+		if (!config().getBool("gl.warmup", true))
+			return;
+		//The samplers would be sampled without a resident handle
+		if (bindlessTextures().enabled()) {
+			logStream(LOG_INFO) << "pipeline warm-up: skipped with bindless textures" << std::endl;
+			return;
+		}
+		StartupScope scope("gl", "pipeline warm-up");
+		PipelineWarmup & warmup = pipelineWarmup();
+		PipelineWarmup::State solid;
+		PipelineWarmup::State depthOnly(GL_TRIANGLES, true, false);
+		RenderTargetFormat wallFormat = wallTargetFormat();
+		int wall = warmup.addTarget("wall", wallFormat.color, GL_DEPTH_COMPONENT24, wallFormat.samples, 1);
+		warmup.add("shader", shaderProg.id(), box->VAO, wall, solid);
+		warmup.add("depth prepass", depthProg.id(), box->VAO, wall, depthOnly);
+		if (lightingOn) {
+			int shadowMap = warmup.addTarget("shadow map", 0, GL_DEPTH_COMPONENT24, 1, 1);
+			warmup.add("shadow", shadowProg.id(), box->VAO, shadowMap, depthOnly);
+		}
+		if (layeredWalls) {
+			int walls = warmup.addTarget("walls", wallFormat.color, GL_DEPTH_COMPONENT24, wallFormat.samples,
+				stereoWalls ? 2 * wallCount : wallCount);
+			warmup.add("walls layered", wallLayeredProg.id(), box->VAO, walls, solid);
+			warmup.add("depth prepass layered", depthLayeredProg.id(), box->VAO, walls, depthOnly);
+		}
+		if (pointCloud.valid())
+			warmup.add("point cloud", pointCloudProg.id(), pointCloud.vertexArray(), wall, PipelineWarmup::State(GL_POINTS));
+		//Every composite variant begun, the broken wall's too
+		int eyeTarget = warmup.addTarget("eye", eyeColor, eyeDepth, eyeSamples, 1);
+		warmVariants(screenVariants, wallQuad->VAO, eyeTarget);
+		warmVariants(screenArrayVariants, wallQuad->VAO, eyeTarget);
+		warmVariants(raycastVariants, raycastVao, eyeTarget);
+		warmVariants(mergedVariants, mergedWallVao, eyeTarget);
+		warmup.add("virtual sky", virtualSkyProg.id(), skybox->VAO, eyeTarget, solid);
+		//The wireframes, only drawn once debug is switched on
+		warmup.add("debug lines", debugLinesProg.id(), debugDraw().vertexArray(), eyeTarget, PipelineWarmup::State(GL_LINES));
+		warmup.run();
+	}
+
+	void warmVariants(const SceneVariants & composite, GLuint vao, int target) {
+		for (const auto & entry : composite.programs)
+			pipelineWarmup().add(composite.frag + " " + composite.variants.describe(entry.first), entry.second->id(), vao, target,
+				PipelineWarmup::State());
+	}
+
+	// With analyticSky the composite traces the sky itself: the ray from where the walls were
+	// rendered from through each wall point, taken back into the skybox's space
+	void setAnalyticSky(const SceneProgram & compositeProg, int eye) {
+		if (!analyticSky)
+			return;
+		int view = viewIndex(shownViewer, eye);
+		mat4 skyFromWall = rigidInverse(wallModelviews[view]);
+		vec3 origin = vec3(skyFromWall * vec4(eyePos[view], 1.f));
+		glm::mat3 rotation = glm::mat3(skyFromWall);
+		compositeProg.skyEye.set(eyePos[view]);
+		compositeProg.skyOrigin.set(origin);
+		compositeProg.skyRotation.set(rotation);
+		compositeProg.skySize.set(SKYBOX_SIZE);
+		compositeProg.bindTexture(compositeProg.skybox, 1, GL_TEXTURE_CUBE_MAP, wallSkyTexture(eye));
+	}
+
+	//! Draws a skybox behind everything drawn so far, without writing depth.
+	// With skyboxLast the vertex shader puts it on the far plane (skyboxDepth) and only the
+	// pixels nothing else covered pass the depth test, otherwise it is just drawn.
+	// @input prog The bound program, with projection, view and transform set
+	// @input instances More than one for the instanced layered passes
+	void drawSkybox(const SceneProgram & prog, Box * sky, GLuint texture, GLsizei instances) {
+		prog.bindTexture(prog.cubebox, 0, GL_TEXTURE_CUBE_MAP, texture);
+		beginSkybox(prog);
+		if (instances > 1)
+			sky->drawInstanced(prog.id(), 0, instances);
+		else
+			sky->draw(prog.id(), 0);
+		endSkybox(prog);
+	}
+
+	//! Pages in the environment skybox.virtual names, six tiled faces from TexCacheBuilder
+	// --tiles separated by commas, under skybox.virtual_budget_mb. Without sparse textures,
+	// or with files that do not make one, the skybox sets' cubes are drawn as before.
+	void setupVirtualSky(const std::string & list) {
+		if (list.empty())
+			return;
+		std::vector<std::string> files;
+		size_t start = 0;
+		while (start < list.size()) {
+			size_t end = std::min(list.find(',', start), list.size());
+			std::string name = list.substr(start, end - start);
+			start = end + 1;
+			name.erase(0, name.find_first_not_of(" \t"));
+			name.erase(name.find_last_not_of(" \t") + 1);
+			if (!name.empty())
+				files.push_back(name);
+		}
+		uint64_t budget = (uint64_t)std::max(config().getInt("skybox.virtual_budget_mb", 256), 0) * 1024 * 1024;
+		if (!virtualSky.init(files, budget, &uploads)) {
+			std::cerr << "skybox.virtual: drawing the skybox sets instead" << std::endl;
+			return;
+		}
+		virtualSkyProg.load("shader.vert", "virtualSky.frag");
+		//After setupShaderReload, so it is watched here
+		if (shaderReloader.enabled())
+			shaderReloader.watch(virtualSkyProg.program, [this] { virtualSkyProg.bindUniforms(); });
+		//The walls are then rendered with the one environment for both eyes
+		virtualWalls = config().getBool("skybox.virtual_walls", false);
+	}
 
-			glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-			//glViewport(0, 0, windowSize.x, windowSize.y);
-			glViewport(0, 0, 1024, 1024);
-			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-			for (int i = 0; i < 3; i++) {
+	// Puts virtualSkyProg in use with the virtual environment's residency, its tile numbering
+	// and this frame's feedback buffer. Its cube map is bound like any skybox's.
+	void useVirtualSky() {
+		virtualSkyProg.use();
+		virtualSkyProg.bindTexture(virtualSkyProg.residency, 3, GL_TEXTURE_CUBE_MAP, virtualSky.residencyMap());
+		virtualSkyProg.vtTiles.set(virtualSky.tilesPerSide());
+		virtualSkyProg.vtPagedLevels.set(virtualSky.pagedLevels());
+		virtualSkyProg.vtLevelOffsets.set(virtualSky.levelOffsets(), VirtualTexture::MAX_LEVELS);
+		virtualSkyProg.vtFaceTiles.set(virtualSky.faceTiles());
+		virtualSkyProg.vtFeedbackPhase.set(virtualSky.feedbackPhase());
+		virtualSky.bindFeedback();
+	}
 
+	void beginSkybox(const SceneProgram & prog) {
+		glState().depthMask(false);
+		if (skyboxLast) {
+			prog.skyboxDepth.set(1);
+			glDepthFunc(GL_LEQUAL);
+		}
+	}
 
-				//Setup texture
-				glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, renderedTextures[eye * 3 + i], 0);
-				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	void endSkybox(const SceneProgram & prog) {
+		if (skyboxLast) {
+			glDepthFunc(GL_LESS);
+			prog.skyboxDepth.set(0);
+		}
+		glState().depthMask(true);
+	}
 
-				glUniformMatrix4fv(uProjection, 1, GL_FALSE, (&quadProjections[i][0][0]));
-				//Render cubes to walls
+	mat4 wallLayerMatrix(int layer) const {
+		return wallProjections[layer] * wallModelviews[layer / wallCount];
+	}
 
-				mat4 scaledBoxTransform = glm::scale(boxtransform, glm::vec3(boxScale));
-				glUniformMatrix4fv(uTransform, 1, GL_FALSE, &(scaledBoxTransform[0][0]));
-				box->draw(shaderProg, texture_box);
+	// What moves the layer's projection by this frame's jitter (walls.temporal)
+	mat4 wallJitter(int layer) const {
+		return wallTemporal.jitterMatrix(layer, wallRenderSizes[layer]);
+	}
 
-				glDepthMask(GL_FALSE);
-				glm::mat4 skyboxTransform = glm::scale(glm::mat4(1.0f), glm::vec3(20.0f));
-				glUniformMatrix4fv(uTransform, 1, GL_FALSE, &(skyboxTransform[0][0]));
-				skybox->draw(shaderProg, texture_skybox[eye]);
-				glDepthMask(GL_TRUE);
-			}
+	// The matrix the wall passes draw the layer with, jittered
+	mat4 wallRenderMatrix(int layer) const {
+		return wallJitter(layer) * wallLayerMatrix(layer);
+	}
 
-			glBindFramebuffer(GL_FRAMEBUFFER, 0);
-			//glViewport(0, 0, imgWidth, imgHeight);
-			
-			glClear(GL_COLOR_BUFFER_BIT);
+	// Whether rendering the layer now would give what it already holds
+	bool wallLayerCurrent(int layer) const {
+		const WallLayerState & state = wallLayerStates[layer];
+		return incrementalWalls && state.valid
+			&& state.skybox == skyboxActive
+			&& state.videoFrame == videoFrame
+			&& state.pointCloud == pointCloud.version()
+			&& state.textures == wallTextureVersion()
+			&& state.size == wallResolution.size(layerEye(layer), layer % wallCount)
+			&& state.matrix == wallLayerMatrix(layer)
+			&& state.bands.edges == layerBands(layer).edges
+			&& wallTemporal.converged(layer, state.matrix)
+			&& state.boxTransform == entities.world(boxEntity)
+			&& state.boxSkin == skinnedBox.version()
+			&& wallRegionCovered(layer);
+	}
 
-			glDisable(GL_DEPTH_TEST);
-		//}
+	void setWallLayerRendered(int layer) {
+		WallLayerState & state = wallLayerStates[layer];
+		state.valid = true;
+		state.matrix = wallLayerMatrix(layer);
+		state.boxTransform = entities.world(boxEntity);
+		state.boxSkin = skinnedBox.version();
+		state.skybox = skyboxActive;
+		state.videoFrame = videoFrame;
+		state.pointCloud = pointCloud.version();
+		state.textures = wallTextureVersion();
+		state.size = wallResolution.size(layerEye(layer), layer % wallCount);
+		state.bands = layerBands(layer);
+		state.region = wallRegions[layer];
+	}
 
-		
-		//---------------Draw the CAVE---------------//
-		glBindFramebuffer(GL_FRAMEBUFFER, hmd_fbo);
-		const auto& vp = _sceneLayer.Viewport[eye];
-		glViewport(vp.Pos.x, vp.Pos.y, vp.Size.w, vp.Size.h);
+	// Draws one wall of the CAVE with whatever the wall pass rendered for it
+	void updateWallLayers() {
+		for (int i = 0; i < wallCount; i++) {
+			GLuint texture;
+			GLint layer;
+			GLsizei size;
+			if (wallTexture(ovrEye_Left, i, texture, layer, size))
+				wallLayers.update(i, texture, layer, size, wallTransforms[i]);
+			else
+				wallLayers.hide(i);
+		}
+	}
 
-		glUseProgram(screenShaderProg);
-		uProjection = glGetUniformLocation(screenShaderProg, "projection");
-		uModelview = glGetUniformLocation(screenShaderProg, "modelview");
-		uTransform = glGetUniformLocation(screenShaderProg, "transform");
-		uColor = glGetUniformLocation(screenShaderProg, "incolor");
-		GLuint uBroken = glGetUniformLocation(screenShaderProg, "broken");
-
-		glUniformMatrix4fv(uProjection, 1, GL_FALSE, (&projection[0][0]));
-		glUniformMatrix4fv(uModelview, 1, GL_FALSE, &(modelview[0][0]));
-		glUniform1i(uBroken, 0);
-
-		//left wall
-		const glm::vec3 leftColor(0, 0.7f, 0);
-		glUniformMatrix4fv(uTransform, 1, GL_FALSE, &(leftTransform[0][0]));
-		glUniform3fv(uColor, 1, &(leftColor[0]));
-		leftwall->draw(screenShaderProg, renderedTextures[eye * 3]);//leftTextures[eye]);
-
-		//right wall
-		const glm::vec3 rightColor(0, 0, 0.7f);
-		glUniformMatrix4fv(uTransform, 1, GL_FALSE, &(rightTransform[0][0]));
-		glUniform3fv(uColor, 1, &(rightColor[0]));
-		rightwall->draw(screenShaderProg, renderedTextures[eye * 3 + 1]);//rightTextures[eye]);
-
-		//floor
-		const glm::vec3 floorColor(0.7f, 0, 0);
-		glUniformMatrix4fv(uTransform, 1, GL_FALSE, &(floorTransform[0][0]));
-		glUniform3fv(uColor, 1, &(floorColor[0]));
-		if(eye && broken)
-			glUniform1i(uBroken, 2);
-		floor->draw(screenShaderProg, renderedTextures[eye * 3 + 2]);//floorTextures[eye]);
-		
+	bool wallTexture(int eye, int i, GLuint & texture, GLint & layerOut, GLsizei & size) const {
+		if (i >= wallCount)
+			return false;
+		int layer = layerIndex(viewIndex(shownViewer, eye), i);
+		size = wallResolution.size(eye, i);
+		if (shownViewer) {
+			texture = viewerTargets[shownViewer]->color;
+			layerOut = layerIndex(eye, i);
+		}
+		else if (stereoWalls) {
+			texture = stereoWallTarget->color;
+			layerOut = layer;
+		}
+		else if (layeredWalls) {
+			texture = eyeWallTargets[eye]->color;
+			layerOut = i;
+		}
+		else {
+			texture = wallTargets[layer]->color;
+			layerOut = -1;
+		}
+		//A wall switched off has nothing to show, the compositor's layer and a render node's
+		//window leave it out
+		return wallVisible[layer] && !wallOff(eye, i);
+	}
 
-		
-		//---------------Wireframes---------------//
-		//If A is pressed
-		if (debug) {
-			glUseProgram(pyrShaderProg);
-
-			//Draw wireframes
-			uProjection = glGetUniformLocation(pyrShaderProg, "projection");
-			uModelview = glGetUniformLocation(pyrShaderProg, "modelview");
-			uTransform = glGetUniformLocation(pyrShaderProg, "transform");
-			uColor = glGetUniformLocation(pyrShaderProg, "incolor");
-
-			glUniformMatrix4fv(uProjection, 1, GL_FALSE, (&projection[0][0]));
-			glUniformMatrix4fv(uModelview, 1, GL_FALSE, &(modelview[0][0]));
-						
-			//Pyramid coordinates
-			glm::mat4 pyr_transform;
-			glUniformMatrix4fv(uTransform, 1, GL_FALSE, &(pyr_transform[0][0]));
-
-			//LEFT EYE WIREFRAMES 
-			//LEFT WALL WIREFRAME
-			glm::vec3 wireframe_color(0, 0, 1);
-			glUniform3fv(uColor, 1, &(wireframe_color[0]));
-			std::vector<glm::vec3> leftWall_vertices = {
-				leftWallVerts[0], leftWallVerts[1], leftWallVerts[3], leftWallVerts[2]
-			};
-			leftWall_vertices.insert(leftWall_vertices.begin(), vec3(eyePos[eye].x, eyePos[eye].y, eyePos[eye].z));
-			lefteye_wireFrames[0] = new Pyramid(leftWall_vertices);
-			lefteye_wireFrames[0]->draw(pyrShaderProg);
-
-			//RIGHT WALL WIREFRAME
-			wireframe_color = vec3(1, 0, 0);
-			glUniform3fv(uColor, 1, &(wireframe_color[0]));
-			std::vector<glm::vec3> rightWall_vertices = {
-				rightWallVerts[0], rightWallVerts[1], rightWallVerts[3], rightWallVerts[2]
-			};
-			rightWall_vertices.insert(rightWall_vertices.begin(), vec3(eyePos[eye].x, eyePos[eye].y, eyePos[eye].z));
-			lefteye_wireFrames[1] = new Pyramid(rightWall_vertices);
-			lefteye_wireFrames[1]->draw(pyrShaderProg);
-
-			//FLOOR WIREFRAME
-			wireframe_color = vec3(0, 1, 0);
-			glUniform3fv(uColor, 1, &(wireframe_color[0]));
-			std::vector<glm::vec3> floor_vertices = {
-				floorVerts[0], floorVerts[1], floorVerts[3], floorVerts[2]
-			};
-			floor_vertices.insert(floor_vertices.begin(), vec3(eyePos[eye].x, eyePos[eye].y, eyePos[eye].z));
-			lefteye_wireFrames[2] = new Pyramid(floor_vertices);
-			lefteye_wireFrames[2]->draw(pyrShaderProg);
-		}
-
-	}
-
-	void checkInput(ovrSession session, bool &track, bool &B_down, bool& A_down, bool& debug) {
-		ovrInputState inputState;
-		if (OVR_SUCCESS(ovr_GetInputState(session, ovrControllerType_Touch, &inputState)))
+	void drawWall(const SceneProgram & compositeProg, int eye, int i) {
+		int layer = layerIndex(viewIndex(shownViewer, eye), i);
+		if (!wallVisible[layer])
+			return;
+		compositeProg.uvScale.set(wallUvScale[layer]);
+		//Past what walls.partial rendered of the wall the edge of it is stretched, not what
+		//the target held before
+		const vec4 & region = wallLayerStates[layer].region;
+		compositeProg.uvCrop.set(vec4(region.x, region.z, -region.y, -region.w) * 0.5f + 0.5f);
+		compositeProg.bandEdges.set(wallLayerStates[layer].bands.edges);
+		compositeProg.bandPacked.set(wallLayerStates[layer].bands.packed);
+		if (shownViewer || stereoWalls || layeredWalls) {
+			int arrayLayer;
+			GLuint texture = wallArray(eye, i, arrayLayer);
+			compositeProg.bindTexture(compositeProg.renderedTextures, 0, GL_TEXTURE_2D_ARRAY, texture);
+			wallQuad->drawLayer(compositeProg.layer.id(), 0, arrayLayer);
+		}
+		else {
+			compositeProg.bindTexture(compositeProg.renderedTexture, 0, GL_TEXTURE_2D, wallTargets[layer]->color);
+			wallQuad->draw(compositeProg.id(), 0);
+		}
+	}
+
+	//! The texture array eye's wall i is shown from, and its layer in it
+	GLuint wallArray(int eye, int i, int & arrayLayer) const {
+		if (shownViewer) {
+			arrayLayer = layerIndex(eye, i);
+			return viewerTargets[shownViewer]->color;
+		}
+		if (stereoWalls) {
+			arrayLayer = layerIndex(viewIndex(shownViewer, eye), i);
+			return stereoWallTarget->color;
+		}
+		arrayLayer = i;
+		return eyeWallTargets[eye]->color;
+	}
+
+	//! Every wall of an eye in one draw: the walls' inverse transforms, layers and uv scales
+	// go to wallRaycast.frag, which finds the wall under each pixel. Only for the array
+	// targets, all of an eye's walls are in one texture there.
+	void drawWallsRaycast(const SceneProgram & prog, int eye) {
+		prog.bindTexture(prog.renderedTextures, 0, GL_TEXTURE_2D_ARRAY, setWallSampling(prog, eye));
+		glState().bindVertexArray(raycastVao);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		glStats().addDraw();
+	}
+
+	//! Every wall of an eye in one draw of the merged quads (mergedWallBuffer), what differs
+	// per wall in uniform arrays as for drawWallsRaycast
+	void drawWallsMerged(const SceneProgram & prog, int eye) {
+		prog.bindTexture(prog.renderedTextures, 0, GL_TEXTURE_2D_ARRAY, setWallSampling(prog, eye));
+		glState().polygonMode(GL_FILL);
+		glState().bindVertexArray(mergedWallVao);
+		glDrawArrays(GL_TRIANGLES, 0, 6 * wallCount);
+		glStats().addDraw();
+	}
+
+	//! The per wall uniforms of the one draw composites: every wall's sampling (its uv scale,
+	// layer, or below 0 if not shown, and whether it is switched off) and bands.
+	// @return The array all of the eye's walls are in
+	GLuint setWallSampling(const SceneProgram & prog, int eye) {
+		glm::vec4 sampling[CaveLayout::MAX_WALLS], edges[CaveLayout::MAX_WALLS], packed[CaveLayout::MAX_WALLS];
+		GLuint texture = 0;
+		for (int i = 0; i < wallCount; i++) {
+			int layer = layerIndex(viewIndex(shownViewer, eye), i);
+			int arrayLayer;
+			texture = wallArray(eye, i, arrayLayer);
+			sampling[i] = glm::vec4(wallUvScale[layer].x, wallVisible[layer] ? (float)arrayLayer : -1.f,
+				wallOff(eye, i) ? 1.f : 0.f, wallUvScale[layer].y);
+			edges[i] = wallLayerStates[layer].bands.edges;
+			packed[i] = wallLayerStates[layer].bands.packed;
+		}
+		prog.wallCount.set(wallCount);
+		prog.wallInverses.set(wallInverseTransforms, wallCount);
+		prog.wallSampling.set(sampling, wallCount);
+		prog.bandEdges.set(edges, wallCount);
+		prog.bandPacked.set(packed, wallCount);
+		return texture;
+	}
+
+	//! What a cluster's render nodes need of this frame, once both eyes have rendered: the
+	// shown viewer's views of the walls, the box, the environment and the walls switched off
+	void clusterFrame(ClusterFrame & out) const {
+		for (int eye = 0; eye < 2; eye++) {
+			int view = viewIndex(shownViewer, eye);
+			out.wallModelviews[eye] = wallModelviews[view];
+			out.eyePositions[eye] = eyePos[view];
+		}
+		out.boxPosition = entities.position(boxEntity);
+		out.boxScale = entities.scale(boxEntity).x;
+		out.skybox = skyboxPending >= 0 ? skyboxPending : skyboxActive;
+		out.wallsOff = wallsOff;
+	}
+
+	// A render node shows its wall textures as they are, the sky has to be in them and the
+	// wall at one density
+	void setClusterNode() {
+		analyticSky = false;
+		partialWalls = false;
+		wallResolution.disableVariable();
+	}
+
+	//! The walls in walls (a bit per wall) go to projectors as well: rendered every frame
+	// wherever the head looks, at their full resolution and with the sky in them, like a
+	// render node's
+	void setProjectedWalls(uint32_t walls) {
+		projectedWalls = walls;
+		if (!walls)
+			return;
+		setClusterNode();
+		wallResolution.disableAdaptive();
+	}
+
+	//! A render node's frame: both eyes' walls in wallMask (a bit per wall) rendered from the
+	// master's state, in place of the head and the simulation. The others are left out.
+	void renderClusterWalls(const ClusterFrame & state, uint32_t wallMask) {
+		glState().invalidate();
+		if (state.boxPosition != entities.position(boxEntity))
+			entities.setPosition(boxEntity, state.boxPosition);
+		if (vec3(state.boxScale) != entities.scale(boxEntity))
+			entities.setScale(boxEntity, vec3(state.boxScale));
+		//The master's environment once it is loaded here too
+		if (state.skybox >= 0 && state.skybox < skyboxSetCount && state.skybox != skyboxActive && state.skybox != skyboxPending)
+			requestSkybox(skyboxSets[state.skybox].name);
+		wallsOff = state.wallsOff;
+		updateEntities();
+		wallSchedule.beginFrame(0.f, 0.f);
+		uploadScheduler.beginFrame(0.f, 0.f, 0.0);
+		wallTemporal.beginFrame();
+		wallCubeCapture.beginFrame();
+		depthPrepass.beginFrame();
+		serviceUploads(0.0);
+		updateShaders();
+		updateLayout();
+		updateLighting();
+		shadeProps();
+		updateSkyboxSwap();
+		drawListStale = true;
+
+		cameras.beginFrame();
+		wallViews.beginFrame();
 		{
-			// On left thumbstick movement, change box size
-			if (inputState.Thumbstick[ovrHand_Left].x != 0) {
-				float temp = boxScale + (inputState.Thumbstick[ovrHand_Left].x * 0.01f);
-				if (temp > 0.01f && temp < 1.0f)
-					boxScale = temp;
+			CpuScope scope("off-axis");
+			for (int eye = 0; eye < 2; eye++) {
+				wallModelviews[eye] = state.wallModelviews[eye];
+				eyePos[eye] = state.eyePositions[eye];
+				for (int i = 0; i < wallCount; i++)
+					wallVisible[layerIndex(eye, i)] = ((wallMask >> i) & 1) != 0;
 			}
-
-			// On left thumbstick press, reset box size
-			if (inputState.Buttons & ovrButton_LThumb) {
-				boxScale = 0.2f;
+			cave.computeProjections(eyePos, 2, wallProjections);
+			if (gpuWallProjection)
+				wallViews.setViews(0, 2, eyePos, wallModelviews);
+			cullPropLayers(0, 2);
+			for (int eye = 0; eye < 2; eye++)
+				setWallCameras(eye);
+		}
+		glEnable(GL_DEPTH_TEST);
+		recordDrawList();
+		wallResolution.beginPass();
+		if (stereoWalls) {
+			if (renderLayeredWalls(*stereoWallTarget, 0, 2 * wallCount))
+				RenderTargetCache::discardDepth();
+		}
+		else {
+			//Both eyes were culled above, so their walls are recorded in one go
+			if (!layeredWalls)
+				recordWallCommands(0, 2);
+			for (int eye = 0; eye < 2; eye++) {
+				if (!layeredWalls)
+					renderWallsSeparately(eye);
+				else if (renderLayeredWalls(*eyeWallTargets[eye], layerIndex(eye, 0), wallCount))
+					RenderTargetCache::discardDepth();
 			}
+			wallCommandsRecorded = 0;
+		}
+		wallResolution.endPass();
+		glDisable(GL_DEPTH_TEST);
+		glState().bindVertexArray(0);
+	}
 
-			// On right thumbstick movement or left thumbstick vertical movement, translate box
-			if (inputState.Thumbstick[ovrHand_Right].x != 0 || inputState.Thumbstick[ovrHand_Right].y != 0 
-					|| inputState.Thumbstick[ovrHand_Left].y != 0) {
-				boxtransform = glm::translate(boxtransform, vec3(inputState.Thumbstick[ovrHand_Right].x * 0.01f, 
-					inputState.Thumbstick[ovrHand_Right].y * 0.01f, inputState.Thumbstick[ovrHand_Left].y * -0.01f));
-			}
+	//! textures.quality: full, or high, medium and low to load the environments only from the
+	// level their views resolve down. A skybox drawn into the walls is sampled across a face
+	// at about a wall target's size, the one around the CAVE at eyeFaceTexels. A texture
+	// drawn both ways goes by the larger, and without an eye buffer the outer skyboxes keep
+	// every level.
+	void limitTextureSizes(float eyeFaceTexels) {
+		TextureQuality quality = TextureQuality::FULL;
+		if (!parseTextureQuality(config().getString("textures.quality", "full"), quality))
+			std::cerr << "textures.quality is full, high, medium or low, loading every level" << std::endl;
+		if (quality == TextureQuality::FULL)
+			return;
+		float wallTexels = (float)wallResolution.maxBase();
+		//0 for not seen yet, negative for no limit
+		std::map<std::string, float> sampled;
+		auto sample = [&sampled](const char * name, float texels) {
+			float & s = sampled[name];
+			s = texels <= 0.f || s < 0.f ? -1.f : std::max(s, texels);
+		};
+		sample("calibration_cube", wallTexels);
+		for (const SkyboxSet & set : skyboxSets) {
+			sample(set.eyes[0], wallTexels);
+			sample(set.eyes[1], wallTexels);
+			sample(set.outer, eyeFaceTexels);
+		}
+		for (const auto & it : sampled) {
+			if (it.second > 0.f)
+				assets.limitSize(it.first, textureSizeLimit(quality, it.second));
+		}
+	}
+
+	static int findSkyboxSet(const char * name) {
+		for (int i = 0; i < skyboxSetCount; i++) {
+			if (!strcmp(skyboxSets[i].name, name))
+				return i;
+		}
+		std::cerr << "unknown skybox set " << name << std::endl;
+		return -1;
+	}
+
+	//! Switch to another environment without stalling the frame.
+	// @input name One of the skyboxSets. Its cubemaps are loaded and uploaded in the background,
+	//		and the scene keeps drawing the current set until all of them are resident. A set
+	//		still loading that this one replaces is cancelled.
+	void requestSkybox(const char * name) {
+		int set = findSkyboxSet(name);
+		if (set < 0 || set == skyboxPending)
+			return;
+		if (skyboxPending >= 0)
+			cancelSkybox(skyboxSets[skyboxPending]);
+		if (set == skyboxActive) {
+			skyboxPending = -1;
+			return;
+		}
+		skyboxPending = set;
+		assets.prefetch(skyboxSets[set].outer, AssetLoader::SOON);
+		assets.prefetch(skyboxSets[set].eyes[0], AssetLoader::SOON);
+		assets.prefetch(skyboxSets[set].eyes[1], AssetLoader::SOON);
+	}
+
+	//Switching through the sets quickly leaves only the last one's files to load
+	void cancelSkybox(const SkyboxSet & set) {
+		const SkyboxSet & active = skyboxSets[skyboxActive];
+		for (const char * name : { set.outer, set.eyes[0], set.eyes[1] }) {
+			if (strcmp(name, active.outer) && strcmp(name, active.eyes[0]) && strcmp(name, active.eyes[1]))
+				assets.cancel(name);
+		}
+	}
+
+	void updateSkyboxSwap() {
+		if (skyboxPending < 0)
+			return;
+		const SkyboxSet & set = skyboxSets[skyboxPending];
+		//Keeps the set used while it loads, so the budget does not evict half of it, and asks
+		//again for what it did evict
+		assets.prefetch(set.outer, AssetLoader::SOON);
+		assets.prefetch(set.eyes[0], AssetLoader::SOON);
+		assets.prefetch(set.eyes[1], AssetLoader::SOON);
+		if (assets.resident(set.outer) && assets.resident(set.eyes[0]) && assets.resident(set.eyes[1])) {
+			skyboxActive = skyboxPending;
+			skyboxPending = -1;
+		}
+		//A face that cannot be loaded never becomes resident, the set stays as it is
+		else if (assets.failed(set.outer) || assets.failed(set.eyes[0]) || assets.failed(set.eyes[1])) {
+			std::cerr << "skybox set " << set.name << " failed to load, keeping " << skyboxSets[skyboxActive].name << std::endl;
+			cancelSkybox(set);
+			skyboxPending = -1;
+		}
+	}
 
+	// Runs once a frame: the presses among the frame's events, then as many simulation steps
+	// as the time since the last frame holds
+	void checkInput(const FrameState & state) {
+		for (size_t i = 0; i < state.eventCount; i++) {
+			const InputEvent & e = state.events[i];
+			if (e.type == InputEvent::THUMBSTICK) {
+				thumbsticks[e.code] = vec2(e.x, e.y);
+				continue;
+			}
+			if (e.type != InputEvent::TOUCH_BUTTON || !e.action)
+				continue;
+			switch (e.code) {
+			// On left thumbstick press, reset box size
+			case ovrButton_LThumb:
+				boxCurrent.scale = boxPrevious.scale = BOX_SCALE;
+				break;
+			// On right thumbstick press, composite the next viewer's walls
+			case ovrButton_RThumb:
+				shownViewer = (shownViewer + 1) % viewerCount;
+				break;
 			// On B press, change head tracking mode
-			if (inputState.Buttons & ovrButton_B && !B_down) {
-				B_down = true;
+			case ovrButton_B:
 				track = !track;
-				printf("Tracking mode:%d", track);
+				logStream(LOG_INFO) << "Tracking mode:" << track << std::endl;
+				break;
+			case ovrButton_A:
+				debug = !debug;
+				break;
+			case ovrButton_X:
+				if (brokenWall >= 0)
+					wallsOff ^= 1u << layerIndex(ovrEye_Right, brokenWall);
+				break;
+			// Y cycles through the environments
+			case ovrButton_Y: {
+				int current = skyboxPending >= 0 ? skyboxPending : skyboxActive;
+				requestSkybox(skyboxSets[(current + 1) % skyboxSetCount].name);
+				break;
 			}
-			if (!(inputState.Buttons & ovrButton_B)) {
-				B_down = false;
 			}
+		}
 
-			// Check A press
-			if (inputState.Buttons & ovrButton_A && !A_down) {
-				A_down = true;
-				debug = !debug;				
-			}
-			if (!(inputState.Buttons & ovrButton_A)) {
-				A_down = false;
-			}
+		int steps = simulation.advance(state.displayTime);
+		for (int i = 0; i < steps; i++) {
+			boxPrevious = boxCurrent;
+			stepSimulation((float)simulation.step());
+			if (physics.active())
+				physics.step((float)simulation.step(), &jobs());
+		}
+		if (cpuProfiler().enabled())
+			cpuProfiler().counter("sim steps", steps);
+
+		// The box is drawn where it is between the last two steps at this frame's time
+		float alpha = simulation.alpha();
+		vec3 position = glm::mix(boxPrevious.position, boxCurrent.position, alpha);
+		vec3 scale = vec3(glm::mix(boxPrevious.scale, boxCurrent.scale, alpha));
+		if (position != entities.position(boxEntity))
+			entities.setPosition(boxEntity, position);
+		if (scale != entities.scale(boxEntity))
+			entities.setScale(boxEntity, scale);
+		if (physics.active())
+			physics.apply(entities, alpha);
+	}
 
-			// Check X press
-			if (inputState.Buttons & ovrButton_X && !X_down) {
-				X_down = true;
-				broken = !broken;
+	//! The prop the right controller points at, once a frame before the entities update, so
+	// it is picked against their bounds of the frame before. Grabs it on an index trigger
+	// press and moves a grabbed one with the hand.
+	void pickProp(const FrameState & state) {
+		if (!pickProps)
+			return;
+		CpuScope scope("pick");
+		pickRay = ovr::toPose(state.tracking.HandPoses[ovrHand_Right].ThePose);
+		bool held = state.inputValid && state.input.IndexTrigger[ovrHand_Right] > 0.5f;
+		vec3 handVelocity = ovr::toGlm(state.tracking.HandPoses[ovrHand_Right].LinearVelocity);
+		if (grabbedProp != EntityStore::NONE) {
+			if (held) {
+				RigidPose moved = pickRay * grabOffset;
+				entities.setPosition(grabbedProp, moved.position);
+				entities.setRotation(grabbedProp, moved.orientation);
+				if (physics.active())
+					physics.hold(entities.index(grabbedProp) - 1, moved.position, moved.orientation, handVelocity);
 			}
-			if (!(inputState.Buttons & ovrButton_X)) {
-				X_down = false;
+			else {
+				grabbedProp = EntityStore::NONE;
+				//Thrown, at the speed the hand had when it let go
+				physics.release(handVelocity);
 			}
+		}
+
+		//The grabbed prop goes on being picked, it is in the hand whatever is in front of it
+		if (grabbedProp == EntityStore::NONE) {
+			size_t hit;
+			vec3 direction = pickRay.orientation * vec3(0.f, 0.f, -1.f);
+			bool found = propBvh ? propTree.raycast(entities, pickRay.position, direction, pickDistance, hit, pickedAt)
+				: entities.raycast(pickRay.position, direction, pickDistance, 1, propCount, hit, pickedAt);
+			pickedProp = found ? entities.entity(hit) : EntityStore::NONE;
+		}
+		//A press grabs, holding the trigger while sweeping over props does not
+		if (held && !grabHeld && pickedProp != EntityStore::NONE) {
+			grabbedProp = pickedProp;
+			grabOffset = pickRay.inverse() * RigidPose(entities.rotation(grabbedProp), entities.position(grabbedProp));
+		}
+		grabHeld = held;
+	}
 
+	// One fixed step of dt seconds of the simulation
+	void stepSimulation(float dt) {
+		const vec2 & left = thumbsticks[ovrHand_Left];
+		const vec2 & right = thumbsticks[ovrHand_Right];
+		// On left thumbstick movement, change box size
+		if (left.x != 0) {
+			float temp = boxCurrent.scale + left.x * BOX_SCALE_SPEED * dt;
+			if (temp > 0.01f && temp < 1.0f)
+				boxCurrent.scale = temp;
 		}
+
+		// On right thumbstick movement or left thumbstick vertical movement, translate box
+		boxCurrent.position += vec3(right.x, right.y, -left.y) * BOX_MOVE_SPEED * dt;
 	}
 };
 
@@ -1295,6 +6527,15 @@ public:
 // An example application that renders a simple cube
 class ExampleApp : public RiftApp {
 	std::shared_ptr<ColorCubeScene> cubeScene;
+	std::function<mat4(ovrEyeType)> lateModelview;
+	// With cluster.role=master every frame's walls go out to the render nodes as well, as
+	// deltas on the last full state, which goes out every cluster.key_interval frames. A node
+	// that loses or skips a state can apply the next one all the same.
+	ClusterSync cluster;
+	FrameDeltaWriter clusterCoder{ sizeof(ClusterFrame), (unsigned int)std::max(config().getInt("cluster.key_interval", 30), 1), true };
+	std::vector<unsigned char> clusterCoded;
+	// The walls on the room's projectors, windows of their own (projector.walls)
+	ProjectorOutputs projectors;
 
 public:
 	ExampleApp() { }
@@ -1304,33 +6545,799 @@ protected:
 		RiftApp::initGl();
 		glClearColor(0.5, 0.5, 0.5, 0);
 		glEnable(GL_DEPTH_TEST);
-		ovr_RecenterTrackingOrigin(_session);
+		recenter();
+		StartupScope scope("scene", "ColorCubeScene");
+		cubeScene = std::shared_ptr<ColorCubeScene>(new ColorCubeScene(eyeFaceTexels()));
+		cubeScene->setEyeProjections(eyeProjection(ovrEye_Left), eyeProjection(ovrEye_Right));
+		if (_session && config().getBool("walls.quad_layers", false)) {
+			cubeScene->enableWallLayers(_session, config().getBool("walls.quad_high_quality", true));
+		}
+		cubeScene->warmPipelines(GL_SRGB8_ALPHA8, eyeBufferStencil() ? GL_DEPTH24_STENCIL8 : GL_DEPTH_COMPONENT16,
+			config().getInt("eye.msaa", 1));
+		if (config().getBool("pose.late_latch", false)) {
+			lateModelview = [this](ovrEyeType eye) { return rigidInverse(latchEyePose(eye)); };
+		}
+		if (parseClusterRole(config().getString("cluster.role", "off")) == ClusterSync::MASTER) {
+			cluster.startMaster(config().getString("cluster.group", "239.255.48.51"), config().getInt("cluster.port", 47800),
+				config().getInt("cluster.nodes", 0), config().getInt("cluster.ttl", 1));
+			clusterCoded.resize(clusterCoder.maxCoded());
+		}
+		setupProjectors(config().getString("projector.walls"));
+	}
+
+	//! A projector window for each wall in list (comma separated names, "all" for every
+	// wall) and each eye projector.eyes names: left (the default), right, or both for
+	// passive stereo, the left eye's windows first. They go on the monitors from
+	// projector.first_monitor (1, the one after the main window's) on, and swap with vsync
+	// only with projector.vsync. Outputs past the last monitor open as
+	// projector.window_size windows.
+	void setupProjectors(const std::string & list) {
+		if (list.empty())
+			return;
+		std::vector<int> walls;
+		if (list == "all") {
+			for (int i = 0; i < cubeScene->wallCount; i++)
+				walls.push_back(i);
+		}
+		size_t start = list == "all" ? list.size() : 0;
+		while (start < list.size()) {
+			size_t end = std::min(list.find(',', start), list.size());
+			std::string name = list.substr(start, end - start);
+			start = end + 1;
+			name.erase(0, name.find_first_not_of(" \t"));
+			name.erase(name.find_last_not_of(" \t") + 1);
+			if (name.empty())
+				continue;
+			int wall = cubeScene->cave.find(name);
+			if (wall < 0)
+				std::cerr << "projector.walls: no wall " << name << std::endl;
+			else
+				walls.push_back(wall);
+		}
+		std::string eyes = config().getString("projector.eyes", "left");
+		std::vector<ProjectorOutputs::Output> outputs;
+		for (int eye = 0; eye < 2; eye++) {
+			if ((eye == 0 && eyes == "right") || (eye == 1 && eyes != "right" && eyes != "both"))
+				continue;
+			for (int wall : walls)
+				outputs.push_back({ wall, eye });
+		}
+		uint32_t projected = 0;
+		for (int wall : walls)
+			projected |= 1u << wall;
+		cubeScene->setProjectedWalls(projected);
+		size_t opened = projectors.open(window, outputs, config().getInt("projector.first_monitor", 1),
+			config().getInt("projector.window_size", 512), config().getBool("projector.vsync", false));
+		logStream(LOG_INFO) << opened << " projector outputs" << std::endl;
+	}
+
+	void shutdownGl() override {
+		cluster.shutdown();
+		cubeScene.reset();
+		RiftApp::shutdownGl();
+	}
+
+	//The walls the frame rendered go to the projectors as well, before the mirror's swap
+	void finishFrame() override {
+		projectors.present([this](int eye, int wall, GLuint & texture, GLint & layer, GLsizei & size) {
+			return cubeScene->wallTexture(eye, wall, texture, layer, size);
+		});
+		RiftApp::finishFrame();
+	}
+
+	int sceneLayers(const ovrLayerHeader ** out, int max) const override {
+		return cubeScene->wallLayerHeaders(out, max);
+	}
+
+	void prepareScene(const FrameState & predicted) override {
+		cubeScene->prepareFrame(predicted);
+	}
+
+	bool mirrorWallTexture(int eye, int wall, GLuint & texture, GLint & layer, GLsizei & size) const override {
+		return cubeScene->wallTexture(eye, wall, texture, layer, size);
+	}
+
+	bool sceneResidency(uint64_t & resident, uint64_t & budget, size_t & evictions) const override {
+		return cubeScene->textureResidency(resident, budget, evictions);
+	}
+
+	bool sceneCoversEyes() const override {
+		return cubeScene->coversEyeBuffer();
+	}
+
+	void renderScene(const RenderContext & context) override {
+		cubeScene->setSingleView(singleView());
+		cubeScene->setHeadTracked(headPositionTracked());
+		cubeScene->render(context, lateModelview);
+		if ((context.eye == ovrEye_Right || singleView()) && cluster.role() == ClusterSync::MASTER) {
+			ClusterFrame state = {};
+			cubeScene->clusterFrame(state);
+			cluster.publish(clusterCoded.data(), clusterCoder.write(&state, clusterCoded.data()));
+		}
+	}
+};
+
+// A render node of a clustered CAVE (cluster.role=node), on a machine of its own with no
+// headset. Its window shows the walls cluster.walls names (comma separated, every wall by
+// default) side by side, as cluster.eye (0 left, 1 right) sees them: one projector across
+// them, or a window per projector with a node each. cluster.window_width, _height, _x
+// and _y place the window.
+//
+// Every frame it renders the newest state the master sent (waiting up to
+// cluster.timeout_ms for one), then waits at the swap barrier, so every node shows the
+// frame at once. cluster.node is its number in the cluster, the master's cluster.nodes
+// counts them.
+class ClusterNodeApp : public GlfwApp {
+	std::shared_ptr<ColorCubeScene> cubeScene;
+	ClusterSync cluster;
+	// The master's state as of the last datagram, which only holds what changed since the
+	// one before. After a lost one the node waits for the next full state.
+	FrameDeltaReader clusterReader{ sizeof(ClusterFrame) };
+	ClusterFrame state = {};
+	uint64_t stateFrame = 0;
+	bool rendered = false;
+	std::vector<int> walls;
+	uint32_t wallMask = 0;
+	int nodeEye = 0;
+	int timeoutMs = 100;
+	GLuint readFbo = 0;
+
+protected:
+	GLFWwindow * createRenderingTarget(uvec2 & outSize, ivec2 & outPosition) override {
+		outSize = uvec2(std::max(config().getInt("cluster.window_width", 1280), 1), std::max(config().getInt("cluster.window_height", 720), 1));
+		outPosition = ivec2(config().getInt("cluster.window_x", INT_MIN), config().getInt("cluster.window_y", INT_MIN));
+		return glfw::createWindow(outSize, outPosition);
+	}
+
+	void initGl() override {
+		GlfwApp::initGl();
+		// The swap barrier holds the frame, the swap itself goes with the projector's refresh
+		glfwSwapInterval(config().getBool("cluster.vsync", true) ? 1 : 0);
+		StartupScope scope("scene", "ColorCubeScene");
 		cubeScene = std::shared_ptr<ColorCubeScene>(new ColorCubeScene());
+		cubeScene->setClusterNode();
+		setupWalls(config().getString("cluster.walls"));
+		//The node's window, as GLFW asks for it
+		cubeScene->warmPipelines(GL_RGBA8, GL_DEPTH24_STENCIL8, 1);
+		nodeEye = config().getInt("cluster.eye", 0) ? 1 : 0;
+		timeoutMs = std::max(config().getInt("cluster.timeout_ms", 100), 1);
+		glGenFramebuffers(1, &readFbo);
+		if (!cluster.startNode(config().getString("cluster.group", "239.255.48.51"), config().getInt("cluster.port", 47800),
+				config().getInt("cluster.node", 0))) {
+			FAIL("Could not join the cluster");
+		}
 	}
 
 	void shutdownGl() override {
+		cluster.shutdown();
+		glDeleteFramebuffers(1, &readFbo);
 		cubeScene.reset();
+		GlfwApp::shutdownGl();
+	}
+
+	// The walls named in list, in its order, or all of them
+	void setupWalls(const std::string & list) {
+		size_t start = 0;
+		while (start < list.size()) {
+			size_t end = std::min(list.find(',', start), list.size());
+			std::string name = list.substr(start, end - start);
+			start = end + 1;
+			name.erase(0, name.find_first_not_of(" \t"));
+			name.erase(name.find_last_not_of(" \t") + 1);
+			if (name.empty())
+				continue;
+			int wall = cubeScene->cave.find(name);
+			if (wall < 0) {
+				std::cerr << "cluster.walls: no wall " << name << std::endl;
+				continue;
+			}
+			walls.push_back(wall);
+		}
+		if (walls.empty()) {
+			for (int i = 0; i < cubeScene->wallCount; i++)
+				walls.push_back(i);
+		}
+		for (int wall : walls)
+			wallMask |= 1u << wall;
 	}
 
-	void renderScene(const glm::mat4 & projection, const glm::mat4 & headPose, ovrEyeType eye, int displaymode, GLuint hmd_fbo, ovrLayerEyeFov _sceneLayer, uvec2 windowSize) override {
-		cubeScene->render(projection, glm::inverse(headPose), _session, eye, displaymode, hmd_fbo, _sceneLayer, windowSize);
+	void draw() override {
+		frameArena().reset();
+		unsigned char packet[ClusterSync::MAX_PAYLOAD];
+		size_t size = 0;
+		uint64_t received;
+		// Without a new state there is nothing to show that is not on screen already
+		rendered = false;
+		if (!cluster.receive(received, packet, size, timeoutMs))
+			return;
+		if (!clusterReader.read(packet, size, &state))
+			return;
+		stateFrame = received;
+		cubeScene->renderClusterWalls(state, wallMask);
+
+		// The walls side by side, each stretched over its part of the window
+		CpuScope scope("wall blit");
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+		glViewport(0, 0, windowSize.x, windowSize.y);
+		glClear(GL_COLOR_BUFFER_BIT);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, readFbo);
+		for (size_t i = 0; i < walls.size(); i++) {
+			GLuint texture;
+			GLint layer;
+			GLsizei wallSize;
+			if (!cubeScene->wallTexture(nodeEye, walls[i], texture, layer, wallSize))
+				continue;
+			if (layer >= 0)
+				glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture, 0, layer);
+			else
+				glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+			GLint left = (GLint)(windowSize.x * i / walls.size());
+			GLint right = (GLint)(windowSize.x * (i + 1) / walls.size());
+			glBlitFramebuffer(0, 0, wallSize, wallSize, left, 0, right, windowSize.y, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+		}
+		glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+		rendered = true;
+	}
+
+	// Ready once the GPU is done, then the swap every node makes together
+	void finishFrame() override {
+		if (!rendered)
+			return;
+		{
+			CpuScope scope("swap barrier");
+			glFinish();
+			cluster.swapBarrier(stateFrame, timeoutMs);
+		}
+		GlfwApp::finishFrame();
 	}
 };
 
 // Execute our example class
+#ifdef CAVE_BENCHMARK
+
+// With benchmark.micro the benchmark build times the CPU hot paths one by one instead of
+// rendering frames: the off-axis projections, the SDK pose conversions, the head pose
+// inverse, mapping the shipped PPMs and the texture uploads. The context is only there for
+// the uploads, the window stays hidden and closes once the cases have run.
+// benchmark.micro_repeats and benchmark.micro_ms set how long each case runs,
+// benchmark.micro_csv also writes the results there.
+class MicroBenchApp : public GlfwApp {
+protected:
+	GLFWwindow * createRenderingTarget(uvec2 & outSize, ivec2 & outPosition) override {
+		glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+		return glfw::createWindow(uvec2(256, 256));
+	}
+
+	void initGl() override {
+		GlfwApp::initGl();
+		MicroBench bench(config().getInt("benchmark.micro_repeats", 5), config().getFloat("benchmark.micro_ms", 200.0f) / 1000.0f);
+		benchCave(bench);
+		benchPoses(bench);
+		benchEntities(bench);
+		benchImages(bench);
+		benchPixels(bench);
+		bench.report(std::cout);
+		std::string csvFile = config().getString("benchmark.micro_csv");
+		if (!csvFile.empty())
+			bench.writeCsv(csvFile.c_str());
+		glfwSetWindowShouldClose(window, 1);
+	}
+
+	void draw() override {}
+
+	// The same eye positions every run, a little apart so nothing is computed only once
+	static void benchCave(MicroBench & bench) {
+		CaveLayout cave;
+		std::string layoutFile = config().getString("cave.layout");
+		if (!layoutFile.empty())
+			cave.load(layoutFile.c_str());
+		const int CASES = 64;
+		vec3 eyes[CASES][2];
+		for (int i = 0; i < CASES; i++) {
+			float t = (float)i / CASES;
+			eyes[i][0] = vec3(-0.032f + 0.1f * t, 0.2f * t, 0.1f - 0.2f * t);
+			eyes[i][1] = eyes[i][0] + vec3(0.064f, 0.f, 0.f);
+		}
+		mat4 projections[2 * CaveLayout::MAX_WALLS];
+		const CaveLayout::Kernel kernels[] = { CaveLayout::KERNEL_SCALAR, CaveLayout::KERNEL_SSE, CaveLayout::KERNEL_AVX };
+		for (CaveLayout::Kernel requested : kernels) {
+			// The CPU may not have it, then it is the same as the next narrower one
+			CaveLayout::setKernel(requested);
+			CaveLayout::Kernel kernel = CaveLayout::kernel();
+			if (kernel != requested)
+				continue;
+			std::cout << "CaveLayout " << CaveLayout::kernelName(kernel) << " kernel off the scalar one by at most "
+				<< cave.kernelError(kernel) << std::endl;
+			bench.run(std::string("CaveLayout::computeProjections ") + CaveLayout::kernelName(kernel), CASES, [&]() -> uint64_t {
+				for (int i = 0; i < CASES; i++) {
+					cave.computeProjections(eyes[i], 2, projections, kernel);
+					MicroBench::keep(projections[0][0][0]);
+				}
+				return 0;
+			});
+		}
+		CaveLayout::setKernel(CaveLayout::KERNEL_AUTO);
+	}
+
+	static void benchPoses(MicroBench & bench) {
+		const int CASES = 256;
+		std::vector<ovrPosef> poses(CASES);
+		std::vector<mat4> matrices(CASES);
+		for (int i = 0; i < CASES; i++) {
+			float t = (float)i / CASES;
+			quat orientation = glm::angleAxis(6.0f * t, glm::normalize(vec3(0.3f, 1.f, 0.1f)));
+			poses[i].Orientation = ovr::fromGlm(orientation);
+			poses[i].Position = ovr::fromGlm(vec3(t, 1.6f, -t));
+			matrices[i] = ovr::toGlm(poses[i]);
+		}
+		bench.run("ovr::toGlm(ovrPosef)", CASES, [&]() -> uint64_t {
+			for (int i = 0; i < CASES; i++)
+				MicroBench::keep(ovr::toGlm(poses[i])[3][0]);
+			return 0;
+		});
+		bench.run("ovr::fromGlm(mat4)", CASES, [&]() -> uint64_t {
+			for (int i = 0; i < CASES; i++)
+				MicroBench::keep(ovr::fromGlm(matrices[i]).M[0][3]);
+			return 0;
+		});
+		bench.run("glm::inverse(headPose)", CASES, [&]() -> uint64_t {
+			for (int i = 0; i < CASES; i++)
+				MicroBench::keep(glm::inverse(matrices[i])[3][0]);
+			return 0;
+		});
+		bench.run("rigidInverse(headPose)", CASES, [&]() -> uint64_t {
+			for (int i = 0; i < CASES; i++)
+				MicroBench::keep(rigidInverse(matrices[i])[3][0]);
+			return 0;
+		});
+		bench.run("ovr::toGlmInverse(ovrPosef)", CASES, [&]() -> uint64_t {
+			for (int i = 0; i < CASES; i++)
+				MicroBench::keep(ovr::toGlmInverse(poses[i])[3][0]);
+			return 0;
+		});
+	}
+
+	// A grid of props moved every frame and culled against both eyes' walls, on the render
+	// thread alone and split over the worker pool, one by one and through a hierarchy
+	static void benchEntities(MicroBench & bench) {
+		const int COUNT = 16384;
+		EntityStore store;
+		for (int i = 0; i < COUNT; i++)
+			store.create(vec3((float)(i % 32), (float)(i / 32 % 32), (float)(i / 1024)) * 0.1f - vec3(1.6f), quat(), vec3(0.02f));
+		CaveLayout cave;
+		vec3 eyes[2] = { vec3(-0.032f, 0.f, 0.f), vec3(0.032f, 0.f, 0.f) };
+		mat4 projections[2 * CaveLayout::MAX_WALLS];
+		cave.computeProjections(eyes, 2, projections);
+		int views = 2 * (int)cave.size();
+		std::vector<uint32_t> masks(COUNT, 0);
+		JobSystem * pools[] = { nullptr, &jobs() };
+		for (JobSystem * pool : pools) {
+			std::string threads = pool ? std::to_string(pool->threadCount()) + " threads" : std::string("1 thread");
+			bench.run("EntityStore::update, " + threads, COUNT, [&]() -> uint64_t {
+				for (int i = 0; i < COUNT; i++)
+					store.setRotation((EntityStore::Entity)i, glm::angleAxis(0.001f * i, vec3(0.f, 1.f, 0.f)));
+				store.update(pool);
+				return 0;
+			});
+			bench.run("EntityStore::cullViews, " + threads, COUNT, [&]() -> uint64_t {
+				MicroBench::keep((uint64_t)store.cullViews(projections, views, 0, 0, COUNT, masks.data(), pool));
+				return 0;
+			});
+		}
+		EntityBvh tree;
+		tree.update(store, 0, COUNT);
+		bench.run("EntityBvh::update (refit)", COUNT, [&]() -> uint64_t {
+			//One entity touched is enough for a new version, the refit goes over every node
+			store.setRotation(0, glm::angleAxis(0.5f, vec3(0.f, 1.f, 0.f)));
+			store.update();
+			MicroBench::keep((uint64_t)tree.update(store, 0, COUNT));
+			return 0;
+		});
+		for (JobSystem * pool : pools) {
+			std::string threads = pool ? std::to_string(pool->threadCount()) + " threads" : std::string("1 thread");
+			bench.run("EntityBvh::cullViews, " + threads, COUNT, [&]() -> uint64_t {
+				MicroBench::keep((uint64_t)tree.cullViews(store, projections, views, 0, masks.data(), pool));
+				return 0;
+			});
+		}
+		LodSelector lods;
+		const float errors[] = { 0.f, 0.005f, 0.02f, 0.08f };
+		lods.configure(errors, 4, 1.f, 0.25f);
+		lods.resize(COUNT);
+		float pixelScales[2 * CaveLayout::MAX_WALLS];
+		for (int i = 0; i < views; i++)
+			pixelScales[i] = LodSelector::pixelScale(projections[i], 1024);
+		for (JobSystem * pool : pools) {
+			std::string threads = pool ? std::to_string(pool->threadCount()) + " threads" : std::string("1 thread");
+			bench.run("LodSelector::select, " + threads, COUNT, [&]() -> uint64_t {
+				MicroBench::keep((uint64_t)lods.select(projections, pixelScales, views, 0, masks.data(), store.worldMatrices(),
+					store.boundsMin(), store.boundsMax(), pool));
+				return 0;
+			});
+		}
+	}
+
+	// The pixel conversions of a made up 1024 square RGB image in every kernel the CPU has,
+	// each checked against the scalar one's bytes first
+	static void benchPixels(MicroBench & bench) {
+		const uint32_t SIDE = 1024;
+		const size_t TEXELS = (size_t)SIDE * SIDE;
+		std::vector<unsigned char> rgb(TEXELS * 3);
+		uint32_t seed = 1;
+		for (unsigned char & c : rgb) {
+			seed = seed * 1664525u + 1013904223u;
+			c = (unsigned char)(seed >> 24);
+		}
+		std::vector<unsigned char> expanded(TEXELS * 4), half(TEXELS * 3 / 4), flipped(rgb);
+		std::vector<unsigned char> scalarExpanded(TEXELS * 4), scalarHalf(TEXELS * 3 / 4), scalarSrgb(TEXELS * 3 / 4);
+		expandRGB8(rgb.data(), TEXELS, scalarExpanded.data(), true, PIXEL_KERNEL_SCALAR);
+		downsamplePixels(rgb.data(), SIDE, SIDE, scalarHalf.data(), SIDE / 2, SIDE / 2, false, PIXEL_KERNEL_SCALAR);
+		downsamplePixels(rgb.data(), SIDE, SIDE, scalarSrgb.data(), SIDE / 2, SIDE / 2, true, PIXEL_KERNEL_SCALAR);
+
+		const PixelKernel kernels[] = { PIXEL_KERNEL_SCALAR, PIXEL_KERNEL_SSSE3, PIXEL_KERNEL_AVX2 };
+		for (PixelKernel requested : kernels) {
+			// The CPU may not have it, then it is the same as the next narrower one
+			setPixelKernel(requested);
+			PixelKernel kernel = pixelKernel();
+			if (kernel != requested)
+				continue;
+			std::string name = pixelKernelName(kernel);
+			expandRGB8(rgb.data(), TEXELS, expanded.data(), true, kernel);
+			downsamplePixels(rgb.data(), SIDE, SIDE, half.data(), SIDE / 2, SIDE / 2, false, kernel);
+			bool same = expanded == scalarExpanded && half == scalarHalf;
+			downsamplePixels(rgb.data(), SIDE, SIDE, half.data(), SIDE / 2, SIDE / 2, true, kernel);
+			if (!same || half != scalarSrgb)
+				std::cerr << "the " << name << " pixel kernel does not give the scalar one's bytes" << std::endl;
+
+			bench.run("expandRGB8 (BGRA) " + name, 1, [&]() -> uint64_t {
+				expandRGB8(rgb.data(), TEXELS, expanded.data(), true, kernel);
+				MicroBench::keep(expanded[TEXELS]);
+				return TEXELS * 3;
+			});
+			bench.run("flipRows " + name, 1, [&]() -> uint64_t {
+				flipRows(flipped.data(), SIDE * 3, SIDE, kernel);
+				MicroBench::keep(flipped[0]);
+				return TEXELS * 3;
+			});
+			bench.run("downsamplePixels " + name, 1, [&]() -> uint64_t {
+				downsamplePixels(rgb.data(), SIDE, SIDE, half.data(), SIDE / 2, SIDE / 2, false, kernel);
+				MicroBench::keep(half[0]);
+				return TEXELS * 3;
+			});
+			bench.run("downsamplePixels (sRGB) " + name, 1, [&]() -> uint64_t {
+				downsamplePixels(rgb.data(), SIDE, SIDE, half.data(), SIDE / 2, SIDE / 2, true, kernel);
+				MicroBench::keep(half[0]);
+				return TEXELS * 3;
+			});
+		}
+		setPixelKernel(PIXEL_KERNEL_AUTO);
+	}
+
+	// Every PPM the scene ships with, mapped and read through. After the first pass they come
+	// from the file cache, so this times the parse and the memory, not the disk.
+	static void benchImages(MicroBench & bench) {
+		std::vector<std::string> files;
+		for (const TextureAsset & asset : sceneTextures) {
+			for (const std::string & file : asset.files) {
+				if (std::find(files.begin(), files.end(), file) == files.end())
+					files.push_back(file);
+			}
+		}
+		files.erase(std::remove_if(files.begin(), files.end(), [](const std::string & file) {
+			//The uploads below take the faces as they are mapped, 8 bits a sample
+			PPMImage image;
+			if (mapPPM(file.c_str(), image) && image.maxval <= 255)
+				return false;
+			std::cerr << "micro benchmark skips " << file << std::endl;
+			return true;
+		}), files.end());
+		if (files.empty())
+			return;
+
+		bench.run("mapPPM + read", (uint64_t)files.size(), [&]() -> uint64_t {
+			uint64_t bytes = 0;
+			for (const std::string & file : files) {
+				PPMImage image;
+				mapPPM(file.c_str(), image);
+				size_t size = (size_t)image.width * image.height * 3;
+				uint64_t sum = 0;
+				for (size_t i = 0; i < size; i += 64)
+					sum += image.pixels[i];
+				MicroBench::keep(sum);
+				bytes += size;
+			}
+			return bytes;
+		});
+
+		// The same faces deployed as QOIs, where there are any: their bytes are what is read
+		// from disk, the decode has to beat that read to be worth it
+		std::vector<std::string> qoiFiles;
+		for (const std::string & file : files) {
+			uint64_t size, time;
+			std::string qoi = qoiSourcePath(file);
+			if (sourceFileStamp(qoi.c_str(), size, time))
+				qoiFiles.push_back(qoi);
+		}
+		if (!qoiFiles.empty()) {
+			std::vector<unsigned char> decoded;
+			bench.run("mapQOI + decodeQOI", (uint64_t)qoiFiles.size(), [&]() -> uint64_t {
+				uint64_t bytes = 0;
+				for (const std::string & file : qoiFiles) {
+					QOIImage image;
+					if (!mapQOI(file.c_str(), image))
+						continue;
+					decoded.resize((size_t)image.width * image.height * 3);
+					MicroBench::keep((uint64_t)decodeQOI(image, decoded.data()));
+					bytes += image.file.size();
+				}
+				return bytes;
+			});
+		}
+
+		// The uploads wait for the GPU, so they time the whole copy and not only the call
+		PPMImage face;
+		mapPPM(files[0].c_str(), face);
+		uint64_t faceBytes = (uint64_t)face.width * face.height * 3;
+		Quad quad;
+		bench.run("Quad::loadQuadTexture", 1, [&]() -> uint64_t {
+			GLuint texture = quad.loadQuadTexture(face.pixels, face.width, face.height);
+			glFinish();
+			gpuMemory().release(GpuMemory::KIND_TEXTURE, texture);
+			glDeleteTextures(1, &texture);
+			return faceBytes;
+		});
+		Box box;
+		std::vector<const unsigned char *> faces(6, face.pixels);
+		bench.run("Box::loadBoxTexture", 1, [&]() -> uint64_t {
+			GLuint texture = box.loadBoxTexture(faces, face.width, face.height);
+			glFinish();
+			gpuMemory().release(GpuMemory::KIND_TEXTURE, texture);
+			glDeleteTextures(1, &texture);
+			return 6 * faceBytes;
+		});
+	}
+};
+
+#endif
+
+// The GL half of the station calibration (StationProbe.h): the fill and upload tests in the
+// context of a hidden window, which then closes
+class StationProbeApp : public GlfwApp {
+public:
+	StationProbeApp(StationProbe & probe) : probe(probe) {}
+
+protected:
+	GLFWwindow * createRenderingTarget(uvec2 & outSize, ivec2 & outPosition) override {
+		glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+		return glfw::createWindow(uvec2(256, 256));
+	}
+
+	void initGl() override {
+		GlfwApp::initGl();
+		probe.measureFill();
+		probe.measureUpload();
+		glfwSetWindowShouldClose(window, 1);
+	}
+
+	void draw() override {}
+
+private:
+	StationProbe & probe;
+};
+
+//! Measures the station and writes its profile to filename: the GL tests, station.disk_mb
+// of disk in the working directory and, in the benchmark build, station.frames frames of the
+// scene as it is configured, headless. The settings are as they were after.
+static void calibrateStation(const std::string & filename) {
+	logStream(LOG_INFO) << "calibrating the station" << std::endl;
+	StationProbe probe;
+	StationProbeApp(probe).run();
+	probe.measureDisk(".", std::max(config().getInt("station.disk_mb", 256), 4));
+#ifdef CAVE_BENCHMARK
+	{
+		Config settings = config();
+		std::string frames = std::to_string(std::max(config().getInt("station.frames", 600), 1));
+		config().set("benchmark.warmup", "100");
+		config().set("benchmark.frames", frames);
+		config().set("benchmark.session", "sweep");
+		config().set("benchmark.baseline", "");
+		config().set("benchmark.update_baseline", "0");
+		config().set("soak.minutes", "0");
+		ExampleApp app;
+		if (app.run() == 0 && app.measuredGpu().frames)
+			probe.setSceneTimes(app.measuredGpu().p50, app.measuredFrame().p50, config().getInt("walls.resolution", 1024));
+		config() = settings;
+	}
+#endif
+	probe.report(logStream(LOG_INFO));
+	if (probe.write(filename.c_str()))
+		logStream(LOG_INFO) << "station profile written to " << filename << std::endl;
+	else
+		std::cerr << "could not write the station profile " << filename << std::endl;
+}
+
+//! Opens the asset archive named on the command line, looking in the working directory and
+// then next to the executable. Without one every file is read from disk.
+static void openAssetArchive(int argc, char** argv) {
+	Config args;
+	args.parseArgs(argc, argv);
+	std::string name = args.getString("assets.archive", "project3.p3ar");
+	if (name.empty())
+		return;
+	//The settings are in the archive, so large pages for it can only be asked for on the
+	//command line
+	bool intoLargePages = args.getBool("memory.large_pages", false) && largePages().enable() &&
+		args.getBool("memory.large_pages_archive", true);
+	StartupScope scope("assets", name);
+	//A delta left next to the archive (assets.delta, TexCacheBuilder --delta) brings it up
+	//to date before it is mapped, and is deleted once it is in
+	std::string delta = args.getString("assets.delta", "project3.p3ad");
+	if (!delta.empty() && GetFileAttributesA(delta.c_str()) != INVALID_FILE_ATTRIBUTES && applyAssetDelta(name.c_str(), delta.c_str(), logStream(LOG_INFO)))
+		DeleteFileA(delta.c_str());
+	if (!assetArchive().open(name.c_str(), intoLargePages)) {
+		char executable[MAX_PATH];
+		DWORD length = GetModuleFileNameA(nullptr, executable, MAX_PATH);
+		std::string path(executable, length < MAX_PATH ? length : 0);
+		size_t slash = path.find_last_of("\\/");
+		if (slash == std::string::npos || !assetArchive().open((path.substr(0, slash + 1) + name).c_str(), intoLargePages))
+			return;
+	}
+	logStream(LOG_INFO) << "serving " << assetArchive().size() << " files from the asset archive " << name << std::endl;
+}
+
+//! The profile-guided optimization training run (pgo.train): the app once per trace of the
+// comma separated list, each replayed over and over for pgo.frames frames, then a clean
+// exit so a PGInstrument build writes its profile. Traces that cannot be read are skipped.
+// @return The first failed run's result, or 1 if no trace could be read
+static int runTraining(const std::string & list) {
+	std::string frames = std::to_string(std::max(config().getInt("pgo.frames", 3000), 1));
+	int runs = 0;
+	size_t start = 0;
+	while (start < list.size()) {
+		size_t end = std::min(list.find(',', start), list.size());
+		std::string trace = list.substr(start, end - start);
+		start = end + 1;
+		trace.erase(0, trace.find_first_not_of(" \t"));
+		trace.erase(trace.find_last_not_of(" \t") + 1);
+		if (trace.empty())
+			continue;
+		if (!std::ifstream(trace).is_open()) {
+			std::cerr << "pgo.train: no trace " << trace << std::endl;
+			continue;
+		}
+		config().set("trace.replay", trace);
+		config().set("trace.loop", "1");
+		config().set("app.max_frames", frames);
+		//The benchmark build would stop at its own count otherwise
+		config().set("benchmark.warmup", "0");
+		config().set("benchmark.frames", frames);
+		logStream(LOG_INFO) << "training on " << trace << " for " << frames << " frames" << std::endl;
+		int result = ExampleApp().run();
+		if (result)
+			return result;
+		runs++;
+	}
+	return runs ? 0 : 1;
+}
+
 int main(int argc, char** argv)
 {
 	int result = -1;
+	// A render node has no headset, it only needs the cluster's state
+	bool clusterNode = false;
+	// From here on printing only queues the line for the log's writer thread
+	logger().install();
 	try {
-		if (!OVR_SUCCESS(ovr_Initialize(nullptr))) {
-			FAIL("Failed to initialize the Oculus SDK");
+		// A packed archive (--assets.archive, project3.p3ar by default) serves every file it
+		// has, the settings included, so it is opened before anything is read
+		openAssetArchive(argc, argv);
+		// Settings come from project3.cfg next to the executable's working directory, and
+		// any of them can be overridden with --key=value
+		config().load("project3.cfg");
+		config().parseArgs(argc, argv);
+		// The station profile (station.profile) has the settings the calibration picked for this
+		// machine, over project3.cfg, the command line read again to stay over both. The
+		// benchmark build leaves it out unless station.apply, so its baselines stay comparable.
+#ifdef CAVE_BENCHMARK
+		bool stationDefaults = false;
+#else
+		bool stationDefaults = true;
+#endif
+		std::string stationFile = config().getString("station.profile", "project3.station.cfg");
+		bool stationProfile = !stationFile.empty() && config().getBool("station.apply", stationDefaults) &&
+			config().load(stationFile.c_str());
+		if (stationProfile)
+			config().parseArgs(argc, argv);
+		std::string sharedCache = config().getString("assets.shared_cache_name", "Local\\Project3AssetCache");
+		//Started by an instance to hold the shared asset cache between runs, it does nothing else
+		if (config().getBool("assets.shared_cache_keeper", false)) {
+			result = SharedAssetCache::keep(sharedCache, config().getFloat("assets.shared_cache_hours", 12.f));
+			logger().shutdown();
+			return result;
+		}
+		logger().configure(Log::parseLevel(config().getString("log.level", "info")),
+			config().getInt("log.lines_per_second", 200), config().getString("log.file", ""));
+		// memory.large_pages puts the image arenas' blocks and the frame arena in large pages
+		// (LargePages.h), where the account may lock pages in memory
+		if (config().getBool("memory.large_pages", false) && largePages().enable())
+			logStream(LOG_INFO) << "large pages of " << (largePages().largePageSize() >> 10) << " KB" << std::endl;
+		// assets.shared_cache_mb keeps decoded images and program binaries in shared memory for
+		// the next run, a keeper process holding it in between (SharedAssetCache.h)
+		int sharedCacheMb = config().getInt("assets.shared_cache_mb", 0);
+		if (sharedCacheMb > 0) {
+			StartupScope scope("assets", "shared cache");
+			sharedAssetCache().attach(sharedCache, (size_t)sharedCacheMb * 1024 * 1024, config().getBool("assets.shared_cache_keep", true));
+		}
+		// stress.props, .textures, .walls and .viewers swap the scene for a synthetic one of
+		// that size, for the scaling benchmarks (StressScene.h)
+		StressSpec stress;
+		if (stressSpecFromConfig(stress) && !applyStressScene(stress)) {
+			FAIL("Could not write the stress scene");
+		}
+		// threads.* sets the priority, MMCSS task and cores of the render, upload and worker
+		// threads as each starts (ThreadScheduling.h)
+		threadScheduling().configure();
+		clusterNode = parseClusterRole(config().getString("cluster.role", "off")) == ClusterSync::NODE;
+		// station.calibrate measures the station and writes its profile (StationProbe.h): "first"
+		// when there is none yet, the headset build's default, "now" on this run, or "off"
+		std::string calibrate = config().getString("station.calibrate", stationDefaults ? "first" : "off");
+		bool calibrating = !clusterNode && !stationFile.empty() && !config().getBool("benchmark.micro", false) && config().getString("pgo.train").empty() &&
+			(calibrate == "now" || (calibrate == "first" && GetFileAttributesA(stationFile.c_str()) == INVALID_FILE_ATTRIBUTES));
+		// Every background job and parallel loop of the app runs on these
+		jobs().start((unsigned int)std::max(config().getInt("jobs.threads", 0), 0));
+		// The scene's files are read while the SDK and the window are set up (startup.prefetch),
+		// after a calibration once the profile it writes has picked the threads
+		if (!calibrating && config().getBool("startup.prefetch", true))
+			prefetchStartupFiles();
+#ifndef CAVE_BENCHMARK
+		if (!clusterNode) {
+			ovrResult initResult;
+			{
+				StartupScope scope("sdk", "ovr_Initialize");
+				initResult = ovr_Initialize(nullptr);
+			}
+			if (!OVR_SUCCESS(initResult)) {
+				FAIL("Failed to initialize the Oculus SDK");
+			}
+		}
+#endif
+		if (calibrating) {
+			calibrateStation(stationFile);
+			if (config().getBool("station.apply", stationDefaults) && config().load(stationFile.c_str()))
+				config().parseArgs(argc, argv);
+			//The calibration ran on the threads of the settings before, the run gets the profile's
+			threadScheduling().configure();
+			jobs().start((unsigned int)std::max(config().getInt("jobs.threads", 0), 0));
+			if (config().getBool("startup.prefetch", true))
+				prefetchStartupFiles();
+		}
+#ifdef CAVE_BENCHMARK
+		if (config().getBool("benchmark.micro", false)) {
+			result = MicroBenchApp().run();
+		}
+		else
+#endif
+		if (clusterNode) {
+			result = ClusterNodeApp().run();
+		}
+		else if (!config().getString("pgo.train").empty()) {
+			result = runTraining(config().getString("pgo.train"));
+		}
+		else {
+			result = ExampleApp().run();
 		}
-		result = ExampleApp().run();
 	}
 	catch (std::exception & error) {
-		OutputDebugStringA(error.what());
-		std::cerr << error.what() << std::endl;
+		logStream(LOG_ERROR) << error.what() << std::endl;
+		logger().flush();
 	}
-	ovr_Shutdown();
+	jobs().stop();
+	sharedAssetCache().detach();
+#ifndef CAVE_BENCHMARK
+	if (!clusterNode)
+		ovr_Shutdown();
+#endif
+	logger().shutdown();
 	return result;
 }
@@ -0,0 +1,18 @@
+#version 410 core
+// Round points, opaque so the analytic sky (walls.analytic_sky) leaves them alone
+
+#ifdef MULTIVIEW
+in vec3 vsColor;
+#define pointColor vsColor
+#else
+in vec3 pointColor;
+#endif
+out vec4 color;
+
+void main()
+{
+	vec2 offset = gl_PointCoord * 2.0 - 1.0;
+	if (dot(offset, offset) > 1.0)
+		discard;
+	color = vec4(pointColor, 1.0);
+}
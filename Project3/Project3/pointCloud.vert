@@ -0,0 +1,37 @@
+#version 410 core
+// A point cloud's points (PointCloud.h), each the size of its node's spacing on screen so
+// that a node's points cover its surface without holes at any level. Into one layer through
+// pointCloud.geom, or with MULTIVIEW into every view of a multiview pass at once, VIEWS
+// (both eyes' walls) from the CAVE layout.
+#ifdef MULTIVIEW
+#extension GL_OVR_multiview : require
+layout (num_views = VIEWS) in;
+#else
+#define VIEWS 1
+#endif
+
+layout (location = 0) in vec3 position;
+// The level of the point's node in alpha, out of 255
+layout (location = 1) in vec4 vertexColor;
+
+// The cloud's model matrix
+uniform mat4 transform;
+// Model units to clip space by view, and the root's spacing in pixels at clip w = 1 (times
+// pointcloud.point_scale)
+uniform mat4 layerMatrices[VIEWS];
+uniform float pointSizes[VIEWS];
+
+out vec3 vsColor;
+
+void main()
+{
+	vsColor = vertexColor.rgb;
+	float level = floor(vertexColor.a * 255.0 + 0.5);
+#ifdef MULTIVIEW
+	int view = int(gl_ViewID_OVR);
+#else
+	int view = 0;
+#endif
+	gl_Position = layerMatrices[view] * (transform * vec4(position, 1.0));
+	gl_PointSize = clamp(pointSizes[view] * exp2(-level) / max(gl_Position.w, 1e-4), 1.0, 32.0);
+}
@@ -1,15 +1,49 @@
 #version 330 core
+#ifdef BINDLESS
+#extension GL_ARB_bindless_texture : require
+// Samplers are given resident texture handles instead of texture units
+layout (bindless_sampler) uniform;
+#endif
 
 in vec2 texCoords;
+in vec3 worldPos;
 uniform sampler2D renderedTexture;
-uniform int broken;
+// The part of the texture the wall was rendered into
+uniform vec2 uvScale;
+// What was not rendered of the wall (walls.partial) from its left, bottom, right and top
+// edges, in wall uv
+uniform vec4 uvCrop;
+
+// Compiled as variants (ShaderVariants): ANALYTIC_SKY, BROKEN for a wall that shows black
+
+// Analytic sky: the wall pass only rendered the box (alpha marks where), the sky behind it
+// is looked up here along the ray from the wall's viewpoint through this point. The ray is
+// taken into the skybox's space, a cube of skySize around the origin.
+uniform samplerCube skybox;
+uniform vec3 skyEye;
+uniform vec3 skyOrigin;
+uniform mat3 skyRotation;
+uniform float skySize;
+
+vec3 skyColor()
+{
+	vec3 d = skyRotation * (worldPos - skyEye);
+	vec3 t = (sign(d) * skySize - skyOrigin) / d;
+	float s = min(t.x, min(t.y, t.z));
+	return texture(skybox, normalize(skyOrigin + s * d)).rgb;
+}
 
 out vec3 color;
 
 void main()
 {
-	color = texture(renderedTexture, texCoords).rgb;
-	if(broken > 0){
-		color = vec3(0,0,0);
-	}
+	vec2 uv = clamp(texCoords, uvCrop.xy, vec2(1.0) - uvCrop.zw) * uvScale;
+#if defined(BROKEN)
+	color = vec3(0.0);
+#elif defined(ANALYTIC_SKY)
+	vec4 wall = texture(renderedTexture, uv);
+	color = mix(skyColor(), wall.rgb, wall.a);
+#else
+	color = texture(renderedTexture, uv).rgb;
+#endif
 }
@@ -4,17 +4,28 @@
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec2 vertexUV;
 
-uniform mat4 projection;
-uniform mat4 modelview;
+// The camera of the draw, bound by CameraUniforms (frame -> eye -> wall)
+layout (std140) uniform Camera {
+	mat4 projection;
+	mat4 modelview;
+	// projection * modelview, so vertices need no matrix products of their own
+	mat4 viewProjection;
+	mat4 wallProjections[8];
+	vec4 eyePosition;
+};
 uniform mat4 transform;
 
 //Output data
 out vec2 texCoords;
+// Where on the wall the fragment is, for the analytic sky
+out vec3 worldPos;
 
 void main()
 {
     // OpenGL maintains the D matrix so you only need to multiply by P, V (aka C inverse), and M
 	//texCoords = position.xy;
 	texCoords = vertexUV;
-	gl_Position = projection * (modelview * transform) * vec4(position.x, position.y, position.z, 1.0);
+	vec4 world = transform * vec4(position, 1.0);
+	worldPos = world.xyz;
+	gl_Position = viewProjection * world;
 }
@@ -0,0 +1,57 @@
+#version 330 core
+#ifdef BINDLESS
+#extension GL_ARB_bindless_texture : require
+// Samplers are given resident texture handles instead of texture units
+layout (bindless_sampler) uniform;
+#endif
+// screenShader.frag for walls rendered into one texture array, layer picks the wall
+
+in vec2 texCoords;
+in vec3 worldPos;
+uniform sampler2DArray renderedTextures;
+uniform int layer;
+// The part of the texture the wall was rendered into, and its bands in there
+uniform vec2 uvScale;
+uniform vec4 bandEdges;
+uniform vec4 bandPacked;
+// What was not rendered of the wall (walls.partial) from its left, bottom, right and top
+// edges, in wall uv
+uniform vec4 uvCrop;
+
+// Compiled as variants (ShaderVariants): ANALYTIC_SKY, BROKEN for a wall that shows black
+
+// Analytic sky: the wall pass only rendered the box (alpha marks where), the sky behind it
+// is looked up here along the ray from the wall's viewpoint through this point. The ray is
+// taken into the skybox's space, a cube of skySize around the origin.
+uniform samplerCube skybox;
+uniform vec3 skyEye;
+uniform vec3 skyOrigin;
+uniform mat3 skyRotation;
+uniform float skySize;
+
+vec3 skyColor()
+{
+	vec3 d = skyRotation * (worldPos - skyEye);
+	vec3 t = (sign(d) * skySize - skyOrigin) / d;
+	float s = min(t.x, min(t.y, t.z));
+	return texture(skybox, normalize(skyOrigin + s * d)).rgb;
+}
+
+out vec3 color;
+
+// Wall uv to where it was drawn with variable resolution, band() and bandUV(), from the
+// defines (WallResolution::shaderDefines)
+BAND_FUNCTIONS
+
+void main()
+{
+	vec2 uv = bandUV(clamp(texCoords, uvCrop.xy, vec2(1.0) - uvCrop.zw), bandEdges, bandPacked) * uvScale;
+#if defined(BROKEN)
+	color = vec3(0.0);
+#elif defined(ANALYTIC_SKY)
+	vec4 wall = texture(renderedTextures, vec3(uv, layer));
+	color = mix(skyColor(), wall.rgb, wall.a);
+#else
+	color = texture(renderedTextures, vec3(uv, layer)).rgb;
+#endif
+}
@@ -4,6 +4,14 @@
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <sstream>
+#include <cstdint>
+#include <cstring>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
 using namespace std;
 
 #define GLFW_INCLUDE_GLEXT
@@ -15,25 +23,31 @@ using namespace std;
 #include <GLFW/glfw3.h>
 
 #include "shader.h"
+#include "StartupProfiler.h"
+#include "Config.h"
+#include "AssetArchive.h"
+#include "GLExtensions.h"
+#include "Log.h"
+#include "SharedAssetCache.h"
+#include "StartupPrefetch.h"
 
-GLuint LoadShaders(const char * vertex_file_path, const char * fragment_file_path) {
-
-	// Create the shaders
-	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
-
-	// Read the Vertex Shader code from the file
-	std::string VertexShaderCode;
-	std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-	if (VertexShaderStream.is_open()) {
-		std::string Line = "";
-		while (getline(VertexShaderStream, Line))
-			VertexShaderCode += "\n" + Line;
-		VertexShaderStream.close();
+// Reads a whole shader source file, from the asset archive or startup's reads ahead if they
+// have it. On failure says where it looked and returns false.
+static bool readShaderFile(const char * file_path, std::string & code) {
+	const unsigned char * archived;
+	size_t archivedSize;
+	if (assetArchive().find(file_path, archived, archivedSize)) {
+		code.assign((const char *)archived, archivedSize);
+		return true;
 	}
-	else {
-		printf("Impossible to open %s. Check to make sure the file exists and you passed in the right filepath!\n", vertex_file_path);
-		printf("The current working directory is:");
+	if (startupPrefetch().source(file_path, code))
+		return true;
+	std::ifstream stream(file_path, std::ios::in);
+	if (!stream.is_open()) {
+		logStream(LOG_ERROR) << "Impossible to open " << file_path << ". Check to make sure the file exists and you passed in the right filepath!" << std::endl;
+		logStream(LOG_ERROR) << "The current working directory is:" << std::endl;
+		// The shell prints straight to the console, after what is queued
+		logger().flush();
 		// Please for the love of whatever deity/ies you believe in never do something like the next line of code,
 		// Especially on non-Windows systems where you can have the system happily execute "rm -rf ~"
 #ifdef _WIN32
@@ -42,83 +56,321 @@ GLuint LoadShaders(const char * vertex_file_path, const char * fragment_file_pat
 		system("pwd");
 #endif
 		getchar();
-		return 0;
+		return false;
 	}
+	// In one go, not a line (and a copy of everything before it) at a time
+	std::ostringstream contents;
+	contents << stream.rdbuf();
+	code = contents.str();
+	return true;
+}
 
-	// Read the Fragment Shader code from the file
-	std::string FragmentShaderCode;
-	std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-	if (FragmentShaderStream.is_open()) {
-		std::string Line = "";
-		while (getline(FragmentShaderStream, Line))
-			FragmentShaderCode += "\n" + Line;
-		FragmentShaderStream.close();
-	}
+// Puts defines right after the #version line (which has to come first) of code
+static void insertDefines(std::string & code, const std::string & defines) {
+	if (defines.empty())
+		return;
+	size_t version = code.find("#version");
+	size_t lineEnd = version == std::string::npos ? std::string::npos : code.find('\n', version);
+	if (lineEnd == std::string::npos)
+		code = defines + code;
+	else
+		code.insert(lineEnd + 1, defines);
+}
 
+// Hands a stage to the driver without asking how it went, so a driver compiling in the
+// background (KHR_parallel_shader_compile) is not made to finish it here
+static GLuint submitShader(GLenum type, const char * file_path, const std::string & code) {
+	GLuint ShaderID = glCreateShader(type);
+	logStream(LOG_DEBUG) << "Compiling shader : " << file_path << std::endl;
+	char const * SourcePointer = code.c_str();
+	glShaderSource(ShaderID, 1, &SourcePointer, NULL);
+	glCompileShader(ShaderID);
+	return ShaderID;
+}
+
+// Prints how a stage compiled, once it has
+static void printShaderLog(GLuint ShaderID, const std::string & file_path) {
 	GLint Result = GL_FALSE;
 	int InfoLogLength;
-
-
-	// Compile Vertex Shader
-	printf("Compiling shader : %s\n", vertex_file_path);
-	char const * VertexSourcePointer = VertexShaderCode.c_str();
-	glShaderSource(VertexShaderID, 1, &VertexSourcePointer, NULL);
-	glCompileShader(VertexShaderID);
-
-	// Check Vertex Shader
-	glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+	glGetShaderiv(ShaderID, GL_COMPILE_STATUS, &Result);
+	glGetShaderiv(ShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
 	if (InfoLogLength > 0) {
-		std::vector<char> VertexShaderErrorMessage(InfoLogLength + 1);
-		glGetShaderInfoLog(VertexShaderID, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
-		printf("%s\n", &VertexShaderErrorMessage[0]);
+		std::vector<char> ShaderErrorMessage(InfoLogLength + 1);
+		glGetShaderInfoLog(ShaderID, InfoLogLength, NULL, &ShaderErrorMessage[0]);
+		logStream(Result ? LOG_WARNING : LOG_ERROR) << file_path << ": " << &ShaderErrorMessage[0] << std::endl;
 	}
 	else {
-		printf("Successfully compiled vertex shader!\n");
+		logStream(LOG_DEBUG) << "Successfully compiled " << file_path << "!" << std::endl;
 	}
+}
 
+// Linked programs are kept on disk as what glGetProgramBinary gives for them, so that a
+// warm start loads them instead of compiling and linking every stage again. A cache file
+// is named by a hash of the stages' final sources (defines in) and the driver, and holds
+// the driver string it was made with; anything that does not match, or that the driver
+// turns down, is compiled from source and cached again. shaders.binary_cache turns it off,
+// shaders.cache_dir says where the files go.
+struct ProgramCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t binaryFormat;
+	uint32_t length;
+	uint64_t sourceHash;
+	char driver[248];
+};
 
+static const uint32_t PROGRAM_CACHE_MAGIC = 0x42503350; // "P3PB"
+static const uint32_t PROGRAM_CACHE_VERSION = 1;
 
-	// Compile Fragment Shader
-	printf("Compiling shader : %s\n", fragment_file_path);
-	char const * FragmentSourcePointer = FragmentShaderCode.c_str();
-	glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer, NULL);
-	glCompileShader(FragmentShaderID);
+struct ShaderStageSource {
+	GLenum type;
+	const char * file;
+	const std::string * code;
+};
 
-	// Check Fragment Shader
-	glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	if (InfoLogLength > 0) {
-		std::vector<char> FragmentShaderErrorMessage(InfoLogLength + 1);
-		glGetShaderInfoLog(FragmentShaderID, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
-		printf("%s\n", &FragmentShaderErrorMessage[0]);
+static bool programCacheEnabled() {
+	static int enabled = -1;
+	if (enabled < 0) {
+		GLint formats = 0;
+		if (GLEW_ARB_get_program_binary)
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		enabled = formats > 0 && config().getBool("shaders.binary_cache", true);
 	}
-	else {
-		printf("Successfully compiled fragment shader!\n");
+	return enabled != 0;
+}
+
+// Who made a binary: one made by another driver, or another version of it, is no use
+static std::string driverString() {
+	std::string driver;
+	for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+		const char * value = (const char *)glGetString(name);
+		driver += value ? value : "";
+		driver += '|';
 	}
+	return driver.substr(0, sizeof(ProgramCacheHeader::driver) - 1);
+}
 
+// FNV-1a over the stages, each with its type
+static uint64_t hashStages(const std::vector<ShaderStageSource> & stages) {
+	uint64_t hash = 14695981039346656037ull;
+	auto add = [&](const void * data, size_t size) {
+		const unsigned char * bytes = (const unsigned char *)data;
+		for (size_t i = 0; i < size; i++)
+			hash = (hash ^ bytes[i]) * 1099511628211ull;
+	};
+	for (const ShaderStageSource & stage : stages) {
+		add(&stage.type, sizeof(stage.type));
+		add(stage.code->data(), stage.code->size());
+	}
+	return hash;
+}
+
+static std::string programCachePath(uint64_t sourceHash, const std::string & driver) {
+	uint64_t hash = sourceHash;
+	for (char c : driver)
+		hash = (hash ^ (unsigned char)c) * 1099511628211ull;
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.p3pb", (unsigned long long)hash);
+	return config().getString("shaders.cache_dir", "shadercache") + "/" + name;
+}
+
+// The cached program for these sources, 0 if there is none this driver takes. A run before
+// this one may have left it in the shared asset cache, which saves reading the file.
+static GLuint loadCachedProgram(uint64_t sourceHash, const std::string & driver) {
+	std::string path = programCachePath(sourceHash, driver);
+	// The header and the binary after it, as in the file
+	std::vector<char> file;
+	const unsigned char * shared;
+	size_t size;
+	if (!sharedAssetCache().find("program:" + path, sourceHash, shared, size)) {
+		std::ifstream stream(path, std::ios::in | std::ios::binary);
+		std::ostringstream contents;
+		contents << stream.rdbuf();
+		std::string read = contents.str();
+		file.assign(read.begin(), read.end());
+		shared = (const unsigned char *)file.data();
+		size = file.size();
+	}
+	ProgramCacheHeader header;
+	if (size < sizeof(header))
+		return 0;
+	memcpy(&header, shared, sizeof(header));
+	header.driver[sizeof(header.driver) - 1] = 0;
+	if (header.magic != PROGRAM_CACHE_MAGIC || header.version != PROGRAM_CACHE_VERSION ||
+		header.sourceHash != sourceHash || driver != header.driver || header.length > size - sizeof(header))
+		return 0;
+	if (!file.empty())
+		sharedAssetCache().insert("program:" + path, sourceHash, file.data(), sizeof(header) + header.length);
 
-	// Link the program
-	printf("Linking program\n");
 	GLuint ProgramID = glCreateProgram();
-	glAttachShader(ProgramID, VertexShaderID);
-	glAttachShader(ProgramID, FragmentShaderID);
+	glProgramBinary(ProgramID, header.binaryFormat, shared + sizeof(header), (GLsizei)header.length);
+	GLint Result = GL_FALSE;
+	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
+	if (!Result) {
+		// Drivers may refuse their own old binaries, say after an update
+		logStream(LOG_INFO) << "Cached program no longer loads, compiling" << std::endl;
+		glDeleteProgram(ProgramID);
+		return 0;
+	}
+	return ProgramID;
+}
+
+static void storeCachedProgram(GLuint ProgramID, uint64_t sourceHash, const std::string & driver) {
+	GLint Result = GL_FALSE, length = 0;
+	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
+	glGetProgramiv(ProgramID, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (!Result || length <= 0)
+		return;
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(ProgramID, length, &length, &format, binary.data());
+
+	ProgramCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = PROGRAM_CACHE_MAGIC;
+	header.version = PROGRAM_CACHE_VERSION;
+	header.binaryFormat = format;
+	header.length = (uint32_t)length;
+	header.sourceHash = sourceHash;
+	strncpy(header.driver, driver.c_str(), sizeof(header.driver) - 1);
+
+	std::string dir = config().getString("shaders.cache_dir", "shadercache");
+#ifdef _WIN32
+	_mkdir(dir.c_str());
+#else
+	mkdir(dir.c_str(), 0755);
+#endif
+	std::ofstream stream(programCachePath(sourceHash, driver), std::ios::out | std::ios::binary | std::ios::trunc);
+	stream.write((const char *)&header, sizeof(header));
+	stream.write(binary.data(), length);
+	if (!stream)
+		std::cerr << "Could not write the program cache in " << dir << std::endl;
+	if (sharedAssetCache().attached()) {
+		binary.insert(binary.begin(), (const char *)&header, (const char *)&header + sizeof(header));
+		sharedAssetCache().insert("program:" + programCachePath(sourceHash, driver), sourceHash, binary.data(), binary.size());
+	}
+}
+
+// Links the stages into a program, again without asking how it went. A stage that did not
+// compile makes the link fail, which finishProgram reports.
+static GLuint submitLink(const std::vector<GLuint> & ShaderIDs) {
+	GLuint ProgramID = glCreateProgram();
+	for (GLuint ShaderID : ShaderIDs)
+		glAttachShader(ProgramID, ShaderID);
+	if (programCacheEnabled())
+		glProgramParameteri(ProgramID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glLinkProgram(ProgramID);
+	return ProgramID;
+}
+
+// Starts the program for the stages: the cached binary if there is one, else every stage
+// compiled and linked
+static PendingProgram beginProgram(const std::vector<ShaderStageSource> & stages) {
+	PendingProgram pending;
+	if (programCacheEnabled()) {
+		pending.driver = driverString();
+		pending.sourceHash = hashStages(stages);
+		pending.program = loadCachedProgram(pending.sourceHash, pending.driver);
+		if (pending.program) {
+			logStream(LOG_DEBUG) << "Loaded cached program" << std::endl;
+			pending.cached = true;
+			return pending;
+		}
+	}
+	for (const ShaderStageSource & stage : stages) {
+		pending.shaders.push_back(submitShader(stage.type, stage.file, *stage.code));
+		pending.files.push_back(stage.file);
+	}
+	pending.program = submitLink(pending.shaders);
+	return pending;
+}
 
-	// Check the program
+bool ProgramReady(const PendingProgram & pending) {
+	if (!pending.program || pending.cached || !supportsParallelShaderCompile())
+		return true;
+	GLint done = GL_FALSE;
+	glGetProgramiv(pending.program, GL_COMPLETION_STATUS_KHR, &done);
+	return done != GL_FALSE;
+}
+
+GLuint FinishProgram(PendingProgram & pending) {
+	GLuint ProgramID = pending.program;
+	pending.program = 0;
+	if (!ProgramID || pending.cached)
+		return ProgramID;
+	StartupScope scope("shaders", "finish " + (pending.files.empty() ? std::string() : pending.files[0]));
+
+	// Asking is what waits for the driver
+	for (size_t i = 0; i < pending.shaders.size(); i++)
+		printShaderLog(pending.shaders[i], pending.files[i]);
+	logStream(LOG_DEBUG) << "Linking program" << std::endl;
+	GLint Result = GL_FALSE;
+	int InfoLogLength;
 	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
 	glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
 	if (InfoLogLength > 0) {
 		std::vector<char> ProgramErrorMessage(InfoLogLength + 1);
 		glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
-		printf("%s\n", &ProgramErrorMessage[0]);
+		logStream(Result ? LOG_WARNING : LOG_ERROR) << &ProgramErrorMessage[0] << std::endl;
 	}
 
-	glDetachShader(ProgramID, VertexShaderID);
-	glDetachShader(ProgramID, FragmentShaderID);
-
-	glDeleteShader(VertexShaderID);
-	glDeleteShader(FragmentShaderID);
+	for (GLuint ShaderID : pending.shaders) {
+		glDetachShader(ProgramID, ShaderID);
+		glDeleteShader(ShaderID);
+	}
+	pending.shaders.clear();
 
+	if (programCacheEnabled())
+		storeCachedProgram(ProgramID, pending.sourceHash, pending.driver);
 	return ProgramID;
-}
\ No newline at end of file
+}
+
+GLuint LoadShaders(const char * vertex_file_path, const char * fragment_file_path) {
+	return LoadShaders(vertex_file_path, nullptr, fragment_file_path);
+}
+
+GLuint LoadShaders(const char * vertex_file_path, const char * geometry_file_path, const char * fragment_file_path) {
+	return LoadShaders(vertex_file_path, geometry_file_path, fragment_file_path, std::string());
+}
+
+GLuint LoadShaders(const char * vertex_file_path, const char * geometry_file_path, const char * fragment_file_path, const std::string & defines) {
+	PendingProgram pending = BeginShaders(vertex_file_path, geometry_file_path, fragment_file_path, defines);
+	return FinishProgram(pending);
+}
+
+GLuint LoadComputeShader(const char * compute_file_path, const std::string & defines) {
+	PendingProgram pending = BeginComputeShader(compute_file_path, defines);
+	return FinishProgram(pending);
+}
+
+PendingProgram BeginShaders(const char * vertex_file_path, const char * geometry_file_path, const char * fragment_file_path, const std::string & defines) {
+	StartupScope scope("shaders", std::string(vertex_file_path) + " " +
+		(geometry_file_path ? std::string(geometry_file_path) + " " : std::string()) + fragment_file_path);
+
+	// Read the shader code from the files
+	std::string VertexShaderCode, GeometryShaderCode, FragmentShaderCode;
+	if (!readShaderFile(vertex_file_path, VertexShaderCode) ||
+		(geometry_file_path && !readShaderFile(geometry_file_path, GeometryShaderCode)) ||
+		!readShaderFile(fragment_file_path, FragmentShaderCode)) {
+		return PendingProgram();
+	}
+	insertDefines(VertexShaderCode, defines);
+	insertDefines(GeometryShaderCode, defines);
+	insertDefines(FragmentShaderCode, defines);
+
+	std::vector<ShaderStageSource> stages = { { GL_VERTEX_SHADER, vertex_file_path, &VertexShaderCode } };
+	if (geometry_file_path)
+		stages.push_back({ GL_GEOMETRY_SHADER, geometry_file_path, &GeometryShaderCode });
+	stages.push_back({ GL_FRAGMENT_SHADER, fragment_file_path, &FragmentShaderCode });
+	return beginProgram(stages);
+}
+
+PendingProgram BeginComputeShader(const char * compute_file_path, const std::string & defines) {
+	StartupScope scope("shaders", compute_file_path);
+
+	std::string ComputeShaderCode;
+	if (!readShaderFile(compute_file_path, ComputeShaderCode))
+		return PendingProgram();
+	insertDefines(ComputeShaderCode, defines);
+	return beginProgram({ { GL_COMPUTE_SHADER, compute_file_path, &ComputeShaderCode } });
+}
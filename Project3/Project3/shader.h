@@ -1,6 +1,7 @@
 #ifndef SHADER_HPP
 #define SHADER_HPP
 #include <stdio.h>
+#include <stdint.h>
 #include <string>
 #include <vector>
 #include <iostream>
@@ -17,5 +18,31 @@ using namespace std;
 #include <GLFW/glfw3.h>
 
 GLuint LoadShaders(const char * vertex_file_path, const char * fragment_file_path);
+// Same with a geometry stage in between
+GLuint LoadShaders(const char * vertex_file_path, const char * geometry_file_path, const char * fragment_file_path);
+// Same with defines ("#define NAME value" lines) added after every stage's #version line,
+// for shaders that need compile time constants
+GLuint LoadShaders(const char * vertex_file_path, const char * geometry_file_path, const char * fragment_file_path, const std::string & defines);
+// A program of just a compute stage (GL 4.3 or ARB_compute_shader)
+GLuint LoadComputeShader(const char * compute_file_path, const std::string & defines = std::string());
+
+// Loading in two steps, so that several programs compile at once: Begin* reads the files
+// and hands every stage and the link to the driver without asking how they went, which
+// would make it finish them there and then. FinishProgram asks, prints the logs and
+// returns the program (0 or one that did not link, as LoadShaders). In between the driver
+// compiles on its own threads where it has KHR_parallel_shader_compile, and ProgramReady
+// says whether it is done. Programs from the binary cache are ready at once.
+struct PendingProgram {
+	GLuint program = 0;
+	std::vector<GLuint> shaders;
+	std::vector<std::string> files;
+	bool cached = false;
+	uint64_t sourceHash = 0;
+	std::string driver;
+};
+PendingProgram BeginShaders(const char * vertex_file_path, const char * geometry_file_path, const char * fragment_file_path, const std::string & defines = std::string());
+PendingProgram BeginComputeShader(const char * compute_file_path, const std::string & defines = std::string());
+bool ProgramReady(const PendingProgram & pending);
+GLuint FinishProgram(PendingProgram & pending);
 
 #endif
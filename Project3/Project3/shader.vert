@@ -4,17 +4,48 @@
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec2 vertexUV;
 
-uniform mat4 projection;
-uniform mat4 modelview;
+// The camera of the draw, bound by CameraUniforms (frame -> eye -> wall)
+layout (std140) uniform Camera {
+	mat4 projection;
+	mat4 modelview;
+	// projection * modelview, so vertices need no matrix products of their own
+	mat4 viewProjection;
+	mat4 wallProjections[8];
+	vec4 eyePosition;
+};
 uniform mat4 transform;
+// Per instance model matrix (Box::setInstanceTransforms), used instead of none when
+// instanced is set
+layout (location = 5) in mat4 instanceTransform;
+uniform int instanced;
+// Per instance atlas tile (a draw list or culler with tiles), read when atlased is set
+layout (location = 9) in vec4 instanceAtlasRect;
+layout (location = 10) in float instanceAtlasLayer;
+uniform int atlased;
+// Skyboxes drawn last are put on the far plane, behind everything already drawn
+uniform int skyboxDepth;
 
 //Output data
 out vec3 texCoords;
+out vec2 meshUV;
+flat out vec4 atlasRect;
+flat out float atlasLayer;
+out vec3 worldPosition;
+// The same in the depth pre-pass (depthOnly.frag) and the shading after it, to the bit
+invariant gl_Position;
 
 void main()
 {
     // OpenGL maintains the D matrix so you only need to multiply by P, V (aka C inverse), and M
 	texCoords = normalize (position.xyz);
 	//texCoords.y = 1.0 - texCoords.y;
-	gl_Position = projection * (modelview * transform) * vec4(position.x, position.y, position.z, 1.0);
+	meshUV = vertexUV;
+	atlasRect = instanceAtlasRect;
+	atlasLayer = atlased != 0 ? instanceAtlasLayer : -1.0;
+	vec4 local = instanced != 0 ? instanceTransform * vec4(position, 1.0) : vec4(position, 1.0);
+	vec4 world = transform * local;
+	worldPosition = world.xyz;
+	gl_Position = viewProjection * world;
+	if (skyboxDepth != 0)
+		gl_Position = gl_Position.xyww;
 }
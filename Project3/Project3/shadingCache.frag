@@ -0,0 +1,49 @@
+#version 330 core
+// A prop's material at every texel of its shading cache tile: the faces of the cube in a
+// grid of three by two, +x, +y and +z on the first row, -x, -y and -z on the second. Each
+// face is mapped as shader.frag maps it (atlased 2), so what is shaded here is what the
+// views would have shaded at the same point, lit too with LIGHTING.
+
+in vec2 tileUV;
+flat in vec4 atlasRect;
+flat in float atlasLayer;
+uniform samplerCube cubebox;
+uniform sampler2DArray atlas;
+
+#ifdef LIGHTING
+flat in mat4 model;
+flat in mat3 normalMatrix;
+#endif
+
+out vec4 color;
+
+#ifdef LIGHTING
+// The Lighting block and lightAt(), from the defines (Lighting::shaderDefines)
+LIGHTING_DECLARATIONS
+#endif
+
+void main()
+{
+	vec2 grid = tileUV * vec2(3.0, 2.0);
+	vec2 cell = min(floor(grid), vec2(2.0, 1.0));
+	// The face's uv from -1 to 1, and the direction from the cube's center it is seen at
+	vec2 uv = (grid - cell) * 2.0 - 1.0;
+	float s = cell.y < 0.5 ? 1.0 : -1.0;
+	vec3 direction;
+	if (cell.x < 0.5)
+		direction = vec3(s, -uv.y, -uv.x * s);
+	else if (cell.x < 1.5)
+		direction = vec3(uv.x, s, uv.y * s);
+	else
+		direction = vec3(uv.x * s, -uv.y, s);
+
+	if (atlasLayer >= 0.0)
+		color = vec4(texture(atlas, vec3(atlasRect.xy + (uv * 0.5 + 0.5) * atlasRect.zw, atlasLayer)).rgb, 1.0);
+	else
+		color = vec4(texture(cubebox, direction).rgb, 1.0);
+#ifdef LIGHTING
+	// direction is on the unit cube already, the prop's mesh
+	vec3 axis = cell.x < 0.5 ? vec3(s, 0.0, 0.0) : cell.x < 1.5 ? vec3(0.0, s, 0.0) : vec3(0.0, 0.0, s);
+	color.rgb *= lightAt((model * vec4(direction, 1.0)).xyz, normalize(normalMatrix * axis));
+#endif
+}
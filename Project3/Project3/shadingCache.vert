@@ -0,0 +1,36 @@
+#version 330 core
+// NOTE: Do NOT use any version older than 330! Bad things will happen!
+// A quad over one instance's tile of the shading cache layer being drawn (ShadingCache),
+// instance i of the draw in tile i of the layer
+
+// The instance's material: its atlas tile, layer below 0 for the cube texture
+layout (location = 9) in vec4 instanceAtlasRect;
+layout (location = 10) in float instanceAtlasLayer;
+// Tiles across the layer, and a tile's size as a part of the layer
+uniform int columns;
+uniform vec2 tileScale;
+
+// Where in the tile, 0 to 1 across all six faces
+out vec2 tileUV;
+flat out vec4 atlasRect;
+flat out float atlasLayer;
+#ifdef LIGHTING
+// Where the instance is, to light its faces where they are
+layout (location = 5) in mat4 instanceTransform;
+flat out mat4 model;
+flat out mat3 normalMatrix;
+#endif
+
+void main()
+{
+	vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+	vec2 tile = vec2(gl_InstanceID % columns, gl_InstanceID / columns);
+	tileUV = corner;
+	atlasRect = instanceAtlasRect;
+	atlasLayer = instanceAtlasLayer;
+#ifdef LIGHTING
+	model = instanceTransform;
+	normalMatrix = transpose(inverse(mat3(instanceTransform)));
+#endif
+	gl_Position = vec4((tile + corner) * tileScale * 2.0 - 1.0, 0.0, 1.0);
+}
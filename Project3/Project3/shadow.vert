@@ -0,0 +1,21 @@
+#version 330 core
+// NOTE: Do NOT use any version older than 330! Bad things will happen!
+// The objects as the sun sees them, for its shadow map (Lighting), with depthOnly.frag
+
+layout (location = 0) in vec3 position;
+
+// The start of the Lighting block of the lit shaders (Lighting::shaderDefines), all that is needed here
+layout (std140) uniform Lighting {
+	mat4 sunViewProjection;
+};
+uniform mat4 transform;
+// Per instance model matrix (Box::setInstanceTransforms), used instead of none when
+// instanced is set
+layout (location = 5) in mat4 instanceTransform;
+uniform int instanced;
+
+void main()
+{
+	vec4 local = instanced != 0 ? instanceTransform * vec4(position, 1.0) : vec4(position, 1.0);
+	gl_Position = sunViewProjection * (transform * local);
+}
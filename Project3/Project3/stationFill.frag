@@ -0,0 +1,13 @@
+#version 330 core
+// A little arithmetic a pixel and a write, about what a lit wall pixel costs the ROPs
+// (StationProbe's fill test)
+
+uniform vec4 tint;
+
+out vec4 color;
+
+void main()
+{
+	vec2 p = gl_FragCoord.xy * 0.001;
+	color = tint * vec4(fract(p.x + p.y), fract(p.x * p.y), 0.5, 1.0);
+}
@@ -0,0 +1,9 @@
+#version 330 core
+// NOTE: Do NOT use any version older than 330! Bad things will happen!
+
+// One triangle over the whole target, from the vertex ids alone (StationProbe's fill test)
+void main()
+{
+	vec2 corner = vec2(float((gl_VertexID << 1) & 2), float(gl_VertexID & 2));
+	gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,76 @@
+#version 430 core
+// The environment as a sparse cube map (VirtualTexture), for the outer skybox and the
+// walls' sky. Draws with shader.vert like any skybox.
+#ifdef BINDLESS
+#extension GL_ARB_bindless_texture : require
+layout (bindless_sampler) uniform;
+#endif
+
+// Tiles are only recorded where the draw is actually seen
+layout (early_fragment_tests) in;
+
+in vec3 texCoords;
+uniform samplerCube cubebox;
+// The finest level resident around each level 0 tile, in 255ths
+uniform samplerCube residency;
+
+// Level 0 tiles a side, the levels that are paged, where each level's tiles start within
+// a face and the tiles of a face, to number a tile the way VirtualTexture does
+uniform int vtTiles;
+uniform int vtPagedLevels;
+uniform int vtLevelOffsets[16];
+uniform int vtFaceTiles;
+uniform int vtFeedbackPhase;
+
+// A bit per tile, set by the pixels that sample it
+layout (std430, binding = 3) buffer VirtualFeedback {
+	uint feedback[];
+};
+
+out vec4 color;
+
+// The face and texture coordinates a direction samples, as in the cube map table of the
+// GL specification
+int cubeFace(vec3 d, out vec2 st)
+{
+	vec3 a = abs(d);
+	int face;
+	vec3 m;
+	if (a.x >= a.y && a.x >= a.z) {
+		face = d.x > 0.0 ? 0 : 1;
+		m = vec3(-sign(d.x) * d.z, -d.y, a.x);
+	}
+	else if (a.y >= a.z) {
+		face = d.y > 0.0 ? 2 : 3;
+		m = vec3(d.x, sign(d.y) * d.z, a.y);
+	}
+	else {
+		face = d.z > 0.0 ? 4 : 5;
+		m = vec3(sign(d.z) * d.x, -d.y, a.z);
+	}
+	st = clamp(m.xy / m.z * 0.5 + 0.5, 0.0, 0.99999);
+	return face;
+}
+
+void main()
+{
+	float wanted = textureQueryLod(cubebox, texCoords).y;
+
+	// A few pixels in each 4x4 block record per frame, a different one each frame, which is
+	// plenty to find every tile and keeps the atomics few
+	ivec2 pixel = ivec2(gl_FragCoord.xy) & 3;
+	if (pixel.y * 4 + pixel.x == (vtFeedbackPhase & 15)) {
+		int level = int(floor(wanted));
+		if (level < vtPagedLevels) {
+			level = max(level, 0);
+			vec2 st;
+			int face = cubeFace(texCoords, st);
+			ivec2 tile = ivec2(st * float(vtTiles >> level));
+			int index = face * vtFaceTiles + vtLevelOffsets[level] + tile.y * (vtTiles >> level) + tile.x;
+			atomicOr(feedback[index >> 5], 1u << uint(index & 31));
+		}
+	}
+
+	float resident = texture(residency, texCoords).r * 255.0;
+	color = vec4(textureLod(cubebox, texCoords, max(wanted, resident)).rgb, 1.0);
+}
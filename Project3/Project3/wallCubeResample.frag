@@ -0,0 +1,23 @@
+#version 400 core
+// A wall layer looked up from the cube its eye's view was captured into (WallCubeCapture)
+
+uniform samplerCubeArray capture;
+// Which eye's cube, and the layer's side
+uniform int cube;
+uniform int size;
+// The inverse of the wall's off-axis projection: from the layer's clip space back to the
+// space the cube was captured in, around the eye
+uniform mat4 wallToCapture;
+
+out vec4 color;
+
+void main()
+{
+	vec2 clip = gl_FragCoord.xy / float(size) * 2.0 - 1.0;
+	// The texel's ray from the eye, between where it crosses the near and far planes
+	vec4 near = wallToCapture * vec4(clip, -1.0, 1.0);
+	vec4 far = wallToCapture * vec4(clip, 1.0, 1.0);
+	vec3 direction = far.xyz / far.w - near.xyz / near.w;
+	// Alpha too, the analytic sky's coverage
+	color = texture(capture, vec4(direction, float(cube)));
+}
@@ -0,0 +1,78 @@
+#version 410 core
+#ifdef BINDLESS
+#extension GL_ARB_bindless_texture : require
+// Samplers are given resident texture handles instead of texture units
+layout (bindless_sampler) uniform;
+#endif
+// shader.frag for the layered wall passes, where one draw covers the layers of both eyes.
+// Each eye samples its own cubemap.
+
+in vec3 texCoords;
+flat in int eyeIndex;
+uniform samplerCube cubebox;
+uniform samplerCube cubeboxRight;
+in vec2 meshUV;
+flat in vec4 atlasRect;
+flat in float atlasLayer;
+// 1 when the objects' tiles are mapped with their mesh's UVs, 2 for the cube, which has
+// none: each face gets the whole tile, 3 for the cube's tile in the shading cache, where
+// each face has a cell of its own (ShadingCache)
+uniform int atlased;
+uniform sampler2DArray atlas;
+// Where the point is in the world, for the lighting
+in vec3 worldPosition;
+
+// Alpha is coverage, the analytic sky composite fills in where it is 0
+out vec4 color;
+
+#ifdef LIGHTING
+// Set for the objects, the skies are not lit
+uniform int lit;
+// The Lighting block and lightAt(), from the defines (Lighting::shaderDefines)
+LIGHTING_DECLARATIONS
+#endif
+
+// The object's atlas tile at this point, for objects with one (atlasLayer below 0 is none)
+vec3 atlasColor()
+{
+	vec2 uv = meshUV;
+	if (atlased >= 2) {
+		vec3 a = abs(texCoords);
+		vec2 cell;
+		if (a.x >= a.y && a.x >= a.z) {
+			uv = vec2(texCoords.z * -sign(texCoords.x), -texCoords.y) / a.x;
+			cell = vec2(0.0, texCoords.x < 0.0 ? 1.0 : 0.0);
+		}
+		else if (a.y >= a.z) {
+			uv = vec2(texCoords.x, texCoords.z * sign(texCoords.y)) / a.y;
+			cell = vec2(1.0, texCoords.y < 0.0 ? 1.0 : 0.0);
+		}
+		else {
+			uv = vec2(texCoords.x * sign(texCoords.z), -texCoords.y) / a.z;
+			cell = vec2(2.0, texCoords.z < 0.0 ? 1.0 : 0.0);
+		}
+		uv = uv * 0.5 + 0.5;
+		// Half a texel inside the face, so filtering does not reach into the next one
+		if (atlased == 3) {
+			vec2 face = vec2(textureSize(atlas, 0).xy) * atlasRect.zw / vec2(3.0, 2.0);
+			uv = (cell + clamp(uv, 0.5 / face, 1.0 - 0.5 / face)) / vec2(3.0, 2.0);
+		}
+	}
+	return texture(atlas, vec3(atlasRect.xy + clamp(uv, 0.0, 1.0) * atlasRect.zw, atlasLayer)).rgb;
+}
+
+void main()
+{
+	if (atlasLayer >= 0.0)
+		color = vec4(atlasColor(), 1.0);
+	else if (eyeIndex == 0)
+		color = vec4(texture(cubebox, texCoords).rgb, 1.0);
+	else
+		color = vec4(texture(cubeboxRight, texCoords).rgb, 1.0);
+#ifdef LIGHTING
+	// What the shading cache holds is lit already. The surface's facing is taken from how
+	// the position changes across the pixel, which needs no normals in the meshes.
+	if (lit != 0 && !(atlased == 3 && atlasLayer >= 0.0))
+		color.rgb *= lightAt(worldPosition, normalize(cross(dFdx(worldPosition), dFdy(worldPosition))));
+#endif
+}
@@ -0,0 +1,97 @@
+#version 410 core
+// Vertex stage of the single pass wall render. Instance i is drawn into layer layerIds[i]
+// of the wall texture array, projected with that layer's wall and eye (see wallLayered.geom).
+
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec2 vertexUV;
+
+// Wall projection * modelview of each instance, and the layer it draws to (walls out of
+// view get no instance). Instanced props repeat every layerCount instances.
+uniform mat4 layerMatrices[16];
+uniform int layerIds[16];
+uniform int layerCount;
+uniform mat4 transform;
+// Per instance model matrix (Box::setInstanceTransforms), used instead of none when
+// instanced is set
+layout (location = 5) in mat4 instanceTransform;
+uniform int instanced;
+// Per instance atlas tile (a draw list or culler with tiles), read when atlased is set
+layout (location = 9) in vec4 instanceAtlasRect;
+layout (location = 10) in float instanceAtlasLayer;
+uniform int atlased;
+// Skyboxes drawn last are put on the far plane, behind everything already drawn
+uniform int skyboxDepth;
+
+//Output data
+out vec3 vsTexCoords;
+out vec2 vsMeshUV;
+flat out vec4 vsAtlasRect;
+flat out float vsAtlasLayer;
+flat out int vsLayer;
+out vec3 vsWorldPosition;
+// The same in the depth pre-pass (depthOnly.frag) and the shading after it, to the bit
+invariant gl_Position;
+
+#ifdef WALL_VIEWS
+// walls.gpu_projection: with projectWalls set the layer's off-axis projection is worked out
+// here from the walls and the views (WallViews.h), and layerMatrices is not read
+layout (std140) uniform WallViews {
+	// Per wall: right, up and normal with dot(right, bottom left), dot(right, bottom right)
+	// and dot(up, bottom left) in w, then dot(up, top left) and dot(normal, bottom left)
+	vec4 walls[32];
+	// By view (layer / wallCount): the eye in CAVE space and the walls' modelview
+	vec4 eyes[8];
+	mat4 modelviews[8];
+	// The frustums' z scale and offset
+	vec4 depthTerms;
+};
+uniform int projectWalls;
+uniform int layerBase;
+uniform int wallCount;
+
+// CaveLayout's projectWall for layer (view * wallCount + wall of the whole set), applied
+// to the point instead of made into a matrix: frustum * view only has the terms
+// (A x + C z, B y + D z, E z + F w, -z) of the point in the wall's basis from the eye
+vec4 wallClip(int layer, vec4 world)
+{
+	int view = layer / wallCount;
+	int wall = layer - view * wallCount;
+	vec4 right = walls[4 * wall];
+	vec4 up = walls[4 * wall + 1];
+	vec4 normal = walls[4 * wall + 2];
+	vec2 edges = walls[4 * wall + 3].xy;
+	vec3 eye = eyes[view].xyz;
+	vec4 v = modelviews[view] * world;
+	vec3 p = v.xyz - eye * v.w;
+	vec3 q = vec3(dot(right.xyz, p), dot(up.xyz, p), dot(normal.xyz, p));
+	// The eye's distance from the screen, and the edges relative to it
+	float distance = dot(normal.xyz, eye) - edges.y;
+	float er = dot(right.xyz, eye);
+	float eu = dot(up.xyz, eye);
+	float width = up.w - right.w;
+	float height = edges.x - normal.w;
+	return vec4(2.0 * distance / width * q.x + (up.w + right.w - 2.0 * er) / width * q.z,
+		2.0 * distance / height * q.y + (edges.x + normal.w - 2.0 * eu) / height * q.z,
+		depthTerms.x * q.z + depthTerms.y * v.w, -q.z);
+}
+#endif
+
+void main()
+{
+	vsTexCoords = normalize(position.xyz);
+	vsMeshUV = vertexUV;
+	vsAtlasRect = instanceAtlasRect;
+	vsAtlasLayer = atlased != 0 ? instanceAtlasLayer : -1.0;
+	int slot = gl_InstanceID % layerCount;
+	vec4 local = instanced != 0 ? instanceTransform * vec4(position, 1.0) : vec4(position, 1.0);
+	vsLayer = layerIds[slot];
+	vec4 world = transform * local;
+	vsWorldPosition = world.xyz;
+#ifdef WALL_VIEWS
+	gl_Position = projectWalls != 0 ? wallClip(layerBase + vsLayer, world) : layerMatrices[slot] * world;
+#else
+	gl_Position = layerMatrices[slot] * world;
+#endif
+	if (skyboxDepth != 0)
+		gl_Position = gl_Position.xyww;
+}
@@ -0,0 +1,59 @@
+#version 330 core
+#ifdef BINDLESS
+#extension GL_ARB_bindless_texture : require
+// Samplers are given resident texture handles instead of texture units
+layout (bindless_sampler) uniform;
+#endif
+// screenShaderArray.frag for every wall of an eye in one draw (wallMerged.vert), what it
+// takes per wall in arrays indexed by the fragment's wall. Compiled with ANALYTIC_SKY or not.
+
+in vec2 texCoords;
+in vec3 worldPos;
+flat in int wallIndex;
+uniform sampler2DArray renderedTextures;
+// Per wall: the part of its texture it was rendered into across, its layer in
+// renderedTextures (below 0 for a wall not shown), 1 for a wall switched off, which shows
+// black, and the part down
+uniform vec4 wallSampling[8];
+// Per wall, its bands with variable resolution (bandUV)
+uniform vec4 bandEdges[8];
+uniform vec4 bandPacked[8];
+
+// Analytic sky: the wall pass only rendered the box (alpha marks where), the sky behind it
+// is looked up here along the ray from the wall's viewpoint through this point. The ray is
+// taken into the skybox's space, a cube of skySize around the origin.
+uniform samplerCube skybox;
+uniform vec3 skyEye;
+uniform vec3 skyOrigin;
+uniform mat3 skyRotation;
+uniform float skySize;
+
+vec3 skyColor()
+{
+	vec3 d = skyRotation * (worldPos - skyEye);
+	vec3 t = (sign(d) * skySize - skyOrigin) / d;
+	float s = min(t.x, min(t.y, t.z));
+	return texture(skybox, normalize(skyOrigin + s * d)).rgb;
+}
+
+out vec3 color;
+
+// Wall uv to where it was drawn with variable resolution, band() and bandUV(), from the
+// defines (WallResolution::shaderDefines)
+BAND_FUNCTIONS
+
+void main()
+{
+	vec4 sampling = wallSampling[wallIndex];
+	if (sampling.z > 0.0) {
+		color = vec3(0.0);
+		return;
+	}
+	vec2 uv = bandUV(texCoords, bandEdges[wallIndex], bandPacked[wallIndex]) * sampling.xw;
+#ifdef ANALYTIC_SKY
+	vec4 wall = texture(renderedTextures, vec3(uv, sampling.y));
+	color = mix(skyColor(), wall.rgb, wall.a);
+#else
+	color = texture(renderedTextures, vec3(uv, sampling.y)).rgb;
+#endif
+}
@@ -0,0 +1,33 @@
+#version 330 core
+// screenShader.vert for every wall of an eye in one draw: the walls' quads already in world
+// space, one buffer of them with each vertex's wall. A wall not shown is collapsed to a
+// point, which draws nothing.
+
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec2 vertexUV;
+layout (location = 2) in int wall;
+
+// The camera of the draw, bound by CameraUniforms (frame -> eye -> wall)
+layout (std140) uniform Camera {
+	mat4 projection;
+	mat4 modelview;
+	// projection * modelview, so vertices need no matrix products of their own
+	mat4 viewProjection;
+	mat4 wallProjections[8];
+	vec4 eyePosition;
+};
+// Per wall as wallMerged.frag has it, only whether it is shown is read here
+uniform vec4 wallSampling[8];
+
+out vec2 texCoords;
+// Where on the wall the fragment is, for the analytic sky
+out vec3 worldPos;
+flat out int wallIndex;
+
+void main()
+{
+	texCoords = vertexUV;
+	worldPos = position;
+	wallIndex = wall;
+	gl_Position = wallSampling[wall].y < 0.0 ? vec4(0.0) : viewProjection * vec4(position, 1.0);
+}
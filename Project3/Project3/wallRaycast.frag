@@ -0,0 +1,114 @@
+#version 330 core
+#ifdef BINDLESS
+#extension GL_ARB_bindless_texture : require
+// Samplers are given resident texture handles instead of texture units
+layout (bindless_sampler) uniform;
+#endif
+// screenShaderArray.frag for every wall at once: the pixel's ray is taken into each wall's
+// Quad space, where the wall is the square -1 to 1 at z = 0, and the nearest wall it hits
+// is shown. Depth is written as the wall quad's would be. Compiled with ANALYTIC_SKY or not.
+
+in vec4 rayNear;
+in vec4 rayFar;
+
+uniform sampler2DArray renderedTextures;
+uniform int wallCount;
+// World to Quad space, the inverses of the wall transforms
+uniform mat4 wallInverses[8];
+// Per wall: the part of its texture it was rendered into across, its layer in
+// renderedTextures (below 0 for a wall not shown), 1 for a wall switched off, which shows
+// black, and the part down
+uniform vec4 wallSampling[8];
+// Per wall, its bands with variable resolution (bandUV)
+uniform vec4 bandEdges[8];
+uniform vec4 bandPacked[8];
+
+// The camera of the draw, bound by CameraUniforms (frame -> eye -> wall)
+layout (std140) uniform Camera {
+	mat4 projection;
+	mat4 modelview;
+	mat4 viewProjection;
+	mat4 wallProjections[8];
+	vec4 eyePosition;
+};
+
+// Analytic sky: the wall pass only rendered the box (alpha marks where), the sky behind it
+// is looked up here along the ray from the wall's viewpoint through this point. The ray is
+// taken into the skybox's space, a cube of skySize around the origin.
+uniform samplerCube skybox;
+uniform vec3 skyEye;
+uniform vec3 skyOrigin;
+uniform mat3 skyRotation;
+uniform float skySize;
+
+vec3 skyColor(vec3 worldPos)
+{
+	vec3 d = skyRotation * (worldPos - skyEye);
+	vec3 t = (sign(d) * skySize - skyOrigin) / d;
+	float s = min(t.x, min(t.y, t.z));
+	return texture(skybox, normalize(skyOrigin + s * d)).rgb;
+}
+
+out vec3 color;
+
+// Where the ray hits wall's plane, in its texture's 0 to 1, and how far along it
+vec2 wallUV(int wall, vec3 origin, vec3 direction, out float t)
+{
+	vec3 o = (wallInverses[wall] * vec4(origin, 1.0)).xyz;
+	vec3 d = (wallInverses[wall] * vec4(direction, 0.0)).xyz;
+	t = -o.z / d.z;
+	return (o.xy + t * d.xy) * 0.5 + 0.5;
+}
+
+// Wall uv to where it was drawn with variable resolution, band() and bandUV(), from the
+// defines (WallResolution::shaderDefines)
+BAND_FUNCTIONS
+
+void main()
+{
+	vec3 origin = rayNear.xyz / rayNear.w;
+	vec3 direction = rayFar.xyz / rayFar.w - origin;
+	// The rays of the neighbouring pixels, for the texture gradients. Taken here, while every
+	// pixel of the quad is still running.
+	vec3 originDx = dFdx(origin), originDy = dFdy(origin);
+	vec3 directionDx = dFdx(direction), directionDy = dFdy(direction);
+
+	// Between the near (0) and far (1) planes, as the quads are clipped
+	float nearest = 1.0;
+	int hit = -1;
+	vec2 hitUV = vec2(0.0);
+	for (int i = 0; i < wallCount; i++) {
+		float t;
+		vec2 uv = wallUV(i, origin, direction, t);
+		if (t >= 0.0 && t < nearest && all(greaterThanEqual(uv, vec2(0.0))) && all(lessThanEqual(uv, vec2(1.0)))) {
+			nearest = t;
+			hit = i;
+			hitUV = uv;
+		}
+	}
+	if (hit < 0 || wallSampling[hit].y < 0.0)
+		discard;
+
+	vec3 worldPos = origin + nearest * direction;
+	vec4 clip = viewProjection * vec4(worldPos, 1.0);
+	gl_FragDepth = (gl_DepthRange.diff * clip.z / clip.w + gl_DepthRange.near + gl_DepthRange.far) * 0.5;
+
+	vec4 sampling = wallSampling[hit];
+	if (sampling.z > 0.0) {
+		color = vec3(0.0);
+		return;
+	}
+	// Neighbouring pixels may hit other walls, so the gradients are of the neighbouring rays
+	// on this wall's plane, where they are smooth, rather than of hitUV
+	float unused;
+	vec2 scale = sampling.xw;
+	vec2 uv = bandUV(hitUV, bandEdges[hit], bandPacked[hit]) * scale;
+	vec2 uvDx = bandUV(wallUV(hit, origin + originDx, direction + directionDx, unused), bandEdges[hit], bandPacked[hit]) * scale - uv;
+	vec2 uvDy = bandUV(wallUV(hit, origin + originDy, direction + directionDy, unused), bandEdges[hit], bandPacked[hit]) * scale - uv;
+	vec4 wall = textureGrad(renderedTextures, vec3(uv, sampling.y), uvDx, uvDy);
+#ifdef ANALYTIC_SKY
+	color = mix(skyColor(worldPos), wall.rgb, wall.a);
+#else
+	color = wall.rgb;
+#endif
+}
@@ -0,0 +1,27 @@
+#version 330 core
+// The CAVE composite as one fullscreen triangle: no vertex attributes, the corners come from
+// gl_VertexID. wallRaycast.frag finds the wall each pixel looks at.
+
+// The camera of the draw, bound by CameraUniforms (frame -> eye -> wall)
+layout (std140) uniform Camera {
+	mat4 projection;
+	mat4 modelview;
+	// projection * modelview, so vertices need no matrix products of their own
+	mat4 viewProjection;
+	mat4 wallProjections[8];
+	vec4 eyePosition;
+};
+
+// The pixel's ray, from the near to the far plane, in world space before the divide. Both
+// are linear across the screen, so they interpolate.
+out vec4 rayNear;
+out vec4 rayFar;
+
+void main()
+{
+	vec2 ndc = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;
+	mat4 unproject = inverse(viewProjection);
+	rayNear = unproject * vec4(ndc, -1.0, 1.0);
+	rayFar = unproject * vec4(ndc, 1.0, 1.0);
+	gl_Position = vec4(ndc, 0.0, 1.0);
+}
@@ -0,0 +1,14 @@
+#version 330 core
+// The kept color where wallReproject.vert moved it
+
+uniform sampler2DArray sourceColor;
+uniform int layer;
+
+in vec2 sourceUV;
+
+out vec4 color;
+
+void main()
+{
+	color = texture(sourceColor, vec3(sourceUV, float(layer)));
+}
@@ -0,0 +1,31 @@
+#version 330 core
+// NOTE: Do NOT use any version older than 330! Bad things will happen!
+// A wall layer's kept image moved to where the eye is now (WallReprojection): a grid over
+// the kept layer, every vertex put back into the world by the depth under it and projected
+// again. Two triangles per cell, from gl_VertexID.
+
+uniform sampler2DArray sourceDepth;
+// New clip space from the kept one
+uniform mat4 reprojection;
+// Cells across the grid, texels across a cell, and the texels of the layer rendered
+uniform int cells;
+uniform int step;
+uniform int size;
+// The kept layer's part of the arrays
+uniform float sourceScale;
+uniform int layer;
+
+out vec2 sourceUV;
+
+void main()
+{
+	const ivec2 corners[6] = ivec2[6](ivec2(0, 0), ivec2(1, 0), ivec2(0, 1), ivec2(0, 1), ivec2(1, 0), ivec2(1, 1));
+	int cell = gl_VertexID / 6;
+	ivec2 vertex = ivec2(cell % cells, cell / cells) + corners[gl_VertexID % 6];
+	// Corners at the texels' edges, the depth of the texel inside the layer at each
+	ivec2 texel = min(vertex * step, ivec2(size));
+	float depth = texelFetch(sourceDepth, ivec3(min(texel, ivec2(size - 1)), layer), 0).r;
+	vec2 uv = vec2(texel) / float(size);
+	sourceUV = uv * sourceScale;
+	gl_Position = reprojection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+}
@@ -0,0 +1,57 @@
+#version 330 core
+// A wall layer at full size from its reduced, jittered render and the layer resolved the
+// frame before (WallTemporal)
+
+uniform sampler2DArray renderColor;
+uniform sampler2DArray renderDepth;
+uniform sampler2DArray history;
+uniform int layer;
+// How far the render's projection was moved this frame, in its texels
+uniform vec2 jitter;
+// The sides of the render and of the layer resolved
+uniform int renderSize;
+uniform int size;
+// The render's and the history's part of the arrays
+uniform float inputScale;
+uniform float historyScale;
+// The previous resolve's clip space from this one's
+uniform mat4 reprojection;
+uniform int historyValid;
+uniform float feedback;
+
+out vec4 color;
+
+void main()
+{
+	vec2 uv = gl_FragCoord.xy / float(size);
+	// Where this pixel's point landed in the render, which was drawn moved by the jitter
+	vec2 renderPosition = uv * float(renderSize) + jitter;
+	vec4 current = texture(renderColor, vec3(renderPosition / float(renderSize) * inputScale, float(layer)));
+	if (historyValid == 0) {
+		color = current;
+		return;
+	}
+
+	// The render's colors around the point bound what the history may hold there
+	ivec2 texel = clamp(ivec2(renderPosition), ivec2(0), ivec2(renderSize - 1));
+	vec4 lo = current, hi = current;
+	for (int y = -1; y <= 1; y++) {
+		for (int x = -1; x <= 1; x++) {
+			vec4 neighbour = texelFetch(renderColor, ivec3(clamp(texel + ivec2(x, y), ivec2(0), ivec2(renderSize - 1)), layer), 0);
+			lo = min(lo, neighbour);
+			hi = max(hi, neighbour);
+		}
+	}
+
+	// Where the point was in the frame before's layer, by its depth and how the wall's
+	// matrix changed
+	float depth = texelFetch(renderDepth, ivec3(texel, layer), 0).r;
+	vec4 previous = reprojection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+	vec2 previousUV = previous.xy / previous.w * 0.5 + 0.5;
+	if (previous.w <= 0.0 || any(lessThan(previousUV, vec2(0.0))) || any(greaterThan(previousUV, vec2(1.0)))) {
+		color = current;
+		return;
+	}
+	vec4 past = clamp(texture(history, vec3(previousUV * historyScale, float(layer))), lo, hi);
+	color = mix(current, past, feedback);
+}
@@ -0,0 +1,10 @@
+#version 330 core
+// NOTE: Do NOT use any version older than 330! Bad things will happen!
+// One triangle over the whole viewport, for the temporal resolve of a wall layer
+// (WallTemporal)
+
+void main()
+{
+	vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,450 @@
+// Converts the PPM assets into texture cache files (.p3tc) with full mip chains.
+// Runs as a post-build step of this project over Project3-Assets, and can be run by hand:
+//
+//   TexCacheBuilder [--rgb] [--srgb] [--flip] [--force] <file or directory>...
+//   TexCacheBuilder --atlas <out.p3ta> [--atlas-size N] <file or directory>...
+//   TexCacheBuilder --tiles [--tile-size N] [--force] <file or directory>...
+//   TexCacheBuilder --archive <out.p3ar> [--rgb] [--srgb] [--flip] [--force] <file or directory>...
+//   TexCacheBuilder --delta <old.p3ar> <new.p3ar> <out.p3ad>
+//   TexCacheBuilder --apply <archive.p3ar> <delta.p3ad>
+//
+// Directories are searched recursively for *.ppm, *.qoi and *.pfm. A cache that is newer
+// than its source is left alone unless --force is given. PPMs and QOIs become BC1 caches and
+// PFMs, the HDR environments, BC6H caches; --rgb stores uncompressed RGB8 or half float RGB mips instead.
+// --srgb filters the 8-bit mips in linear light, for sources whose bytes are sRGB, and --flip
+// turns the sources upside down first, for cubemap faces stored the other way up.
+// --atlas instead packs all the sources onto the N square pages (1024 by default) of one
+// texture atlas, for many small prop textures that are drawn together. --tiles writes each
+// PPM's mip chain cut into N square tiles (256 by default) instead, a .p3vt for the faces of
+// a virtual environment (skybox.virtual) too big to upload whole.
+// --archive packs every file given, and every file in the directories given, into one asset
+// archive (AssetArchive.h) instead, the images as their texture caches, which are brought up
+// to date first; an image that cannot be decoded is left out of it, with a warning. Files
+// are stored under the paths they are given by, so run it from where the app runs and name
+// them as the app does, for a deployment:
+//
+//   cd Project3 && TexCacheBuilder --archive project3.p3ar ..\Project3-Assets project3.cfg *.vert *.geom *.frag *.comp
+//
+// --delta writes what a station with the old archive needs to get to the new one, only the
+// chunks of it that the old one does not have (AssetArchive.h), to be sent instead of the
+// whole archive. --apply brings an archive up to date with one; the app does the same with
+// assets.delta when it starts.
+
+#include <Windows.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "../Project3/AssetArchive.h"
+#include "../Project3/Image.h"
+#include "../Project3/PixelConvert.h"
+#include "../Project3/TextureCache.h"
+#include "../Project3/TextureAtlas.h"
+#include "../Project3/TiledTexture.h"
+
+static bool endsWith(const std::string& s, const char* suffix)
+{
+	size_t n = strlen(suffix);
+	return s.size() >= n && _stricmp(s.c_str() + s.size() - n, suffix) == 0;
+}
+
+static bool isImageSource(const std::string& path)
+{
+	return endsWith(path, ".ppm") || endsWith(path, ".qoi") || endsWith(path, ".pfm");
+}
+
+// The image sources under path, or with anyFile every file. A path with wildcards in its
+// file name is every file it matches.
+static void collectSources(const std::string& path, std::vector<std::string>& out, bool anyFile = false)
+{
+	WIN32_FIND_DATAA data;
+	size_t slash = path.find_last_of("\\/");
+	if (path.find_first_of("*?", slash == std::string::npos ? 0 : slash) != std::string::npos) {
+		HANDLE matches = FindFirstFileA(path.c_str(), &data);
+		if (matches == INVALID_HANDLE_VALUE) {
+			return;
+		}
+		std::string directory = slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+		do {
+			if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && (anyFile || isImageSource(data.cFileName))) {
+				out.push_back(directory + data.cFileName);
+			}
+		} while (FindNextFileA(matches, &data));
+		FindClose(matches);
+		return;
+	}
+	HANDLE find = FindFirstFileA((path + "\\*").c_str(), &data);
+	if (find == INVALID_HANDLE_VALUE) {
+		if (anyFile || isImageSource(path)) {
+			out.push_back(path);
+		}
+		return;
+	}
+	do {
+		std::string name = data.cFileName;
+		if (name == "." || name == "..") {
+			continue;
+		}
+		std::string child = path + "\\" + name;
+		if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+			collectSources(child, out, anyFile);
+		}
+		else if (anyFile || isImageSource(name)) {
+			out.push_back(child);
+		}
+	} while (FindNextFileA(find, &data));
+	FindClose(find);
+}
+
+// True if the cache exists and was built from exactly this version of the source
+static bool upToDate(const std::string& source, const std::string& cache, TexCacheFormat format)
+{
+	MappedFile file;
+	if (!file.open(cache.c_str()) || file.size() < sizeof(TexCacheHeader)) {
+		return false;
+	}
+	const TexCacheHeader* header = (const TexCacheHeader*)file.data();
+	uint64_t size, time;
+	sourceFileStamp(source.c_str(), size, time);
+	return header->magic == TEXCACHE_MAGIC && header->version == TEXCACHE_VERSION &&
+		header->format == format && header->sourceSize == size && header->sourceTime == time;
+}
+
+// The source's file name without directory and extension, which names it in an atlas
+static std::string sourceName(const std::string& source)
+{
+	size_t slash = source.find_last_of("\\/");
+	std::string name = slash == std::string::npos ? source : source.substr(slash + 1);
+	size_t dot = name.rfind('.');
+	return dot == std::string::npos ? name : name.substr(0, dot);
+}
+
+// The full range 8-bit pixels of a PPM or QOI source. They stay in ppm's mapping where they
+// can be used as they are, and are put in storage otherwise.
+static bool readRGB8(const std::string& source, PPMImage& ppm, std::vector<unsigned char>& storage,
+	const unsigned char*& pixels, int& width, int& height)
+{
+	if (isQOIPath(source.c_str())) {
+		QOIImage qoi;
+		if (!mapQOI(source.c_str(), qoi)) {
+			return false;
+		}
+		storage.resize((size_t)qoi.width * qoi.height * 3);
+		if (!decodeQOI(qoi, storage.data())) {
+			std::cerr << "error parsing qoi file, incomplete data in " << source << std::endl;
+			return false;
+		}
+		pixels = storage.data();
+		width = qoi.width;
+		height = qoi.height;
+		return true;
+	}
+	if (!mapPPM(source.c_str(), ppm)) {
+		return false;
+	}
+	pixels = ppm.pixels;
+	width = ppm.width;
+	height = ppm.height;
+	if (ppm.maxval != 255) {
+		storage.resize((size_t)ppm.width * ppm.height * 3);
+		expandPPMRange(ppm, storage.data());
+		pixels = storage.data();
+	}
+	return true;
+}
+
+// The same for a tiled file, which also has to have the tile size asked for
+static bool tiledUpToDate(const std::string& source, const std::string& tiled, uint32_t tileSize)
+{
+	MappedFile file;
+	if (!file.open(tiled.c_str()) || file.size() < sizeof(TexTiledHeader)) {
+		return false;
+	}
+	const TexTiledHeader* header = (const TexTiledHeader*)file.data();
+	uint64_t size, time;
+	sourceFileStamp(source.c_str(), size, time);
+	return header->magic == TEXTILED_MAGIC && header->version == TEXTILED_VERSION &&
+		header->tileSize == tileSize && header->sourceSize == size && header->sourceTime == time;
+}
+
+static int buildTiled(uint32_t tileSize, bool force, const std::vector<std::string>& sources)
+{
+	int failures = 0;
+	for (const std::string& source : sources) {
+		std::string tiled = tiledTexturePath(source);
+		if (isPFMPath(source.c_str())) {
+			std::cerr << "tiles are 8-bit, " << source << " is HDR" << std::endl;
+			failures++;
+			continue;
+		}
+		if (!force && tiledUpToDate(source, tiled, tileSize)) {
+			continue;
+		}
+		PPMImage image;
+		std::vector<unsigned char> expanded;
+		const unsigned char* pixels;
+		int width, height;
+		if (!readRGB8(source, image, expanded, pixels, width, height)) {
+			failures++;
+			continue;
+		}
+		uint64_t size, time;
+		sourceFileStamp(source.c_str(), size, time);
+		if (!writeTiledTexture(tiled.c_str(), pixels, width, height, tileSize, size, time)) {
+			std::cerr << "failed to write " << tiled << std::endl;
+			failures++;
+			continue;
+		}
+		uint64_t tiledSize, tiledTime;
+		sourceFileStamp(tiled.c_str(), tiledSize, tiledTime);
+		std::cout << source << " -> " << tiled << " (" << tiledSize / (1024 * 1024) << " MB)" << std::endl;
+	}
+	return failures ? 1 : 0;
+}
+
+static int buildAtlas(const std::string& atlas, uint32_t pageSize, const std::vector<std::string>& sources)
+{
+	std::vector<PPMImage> mapped(sources.size());
+	std::vector<std::vector<unsigned char>> expanded(sources.size());
+	std::vector<AtlasImage> images;
+	for (size_t i = 0; i < sources.size(); i++) {
+		PPMImage& image = mapped[i];
+		if (isPFMPath(sources[i].c_str())) {
+			std::cerr << "atlas pages are 8-bit, " << sources[i] << " is HDR" << std::endl;
+			return 1;
+		}
+		AtlasImage entry;
+		int width, height;
+		if (!readRGB8(sources[i], image, expanded[i], entry.rgb, width, height)) {
+			return 1;
+		}
+		entry.name = sourceName(sources[i]);
+		entry.width = (uint32_t)width;
+		entry.height = (uint32_t)height;
+		images.push_back(entry);
+	}
+	if (!writeTextureAtlas(atlas.c_str(), images, pageSize)) {
+		std::cerr << "failed to write " << atlas << std::endl;
+		return 1;
+	}
+	uint64_t size, time;
+	sourceFileStamp(atlas.c_str(), size, time);
+	std::cout << images.size() << " images -> " << atlas << " (" << size / 1024 << " KB)" << std::endl;
+	return 0;
+}
+
+// failed, if given, gets the sources that could not be cached
+static int buildCaches(bool uncompressed, bool srgb, bool flip, bool force, const std::vector<std::string>& sources,
+	std::vector<std::string>* failed = nullptr)
+{
+	int failures = 0;
+	uint64_t bytesIn = 0, bytesOut = 0;
+	for (const std::string& source : sources) {
+		std::string cache = textureCachePath(source);
+		bool hdr = isPFMPath(source.c_str());
+		TexCacheFormat format = hdr ? (uncompressed ? TEXCACHE_RGB16F : TEXCACHE_BC6H)
+			: (uncompressed ? TEXCACHE_RGB8 : TEXCACHE_BC1);
+		if (!force && upToDate(source, cache, format)) {
+			continue;
+		}
+
+		uint64_t size, time;
+		sourceFileStamp(source.c_str(), size, time);
+		bool written;
+		if (hdr) {
+			PFMImage image;
+			if (!mapPFM(source.c_str(), image)) {
+				failures++;
+				if (failed) {
+					failed->push_back(source);
+				}
+				continue;
+			}
+			std::vector<float> pixels((size_t)image.width * image.height * 3);
+			decodePFM(image, pixels.data());
+			if (flip) {
+				flipRows(reinterpret_cast<unsigned char*>(pixels.data()), (size_t)image.width * 3 * sizeof(float), image.height);
+			}
+			written = writeHdrTextureCache(cache.c_str(), pixels.data(), image.width, image.height, format, size, time);
+		}
+		else {
+			// Caches always hold the full 8-bit range
+			PPMImage image;
+			std::vector<unsigned char> expanded;
+			const unsigned char* pixels;
+			int width, height;
+			if (!readRGB8(source, image, expanded, pixels, width, height)) {
+				failures++;
+				if (failed) {
+					failed->push_back(source);
+				}
+				continue;
+			}
+			// A mapped PPM is read only, it is flipped in a copy
+			if (flip) {
+				if (pixels != expanded.data()) {
+					expanded.assign(pixels, pixels + (size_t)width * height * 3);
+				}
+				flipRows(expanded.data(), (size_t)width * 3, height);
+				pixels = expanded.data();
+			}
+			written = writeTextureCache(cache.c_str(), pixels, width, height, format, size, time, srgb);
+		}
+		if (!written) {
+			std::cerr << "failed to write " << cache << std::endl;
+			failures++;
+			if (failed) {
+				failed->push_back(source);
+			}
+			continue;
+		}
+
+		uint64_t cacheSize, cacheTime;
+		sourceFileStamp(cache.c_str(), cacheSize, cacheTime);
+		bytesIn += size;
+		bytesOut += cacheSize;
+		std::cout << source << " -> " << cache << " (" << size / 1024 << " KB -> " << cacheSize / 1024 << " KB)" << std::endl;
+	}
+
+	if (bytesIn) {
+		std::cout << "texture cache: " << bytesIn / (1024 * 1024) << " MB of source in "
+			<< bytesOut / (1024 * 1024) << " MB of cache" << std::endl;
+	}
+	return failures ? 1 : 0;
+}
+
+static int buildArchive(const std::string& archive, bool uncompressed, bool srgb, bool flip, bool force,
+	const std::vector<std::string>& paths)
+{
+	std::vector<std::string> files;
+	for (const std::string& path : paths) {
+		collectSources(path, files, true);
+	}
+	std::vector<std::string> images;
+	std::copy_if(files.begin(), files.end(), std::back_inserter(images), isImageSource);
+	// An input that cannot be decoded is left out rather than losing the whole archive
+	std::vector<std::string> failed;
+	buildCaches(uncompressed, srgb, flip, force, images, &failed);
+	for (const std::string& source : failed) {
+		std::cerr << source << " left out of " << archive << ", it could not be cached" << std::endl;
+	}
+
+	// A cache is in the directories as well as named for its source, and goes in once
+	std::vector<AssetArchiveFile> packed;
+	std::vector<std::string> names;
+	std::string archiveName = AssetArchive::entryName(archive);
+	uint64_t bytes = 0;
+	for (const std::string& file : files) {
+		if (std::find(failed.begin(), failed.end(), file) != failed.end()) {
+			continue;
+		}
+		std::string path = isImageSource(file) ? textureCachePath(file) : file;
+		std::string name = AssetArchive::entryName(path);
+		if (name == archiveName || std::find(names.begin(), names.end(), name) != names.end()) {
+			continue;
+		}
+		uint64_t size, time;
+		sourceFileStamp(path.c_str(), size, time);
+		bytes += size;
+		names.push_back(name);
+		packed.push_back({ path, path });
+	}
+	if (!writeAssetArchive(archive.c_str(), packed)) {
+		std::cerr << "failed to write " << archive << std::endl;
+		return 1;
+	}
+	uint64_t size, time;
+	sourceFileStamp(archive.c_str(), size, time);
+	std::cout << packed.size() << " files, " << bytes / (1024 * 1024) << " MB -> " << archive << " ("
+		<< size / (1024 * 1024) << " MB)" << std::endl;
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	bool uncompressed = false;
+	bool srgb = false;
+	bool flip = false;
+	bool force = false;
+	std::string archive;
+	std::string atlas;
+	uint32_t atlasSize = 1024;
+	bool tiles = false;
+	uint32_t tileSize = 256;
+	std::vector<std::string> sources;
+
+	if (argc == 5 && std::string(argv[1]) == "--delta") {
+		return writeAssetDelta(argv[2], argv[3], argv[4]) ? 0 : 1;
+	}
+	if (argc == 4 && std::string(argv[1]) == "--apply") {
+		return applyAssetDelta(argv[2], argv[3], std::cout) ? 0 : 1;
+	}
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--rgb") {
+			uncompressed = true;
+		}
+		else if (arg == "--srgb") {
+			srgb = true;
+		}
+		else if (arg == "--flip") {
+			flip = true;
+		}
+		else if (arg == "--force") {
+			force = true;
+		}
+		else if (arg == "--archive" && i + 1 < argc) {
+			archive = argv[++i];
+		}
+		else if (arg == "--atlas" && i + 1 < argc) {
+			atlas = argv[++i];
+		}
+		else if (arg == "--atlas-size" && i + 1 < argc) {
+			atlasSize = (uint32_t)atoi(argv[++i]);
+		}
+		else if (arg == "--tiles") {
+			tiles = true;
+		}
+		else if (arg == "--tile-size" && i + 1 < argc) {
+			tileSize = (uint32_t)atoi(argv[++i]);
+		}
+		else {
+			sources.push_back(arg);
+		}
+	}
+
+	if (sources.empty()) {
+		std::cerr << "usage: TexCacheBuilder [--rgb] [--srgb] [--flip] [--force] <file or directory>..." << std::endl
+			<< "       TexCacheBuilder --atlas <out.p3ta> [--atlas-size N] <file or directory>..." << std::endl
+			<< "       TexCacheBuilder --tiles [--tile-size N] [--force] <file or directory>..." << std::endl
+			<< "       TexCacheBuilder --archive <out.p3ar> [--rgb] [--srgb] [--flip] [--force] <file or directory>..." << std::endl
+			<< "       TexCacheBuilder --delta <old.p3ar> <new.p3ar> <out.p3ad>" << std::endl
+			<< "       TexCacheBuilder --apply <archive.p3ar> <delta.p3ad>" << std::endl;
+		return 1;
+	}
+	if (!archive.empty()) {
+		return buildArchive(archive, uncompressed, srgb, flip, force, sources);
+	}
+	// The image sources of the files and directories given
+	std::vector<std::string> paths;
+	paths.swap(sources);
+	for (const std::string& path : paths) {
+		collectSources(path, sources);
+	}
+	if (sources.empty()) {
+		std::cerr << "no .ppm, .qoi or .pfm sources found" << std::endl;
+		return 1;
+	}
+	if (!atlas.empty()) {
+		return buildAtlas(atlas, atlasSize, sources);
+	}
+	if (tiles) {
+		return buildTiled(tileSize, force, sources);
+	}
+
+	return buildCaches(uncompressed, srgb, flip, force, sources);
+}